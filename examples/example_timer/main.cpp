@@ -13,6 +13,10 @@
  * - TIM14 - Periodic callback every 500ms to toggle LED pattern
  *
  * Note: PA7 is shared with I2C3_SCL. Don't use I2C3 if using this PWM output.
+ *
+ * TIM2 and TIM3 are PWM outputs here, so project.yaml leaves us_timers
+ * unset: InitMicrosecondTiming() then takes no timer on the G0 and
+ * GetCurrentTimeUs() counts in milliseconds.
  */
 #include "lumos.h"
 #include "lumos_micro_brain.h"
@@ -45,7 +49,7 @@ void periodicCallback()
  */
 void setup(void)
 {
-    // Initialize timing system
+    // Initialize timing system (no timers taken without us_timers)
     InitMicrosecondTiming();
 
     // Configure status LED
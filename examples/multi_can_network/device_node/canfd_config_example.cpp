@@ -38,18 +38,18 @@ void setup(void)
     // - Seg2: 2 time quanta
     // - Total: 8 time quanta per bit
 
-    CAN1.begin(1000000);  // Start with 1 Mbps nominal (sets base configuration)
-    
+    // The setters only stage the configuration, begin() applies it once
     CAN1.enableFD(true)  // Enable CAN FD with Bit Rate Switching (BRS)
         .setNominalBitrate(5, 13, 2)   // 1 Mbps nominal for arbitration
         .setDataBitrate(2, 5, 2);      // 5 Mbps data rate for data phase
+    CAN1.begin();
 
     // Alternative: Different nominal/data rates
     // For 500 kbps nominal, 5 Mbps data:
-    // CAN1.begin(500000);
     // CAN1.enableFD(true)
     //     .setNominalBitrate(10, 13, 2)  // 500 kbps nominal
     //     .setDataBitrate(2, 5, 2);      // 5 Mbps data
+    // CAN1.begin();
 
     CAN1.setAcceptAll();  // Accept all messages
 }
@@ -6,9 +6,12 @@
  * - Initializing FDCAN peripheral on STM32G0
  * - Sending periodic counter messages (50ms period)
  * - Receiving messages and echoing them back
+ * - Queueing transmissions so bursts are not lost when the TX FIFO is full
+ * - Receiving firmware updates over CAN FD (lumos can-update), together
+ *   with every other node on the bus
  *
  * CAN Configuration:
- * - Bitrate: 500 kbps (standard CAN)
+ * - CAN FD: 1 Mbps nominal, 5 Mbps data
  * - TX ID: 0x100 (counter messages)
  * - RX ID: 0x200 (echo request)
  * - TX Echo ID: 0x201 (echo response)
@@ -22,6 +25,8 @@
  * Network Protocol:
  * - Device sends counter (4 bytes, little-endian) on 0x100 every 50ms
  * - Device listens on 0x200, echoes received data back on 0x201
+ * - Firmware update frames (can_update.h) are stored in flash bank 2, below
+ *   the settings pages; node address NODE_ID
  */
 
 #include "lumos.h"
@@ -29,6 +34,8 @@
 #include "stm32g0xx_hal_fdcan.h"  // Force FDCAN HAL module detection
 #include "sys.h"
 #include "gpio.h"
+#include "can_update.h"
+#include <cstring>
 
 // Status LED for visual feedback
 GPIO status_led(GPIOD, GPIO_PIN_2);
@@ -45,6 +52,93 @@ const uint32_t TX_COUNTER_ID = 0x100;  // Periodic counter messages
 const uint32_t RX_ECHO_ID = 0x200;     // Echo request ID
 const uint32_t TX_ECHO_ID = 0x201;     // Echo response ID
 
+// Frames waiting for the FDCAN TX FIFO (fed from the TX complete interrupt)
+CANFrame tx_queue[16];
+
+// Received frames, queued from the FDCAN interrupt so a firmware update
+// keeps arriving while flash is being programmed
+CANFrame rx_queue[64];
+
+// FDCAN1 interrupt line 0 (shared with TIM16 on the STM32G0)
+extern "C" void TIM16_FDCAN_IT0_IRQHandler(void) { CAN1.handleInterrupt(); }
+
+// ===== Firmware Update over CAN FD =====
+// Address of this board for `lumos can-update --nodes`; unique on the bus
+const uint8_t NODE_ID = 1;
+
+// Bank 2 of the 128 KB flash (0x08010000, pages from 256) holds a
+// downloaded image, up to the settings store's pages at 0x0801E000. The
+// linker script gives the application 120 KB, so with staging it has to
+// stay in bank 1; begin() refuses while it does not. Installing the image
+// over the application is left to a bootloader; this only stages and
+// checks it.
+extern "C" uint8_t _sidata[], _sdata[], _edata[];
+
+class FlashStaging
+{
+public:
+    static constexpr uint32_t BASE = FLASH_BASE + 64 * 1024;
+    static constexpr uint32_t SIZE = 0x0801E000 - BASE;
+    static constexpr uint32_t FIRST_PAGE = 256;
+
+    bool staged() const { return staged_; }
+
+    uint32_t capacity() { return SIZE; }
+
+    bool begin(uint32_t size)
+    {
+        staged_ = false;
+        // The end of the image is that of the .data initializers
+        const uint32_t image_end = reinterpret_cast<uint32_t>(_sidata) + (_edata - _sdata);
+        if (image_end > BASE || size > SIZE) {
+            return false;
+        }
+        FLASH_EraseInitTypeDef erase = {};
+        erase.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase.Banks = FLASH_BANK_2;
+        erase.Page = FIRST_PAGE;
+        erase.NbPages = (size + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+        uint32_t failed_page = 0;
+        HAL_FLASH_Unlock();
+        const bool ok = HAL_FLASHEx_Erase(&erase, &failed_page) == HAL_OK;
+        HAL_FLASH_Lock();
+        return ok;
+    }
+
+    bool write(uint32_t offset, const uint8_t* data, uint8_t length)
+    {
+        // Double words; the end of the last one stays erased
+        HAL_FLASH_Unlock();
+        bool ok = true;
+        for (uint8_t i = 0; ok && i < length; i += 8) {
+            uint64_t word = UINT64_MAX;
+            memcpy(&word, data + i, length - i < 8 ? length - i : 8);
+            ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, BASE + offset + i, word) == HAL_OK;
+        }
+        HAL_FLASH_Lock();
+        return ok;
+    }
+
+    bool read(uint32_t offset, uint8_t* data, uint8_t length)
+    {
+        memcpy(data, reinterpret_cast<const uint8_t*>(BASE + offset), length);
+        return true;
+    }
+
+    // Only an image whose flash copy matches the announced CRC is staged
+    bool finish(uint32_t size, uint32_t crc)
+    {
+        staged_ = size <= SIZE && Crc32(0, reinterpret_cast<const void*>(BASE), size) == crc;
+        return staged_;
+    }
+
+private:
+    bool staged_ = false;
+};
+
+FlashStaging staging;
+CANUpdateTarget<FlashStaging> update(CAN1, staging, NODE_ID);
+
 // Statistics
 uint32_t messages_sent = 0;
 uint32_t messages_received = 0;
@@ -79,13 +173,23 @@ void setup(void)
 
     // Configuration Option 2: CAN FD with 5 Mbps data rate
     // Uncomment the following to enable CAN FD mode:
-    CAN1.begin(1000000);  // 1 Mbps nominal bitrate for arbitration
     CAN1.enableFD(true)   // Enable CAN FD with Bit Rate Switching
         .setNominalBitrate(5, 13, 2)   // 1 Mbps nominal (80MHz / (5 * 16))
         .setDataBitrate(2, 5, 2);      // 5 Mbps data rate (80MHz / (2 * 8))
+    CAN1.begin();  // Applies the settings above
+
+    // Queue transmissions instead of failing when the 3 hardware TX
+    // buffers are busy
+    CAN1.beginTxQueue(tx_queue, 16, TIM16_FDCAN_IT0_IRQn);
+    CAN1.beginRxInterrupt(rx_queue, 64, TIM16_FDCAN_IT0_IRQn);
 
-    // Configure receive filter to accept messages with ID 0x200
-    CAN1.setFilter(RX_ECHO_ID, 0x7FF, false);  // Standard ID, exact match
+    // Accept echo requests (0x200) and firmware update traffic
+    static const CANFilter filters[] = {
+        CANFilter::exact(RX_ECHO_ID),
+        CANUpdateTarget<FlashStaging>::controlFilter(),
+        CANUpdateTarget<FlashStaging>::dataFilter(),
+    };
+    CAN1.setFilters(filters, 3);
 
     // Alternatively, to accept all messages:
     // CAN1.setAcceptAll();
@@ -130,32 +234,33 @@ void loop(void)
     }
 
     // ===== Receive and Echo Messages =====
-    if (CAN1.available()) {
-        uint32_t rx_id;
-        uint8_t rx_data[8];
-        uint8_t rx_length;
-        bool rx_extended;
-
-        // Read received message
-        if (CAN1.read(rx_id, rx_data, rx_length, rx_extended)) {
-            messages_received++;
-
-            // Check if this is an echo request
-            if (rx_id == RX_ECHO_ID) {
-                // Echo the message back on TX_ECHO_ID
-                if (CAN1.send(TX_ECHO_ID, rx_data, rx_length, rx_extended)) {
-                    messages_echoed++;
-                    
-                    // Toggle LED to indicate echo
-                    status_led.toggle();
-                    DelayMs(1);  // Brief visual indicator
-                }
+    CANFrame frame;
+    while (CAN1.read(frame)) {
+        // Firmware update frames are stored and answered by the target
+        if (update.handle(frame)) {
+            continue;
+        }
+        messages_received++;
+
+        // Check if this is an echo request
+        if (frame.id == RX_ECHO_ID) {
+            // Echo the message back on TX_ECHO_ID
+            if (CAN1.send(TX_ECHO_ID, frame.data, frame.length, frame.extended)) {
+                messages_echoed++;
+
+                // Toggle LED to indicate echo
+                status_led.toggle();
             }
         }
     }
 
+    // A checked image is staged: keep the LED on
+    if (staging.staged()) {
+        status_led.high();
+    }
+
     // Turn off LED after send pulse
-    if (status_led.read()) {
+    else if (status_led.read()) {
         DelayMs(1);
         status_led.low();
     }
@@ -185,6 +290,12 @@ void loop(void)
  * - Same data length as received
  * - Sent immediately after receiving echo request
  *
+ * Firmware Update (see can_update.h):
+ * - Data: extended IDs 0x1F000000 + frame number, 64 bytes each
+ * - Control: 0x7E0 (BEGIN, QUERY, COMMIT, ABORT)
+ * - Status: 0x780 + NODE_ID, the frames received of a 16 KB block
+ * - `lumos can-update <gateway port> --nodes 1-20` through device_reader
+ *
  * Example Usage:
  * 1. Connect two or more LumosMicroBrain boards via CAN bus
  * 2. All devices send counter messages on 0x100
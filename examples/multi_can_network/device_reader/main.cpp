@@ -7,8 +7,13 @@
  * - Reading counter messages from device_node on ID 0x100
  * - Reading echo response messages on ID 0x201
  * - Outputting all received CAN data to USB serial (SerialPgm)
+ * - Reporting bus statistics and echo round-trip latency once per second
+ *   (view them with `lumos can-stats`)
+ * - Acting as a binary CAN bridge for `lumos can` (sniff, record, replay)
+ *   and the gateway of `lumos can-update` (firmware to many nodes at once)
  *
  * Network Protocol:
+ * - CAN FD, 1 Mbps nominal / 5 Mbps data (must match every node)
  * - TX: Echo requests on 0x200 every 100ms (triggers device_node echo)
  * - RX: Counter messages on 0x100 from device_node (50ms period)
  * - RX: Echo responses on 0x201 from device_node (echoed data)
@@ -19,6 +24,7 @@
  * - CAN_TX: PB11
  * - CAN_RX: PB12
  * - USB: PA11 (D-), PA12 (D+)
+ * - SerialPgm runs at 1 Mbaud so the binary bridge keeps up with a busy bus
  * - Status LED: PD2
  */
 
@@ -28,6 +34,7 @@
 #include "stm32g0xx_hal_uart.h"   // Force UART HAL module detection
 #include "sys.h"
 #include "gpio.h"
+#include "can_bridge.h"
 
 // Status LED for visual feedback
 GPIO status_led(GPIOD, GPIO_PIN_2);
@@ -50,6 +57,30 @@ uint32_t counter_messages_received = 0;
 uint32_t echo_responses_received = 0;
 uint32_t last_received_counter = 0;
 
+// Round-trip latency of echo requests, measured with the FDCAN timestamp
+// counter (send time vs. reception time of the echo response)
+uint16_t echo_sent_timestamp = 0;
+uint32_t echo_sent_value = 0;
+uint32_t latency_count = 0;
+uint32_t latency_min_us = 0;
+uint32_t latency_max_us = 0;
+uint64_t latency_sum_us = 0;
+
+uint64_t last_stats_time = 0;
+const uint32_t STATS_PERIOD_MS = 1000;
+
+// Serial speed, shared by the text output and the binary bridge
+const uint32_t SERIAL_BAUD = 1000000;
+
+// Received frames are queued from the FDCAN interrupt while the serial
+// port is busy; frames from the host queue for the bus the same way
+CANFrame rx_queue[64];
+CANFrame tx_queue[32];
+extern "C" void TIM16_FDCAN_IT0_IRQHandler(void) { CAN1.handleInterrupt(); }
+
+// Switched to binary mode by `lumos can`
+CANBridge<Serial> bridge(CAN1, SerialPgm);
+
 /**
  * @brief Setup function - called once at startup
  */
@@ -71,30 +102,31 @@ void setup(void)
     }
 
     // ===== Initialize USB Serial =====
-    SerialPgm.begin(115200);  // USB virtual COM port
+    SerialPgm.begin(SERIAL_BAUD);  // USB virtual COM port
     DelayMs(500);  // Wait for USB enumeration
 
     SerialPgm.println("=== CAN Network Reader Node ===");
     SerialPgm.println("Initializing...");
 
     // ===== Initialize CAN Bus =====
-    // Configuration Option 1: Classic CAN at 500 kbps (default, matches device_node)
-    CAN1.begin(500000);  // 500 kbps standard CAN
-
-    // Configuration Option 2: CAN FD with 5 Mbps data rate
-    // Uncomment to match device_node if it's configured for CAN FD:
-    /*
-    CAN1.begin(1000000);  // 1 Mbps nominal bitrate for arbitration
+    // CAN FD with 5 Mbps data rate, as device_node; firmware updates
+    // (lumos can-update) need FD for their 64-byte frames
     CAN1.enableFD(true)   // Enable CAN FD with Bit Rate Switching
         .setNominalBitrate(5, 13, 2)   // 1 Mbps nominal (80MHz / (5 * 16))
         .setDataBitrate(2, 5, 2);      // 5 Mbps data rate (80MHz / (2 * 8))
-    */
+    CAN1.begin();  // Applies the settings above
+
+    // Classic CAN at 500 kbps instead (then set device_node the same;
+    // no firmware updates over CAN):
+    // CAN1.begin(500000);
 
     // Configure receive filter to accept messages from device_node
     // Accept both counter (0x100) and echo response (0x201)
     CAN1.setAcceptAll();  // Accept all messages for simplicity
+    CAN1.beginRxInterrupt(rx_queue, 64, TIM16_FDCAN_IT0_IRQn);
+    CAN1.beginTxQueue(tx_queue, 32, TIM16_FDCAN_IT0_IRQn);
 
-    SerialPgm.println("CAN initialized at 500 kbps");
+    SerialPgm.println("CAN FD initialized at 1 Mbps / 5 Mbps");
     SerialPgm.println("Listening on IDs: 0x100 (counter), 0x201 (echo response)");
     SerialPgm.println("Sending echo requests on ID: 0x200");
     SerialPgm.println();
@@ -117,6 +149,22 @@ void loop(void)
 {
     uint64_t current_time = GetCurrentTimeMs();
 
+    // ===== Binary Bridge (lumos can) =====
+    // Host packets: mode switch and frames to replay onto the bus
+    bridge.poll();
+    if (bridge.binary()) {
+        // Sniffer: forward every frame, no echo traffic or text output
+        CANFrame frame;
+        while (CAN1.read(frame)) {
+            bridge.forward(frame);
+        }
+        if (current_time - last_stats_time >= STATS_PERIOD_MS) {
+            last_stats_time = current_time;
+            bridge.sendDrops();
+        }
+        return;
+    }
+
     // ===== Periodic Echo Request Transmission (100ms) =====
     if (current_time - last_echo_request_time >= ECHO_REQUEST_PERIOD_MS) {
         last_echo_request_time = current_time;
@@ -129,6 +177,8 @@ void loop(void)
         data[3] = (echo_request_counter >> 24) & 0xFF;
 
         // Send echo request message
+        echo_sent_timestamp = CAN1.getTimestamp();
+        echo_sent_value = echo_request_counter;
         if (CAN1.send(TX_ECHO_REQUEST_ID, data, 4, false)) {
             echo_requests_sent++;
             echo_request_counter++;
@@ -140,13 +190,13 @@ void loop(void)
 
     // ===== Receive and Process CAN Messages =====
     if (CAN1.available()) {
-        uint32_t rx_id;
-        uint8_t rx_data[8];
-        uint8_t rx_length;
-        bool rx_extended;
+        CANFrame frame;
 
         // Read received message
-        if (CAN1.read(rx_id, rx_data, rx_length, rx_extended)) {
+        if (CAN1.read(frame)) {
+            const uint32_t rx_id = frame.id;
+            const uint8_t* rx_data = frame.data;
+            const uint8_t rx_length = frame.length;
 
             // Process counter message from device_node (ID 0x100)
             if (rx_id == RX_COUNTER_ID) {
@@ -183,6 +233,16 @@ void loop(void)
                                            ((uint32_t)rx_data[2] << 16) |
                                            ((uint32_t)rx_data[3] << 24);
 
+                    // Timestamps are 16-bit, the difference survives a wrap
+                    if (echoed_value == echo_sent_value) {
+                        const uint32_t latency_us =
+                            CAN1.timestampToMicros(frame.timestamp - echo_sent_timestamp);
+                        if (latency_count == 0 || latency_us < latency_min_us) latency_min_us = latency_us;
+                        if (latency_us > latency_max_us) latency_max_us = latency_us;
+                        latency_sum_us += latency_us;
+                        latency_count++;
+                    }
+
                     // Print to serial
                     SerialPgm.print("Echo Response: ");
                     SerialPgm.print(echoed_value);
@@ -204,6 +264,17 @@ void loop(void)
         }
     }
 
+    // ===== Statistics for `lumos can-stats` (1 s) =====
+    if (current_time - last_stats_time >= STATS_PERIOD_MS) {
+        last_stats_time = current_time;
+        CAN1.printStats(SerialPgm, 1);
+        if (latency_count > 0) {
+            SerialPgm.printf("@canlatency port=1 n=%u min_us=%u avg_us=%u max_us=%u\r\n",
+                             latency_count, latency_min_us,
+                             static_cast<uint32_t>(latency_sum_us / latency_count), latency_max_us);
+        }
+    }
+
     // Turn off LED after send pulse
     if (status_led.read()) {
         DelayMs(1);
@@ -238,18 +309,30 @@ void loop(void)
  * Serial Output Format:
  * - Counter messages: "Counter: 1234 (0x4d2)"
  * - Echo responses: "Echo Response: 5678 (0x162e) - Data: 2e 16 00 00"
+ * - Every second: "@canstats ..." and "@canlatency ..." lines, shown as
+ *   rates, bus load and round-trip latency by `lumos can-stats`
+ *
+ * Binary Bridge:
+ * - `lumos can <port>` switches the node to the binary framing described in
+ *   can_bridge.h and prints every frame on the bus with its timestamp
+ * - `lumos can <port> --record bus.log` saves them in candump log format
+ * - `lumos can replay bus.log <port>` sends a recording back onto the bus
+ *   with its original timing
+ * - `lumos can-update <port> --nodes 1-20` broadcasts build/firmware.bin
+ *   to the nodes through this board (see can_update.h); the queues above
+ *   let host frames wait for the bus and status replies for the port
  *
  * Example Usage:
  * 1. Flash device_node to one LumosMicroBrain board
  * 2. Flash device_reader to another LumosMicroBrain board
  * 3. Connect both boards to same CAN bus with proper termination
  * 4. Connect device_reader to PC via USB
- * 5. Open serial terminal at 115200 baud
+ * 5. Open serial terminal at 1000000 baud (lumos monitor <port> 1000000)
  * 6. Observe counter messages and echo responses
  *
  * Troubleshooting:
  * - No serial output: Check USB connection and serial terminal settings
  * - No counter messages: Verify device_node is running and connected
  * - No echo responses: Check CAN bus termination and wiring
- * - Mismatched data: Ensure both devices use same CAN bitrate
+ * - Mismatched data: Ensure both devices use same CAN bitrate and FD setting
  */
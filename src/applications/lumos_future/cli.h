@@ -10,6 +10,7 @@ namespace CLI {
 
 struct CommandContext {
     std::vector<std::string> args;
+    std::map<std::string, std::string> options;
     std::string working_directory;
 };
 
@@ -169,7 +169,8 @@ int AppCommand::CreateApp(const CLI::CommandContext& ctx) {
         source_file << "    // This is your main application loop\n\n";
         source_file << "    // TODO: Add your application logic here\n";
         source_file << "    // Example:\n";
-        source_file << "    // LogInfo(\"Step \" + std::to_string(GetStats().step_count));\n";
+        source_file << "    // LUMOS_LOG_MESSAGE(kStep, Info, \"Step %ld\");   // At namespace scope\n";
+        source_file << "    // Log(kStep, static_cast<int32_t>(GetStats().step_count));\n";
         source_file << "}\n\n";
         source_file << "void " << app_name << "App::DeInit() {\n";
         source_file << "    // Called once when the application is shutting down\n";
@@ -1,8 +1,15 @@
 #include "project_command.h"
 #include "../config/project_config.h"
+#include "builder.h"
+#include "lumos_root.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
@@ -18,17 +25,19 @@ std::string ProjectCommand::GetUsage() const {
 
 Subcommands:
   create <name>    Create a new Lumos project
-  build            Build the current project
+  build            Build every app, one firmware per target node
   clean            Clean build artifacts
   list             List all projects in workspace
 
 Options:
-  --target <mcu>   Specify target microcontroller
+  --target <name>  Build only the node of this target (host, LumosBrain, ...)
+  --jobs <n>       Parallel compile jobs (default: LUMOS_JOBS or all cores)
+  --profile <p>    Override each node's profile (debug, release, size, fast)
   --help           Show this help message
 
 Examples:
   lumos project create MyRobot
-  lumos project build --target stm32f407
+  lumos project build --target LumosBrain
   lumos project clean
 )";
 }
@@ -177,19 +186,248 @@ int ProjectCommand::BuildProject(const CLI::CommandContext& ctx) {
 
     std::cout << "Building project: " << config.GetProjectInfo().name << std::endl;
 
-    // TODO: Implement actual build logic
-    // For now, just create build directory and run cmake
-    fs::path build_path = fs::path(ctx.working_directory) / "build";
+    std::string lumos_root = GetLumosRoot();
+    if (lumos_root.empty()) {
+        std::cerr << "Error: Lumos installation not found (set LUMOS_ROOT)" << std::endl;
+        return 1;
+    }
+
+    auto option = [&ctx](const std::string& name) -> std::string {
+        auto it = ctx.options.find(name);
+        return it == ctx.options.end() ? "" : it->second;
+    };
+    std::string only_target = option("target");
+    unsigned int jobs = 0;
+    if (!option("jobs").empty()) {
+        try {
+            jobs = static_cast<unsigned int>(std::stoul(option("jobs")));
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid value '" << option("jobs") << "' for --jobs" << std::endl;
+            return 1;
+        }
+    }
+
+    // Every target is one node running all of its apps under one scheduler
+    std::map<std::string, std::vector<Config::ApplicationConfig>> nodes;
+    for (const auto& app : config.GetApplications()) {
+        if (only_target.empty() || app.target == only_target) {
+            nodes[app.target].push_back(app);
+        }
+    }
+    if (nodes.empty()) {
+        if (only_target.empty()) {
+            std::cerr << "Error: The project has no applications (add one with 'lumos app create')" << std::endl;
+        } else {
+            std::cerr << "Error: No applications target '" << only_target << "'" << std::endl;
+        }
+        return 1;
+    }
+
+    std::vector<std::string> node_dirs;
+    for (const auto& node : nodes) {
+        std::string node_dir;
+        if (!WriteNodeProject(ctx.working_directory, lumos_root, node.first, node.second, node_dir)) {
+            return 1;
+        }
+        node_dirs.push_back(node_dir);
+    }
+    std::cout << std::endl;
+
+    // One builder for all nodes: the HAL drivers of each board
+    // configuration are archived once into the shared library directory,
+    // and board, wrapper and framework objects compiled for one node are
+    // restored from the object cache for every other node with the same
+    // board configuration
+    Builder builder(lumos_root);
+    builder.SetJobs(jobs);
+    if (!option("profile").empty()) {
+        builder.SetProfile(option("profile"));
+    }
+
+    size_t index = 0;
+    std::vector<std::string> failed;
+    for (const auto& node : nodes) {
+        const std::string& node_dir = node_dirs[index++];
+        std::cout << "=== Node " << node.first << " (" << node.second.size() << " app"
+                  << (node.second.size() == 1 ? "" : "s") << ") ===" << std::endl;
+        if (!builder.Build(node_dir)) {
+            failed.push_back(node.first);
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "Built " << (nodes.size() - failed.size()) << " of " << nodes.size()
+              << " node(s)" << std::endl;
+    index = 0;
+    for (const auto& node : nodes) {
+        const std::string& node_dir = node_dirs[index++];
+        bool ok = std::find(failed.begin(), failed.end(), node.first) == failed.end();
+        std::cout << "  " << node.first << ": "
+                  << (ok ? fs::relative(node_dir, ctx.working_directory).string() + "/build" : "FAILED")
+                  << std::endl;
+    }
+    return failed.empty() ? 0 : 1;
+}
+
+std::string ProjectCommand::GetLumosRoot() {
+    std::vector<std::string> candidates;
+    if (const char* env = std::getenv("LUMOS_ROOT")) {
+        candidates.push_back(env);
+    }
+#ifdef LUMOS_ROOT_DIR
+    candidates.push_back(LUMOS_ROOT_DIR);
+#endif
+    for (const auto& candidate : candidates) {
+        if (Lumos::IsValidLumosRoot(candidate)) {
+            return candidate;
+        }
+    }
+    return "";
+}
 
-    if (!fs::exists(build_path)) {
-        fs::create_directories(build_path);
+std::string ProjectCommand::GetBoardName(const std::string& target) {
+    // Apps default to the native simulator
+    if (target == "host") {
+        return "Host";
+    }
+    return target;
+}
+
+bool ProjectCommand::WriteNodeProject(const std::string& project_dir,
+                                      const std::string& lumos_root,
+                                      const std::string& target,
+                                      const std::vector<Config::ApplicationConfig>& apps,
+                                      std::string& node_dir) {
+    fs::path resources = fs::path(lumos_root) / "src";
+    if (!fs::exists(resources / "toolchains")) {
+        resources = lumos_root;
+    }
+
+    // project.yaml names boards like LumosBrain; their directories are lumos_brain
+    std::string board = GetBoardName(target);
+    std::string board_dir;
+    for (size_t i = 0; i < board.length(); ++i) {
+        if (i > 0 && std::isupper(static_cast<unsigned char>(board[i])) &&
+            std::islower(static_cast<unsigned char>(board[i - 1]))) {
+            board_dir += '_';
+        }
+        board_dir += static_cast<char>(std::tolower(static_cast<unsigned char>(board[i])));
+    }
+    if (!fs::exists(resources / "boards" / board_dir)) {
+        std::cerr << "Error: Unknown target '" << target << "' (expected host or a board such as LumosBrain)" << std::endl;
+        return false;
+    }
+
+    // build/<target> is a generated lumos project whose sources are the
+    // apps' own files, so they are compiled in place
+    fs::path node_path = fs::path(project_dir) / "build" / target;
+    node_dir = node_path.string();
+
+    std::ostringstream yaml;
+    yaml << "# Generated by 'lumos project build' from lumos.json, do not edit\n";
+    yaml << "board: " << board << "\n";
+    yaml << "sources:\n";
+    yaml << "  - main.cpp\n";
+
+    std::ostringstream includes;
+    includes << "include_dirs:\n";
+    // Apps include <framework/application.h>
+    includes << "  - " << resources.string() << "\n";
+
+    for (const auto& app : apps) {
+        fs::path app_path = fs::path(project_dir) / "apps" / app.name;
+        if (!fs::exists(app_path)) {
+            std::cerr << "Error: Application directory apps/" << app.name << " not found" << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> sources;
+        std::error_code ec;
+        for (const auto& entry : fs::recursive_directory_iterator(app_path / "src", ec)) {
+            std::string extension = entry.path().extension().string();
+            if (entry.is_regular_file() && (extension == ".c" || extension == ".cpp")) {
+                sources.push_back(fs::relative(entry.path(), node_path).generic_string());
+            }
+        }
+        std::sort(sources.begin(), sources.end());
+        for (const auto& source : sources) {
+            yaml << "  - " << source << "\n";
+        }
+        includes << "  - " << fs::relative(app_path / "include", node_path).generic_string() << "\n";
+    }
+    yaml << includes.str();
+
+    // Apps run at the rate and priority lumos.json gives them
+    std::ostringstream main;
+    main << "// Generated by 'lumos project build' from lumos.json, do not edit\n";
+    main << "// Node " << target << ": ";
+    for (size_t i = 0; i < apps.size(); ++i) {
+        main << apps[i].name << (i + 1 < apps.size() ? ", " : "\n");
+    }
+    main << "\n";
+    main << "#include \"scheduler.h\"\n";
+    for (const auto& app : apps) {
+        main << "#include \"" << app.name << ".h\"\n";
+    }
+    main << "\n";
+    main << "static Lumos::Scheduler scheduler;\n";
+    for (const auto& app : apps) {
+        main << "static " << app.name << "::" << app.name << "App app_" << app.name << ";\n";
+    }
+    main << "\n";
+    main << "void setup()\n";
+    main << "{\n";
+    for (const auto& app : apps) {
+        main << "    app_" << app.name << ".SetUpdateRate(" << app.rate_hz << ");\n";
+        main << "    app_" << app.name << ".SetPriority(" << static_cast<int>(app.priority) << ");\n";
+        main << "    scheduler.Add(app_" << app.name << ");\n";
+    }
+    main << "    scheduler.Run();\n";
+    main << "}\n";
+    main << "\n";
+    main << "void loop()\n";
+    main << "{\n";
+    main << "}\n";
+
+    try {
+        fs::create_directories(node_path);
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "Error creating " << node_dir << ": " << e.what() << std::endl;
+        return false;
     }
 
-    std::cout << "Build functionality will be implemented in Phase 2" << std::endl;
-    std::cout << "For now, you can manually run:" << std::endl;
-    std::cout << "  cd build && cmake .. && make" << std::endl;
+    // Rewriting unchanged files would invalidate the node's cached build plan
+    if (!WriteIfChanged(node_path / "project.yaml", yaml.str()) ||
+        !WriteIfChanged(node_path / "main.cpp", main.str())) {
+        std::cerr << "Error: Failed to write node project " << node_dir << std::endl;
+        return false;
+    }
 
-    return 0;
+    std::cout << "  Node " << target << " (" << board << "): ";
+    for (size_t i = 0; i < apps.size(); ++i) {
+        std::cout << apps[i].name << (i + 1 < apps.size() ? ", " : "");
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+bool ProjectCommand::WriteIfChanged(const fs::path& path, const std::string& content) {
+    std::ifstream existing(path, std::ios::binary);
+    if (existing.is_open()) {
+        std::ostringstream ss;
+        ss << existing.rdbuf();
+        if (ss.str() == content) {
+            return true;
+        }
+    }
+    existing.close();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << content;
+    return static_cast<bool>(file);
 }
 
 int ProjectCommand::CleanProject(const CLI::CommandContext& ctx) {
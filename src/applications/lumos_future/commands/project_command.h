@@ -1,7 +1,10 @@
 #pragma once
 
 #include "../cli.h"
+#include "../config/project_config.h"
+#include <filesystem>
 #include <string>
+#include <vector>
 
 namespace Lumos {
 namespace Commands {
@@ -23,6 +26,23 @@ private:
     int ListProjects(const CLI::CommandContext& ctx);
 
     void PrintHelp();
+
+    // LUMOS_ROOT, else the tree this tool was built from; empty if neither
+    // has the boards and toolchains
+    static std::string GetLumosRoot();
+
+    // lumos.json target to project.yaml board (host is the Host simulator)
+    static std::string GetBoardName(const std::string& target);
+
+    // Generate build/<target>: a project for the lumos builder with the
+    // target's apps as sources and a main.cpp that schedules them
+    static bool WriteNodeProject(const std::string& project_dir,
+                                 const std::string& lumos_root,
+                                 const std::string& target,
+                                 const std::vector<Config::ApplicationConfig>& apps,
+                                 std::string& node_dir);
+
+    static bool WriteIfChanged(const std::filesystem::path& path, const std::string& content);
 };
 
 } // namespace Commands
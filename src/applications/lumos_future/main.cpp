@@ -59,6 +59,7 @@ int main(int argc, char** argv) {
     for (const auto& arg : parsed.args) {
         ctx.args.push_back(arg);
     }
+    ctx.options = parsed.options;
 
     // Execute command
     return cmd->Execute(ctx);
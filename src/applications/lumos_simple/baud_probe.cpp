@@ -0,0 +1,203 @@
+#include "baud_probe.h"
+#include "serial.h"
+#include "stm32_communicator.h"
+#include "token_log_decoder.h"
+#include <chrono>
+
+namespace Lumos {
+
+namespace {
+
+// Enough bytes to tell text from noise; more only makes detection slower
+const size_t kSampleBytes = 2048;
+const size_t kMinSampleBytes = 16;
+
+// A rate scoring this high is taken without trying the rest
+const double kAcceptScore = 0.97;
+// The best rate still has to score this high
+const double kMinScore = 0.85;
+
+bool IsTextByte(uint8_t byte) {
+    return (byte >= 0x20 && byte < 0x7F) || byte == '\t' || byte == '\n' || byte == '\r' || byte == 0x1B;
+}
+
+// Continuation bytes after a UTF-8 lead byte, -1 if it can't start a sequence
+int Utf8Continuations(uint8_t byte) {
+    if ((byte & 0xE0) == 0xC0 && byte >= 0xC2) {
+        return 1;
+    }
+    if ((byte & 0xF0) == 0xE0) {
+        return 2;
+    }
+    if ((byte & 0xF8) == 0xF0 && byte <= 0xF4) {
+        return 3;
+    }
+    return -1;
+}
+
+} // namespace
+
+const std::vector<int>& ConsoleBaudRates() {
+    static const std::vector<int> rates = {
+        115200, 921600, 1000000, 2000000, 460800, 230400, 57600, 38400, 19200, 9600
+    };
+    return rates;
+}
+
+const std::vector<int>& RomBootloaderBaudRates() {
+    // AN2606 only promises 115200; faster rates depend on the part and
+    // its clock, so they are found by trying
+    static const std::vector<int> rates = {921600, 460800, 230400, 115200};
+    return rates;
+}
+
+double ScoreConsoleSample(const uint8_t* data, size_t length) {
+    TokenLogParser parser;
+    size_t good = 0;
+    size_t bad = 0;
+    size_t frame = 0;       // Bytes of the frame in progress
+    size_t sequence = 0;    // Bytes of the UTF-8 sequence in progress
+    int continuations = 0;  // Still expected in it
+
+    for (size_t i = 0; i < length; i++) {
+        const uint8_t byte = data[i];
+        switch (parser.Feed(byte)) {
+            case TokenLogParser::Result::Pending:
+                frame++;
+                continue;
+            case TokenLogParser::Result::Frame:
+                good += frame + 1;
+                frame = 0;
+                continue;
+            case TokenLogParser::Result::Error:
+                bad += frame + 1;
+                frame = 0;
+                continue;
+            case TokenLogParser::Result::Text:
+                break;
+        }
+
+        if (continuations > 0) {
+            if ((byte & 0xC0) == 0x80) {
+                sequence++;
+                if (--continuations == 0) {
+                    good += sequence;
+                    sequence = 0;
+                }
+                continue;
+            }
+            bad += sequence;
+            sequence = 0;
+            continuations = 0;
+        }
+        if (IsTextByte(byte)) {
+            good++;
+        } else if (byte >= 0x80 && Utf8Continuations(byte) > 0) {
+            continuations = Utf8Continuations(byte);
+            sequence = 1;
+        } else {
+            bad++;
+        }
+    }
+
+    const size_t counted = good + bad;
+    return counted == 0 ? 0.0 : static_cast<double>(good) / counted;
+}
+
+bool DetectConsoleBaud(const std::string& port, const std::vector<int>& candidates, int listen_ms,
+                       const volatile bool& running, BaudDetection& result, std::string& error) {
+    result = BaudDetection();
+    if (candidates.empty()) {
+        error = "No baud rates to try";
+        return false;
+    }
+
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = candidates[0];
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    size_t total = 0;
+    int current = candidates[0];
+    std::vector<uint8_t> sample(kSampleBytes);
+    for (int baud : candidates) {
+        if (!running) {
+            break;
+        }
+        // A rate the adapter can't do can't be the console's either
+        if (baud != current) {
+            if (!serial.SetBaudRate(baud)) {
+                continue;
+            }
+            current = baud;
+        }
+        // Bytes received at the previous rate are not part of the sample
+        serial.Flush();
+
+        size_t length = 0;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(listen_ms);
+        while (running && length < sample.size()) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                break;
+            }
+            int bytes_read = serial.Read(sample.data() + length, sample.size() - length, static_cast<int>(left));
+            if (bytes_read < 0) {
+                error = port + ": " + serial.GetLastError();
+                return false;
+            }
+            length += static_cast<size_t>(bytes_read);
+        }
+        total += length;
+
+        if (length < kMinSampleBytes) {
+            continue;
+        }
+        const double score = ScoreConsoleSample(sample.data(), length);
+        if (score > result.score) {
+            result.baud_rate = baud;
+            result.bytes = length;
+            result.score = score;
+        }
+        if (score >= kAcceptScore) {
+            break;
+        }
+    }
+    serial.Close();
+
+    if (result.score >= kMinScore) {
+        return true;
+    }
+    if (!running) {
+        error = "Cancelled";
+    } else if (total == 0) {
+        error = "No output from " + port + " at any rate";
+    } else {
+        error = "Output from " + port + " looks like text at no rate";
+    }
+    return false;
+}
+
+int ConnectRomBootloader(SimpleSerial::STM32Communicator& comm, const std::string& port,
+                         const std::vector<int>& rates, std::string& error) {
+    for (int baud : rates) {
+        comm.Disconnect();
+        if (!comm.Connect(port, baud)) {
+            error = comm.GetLastError();
+            continue;
+        }
+        uint16_t pid = 0;
+        if (comm.EnterBootloader(true) && comm.ReadProductId(pid)) {
+            return baud;
+        }
+        error = comm.GetLastError();
+    }
+    comm.Disconnect();
+    return 0;
+}
+
+} // namespace Lumos
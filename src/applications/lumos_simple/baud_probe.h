@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SimpleSerial {
+class STM32Communicator;
+}
+
+namespace Lumos {
+
+/** Console rates DetectConsoleBaud() tries, most common first */
+const std::vector<int>& ConsoleBaudRates();
+
+/** Rates ConnectRomBootloader() tries, fastest first */
+const std::vector<int>& RomBootloaderBaudRates();
+
+/**
+ * @brief Share of @p data (0-1) that reads as console output
+ *
+ * Printable ASCII, tabs, line ends, ANSI escapes, complete UTF-8
+ * sequences and tokenized log frames that pass their CRC count as
+ * output. Bytes read at the wrong rate come out as control bytes, broken
+ * UTF-8 and frames that fail their CRC. A frame still open at the end of
+ * the sample counts for neither.
+ */
+double ScoreConsoleSample(const uint8_t* data, size_t length);
+
+struct BaudDetection {
+    int baud_rate = 0;      // Best rate, 0 if nothing was received
+    size_t bytes = 0;       // Received at that rate
+    double score = 0.0;     // ScoreConsoleSample() of those bytes
+};
+
+/**
+ * @brief Find the rate a device's console is sending at
+ *
+ * Listens for up to @p listen_ms at each rate in @p candidates, switching
+ * the rate on one open port so boards that reset on DTR reset at most
+ * once. Stops at the first rate whose output is clearly text; otherwise
+ * the best one wins if it is good enough. Only works while the firmware
+ * prints something.
+ *
+ * @param result Receives the best rate found, also when it is rejected
+ * @return false if no rate is convincing (@p error says why)
+ */
+bool DetectConsoleBaud(const std::string& port, const std::vector<int>& candidates, int listen_ms,
+                       const volatile bool& running, BaudDetection& result, std::string& error);
+
+/**
+ * @brief Connect @p comm to the STM32 ROM bootloader at the first rate that works
+ *
+ * The ROM bootloader times the first 0x7F after reset to pick its rate
+ * (AN3155), so every rate in @p rates gets a DTR reset, the sync and a
+ * GET_ID to check that bytes get through both ways. Rates the adapter
+ * rejects are skipped.
+ *
+ * @return The rate @p comm is left connected at, 0 if none worked
+ */
+int ConnectRomBootloader(SimpleSerial::STM32Communicator& comm, const std::string& port,
+                         const std::vector<int>& rates, std::string& error);
+
+} // namespace Lumos
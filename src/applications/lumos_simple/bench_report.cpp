@@ -0,0 +1,277 @@
+#include "bench_report.h"
+#include "interrupt_poll.h"
+#include "json_util.h"
+#include "serial.h"
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+// Changes of a cycle or two are pipeline and flash wait state noise
+const uint32_t kMinRegressionCycles = 2;
+
+uint32_t ToNumber(const std::map<std::string, std::string>& fields, const std::string& key) {
+    auto it = fields.find(key);
+    if (it == fields.end()) {
+        return 0;
+    }
+    try {
+        return static_cast<uint32_t>(std::stoul(it->second));
+    } catch (...) {
+        return 0;
+    }
+}
+
+std::string ToText(const std::map<std::string, std::string>& fields, const std::string& key) {
+    auto it = fields.find(key);
+    return it != fields.end() ? it->second : "";
+}
+
+bool IsRegression(const BenchResult& result, const BenchResult& baseline, double threshold_percent) {
+    if (result.IsSkipped() || baseline.IsSkipped() || result.min <= baseline.min) {
+        return false;
+    }
+    const uint32_t slower = result.min - baseline.min;
+    return slower >= kMinRegressionCycles && 100.0 * slower / std::max(baseline.min, 1u) > threshold_percent;
+}
+
+} // namespace
+
+bool BenchReport::Feed(const std::string& line) {
+    if (complete_) {
+        return false;
+    }
+
+    // The marker may follow other output on the same line
+    size_t start = line.find('@');
+    if (start == std::string::npos) {
+        return false;
+    }
+
+    std::istringstream ss(line.substr(start + 1));
+    std::string kind;
+    ss >> kind;
+    if (kind != "bench" && kind != "bench_skip" && kind != "bench_begin" && kind != "bench_done") {
+        return false;
+    }
+
+    std::map<std::string, std::string> fields;
+    std::string token;
+    while (ss >> token) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            continue;
+        }
+        fields[token.substr(0, equals)] = token.substr(equals + 1);
+    }
+
+    // A begin restarts the run: the host may connect partway through one
+    if (kind == "bench_begin") {
+        board_ = ToText(fields, "board");
+        results_.clear();
+        started_ = true;
+        return false;
+    }
+    if (!started_) {
+        return false;
+    }
+    if (kind == "bench_done") {
+        complete_ = true;
+        return true;
+    }
+
+    BenchResult result;
+    result.name = ToText(fields, "name");
+    if (result.name.empty()) {
+        return false;
+    }
+    if (kind == "bench_skip") {
+        result.skip_reason = ToText(fields, "reason");
+        if (result.skip_reason.empty()) {
+            result.skip_reason = "unknown";
+        }
+    } else {
+        result.count = ToNumber(fields, "n");
+        result.min = ToNumber(fields, "min");
+        result.avg = ToNumber(fields, "avg");
+        result.max = ToNumber(fields, "max");
+        result.clock_hz = ToNumber(fields, "clock");
+    }
+    results_.push_back(result);
+    return false;
+}
+
+const BenchResult* BenchReport::Find(const std::string& name) const {
+    for (const auto& result : results_) {
+        if (result.name == name) {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+bool BenchReport::Load(const std::string& path, std::string& error) {
+    try {
+        // JSON is a subset of YAML, so yaml-cpp reads the report directly
+        YAML::Node root = YAML::LoadFile(path);
+        board_ = root["board"] ? root["board"].as<std::string>() : "";
+        results_.clear();
+        for (const auto& node : root["results"]) {
+            BenchResult result;
+            result.name = node["name"].as<std::string>();
+            if (node["skipped"]) {
+                result.skip_reason = node["skipped"].as<std::string>();
+            } else {
+                result.count = node["n"].as<uint32_t>();
+                result.min = node["min"].as<uint32_t>();
+                result.avg = node["avg"].as<uint32_t>();
+                result.max = node["max"].as<uint32_t>();
+                result.clock_hz = node["clock"].as<uint32_t>();
+            }
+            results_.push_back(result);
+        }
+    } catch (const std::exception& e) {
+        error = path + ": " + e.what();
+        return false;
+    }
+    started_ = true;
+    complete_ = true;
+    return true;
+}
+
+bool BenchReport::Write(const std::string& path, std::string& error) const {
+    std::ostringstream ss;
+    ss << "{\n";
+    ss << "  \"board\": " << JsonString(board_) << ",\n";
+    ss << "  \"results\": [\n";
+    for (size_t i = 0; i < results_.size(); ++i) {
+        const BenchResult& result = results_[i];
+        ss << "    {\"name\": " << JsonString(result.name);
+        if (result.IsSkipped()) {
+            ss << ", \"skipped\": " << JsonString(result.skip_reason);
+        } else {
+            ss << ", \"n\": " << result.count << ", \"min\": " << result.min
+               << ", \"avg\": " << result.avg << ", \"max\": " << result.max
+               << ", \"clock\": " << result.clock_hz;
+        }
+        ss << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+    }
+    ss << "  ]\n";
+    ss << "}\n";
+
+    if (!WriteFileAtomically(path, ss.str())) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+void BenchReport::Print(std::ostream& out, const BenchReport* baseline, double threshold_percent) const {
+    char text[256];
+    out << "Board: " << board_ << std::endl;
+    if (baseline != nullptr && baseline->GetBoard() != board_) {
+        out << "Warning: baseline is from " << baseline->GetBoard() << std::endl;
+    }
+    snprintf(text, sizeof(text), "%-22s %6s %8s %8s %8s %9s", "benchmark", "n", "min", "avg", "max", "min ns");
+    out << text << (baseline != nullptr ? "  vs baseline" : "") << std::endl;
+
+    for (const auto& result : results_) {
+        if (result.IsSkipped()) {
+            snprintf(text, sizeof(text), "%-22s skipped (%s)", result.name.c_str(), result.skip_reason.c_str());
+            out << text << std::endl;
+            continue;
+        }
+
+        const double ns = result.clock_hz > 0 ? 1e9 * result.min / result.clock_hz : 0.0;
+        snprintf(text, sizeof(text), "%-22s %6u %8u %8u %8u %9.1f", result.name.c_str(),
+                 result.count, result.min, result.avg, result.max, ns);
+        out << text;
+
+        const BenchResult* before = baseline != nullptr ? baseline->Find(result.name) : nullptr;
+        if (before != nullptr && !before->IsSkipped()) {
+            const double change = before->min > 0
+                ? 100.0 * (static_cast<double>(result.min) - before->min) / before->min : 0.0;
+            snprintf(text, sizeof(text), "  %8u -> %+6.1f%%", before->min, change);
+            out << text;
+            if (before->clock_hz != result.clock_hz) {
+                out << " (clock changed)";
+            }
+            if (IsRegression(result, *before, threshold_percent)) {
+                out << "  <- regression";
+            }
+        } else if (baseline != nullptr) {
+            out << "  new";
+        }
+        out << std::endl;
+    }
+}
+
+std::vector<std::string> BenchReport::FindRegressions(const BenchReport& baseline, double threshold_percent) const {
+    std::vector<std::string> regressions;
+    for (const auto& result : results_) {
+        const BenchResult* before = baseline.Find(result.name);
+        if (before != nullptr && IsRegression(result, *before, threshold_percent)) {
+            regressions.push_back(result.name);
+        }
+    }
+    return regressions;
+}
+
+bool CollectBenchReport(const std::string& port, int baud_rate, double timeout_s,
+                        const volatile bool& running, BenchReport& report, std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::string partial;
+    uint8_t buffer[1024];
+    while (running && !report.IsComplete()) {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (timeout_s > 0 && elapsed >= timeout_s) {
+            break;
+        }
+
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+
+        const char* data = reinterpret_cast<const char*>(buffer);
+        const char* end = data + bytes_read;
+        while (data < end && !report.IsComplete()) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            partial.append(data, newline ? newline : end);
+            if (!newline) {
+                break;
+            }
+            report.Feed(partial);
+            partial.clear();
+            data = newline + 1;
+        }
+    }
+    serial.Close();
+
+    if (!report.IsComplete()) {
+        error = running ? "No complete benchmark run from " + port + " within " +
+                          std::to_string(static_cast<int>(timeout_s)) + " s"
+                        : "Interrupted";
+        return false;
+    }
+    return true;
+}
+
+} // namespace Lumos
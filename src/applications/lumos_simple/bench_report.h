@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One benchmark of an on-target run (lumos bench)
+ *
+ * Cycle counts are CPU cycles with the measurement overhead removed; see
+ * wrapper/bench.h for how the firmware takes them.
+ */
+struct BenchResult {
+    std::string name;
+    uint32_t count = 0;
+    uint32_t min = 0;
+    uint32_t avg = 0;
+    uint32_t max = 0;
+    uint32_t clock_hz = 0;
+    std::string skip_reason;    // Set if the board could not run it
+
+    bool IsSkipped() const { return !skip_reason.empty(); }
+};
+
+/**
+ * @brief Results of a wrapper benchmark run
+ *
+ * The firmware prints a complete run between "@bench_begin" and
+ * "@bench_done" lines:
+ *
+ *   @bench_begin board=LumosBrain
+ *   @bench name=gpio_write n=1000 min=4 avg=4 max=41 clock=550000000
+ *   @bench_skip name=spi_transfer_byte reason=no_spi_port
+ *   @bench_done board=LumosBrain
+ *
+ * Reports are saved as JSON and compared against a saved baseline on the
+ * minimum, which interrupts and cache misses can't inflate.
+ */
+class BenchReport {
+public:
+    /**
+     * @brief Add a console line
+     * @return true once the line completed a run
+     */
+    bool Feed(const std::string& line);
+
+    bool IsComplete() const { return complete_; }
+    const std::string& GetBoard() const { return board_; }
+    const std::vector<BenchResult>& GetResults() const { return results_; }
+    const BenchResult* Find(const std::string& name) const;
+
+    bool Load(const std::string& path, std::string& error);
+    bool Write(const std::string& path, std::string& error) const;
+
+    /**
+     * @brief Print the results as a table
+     * @param baseline Report to compare against (nullptr = no comparison)
+     * @param threshold_percent Slowdown of the minimum flagged as a regression
+     */
+    void Print(std::ostream& out, const BenchReport* baseline, double threshold_percent) const;
+
+    /**
+     * @brief Names of the benchmarks slower than @p baseline by more than
+     *        @p threshold_percent
+     */
+    std::vector<std::string> FindRegressions(const BenchReport& baseline, double threshold_percent) const;
+
+private:
+    std::string board_;
+    std::vector<BenchResult> results_;
+    bool started_ = false;
+    bool complete_ = false;
+};
+
+/**
+ * @brief Read @p port until a complete run is in @p report
+ *
+ * Gives up after @p timeout_s seconds or when @p running turns false.
+ */
+bool CollectBenchReport(const std::string& port, int baud_rate, double timeout_s,
+                        const volatile bool& running, BenchReport& report, std::string& error);
+
+} // namespace Lumos
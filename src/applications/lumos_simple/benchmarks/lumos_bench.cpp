@@ -0,0 +1,691 @@
+/**
+ * @file lumos_bench.cpp
+ * @brief Host-side throughput of the lumos tool itself
+ *
+ * Measures:
+ * - build/clean, build/clean_cached, build/noop: Builder on a generated
+ *   project (Host board by default, so no ARM toolchain is needed)
+ * - hal_detect/cold, hal_detect/cached: HALModuleDetector on a generated
+ *   project of many sources and headers, without and with its cache
+ * - startup/find_root, startup/find_root_cached: locating the Lumos tree
+ *   from the executable path, by searching and from the remembered root
+ * - flash/stm32_*: STM32Communicator against the emulated ROM bootloader
+ * - flash/lumos_*: LumosBootloader against the emulated Lumos bootloader,
+ *   stop-and-wait, windowed, windowed with LZ4 and windowed over a lossy link
+ * - monitor/stm32: bytes per second through the `lumos monitor` reader
+ *
+ * The devices are bootloader_emulator.h on a pseudo-terminal. By default
+ * they answer at once and the pty ignores the baud rate, so the flash and
+ * monitor figures are the protocol and host CPU cost alone, an upper bound
+ * for what a real link reaches. --line-rate, --latency-us and --loss model
+ * a cable instead.
+ *
+ * POSIX only. Usage:
+ *   lumos_bench [--filter TEXT] [--repetitions N] [--image-kb N]
+ *               [--board NAME] [--root DIR] [--line-rate] [--latency-us N]
+ *               [--loss PERCENT] [--seed N] [-o results.json]
+ */
+
+#include "bootloader_emulator.h"
+#include "builder.h"
+#include "hal_module_detector.h"
+#include "json_util.h"
+#include "lumos_root.h"
+#include "crc32.h"
+#include "lumos_bootloader.h"
+#include "stm32_communicator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace Lumos;
+using SimpleSerial::Crc32;
+using SimpleSerial::FirmwareData;
+using SimpleSerial::LumosBootloader;
+using SimpleSerial::STM32Communicator;
+
+#ifndef LUMOS_BENCH_ROOT
+#define LUMOS_BENCH_ROOT "."
+#endif
+
+namespace {
+
+struct Result {
+    std::string name;
+    int repetitions = 0;
+    double min_s = 0.0;
+    double mean_s = 0.0;
+    double bytes = 0.0;   // Processed per repetition, 0 = no rate
+    std::string error;
+};
+
+// Holds back std::cout while the tool prints its progress
+class QuietOutput {
+public:
+    QuietOutput() : saved_(std::cout.rdbuf(&captured_)) {}
+    ~QuietOutput() { std::cout.rdbuf(saved_); }
+
+    std::string GetText() const { return captured_.str(); }
+
+private:
+    std::stringbuf captured_;
+    std::streambuf* saved_;
+};
+
+std::string FormatSeconds(double seconds) {
+    char text[32];
+    if (seconds >= 1.0) {
+        snprintf(text, sizeof(text), "%.3f s", seconds);
+    } else if (seconds >= 1e-3) {
+        snprintf(text, sizeof(text), "%.3f ms", seconds * 1e3);
+    } else {
+        snprintf(text, sizeof(text), "%.1f us", seconds * 1e6);
+    }
+    return text;
+}
+
+std::string FormatRate(const Result& result) {
+    if (result.bytes <= 0.0 || result.min_s <= 0.0) {
+        return "";
+    }
+    char text[32];
+    const double rate = result.bytes / result.min_s;
+    if (rate >= 1024.0 * 1024.0) {
+        snprintf(text, sizeof(text), "%.2f MiB/s", rate / (1024.0 * 1024.0));
+    } else {
+        snprintf(text, sizeof(text), "%.1f KiB/s", rate / 1024.0);
+    }
+    return text;
+}
+
+void PrintResult(const Result& result) {
+    if (!result.error.empty()) {
+        printf("%-28s failed: %s\n", result.name.c_str(), result.error.c_str());
+    } else {
+        printf("%-28s %4d %12s %12s %14s\n", result.name.c_str(), result.repetitions,
+               FormatSeconds(result.min_s).c_str(), FormatSeconds(result.mean_s).c_str(),
+               FormatRate(result).c_str());
+    }
+    fflush(stdout);
+}
+
+// One timed call: a body may narrow the time down to the part it measures
+struct Run {
+    std::string error;
+    double seconds = -1.0;   // < 0 = the whole call
+};
+
+/**
+ * Times @p repetitions calls of @p body, each after @p setup (untimed).
+ * A body returning false ends the benchmark with its error.
+ */
+Result Measure(const std::string& name, int repetitions, double bytes,
+               const std::function<bool()>& setup,
+               const std::function<bool(Run&)>& body) {
+    Result result;
+    result.name = name;
+    result.bytes = bytes;
+    double total = 0.0;
+    for (int i = 0; i < repetitions; i++) {
+        if (setup && !setup()) {
+            result.error = "setup failed";
+            break;
+        }
+        Run run;
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = body(run);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!ok) {
+            result.error = run.error.empty() ? "failed" : run.error;
+            break;
+        }
+        if (run.seconds >= 0.0) {
+            seconds = run.seconds;
+        }
+        total += seconds;
+        result.min_s = result.repetitions == 0 ? seconds : std::min(result.min_s, seconds);
+        result.repetitions++;
+    }
+    if (result.repetitions > 0) {
+        result.mean_s = total / result.repetitions;
+    }
+    PrintResult(result);
+    return result;
+}
+
+bool WriteText(const fs::path& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+    return static_cast<bool>(out);
+}
+
+// Code-like firmware image: common instruction words mixed with literals,
+// so LZ4 gets roughly the ratio it does on a real binary
+std::vector<uint8_t> MakeImage(size_t size) {
+    static const uint32_t common[8] = {
+        0x4770BF00, 0xE92D4FF0, 0x46854616, 0x68DB2300,
+        0xF8D3B510, 0x00000000, 0x20004000, 0xBD10E8BD,
+    };
+    std::vector<uint8_t> image(size);
+    uint32_t state = 0x2545F491;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        state = state * 1664525u + 1013904223u;
+        const uint32_t word = (state >> 28) < 12 ? common[(state >> 24) & 7] : state;
+        memcpy(&image[i], &word, 4);
+    }
+    return image;
+}
+
+// ── Devices ──────────────────────────────────────────────────────────────────
+
+// Streams log lines into the tool, as a board running `lumos monitor` does
+class FakeConsole : public PtyEmulator {
+public:
+    FakeConsole(const EmulatorConfig& config, size_t bytes) : PtyEmulator(config), bytes_(bytes) {}
+    ~FakeConsole() override { Stop(); }
+
+    // Starts the output once the tool has configured the port
+    void Go() { go_ = true; }
+
+protected:
+    void Run() override {
+        while (!go_ && !stop_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::string block;
+        for (int i = 0; block.size() < 4096; i++) {
+            block += "[INFO] t=" + std::to_string(1000 + i) + " imu ax=0.012 ay=-0.981 az=0.034 temp=31.5\r\n";
+        }
+        size_t sent = 0;
+        while (!stop_ && sent < bytes_) {
+            const size_t length = std::min(block.size(), bytes_ - sent);
+            Send(reinterpret_cast<const uint8_t*>(block.data()), length);
+            if (!Drain()) {
+                return;
+            }
+            sent += length;
+        }
+    }
+
+private:
+    size_t bytes_;
+    std::atomic<bool> go_{false};
+};
+
+// ── Benchmarks ────────────────────────────────────────────────────────────────
+
+struct Options {
+    std::string filter;
+    int repetitions = 3;
+    size_t image_kb = 64;
+    std::string board = "Host";
+    std::string root = LUMOS_BENCH_ROOT;
+    std::string output;
+    EmulatorConfig device;
+};
+
+class Suite {
+public:
+    Suite(const Options& options, const fs::path& work) : options_(options), work_(work) {}
+
+    const std::vector<Result>& GetResults() const { return results_; }
+
+    void Add(const std::string& name, double bytes,
+             const std::function<bool()>& setup, const std::function<bool(Run&)>& body,
+             int repetitions = 0) {
+        if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+        results_.push_back(Measure(name, repetitions > 0 ? repetitions : options_.repetitions,
+                                   bytes, setup, body));
+    }
+
+    void AddBuilds() {
+        const fs::path project = work_ / "build_project";
+        fs::create_directories(project);
+        WriteText(project / "project.yaml", "board: " + options_.board + "\nprofile: release\n");
+        WriteText(project / "main.cpp",
+                  "#include \"lumos.h\"\n#include \"sys.h\"\n\n"
+                  "void setup(void)\n{\n}\n\n"
+                  "void loop(void)\n{\n    DelayMs(10);\n}\n");
+        const std::string project_dir = project.string();
+        const std::string cache_dir = (work_ / "object_cache").string();
+
+        auto build = [this, project_dir](bool cache, std::string& error) {
+            QuietOutput quiet;
+            Builder builder(options_.root);
+            if (!cache) {
+                builder.DisableObjectCache();
+            }
+            if (!builder.Build(project_dir)) {
+                std::cerr << quiet.GetText();
+                error = "build of " + options_.board + " failed (see stderr)";
+                return false;
+            }
+            return true;
+        };
+        auto clean = [project]() {
+            std::error_code ec;
+            fs::remove_all(project / "build", ec);
+            return !ec;
+        };
+
+        Add("build/clean", 0, clean, [&](Run& run) { return build(false, run.error); });
+
+        // The first clean build fills the cache, the timed ones fetch from it
+        setenv("LUMOS_CACHE_DIR", cache_dir.c_str(), 1);
+        bool warmed = false;
+        Add("build/clean_cached", 0,
+            [&]() {
+                std::string error;
+                if (!warmed && !(clean() && build(true, error))) {
+                    return false;
+                }
+                warmed = true;
+                return clean();
+            },
+            [&](Run& run) { return build(true, run.error); });
+        unsetenv("LUMOS_CACHE_DIR");
+
+        bool built = false;
+        Add("build/noop", 0,
+            [&]() {
+                std::string error;
+                built = built || build(false, error);
+                return built;
+            },
+            [&](Run& run) { return build(false, run.error); });
+    }
+
+    void AddHalDetection() {
+        const int kSources = 64;
+        const int kHeaders = 16;
+        static const char* const modules[] = {"uart", "spi", "i2c", "tim", "adc", "fdcan", "dma", "gpio"};
+
+        const fs::path project = work_ / "hal_project";
+        fs::create_directories(project);
+        for (int h = 0; h < kHeaders; h++) {
+            std::ostringstream header;
+            header << "#pragma once\n#include \"stm32h7xx_hal_" << modules[h % 8] << ".h\"\n";
+            if (h > 0) {
+                header << "#include \"driver_" << (h - 1) << ".h\"\n";
+            }
+            header << "\nint driver_" << h << "(void);\n";
+            WriteText(project / ("driver_" + std::to_string(h) + ".h"), header.str());
+        }
+
+        std::vector<std::string> sources;
+        for (int s = 0; s < kSources; s++) {
+            std::ostringstream source;
+            source << "#include <stdint.h>\n#include \"driver_" << (s % kHeaders) << ".h\"\n"
+                   << "#include \"driver_" << ((s * 7) % kHeaders) << ".h\"\n\n";
+            for (int line = 0; line < 200; line++) {
+                source << "static int value_" << line << " = " << line << ";   // filler\n";
+            }
+            sources.push_back("source_" + std::to_string(s) + ".cpp");
+            WriteText(project / sources.back(), source.str());
+        }
+
+        const std::string project_dir = project.string();
+        const std::string cache_file = (project / "include_cache").string();
+        auto detect = [sources, project_dir](const std::string& cache, std::string& error) {
+            HALModuleDetector detector;
+            if (detector.DetectModules(sources, project_dir, cache).empty()) {
+                error = "no modules detected";
+                return false;
+            }
+            return true;
+        };
+
+        Add("hal_detect/cold", 0, nullptr, [&](Run& run) { return detect("", run.error); });
+
+        bool warmed = false;
+        Add("hal_detect/cached", 0,
+            [&]() {
+                std::string error;
+                warmed = warmed || detect(cache_file, error);
+                return warmed;
+            },
+            [&](Run& run) { return detect(cache_file, run.error); });
+    }
+
+    void AddStartup() {
+        // A development tree with the executable four levels down, as the
+        // CMake build lays it out
+        const fs::path root = work_ / "lumos_tree";
+        fs::create_directories(root / "src" / "toolchains");
+        fs::create_directories(root / "src" / "boards");
+        const std::string executable = (root / "build" / "src" / "applications" / "lumos_simple" / "lumos").string();
+        const fs::path cache_dir = work_ / "root_cache";
+
+        // The environment variable would win over both
+        const char* env_root = std::getenv("LUMOS_ROOT");
+        const std::string saved_root = env_root != nullptr ? env_root : "";
+        unsetenv("LUMOS_ROOT");
+        setenv("LUMOS_CACHE_DIR", cache_dir.string().c_str(), 1);
+
+        auto find = [&](std::string& error) {
+            if (FindLumosRoot(executable) != root.string()) {
+                error = "root not found";
+                return false;
+            }
+            return true;
+        };
+        auto forget = [&]() {
+            std::error_code ec;
+            fs::remove_all(cache_dir, ec);
+            return !ec;
+        };
+
+        Add("startup/find_root", 0, forget, [&](Run& run) { return find(run.error); }, 100);
+        Add("startup/find_root_cached", 0, nullptr, [&](Run& run) { return find(run.error); }, 100);
+
+        if (!saved_root.empty()) {
+            setenv("LUMOS_ROOT", saved_root.c_str(), 1);
+        }
+        unsetenv("LUMOS_CACHE_DIR");
+    }
+
+    void AddStm32Flash() {
+        FirmwareData firmware;
+        firmware.start_address = Stm32RomEmulator::kFlashBase;
+        firmware.data = MakeImage(std::min(options_.image_kb * 1024, Stm32RomEmulator::kFlashSize));
+        const double bytes = static_cast<double>(firmware.Size());
+
+        Stm32RomEmulator rom(options_.device);
+        std::string error;
+        if (!rom.Start(error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return;
+        }
+
+        // One run over the protocol, connected as `lumos flash` connects
+        auto session = [&](bool streamed, const std::function<bool(STM32Communicator&)>& step,
+                           std::string& error) {
+            QuietOutput quiet;
+            STM32Communicator comm;
+            comm.SetStreamedWrites(streamed);
+            if (!comm.Connect(rom.GetPort(), 115200) || !comm.EnterBootloader(false) || !step(comm)) {
+                error = comm.GetLastError();
+                return false;
+            }
+            comm.Disconnect();
+            return true;
+        };
+        auto flash = [&](bool streamed, std::string& error) {
+            if (!session(streamed, [&](STM32Communicator& comm) { return comm.Flash(firmware, true); }, error)) {
+                return false;
+            }
+            if (rom.ReadFlash(firmware.start_address, firmware.Size()) != firmware.data) {
+                error = "flash contents differ";
+                return false;
+            }
+            return true;
+        };
+
+        Add("flash/stm32", bytes, nullptr, [&](Run& run) { return flash(false, run.error); });
+        Add("flash/stm32_streamed", bytes, nullptr, [&](Run& run) { return flash(true, run.error); });
+
+        // One page differs: compared in full, one page rewritten
+        Add("flash/stm32_delta_1_page", bytes,
+            [&]() {
+                std::vector<uint8_t> board = firmware.data;
+                board[board.size() / 2] ^= 0xFF;
+                rom.LoadFlash(firmware.start_address, board.data(), board.size());
+                return true;
+            },
+            [&](Run& run) {
+                return session(true, [&](STM32Communicator& comm) { return comm.FlashDelta(firmware); },
+                               run.error);
+            });
+
+        Add("flash/stm32_verify", bytes,
+            [&]() {
+                rom.LoadFlash(firmware.start_address, firmware.data.data(), firmware.Size());
+                return true;
+            },
+            [&](Run& run) {
+                return session(true, [&](STM32Communicator& comm) { return comm.Verify(firmware); },
+                               run.error);
+            });
+    }
+
+    void AddLumosFlash() {
+        const std::vector<uint8_t> image = MakeImage(options_.image_kb * 1024);
+        const double bytes = static_cast<double>(image.size());
+
+        struct Mode {
+            const char* name;
+            uint8_t window;
+            uint16_t chunk;
+            bool compression;
+            bool lazy_erase;
+            double loss_percent;   // < 0 = --loss
+        };
+        static const Mode modes[] = {
+            {"flash/lumos_stop_and_wait", 1, 256, false, true, -1.0},
+            {"flash/lumos_full_erase", 8, 1024, false, false, -1.0},   // Erase, then transfer
+            {"flash/lumos_windowed", 8, 1024, false, true, -1.0},
+            {"flash/lumos_windowed_lz4", 8, 1024, true, true, -1.0},
+            {"flash/lumos_windowed_lossy", 8, 1024, false, true, 5.0},   // About 1 in 20 chunks resent
+        };
+
+        for (const Mode& mode : modes) {
+            EmulatorConfig config = options_.device;
+            if (mode.loss_percent >= 0.0) {
+                config.loss_percent = mode.loss_percent;
+            }
+            std::unique_ptr<LumosBootloaderEmulator> device;
+            size_t sent = 0;
+            uint64_t corrupted = 0;
+            Add(mode.name, bytes,
+                [&]() {
+                    std::string error;
+                    device.reset(new LumosBootloaderEmulator(config));
+                    return device->Start(error);
+                },
+                [&](Run& run) {
+                    LumosBootloader loader;
+                    loader.SetWindowSize(mode.window);
+                    loader.SetChunkSize(mode.chunk);
+                    loader.SetCompression(mode.compression);
+                    loader.SetVerify(mode.window > 1);
+                    loader.SetLazyErase(mode.lazy_erase);
+                    // From START on, erase included; the reset and handshake before it are fixed delays
+                    std::chrono::steady_clock::time_point start;
+                    auto progress = [&](int percent, const std::string&) {
+                        if (percent == 15) {
+                            start = std::chrono::steady_clock::now();
+                        }
+                    };
+                    if (!loader.Flash(device->GetPort(), image, progress)) {
+                        run.error = loader.GetLastError();
+                        return false;
+                    }
+                    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    sent = loader.GetBytesSent();
+                    device->Stop();
+                    corrupted = device->GetStats().corrupted;
+                    if (device->GetStats().sessions != 1 || device->GetImage() != image) {
+                        run.error = "image differs";
+                        return false;
+                    }
+                    return true;
+                });
+            if (mode.compression && sent > 0) {
+                printf("%-28s %.1f%% of the image on the wire\n", "", 100.0 * sent / image.size());
+            }
+            if (corrupted > 0) {
+                printf("%-28s %llu chunks corrupted and resent\n", "", static_cast<unsigned long long>(corrupted));
+            }
+        }
+    }
+
+    void AddMonitor() {
+        const size_t kBytes = 16 * 1024 * 1024;
+        std::unique_ptr<FakeConsole> console;
+
+        Add("monitor/stm32", static_cast<double>(kBytes),
+            [&]() {
+                std::string error;
+                console.reset(new FakeConsole(options_.device, kBytes));
+                return console->Start(error);
+            },
+            [&](Run& run) {
+                STM32Communicator comm;
+                std::atomic<size_t> received{0};
+                if (!comm.Connect(console->GetPort(), 115200) ||
+                    !comm.StartMonitoring([&](const uint8_t*, size_t length) { received += length; })) {
+                    run.error = comm.GetLastError();
+                    return false;
+                }
+                const auto start = std::chrono::steady_clock::now();
+                console->Go();
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+                while (received < kBytes && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                comm.StopMonitoring();
+                comm.Disconnect();
+                console->Stop();
+                if (received < kBytes) {
+                    run.error = "received " + std::to_string(received) + " of " + std::to_string(kBytes) + " bytes";
+                    return false;
+                }
+                return true;
+            });
+    }
+
+private:
+    const Options& options_;
+    fs::path work_;
+    std::vector<Result> results_;
+};
+
+bool WriteResults(const std::string& path, const Options& options, const std::vector<Result>& results) {
+    std::ostringstream ss;
+    ss << "{\n";
+    ss << "  \"board\": " << JsonString(options.board) << ",\n";
+    ss << "  \"image_kb\": " << options.image_kb << ",\n";
+    ss << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        ss << "    {\"name\": " << JsonString(result.name);
+        if (!result.error.empty()) {
+            ss << ", \"error\": " << JsonString(result.error);
+        } else {
+            ss << ", \"repetitions\": " << result.repetitions << ", \"min_s\": " << result.min_s
+               << ", \"mean_s\": " << result.mean_s;
+            if (result.bytes > 0) {
+                ss << ", \"bytes_per_second\": " << static_cast<uint64_t>(result.bytes / result.min_s);
+            }
+        }
+        ss << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    ss << "  ]\n";
+    ss << "}\n";
+    return WriteFileAtomically(path, ss.str());
+}
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "  --filter TEXT       Only run benchmarks whose name contains TEXT" << std::endl;
+    std::cout << "  --repetitions N     Timed runs per benchmark (default: 3)" << std::endl;
+    std::cout << "  --image-kb N        Firmware image size for the flash benchmarks (default: 64)" << std::endl;
+    std::cout << "  --board NAME        Board of the build benchmarks (default: Host)" << std::endl;
+    std::cout << "  --root DIR          Lumos tree the builder uses (default: this source tree)" << std::endl;
+    std::cout << "  --line-rate         Pace the devices at the baud rate the tool sets" << std::endl;
+    std::cout << "  --latency-us N      Device reply latency (default: 0)" << std::endl;
+    std::cout << "  --loss PERCENT      Data packets the devices receive corrupted (default: 0)" << std::endl;
+    std::cout << "  --seed N            Loss pattern (default: 1)" << std::endl;
+    std::cout << "  -o FILE             Also write the results as JSON" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--repetitions" && has_value) {
+            options.repetitions = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--image-kb" && has_value) {
+            options.image_kb = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--board" && has_value) {
+            options.board = argv[++i];
+        } else if (arg == "--root" && has_value) {
+            options.root = argv[++i];
+        } else if (arg == "--line-rate") {
+            options.device.line_rate = true;
+        } else if (arg == "--latency-us" && has_value) {
+            options.device.latency_us = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--loss" && has_value) {
+            options.device.loss_percent = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--seed" && has_value) {
+            options.device.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-o" && has_value) {
+            options.output = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    std::error_code ec;
+    const fs::path work = fs::temp_directory_path(ec) / ("lumos_bench_" + std::to_string(getpid()));
+    fs::create_directories(work, ec);
+    if (ec) {
+        std::cerr << "Error: Cannot create " << work.string() << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    printf("%zu KiB images, %d repetitions, build board %s\n\n", options.image_kb,
+           options.repetitions, options.board.c_str());
+    if (options.device.line_rate || options.device.latency_us > 0 || options.device.loss_percent > 0) {
+        printf("Devices: %s, %u us latency, %.1f%% loss\n\n",
+               options.device.line_rate ? "line rate" : "unpaced", options.device.latency_us,
+               options.device.loss_percent);
+    }
+    printf("%-28s %4s %12s %12s %14s\n", "benchmark", "reps", "min", "mean", "rate (min)");
+
+    Suite suite(options, work);
+    suite.AddBuilds();
+    suite.AddHalDetection();
+    suite.AddStartup();
+    suite.AddStm32Flash();
+    suite.AddLumosFlash();
+    suite.AddMonitor();
+    fs::remove_all(work, ec);
+
+    bool failed = false;
+    for (const auto& result : suite.GetResults()) {
+        failed = failed || !result.error.empty();
+    }
+    if (!options.output.empty()) {
+        if (!WriteResults(options.output, options, suite.GetResults())) {
+            std::cerr << "Error: Failed to write " << options.output << std::endl;
+            return 1;
+        }
+        std::cout << "\nResults written to " << options.output << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,362 @@
+#include "board_pin_map.h"
+#include "json_util.h"
+#include <yaml-cpp/yaml.h>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+// Group keys that are settings rather than pins
+const char* const kGroupSettings[] = {"AF", "DMA_TX", "DMA_RX", "DMA_TX_IRQ", "DMA_RX_IRQ"};
+
+bool IsSetting(const std::string& key) {
+    for (const char* setting : kGroupSettings) {
+        if (key == setting) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsIdentifier(const std::string& name) {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+        return false;
+    }
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "PB12" -> port B, pin 12
+bool ParsePinName(const std::string& text, char& port, int& number) {
+    if (text.size() < 3 || text.size() > 4 || text[0] != 'P' || text[1] < 'A' || text[1] > 'K') {
+        return false;
+    }
+    number = 0;
+    for (size_t i = 2; i < text.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(text[i]))) {
+            return false;
+        }
+        number = number * 10 + (text[i] - '0');
+    }
+    port = text[1];
+    return number <= 15;
+}
+
+// "PB12" or "PB12_[PA10]" (PA10 can replace PB12)
+bool ParsePinKey(const std::string& key, BoardPin& pin) {
+    std::string primary = key;
+    pin.alternatives.clear();
+    size_t bracket = key.find("_[");
+    if (bracket != std::string::npos) {
+        if (key.back() != ']') {
+            return false;
+        }
+        primary = key.substr(0, bracket);
+        std::string list = key.substr(bracket + 2, key.size() - bracket - 3);
+        std::stringstream items(list);
+        std::string item;
+        while (std::getline(items, item, ',')) {
+            item.erase(0, item.find_first_not_of(' '));
+            item.erase(item.find_last_not_of(' ') + 1);
+            char port;
+            int number;
+            if (!ParsePinName(item, port, number)) {
+                return false;
+            }
+            pin.alternatives.push_back(item);
+        }
+    }
+    pin.name = primary;
+    return ParsePinName(primary, pin.port, pin.number);
+}
+
+// "USB DP" -> USB_DP, "RX, from CP_TX" -> RX
+std::string ToIdentifier(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        if (c == ',' || c == '(') {
+            break;
+        }
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            result += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        } else if (!result.empty() && result.back() != '_') {
+            result += '_';
+        }
+    }
+    while (!result.empty() && result.back() == '_') {
+        result.pop_back();
+    }
+    if (!result.empty() && std::isdigit(static_cast<unsigned char>(result[0]))) {
+        result = "P" + result;
+    }
+    return result;
+}
+
+std::string PinInitializer(const std::string& name, int af) {
+    char port;
+    int number;
+    ParsePinName(name, port, number);
+    return std::string("{GPIO") + port + "_BASE, GPIO_PIN_" + std::to_string(number) + ", " +
+           std::to_string(af < 0 ? 0 : af) + "}";
+}
+
+} // namespace
+
+bool BoardPinMap::Load(const std::string& path, std::string& error) {
+    source_ = path;
+    groups_.clear();
+
+    YAML::Node root;
+    try {
+        root = YAML::LoadFile(path);
+    } catch (const YAML::Exception& e) {
+        error = "Failed to parse " + path + ": " + e.what();
+        return false;
+    }
+    if (!root.IsMap()) {
+        return true;
+    }
+
+    for (const auto& entry : root) {
+        if (!entry.second.IsMap()) {
+            continue;
+        }
+        BoardPinGroup group;
+        group.key = entry.first.as<std::string>();
+        std::string where = path + ": " + group.key;
+
+        // Only maps with at least one pin key are pin groups
+        bool has_pins = false;
+        for (const auto& item : entry.second) {
+            BoardPin pin;
+            has_pins = has_pins || ParsePinKey(item.first.as<std::string>(), pin);
+        }
+        if (!has_pins) {
+            continue;
+        }
+
+        size_t bracket = group.key.find('[');
+        if (bracket != std::string::npos && group.key.back() == ']') {
+            group.connector = group.key.substr(bracket + 1, group.key.size() - bracket - 2);
+            group.identifier = ToIdentifier(group.key.substr(0, bracket)) + "_" + ToIdentifier(group.connector);
+        } else {
+            // FDCAN1, USB, ... alone would be expanded as the HAL's instance macros
+            group.identifier = ToIdentifier(group.key);
+            if (group.identifier.size() < 5 || group.identifier.compare(group.identifier.size() - 5, 5, "_PINS") != 0) {
+                group.identifier += "_PINS";
+            }
+        }
+
+        std::set<std::string> signals;
+        for (const auto& item : entry.second) {
+            std::string key = item.first.as<std::string>();
+            std::string value = item.second.IsScalar() ? item.second.as<std::string>() : "";
+            if (IsSetting(key)) {
+                if (key == "AF") {
+                    try {
+                        group.af = item.second.as<int>();
+                    } catch (const YAML::Exception&) {
+                        group.af = -1;
+                    }
+                    if (group.af < 0 || group.af > 15) {
+                        error = where + ": AF must be 0 to 15";
+                        return false;
+                    }
+                    continue;
+                }
+                if (!IsIdentifier(value)) {
+                    error = where + ": " + key + " must name a DMA stream or channel, e.g. DMA1_Stream0";
+                    return false;
+                }
+                (key == "DMA_TX" ? group.dma_tx : key == "DMA_RX" ? group.dma_rx :
+                 key == "DMA_TX_IRQ" ? group.dma_tx_irq : group.dma_rx_irq) = value;
+                continue;
+            }
+
+            BoardPin pin;
+            if (!ParsePinKey(key, pin)) {
+                error = where + ": '" + key + "' is not a pin (PA0..PK15)";
+                return false;
+            }
+            pin.signal = ToIdentifier(value);
+            if (pin.signal.empty()) {
+                pin.signal = pin.name;
+            }
+            if (IsSetting(pin.signal) || pin.signal == "pins" || !signals.insert(pin.signal).second) {
+                error = where + ": signal '" + pin.signal + "' is used twice";
+                return false;
+            }
+            group.pins.push_back(pin);
+        }
+        if (!group.dma_tx_irq.empty() && group.dma_tx.empty()) {
+            error = where + ": DMA_TX_IRQ without DMA_TX";
+            return false;
+        }
+        if (!group.dma_rx_irq.empty() && group.dma_rx.empty()) {
+            error = where + ": DMA_RX_IRQ without DMA_RX";
+            return false;
+        }
+        for (const auto& other : groups_) {
+            if (other.identifier == group.identifier) {
+                error = where + ": same name as " + other.key + " (" + group.identifier + ")";
+                return false;
+            }
+        }
+        groups_.push_back(group);
+    }
+
+    // A pin in two groups must be two uses of one connector
+    std::map<std::string, std::vector<const BoardPinGroup*>> users;
+    for (const auto& group : groups_) {
+        for (const auto& pin : group.pins) {
+            users[pin.name].push_back(&group);
+        }
+    }
+    for (const auto& user : users) {
+        const std::vector<const BoardPinGroup*>& groups = user.second;
+        for (size_t i = 1; i < groups.size(); ++i) {
+            if (groups[i]->connector.empty() || groups[i]->connector != groups[0]->connector) {
+                error = path + ": " + user.first + " is assigned to both " + groups[0]->key + " and " +
+                        groups[i]->key + " (groups may only share pins on the same [connector])";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string BoardPinMap::GenerateHeader() const {
+    std::map<std::string, std::vector<const BoardPinGroup*>> users;
+    for (const auto& group : groups_) {
+        for (const auto& pin : group.pins) {
+            users[pin.name].push_back(&group);
+        }
+    }
+
+    std::ostringstream out;
+    out << "// Generated by lumos from the board's " << fs::path(source_).filename().string()
+        << " - do not edit\n";
+    out << "#pragma once\n";
+    out << "\n";
+    out << "#include <cstddef>\n";
+    out << "#include <cstdint>\n";
+    out << "\n";
+    out << "// Uses the board's HAL for GPIOx_BASE and GPIO_PIN_x (lumos.h includes it)\n";
+    out << "namespace BoardPins {\n";
+    out << "\n";
+    out << "struct Pin {\n";
+    out << "    uintptr_t port_base;   // GPIOx_BASE, as FastPin<> takes it\n";
+    out << "    uint16_t pin;          // GPIO_PIN_x\n";
+    out << "    uint8_t af;            // Alternate function number, 0 without 'AF:'\n";
+    out << "\n";
+    out << "    GPIO_TypeDef* port() const { return reinterpret_cast<GPIO_TypeDef*>(port_base); }\n";
+    out << "};\n";
+    out << "\n";
+    out << "// True if two groups share a pin, for code that must not use both:\n";
+    out << "//   static_assert(!BoardPins::Overlap(BoardPins::A::pins, BoardPins::B::pins), \"...\");\n";
+    out << "template <size_t N, size_t M>\n";
+    out << "constexpr bool Overlap(const Pin (&a)[N], const Pin (&b)[M]) {\n";
+    out << "    for (size_t i = 0; i < N; i++) {\n";
+    out << "        for (size_t j = 0; j < M; j++) {\n";
+    out << "            if (a[i].port_base == b[j].port_base && a[i].pin == b[j].pin) {\n";
+    out << "                return true;\n";
+    out << "            }\n";
+    out << "        }\n";
+    out << "    }\n";
+    out << "    return false;\n";
+    out << "}\n";
+
+    for (const auto& group : groups_) {
+        out << "\n";
+        out << "// " << group.key << "\n";
+        std::map<std::string, std::set<std::string>> shared;  // other group -> pins
+        for (const auto& pin : group.pins) {
+            for (const BoardPinGroup* other : users[pin.name]) {
+                if (other != &group) {
+                    shared[other->key].insert(pin.name);
+                }
+            }
+        }
+        for (const auto& other : shared) {
+            out << "// Shares";
+            for (const auto& pin : other.second) {
+                out << " " << pin;
+            }
+            out << " with " << other.first << ": use one at a time\n";
+        }
+
+        out << "struct " << group.identifier << " {\n";
+        if (group.af >= 0) {
+            out << "    static constexpr uint8_t AF = " << group.af << ";\n";
+        }
+        for (const auto& pin : group.pins) {
+            out << "    static constexpr Pin " << pin.signal << " = " << PinInitializer(pin.name, group.af) << ";\n";
+            for (size_t i = 0; i < pin.alternatives.size(); ++i) {
+                out << "    static constexpr Pin " << pin.signal << "_ALT" << (i == 0 ? "" : std::to_string(i + 1))
+                    << " = " << PinInitializer(pin.alternatives[i], group.af) << ";\n";
+            }
+        }
+        if (!group.dma_tx.empty()) {
+            out << "    static constexpr uintptr_t DMA_TX = " << group.dma_tx << "_BASE;\n";
+            out << "    static constexpr IRQn_Type DMA_TX_IRQ = "
+                << (group.dma_tx_irq.empty() ? group.dma_tx : group.dma_tx_irq) << "_IRQn;\n";
+        }
+        if (!group.dma_rx.empty()) {
+            out << "    static constexpr uintptr_t DMA_RX = " << group.dma_rx << "_BASE;\n";
+            out << "    static constexpr IRQn_Type DMA_RX_IRQ = "
+                << (group.dma_rx_irq.empty() ? group.dma_rx : group.dma_rx_irq) << "_IRQn;\n";
+        }
+        out << "    static constexpr Pin pins[] = {";
+        for (size_t i = 0; i < group.pins.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << group.pins[i].signal;
+        }
+        out << "};\n";
+        out << "};\n";
+    }
+
+    out << "\n";
+    out << "} // namespace BoardPins\n";
+    return out.str();
+}
+
+bool GenerateBoardPins(const std::string& config_path, const std::string& header_path, std::string& error) {
+    BoardPinMap map;
+    if (!map.Load(config_path, error)) {
+        return false;
+    }
+    std::string header = map.GenerateHeader();
+
+    std::ifstream existing(header_path, std::ios::binary);
+    if (existing) {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == header) {
+            return true;
+        }
+    }
+
+    std::error_code ec;
+    fs::path parent = fs::path(header_path).parent_path();
+    if (!parent.empty()) {
+        fs::create_directories(parent, ec);
+    }
+    if (!WriteFileAtomically(header_path, header)) {
+        error = "Failed to write " + header_path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace Lumos
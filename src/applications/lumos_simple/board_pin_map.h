@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One pin of a board pin group
+ */
+struct BoardPin {
+    std::string name;         // "PB8"
+    char port = 'A';
+    int number = 0;
+    std::string signal;       // "TX", identifier in the generated header
+    std::vector<std::string> alternatives;  // "PB12_[PA10]" -> PA10
+};
+
+/**
+ * @brief Pins of one peripheral or connector function in config.yaml
+ *
+ *   UART3[JST]:          # peripheral, optionally [connector]
+ *     PB8: "TX"
+ *     PB9: "RX"
+ *     AF: 4              # alternate function number (GPIO_AF4_USART3)
+ *     DMA_TX: DMA1_Stream0
+ *     DMA_RX: DMA1_Stream1
+ *     DMA_RX_IRQ: DMA1_Stream1   # when the IRQ is not <stream>_IRQn
+ */
+struct BoardPinGroup {
+    std::string key;          // "UART3[JST]"
+    std::string identifier;   // "UART3_JST", "FDCAN1_PINS" without a connector
+    std::string connector;    // "JST", empty without brackets
+    int af = -1;
+    std::string dma_tx;
+    std::string dma_rx;
+    std::string dma_tx_irq;
+    std::string dma_rx_irq;
+    std::vector<BoardPin> pins;
+};
+
+/**
+ * @brief Board pin assignments from the board's config.yaml
+ *
+ * Top-level maps with pin keys (PA0..PK15) are pin groups; everything else
+ * (MCU, Memory, connector pinouts keyed by number) is ignored. A pin may
+ * belong to several groups only when they name the same connector, which
+ * makes them alternative uses of it (I2C1[JST] and UART3[JST]); any other
+ * reuse is a conflict and fails the build.
+ */
+class BoardPinMap {
+public:
+    /**
+     * @brief Load and check a board config.yaml
+     * @return false with @p error set if it is malformed or pins conflict
+     */
+    bool Load(const std::string& path, std::string& error);
+
+    const std::vector<BoardPinGroup>& GetGroups() const { return groups_; }
+
+    /**
+     * @brief C++ header with a constexpr descriptor per group
+     *
+     * Each group is a struct of BoardPins::Pin constants named by signal
+     * (port base address, pin mask, alternate function), its AF and DMA
+     * streams, and an array of all its pins for BoardPins::Overlap().
+     */
+    std::string GenerateHeader() const;
+
+private:
+    std::string source_;
+    std::vector<BoardPinGroup> groups_;
+};
+
+/**
+ * @brief Load @p config_path and write build/generated/board_pins.h
+ *
+ * The header is only rewritten when its content changes.
+ */
+bool GenerateBoardPins(const std::string& config_path, const std::string& header_path, std::string& error);
+
+} // namespace Lumos
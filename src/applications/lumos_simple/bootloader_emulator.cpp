@@ -0,0 +1,777 @@
+#include "bootloader_emulator.h"
+
+#ifndef _WIN32
+
+#include "crc32.h"
+#include "lumos_bootloader.h"
+#include "lz4_block.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace Lumos {
+
+namespace {
+
+const uint8_t kRomAck = 0x79;
+const uint8_t kRomNack = 0x1F;
+
+const uint8_t kBootAck = 0xAA;
+const uint8_t kBootNack = 0x55;
+const uint8_t kMagic[3] = {0x7E, 0x5B, 0x9C};
+const uint16_t kMinChunk = 256;
+const uint16_t kMaxChunk = 16384;
+const uint16_t kCompressed = 0x8000;
+const uint8_t kFeatures = 0x07;    // LZ4, CRC-32 verify, lazy erase
+const uint8_t kLazyErase = 0x04;
+const size_t kErasePage = 2048;
+
+uint32_t SpeedToBaud(speed_t speed) {
+    static const struct {
+        speed_t speed;
+        uint32_t baud;
+    } rates[] = {
+        {B9600, 9600}, {B19200, 19200}, {B38400, 38400}, {B57600, 57600},
+        {B115200, 115200}, {B230400, 230400},
+#ifdef B460800
+        {B460800, 460800},
+#endif
+#ifdef B921600
+        {B921600, 921600},
+#endif
+#ifdef B1000000
+        {B1000000, 1000000}, {B1500000, 1500000}, {B2000000, 2000000},
+#endif
+    };
+    for (const auto& rate : rates) {
+        if (rate.speed == speed) {
+            return rate.baud;
+        }
+    }
+    // macOS passes other rates through as plain numbers
+    return speed > 1000 ? static_cast<uint32_t>(speed) : 0;
+}
+
+uint32_t ReadLe32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// Waits up to @p timeout_us for @p fd to become readable or writable
+bool WaitFor(int fd, bool write, int64_t timeout_us) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeout_us / 1000000);
+    timeout.tv_usec = static_cast<suseconds_t>(timeout_us % 1000000);
+    return select(fd + 1, write ? nullptr : &set, write ? &set : nullptr, nullptr, &timeout) > 0;
+}
+
+} // namespace
+
+// ── PtyEmulator ───────────────────────────────────────────────────────────────
+
+PtyEmulator::PtyEmulator(const EmulatorConfig& config)
+    : config_(config)
+    , rng_(config.seed)
+{
+}
+
+PtyEmulator::~PtyEmulator() {
+    Stop();
+}
+
+bool PtyEmulator::Start(std::string& error) {
+    master_ = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_ < 0 || grantpt(master_) != 0 || unlockpt(master_) != 0) {
+        error = std::string("Cannot create a pseudo-terminal: ") + strerror(errno);
+        return false;
+    }
+    port_ = ptsname(master_);
+    hold_ = open(port_.c_str(), O_RDWR | O_NOCTTY);
+    if (hold_ < 0) {
+        error = "Cannot open " + port_ + ": " + strerror(errno);
+        return false;
+    }
+    // Raw until the tool configures its end, so early bytes aren't echoed
+    termios tty;
+    if (tcgetattr(hold_, &tty) == 0) {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, B115200);
+        cfsetospeed(&tty, B115200);
+        tcsetattr(hold_, TCSANOW, &tty);
+    }
+    fcntl(master_, F_SETFL, fcntl(master_, F_GETFL) | O_NONBLOCK);
+
+    stop_ = false;
+    rx_free_ = tx_free_ = Clock::now();
+    thread_ = std::thread([this]() { Run(); });
+    return true;
+}
+
+void PtyEmulator::Stop() {
+    stop_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (hold_ >= 0) {
+        close(hold_);
+        hold_ = -1;
+    }
+    if (master_ >= 0) {
+        close(master_);
+        master_ = -1;
+    }
+}
+
+EmulatorStats PtyEmulator::GetStats() const {
+    EmulatorStats stats;
+    stats.sessions = sessions_;
+    stats.packets = packets_;
+    stats.corrupted = corrupted_;
+    stats.bytes_in = bytes_in_;
+    stats.bytes_out = bytes_out_;
+    stats.bytes_written = bytes_written_;
+    return stats;
+}
+
+uint32_t PtyEmulator::GetBaudRate() const {
+    termios tty;
+    if (tcgetattr(hold_, &tty) != 0) {
+        return 0;
+    }
+    return SpeedToBaud(cfgetospeed(&tty));
+}
+
+double PtyEmulator::GetByteTimeUs() const {
+    if (!config_.line_rate) {
+        return 0.0;
+    }
+    const uint32_t baud = GetBaudRate();
+    return baud > 0 ? 1e6 * GetFrameBits() / baud : 0.0;
+}
+
+bool PtyEmulator::FlushDue() {
+    while (!pending_.empty() && pending_.front().due <= Clock::now()) {
+        const std::vector<uint8_t>& bytes = pending_.front().bytes;
+        size_t sent = 0;
+        while (sent < bytes.size()) {
+            if (stop_) {
+                return false;
+            }
+            const ssize_t n = write(master_, bytes.data() + sent, bytes.size() - sent);
+            if (n > 0) {
+                sent += static_cast<size_t>(n);
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                return false;
+            } else {
+                WaitFor(master_, true, 100000);   // The tool isn't reading yet
+            }
+        }
+        bytes_out_ += bytes.size();
+        pending_.pop_front();
+    }
+    return true;
+}
+
+bool PtyEmulator::WaitUntil(Clock::time_point until) {
+    while (true) {
+        if (!FlushDue() || stop_) {
+            return false;
+        }
+        const Clock::time_point now = Clock::now();
+        if (now >= until) {
+            return true;
+        }
+        Clock::time_point wake = std::min(until, now + std::chrono::milliseconds(100));
+        if (!pending_.empty()) {
+            wake = std::min(wake, pending_.front().due);
+        }
+        std::this_thread::sleep_until(wake);
+    }
+}
+
+bool PtyEmulator::Readable(int timeout_us) {
+    return WaitFor(master_, false, timeout_us);
+}
+
+bool PtyEmulator::Receive(uint8_t* data, size_t length) {
+    // Bytes already queued arrived back to back behind the previous ones
+    const bool queued = Readable(0);
+    Clock::time_point first;
+    size_t taken = 0;
+    while (taken < length) {
+        if (!FlushDue() || stop_) {
+            return false;
+        }
+        int64_t timeout_us = 100000;
+        if (!pending_.empty()) {
+            const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                pending_.front().due - Clock::now()).count();
+            timeout_us = std::max<int64_t>(0, std::min<int64_t>(timeout_us, wait));
+        }
+        if (!Readable(static_cast<int>(timeout_us))) {
+            continue;
+        }
+        const ssize_t n = read(master_, data + taken, length - taken);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        if (taken == 0) {
+            first = Clock::now();
+        }
+        taken += static_cast<size_t>(n);
+    }
+    bytes_in_ += length;
+
+    const double byte_us = GetByteTimeUs();
+    if (byte_us <= 0.0) {
+        return true;
+    }
+    const Clock::time_point start = queued ? rx_free_ : std::max(rx_free_, first);
+    rx_free_ = start + std::chrono::nanoseconds(static_cast<int64_t>(byte_us * 1000.0 * length));
+    return WaitUntil(rx_free_);
+}
+
+void PtyEmulator::Send(const uint8_t* data, size_t length) {
+    Clock::time_point due = Clock::now() + std::chrono::microseconds(config_.latency_us);
+    const double byte_us = GetByteTimeUs();
+    if (byte_us > 0.0) {
+        tx_free_ = std::max(tx_free_, due) +
+                   std::chrono::nanoseconds(static_cast<int64_t>(byte_us * 1000.0 * length));
+        due = tx_free_;
+    }
+    if (!pending_.empty()) {
+        due = std::max(due, pending_.back().due);   // Replies never overtake each other
+    }
+    pending_.push_back({due, std::vector<uint8_t>(data, data + length)});
+}
+
+bool PtyEmulator::Drain() {
+    return pending_.empty() || (WaitUntil(pending_.back().due) && FlushDue());
+}
+
+bool PtyEmulator::Busy(uint64_t us) {
+    return us == 0 || WaitUntil(Clock::now() + std::chrono::microseconds(us));
+}
+
+bool PtyEmulator::Program(size_t bytes) {
+    bytes_written_ += bytes;
+    return Busy(static_cast<uint64_t>(bytes) * config_.write_us_per_kb / 1024);
+}
+
+bool PtyEmulator::Corrupt(uint8_t* data, size_t length) {
+    if (config_.loss_percent <= 0.0 || length == 0 ||
+        std::uniform_real_distribution<double>(0.0, 100.0)(rng_) >= config_.loss_percent) {
+        return false;
+    }
+    data[rng_() % length] ^= static_cast<uint8_t>(1u << (rng_() % 8));
+    corrupted_++;
+    return true;
+}
+
+// ── Stm32RomEmulator ──────────────────────────────────────────────────────────
+
+const uint32_t Stm32RomEmulator::kFlashBase;
+const size_t Stm32RomEmulator::kFlashSize;
+const size_t Stm32RomEmulator::kPageSize;
+const uint32_t Stm32RomEmulator::kFlashSizeRegister;
+
+Stm32RomEmulator::Stm32RomEmulator(const EmulatorConfig& config)
+    : PtyEmulator(config)
+    , flash_(kFlashSize, 0xFF)
+{
+}
+
+Stm32RomEmulator::~Stm32RomEmulator() {
+    Stop();
+}
+
+void Stm32RomEmulator::LoadFlash(uint32_t address, const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(flash_mutex_);
+    if (address >= kFlashBase && address - kFlashBase + length <= flash_.size()) {
+        std::copy(data, data + length, flash_.begin() + (address - kFlashBase));
+    }
+}
+
+std::vector<uint8_t> Stm32RomEmulator::ReadFlash(uint32_t address, size_t length) const {
+    std::lock_guard<std::mutex> lock(flash_mutex_);
+    if (address < kFlashBase || address - kFlashBase + length > flash_.size()) {
+        return {};
+    }
+    const auto begin = flash_.begin() + (address - kFlashBase);
+    return std::vector<uint8_t>(begin, begin + length);
+}
+
+void Stm32RomEmulator::Run() {
+    uint8_t command;
+    while (ReceiveByte(command)) {
+        if (command == 0x7F) {
+            // Too fast for the auto-baud to time: no reply
+            if (GetBaudRate() > config_.max_baud) {
+                continue;
+            }
+            sessions_++;
+            SendByte(kRomAck);
+            continue;
+        }
+        uint8_t complement;
+        if (!ReceiveByte(complement)) {
+            return;
+        }
+        if (static_cast<uint8_t>(~command) != complement) {
+            SendByte(kRomNack);
+            continue;
+        }
+
+        bool ok = true;
+        switch (command) {
+            case 0x02: ok = GetId(); break;
+            case 0x11: ok = ReadMemory(); break;
+            case 0x21: ok = Go(); break;
+            case 0x31: ok = WriteMemory(); break;
+            case 0x44: ok = ExtendedErase(); break;
+            default: SendByte(kRomNack); break;
+        }
+        if (!ok) {
+            return;
+        }
+    }
+}
+
+bool Stm32RomEmulator::ReceiveAddress(long& offset) {
+    uint8_t bytes[5];
+    if (!Receive(bytes, sizeof(bytes))) {
+        return false;
+    }
+    // MSB first, unlike the Lumos protocol
+    const uint32_t address = (static_cast<uint32_t>(bytes[0]) << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    const bool valid = (bytes[0] ^ bytes[1] ^ bytes[2] ^ bytes[3]) == bytes[4] &&
+                       ((address >= kFlashBase && address < kFlashBase + kFlashSize) ||
+                        address == kFlashSizeRegister);
+    offset = valid ? static_cast<long>(address - kFlashBase) : -1;
+    SendByte(valid ? kRomAck : kRomNack);
+    return true;
+}
+
+long Stm32RomEmulator::PageOffset(size_t page) {
+    // Bank 1 pages from 0, bank 2 pages from 256
+    const size_t bank_pages = kFlashSize / 2 / kPageSize;
+    if (page < bank_pages) {
+        return static_cast<long>(page * kPageSize);
+    }
+    if (page >= 256 && page - 256 < bank_pages) {
+        return static_cast<long>(kFlashSize / 2 + (page - 256) * kPageSize);
+    }
+    return -1;
+}
+
+bool Stm32RomEmulator::GetId() {
+    // ACK, N = 1, product ID 0x0467 MSB first, ACK
+    const uint8_t reply[5] = {kRomAck, 0x01, 0x04, 0x67, kRomAck};
+    Send(reply, sizeof(reply));
+    return true;
+}
+
+bool Stm32RomEmulator::Go() {
+    // The firmware is not modelled: the device stays in the bootloader
+    // and simply answers the next sync again
+    SendByte(kRomAck);
+    long offset;
+    return ReceiveAddress(offset);
+}
+
+bool Stm32RomEmulator::ReadMemory() {
+    SendByte(kRomAck);
+    long offset;
+    if (!ReceiveAddress(offset)) {
+        return false;
+    }
+    if (offset < 0) {
+        return true;
+    }
+    uint8_t count[2];
+    if (!Receive(count, sizeof(count))) {
+        return false;
+    }
+    const size_t length = count[0] + 1u;
+    if (offset == static_cast<long>(kFlashSizeRegister - kFlashBase) &&
+        static_cast<uint8_t>(~count[0]) == count[1] && length <= 2) {
+        // Flash size in KB, little-endian
+        const uint8_t reply[3] = {kRomAck, static_cast<uint8_t>(kFlashSize / 1024),
+                                  static_cast<uint8_t>(kFlashSize / 1024 >> 8)};
+        Send(reply, 1 + length);
+        return true;
+    }
+    if (static_cast<uint8_t>(~count[0]) != count[1] || offset + length > kFlashSize) {
+        SendByte(kRomNack);
+        return true;
+    }
+
+    std::vector<uint8_t> reply(1 + length);
+    reply[0] = kRomAck;
+    {
+        std::lock_guard<std::mutex> lock(flash_mutex_);
+        std::copy_n(flash_.begin() + offset, length, reply.begin() + 1);
+    }
+    Send(reply.data(), reply.size());
+    return true;
+}
+
+bool Stm32RomEmulator::WriteMemory() {
+    SendByte(kRomAck);
+    long offset;
+    if (!ReceiveAddress(offset)) {
+        return false;
+    }
+    if (offset < 0) {
+        return true;
+    }
+
+    // N-1, N data bytes, XOR checksum over both
+    uint8_t packet[1 + 256 + 1];
+    if (!ReceiveByte(packet[0]) || !Receive(packet + 1, packet[0] + 2u)) {
+        return false;
+    }
+    const size_t length = packet[0] + 1u;
+    packets_++;
+    Corrupt(packet + 1, length);
+
+    uint8_t checksum = 0;
+    for (size_t i = 0; i <= length; i++) {
+        checksum ^= packet[i];
+    }
+    if (checksum != packet[length + 1] || offset + length > kFlashSize) {
+        SendByte(kRomNack);
+        return true;
+    }
+
+    {
+        // Programming only clears bits
+        std::lock_guard<std::mutex> lock(flash_mutex_);
+        for (size_t i = 0; i < length; i++) {
+            flash_[offset + i] &= packet[1 + i];
+        }
+    }
+    if (!Program(length)) {
+        return false;
+    }
+    SendByte(kRomAck);
+    return true;
+}
+
+bool Stm32RomEmulator::ExtendedErase() {
+    SendByte(kRomAck);
+    uint8_t count[2];
+    if (!Receive(count, sizeof(count))) {
+        return false;
+    }
+
+    if (count[0] == 0xFF && count[1] == 0xFF) {
+        uint8_t checksum;
+        if (!ReceiveByte(checksum)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(flash_mutex_);
+            std::fill(flash_.begin(), flash_.end(), 0xFF);
+        }
+        if (!Busy(config_.erase_ms * 1000ull)) {
+            return false;
+        }
+        SendByte(kRomAck);
+        return true;
+    }
+
+    // N-1 (2 bytes), N page codes (2 bytes each), XOR checksum
+    const size_t pages = ((count[0] << 8) | count[1]) + 1u;
+    std::vector<uint8_t> codes(pages * 2 + 1);
+    if (!Receive(codes.data(), codes.size())) {
+        return false;
+    }
+    uint8_t checksum = count[0] ^ count[1];
+    for (size_t i = 0; i + 1 < codes.size(); i++) {
+        checksum ^= codes[i];
+    }
+    bool valid = checksum == codes.back();
+    for (size_t i = 0; valid && i < pages; i++) {
+        valid = PageOffset((codes[2 * i] << 8) | codes[2 * i + 1]) >= 0;
+    }
+    if (!valid) {
+        SendByte(kRomNack);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(flash_mutex_);
+        for (size_t i = 0; i < pages; i++) {
+            const long offset = PageOffset((codes[2 * i] << 8) | codes[2 * i + 1]);
+            std::fill_n(flash_.begin() + offset, kPageSize, 0xFF);
+        }
+    }
+    if (!Busy(pages * config_.page_erase_ms * 1000ull)) {
+        return false;
+    }
+    SendByte(kRomAck);
+    return true;
+}
+
+// ── LumosBootloaderEmulator ───────────────────────────────────────────────────
+
+LumosBootloaderEmulator::LumosBootloaderEmulator(const EmulatorConfig& config)
+    : PtyEmulator(config)
+{
+}
+
+LumosBootloaderEmulator::~LumosBootloaderEmulator() {
+    Stop();
+}
+
+std::vector<uint8_t> LumosBootloaderEmulator::GetImage() const {
+    std::lock_guard<std::mutex> lock(image_mutex_);
+    return completed_;
+}
+
+void LumosBootloaderEmulator::Run() {
+    while (Handshake()) {
+        bool done = false;
+        while (!done && !restart_) {
+            uint8_t type;
+            if (!ReceiveByte(type)) {
+                return;
+            }
+
+            bool ok = true;
+            switch (type) {
+                case 0x01: ok = StartPacket(); break;
+                case 0x02: ok = Data(false); break;
+                case 0x03: ok = End(); done = true; break;
+                case 0x04: ok = Hello(); break;
+                case 0x05: ok = Data(true); break;
+                case 0x06: ok = Verify(); break;
+                case 0x7E: {
+                    // The tool gave up and reset the board
+                    uint8_t rest[2];
+                    ok = Receive(rest, sizeof(rest));
+                    restart_ = ok && rest[0] == kMagic[1] && rest[1] == kMagic[2];
+                    if (ok && !restart_) {
+                        SendByte(kBootNack);
+                    }
+                    break;
+                }
+                default: SendByte(kBootNack); break;
+            }
+            if (!ok) {
+                return;
+            }
+        }
+    }
+}
+
+bool LumosBootloaderEmulator::Handshake() {
+    if (!restart_) {
+        // Magic after the reset, possibly behind noise from the application
+        uint8_t recent[3] = {};
+        while (!std::equal(recent, recent + 3, kMagic)) {
+            recent[0] = recent[1];
+            recent[1] = recent[2];
+            if (!ReceiveByte(recent[2])) {
+                return false;
+            }
+        }
+    }
+    restart_ = false;
+    chunk_size_ = kMinChunk;
+    image_.clear();
+    have_.clear();
+    received_ = 0;
+    lazy_erase_ = false;
+    erased_ = 0;
+
+    // Bootloader ACK, READY and ERASE_DONE: nothing is erased before START
+    const uint8_t ready[5] = {0xAC, 0xCE, 0x55, kBootAck, kBootAck};
+    Send(ready, sizeof(ready));
+    return true;
+}
+
+bool LumosBootloaderEmulator::Hello() {
+    // version | window | chunk (2) | baud (4) | features
+    uint8_t request[9];
+    if (!Receive(request, sizeof(request))) {
+        return false;
+    }
+    const uint8_t window = std::max<uint8_t>(1, std::min(request[1], config_.max_window));
+    const uint16_t requested_chunk = static_cast<uint16_t>(request[2] | (request[3] << 8));
+    const uint16_t chunk = std::min(std::max(requested_chunk, kMinChunk), kMaxChunk);
+    const uint32_t baud = std::min(ReadLe32(request + 4), config_.max_baud);
+    chunk_size_ = chunk;
+    lazy_erase_ = (request[8] & kLazyErase) != 0;
+
+    const uint8_t reply[10] = {
+        kBootAck, 4, window,
+        static_cast<uint8_t>(chunk >> 0), static_cast<uint8_t>(chunk >> 8),
+        static_cast<uint8_t>(baud >> 0), static_cast<uint8_t>(baud >> 8),
+        static_cast<uint8_t>(baud >> 16), static_cast<uint8_t>(baud >> 24),
+        static_cast<uint8_t>(request[8] & kFeatures),
+    };
+    Send(reply, sizeof(reply));
+    return true;
+}
+
+bool LumosBootloaderEmulator::StartPacket() {
+    uint8_t size[4];
+    if (!Receive(size, sizeof(size))) {
+        return false;
+    }
+    const uint32_t length = ReadLe32(size);
+    image_.assign(length, 0xFF);
+    have_.assign((length + chunk_size_ - 1) / chunk_size_, false);
+    received_ = 0;
+    erased_ = 0;
+
+    if (!lazy_erase_) {
+        // The whole application area before the ACK
+        if (!Busy(config_.erase_ms * 1000ull)) {
+            return false;
+        }
+        erased_ = length;
+        SendByte(kBootAck);
+        return true;
+    }
+    // The first chunk's pages while it is on its way
+    SendByte(kBootAck);
+    return EraseAhead(chunk_size_);
+}
+
+bool LumosBootloaderEmulator::EraseAhead(size_t end) {
+    // Pages in order from the start of the image, each once
+    end = std::min(end, image_.size());
+    size_t pages = 0;
+    while (erased_ < end) {
+        erased_ += kErasePage;
+        pages++;
+    }
+    return Busy(pages * config_.page_erase_ms * 1000ull);
+}
+
+bool LumosBootloaderEmulator::Data(bool sequenced) {
+    // [seq (2)] | size (2, bit 15 = LZ4) | payload | CRC16 of the decoded chunk
+    uint8_t header[4];
+    if (!Receive(header, sequenced ? 4 : 2)) {
+        return false;
+    }
+    const uint8_t* size_field = sequenced ? header + 2 : header;
+    const size_t seq = sequenced ? header[0] | (header[1] << 8) : 0;
+    const uint16_t size = static_cast<uint16_t>(size_field[0] | (size_field[1] << 8));
+    const size_t payload = size & ~kCompressed;
+
+    std::vector<uint8_t> packet(payload + 2);
+    if (!Receive(packet.data(), packet.size())) {
+        return false;
+    }
+    packets_++;
+    Corrupt(packet.data(), packet.size());
+
+    bool valid = true;
+    if (size & kCompressed) {
+        valid = SimpleSerial::Lz4DecompressBlock(packet.data(), payload, chunk_size_, chunk_);
+    } else {
+        chunk_.assign(packet.begin(), packet.begin() + payload);
+    }
+    const size_t offset = sequenced ? seq * chunk_size_ : received_;
+    const uint16_t crc = static_cast<uint16_t>(packet[payload] | (packet[payload + 1] << 8));
+    valid = valid && (!sequenced || seq < have_.size()) && offset + chunk_.size() <= image_.size() &&
+            SimpleSerial::LumosBootloader::Crc16(chunk_.data(), static_cast<uint32_t>(chunk_.size())) == crc;
+
+    if (valid) {
+        // A window can run ahead of the erase, a resend never does
+        if (!EraseAhead(offset + chunk_.size())) {
+            return false;
+        }
+        std::copy(chunk_.begin(), chunk_.end(), image_.begin() + offset);
+        if (sequenced) {
+            have_[seq] = true;
+        } else {
+            received_ += chunk_.size();
+        }
+    }
+
+    // Lazy erase ACKs before programming: the chunk is written, and the
+    // next one's pages erased, while the next packet arrives
+    if (lazy_erase_) {
+        Reply(sequenced, valid, seq);
+        return !valid || (Program(chunk_.size()) && EraseAhead(offset + chunk_.size() + chunk_size_));
+    }
+    if (valid && !Program(chunk_.size())) {
+        return false;
+    }
+    Reply(sequenced, valid, seq);
+    return true;
+}
+
+void LumosBootloaderEmulator::Reply(bool sequenced, bool valid, size_t seq) {
+    if (!sequenced) {
+        SendByte(valid ? kBootAck : kBootNack);
+        return;
+    }
+
+    // Cumulative ACK of the chunks written so far, or NACK of this one
+    size_t next = 0;
+    while (next < have_.size() && have_[next]) {
+        next++;
+    }
+    const size_t reported = valid ? next : seq;
+    const uint8_t reply[3] = {
+        static_cast<uint8_t>(valid ? 0xA5 : 0x5A),
+        static_cast<uint8_t>(reported >> 0), static_cast<uint8_t>(reported >> 8),
+    };
+    Send(reply, sizeof(reply));
+}
+
+bool LumosBootloaderEmulator::Verify() {
+    uint8_t size[4];
+    if (!Receive(size, sizeof(size))) {
+        return false;
+    }
+    const size_t length = std::min<size_t>(ReadLe32(size), image_.size());
+    const uint32_t crc = SimpleSerial::Crc32(image_.data(), length);
+    const uint8_t reply[5] = {
+        kBootAck,
+        static_cast<uint8_t>(crc >> 0), static_cast<uint8_t>(crc >> 8),
+        static_cast<uint8_t>(crc >> 16), static_cast<uint8_t>(crc >> 24),
+    };
+    Send(reply, sizeof(reply));
+    return true;
+}
+
+bool LumosBootloaderEmulator::End() {
+    // CRC16 of the image, zero-padded to 4 bytes
+    uint8_t crc[4];
+    if (!Receive(crc, sizeof(crc))) {
+        return false;
+    }
+    const bool complete = received_ == image_.size() ||
+                          (!have_.empty() && std::all_of(have_.begin(), have_.end(), [](bool b) { return b; }));
+    const uint16_t expected = SimpleSerial::LumosBootloader::Crc16(image_.data(), static_cast<uint32_t>(image_.size()));
+    const bool valid = !image_.empty() && complete && expected == (crc[0] | (crc[1] << 8));
+    if (valid) {
+        std::lock_guard<std::mutex> lock(image_mutex_);
+        completed_ = image_;
+        sessions_++;
+    }
+    SendByte(valid ? kBootAck : kBootNack);
+    return true;
+}
+
+} // namespace Lumos
+
+#endif // _WIN32
@@ -0,0 +1,215 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Link and flash behaviour of an emulated board
+ *
+ * All zero (the default) is an ideal device: replies at once, never
+ * loses a byte and programs flash in no time.
+ */
+struct EmulatorConfig {
+    bool line_rate = false;         // Pace bytes at the baud rate the tool set on its end
+    uint32_t latency_us = 0;        // Before each reply (USB adapter, firmware turnaround)
+    double loss_percent = 0.0;      // Data packets corrupted on the way in
+    uint32_t erase_ms = 0;          // Full erase (Lumos START without lazy erase, ROM global erase)
+    uint32_t page_erase_ms = 0;     // Per page (ROM extended erase, Lumos lazy erase)
+    uint32_t write_us_per_kb = 0;   // Flash programming
+    uint32_t max_baud = 2000000;    // Highest rate the Lumos bootloader grants in HELLO,
+                                    // and the ROM bootloader's auto-baud syncs at
+    uint8_t max_window = 32;        // Largest window the Lumos bootloader grants
+    uint32_t seed = 1;              // Loss pattern, the same for the same seed
+};
+
+struct EmulatorStats {
+    uint64_t sessions = 0;        // Completed downloads (Lumos END) or 0x7F syncs (ROM)
+    uint64_t packets = 0;         // Data packets received
+    uint64_t corrupted = 0;       // Of those, corrupted by the loss setting
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t bytes_written = 0;   // Programmed into flash
+};
+
+/**
+ * @brief A device on the master side of a pseudo-terminal
+ *
+ * The tool opens GetPort() like any serial port. The device thread reads
+ * what it writes and answers through a queue, so latency and the line rate
+ * delay replies without holding up reception (as a UART with DMA does).
+ * The slave is held open too, so the device survives the tool closing
+ * and reopening the port between runs.
+ */
+class PtyEmulator {
+public:
+    explicit PtyEmulator(const EmulatorConfig& config);
+    virtual ~PtyEmulator();
+
+    bool Start(std::string& error);
+
+    /** Ends the device thread; subclasses call it from their destructor */
+    void Stop();
+
+    const std::string& GetPort() const { return port_; }
+    EmulatorStats GetStats() const;
+
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    const EmulatorConfig config_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> sessions_{0};
+    std::atomic<uint64_t> packets_{0};
+    std::atomic<uint64_t> corrupted_{0};
+    std::atomic<uint64_t> bytes_written_{0};
+
+    virtual void Run() = 0;
+
+    /** Rate the tool set on its end of the pty, 0 if unknown */
+    uint32_t GetBaudRate() const;
+
+    // Bits per byte on the wire: 10 for 8N1, 11 for 8E1
+    virtual int GetFrameBits() const { return 10; }
+
+    /** Exactly @p length bytes, arriving at the line rate; false once stopped */
+    bool Receive(uint8_t* data, size_t length);
+    bool ReceiveByte(uint8_t& byte) { return Receive(&byte, 1); }
+
+    /** Queues a reply, sent after the latency at the line rate */
+    void Send(const uint8_t* data, size_t length);
+    void SendByte(uint8_t byte) { Send(&byte, 1); }
+
+    /** Waits until every queued reply is on its way; false once stopped */
+    bool Drain();
+
+    /** Spends @p us of device time (erase, programming); replies still go out */
+    bool Busy(uint64_t us);
+
+    /** Flash programming time of @p bytes */
+    bool Program(size_t bytes);
+
+    /** Applies the loss setting to a received data packet; true if corrupted */
+    bool Corrupt(uint8_t* data, size_t length);
+
+private:
+    struct Pending {
+        Clock::time_point due;
+        std::vector<uint8_t> bytes;
+    };
+
+    int master_ = -1;
+    int hold_ = -1;
+    std::string port_;
+    std::thread thread_;
+    std::mt19937 rng_;
+    std::deque<Pending> pending_;
+    Clock::time_point rx_free_;   // When the line into the device is next idle
+    Clock::time_point tx_free_;   // When the line out of it is
+    std::atomic<uint64_t> bytes_in_{0};
+    std::atomic<uint64_t> bytes_out_{0};
+
+    double GetByteTimeUs() const;
+    bool Readable(int timeout_us);
+    bool FlushDue();
+    bool WaitUntil(Clock::time_point until);
+};
+
+/**
+ * @brief STM32 ROM bootloader (AN3155) as STM32Communicator uses it
+ *
+ * Emulates an STM32G0B1 (product ID 0x467): 256 KB of flash in 2 KB pages
+ * at 0x08000000, two banks with bank 2 pages numbered from 256, and the
+ * flash size register, with GET_ID, READ_MEMORY, GO, WRITE_MEMORY and
+ * EXTENDED_ERASE. Corrupted writes fail their checksum and are NACKed.
+ */
+class Stm32RomEmulator : public PtyEmulator {
+public:
+    static const uint32_t kFlashBase = 0x08000000;
+    static const size_t kFlashSize = 256 * 1024;
+    static const size_t kPageSize = 2 * 1024;
+    static const uint32_t kFlashSizeRegister = 0x1FFF75E0;
+
+    explicit Stm32RomEmulator(const EmulatorConfig& config = EmulatorConfig());
+    ~Stm32RomEmulator() override;
+
+    /** Sets flash contents directly, e.g. an image already on the board */
+    void LoadFlash(uint32_t address, const uint8_t* data, size_t length);
+    std::vector<uint8_t> ReadFlash(uint32_t address, size_t length) const;
+
+protected:
+    void Run() override;
+    int GetFrameBits() const override { return 11; }
+
+private:
+    mutable std::mutex flash_mutex_;
+    std::vector<uint8_t> flash_;
+
+    bool ReceiveAddress(long& offset);
+    static long PageOffset(size_t page);
+    bool GetId();
+    bool ReadMemory();
+    bool Go();
+    bool WriteMemory();
+    bool ExtendedErase();
+};
+
+/**
+ * @brief Lumos bootloader, protocol version 4 (see lumos_bootloader.h)
+ *
+ * Serves one download after another: magic, HELLO (granting up to
+ * max_baud and max_window, LZ4, verify and lazy erase), START, DATA or
+ * DATA_SEQ, VERIFY and END. Corrupted chunks fail their CRC and are
+ * NACKed, as the MCU does; the host resends them in windowed mode only.
+ *
+ * ERASE_DONE goes out at once. Without lazy erase START takes erase_ms;
+ * with it each 2 KB page takes page_erase_ms right before the first chunk
+ * that needs it. A chunk is ACKed once its CRC checks, then programmed
+ * and the next chunk's pages erased while the next packet arrives.
+ */
+class LumosBootloaderEmulator : public PtyEmulator {
+public:
+    explicit LumosBootloaderEmulator(const EmulatorConfig& config = EmulatorConfig());
+    ~LumosBootloaderEmulator() override;
+
+    /** Image of the last completed download */
+    std::vector<uint8_t> GetImage() const;
+
+protected:
+    void Run() override;
+
+private:
+    mutable std::mutex image_mutex_;
+    std::vector<uint8_t> image_;       // Download in progress
+    std::vector<uint8_t> completed_;
+    std::vector<bool> have_;           // Chunks received, windowed mode
+    std::vector<uint8_t> chunk_;
+    size_t chunk_size_ = 256;
+    size_t received_ = 0;              // Stop-and-wait write position
+    bool lazy_erase_ = false;          // Granted in HELLO
+    size_t erased_ = 0;                // Image bytes erased so far, lazy erase
+    bool restart_ = false;             // Magic seen mid-session
+
+    bool Handshake();
+    bool Hello();
+    bool StartPacket();
+    bool Data(bool sequenced);
+    bool EraseAhead(size_t end);
+    void Reply(bool sequenced, bool valid, size_t seq);
+    bool Verify();
+    bool End();
+};
+
+} // namespace Lumos
+
+#endif // _WIN32
@@ -0,0 +1,333 @@
+#include "build_daemon.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+// The build output is followed by a NUL, the exit status and a newline;
+// compiler and tool output never contains a NUL
+const char kTrailer = '\0';
+
+bool MakeAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int Connect(const std::string& path) {
+    sockaddr_un address;
+    if (!MakeAddress(path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool WriteAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string GetDaemonSocketPath(const std::string& project_dir) {
+    return project_dir + "/build/daemon.sock";
+}
+
+BuildDaemon::BuildDaemon(const std::string& lumos_root, const std::string& project_dir)
+    : project_dir_(project_dir),
+      socket_path_(GetDaemonSocketPath(project_dir)),
+      builder_(lumos_root)
+{
+    // Only safe if every change is reported
+    if (watcher_.IsSupported()) {
+        builder_.EnableResidentState();
+    }
+}
+
+BuildDaemon::~BuildDaemon() {
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+}
+
+bool BuildDaemon::Listen() {
+    sockaddr_un address;
+    if (!MakeAddress(socket_path_, address)) {
+        std::cerr << "Error: Socket path too long: " << socket_path_ << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(socket_path_).parent_path(), ec);
+
+    // A socket nobody answers on is left over from a daemon that died
+    if (fs::exists(socket_path_, ec)) {
+        int other = Connect(socket_path_);
+        if (other >= 0) {
+            close(other);
+            std::cerr << "Error: A daemon is already running for this project" << std::endl;
+            return false;
+        }
+        unlink(socket_path_.c_str());
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "Error: Failed to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, 4) != 0) {
+        std::cerr << "Error: Failed to listen on " << socket_path_ << ": " << std::strerror(errno) << std::endl;
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+bool BuildDaemon::Run(volatile bool& running) {
+    if (!Listen()) {
+        return false;
+    }
+
+    // A client that goes away mid-build must not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cout << "Lumos daemon for " << project_dir_ << std::endl;
+    std::cout << "Listening on " << socket_path_ << std::endl;
+    if (watcher_.IsSupported()) {
+        std::cout << "Watching sources with inotify; 'lumos build' now only redoes what changed" << std::endl;
+    } else {
+        std::cout << "File watching is not supported here; every build revalidates its inputs" << std::endl;
+    }
+    std::cout << "Press Ctrl+C to stop" << std::endl;
+
+    while (running) {
+        pollfd fds[2];
+        fds[0] = {listen_fd_, POLLIN, 0};
+        fds[1] = {watcher_.GetFd(), POLLIN, 0};
+        int count = watcher_.IsSupported() ? 2 : 1;
+        int ready = poll(fds, count, 200);
+        if (ready <= 0) {
+            continue;
+        }
+
+        if (count > 1 && (fds[1].revents & POLLIN)) {
+            ProcessChanges();
+        }
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listen_fd_, nullptr, nullptr);
+            if (client >= 0) {
+                ServeClient(client);
+                close(client);
+            }
+        }
+    }
+
+    std::cout << "Daemon stopped after " << builds_ << " build(s)" << std::endl;
+    return true;
+}
+
+void BuildDaemon::ProcessChanges() {
+    for (const auto& change : watcher_.ReadChanges()) {
+        builder_.NotifyChanged(change.path, change.structural);
+    }
+}
+
+bool BuildDaemon::ReadRequest(int client, DaemonRequest& request) {
+    // profile=<name>\njobs=<n>\n\n
+    std::string text;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (text.find("\n\n") == std::string::npos) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        pollfd fd = {client, POLLIN, 0};
+        if (left <= 0 || poll(&fd, 1, static_cast<int>(left)) <= 0) {
+            return false;
+        }
+        char buffer[256];
+        ssize_t length = read(client, buffer, sizeof(buffer));
+        if (length <= 0 || text.size() > 4096) {
+            return false;
+        }
+        text.append(buffer, static_cast<size_t>(length));
+    }
+
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+        if (line.rfind("profile=", 0) == 0) {
+            request.profile = line.substr(8);
+        } else if (line.rfind("jobs=", 0) == 0) {
+            try {
+                request.jobs = static_cast<unsigned int>(std::stoul(line.substr(5)));
+            } catch (...) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void BuildDaemon::ServeClient(int client) {
+    DaemonRequest request;
+    if (!ReadRequest(client, request)) {
+        return;
+    }
+
+    // Everything that changed up to now must be known before building
+    ProcessChanges();
+
+    builder_.SetProfile(request.profile);
+    builder_.SetJobs(request.jobs);
+
+    // The build writes to the client as if it ran in its terminal,
+    // compilers included
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(client, STDOUT_FILENO);
+    dup2(client, STDERR_FILENO);
+
+    auto start = std::chrono::steady_clock::now();
+    bool success = builder_.Build(project_dir_);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    // Writes to a client that disconnected fail and leave the streams bad
+    std::cout.clear();
+    std::cerr.clear();
+
+    std::string trailer(1, kTrailer);
+    trailer += std::to_string(success ? 0 : 1) + "\n";
+    WriteAll(client, trailer.data(), trailer.size());
+
+    // Watch what the plan now depends on; changes in directories not
+    // watched before went unseen, so check those inputs once
+    if (watcher_.SetDirectories(builder_.GetWatchDirectories()) > 0) {
+        builder_.RevalidateResidentState();
+    }
+
+    builds_++;
+    std::cout << "Build " << builds_ << ": " << (success ? "succeeded" : "failed")
+              << " in " << std::fixed << std::setprecision(2) << seconds << " s"
+              << std::defaultfloat << std::endl;
+}
+
+bool BuildWithDaemon(const std::string& project_dir, const DaemonRequest& request, int& exit_code) {
+    std::string socket_path = GetDaemonSocketPath(project_dir);
+    std::error_code ec;
+    if (!fs::exists(socket_path, ec)) {
+        return false;
+    }
+    int fd = Connect(socket_path);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string text = "profile=" + request.profile + "\njobs=" + std::to_string(request.jobs) + "\n\n";
+    if (!WriteAll(fd, text.data(), text.size())) {
+        close(fd);
+        return false;
+    }
+
+    std::cout << "Building with lumos daemon (build/daemon.sock)" << std::endl;
+    std::cout << std::endl;
+    std::cout.flush();
+
+    bool trailer = false;
+    std::string status;
+    char buffer[4096];
+    while (true) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+        size_t output = static_cast<size_t>(length);
+        if (!trailer) {
+            const char* end = static_cast<const char*>(std::memchr(buffer, kTrailer, output));
+            if (end != nullptr) {
+                trailer = true;
+                status.append(end + 1, static_cast<const char*>(buffer + output));
+                output = static_cast<size_t>(end - buffer);
+            }
+            std::cout.write(buffer, static_cast<std::streamsize>(output));
+            std::cout.flush();
+        } else {
+            status.append(buffer, output);
+        }
+    }
+    close(fd);
+
+    if (!trailer) {
+        std::cerr << "Error: The daemon closed the connection before the build finished" << std::endl;
+        exit_code = 1;
+        return true;
+    }
+    try {
+        exit_code = std::stoi(status);
+    } catch (...) {
+        exit_code = 1;
+    }
+    return true;
+}
+
+} // namespace Lumos
+
+#endif // _WIN32
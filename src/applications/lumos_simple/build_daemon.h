@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include "builder.h"
+#include "file_watcher.h"
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Options of one build served by the daemon
+ */
+struct DaemonRequest {
+    std::string profile;     // empty = profile from project.yaml
+    unsigned int jobs = 0;   // 0 = LUMOS_JOBS or hardware threads
+};
+
+/**
+ * @brief Builds one project on request, keeping its state in memory
+ *
+ * `lumos daemon` listens on build/daemon.sock in the project directory.
+ * `lumos build` sends its options there and receives the build output and
+ * exit status, so a rebuild skips loading project.yaml and the board
+ * config, HAL detection and re-checking the build plan's inputs: the file
+ * watcher reports which of them changed in between, and only what those
+ * changes affect is resolved again. Objects are still checked against
+ * their sources and headers as in every build.
+ *
+ * Without inotify (non-Linux) nothing is kept between builds; the daemon
+ * then only saves starting the tool.
+ */
+class BuildDaemon {
+public:
+    BuildDaemon(const std::string& lumos_root, const std::string& project_dir);
+    ~BuildDaemon();
+
+    /**
+     * @brief Serve builds until @p running is cleared
+     * @return false if the socket could not be set up
+     */
+    bool Run(volatile bool& running);
+
+private:
+    std::string project_dir_;
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    Builder builder_;
+    FileWatcher watcher_;
+    size_t builds_ = 0;
+
+    bool Listen();
+    void ServeClient(int client);
+    bool ReadRequest(int client, DaemonRequest& request);
+    void ProcessChanges();
+};
+
+/** Socket a project's daemon listens on */
+std::string GetDaemonSocketPath(const std::string& project_dir);
+
+/**
+ * @brief Build through the project's daemon, if one is running
+ * @param exit_code Exit status of the build
+ * @return false if no daemon answered; build without it then
+ */
+bool BuildWithDaemon(const std::string& project_dir, const DaemonRequest& request, int& exit_code);
+
+} // namespace Lumos
+
+#endif // _WIN32
@@ -0,0 +1,96 @@
+#include "build_matrix.h"
+#include "job_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace Lumos {
+
+BuildMatrix::BuildMatrix(const std::string& executable, unsigned int jobs)
+    : executable_(executable),
+      jobs_(jobs)
+{
+}
+
+std::vector<BoardBuildResult> BuildMatrix::Build(const std::vector<std::string>& boards,
+                                                 const std::vector<std::string>& build_args) {
+    std::vector<BoardBuildResult> results(boards.size());
+    if (boards.empty()) {
+        return results;
+    }
+
+    // All boards build at once, so split the compile jobs between them
+    // rather than oversubscribing the machine once per board
+    unsigned int total = jobs_ != 0 ? jobs_ : JobPool::DefaultJobCount();
+    std::cout << "Building " << boards.size() << " boards with " << total << " jobs" << std::endl;
+    std::cout << std::endl;
+
+    std::mutex output_mutex;
+    std::vector<std::thread> threads;
+    threads.reserve(boards.size());
+    for (size_t i = 0; i < boards.size(); ++i) {
+        unsigned int share = total / static_cast<unsigned int>(boards.size());
+        if (i < total % boards.size()) {
+            share++;
+        }
+        std::vector<std::string> args = {executable_, "build", "--board", boards[i], "--no-daemon",
+                                         "-j", std::to_string(std::max(1u, share))};
+        args.insert(args.end(), build_args.begin(), build_args.end());
+
+        threads.emplace_back([&, i, args]() {
+            BoardBuildResult& result = results[i];
+            result.board = boards[i];
+            auto start = std::chrono::steady_clock::now();
+            result.process = Process::Run(args);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Flush the whole board log at once so boards never interleave
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cout << "--- " << result.board << " ---" << std::endl;
+            std::cout << result.process.output;
+            if (!result.process.output.empty() && result.process.output.back() != '\n') {
+                std::cout << std::endl;
+            }
+            std::cout << std::endl << std::flush;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+bool BuildMatrix::PrintSummary(const std::vector<BoardBuildResult>& results) {
+    size_t width = 5;
+    size_t passed = 0;
+    for (const auto& result : results) {
+        width = std::max(width, result.board.size());
+        if (result.process.Succeeded()) {
+            passed++;
+        }
+    }
+
+    std::cout << std::left << std::setw(static_cast<int>(width)) << "Board" << "  Result  Time" << std::endl;
+    for (const auto& result : results) {
+        bool success = result.process.Succeeded();
+        std::cout << std::left << std::setw(static_cast<int>(width)) << result.board << "  "
+                  << (success ? "PASS  " : "FAIL  ") << "  "
+                  << std::right << std::fixed << std::setprecision(1) << std::setw(5)
+                  << result.seconds << "s";
+        if (success) {
+            std::cout << "  build/" << result.board << "/";
+        } else {
+            std::cout << "  " << result.process.Describe();
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat << std::endl;
+    std::cout << passed << "/" << results.size() << " boards built successfully" << std::endl;
+
+    return passed == results.size();
+}
+
+} // namespace Lumos
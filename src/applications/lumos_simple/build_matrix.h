@@ -0,0 +1,56 @@
+#pragma once
+
+#include "process.h"
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Outcome of building one board of a matrix
+ */
+struct BoardBuildResult {
+    std::string board;
+    ProcessResult process;
+    double seconds = 0.0;
+};
+
+/**
+ * @brief Build every board a project lists at once (lumos build)
+ *
+ * Each board is a `lumos build --board <name>` child process with its
+ * share of the compile jobs, building into build/<board>. A child's log is
+ * captured and printed as one block when it finishes. The object cache and
+ * the include cache under build/ are shared by all boards. Unlike a single
+ * build, one failing board does not stop the others.
+ */
+class BuildMatrix {
+public:
+    /**
+     * @brief Construct a matrix
+     * @param executable lumos binary run once per board
+     * @param jobs Compile jobs across all boards (0 = LUMOS_JOBS or hardware threads)
+     */
+    BuildMatrix(const std::string& executable, unsigned int jobs = 0);
+
+    /**
+     * @brief Build every board from the current directory and wait for completion
+     * @param boards Boards from project.yaml
+     * @param build_args Options passed on to every board's build, e.g. --profile
+     * @return One result per board, in the order given
+     */
+    std::vector<BoardBuildResult> Build(const std::vector<std::string>& boards,
+                                        const std::vector<std::string>& build_args);
+
+    /**
+     * @brief Print a pass/fail table
+     * @return true if every board built
+     */
+    static bool PrintSummary(const std::vector<BoardBuildResult>& results);
+
+private:
+    std::string executable_;
+    unsigned int jobs_;
+};
+
+} // namespace Lumos
@@ -0,0 +1,214 @@
+#include "build_plan.h"
+#include "json_util.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <yaml-cpp/yaml.h>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+// Bump when the plan layout or the way plans are resolved changes
+const int kPlanVersion = 3;
+
+const char* JsonBool(bool value) {
+    return value ? "true" : "false";
+}
+
+std::vector<std::string> StringList(const YAML::Node& node) {
+    if (!node || !node.IsSequence()) {
+        return {};
+    }
+    return node.as<std::vector<std::string>>();
+}
+
+CompileJob ParseJob(const YAML::Node& node) {
+    CompileJob job;
+    job.source = node["source"].as<std::string>();
+    job.object = node["object"].as<std::string>();
+    job.label = node["label"].as<std::string>();
+    job.project_includes = node["project_includes"].as<bool>();
+    job.hal = node["hal"].as<bool>();
+    job.user = node["user"].as<bool>();
+    job.unity_sources = StringList(node["unity_sources"]);
+    job.inv.compiler = node["compiler"].as<std::string>();
+    job.inv.codegen_flags = StringList(node["codegen_flags"]);
+    job.inv.preprocessor_flags = StringList(node["preprocessor_flags"]);
+    job.inv.force_include = node["force_include"].as<std::string>();
+    job.inv.preprocess = node["preprocess"].as<bool>();
+    return job;
+}
+
+} // namespace
+
+long long BuildPlan::GetModificationTime(const std::string& path) {
+    std::error_code ec;
+    auto time = fs::last_write_time(path, ec);
+    if (ec) {
+        return -1;
+    }
+    return static_cast<long long>(time.time_since_epoch().count());
+}
+
+void BuildPlan::AddInput(const std::string& path) {
+    for (const auto& input : inputs_) {
+        if (input.path == path) {
+            return;
+        }
+    }
+    inputs_.push_back({path, GetModificationTime(path)});
+}
+
+std::vector<std::string> BuildPlan::GetInputPaths() const {
+    std::vector<std::string> paths;
+    for (const auto& input : inputs_) {
+        paths.push_back(input.path);
+    }
+    return paths;
+}
+
+bool BuildPlan::IsCurrent() const {
+    for (const auto& input : inputs_) {
+        if (GetModificationTime(input.path) != input.mtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BuildPlan::ReadJobs(const std::string& plan_file, std::vector<CompileJob>& jobs) {
+    jobs.clear();
+    try {
+        YAML::Node root = YAML::LoadFile(plan_file);
+        if (!root["version"] || root["version"].as<int>() != kPlanVersion) {
+            return false;
+        }
+        for (const auto& node : root["jobs"]) {
+            jobs.push_back(ParseJob(node));
+        }
+        return true;
+    } catch (const YAML::Exception&) {
+        jobs.clear();
+        return false;
+    }
+}
+
+bool BuildPlan::Load(const std::string& plan_file, const std::string& settings) {
+    std::error_code ec;
+    if (!fs::exists(plan_file, ec)) {
+        return false;
+    }
+
+    try {
+        // JSON is a subset of YAML, so yaml-cpp reads the plan directly
+        YAML::Node root = YAML::LoadFile(plan_file);
+        if (!root["version"] || root["version"].as<int>() != kPlanVersion) {
+            return false;
+        }
+        if (!root["settings"] || root["settings"].as<std::string>() != settings) {
+            return false;
+        }
+
+        std::vector<Input> inputs;
+        for (const auto& node : root["inputs"]) {
+            Input input{node["path"].as<std::string>(), node["mtime"].as<long long>()};
+            if (GetModificationTime(input.path) != input.mtime) {
+                return false;
+            }
+            inputs.push_back(input);
+        }
+
+        std::vector<CompileJob> jobs;
+        for (const auto& node : root["jobs"]) {
+            jobs.push_back(ParseJob(node));
+        }
+
+        inputs_ = std::move(inputs);
+        this->jobs = std::move(jobs);
+        hal_modules = StringList(root["hal_modules"]);
+        hal_library = root["hal_library"].as<std::string>();
+        link_flags = StringList(root["link_flags"]);
+        return true;
+    } catch (const YAML::Exception&) {
+        // A damaged plan is simply recomputed
+        return false;
+    }
+}
+
+bool BuildPlan::Save(const std::string& plan_file, const std::string& settings) const {
+    std::ostringstream ss;
+    ss << "{\n";
+    ss << "  \"version\": " << kPlanVersion << ",\n";
+    ss << "  \"settings\": " << JsonString(settings) << ",\n";
+
+    ss << "  \"inputs\": [";
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        ss << (i > 0 ? ",\n" : "\n");
+        ss << "    {\"path\": " << JsonString(inputs_[i].path) << ", \"mtime\": " << inputs_[i].mtime << "}";
+    }
+    ss << "\n  ],\n";
+
+    ss << "  \"hal_modules\": " << JsonArray(hal_modules) << ",\n";
+    ss << "  \"hal_library\": " << JsonString(hal_library) << ",\n";
+    ss << "  \"link_flags\": " << JsonArray(link_flags) << ",\n";
+
+    ss << "  \"jobs\": [";
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const CompileJob& job = jobs[i];
+        ss << (i > 0 ? ",\n" : "\n");
+        ss << "    {\n";
+        ss << "      \"source\": " << JsonString(job.source) << ",\n";
+        ss << "      \"object\": " << JsonString(job.object) << ",\n";
+        ss << "      \"label\": " << JsonString(job.label) << ",\n";
+        ss << "      \"project_includes\": " << JsonBool(job.project_includes) << ",\n";
+        ss << "      \"hal\": " << JsonBool(job.hal) << ",\n";
+        ss << "      \"user\": " << JsonBool(job.user) << ",\n";
+        ss << "      \"unity_sources\": " << JsonArray(job.unity_sources) << ",\n";
+        ss << "      \"compiler\": " << JsonString(job.inv.compiler) << ",\n";
+        ss << "      \"codegen_flags\": " << JsonArray(job.inv.codegen_flags) << ",\n";
+        ss << "      \"preprocessor_flags\": " << JsonArray(job.inv.preprocessor_flags) << ",\n";
+        ss << "      \"force_include\": " << JsonString(job.inv.force_include) << ",\n";
+        ss << "      \"preprocess\": " << JsonBool(job.inv.preprocess) << "\n";
+        ss << "    }";
+    }
+    ss << "\n  ]\n";
+    ss << "}\n";
+
+    return WriteFileAtomically(plan_file, ss.str());
+}
+
+bool WriteCompileCommands(const std::string& path,
+                          const std::string& directory,
+                          const std::vector<CompileCommand>& commands) {
+    std::ostringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < commands.size(); ++i) {
+        ss << (i > 0 ? ",\n" : "\n");
+        ss << "  {\n";
+        ss << "    \"directory\": " << JsonString(directory) << ",\n";
+        ss << "    \"file\": " << JsonString(commands[i].file) << ",\n";
+        ss << "    \"output\": " << JsonString(commands[i].output) << ",\n";
+        ss << "    \"arguments\": " << JsonArray(commands[i].arguments) << "\n";
+        ss << "  }";
+    }
+    ss << "\n]\n";
+    std::string content = ss.str();
+
+    // Leave an unchanged database alone so clangd doesn't reindex
+    std::ifstream existing(path, std::ios::binary);
+    if (existing.is_open()) {
+        std::ostringstream previous;
+        previous << existing.rdbuf();
+        if (previous.str() == content) {
+            return true;
+        }
+    }
+    existing.close();
+
+    return WriteFileAtomically(path, content);
+}
+
+} // namespace Lumos
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Compiler and flag groups for one source file
+ */
+struct CompilerInvocation {
+    std::string compiler;
+    std::vector<std::string> codegen_flags;       // -mcpu, -O, warnings, ...
+    std::vector<std::string> preprocessor_flags;  // -D, -I
+    std::string force_include;       // board lumos.h (empty if none)
+    std::string pch_header;          // precompiled wrapper replacing force_include
+    bool preprocess = true;          // false for plain .s assembly
+};
+
+/**
+ * @brief A single translation unit scheduled for compilation
+ */
+struct CompileJob {
+    std::string source;
+    std::string object;
+    std::string label;
+    bool project_includes = true;  // false for shared HAL objects
+    bool hal = false;              // archived into the HAL library
+    bool user = false;             // project source; the rest is partially linked once
+    std::vector<std::string> unity_sources;  // HAL drivers #included by a generated unity source
+    CompilerInvocation inv;
+};
+
+/**
+ * @brief One entry of a compile_commands.json database
+ */
+struct CompileCommand {
+    std::string file;
+    std::string output;
+    std::vector<std::string> arguments;
+};
+
+/**
+ * @brief Fully resolved build of one project and profile
+ *
+ * Resolving a build stats every include path, scans the board and wrapper
+ * directories and parses the user sources for HAL modules. The result is
+ * saved to build/<profile>/plan.json together with the modification times
+ * of every file and directory it was derived from, so a later build with
+ * the same inputs can load it instead of resolving everything again.
+ */
+class BuildPlan {
+public:
+    std::vector<std::string> hal_modules;
+    std::vector<CompileJob> jobs;
+    std::string hal_library;               // empty if no HAL drivers are used
+    std::vector<std::string> link_flags;
+
+    /**
+     * @brief Record a file or directory whose change invalidates the plan
+     *
+     * The current modification time is captured; missing paths are recorded
+     * as missing, so creating them later invalidates the plan as well.
+     */
+    void AddInput(const std::string& path);
+
+    /** Files and directories the plan was derived from */
+    std::vector<std::string> GetInputPaths() const;
+
+    /** true if no input changed since the plan was created or loaded */
+    bool IsCurrent() const;
+
+    /**
+     * @brief Load a saved plan if it is still valid
+     * @param plan_file Path to plan.json
+     * @param settings Settings the plan must have been created with
+     * @return true if the plan was loaded and none of its inputs changed
+     */
+    bool Load(const std::string& plan_file, const std::string& settings);
+
+    /**
+     * @brief Save the plan
+     * @param plan_file Path to plan.json
+     * @param settings Settings the plan was created with
+     * @return true on success
+     */
+    bool Save(const std::string& plan_file, const std::string& settings) const;
+
+    /**
+     * @brief Read the jobs of a saved plan, current or not
+     *
+     * For reports about the last build, which only need to know where each
+     * object came from.
+     */
+    static bool ReadJobs(const std::string& plan_file, std::vector<CompileJob>& jobs);
+
+private:
+    struct Input {
+        std::string path;
+        long long mtime;  // -1 if the path did not exist
+    };
+    std::vector<Input> inputs_;
+
+    static long long GetModificationTime(const std::string& path);
+};
+
+/**
+ * @brief Write a compile_commands.json database for clangd and other tools
+ * @param path Output file
+ * @param directory Working directory recorded for every command
+ * @param commands One entry per translation unit
+ * @return true on success; the file is left untouched if unchanged
+ */
+bool WriteCompileCommands(const std::string& path,
+                          const std::string& directory,
+                          const std::vector<CompileCommand>& commands);
+
+} // namespace Lumos
@@ -0,0 +1,122 @@
+#include "build_trace.h"
+#include "json_util.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+std::string FormatSeconds(long long microseconds) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << (microseconds / 1e6) << " s";
+    return ss.str();
+}
+
+bool IsTranslationUnit(const std::string& category) {
+    return category == "compile" || category == "cache";
+}
+
+} // namespace
+
+BuildTrace::BuildTrace()
+    : enabled_(false)
+    , origin_(Clock::now())
+{
+}
+
+void BuildTrace::Enable() {
+    enabled_ = true;
+    origin_ = Clock::now();
+}
+
+void BuildTrace::Record(const std::string& name, const std::string& category,
+                        Clock::time_point start, Clock::time_point end) {
+    if (!enabled_) {
+        return;
+    }
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Lanes are numbered in order of first use; the main thread records first
+    auto lane = lanes_.emplace(std::this_thread::get_id(), static_cast<int>(lanes_.size())).first->second;
+    events_.push_back({name, category,
+                       duration_cast<microseconds>(start - origin_).count(),
+                       duration_cast<microseconds>(end - start).count(),
+                       lane});
+}
+
+bool BuildTrace::WriteChromeTrace(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::ostringstream ss;
+    ss << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (const auto& item : lanes_) {
+        int lane = item.second;
+        ss << (first ? "" : ",\n");
+        ss << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << lane
+           << ", \"args\": {\"name\": " << JsonString(lane == 0 ? "main" : "job " + std::to_string(lane)) << "}}";
+        first = false;
+    }
+    for (const auto& event : events_) {
+        ss << (first ? "" : ",\n");
+        ss << "  {\"name\": " << JsonString(event.name) << ", \"cat\": " << JsonString(event.category)
+           << ", \"ph\": \"X\", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us
+           << ", \"pid\": 1, \"tid\": " << event.lane << "}";
+        first = false;
+    }
+    ss << "\n]}\n";
+
+    return WriteFileAtomically(path, ss.str());
+}
+
+void BuildTrace::PrintSummary(size_t slowest) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (events_.empty()) {
+        return;
+    }
+
+    long long begin = events_.front().start_us;
+    long long end = 0;
+    std::map<std::string, std::pair<size_t, long long>> totals;  // category -> (steps, time)
+    std::vector<const Event*> units;
+    for (const auto& event : events_) {
+        begin = std::min(begin, event.start_us);
+        end = std::max(end, event.start_us + event.duration_us);
+        auto& total = totals[event.category];
+        total.first++;
+        total.second += event.duration_us;
+        if (IsTranslationUnit(event.category)) {
+            units.push_back(&event);
+        }
+    }
+
+    std::cout << "Build timings (" << FormatSeconds(end - begin) << " wall):" << std::endl;
+    for (const auto& item : totals) {
+        std::cout << "  " << std::left << std::setw(10) << item.first << std::right
+                  << std::setw(5) << item.second.first << " step(s) "
+                  << std::setw(10) << FormatSeconds(item.second.second) << std::endl;
+    }
+
+    if (units.empty()) {
+        return;
+    }
+
+    std::sort(units.begin(), units.end(), [](const Event* a, const Event* b) {
+        return a->duration_us > b->duration_us;
+    });
+    units.resize(std::min(units.size(), slowest));
+
+    std::cout << "Slowest translation units:" << std::endl;
+    for (const auto* unit : units) {
+        std::cout << "  " << std::setw(10) << FormatSeconds(unit->duration_us) << "  " << unit->name
+                  << (unit->category == "cache" ? " (cached)" : "") << std::endl;
+    }
+}
+
+} // namespace Lumos
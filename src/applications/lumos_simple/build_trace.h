@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Wall-clock timings of build steps (lumos build --timings)
+ *
+ * Steps can be recorded from any thread; each thread becomes one lane of
+ * the Chrome trace so parallel compile jobs show up side by side. Open
+ * the trace in chrome://tracing or https://ui.perfetto.dev.
+ */
+class BuildTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    BuildTrace();
+
+    /**
+     * @brief Start collecting; timestamps are relative to this call
+     */
+    void Enable();
+
+    bool IsEnabled() const { return enabled_; }
+
+    /**
+     * @brief Record a finished step (no-op while disabled)
+     * @param name Step name, e.g. the source file label
+     * @param category Step kind: compile, cache, pch, archive, link, ...
+     * @param start Time the step started
+     * @param end Time the step finished
+     */
+    void Record(const std::string& name, const std::string& category,
+                Clock::time_point start, Clock::time_point end);
+
+    /**
+     * @brief Write all steps in Chrome trace event format
+     * @return true on success
+     */
+    bool WriteChromeTrace(const std::string& path) const;
+
+    /**
+     * @brief Print per-category totals and the slowest translation units
+     * @param slowest Number of translation units to list
+     */
+    void PrintSummary(size_t slowest = 10) const;
+
+private:
+    struct Event {
+        std::string name;
+        std::string category;
+        long long start_us;
+        long long duration_us;
+        int lane;
+    };
+
+    bool enabled_;
+    Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::map<std::thread::id, int> lanes_;
+};
+
+} // namespace Lumos
@@ -1,35 +1,65 @@
 #include "builder.h"
+#include "cache_config.h"
+#include "interface_compiler.h"
+#include "board_pin_map.h"
+#include "job_pool.h"
+#include "json_util.h"
+#include "lumos_root.h"
+#include "depfile.h"
+#include "elf_file.h"
+#include "firmware_image.h"
+#include "object_cache.h"
+#include "process.h"
+#include "size_report.h"
 #include <iostream>
 #include <filesystem>
 #include <sstream>
 #include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <thread>
 #include <fstream>
-#include <yaml-cpp/yaml.h>
+
 
 namespace fs = std::filesystem;
 
 namespace Lumos {
 
+namespace {
+
+// HAL drivers per unity translation unit: few enough that a clean build
+// still compiles several in parallel
+const size_t kHALUnityBatch = 8;
+
+} // namespace
+
 Builder::Builder(const std::string& lumos_root)
-    : lumos_root_(lumos_root)
+    : lumos_root_(lumos_root),
+      resource_base_(Lumos::GetResourceBasePath(lumos_root))
 {
 }
 
 // Helper to get the correct base path for resources
 // Development: lumos_root/src/
 // Release: lumos_root/
+// Resolved once on construction; every path helper goes through here
 std::string Builder::GetResourceBasePath() const {
-    // Check if we have development structure (with src/)
-    fs::path dev_path = fs::path(lumos_root_) / "src" / "toolchains";
-    if (fs::exists(dev_path)) {
-        return lumos_root_ + "/src";
-    }
-    // Otherwise assume release structure (no src/)
-    return lumos_root_;
+    return resource_base_;
 }
 
 std::string Builder::GetToolchainPath() const {
-    return GetResourceBasePath() + "/toolchains/gcc-arm-none-eabi-10.3-2021.10/bin";
+    return toolchain_.bin_dir;
+}
+
+std::string Builder::GetHostCompiler(bool cxx) const {
+    const char* env = std::getenv(cxx ? "CXX" : "CC");
+    if (env != nullptr && env[0] != '\0') {
+        return env;
+    }
+    return cxx ? "g++" : "gcc";
 }
 
 std::string Builder::GetPlatformPath(const std::string& platform) const {
@@ -50,17 +80,30 @@ std::string Builder::GetBoardPath(const std::string& board_name) const {
     return GetResourceBasePath() + "/boards/" + board_dir;
 }
 
-std::vector<std::string> Builder::GetIncludePaths(const BoardConfig& board, const std::string& project_dir) const {
+std::vector<std::string> Builder::GetIncludePaths(const BoardConfig& board, const std::string& project_dir,
+                                                  bool project_includes) const {
     std::string platform_path = GetPlatformPath(board.platform);
 
     std::vector<std::string> includes;
 
     // Add project include directory if it exists
     std::string project_include = project_dir + "/include";
-    if (fs::exists(project_include)) {
+    if (project_includes && fs::exists(project_include)) {
         includes.push_back(project_include);
     }
 
+    // Extra directories listed in project.yaml, e.g. headers of sources
+    // that live outside the project
+    if (project_includes) {
+        includes.insert(includes.end(), include_dirs_.begin(), include_dirs_.end());
+    }
+
+    // Headers generated from the project's interface files
+    std::string generated_include = output_dir_ + "/generated";
+    if (project_includes && fs::exists(generated_include)) {
+        includes.push_back(generated_include);
+    }
+
     // Add board-specific directory for board headers
     std::string board_path = GetBoardPath(board.name);
     if (fs::exists(board_path)) {
@@ -73,6 +116,14 @@ std::vector<std::string> Builder::GetIncludePaths(const BoardConfig& board, cons
         includes.push_back(wrapper_path);
     }
 
+    // The host board's headers stand in for the wrapper's; its Serial runs
+    // over the serial module, and there is no CMSIS, HAL or middleware
+    if (board.IsHost()) {
+        includes.push_back(GetResourceBasePath() + "/modules/serial");
+        includes.push_back(GetResourceBasePath() + "/framework");
+        return includes;
+    }
+
     includes.push_back(platform_path + "/Drivers/CMSIS/Include");
 
     // Add platform-specific CMSIS device include
@@ -93,26 +144,131 @@ std::vector<std::string> Builder::GetIncludePaths(const BoardConfig& board, cons
         includes.push_back(platform_path + "/Drivers/STM32G4xx_HAL_Driver/Inc");
     }
 
-    // Add USB Middleware includes if needed
-    includes.push_back(platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Core/Inc");
-    includes.push_back(platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Inc");
+    // Middleware headers only for the modules that use them: usb.h and
+    // filesystem.h compile without them (no CDC device, no FatFs)
+    auto uses = [this](const char* module) {
+        return std::find(hal_modules_.begin(), hal_modules_.end(), module) != hal_modules_.end();
+    };
+    if (uses("pcd")) {
+        includes.push_back(platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Core/Inc");
+        includes.push_back(platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Inc");
+    }
+
+    // FatFs for filesystem.h (configured by the wrapper's ffconf.h)
+    if (uses("sd") || uses("sdmmc")) {
+        includes.push_back(platform_path + "/Middlewares/Third_Party/FatFs/src");
+    }
+
+    // CMSIS-DSP for the framework's dsp_pipeline.h; PrivateInclude is only
+    // in packages that ship the library as sources
+    if (dsp_) {
+        includes.push_back(platform_path + "/Drivers/CMSIS/DSP/Include");
+        if (fs::exists(platform_path + "/Drivers/CMSIS/DSP/PrivateInclude")) {
+            includes.push_back(platform_path + "/Drivers/CMSIS/DSP/PrivateInclude");
+        }
+    }
+
+    // Framework headers (message_bus.h and sync.h work without an RTOS)
+    includes.push_back(GetResourceBasePath() + "/framework");
+
+    // FreeRTOS for the framework's RtosExecutor (configured by the
+    // wrapper's FreeRTOSConfig.h)
+    if (!rtos_.empty()) {
+        includes.push_back(platform_path + "/Middlewares/Third_Party/FreeRTOS/Source/include");
+        includes.push_back(GetFreeRTOSPortPath(board));
+    }
 
     return includes;
 }
 
 std::vector<std::string> Builder::GetDefines(const BoardConfig& board) const {
-    return {
+    if (board.IsHost()) {
+        std::vector<std::string> host_defines = {"LUMOS_HOST"};
+        if (event_loop_) {
+            host_defines.push_back("LUMOS_EVENT_LOOP");
+        }
+        return host_defines;
+    }
+
+    std::vector<std::string> defines = {
         board.mcu,
         "USE_HAL_DRIVER"
     };
+
+    if (scope_trace_) {
+        defines.push_back("LUMOS_TRACE");
+    }
+
+    if (fast_libc_) {
+        defines.push_back("LUMOS_FAST_LIBC");
+    }
+
+    if (event_loop_) {
+        defines.push_back("LUMOS_EVENT_LOOP");
+    }
+
+    // Cortex-M0+ microsecond time base (wrapper/sys.cpp); the other cores
+    // use the DWT cycle counter and ignore these
+    if (us_timers_.size() == 2) {
+        defines.push_back("LUMOS_US_TIMER_LOW=" + us_timers_[0]);
+        defines.push_back("LUMOS_US_TIMER_HIGH=" + us_timers_[1]);
+    }
+
+    // Older arm_math.h versions need the core named; newer ones read it
+    // from the compiler and ignore these
+    if (dsp_) {
+        defines.push_back("LUMOS_DSP");
+        if (board.cpu == "cortex-m7") {
+            defines.push_back("ARM_MATH_CM7");
+        } else if (board.cpu == "cortex-m4") {
+            defines.push_back("ARM_MATH_CM4");
+        } else if (board.cpu == "cortex-m0plus") {
+            defines.push_back("ARM_MATH_CM0PLUS");
+        } else if (board.cpu == "cortex-m33") {
+            defines.push_back("ARM_MATH_ARMV8MML");
+        }
+    }
+
+    if (rtos_ == "freertos") {
+        defines.push_back("LUMOS_RTOS_FREERTOS");
+        defines.push_back("LUMOS_RTOS_STACK_POOL_WORDS=" + std::to_string(rtos_stack_pool_));
+        defines.push_back("LUMOS_RTOS_DEFAULT_STACK_WORDS=" + std::to_string(rtos_default_stack_));
+    }
+
+    return defines;
+}
+
+std::vector<std::string> Builder::GetBoardModuleDefines(const std::vector<std::string>& hal_modules) const {
+    // LUMOS_BOARD_MODULES tells board files the list is known; without it
+    // (other build flows) they define everything
+    std::vector<std::string> defines = {"LUMOS_BOARD_MODULES"};
+    for (const auto& module : hal_modules) {
+        std::string name = module;
+        for (auto& c : name) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        defines.push_back("LUMOS_HAL_" + name);
+    }
+    return defines;
 }
 
 std::vector<std::string> Builder::GetCompilerFlags(const BoardConfig& board) const {
+    if (board.IsHost()) {
+        // Exceptions and RTTI stay on: host builds catch app exceptions
+        std::vector<std::string> flags = {"-Wall", "-pthread"};
+        for (const auto& flag : ProjectConfig::GetProfileFlags(profile_)) {
+            flags.push_back(flag);
+        }
+        if (lto_) {
+            flags.push_back("-flto");
+        }
+        return flags;
+    }
+
     std::vector<std::string> flags = {
         "-mcpu=" + board.cpu,
         "-mthumb",
         "-mfloat-abi=" + board.float_abi,
-        "-O0",
         "-Wall",
         "-ffunction-sections",
         "-fdata-sections",
@@ -125,6 +281,15 @@ std::vector<std::string> Builder::GetCompilerFlags(const BoardConfig& board) con
         flags.push_back("-mfpu=" + board.fpu);
     }
 
+    // Optimization level from the build profile
+    for (const auto& flag : ProjectConfig::GetProfileFlags(profile_)) {
+        flags.push_back(flag);
+    }
+
+    if (lto_) {
+        flags.push_back("-flto");
+    }
+
     return flags;
 }
 
@@ -237,7 +402,7 @@ std::string Builder::GetSystemFile(const BoardConfig& board) const {
     return "";
 }
 
-std::vector<std::string> Builder::GetBoardSupportFiles(const BoardConfig& board) const {
+std::vector<std::string> Builder::GetBoardSupportFiles(const BoardConfig& board, const ProjectConfig& project) const {
     std::vector<std::string> board_files;
     std::string board_path = GetBoardPath(board.name);
 
@@ -265,15 +430,38 @@ std::vector<std::string> Builder::GetBoardSupportFiles(const BoardConfig& board)
         std::cerr << "Error scanning board directory: " << ec.message() << std::endl;
     }
 
-    // Also scan wrapper directory for generic peripheral implementations
+    // The host board implements the peripherals itself
+    if (board.IsHost()) {
+        std::vector<std::string> serial_files = GetHostSerialFiles();
+        board_files.insert(board_files.end(), serial_files.begin(), serial_files.end());
+        return board_files;
+    }
+
+    // Also scan wrapper directory for generic peripheral implementations.
+    // With wrappers: auto, those for HAL modules outside the build are left
+    // out: --gc-sections would drop their code anyway, but not before they
+    // were compiled, and not their interrupt handlers
     std::string wrapper_path = GetResourceBasePath() + "/wrapper";
+    std::vector<std::string> skipped;
     if (fs::exists(wrapper_path)) {
         std::error_code wrapper_ec;
         for (const auto& entry : fs::directory_iterator(wrapper_path, wrapper_ec)) {
             if (entry.is_regular_file()) {
                 std::string extension = entry.path().extension().string();
-                if (extension == ".c" || extension == ".cpp") {
+                if (extension != ".c" && extension != ".cpp") {
+                    continue;
+                }
+                std::string stem = entry.path().stem().string();
+                std::vector<std::string> modules = ProjectConfig::GetWrapperModules(stem);
+                bool needed = project.wrappers != "auto" || modules.empty();
+                for (const auto& module : modules) {
+                    needed = needed || std::find(project.hal_modules.begin(), project.hal_modules.end(),
+                                                 module) != project.hal_modules.end();
+                }
+                if (needed) {
                     board_files.push_back(entry.path().string());
+                } else {
+                    skipped.push_back(stem);
                 }
             }
         }
@@ -281,11 +469,38 @@ std::vector<std::string> Builder::GetBoardSupportFiles(const BoardConfig& board)
             std::cerr << "Error scanning wrapper directory: " << wrapper_ec.message() << std::endl;
         }
     }
+    if (!skipped.empty()) {
+        std::sort(skipped.begin(), skipped.end());
+        std::cout << "Wrappers not used by the HAL modules: ";
+        for (size_t i = 0; i < skipped.size(); ++i) {
+            std::cout << (i > 0 ? ", " : "") << skipped[i];
+        }
+        std::cout << std::endl;
+    }
 
     return board_files;
 }
 
+std::vector<std::string> Builder::GetHostSerialFiles() const {
+    // The serial module (as in lumos itself) for host Serial ports
+    std::string serial_path = GetResourceBasePath() + "/modules/serial";
+    return {
+        serial_path + "/serial_common.cpp",
+#if defined(_WIN32)
+        serial_path + "/serial_windows.cpp"
+#elif defined(__APPLE__)
+        serial_path + "/serial_mac.cpp"
+#else
+        serial_path + "/serial_linux.cpp"
+#endif
+    };
+}
+
 std::vector<std::string> Builder::GetRequiredHALFiles(const BoardConfig& board, const std::vector<std::string>& hal_modules) const {
+    if (board.IsHost()) {
+        return {};
+    }
+
     std::string platform_path = GetPlatformPath(board.platform);
     std::string hal_driver_path;
     std::string prefix;
@@ -342,12 +557,24 @@ std::vector<std::string> Builder::GetRequiredHALFiles(const BoardConfig& board,
                 hal_files.push_back(ll_usb_file);
             }
         }
+
+        // Special case: SD module needs the LL SDMMC command layer
+        if (module == "sd") {
+            std::string ll_sdmmc_file = hal_driver_path + "/" + prefix.substr(0, prefix.find("_hal")) + "_ll_sdmmc.c";
+            if (fs::exists(ll_sdmmc_file)) {
+                hal_files.push_back(ll_sdmmc_file);
+            }
+        }
     }
 
     return hal_files;
 }
 
 std::vector<std::string> Builder::GetUSBMiddlewareFiles(const BoardConfig& board) const {
+    if (board.IsHost()) {
+        return {};
+    }
+
     std::string platform_path = GetPlatformPath(board.platform);
     std::string usb_core_path = platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Core/Src";
     std::string usb_cdc_path = platform_path + "/Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Src";
@@ -364,34 +591,183 @@ std::vector<std::string> Builder::GetUSBMiddlewareFiles(const BoardConfig& board
     return usb_files;
 }
 
-std::vector<std::string> Builder::GetLinkerFlags(const BoardConfig& board, const std::string& project_dir) const {
+std::vector<std::string> Builder::GetFatFsFiles(const BoardConfig& board) const {
+    if (board.IsHost()) {
+        return {};
+    }
+
+    std::string fatfs_path = GetPlatformPath(board.platform) + "/Middlewares/Third_Party/FatFs/src";
+
+    // Only the core: ffconf.h disables long file names, so no code page
+    // tables, and the disk I/O layer is the wrapper's filesystem.cpp
     return {
+        fatfs_path + "/ff.c"
+    };
+}
+
+std::string Builder::GetFreeRTOSPortPath(const BoardConfig& board) const {
+    std::string portable_path = GetPlatformPath(board.platform) + "/Middlewares/Third_Party/FreeRTOS/Source/portable/GCC";
+
+    // The Cortex-M7 in the H7 is r1p1 or later, which uses the plain M4F port
+    if (board.cpu == "cortex-m0plus") {
+        return portable_path + "/ARM_CM0";
+    } else if (board.cpu == "cortex-m33") {
+        return portable_path + "/ARM_CM33_NTZ/non_secure";
+    }
+    return portable_path + "/ARM_CM4F";
+}
+
+std::vector<std::string> Builder::GetFreeRTOSFiles(const BoardConfig& board) const {
+    std::string source_path = GetPlatformPath(board.platform) + "/Middlewares/Third_Party/FreeRTOS/Source";
+    std::string port_path = GetFreeRTOSPortPath(board);
+
+    // Kernel and port only: everything is statically allocated, so no
+    // heap_*.c, and software timers are disabled in FreeRTOSConfig.h
+    std::vector<std::string> files = {
+        source_path + "/tasks.c",
+        source_path + "/queue.c",
+        source_path + "/list.c",
+        port_path + "/port.c"
+    };
+    if (board.cpu == "cortex-m33") {
+        files.push_back(port_path + "/portasm.c");
+    }
+    return files;
+}
+
+std::string Builder::GetDspLibrary(const BoardConfig& board) const {
+    // Named by core, l(ittle endian), f(loat ABI) and FPU precision
+    const bool hard = board.float_abi == "hard";
+    std::string name;
+    if (board.cpu == "cortex-m7") {
+        name = !hard ? "cortexM7l" : board.fpu == "fpv5-d16" ? "cortexM7lfdp" : "cortexM7lfsp";
+    } else if (board.cpu == "cortex-m4") {
+        name = hard ? "cortexM4lf" : "cortexM4l";
+    } else if (board.cpu == "cortex-m0plus") {
+        name = "cortexM0l";
+    } else if (board.cpu == "cortex-m33" && hard) {
+        name = "ARMv8MMLldfsp";
+    } else {
+        return "";
+    }
+    std::string library = GetPlatformPath(board.platform) + "/Drivers/CMSIS/DSP/Lib/GCC/libarm_" + name + "_math.a";
+    return fs::exists(library) ? library : "";
+}
+
+std::vector<std::string> Builder::GetDspFiles(const BoardConfig& board) const {
+    // Packages without prebuilt libraries have one source per function
+    // group that includes all of the group's functions; the groups
+    // dsp_pipeline.h draws on, the rest is dropped by --gc-sections anyway
+    std::string source_path = GetPlatformPath(board.platform) + "/Drivers/CMSIS/DSP/Source";
+    std::vector<std::string> files;
+    for (const char* group : {"BasicMathFunctions", "CommonTables", "ComplexMathFunctions", "FastMathFunctions",
+                              "FilteringFunctions", "SupportFunctions", "TransformFunctions"}) {
+        files.push_back(source_path + "/" + group + "/" + group + ".c");
+    }
+    return files;
+}
+
+std::vector<std::string> Builder::GetFrameworkFiles() const {
+    std::string framework_path = GetResourceBasePath() + "/framework";
+    // Heap- and iostream-free on the device; what a project does not use
+    // is dropped by --gc-sections
+    std::vector<std::string> files = {
+        framework_path + "/application.cpp",
+        framework_path + "/scheduler.cpp",
+        framework_path + "/logging.cpp",
+        framework_path + "/transport.cpp",
+        framework_path + "/time_sync.cpp",
+        framework_path + "/dma_pool.cpp",
+        framework_path + "/stats_endpoint.cpp",
+        framework_path + "/power_tracker.cpp"
+    };
+
+    // Apps as tasks
+    if (!rtos_.empty()) {
+        files.push_back(framework_path + "/rtos_executor.cpp");
+    }
+
+    // The settings store, with the flash wrapper and HAL module it needs
+    if (std::find(hal_modules_.begin(), hal_modules_.end(), "flash") != hal_modules_.end()) {
+        files.push_back(framework_path + "/settings_store.cpp");
+    }
+    return files;
+}
+
+std::vector<std::string> Builder::GetLinkerFlags(const BoardConfig& board, const std::string& project_dir) const {
+    (void)project_dir;
+    if (board.IsHost()) {
+        std::vector<std::string> flags = {"-pthread", "-lm"};
+        if (lto_) {
+            flags.push_back("-flto");
+            for (const auto& flag : ProjectConfig::GetProfileFlags(profile_)) {
+                flags.push_back(flag);
+            }
+        }
+        return flags;
+    }
+
+    std::vector<std::string> flags = {
         "-mcpu=" + board.cpu,
         "-mthumb",
         "-mfloat-abi=" + board.float_abi,
         "-T" + GetLinkerScript(board),
         "-Wl,--gc-sections",
-        "-Wl,-Map=" + project_dir + "/build/firmware.map",
+        "-Wl,-Map=" + build_dir_ + "/firmware.map",
         "-specs=nano.specs",
-        "-specs=nosys.specs",
-        "-lc",
-        "-lm",
-        "-lnosys"
+        "-specs=nosys.specs"
     };
+
+    // Ahead of libm, which it calls into
+    const std::string dsp_library = dsp_ ? GetDspLibrary(board) : "";
+    if (!dsp_library.empty()) {
+        flags.push_back(dsp_library);
+    }
+    flags.insert(flags.end(), {"-lc", "-lm", "-lnosys"});
+
+    // LTO runs the optimizer again at link time, so it needs the same
+    // optimization level and FPU settings as the compile step
+    if (lto_) {
+        flags.push_back("-flto");
+        if (board.float_abi == "hard" && !board.fpu.empty()) {
+            flags.push_back("-mfpu=" + board.fpu);
+        }
+        for (const auto& flag : ProjectConfig::GetProfileFlags(profile_)) {
+            flags.push_back(flag);
+        }
+    }
+
+    return flags;
 }
 
-bool Builder::RunCommand(const std::string& command) const {
-    std::cout << "Running: " << command << std::endl;
-    int result = system(command.c_str());
-    return result == 0;
+bool Builder::RunCommand(const std::vector<std::string>& command, const std::string& response_file) const {
+    std::string output;
+    bool success = RunCommand(command, output, response_file);
+    std::cout << output << std::flush;
+    return success;
 }
 
-bool Builder::CompileFile(const std::string& source_file,
-                         const std::string& output_file,
-                         const BoardConfig& board,
-                         const std::string& project_dir) const {
+// Run a command and capture its stdout/stderr instead of writing to the
+// console, so parallel jobs can print their logs as one block
+bool Builder::RunCommand(const std::vector<std::string>& command, std::string& output,
+                         const std::string& response_file, size_t program_args) const {
+    output += "Running: " + Process::ToString(command) + "\n";
+
+    ProcessResult result = Process::Run(command, response_file, program_args);
+    output += result.output;
+    if (!result.Succeeded()) {
+        output += "Error: " + fs::path(command.front()).filename().string() + " " + result.Describe() + "\n";
+        return false;
+    }
+    return true;
+}
+
+bool Builder::GetCompilerInvocation(const std::string& source_file,
+                                    const BoardConfig& board,
+                                    const std::string& project_dir,
+                                    CompilerInvocation& inv,
+                                    bool project_includes) const {
     std::string toolchain = GetToolchainPath();
-    std::string compiler;
 
     // Helper lambda for ends_with (C++17 compatible)
     auto ends_with = [](const std::string& str, const std::string& suffix) {
@@ -400,237 +776,802 @@ bool Builder::CompileFile(const std::string& source_file,
     };
 
     // Choose compiler based on file extension
-    if (ends_with(source_file, ".c")) {
-        compiler = toolchain + "/arm-none-eabi-gcc";
+    if (board.IsHost()) {
+        if (ends_with(source_file, ".c")) {
+            inv.compiler = GetHostCompiler(false);
+        } else if (ends_with(source_file, ".cpp") || ends_with(source_file, ".cc")) {
+            inv.compiler = GetHostCompiler(true);
+        } else {
+            return false;
+        }
+    } else if (ends_with(source_file, ".c")) {
+        inv.compiler = toolchain + "/arm-none-eabi-gcc";
     } else if (ends_with(source_file, ".cpp") || ends_with(source_file, ".cc")) {
-        compiler = toolchain + "/arm-none-eabi-g++";
+        inv.compiler = toolchain + "/arm-none-eabi-g++";
     } else if (ends_with(source_file, ".s") || ends_with(source_file, ".S")) {
-        compiler = toolchain + "/arm-none-eabi-gcc";
+        inv.compiler = toolchain + "/arm-none-eabi-gcc";
     } else {
-        std::cerr << "Unknown file type: " << source_file << std::endl;
         return false;
     }
 
-    std::ostringstream cmd;
-    cmd << compiler << " -c " << source_file << " -o " << output_file;
+    inv.codegen_flags.clear();
+    inv.preprocessor_flags.clear();
 
     // Add compiler flags (skip for assembly)
     if (!ends_with(source_file, ".s") && !ends_with(source_file, ".S")) {
-        for (const auto& flag : GetCompilerFlags(board)) {
-            cmd << " " << flag;
+        inv.codegen_flags = GetCompilerFlags(board);
+
+        // GCC 10 (the bundled toolchain) only enables coroutines with
+        // -fcoroutines; later g++ and clang do so under -std=c++20
+        const bool cxx = ends_with(source_file, ".cpp") || ends_with(source_file, ".cc");
+        if (cxx && cxx_standard_ != 0) {
+            inv.codegen_flags.push_back("-std=gnu++" + std::to_string(cxx_standard_));
+            if (cxx_standard_ >= 20 && !board.IsHost() && toolchain_.GetMajorVersion() < 11) {
+                inv.codegen_flags.push_back("-fcoroutines");
+            }
         }
 
         // Add defines
         for (const auto& define : GetDefines(board)) {
-            cmd << " -D" << define;
+            inv.preprocessor_flags.push_back("-D" + define);
         }
 
         // Add include paths
-        for (const auto& include : GetIncludePaths(board, project_dir)) {
-            cmd << " -I" << include;
+        for (const auto& include : GetIncludePaths(board, project_dir, project_includes)) {
+            inv.preprocessor_flags.push_back("-I" + include);
         }
 
         // Automatically include lumos.h for user convenience
         std::string board_path = GetBoardPath(board.name);
         std::string lumos_header = board_path + "/lumos.h";
         if (fs::exists(lumos_header)) {
-            cmd << " -include " << lumos_header;
+            inv.force_include = lumos_header;
         }
     } else {
         // Assembly files just need basic flags
-        cmd << " -mcpu=" << board.cpu << " -mthumb";
+        inv.codegen_flags = {"-mcpu=" + board.cpu, "-mthumb"};
     }
 
-    return RunCommand(cmd.str());
+    // Lowercase .s is assembled without running the preprocessor
+    inv.preprocess = !ends_with(source_file, ".s");
+    return true;
 }
 
-bool Builder::LinkFiles(const std::vector<std::string>& object_files,
-                       const std::string& output_elf,
-                       const BoardConfig& board,
-                       const std::string& project_dir) const {
-    std::string toolchain = GetToolchainPath();
-    std::string linker = toolchain + "/arm-none-eabi-g++";
-
-    std::ostringstream cmd;
-    cmd << linker;
-
-    // Add all object files
-    for (const auto& obj : object_files) {
-        cmd << " " << obj;
+std::vector<std::string> Builder::GetCompileCommand(const std::string& source_file,
+                                                    const std::string& output_file,
+                                                    const CompilerInvocation& inv) const {
+    std::vector<std::string> cmd = {inv.compiler, "-c", source_file, "-o", output_file};
+    cmd.insert(cmd.end(), inv.codegen_flags.begin(), inv.codegen_flags.end());
+    cmd.insert(cmd.end(), inv.preprocessor_flags.begin(), inv.preprocessor_flags.end());
+
+    // Force-include lumos.h, through its precompiled wrapper when available
+    if (!inv.pch_header.empty()) {
+        cmd.insert(cmd.end(), {"-include", inv.pch_header, "-Winvalid-pch"});
+    } else if (!inv.force_include.empty()) {
+        cmd.insert(cmd.end(), {"-include", inv.force_include});
     }
 
-    cmd << " -o " << output_elf;
-
-    // Add linker flags
-    for (const auto& flag : GetLinkerFlags(board, project_dir)) {
-        cmd << " " << flag;
+    // Emit a depfile next to the object for incremental rebuilds
+    if (inv.preprocess) {
+        cmd.insert(cmd.end(), {"-MMD", "-MP", "-MF", fs::path(output_file).replace_extension(".d").string()});
     }
 
-    return RunCommand(cmd.str());
+    return cmd;
 }
 
-bool Builder::CreateBinary(const std::string& elf_file, const std::string& bin_file) const {
-    std::string toolchain = GetToolchainPath();
-    std::string objcopy = toolchain + "/arm-none-eabi-objcopy";
-
-    std::ostringstream cmd;
-    cmd << objcopy << " -O binary " << elf_file << " " << bin_file;
-
-    return RunCommand(cmd.str());
-}
+std::string Builder::GetCacheKey(const std::string& source_file,
+                                 const std::string& output_file,
+                                 const CompilerInvocation& inv) const {
+    std::string content;
+
+    if (inv.preprocess) {
+        // Preprocess to a temporary file; this also writes the depfile so a
+        // cache hit leaves the object just as incremental tracking expects
+        std::string preprocessed = output_file + ".i";
+        std::vector<std::string> cmd = {inv.compiler, "-E", source_file, "-o", preprocessed};
+        cmd.insert(cmd.end(), inv.codegen_flags.begin(), inv.codegen_flags.end());
+        cmd.insert(cmd.end(), inv.preprocessor_flags.begin(), inv.preprocessor_flags.end());
+        // Hash the real header, not the per-project PCH wrapper, so the key
+        // stays the same across projects
+        if (!inv.force_include.empty()) {
+            cmd.insert(cmd.end(), {"-include", inv.force_include});
+        }
+        cmd.insert(cmd.end(), {"-MMD", "-MP", "-MT", output_file,
+                               "-MF", fs::path(output_file).replace_extension(".d").string()});
 
-std::string Builder::PromptLanguage() const {
-    std::cout << "\nNo main.c or main.cpp found in project directory." << std::endl;
-    std::cout << "Select programming language:" << std::endl;
-    std::cout << "  1. C++" << std::endl;
-    std::cout << "  2. C" << std::endl;
-    std::cout << "Enter choice [1-2]: ";
+        std::string pp_output;
+        if (!RunCommand(cmd, pp_output)) {
+            // Let the real compile report the error
+            return "";
+        }
 
-    std::string input;
-    std::getline(std::cin, input);
+        std::ifstream file(preprocessed, std::ios::binary);
+        std::ostringstream ss;
+        ss << file.rdbuf();
+        content = ss.str();
+        file.close();
 
-    if (input == "2") {
-        return "C";
+        std::error_code ec;
+        fs::remove(preprocessed, ec);
+    } else {
+        std::ifstream file(source_file, std::ios::binary);
+        if (!file.is_open()) {
+            return "";
+        }
+        std::ostringstream ss;
+        ss << file.rdbuf();
+        content = ss.str();
     }
-    // Default to C++
-    return "C++";
+
+    // An upgrade in place keeps the compiler's path, not its version
+    std::string compiler = host_ ? inv.compiler : inv.compiler + " " + toolchain_.version;
+    return ObjectCache::MakeKey(compiler, Process::ToString(inv.codegen_flags), content);
 }
 
-bool Builder::GenerateMainFile(const std::string& language, const std::string& project_dir) const {
-    std::string filename = (language == "C") ? "main.c" : "main.cpp";
-    fs::path main_path = fs::path(project_dir) / filename;
+bool Builder::CompileFile(const std::string& source_file,
+                         const std::string& output_file,
+                         const CompilerInvocation& inv,
+                         const std::vector<std::string>& command,
+                         bool& cache_hit,
+                         std::string& output) const {
+    // Drop the old stamp first so a failed compile is never considered up to date
+    std::string stamp = output_file + ".cmd";
+    std::error_code ec;
+    fs::remove(stamp, ec);
+    // Sources in project subdirectories keep them under the build directory
+    fs::create_directories(fs::path(output_file).parent_path(), ec);
+
+    cache_hit = false;
+    std::string key;
+    if (object_cache_.IsEnabled()) {
+        key = GetCacheKey(source_file, output_file, inv);
+        if (!key.empty() && object_cache_.Fetch(key, output_file)) {
+            cache_hit = true;
+            WriteCommandStamp(stamp, Process::ToString(command));
+            return true;
+        }
+    }
 
-    std::ofstream file(main_path);
-    if (!file.is_open()) {
-        std::cerr << "Error: Failed to create " << filename << std::endl;
+    // The launcher (ccache, sccache, distcc) only changes where and how the
+    // object is produced, so it stays out of the stamp and cache key
+    std::vector<std::string> launched = compiler_launcher_;
+    launched.insert(launched.end(), command.begin(), command.end());
+    if (!RunCommand(launched, output, output_file + ".rsp", compiler_launcher_.size() + 1)) {
         return false;
     }
 
-    const std::string loop_declaration = (language == "C") ? "void loop(void);" : "void loop();";
-    const std::string setup_declaration = (language == "C") ? "void setup(void);" : "void setup();";
+    if (!key.empty()) {
+        object_cache_.Store(key, output_file);
+    }
 
-    file << "/**\n";
-    file << " * Main application file\n";
-    file << " * This is where the setup() and loop() functions are defined\n";
-    file << " */\n\n";
-    file << "/**\n";
-    file << " * Setup function - called once at startup\n";
-    file << " */\n";
-    file << setup_declaration << "\n";
-    file << "{\n";
-    file << "    // Initialize your application here\n";
-    file << "    // - Configure GPIO pins\n";
-    file << "    // - Initialize UART, SPI, I2C, etc.\n";
-    file << "    // - Set up timers\n";
-    file << "}\n\n";
-    file << "/**\n";
-    file << " * Loop function - called repeatedly\n";
-    file << " */\n";
-    file << loop_declaration << "\n";
-    file << "{\n";
-    file << "    // Your main application logic here\n";
-    file << "    // This function runs continuously\n";
-    file << "}\n";
+    WriteCommandStamp(stamp, Process::ToString(command));
+    return true;
+}
 
-    file.close();
+bool Builder::WriteUnitySource(const CompileJob& job) const {
+    std::string content = "/* Generated by lumos: HAL unity build */\n";
+    for (const auto& member : job.unity_sources) {
+        content += "#include \"" + fs::path(member).generic_string() + "\"\n";
+    }
 
-    std::cout << "Created " << filename << std::endl;
-    return true;
+    // Rewritten only when the batch changes, so the object stays up to date
+    std::ifstream existing(job.source, std::ios::binary);
+    if (existing.is_open()) {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == content) {
+            return true;
+        }
+    }
+    return WriteFileAtomically(job.source, content);
 }
 
-bool Builder::CheckAndCreateMainFile(const std::string& project_dir, ProjectConfig& project) {
-    fs::path main_c = fs::path(project_dir) / "main.c";
-    fs::path main_cpp = fs::path(project_dir) / "main.cpp";
+bool Builder::CompileUnityMembers(const CompileJob& job, const CompilerInvocation& inv,
+                                  std::string& output) const {
+    std::vector<std::string> objects;
+    for (const auto& member : job.unity_sources) {
+        std::string object = fs::path(job.object).parent_path().string() + "/" +
+                             fs::path(member).stem().string() + ".o";
+        std::vector<std::string> command = GetCompileCommand(member, object, inv);
+        objects.push_back(object);
+        if (IsObjectUpToDate(member, object, Process::ToString(command))) {
+            continue;
+        }
+        bool cache_hit = false;
+        if (!CompileFile(member, object, inv, command, cache_hit, output)) {
+            return false;
+        }
+    }
 
-    bool main_c_exists = fs::exists(main_c);
-    bool main_cpp_exists = fs::exists(main_cpp);
-    std::string main_file;
-    std::string language;
+    // Partially linked into the unity object, so the archive has the same
+    // members either way. Plain ld without the LTO plugin keeps each
+    // driver's LTO sections intact for the final link.
+    std::vector<std::string> cmd = {GetToolchainPath() + "/arm-none-eabi-ld", "-r"};
+    cmd.insert(cmd.end(), objects.begin(), objects.end());
+    cmd.insert(cmd.end(), {"-o", job.object});
+    return RunCommand(cmd, output, job.object + ".rsp");
+}
 
-    // Check if we need to create a main file
-    if (!main_c_exists && !main_cpp_exists) {
-        // No main file found, prompt user for language
-        language = PromptLanguage();
+std::string Builder::GetPrecompiledHeader(const std::string& source_file) const {
+    std::string ext = fs::path(source_file).extension().string();
+    if (ext == ".c") {
+        return pch_c_;
+    } else if (ext == ".cpp" || ext == ".cc") {
+        return pch_cxx_;
+    }
+    return "";
+}
 
-        // Generate the main file
-        if (!GenerateMainFile(language, project_dir)) {
-            return false;
+bool Builder::PreparePrecompiledHeaders(const BuildPlan& plan) {
+    pch_c_.clear();
+    pch_cxx_.clear();
+
+    // Any C or C++ job that sees the project includes gives the flag set
+    // for its language
+    const CompilerInvocation* c_inv = nullptr;
+    const CompilerInvocation* cxx_inv = nullptr;
+    for (const auto& job : plan.jobs) {
+        if (!job.project_includes || job.inv.force_include.empty()) {
+            continue;
+        }
+        std::string ext = fs::path(job.source).extension().string();
+        if (ext == ".c" && c_inv == nullptr) {
+            c_inv = &job.inv;
+        } else if ((ext == ".cpp" || ext == ".cc") && cxx_inv == nullptr) {
+            cxx_inv = &job.inv;
         }
+    }
 
-        main_file = (language == "C") ? "main.c" : "main.cpp";
+    struct PchJob {
+        std::string language;
+        const CompilerInvocation* inv;
+        std::string header;
+        std::string* result;
+        bool ok;
+    };
+    std::vector<PchJob> pch_jobs;
+    if (c_inv != nullptr) {
+        pch_jobs.push_back({"c-header", c_inv, build_dir_ + "/pch/c/lumos.h", &pch_c_, false});
+    }
+    if (cxx_inv != nullptr) {
+        pch_jobs.push_back({"c++-header", cxx_inv, build_dir_ + "/pch/cxx/lumos.h", &pch_cxx_, false});
+    }
+    if (pch_jobs.empty()) {
+        // Board has no lumos.h, nothing to precompile
+        return true;
+    }
 
-        // If auto-discovery was used, reload the sources
-        YAML::Node config = YAML::LoadFile(project_dir + "/project.yaml");
-        if (!config["sources"]) {
-            // Re-scan for sources since we just created a new file
-            std::cout << "Re-scanning for source files..." << std::endl;
-            project.sources.clear();
+    std::vector<JobPool::Job> pool_jobs;
+    for (auto& job : pch_jobs) {
+        pool_jobs.push_back([this, &job](std::string& output) {
+            std::string gch = job.header + ".gch";
+            std::vector<std::string> cmd = {job.inv->compiler, "-x", job.language, job.header, "-o", gch};
+            cmd.insert(cmd.end(), job.inv->codegen_flags.begin(), job.inv->codegen_flags.end());
+            cmd.insert(cmd.end(), job.inv->preprocessor_flags.begin(), job.inv->preprocessor_flags.end());
+            cmd.insert(cmd.end(), {"-MMD", "-MP", "-MF", fs::path(gch).replace_extension(".d").string()});
+            std::string cmd_line = Process::ToString(cmd);
+
+            if (fs::exists(job.header) && IsObjectUpToDate(job.header, gch, cmd_line)) {
+                job.ok = true;
+                return true;
+            }
 
+            // GCC picks up lumos.h.gch next to the wrapper and falls back to
+            // the wrapper's text if the PCH can't be used. Rewriting the
+            // wrapper also bumps its mtime so dependent objects rebuild.
             std::error_code ec;
-            for (const auto& entry : fs::directory_iterator(project_dir, ec)) {
-                if (entry.is_regular_file()) {
-                    std::string extension = entry.path().extension().string();
-                    if (extension == ".c" || extension == ".cpp") {
-                        project.sources.push_back(entry.path().filename().string());
-                    }
-                }
+            fs::create_directories(fs::path(job.header).parent_path(), ec);
+            {
+                std::ofstream wrapper(job.header, std::ios::trunc);
+                wrapper << "// Generated by lumos build - precompiled wrapper for lumos.h\n";
+                wrapper << "#include \"" << job.inv->force_include << "\"\n";
             }
-        } else {
-            // Add the new main file to sources list
-            project.sources.push_back(main_file);
-        }
-    } else {
-        // Main file exists, check if it's in the sources list
-        main_file = main_c_exists ? "main.c" : "main.cpp";
 
-        // Check if main file is in sources list
-        bool found = false;
-        for (const auto& src : project.sources) {
-            if (src == main_file) {
-                found = true;
-                break;
+            output += "  " + fs::path(job.inv->force_include).filename().string() + " -> " +
+                      fs::path(job.header).parent_path().filename().string() + "/lumos.h.gch\n";
+            std::string stamp = gch + ".cmd";
+            fs::remove(stamp, ec);
+            std::string log;
+            auto start = BuildTrace::Clock::now();
+            bool ok = RunCommand(cmd, log);
+            trace_.Record(fs::path(job.header).parent_path().filename().string() + "/lumos.h.gch", "pch",
+                          start, BuildTrace::Clock::now());
+            if (!ok) {
+                output += log;
+                fs::remove(gch, ec);
+                return true;  // Not fatal: sources just include lumos.h directly
             }
-        }
+            WriteCommandStamp(stamp, cmd_line);
+            job.ok = true;
+            return true;
+        });
+    }
 
-        // If not found and we have an explicit sources list, add it
-        YAML::Node config = YAML::LoadFile(project_dir + "/project.yaml");
-        if (!found && config["sources"]) {
-            std::cout << "Adding " << main_file << " to sources list" << std::endl;
-            project.sources.push_back(main_file);
+    std::cout << "Precompiling headers..." << std::endl;
+    JobPool pool(jobs_);
+    pool.Run(pool_jobs);
+    std::cout << std::endl;
+
+    for (const auto& job : pch_jobs) {
+        if (job.ok) {
+            *job.result = job.header;
+        } else {
+            std::cerr << "Warning: " << (job.language == "c-header" ? "C" : "C++")
+                      << " precompiled header failed, compiling without it" << std::endl;
         }
     }
-
     return true;
 }
 
-bool Builder::Build(const std::string& project_dir) {
-    std::cout << "=== Lumos Builder ===" << std::endl;
-    std::cout << "Project directory: " << project_dir << std::endl;
+bool Builder::CompileAll(const std::vector<CompileJob>& jobs) const {
+    JobPool pool(jobs_);
+    std::cout << "Compiling " << jobs.size() << " files with "
+              << std::min<size_t>(pool.GetJobCount(), jobs.size()) << " job(s)..." << std::endl;
+
+    std::atomic<size_t> up_to_date{0};
+    std::atomic<size_t> cache_hits{0};
+    std::vector<JobPool::Job> pool_jobs;
+    pool_jobs.reserve(jobs.size());
+    for (const auto& job : jobs) {
+        pool_jobs.push_back([this, &job, &up_to_date, &cache_hits](std::string& output) {
+            CompilerInvocation inv = job.inv;
+            if (job.project_includes) {
+                inv.pch_header = GetPrecompiledHeader(job.source);
+            }
+            std::vector<std::string> command = GetCompileCommand(job.source, job.object, inv);
+
+            // Skip objects whose source, headers and command line are unchanged
+            if (IsObjectUpToDate(job.source, job.object, Process::ToString(command))) {
+                up_to_date++;
+                return true;
+            }
+
+            std::string line = "  " + job.label + " -> " + fs::path(job.object).filename().string();
+            std::string log;
+            bool cache_hit = false;
+            auto start = BuildTrace::Clock::now();
+            bool ok = CompileFile(job.source, job.object, inv, command, cache_hit, log);
+            if (!ok && !job.unity_sources.empty()) {
+                // Some drivers clash when merged (static helpers or private
+                // macros with the same name); build those one by one
+                log = "  " + job.label + " can't be merged, compiling its drivers separately\n";
+                ok = CompileUnityMembers(job, inv, log);
+            }
+            trace_.Record(job.label, cache_hit ? "cache" : "compile", start, BuildTrace::Clock::now());
+            if (!ok) {
+                output += line + "\n" + log;
+                output += "Error: Compilation failed for " + job.label + "\n";
+                return false;
+            }
+
+            if (cache_hit) {
+                cache_hits++;
+                output += line + " (cached)\n";
+            } else {
+                output += line + "\n" + log;
+            }
+            return true;
+        });
+    }
+
+    bool success = pool.Run(pool_jobs);
+    if (up_to_date > 0) {
+        std::cout << "  " << up_to_date << " of " << jobs.size() << " objects up to date" << std::endl;
+    }
+    if (cache_hits > 0) {
+        std::cout << "  " << cache_hits << " objects restored from cache" << std::endl;
+    }
+    if (up_to_date + cache_hits < jobs.size()) {
+        // New objects were stored; keep the shared cache within its limit
+        object_cache_.Trim();
+    }
     std::cout << std::endl;
+    return success;
+}
 
-    // Load project configuration
-    ProjectConfig project;
-    std::string yaml_path = project_dir + "/project.yaml";
+bool Builder::LinkFiles(const std::vector<std::string>& object_files,
+                       const std::string& output_elf,
+                       const std::vector<std::string>& link_flags) const {
+    std::string toolchain = GetToolchainPath();
+    std::string linker = host_ ? GetHostCompiler(true) : toolchain + "/arm-none-eabi-g++";
 
-    if (!project.Load(yaml_path, project_dir)) {
-        std::cerr << "Error: Failed to load project.yaml" << std::endl;
+    std::vector<std::string> cmd = {linker};
+
+    // Add all object files
+    cmd.insert(cmd.end(), object_files.begin(), object_files.end());
+
+    cmd.insert(cmd.end(), {"-o", output_elf});
+
+    // Add linker flags
+    cmd.insert(cmd.end(), link_flags.begin(), link_flags.end());
+    return RunLink(cmd, object_files, output_elf);
+}
+
+bool Builder::LinkRelocatable(const std::vector<std::string>& object_files,
+                              const std::string& output) const {
+    std::string linker = host_ ? GetHostCompiler(true) : GetToolchainPath() + "/arm-none-eabi-g++";
+
+    // No startup files or libraries: those belong to the final link
+    std::vector<std::string> cmd = {linker, "-r", "-nostdlib"};
+    cmd.insert(cmd.end(), object_files.begin(), object_files.end());
+    cmd.insert(cmd.end(), {"-o", output, "-Wl,-Map=" + output + ".map"});
+    return RunLink(cmd, object_files, output);
+}
+
+bool Builder::RunLink(const std::vector<std::string>& cmd,
+                      const std::vector<std::string>& object_files,
+                      const std::string& output) const {
+    std::string cmd_line = Process::ToString(cmd);
+
+    // Relink only when an object is newer than the output or the command changed
+    std::string stamp = output + ".cmd";
+    std::error_code ec;
+    auto output_time = fs::last_write_time(output, ec);
+    bool relink = ec || CommandChanged(stamp, cmd_line);
+    for (size_t i = 0; !relink && i < object_files.size(); ++i) {
+        auto obj_time = fs::last_write_time(object_files[i], ec);
+        relink = ec || obj_time > output_time;
+    }
+    if (!relink) {
+        std::cout << "  " << fs::path(output).filename().string() << " is up to date" << std::endl;
+        return true;
+    }
+
+    // Long object lists go through a response file (Windows limits the
+    // command line to 32K characters)
+    fs::remove(stamp, ec);
+    auto start = BuildTrace::Clock::now();
+    bool ok = RunCommand(cmd, output + ".rsp");
+    trace_.Record(fs::path(output).filename().string(), "link", start, BuildTrace::Clock::now());
+    if (!ok) {
         return false;
     }
+    WriteCommandStamp(stamp, cmd_line);
+    return true;
+}
 
-    // Check if main file exists, create if needed
-    if (!CheckAndCreateMainFile(project_dir, project)) {
-        std::cerr << "Error: Failed to create main file" << std::endl;
+bool Builder::HasProjectHALConfig(const std::string& project_dir) const {
+    std::error_code ec;
+    fs::path include_dir = fs::path(project_dir) / "include";
+    if (!fs::is_directory(include_dir, ec)) {
         return false;
     }
+    for (const auto& entry : fs::directory_iterator(include_dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 11 && name.compare(name.size() - 11, 11, "_hal_conf.h") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    std::cout << "Board: " << project.board << std::endl;
-    std::cout << "Sources: " << project.sources.size() << " files" << std::endl;
+std::vector<std::string> Builder::GetHALConfigHeaders(const CompilerInvocation& inv) const {
+    // The board's lumos.h and each *_hal_conf.h on the include path
+    std::vector<std::string> headers;
+    if (!inv.force_include.empty()) {
+        headers.push_back(inv.force_include);
+    }
+    std::error_code ec;
+    for (const auto& flag : inv.preprocessor_flags) {
+        if (flag.compare(0, 2, "-I") != 0 || !fs::is_directory(flag.substr(2), ec)) {
+            continue;
+        }
+        for (const auto& entry : fs::directory_iterator(flag.substr(2), ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() > 11 && name.compare(name.size() - 11, 11, "_hal_conf.h") == 0) {
+                headers.push_back(entry.path().string());
+            }
+        }
+    }
+    std::sort(headers.begin(), headers.end());
+    return headers;
+}
+
+std::string Builder::GetHALLibraryPath(const BoardConfig& board,
+                                       const std::vector<std::string>& hal_files,
+                                       const std::string& project_dir,
+                                       bool project_includes,
+                                       bool unity) const {
+    // The key covers everything that affects the archive contents: the
+    // compiler and its flags, how the drivers are grouped into translation
+    // units, the identity of each driver source and the contents of the
+    // headers that configure them (*_hal_conf.h, the board's lumos.h)
+    CompilerInvocation inv;
+    GetCompilerInvocation(hal_files.front(), board, project_dir, inv, project_includes);
+
+    std::ostringstream key;
+    key << inv.compiler << "\n" << Process::ToString(inv.codegen_flags) << "\n"
+        << Process::ToString(inv.preprocessor_flags) << " " << inv.force_include << "\n";
+    if (unity) {
+        key << "unity " << kHALUnityBatch << "\n";
+    }
+    std::vector<std::string> sorted = hal_files;
+    std::sort(sorted.begin(), sorted.end());
+    std::error_code ec;
+    for (const auto& file : sorted) {
+        key << file << " " << fs::file_size(file, ec) << " "
+            << fs::last_write_time(file, ec).time_since_epoch().count() << "\n";
+    }
+
+    std::vector<std::string> config_headers = GetHALConfigHeaders(inv);
+    for (const auto& header : config_headers) {
+        std::ifstream in(header, std::ios::binary);
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        key << header << " " << ObjectCache::Hash(contents.str()) << "\n";
+    }
+
+    std::ostringstream hash;
+    hash << std::hex << std::setfill('0') << std::setw(16) << ObjectCache::Hash(key.str());
+
+    std::string board_dir = fs::path(GetBoardPath(board.name)).filename().string();
+    std::string name = "libhal_" + board_dir + "_" + hash.str().substr(0, 12) + ".a";
+
+    // Shared between projects when possible, otherwise kept in the project
+    std::string dir;
+    if (object_cache_.IsEnabled() && !project_includes) {
+        dir = (fs::path(object_cache_.GetRoot()) / "hal").string();
+    } else {
+        dir = build_dir_ + "/hal";
+    }
+    return dir + "/" + name;
+}
+
+bool Builder::CreateArchive(const std::vector<std::string>& object_files,
+                           const std::string& archive) const {
+    std::string toolchain = GetToolchainPath();
+    // LTO objects carry GIMPLE; gcc-ar adds the plugin symbol index for them
+    std::string ar = toolchain + (lto_ ? "/arm-none-eabi-gcc-ar" : "/arm-none-eabi-ar");
+
+    std::error_code ec;
+    fs::create_directories(fs::path(archive).parent_path(), ec);
+
+    // Build under a temporary name and rename so concurrent builds sharing
+    // the library directory never link a half-written archive
+    std::string tmp = archive + ".tmp." + std::to_string(
+        std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+        static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+    std::vector<std::string> cmd = {ar, "rcs", tmp};
+    cmd.insert(cmd.end(), object_files.begin(), object_files.end());
+
+    auto start = BuildTrace::Clock::now();
+    bool ok = RunCommand(cmd, tmp + ".rsp");
+    trace_.Record(fs::path(archive).filename().string(), "archive", start, BuildTrace::Clock::now());
+    if (!ok) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+
+    fs::rename(tmp, archive, ec);
+    if (ec) {
+        std::cerr << "Error: Failed to install " << archive << ": " << ec.message() << std::endl;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool Builder::CreateBinary(const std::string& elf_file, const std::string& bin_file) const {
+    std::string toolchain = GetToolchainPath();
+    std::string objcopy = toolchain + "/arm-none-eabi-objcopy";
+
+    // A relink often reproduces the previous ELF byte for byte (a comment
+    // or whitespace edit), and then the binary made from it is still right
+    std::ostringstream elf_hash;
+    {
+        std::ifstream elf(elf_file, std::ios::binary);
+        std::ostringstream content;
+        content << elf.rdbuf();
+        elf_hash << objcopy << "\n" << std::hex << ObjectCache::Hash(content.str());
+    }
+    std::string base = fs::path(bin_file).replace_extension().string();
+    std::string stamp = bin_file + ".cmd";
+    std::error_code ec;
+    if (fs::exists(bin_file, ec) && fs::exists(base + ".hex", ec) && fs::exists(base + ".segments", ec) &&
+        !CommandChanged(stamp, elf_hash.str())) {
+        std::cout << "  " << fs::path(bin_file).filename().string() << " is up to date" << std::endl;
+        return true;
+    }
+    fs::remove(stamp, ec);
+
+    // Written beside and renamed over the old image: objcopy truncates its
+    // output in place, which would pull the pages from under a flasher
+    // (lumos flash, the GUI) that still has the previous image mapped.
+    // Intel HEX goes next to it for external programmers.
+    auto start = BuildTrace::Clock::now();
+    bool ok = true;
+    for (const auto& format : {std::make_pair("binary", bin_file), std::make_pair("ihex", base + ".hex")}) {
+        std::string tmp = format.second + ".tmp";
+        ok = RunCommand({objcopy, "-O", format.first, elf_file, tmp});
+        if (ok) {
+            fs::rename(tmp, format.second, ec);
+            if (ec) {
+                std::cerr << "Error: Failed to install " << format.second << ": " << ec.message() << std::endl;
+                ok = false;
+            }
+        }
+        if (!ok) {
+            fs::remove(tmp, ec);
+            break;
+        }
+    }
+    trace_.Record(fs::path(bin_file).filename().string(), "objcopy", start, BuildTrace::Clock::now());
+    if (!ok) {
+        return false;
+    }
+
+    // The sparse image holds only the populated flash ranges, so flashing
+    // it leaves the gaps objcopy fills in the binary alone
+    ElfFile elf;
+    std::string error;
+    if (!elf.Load(elf_file, error) || !WriteSegmentFile(base + ".segments", GetImageSegments(elf))) {
+        std::cerr << "Error: Failed to write " << base << ".segments" << (error.empty() ? "" : ": " + error) << std::endl;
+        return false;
+    }
+
+    WriteCommandStamp(stamp, elf_hash.str());
+    return true;
+}
+
+std::string Builder::PromptLanguage() const {
+    std::cout << "\nNo main.c or main.cpp found in project directory." << std::endl;
+    std::cout << "Select programming language:" << std::endl;
+    std::cout << "  1. C++" << std::endl;
+    std::cout << "  2. C" << std::endl;
+    std::cout << "Enter choice [1-2]: ";
+
+    std::string input;
+    std::getline(std::cin, input);
+
+    if (input == "2") {
+        return "C";
+    }
+    // Default to C++
+    return "C++";
+}
+
+bool Builder::GenerateMainFile(const std::string& language, const std::string& project_dir) const {
+    std::string filename = (language == "C") ? "main.c" : "main.cpp";
+    fs::path main_path = fs::path(project_dir) / filename;
+
+    std::ofstream file(main_path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Failed to create " << filename << std::endl;
+        return false;
+    }
+
+    const std::string loop_declaration = (language == "C") ? "void loop(void);" : "void loop();";
+    const std::string setup_declaration = (language == "C") ? "void setup(void);" : "void setup();";
+
+    file << "/**\n";
+    file << " * Main application file\n";
+    file << " * This is where the setup() and loop() functions are defined\n";
+    file << " */\n\n";
+    file << "/**\n";
+    file << " * Setup function - called once at startup\n";
+    file << " */\n";
+    file << setup_declaration << "\n";
+    file << "{\n";
+    file << "    // Initialize your application here\n";
+    file << "    // - Configure GPIO pins\n";
+    file << "    // - Initialize UART, SPI, I2C, etc.\n";
+    file << "    // - Set up timers\n";
+    file << "}\n\n";
+    file << "/**\n";
+    file << " * Loop function - called repeatedly\n";
+    file << " */\n";
+    file << loop_declaration << "\n";
+    file << "{\n";
+    file << "    // Your main application logic here\n";
+    file << "    // This function runs continuously\n";
+    file << "}\n";
+
+    file.close();
+
+    std::cout << "Created " << filename << std::endl;
+    return true;
+}
+
+bool Builder::CheckAndCreateMainFile(const std::string& project_dir, ProjectConfig& project) {
+    fs::path main_c = fs::path(project_dir) / "main.c";
+    fs::path main_cpp = fs::path(project_dir) / "main.cpp";
+
+    bool main_c_exists = fs::exists(main_c);
+    bool main_cpp_exists = fs::exists(main_cpp);
+    std::string main_file;
+    std::string language;
+
+    // Check if we need to create a main file
+    if (!main_c_exists && !main_cpp_exists) {
+        // No main file found, prompt user for language
+        language = PromptLanguage();
+
+        // Generate the main file
+        if (!GenerateMainFile(language, project_dir)) {
+            return false;
+        }
+
+        main_file = (language == "C") ? "main.c" : "main.cpp";
+
+        // If auto-discovery was used, reload the sources
+        if (project.sources_discovered) {
+            // Re-scan for sources since we just created a new file
+            std::cout << "Re-scanning for source files..." << std::endl;
+            project.ExpandSources(project_dir);
+        } else {
+            // Add the new main file to sources list
+            project.sources.push_back(main_file);
+        }
+    } else {
+        // Main file exists, check if it's in the sources list
+        main_file = main_c_exists ? "main.c" : "main.cpp";
+
+        // Check if main file is in sources list
+        bool found = false;
+        for (const auto& src : project.sources) {
+            if (src == main_file) {
+                found = true;
+                break;
+            }
+        }
+
+        // If not found and we have an explicit sources list, add it
+        if (!found && !project.sources_discovered) {
+            std::cout << "Adding " << main_file << " to sources list" << std::endl;
+            project.sources.push_back(main_file);
+        }
+    }
+
+    return true;
+}
+
+std::string Builder::GetPlanSettings() const {
+    // Everything besides the recorded inputs that changes resolved commands
+    std::ostringstream settings;
+    settings << "root=" << lumos_root_ << "\n"
+             << "profile=" << profile_ << "\n"
+             << "lto=" << (lto_ ? 1 : 0) << "\n"
+             << "trace=" << (scope_trace_ ? 1 : 0) << "\n"
+             << "fast_libc=" << (fast_libc_ ? 1 : 0) << "\n"
+             << "dsp=" << (dsp_ ? 1 : 0) << "\n"
+             << "event_loop=" << (event_loop_ ? 1 : 0) << "\n"
+             << "us_timers=" << (us_timers_.size() == 2 ? us_timers_[0] + "," + us_timers_[1] : "") << "\n"
+             << "cxx=" << cxx_standard_ << "\n"
+             << "toolchain=" << toolchain_.bin_dir << "," << toolchain_.version << "\n"
+             << "rtos=" << rtos_ << "," << rtos_stack_pool_ << "," << rtos_default_stack_ << "\n"
+             << "cache=" << (object_cache_.IsEnabled() ? object_cache_.GetRoot() : "") << "\n";
+    return settings.str();
+}
+
+bool Builder::CreateBuildPlan(ProjectConfig& project,
+                              const BoardConfig& board,
+                              const std::string& project_dir,
+                              BuildPlan& plan) {
+    // Source discovery, include paths and the PCH/HAL config checks depend
+    // on these files and directories existing
+    plan.AddInput(project_dir + "/project.yaml");
+    plan.AddInput(project_dir);
+    for (const auto& dir : project.source_dirs) {
+        plan.AddInput(dir);
+    }
+    plan.AddInput(project_dir + "/include");
+    plan.AddInput(output_dir_ + "/generated");
+    plan.AddInput(GetBoardPath(board.name));
+    plan.AddInput(GetResourceBasePath() + "/wrapper");
 
     // Auto-detect HAL modules if not specified
     if (project.hal_modules.empty()) {
         std::cout << "Auto-detecting HAL modules from source files..." << std::endl;
         HALModuleDetector detector;
-        project.hal_modules = detector.DetectModules(project.sources, project_dir);
+        std::vector<std::string> scanned;
+        project.hal_modules = detector.DetectModules(project.sources, project_dir,
+                                                      project_dir + "/build/include_cache", &scanned);
+
+        // Editing any scanned source or header re-runs detection
+        for (const auto& file : scanned) {
+            plan.AddInput(file);
+        }
 
         if (!project.hal_modules.empty()) {
             std::cout << "Detected modules: ";
@@ -654,94 +1595,118 @@ bool Builder::Build(const std::string& project_dir) {
         }
         std::cout << std::endl;
     }
-    std::cout << std::endl;
-
-    // Get board configuration
-    BoardConfig board = BoardConfig::GetConfig(project.board);
-    std::cout << "Platform: " << board.platform << std::endl;
-    std::cout << "MCU: " << board.mcu << std::endl;
-    std::cout << "CPU: " << board.cpu << std::endl;
-    std::cout << std::endl;
 
-    // Create build directory
-    std::string build_dir = project_dir + "/build";
-    fs::create_directories(build_dir);
-
-    std::vector<std::string> object_files;
+    plan.hal_modules = project.hal_modules;
+    hal_modules_ = project.hal_modules;
+    std::string build_dir = build_dir_;
+
+    auto add_job = [&](const std::string& source, const std::string& obj_path, const std::string& label,
+                       bool project_includes, bool hal) {
+        CompileJob job;
+        job.source = source;
+        job.object = obj_path;
+        job.label = label;
+        job.project_includes = project_includes;
+        job.hal = hal;
+        if (!GetCompilerInvocation(source, board, project_dir, job.inv, project_includes)) {
+            std::cerr << "Error: Unknown file type: " << source << std::endl;
+            return false;
+        }
+        plan.jobs.push_back(job);
+        return true;
+    };
 
-    // Compile user source files
-    std::cout << "Compiling user sources..." << std::endl;
+    // User source files; those in subdirectories keep their path so
+    // equal names in different directories don't collide
     for (const auto& source : project.sources) {
         std::string source_path = project_dir + "/" + source;
-        std::string obj_name = fs::path(source).stem().string() + ".o";
-        std::string obj_path = build_dir + "/" + obj_name;
-
-        std::cout << "  " << source << " -> " << obj_name << std::endl;
-
-        if (!CompileFile(source_path, obj_path, board, project_dir)) {
-            std::cerr << "Error: Compilation failed for " << source << std::endl;
+        std::string obj_name = fs::path(source).replace_extension(".o").lexically_normal().generic_string();
+        if (!add_job(source_path, build_dir + "/" + obj_name, source, true, false)) {
             return false;
         }
-
-        object_files.push_back(obj_path);
+        plan.jobs.back().user = true;
     }
-    std::cout << std::endl;
 
-    // Compile board support files
-    std::vector<std::string> board_files = GetBoardSupportFiles(board);
-    if (!board_files.empty()) {
-        std::cout << "Compiling board support files..." << std::endl;
-        for (const auto& board_file : board_files) {
-            std::string filename = fs::path(board_file).filename().string();
-            std::string stem = fs::path(board_file).stem().string();
-
-            // Rename board's main to board_main to avoid conflict with user code
-            std::string obj_name;
-            if (stem == "main") {
-                obj_name = "board_main.o";
-            } else {
-                obj_name = stem + ".o";
-            }
-            std::string obj_path = build_dir + "/" + obj_name;
+    // Board support files
+    std::vector<std::string> board_files = GetBoardSupportFiles(board, project);
+    for (const auto& board_file : board_files) {
+        std::string filename = fs::path(board_file).filename().string();
+        std::string stem = fs::path(board_file).stem().string();
 
-            std::cout << "  " << filename << " -> " << obj_name << std::endl;
-
-            if (!CompileFile(board_file, obj_path, board, project_dir)) {
-                std::cerr << "Error: Compilation failed for " << filename << std::endl;
-                return false;
-            }
+        // Rename board's main to board_main to avoid conflict with user code
+        std::string obj_name;
+        if (stem == "main") {
+            obj_name = "board_main.o";
+        } else {
+            obj_name = stem + ".o";
+        }
+        if (!add_job(board_file, build_dir + "/" + obj_name, filename, true, false)) {
+            return false;
+        }
 
-            object_files.push_back(obj_path);
+        // Board globals (sdcard, usb, Serial ports, ...) are only defined when
+        // their HAL module is in the build, so unused ones cost no flash, no
+        // constructors before setup() and pull in no interrupt handlers
+        for (const auto& define : GetBoardModuleDefines(project.hal_modules)) {
+            plan.jobs.back().inv.preprocessor_flags.push_back("-D" + define);
         }
-        std::cout << std::endl;
+
+        // SystemClock_Config() picks its PLL, flash latency and voltage
+        // scaling from the clock profile
+        plan.jobs.back().inv.preprocessor_flags.push_back("-D" + ProjectConfig::GetClockDefine(project.clock));
     }
 
-    // Compile HAL driver files
-    std::cout << "Compiling HAL drivers..." << std::endl;
-    std::vector<std::string> hal_files = GetRequiredHALFiles(board, project.hal_modules);
-    for (const auto& hal_file : hal_files) {
+    // HAL driver files go into a per-board static library that is built
+    // once per flag set and then reused by every build
+    std::vector<std::string> hal_files;
+    for (const auto& hal_file : GetRequiredHALFiles(board, project.hal_modules)) {
+        plan.AddInput(fs::path(hal_file).parent_path().string());
         // Only compile if file exists
         if (!fs::exists(hal_file)) {
             std::cout << "  Skipping " << fs::path(hal_file).filename().string() << " (not found)" << std::endl;
             continue;
         }
+        // The library name hashes each driver's timestamp
+        plan.AddInput(hal_file);
+        hal_files.push_back(hal_file);
+    }
 
-        std::string hal_filename = fs::path(hal_file).filename().string();
-        std::string obj_name = fs::path(hal_file).stem().string() + ".o";
-        std::string obj_path = build_dir + "/" + obj_name;
-
-        std::cout << "  " << hal_filename << " -> " << obj_name << std::endl;
-
-        if (!CompileFile(hal_file, obj_path, board, project_dir)) {
-            std::cerr << "Error: Failed to compile HAL file " << hal_filename << std::endl;
-            return false;
+    // A project-level HAL config changes what the drivers compile to, so the
+    // library can only be shared when the project doesn't override it
+    bool hal_uses_project = HasProjectHALConfig(project_dir);
+    bool hal_unity = project.hal_unity && hal_files.size() > 1;
+    if (!hal_files.empty()) {
+        // Edited in place, they change the library name
+        CompilerInvocation hal_inv;
+        GetCompilerInvocation(hal_files.front(), board, project_dir, hal_inv, hal_uses_project);
+        for (const auto& header : GetHALConfigHeaders(hal_inv)) {
+            plan.AddInput(header);
+        }
+    }
+    if (hal_unity) {
+        // Each batch is one generated source #including its drivers, so the
+        // device header and HAL headers are parsed once per batch
+        plan.hal_library = GetHALLibraryPath(board, hal_files, project_dir, hal_uses_project, true);
+        for (size_t first = 0; first < hal_files.size(); first += kHALUnityBatch) {
+            size_t last = std::min(first + kHALUnityBatch, hal_files.size());
+            std::string name = "hal_unity_" + std::to_string(first / kHALUnityBatch);
+            if (!add_job(build_dir + "/hal/" + name + ".c", build_dir + "/hal/" + name + ".o",
+                         name + ".c (" + std::to_string(last - first) + " drivers)", hal_uses_project, true)) {
+                return false;
+            }
+            plan.jobs.back().unity_sources.assign(hal_files.begin() + first, hal_files.begin() + last);
+        }
+    } else if (!hal_files.empty()) {
+        plan.hal_library = GetHALLibraryPath(board, hal_files, project_dir, hal_uses_project, false);
+        for (const auto& hal_file : hal_files) {
+            std::string obj_path = build_dir + "/hal/" + fs::path(hal_file).stem().string() + ".o";
+            if (!add_job(hal_file, obj_path, fs::path(hal_file).filename().string(), hal_uses_project, true)) {
+                return false;
+            }
         }
-
-        object_files.push_back(obj_path);
     }
-    std::cout << std::endl;
 
-    // Compile USB middleware files if needed
+    // USB middleware files if needed
     bool uses_usb = false;
     for (const auto& module : project.hal_modules) {
         if (module == "pcd" || module == "pcd_ex") {
@@ -751,9 +1716,9 @@ bool Builder::Build(const std::string& project_dir) {
     }
 
     if (uses_usb) {
-        std::cout << "Compiling USB middleware..." << std::endl;
         std::vector<std::string> usb_files = GetUSBMiddlewareFiles(board);
         for (const auto& usb_file : usb_files) {
+            plan.AddInput(fs::path(usb_file).parent_path().string());
             if (!fs::exists(usb_file)) {
                 std::cout << "  Skipping " << fs::path(usb_file).filename().string() << " (not found)" << std::endl;
                 continue;
@@ -761,41 +1726,624 @@ bool Builder::Build(const std::string& project_dir) {
 
             std::string usb_filename = fs::path(usb_file).filename().string();
             std::string obj_name = fs::path(usb_file).stem().string() + ".o";
-            std::string obj_path = build_dir + "/" + obj_name;
+            if (!add_job(usb_file, build_dir + "/" + obj_name, usb_filename, true, false)) {
+                return false;
+            }
+        }
+    }
+
+    // FatFs for SD card projects; the linker drops it unless filesystem.h is used
+    bool uses_sd = false;
+    for (const auto& module : project.hal_modules) {
+        if (module == "sd" || module == "sdmmc") {
+            uses_sd = true;
+            break;
+        }
+    }
+
+    if (uses_sd) {
+        for (const auto& fatfs_file : GetFatFsFiles(board)) {
+            plan.AddInput(fs::path(fatfs_file).parent_path().string());
+            if (!fs::exists(fatfs_file)) {
+                std::cout << "  Skipping " << fs::path(fatfs_file).filename().string() << " (not found)" << std::endl;
+                continue;
+            }
 
-            std::cout << "  " << usb_filename << " -> " << obj_name << std::endl;
+            std::string fatfs_filename = fs::path(fatfs_file).filename().string();
+            std::string obj_name = fs::path(fatfs_file).stem().string() + ".o";
+            if (!add_job(fatfs_file, build_dir + "/" + obj_name, fatfs_filename, true, false)) {
+                return false;
+            }
+        }
+    }
 
-            if (!CompileFile(usb_file, obj_path, board, project_dir)) {
-                std::cerr << "Error: Failed to compile USB file " << usb_filename << std::endl;
+    // FreeRTOS kernel
+    if (!rtos_.empty()) {
+        for (const auto& rtos_file : GetFreeRTOSFiles(board)) {
+            plan.AddInput(fs::path(rtos_file).parent_path().string());
+            if (!fs::exists(rtos_file)) {
+                std::cerr << "Error: FreeRTOS source not found: " << rtos_file << std::endl;
                 return false;
             }
 
-            object_files.push_back(obj_path);
+            std::string rtos_filename = fs::path(rtos_file).filename().string();
+            std::string obj_name = "freertos_" + fs::path(rtos_file).stem().string() + ".o";
+            if (!add_job(rtos_file, build_dir + "/" + obj_name, rtos_filename, true, false)) {
+                return false;
+            }
+
+            // The Cortex-M33 port defines SysTick_Handler itself; renamed,
+            // the board's handler calls it next to HAL_IncTick()
+            if (board.cpu == "cortex-m33" && rtos_filename == "port.c") {
+                plan.jobs.back().inv.preprocessor_flags.push_back("-DSysTick_Handler=xPortSysTickHandler");
+            }
         }
-        std::cout << std::endl;
     }
 
-    // Compile system files (startup file)
-    std::cout << "Compiling system files..." << std::endl;
+    // CMSIS-DSP: the package's prebuilt library for the core if it has
+    // one (linked, see GetLinkerFlags()), else its sources
+    if (dsp_) {
+        const std::string dsp_library = GetDspLibrary(board);
+        plan.AddInput(GetPlatformPath(board.platform) + "/Drivers/CMSIS/DSP/Lib/GCC");
+        for (const auto& dsp_file : dsp_library.empty() ? GetDspFiles(board) : std::vector<std::string>()) {
+            plan.AddInput(fs::path(dsp_file).parent_path().string());
+            if (!fs::exists(dsp_file)) {
+                std::cerr << "Error: CMSIS-DSP not found for " << board.cpu << ": no library in Drivers/CMSIS/DSP/Lib/GCC"
+                          << " and no " << dsp_file << std::endl;
+                return false;
+            }
+
+            std::string dsp_filename = fs::path(dsp_file).filename().string();
+            std::string obj_name = "cmsisdsp_" + fs::path(dsp_file).stem().string() + ".o";
+            if (!add_job(dsp_file, build_dir + "/" + obj_name, dsp_filename, false, false)) {
+                return false;
+            }
+        }
+    }
 
-    // Startup file (board-specific or platform default)
+    // Framework sources (the transport always, the app runtime with an RTOS,
+    // the settings store with the flash module);
+    // unused code is dropped by --gc-sections
+    plan.AddInput(GetResourceBasePath() + "/framework");
+    for (const auto& framework_file : GetFrameworkFiles()) {
+        std::string framework_filename = fs::path(framework_file).filename().string();
+        std::string obj_name = "framework_" + fs::path(framework_file).stem().string() + ".o";
+        if (!add_job(framework_file, build_dir + "/" + obj_name, framework_filename, true, false)) {
+            return false;
+        }
+    }
+
+    // Startup file (board-specific); the host board's main() is enough
+    if (board.IsHost()) {
+        plan.link_flags = GetLinkerFlags(board, project_dir);
+        return true;
+    }
     std::string startup_file = GetStartupFile(board);
-    std::string startup_filename = fs::path(startup_file).filename().string();
-    std::string startup_obj = build_dir + "/startup.o";
-    std::cout << "  " << startup_filename << " -> startup.o" << std::endl;
-    if (!CompileFile(startup_file, startup_obj, board, project_dir)) {
+    if (startup_file.empty()) {
         std::cerr << "Error: Failed to compile startup file" << std::endl;
         return false;
     }
-    object_files.push_back(startup_obj);
+    if (!add_job(startup_file, build_dir + "/startup.o", fs::path(startup_file).filename().string(), true, false)) {
+        return false;
+    }
+
+    // GetLinkerScript() has already reported a missing script
+    plan.link_flags = GetLinkerFlags(board, project_dir);
+    return std::find(plan.link_flags.begin(), plan.link_flags.end(), "-T") == plan.link_flags.end();
+}
+
+bool Builder::UpdateCompileCommands(const BuildPlan& plan,
+                                    const std::string& project_dir,
+                                    const std::string& database) const {
+    std::error_code ec;
+    std::string directory = fs::absolute(project_dir, ec).string();
+
+    // clangd doesn't ask a cross compiler where its system headers are,
+    // so list the directories the toolchain probe found
+    auto add_system_includes = [this](std::vector<std::string>& arguments, const CompilerInvocation& inv) {
+        if (host_) {
+            return;
+        }
+        bool cxx = inv.compiler.size() >= 3 && inv.compiler.compare(inv.compiler.size() - 3, 3, "g++") == 0;
+        for (const auto& dir : cxx ? toolchain_.cxx_includes : toolchain_.c_includes) {
+            arguments.push_back("-isystem");
+            arguments.push_back(dir);
+        }
+    };
+
+    std::vector<CompileCommand> commands;
+    for (const auto& job : plan.jobs) {
+        // Editors look drivers up by their own path, not the unity source
+        for (const auto& member : job.unity_sources) {
+            CompileCommand command;
+            command.file = fs::absolute(member, ec).string();
+            command.output = job.object;
+            command.arguments = GetCompileCommand(member, job.object, job.inv);
+            add_system_includes(command.arguments, job.inv);
+            commands.push_back(command);
+        }
+        if (!job.unity_sources.empty()) {
+            continue;
+        }
+
+        // Tools like clangd can't read GCC's .gch, so list the plain lumos.h
+        CompileCommand command;
+        command.file = fs::absolute(job.source, ec).string();
+        command.output = job.object;
+        command.arguments = GetCompileCommand(job.source, job.object, job.inv);
+        add_system_includes(command.arguments, job.inv);
+        commands.push_back(command);
+    }
+    return WriteCompileCommands(database, directory, commands);
+}
+
+void Builder::NotifyChanged(const std::string& path, bool structural) {
+    if (!resident_ || !resident_config_valid_) {
+        return;
+    }
+
+    fs::path changed = fs::path(path).lexically_normal();
+    fs::path parent = changed.parent_path();
+    fs::path project = fs::path(resident_dir_).lexically_normal();
+    fs::path board_yaml = fs::path(GetBoardPath(resident_board_.name) + "/config.yaml").lexically_normal();
+
+    // Without a sources list the project's files are the sources, and
+    // source patterns depend on the directories they matched in
+    bool source_dir = std::find(resident_project_.source_dirs.begin(), resident_project_.source_dirs.end(),
+                                parent.string()) != resident_project_.source_dirs.end();
+    if (changed == project / "project.yaml" || changed == board_yaml ||
+        (structural && (parent == project || changed == project || source_dir))) {
+        resident_config_valid_ = false;
+        resident_plan_valid_ = false;
+        return;
+    }
+
+    // Directory inputs change when an entry is added or removed, file
+    // inputs when they are written
+    if (resident_plan_valid_) {
+        for (const auto& input : resident_plan_.GetInputPaths()) {
+            fs::path input_path = fs::path(input).lexically_normal();
+            if (input_path == changed || (structural && input_path == parent)) {
+                resident_plan_valid_ = false;
+                return;
+            }
+        }
+    }
+}
+
+bool Builder::RevalidateResidentState() {
+    if (resident_plan_valid_ && !resident_plan_.IsCurrent()) {
+        // project.yaml and the project directory are plan inputs as well
+        resident_config_valid_ = false;
+        resident_plan_valid_ = false;
+        return true;
+    }
+    return false;
+}
+
+std::set<std::string> Builder::GetWatchDirectories() const {
+    std::set<std::string> directories;
+    if (!resident_config_valid_) {
+        return directories;
+    }
+
+    std::error_code ec;
+    directories.insert(fs::path(resident_dir_).lexically_normal().string());
+    directories.insert(fs::path(GetBoardPath(resident_board_.name)).lexically_normal().string());
+    directories.insert(resident_project_.source_dirs.begin(), resident_project_.source_dirs.end());
+    if (resident_plan_valid_) {
+        for (const auto& input : resident_plan_.GetInputPaths()) {
+            fs::path path = fs::path(input).lexically_normal();
+            if (fs::is_directory(path, ec)) {
+                directories.insert(path.string());
+            } else {
+                directories.insert(path.parent_path().string());
+            }
+        }
+    }
+    return directories;
+}
+
+bool Builder::Build(const std::string& project_dir) {
+    bool success = BuildProject(project_dir);
+
+    if (trace_.IsEnabled()) {
+        std::cout << std::endl;
+        trace_.PrintSummary();
+        std::string trace_file = (output_dir_.empty() ? project_dir + "/build" : output_dir_) + "/trace.json";
+        if (trace_.WriteChromeTrace(trace_file)) {
+            std::cout << "Trace written to " << trace_file << std::endl;
+        } else {
+            std::cerr << "Warning: Failed to write " << trace_file << std::endl;
+        }
+    }
+
+    return success;
+}
+
+void Builder::RecordBuild(const std::string& output_dir,
+                          const BoardConfig& board,
+                          const std::string& plan_file,
+                          const BuildPlan& plan) const {
+    CachedBuild build;
+    build.board = board.name;
+    build.board_path = GetBoardPath(board.name);
+    build.toolchain_path = host_ ? GetHostCompiler(true) : GetToolchainPath();
+    build.profile = profile_;
+    std::ifstream file(plan_file, std::ios::binary);
+    if (file.is_open()) {
+        std::ostringstream content;
+        content << file.rdbuf();
+        build.plan_hash = ObjectCache::Hash(content.str());
+    }
+    build.hal_modules = plan.hal_modules;
+    build.hal_library = plan.hal_library;
+
+    CacheConfig cache;
+    cache.Load(output_dir);
+    cache.SetBuild(build);
+    cache.Save(output_dir);
+}
+
+bool Builder::Prepare(const std::string& project_dir, ProjectConfig& project) {
+    if (!project.Load(project_dir + "/project.yaml", project_dir)) {
+        std::cerr << "Error: Failed to load project.yaml" << std::endl;
+        return false;
+    }
+    if (!CheckAndCreateMainFile(project_dir, project)) {
+        std::cerr << "Error: Failed to create main file" << std::endl;
+        return false;
+    }
+
+    // The boards detect HAL modules from the same sources; scanning them
+    // once here leaves every board's scan a cache hit
+    if (project.hal_modules.empty()) {
+        HALModuleDetector detector;
+        detector.DetectModules(project.sources, project_dir, project_dir + "/build/include_cache");
+    }
+    return true;
+}
+
+bool Builder::BuildProject(const std::string& project_dir) {
+    std::cout << "=== Lumos Builder ===" << std::endl;
+    std::cout << "Project directory: " << project_dir << std::endl;
+    std::cout << std::endl;
+
+    // Load project configuration
+    ProjectConfig project;
+    BoardConfig board;
+    bool resident_config = resident_ && resident_config_valid_ && resident_dir_ == project_dir;
+    if (resident_config) {
+        project = resident_project_;
+        board = resident_board_;
+    } else {
+        std::string yaml_path = project_dir + "/project.yaml";
+
+        if (!project.Load(yaml_path, project_dir)) {
+            std::cerr << "Error: Failed to load project.yaml" << std::endl;
+            return false;
+        }
+
+        // Check if main file exists, create if needed
+        if (!CheckAndCreateMainFile(project_dir, project)) {
+            std::cerr << "Error: Failed to create main file" << std::endl;
+            return false;
+        }
+
+        // One board of a build matrix
+        if (!board_override_.empty()) {
+            if (std::find(project.boards.begin(), project.boards.end(), board_override_) == project.boards.end()) {
+                std::cerr << "Error: Board '" << board_override_ << "' is not listed in project.yaml" << std::endl;
+                return false;
+            }
+            project.board = board_override_;
+        }
+
+        // Get board configuration
+        board = BoardConfig::GetConfig(project.board);
+
+        // The board's config.yaml lists the clock each profile runs at
+        std::string board_yaml = GetBoardPath(board.name) + "/config.yaml";
+        if (fs::exists(board_yaml) && !board.LoadBoardYaml(board_yaml)) {
+            return false;
+        }
+
+        if (resident_) {
+            resident_dir_ = project_dir;
+            resident_project_ = project;
+            resident_board_ = board;
+            resident_config_valid_ = true;
+            resident_plan_valid_ = false;
+        }
+    }
+
+    std::cout << "Board: " << project.board << std::endl;
+    std::cout << "Sources: " << project.sources.size() << " files" << std::endl;
+    std::cout << "Platform: " << board.platform << std::endl;
+    std::cout << "MCU: " << board.mcu << std::endl;
+    std::cout << "CPU: " << board.cpu << std::endl;
+    host_ = board.IsHost();
+    if (!board.clock_profiles.empty() && board.clock_profiles.count(project.clock) == 0) {
+        std::cerr << "Error: Board " << board.name << " has no '" << project.clock
+                  << "' clock profile" << std::endl;
+        return false;
+    }
+    std::cout << "Clock: " << project.clock;
+    if (board.clock_profiles.count(project.clock)) {
+        std::cout << " (" << board.clock_profiles[project.clock];
+        if (!board.max_cpu.empty()) {
+            std::cout << " of " << board.max_cpu << " max";
+        }
+        std::cout << ")";
+    }
+    std::cout << std::endl;
+    std::cout << std::endl;
+
+    // Select build profile (command line overrides project.yaml)
+    profile_ = profile_override_.empty() ? project.profile : profile_override_;
+    if (ProjectConfig::GetProfileFlags(profile_).empty()) {
+        std::cerr << "Error: Unknown profile '" << profile_
+                  << "' (expected debug, release, size or fast)" << std::endl;
+        return false;
+    }
+    lto_ = project.lto;
+    scope_trace_ = project.trace;
+    // The host's libc is fast already
+    fast_libc_ = !host_ && project.UsesFastLibc(profile_);
+    dsp_ = project.dsp;
+    event_loop_ = project.event_loop;
+    us_timers_ = project.us_timers;
+    cxx_standard_ = project.cxx_standard;
+    rtos_ = project.rtos;
+    rtos_stack_pool_ = project.rtos_stack_pool;
+    rtos_default_stack_ = project.rtos_default_stack;
+    include_dirs_.clear();
+    for (const auto& dir : project.include_dirs) {
+        std::error_code ec;
+        include_dirs_.push_back(fs::absolute(fs::path(project_dir) / dir, ec).lexically_normal().string());
+    }
+    // The environment wins, so CI can add a launcher without editing
+    // projects; set but empty, it turns the project's launcher off
+    const char* launcher = std::getenv("LUMOS_COMPILER_LAUNCHER");
+    compiler_launcher_ = ProjectConfig::SplitLauncher(launcher != nullptr ? launcher : project.compiler_launcher);
+    if (!compiler_launcher_.empty()) {
+        std::cout << "Compiler launcher: " << Process::ToString(compiler_launcher_) << std::endl;
+    }
+    // A previous project's precompiled headers must not leak into this one
+    pch_c_.clear();
+    pch_cxx_.clear();
+    if (host_ && !rtos_.empty()) {
+        std::cerr << "Error: The Host board does not support rtos: " << rtos_ << std::endl;
+        return false;
+    }
+    if (host_ && dsp_) {
+        std::cerr << "Error: The Host board does not support dsp (CMSIS-DSP is built for Cortex-M)" << std::endl;
+        return false;
+    }
+    if (host_ && scope_trace_) {
+        std::cerr << "Warning: Scope tracing needs the cycle counter, ignored on the Host board" << std::endl;
+        scope_trace_ = false;
+    }
+    // Other boards build with the arm-none-eabi GCC the environment or
+    // project.yaml asks for, the newest bundled one by default
+    if (!host_) {
+        const char* requested = std::getenv("LUMOS_TOOLCHAIN");
+        ToolchainFinder finder(GetResourceBasePath(), ToolchainFinder::DefaultCacheFile());
+        std::string error;
+        if (!finder.Select(requested != nullptr && requested[0] != '\0' ? requested : project.toolchain,
+                           toolchain_, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        finder.Save();
+        std::cout << "Toolchain: GCC " << toolchain_.version << " (" << toolchain_.origin << ", "
+                  << toolchain_.bin_dir << ")" << std::endl;
+    }
+    std::cout << "Profile: " << profile_ << (lto_ ? " (LTO)" : "") << (scope_trace_ ? " (trace)" : "")
+              << (fast_libc_ ? " (fast libc)" : "") << (dsp_ ? " (CMSIS-DSP)" : "") << (event_loop_ ? " (event loop)" : "")
+              << (cxx_standard_ != 0 ? " (C++" + std::to_string(cxx_standard_) + ")" : "") << std::endl;
+    if (!rtos_.empty()) {
+        std::cout << "RTOS: " << rtos_ << " (" << rtos_stack_pool_ << " stack words, "
+                  << rtos_default_stack_ << " per task)" << std::endl;
+    }
     std::cout << std::endl;
 
+    // Each profile builds into its own directory so switching profiles
+    // keeps the other profiles' objects up to date; each board of a
+    // matrix has its own outputs, generated headers and profiles
+    std::string output_dir = project_dir + "/build";
+    if (project.boards.size() > 1) {
+        output_dir += "/" + project.board;
+    }
+    output_dir_ = output_dir;
+    std::string build_dir = output_dir + "/" + profile_;
+    build_dir_ = build_dir;
+    fs::create_directories(build_dir);
+
+    // Interface headers are shared by all profiles and only rewritten when
+    // their content changes
+    for (const auto& interface_file : project.interfaces) {
+        std::string interface_path = (fs::path(project_dir) / interface_file).string();
+        std::string header_path = output_dir + "/generated/" + GetInterfaceHeaderName(interface_file);
+        std::string error;
+        if (!GenerateInterface(interface_path, header_path, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+        std::cout << "Interface: " << interface_file << " -> generated/"
+                  << GetInterfaceHeaderName(interface_file) << std::endl;
+    }
+
+    // Pin descriptors from the board's config.yaml, for the board sources
+    // and the project alike
+    std::string board_yaml = GetBoardPath(board.name) + "/config.yaml";
+    if (fs::exists(board_yaml)) {
+        std::string error;
+        if (!GenerateBoardPins(board_yaml, output_dir + "/generated/board_pins.h", error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
+    }
+
+    // Reuse the commands resolved by the previous build when nothing they
+    // were derived from has changed
+    BuildPlan plan;
+    std::string plan_file = build_dir + "/plan.json";
+    std::string settings = GetPlanSettings();
+    std::string plan_key = build_dir + "\n" + settings;
+    auto plan_start = BuildTrace::Clock::now();
+    bool resident_plan = resident_ && resident_plan_valid_ && resident_plan_key_ == plan_key;
+    if (resident_plan || plan.Load(plan_file, settings)) {
+        if (resident_plan) {
+            plan = resident_plan_;
+            std::cout << "Using resident build plan" << std::endl;
+        } else {
+            std::cout << "Using cached build plan" << std::endl;
+        }
+        if (!plan.hal_modules.empty()) {
+            std::cout << "HAL modules: ";
+            for (size_t i = 0; i < plan.hal_modules.size(); ++i) {
+                std::cout << plan.hal_modules[i];
+                if (i < plan.hal_modules.size() - 1) {
+                    std::cout << ", ";
+                }
+            }
+            std::cout << std::endl;
+        }
+    } else {
+        if (!CreateBuildPlan(project, board, project_dir, plan)) {
+            return false;
+        }
+        if (!plan.Save(plan_file, settings)) {
+            std::cerr << "Warning: Failed to write " << plan_file << std::endl;
+        }
+    }
+    if (resident_ && !resident_plan) {
+        resident_plan_ = plan;
+        resident_plan_key_ = plan_key;
+        resident_plan_valid_ = true;
+    }
+    trace_.Record("build plan", "plan", plan_start, BuildTrace::Clock::now());
+    std::cout << std::endl;
+
+    if (!UpdateCompileCommands(plan, project_dir, output_dir + "/compile_commands.json")) {
+        std::cerr << "Warning: Failed to write compile_commands.json" << std::endl;
+    }
+
+    // HAL driver objects are only compiled when their library is missing
+    std::vector<std::string> object_files;
+    std::vector<std::string> stable_objects;
+    std::vector<std::string> hal_objects;
+    std::vector<CompileJob> compile_jobs;
+    bool build_hal_library = !plan.hal_library.empty() && !fs::exists(plan.hal_library);
+    if (!plan.hal_library.empty() && !build_hal_library) {
+        std::cout << "Using HAL library " << fs::path(plan.hal_library).filename().string() << std::endl;
+    }
+    for (const auto& job : plan.jobs) {
+        if (job.hal) {
+            if (build_hal_library) {
+                compile_jobs.push_back(job);
+                hal_objects.push_back(job.object);
+            }
+            continue;
+        }
+        compile_jobs.push_back(job);
+        (job.user ? object_files : stable_objects).push_back(job.object);
+    }
+    if (build_hal_library) {
+        fs::create_directories(build_dir + "/hal");
+        for (const auto& job : compile_jobs) {
+            if (!job.unity_sources.empty() && !WriteUnitySource(job)) {
+                std::cerr << "Error: Failed to write " << job.source << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Precompile lumos.h and the HAL headers behind it for user, board and
+    // wrapper sources
+    if (project.pch) {
+        PreparePrecompiledHeaders(plan);
+    }
+
+    // All translation units are independent, so compile them concurrently
+    if (!CompileAll(compile_jobs)) {
+        std::cerr << "Error: Compilation failed" << std::endl;
+        return false;
+    }
+
+    if (build_hal_library) {
+        std::cout << "Archiving " << fs::path(plan.hal_library).filename().string() << "..." << std::endl;
+        if (!CreateArchive(hal_objects, plan.hal_library)) {
+            std::cerr << "Error: Failed to create HAL library" << std::endl;
+            return false;
+        }
+        std::cout << std::endl;
+    }
+
+    // Board, wrapper, framework and startup objects only change with the
+    // board or the tool, so they are partially linked into one relocatable
+    // object and an edit to user code relinks just the user objects against
+    // it. Not with LTO, where the partial link would run the LTO pass, and
+    // not worth it for the host board.
+    if (!host_ && !lto_ && stable_objects.size() > 1) {
+        std::cout << "Linking board support..." << std::endl;
+        std::string stable = build_dir + "/stable.o";
+        if (!LinkRelocatable(stable_objects, stable)) {
+            std::cerr << "Error: Partial link failed" << std::endl;
+            return false;
+        }
+        object_files.push_back(stable);
+    } else {
+        object_files.insert(object_files.end(), stable_objects.begin(), stable_objects.end());
+    }
+
+    // Archives go after all objects so the linker pulls in only the HAL
+    // members that are actually referenced
+    if (!plan.hal_library.empty()) {
+        object_files.push_back(plan.hal_library);
+    }
+
     // Note: system_stm32h7xx.c is now compiled as part of board support files
 
+    // The host board links a native program, run as build/firmware
+    if (host_) {
+#ifdef _WIN32
+        const std::string program_name = "firmware.exe";
+#else
+        const std::string program_name = "firmware";
+#endif
+        std::cout << "Linking..." << std::endl;
+        std::string program = build_dir + "/" + program_name;
+        if (!LinkFiles(object_files, program, plan.link_flags)) {
+            std::cerr << "Error: Linking failed" << std::endl;
+            return false;
+        }
+        std::cout << std::endl;
+
+        std::string published = output_dir + "/" + program_name;
+        std::error_code ec;
+        fs::copy_file(program, published, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            std::cerr << "Error: Failed to copy " << program_name << " to " << output_dir << ": " << ec.message() << std::endl;
+            return false;
+        }
+
+        std::cout << "Build complete!" << std::endl;
+        std::cout << "Output files:" << std::endl;
+        std::cout << "  " << published << std::endl;
+        std::cout << "Run it with: " << published << " [--duration <seconds>] [--realtime]" << std::endl;
+        RecordBuild(output_dir, board, plan_file, plan);
+        return true;
+    }
+
     // Link
     std::cout << "Linking..." << std::endl;
     std::string elf_file = build_dir + "/firmware.elf";
-    if (!LinkFiles(object_files, elf_file, board, project_dir)) {
+    if (stage_callback_) {
+        stage_callback_(Stage::Linking, elf_file);
+    }
+    if (!LinkFiles(object_files, elf_file, plan.link_flags)) {
         std::cerr << "Error: Linking failed" << std::endl;
         return false;
     }
@@ -809,12 +2357,34 @@ bool Builder::Build(const std::string& project_dir) {
         return false;
     }
     std::cout << std::endl;
+    if (stage_callback_) {
+        stage_callback_(Stage::ImageReady, bin_file);
+    }
+
+    // Publish the profile's outputs at build/ where flash and other tools
+    // expect them
+    std::vector<std::string> outputs;
+    for (const std::string name : {"firmware.elf", "firmware.bin", "firmware.hex", "firmware.segments", "firmware.map"}) {
+        std::string src = build_dir + "/" + name;
+        std::string dst = output_dir + "/" + name;
+        std::error_code ec;
+        if (fs::exists(src, ec)) {
+            fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
+            if (ec) {
+                std::cerr << "Error: Failed to copy " << name << " to " << output_dir << ": " << ec.message() << std::endl;
+                return false;
+            }
+            outputs.push_back(dst);
+        }
+    }
+    bin_file = output_dir + "/firmware.bin";
 
     // Print file sizes
     std::cout << "Build complete!" << std::endl;
     std::cout << "Output files:" << std::endl;
-    std::cout << "  " << elf_file << std::endl;
-    std::cout << "  " << bin_file << std::endl;
+    for (const auto& output : outputs) {
+        std::cout << "  " << output << std::endl;
+    }
 
     // Get binary size
     if (fs::exists(bin_file)) {
@@ -822,6 +2392,24 @@ bool Builder::Build(const std::string& project_dir) {
         std::cout << "  Binary size: " << bin_size << " bytes" << std::endl;
     }
 
+    // Region usage, diffed against the previous build (details: lumos size)
+    SizeReport size_report;
+    std::string size_error;
+    if (size_report.Load(output_dir + "/firmware.elf", output_dir + "/firmware.map", size_error)) {
+        SizeReport previous;
+        bool has_previous = previous.LoadPrevious(output_dir, size_report);
+        size_report.Record(output_dir);
+        std::cout << std::endl;
+        std::cout << "Memory usage:" << std::endl;
+        size_report.PrintRegions(has_previous ? &previous : nullptr);
+        if (size_report.HasLibraryCode()) {
+            std::cout << std::endl;
+            std::cout << "Formatting code from the C library:" << std::endl;
+            size_report.PrintLibraryCode();
+        }
+    }
+
+    RecordBuild(output_dir, board, plan_file, plan);
     return true;
 }
 
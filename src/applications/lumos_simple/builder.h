@@ -2,6 +2,12 @@
 
 #include "project_config.h"
 #include "hal_module_detector.h"
+#include "object_cache.h"
+#include "build_plan.h"
+#include "build_trace.h"
+#include "toolchain.h"
+#include <functional>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -13,39 +19,202 @@ public:
 
     bool Build(const std::string& project_dir);
 
+    // Number of parallel compile jobs (0 = LUMOS_JOBS or hardware threads)
+    void SetJobs(unsigned int jobs) { jobs_ = jobs; }
+
+    // Override the profile from project.yaml (debug, release, size, fast)
+    void SetProfile(const std::string& profile) { profile_override_ = profile; }
+
+    // Build one board of a project.yaml board list; a project listing
+    // several boards builds each into build/<board>
+    void SetBoard(const std::string& board) { board_override_ = board; }
+
+    // Work every board of a build matrix shares, done once before the
+    // per-board builds: load project.yaml, create a missing main file
+    // (which may prompt) and fill the include cache HAL detection reads
+    bool Prepare(const std::string& project_dir, ProjectConfig& project);
+
+    // Bypass the shared object cache for this build
+    void DisableObjectCache() { object_cache_.Disable(); }
+
+    // Record step timings, print a summary and write build/trace.json
+    void EnableTimings() { trace_.Enable(); }
+
+    // Progress of a firmware build for lumos run: Linking as the link
+    // starts, ImageReady with the profile's firmware.bin once objcopy has
+    // written it, before the build's copies and reports. Called from
+    // Build(); not for the host board
+    enum class Stage { Linking, ImageReady };
+    using StageCallback = std::function<void(Stage stage, const std::string& path)>;
+    void SetStageCallback(StageCallback callback) { stage_callback_ = std::move(callback); }
+
+    // Keep the project configuration and build plan in memory between
+    // Build() calls instead of reloading and revalidating them (lumos
+    // daemon); the caller reports every change through NotifyChanged()
+    void EnableResidentState() { resident_ = true; }
+
+    // A watched file or directory changed; structural for a create,
+    // delete or rename. Drops the resident state the change affects.
+    void NotifyChanged(const std::string& path, bool structural);
+
+    // Drop the resident state if any of its inputs changed unreported,
+    // e.g. before their directories were watched; true if it was dropped
+    bool RevalidateResidentState();
+
+    // Directories whose changes affect the resident state
+    std::set<std::string> GetWatchDirectories() const;
+
 private:
     std::string lumos_root_;
+    std::string resource_base_;             // lumos_root_/src or lumos_root_
+    unsigned int jobs_ = 0;
+    std::string profile_override_;
+    std::string board_override_;
+    StageCallback stage_callback_;
+
+    // Settings of the build in progress
+    std::string profile_ = "debug";
+    bool lto_ = false;
+    bool scope_trace_ = false;         // LUMOS_TRACE (project.yaml trace)
+    bool fast_libc_ = false;           // LUMOS_FAST_LIBC (project.yaml fast_libc, by profile)
+    bool dsp_ = false;                 // CMSIS-DSP (project.yaml dsp)
+    bool event_loop_ = false;          // LUMOS_EVENT_LOOP (project.yaml event_loop)
+    std::vector<std::string> us_timers_;  // LUMOS_US_TIMER_LOW/HIGH (project.yaml us_timers)
+    int cxx_standard_ = 0;             // -std=gnu++NN for C++ sources, 0 = compiler default
+    bool host_ = false;                // Host simulator board: native compiler and program
+    Toolchain toolchain_;              // arm-none-eabi installation for the other boards
+    std::string rtos_;                 // "" or freertos
+    uint32_t rtos_stack_pool_ = 0;     // Words
+    uint32_t rtos_default_stack_ = 0;  // Words
+    std::string output_dir_;           // build or build/<board>: published outputs and generated headers
+    std::string build_dir_;
+    std::vector<std::string> include_dirs_;  // project.yaml include_dirs, absolute
+    std::vector<std::string> hal_modules_;   // Of the plan being created; select middleware includes
+    std::vector<std::string> compiler_launcher_;  // e.g. ccache; LUMOS_COMPILER_LAUNCHER or project.yaml
+    std::string pch_c_;
+    std::string pch_cxx_;
+    ObjectCache object_cache_;
+    mutable BuildTrace trace_;
+
+    // Resident state, kept while nothing it was derived from changes
+    bool resident_ = false;
+    std::string resident_dir_;              // Project the state belongs to
+    bool resident_config_valid_ = false;
+    ProjectConfig resident_project_;        // After main file handling, before HAL detection
+    BoardConfig resident_board_;
+    bool resident_plan_valid_ = false;
+    std::string resident_plan_key_;         // Build directory and plan settings
+    BuildPlan resident_plan_;
+
+    bool BuildProject(const std::string& project_dir);
 
     std::string GetResourceBasePath() const;  // Helper for dev vs release structure
     std::string GetToolchainPath() const;
+    std::string GetHostCompiler(bool cxx) const;  // CC/CXX, default gcc/g++
     std::string GetPlatformPath(const std::string& platform) const;
     std::string GetBoardPath(const std::string& board_name) const;
 
-    std::vector<std::string> GetIncludePaths(const BoardConfig& board, const std::string& project_dir) const;
+    std::vector<std::string> GetIncludePaths(const BoardConfig& board, const std::string& project_dir,
+                                             bool project_includes = true) const;
     std::vector<std::string> GetDefines(const BoardConfig& board) const;
+    std::vector<std::string> GetBoardModuleDefines(const std::vector<std::string>& hal_modules) const;
     std::vector<std::string> GetCompilerFlags(const BoardConfig& board) const;
     std::vector<std::string> GetLinkerFlags(const BoardConfig& board, const std::string& project_dir) const;
 
     std::string GetLinkerScript(const BoardConfig& board) const;
     std::string GetStartupFile(const BoardConfig& board) const;
     std::string GetSystemFile(const BoardConfig& board) const;
-    std::vector<std::string> GetBoardSupportFiles(const BoardConfig& board) const;
+    // Board sources plus src/wrapper (all, or per project.yaml wrappers)
+    std::vector<std::string> GetBoardSupportFiles(const BoardConfig& board, const ProjectConfig& project) const;
+    std::vector<std::string> GetHostSerialFiles() const;
     std::vector<std::string> GetRequiredHALFiles(const BoardConfig& board, const std::vector<std::string>& hal_modules) const;
     std::vector<std::string> GetUSBMiddlewareFiles(const BoardConfig& board) const;
+    std::vector<std::string> GetFatFsFiles(const BoardConfig& board) const;
+    std::string GetFreeRTOSPortPath(const BoardConfig& board) const;
+    std::vector<std::string> GetFreeRTOSFiles(const BoardConfig& board) const;
+    std::string GetDspLibrary(const BoardConfig& board) const;  // "" if the package has none for the core
+    std::vector<std::string> GetDspFiles(const BoardConfig& board) const;
+    std::vector<std::string> GetFrameworkFiles() const;
+
+    bool GetCompilerInvocation(const std::string& source_file,
+                               const BoardConfig& board,
+                               const std::string& project_dir,
+                               CompilerInvocation& inv,
+                               bool project_includes = true) const;
+
+    std::vector<std::string> GetCompileCommand(const std::string& source_file,
+                                              const std::string& output_file,
+                                              const CompilerInvocation& inv) const;
+
+    std::string GetCacheKey(const std::string& source_file,
+                           const std::string& output_file,
+                           const CompilerInvocation& inv) const;
 
     bool CompileFile(const std::string& source_file,
                     const std::string& output_file,
-                    const BoardConfig& board,
-                    const std::string& project_dir) const;
+                    const CompilerInvocation& inv,
+                    const std::vector<std::string>& command,
+                    bool& cache_hit,
+                    std::string& output) const;
+
+    // Precompiled lumos.h wrappers for the current build (empty if unused)
+    bool PreparePrecompiledHeaders(const BuildPlan& plan);
+    std::string GetPrecompiledHeader(const std::string& source_file) const;
+
+    // Resolve every compile and link command of the build (cached in plan.json)
+    std::string GetPlanSettings() const;
+    bool CreateBuildPlan(ProjectConfig& project,
+                         const BoardConfig& board,
+                         const std::string& project_dir,
+                         BuildPlan& plan);
+    // Record what a successful build resolved in build/lumos.cache
+    void RecordBuild(const std::string& output_dir,
+                     const BoardConfig& board,
+                     const std::string& plan_file,
+                     const BuildPlan& plan) const;
+    bool UpdateCompileCommands(const BuildPlan& plan,
+                               const std::string& project_dir,
+                               const std::string& database) const;
+
+    bool CompileAll(const std::vector<CompileJob>& jobs) const;
+
+    // HAL unity builds: the generated source and, when its drivers can't
+    // share a translation unit, the same object built from each on its own
+    bool WriteUnitySource(const CompileJob& job) const;
+    bool CompileUnityMembers(const CompileJob& job, const CompilerInvocation& inv,
+                             std::string& output) const;
 
     bool LinkFiles(const std::vector<std::string>& object_files,
                   const std::string& output_elf,
-                  const BoardConfig& board,
-                  const std::string& project_dir) const;
+                  const std::vector<std::string>& link_flags) const;
+
+    // Partially link (ld -r) the objects that rarely change into one
+    // relocatable object, with its map beside it as <output>.map
+    bool LinkRelocatable(const std::vector<std::string>& object_files,
+                         const std::string& output) const;
+
+    // Runs a link of object_files into output unless output is newer than
+    // all of them and was made by the same command
+    bool RunLink(const std::vector<std::string>& cmd,
+                 const std::vector<std::string>& object_files,
+                 const std::string& output) const;
+
+    bool HasProjectHALConfig(const std::string& project_dir) const;
+    std::vector<std::string> GetHALConfigHeaders(const CompilerInvocation& inv) const;
+    std::string GetHALLibraryPath(const BoardConfig& board,
+                                  const std::vector<std::string>& hal_files,
+                                  const std::string& project_dir,
+                                  bool project_includes,
+                                  bool unity) const;
+    bool CreateArchive(const std::vector<std::string>& object_files,
+                      const std::string& archive) const;
 
     bool CreateBinary(const std::string& elf_file, const std::string& bin_file) const;
 
-    bool RunCommand(const std::string& command) const;
+    // Spawn a tool directly (no shell); long commands use response_file
+    bool RunCommand(const std::vector<std::string>& command, const std::string& response_file = "") const;
+    bool RunCommand(const std::vector<std::string>& command, std::string& output,
+                    const std::string& response_file = "", size_t program_args = 1) const;
 
     bool CheckAndCreateMainFile(const std::string& project_dir, ProjectConfig& project);
     std::string PromptLanguage() const;
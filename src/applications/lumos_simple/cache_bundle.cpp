@@ -0,0 +1,181 @@
+#include "cache_bundle.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const char* const kBundleHeader = "lumos-cache-bundle 1";
+const char* const kToolchainsFile = "toolchains";
+
+// Copy exactly @p size bytes between streams
+bool CopyBytes(std::istream& in, std::ostream& out, uint64_t size) {
+    std::vector<char> buffer(1 << 16);
+    while (size > 0) {
+        std::streamsize chunk = static_cast<std::streamsize>(std::min<uint64_t>(size, buffer.size()));
+        if (!in.read(buffer.data(), chunk)) {
+            return false;
+        }
+        out.write(buffer.data(), chunk);
+        size -= static_cast<uint64_t>(chunk);
+    }
+    return out.good();
+}
+
+// Only the cache's own entries, so a bundle can't write elsewhere
+bool IsCachePath(const std::string& path) {
+    fs::path relative(path);
+    if (relative.is_absolute() || relative.has_root_name()) {
+        return false;
+    }
+    for (const auto& part : relative) {
+        if (part == ".." || part == ".") {
+            return false;
+        }
+    }
+    std::string first = relative.begin()->string();
+    bool nested = std::distance(relative.begin(), relative.end()) > 1;
+    return path == kToolchainsFile || ((first == "objects" || first == "hal") && nested);
+}
+
+// Rename-into-place temporaries of concurrent builds are left out
+bool IsTemporary(const fs::path& path) {
+    return path.filename().string().find(".tmp") != std::string::npos;
+}
+
+} // namespace
+
+bool CacheBundle::Export(const std::string& cache_root, const std::string& bundle_file,
+                         CacheBundleStats& stats, std::string& error) {
+    std::vector<std::string> entries;
+    std::error_code ec;
+    for (const char* dir : {"objects", "hal"}) {
+        fs::path path = fs::path(cache_root) / dir;
+        if (!fs::exists(path, ec)) {
+            continue;
+        }
+        for (auto it = fs::recursive_directory_iterator(path, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_regular_file(ec) && !IsTemporary(it->path())) {
+                entries.push_back(it->path().lexically_relative(cache_root).generic_string());
+            }
+        }
+        ec.clear();
+    }
+    if (fs::is_regular_file(fs::path(cache_root) / kToolchainsFile, ec)) {
+        entries.push_back(kToolchainsFile);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::string tmp = bundle_file + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            error = "Cannot write " + bundle_file;
+            return false;
+        }
+        out << kBundleHeader << "\n";
+        for (const auto& entry : entries) {
+            // An entry evicted meanwhile is simply left out
+            std::ifstream in(fs::path(cache_root) / entry, std::ios::binary);
+            uint64_t size = fs::file_size(fs::path(cache_root) / entry, ec);
+            if (!in.is_open() || ec) {
+                continue;
+            }
+            out << size << "\t" << entry << "\n";
+            if (!CopyBytes(in, out, size)) {
+                error = "Failed to copy " + entry + " into " + bundle_file;
+                out.close();
+                fs::remove(tmp, ec);
+                return false;
+            }
+            stats.files++;
+            stats.bytes += size;
+        }
+        out << "end\n";
+        if (!out.good()) {
+            error = "Failed to write " + bundle_file;
+            out.close();
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tmp, bundle_file, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        error = "Cannot write " + bundle_file;
+        return false;
+    }
+    return true;
+}
+
+bool CacheBundle::Import(const std::string& bundle_file, const std::string& cache_root,
+                         CacheBundleStats& stats, std::string& error) {
+    std::ifstream in(bundle_file, std::ios::binary);
+    if (!in.is_open()) {
+        error = "Cannot open " + bundle_file;
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != kBundleHeader) {
+        error = bundle_file + " is not a Lumos cache bundle";
+        return false;
+    }
+
+    std::error_code ec;
+    while (std::getline(in, line)) {
+        if (line == "end") {
+            return true;
+        }
+
+        std::istringstream fields(line);
+        uint64_t size = 0;
+        std::string path;
+        if (!(fields >> size) || fields.get() != '\t' || !std::getline(fields, path) || !IsCachePath(path)) {
+            error = bundle_file + " has an invalid entry: " + line;
+            return false;
+        }
+
+        fs::path dest = fs::path(cache_root) / path;
+        if (fs::exists(dest, ec)) {
+            in.seekg(static_cast<std::streamoff>(size), std::ios::cur);
+            stats.skipped++;
+            continue;
+        }
+
+        // Rename into place so concurrent builds never see a partial entry
+        fs::create_directories(dest.parent_path(), ec);
+        std::string tmp = dest.string() + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out.is_open() || !CopyBytes(in, out, size)) {
+                out.close();
+                fs::remove(tmp, ec);
+                error = bundle_file + " is truncated at " + path;
+                return false;
+            }
+        }
+        fs::rename(tmp, dest, ec);
+        if (ec) {
+            fs::remove(tmp, ec);
+            error = "Cannot write " + dest.string();
+            return false;
+        }
+        stats.files++;
+        stats.bytes += size;
+    }
+
+    error = bundle_file + " is truncated";
+    return false;
+}
+
+} // namespace Lumos
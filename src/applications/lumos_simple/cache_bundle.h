@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief What an export or import moved
+ */
+struct CacheBundleStats {
+    uint64_t files = 0;         // Entries written (export) or added (import)
+    uint64_t skipped = 0;       // Import only: already in the cache
+    uint64_t bytes = 0;         // Of the files written or added
+};
+
+/**
+ * @brief Moves the shared cache between machines as a single file
+ *
+ * A bundle holds the cache's compiled objects (objects/), the prebuilt HAL
+ * archives (hal/) and the toolchain probes (toolchains), so a CI image or
+ * volume can start with what an earlier build produced. The format is a
+ * "lumos-cache-bundle 1" line, then per file a "<size>\t<path>" line
+ * followed by its bytes, and an "end" line.
+ *
+ * Objects and HAL archives are named by the hash of what produced them, so
+ * importing only adds the entries the cache lacks and never replaces one.
+ * The toolchain probes are only taken when the cache has none. Object keys
+ * cover the preprocessed sources, which name the Lumos installation's
+ * paths: entries are reused where Lumos and the toolchain are installed at
+ * the same locations, as in copies of one container image.
+ */
+class CacheBundle {
+public:
+    /**
+     * @brief Write every cache entry under @p cache_root to @p bundle_file
+     */
+    static bool Export(const std::string& cache_root, const std::string& bundle_file,
+                       CacheBundleStats& stats, std::string& error);
+
+    /**
+     * @brief Add the entries of @p bundle_file missing from @p cache_root
+     */
+    static bool Import(const std::string& bundle_file, const std::string& cache_root,
+                       CacheBundleStats& stats, std::string& error);
+};
+
+} // namespace Lumos
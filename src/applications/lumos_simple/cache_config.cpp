@@ -1,18 +1,130 @@
 #include "cache_config.h"
+#include "json_util.h"
 #include <yaml-cpp/yaml.h>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
 namespace Lumos {
 
+namespace {
+
+const char* const kCacheFile = "lumos.cache";
+const char* const kHeader = "lumos-cache 1";
+
+std::vector<std::string> SplitFields(const std::string& line, char separator) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(separator, start);
+        fields.push_back(line.substr(start, end - start));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return fields;
+}
+
+template <typename T>
+bool ParseNumber(const std::string& text, T& value, int base = 10) {
+    try {
+        size_t used = 0;
+        unsigned long long parsed = std::stoull(text, &used, base);
+        if (used != text.size()) {
+            return false;
+        }
+        value = static_cast<T>(parsed);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+} // namespace
+
 CacheConfig::CacheConfig()
     : serial_port_("")
 {
 }
 
+const CachedFlash* CacheConfig::GetFlash(const std::string& port) const {
+    auto it = flashes_.find(port);
+    return it == flashes_.end() ? nullptr : &it->second;
+}
+
+CachedLink CacheConfig::GetLink(const std::string& port) const {
+    auto it = links_.find(port);
+    return it == links_.end() ? CachedLink() : it->second;
+}
+
+void CacheConfig::SetLink(const std::string& port, const CachedLink& link) {
+    if (link.monitor_baud == 0 && link.rom_baud == 0) {
+        links_.erase(port);
+    } else {
+        links_[port] = link;
+    }
+}
+
 bool CacheConfig::Load(const fs::path& build_dir) {
+    fs::path cache_path = build_dir / kCacheFile;
+
+    std::ifstream file(cache_path, std::ios::binary);
+    if (!file.is_open()) {
+        return LoadLegacy(build_dir);
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kHeader) {
+        // Another version's format: start over rather than misread it
+        return false;
+    }
+
+    // Unknown or malformed records are skipped, so a damaged cache only
+    // loses what it cannot read
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields = SplitFields(line, '\t');
+        const std::string& key = fields[0];
+        if (key == "serial_port" && fields.size() == 2) {
+            serial_port_ = fields[1];
+        } else if (key == "board" && fields.size() == 3) {
+            build_.board = fields[1];
+            build_.board_path = fields[2];
+        } else if (key == "toolchain" && fields.size() == 2) {
+            build_.toolchain_path = fields[1];
+        } else if (key == "profile" && fields.size() == 2) {
+            build_.profile = fields[1];
+        } else if (key == "plan" && fields.size() == 2) {
+            ParseNumber(fields[1], build_.plan_hash, 16);
+        } else if (key == "hal" && fields.size() == 3) {
+            build_.hal_modules.clear();
+            if (!fields[1].empty()) {
+                build_.hal_modules = SplitFields(fields[1], ',');
+            }
+            build_.hal_library = fields[2];
+        } else if (key == "flash" && fields.size() == 8) {
+            CachedFlash flash;
+            if (ParseNumber(fields[2], flash.image_crc, 16) &&
+                ParseNumber(fields[3], flash.image_size) &&
+                ParseNumber(fields[4], flash.flashed_at) &&
+                ParseNumber(fields[5], flash.baud_rate) &&
+                ParseNumber(fields[6], flash.window) &&
+                ParseNumber(fields[7], flash.chunk_size)) {
+                flashes_[fields[1]] = flash;
+            }
+        } else if (key == "link" && fields.size() == 4) {
+            CachedLink link;
+            if (ParseNumber(fields[2], link.monitor_baud) && ParseNumber(fields[3], link.rom_baud)) {
+                links_[fields[1]] = link;
+            }
+        }
+    }
+    return true;
+}
+
+bool CacheConfig::LoadLegacy(const fs::path& build_dir) {
     fs::path cache_path = build_dir / "cache.yaml";
 
     if (!fs::exists(cache_path)) {
@@ -33,6 +145,35 @@ bool CacheConfig::Load(const fs::path& build_dir) {
     }
 }
 
+std::string CacheConfig::Serialize() const {
+    std::ostringstream out;
+    out << kHeader << "\n";
+    if (!serial_port_.empty()) {
+        out << "serial_port\t" << serial_port_ << "\n";
+    }
+    if (!build_.board.empty()) {
+        out << "board\t" << build_.board << "\t" << build_.board_path << "\n";
+        out << "toolchain\t" << build_.toolchain_path << "\n";
+        out << "profile\t" << build_.profile << "\n";
+        out << "plan\t" << std::hex << build_.plan_hash << std::dec << "\n";
+        out << "hal\t";
+        for (size_t i = 0; i < build_.hal_modules.size(); ++i) {
+            out << (i > 0 ? "," : "") << build_.hal_modules[i];
+        }
+        out << "\t" << build_.hal_library << "\n";
+    }
+    for (const auto& entry : flashes_) {
+        const CachedFlash& flash = entry.second;
+        out << "flash\t" << entry.first << "\t" << std::hex << flash.image_crc << std::dec
+            << "\t" << flash.image_size << "\t" << flash.flashed_at << "\t" << flash.baud_rate
+            << "\t" << flash.window << "\t" << flash.chunk_size << "\n";
+    }
+    for (const auto& entry : links_) {
+        out << "link\t" << entry.first << "\t" << entry.second.monitor_baud << "\t" << entry.second.rom_baud << "\n";
+    }
+    return out.str();
+}
+
 bool CacheConfig::Save(const fs::path& build_dir) {
     // Ensure build directory exists
     if (!fs::exists(build_dir)) {
@@ -44,37 +185,28 @@ bool CacheConfig::Save(const fs::path& build_dir) {
         }
     }
 
-    fs::path cache_path = build_dir / "cache.yaml";
-
-    try {
-        YAML::Emitter out;
-        out << YAML::BeginMap;
-        out << YAML::Comment("Lumos Cache - Non-persistent project settings");
-        out << YAML::Comment("This file is auto-generated and not meant to be version controlled");
-        out << YAML::Newline;
-
-        if (!serial_port_.empty()) {
-            out << YAML::Key << "serial_port";
-            out << YAML::Value << serial_port_;
-            out << YAML::Comment("Last used serial port");
-        }
-
-        out << YAML::EndMap;
+    fs::path cache_path = build_dir / kCacheFile;
+    std::string content = Serialize();
 
-        std::ofstream fout(cache_path);
-        if (!fout.is_open()) {
-            std::cerr << "Error: Failed to open cache.yaml for writing" << std::endl;
-            return false;
+    // Most runs change nothing, so don't rewrite the file for them
+    std::ifstream existing(cache_path, std::ios::binary);
+    if (existing.is_open()) {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == content) {
+            return true;
         }
+    }
 
-        fout << out.c_str() << std::endl;
-        fout.close();
-
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error: Failed to save cache.yaml: " << e.what() << std::endl;
+    if (!WriteFileAtomically(cache_path.string(), content)) {
+        std::cerr << "Error: Failed to write " << cache_path.string() << std::endl;
         return false;
     }
+
+    // Its settings now live in lumos.cache
+    std::error_code ec;
+    fs::remove(build_dir / "cache.yaml", ec);
+    return true;
 }
 
 } // namespace Lumos
@@ -1,30 +1,72 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <filesystem>
+#include <map>
+#include <vector>
 
 namespace Lumos {
 
+/**
+ * @brief What the last successful build resolved
+ */
+struct CachedBuild {
+    std::string board;
+    std::string board_path;
+    std::string toolchain_path;
+    std::string profile;
+    uint64_t plan_hash = 0;                 // Of build/<profile>/plan.json
+    std::vector<std::string> hal_modules;
+    std::string hal_library;                // Named by the hash of its sources and flags
+};
+
+/**
+ * @brief Last image flashed to a port and the link settings it got
+ */
+struct CachedFlash {
+    uint32_t image_crc = 0;                 // CRC32 of the whole image
+    uint64_t image_size = 0;
+    int64_t flashed_at = 0;                 // Unix time
+    uint32_t baud_rate = 0;                 // Granted by the Lumos bootloader (0 = ROM bootloader)
+    uint32_t window = 0;
+    uint32_t chunk_size = 0;
+};
+
+/**
+ * @brief Baud rates found to work on a port
+ */
+struct CachedLink {
+    uint32_t monitor_baud = 0;              // Console rate lumos monitor detected (0 = unknown)
+    uint32_t rom_baud = 0;                  // Fastest rate the ROM bootloader took (0 = unknown)
+};
+
 /**
  * @brief Cache configuration for project-specific settings
  *
- * Stores non-persistent settings like the last used serial port.
- * Cache is stored in build/cache.yaml and is not meant to be
- * version controlled or shared across different machines.
+ * Stores non-persistent state: the last used serial port, what the last
+ * build resolved, what was last flashed to each port and the baud rates
+ * each port worked at. Cache is stored
+ * in build/lumos.cache, one tab-separated record per line, and is not
+ * meant to be version controlled or shared across different machines.
+ * A build/cache.yaml left by older versions is still read.
  */
 class CacheConfig {
 public:
     CacheConfig();
 
     /**
-     * @brief Load cache from build/cache.yaml
+     * @brief Load cache from build/lumos.cache
      * @param build_dir Path to the build directory
      * @return true if loaded successfully, false otherwise (file may not exist yet)
      */
     bool Load(const std::filesystem::path& build_dir);
 
     /**
-     * @brief Save cache to build/cache.yaml
+     * @brief Save cache to build/lumos.cache
+     *
+     * Written atomically, and only when the content changed.
+     *
      * @param build_dir Path to the build directory
      * @return true if saved successfully, false otherwise
      */
@@ -48,8 +90,30 @@ public:
      */
     bool HasSerialPort() const { return !serial_port_.empty(); }
 
+    const CachedBuild& GetBuild() const { return build_; }
+    void SetBuild(const CachedBuild& build) { build_ = build; }
+
+    /**
+     * @brief Last flash to @p port
+     * @return nullptr if nothing was flashed to it yet
+     */
+    const CachedFlash* GetFlash(const std::string& port) const;
+    void SetFlash(const std::string& port, const CachedFlash& flash) { flashes_[port] = flash; }
+
+    /**
+     * @brief Baud rates found for @p port, all zero if none yet
+     */
+    CachedLink GetLink(const std::string& port) const;
+    void SetLink(const std::string& port, const CachedLink& link);
+
 private:
     std::string serial_port_;
+    CachedBuild build_;
+    std::map<std::string, CachedFlash> flashes_;
+    std::map<std::string, CachedLink> links_;
+
+    bool LoadLegacy(const std::filesystem::path& build_dir);
+    std::string Serialize() const;
 };
 
 } // namespace Lumos
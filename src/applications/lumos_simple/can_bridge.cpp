@@ -0,0 +1,423 @@
+#include "can_bridge.h"
+#include "interrupt_poll.h"
+#include "serial.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace Lumos {
+
+namespace {
+
+bool ParseNumber(const std::string& text, uint32_t& value) {
+    try {
+        size_t pos = 0;
+        value = static_cast<uint32_t>(std::stoul(text, &pos, 0));
+        return pos == text.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+void Put32(std::vector<uint8_t>& buffer, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint32_t Get32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+bool Write(SimpleSerial::Serial& serial, const std::vector<uint8_t>& bytes) {
+    return serial.Write(bytes.data(), bytes.size()) == static_cast<int>(bytes.size());
+}
+
+double WallTime() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// "  0.001234  123  [8]  01 02 03 ..."
+std::string FormatFrame(const CanFrame& frame) {
+    char text[32];
+    std::string line;
+    snprintf(text, sizeof(text), "%12.6f  ", frame.time);
+    line += text;
+    snprintf(text, sizeof(text), frame.extended ? "%08X" : "     %03X", frame.id);
+    line += text;
+    snprintf(text, sizeof(text), frame.fd ? "  FD [%2u] " : "     [%u] ", static_cast<unsigned>(frame.data.size()));
+    line += text;
+    for (uint8_t byte : frame.data) {
+        snprintf(text, sizeof(text), " %02X", byte);
+        line += text;
+    }
+    return line;
+}
+
+} // namespace
+
+bool CanIdFilter::Parse(const std::string& text, CanIdFilter& filter) {
+    const size_t slash = text.find('/');
+    filter = CanIdFilter();
+    if (!ParseNumber(text.substr(0, slash), filter.id)) {
+        return false;
+    }
+    return slash == std::string::npos || ParseNumber(text.substr(slash + 1), filter.mask);
+}
+
+bool MatchesAny(const std::vector<CanIdFilter>& filters, const CanFrame& frame) {
+    if (filters.empty()) {
+        return true;
+    }
+    for (const auto& filter : filters) {
+        if (filter.Matches(frame)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace CanBridge {
+
+uint8_t Crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+std::vector<uint8_t> EncodePacket(const std::vector<uint8_t>& packet) {
+    std::vector<uint8_t> raw = packet;
+    raw.push_back(Crc8(packet.data(), packet.size()));
+
+    std::vector<uint8_t> encoded(1, 0);
+    size_t code_index = 0;
+    uint8_t code = 1;
+    for (uint8_t byte : raw) {
+        if (byte == 0) {
+            encoded[code_index] = code;
+            code_index = encoded.size();
+            encoded.push_back(0);
+            code = 1;
+            continue;
+        }
+        encoded.push_back(byte);
+        if (++code == 0xFF) {
+            encoded[code_index] = code;
+            code_index = encoded.size();
+            encoded.push_back(0);
+            code = 1;
+        }
+    }
+    encoded[code_index] = code;
+    encoded.push_back(0);
+    return encoded;
+}
+
+std::vector<uint8_t> ModePacket(bool binary) {
+    return EncodePacket({kTypeMode, static_cast<uint8_t>(binary ? 1 : 0)});
+}
+
+std::vector<uint8_t> SendPacket(const CanFrame& frame) {
+    std::vector<uint8_t> packet;
+    packet.push_back(kTypeSend);
+    packet.push_back((frame.extended ? kFlagExtended : 0) | (frame.fd ? kFlagFd : 0));
+    Put32(packet, frame.id);
+    packet.push_back(static_cast<uint8_t>(frame.data.size()));
+    packet.insert(packet.end(), frame.data.begin(), frame.data.end());
+    return EncodePacket(packet);
+}
+
+void Decoder::Feed(const uint8_t* data, size_t length, std::vector<std::vector<uint8_t>>& packets) {
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] != 0) {
+            if (encoded_.size() < 512) {
+                encoded_.push_back(data[i]);
+            }
+            continue;
+        }
+
+        // COBS decode
+        std::vector<uint8_t> packet;
+        bool valid = !encoded_.empty();
+        size_t read = 0;
+        while (valid && read < encoded_.size()) {
+            const uint8_t code = encoded_[read++];
+            if (code == 0 || read + code - 1 > encoded_.size()) {
+                valid = false;
+                break;
+            }
+            packet.insert(packet.end(), encoded_.begin() + read, encoded_.begin() + read + code - 1);
+            read += code - 1;
+            if (code != 0xFF && read < encoded_.size()) {
+                packet.push_back(0);
+            }
+        }
+        encoded_.clear();
+
+        valid = valid && packet.size() >= 2 &&
+                Crc8(packet.data(), packet.size() - 1) == packet.back();
+        if (!valid) {
+            if (synced_) {
+                errors_++;
+            }
+            continue;
+        }
+        synced_ = true;
+        packet.pop_back();
+        packets.push_back(std::move(packet));
+    }
+}
+
+bool ParseFrame(const std::vector<uint8_t>& packet, CanFrame& frame, uint32_t& time_us) {
+    // type | flags | id u32 | time_us u32 | length | data
+    if (packet.size() < 11 || packet[0] != kTypeFrame || packet.size() < 11u + packet[10]) {
+        return false;
+    }
+    frame.extended = (packet[1] & kFlagExtended) != 0;
+    frame.fd = (packet[1] & kFlagFd) != 0;
+    frame.id = Get32(&packet[2]);
+    time_us = Get32(&packet[6]);
+    frame.data.assign(packet.begin() + 11, packet.begin() + 11 + packet[10]);
+    return true;
+}
+
+} // namespace CanBridge
+
+std::string FormatCandump(const CanFrame& frame, double epoch_time, const std::string& interface) {
+    char text[64];
+    snprintf(text, sizeof(text), "(%.6f) %s ", epoch_time, interface.c_str());
+    std::string line = text;
+    snprintf(text, sizeof(text), frame.extended ? "%08X" : "%03X", frame.id);
+    line += text;
+    line += frame.fd ? "##0" : "#";
+    for (uint8_t byte : frame.data) {
+        snprintf(text, sizeof(text), "%02X", byte);
+        line += text;
+    }
+    return line;
+}
+
+bool ParseCandump(const std::string& line, CanFrame& frame) {
+    // (seconds) interface ID#DATA  or  ID##FLAGSDATA
+    char interface[32];
+    char body[300];
+    double time = 0.0;
+    if (sscanf(line.c_str(), " (%lf) %31s %299s", &time, interface, body) != 3) {
+        return false;
+    }
+
+    std::string text = body;
+    const size_t hash = text.find('#');
+    if (hash == std::string::npos || hash == 0) {
+        return false;
+    }
+    const std::string id = text.substr(0, hash);
+    std::string data = text.substr(hash + 1);
+    frame = CanFrame();
+    frame.time = time;
+    frame.extended = id.size() > 3;
+    if (!data.empty() && data[0] == '#') {
+        // CAN FD: one flags digit before the data
+        frame.fd = true;
+        data = data.size() >= 2 ? data.substr(2) : "";
+    } else if (!data.empty() && (data[0] == 'R' || data[0] == 'r')) {
+        return false;  // Remote frames are not replayed
+    }
+    if (!ParseNumber("0x" + id, frame.id) || data.size() % 2 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < data.size(); i += 2) {
+        uint32_t byte = 0;
+        if (!ParseNumber("0x" + data.substr(i, 2), byte)) {
+            return false;
+        }
+        frame.data.push_back(static_cast<uint8_t>(byte));
+    }
+    return frame.data.size() <= 64;
+}
+
+bool RunCanSniffer(const CanSnifferOptions& options, const volatile bool& running, std::string& error) {
+    std::ofstream record;
+    if (!options.record_file.empty()) {
+        record.open(options.record_file, std::ios::out | std::ios::trunc);
+        if (!record.is_open()) {
+            error = "cannot open " + options.record_file;
+            return false;
+        }
+    }
+
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = options.baud_rate;
+    if (!serial.Open(options.port, config)) {
+        error = options.port + ": " + serial.GetLastError();
+        return false;
+    }
+    if (!Write(serial, CanBridge::ModePacket(true))) {
+        error = options.port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    CanBridge::Decoder decoder;
+    std::vector<std::vector<uint8_t>> packets;
+    uint8_t buffer[4096];
+
+    // Device time, extended past its 32-bit wrap, and where it starts
+    bool have_time = false;
+    uint32_t last_time_us = 0;
+    uint64_t device_us = 0;
+    uint64_t first_us = 0;
+    double first_wall = 0.0;
+
+    uint64_t frames = 0;
+    uint64_t shown = 0;
+    uint32_t can_dropped = 0;
+    uint32_t bridge_dropped = 0;
+    bool ok = true;
+
+    while (running) {
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = options.port + ": " + serial.GetLastError();
+            ok = false;
+            break;
+        }
+
+        packets.clear();
+        decoder.Feed(buffer, static_cast<size_t>(bytes_read), packets);
+        for (const auto& packet : packets) {
+            if (packet[0] == CanBridge::kTypeDrops && packet.size() >= 9) {
+                const uint32_t can = Get32(&packet[1]);
+                const uint32_t bridge = Get32(&packet[5]);
+                if (can != can_dropped || bridge != bridge_dropped) {
+                    std::cerr << "Warning: frames lost on the device (CAN receive " << can
+                              << ", serial " << bridge << ")" << std::endl;
+                    can_dropped = can;
+                    bridge_dropped = bridge;
+                }
+                continue;
+            }
+
+            CanFrame frame;
+            uint32_t time_us = 0;
+            if (!CanBridge::ParseFrame(packet, frame, time_us)) {
+                continue;
+            }
+            if (!have_time) {
+                have_time = true;
+                device_us = time_us;
+                first_us = time_us;
+                first_wall = WallTime();
+            } else {
+                device_us += static_cast<uint32_t>(time_us - last_time_us);
+            }
+            last_time_us = time_us;
+            frames++;
+
+            frame.time = (device_us - first_us) / 1e6;
+            if (!MatchesAny(options.filters, frame)) {
+                continue;
+            }
+            shown++;
+            if (!options.quiet) {
+                std::cout << FormatFrame(frame) << '\n';
+            }
+            if (record.is_open()) {
+                record << FormatCandump(frame, first_wall + frame.time, "can0") << '\n';
+            }
+        }
+        std::cout << std::flush;
+    }
+
+    // Back to text so the board's normal output returns
+    Write(serial, CanBridge::ModePacket(false));
+    serial.Close();
+
+    std::cout << frames << " frames received";
+    if (!options.filters.empty()) {
+        std::cout << ", " << shown << " matched the filters";
+    }
+    if (record.is_open()) {
+        std::cout << ", recorded to " << options.record_file;
+    }
+    std::cout << std::endl;
+    if (decoder.GetErrors() > 0) {
+        std::cerr << "Warning: " << decoder.GetErrors() << " corrupted packets were dropped" << std::endl;
+    }
+    return ok;
+}
+
+bool RunCanReplay(const std::string& log_file, const std::string& port, int baud_rate,
+                  const std::vector<CanIdFilter>& filters, const volatile bool& running,
+                  std::string& error) {
+    std::ifstream file(log_file);
+    if (!file.is_open()) {
+        error = "cannot open " + log_file;
+        return false;
+    }
+
+    std::vector<CanFrame> frames;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        CanFrame frame;
+        if (!ParseCandump(line, frame)) {
+            std::cerr << "Warning: " << log_file << ":" << line_number << ": skipping unreadable line"
+                      << std::endl;
+            continue;
+        }
+        if (MatchesAny(filters, frame)) {
+            frames.push_back(frame);
+        }
+    }
+    if (frames.empty()) {
+        error = "no frames to replay in " + log_file;
+        return false;
+    }
+
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    // Binary mode keeps the bridge's own traffic off the bus
+    bool ok = Write(serial, CanBridge::ModePacket(true));
+    const auto start = std::chrono::steady_clock::now();
+    const double first = frames.front().time;
+    size_t sent = 0;
+    for (const auto& frame : frames) {
+        if (!running || !ok) {
+            break;
+        }
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(frame.time - first)));
+        ok = Write(serial, CanBridge::SendPacket(frame));
+        sent += ok ? 1 : 0;
+    }
+    if (!ok) {
+        error = port + ": " + serial.GetLastError();
+    }
+
+    Write(serial, CanBridge::ModePacket(false));
+    serial.Close();
+    std::cout << "Replayed " << sent << " of " << frames.size() << " frames" << std::endl;
+    return ok;
+}
+
+} // namespace Lumos
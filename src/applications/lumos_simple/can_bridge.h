@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief A CAN frame as seen by the host tools
+ */
+struct CanFrame {
+    uint32_t id = 0;
+    bool extended = false;
+    bool fd = false;
+    std::vector<uint8_t> data;
+    double time = 0.0;  // seconds
+};
+
+/**
+ * @brief ID filter: a frame matches if (id & mask) == (filter id & mask)
+ */
+struct CanIdFilter {
+    uint32_t id = 0;
+    uint32_t mask = 0x1FFFFFFF;
+
+    bool Matches(const CanFrame& frame) const { return (frame.id & mask) == (id & mask); }
+
+    /**
+     * @brief Parse "ID" or "ID/MASK" (decimal or 0x hex)
+     */
+    static bool Parse(const std::string& text, CanIdFilter& filter);
+};
+
+/** True if @p filters is empty or any of them matches */
+bool MatchesAny(const std::vector<CanIdFilter>& filters, const CanFrame& frame);
+
+/**
+ * @brief Packet framing of the firmware CAN bridge (src/wrapper/can_bridge.h)
+ *
+ * Packets are "type | payload | crc8" (poly 0x07), COBS-encoded and
+ * terminated by a 0x00 byte. See the firmware header for the packet types.
+ */
+namespace CanBridge {
+
+constexpr uint8_t kTypeFrame = 0x01;
+constexpr uint8_t kTypeSend = 0x02;
+constexpr uint8_t kTypeMode = 0x03;
+constexpr uint8_t kTypeDrops = 0x04;
+
+constexpr uint8_t kFlagExtended = 0x01;
+constexpr uint8_t kFlagFd = 0x02;
+
+uint8_t Crc8(const uint8_t* data, size_t length);
+
+/** Append the CRC, COBS-encode and add the terminating 0x00 */
+std::vector<uint8_t> EncodePacket(const std::vector<uint8_t>& packet);
+
+/** MODE packet switching the bridge to binary (true) or text */
+std::vector<uint8_t> ModePacket(bool binary);
+
+/** SEND packet putting @p frame on the bus */
+std::vector<uint8_t> SendPacket(const CanFrame& frame);
+
+/**
+ * @brief Splits a byte stream back into packets
+ *
+ * Bytes that do not decode to a packet with a valid CRC (text output from
+ * before the switch to binary mode, line noise) are dropped.
+ */
+class Decoder {
+public:
+    /**
+     * @brief Decode @p data, appending complete packets (type and payload, no CRC)
+     */
+    void Feed(const uint8_t* data, size_t length, std::vector<std::vector<uint8_t>>& packets);
+
+    /** Packets rejected after the first good one */
+    uint64_t GetErrors() const { return errors_; }
+
+private:
+    std::vector<uint8_t> encoded_;
+    bool synced_ = false;
+    uint64_t errors_ = 0;
+};
+
+/**
+ * @brief Parse a FRAME packet
+ * @param time_us Receives the device's 32-bit microsecond time
+ */
+bool ParseFrame(const std::vector<uint8_t>& packet, CanFrame& frame, uint32_t& time_us);
+
+} // namespace CanBridge
+
+/**
+ * @brief One line of a candump -l log: "(1436509052.249713) can0 123#DEADBEEF"
+ *
+ * Extended IDs have 8 hex digits, CAN FD frames use "##<flags>".
+ */
+std::string FormatCandump(const CanFrame& frame, double epoch_time, const std::string& interface);
+bool ParseCandump(const std::string& line, CanFrame& frame);
+
+struct CanSnifferOptions {
+    std::string port;
+    int baud_rate = 1000000;
+    std::vector<CanIdFilter> filters;
+    std::string record_file;  // candump log, empty = none
+    bool quiet = false;       // don't print frames
+};
+
+/**
+ * @brief Print (and record) bus traffic until @p running turns false (lumos can)
+ */
+bool RunCanSniffer(const CanSnifferOptions& options, const volatile bool& running, std::string& error);
+
+/**
+ * @brief Send a candump log back onto the bus with its original timing (lumos can replay)
+ */
+bool RunCanReplay(const std::string& log_file, const std::string& port, int baud_rate,
+                  const std::vector<CanIdFilter>& filters, const volatile bool& running,
+                  std::string& error);
+
+} // namespace Lumos
@@ -0,0 +1,140 @@
+#include "can_stats.h"
+#include "interrupt_poll.h"
+#include "serial.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace Lumos {
+
+uint32_t CanStatsLine::Get(const std::string& key) const {
+    auto it = fields.find(key);
+    return it != fields.end() ? it->second : 0;
+}
+
+bool ParseCanStatsLine(const std::string& line, CanStatsLine& parsed) {
+    // The marker may follow other output on the same line
+    size_t start = line.find('@');
+    if (start == std::string::npos) {
+        return false;
+    }
+
+    std::istringstream ss(line.substr(start + 1));
+    std::string kind;
+    ss >> kind;
+    if (kind != "canstats" && kind != "canlatency") {
+        return false;
+    }
+
+    parsed.kind = kind;
+    parsed.fields.clear();
+    std::string token;
+    while (ss >> token) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            continue;
+        }
+        try {
+            parsed.fields[token.substr(0, equals)] =
+                static_cast<uint32_t>(std::stoul(token.substr(equals + 1)));
+        } catch (...) {
+            // Not a number: ignore the field
+        }
+    }
+    return true;
+}
+
+std::string CanStatsView::Feed(const std::string& line) {
+    CanStatsLine stats;
+    if (!ParseCanStatsLine(line, stats)) {
+        return "";
+    }
+
+    const uint32_t port = stats.Get("port");
+    char text[256];
+
+    if (stats.kind == "canlatency") {
+        snprintf(text, sizeof(text), "CAN%u  latency  n=%u  min %u us  avg %u us  max %u us",
+                 port, stats.Get("n"), stats.Get("min_us"), stats.Get("avg_us"), stats.Get("max_us"));
+        return text;
+    }
+
+    std::string rates;
+    auto prev = previous_.find(port);
+    if (prev != previous_.end()) {
+        // Unsigned differences survive the counters wrapping
+        const uint32_t elapsed_ms = stats.Get("t") - prev->second.Get("t");
+        if (elapsed_ms > 0) {
+            const double seconds = elapsed_ms / 1000.0;
+            const double tx_rate = (stats.Get("tx") - prev->second.Get("tx")) / seconds;
+            const double rx_rate = (stats.Get("rx") - prev->second.Get("rx")) / seconds;
+            const uint32_t bitrate = stats.Get("bitrate");
+            const double load = bitrate > 0
+                ? 100.0 * (stats.Get("bits") - prev->second.Get("bits")) / seconds / bitrate
+                : 0.0;
+            char buffer[96];
+            snprintf(buffer, sizeof(buffer), "tx %7.1f/s  rx %7.1f/s  load %5.1f%%  ",
+                     tx_rate, rx_rate, load);
+            rates = buffer;
+        }
+    }
+    if (rates.empty()) {
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), "tx %9u  rx %9u  ", stats.Get("tx"), stats.Get("rx"));
+        rates = buffer;
+    }
+
+    snprintf(text, sizeof(text),
+             "CAN%u  %sdrop tx %u rx %u  fifo hw %u/%u  queue hw rx %u tx %u  "
+             "tec %u rec %u  passive %u ms  bus-off %u",
+             port, rates.c_str(), stats.Get("tx_drop"), stats.Get("rx_drop"),
+             stats.Get("fifo0_hw"), stats.Get("fifo1_hw"), stats.Get("rxq_hw"), stats.Get("txq_hw"),
+             stats.Get("tec"), stats.Get("rec"), stats.Get("ep_ms"), stats.Get("busoff"));
+    previous_[port] = stats;
+    return text;
+}
+
+bool RunCanStats(const std::string& port, int baud_rate, const volatile bool& running,
+                 std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    CanStatsView view;
+    std::string partial;
+    uint8_t buffer[1024];
+    while (running) {
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+
+        const char* data = reinterpret_cast<const char*>(buffer);
+        const char* end = data + bytes_read;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            partial.append(data, newline ? newline : end);
+            if (!newline) {
+                break;
+            }
+            const std::string text = view.Feed(partial);
+            if (!text.empty()) {
+                std::cout << text << std::endl;
+            }
+            partial.clear();
+            data = newline + 1;
+        }
+    }
+
+    serial.Close();
+    return true;
+}
+
+} // namespace Lumos
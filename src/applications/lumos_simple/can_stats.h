@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Key/value fields of one "@canstats" or "@canlatency" line
+ *
+ * Firmware reports CAN bus health as text lines on its serial console:
+ *
+ *   @canstats port=1 t=12345 bitrate=500000 tx=.. tx_drop=.. rx=.. rx_drop=..
+ *             bits=.. fifo0_hw=.. fifo1_hw=.. rxq_hw=.. txq_hw=.. tec=.. rec=..
+ *             ep_ms=.. busoff=..
+ *   @canlatency port=1 n=.. min_us=.. avg_us=.. max_us=..
+ *
+ * (CAN::printStats() writes the first form.) Counters are free-running
+ * 32-bit values, t is the device's millisecond tick.
+ */
+struct CanStatsLine {
+    std::string kind;                      // "canstats" or "canlatency"
+    std::map<std::string, uint32_t> fields;
+
+    uint32_t Get(const std::string& key) const;
+};
+
+/**
+ * @brief Parse a console line
+ * @return false if it is not a stats line
+ */
+bool ParseCanStatsLine(const std::string& line, CanStatsLine& parsed);
+
+/**
+ * @brief Turns successive stats lines into rates (lumos can-stats)
+ *
+ * Each "@canstats" line is printed as frame rates, estimated bus load and
+ * the drop, high-water and error counters; rates need two lines from the
+ * same port, the first one only prints the totals.
+ */
+class CanStatsView {
+public:
+    /**
+     * @brief Format @p line for display
+     * @return The text to print, empty for lines that are not stats
+     */
+    std::string Feed(const std::string& line);
+
+private:
+    std::map<uint32_t, CanStatsLine> previous_;  // last "@canstats" per port
+};
+
+/**
+ * @brief Print stats lines from @p port until @p running turns false
+ */
+bool RunCanStats(const std::string& port, int baud_rate, const volatile bool& running,
+                 std::string& error);
+
+} // namespace Lumos
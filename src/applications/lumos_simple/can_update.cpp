@@ -0,0 +1,412 @@
+#include "can_update.h"
+#include "can_bridge.h"
+#include "serial.h"
+#include "crc32.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace Lumos {
+
+namespace CanUpdate {
+
+bool ParseNodes(const std::string& text, std::vector<uint8_t>& nodes) {
+    nodes.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) {
+            comma = text.size();
+        }
+        const std::string item = text.substr(start, comma - start);
+        const size_t dash = item.find('-');
+        try {
+            size_t pos = 0;
+            const unsigned long first = std::stoul(item.substr(0, dash), &pos, 0);
+            unsigned long last = first;
+            if (dash != std::string::npos) {
+                last = std::stoul(item.substr(dash + 1), &pos, 0);
+            }
+            if (pos == 0 || first > last || last >= kMaxNodes) {
+                return false;
+            }
+            for (unsigned long node = first; node <= last; ++node) {
+                nodes.push_back(static_cast<uint8_t>(node));
+            }
+        } catch (...) {
+            return false;
+        }
+        start = comma + 1;
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    return !nodes.empty();
+}
+
+} // namespace CanUpdate
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct NodeStatus {
+    uint8_t state = 0;
+    uint16_t session = 0;
+    uint16_t block = 0;
+    uint16_t missing = 0;
+    uint8_t bitmap[CanUpdate::kBlockFrames / 8] = {};
+};
+
+struct Node {
+    bool alive = true;
+    std::string reason;
+    bool replied = false;    // In the current round
+    NodeStatus status;
+    int strikes = 0;         // Unanswered queries or rounds without progress, in a row
+    uint16_t last_missing = 0;
+};
+
+void Put16(std::vector<uint8_t>& buffer, uint16_t value) {
+    buffer.push_back(static_cast<uint8_t>(value));
+    buffer.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void Put32(std::vector<uint8_t>& buffer, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint16_t Get16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+class Updater {
+public:
+    Updater(SimpleSerial::Serial& serial, const std::vector<uint8_t>& image, const CanUpdateOptions& options,
+            const volatile bool& running)
+        : serial_(serial), image_(image), options_(options), running_(running) {
+        frames_ = (image.size() + CanUpdate::kFrameBytes - 1) / CanUpdate::kFrameBytes;
+        // Different from the last run, so no node mistakes it for a repeat
+        session_ = static_cast<uint16_t>(Clock::now().time_since_epoch().count() | 1);
+        for (uint8_t node : options.nodes) {
+            nodes_[node] = Node();
+        }
+    }
+
+    bool Run(std::string& error) {
+        if (!Begin()) {
+            return Failed(error);
+        }
+
+        const size_t blocks = (frames_ + CanUpdate::kBlockFrames - 1) / CanUpdate::kBlockFrames;
+        const auto start = Clock::now();
+        for (size_t block = 0; block < blocks && AnyAlive(); ++block) {
+            if (!SendBlock(static_cast<uint16_t>(block))) {
+                return Failed(error);
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::cout << "\r  Block " << (block + 1) << "/" << blocks << ", " << CountAlive() << " nodes, "
+                      << static_cast<int>(std::min(image_.size(), (block + 1) * CanUpdate::kBlockFrames *
+                                                                      CanUpdate::kFrameBytes) /
+                                          1024.0 / std::max(seconds, 1e-3))
+                      << " KB/s, " << repeated_ << " frames repeated" << std::flush;
+        }
+        std::cout << std::endl;
+
+        if (AnyAlive() && !Commit()) {
+            return Failed(error);
+        }
+        return true;
+    }
+
+    void Abort() {
+        SendControl(CanUpdate::kAbort, CanUpdate::kAllNodes, {});
+    }
+
+    std::vector<CanUpdateResult> GetResults() const {
+        std::vector<CanUpdateResult> results;
+        for (const auto& entry : nodes_) {
+            CanUpdateResult result;
+            result.node = entry.first;
+            result.ok = entry.second.alive && entry.second.status.state == CanUpdate::kDone;
+            result.reason = entry.second.alive && !result.ok ? "not committed" : entry.second.reason;
+            results.push_back(result);
+        }
+        return results;
+    }
+
+private:
+    SimpleSerial::Serial& serial_;
+    const std::vector<uint8_t>& image_;
+    const CanUpdateOptions& options_;
+    const volatile bool& running_;
+    CanBridge::Decoder decoder_;
+    std::map<uint8_t, Node> nodes_;
+    size_t frames_ = 0;
+    uint16_t session_ = 0;
+    uint64_t repeated_ = 0;
+    bool port_failed_ = false;
+
+    bool Failed(std::string& error) {
+        error = port_failed_ ? options_.port + ": " + serial_.GetLastError() : "interrupted";
+        return false;
+    }
+
+    bool AnyAlive() const { return CountAlive() > 0; }
+
+    size_t CountAlive() const {
+        size_t alive = 0;
+        for (const auto& entry : nodes_) {
+            alive += entry.second.alive ? 1 : 0;
+        }
+        return alive;
+    }
+
+    void Drop(Node& node, const std::string& reason) {
+        node.alive = false;
+        node.reason = reason;
+    }
+
+    bool Send(const CanFrame& frame) {
+        const std::vector<uint8_t> bytes = CanBridge::SendPacket(frame);
+        if (serial_.Write(bytes.data(), bytes.size()) != static_cast<int>(bytes.size())) {
+            port_failed_ = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool SendControl(uint8_t command, uint8_t node, const std::vector<uint8_t>& arguments) {
+        CanFrame frame;
+        frame.id = CanUpdate::kControlId;
+        frame.fd = true;
+        frame.data = {command, node};
+        Put16(frame.data, session_);
+        frame.data.insert(frame.data.end(), arguments.begin(), arguments.end());
+        // Above 8 bytes FD lengths go in steps; BEGIN, the longest, is 12
+        if (frame.data.size() > 8) {
+            frame.data.resize(12, 0);
+        }
+        return Send(frame);
+    }
+
+    bool SendData(size_t seq) {
+        CanFrame frame;
+        frame.id = CanUpdate::kDataBase | static_cast<uint32_t>(seq);
+        frame.extended = true;
+        frame.fd = true;
+        const size_t offset = seq * CanUpdate::kFrameBytes;
+        const size_t length = std::min(CanUpdate::kFrameBytes, image_.size() - offset);
+        frame.data.assign(image_.begin() + offset, image_.begin() + offset + length);
+        frame.data.resize(CanUpdate::kFrameBytes, 0xFF);
+        return Send(frame);
+    }
+
+    /**
+     * @brief Read STATUS replies until every live node has replied or @p timeout_ms passed
+     * @return false if the port failed or the run was interrupted
+     */
+    bool Collect(int timeout_ms) {
+        const auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        uint8_t buffer[4096];
+        std::vector<std::vector<uint8_t>> packets;
+        while (running_) {
+            bool waiting = false;
+            for (const auto& entry : nodes_) {
+                waiting |= entry.second.alive && !entry.second.replied;
+            }
+            const int left = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+            if (!waiting || left <= 0) {
+                return true;
+            }
+
+            const int bytes_read = serial_.Read(buffer, sizeof(buffer), std::min(left, 20));
+            if (bytes_read < 0) {
+                port_failed_ = true;
+                return false;
+            }
+            packets.clear();
+            decoder_.Feed(buffer, static_cast<size_t>(bytes_read), packets);
+            for (const auto& packet : packets) {
+                CanFrame frame;
+                uint32_t time_us = 0;
+                if (!CanBridge::ParseFrame(packet, frame, time_us) || frame.extended ||
+                    frame.id < CanUpdate::kStatusBase || frame.id >= CanUpdate::kStatusBase + CanUpdate::kMaxNodes ||
+                    frame.data.size() < CanUpdate::kStatusBytes) {
+                    continue;  // Other traffic on the bus
+                }
+                auto it = nodes_.find(static_cast<uint8_t>(frame.id - CanUpdate::kStatusBase));
+                if (it == nodes_.end()) {
+                    continue;
+                }
+                NodeStatus& status = it->second.status;
+                status.state = frame.data[0];
+                status.session = Get16(&frame.data[2]);
+                status.block = Get16(&frame.data[4]);
+                status.missing = Get16(&frame.data[6]);
+                std::copy(frame.data.begin() + 8, frame.data.begin() + 8 + sizeof(status.bitmap), status.bitmap);
+                it->second.replied = true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Send @p command to every live node and collect the replies
+     *
+     * Broadcast first, waiting up to @p timeout_ms; nodes that stay silent
+     * are asked again one by one, up to the retry limit, then dropped. A
+     * node that missed the broadcast still acts on it, so the repeats only
+     * wait the reply timeout.
+     */
+    bool Exchange(uint8_t command, const std::vector<uint8_t>& arguments, int timeout_ms) {
+        for (auto& entry : nodes_) {
+            entry.second.replied = false;
+        }
+        if (!SendControl(command, CanUpdate::kAllNodes, arguments) || !Collect(timeout_ms)) {
+            return false;
+        }
+        for (auto& entry : nodes_) {
+            Node& node = entry.second;
+            int attempts = 0;
+            while (node.alive && !node.replied && attempts++ < options_.retries) {
+                if (!SendControl(command, entry.first, arguments) || !Collect(options_.reply_timeout_ms)) {
+                    return false;
+                }
+            }
+            if (node.alive && !node.replied) {
+                Drop(node, "no reply");
+            } else if (node.alive && node.status.session != session_) {
+                Drop(node, "not in this session");
+            } else if (node.alive && node.status.state == CanUpdate::kError) {
+                Drop(node, command == CanUpdate::kCommit ? "CRC or storage failure" : "no room or storage failure");
+            }
+        }
+        return true;
+    }
+
+    bool Begin() {
+        std::vector<uint8_t> arguments;
+        Put32(arguments, static_cast<uint32_t>(image_.size()));
+        Put32(arguments, SimpleSerial::Crc32(image_.data(), image_.size()));
+        std::cout << "  Erasing on " << nodes_.size() << " nodes..." << std::endl;
+        return Exchange(CanUpdate::kBegin, arguments, options_.begin_timeout_ms);
+    }
+
+    // Broadcast one block, then repeat what any node missed
+    bool SendBlock(uint16_t block) {
+        const size_t first = static_cast<size_t>(block) * CanUpdate::kBlockFrames;
+        const size_t count = std::min(CanUpdate::kBlockFrames, frames_ - first);
+        std::vector<bool> wanted(count, true);
+        for (auto& entry : nodes_) {
+            entry.second.strikes = 0;
+            entry.second.last_missing = static_cast<uint16_t>(count);
+        }
+
+        bool first_round = true;
+        while (true) {
+            const auto start = Clock::now();
+            size_t sent = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (!wanted[i]) {
+                    continue;
+                }
+                if (!running_) {
+                    return false;
+                }
+                if (options_.frame_rate > 0) {
+                    std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1000000 / options_.frame_rate));
+                }
+                if (!SendData(first + i)) {
+                    return false;
+                }
+                sent++;
+            }
+            if (!first_round) {
+                repeated_ += sent;
+            }
+            first_round = false;
+
+            std::vector<uint8_t> arguments;
+            Put16(arguments, block);
+            if (!Exchange(CanUpdate::kQuery, arguments, options_.reply_timeout_ms)) {
+                return false;
+            }
+
+            // The union of what the live nodes are missing
+            std::fill(wanted.begin(), wanted.end(), false);
+            bool any = false;
+            for (auto& entry : nodes_) {
+                Node& node = entry.second;
+                if (!node.alive || node.status.missing == 0) {
+                    continue;
+                }
+                if (node.status.missing >= node.last_missing && ++node.strikes > options_.retries) {
+                    Drop(node, "no progress in block " + std::to_string(block));
+                    continue;
+                }
+                if (node.status.missing < node.last_missing) {
+                    node.strikes = 0;
+                }
+                node.last_missing = node.status.missing;
+                for (size_t i = 0; i < count; ++i) {
+                    if (!(node.status.bitmap[i / 8] & (1u << (i % 8)))) {
+                        wanted[i] = true;
+                        any = true;
+                    }
+                }
+            }
+            if (!any) {
+                return true;
+            }
+        }
+    }
+
+    bool Commit() {
+        std::cout << "  Checking the image on " << CountAlive() << " nodes..." << std::endl;
+        // The nodes read back the whole image for its CRC
+        return Exchange(CanUpdate::kCommit, {}, options_.begin_timeout_ms);
+    }
+};
+
+} // namespace
+
+bool RunCanUpdate(const std::vector<uint8_t>& image, const CanUpdateOptions& options, const volatile bool& running,
+                  std::vector<CanUpdateResult>& results, std::string& error) {
+    if (image.empty() || image.size() > 0x10000 * CanUpdate::kFrameBytes) {
+        error = "image must be 1 byte to 4 MB";
+        return false;
+    }
+
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = options.baud_rate;
+    if (!serial.Open(options.port, config)) {
+        error = options.port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    const std::vector<uint8_t> binary = CanBridge::ModePacket(true);
+    if (serial.Write(binary.data(), binary.size()) != static_cast<int>(binary.size())) {
+        error = options.port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    Updater updater(serial, image, options, running);
+    const bool ok = updater.Run(error);
+    if (!ok) {
+        updater.Abort();
+    }
+    results = updater.GetResults();
+
+    const std::vector<uint8_t> text = CanBridge::ModePacket(false);
+    serial.Write(text.data(), text.size());
+    serial.Close();
+    return ok;
+}
+
+} // namespace Lumos
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief IDs and commands of the CAN FD firmware update (src/wrapper/can_update.h)
+ */
+namespace CanUpdate {
+
+constexpr uint32_t kDataBase = 0x1F000000;
+constexpr uint32_t kControlId = 0x7E0;
+constexpr uint32_t kStatusBase = 0x780;
+constexpr uint8_t kMaxNodes = 64;
+constexpr uint8_t kAllNodes = 0xFF;
+
+constexpr uint8_t kBegin = 0x01;
+constexpr uint8_t kQuery = 0x02;
+constexpr uint8_t kCommit = 0x03;
+constexpr uint8_t kAbort = 0x04;
+
+constexpr uint8_t kIdle = 0;
+constexpr uint8_t kReceiving = 1;
+constexpr uint8_t kDone = 2;
+constexpr uint8_t kError = 3;
+
+constexpr size_t kFrameBytes = 64;
+constexpr size_t kBlockFrames = 256;
+constexpr size_t kStatusBytes = 48;
+
+/**
+ * @brief Parse a node list: "3", "1,2,7" or ranges such as "1-20"
+ */
+bool ParseNodes(const std::string& text, std::vector<uint8_t>& nodes);
+
+} // namespace CanUpdate
+
+struct CanUpdateOptions {
+    std::string port;
+    int baud_rate = 1000000;
+    std::vector<uint8_t> nodes;
+    uint32_t frame_rate = 1000;    // Data frames per second, 0 = as fast as the serial link takes them
+    int retries = 5;               // Unanswered queries, or rounds without progress, before a node is dropped
+    int begin_timeout_ms = 5000;   // BEGIN replies come after the erase
+    int reply_timeout_ms = 100;    // Other replies
+};
+
+struct CanUpdateResult {
+    uint8_t node = 0;
+    bool ok = false;
+    std::string reason;  // Why the node was dropped
+};
+
+/**
+ * @brief Download @p image to every node in @p options at once (lumos can-update)
+ *
+ * Streams the image through a CAN bridge board: each 16 KB block is
+ * broadcast, all nodes are asked for the frames they are missing, and
+ * the union of those is sent again until every node has the block. A
+ * node that stops answering or making progress is dropped; the others
+ * carry on. Ends with COMMIT, which has each node check the image CRC.
+ *
+ * @param results One entry per node
+ * @return false if the port failed or the download was interrupted
+ */
+bool RunCanUpdate(const std::vector<uint8_t>& image, const CanUpdateOptions& options, const volatile bool& running,
+                  std::vector<CanUpdateResult>& results, std::string& error);
+
+} // namespace Lumos
@@ -0,0 +1,254 @@
+#include "capture_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace Lumos {
+
+namespace {
+
+const char kMagic[4] = {'L', 'C', 'A', 'P'};
+const uint16_t kVersion = 1;
+const size_t kRecordHeader = 12;
+const size_t kFlushBytes = 1 << 20;
+const auto kFlushInterval = std::chrono::milliseconds(500);
+
+void Put16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+uint64_t Get(const uint8_t* p, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+// ── CaptureWriter ────────────────────────────────────────────────────────────
+
+CaptureWriter::~CaptureWriter() {
+    Close();
+}
+
+bool CaptureWriter::Open(const std::string& path, const std::vector<std::string>& ports,
+                         std::string& error) {
+    if (ports.size() > 256) {
+        error = "at most 256 ports can be captured";
+        return false;
+    }
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    std::vector<uint8_t> header(kMagic, kMagic + 4);
+    Put16(header, kVersion);
+    Put16(header, static_cast<uint16_t>(ports.size()));
+    for (const auto& port : ports) {
+        Put16(header, static_cast<uint16_t>(port.size()));
+        header.insert(header.end(), port.begin(), port.end());
+    }
+    file_.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    active_.reserve(kFlushBytes + 64 * 1024);
+    stop_ = false;
+    failed_ = !file_;
+    captured_ = 0;
+    writer_ = std::thread(&CaptureWriter::WriterThreadFunc, this);
+    return true;
+}
+
+void CaptureWriter::Append(uint8_t port, uint64_t time_ns, const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (length > 0) {
+        const uint16_t chunk = static_cast<uint16_t>(std::min<size_t>(length, 0xFFFF));
+        uint8_t header[kRecordHeader] = {port, 0, static_cast<uint8_t>(chunk),
+                                         static_cast<uint8_t>(chunk >> 8)};
+        for (int i = 0; i < 8; ++i) {
+            header[4 + i] = static_cast<uint8_t>(time_ns >> (8 * i));
+        }
+        active_.insert(active_.end(), header, header + kRecordHeader);
+        active_.insert(active_.end(), data, data + chunk);
+        captured_ += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    if (active_.size() >= kFlushBytes) {
+        wake_.notify_one();
+    }
+}
+
+void CaptureWriter::WriterThreadFunc() {
+    std::vector<uint8_t> writing;
+    writing.reserve(active_.capacity());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait_for(lock, kFlushInterval, [&] { return stop_ || active_.size() >= kFlushBytes; });
+        const bool stopping = stop_;
+
+        // Swap buffers so Append() keeps going while the disk is busy
+        writing.swap(active_);
+        lock.unlock();
+        if (!writing.empty()) {
+            file_.write(reinterpret_cast<const char*>(writing.data()), writing.size());
+            file_.flush();
+            writing.clear();
+        }
+        lock.lock();
+        if (!file_) {
+            failed_ = true;
+        }
+        if (stopping && active_.empty()) {
+            return;
+        }
+    }
+}
+
+bool CaptureWriter::Close() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+    if (file_.is_open()) {
+        file_.close();
+        failed_ = failed_ || !file_;
+    }
+    return !failed_;
+}
+
+// ── CaptureReader ────────────────────────────────────────────────────────────
+
+bool CaptureReader::Open(const std::string& path, std::string& error) {
+    file_.open(path, std::ios::binary);
+    if (!file_.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    uint8_t header[8];
+    if (!file_.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, kMagic, 4) != 0) {
+        error = path + " is not a lumos capture";
+        return false;
+    }
+    if (Get(header + 4, 2) != kVersion) {
+        error = path + ": unsupported capture version " + std::to_string(Get(header + 4, 2));
+        return false;
+    }
+
+    const size_t count = Get(header + 6, 2);
+    ports_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t length[2];
+        if (!file_.read(reinterpret_cast<char*>(length), 2)) {
+            error = path + ": truncated header";
+            return false;
+        }
+        std::string name(Get(length, 2), '\0');
+        if (!file_.read(&name[0], name.size())) {
+            error = path + ": truncated header";
+            return false;
+        }
+        ports_.push_back(name);
+    }
+    return true;
+}
+
+bool CaptureReader::Next(CaptureRecord& record) {
+    uint8_t header[kRecordHeader];
+    if (!file_.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        return false;
+    }
+    record.port = header[0];
+    record.time_ns = Get(header + 4, 8);
+    record.data.resize(Get(header + 2, 2));
+    return static_cast<bool>(file_.read(reinterpret_cast<char*>(record.data.data()),
+                                        record.data.size()));
+}
+
+// ── Decoder ──────────────────────────────────────────────────────────────────
+
+bool DecodeCapture(const std::string& path, bool hex, std::string& error) {
+    CaptureReader reader;
+    if (!reader.Open(path, error)) {
+        return false;
+    }
+    const auto& ports = reader.GetPorts();
+
+    auto label = [&](uint8_t port) {
+        return port < ports.size() ? ports[port] : "port" + std::to_string(port);
+    };
+    auto stamp = [](uint64_t time_ns) {
+        char text[32];
+        snprintf(text, sizeof(text), "[%11.6f]", time_ns / 1e9);
+        return std::string(text);
+    };
+
+    // Text mode reassembles lines per port; a line is stamped with the
+    // arrival of its first byte, as lumos monitor does live
+    struct Partial {
+        std::string text;
+        uint64_t start = 0;
+    };
+    std::map<uint8_t, Partial> partials;
+    std::map<uint8_t, uint64_t> bytes;
+
+    CaptureRecord record;
+    while (reader.Next(record)) {
+        bytes[record.port] += record.data.size();
+        if (hex) {
+            std::cout << stamp(record.time_ns) << ' ' << label(record.port) << " |";
+            char byte[4];
+            for (uint8_t b : record.data) {
+                snprintf(byte, sizeof(byte), " %02x", b);
+                std::cout << byte;
+            }
+            std::cout << '\n';
+            continue;
+        }
+
+        Partial& partial = partials[record.port];
+        for (uint8_t b : record.data) {
+            if (partial.text.empty()) {
+                partial.start = record.time_ns;
+            }
+            if (b != '\n') {
+                partial.text.push_back(static_cast<char>(b));
+                continue;
+            }
+            while (!partial.text.empty() && partial.text.back() == '\r') {
+                partial.text.pop_back();
+            }
+            std::cout << stamp(partial.start) << ' ' << label(record.port) << " | " << partial.text << '\n';
+            partial.text.clear();
+        }
+    }
+    for (auto& entry : partials) {
+        if (!entry.second.text.empty()) {
+            std::cout << stamp(entry.second.start) << ' ' << label(entry.first) << " | "
+                      << entry.second.text << '\n';
+        }
+    }
+
+    std::cout.flush();
+    std::cerr << std::endl;
+    for (const auto& entry : bytes) {
+        std::cerr << label(entry.first) << ": " << entry.second << " bytes" << std::endl;
+    }
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Raw serial capture file (lumos monitor --capture)
+ *
+ * Layout, all integers little-endian:
+ *
+ *   header:  "LCAP" | version u16 | port count u16 | per port: length u16, name
+ *   records: port u8 | flags u8 | length u16 | time_ns u64 | data[length]
+ *
+ * Each record is one read from a port; time_ns is the steady-clock time
+ * of its arrival relative to the start of the capture. A capture cut
+ * short (power loss, kill -9) loses at most the incomplete last record.
+ */
+struct CaptureRecord {
+    uint8_t port = 0;
+    uint64_t time_ns = 0;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Appends records through large buffered writes on a writer thread
+ *
+ * Append() only copies into memory, so a slow disk never stalls the
+ * serial loop; the writer thread flushes a buffer once it holds 1 MB or
+ * every 500 ms, whichever comes first.
+ */
+class CaptureWriter {
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    bool Open(const std::string& path, const std::vector<std::string>& ports, std::string& error);
+
+    void Append(uint8_t port, uint64_t time_ns, const uint8_t* data, size_t length);
+
+    /**
+     * @brief Flush everything and close the file
+     * @return false if a write failed at any point
+     */
+    bool Close();
+
+    /** Payload bytes captured so far */
+    uint64_t GetBytesCaptured() const { return captured_; }
+
+private:
+    void WriterThreadFunc();
+
+    std::ofstream file_;
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<uint8_t> active_;   // filled by Append, guarded by mutex_
+    bool stop_ = false;
+    bool failed_ = false;
+    uint64_t captured_ = 0;
+};
+
+/**
+ * @brief Reads a capture file record by record
+ */
+class CaptureReader {
+public:
+    bool Open(const std::string& path, std::string& error);
+
+    const std::vector<std::string>& GetPorts() const { return ports_; }
+
+    /**
+     * @brief Read the next record
+     * @return false at the end of the file (or a truncated last record)
+     */
+    bool Next(CaptureRecord& record);
+
+private:
+    std::ifstream file_;
+    std::vector<std::string> ports_;
+};
+
+/**
+ * @brief Print a capture (lumos decode)
+ * @param hex Dump every record in hex instead of reassembling text lines
+ * @return true on success
+ */
+bool DecodeCapture(const std::string& path, bool hex, std::string& error);
+
+} // namespace Lumos
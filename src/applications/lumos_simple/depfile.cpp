@@ -0,0 +1,124 @@
+#include "depfile.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+bool ParseDepFile(const std::string& dep_path, std::vector<std::string>& deps) {
+    std::ifstream file(dep_path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Join the first rule across backslash-newline continuations
+    std::string rule;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line.back() == '\\') {
+            line.pop_back();
+            rule += line + " ";
+            continue;
+        }
+        rule += line;
+        break;
+    }
+
+    // Target ends at the first ':' followed by whitespace or end of line,
+    // which skips drive letters like C:\ on Windows
+    size_t colon = std::string::npos;
+    for (size_t i = 0; i < rule.size(); ++i) {
+        if (rule[i] == ':' && (i + 1 == rule.size() || rule[i + 1] == ' ' || rule[i + 1] == '\t')) {
+            colon = i;
+            break;
+        }
+    }
+    if (colon == std::string::npos) {
+        return false;
+    }
+
+    deps.clear();
+    std::string current;
+    for (size_t i = colon + 1; i < rule.size(); ++i) {
+        char c = rule[i];
+        if (c == '\\' && i + 1 < rule.size() && rule[i + 1] == ' ') {
+            // Escaped space inside a path
+            current += ' ';
+            ++i;
+        } else if (c == ' ' || c == '\t') {
+            if (!current.empty()) {
+                deps.push_back(current);
+                current.clear();
+            }
+        } else if (c == '$' && i + 1 < rule.size() && rule[i + 1] == '$') {
+            current += '$';
+            ++i;
+        } else {
+            current += c;
+        }
+    }
+    if (!current.empty()) {
+        deps.push_back(current);
+    }
+
+    return true;
+}
+
+bool CommandChanged(const std::string& stamp_path, const std::string& command) {
+    std::ifstream file(stamp_path, std::ios::binary);
+    if (!file.is_open()) {
+        return true;
+    }
+
+    std::ostringstream previous;
+    previous << file.rdbuf();
+    return previous.str() != command;
+}
+
+bool WriteCommandStamp(const std::string& stamp_path, const std::string& command) {
+    std::ofstream file(stamp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << command;
+    return file.good();
+}
+
+bool IsObjectUpToDate(const std::string& source_file,
+                      const std::string& object_file,
+                      const std::string& command) {
+    std::error_code ec;
+    auto object_time = fs::last_write_time(object_file, ec);
+    if (ec) {
+        return false;
+    }
+
+    // Any change to flags, defines or include paths forces a rebuild
+    if (CommandChanged(object_file + ".cmd", command)) {
+        return false;
+    }
+
+    std::vector<std::string> deps;
+    std::string dep_path = fs::path(object_file).replace_extension(".d").string();
+    if (!ParseDepFile(dep_path, deps)) {
+        // Plain assembly produces no depfile; fall back to the source alone
+        deps = {source_file};
+    }
+
+    for (const auto& dep : deps) {
+        auto dep_time = fs::last_write_time(dep, ec);
+        if (ec || dep_time > object_time) {
+            // Missing or newer prerequisite
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace Lumos
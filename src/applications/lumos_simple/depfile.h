@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Parse a Makefile-style dependency file produced by -MMD -MP
+ *
+ * Only the first rule (the object file's) is read; the phony header
+ * targets emitted by -MP are ignored.
+ *
+ * @param dep_path Path to the .d file
+ * @param deps Receives the prerequisites (source file first, then headers)
+ * @return true if the file was read and contained a rule
+ */
+bool ParseDepFile(const std::string& dep_path, std::vector<std::string>& deps);
+
+/**
+ * @brief Check whether an object file can be reused
+ *
+ * The object is up to date when it exists, the command line recorded next
+ * to it (<object>.cmd) matches @p command exactly, and neither the source
+ * nor any header listed in its depfile (<object minus .o>.d) is newer than it.
+ *
+ * @param source_file Translation unit
+ * @param object_file Object produced from it
+ * @param command Full compiler command line that would be run
+ * @return true if compilation can be skipped
+ */
+bool IsObjectUpToDate(const std::string& source_file,
+                      const std::string& object_file,
+                      const std::string& command);
+
+/**
+ * @brief Check whether a command differs from the one recorded for an output
+ * @param stamp_path Path of the stamp file holding the previous command
+ * @param command Command that would be run now
+ * @return true if there is no stamp or it differs
+ */
+bool CommandChanged(const std::string& stamp_path, const std::string& command);
+
+/**
+ * @brief Record the command used to produce an output
+ * @param stamp_path Path of the stamp file
+ * @param command Command line to store
+ * @return true on success
+ */
+bool WriteCommandStamp(const std::string& stamp_path, const std::string& command);
+
+} // namespace Lumos
@@ -0,0 +1,221 @@
+#include "elf_file.h"
+#include <fstream>
+#include <iterator>
+
+namespace Lumos {
+
+namespace {
+
+const uint32_t kSectionSymtab = 2;
+const uint32_t kSectionNobits = 8;
+const uint64_t kFlagWrite = 0x1;
+const uint64_t kFlagAlloc = 0x2;
+const uint64_t kFlagExec = 0x4;
+const uint32_t kSegmentLoad = 1;
+const uint8_t kSymbolObject = 1;
+const uint8_t kSymbolFunction = 2;
+const uint16_t kMachineArm = 40;
+
+// Bounds-checked little-endian reads from the file image
+class Reader {
+public:
+    explicit Reader(const std::vector<uint8_t>& data) : data_(data), ok_(true) {}
+
+    uint64_t Read(uint64_t offset, size_t bytes) {
+        if (offset + bytes > data_.size() || offset + bytes < offset) {
+            ok_ = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(data_[offset + i]) << (8 * i);
+        }
+        return value;
+    }
+
+    std::string String(uint64_t offset) {
+        std::string value;
+        while (offset < data_.size() && data_[offset] != 0) {
+            value += static_cast<char>(data_[offset++]);
+        }
+        if (offset >= data_.size()) {
+            ok_ = false;
+        }
+        return value;
+    }
+
+    bool Ok() const { return ok_; }
+
+private:
+    const std::vector<uint8_t>& data_;
+    bool ok_;
+};
+
+} // namespace
+
+bool ElfFile::Load(const std::string& path, std::string& error) {
+    sections_.clear();
+    symbols_.clear();
+    data_.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (data.size() < 16 || data[0] != 0x7f || data[1] != 'E' || data[2] != 'L' || data[3] != 'F') {
+        error = path + " is not an ELF file";
+        return false;
+    }
+    bool is64 = data[4] == 2;
+    if ((data[4] != 1 && data[4] != 2) || data[5] != 1) {
+        error = path + ": only little-endian ELF32/ELF64 is supported";
+        return false;
+    }
+
+    Reader r(data);
+    size_t word = is64 ? 8 : 4;
+    uint64_t phoff = r.Read(is64 ? 0x20 : 0x1C, word);
+    uint64_t shoff = r.Read(is64 ? 0x28 : 0x20, word);
+    size_t phentsize = r.Read(is64 ? 0x36 : 0x2A, 2);
+    size_t phnum = r.Read(is64 ? 0x38 : 0x2C, 2);
+    size_t shentsize = r.Read(is64 ? 0x3A : 0x2E, 2);
+    size_t shnum = r.Read(is64 ? 0x3C : 0x30, 2);
+    size_t shstrndx = r.Read(is64 ? 0x3E : 0x32, 2);
+    bool arm = r.Read(0x12, 2) == kMachineArm;
+
+    // Loadable segments map run-time addresses to load addresses
+    struct Segment {
+        uint64_t vaddr;
+        uint64_t paddr;
+        uint64_t memsz;
+    };
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < phnum; ++i) {
+        uint64_t ph = phoff + i * phentsize;
+        if (r.Read(ph, 4) != kSegmentLoad) {
+            continue;
+        }
+        if (is64) {
+            segments.push_back({r.Read(ph + 0x10, 8), r.Read(ph + 0x18, 8), r.Read(ph + 0x28, 8)});
+        } else {
+            segments.push_back({r.Read(ph + 0x08, 4), r.Read(ph + 0x0C, 4), r.Read(ph + 0x14, 4)});
+        }
+    }
+
+    struct RawSection {
+        uint32_t name;
+        uint32_t type;
+        uint64_t offset;
+        uint32_t link;
+        uint64_t entsize;
+    };
+    std::vector<RawSection> raw;
+    for (size_t i = 0; i < shnum; ++i) {
+        uint64_t sh = shoff + i * shentsize;
+        RawSection rs;
+        ElfSection section;
+        rs.name = static_cast<uint32_t>(r.Read(sh, 4));
+        rs.type = static_cast<uint32_t>(r.Read(sh + 4, 4));
+        uint64_t flags = r.Read(sh + 8, word);
+        section.address = r.Read(sh + (is64 ? 0x10 : 0x0C), word);
+        rs.offset = r.Read(sh + (is64 ? 0x18 : 0x10), word);
+        section.offset = rs.offset;
+        section.size = r.Read(sh + (is64 ? 0x20 : 0x14), word);
+        rs.link = static_cast<uint32_t>(r.Read(sh + (is64 ? 0x28 : 0x18), 4));
+        rs.entsize = r.Read(sh + (is64 ? 0x38 : 0x24), word);
+
+        section.alloc = (flags & kFlagAlloc) != 0;
+        section.write = (flags & kFlagWrite) != 0;
+        section.exec = (flags & kFlagExec) != 0;
+        section.nobits = rs.type == kSectionNobits;
+        section.load_address = section.address;
+        for (const auto& segment : segments) {
+            if (section.alloc && section.address >= segment.vaddr &&
+                section.address < segment.vaddr + segment.memsz) {
+                section.load_address = section.address - segment.vaddr + segment.paddr;
+                break;
+            }
+        }
+
+        raw.push_back(rs);
+        sections_.push_back(section);
+    }
+    if (!r.Ok()) {
+        error = path + ": truncated section headers";
+        return false;
+    }
+
+    if (shstrndx < raw.size()) {
+        uint64_t strtab = raw[shstrndx].offset;
+        for (size_t i = 0; i < sections_.size(); ++i) {
+            sections_[i].name = r.String(strtab + raw[i].name);
+        }
+    }
+
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i].type != kSectionSymtab || raw[i].entsize == 0 || raw[i].link >= raw.size()) {
+            continue;
+        }
+        uint64_t strtab = raw[raw[i].link].offset;
+        uint64_t count = sections_[i].size / raw[i].entsize;
+        for (uint64_t j = 0; j < count; ++j) {
+            uint64_t sym = raw[i].offset + j * raw[i].entsize;
+            ElfSymbol symbol;
+            uint32_t name = static_cast<uint32_t>(r.Read(sym, 4));
+            uint8_t info;
+            size_t shndx;
+            if (is64) {
+                info = static_cast<uint8_t>(r.Read(sym + 4, 1));
+                shndx = r.Read(sym + 6, 2);
+                symbol.address = r.Read(sym + 8, 8);
+                symbol.size = r.Read(sym + 16, 8);
+            } else {
+                symbol.address = r.Read(sym + 4, 4);
+                symbol.size = r.Read(sym + 8, 4);
+                info = static_cast<uint8_t>(r.Read(sym + 12, 1));
+                shndx = r.Read(sym + 14, 2);
+            }
+
+            uint8_t type = info & 0x0f;
+            if (symbol.size == 0 || (type != kSymbolObject && type != kSymbolFunction)) {
+                continue;
+            }
+            symbol.name = r.String(strtab + name);
+            symbol.function = type == kSymbolFunction;
+            symbol.section = shndx < sections_.size() ? static_cast<int>(shndx) : -1;
+            // Thumb function addresses carry the mode in bit 0
+            if (arm && symbol.function) {
+                symbol.address &= ~static_cast<uint64_t>(1);
+            }
+            symbols_.push_back(symbol);
+        }
+    }
+
+    if (!r.Ok()) {
+        error = path + ": truncated symbol table";
+        return false;
+    }
+    data_ = std::move(data);
+    return true;
+}
+
+const ElfSection* ElfFile::FindSection(const std::string& name) const {
+    for (const auto& section : sections_) {
+        if (section.name == name) {
+            return &section;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t> ElfFile::GetContents(const ElfSection& section) const {
+    if (section.nobits || section.offset > data_.size() || section.size > data_.size() - section.offset) {
+        return {};
+    }
+    return std::vector<uint8_t>(data_.begin() + section.offset, data_.begin() + section.offset + section.size);
+}
+
+} // namespace Lumos
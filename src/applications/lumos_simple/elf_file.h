@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Section of an ELF file
+ */
+struct ElfSection {
+    std::string name;
+    uint64_t address = 0;       // run-time address (VMA)
+    uint64_t load_address = 0;  // where the contents are stored (LMA)
+    uint64_t size = 0;
+    uint64_t offset = 0;        // position of the contents in the file
+    bool alloc = false;         // occupies memory on the target
+    bool nobits = false;        // .bss-like, takes no space in the image
+    bool write = false;
+    bool exec = false;
+};
+
+/**
+ * @brief Sized symbol from the ELF symbol table
+ */
+struct ElfSymbol {
+    std::string name;
+    uint64_t address = 0;
+    uint64_t size = 0;
+    bool function = false;
+    int section = -1;           // index into ElfFile::GetSections(), -1 if none
+};
+
+/**
+ * @brief Minimal reader for section headers and symbols of ELF files
+ *
+ * Supports little-endian ELF32 (ARM firmware) and ELF64. Load addresses
+ * are derived from the program headers, so initialized data placed in RAM
+ * is attributed to its flash image as well.
+ */
+class ElfFile {
+public:
+    /**
+     * @brief Read an ELF file
+     * @param path ELF file path
+     * @param error Receives a description if loading fails
+     * @return true on success
+     */
+    bool Load(const std::string& path, std::string& error);
+
+    const std::vector<ElfSection>& GetSections() const { return sections_; }
+    const std::vector<ElfSymbol>& GetSymbols() const { return symbols_; }
+
+    /**
+     * @brief Section by name, nullptr if the file has none
+     */
+    const ElfSection* FindSection(const std::string& name) const;
+
+    /**
+     * @brief Contents of @p section (empty for .bss-like sections)
+     */
+    std::vector<uint8_t> GetContents(const ElfSection& section) const;
+
+private:
+    std::vector<uint8_t> data_;
+    std::vector<ElfSection> sections_;
+    std::vector<ElfSymbol> symbols_;
+};
+
+} // namespace Lumos
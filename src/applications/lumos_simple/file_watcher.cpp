@@ -0,0 +1,151 @@
+#include "file_watcher.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Lumos {
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher() {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "Warning: inotify unavailable, file changes are not watched" << std::endl;
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+size_t FileWatcher::SetDirectories(const std::set<std::string>& directories) {
+    if (fd_ < 0) {
+        return 0;
+    }
+
+    // Drop watches no longer wanted
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (directories.count(it->directory) == 0) {
+            inotify_rm_watch(fd_, it->wd);
+            it = watches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    size_t added = 0;
+    for (const auto& directory : directories) {
+        bool watched = false;
+        for (const auto& watch : watches_) {
+            if (watch.directory == directory) {
+                watched = true;
+                break;
+            }
+        }
+        if (watched) {
+            continue;
+        }
+        int wd = inotify_add_watch(fd_, directory.c_str(), mask);
+        if (wd >= 0) {
+            watches_.push_back({wd, directory});
+            added++;
+        } else if (errno == ENOSPC) {
+            std::cerr << "Warning: Out of inotify watches (fs.inotify.max_user_watches), not watching "
+                      << directory << std::endl;
+        }
+    }
+    return added;
+}
+
+bool FileWatcher::Wait(int timeout_ms) {
+    if (fd_ < 0) {
+        return false;
+    }
+    pollfd fd = {fd_, POLLIN, 0};
+    return poll(&fd, 1, timeout_ms) > 0;
+}
+
+std::vector<FileWatcher::Change> FileWatcher::ReadChanges() {
+    std::vector<Change> changes;
+    if (fd_ < 0) {
+        return changes;
+    }
+
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    while (true) {
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost; report every directory as changed
+                for (const auto& watch : watches_) {
+                    changes.push_back({watch.directory, true});
+                }
+                continue;
+            }
+
+            for (auto it = watches_.begin(); it != watches_.end(); ++it) {
+                if (it->wd != event->wd) {
+                    continue;
+                }
+                bool self = (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0;
+                std::string path = it->directory;
+                if (!self && event->len > 0) {
+                    path += "/";
+                    path += event->name;
+                }
+                bool structural = self ||
+                    (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) != 0;
+                changes.push_back({path, structural});
+                if (event->mask & IN_IGNORED) {
+                    // The directory is gone; SetDirectories() adds it again if it returns
+                    watches_.erase(it);
+                }
+                break;
+            }
+        }
+    }
+    return changes;
+}
+
+#else
+
+bool FileWatcher::Wait(int timeout_ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    return false;
+}
+
+FileWatcher::FileWatcher() {
+}
+
+FileWatcher::~FileWatcher() {
+}
+
+size_t FileWatcher::SetDirectories(const std::set<std::string>&) {
+    return 0;
+}
+
+std::vector<FileWatcher::Change> FileWatcher::ReadChanges() {
+    return {};
+}
+
+#endif
+
+} // namespace Lumos
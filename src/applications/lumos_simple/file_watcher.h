@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Reports changes inside a set of directories
+ *
+ * Each directory is watched on its own (not recursively) for files being
+ * written, created, deleted or renamed in it. Uses inotify on Linux; on
+ * other platforms IsSupported() is false and no changes are ever reported,
+ * so callers must fall back to checking modification times themselves.
+ */
+class FileWatcher {
+public:
+    struct Change {
+        std::string path;
+        bool structural;  // Created, deleted or renamed rather than written
+    };
+
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool IsSupported() const { return fd_ >= 0; }
+
+    /**
+     * @brief Watch exactly these directories
+     *
+     * Directories already watched keep their watch, so no change between
+     * two calls is lost. Missing directories are skipped.
+     * @return Number of directories newly watched; changes made in them
+     *         before this call were not seen
+     */
+    size_t SetDirectories(const std::set<std::string>& directories);
+
+    /** Descriptor that becomes readable when changes are pending; -1 if unsupported */
+    int GetFd() const { return fd_; }
+
+    /** Waits up to @p timeout_ms for changes; true if some are pending */
+    bool Wait(int timeout_ms);
+
+    /** Changes since the last call; never blocks */
+    std::vector<Change> ReadChanges();
+
+private:
+    int fd_ = -1;
+    struct Watch {
+        int wd;
+        std::string directory;
+    };
+    std::vector<Watch> watches_;
+};
+
+} // namespace Lumos
@@ -0,0 +1,128 @@
+#include "firmware_image.h"
+#include "elf_file.h"
+#include "json_util.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Lumos {
+
+namespace {
+
+const char kMagic[4] = {'L', 'S', 'E', 'G'};
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = 12;
+const size_t kEntrySize = 12;
+
+// STM32 main flash is mapped from 0x08000000; sections stored anywhere
+// else (RAM without a load address in flash) cannot be programmed
+const uint64_t kFlashStart = 0x08000000;
+const uint64_t kFlashEnd = 0x20000000;
+
+// Sections closer than this are one segment; alignment padding is a few bytes
+const uint64_t kMergeGap = 256;
+
+void PutU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint32_t GetU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+std::vector<ImageSegment> GetImageSegments(const ElfFile& elf) {
+    std::vector<const ElfSection*> sections;
+    for (const auto& section : elf.GetSections()) {
+        if (section.alloc && !section.nobits && section.size > 0 &&
+            section.load_address >= kFlashStart && section.load_address + section.size <= kFlashEnd) {
+            sections.push_back(&section);
+        }
+    }
+    std::sort(sections.begin(), sections.end(), [](const ElfSection* a, const ElfSection* b) {
+        return a->load_address < b->load_address;
+    });
+
+    std::vector<ImageSegment> segments;
+    for (const ElfSection* section : sections) {
+        std::vector<uint8_t> contents = elf.GetContents(*section);
+        if (contents.empty()) {
+            continue;
+        }
+        uint64_t address = section->load_address;
+        if (!segments.empty()) {
+            ImageSegment& last = segments.back();
+            uint64_t end = last.address + last.data.size();
+            if (address >= end && address - end <= kMergeGap) {
+                last.data.resize(static_cast<size_t>(address - last.address), 0xFF);
+                last.data.insert(last.data.end(), contents.begin(), contents.end());
+                continue;
+            }
+        }
+        ImageSegment segment;
+        segment.address = static_cast<uint32_t>(address);
+        segment.data = std::move(contents);
+        segments.push_back(std::move(segment));
+    }
+    return segments;
+}
+
+bool WriteSegmentFile(const std::string& path, const std::vector<ImageSegment>& segments) {
+    std::string out(kMagic, sizeof(kMagic));
+    PutU32(out, kVersion);
+    PutU32(out, static_cast<uint32_t>(segments.size()));
+
+    size_t offset = kHeaderSize + kEntrySize * segments.size();
+    for (const auto& segment : segments) {
+        PutU32(out, segment.address);
+        PutU32(out, static_cast<uint32_t>(segment.data.size()));
+        PutU32(out, static_cast<uint32_t>(offset));
+        offset += segment.data.size();
+    }
+    for (const auto& segment : segments) {
+        out.append(reinterpret_cast<const char*>(segment.data.data()), segment.data.size());
+    }
+    return WriteFileAtomically(path, out);
+}
+
+bool ReadSegmentFile(const uint8_t* data, size_t size,
+                     std::vector<ImageSegmentView>& segments, std::string& error) {
+    segments.clear();
+    if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a sparse image";
+        return false;
+    }
+    if (GetU32(data + 4) != kVersion) {
+        error = "unsupported sparse image version";
+        return false;
+    }
+    uint32_t count = GetU32(data + 8);
+    if (count == 0 || (size - kHeaderSize) / kEntrySize < count) {
+        error = "sparse image has no valid segment table";
+        return false;
+    }
+
+    uint64_t previous_end = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* entry = data + kHeaderSize + kEntrySize * i;
+        ImageSegmentView segment;
+        segment.address = GetU32(entry);
+        segment.size = GetU32(entry + 4);
+        uint32_t offset = GetU32(entry + 8);
+        if (segment.size == 0 || offset > size || segment.size > size - offset ||
+            segment.address < previous_end) {
+            error = "sparse image segment " + std::to_string(i) + " is damaged";
+            segments.clear();
+            return false;
+        }
+        segment.data = data + offset;
+        previous_end = static_cast<uint64_t>(segment.address) + segment.size;
+        segments.push_back(segment);
+    }
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+class ElfFile;
+
+/**
+ * @brief Populated flash range of a firmware image
+ */
+struct ImageSegment {
+    uint32_t address = 0;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Segment of a sparse image, pointing into the file's contents
+ */
+struct ImageSegmentView {
+    uint32_t address = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief Flash ranges of @p elf, by load address
+ *
+ * Every allocated section with contents that is stored in flash counts;
+ * sections a few bytes apart (alignment) are merged, with the gap filled
+ * as erased flash (0xFF). Unlike objcopy -O binary, ranges far apart stay
+ * separate instead of being joined by filler.
+ */
+std::vector<ImageSegment> GetImageSegments(const ElfFile& elf);
+
+/**
+ * @brief Write @p segments to a sparse image (build/firmware.segments)
+ *
+ * Little-endian: "LSEG", version and segment count, then per segment its
+ * address, size and file offset, followed by the segment data. Written
+ * atomically, so a flasher never sees half a file.
+ */
+bool WriteSegmentFile(const std::string& path, const std::vector<ImageSegment>& segments);
+
+/**
+ * @brief Parse a sparse image, e.g. mapped with SimpleSerial::MappedFile
+ * @param data File contents; the views point into it
+ * @param size File size
+ * @param segments Receives the segments in address order
+ * @param error Receives a description if the file is damaged
+ * @return false if it is no sparse image, damaged or empty
+ */
+bool ReadSegmentFile(const uint8_t* data, size_t size,
+                     std::vector<ImageSegmentView>& segments, std::string& error);
+
+} // namespace Lumos
@@ -0,0 +1,276 @@
+#include "gc_report.h"
+#include "elf_file.h"
+#include "map_file.h"
+#include "project_config.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+// Modules in report order
+const char* const kModules[] = {"user", "board", "wrapper", "framework", "middleware", "HAL", "toolchain", "other"};
+
+// "build/debug/main.o" -> "main.o", "/x/libhal.a(gpio.o)" -> "libhal.a(gpio.o)"
+std::string ShortObjectName(const std::string& object) {
+    size_t paren = object.find('(');
+    std::string path = paren == std::string::npos ? object : object.substr(0, paren);
+    std::string member = paren == std::string::npos ? "" : object.substr(paren);
+    return fs::path(path).filename().string() + member;
+}
+
+std::string ModuleForJob(const CompileJob& job) {
+    if (job.user) {
+        return "user";
+    }
+    if (job.hal) {
+        return "HAL";
+    }
+    std::string source = fs::path(job.source).generic_string();
+    std::string dir = fs::path(job.source).parent_path().filename().string();
+    if (dir == "wrapper") {
+        return "wrapper";
+    }
+    if (dir == "framework") {
+        return "framework";
+    }
+    if (source.find("/Middlewares/") != std::string::npos) {
+        return "middleware";
+    }
+    if (fs::path(job.source).parent_path().parent_path().filename() == "boards") {
+        return "board";
+    }
+    return "other";
+}
+
+// Readable C++ names; C symbols are returned as they are
+std::string Demangle(const std::string& name) {
+#if defined(__GNUC__)
+    int status = 0;
+    char* readable = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (readable != nullptr) {
+        std::string result = status == 0 ? readable : name;
+        std::free(readable);
+        return result;
+    }
+#endif
+    return name;
+}
+
+// ".text.HAL_Init" -> "HAL_Init"; empty for data and unnamed sections
+std::string FunctionName(const std::string& section) {
+    const std::string prefix = ".text.";
+    if (section.compare(0, prefix.size(), prefix) != 0 || section.size() == prefix.size()) {
+        return "";
+    }
+    return section.substr(prefix.size());
+}
+
+// Kept because the vector table or the startup code refers to it, not
+// because anything called it
+bool IsEntryPoint(const std::string& section) {
+    std::string function = FunctionName(section);
+    if (section == ".text.startup" || section.compare(0, 11, ".init_array") == 0 ||
+        section.compare(0, 14, ".preinit_array") == 0) {
+        return true;
+    }
+    if (function.compare(0, 15, "_GLOBAL__sub_I_") == 0) {
+        return true;
+    }
+    return function.size() > 7 && function.compare(function.size() - 7, 7, "Handler") == 0;
+}
+
+} // namespace
+
+bool GcReport::Load(const std::string& elf_file, const std::string& map_file,
+                    const std::vector<CompileJob>& jobs, std::string& error) {
+    objects_.clear();
+
+    ElfFile elf;
+    if (!elf.Load(elf_file, error)) {
+        return false;
+    }
+    MapFile map;
+    if (!map.Load(map_file)) {
+        error = "cannot read " + map_file;
+        return false;
+    }
+
+    std::map<std::string, const CompileJob*> by_object;
+    for (const auto& job : jobs) {
+        by_object[job.object] = &job;
+    }
+    auto object_for = [this, &by_object](const std::string& path) -> Object& {
+        auto existing = objects_.find(path);
+        if (existing != objects_.end()) {
+            return existing->second;
+        }
+        Object& object = objects_[path];
+        auto job = by_object.find(path);
+        if (job != by_object.end()) {
+            object.module = ModuleForJob(*job->second);
+            object.source = job->second->source;
+        } else if (ShortObjectName(path).compare(0, 7, "libhal_") == 0) {
+            object.module = "HAL";
+        } else {
+            object.module = "toolchain";
+        }
+        return object;
+    };
+
+    std::map<std::string, bool> alloc;
+    for (const auto& section : elf.GetSections()) {
+        alloc[section.name] = section.alloc;
+    }
+    for (const auto& contribution : map.GetContributions()) {
+        auto it = alloc.find(contribution.output_section);
+        if (it == alloc.end() || !it->second) {
+            continue;  // Debug info and sections not loaded
+        }
+        object_for(contribution.object).kept.push_back({contribution.input_section, contribution.size});
+    }
+    for (const auto& contribution : map.GetDiscarded()) {
+        const std::string& name = contribution.input_section;
+        if (name.compare(0, 6, ".debug") == 0 || name == ".comment" || name.compare(0, 4, ".ARM") == 0) {
+            continue;  // Dropped with their code, not flash
+        }
+        object_for(contribution.object).discarded.push_back({name, contribution.size});
+    }
+    return true;
+}
+
+void GcReport::PrintModules() const {
+    struct Totals {
+        uint64_t kept = 0;
+        uint64_t discarded = 0;
+        size_t objects = 0;
+        size_t unused = 0;
+    };
+    std::map<std::string, Totals> totals;
+    for (const auto& item : objects_) {
+        Totals& t = totals[item.second.module];
+        uint64_t kept = 0;
+        for (const auto& section : item.second.kept) {
+            kept += section.size;
+        }
+        for (const auto& section : item.second.discarded) {
+            t.discarded += section.size;
+        }
+        t.kept += kept;
+        t.objects++;
+        if (kept == 0) {
+            t.unused++;
+        }
+    }
+
+    std::cout << "  " << std::left << std::setw(12) << "Module" << std::right << std::setw(10) << "Kept"
+              << std::setw(12) << "Discarded" << std::setw(10) << "Objects" << std::setw(10) << "Unused"
+              << std::endl;
+    for (const char* module : kModules) {
+        auto it = totals.find(module);
+        if (it == totals.end()) {
+            continue;
+        }
+        const Totals& t = it->second;
+        std::cout << "  " << std::left << std::setw(12) << module << std::right << std::setw(10) << t.kept
+                  << std::setw(12) << t.discarded << std::setw(10) << t.objects << std::setw(10) << t.unused
+                  << std::endl;
+    }
+}
+
+void GcReport::PrintFunctions(size_t top) const {
+    struct Row {
+        uint64_t size;
+        std::string name;
+        std::string object;
+    };
+    std::map<std::string, std::vector<Row>> by_module;
+    for (const auto& item : objects_) {
+        for (const auto& section : item.second.kept) {
+            std::string function = FunctionName(section.name);
+            if (!function.empty()) {
+                by_module[item.second.module].push_back({section.size, Demangle(function),
+                                                         ShortObjectName(item.first)});
+            }
+        }
+    }
+
+    for (const char* module : kModules) {
+        auto it = by_module.find(module);
+        if (it == by_module.end()) {
+            continue;
+        }
+        std::vector<Row>& rows = it->second;
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+            return a.size != b.size ? a.size > b.size : a.name < b.name;
+        });
+        std::cout << "  " << module << ":" << std::endl;
+        for (size_t i = 0; i < rows.size() && i < top; ++i) {
+            std::cout << "  " << std::setw(10) << rows[i].size << "  " << rows[i].name
+                      << " (" << rows[i].object << ")" << std::endl;
+        }
+    }
+}
+
+void GcReport::PrintWrappers(const std::vector<std::string>& hal_modules) const {
+    bool any = false;
+    for (const auto& item : objects_) {
+        const Object& object = item.second;
+        if (object.module != "wrapper") {
+            continue;
+        }
+        if (!any) {
+            std::cout << "  " << std::setw(10) << "Kept" << std::setw(12) << "Discarded" << "  Object" << std::endl;
+            any = true;
+        }
+
+        uint64_t kept = 0;
+        uint64_t entry_points = 0;
+        for (const auto& section : object.kept) {
+            kept += section.size;
+            if (IsEntryPoint(section.name)) {
+                entry_points += section.size;
+            }
+        }
+        uint64_t discarded = 0;
+        for (const auto& section : object.discarded) {
+            discarded += section.size;
+        }
+
+        std::vector<std::string> notes;
+        if (kept == 0) {
+            notes.push_back("nothing kept");
+        } else if (entry_points == kept) {
+            notes.push_back("kept only by interrupt vectors or static constructors");
+        }
+        std::vector<std::string> modules = ProjectConfig::GetWrapperModules(fs::path(object.source).stem().string());
+        bool needed = modules.empty();
+        for (const auto& module : modules) {
+            needed = needed || std::find(hal_modules.begin(), hal_modules.end(), module) != hal_modules.end();
+        }
+        if (!needed) {
+            notes.push_back("HAL module not in the build; 'wrappers: auto' drops it");
+        }
+
+        std::cout << "  " << std::setw(10) << kept << std::setw(12) << discarded << "  "
+                  << ShortObjectName(item.first);
+        for (size_t i = 0; i < notes.size(); ++i) {
+            std::cout << (i == 0 ? "  <- " : ", ") << notes[i];
+        }
+        std::cout << std::endl;
+    }
+    if (!any) {
+        std::cout << "  No wrapper objects in this build" << std::endl;
+    }
+}
+
+} // namespace Lumos
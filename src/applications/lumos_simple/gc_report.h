@@ -0,0 +1,68 @@
+#pragma once
+
+#include "build_plan.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief What --gc-sections kept and removed, per module (lumos size --gc)
+ *
+ * The map file lists every input section that was placed and, under
+ * "Discarded input sections", every one --gc-sections dropped. Objects are
+ * assigned to a module (user, board, wrapper, framework, HAL, ...) by the
+ * source they were compiled from, as recorded in the build plan; anything
+ * else, such as the C library, counts as toolchain.
+ */
+class GcReport {
+public:
+    /**
+     * @brief Analyze a linked firmware
+     * @param elf_file Path to firmware.elf
+     * @param map_file Path to firmware.map
+     * @param jobs Compile jobs of the build that produced it
+     * @param error Receives a description if analysis fails
+     * @return true on success
+     */
+    bool Load(const std::string& elf_file, const std::string& map_file,
+              const std::vector<CompileJob>& jobs, std::string& error);
+
+    /**
+     * @brief Print kept and discarded bytes per module
+     */
+    void PrintModules() const;
+
+    /**
+     * @brief Print the largest functions kept, per module
+     */
+    void PrintFunctions(size_t top) const;
+
+    /**
+     * @brief Print what each src/wrapper object contributes
+     *
+     * Flags wrappers of which nothing was kept, whose code is only kept by
+     * the interrupt vector table or static constructors, and those whose
+     * HAL module the build doesn't use (see ProjectConfig::GetWrapperModules).
+     */
+    void PrintWrappers(const std::vector<std::string>& hal_modules) const;
+
+private:
+    struct Section {
+        std::string name;  // input section, e.g. .text.HAL_Init
+        uint64_t size;
+    };
+
+    struct Object {
+        std::string module;
+        std::string source;
+        std::vector<Section> kept;
+        std::vector<Section> discarded;
+    };
+
+    std::map<std::string, Object> objects_;  // short object name -> sections
+};
+
+} // namespace Lumos
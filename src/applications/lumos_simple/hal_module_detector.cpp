@@ -1,5 +1,5 @@
 #include "hal_module_detector.h"
-#include <fstream>
+#include "include_scanner.h"
 #include <filesystem>
 #include <regex>
 #include <algorithm>
@@ -30,6 +30,7 @@ const std::vector<HeaderToModuleMapping> HALModuleDetector::special_mappings_ =
     // === Filesystem ===
     {"ff.h", {"sdmmc"}, "FatFs Filesystem", true},
     {"diskio.h", {"sdmmc"}, "FatFs Disk I/O", true},
+    {"filesystem.h", {"sd", "sdmmc"}, "Lumos FAT Filesystem", true},
 
     // === Graphics (might need both LTDC and DMA2D) ===
     {"ltdc", {"ltdc", "dma2d"}, "LCD-TFT Display Controller", false},
@@ -37,6 +38,26 @@ const std::vector<HeaderToModuleMapping> HALModuleDetector::special_mappings_ =
     // === FreeRTOS (often uses TIM for timebase) ===
     {"FreeRTOS.h", {"tim"}, "FreeRTOS RTOS", true},
     {"cmsis_os", {"tim"}, "CMSIS-RTOS", false},
+
+    // === Lumos wrappers (src/wrapper); the modules select their sources,
+    // see ProjectConfig::GetWrapperModules ===
+    {"uart.h", {"uart"}, "Lumos UART", true},
+    {"spi.h", {"spi"}, "Lumos SPI", true},
+    {"i2c.h", {"i2c"}, "Lumos I2C", true},
+    {"bus_device.h", {"spi", "i2c"}, "Lumos bus devices", true},
+    {"can.h", {"fdcan"}, "Lumos CAN", true},
+    {"can_bridge.h", {"fdcan"}, "Lumos CAN bridge", true},
+    {"can_update.h", {"fdcan"}, "Lumos CAN firmware update", true},
+    {"can_isotp.h", {"fdcan"}, "Lumos CAN ISO-TP transport", true},
+    {"adc.h", {"adc", "tim"}, "Lumos ADC (timer triggered)", true},
+    {"timer.h", {"tim"}, "Lumos Timer", true},
+    {"soft_timer.h", {"tim"}, "Lumos software timers", true},
+    {"flash.h", {"flash"}, "Lumos internal flash", true},
+    {"settings_store.h", {"flash"}, "Lumos settings store", true},
+    {"sd.h", {"sd"}, "Lumos SD card", true},
+    {"usb.h", {"pcd"}, "Lumos USB CDC", true},
+    {"usb_msc.h", {"pcd", "sd"}, "Lumos USB mass storage", true},
+    {"shield_sampler.h", {"i2c", "spi", "adc", "tim"}, "Lumos shield sensor sampler", true},
 };
 
 HALModuleDetector::HALModuleDetector() {
@@ -44,19 +65,19 @@ HALModuleDetector::HALModuleDetector() {
 
 std::vector<std::string> HALModuleDetector::DetectModules(
     const std::vector<std::string>& source_files,
-    const std::string& project_dir) const
+    const std::string& project_dir,
+    const std::string& cache_file,
+    std::vector<std::string>* scanned_files) const
 {
     std::set<std::string> detected_modules;
-    std::vector<std::string> all_includes;
+    std::vector<std::string> files;
 
-    // Step 1: Parse includes from all source files
+    // Step 1: Start from all source files
     for (const auto& source : source_files) {
-        std::string full_path = project_dir + "/" + source;
-        auto includes = ParseIncludesFromFile(full_path);
-        all_includes.insert(all_includes.end(), includes.begin(), includes.end());
+        files.push_back(project_dir + "/" + source);
     }
 
-    // Step 2: Also parse includes from headers in include/ directory
+    // Step 2: Also parse headers in include/ directory, even if no source includes them
     std::string include_dir = project_dir + "/include";
     std::error_code ec;
     if (std::filesystem::exists(include_dir, ec) && std::filesystem::is_directory(include_dir, ec)) {
@@ -67,52 +88,38 @@ std::vector<std::string> HALModuleDetector::DetectModules(
                 if (filename.size() >= 2 &&
                     (filename.substr(filename.size() - 2) == ".h" ||
                      (filename.size() >= 4 && filename.substr(filename.size() - 4) == ".hpp"))) {
-                    auto includes = ParseIncludesFromFile(entry.path().string());
-                    all_includes.insert(all_includes.end(), includes.begin(), includes.end());
+                    files.push_back(entry.path().string());
                 }
             }
         }
     }
 
-    // Step 3: Detect from standard HAL headers (pattern-based)
+    // Step 3: Collect includes, following project headers transitively
+    IncludeScanner scanner(cache_file);
+    scanner.AddSearchPath(include_dir);
+    scanner.AddSearchPath(project_dir);
+    std::vector<std::string> visited;
+    std::vector<std::string> all_includes = scanner.ScanTransitive(files, visited);
+    scanner.Save();
+    if (scanned_files != nullptr) {
+        *scanned_files = visited;
+    }
+
+    // Step 4: Detect from standard HAL headers (pattern-based)
     auto standard_modules = DetectFromStandardHALHeaders(all_includes);
     detected_modules.insert(standard_modules.begin(), standard_modules.end());
 
-    // Step 4: Detect from special case mappings
+    // Step 5: Detect from special case mappings
     auto special_modules = DetectFromSpecialHeaders(all_includes);
     detected_modules.insert(special_modules.begin(), special_modules.end());
 
-    // Step 5: Return sorted unique list
+    // Step 6: Return sorted unique list
     std::vector<std::string> result(detected_modules.begin(), detected_modules.end());
     std::sort(result.begin(), result.end());
 
     return result;
 }
 
-std::vector<std::string> HALModuleDetector::ParseIncludesFromFile(const std::string& file_path) const {
-    std::vector<std::string> includes;
-    std::ifstream file(file_path);
-
-    if (!file.is_open()) {
-        return includes;
-    }
-
-    std::string line;
-    // Regex to match #include directives: #include "header.h" or #include <header.h>
-    std::regex include_pattern(R"(^\s*#\s*include\s+[<"]([^>"]+)[>"])");
-
-    while (std::getline(file, line)) {
-        std::smatch match;
-        if (std::regex_search(line, match, include_pattern)) {
-            if (match.size() > 1) {
-                includes.push_back(match[1].str());
-            }
-        }
-    }
-
-    return includes;
-}
-
 std::set<std::string> HALModuleDetector::DetectFromStandardHALHeaders(
     const std::vector<std::string>& includes) const
 {
@@ -120,7 +127,7 @@ std::set<std::string> HALModuleDetector::DetectFromStandardHALHeaders(
 
     // Pattern: stm32{platform}_hal_{module}.h
     // Example: stm32h7xx_hal_uart.h → uart
-    std::regex hal_pattern(R"(stm32[a-z0-9]+_hal_([a-z0-9_]+)\.h)");
+    static const std::regex hal_pattern(R"(stm32[a-z0-9]+_hal_([a-z0-9_]+)\.h)");
 
     for (const auto& include : includes) {
         std::smatch match;
@@ -23,11 +23,14 @@ struct HeaderToModuleMapping {
  * @brief HAL Module Detector
  *
  * Automatically detects which HAL modules are needed by analyzing
- * #include directives in user source files.
+ * #include directives in user source files and the project headers they
+ * include, transitively.
  *
  * Detection works in two phases:
  * 1. Pattern-based: Standard HAL headers (stm32xxx_hal_<module>.h)
- * 2. Table-based: Special cases (USB, networking, filesystem, etc.)
+ * 2. Table-based: Special cases (USB, networking, filesystem, etc.) and
+ *    the Lumos wrapper headers (uart.h, can.h, ...), whose modules in turn
+ *    decide which src/wrapper sources are compiled
  */
 class HALModuleDetector {
 public:
@@ -37,23 +40,20 @@ public:
      * @brief Detect required HAL modules from source files
      * @param source_files List of source file paths (relative to project)
      * @param project_dir Absolute path to project directory
+     * @param cache_file Include scanner cache (empty = scan every file)
+     * @param scanned_files If set, receives every file that was scanned
      * @return Vector of detected HAL module names
      */
     std::vector<std::string> DetectModules(
         const std::vector<std::string>& source_files,
-        const std::string& project_dir) const;
+        const std::string& project_dir,
+        const std::string& cache_file = "",
+        std::vector<std::string>* scanned_files = nullptr) const;
 
 private:
     // Static mapping table for special cases
     static const std::vector<HeaderToModuleMapping> special_mappings_;
 
-    /**
-     * @brief Parse #include directives from a source file
-     * @param file_path Path to source file
-     * @return Vector of included header names
-     */
-    std::vector<std::string> ParseIncludesFromFile(const std::string& file_path) const;
-
     /**
      * @brief Detect modules from standard HAL headers using pattern matching
      * @param includes List of included headers
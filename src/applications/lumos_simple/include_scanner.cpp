@@ -0,0 +1,369 @@
+#include "include_scanner.h"
+#include "job_pool.h"
+#include "mapped_file.h"
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const char* kCacheHeader = "lumos-include-cache 1";
+
+// Files in one breadth-first level before they are scanned on the pool
+const size_t kParallelFiles = 16;
+
+// Files at least this large are memory mapped instead of read
+const uintmax_t kMapBytes = 64 * 1024;
+
+bool IsHorizontalSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r';
+}
+
+} // namespace
+
+IncludeScanner::IncludeScanner(const std::string& cache_file)
+    : cache_file_(cache_file)
+    , dirty_(false)
+{
+    if (!cache_file_.empty()) {
+        LoadCache();
+    }
+}
+
+void IncludeScanner::AddSearchPath(const std::string& dir) {
+    std::error_code ec;
+    if (fs::is_directory(dir, ec)) {
+        search_paths_.push_back(dir);
+    }
+}
+
+void IncludeScanner::LoadCache() {
+    std::ifstream file(cache_file_);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) {
+        // Unknown format, rebuild from scratch
+        dirty_ = true;
+        return;
+    }
+
+    // "<mtime> <size> <count>\t<path>" followed by <count> lines of "q|a\t<name>"
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        Entry entry{0, 0, {}, false};
+        size_t count = 0;
+        std::string path;
+        if (!(fields >> entry.mtime >> entry.size >> count) || fields.get() != '\t' ||
+            !std::getline(fields, path)) {
+            dirty_ = true;
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!std::getline(file, line) || line.size() < 2 || line[1] != '\t') {
+                dirty_ = true;
+                return;
+            }
+            entry.includes.push_back({line.substr(2), line[0] == 'q'});
+        }
+        entries_[path] = entry;
+    }
+}
+
+bool IncludeScanner::Save() const {
+    bool unused = false;
+    for (const auto& item : entries_) {
+        unused = unused || !item.second.used;
+    }
+    if (cache_file_.empty() || (!dirty_ && !unused)) {
+        return true;
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(cache_file_).parent_path(), ec);
+
+    std::string tmp = cache_file_ + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << kCacheHeader << "\n";
+        // Drop files that are no longer part of the project
+        for (const auto& item : entries_) {
+            const Entry& entry = item.second;
+            if (!entry.used) {
+                continue;
+            }
+            file << entry.mtime << " " << entry.size << " " << entry.includes.size() << "\t" << item.first << "\n";
+            for (const auto& include : entry.includes) {
+                file << (include.quoted ? 'q' : 'a') << "\t" << include.name << "\n";
+            }
+        }
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    fs::rename(tmp, cache_file_, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool IncludeScanner::Lookup(const std::string& file, Entry& entry) const {
+    std::error_code ec;
+    long long mtime = static_cast<long long>(fs::last_write_time(file, ec).time_since_epoch().count());
+    uintmax_t size = ec ? 0 : fs::file_size(file, ec);
+    if (ec) {
+        mtime = -1;
+        size = 0;
+    }
+
+    auto it = entries_.find(file);
+    if (it != entries_.end() && it->second.mtime == mtime && it->second.size == size) {
+        return true;
+    }
+
+    // Large files (vendor SDK headers run to megabytes) are parsed in
+    // place from a mapping; for small ones mapping costs more than a read
+    entry = Entry{mtime, size, {}, true};
+    SimpleSerial::MappedFile mapped;
+    if (size >= kMapBytes && mapped.Open(file)) {
+        entry.includes = ParseIncludes(std::string_view(reinterpret_cast<const char*>(mapped.Data()), mapped.Size()));
+        return false;
+    }
+    std::ifstream stream(file, std::ios::binary);
+    if (stream.is_open()) {
+        std::ostringstream content;
+        content << stream.rdbuf();
+        entry.includes = ParseIncludes(content.str());
+    }
+    return false;
+}
+
+const std::vector<IncludeDirective>& IncludeScanner::GetIncludes(const std::string& file) {
+    Entry entry;
+    if (Lookup(file, entry)) {
+        Entry& cached = entries_[file];
+        cached.used = true;
+        return cached.includes;
+    }
+
+    dirty_ = true;
+    Entry& stored = entries_[file];
+    stored = entry;
+    return stored.includes;
+}
+
+std::string IncludeScanner::Resolve(const IncludeDirective& include, const std::string& from) const {
+    std::error_code ec;
+    if (include.quoted) {
+        fs::path candidate = fs::path(from).parent_path() / include.name;
+        if (fs::is_regular_file(candidate, ec)) {
+            return candidate.lexically_normal().string();
+        }
+    }
+    for (const auto& dir : search_paths_) {
+        fs::path candidate = fs::path(dir) / include.name;
+        if (fs::is_regular_file(candidate, ec)) {
+            return candidate.lexically_normal().string();
+        }
+    }
+    return "";
+}
+
+std::vector<std::string> IncludeScanner::ScanTransitive(const std::vector<std::string>& files,
+                                                        std::vector<std::string>& visited) {
+    std::vector<std::string> names;
+    std::set<std::string> seen;
+    std::vector<std::string> pending;
+
+    visited.clear();
+    for (const auto& file : files) {
+        std::string path = fs::path(file).lexically_normal().string();
+        if (seen.insert(path).second) {
+            pending.push_back(path);
+        }
+    }
+
+    // Breadth-first so starting files keep their order in visited. The
+    // files of one level are checked, parsed and their includes resolved
+    // in parallel, each worker into its own slot; the slots are merged in
+    // order once the level is done.
+    for (size_t level = 0; level < pending.size();) {
+        const size_t end = pending.size();
+        std::vector<Entry> fresh(end - level);
+        std::vector<char> cached(end - level, 0);
+        std::vector<std::vector<std::string>> resolved(end - level);
+        auto scan = [this, &pending, &fresh, &cached, &resolved, level](size_t i) {
+            const size_t slot = i - level;
+            cached[slot] = Lookup(pending[i], fresh[slot]) ? 1 : 0;
+            const Entry& entry = cached[slot] ? entries_.find(pending[i])->second : fresh[slot];
+            for (const auto& include : entry.includes) {
+                resolved[slot].push_back(Resolve(include, pending[i]));
+            }
+        };
+        // Threads only pay off once a level has more than a few files
+        JobPool pool;
+        if (end - level >= kParallelFiles && pool.GetJobCount() > 1) {
+            std::vector<JobPool::Job> jobs;
+            jobs.reserve(end - level);
+            for (size_t i = level; i < end; ++i) {
+                jobs.push_back([&scan, i](std::string&) {
+                    scan(i);
+                    return true;
+                });
+            }
+            pool.Run(jobs);
+        } else {
+            for (size_t i = level; i < end; ++i) {
+                scan(i);
+            }
+        }
+
+        for (size_t i = level; i < end; ++i) {
+            const std::string file = pending[i];
+            Entry& entry = entries_[file];
+            if (cached[i - level]) {
+                entry.used = true;
+            } else {
+                entry = std::move(fresh[i - level]);
+                dirty_ = true;
+            }
+
+            visited.push_back(file);
+            for (size_t k = 0; k < entry.includes.size(); ++k) {
+                names.push_back(entry.includes[k].name);
+                const std::string& path = resolved[i - level][k];
+                if (!path.empty() && seen.insert(path).second) {
+                    pending.push_back(path);
+                }
+            }
+        }
+        level = end;
+    }
+
+    return names;
+}
+
+std::vector<IncludeDirective> IncludeScanner::ParseIncludes(std::string_view content) {
+    std::vector<IncludeDirective> includes;
+    const size_t n = content.size();
+    size_t i = 0;
+    bool line_start = true;
+
+    // Skip a backslash-newline continuation at position i
+    auto skip_continuation = [&]() {
+        while (i < n && content[i] == '\\') {
+            size_t j = i + 1;
+            if (j < n && content[j] == '\r') ++j;
+            if (j < n && content[j] == '\n') {
+                i = j + 1;
+            } else {
+                break;
+            }
+        }
+    };
+
+    // Skip whitespace and comments within the current line
+    auto skip_space = [&]() {
+        for (;;) {
+            skip_continuation();
+            if (i < n && IsHorizontalSpace(content[i])) {
+                ++i;
+            } else if (i + 1 < n && content[i] == '/' && content[i + 1] == '*') {
+                size_t end = content.find("*/", i + 2);
+                i = (end == std::string::npos) ? n : end + 2;
+            } else {
+                break;
+            }
+        }
+    };
+
+    while (i < n) {
+        skip_continuation();
+        if (i >= n) {
+            break;
+        }
+        char c = content[i];
+
+        if (c == '\n') {
+            line_start = true;
+            ++i;
+        } else if (IsHorizontalSpace(c)) {
+            ++i;
+        } else if (c == '/' && i + 1 < n && content[i + 1] == '/') {
+            // Line comment, may be continued with a trailing backslash
+            while (i < n && content[i] != '\n') {
+                if (content[i] == '\\') {
+                    size_t before = i;
+                    skip_continuation();
+                    if (i != before) continue;
+                }
+                ++i;
+            }
+        } else if (c == '/' && i + 1 < n && content[i + 1] == '*') {
+            // Block comments count as whitespace, even before a directive
+            size_t end = content.find("*/", i + 2);
+            for (size_t k = i; k < (end == std::string::npos ? n : end); ++k) {
+                if (content[k] == '\n') line_start = true;
+            }
+            i = (end == std::string::npos) ? n : end + 2;
+        } else if (c == '"' || c == '\'') {
+            // String or character literal
+            ++i;
+            while (i < n && content[i] != c && content[i] != '\n') {
+                if (content[i] == '\\') ++i;
+                ++i;
+            }
+            ++i;
+            line_start = false;
+        } else if (c == '#' && line_start) {
+            ++i;
+            skip_space();
+            size_t start = i;
+            while (i < n && (std::isalnum(static_cast<unsigned char>(content[i])) || content[i] == '_')) {
+                ++i;
+            }
+            std::string_view directive = content.substr(start, i - start);
+            if (directive == "include" || directive == "include_next" || directive == "import") {
+                skip_space();
+                if (i < n && (content[i] == '"' || content[i] == '<')) {
+                    char close = content[i] == '"' ? '"' : '>';
+                    size_t name_start = ++i;
+                    while (i < n && content[i] != close && content[i] != '\n') {
+                        ++i;
+                    }
+                    if (i < n && content[i] == close && i > name_start) {
+                        includes.push_back({std::string(content.substr(name_start, i - name_start)), close == '"'});
+                    }
+                }
+            }
+            // Ignore the rest of the directive line
+            while (i < n && content[i] != '\n') {
+                size_t before = i;
+                skip_continuation();
+                if (i == before) ++i;
+            }
+            line_start = false;
+        } else {
+            line_start = false;
+            ++i;
+        }
+    }
+
+    return includes;
+}
+
+} // namespace Lumos
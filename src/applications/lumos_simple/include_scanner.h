@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One #include directive found in a source file
+ */
+struct IncludeDirective {
+    std::string name;  // header as written, e.g. "stm32h7xx_hal_uart.h"
+    bool quoted;       // "..." (true) or <...> (false)
+};
+
+/**
+ * @brief Lightweight #include scanner with a persistent per-file cache
+ *
+ * Files are tokenized just enough to find preprocessor include directives:
+ * comments, string literals and line continuations are skipped, but no
+ * macros or conditionals are evaluated, so every include in the file is
+ * reported. Quoted includes are resolved relative to the including file,
+ * then against the search paths; only headers found there are followed,
+ * which keeps the scan inside the project.
+ *
+ * Results are cached by file modification time and size, so unchanged
+ * files are not read again by later builds. Changed files are memory
+ * mapped and, in large trees, parsed on a JobPool.
+ */
+class IncludeScanner {
+public:
+    /**
+     * @brief Construct a scanner
+     * @param cache_file File the per-file results are loaded from and saved
+     *        to (empty = no persistent cache)
+     */
+    explicit IncludeScanner(const std::string& cache_file = "");
+
+    /**
+     * @brief Add a directory in which includes are resolved and followed
+     */
+    void AddSearchPath(const std::string& dir);
+
+    /**
+     * @brief Includes of a single file, from the cache when unchanged
+     */
+    const std::vector<IncludeDirective>& GetIncludes(const std::string& file);
+
+    /**
+     * @brief Scan files and every local header they include, transitively
+     * @param files Starting files
+     * @param visited Receives every file that was scanned, starting files first
+     * @return Names of all includes encountered, local or not
+     */
+    std::vector<std::string> ScanTransitive(const std::vector<std::string>& files,
+                                            std::vector<std::string>& visited);
+
+    /**
+     * @brief Write the cache if anything changed since it was loaded
+     * @return true on success or if nothing needed to be written
+     */
+    bool Save() const;
+
+    /**
+     * @brief Extract include directives from source text
+     */
+    static std::vector<IncludeDirective> ParseIncludes(std::string_view content);
+
+private:
+    struct Entry {
+        long long mtime;
+        uintmax_t size;
+        std::vector<IncludeDirective> includes;
+        bool used;
+    };
+
+    std::string cache_file_;
+    std::vector<std::string> search_paths_;
+    std::map<std::string, Entry> entries_;
+    bool dirty_;
+
+    void LoadCache();
+
+    // true if the cached entry of @p file is current, else parse it into
+    // @p entry; only reads entries_, so workers may call it concurrently
+    bool Lookup(const std::string& file, Entry& entry) const;
+    std::string Resolve(const IncludeDirective& include, const std::string& from) const;
+};
+
+} // namespace Lumos
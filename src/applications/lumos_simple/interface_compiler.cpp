@@ -0,0 +1,462 @@
+#include "interface_compiler.h"
+#include "json_util.h"
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+struct ScalarType {
+    const char* cpp;
+    size_t size;
+};
+
+// Wire types and the C++ types they map to
+const std::map<std::string, ScalarType>& GetScalarTypes() {
+    static const std::map<std::string, ScalarType> types = {
+        {"bool", {"bool", 1}},
+        {"char", {"char", 1}},
+        {"int8", {"int8_t", 1}},
+        {"uint8", {"uint8_t", 1}},
+        {"int16", {"int16_t", 2}},
+        {"uint16", {"uint16_t", 2}},
+        {"int32", {"int32_t", 4}},
+        {"uint32", {"uint32_t", 4}},
+        {"int64", {"int64_t", 8}},
+        {"uint64", {"uint64_t", 8}},
+        {"float32", {"float", 4}},
+        {"float", {"float", 4}},
+        {"float64", {"double", 8}},
+        {"double", {"double", 8}},
+    };
+    return types;
+}
+
+bool IsIdentifier(const std::string& name) {
+    if (name.empty() || !(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_')) {
+        return false;
+    }
+    for (char c : name) {
+        if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// C++ keywords, identifiers reserved to the implementation (a double
+// underscore, or an underscore and a capital), the lumos_ prefix of the
+// generated parameters and the names the generated code refers to
+bool IsReservedName(const std::string& name) {
+    static const std::set<std::string> reserved = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+        "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept",
+        "const", "consteval", "constexpr", "constinit", "const_cast", "continue", "co_await",
+        "co_return", "co_yield", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+        "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+        "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+        "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+        "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+        "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local",
+        "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+        "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+        "std", "Lumos", "size_t", "int8_t", "uint8_t", "int16_t", "uint16_t", "int32_t", "uint32_t",
+        "int64_t", "uint64_t",
+    };
+    if (reserved.count(name) > 0 || name.find("__") != std::string::npos || name.compare(0, 6, "lumos_") == 0) {
+        return true;
+    }
+    return name.size() > 1 && name[0] == '_' && std::isupper(static_cast<unsigned char>(name[1]));
+}
+
+// Names the generated struct already uses
+bool IsReservedFieldName(const std::string& name) {
+    return name == "kId" || name == "kSize" || name == "kFitsCan" || name == "kFitsCanFd" ||
+           name == "Serialize" || name == "Deserialize" || IsReservedName(name);
+}
+
+// "float32[3]" -> type "float32", count 3
+bool ParseFieldType(const std::string& text, std::string& type, size_t& count) {
+    std::string::size_type bracket = text.find('[');
+    if (bracket == std::string::npos) {
+        type = text;
+        count = 0;
+        return IsIdentifier(type);
+    }
+    if (text.back() != ']' || bracket + 2 > text.size() - 1) {
+        return false;
+    }
+    type = text.substr(0, bracket);
+    std::string digits = text.substr(bracket + 1, text.size() - bracket - 2);
+    for (char c : digits) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    count = std::stoul(digits);
+    return IsIdentifier(type) && count > 0;
+}
+
+bool IsScalar(const std::string& type) {
+    return GetScalarTypes().count(type) != 0;
+}
+
+// char/int8/uint8 arrays are copied in one go
+bool IsByteArray(const InterfaceField& field) {
+    return field.count > 0 && field.size == 1 && field.type != "bool" && IsScalar(field.type);
+}
+
+std::string GetCppType(const std::string& type) {
+    auto it = GetScalarTypes().find(type);
+    return it != GetScalarTypes().end() ? it->second.cpp : type;
+}
+
+std::string Hex(uint32_t value, int digits) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::uppercase << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+} // namespace
+
+bool InterfaceDefinition::Load(const std::string& path, std::string& error) {
+    source = path;
+    ns.clear();
+    messages.clear();
+
+    YAML::Node root;
+    try {
+        root = YAML::LoadFile(path);
+    } catch (const YAML::Exception& e) {
+        error = "Failed to parse " + path + ": " + e.what();
+        return false;
+    }
+
+    if (root["namespace"]) {
+        ns = root["namespace"].as<std::string>();
+        std::string::size_type start = 0;
+        while (true) {
+            std::string::size_type end = ns.find("::", start);
+            if (!IsIdentifier(ns.substr(start, end - start)) || IsReservedName(ns.substr(start, end - start))) {
+                error = path + ": invalid namespace '" + ns + "'";
+                return false;
+            }
+            if (end == std::string::npos) {
+                break;
+            }
+            start = end + 2;
+        }
+    }
+
+    YAML::Node messages_node = root["messages"];
+    if (!messages_node || !messages_node.IsMap() || messages_node.size() == 0) {
+        error = path + ": no 'messages' map";
+        return false;
+    }
+
+    std::set<uint16_t> ids;
+    for (const auto& message_entry : messages_node) {
+        InterfaceMessage message;
+        message.name = message_entry.first.as<std::string>();
+        std::string where = path + ": message '" + message.name + "'";
+        if (!IsIdentifier(message.name) || IsScalar(message.name) || IsReservedName(message.name)) {
+            error = where + " is not a valid name";
+            return false;
+        }
+        if (FindMessage(message.name) != nullptr) {
+            error = where + " is defined twice";
+            return false;
+        }
+
+        YAML::Node body = message_entry.second;
+        if (!body.IsMap() || !body["id"]) {
+            error = where + " needs an 'id'";
+            return false;
+        }
+        try {
+            uint32_t id = body["id"].as<uint32_t>();
+            if (id > 0xFFFF) {
+                error = where + " has an id above 0xFFFF";
+                return false;
+            }
+            message.id = static_cast<uint16_t>(id);
+        } catch (const YAML::Exception&) {
+            error = where + " has an invalid id";
+            return false;
+        }
+        if (!ids.insert(message.id).second) {
+            error = where + " reuses id " + Hex(message.id, 4);
+            return false;
+        }
+
+        YAML::Node fields = body["fields"];
+        if (!fields || !fields.IsMap() || fields.size() == 0) {
+            error = where + " has no 'fields' map";
+            return false;
+        }
+        std::set<std::string> names;
+        for (const auto& field_entry : fields) {
+            InterfaceField field;
+            field.name = field_entry.first.as<std::string>();
+            std::string type_text = field_entry.second.as<std::string>();
+            if (!IsIdentifier(field.name) || IsReservedFieldName(field.name)) {
+                error = where + ": invalid field name '" + field.name + "'";
+                return false;
+            }
+            if (!names.insert(field.name).second) {
+                error = where + ": field '" + field.name + "' is defined twice";
+                return false;
+            }
+            if (!ParseFieldType(type_text, field.type, field.count)) {
+                error = where + ": invalid type '" + type_text + "' for field '" + field.name + "'";
+                return false;
+            }
+
+            auto scalar = GetScalarTypes().find(field.type);
+            if (scalar != GetScalarTypes().end()) {
+                field.size = scalar->second.size;
+            } else if (const InterfaceMessage* nested = FindMessage(field.type)) {
+                field.size = nested->size;
+            } else {
+                error = where + ": unknown type '" + field.type + "' for field '" + field.name +
+                        "' (messages must be defined before they are used)";
+                return false;
+            }
+
+            field.offset = message.size;
+            message.size += field.size * (field.count > 0 ? field.count : 1);
+            message.fields.push_back(field);
+        }
+        messages.push_back(message);
+    }
+    return true;
+}
+
+uint32_t InterfaceDefinition::GetHash() const {
+    std::string layout = ns;
+    for (const auto& message : messages) {
+        layout += ";" + message.name + "=" + std::to_string(message.id) + "{";
+        for (const auto& field : message.fields) {
+            // Aliases hash like the type they stand for
+            layout += field.name + ":" + GetCppType(field.type) + "[" + std::to_string(field.count) + "],";
+        }
+        layout += "}";
+    }
+
+    uint32_t hash = 2166136261u;
+    for (char c : layout) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+const InterfaceMessage* InterfaceDefinition::FindMessage(const std::string& name) const {
+    for (const auto& message : messages) {
+        if (message.name == name) {
+            return &message;
+        }
+    }
+    return nullptr;
+}
+
+std::string GenerateInterfaceHeader(const InterfaceDefinition& definition) {
+    std::ostringstream out;
+    out << "// Generated by 'lumos interface generate' from "
+        << fs::path(definition.source).filename().string() << " - do not edit\n";
+    out << "#pragma once\n";
+    out << "\n";
+    out << "#include <cstddef>\n";
+    out << "#include <cstdint>\n";
+    out << "#include <cstring>\n";
+    out << "\n";
+
+    // Shared by every generated header
+    out << "#ifndef LUMOS_WIRE_HELPERS\n";
+    out << "#define LUMOS_WIRE_HELPERS\n";
+    out << "namespace Lumos {\n";
+    out << "namespace Wire {\n";
+    out << "\n";
+    out << "// Little-endian scalar access at any alignment; a plain memcpy, so a\n";
+    out << "// single load/store on the Cortex-M and the host\n";
+    out << "template <typename T>\n";
+    out << "inline void Put(uint8_t* out, T value) {\n";
+    out << "#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__\n";
+    out << "    uint8_t bytes[sizeof(T)];\n";
+    out << "    std::memcpy(bytes, &value, sizeof(T));\n";
+    out << "    for (size_t i = 0; i < sizeof(T); i++) {\n";
+    out << "        out[i] = bytes[sizeof(T) - 1 - i];\n";
+    out << "    }\n";
+    out << "#else\n";
+    out << "    std::memcpy(out, &value, sizeof(T));\n";
+    out << "#endif\n";
+    out << "}\n";
+    out << "\n";
+    out << "template <typename T>\n";
+    out << "inline void Get(const uint8_t* in, T& value) {\n";
+    out << "#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__\n";
+    out << "    uint8_t bytes[sizeof(T)];\n";
+    out << "    for (size_t i = 0; i < sizeof(T); i++) {\n";
+    out << "        bytes[i] = in[sizeof(T) - 1 - i];\n";
+    out << "    }\n";
+    out << "    std::memcpy(&value, bytes, sizeof(T));\n";
+    out << "#else\n";
+    out << "    std::memcpy(&value, in, sizeof(T));\n";
+    out << "#endif\n";
+    out << "}\n";
+    out << "\n";
+    out << "inline void Put(uint8_t* out, bool value) { out[0] = value ? 1 : 0; }\n";
+    out << "inline void Get(const uint8_t* in, bool& value) { value = in[0] != 0; }\n";
+    out << "\n";
+    out << "} // namespace Wire\n";
+    out << "} // namespace Lumos\n";
+    out << "#endif // LUMOS_WIRE_HELPERS\n";
+    out << "\n";
+
+    if (!definition.ns.empty()) {
+        out << "namespace " << definition.ns << " {\n";
+        out << "\n";
+    }
+
+    size_t max_size = 0;
+    for (const auto& message : definition.messages) {
+        max_size = std::max(max_size, message.size);
+    }
+    out << "// Changes whenever a message layout changes; compare it across a link\n";
+    out << "constexpr uint32_t kInterfaceHash = " << Hex(definition.GetHash(), 8) << ";\n";
+    out << "constexpr size_t kMaxMessageSize = " << max_size << ";\n";
+    out << "\n";
+
+    for (const auto& message : definition.messages) {
+        out << "struct " << message.name << " {\n";
+        out << "    static constexpr uint16_t kId = " << Hex(message.id, 4) << ";\n";
+        out << "    static constexpr size_t kSize = " << message.size << ";   // Wire size in bytes\n";
+        out << "    static constexpr bool kFitsCan = kSize <= 8;\n";
+        out << "    static constexpr bool kFitsCanFd = kSize <= 64;\n";
+        out << "\n";
+        for (const auto& field : message.fields) {
+            out << "    " << GetCppType(field.type) << " " << field.name;
+            if (field.count > 0) {
+                out << "[" << field.count << "]";
+            }
+            out << (IsScalar(field.type) ? " = {};\n" : ";\n");
+        }
+        out << "\n";
+
+        out << "    // Write kSize bytes to @p lumos_out_; returns kSize\n";
+        out << "    size_t Serialize(uint8_t* lumos_out_) const {\n";
+        for (const auto& field : message.fields) {
+            std::string at = "lumos_out_ + " + std::to_string(field.offset);
+            if (field.count > 0 && IsByteArray(field)) {
+                out << "        std::memcpy(" << at << ", " << field.name << ", " << field.count << ");\n";
+            } else if (field.count > 0) {
+                out << "        for (size_t lumos_i_ = 0; lumos_i_ < " << field.count << "; lumos_i_++) {\n";
+                at += " + lumos_i_ * " + std::to_string(field.size);
+                if (IsScalar(field.type)) {
+                    out << "            Lumos::Wire::Put(" << at << ", " << field.name << "[lumos_i_]);\n";
+                } else {
+                    out << "            " << field.name << "[lumos_i_].Serialize(" << at << ");\n";
+                }
+                out << "        }\n";
+            } else if (IsScalar(field.type)) {
+                out << "        Lumos::Wire::Put(" << at << ", " << field.name << ");\n";
+            } else {
+                out << "        " << field.name << ".Serialize(" << at << ");\n";
+            }
+        }
+        out << "        return kSize;\n";
+        out << "    }\n";
+        out << "\n";
+
+        out << "    // Read from @p lumos_in_; false if @p lumos_length_ is shorter than kSize\n";
+        out << "    bool Deserialize(const uint8_t* lumos_in_, size_t lumos_length_) {\n";
+        out << "        if (lumos_length_ < kSize) {\n";
+        out << "            return false;\n";
+        out << "        }\n";
+        for (const auto& field : message.fields) {
+            std::string at = "lumos_in_ + " + std::to_string(field.offset);
+            std::string size = std::to_string(field.size);
+            if (field.count > 0 && IsByteArray(field)) {
+                out << "        std::memcpy(" << field.name << ", " << at << ", " << field.count << ");\n";
+            } else if (field.count > 0) {
+                out << "        for (size_t lumos_i_ = 0; lumos_i_ < " << field.count << "; lumos_i_++) {\n";
+                at += " + lumos_i_ * " + size;
+                if (IsScalar(field.type)) {
+                    out << "            Lumos::Wire::Get(" << at << ", " << field.name << "[lumos_i_]);\n";
+                } else {
+                    out << "            " << field.name << "[lumos_i_].Deserialize(" << at << ", " << size << ");\n";
+                }
+                out << "        }\n";
+            } else if (IsScalar(field.type)) {
+                out << "        Lumos::Wire::Get(" << at << ", " << field.name << ");\n";
+            } else {
+                out << "        " << field.name << ".Deserialize(" << at << ", " << size << ");\n";
+            }
+        }
+        out << "        return true;\n";
+        out << "    }\n";
+        out << "};\n";
+        out << "\n";
+    }
+
+    out << "// Wire size of the message with @p id, 0 if it is not in this interface\n";
+    out << "constexpr size_t GetMessageSize(uint16_t id) {\n";
+    for (const auto& message : definition.messages) {
+        out << "    if (id == " << message.name << "::kId) {\n";
+        out << "        return " << message.name << "::kSize;\n";
+        out << "    }\n";
+    }
+    out << "    return 0;\n";
+    out << "}\n";
+
+    if (!definition.ns.empty()) {
+        out << "\n";
+        out << "} // namespace " << definition.ns << "\n";
+    }
+    return out.str();
+}
+
+std::string GetInterfaceHeaderName(const std::string& interface_path) {
+    return fs::path(interface_path).stem().string() + "_messages.h";
+}
+
+bool GenerateInterface(const std::string& interface_path, const std::string& header_path,
+                       std::string& error) {
+    InterfaceDefinition definition;
+    if (!definition.Load(interface_path, error)) {
+        return false;
+    }
+    std::string header = GenerateInterfaceHeader(definition);
+
+    std::ifstream existing(header_path, std::ios::binary);
+    if (existing) {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == header) {
+            return true;
+        }
+    }
+
+    std::error_code ec;
+    fs::path parent = fs::path(header_path).parent_path();
+    if (!parent.empty()) {
+        fs::create_directories(parent, ec);
+    }
+    if (!WriteFileAtomically(header_path, header)) {
+        error = "Failed to write " + header_path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One field of an interface message
+ *
+ * The type is a scalar (bool, char, int8..int64, uint8..uint64, float32,
+ * float64) or a message defined earlier in the same file, optionally as a
+ * fixed array: "float32[3]".
+ */
+struct InterfaceField {
+    std::string name;
+    std::string type;      // Scalar or message name, without the array suffix
+    size_t count = 0;      // Array length, 0 for a single value
+    size_t offset = 0;     // Byte offset in the wire format
+    size_t size = 0;       // Wire size of one element
+};
+
+struct InterfaceMessage {
+    std::string name;
+    uint16_t id = 0;
+    std::vector<InterfaceField> fields;
+    size_t size = 0;       // Wire size
+};
+
+/**
+ * @brief A parsed interface file (lumos interface generate)
+ *
+ * Interface files are YAML:
+ *
+ *   namespace: sensor
+ *   messages:
+ *     TemperatureReading:
+ *       id: 0x10
+ *       fields:
+ *         temperature: float32
+ *         timestamp: uint32
+ *         sensor_id: uint8
+ *
+ * Fields keep the order of the file. The wire format is the fields back
+ * to back, little-endian and without padding, so it is the same on the
+ * MCU and the host.
+ */
+struct InterfaceDefinition {
+    std::string source;    // File it was loaded from
+    std::string ns;
+    std::vector<InterfaceMessage> messages;
+
+    /**
+     * @brief Load and check an interface file
+     * @return false with @p error set if it is malformed
+     */
+    bool Load(const std::string& path, std::string& error);
+
+    /**
+     * @brief FNV-1a hash of the wire layout of every message
+     *
+     * Only names, ids and types go in, so a firmware and a host tool built
+     * from the same file agree, and any layout change alters it.
+     */
+    uint32_t GetHash() const;
+
+    const InterfaceMessage* FindMessage(const std::string& name) const;
+};
+
+/**
+ * @brief C++ header with the message structs and their serializers
+ *
+ * Each message becomes a struct with constexpr kId and kSize, Serialize()
+ * writing straight into the caller's buffer (a CAN frame, a UART packet)
+ * and Deserialize() reading straight from it. The header only needs the
+ * C++ standard library, so firmware and host tools include the same file.
+ */
+std::string GenerateInterfaceHeader(const InterfaceDefinition& definition);
+
+/**
+ * @brief Header file name for an interface file: sensor.yaml -> sensor_messages.h
+ */
+std::string GetInterfaceHeaderName(const std::string& interface_path);
+
+/**
+ * @brief Load @p interface_path and write its header to @p header_path
+ *
+ * The header is only rewritten when its content changes, so firmware that
+ * includes it is not recompiled needlessly.
+ */
+bool GenerateInterface(const std::string& interface_path, const std::string& header_path,
+                       std::string& error);
+
+} // namespace Lumos
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "serial.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos {
+
+/**
+ * @brief How long the commands that run until Ctrl+C wait for data at once
+ *
+ * main.cpp's SIGINT handler only clears the `running` flag that these
+ * loops are passed; the timeout bounds how long that takes to be noticed,
+ * data is handled as soon as it arrives.
+ */
+constexpr int kInterruptPollMs = 100;
+
+/**
+ * @brief serial.Read() for those loops, returning after kInterruptPollMs
+ * @return Bytes read (0 on timeout), -1 on error
+ */
+inline int ReadPolled(SimpleSerial::Serial& serial, uint8_t* buffer, size_t length) {
+    return serial.Read(buffer, length, kInterruptPollMs);
+}
+
+} // namespace Lumos
@@ -0,0 +1,95 @@
+#include "job_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace Lumos {
+
+JobPool::JobPool(unsigned int jobs)
+    : jobs_(jobs == 0 ? DefaultJobCount() : jobs)
+{
+}
+
+unsigned int JobPool::DefaultJobCount() {
+    // Explicit override from the environment takes precedence
+    const char* env = std::getenv("LUMOS_JOBS");
+    if (env != nullptr) {
+        unsigned int jobs = 0;
+        if (ParseJobCount(env, jobs)) {
+            return jobs;
+        }
+        std::cerr << "Warning: Ignoring invalid LUMOS_JOBS value '" << env << "'" << std::endl;
+    }
+
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 1 : hw;
+}
+
+bool JobPool::ParseJobCount(const std::string& text, unsigned int& jobs) {
+    // std::stoi alone would read "4abc" as 4
+    try {
+        size_t end = 0;
+        int value = std::stoi(text, &end);
+        if (end != text.size() || value <= 0) {
+            return false;
+        }
+        jobs = static_cast<unsigned int>(value);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool JobPool::Run(const std::vector<Job>& jobs) {
+    if (jobs.empty()) {
+        return true;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex output_mutex;
+
+    auto worker = [&]() {
+        while (!failed.load()) {
+            size_t index = next.fetch_add(1);
+            if (index >= jobs.size()) {
+                return;
+            }
+
+            std::string output;
+            bool ok = jobs[index](output);
+
+            {
+                // Flush the whole job log at once so lines never interleave
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << output << std::flush;
+            }
+
+            if (!ok) {
+                failed.store(true);
+            }
+        }
+    };
+
+    size_t thread_count = std::min<size_t>(jobs_, jobs.size());
+    if (thread_count <= 1) {
+        worker();
+        return !failed.load();
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return !failed.load();
+}
+
+} // namespace Lumos
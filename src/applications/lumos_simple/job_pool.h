@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Fixed-size worker pool for running independent build jobs
+ *
+ * Each job writes its log into a private buffer which is flushed to stdout
+ * as a single block once the job finishes, so output from concurrent
+ * compiler invocations never interleaves. The first failing job stops the
+ * pool from scheduling further work; jobs already running are allowed to
+ * finish so their diagnostics are still reported.
+ */
+class JobPool {
+public:
+    /**
+     * @brief A unit of work
+     * @param output Buffer the job appends its log/diagnostics to
+     * @return true on success, false to fail the whole run
+     */
+    using Job = std::function<bool(std::string& output)>;
+
+    /**
+     * @brief Construct a pool
+     * @param jobs Number of worker threads (0 = hardware thread count)
+     */
+    explicit JobPool(unsigned int jobs = 0);
+
+    /**
+     * @brief Run all jobs and wait for completion
+     * @param jobs Jobs to execute, scheduled in order
+     * @return true if every job succeeded, false on the first failure
+     */
+    bool Run(const std::vector<Job>& jobs);
+
+    /**
+     * @brief Number of worker threads this pool uses
+     */
+    unsigned int GetJobCount() const { return jobs_; }
+
+    /**
+     * @brief Default job count: LUMOS_JOBS if set, else hardware threads
+     */
+    static unsigned int DefaultJobCount();
+
+    /**
+     * @brief Parse a job count from -j or LUMOS_JOBS
+     * @return false unless @p text is a whole positive number
+     */
+    static bool ParseJobCount(const std::string& text, unsigned int& jobs);
+
+private:
+    unsigned int jobs_;
+};
+
+} // namespace Lumos
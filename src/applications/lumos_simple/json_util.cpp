@@ -0,0 +1,64 @@
+#include "json_util.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+std::string JsonString(const std::string& value) {
+    std::ostringstream ss;
+    ss << '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"':  ss << "\\\""; break;
+            case '\\': ss << "\\\\"; break;
+            case '\n': ss << "\\n"; break;
+            case '\r': ss << "\\r"; break;
+            case '\t': ss << "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+                       << std::dec;
+                } else {
+                    ss << c;
+                }
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+std::string JsonArray(const std::vector<std::string>& values) {
+    std::string out = "[";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) out += ", ";
+        out += JsonString(values[i]);
+    }
+    return out + "]";
+}
+
+bool WriteFileAtomically(const std::string& path, const std::string& content) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << content;
+        if (!file.good()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace Lumos
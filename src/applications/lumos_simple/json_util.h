@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Quote and escape a string as a JSON string literal
+ */
+std::string JsonString(const std::string& value);
+
+/**
+ * @brief Format strings as a single-line JSON array
+ */
+std::string JsonArray(const std::vector<std::string>& values);
+
+/**
+ * @brief Write a file through a temporary so readers never see it truncated
+ * @return true on success
+ */
+bool WriteFileAtomically(const std::string& path, const std::string& content);
+
+} // namespace Lumos
@@ -0,0 +1,136 @@
+#include "lumos_root.h"
+#include "json_util.h"
+#include "object_cache.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+// One "<executable>\t<root>\t<resource base>" line per executable
+const char* const kRootsFile = "roots";
+
+bool HasResources(const fs::path& base) {
+    std::error_code ec;
+    return fs::exists(base / "toolchains", ec) && fs::exists(base / "boards", ec);
+}
+
+std::string GetRootsFile() {
+    std::string dir = ObjectCache::DefaultDirectory();
+    return dir.empty() ? "" : (fs::path(dir) / kRootsFile).string();
+}
+
+std::string LoadRememberedRoot(const std::string& roots_file, const std::string& executable) {
+    const std::string prefix = executable + "\t";
+    std::ifstream file(roots_file);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        // Only the layout found last time is checked
+        size_t tab = line.find('\t', prefix.size());
+        if (tab == std::string::npos || !HasResources(line.substr(tab + 1))) {
+            return "";
+        }
+        return line.substr(prefix.size(), tab - prefix.size());
+    }
+    return "";
+}
+
+void RememberRoot(const std::string& roots_file, const std::string& executable, const std::string& root) {
+    std::ostringstream content;
+    std::ifstream file(roots_file);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, executable.size() + 1, executable + "\t") != 0 && !line.empty()) {
+            content << line << "\n";
+        }
+    }
+    file.close();
+    content << executable << "\t" << root << "\t" << GetResourceBasePath(root) << "\n";
+
+    std::error_code ec;
+    fs::create_directories(fs::path(roots_file).parent_path(), ec);
+    WriteFileAtomically(roots_file, content.str());
+}
+
+} // namespace
+
+bool IsValidLumosRoot(const std::string& path) {
+    // Development structure: src/toolchains, src/boards
+    // Release structure: toolchains, boards (no src/)
+    return HasResources(fs::path(path) / "src") || HasResources(path);
+}
+
+std::string GetResourceBasePath(const std::string& lumos_root) {
+    std::error_code ec;
+    if (fs::exists(fs::path(lumos_root) / "src" / "toolchains", ec)) {
+        return lumos_root + "/src";
+    }
+    return lumos_root;
+}
+
+std::string FindLumosRoot(const std::string& executable) {
+    if (const char* env = std::getenv("LUMOS_ROOT")) {
+        if (env[0] != '\0' && IsValidLumosRoot(env)) {
+            return env;
+        }
+    }
+
+    std::string roots_file = executable.empty() ? "" : GetRootsFile();
+    if (!roots_file.empty()) {
+        std::string root = LoadRememberedRoot(roots_file, executable);
+        if (!root.empty()) {
+            return root;
+        }
+    }
+
+    std::vector<fs::path> candidates;
+    if (!executable.empty()) {
+        fs::path current_dir = fs::path(executable).parent_path();
+
+        // Strategy 1: Installed structure (bin/lumos -> ../share/lumos)
+        // Example: /usr/local/bin/lumos -> /usr/local/share/lumos
+        candidates.push_back(current_dir.parent_path() / "share" / "lumos");
+
+        // Strategy 2: Development structure (build/src/applications/lumos_simple/lumos -> ../../../../)
+        // Walk up the tree looking for the marker
+        fs::path temp = current_dir;
+        for (int i = 0; i < 6; i++) {  // Look up to 6 levels
+            candidates.push_back(temp);
+            if (temp.parent_path() == temp) break;  // Reached filesystem root
+            temp = temp.parent_path();
+        }
+    }
+
+    // Fallback: Check standard installation locations
+#ifndef _WIN32
+    candidates.push_back("/usr/local/share/lumos");
+    candidates.push_back("/usr/share/lumos");
+    candidates.push_back("/opt/lumos/share/lumos");
+#else
+    candidates.push_back("C:\\Program Files\\Lumos\\share\\lumos");
+    candidates.push_back("C:\\Program Files (x86)\\Lumos\\share\\lumos");
+#endif
+
+    for (const auto& candidate : candidates) {
+        if (IsValidLumosRoot(candidate.string())) {
+            if (!roots_file.empty()) {
+                RememberRoot(roots_file, executable, candidate.string());
+            }
+            return candidate.string();
+        }
+    }
+
+    // If all else fails, return empty (will cause error)
+    return "";
+}
+
+} // namespace Lumos
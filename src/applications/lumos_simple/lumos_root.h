@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Check for a Lumos installation at @p path
+ *
+ * Development trees keep toolchains/ and boards/ under src/, release
+ * installs at the top.
+ */
+bool IsValidLumosRoot(const std::string& path);
+
+/**
+ * @brief Directory holding toolchains/, boards/, wrapper/ etc. of @p lumos_root
+ * @return lumos_root/src for a development tree, lumos_root otherwise
+ */
+std::string GetResourceBasePath(const std::string& lumos_root);
+
+/**
+ * @brief Find the Lumos installation the tool belongs to
+ *
+ * In order: the LUMOS_ROOT environment variable, the root found for
+ * @p executable by an earlier run, then a search of the installed layout
+ * (bin/../share/lumos), up to six parents of the executable and the
+ * standard install locations. A root found by searching is remembered in
+ * the user cache directory (see ObjectCache::DefaultDirectory), so later
+ * runs check two paths instead of probing a dozen, which matters on
+ * network filesystems.
+ *
+ * @param executable Path of the running executable (empty = skip to
+ *                   the standard locations)
+ * @return Root directory, or empty if none was found
+ */
+std::string FindLumosRoot(const std::string& executable);
+
+} // namespace Lumos
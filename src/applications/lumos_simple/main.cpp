@@ -1,16 +1,57 @@
+#include "baud_probe.h"
+#include "bench_report.h"
+#include "bootloader_emulator.h"
+#include "build_daemon.h"
+#include "build_matrix.h"
 #include "builder.h"
+#include "cache_bundle.h"
 #include "cache_config.h"
+#include "can_bridge.h"
+#include "can_update.h"
+#include "can_stats.h"
+#include "capture_file.h"
+#include "elf_file.h"
+#include "file_watcher.h"
+#include "firmware_image.h"
+#include "gc_report.h"
+#include "interface_compiler.h"
+#include "job_pool.h"
+#include "lumos_root.h"
+#include "object_cache.h"
+#include "size_report.h"
+#include "multi_flash.h"
+#include "memory_stats.h"
+#include "multi_monitor.h"
+#include "profile_report.h"
+#include "rtt_monitor.h"
+#include "runtime_stats.h"
+#include "usb_monitor.h"
+#include "target_trace.h"
+#include "toolchain.h"
+#include "stream_decompressor.h"
+#include "token_log_decoder.h"
+#include "crc32.h"
+#include "mapped_file.h"
+#include "port_watcher.h"
 #include "serial.h"
 #include "stm32_communicator.h"
+#include "swd_flasher.h"
 #include <iostream>
 #include <filesystem>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
 #include <string>
 #include <limits>
 #include <csignal>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
 #include <algorithm>
 #include <vector>
 
@@ -26,7 +67,8 @@
 
 namespace fs = std::filesystem;
 
-// Global flag for signal handling
+// Global flag for signal handling; the loops it stops poll it at least
+// every kInterruptPollMs (interrupt_poll.h)
 static volatile bool g_running = true;
 
 void SignalHandler(int signal) {
@@ -43,20 +85,164 @@ void PrintUsage() {
     std::cout << std::endl;
     std::cout << "Commands:" << std::endl;
     std::cout << "  init               Initialize a new project in current directory" << std::endl;
-    std::cout << "  build              Build the project in current directory" << std::endl;
+    std::cout << "  build [options]    Build the project in current directory" << std::endl;
+#ifndef _WIN32
+    std::cout << "  daemon             Keep the project's build state in memory and serve 'lumos build'" << std::endl;
+#endif
+    std::cout << "  toolchains         List the arm-none-eabi toolchains found and the one a build uses" << std::endl;
+    std::cout << "  cache export FILE  Write the shared object cache and HAL archives to a bundle" << std::endl;
+    std::cout << "  cache import FILE  Add a bundle's entries missing from the shared cache" << std::endl;
+    std::cout << "  watch [port]       Rebuild when project files change (-j, --profile as for build)" << std::endl;
+    std::cout << "    --flash          Delta-flash each successful build to the port" << std::endl;
+    std::cout << "    --monitor        Monitor the port between builds (implies --flash)" << std::endl;
+    std::cout << "    --baud N         Monitor baud rate (default: 115200)" << std::endl;
+    std::cout << "    --debounce-ms N  Quiet time after the last change (default: 300)" << std::endl;
+    std::cout << "  run [port]         Build and flash, writing the image while the build finishes" << std::endl;
+    std::cout << "    --verify         Read back a sample of the written blocks" << std::endl;
+    std::cout << "    --baud N         ROM bootloader rate (default: fastest that works, cached per port)" << std::endl;
+    std::cout << "    -j, --profile, --board, --no-cache as for build" << std::endl;
+    std::cout << "  size [--top N]     Show flash/RAM usage per region, object and symbol" << std::endl;
+    std::cout << "    --gc             Show what --gc-sections kept and removed per module" << std::endl;
+    std::cout << "    --board B        Board of a project.yaml board list (reads build/<board>)" << std::endl;
     std::cout << "  flash [port]       Flash firmware to STM32 (auto-detects port if not specified)" << std::endl;
+    std::cout << "    --delta          Only erase and write flash sectors that changed" << std::endl;
+    std::cout << "    --board B        Board of a project.yaml board list (flashes build/<board>)" << std::endl;
+    std::cout << "    --verify         Read back a sample of the written blocks" << std::endl;
+    std::cout << "    --stream         Pipeline each write's command, address and data" << std::endl;
+    std::cout << "    --all            Flash every attached device via the Lumos bootloader" << std::endl;
+    std::cout << "    --ports a,b,c    Flash the listed ports via the Lumos bootloader" << std::endl;
+    std::cout << "    -j N             Devices to flash concurrently (default: all)" << std::endl;
+    std::cout << "    --swd            Program over SWD with a debug probe (needs OpenOCD)" << std::endl;
+    std::cout << "    --probe P        SWD probe: stlink, cmsis-dap (default: stlink)" << std::endl;
+    std::cout << "    --probe-serial S Serial number of the probe to use" << std::endl;
+    std::cout << "    --swd-speed kHz  SWD clock (default: 4000)" << std::endl;
+    std::cout << "    --baud N         ROM bootloader rate (default: fastest that works, cached per port)" << std::endl;
     std::cout << "  monitor [port]     Monitor serial output from MCU" << std::endl;
+    std::cout << "    --ports a,b,c    Monitor several ports, lines prefixed and timestamped" << std::endl;
+    std::cout << "    --baud N|auto    Baud rate (default: cached or detected; 115200 with --ports)" << std::endl;
+    std::cout << "    --log FILE       Also append the output to FILE (merged with --ports)" << std::endl;
+    std::cout << "    --capture FILE   Record raw timestamped bytes to FILE instead of printing" << std::endl;
+    std::cout << "    --elf FILE       Decode tokenized logs with FILE (default: build/firmware.elf)" << std::endl;
+#ifndef _WIN32
+    std::cout << "    --rtt            Read the RTT ring (rtt.h) through a debug probe (needs OpenOCD)" << std::endl;
+    std::cout << "    --probe P        RTT probe: stlink, cmsis-dap (default: stlink)" << std::endl;
+#endif
+    std::cout << "    --usb            Read the vendor bulk stream (USBInterface::Vendor, needs libusb)" << std::endl;
+    std::cout << "    --usb-serial S   USB serial number of the board to use" << std::endl;
+    std::cout << "  profile [port]     Sample the firmware's PC (framework/profiler.h) and print a profile" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+    std::cout << "    --elf FILE       Symbols to use (default: build/firmware.elf)" << std::endl;
+    std::cout << "    --duration S     Stop after S seconds (default: until Ctrl+C)" << std::endl;
+    std::cout << "    --top N          Rows per table (default: 25, 0 for all)" << std::endl;
+    std::cout << "    --folded FILE    Write collapsed stacks for flame graph tools" << std::endl;
+    std::cout << "  trace [port]       Record LUMOS_TRACE scopes (wrapper/trace.h) as a Perfetto timeline" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+    std::cout << "    --elf FILE       Names to use (default: build/firmware.elf)" << std::endl;
+    std::cout << "    --duration S     Stop after S seconds (default: until Ctrl+C)" << std::endl;
+    std::cout << "    -o FILE          Output (default: build/firmware_trace.json)" << std::endl;
+    std::cout << "  decode <file>      Print a capture recorded with monitor --capture" << std::endl;
+    std::cout << "    --hex            Dump each received chunk in hex" << std::endl;
+    std::cout << "  unpack <file>      Decompress a stream written through framework/stream_compressor.h" << std::endl;
+    std::cout << "    -o FILE          Output (default: <file> with extension .raw)" << std::endl;
+    std::cout << "  can [port]         Print CAN bus traffic through a CAN bridge board (binary mode)" << std::endl;
+    std::cout << "    --id ID[/MASK]   Only frames matching the ID (repeatable)" << std::endl;
+    std::cout << "    --record FILE    Save frames as a candump log" << std::endl;
+    std::cout << "    --quiet          Don't print frames (with --record)" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 1000000)" << std::endl;
+    std::cout << "  can replay <file> [port]  Send a candump log onto the bus with its original timing" << std::endl;
+    std::cout << "  can-update [port]  Download build/firmware.bin to many CAN FD nodes at once (wrapper/can_update.h)" << std::endl;
+    std::cout << "    --nodes LIST     Node addresses, e.g. 1-20 or 1,4,7 (required)" << std::endl;
+    std::cout << "    --firmware FILE  Image to send (default: build/firmware.bin)" << std::endl;
+    std::cout << "    --rate N         Data frames per second (default: 1000, 0 = as fast as the link)" << std::endl;
+    std::cout << "    --retries N      Attempts before a node is dropped (default: 5)" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 1000000)" << std::endl;
+    std::cout << "  can-stats [port]   Show CAN bus load, drops and latency reported by the firmware" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+    std::cout << "  memory [port]      Show stack and heap high-water marks reported by the firmware" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+    std::cout << "  stats [port]       Poll per-app CPU load, ISR load, queue depths and power states (framework/stats_endpoint.h)" << std::endl;
+    std::cout << "    --rate HZ        Requests per second (default: 50)" << std::endl;
+    std::cout << "    --duration S     Stop after S seconds" << std::endl;
+    std::cout << "    --current R,S,T  Supply mA in Run, Sleep and Stop: average current and charge per step" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+    std::cout << "  bench [port]       Build, flash and run the wrapper micro-benchmarks (wrapper/bench.h)" << std::endl;
+    std::cout << "    --board B        Board to benchmark (default: board in project.yaml)" << std::endl;
+    std::cout << "    --no-flash       Only collect results from firmware already running" << std::endl;
+    std::cout << "    --no-fast-libc   Build with newlib's memcpy/memset (fast_libc off) for comparison" << std::endl;
+    std::cout << "    --baseline FILE  Compare against saved results, fail on regressions" << std::endl;
+    std::cout << "    --threshold PCT  Slowdown counted as a regression (default: 5)" << std::endl;
+    std::cout << "    -o FILE          Output (default: build/bench.json)" << std::endl;
+    std::cout << "    --timeout S      Give up waiting for results after S seconds (default: 30)" << std::endl;
+    std::cout << "    --baud N         Baud rate (default: 115200)" << std::endl;
+#ifndef _WIN32
+    std::cout << "  emulate <lumos|stm32>  Emulate a bootloader on a pseudo-terminal to flash against" << std::endl;
+    std::cout << "    --line-rate      Pace bytes at the baud rate the tool sets" << std::endl;
+    std::cout << "    --latency-us N   Delay before each reply" << std::endl;
+    std::cout << "    --loss PCT       Data packets received corrupted" << std::endl;
+    std::cout << "    --erase-ms N     Full erase time (Lumos START without lazy erase, ROM global erase)" << std::endl;
+    std::cout << "    --page-erase-ms N  Page erase time (ROM extended erase, Lumos lazy erase)" << std::endl;
+    std::cout << "    --write-us-per-kb N  Flash programming time" << std::endl;
+    std::cout << "    --max-baud N     Highest baud rate granted (lumos) or synced to (stm32, default: 2000000)" << std::endl;
+    std::cout << "    --seed N         Loss pattern (default: 1)" << std::endl;
+#endif
+    std::cout << "  interface generate <file>  Generate message structs and serializers from an interface file" << std::endl;
+    std::cout << "    -o FILE          Output header (default: <name>_messages.h next to the file)" << std::endl;
+    std::cout << "  interface validate <file>  Check an interface file and print its wire layout" << std::endl;
     std::cout << "  reset <port>       Reset/unstick a serial port" << std::endl;
-    std::cout << "  ports              List available serial ports" << std::endl;
+    std::cout << "  ports              List available serial ports with USB IDs" << std::endl;
+    std::cout << "    --watch, -w      Keep running and report ports as they are plugged/unplugged" << std::endl;
+    std::cout << "    --status         Also check whether each port is free (Linux: without opening it)" << std::endl;
     std::cout << "  --help, -h         Show this help message" << std::endl;
     std::cout << "  --version, -v      Show version" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Build options:" << std::endl;
+    std::cout << "  -j N, --jobs N     Parallel compile jobs (default: LUMOS_JOBS or CPU count)" << std::endl;
+    std::cout << "  -p, --profile P    Build profile: debug, release, size, fast (default: project.yaml)" << std::endl;
+    std::cout << "  --board B          Build only board B of a project.yaml board list (default: all, into build/<board>)" << std::endl;
+    std::cout << "  --no-cache         Don't use the shared object cache (LUMOS_CACHE_DIR)" << std::endl;
+    std::cout << "  --timings          Report step times and write build/trace.json" << std::endl;
+#ifndef _WIN32
+    std::cout << "  --no-daemon        Build in this process even if 'lumos daemon' is running" << std::endl;
+#endif
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  mkdir my_project && cd my_project" << std::endl;
     std::cout << "  lumos init" << std::endl;
     std::cout << "  lumos build" << std::endl;
+    std::cout << "  lumos build -j 8" << std::endl;
+    std::cout << "  lumos build --profile release" << std::endl;
+    std::cout << "  lumos build --board Host" << std::endl;
+#ifndef _WIN32
+    std::cout << "  lumos daemon &" << std::endl;
+#endif
+    std::cout << "  lumos watch --monitor" << std::endl;
+    std::cout << "  lumos size --top 20" << std::endl;
+    std::cout << "  lumos size --gc" << std::endl;
+    std::cout << "  lumos run" << std::endl;
     std::cout << "  lumos flash" << std::endl;
+    std::cout << "  lumos flash --delta" << std::endl;
+    std::cout << "  lumos flash --ports /dev/ttyUSB0,/dev/ttyUSB1" << std::endl;
+    std::cout << "  lumos flash --swd --delta" << std::endl;
     std::cout << "  lumos monitor" << std::endl;
+    std::cout << "  lumos monitor --ports /dev/ttyUSB0,/dev/ttyUSB1 --log rig.log" << std::endl;
+    std::cout << "  lumos monitor /dev/ttyUSB0 921600 --capture telemetry.lcap" << std::endl;
+#ifndef _WIN32
+    std::cout << "  lumos monitor --rtt" << std::endl;
+#endif
+    std::cout << "  lumos monitor --usb --capture stream.lcap" << std::endl;
+    std::cout << "  lumos profile /dev/ttyUSB0 --duration 10 --folded profile.folded" << std::endl;
+    std::cout << "  lumos trace /dev/ttyUSB0 --duration 5" << std::endl;
+    std::cout << "  lumos decode telemetry.lcap" << std::endl;
+    std::cout << "  lumos unpack LOG.BIN -o log.bin" << std::endl;
+    std::cout << "  lumos can /dev/ttyACM0 --id 0x100/0x7F0 --record bus.log" << std::endl;
+    std::cout << "  lumos can replay bus.log /dev/ttyACM0" << std::endl;
+    std::cout << "  lumos can-update /dev/ttyACM0 --nodes 1-20" << std::endl;
+    std::cout << "  lumos can-stats /dev/ttyACM0" << std::endl;
+    std::cout << "  lumos memory /dev/ttyUSB0" << std::endl;
+    std::cout << "  lumos stats /dev/ttyUSB0 --rate 100" << std::endl;
+    std::cout << "  lumos stats /dev/ttyUSB0 --current 6.2,1.9,0.004" << std::endl;
+    std::cout << "  lumos bench /dev/ttyUSB0 --baseline bench_baseline.json" << std::endl;
+    std::cout << "  lumos emulate lumos --line-rate --loss 1" << std::endl;
     std::cout << "  lumos reset /dev/ttyUSB0" << std::endl;
 }
 
@@ -87,79 +273,10 @@ std::string GetExecutablePath() {
     return "";
 }
 
-bool IsValidLumosRoot(const fs::path& path) {
-    // Check for presence of required directories/files
-    // Development structure: src/toolchains, src/boards
-    // Release structure: toolchains, boards (no src/)
-    bool dev_structure = fs::exists(path / "src" / "toolchains") &&
-                         fs::exists(path / "src" / "boards");
-    bool release_structure = fs::exists(path / "toolchains") &&
-                             fs::exists(path / "boards");
-
-    return dev_structure || release_structure;
-}
-
 std::string GetLumosRoot() {
     // Auto-detect LUMOS_ROOT from executable path
     // Works for both development and release builds without requiring environment variables
-    std::string exe_path_str = GetExecutablePath();
-    if (!exe_path_str.empty()) {
-        fs::path exe_path = fs::path(exe_path_str);
-        fs::path current_dir = exe_path.parent_path();
-
-        // Try multiple strategies to find LUMOS_ROOT
-        std::vector<fs::path> candidates;
-
-        // Strategy 1: Installed structure (bin/lumos -> ../share/lumos)
-        // Example: /usr/local/bin/lumos -> /usr/local/share/lumos
-        candidates.push_back(current_dir.parent_path() / "share" / "lumos");
-
-        // Strategy 2: Development structure (build/src/applications/lumos_simple/lumos -> ../../../../)
-        // Walk up the tree looking for the marker
-        fs::path temp = current_dir;
-        for (int i = 0; i < 6; i++) {  // Look up to 6 levels
-            candidates.push_back(temp);
-            if (temp.parent_path() == temp) break;  // Reached filesystem root
-            temp = temp.parent_path();
-        }
-
-        // Check each candidate
-        for (const auto& candidate : candidates) {
-            if (IsValidLumosRoot(candidate)) {
-                return candidate.string();
-            }
-        }
-    }
-
-    // Fallback: Check standard installation locations (Unix-like systems)
-#ifndef _WIN32
-    std::vector<std::string> standard_paths = {
-        "/usr/local/share/lumos",
-        "/usr/share/lumos",
-        "/opt/lumos/share/lumos"
-    };
-
-    for (const auto& path : standard_paths) {
-        if (IsValidLumosRoot(path)) {
-            return path;
-        }
-    }
-#else
-    // Windows standard paths
-    std::vector<std::string> standard_paths = {
-        "C:\\Program Files\\Lumos\\share\\lumos",
-        "C:\\Program Files (x86)\\Lumos\\share\\lumos"
-    };
-
-    for (const auto& path : standard_paths) {
-        if (IsValidLumosRoot(path)) {
-            return path;
-        }
-    }
-#endif
-
-    // If all else fails, return empty (will cause error)
-    return "";
+    return Lumos::FindLumosRoot(GetExecutablePath());
 }
 
 std::string Prompt(const std::string& question, const std::vector<std::string>& options, size_t default_index = 0) {
@@ -196,6 +313,34 @@ std::string Prompt(const std::string& question, const std::vector<std::string>&
     return options[default_index];
 }
 
+// Where the outputs of @p board are: build/, or build/<board> for one
+// board of a project.yaml board list (empty @p board picks the only one)
+bool GetBoardOutputDir(const fs::path& project_dir, const std::string& board, fs::path& output_dir) {
+    output_dir = project_dir / "build";
+    std::vector<std::string> boards;
+    if (!Lumos::ProjectConfig::ReadBoards((project_dir / "project.yaml").string(), boards) || boards.size() < 2) {
+        if (!board.empty() && (boards.empty() || boards.front() != board)) {
+            std::cerr << "Error: Board '" << board << "' is not the board in project.yaml" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (board.empty()) {
+        std::cerr << "Error: project.yaml lists several boards; pick one with --board (";
+        for (size_t i = 0; i < boards.size(); ++i) {
+            std::cerr << (i > 0 ? ", " : "") << boards[i];
+        }
+        std::cerr << ")" << std::endl;
+        return false;
+    }
+    if (std::find(boards.begin(), boards.end(), board) == boards.end()) {
+        std::cerr << "Error: Board '" << board << "' is not listed in project.yaml" << std::endl;
+        return false;
+    }
+    output_dir /= board;
+    return true;
+}
+
 /**
  * @brief Get serial port with caching support
  *
@@ -214,6 +359,7 @@ std::string GetSerialPortWithCache(const fs::path& project_dir, const std::strin
     // If port explicitly specified, use it and update cache
     if (!explicit_port.empty()) {
         Lumos::CacheConfig cache;
+        cache.Load(build_dir);
         cache.SetSerialPort(explicit_port);
         cache.Save(build_dir);
         return explicit_port;
@@ -280,6 +426,449 @@ std::string GetSerialPortWithCache(const fs::path& project_dir, const std::strin
     return selected_port;
 }
 
+// Console rate of @p port for lumos monitor: the one found last time, else
+// detected from what the firmware prints; 115200 if that fails
+int ResolveMonitorBaud(const fs::path& project_dir, const std::string& port, bool redetect) {
+    fs::path build_dir = project_dir / "build";
+    Lumos::CacheConfig cache;
+    cache.Load(build_dir);
+    Lumos::CachedLink link = cache.GetLink(port);
+    if (link.monitor_baud > 0 && !redetect) {
+        std::cout << "Using cached baud rate: " << link.monitor_baud << " (--baud auto to detect again)" << std::endl;
+        return static_cast<int>(link.monitor_baud);
+    }
+
+    std::cout << "Detecting baud rate..." << std::endl;
+    signal(SIGINT, SignalHandler);
+    Lumos::BaudDetection detection;
+    std::string error;
+    if (!Lumos::DetectConsoleBaud(port, Lumos::ConsoleBaudRates(), 300, g_running, detection, error)) {
+        std::cout << error << "; using 115200 (pass a baud rate to skip detection)" << std::endl;
+        return 115200;
+    }
+    std::cout << "Detected " << detection.baud_rate << " baud (" << static_cast<int>(detection.score * 100)
+              << "% of " << detection.bytes << " bytes readable)" << std::endl;
+    link.monitor_baud = static_cast<uint32_t>(detection.baud_rate);
+    cache.SetLink(port, link);
+    cache.Save(build_dir);
+    return detection.baud_rate;
+}
+
+// What went onto a port just now, for the lumos.cache next to the firmware
+Lumos::CachedFlash MakeFlashRecord(const SimpleSerial::MappedFile& firmware_file, uint32_t image_crc) {
+    Lumos::CachedFlash flash;
+    flash.image_crc = image_crc;
+    flash.image_size = firmware_file.Size();
+    flash.flashed_at = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    return flash;
+}
+
+// True if @p key (a port, or the SWD probe) last received this very image;
+// a delta flash would then not write a single sector
+bool FlashUnchanged(const fs::path& firmware_path, const std::string& key,
+                    const SimpleSerial::MappedFile& firmware_file, uint32_t image_crc) {
+    Lumos::CacheConfig cache;
+    cache.Load(firmware_path.parent_path());
+    const Lumos::CachedFlash* last = cache.GetFlash(key);
+    if (last == nullptr || last->image_crc != image_crc || last->image_size != firmware_file.Size()) {
+        return false;
+    }
+    std::cout << "Firmware unchanged since the last flash to " << key
+              << " (CRC32 " << std::hex << std::setw(8) << std::setfill('0') << image_crc
+              << std::dec << std::setfill(' ') << ")" << std::endl;
+    std::cout << "Nothing to do; flash without --delta to write it anyway" << std::endl;
+    return true;
+}
+
+// The sparse image of the same build holds only the populated ranges, so
+// only the sectors under them are erased and written. Empty if there is
+// none or it is older than @p firmware_path; @p segment_file backs the data.
+std::vector<SimpleSerial::FirmwareData> LoadSegments(const fs::path& firmware_path,
+                                                     SimpleSerial::MappedFile& segment_file) {
+    std::vector<SimpleSerial::FirmwareData> segments;
+    fs::path segment_path = fs::path(firmware_path).replace_extension(".segments");
+    std::error_code ec;
+    if (fs::exists(segment_path, ec) &&
+        fs::last_write_time(segment_path, ec) >= fs::last_write_time(firmware_path, ec) &&
+        segment_file.Open(segment_path.string())) {
+        std::vector<Lumos::ImageSegmentView> views;
+        std::string error;
+        if (Lumos::ReadSegmentFile(segment_file.Data(), segment_file.Size(), views, error)) {
+            size_t populated = 0;
+            for (const auto& view : views) {
+                SimpleSerial::FirmwareData segment;
+                segment.start_address = view.address;
+                segment.image = view.data;
+                segment.image_size = view.size;
+                segments.push_back(segment);
+                populated += view.size;
+            }
+            std::cout << "Sparse image: " << segments.size() << " segment(s), " << populated << " bytes" << std::endl;
+        } else {
+            std::cerr << "Warning: Ignoring " << segment_path.filename().string() << ": " << error << std::endl;
+        }
+    }
+    return segments;
+}
+
+// Keep the .settings range of the build (settings_store.h) out of every
+// erase; without a firmware.elf next to @p firmware_path nothing is kept
+void PreserveSettings(SimpleSerial::FlashTarget& target, const fs::path& firmware_path) {
+    Lumos::ElfFile elf;
+    std::string error;
+    if (!elf.Load(fs::path(firmware_path).replace_extension(".elf").string(), error)) {
+        return;
+    }
+    const Lumos::ElfSection* settings = elf.FindSection(".settings");
+    if (settings != nullptr && settings->size > 0) {
+        target.SetPreservedRange(static_cast<uint32_t>(settings->address), static_cast<uint32_t>(settings->size));
+    }
+}
+
+// Write the image (or its segments) through a connected ROM bootloader
+bool WriteRomImage(SimpleSerial::STM32Communicator& comm, const SimpleSerial::FirmwareData& firmware,
+                   std::vector<SimpleSerial::FirmwareData> segments, bool delta, bool verify, bool stream,
+                   std::string& error) {
+    comm.SetStreamedWrites(stream);
+    bool flashed;
+    if (!segments.empty()) {
+        flashed = comm.FlashSegments(segments, delta);
+    } else {
+        flashed = delta ? comm.FlashDelta(firmware) : comm.Flash(firmware, true);
+    }
+    if (!flashed) {
+        error = "Failed to flash firmware: " + comm.GetLastError();
+        return false;
+    }
+
+    // Sampled read-back: every 16th block plus the image tail
+    if (verify) {
+        std::cout << "Verifying..." << std::endl;
+        if (segments.empty()) {
+            segments.push_back(firmware);
+        }
+        for (const auto& segment : segments) {
+            if (!comm.Verify(segment, 16)) {
+                error = "Failed to verify firmware: " + comm.GetLastError();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Flash @p firmware_file over the STM32 ROM bootloader on @p port_name,
+// at @p baud_rate or (0) the fastest rate the bootloader takes
+bool FlashFirmware(const std::string& port_name, const fs::path& firmware_path,
+                   const SimpleSerial::MappedFile& firmware_file, bool delta, bool verify, bool stream,
+                   int baud_rate) {
+    std::cout << "\nFlashing firmware..." << std::endl;
+    std::cout << "  Firmware: " << firmware_path << std::endl;
+    std::cout << "  Size: " << firmware_file.Size() << " bytes" << std::endl;
+    std::cout << "  Port: " << port_name << std::endl;
+    std::cout << std::endl;
+
+    // A delta flash of the image this port last received would not write
+    // a single sector, so skip connecting to the board at all
+    uint32_t image_crc = SimpleSerial::Crc32(firmware_file.Data(), firmware_file.Size());
+    if (delta && !verify && FlashUnchanged(firmware_path, port_name, firmware_file, image_crc)) {
+        return true;
+    }
+
+    // The rate this port worked at last time goes first, then the others
+    // fastest first
+    Lumos::CacheConfig cache;
+    cache.Load(firmware_path.parent_path());
+    Lumos::CachedLink link = cache.GetLink(port_name);
+    std::vector<int> rates;
+    if (baud_rate > 0) {
+        rates.push_back(baud_rate);
+    } else {
+        if (link.rom_baud > 0) {
+            rates.push_back(static_cast<int>(link.rom_baud));
+        }
+        for (int rate : Lumos::RomBootloaderBaudRates()) {
+            if (rate != static_cast<int>(link.rom_baud)) {
+                rates.push_back(rate);
+            }
+        }
+    }
+
+    // Prepare firmware data
+    SimpleSerial::FirmwareData firmware;
+    firmware.start_address = 0x08000000;  // STM32 flash start address
+    firmware.image = firmware_file.Data();
+    firmware.image_size = firmware_file.Size();
+
+    SimpleSerial::MappedFile segment_file;
+    std::vector<SimpleSerial::FirmwareData> segments = LoadSegments(firmware_path, segment_file);
+
+    SimpleSerial::STM32Communicator comm;
+    PreserveSettings(comm, firmware_path);
+    int link_baud = 0;
+    while (true) {
+        std::cout << "Entering bootloader mode..." << std::endl;
+        std::string error;
+        link_baud = Lumos::ConnectRomBootloader(comm, port_name, rates, error);
+        if (link_baud == 0) {
+            std::cerr << "Failed to enter bootloader: " << error << std::endl;
+            return false;
+        }
+        std::cout << "Bootloader ready at " << link_baud << " baud" << std::endl;
+
+        if (WriteRomImage(comm, firmware, segments, delta, verify, stream, error)) {
+            break;
+        }
+        comm.Disconnect();
+        std::cerr << error << std::endl;
+        // A rate the sync got through at can still drop bytes under load;
+        // the next flash probes again rather than trusting it
+        if (baud_rate > 0 || link_baud <= 115200) {
+            if (baud_rate == 0 && link.rom_baud != 0) {
+                link.rom_baud = 0;
+                cache.SetLink(port_name, link);
+                cache.Save(firmware_path.parent_path());
+            }
+            return false;
+        }
+        std::cout << "Retrying at 115200 baud..." << std::endl;
+        rates = {115200};
+    }
+
+    std::cout << "\n✓ Firmware flashed successfully!" << std::endl;
+    const SimpleSerial::RoundTripStats& round_trip = comm.GetRoundTrip();
+    if (round_trip.count > 0) {
+        std::cout << "  Link: " << link_baud << " baud, " << round_trip.Describe()
+                  << (comm.IsLowLatency() ? "" : " (low-latency mode not available)") << std::endl;
+    }
+    comm.Disconnect();
+    cache.SetFlash(port_name, MakeFlashRecord(firmware_file, image_crc));
+    if (baud_rate == 0) {
+        link.rom_baud = static_cast<uint32_t>(link_baud);
+        cache.SetLink(port_name, link);
+    }
+    cache.Save(firmware_path.parent_path());
+    return true;
+}
+
+// Flash @p firmware_file over SWD with a debug probe, through OpenOCD
+bool FlashFirmwareSwd(const fs::path& firmware_path, const SimpleSerial::MappedFile& firmware_file,
+                      const Lumos::SwdOptions& options, bool delta, bool verify) {
+    std::cout << "\nFlashing firmware over SWD..." << std::endl;
+    std::cout << "  Firmware: " << firmware_path << std::endl;
+    std::cout << "  Size: " << firmware_file.Size() << " bytes" << std::endl;
+    std::cout << "  Probe: " << options.probe << (options.serial.empty() ? "" : " " + options.serial)
+              << " at " << options.speed_khz << " kHz" << std::endl;
+    std::cout << std::endl;
+
+    // The cache remembers the probe's image like a port's
+    const std::string key = options.serial.empty() ? "swd" : "swd:" + options.serial;
+    uint32_t image_crc = SimpleSerial::Crc32(firmware_file.Data(), firmware_file.Size());
+    if (delta && !verify && FlashUnchanged(firmware_path, key, firmware_file, image_crc)) {
+        return true;
+    }
+
+    SimpleSerial::MappedFile segment_file;
+    std::vector<SimpleSerial::FirmwareData> segments = LoadSegments(firmware_path, segment_file);
+    if (segments.empty()) {
+        SimpleSerial::FirmwareData firmware;
+        firmware.start_address = 0x08000000;  // STM32 flash start address
+        firmware.image = firmware_file.Data();
+        firmware.image_size = firmware_file.Size();
+        segments.push_back(firmware);
+    }
+
+    Lumos::SwdFlasher flasher(options);
+    PreserveSettings(flasher, firmware_path);
+    if (!flasher.Flash(segments, delta, verify)) {
+        std::cerr << "Failed to flash firmware: " << flasher.GetLastError() << std::endl;
+        return false;
+    }
+
+    std::cout << "\n✓ Firmware flashed successfully!" << std::endl;
+    Lumos::CacheConfig cache;
+    cache.Load(firmware_path.parent_path());
+    cache.SetFlash(key, MakeFlashRecord(firmware_file, image_crc));
+    cache.Save(firmware_path.parent_path());
+    return true;
+}
+
+// Build the project and flash it over the ROM bootloader as one pipeline.
+// While the build compiles, a second thread resets the board into the
+// bootloader; as the link starts it erases the sectors the last image
+// took, and as soon as objcopy has written the new one it writes it,
+// while the build still publishes its outputs and reports. Only sectors
+// the new image covers beyond the last one wait for their erase.
+bool BuildAndFlash(Lumos::Builder& builder, const fs::path& project_dir, const fs::path& output_dir,
+                   const std::string& port_name, bool verify, int baud_rate) {
+    const uint32_t flash_start = 0x08000000;
+
+    // The previous image is the guess at the new one's size; without
+    // one there is nothing to erase ahead
+    std::error_code ec;
+    const fs::path previous = output_dir / "firmware.bin";
+    const size_t expected_size = fs::exists(previous, ec) ? static_cast<size_t>(fs::file_size(previous, ec)) : 0;
+
+    Lumos::CacheConfig cache;
+    cache.Load(output_dir);
+    Lumos::CachedLink link = cache.GetLink(port_name);
+    std::vector<int> rates;
+    if (baud_rate > 0) {
+        rates.push_back(baud_rate);
+    } else {
+        if (link.rom_baud > 0) {
+            rates.push_back(static_cast<int>(link.rom_baud));
+        }
+        for (int rate : Lumos::RomBootloaderBaudRates()) {
+            if (rate != static_cast<int>(link.rom_baud)) {
+                rates.push_back(rate);
+            }
+        }
+    }
+
+    enum class Step { Compiling, Linking, ImageReady, Failed };
+    std::mutex mutex;
+    std::condition_variable changed;
+    Step step = Step::Compiling;
+    std::string image_path;
+    auto wait_past = [&](Step current) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return step != current; });
+        return step;
+    };
+
+    // Results of the flash thread, read after it is joined
+    bool flashed = false;
+    bool erased = false;
+    int link_baud = 0;
+    std::string error;
+    SimpleSerial::MappedFile firmware_file;
+    std::chrono::steady_clock::time_point image_time;
+    std::chrono::steady_clock::time_point flashed_time;
+
+    std::thread flasher([&] {
+        SimpleSerial::STM32Communicator comm;
+        link_baud = Lumos::ConnectRomBootloader(comm, port_name, rates, error);
+        if (link_baud == 0) {
+            error = "Failed to enter bootloader: " + error;
+            return;
+        }
+        std::cout << "[run] Bootloader ready at " << link_baud << " baud" << std::endl;
+
+        Step reached = wait_past(Step::Compiling);
+        if (reached == Step::Linking) {
+            if (expected_size > 0) {
+                std::cout << "[run] Erasing the last image's sectors while linking..." << std::endl;
+                erased = true;
+                if (!comm.EraseAhead(flash_start, expected_size)) {
+                    std::cout << "[run] " << comm.GetLastError() << std::endl;
+                }
+            }
+            reached = wait_past(Step::Linking);
+        }
+
+        if (reached != Step::ImageReady) {
+            // Nothing erased yet: start the firmware that is still there
+            if (!erased) {
+                comm.Go(flash_start);
+            }
+            comm.Disconnect();
+            return;
+        }
+
+        if (!firmware_file.Open(image_path)) {
+            error = "Failed to open firmware file: " + firmware_file.GetLastError();
+            comm.Disconnect();
+            return;
+        }
+        SimpleSerial::FirmwareData firmware;
+        firmware.start_address = flash_start;
+        firmware.image = firmware_file.Data();
+        firmware.image_size = firmware_file.Size();
+
+        // Written just before the image was reported, so it is current;
+        // without it the whole binary is one range
+        SimpleSerial::MappedFile segment_file;
+        std::vector<SimpleSerial::FirmwareData> segments = LoadSegments(image_path, segment_file);
+        if (segments.empty()) {
+            segments.push_back(firmware);
+        }
+        PreserveSettings(comm, image_path);
+        std::cout << "[run] Writing " << firmware.image_size << " bytes..." << std::endl;
+        flashed = WriteRomImage(comm, firmware, segments, false, verify, false, error);
+        flashed_time = std::chrono::steady_clock::now();
+        comm.Disconnect();
+    });
+
+    builder.SetStageCallback([&](Lumos::Builder::Stage stage, const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stage == Lumos::Builder::Stage::Linking) {
+            step = Step::Linking;
+        } else {
+            step = Step::ImageReady;
+            image_path = path;
+            image_time = std::chrono::steady_clock::now();
+        }
+        changed.notify_all();
+    });
+    const bool built = builder.Build(project_dir.string());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (step != Step::ImageReady) {
+            step = Step::Failed;
+            changed.notify_all();
+        }
+    }
+    flasher.join();
+    builder.SetStageCallback(nullptr);
+
+    std::cout << std::endl;
+    if (!built && image_path.empty()) {
+        std::cerr << "Build failed, nothing flashed" << std::endl;
+        if (erased) {
+            std::cerr << "The board is in the bootloader with its image partly erased; "
+                      << "run 'lumos flash' once the build is fixed" << std::endl;
+        }
+        return false;
+    }
+    if (image_path.empty()) {
+        std::cerr << "Error: The build made no firmware.bin to flash (Host board?)" << std::endl;
+        return false;
+    }
+    if (!flashed) {
+        std::cerr << error << std::endl;
+        if (baud_rate == 0 && link.rom_baud != 0) {
+            Lumos::CacheConfig records;
+            records.Load(output_dir);
+            link.rom_baud = 0;
+            records.SetLink(port_name, link);
+            records.Save(output_dir);
+        }
+        return false;
+    }
+
+    std::cout << "✓ Firmware flashed "
+              << std::fixed << std::setprecision(2)
+              << std::chrono::duration<double>(flashed_time - image_time).count()
+              << std::defaultfloat << " s after the image was written" << std::endl;
+    if (!built) {
+        std::cerr << "Warning: The build failed after the image was written (see above)" << std::endl;
+    }
+
+    // Reloaded: the build saved its own records meanwhile
+    Lumos::CacheConfig records;
+    records.Load(output_dir);
+    uint32_t image_crc = SimpleSerial::Crc32(firmware_file.Data(), firmware_file.Size());
+    records.SetFlash(port_name, MakeFlashRecord(firmware_file, image_crc));
+    if (baud_rate == 0) {
+        link.rom_baud = static_cast<uint32_t>(link_baud);
+        records.SetLink(port_name, link);
+    }
+    records.Save(output_dir);
+    return built;
+}
+
 void GenerateMainFile(const std::string& language, const fs::path& project_dir) {
     std::string filename = (language == "C") ? "main.c" : "main.cpp";
     fs::path main_path = project_dir / filename;
@@ -339,7 +928,11 @@ void GenerateProjectYaml(const std::string& board, const std::string& language,
     file << "# hal_modules:\n";
     file << "#   - uart\n";
     file << "#   - spi\n";
-    file << "#   - i2c\n";
+    file << "#   - i2c\n\n";
+    file << "# Optional: build profile - debug (-Og), release (-O2), size (-Os), fast (-O3)\n";
+    file << "# profile: debug\n\n";
+    file << "# Optional: link-time optimization\n";
+    file << "# lto: false\n";
 
     file.close();
 }
@@ -375,6 +968,63 @@ void GenerateReadme(const std::string& board, const std::string& language, const
     file.close();
 }
 
+// Boards src/benchmarks/wrapper_bench has a configuration for
+bool IsBenchBoard(const std::string& board) {
+    return board == "LumosBrain" || board == "LumosMicroBrain";
+}
+
+// Set up @p bench_dir as a project building the wrapper benchmarks for
+// @p board, with or without the fast libc layer (newlib's otherwise).
+// Files are only rewritten when they change, so repeated runs build
+// incrementally.
+bool PrepareBenchProject(const std::string& lumos_root, const std::string& board, bool fast_libc,
+                         const fs::path& bench_dir, std::string& error) {
+    fs::path source = fs::path(lumos_root) / "src" / "benchmarks" / "wrapper_bench" / "main.cpp";
+    std::ifstream source_file(source, std::ios::binary);
+    if (!source_file) {
+        error = "Benchmark source not found: " + source.string();
+        return false;
+    }
+    std::stringstream main_content;
+    main_content << source_file.rdbuf();
+
+    // The benchmarks use more peripherals than detection from main.cpp
+    // would give either board, so the modules are listed
+    std::stringstream yaml_content;
+    yaml_content << "# Generated by: lumos bench\n";
+    yaml_content << "sources:\n";
+    yaml_content << "  - main.cpp\n";
+    yaml_content << "board: " << board << "\n";
+    yaml_content << "hal_modules:\n";
+    for (const char* module : {"uart", "spi", "fdcan", "adc", "tim"}) {
+        yaml_content << "  - " << module << "\n";
+    }
+    yaml_content << "profile: release\n";
+    yaml_content << "fast_libc: " << (fast_libc ? "true" : "false") << "\n";
+
+    std::error_code ec;
+    fs::create_directories(bench_dir, ec);
+    const std::pair<fs::path, std::string> files[] = {
+        {bench_dir / "main.cpp", main_content.str()},
+        {bench_dir / "project.yaml", yaml_content.str()},
+    };
+    for (const auto& file : files) {
+        std::ifstream existing(file.first, std::ios::binary);
+        std::stringstream current;
+        current << existing.rdbuf();
+        if (existing && current.str() == file.second) {
+            continue;
+        }
+        existing.close();
+        std::ofstream out(file.first, std::ios::binary | std::ios::trunc);
+        if (!(out << file.second)) {
+            error = "Failed to write " + file.first.string();
+            return false;
+        }
+    }
+    return true;
+}
+
 int InitProject() {
     fs::path current_dir = fs::current_path();
     bool yaml_exists = fs::exists(current_dir / "project.yaml");
@@ -506,87 +1156,594 @@ int main(int argc, char** argv) {
         }
         std::cout << std::endl;
 
+        // Parse build options
+        unsigned int jobs = 0;  // 0 = LUMOS_JOBS or hardware thread count
+        bool no_cache = false;
+        bool timings = false;
+        bool no_daemon = false;
+        std::string profile;    // empty = profile from project.yaml
+        std::string board;      // empty = every board in project.yaml
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value;
+            if (arg == "--board" && i + 1 < argc) {
+                board = argv[++i];
+                continue;
+            }
+            if (arg == "--no-cache") {
+                no_cache = true;
+                continue;
+            }
+            if (arg == "--no-daemon") {
+                no_daemon = true;
+                continue;
+            }
+            if (arg == "--timings") {
+                timings = true;
+                continue;
+            }
+            if ((arg == "--profile" || arg == "-p") && i + 1 < argc) {
+                profile = argv[++i];
+                continue;
+            }
+            if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+                value = argv[++i];
+            } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+                value = arg.substr(2);
+            } else {
+                std::cerr << "Error: Unknown build option '" << arg << "'" << std::endl;
+                return 1;
+            }
+
+            if (!Lumos::JobPool::ParseJobCount(value, jobs)) {
+                std::cerr << "Error: Invalid job count '" << value << "'" << std::endl;
+                return 1;
+            }
+        }
+
+        // A project listing several boards builds them all at once, each
+        // into build/<board>, unless --board picks one
+        std::vector<std::string> boards;
+        if (board.empty() && Lumos::ProjectConfig::ReadBoards(yaml_path.string(), boards) && boards.size() > 1) {
+            Lumos::Builder builder(lumos_root);
+            Lumos::ProjectConfig project;
+            if (!builder.Prepare(project_dir, project)) {
+                return 1;
+            }
+            std::vector<std::string> build_args;
+            if (!profile.empty()) {
+                build_args.push_back("--profile");
+                build_args.push_back(profile);
+            }
+            if (no_cache) {
+                build_args.push_back("--no-cache");
+            }
+            if (timings) {
+                build_args.push_back("--timings");
+            }
+            Lumos::BuildMatrix matrix(GetExecutablePath(), jobs);
+            std::vector<Lumos::BoardBuildResult> results = matrix.Build(project.boards, build_args);
+            return Lumos::BuildMatrix::PrintSummary(results) ? 0 : 1;
+        }
+
+#ifndef _WIN32
+        // A running daemon builds with its resident state; it always uses
+        // the object cache, records no timings and can't ask for a main
+        // file or build one board of a matrix
+        bool has_main = fs::exists(current_dir / "main.c") || fs::exists(current_dir / "main.cpp");
+        if (!no_daemon && !no_cache && !timings && has_main && board.empty()) {
+            Lumos::DaemonRequest request;
+            request.profile = profile;
+            request.jobs = jobs;
+            int exit_code = 1;
+            if (Lumos::BuildWithDaemon(project_dir, request, exit_code)) {
+                return exit_code;
+            }
+        }
+#endif
+
         // Create builder and build
         Lumos::Builder builder(lumos_root);
+        builder.SetJobs(jobs);
+        builder.SetProfile(profile);
+        builder.SetBoard(board);
+        if (no_cache) {
+            builder.DisableObjectCache();
+        }
+        if (timings) {
+            builder.EnableTimings();
+        }
         bool success = builder.Build(project_dir);
 
         return success ? 0 : 1;
     }
 
-    if (command == "ports") {
-        std::cout << "Scanning for serial ports..." << std::endl;
-        auto ports = SimpleSerial::Serial::ListPorts();
-
-        if (ports.empty()) {
-            std::cout << "No serial ports found." << std::endl;
-        } else {
-            std::cout << "Available serial ports:" << std::endl;
-            for (const auto& port : ports) {
-                // Check port status
-                auto status = SimpleSerial::Serial::CheckPortStatus(port);
-                std::string status_str;
+    if (command == "run") {
+        // run [port] [--verify] [--baud N] [-j N] [--profile P] [--board B] [--no-cache]
+        fs::path current_dir = fs::current_path();
+        fs::path yaml_path = current_dir / "project.yaml";
+        if (!fs::exists(yaml_path)) {
+            std::cerr << "Error: project.yaml not found in current directory" << std::endl;
+            std::cerr << "Make sure you're in a Lumos project directory" << std::endl;
+            return 1;
+        }
 
-                switch (status) {
-                    case SimpleSerial::PortStatus::AVAILABLE:
-                        status_str = "\033[32m[Available]\033[0m";  // Green
-                        break;
-                    case SimpleSerial::PortStatus::IN_USE:
-                        status_str = "\033[33m[In Use]\033[0m";     // Yellow
-                        break;
-                    case SimpleSerial::PortStatus::NO_PERMISSION:
-                        status_str = "\033[31m[No Permission]\033[0m";  // Red
-                        break;
-                    case SimpleSerial::PortStatus::UNKNOWN_ERROR:
-                        status_str = "\033[90m[Unknown]\033[0m";    // Gray
-                        break;
+        std::string explicit_port;
+        std::string profile;
+        std::string board;
+        unsigned int jobs = 0;
+        int baud_rate = 0;
+        bool verify = false;
+        bool no_cache = false;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--verify") {
+                    verify = true;
+                } else if (arg == "--no-cache") {
+                    no_cache = true;
+                } else if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                    if (baud_rate <= 0) {
+                        throw std::invalid_argument(arg);
+                    }
+                } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+                    if (!Lumos::JobPool::ParseJobCount(argv[++i], jobs)) {
+                        throw std::invalid_argument(arg);
+                    }
+                } else if ((arg == "--profile" || arg == "-p") && i + 1 < argc) {
+                    profile = argv[++i];
+                } else if (arg == "--board" && i + 1 < argc) {
+                    board = argv[++i];
+                } else if (arg[0] == '-') {
+                    std::cerr << "Error: Unknown run option '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
                 }
-
-                std::cout << "  " << port << "  " << status_str << std::endl;
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << arg << std::endl;
+                return 1;
             }
         }
-        return 0;
-    }
 
-    if (command == "reset") {
-        if (argc < 3) {
-            std::cerr << "Error: Port name required for reset command" << std::endl;
-            std::cerr << "Usage: lumos reset <port>" << std::endl;
-            std::cerr << "Example: lumos reset /dev/ttyUSB0" << std::endl;
+        // One board goes to one port
+        fs::path output_dir;
+        if (!GetBoardOutputDir(current_dir, board, output_dir)) {
             return 1;
         }
 
-        std::string port_name = argv[2];
-
-        std::cout << "Resetting serial port: " << port_name << std::endl;
-
-        // Open the port with standard configuration
-        SimpleSerial::Serial serial;
-        SimpleSerial::SerialConfig config;
-        config.baud_rate = 115200;
-        config.timeout_ms = 1000;
-
-        std::cout << "Opening port..." << std::endl;
-        if (!serial.Open(port_name, config)) {
-            std::cerr << "Failed to open port: " << serial.GetLastError() << std::endl;
-            std::cerr << "Tip: Check if the port exists and you have permission to access it" << std::endl;
+        // Chosen before the build starts, as it may prompt
+        std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
+        if (port_name.empty()) {
             return 1;
         }
 
-        std::cout << "Port opened successfully" << std::endl;
+        Lumos::Builder builder(GetLumosRoot());
+        builder.SetJobs(jobs);
+        builder.SetProfile(profile);
+        builder.SetBoard(board);
+        if (no_cache) {
+            builder.DisableObjectCache();
+        }
+        return BuildAndFlash(builder, current_dir, output_dir, port_name, verify, baud_rate) ? 0 : 1;
+    }
 
-        // Reset DTR and RTS to low state
-        std::cout << "Resetting DTR and RTS lines..." << std::endl;
-        if (!serial.SetDTR(false)) {
-            std::cerr << "Warning: Failed to reset DTR: " << serial.GetLastError() << std::endl;
+    if (command == "watch") {
+        // watch [port] [--flash] [--monitor] [--baud N] [--debounce-ms N] [-j N] [--profile P]
+        fs::path current_dir = fs::current_path();
+        std::string project_dir = current_dir.string();
+        if (!fs::exists(current_dir / "project.yaml")) {
+            std::cerr << "Error: project.yaml not found in current directory" << std::endl;
+            std::cerr << "Make sure you're in a Lumos project directory" << std::endl;
+            return 1;
         }
-        if (!serial.SetRTS(false)) {
-            std::cerr << "Warning: Failed to reset RTS: " << serial.GetLastError() << std::endl;
+
+        std::string explicit_port;
+        std::string profile;
+        unsigned int jobs = 0;
+        bool flash = false;
+        bool monitor = false;
+        int baud_rate = 115200;
+        int debounce_ms = 300;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--flash") {
+                    flash = true;
+                } else if (arg == "--monitor") {
+                    flash = true;
+                    monitor = true;
+                } else if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                } else if (arg == "--debounce-ms" && i + 1 < argc) {
+                    debounce_ms = std::stoi(argv[++i]);
+                } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+                    if (!Lumos::JobPool::ParseJobCount(argv[++i], jobs)) {
+                        throw std::invalid_argument(arg);
+                    }
+                } else if ((arg == "--profile" || arg == "-p") && i + 1 < argc) {
+                    profile = argv[++i];
+                } else if (arg[0] == '-') {
+                    std::cerr << "Error: Unknown watch option '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << arg << std::endl;
+                return 1;
+            }
         }
 
-        // Flush buffers
-        std::cout << "Flushing buffers..." << std::endl;
-        if (!serial.Flush()) {
-            std::cerr << "Warning: Failed to flush buffers" << std::endl;
+        Lumos::FileWatcher watcher;
+        if (!watcher.IsSupported()) {
+            std::cerr << "Error: lumos watch needs inotify (Linux)" << std::endl;
+            return 1;
+        }
+
+        // Chosen once, so every reflash goes to the same board
+        std::string port_name;
+        if (flash) {
+            port_name = GetSerialPortWithCache(current_dir, explicit_port);
+            if (port_name.empty()) {
+                return 1;
+            }
+        }
+
+        // Like the daemon, keep the configuration and plan between builds
+        // and let the watcher report what changed
+        Lumos::Builder builder(GetLumosRoot());
+        builder.SetJobs(jobs);
+        builder.SetProfile(profile);
+        builder.EnableResidentState();
+
+        const fs::path build_dir = current_dir / "build";
+        auto ignored = [&build_dir](const fs::path& path) {
+            // Build outputs, and editor swap, backup and probe files
+            std::string relative = path.lexically_relative(build_dir).generic_string();
+            if (!relative.empty() && relative.rfind("..", 0) != 0) {
+                return true;
+            }
+            std::string name = path.filename().string();
+            return name.empty() || name[0] == '.' || name.back() == '~' || name == "4913" ||
+                   fs::path(name).extension() == ".swp" || fs::path(name).extension() == ".swx";
+        };
+
+        std::unique_ptr<SimpleSerial::STM32Communicator> console;
+        auto stop_monitor = [&console]() {
+            if (console) {
+                console->StopMonitoring();
+                console->Disconnect();
+                console.reset();
+            }
+        };
+
+        // Always watch the project itself, so a broken project.yaml is
+        // picked up again once it is fixed
+        std::set<std::string> project_directories = {current_dir.lexically_normal().string()};
+        if (fs::exists(current_dir / "include")) {
+            project_directories.insert((current_dir / "include").lexically_normal().string());
+        }
+        watcher.SetDirectories(project_directories);
+
+        signal(SIGINT, SignalHandler);
+        std::cout << "Watching " << project_dir << " (Press Ctrl+C to stop)" << std::endl;
+        std::cout << std::endl;
+
+        while (g_running) {
+            auto build_start = std::chrono::steady_clock::now();
+            bool built = builder.Build(project_dir);
+            double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+
+            std::set<std::string> directories = builder.GetWatchDirectories();
+            directories.insert(project_directories.begin(), project_directories.end());
+            bool stale = watcher.SetDirectories(directories) > 0 && builder.RevalidateResidentState();
+
+            std::cout << std::endl;
+            std::cout << (built ? "Build succeeded" : "Build failed") << " in " << std::fixed
+                      << std::setprecision(2) << build_seconds << " s" << std::defaultfloat << std::endl;
+
+            // Files the build had not been watching changed while it ran
+            if (stale) {
+                std::cout << "Inputs changed during the build, rebuilding" << std::endl << std::endl;
+                continue;
+            }
+
+            fs::path firmware_path = build_dir / "firmware.bin";
+            if (built && flash) {
+                SimpleSerial::MappedFile firmware_file;
+                if (!fs::exists(firmware_path)) {
+                    std::cerr << "Warning: No firmware.bin to flash (Host board?)" << std::endl;
+                } else if (!firmware_file.Open(firmware_path.string())) {
+                    std::cerr << "Error: Failed to open firmware file: " << firmware_file.GetLastError() << std::endl;
+                } else {
+                    FlashFirmware(port_name, firmware_path, firmware_file, true, false, false, 0);
+                }
+            }
+
+            if (monitor && g_running) {
+                console.reset(new SimpleSerial::STM32Communicator());
+                if (console->Connect(port_name, baud_rate) && console->StartMonitoring()) {
+                    std::cout << "Monitoring " << port_name << " at " << baud_rate << " baud..." << std::endl;
+                    std::cout << "-----------------------------------------------------------" << std::endl;
+                } else {
+                    std::cerr << "Failed to monitor " << port_name << ": " << console->GetLastError() << std::endl;
+                    console.reset();
+                }
+            }
+            std::cout << "Waiting for changes..." << std::endl;
+
+            // Wait for a relevant change, then until the tree is quiet for
+            // the debounce time (editors write a file in several steps)
+            bool changed = false;
+            auto quiet_since = std::chrono::steady_clock::now();
+            while (g_running) {
+                if (watcher.Wait(changed ? 20 : 100)) {
+                    for (const auto& change : watcher.ReadChanges()) {
+                        builder.NotifyChanged(change.path, change.structural);
+                        if (!ignored(change.path)) {
+                            if (!changed) {
+                                stop_monitor();
+                                std::cout << std::endl << "Changed: "
+                                          << fs::path(change.path).lexically_relative(current_dir).generic_string()
+                                          << std::endl << std::endl;
+                            }
+                            changed = true;
+                            quiet_since = std::chrono::steady_clock::now();
+                        }
+                    }
+                }
+                if (changed && std::chrono::steady_clock::now() - quiet_since >=
+                                   std::chrono::milliseconds(debounce_ms)) {
+                    break;
+                }
+            }
+        }
+
+        stop_monitor();
+        std::cout << "\nWatch stopped." << std::endl;
+        return 0;
+    }
+
+    if (command == "size") {
+        size_t top = 10;
+        bool gc = false;
+        std::string board;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--gc") {
+                gc = true;
+            } else if (arg == "--board" && i + 1 < argc) {
+                board = argv[++i];
+            } else if ((arg == "--top" || arg == "-n") && i + 1 < argc) {
+                try {
+                    int parsed = std::stoi(argv[++i]);
+                    if (parsed <= 0) {
+                        throw std::invalid_argument(arg);
+                    }
+                    top = static_cast<size_t>(parsed);
+                } catch (...) {
+                    std::cerr << "Error: Invalid count '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: Unknown size option '" << arg << "'" << std::endl;
+                return 1;
+            }
+        }
+
+        fs::path build_dir;
+        if (!GetBoardOutputDir(fs::current_path(), board, build_dir)) {
+            return 1;
+        }
+        std::string elf_file = (build_dir / "firmware.elf").string();
+        std::string map_file = (build_dir / "firmware.map").string();
+
+        if (!fs::exists(elf_file)) {
+            std::cerr << "Error: " << elf_file << " not found" << std::endl;
+            std::cerr << "Hint: Run 'lumos build' first" << std::endl;
+            return 1;
+        }
+
+        if (gc) {
+            // The plan of the last build says where each object came from
+            Lumos::CacheConfig cache;
+            cache.Load(build_dir);
+            const Lumos::CachedBuild& build = cache.GetBuild();
+            std::vector<Lumos::CompileJob> jobs;
+            if (build.profile.empty() ||
+                !Lumos::BuildPlan::ReadJobs((build_dir / build.profile / "plan.json").string(), jobs)) {
+                std::cerr << "Warning: No build plan found; objects are not grouped by module" << std::endl;
+            }
+
+            Lumos::GcReport report;
+            std::string error;
+            if (!report.Load(elf_file, map_file, jobs, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            std::cout << "Sections per module (bytes):" << std::endl;
+            report.PrintModules();
+            std::cout << std::endl;
+            std::cout << "Largest functions kept:" << std::endl;
+            report.PrintFunctions(top);
+            std::cout << std::endl;
+            std::cout << "Wrappers:" << std::endl;
+            report.PrintWrappers(build.hal_modules);
+            return 0;
+        }
+
+        Lumos::SizeReport report;
+        std::string error;
+        if (!report.Load(elf_file, map_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        Lumos::SizeReport previous;
+        const Lumos::SizeReport* baseline = previous.LoadPrevious(build_dir.string(), report) ? &previous : nullptr;
+        report.Record(build_dir.string());
+
+        std::cout << "Memory regions:" << std::endl;
+        report.PrintRegions(baseline);
+        std::cout << std::endl;
+        std::cout << "Largest objects (bytes per region):" << std::endl;
+        report.PrintObjects(baseline, top);
+        std::cout << std::endl;
+        std::cout << "Largest symbols:" << std::endl;
+        report.PrintSymbols(baseline, top);
+        if (report.HasLibraryCode()) {
+            std::cout << std::endl;
+            std::cout << "Formatting code from the C library:" << std::endl;
+            report.PrintLibraryCode();
+        }
+        if (baseline != nullptr) {
+            std::cout << std::endl;
+            std::cout << "Changes since the previous build:" << std::endl;
+            report.PrintChanges(previous, top);
+        }
+        return 0;
+    }
+
+    if (command == "ports") {
+        bool watch = false;
+        bool status = false;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--watch" || arg == "-w") {
+                watch = true;
+            } else if (arg == "--status") {
+                status = true;
+            } else {
+                std::cerr << "Error: Unknown ports option '" << arg << "'" << std::endl;
+                return 1;
+            }
+        }
+
+        auto describe = [](const SimpleSerial::PortInfo& port) {
+            std::string text = port.name;
+            if (port.IsUsb()) {
+                char ids[16];
+                snprintf(ids, sizeof(ids), "%04x:%04x", port.vid, port.pid);
+                text += std::string("  ") + ids;
+                if (!port.serial_number.empty()) {
+                    text += "  SN " + port.serial_number;
+                }
+            }
+            if (!port.description.empty()) {
+                text += "  " + port.description;
+            }
+            return text;
+        };
+
+        auto ports = SimpleSerial::Serial::ListPortDetails();
+
+        if (ports.empty()) {
+            std::cout << "No serial ports found." << std::endl;
+        } else {
+            // Checked together; where the OS can't tell without opening
+            // a port (not Linux) that can reset boards that wire DTR to
+            // their reset line, so it is opt-in
+            std::vector<SimpleSerial::PortStatus> statuses;
+            if (status) {
+                std::vector<std::string> names;
+                for (const auto& port : ports) {
+                    names.push_back(port.name);
+                }
+                statuses = SimpleSerial::Serial::CheckPortStatuses(names);
+            }
+
+            std::cout << "Available serial ports:" << std::endl;
+            for (size_t i = 0; i < ports.size(); ++i) {
+                const auto& port = ports[i];
+                std::string status_str;
+                if (status) {
+                    switch (statuses[i]) {
+                        case SimpleSerial::PortStatus::AVAILABLE:
+                            status_str = "  \033[32m[Available]\033[0m";  // Green
+                            break;
+                        case SimpleSerial::PortStatus::IN_USE:
+                            status_str = "  \033[33m[In Use]\033[0m";     // Yellow
+                            break;
+                        case SimpleSerial::PortStatus::NO_PERMISSION:
+                            status_str = "  \033[31m[No Permission]\033[0m";  // Red
+                            break;
+                        case SimpleSerial::PortStatus::UNKNOWN_ERROR:
+                            status_str = "  \033[90m[Unknown]\033[0m";    // Gray
+                            break;
+                    }
+                }
+
+                std::cout << "  " << describe(port) << status_str << std::endl;
+            }
+        }
+
+        if (!watch) {
+            return 0;
+        }
+
+        // Print ports as they come and go until Ctrl+C
+        std::mutex output_mutex;
+        SimpleSerial::PortWatcher watcher;
+        watcher.Start([&](SimpleSerial::PortEvent event, const SimpleSerial::PortInfo& port) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            if (event == SimpleSerial::PortEvent::ADDED) {
+                std::cout << "\033[32m+\033[0m " << describe(port) << std::endl;
+            } else {
+                std::cout << "\033[31m-\033[0m " << describe(port) << std::endl;
+            }
+        });
+        std::cout << "Watching for ports to be plugged in or removed (Press Ctrl+C to exit)..."
+                  << std::endl;
+
+        signal(SIGINT, SignalHandler);
+        while (g_running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        watcher.Stop();
+        return 0;
+    }
+
+    if (command == "reset") {
+        if (argc < 3) {
+            std::cerr << "Error: Port name required for reset command" << std::endl;
+            std::cerr << "Usage: lumos reset <port>" << std::endl;
+            std::cerr << "Example: lumos reset /dev/ttyUSB0" << std::endl;
+            return 1;
+        }
+
+        std::string port_name = argv[2];
+
+        std::cout << "Resetting serial port: " << port_name << std::endl;
+
+        // Open the port with standard configuration
+        SimpleSerial::Serial serial;
+        SimpleSerial::SerialConfig config;
+        config.baud_rate = 115200;
+        config.timeout_ms = 1000;
+
+        std::cout << "Opening port..." << std::endl;
+        if (!serial.Open(port_name, config)) {
+            std::cerr << "Failed to open port: " << serial.GetLastError() << std::endl;
+            std::cerr << "Tip: Check if the port exists and you have permission to access it" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Port opened successfully" << std::endl;
+
+        // Reset DTR and RTS to low state
+        std::cout << "Resetting DTR and RTS lines..." << std::endl;
+        if (!serial.SetDTR(false)) {
+            std::cerr << "Warning: Failed to reset DTR: " << serial.GetLastError() << std::endl;
+        }
+        if (!serial.SetRTS(false)) {
+            std::cerr << "Warning: Failed to reset RTS: " << serial.GetLastError() << std::endl;
+        }
+
+        // Flush buffers
+        std::cout << "Flushing buffers..." << std::endl;
+        if (!serial.Flush()) {
+            std::cerr << "Warning: Failed to flush buffers" << std::endl;
         }
 
         // Small delay to let things settle
@@ -606,95 +1763,414 @@ int main(int argc, char** argv) {
         // Get current directory as project directory
         fs::path current_dir = fs::current_path();
 
-        // Check if firmware.bin exists FIRST before port selection
-        fs::path firmware_path = current_dir / "build" / "firmware.bin";
+        // Get port (from command line, cache, or prompt)
+        std::string explicit_port;
+        std::string board;
+        bool delta = false;
+        bool verify = false;
+        bool stream = false;
+        int baud_rate = 0;
+        bool all_ports = false;
+        std::vector<std::string> ports;
+        unsigned int jobs = 0;
+        bool swd = false;
+        Lumos::SwdOptions swd_options;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--delta") {
+                delta = true;
+            } else if (arg == "--board" && i + 1 < argc) {
+                board = argv[++i];
+            } else if (arg == "--swd") {
+                swd = true;
+            } else if (arg == "--probe" && i + 1 < argc) {
+                swd_options.probe = argv[++i];
+                if (swd_options.probe != "stlink" && swd_options.probe != "cmsis-dap") {
+                    std::cerr << "Error: Unknown probe '" << swd_options.probe
+                              << "' (supported: stlink, cmsis-dap)" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--probe-serial" && i + 1 < argc) {
+                swd_options.serial = argv[++i];
+            } else if (arg == "--swd-speed" && i + 1 < argc) {
+                try {
+                    int parsed = std::stoi(argv[++i]);
+                    if (parsed <= 0) {
+                        throw std::invalid_argument(arg);
+                    }
+                    swd_options.speed_khz = static_cast<unsigned int>(parsed);
+                } catch (...) {
+                    std::cerr << "Error: Invalid SWD speed '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--verify") {
+                verify = true;
+            } else if (arg == "--stream") {
+                stream = true;
+            } else if (arg == "--baud" && i + 1 < argc) {
+                try {
+                    baud_rate = std::stoi(argv[++i]);
+                    if (baud_rate <= 0) {
+                        throw std::invalid_argument(arg);
+                    }
+                } catch (...) {
+                    std::cerr << "Error: Invalid baud rate '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--all") {
+                all_ports = true;
+            } else if (arg == "--ports" && i + 1 < argc) {
+                std::string list = argv[++i];
+                size_t start = 0;
+                while (start <= list.size()) {
+                    size_t comma = list.find(',', start);
+                    if (comma == std::string::npos) {
+                        comma = list.size();
+                    }
+                    if (comma > start) {
+                        ports.push_back(list.substr(start, comma - start));
+                    }
+                    start = comma + 1;
+                }
+            } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+                if (!Lumos::JobPool::ParseJobCount(argv[++i], jobs)) {
+                    std::cerr << "Error: Invalid job count '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg[0] == '-') {
+                std::cerr << "Error: Unknown flash option '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                explicit_port = arg;
+            }
+        }
+
+        // Check if firmware.bin exists before port selection
+        fs::path output_dir;
+        if (!GetBoardOutputDir(current_dir, board, output_dir)) {
+            return 1;
+        }
+        fs::path firmware_path = output_dir / "firmware.bin";
         if (!fs::exists(firmware_path)) {
-            std::cerr << "Error: firmware.bin not found in build directory" << std::endl;
+            std::cerr << "Error: firmware.bin not found in " << output_dir.string() << std::endl;
             std::cerr << "Run 'lumos build' first to compile the firmware" << std::endl;
             return 1;
         }
 
-        // Read firmware file early to check if it's valid
-        std::ifstream file(firmware_path, std::ios::binary | std::ios::ate);
-        if (!file.is_open()) {
-            std::cerr << "Error: Failed to open firmware file" << std::endl;
+        // Map the firmware file early to check if it's valid; every device
+        // is flashed straight from the mapping without copying the image
+        SimpleSerial::MappedFile firmware_file;
+        if (!firmware_file.Open(firmware_path.string())) {
+            std::cerr << "Error: Failed to open firmware file: " << firmware_file.GetLastError() << std::endl;
             return 1;
         }
 
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
+        // Bench programming through a debug probe; the board picks the
+        // OpenOCD target and its flash driver
+        if (swd) {
+            fs::path yaml_path = current_dir / "project.yaml";
+            Lumos::ProjectConfig project;
+            if (!fs::exists(yaml_path) || !project.Load(yaml_path.string(), current_dir.string())) {
+                std::cerr << "Error: --swd needs the board from project.yaml" << std::endl;
+                return 1;
+            }
+            const std::string board_name = board.empty() ? project.board : board;
+            Lumos::BoardConfig board_config = Lumos::BoardConfig::GetConfig(board_name);
+            swd_options.platform = board_config.platform;
+            swd_options.work_dir = (output_dir / "swd").string();
+            if (Lumos::SwdFlasher::GetTargetConfig(board_config.platform).empty()) {
+                std::cerr << "Error: Board " << board_name << " can't be flashed over SWD" << std::endl;
+                return 1;
+            }
+            return FlashFirmwareSwd(firmware_path, firmware_file, swd_options, delta, verify) ? 0 : 1;
+        }
+
+        // Production flashing: many devices through the Lumos bootloader
+        if (all_ports || !ports.empty()) {
+            if (all_ports) {
+                ports = Lumos::MultiFlasher::DetectPorts();
+            }
+            if (ports.empty()) {
+                std::cerr << "Error: No serial ports found" << std::endl;
+                return 1;
+            }
 
-        std::vector<uint8_t> firmware_data(size);
-        if (!file.read(reinterpret_cast<char*>(firmware_data.data()), size)) {
-            std::cerr << "Error: Failed to read firmware file" << std::endl;
-            return 1;
+            std::cout << "\nFlashing " << ports.size() << " device(s)..." << std::endl;
+            std::cout << "  Firmware: " << firmware_path << std::endl;
+            std::cout << "  Size: " << firmware_file.Size() << " bytes" << std::endl;
+            std::cout << std::endl;
+
+            Lumos::MultiFlasher flasher(jobs);
+            auto results = flasher.Flash(ports, firmware_file.Data(), firmware_file.Size());
+            // Each device's granted link settings are kept with its image
+            uint32_t image_crc = SimpleSerial::Crc32(firmware_file.Data(), firmware_file.Size());
+            Lumos::CacheConfig cache;
+            cache.Load(firmware_path.parent_path());
+            for (const auto& result : results) {
+                if (result.success) {
+                    Lumos::CachedFlash flash = MakeFlashRecord(firmware_file, image_crc);
+                    flash.baud_rate = result.baud_rate;
+                    flash.window = result.window;
+                    flash.chunk_size = result.chunk_size;
+                    cache.SetFlash(result.port, flash);
+                }
+            }
+            cache.Save(firmware_path.parent_path());
+            return Lumos::MultiFlasher::PrintSummary(results) ? 0 : 1;
         }
-        file.close();
 
-        // Get port (from command line, cache, or prompt)
-        std::string explicit_port = (argc >= 3) ? argv[2] : "";
         std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
 
         if (port_name.empty()) {
             return 1;
         }
 
-        std::cout << "\nFlashing firmware..." << std::endl;
-        std::cout << "  Firmware: " << firmware_path << std::endl;
-        std::cout << "  Size: " << firmware_data.size() << " bytes" << std::endl;
-        std::cout << "  Port: " << port_name << std::endl;
-        std::cout << std::endl;
+        return FlashFirmware(port_name, firmware_path, firmware_file, delta, verify, stream, baud_rate) ? 0 : 1;
+    }
 
-        // Connect and flash
-        SimpleSerial::STM32Communicator comm;
-        if (!comm.Connect(port_name, 115200)) {
-            std::cerr << "Failed to connect: " << comm.GetLastError() << std::endl;
-            return 1;
+    if (command == "monitor") {
+        // Get current directory as project directory
+        fs::path current_dir = fs::current_path();
+
+        // Get port (from command line, cache, or prompt)
+        // monitor [port] [baud] [--ports a,b,c] [--baud N] [--log file] [--capture file] [--elf file] [--rtt] [--usb]
+        std::string explicit_port;
+        std::vector<std::string> ports;
+        std::string log_file;
+        std::string capture_file;
+        std::string elf_file;
+        int baud_rate = 0;          // 0 = cached or detected
+        bool redetect = false;
+        bool have_port = false;
+        bool rtt = false;
+        bool usb = false;
+        std::string usb_serial;
+        Lumos::SwdOptions probe;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--rtt") {
+                    rtt = true;
+                } else if (arg == "--usb") {
+                    usb = true;
+                } else if (arg == "--usb-serial" && i + 1 < argc) {
+                    usb_serial = argv[++i];
+                    usb = true;
+                } else if (arg == "--probe" && i + 1 < argc) {
+                    probe.probe = argv[++i];
+                    if (probe.probe != "stlink" && probe.probe != "cmsis-dap") {
+                        std::cerr << "Error: Unknown probe '" << probe.probe
+                                  << "' (supported: stlink, cmsis-dap)" << std::endl;
+                        return 1;
+                    }
+                } else if (arg == "--probe-serial" && i + 1 < argc) {
+                    probe.serial = argv[++i];
+                } else if (arg == "--ports" && i + 1 < argc) {
+                    std::string list = argv[++i];
+                    size_t start = 0;
+                    while (start <= list.size()) {
+                        size_t comma = list.find(',', start);
+                        if (comma == std::string::npos) {
+                            comma = list.size();
+                        }
+                        if (comma > start) {
+                            ports.push_back(list.substr(start, comma - start));
+                        }
+                        start = comma + 1;
+                    }
+                } else if (arg == "--baud" && i + 1 < argc) {
+                    const std::string value = argv[++i];
+                    redetect = value == "auto";
+                    baud_rate = redetect ? 0 : std::stoi(value);
+                } else if (arg == "--log" && i + 1 < argc) {
+                    log_file = argv[++i];
+                } else if (arg == "--capture" && i + 1 < argc) {
+                    capture_file = argv[++i];
+                } else if (arg == "--elf" && i + 1 < argc) {
+                    elf_file = argv[++i];
+                } else if (arg[0] == '-') {
+                    std::cerr << "Error: Unknown monitor option '" << arg << "'" << std::endl;
+                    return 1;
+                } else if (!have_port) {
+                    explicit_port = arg;
+                    have_port = true;
+                } else {
+                    redetect = arg == "auto";
+                    baud_rate = redetect ? 0 : std::stoi(arg);
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid baud rate '" << argv[i] << "'" << std::endl;
+                return 1;
+            }
         }
 
-        std::cout << "Entering bootloader mode..." << std::endl;
-        if (!comm.EnterBootloader(true)) {
-            std::cerr << "Failed to enter bootloader: " << comm.GetLastError() << std::endl;
-            comm.Disconnect();
-            return 1;
+        // Tokenized logs (framework/token_log.h) are decoded with the
+        // formats of the project's firmware.elf when it has any
+        Lumos::TokenLogDecoder decoder;
+        bool decode = false;
+        if (capture_file.empty()) {
+            const bool explicit_elf = !elf_file.empty();
+            if (!explicit_elf) {
+                elf_file = (current_dir / "build" / "firmware.elf").string();
+            }
+            std::string error;
+            if ((explicit_elf || fs::exists(elf_file)) && !decoder.Load(elf_file, error)) {
+                if (explicit_elf) {
+                    std::cerr << "Error: " << error << std::endl;
+                    return 1;
+                }
+            } else if (decoder.GetFormatCount() > 0) {
+                decode = true;
+                std::cout << "Decoding tokenized logs with " << elf_file << " ("
+                          << decoder.GetFormatCount() << " formats)" << std::endl;
+            }
         }
 
-        std::cout << "Bootloader ready!" << std::endl;
+#ifndef _WIN32
+        // RTT: the debug probe reads the firmware's log ring in RAM
+        if (rtt) {
+            if (!ports.empty() || !capture_file.empty() || !log_file.empty()) {
+                std::cerr << "Error: --rtt can't be combined with --ports, --capture or --log" << std::endl;
+                return 1;
+            }
+            fs::path yaml_path = current_dir / "project.yaml";
+            Lumos::ProjectConfig project;
+            if (!fs::exists(yaml_path) || !project.Load(yaml_path.string(), current_dir.string())) {
+                std::cerr << "Error: --rtt needs the board from project.yaml" << std::endl;
+                return 1;
+            }
+            Lumos::RttOptions options;
+            options.probe = probe;
+            options.probe.platform = Lumos::BoardConfig::GetConfig(project.board).platform;
+            options.log_path = (current_dir / "build" / "rtt_openocd.log").string();
+            if (Lumos::SwdFlasher::GetTargetConfig(options.probe.platform).empty()) {
+                std::cerr << "Error: Board " << project.board << " has no SWD target" << std::endl;
+                return 1;
+            }
+            std::string error;
+            const std::string elf_path = elf_file.empty() ? (current_dir / "build" / "firmware.elf").string() : elf_file;
+            if (!Lumos::RttMonitor::FindControlBlock(elf_path, options.control_block, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
 
-        // Prepare firmware data
-        SimpleSerial::FirmwareData firmware;
-        firmware.start_address = 0x08000000;  // STM32 flash start address
-        firmware.data = firmware_data;
+            Lumos::RttMonitor monitor(options);
+            if (decode) {
+                monitor.SetTokenLogDecoder(&decoder);
+            }
+            std::cout << "Attaching to RTT through " << probe.probe << "..." << std::endl;
+            if (!monitor.Start(error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            std::cout << "Connected! Monitoring RTT output (Press Ctrl+C to exit)..." << std::endl;
+            std::cout << "-----------------------------------------------------------" << std::endl;
+
+            signal(SIGINT, SignalHandler);
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t received = monitor.Run(g_running);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "\nMonitoring stopped: " << received << " bytes in " << std::fixed
+                      << std::setprecision(1) << seconds << " s" << std::endl;
+            return 0;
+        }
+#endif
 
-        // Flash the firmware
-        if (!comm.Flash(firmware, true)) {
-            std::cerr << "Failed to flash firmware: " << comm.GetLastError() << std::endl;
-            comm.Disconnect();
-            return 1;
+        // Vendor bulk interface: libusb instead of a tty, for full-rate streams
+        if (usb) {
+            if (rtt || !ports.empty() || !log_file.empty()) {
+                std::cerr << "Error: --usb can't be combined with --rtt, --ports or --log" << std::endl;
+                return 1;
+            }
+            Lumos::UsbMonitor monitor;
+            std::string error;
+            if (!monitor.Open(usb_serial, error)) {
+                std::cerr << "Failed to connect: " << error << std::endl;
+                return 1;
+            }
+            if (!capture_file.empty() && !monitor.SetCaptureFile(capture_file, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            if (decode) {
+                monitor.SetTokenLogDecoder(&decoder);
+            }
+            if (capture_file.empty()) {
+                std::cout << "Connected! Monitoring USB bulk stream (Press Ctrl+C to exit)..." << std::endl;
+            } else {
+                std::cout << "Capturing USB bulk stream to " << capture_file << " (Press Ctrl+C to stop)..." << std::endl;
+            }
+            std::cout << "-----------------------------------------------------------" << std::endl;
+
+            signal(SIGINT, SignalHandler);
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t received = monitor.Run(g_running);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "\nMonitoring stopped: " << received << " bytes in " << std::fixed << std::setprecision(1)
+                      << seconds << " s (" << (seconds > 0 ? received / seconds / 1024.0 : 0.0) << " KB/s)"
+                      << std::endl;
+            return 0;
         }
 
-        std::cout << "\n✓ Firmware flashed successfully!" << std::endl;
-        comm.Disconnect();
+        // A capture or decoded logs of a single port also run through the multi-port loop
+        if ((!capture_file.empty() || decode) && ports.empty()) {
+            std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
+            if (port_name.empty()) {
+                return 1;
+            }
+            ports.push_back(port_name);
+            if (baud_rate == 0) {
+                baud_rate = ResolveMonitorBaud(current_dir, port_name, redetect);
+            }
+        }
 
-        return 0;
-    }
+        // Several boards at once: one event loop, lines prefixed per port.
+        // They share one rate, so it is not detected
+        if (!ports.empty()) {
+            if (baud_rate == 0) {
+                baud_rate = 115200;
+            }
+            Lumos::MultiMonitor monitor(baud_rate);
+            std::string error;
+            if (!monitor.Open(ports, error)) {
+                std::cerr << "Failed to connect: " << error << std::endl;
+                return 1;
+            }
+            if (!log_file.empty() && !monitor.SetLogFile(log_file, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            if (!capture_file.empty() && !monitor.SetCaptureFile(capture_file, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            if (decode) {
+                monitor.SetTokenLogDecoder(&decoder);
+            }
 
-    if (command == "monitor") {
-        // Get current directory as project directory
-        fs::path current_dir = fs::current_path();
+            if (capture_file.empty()) {
+                std::cout << "Monitoring " << ports.size() << " ports at " << baud_rate
+                          << " baud (Press Ctrl+C to exit)..." << std::endl;
+            } else {
+                std::cout << "Capturing " << ports.size() << (ports.size() == 1 ? " port" : " ports")
+                          << " at " << baud_rate << " baud to " << capture_file
+                          << " (Press Ctrl+C to stop)..." << std::endl;
+            }
+            std::cout << "-----------------------------------------------------------" << std::endl;
+
+            signal(SIGINT, SignalHandler);
+            monitor.Run(g_running);
+            std::cout << "\nMonitoring stopped." << std::endl;
+            return 0;
+        }
 
-        // Get port (from command line, cache, or prompt)
-        std::string explicit_port = (argc >= 3) ? argv[2] : "";
         std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
 
         if (port_name.empty()) {
             return 1;
         }
-
-        // Get baud rate (default: 115200)
-        int baud_rate = 115200;
-        if (argc >= 4) {
-            baud_rate = std::stoi(argv[3]);
+        if (baud_rate == 0) {
+            baud_rate = ResolveMonitorBaud(current_dir, port_name, redetect);
         }
 
         std::cout << "Opening port: " << port_name << " at " << baud_rate << " baud" << std::endl;
@@ -705,6 +2181,25 @@ int main(int argc, char** argv) {
             return 1;
         }
 
+        // Terminal and log file each read the stream at their own pace, so
+        // a slow disk neither holds up the terminal nor drops port bytes
+        std::ofstream log;
+        int log_subscriber = 0;
+        if (!log_file.empty()) {
+            log.open(log_file, std::ios::out | std::ios::app | std::ios::binary);
+            if (!log.is_open()) {
+                std::cerr << "Error: cannot open " << log_file << std::endl;
+                return 1;
+            }
+            log_subscriber = comm.Subscribe([&log](const uint8_t* data, size_t length) {
+                log.write(reinterpret_cast<const char*>(data), length);
+            });
+        }
+        const int terminal_subscriber = comm.Subscribe([](const uint8_t* data, size_t length) {
+            std::cout.write(reinterpret_cast<const char*>(data), length);
+            std::cout.flush();
+        });
+
         std::cout << "Connected! Monitoring serial data (Press Ctrl+C to exit)..." << std::endl;
         std::cout << "-----------------------------------------------------------" << std::endl;
 
@@ -714,6 +2209,7 @@ int main(int argc, char** argv) {
         // Start monitoring
         if (!comm.StartMonitoring()) {
             std::cerr << "Failed to start monitoring: " << comm.GetLastError() << std::endl;
+            comm.Unsubscribe(log_subscriber);
             return 1;
         }
 
@@ -724,8 +2220,850 @@ int main(int argc, char** argv) {
 
         comm.StopMonitoring();
         comm.Disconnect();
+        const uint64_t terminal_dropped = comm.GetDroppedBytes(terminal_subscriber);
+        const uint64_t log_dropped = log_subscriber ? comm.GetDroppedBytes(log_subscriber) : 0;
+        comm.Unsubscribe(terminal_subscriber);
+        if (log_subscriber) {
+            comm.Unsubscribe(log_subscriber);
+        }
         std::cout << "\nMonitoring stopped." << std::endl;
+        if (terminal_dropped > 0 || log_dropped > 0) {
+            std::cerr << "Warning: fell behind the port and skipped " << terminal_dropped
+                      << " bytes on the terminal, " << log_dropped << " in the log" << std::endl;
+        }
+
+        return 0;
+    }
+
+    if (command == "profile") {
+        // profile [port] [--baud N] [--elf file] [--duration S] [--top N] [--folded file]
+        std::string explicit_port;
+        std::string elf_file = (fs::current_path() / "build" / "firmware.elf").string();
+        std::string folded_file;
+        int baud_rate = 115200;
+        double duration_s = 0;
+        size_t top = 25;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                } else if (arg == "--elf" && i + 1 < argc) {
+                    elf_file = argv[++i];
+                } else if (arg == "--duration" && i + 1 < argc) {
+                    duration_s = std::stod(argv[++i]);
+                } else if (arg == "--top" && i + 1 < argc) {
+                    top = static_cast<size_t>(std::stoul(argv[++i]));
+                } else if (arg == "--folded" && i + 1 < argc) {
+                    folded_file = argv[++i];
+                } else if (arg[0] == '-' || !explicit_port.empty()) {
+                    std::cerr << "Error: Unexpected profile argument '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << argv[i - 1] << std::endl;
+                return 1;
+            }
+        }
+
+        // Symbols first: without them the samples can't be attributed
+        Lumos::ProfileReport report;
+        std::string error;
+        if (!report.LoadSymbols(elf_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        std::string port_name = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "Profiling " << port_name << " with " << elf_file
+                  << " (Press Ctrl+C to stop)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        if (!Lumos::RunProfile(port_name, baud_rate, duration_s, g_running, report, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        std::cout << std::endl;
+        report.Print(std::cout, top);
+        if (!folded_file.empty()) {
+            if (!report.WriteFolded(folded_file, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            std::cout << std::endl << "Collapsed stacks written to " << folded_file
+                      << " (flamegraph.pl or speedscope)" << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "trace") {
+        // trace [port] [--baud N] [--elf file] [--duration S] [-o file]
+        std::string explicit_port;
+        std::string elf_file = (fs::current_path() / "build" / "firmware.elf").string();
+        std::string output_file = (fs::current_path() / "build" / "firmware_trace.json").string();
+        int baud_rate = 115200;
+        double duration_s = 0;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                } else if (arg == "--elf" && i + 1 < argc) {
+                    elf_file = argv[++i];
+                } else if (arg == "--duration" && i + 1 < argc) {
+                    duration_s = std::stod(argv[++i]);
+                } else if (arg == "-o" && i + 1 < argc) {
+                    output_file = argv[++i];
+                } else if (arg[0] == '-' || !explicit_port.empty()) {
+                    std::cerr << "Error: Unexpected trace argument '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << argv[i - 1] << std::endl;
+                return 1;
+            }
+        }
+
+        Lumos::TargetTrace trace;
+        std::string error;
+        if (!trace.LoadNames(elf_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        std::string port_name = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "Tracing " << port_name << " (Press Ctrl+C to stop)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        if (!Lumos::RunTargetTrace(port_name, baud_rate, duration_s, g_running, trace, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        if (trace.GetDroppedCount() > 0) {
+            std::cout << trace.GetDroppedCount() << " events dropped on the target (ring full)" << std::endl;
+        }
+        if (!trace.WriteChromeTrace(output_file)) {
+            std::cerr << "Error: Cannot write " << output_file << std::endl;
+            return 1;
+        }
+        std::cout << "Trace written to " << output_file
+                  << " (open in https://ui.perfetto.dev or chrome://tracing)" << std::endl;
+        return 0;
+    }
+
+    if (command == "decode") {
+        std::string capture_file;
+        bool hex = false;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--hex") {
+                hex = true;
+            } else if (arg[0] == '-' || !capture_file.empty()) {
+                std::cerr << "Error: Unexpected decode argument '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                capture_file = arg;
+            }
+        }
+        if (capture_file.empty()) {
+            std::cerr << "Usage: lumos decode <file> [--hex]" << std::endl;
+            return 1;
+        }
+
+        std::string error;
+        if (!Lumos::DecodeCapture(capture_file, hex, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "unpack") {
+        std::string input_file;
+        std::string output_file;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-o" && i + 1 < argc) {
+                output_file = argv[++i];
+            } else if (arg[0] == '-' || !input_file.empty()) {
+                std::cerr << "Error: Unexpected unpack argument '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                input_file = arg;
+            }
+        }
+        if (input_file.empty()) {
+            std::cerr << "Usage: lumos unpack <file> [-o file]" << std::endl;
+            return 1;
+        }
+        if (output_file.empty()) {
+            output_file = fs::path(input_file).replace_extension(".raw").string();
+        }
+        std::error_code ec;
+        if (fs::equivalent(input_file, output_file, ec)) {
+            std::cerr << "Error: Output would overwrite " << input_file << std::endl;
+            return 1;
+        }
+
+        Lumos::StreamDecompressorStats stats;
+        std::string error;
+        if (!Lumos::UnpackStreamFile(input_file, output_file, stats, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Unpacked " << stats.frames << " frames, " << stats.packed_bytes << " -> "
+                  << stats.raw_bytes << " bytes";
+        if (stats.packed_bytes > 0) {
+            std::cout << " (" << std::fixed << std::setprecision(2)
+                      << static_cast<double>(stats.raw_bytes) / stats.packed_bytes << "x)";
+        }
+        std::cout << " to " << output_file << std::endl;
+        if (stats.missing > 0) {
+            std::cout << "Warning: " << stats.missing << " frames missing (dropped on the device or link)" << std::endl;
+        }
+        if (stats.corrupt > 0) {
+            std::cout << "Warning: " << stats.corrupt << " corrupt regions skipped" << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "can") {
+        // can [port] [options]  or  can replay <file> [port] [options]
+        bool replay = argc > 2 && std::string(argv[2]) == "replay";
+        std::string replay_file;
+        std::string explicit_port;
+        Lumos::CanSnifferOptions options;
+        for (int i = replay ? 3 : 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--baud" && i + 1 < argc) {
+                try {
+                    options.baud_rate = std::stoi(argv[++i]);
+                } catch (...) {
+                    std::cerr << "Error: Invalid baud rate '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--id" && i + 1 < argc) {
+                Lumos::CanIdFilter filter;
+                if (!Lumos::CanIdFilter::Parse(argv[++i], filter)) {
+                    std::cerr << "Error: Invalid CAN ID filter '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+                options.filters.push_back(filter);
+            } else if (!replay && arg == "--record" && i + 1 < argc) {
+                options.record_file = argv[++i];
+            } else if (!replay && arg == "--quiet") {
+                options.quiet = true;
+            } else if (arg[0] == '-') {
+                std::cerr << "Error: Unknown can option '" << arg << "'" << std::endl;
+                return 1;
+            } else if (replay && replay_file.empty()) {
+                replay_file = arg;
+            } else if (explicit_port.empty()) {
+                explicit_port = arg;
+            } else {
+                std::cerr << "Error: Unexpected can argument '" << arg << "'" << std::endl;
+                return 1;
+            }
+        }
+        if (replay && replay_file.empty()) {
+            std::cerr << "Usage: lumos can replay <file> [port] [--baud N] [--id ID[/MASK]]" << std::endl;
+            return 1;
+        }
+
+        options.port = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (options.port.empty()) {
+            return 1;
+        }
+
+        signal(SIGINT, SignalHandler);
+        std::string error;
+        bool ok;
+        if (replay) {
+            std::cout << "Replaying " << replay_file << " on " << options.port
+                      << " (Press Ctrl+C to stop)..." << std::endl;
+            ok = Lumos::RunCanReplay(replay_file, options.port, options.baud_rate, options.filters,
+                                     g_running, error);
+        } else {
+            std::cout << "Listening to CAN through " << options.port << " at " << options.baud_rate
+                      << " baud (Press Ctrl+C to exit)..." << std::endl;
+            ok = Lumos::RunCanSniffer(options, g_running, error);
+        }
+        if (!ok) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "can-update") {
+        // can-update [port] --nodes LIST [options]
+        std::string explicit_port;
+        fs::path firmware_path = fs::current_path() / "build" / "firmware.bin";
+        Lumos::CanUpdateOptions options;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--nodes" && i + 1 < argc) {
+                    if (!Lumos::CanUpdate::ParseNodes(argv[++i], options.nodes)) {
+                        std::cerr << "Error: Invalid node list '" << argv[i] << "' (addresses 0-63)" << std::endl;
+                        return 1;
+                    }
+                } else if (arg == "--firmware" && i + 1 < argc) {
+                    firmware_path = argv[++i];
+                } else if (arg == "--rate" && i + 1 < argc) {
+                    options.frame_rate = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--retries" && i + 1 < argc) {
+                    options.retries = std::stoi(argv[++i]);
+                } else if (arg == "--baud" && i + 1 < argc) {
+                    options.baud_rate = std::stoi(argv[++i]);
+                } else if (arg[0] == '-' || !explicit_port.empty()) {
+                    std::cerr << "Error: Unexpected can-update argument '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << arg << std::endl;
+                return 1;
+            }
+        }
+        if (options.nodes.empty()) {
+            std::cerr << "Usage: lumos can-update [port] --nodes LIST [--firmware FILE] [--rate N]" << std::endl;
+            return 1;
+        }
+
+        SimpleSerial::MappedFile firmware_file;
+        if (!firmware_file.Open(firmware_path.string())) {
+            std::cerr << "Error: cannot read " << firmware_path << std::endl;
+            return 1;
+        }
+        const std::vector<uint8_t> image(firmware_file.Data(), firmware_file.Data() + firmware_file.Size());
+
+        options.port = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (options.port.empty()) {
+            return 1;
+        }
+
+        std::cout << "Updating " << options.nodes.size() << " nodes through " << options.port << " with "
+                  << firmware_path << " (" << image.size() << " bytes)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        std::vector<Lumos::CanUpdateResult> results;
+        std::string error;
+        const bool ok = Lumos::RunCanUpdate(image, options, g_running, results, error);
+        size_t updated = 0;
+        for (const auto& result : results) {
+            if (result.ok) {
+                updated++;
+            } else {
+                std::cerr << "  Node " << static_cast<int>(result.node) << ": " << result.reason << std::endl;
+            }
+        }
+        if (!ok) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << updated << " of " << results.size() << " nodes updated" << std::endl;
+        return updated == results.size() ? 0 : 1;
+    }
+
+    if (command == "can-stats") {
+        // can-stats [port] [--baud N]
+        std::string explicit_port;
+        int baud_rate = 115200;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--baud" && i + 1 < argc) {
+                try {
+                    baud_rate = std::stoi(argv[++i]);
+                } catch (...) {
+                    std::cerr << "Error: Invalid baud rate '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg[0] == '-' || !explicit_port.empty()) {
+                std::cerr << "Error: Unexpected can-stats argument '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                explicit_port = arg;
+            }
+        }
+
+        std::string port_name = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "Reading CAN statistics from " << port_name
+                  << " (Press Ctrl+C to exit)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        std::string error;
+        if (!Lumos::RunCanStats(port_name, baud_rate, g_running, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "stats") {
+        // stats [port] [--baud N] [--rate HZ] [--duration S] [--current RUN,SLEEP,STOP]
+        std::string explicit_port;
+        int baud_rate = 115200;
+        double rate_hz = 50;
+        double duration_s = 0;
+        Lumos::PowerStateCurrents currents;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                } else if (arg == "--rate" && i + 1 < argc) {
+                    rate_hz = std::stod(argv[++i]);
+                } else if (arg == "--duration" && i + 1 < argc) {
+                    duration_s = std::stod(argv[++i]);
+                } else if (arg == "--current" && i + 1 < argc) {
+                    const std::string value = argv[++i];
+                    const size_t first = value.find(',');
+                    const size_t second = first == std::string::npos ? first : value.find(',', first + 1);
+                    if (second == std::string::npos) {
+                        throw std::invalid_argument(value);
+                    }
+                    currents.run_ma = std::stod(value.substr(0, first));
+                    currents.sleep_ma = std::stod(value.substr(first + 1, second - first - 1));
+                    currents.stop_ma = std::stod(value.substr(second + 1));
+                } else if (arg[0] == '-' || !explicit_port.empty()) {
+                    std::cerr << "Error: Unexpected stats argument '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << argv[i - 1] << std::endl;
+                return 1;
+            }
+        }
+        if (rate_hz <= 0) {
+            std::cerr << "Error: --rate must be positive" << std::endl;
+            return 1;
+        }
+
+        std::string port_name = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "Polling runtime stats on " << port_name << " at " << rate_hz
+                  << " Hz (Press Ctrl+C to exit)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        std::string error;
+        if (!Lumos::RunRuntimeStats(port_name, baud_rate, rate_hz, duration_s, currents, g_running, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "memory") {
+        // memory [port] [--baud N]
+        std::string explicit_port;
+        int baud_rate = 115200;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--baud" && i + 1 < argc) {
+                try {
+                    baud_rate = std::stoi(argv[++i]);
+                } catch (...) {
+                    std::cerr << "Error: Invalid baud rate '" << argv[i] << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg[0] == '-' || !explicit_port.empty()) {
+                std::cerr << "Error: Unexpected memory argument '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                explicit_port = arg;
+            }
+        }
+
+        std::string port_name = GetSerialPortWithCache(fs::current_path(), explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "Reading memory usage from " << port_name
+                  << " (Press Ctrl+C to exit)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        std::string error;
+        if (!Lumos::RunMemoryStats(port_name, baud_rate, g_running, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "bench") {
+        // bench [port] [--board B] [--no-flash] [--baseline file] [-o file]
+        //       [--threshold PCT] [--timeout S] [--baud N] [--no-fast-libc]
+        fs::path current_dir = fs::current_path();
+        std::string explicit_port;
+        std::string board;
+        std::string baseline_file;
+        std::string output_file = (current_dir / "build" / "bench.json").string();
+        bool flash = true;
+        bool fast_libc = true;
+        double threshold_percent = 5.0;
+        double timeout_s = 30.0;
+        int baud_rate = 115200;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--board" && i + 1 < argc) {
+                    board = argv[++i];
+                } else if (arg == "--no-flash") {
+                    flash = false;
+                } else if (arg == "--no-fast-libc") {
+                    fast_libc = false;
+                } else if (arg == "--baseline" && i + 1 < argc) {
+                    baseline_file = argv[++i];
+                } else if (arg == "-o" && i + 1 < argc) {
+                    output_file = argv[++i];
+                } else if (arg == "--threshold" && i + 1 < argc) {
+                    threshold_percent = std::stod(argv[++i]);
+                } else if (arg == "--timeout" && i + 1 < argc) {
+                    timeout_s = std::stod(argv[++i]);
+                } else if (arg == "--baud" && i + 1 < argc) {
+                    baud_rate = std::stoi(argv[++i]);
+                } else if (arg[0] == '-' || !explicit_port.empty()) {
+                    std::cerr << "Error: Unexpected bench argument '" << arg << "'" << std::endl;
+                    return 1;
+                } else {
+                    explicit_port = arg;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << argv[i - 1] << std::endl;
+                return 1;
+            }
+        }
+
+        // Baseline first, so a bad path fails before the board is flashed
+        Lumos::BenchReport baseline;
+        std::string error;
+        if (!baseline_file.empty() && !baseline.Load(baseline_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        if (flash) {
+            fs::path yaml_path = current_dir / "project.yaml";
+            if (board.empty() && fs::exists(yaml_path)) {
+                Lumos::ProjectConfig project;
+                if (project.Load(yaml_path.string(), current_dir.string())) {
+                    board = project.board;
+                }
+            }
+            if (board.empty()) {
+                std::cerr << "Error: No board; use --board or run in a project directory" << std::endl;
+                return 1;
+            }
+            if (!IsBenchBoard(board)) {
+                std::cerr << "Error: No benchmark configuration for " << board
+                          << " (supported: LumosBrain, LumosMicroBrain)" << std::endl;
+                return 1;
+            }
+
+            // Built in its own project under build/, next to the user's firmware
+            std::string lumos_root = GetLumosRoot();
+            fs::path bench_dir = current_dir / "build" / "bench";
+            if (!PrepareBenchProject(lumos_root, board, fast_libc, bench_dir, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+
+            std::cout << "Building wrapper benchmarks for " << board << "..." << std::endl;
+            Lumos::Builder builder(lumos_root);
+            if (!builder.Build(bench_dir.string())) {
+                return 1;
+            }
+
+            fs::path firmware_path = bench_dir / "build" / "firmware.bin";
+            SimpleSerial::MappedFile firmware_file;
+            if (!firmware_file.Open(firmware_path.string())) {
+                std::cerr << "Error: Failed to open firmware file: " << firmware_file.GetLastError() << std::endl;
+                return 1;
+            }
 
+            std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
+            if (port_name.empty()) {
+                return 1;
+            }
+            if (!FlashFirmware(port_name, firmware_path, firmware_file, false, false, false, 0)) {
+                return 1;
+            }
+            explicit_port = port_name;
+        }
+
+        std::string port_name = GetSerialPortWithCache(current_dir, explicit_port);
+        if (port_name.empty()) {
+            return 1;
+        }
+
+        std::cout << "\nWaiting for benchmark results on " << port_name
+                  << " (Press Ctrl+C to stop)..." << std::endl;
+        signal(SIGINT, SignalHandler);
+        Lumos::BenchReport report;
+        if (!Lumos::CollectBenchReport(port_name, baud_rate, timeout_s, g_running, report, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        std::cout << std::endl;
+        const Lumos::BenchReport* compare = baseline_file.empty() ? nullptr : &baseline;
+        report.Print(std::cout, compare, threshold_percent);
+
+        std::error_code ec;
+        fs::create_directories(fs::path(output_file).parent_path(), ec);
+        if (!report.Write(output_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << std::endl << "Results written to " << output_file << std::endl;
+
+        if (compare != nullptr) {
+            const std::vector<std::string> regressions = report.FindRegressions(baseline, threshold_percent);
+            if (!regressions.empty()) {
+                std::cerr << regressions.size() << " benchmark(s) more than " << threshold_percent
+                          << "% slower than " << baseline_file << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+#ifndef _WIN32
+    if (command == "daemon") {
+        fs::path current_dir = fs::current_path();
+        if (!fs::exists(current_dir / "project.yaml")) {
+            std::cerr << "Error: project.yaml not found in current directory" << std::endl;
+            std::cerr << "Make sure you're in a Lumos project directory" << std::endl;
+            return 1;
+        }
+        if (argc > 2) {
+            std::cerr << "Error: Unexpected daemon argument '" << argv[2] << "'" << std::endl;
+            return 1;
+        }
+
+        Lumos::BuildDaemon daemon(GetLumosRoot(), current_dir.string());
+        signal(SIGINT, SignalHandler);
+        return daemon.Run(g_running) ? 0 : 1;
+    }
+
+    if (command == "toolchains") {
+        // Same selection as the build: LUMOS_TOOLCHAIN, then project.yaml
+        std::string request;
+        const char* env = std::getenv("LUMOS_TOOLCHAIN");
+        if (env != nullptr && env[0] != '\0') {
+            request = env;
+        } else if (fs::exists(fs::current_path() / "project.yaml")) {
+            request = Lumos::ProjectConfig::ReadToolchain((fs::current_path() / "project.yaml").string());
+        }
+
+        Lumos::ToolchainFinder finder(Lumos::GetResourceBasePath(GetLumosRoot()),
+                                      Lumos::ToolchainFinder::DefaultCacheFile());
+        std::vector<Lumos::Toolchain> toolchains = finder.FindAll();
+        Lumos::Toolchain selected;
+        std::string error;
+        bool have_selected = finder.Select(request, selected, error);
+        finder.Save();
+
+        for (const auto& toolchain : toolchains) {
+            bool used = have_selected && toolchain.bin_dir == selected.bin_dir;
+            std::cout << (used ? "* " : "  ") << std::left << std::setw(10) << toolchain.version
+                      << std::setw(12) << toolchain.origin << toolchain.bin_dir << std::endl;
+        }
+        if (have_selected && selected.origin == "configured") {
+            std::cout << "* " << std::left << std::setw(10) << selected.version
+                      << std::setw(12) << selected.origin << selected.bin_dir << std::endl;
+        }
+        if (!have_selected) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "cache") {
+        std::string action = argc > 2 ? argv[2] : "";
+        if ((action != "export" && action != "import") || argc != 4) {
+            std::cerr << "Usage: lumos cache export|import <bundle file>" << std::endl;
+            return 1;
+        }
+        std::string root = Lumos::ObjectCache::DefaultDirectory();
+        if (root.empty()) {
+            std::cerr << "Error: No cache directory (set LUMOS_CACHE_DIR)" << std::endl;
+            return 1;
+        }
+
+        Lumos::CacheBundleStats stats;
+        std::string error;
+        if (action == "export") {
+            if (!Lumos::CacheBundle::Export(root, argv[3], stats, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            std::cout << "Exported " << stats.files << " entries (" << (stats.bytes / (1024 * 1024))
+                      << " MB) from " << root << " to " << argv[3] << std::endl;
+            return 0;
+        }
+
+        std::error_code ec;
+        fs::create_directories(root, ec);
+        bool imported = Lumos::CacheBundle::Import(argv[3], root, stats, error);
+        // Whatever was added counts against LUMOS_CACHE_SIZE like any build's
+        Lumos::ObjectCache().Trim();
+        std::cout << "Imported " << stats.files << " entries (" << (stats.bytes / (1024 * 1024)) << " MB) into "
+                  << root << ", " << stats.skipped << " already cached" << std::endl;
+        if (!imported) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "emulate") {
+        // emulate <lumos|stm32> [--line-rate] [--latency-us N] [--loss PCT] [--erase-ms N]
+        //         [--page-erase-ms N] [--write-us-per-kb N] [--max-baud N] [--seed N]
+        std::string kind = argc > 2 ? argv[2] : "";
+        if (kind != "lumos" && kind != "stm32") {
+            std::cerr << "Usage: lumos emulate <lumos|stm32> [options]" << std::endl;
+            return 1;
+        }
+        Lumos::EmulatorConfig config;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            try {
+                if (arg == "--line-rate") {
+                    config.line_rate = true;
+                } else if (arg == "--latency-us" && i + 1 < argc) {
+                    config.latency_us = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--loss" && i + 1 < argc) {
+                    config.loss_percent = std::stod(argv[++i]);
+                } else if (arg == "--erase-ms" && i + 1 < argc) {
+                    config.erase_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--page-erase-ms" && i + 1 < argc) {
+                    config.page_erase_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--write-us-per-kb" && i + 1 < argc) {
+                    config.write_us_per_kb = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--max-baud" && i + 1 < argc) {
+                    config.max_baud = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else if (arg == "--seed" && i + 1 < argc) {
+                    config.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+                } else {
+                    std::cerr << "Error: Unexpected emulate argument '" << arg << "'" << std::endl;
+                    return 1;
+                }
+            } catch (...) {
+                std::cerr << "Error: Invalid value '" << argv[i] << "' for " << argv[i - 1] << std::endl;
+                return 1;
+            }
+        }
+
+        std::unique_ptr<Lumos::PtyEmulator> device;
+        if (kind == "lumos") {
+            device.reset(new Lumos::LumosBootloaderEmulator(config));
+        } else {
+            device.reset(new Lumos::Stm32RomEmulator(config));
+        }
+        std::string error;
+        if (!device->Start(error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+
+        std::cout << (kind == "lumos" ? "Lumos bootloader" : "STM32 ROM bootloader")
+                  << " on " << device->GetPort() << std::endl;
+        std::cout << "Flash it with: lumos flash " << (kind == "lumos" ? "--ports " : "")
+                  << device->GetPort() << std::endl;
+        std::cout << "(Press Ctrl+C to stop)" << std::endl;
+        signal(SIGINT, SignalHandler);
+        while (g_running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        device->Stop();
+
+        const Lumos::EmulatorStats stats = device->GetStats();
+        std::cout << std::endl << (kind == "lumos" ? "Downloads: " : "Connections: ") << stats.sessions
+                  << ", packets: " << stats.packets << " (" << stats.corrupted << " corrupted)"
+                  << ", bytes in/out: " << stats.bytes_in << "/" << stats.bytes_out
+                  << ", written: " << stats.bytes_written << std::endl;
+        return 0;
+    }
+#endif
+
+    if (command == "interface") {
+        std::string action = argc > 2 ? argv[2] : "";
+        std::string interface_file;
+        std::string output_file;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if ((arg == "-o" || arg == "--output") && i + 1 < argc && action == "generate") {
+                output_file = argv[++i];
+            } else if (arg[0] == '-' || !interface_file.empty()) {
+                std::cerr << "Error: Unexpected interface argument '" << arg << "'" << std::endl;
+                return 1;
+            } else {
+                interface_file = arg;
+            }
+        }
+        if ((action != "generate" && action != "validate") || interface_file.empty()) {
+            std::cerr << "Usage: lumos interface generate <file> [-o FILE]" << std::endl;
+            std::cerr << "       lumos interface validate <file>" << std::endl;
+            return 1;
+        }
+
+        std::string error;
+        if (action == "generate") {
+            if (output_file.empty()) {
+                output_file = (fs::path(interface_file).parent_path() /
+                               Lumos::GetInterfaceHeaderName(interface_file)).string();
+            }
+            if (!Lumos::GenerateInterface(interface_file, output_file, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            std::cout << "Generated " << output_file << std::endl;
+            return 0;
+        }
+
+        Lumos::InterfaceDefinition definition;
+        if (!definition.Load(interface_file, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << interface_file << ": " << definition.messages.size() << " message(s)";
+        if (!definition.ns.empty()) {
+            std::cout << " in namespace " << definition.ns;
+        }
+        std::cout << std::endl;
+        for (const auto& message : definition.messages) {
+            std::cout << "  " << message.name << " (id " << message.id << ", " << message.size
+                      << " bytes" << (message.size <= 8 ? ", fits a CAN frame" : "") << ")" << std::endl;
+            for (const auto& field : message.fields) {
+                std::cout << "    +" << field.offset << "  " << field.name << ": " << field.type;
+                if (field.count > 0) {
+                    std::cout << "[" << field.count << "]";
+                }
+                std::cout << std::endl;
+            }
+        }
         return 0;
     }
 
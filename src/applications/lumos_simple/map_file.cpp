@@ -0,0 +1,305 @@
+#include "map_file.h"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+std::vector<std::string> Split(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::istringstream ss(line);
+    std::string token;
+    while (ss >> token) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+bool ParseHex(const std::string& text, uint64_t& value) {
+    if (text.size() < 3 || text[0] != '0' || (text[1] != 'x' && text[1] != 'X')) {
+        return false;
+    }
+    try {
+        size_t pos = 0;
+        value = std::stoull(text, &pos, 16);
+        return pos == text.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+// Remaining tokens joined back together (object paths may contain spaces)
+std::string Join(const std::vector<std::string>& tokens, size_t first) {
+    std::string joined;
+    for (size_t i = first; i < tokens.size(); ++i) {
+        if (i > first) joined += ' ';
+        joined += tokens[i];
+    }
+    return joined;
+}
+
+// "address size [load address X]" starting at tokens[first]
+void ParseOutputAddresses(const std::vector<std::string>& tokens, size_t first,
+                          uint64_t& address, uint64_t& load_address) {
+    address = 0;
+    if (tokens.size() > first) {
+        ParseHex(tokens[first], address);
+    }
+    load_address = address;
+    if (tokens.size() >= first + 5 && tokens[first + 2] == "load" && tokens[first + 3] == "address") {
+        ParseHex(tokens[first + 4], load_address);
+    }
+}
+
+std::string Trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+
+// "file (symbol)", or "(symbol)" for a -u option
+void ParseArchiveReference(const std::string& text, ArchiveReference& reference) {
+    size_t open = text.rfind('(');
+    size_t close = text.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+        reference.referenced_by = Trim(text);
+        return;
+    }
+    reference.symbol = text.substr(open + 1, close - open - 1);
+    reference.referenced_by = Trim(text.substr(0, open));
+}
+
+} // namespace
+
+bool MapFile::Load(const std::string& path) {
+    regions_.clear();
+    contributions_.clear();
+    discarded_.clear();
+    archive_references_.clear();
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    enum class Part { Preamble, Archives, Discarded, Memory, Map };
+    Part part = Part::Preamble;
+
+    std::string output_section;
+    uint64_t output_address = 0;
+    uint64_t output_load = 0;
+    std::string pending_input;  // input section name wrapped onto its own line
+    bool pending_output = false;  // output section name wrapped onto its own line
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (line == "Archive member included to satisfy reference by file (symbol)") {
+            part = Part::Archives;
+            continue;
+        }
+        if (line.rfind("As-needed library", 0) == 0 || line == "Allocating common symbols") {
+            part = Part::Preamble;
+            continue;
+        }
+        if (part == Part::Archives) {
+            // "archive(member)" then, indented or on the same line, "file (symbol)"
+            if (Trim(line).empty()) {
+                continue;
+            }
+            if (line[0] != ' ' && line[0] != '\t') {
+                size_t open = line.find('(');
+                size_t close = open == std::string::npos ? open : line.find(')', open);
+                if (close == std::string::npos) {
+                    part = Part::Preamble;  // The next heading
+                } else {
+                    ArchiveReference reference;
+                    reference.member = line.substr(0, close + 1);
+                    std::string rest = Trim(line.substr(close + 1));
+                    if (!rest.empty()) {
+                        ParseArchiveReference(rest, reference);
+                    }
+                    archive_references_.push_back(reference);
+                    continue;
+                }
+            } else if (!archive_references_.empty() && archive_references_.back().symbol.empty()) {
+                ParseArchiveReference(line, archive_references_.back());
+                continue;
+            } else {
+                continue;
+            }
+        }
+
+        if (line == "Discarded input sections") {
+            part = Part::Discarded;
+            output_section = "*discarded*";
+            continue;
+        }
+        if (line == "Memory Configuration") {
+            part = Part::Memory;
+            output_section.clear();
+            continue;
+        }
+        if (line == "Linker script and memory map") {
+            part = Part::Map;
+            output_section.clear();
+            continue;
+        }
+
+        std::vector<std::string> tokens = Split(line);
+        if (tokens.empty()) {
+            continue;
+        }
+
+        if (part == Part::Memory) {
+            // Name Origin Length [Attributes]
+            MemoryRegion region;
+            if (tokens.size() >= 3 && tokens[0] != "*default*" &&
+                ParseHex(tokens[1], region.origin) && ParseHex(tokens[2], region.length)) {
+                region.name = tokens[0];
+                region.attributes = tokens.size() > 3 ? tokens[3] : "";
+                regions_.push_back(region);
+            }
+            continue;
+        }
+        if (part != Part::Map && part != Part::Discarded) {
+            continue;
+        }
+
+        if (part == Part::Map && line[0] == '.') {
+            // Output section: .name [address size [load address X]]
+            output_section = tokens[0];
+            pending_input.clear();
+            pending_output = tokens.size() == 1;
+            ParseOutputAddresses(tokens, 1, output_address, output_load);
+            continue;
+        }
+        if (pending_output) {
+            // Continuation of a wrapped output section line
+            pending_output = false;
+            ParseOutputAddresses(tokens, 0, output_address, output_load);
+            continue;
+        }
+        if (line[0] != ' ' || output_section.empty()) {
+            // LOAD, OUTPUT(...) and other top-level statements
+            continue;
+        }
+
+        std::string input;
+        size_t first = 0;
+        if (line.size() > 1 && line[1] != ' ') {
+            // " .text.name  0xaddr  0xsize  object" or the name alone if too long
+            if (tokens[0][0] != '.' && tokens[0] != "COMMON") {
+                pending_input.clear();
+                continue;  // *fill*, *(.text*) patterns, ...
+            }
+            if (tokens.size() == 1) {
+                pending_input = tokens[0];
+                continue;
+            }
+            input = tokens[0];
+            first = 1;
+        } else if (!pending_input.empty()) {
+            // Continuation of a wrapped input section line
+            input = pending_input;
+            first = 0;
+        } else {
+            continue;  // Symbol and assignment lines
+        }
+        pending_input.clear();
+
+        MapContribution contribution;
+        if (tokens.size() < first + 3 ||
+            !ParseHex(tokens[first], contribution.address) ||
+            !ParseHex(tokens[first + 1], contribution.size) ||
+            contribution.size == 0) {
+            continue;
+        }
+        contribution.input_section = input;
+        contribution.object = Join(tokens, first + 2);
+        if (part == Part::Discarded) {
+            discarded_.push_back(contribution);
+            continue;
+        }
+        contribution.output_section = output_section;
+        contribution.load_address = contribution.address - output_address + output_load;
+        contributions_.push_back(contribution);
+    }
+
+    ExpandPartialLinks();
+    return true;
+}
+
+void MapFile::ExpandPartialLinks() {
+    // Sections of a relocatable link all start at 0, so an input section's
+    // address in its map is its offset within the merged section
+    std::map<std::string, std::map<std::string, std::vector<MapContribution>>> partial;
+    auto load_partial = [&partial](const std::vector<MapContribution>& contributions) {
+        for (const auto& contribution : contributions) {
+            const std::string& object = contribution.object;
+            if (partial.count(object) || object.find('(') != std::string::npos) {
+                continue;
+            }
+            std::error_code ec;
+            std::string map_path = object + ".map";
+            if (!std::filesystem::exists(map_path, ec)) {
+                partial[object];
+                continue;
+            }
+            MapFile map;
+            map.Load(map_path);
+            auto& sections = partial[object];
+            for (const auto& part : map.GetContributions()) {
+                sections[part.output_section].push_back(part);
+            }
+        }
+    };
+    load_partial(contributions_);
+    load_partial(discarded_);
+
+    auto find_parts = [&partial](const MapContribution& contribution) -> const std::vector<MapContribution>* {
+        auto object = partial.find(contribution.object);
+        if (object == partial.end()) {
+            return nullptr;
+        }
+        auto parts = object->second.find(contribution.input_section);
+        return parts == object->second.end() ? nullptr : &parts->second;
+    };
+
+    auto expand = [&find_parts](std::vector<MapContribution>& contributions) {
+        std::vector<MapContribution> expanded;
+        expanded.reserve(contributions.size());
+        for (const auto& contribution : contributions) {
+            const std::vector<MapContribution>* parts = find_parts(contribution);
+            if (parts == nullptr) {
+                expanded.push_back(contribution);
+                continue;
+            }
+            for (const auto& part : *parts) {
+                if (part.address + part.size > contribution.size) {
+                    continue;
+                }
+                MapContribution piece = contribution;
+                piece.input_section = part.input_section;
+                piece.object = part.object;
+                piece.address = contribution.address + part.address;
+                piece.load_address = contribution.load_address + part.address;
+                piece.size = part.size;
+                expanded.push_back(piece);
+            }
+        }
+        contributions = std::move(expanded);
+    };
+    expand(contributions_);
+    expand(discarded_);
+}
+
+} // namespace Lumos
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Memory region from the linker script's MEMORY command
+ */
+struct MemoryRegion {
+    std::string name;        // e.g. FLASH, DTCMRAM, RAM_D1
+    uint64_t origin = 0;
+    uint64_t length = 0;
+    std::string attributes;  // e.g. rx, xrw
+};
+
+/**
+ * @brief One input section placed into an output section
+ */
+struct MapContribution {
+    std::string output_section;  // e.g. .text
+    std::string input_section;   // e.g. .text.HAL_Init
+    std::string object;          // object file or archive(member)
+    uint64_t address = 0;        // run-time address
+    uint64_t load_address = 0;   // image address (differs for .data)
+    uint64_t size = 0;
+};
+
+/**
+ * @brief Archive member the linker pulled in, and the reference that did it
+ */
+struct ArchiveReference {
+    std::string member;         // archive(member), e.g. .../libc_nano.a(libc_a-snprintf.o)
+    std::string referenced_by;  // object file or archive(member), empty for -u
+    std::string symbol;         // e.g. snprintf
+};
+
+/**
+ * @brief Parser for GNU ld map files (-Wl,-Map=...)
+ *
+ * Sections that came from a partially linked object (ld -r) are credited to
+ * the objects they were linked from when its own map is beside it, as
+ * <object>.map, so per-object sizes look the same with or without it.
+ *
+ * The "Discarded input sections" list holds what --gc-sections removed,
+ * the same sections --print-gc-sections would report. The archive member
+ * list at the top says which reference brought each library object in.
+ */
+class MapFile {
+public:
+    /**
+     * @brief Parse a map file
+     * @param path Map file path
+     * @return true if the file could be read
+     */
+    bool Load(const std::string& path);
+
+    const std::vector<MemoryRegion>& GetRegions() const { return regions_; }
+    const std::vector<MapContribution>& GetContributions() const { return contributions_; }
+
+    /** Input sections removed by --gc-sections (no output section or address) */
+    const std::vector<MapContribution>& GetDiscarded() const { return discarded_; }
+
+    /** Archive members and the first reference to each */
+    const std::vector<ArchiveReference>& GetArchiveReferences() const { return archive_references_; }
+
+private:
+    void ExpandPartialLinks();
+
+    std::vector<MemoryRegion> regions_;
+    std::vector<MapContribution> contributions_;
+    std::vector<MapContribution> discarded_;
+    std::vector<ArchiveReference> archive_references_;
+};
+
+} // namespace Lumos
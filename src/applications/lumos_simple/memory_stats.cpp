@@ -0,0 +1,146 @@
+#include "memory_stats.h"
+#include "interrupt_poll.h"
+#include "serial.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+// Task stacks fuller than this are flagged
+const double kTaskStackWarningPercent = 90.0;
+
+double Percent(uint32_t part, uint32_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+} // namespace
+
+uint32_t MemoryStatsLine::Get(const std::string& key) const {
+    auto it = fields.find(key);
+    if (it == fields.end()) {
+        return 0;
+    }
+    try {
+        return static_cast<uint32_t>(std::stoul(it->second));
+    } catch (...) {
+        return 0;
+    }
+}
+
+std::string MemoryStatsLine::GetText(const std::string& key) const {
+    auto it = fields.find(key);
+    return it != fields.end() ? it->second : "";
+}
+
+bool ParseMemoryStatsLine(const std::string& line, MemoryStatsLine& parsed) {
+    // The marker may follow other output on the same line
+    size_t start = line.find('@');
+    if (start == std::string::npos) {
+        return false;
+    }
+
+    std::istringstream ss(line.substr(start + 1));
+    std::string kind;
+    ss >> kind;
+    if (kind != "memory" && kind != "taskstack" && kind != "dmapool") {
+        return false;
+    }
+
+    parsed.kind = kind;
+    parsed.fields.clear();
+    std::string token;
+    while (ss >> token) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            continue;
+        }
+        parsed.fields[token.substr(0, equals)] = token.substr(equals + 1);
+    }
+    return true;
+}
+
+std::string MemoryStatsView::Feed(const std::string& line) {
+    MemoryStatsLine stats;
+    if (!ParseMemoryStatsLine(line, stats)) {
+        return "";
+    }
+
+    char text[256];
+    if (stats.kind == "taskstack") {
+        const uint32_t used = stats.Get("used");
+        const uint32_t size = stats.Get("size");
+        const double percent = Percent(used, size);
+        snprintf(text, sizeof(text), "  task %-16s stack %6u / %6u B (%5.1f%%)%s",
+                 stats.GetText("app").c_str(), used, size, percent,
+                 percent >= kTaskStackWarningPercent ? "  <- nearly full" : "");
+        return text;
+    }
+
+    if (stats.kind == "dmapool") {
+        const uint32_t count = stats.Get("count");
+        const uint32_t failures = stats.Get("failures");
+        snprintf(text, sizeof(text), "  dma  %-16s %3u x %5u B, used %3u, peak %3u / %3u  arena %u / %u B%s",
+                 stats.GetText("name").c_str(), count, stats.Get("block"), stats.Get("used"), stats.Get("peak"),
+                 count, stats.Get("arena"), stats.Get("arena_size"),
+                 failures > 0 ? "  <- ran out of blocks" : "");
+        return text;
+    }
+
+    const uint32_t stack = stats.Get("stack");
+    const uint32_t stack_size = stats.Get("stack_size");
+    snprintf(text, sizeof(text),
+             "t=%u ms  main stack %6u / %6u B (%5.1f%%)  heap %u B, peak %u / %u B (%4.1f%%)%s",
+             stats.Get("t"), stack, stack_size, Percent(stack, stack_size),
+             stats.Get("heap"), stats.Get("heap_peak"), stats.Get("heap_limit"),
+             Percent(stats.Get("heap_peak"), stats.Get("heap_limit")),
+             stack > stack_size ? "  <- stack past its reserve" : "");
+    return text;
+}
+
+bool RunMemoryStats(const std::string& port, int baud_rate, const volatile bool& running,
+                    std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    MemoryStatsView view;
+    std::string partial;
+    uint8_t buffer[1024];
+    while (running) {
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+
+        const char* data = reinterpret_cast<const char*>(buffer);
+        const char* end = data + bytes_read;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            partial.append(data, newline ? newline : end);
+            if (!newline) {
+                break;
+            }
+            const std::string text = view.Feed(partial);
+            if (!text.empty()) {
+                std::cout << text << std::endl;
+            }
+            partial.clear();
+            data = newline + 1;
+        }
+    }
+
+    serial.Close();
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Key/value fields of one "@memory", "@taskstack" or "@dmapool" line
+ *
+ * Firmware reports RAM use as text lines on its serial console
+ * (PrintMemoryUsage() in framework/memory_report.h):
+ *
+ *   @memory t=12345 stack=.. stack_size=.. heap=.. heap_peak=.. heap_limit=..
+ *   @taskstack app=control used=.. size=..
+ *   @dmapool name=frames block=.. count=.. used=.. peak=.. failures=.. arena=.. arena_size=..
+ *
+ * Sizes are in bytes, t is the device's millisecond tick; @dmapool
+ * counts are blocks (PrintDmaPoolUsage() in framework/dma_pool.h).
+ */
+struct MemoryStatsLine {
+    std::string kind;                         // "memory", "taskstack" or "dmapool"
+    std::map<std::string, std::string> fields;
+
+    uint32_t Get(const std::string& key) const;
+    std::string GetText(const std::string& key) const;
+};
+
+/**
+ * @brief Parse a console line
+ * @return false if it is not a memory line
+ */
+bool ParseMemoryStatsLine(const std::string& line, MemoryStatsLine& parsed);
+
+/**
+ * @brief Formats memory lines for display (lumos memory)
+ *
+ * Each line is printed with its share of the reserved size and a warning
+ * once the main stack has grown past its linker reserve or a task stack
+ * is nearly full, or a DMA pool has run out of blocks.
+ */
+class MemoryStatsView {
+public:
+    /**
+     * @brief Format @p line for display
+     * @return The text to print, empty for lines that are not memory lines
+     */
+    std::string Feed(const std::string& line);
+};
+
+/**
+ * @brief Print memory lines from @p port until @p running turns false
+ */
+bool RunMemoryStats(const std::string& port, int baud_rate, const volatile bool& running,
+                    std::string& error);
+
+} // namespace Lumos
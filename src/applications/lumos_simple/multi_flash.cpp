@@ -0,0 +1,159 @@
+#include "multi_flash.h"
+#include "lumos_bootloader.h"
+#include "serial.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace Lumos {
+
+MultiFlasher::MultiFlasher(unsigned int jobs)
+    : jobs_(jobs)
+{
+}
+
+std::vector<std::string> MultiFlasher::DetectPorts() {
+    // Devices running the bootloader enumerate over USB; leave on-board
+    // UARTs alone
+    std::vector<std::string> candidates;
+    for (const auto& port : SimpleSerial::Serial::ListPortDetails()) {
+        if (port.IsUsb()) {
+            candidates.push_back(port.name);
+        }
+    }
+    std::vector<SimpleSerial::PortStatus> statuses = SimpleSerial::Serial::CheckPortStatuses(candidates);
+    std::vector<std::string> ports;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (statuses[i] == SimpleSerial::PortStatus::AVAILABLE) {
+            ports.push_back(candidates[i]);
+        }
+    }
+    std::sort(ports.begin(), ports.end());
+    return ports;
+}
+
+std::vector<FlashResult> MultiFlasher::Flash(const std::vector<std::string>& ports,
+                                             const uint8_t* firmware, size_t size) {
+    std::vector<FlashResult> results(ports.size());
+    std::vector<int> percent(ports.size(), 0);
+    size_t finished = 0;
+
+    std::mutex mutex;  // Guards percent, finished and stdout
+    std::condition_variable done;
+    std::atomic<size_t> next{0};
+
+    size_t width = 0;
+    for (const auto& port : ports) {
+        width = std::max(width, port.size());
+    }
+
+    auto worker = [&]() {
+        while (true) {
+            size_t index = next.fetch_add(1);
+            if (index >= ports.size()) {
+                return;
+            }
+
+            FlashResult& result = results[index];
+            result.port = ports[index];
+            int last_bucket = -1;   // Quarter of the upload reported last
+
+            auto progress = [&](int pct, const std::string& message) {
+                std::lock_guard<std::mutex> lock(mutex);
+                percent[index] = pct;
+                // Upload progress only every 25%, every other step as it happens
+                bool upload = message.rfind("Uploading:", 0) == 0;
+                if (upload) {
+                    if (pct / 25 == last_bucket) {
+                        return;
+                    }
+                    last_bucket = pct / 25;
+                }
+                std::cout << "[" << std::left << std::setw(static_cast<int>(width)) << result.port
+                          << std::right << "] " << std::setw(3) << pct << "% " << message << std::endl;
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            SimpleSerial::LumosBootloader bootloader;
+            result.success = bootloader.Flash(result.port, firmware, size, progress);
+            result.error = result.success ? "" : bootloader.GetLastError();
+            result.baud_rate = bootloader.GetGrantedBaudRate();
+            result.window = bootloader.GetGrantedWindow();
+            result.chunk_size = bootloader.GetGrantedChunkSize();
+            result.round_trip = bootloader.GetRoundTrip();
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            percent[index] = 100;
+            finished++;
+            if (!result.success) {
+                std::cout << "[" << std::left << std::setw(static_cast<int>(width)) << result.port
+                          << std::right << "] FAILED: " << result.error << std::endl;
+            }
+            done.notify_all();
+        }
+    };
+
+    size_t thread_count = jobs_ == 0 ? ports.size() : std::min<size_t>(jobs_, ports.size());
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    // Aggregate progress until every device has finished
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!done.wait_for(lock, std::chrono::seconds(2), [&] { return finished == ports.size(); })) {
+            int total = 0;
+            for (int pct : percent) {
+                total += pct;
+            }
+            std::cout << "Overall: " << total / static_cast<int>(ports.size()) << "% ("
+                      << finished << "/" << ports.size() << " devices finished)" << std::endl;
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+bool MultiFlasher::PrintSummary(const std::vector<FlashResult>& results) {
+    size_t width = 4;
+    size_t passed = 0;
+    for (const auto& result : results) {
+        width = std::max(width, result.port.size());
+        if (result.success) {
+            passed++;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(static_cast<int>(width)) << "Port" << "  Result  Time" << std::endl;
+    for (const auto& result : results) {
+        std::cout << std::left << std::setw(static_cast<int>(width)) << result.port << "  "
+                  << (result.success ? "PASS  " : "FAIL  ") << "  "
+                  << std::right << std::fixed << std::setprecision(1) << std::setw(5)
+                  << result.seconds << "s";
+        if (!result.success) {
+            std::cout << "  " << result.error;
+        } else if (result.round_trip.count > 0) {
+            std::cout << std::setprecision(2) << "  ACK avg " << result.round_trip.MeanMs() << " ms, max "
+                      << result.round_trip.max_ms << " ms";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::defaultfloat << std::endl;
+    std::cout << passed << "/" << results.size() << " devices flashed successfully" << std::endl;
+
+    return passed == results.size();
+}
+
+} // namespace Lumos
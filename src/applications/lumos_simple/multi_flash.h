@@ -0,0 +1,69 @@
+#pragma once
+
+#include "serial.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Outcome of flashing one device
+ */
+struct FlashResult {
+    std::string port;
+    bool success = false;
+    std::string error;
+    double seconds = 0.0;
+    uint32_t baud_rate = 0;       // Granted by the bootloader
+    uint32_t window = 0;
+    uint32_t chunk_size = 0;
+    SimpleSerial::RoundTripStats round_trip;  // DATA packet to ACK
+};
+
+/**
+ * @brief Flash the same firmware to many devices at once (lumos flash --all)
+ *
+ * Each port runs the Lumos bootloader protocol on its own worker thread;
+ * all workers share one in-memory copy of the firmware. Step changes are
+ * printed per device, prefixed with the port, together with a periodic
+ * aggregate progress line. Unlike a build, one failing device does not
+ * stop the others.
+ */
+class MultiFlasher {
+public:
+    /**
+     * @brief Construct a flasher
+     * @param jobs Devices to flash concurrently (0 = all at once)
+     */
+    explicit MultiFlasher(unsigned int jobs = 0);
+
+    /**
+     * @brief Flash every port and wait for completion
+     * @param ports Serial ports, one device each
+     * @param firmware Raw binary firmware, shared read-only by all devices
+     * @param size Firmware size in bytes
+     * @return One result per port, in the order given
+     */
+    std::vector<FlashResult> Flash(const std::vector<std::string>& ports,
+                                   const uint8_t* firmware, size_t size);
+
+    /**
+     * @brief Print a pass/fail table
+     * @return true if every device passed
+     */
+    static bool PrintSummary(const std::vector<FlashResult>& results);
+
+    /**
+     * @brief Ports worth probing for --all
+     *
+     * Available USB serial ports; built-in UARTs (ttyS, ttyAMA, ...) are skipped.
+     */
+    static std::vector<std::string> DetectPorts();
+
+private:
+    unsigned int jobs_;
+};
+
+} // namespace Lumos
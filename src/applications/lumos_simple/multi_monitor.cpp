@@ -0,0 +1,234 @@
+#include "multi_monitor.h"
+#include "interrupt_poll.h"
+#include "serial.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+    #include <io.h>
+    #define isatty _isatty
+    #define fileno _fileno
+#else
+    #include <unistd.h>
+#endif
+
+namespace Lumos {
+
+namespace {
+
+// Bright red, green, yellow, blue, magenta, cyan; then repeat
+const int kColors[] = {91, 92, 93, 94, 95, 96};
+
+// "/dev/ttyUSB0" -> "ttyUSB0", "/dev/pts/3" -> "pts/3", "COM3" -> "COM3"
+std::string Label(const std::string& port) {
+    const std::string dev = "/dev/";
+    return port.compare(0, dev.size(), dev) == 0 ? port.substr(dev.size()) : port;
+}
+
+} // namespace
+
+MultiMonitor::MultiMonitor(int baud_rate)
+    : baud_rate_(baud_rate)
+    , color_(isatty(fileno(stdout)) != 0)
+    , start_(std::chrono::steady_clock::now())
+{
+}
+
+MultiMonitor::~MultiMonitor() = default;
+
+bool MultiMonitor::Open(const std::vector<std::string>& ports, std::string& error) {
+    ports_.clear();
+    size_t width = 0;
+    for (const auto& name : ports) {
+        width = std::max(width, Label(name).size());
+    }
+
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate_;
+    for (const auto& name : ports) {
+        Port port;
+        port.name = name;
+        port.label = Label(name);
+        port.label.resize(width, ' ');
+        port.color = kColors[ports_.size() % (sizeof(kColors) / sizeof(kColors[0]))];
+        port.serial.reset(new SimpleSerial::Serial());
+        if (!port.serial->Open(name, config)) {
+            error = name + ": " + port.serial->GetLastError();
+            ports_.clear();
+            return false;
+        }
+        ports_.push_back(std::move(port));
+    }
+    return true;
+}
+
+bool MultiMonitor::SetLogFile(const std::string& path, std::string& error) {
+    log_.open(path, std::ios::out | std::ios::app);
+    if (!log_.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    return true;
+}
+
+bool MultiMonitor::SetCaptureFile(const std::string& path, std::string& error) {
+    std::vector<std::string> names;
+    for (const auto& port : ports_) {
+        names.push_back(port.name);
+    }
+    capture_.reset(new CaptureWriter());
+    if (!capture_->Open(path, names, error)) {
+        capture_.reset();
+        return false;
+    }
+    return true;
+}
+
+void MultiMonitor::PrintCaptureStats(double now, bool final) {
+    const uint64_t bytes = capture_->GetBytesCaptured();
+    char line[96];
+    snprintf(line, sizeof(line), "\r[%11.6f] captured %llu bytes (%.1f KB/s)", now,
+             static_cast<unsigned long long>(bytes), now > 0 ? bytes / now / 1024.0 : 0.0);
+    std::cout << line << (final ? "\n" : "") << std::flush;
+}
+
+double MultiMonitor::Now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+void MultiMonitor::EmitLine(const Port& port, double time, const std::string& text) {
+    char stamp[32];
+    snprintf(stamp, sizeof(stamp), "[%11.6f]", time);
+
+    if (color_) {
+        std::cout << stamp << " \033[" << port.color << "m" << port.label << "\033[0m | "
+                  << text << '\n';
+    } else {
+        std::cout << stamp << ' ' << port.label << " | " << text << '\n';
+    }
+    if (log_.is_open()) {
+        log_ << stamp << ' ' << port.label << " | " << text << '\n';
+    }
+}
+
+void MultiMonitor::Feed(Port& port, const uint8_t* data, size_t length, double now) {
+    if (decoder_ == nullptr) {
+        FeedText(port, data, length, now);
+        return;
+    }
+
+    // Runs of text go to the line splitter, frames become lines of their own
+    size_t text_start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const TokenLogParser::Result result = port.parser.Feed(data[i]);
+        if (result == TokenLogParser::Result::Text) {
+            continue;
+        }
+        FeedText(port, data + text_start, i - text_start, now);
+        text_start = i + 1;
+        if (result == TokenLogParser::Result::Frame) {
+            const TokenLogFrame& frame = port.parser.GetFrame();
+            char stamp[32];
+            snprintf(stamp, sizeof(stamp), "<%10.6f> ", frame.time_us / 1e6);
+            EmitLine(port, now, stamp + decoder_->Format(frame));
+        }
+    }
+    FeedText(port, data + text_start, length - text_start, now);
+}
+
+void MultiMonitor::FeedText(Port& port, const uint8_t* data, size_t length, double now) {
+    const uint8_t* end = data + length;
+    while (data < end) {
+        if (port.partial.empty()) {
+            port.line_start = now;
+        }
+        const uint8_t* newline = static_cast<const uint8_t*>(memchr(data, '\n', end - data));
+        const uint8_t* stop = newline ? newline : end;
+        port.partial.append(reinterpret_cast<const char*>(data), stop - data);
+        if (!newline) {
+            break;
+        }
+        while (!port.partial.empty() && port.partial.back() == '\r') {
+            port.partial.pop_back();
+        }
+        EmitLine(port, port.line_start, port.partial);
+        port.partial.clear();
+        data = newline + 1;
+    }
+}
+
+void MultiMonitor::Run(const volatile bool& running) {
+    std::vector<Port*> active;
+    std::vector<SimpleSerial::Serial*> serials;
+    for (auto& port : ports_) {
+        active.push_back(&port);
+        serials.push_back(port.serial.get());
+    }
+
+    std::vector<size_t> ready;
+    uint8_t buffer[4096];
+    while (running && !active.empty()) {
+        int count = SimpleSerial::Serial::WaitForAny(serials, kInterruptPollMs, ready);
+        if (count < 0) {
+            std::cerr << "Error waiting for serial data" << std::endl;
+            break;
+        }
+
+        const double now = Now();
+        std::vector<size_t> closed;
+        for (size_t index : ready) {
+            Port& port = *active[index];
+            int bytes_read = port.serial->Read(buffer, sizeof(buffer), 0);
+            if (bytes_read < 0) {
+                std::cout << std::flush;
+                std::cerr << port.name << ": " << port.serial->GetLastError() << std::endl;
+                closed.push_back(index);
+                continue;
+            }
+            if (capture_) {
+                const uint64_t time_ns = static_cast<uint64_t>(now * 1e9);
+                capture_->Append(static_cast<uint8_t>(&port - ports_.data()), time_ns, buffer,
+                                 static_cast<size_t>(bytes_read));
+            } else {
+                Feed(port, buffer, static_cast<size_t>(bytes_read), now);
+            }
+        }
+        if (capture_ && now - last_stats_ >= 1.0) {
+            PrintCaptureStats(now, false);
+            last_stats_ = now;
+        }
+        std::cout << std::flush;
+
+        for (auto it = closed.rbegin(); it != closed.rend(); ++it) {
+            active.erase(active.begin() + *it);
+            serials.erase(serials.begin() + *it);
+        }
+    }
+
+    // Lines still missing their newline
+    for (auto& port : ports_) {
+        if (!port.partial.empty()) {
+            EmitLine(port, port.line_start, port.partial);
+            port.partial.clear();
+        }
+        port.serial->Close();
+        if (port.parser.GetErrorCount() > 0) {
+            std::cerr << port.name << ": " << port.parser.GetErrorCount()
+                      << " corrupt log frames dropped" << std::endl;
+        }
+    }
+    std::cout << std::flush;
+    if (log_.is_open()) {
+        log_.flush();
+    }
+    if (capture_) {
+        PrintCaptureStats(Now(), true);
+        if (!capture_->Close()) {
+            std::cerr << "Error: writing the capture file failed" << std::endl;
+        }
+    }
+}
+
+} // namespace Lumos
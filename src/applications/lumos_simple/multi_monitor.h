@@ -0,0 +1,96 @@
+#pragma once
+
+#include "capture_file.h"
+#include "token_log_decoder.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SimpleSerial {
+class Serial;
+}
+
+namespace Lumos {
+
+/**
+ * @brief Watch many serial ports from one thread (lumos monitor --ports)
+ *
+ * All ports are served by a single Serial::WaitForAny() loop. Output is
+ * split into lines; each line is stamped with the monotonic time its
+ * first byte arrived, prefixed with its port (colour-coded on a
+ * terminal) and optionally appended to a merged log file.
+ *
+ * In capture mode the raw bytes go to a CaptureWriter instead and only a
+ * throughput line is printed, so long recordings never wait on the
+ * terminal; `lumos decode` turns the capture back into lines.
+ *
+ * With a TokenLogDecoder, tokenized log frames between the text are
+ * expanded into lines of their own, stamped with the firmware time.
+ */
+class MultiMonitor {
+public:
+    explicit MultiMonitor(int baud_rate = 115200);
+    ~MultiMonitor();
+
+    /**
+     * @brief Open every port
+     * @param error Receives the first port that failed and why
+     * @return true if all ports were opened
+     */
+    bool Open(const std::vector<std::string>& ports, std::string& error);
+
+    /**
+     * @brief Also write every line, uncoloured, to @p path
+     */
+    bool SetLogFile(const std::string& path, std::string& error);
+
+    /**
+     * @brief Record raw bytes to a capture file instead of printing lines
+     *
+     * Call after Open(); the port names are stored in the capture header.
+     */
+    bool SetCaptureFile(const std::string& path, std::string& error);
+
+    /**
+     * @brief Expand tokenized log frames with @p decoder (must outlive Run())
+     */
+    void SetTokenLogDecoder(const TokenLogDecoder* decoder) { decoder_ = decoder; }
+
+    /** Colour-code ports (default: when stdout is a terminal) */
+    void SetColor(bool enable) { color_ = enable; }
+
+    /**
+     * @brief Print lines until @p running turns false or all ports are gone
+     */
+    void Run(const volatile bool& running);
+
+private:
+    struct Port {
+        std::string name;
+        std::string label;            // padded for alignment
+        std::unique_ptr<SimpleSerial::Serial> serial;
+        std::string partial;          // bytes since the last newline
+        double line_start = 0.0;      // arrival time of partial's first byte
+        int color = 0;                // ANSI colour code
+        TokenLogParser parser;
+    };
+
+    double Now() const;
+    void Feed(Port& port, const uint8_t* data, size_t length, double now);
+    void FeedText(Port& port, const uint8_t* data, size_t length, double now);
+    void EmitLine(const Port& port, double time, const std::string& text);
+    void PrintCaptureStats(double now, bool final);
+
+    int baud_rate_;
+    bool color_;
+    std::vector<Port> ports_;
+    std::ofstream log_;
+    std::unique_ptr<CaptureWriter> capture_;
+    const TokenLogDecoder* decoder_ = nullptr;
+    double last_stats_ = 0.0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace Lumos
@@ -0,0 +1,233 @@
+#include "object_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const uint64_t kDefaultMaxBytes = 2ULL * 1024 * 1024 * 1024;
+
+// Parse sizes like "500M", "2G", "1048576"
+uint64_t ParseSize(const std::string& text, uint64_t fallback) {
+    if (text.empty()) {
+        return fallback;
+    }
+    try {
+        size_t pos = 0;
+        uint64_t value = std::stoull(text, &pos);
+        if (pos < text.size()) {
+            char unit = static_cast<char>(std::toupper(text[pos]));
+            if (unit == 'K') value *= 1024ULL;
+            else if (unit == 'M') value *= 1024ULL * 1024;
+            else if (unit == 'G') value *= 1024ULL * 1024 * 1024;
+            else return fallback;
+        }
+        return value;
+    } catch (...) {
+        return fallback;
+    }
+}
+
+std::string UniqueSuffix() {
+    static thread_local std::mt19937_64 rng{std::random_device{}()};
+    std::ostringstream ss;
+    ss << std::hex << rng();
+    return ss.str();
+}
+
+} // namespace
+
+ObjectCache::ObjectCache()
+    : max_bytes_(kDefaultMaxBytes)
+    , enabled_(false)
+{
+    const char* disabled = std::getenv("LUMOS_NO_CACHE");
+    if (disabled != nullptr && std::string(disabled) != "0") {
+        return;
+    }
+
+    std::string root = DefaultDirectory();
+    if (root.empty()) {
+        return;
+    }
+
+    const char* size = std::getenv("LUMOS_CACHE_SIZE");
+    if (size != nullptr) {
+        max_bytes_ = ParseSize(size, kDefaultMaxBytes);
+    }
+
+    root_ = root;
+    objects_dir_ = (fs::path(root) / "objects").string();
+    std::error_code ec;
+    fs::create_directories(objects_dir_, ec);
+    enabled_ = !ec;
+}
+
+std::string ObjectCache::DefaultDirectory() {
+    if (const char* dir = std::getenv("LUMOS_CACHE_DIR")) {
+        return dir;
+    }
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA")) {
+        return (fs::path(local) / "lumos").string();
+    }
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        return (fs::path(xdg) / "lumos").string();
+    }
+    if (const char* home = std::getenv("HOME")) {
+        return (fs::path(home) / ".cache" / "lumos").string();
+    }
+#endif
+    return "";
+}
+
+uint64_t ObjectCache::Hash(const std::string& data, uint64_t seed) {
+    uint64_t hash = seed;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string ObjectCache::MakeKey(const std::string& compiler,
+                                 const std::string& flags,
+                                 const std::string& content) {
+    // Length-prefix each part so field boundaries can't be confused
+    std::string header = std::to_string(compiler.size()) + ":" + compiler + "\n" +
+                         std::to_string(flags.size()) + ":" + flags + "\n";
+
+    uint64_t h1 = Hash(content, Hash(header));
+    uint64_t h2 = Hash(content, Hash(header, h1 ^ 0x9e3779b97f4a7c15ULL));
+
+    std::ostringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << h1 << std::setw(16) << h2;
+    return ss.str();
+}
+
+std::string ObjectCache::PathForKey(const std::string& key) const {
+    return (fs::path(objects_dir_) / key.substr(0, 2) / (key + ".o")).string();
+}
+
+bool ObjectCache::Fetch(const std::string& key, const std::string& dest_file) const {
+    if (!enabled_) {
+        return false;
+    }
+
+    std::string cached = PathForKey(key);
+    std::error_code ec;
+    if (!fs::exists(cached, ec)) {
+        return false;
+    }
+
+    // Copy via a temporary so an interrupted copy never leaves a truncated object
+    std::string tmp = dest_file + ".tmp." + UniqueSuffix();
+    fs::copy_file(cached, tmp, fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    fs::rename(tmp, dest_file, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+
+    // Refresh the entry's timestamp so LRU eviction keeps it
+    fs::last_write_time(cached, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+bool ObjectCache::Store(const std::string& key, const std::string& object_file) const {
+    if (!enabled_) {
+        return false;
+    }
+
+    std::string cached = PathForKey(key);
+    std::error_code ec;
+    fs::create_directories(fs::path(cached).parent_path(), ec);
+    if (ec) {
+        return false;
+    }
+
+    // Rename into place so concurrent builds never see a partial entry
+    std::string tmp = cached + ".tmp." + UniqueSuffix();
+    fs::copy_file(object_file, tmp, fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    fs::rename(tmp, cached, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+void ObjectCache::Trim() const {
+    if (!enabled_) {
+        return;
+    }
+
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type time;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    // Prebuilt HAL libraries live next to the objects and share the budget
+    for (const fs::path& dir : {fs::path(objects_dir_), fs::path(root_) / "hal"}) {
+        if (!fs::exists(dir, ec)) {
+            continue;
+        }
+        for (auto it = fs::recursive_directory_iterator(dir, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+            Entry entry{it->path(), it->file_size(ec), it->last_write_time(ec)};
+            total += entry.size;
+            entries.push_back(entry);
+        }
+        ec.clear();
+    }
+
+    if (total <= max_bytes_) {
+        return;
+    }
+
+    // Oldest first
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.time < b.time;
+    });
+
+    size_t removed = 0;
+    for (const auto& entry : entries) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        if (fs::remove(entry.path, ec)) {
+            total -= entry.size;
+            removed++;
+        }
+    }
+
+    std::cout << "Object cache: evicted " << removed << " entries" << std::endl;
+}
+
+} // namespace Lumos
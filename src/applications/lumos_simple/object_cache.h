@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Content-addressed object file cache shared between projects
+ *
+ * Objects are stored under <cache dir>/objects/<k0k1>/<key>.o where the key
+ * is a hash of the preprocessed translation unit, the compiler path and the
+ * code generation flags. Identical HAL, wrapper and board sources compiled
+ * by different projects therefore share a single cached object.
+ *
+ * The cache directory defaults to $LUMOS_CACHE_DIR, then
+ * $XDG_CACHE_HOME/lumos, ~/.cache/lumos (%LOCALAPPDATA%\\lumos on Windows).
+ * Its size is bounded by $LUMOS_CACHE_SIZE (bytes, or with a K/M/G suffix,
+ * default 2G); the least recently used objects are evicted first.
+ * Setting LUMOS_NO_CACHE=1 disables the cache.
+ */
+class ObjectCache {
+public:
+    /**
+     * @brief Construct a cache rooted at the default location
+     */
+    ObjectCache();
+
+    /**
+     * @brief Whether the cache is usable (enabled and directory writable)
+     */
+    bool IsEnabled() const { return enabled_; }
+
+    /**
+     * @brief Cache root directory (parent of objects/)
+     */
+    const std::string& GetRoot() const { return root_; }
+
+    /**
+     * @brief Disable the cache for this run (e.g. --no-cache)
+     */
+    void Disable() { enabled_ = false; }
+
+    /**
+     * @brief Copy a cached object to @p dest_file
+     * @param key Cache key from MakeKey()
+     * @param dest_file Destination object path
+     * @return true on a cache hit
+     */
+    bool Fetch(const std::string& key, const std::string& dest_file) const;
+
+    /**
+     * @brief Insert an object into the cache
+     * @param key Cache key from MakeKey()
+     * @param object_file Freshly compiled object
+     * @return true if stored
+     */
+    bool Store(const std::string& key, const std::string& object_file) const;
+
+    /**
+     * @brief Evict least recently used objects until under the size limit
+     */
+    void Trim() const;
+
+    /**
+     * @brief Build a cache key
+     * @param compiler Compiler executable path
+     * @param flags Code generation flags (no paths, defines or includes)
+     * @param content Preprocessed source (or raw source for plain assembly)
+     * @return 32 hex digit key
+     */
+    static std::string MakeKey(const std::string& compiler,
+                               const std::string& flags,
+                               const std::string& content);
+
+    /**
+     * @brief 64-bit FNV-1a hash
+     */
+    static uint64_t Hash(const std::string& data, uint64_t seed = 0xcbf29ce484222325ULL);
+
+    /**
+     * @brief Default cache root directory (empty if none can be determined)
+     */
+    static std::string DefaultDirectory();
+
+private:
+    std::string root_;
+    std::string objects_dir_;
+    uint64_t max_bytes_;
+    bool enabled_;
+
+    std::string PathForKey(const std::string& key) const;
+};
+
+} // namespace Lumos
@@ -0,0 +1,269 @@
+#include "process.h"
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <spawn.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+    extern char** environ;
+#endif
+
+namespace Lumos {
+
+namespace {
+
+// Pipe creation and spawning are serialized so a child launched on one
+// thread never inherits the write end of another job's output pipe, which
+// would keep that pipe from reaching EOF
+std::mutex g_spawn_mutex;
+
+bool NeedsQuoting(const std::string& arg) {
+    return arg.empty() || arg.find_first_of(" \t\n\"'\\") != std::string::npos;
+}
+
+// Quoting understood by GCC's response-file parser (libiberty buildargv)
+std::string QuoteForResponseFile(const std::string& arg) {
+    std::string quoted = "\"";
+    for (char c : arg) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    quoted += "\"";
+    return quoted;
+}
+
+#ifdef _WIN32
+// Quoting understood by the MSVC runtime's command-line parser
+std::string QuoteForWindows(const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos) {
+        return arg;
+    }
+
+    std::string quoted = "\"";
+    for (size_t i = 0; ; ++i) {
+        size_t backslashes = 0;
+        while (i < arg.size() && arg[i] == '\\') {
+            ++backslashes;
+            ++i;
+        }
+        if (i == arg.size()) {
+            // Double trailing backslashes so the closing quote isn't escaped
+            quoted.append(backslashes * 2, '\\');
+            break;
+        } else if (arg[i] == '"') {
+            quoted.append(backslashes * 2 + 1, '\\');
+            quoted += '"';
+        } else {
+            quoted.append(backslashes, '\\');
+            quoted += arg[i];
+        }
+    }
+    quoted += "\"";
+    return quoted;
+}
+#endif
+
+ProcessResult Spawn(const std::vector<std::string>& args) {
+    ProcessResult result;
+    if (args.empty()) {
+        result.output = "Error: Empty command\n";
+        return result;
+    }
+
+#ifdef _WIN32
+    std::string command_line;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) command_line += ' ';
+        command_line += QuoteForWindows(args[i]);
+    }
+
+    SECURITY_ATTRIBUTES sa;
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+
+    HANDLE read_pipe = NULL;
+    HANDLE write_pipe = NULL;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&pi, sizeof(pi));
+
+    {
+        std::lock_guard<std::mutex> lock(g_spawn_mutex);
+        if (!CreatePipe(&read_pipe, &write_pipe, &sa, 0)) {
+            result.output = "Error: Failed to create pipe\n";
+            return result;
+        }
+        SetHandleInformation(read_pipe, HANDLE_FLAG_INHERIT, 0);
+
+        STARTUPINFOA si;
+        ZeroMemory(&si, sizeof(si));
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = write_pipe;
+        si.hStdError = write_pipe;
+
+        BOOL ok = CreateProcessA(NULL, &command_line[0], NULL, NULL, TRUE,
+                                 0, NULL, NULL, &si, &pi);
+        CloseHandle(write_pipe);
+        if (!ok) {
+            CloseHandle(read_pipe);
+            result.output = "Error: Failed to start " + args[0] +
+                            " (error " + std::to_string(GetLastError()) + ")\n";
+            return result;
+        }
+    }
+    result.started = true;
+
+    char buffer[4096];
+    DWORD n = 0;
+    while (ReadFile(read_pipe, buffer, sizeof(buffer), &n, NULL) && n > 0) {
+        result.output.append(buffer, n);
+    }
+    CloseHandle(read_pipe);
+
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD exit_code = 0;
+    GetExitCodeProcess(pi.hProcess, &exit_code);
+    result.exit_code = static_cast<int>(exit_code);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+#else
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    pid_t pid = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_spawn_mutex);
+        if (pipe(fds) != 0) {
+            result.output = std::string("Error: Failed to create pipe: ") + strerror(errno) + "\n";
+            return result;
+        }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+        int rc = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+
+        if (rc != 0) {
+            close(fds[0]);
+            result.output = "Error: Failed to start " + args[0] + ": " + strerror(rc) + "\n";
+            return result;
+        }
+    }
+    result.started = true;
+
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        if (n > 0) {
+            result.output.append(buffer, static_cast<size_t>(n));
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            result.exit_code = -1;
+            return result;
+        }
+    }
+    if (WIFEXITED(status)) {
+        result.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        result.signal = WTERMSIG(status);
+    }
+#endif
+
+    return result;
+}
+
+} // namespace
+
+std::string ProcessResult::Describe() const {
+    if (!started) {
+        return "failed to start";
+    }
+    if (signal != 0) {
+        return "terminated by signal " + std::to_string(signal);
+    }
+    return "exit status " + std::to_string(exit_code);
+}
+
+size_t Process::MaxCommandLength() {
+#ifdef _WIN32
+    // CreateProcess accepts 32767 characters; leave headroom
+    return 30000;
+#else
+    return 128 * 1024;
+#endif
+}
+
+std::string Process::ToString(const std::vector<std::string>& args) {
+    std::string line;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) line += ' ';
+        line += NeedsQuoting(args[i]) ? QuoteForResponseFile(args[i]) : args[i];
+    }
+    return line;
+}
+
+ProcessResult Process::Run(const std::vector<std::string>& args, const std::string& response_file,
+                           size_t program_args) {
+    if (response_file.empty() || args.size() <= program_args) {
+        return Spawn(args);
+    }
+
+    size_t length = 0;
+    for (const auto& arg : args) {
+        length += arg.size() + 3;
+    }
+    if (length <= MaxCommandLength()) {
+        return Spawn(args);
+    }
+
+    // Too long for the platform: move everything after the program name
+    // (and any launcher in front of it) into @response_file, which GCC and
+    // binutils expand themselves
+    std::ofstream file(response_file, std::ios::trunc);
+    if (!file.is_open()) {
+        ProcessResult result;
+        result.output = "Error: Failed to write response file " + response_file + "\n";
+        return result;
+    }
+    for (size_t i = program_args; i < args.size(); ++i) {
+        file << QuoteForResponseFile(args[i]) << "\n";
+    }
+    file.close();
+
+    std::vector<std::string> command(args.begin(), args.begin() + program_args);
+    command.push_back("@" + response_file);
+    return Spawn(command);
+}
+
+} // namespace Lumos
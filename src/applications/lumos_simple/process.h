@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Result of running a child process
+ */
+struct ProcessResult {
+    bool started = false;   // false if the executable could not be launched
+    int exit_code = -1;     // exit status, or -1 if the process didn't exit normally
+    int signal = 0;         // terminating signal (POSIX only), 0 if none
+    std::string output;     // combined stdout and stderr
+
+    bool Succeeded() const { return started && exit_code == 0; }
+
+    /**
+     * @brief Human-readable description of how the process ended
+     */
+    std::string Describe() const;
+};
+
+/**
+ * @brief Launch processes directly without going through a shell
+ *
+ * Uses posix_spawn on Linux/macOS and CreateProcess on Windows. Arguments
+ * are passed as a vector, so paths with spaces need no quoting. stdout and
+ * stderr are captured together, in order, into ProcessResult::output.
+ */
+class Process {
+public:
+    /**
+     * @brief Run a program to completion
+     * @param args Program path followed by its arguments
+     * @param response_file Where to write a GCC-style @response file if the
+     *        command line is too long for the platform (empty = never use one)
+     * @param program_args Leading arguments kept on the command line when a
+     *        response file is used, e.g. 2 for a compiler behind ccache
+     * @return Launch status, exit code and captured output
+     */
+    static ProcessResult Run(const std::vector<std::string>& args,
+                             const std::string& response_file = "",
+                             size_t program_args = 1);
+
+    /**
+     * @brief Join arguments into a printable command line
+     *
+     * Arguments containing whitespace or quotes are quoted. Used for logs
+     * and for the command stamps that drive incremental builds.
+     */
+    static std::string ToString(const std::vector<std::string>& args);
+
+    /**
+     * @brief Longest command line passed directly before switching to a response file
+     */
+    static size_t MaxCommandLength();
+};
+
+} // namespace Lumos
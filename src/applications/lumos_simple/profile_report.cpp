@@ -0,0 +1,263 @@
+#include "profile_report.h"
+#include "elf_file.h"
+#include "interrupt_poll.h"
+#include "serial.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+namespace Lumos {
+
+namespace {
+
+const uint8_t kFrameMarker = 0xFF;      // Profiler::kFrameMarker
+const size_t kHeaderBytes = 3;          // Marker, count, dropped (after the 0x00)
+const size_t kMaxSamplesPerFrame = 16;  // Profiler::kSamplesPerFrame
+
+// CRC-8, polynomial 0x07, as the firmware computes it
+uint8_t Crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t ReadU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Readable C++ names; C symbols are returned as they are
+std::string Demangle(const std::string& name) {
+#if defined(__GNUC__)
+    int status = 0;
+    char* readable = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (readable != nullptr) {
+        std::string result = status == 0 ? readable : name;
+        std::free(readable);
+        return result;
+    }
+#endif
+    return name;
+}
+
+// Rows of @p counts, highest first
+template <typename Key>
+std::vector<std::pair<Key, uint64_t>> SortByCount(const std::map<Key, uint64_t>& counts) {
+    std::vector<std::pair<Key, uint64_t>> rows(counts.begin(), counts.end());
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const std::pair<Key, uint64_t>& a, const std::pair<Key, uint64_t>& b) {
+                         return a.second > b.second;
+                     });
+    return rows;
+}
+
+} // namespace
+
+ProfilerStreamParser::Result ProfilerStreamParser::Feed(uint8_t byte) {
+    if (!in_frame_) {
+        if (byte != 0) {
+            return Result::Text;
+        }
+        in_frame_ = true;
+        pending_.clear();
+        return Result::Pending;
+    }
+
+    pending_.push_back(byte);
+    if (pending_[0] != kFrameMarker) {
+        // Another 0x00-framed stream (e.g. a token log); not ours
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    if (pending_.size() >= 2 && pending_[1] > kMaxSamplesPerFrame) {
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    if (pending_.size() < kHeaderBytes) {
+        return Result::Pending;
+    }
+    const size_t total = kHeaderBytes + pending_[1] * 8 + 1;
+    if (pending_.size() < total) {
+        return Result::Pending;
+    }
+
+    in_frame_ = false;
+    if (Crc8(pending_.data() + 1, total - 2) != pending_[total - 1]) {
+        ++errors_;
+        return Result::Error;
+    }
+    samples_.resize(pending_[1]);
+    for (size_t i = 0; i < samples_.size(); ++i) {
+        samples_[i].pc = ReadU32(pending_.data() + kHeaderBytes + i * 8);
+        samples_[i].lr = ReadU32(pending_.data() + kHeaderBytes + i * 8 + 4);
+    }
+    dropped_ = pending_[2];
+    return Result::Frame;
+}
+
+bool ProfileReport::LoadSymbols(const std::string& elf_path, std::string& error) {
+    functions_.clear();
+
+    ElfFile elf;
+    if (!elf.Load(elf_path, error)) {
+        return false;
+    }
+    for (const ElfSymbol& symbol : elf.GetSymbols()) {
+        if (symbol.function && symbol.size > 0) {
+            // Thumb function symbols have bit 0 set
+            functions_.push_back({static_cast<uint32_t>(symbol.address & ~1ull),
+                                  static_cast<uint32_t>(symbol.size), Demangle(symbol.name)});
+        }
+    }
+    if (functions_.empty()) {
+        error = elf_path + " has no function symbols";
+        return false;
+    }
+    std::sort(functions_.begin(), functions_.end(),
+              [](const Function& a, const Function& b) { return a.address < b.address; });
+    return true;
+}
+
+std::string ProfileReport::Symbolize(uint32_t address) const {
+    address &= ~1u;
+    auto it = std::upper_bound(functions_.begin(), functions_.end(), address,
+                               [](uint32_t value, const Function& function) { return value < function.address; });
+    if (it != functions_.begin()) {
+        --it;
+        if (address - it->address < it->size) {
+            return it->name;
+        }
+    }
+    char text[16];
+    snprintf(text, sizeof(text), "0x%08x", static_cast<unsigned>(address));
+    return text;
+}
+
+void ProfileReport::Add(const std::vector<ProfilerSample>& samples, uint32_t dropped) {
+    dropped_ += dropped;
+    for (const ProfilerSample& sample : samples) {
+        const std::string function = Symbolize(sample.pc);
+        // An EXC_RETURN value: the interrupt hit the first instructions of a handler
+        const std::string caller = (sample.lr & 0xFFFFFF00u) == 0xFFFFFF00u ? "[exception]" : Symbolize(sample.lr);
+        ++flat_[function];
+        ++calls_[std::make_pair(caller, function)];
+        ++samples_;
+    }
+}
+
+void ProfileReport::Print(std::ostream& out, size_t top) const {
+    if (samples_ == 0) {
+        out << "No samples received" << std::endl;
+        return;
+    }
+
+    char line[256];
+    out << "Flat profile (" << samples_ << " samples";
+    if (dropped_ > 0) {
+        out << ", " << dropped_ << " dropped on the target";
+    }
+    out << "):" << std::endl;
+    out << "  samples       %  function" << std::endl;
+    size_t rows = 0;
+    for (const auto& row : SortByCount(flat_)) {
+        if (top > 0 && rows++ >= top) {
+            break;
+        }
+        snprintf(line, sizeof(line), "  %7llu  %5.1f%%  %s", static_cast<unsigned long long>(row.second),
+                 100.0 * row.second / samples_, row.first.c_str());
+        out << line << std::endl;
+    }
+
+    out << std::endl << "Callers (stacked LR, one level):" << std::endl;
+    out << "  samples       %  caller -> function" << std::endl;
+    rows = 0;
+    for (const auto& row : SortByCount(calls_)) {
+        if (top > 0 && rows++ >= top) {
+            break;
+        }
+        snprintf(line, sizeof(line), "  %7llu  %5.1f%%  %s -> %s",
+                 static_cast<unsigned long long>(row.second), 100.0 * row.second / samples_,
+                 row.first.first.c_str(), row.first.second.c_str());
+        out << line << std::endl;
+    }
+}
+
+bool ProfileReport::WriteFolded(const std::string& path, std::string& error) const {
+    std::ofstream file(path);
+    if (!file) {
+        error = "Cannot write " + path;
+        return false;
+    }
+    for (const auto& call : calls_) {
+        file << call.first.first << ";" << call.first.second << " " << call.second << "\n";
+    }
+    if (!file) {
+        error = "Failed writing " + path;
+        return false;
+    }
+    return true;
+}
+
+bool RunProfile(const std::string& port, int baud_rate, double duration_s,
+                const volatile bool& running, ProfileReport& report, std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    ProfilerStreamParser parser;
+    const auto start = std::chrono::steady_clock::now();
+    auto last_progress = start;
+    uint8_t buffer[1024];
+    while (running) {
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - start).count();
+        if (duration_s > 0 && elapsed >= duration_s) {
+            break;
+        }
+        if (now - last_progress >= std::chrono::seconds(1)) {
+            last_progress = now;
+            std::cerr << "\r" << report.GetSampleCount() << " samples" << std::flush;
+        }
+
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+        for (int i = 0; i < bytes_read; ++i) {
+            const ProfilerStreamParser::Result result = parser.Feed(buffer[i]);
+            if (result == ProfilerStreamParser::Result::Frame) {
+                report.Add(parser.GetSamples(), parser.GetDropped());
+            } else if (result == ProfilerStreamParser::Result::Text) {
+                std::cout << static_cast<char>(buffer[i]);
+            }
+        }
+    }
+    std::cerr << "\r" << report.GetSampleCount() << " samples" << std::endl;
+    if (parser.GetErrorCount() > 0) {
+        std::cerr << parser.GetErrorCount() << " corrupt profiler frames dropped" << std::endl;
+    }
+
+    serial.Close();
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Sample of the on-target profiler (framework/profiler.h)
+ */
+struct ProfilerSample {
+    uint32_t pc = 0;
+    uint32_t lr = 0;
+};
+
+/**
+ * @brief Picks profiler frames out of a serial byte stream
+ *
+ * Frames start with 0x00 0xFF; other bytes are ordinary output. A frame
+ * with a bad CRC is dropped and counted.
+ */
+class ProfilerStreamParser {
+public:
+    enum class Result {
+        Text,       // The byte is ordinary output
+        Pending,    // Consumed as part of a frame
+        Frame,      // A frame completed, see GetSamples()/GetDropped()
+        Error       // A corrupt frame was dropped
+    };
+
+    Result Feed(uint8_t byte);
+
+    const std::vector<ProfilerSample>& GetSamples() const { return samples_; }
+    uint32_t GetDropped() const { return dropped_; }
+    uint64_t GetErrorCount() const { return errors_; }
+
+private:
+    std::vector<uint8_t> pending_;  // Frame bytes after the 0x00
+    bool in_frame_ = false;
+    std::vector<ProfilerSample> samples_;
+    uint32_t dropped_ = 0;
+    uint64_t errors_ = 0;
+};
+
+/**
+ * @brief Symbolized profile built from profiler samples (lumos profile)
+ *
+ * PCs are attributed to the function symbols of the firmware.elf of the
+ * running build; addresses outside every function are counted per
+ * address. The stacked LR gives the caller, so the call profile and the
+ * folded stacks are one level deep.
+ */
+class ProfileReport {
+public:
+    /**
+     * @brief Read the function symbols of @p elf_path
+     * @return false with @p error set if the file can't be read or has no functions
+     */
+    bool LoadSymbols(const std::string& elf_path, std::string& error);
+
+    void Add(const std::vector<ProfilerSample>& samples, uint32_t dropped);
+
+    uint64_t GetSampleCount() const { return samples_; }
+    uint64_t GetDroppedCount() const { return dropped_; }
+
+    /**
+     * @brief Print the flat profile and the caller -> callee pairs
+     * @param top Rows per table, 0 for all
+     */
+    void Print(std::ostream& out, size_t top) const;
+
+    /**
+     * @brief Write "caller;function count" lines for flame graph tools
+     */
+    bool WriteFolded(const std::string& path, std::string& error) const;
+
+    /**
+     * @brief Function containing @p address, or its hex form if none
+     */
+    std::string Symbolize(uint32_t address) const;
+
+private:
+    struct Function {
+        uint32_t address;
+        uint32_t size;
+        std::string name;
+    };
+
+    std::vector<Function> functions_;   // Sorted by address
+    std::map<std::string, uint64_t> flat_;
+    std::map<std::pair<std::string, std::string>, uint64_t> calls_;  // (caller, function)
+    uint64_t samples_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+/**
+ * @brief Collect samples from @p port into @p report
+ *
+ * Runs until @p running turns false or, if @p duration_s is positive,
+ * for that many seconds; other output of the firmware is passed through.
+ */
+bool RunProfile(const std::string& port, int baud_rate, double duration_s,
+                const volatile bool& running, ProfileReport& report, std::string& error);
+
+} // namespace Lumos
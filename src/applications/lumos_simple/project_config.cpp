@@ -1,33 +1,55 @@
 #include "project_config.h"
+#include "source_glob.h"
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
 namespace Lumos {
 
+namespace {
+
+// 'board' is one name or a list of them
+bool ParseBoards(const YAML::Node& node, std::vector<std::string>& boards, std::string& error) {
+    boards.clear();
+    if (node.IsSequence()) {
+        for (const auto& item : node) {
+            std::string name = item.as<std::string>();
+            if (std::find(boards.begin(), boards.end(), name) != boards.end()) {
+                error = "Board '" + name + "' is listed twice";
+                return false;
+            }
+            boards.push_back(name);
+        }
+        if (boards.empty()) {
+            error = "'board' lists no boards";
+            return false;
+        }
+    } else {
+        boards.push_back(node.as<std::string>());
+    }
+    return true;
+}
+
+} // namespace
+
 bool ProjectConfig::Load(const std::string& yaml_path, const std::string& project_dir) {
     try {
         YAML::Node config = YAML::LoadFile(yaml_path);
 
-        // Load sources
+        // Load sources: files and patterns (see SourceGlob), or every .c
+        // and .cpp file in the project directory without a sources key
         if (config["sources"]) {
-            // Use explicitly specified sources
-            sources = config["sources"].as<std::vector<std::string>>();
+            source_entries = config["sources"].as<std::vector<std::string>>();
+            ExpandSources(project_dir);
         } else {
-            // Auto-discover all .c and .cpp files in the project directory
             std::cout << "No 'sources' key found, auto-discovering .c and .cpp files..." << std::endl;
-
-            std::error_code ec;
-            for (const auto& entry : fs::directory_iterator(project_dir, ec)) {
-                if (entry.is_regular_file()) {
-                    std::string extension = entry.path().extension().string();
-                    if (extension == ".c" || extension == ".cpp") {
-                        sources.push_back(entry.path().filename().string());
-                    }
-                }
-            }
+            sources_discovered = true;
+            source_entries = {"*.c", "*.cpp"};
+            ExpandSources(project_dir);
 
             if (sources.empty()) {
                 std::cout << "  No source files found yet (will be created if needed)" << std::endl;
@@ -38,7 +60,12 @@ bool ProjectConfig::Load(const std::string& yaml_path, const std::string& projec
 
         // Load board
         if (config["board"]) {
-            board = config["board"].as<std::string>();
+            std::string error;
+            if (!ParseBoards(config["board"], boards, error)) {
+                std::cerr << "Error: " << error << " in " << yaml_path << std::endl;
+                return false;
+            }
+            board = boards.front();
         } else {
             std::cerr << "Error: 'board' field not found in " << yaml_path << std::endl;
             return false;
@@ -49,6 +76,166 @@ bool ProjectConfig::Load(const std::string& yaml_path, const std::string& projec
             hal_modules = config["hal_modules"].as<std::vector<std::string>>();
         }
 
+        // Load build profile (optional)
+        if (config["profile"]) {
+            profile = config["profile"].as<std::string>();
+            if (GetProfileFlags(profile).empty()) {
+                std::cerr << "Error: Unknown profile '" << profile << "' in " << yaml_path
+                          << " (expected debug, release, size or fast)" << std::endl;
+                return false;
+            }
+        }
+
+        // Load LTO switch (optional)
+        if (config["lto"]) {
+            lto = config["lto"].as<bool>();
+        }
+
+        // Load fast memcpy()/memset() selection (optional)
+        if (config["fast_libc"]) {
+            fast_libc = config["fast_libc"].as<std::string>();
+            if (fast_libc != "auto" && fast_libc != "true" && fast_libc != "false") {
+                std::cerr << "Error: Unknown fast_libc '" << fast_libc << "' in " << yaml_path
+                          << " (expected auto, true or false)" << std::endl;
+                return false;
+            }
+        }
+
+        // Load scope trace switch (optional)
+        if (config["trace"]) {
+            trace = config["trace"].as<bool>();
+        }
+
+        // Load CMSIS-DSP switch (optional)
+        if (config["dsp"]) {
+            dsp = config["dsp"].as<bool>();
+        }
+
+        // Load event loop switch (optional)
+        if (config["event_loop"]) {
+            event_loop = config["event_loop"].as<bool>();
+        }
+
+        // Load C++ standard (optional); 20 enables coroutines (framework/coroutine.h)
+        if (config["cxx_standard"]) {
+            cxx_standard = config["cxx_standard"].as<int>();
+            if (cxx_standard != 17 && cxx_standard != 20) {
+                std::cerr << "Error: Unknown cxx_standard " << cxx_standard << " in " << yaml_path
+                          << " (expected 17 or 20)" << std::endl;
+                return false;
+            }
+        }
+
+        // Load precompiled header switch (optional)
+        if (config["pch"]) {
+            pch = config["pch"].as<bool>();
+        }
+
+        // Load system clock profile (optional)
+        if (config["clock"]) {
+            clock = config["clock"].as<std::string>();
+            if (GetClockDefine(clock).empty()) {
+                std::cerr << "Error: Unknown clock profile '" << clock << "' in " << yaml_path
+                          << " (expected max, balanced or low_power)" << std::endl;
+                return false;
+            }
+        }
+
+        // Load the Cortex-M0+ microsecond timer pair (optional): 'TIM2,TIM4'
+        // or a list, the 32-bit timer first
+        if (config["us_timers"]) {
+            YAML::Node node = config["us_timers"];
+            us_timers.clear();
+            if (node.IsSequence()) {
+                for (const auto& entry : node) {
+                    us_timers.push_back(entry.as<std::string>());
+                }
+            } else {
+                std::stringstream list(node.as<std::string>());
+                std::string entry;
+                while (std::getline(list, entry, ',')) {
+                    entry.erase(0, entry.find_first_not_of(" \t"));
+                    entry.erase(entry.find_last_not_of(" \t") + 1);
+                    us_timers.push_back(entry);
+                }
+            }
+            bool valid = us_timers.size() == 2 && us_timers[0] != us_timers[1];
+            for (const auto& timer : us_timers) {
+                valid = valid && timer.size() > 3 && timer.compare(0, 3, "TIM") == 0 &&
+                        timer.find_first_not_of("0123456789", 3) == std::string::npos;
+            }
+            if (!valid) {
+                std::cerr << "Error: us_timers in " << yaml_path
+                          << " must name two timers, e.g. TIM2,TIM4" << std::endl;
+                return false;
+            }
+        }
+
+        // Load RTOS backend (optional): 'rtos: freertos' or a map with
+        // kernel, stack_pool and default_stack (stack sizes in words)
+        if (config["rtos"]) {
+            YAML::Node node = config["rtos"];
+            if (node.IsScalar()) {
+                rtos = node.as<std::string>();
+            } else {
+                if (node["kernel"]) {
+                    rtos = node["kernel"].as<std::string>();
+                }
+                if (node["stack_pool"]) {
+                    rtos_stack_pool = node["stack_pool"].as<uint32_t>();
+                }
+                if (node["default_stack"]) {
+                    rtos_default_stack = node["default_stack"].as<uint32_t>();
+                }
+            }
+            if (rtos != "freertos") {
+                std::cerr << "Error: Unknown rtos '" << rtos << "' in " << yaml_path
+                          << " (expected freertos)" << std::endl;
+                return false;
+            }
+            if (rtos_default_stack > rtos_stack_pool) {
+                std::cerr << "Error: rtos default_stack (" << rtos_default_stack
+                          << " words) is larger than stack_pool (" << rtos_stack_pool
+                          << " words) in " << yaml_path << std::endl;
+                return false;
+            }
+        }
+
+        // Load interface files (optional), relative to the project
+        if (config["interfaces"]) {
+            interfaces = config["interfaces"].as<std::vector<std::string>>();
+        }
+
+        // Load extra include directories (optional), relative to the project
+        if (config["include_dirs"]) {
+            include_dirs = config["include_dirs"].as<std::vector<std::string>>();
+        }
+
+        // Load wrapper selection (optional)
+        if (config["wrappers"]) {
+            wrappers = config["wrappers"].as<std::string>();
+            if (wrappers != "all" && wrappers != "auto") {
+                std::cerr << "Error: Unknown wrappers '" << wrappers << "' in " << yaml_path
+                          << " (expected auto or all)" << std::endl;
+                return false;
+            }
+        }
+
+        // Load HAL unity build switch (optional)
+        if (config["hal_unity"]) {
+            hal_unity = config["hal_unity"].as<bool>();
+        }
+
+        // Load compiler launcher (optional): ccache, sccache, distcc, ...
+        if (config["compiler_launcher"]) {
+            compiler_launcher = config["compiler_launcher"].as<std::string>();
+        }
+
+        // Load toolchain selection (optional), see ToolchainFinder::Select()
+        if (config["toolchain"]) {
+            toolchain = config["toolchain"].as<std::string>();
+        }
+
         return true;
     } catch (const YAML::Exception& e) {
         std::cerr << "Error parsing " << yaml_path << ": " << e.what() << std::endl;
@@ -56,6 +243,96 @@ bool ProjectConfig::Load(const std::string& yaml_path, const std::string& projec
     }
 }
 
+void ProjectConfig::ExpandSources(const std::string& project_dir) {
+    SourceGlob glob(project_dir, project_dir + "/build/source_cache");
+    source_dirs.clear();
+    sources = glob.Expand(source_entries, &source_dirs);
+    glob.Save();
+}
+
+bool ProjectConfig::ReadBoards(const std::string& yaml_path, std::vector<std::string>& boards) {
+    try {
+        YAML::Node config = YAML::LoadFile(yaml_path);
+        std::string error;
+        return config["board"] && ParseBoards(config["board"], boards, error);
+    } catch (const YAML::Exception&) {
+        return false;
+    }
+}
+
+std::string ProjectConfig::ReadToolchain(const std::string& yaml_path) {
+    try {
+        YAML::Node config = YAML::LoadFile(yaml_path);
+        return config["toolchain"] ? config["toolchain"].as<std::string>() : "";
+    } catch (const YAML::Exception&) {
+        return "";
+    }
+}
+
+std::vector<std::string> ProjectConfig::GetProfileFlags(const std::string& profile) {
+    if (profile == "debug") {
+        return {"-Og", "-g3"};
+    } else if (profile == "release") {
+        return {"-O2", "-g", "-DNDEBUG"};
+    } else if (profile == "size") {
+        return {"-Os", "-g", "-DNDEBUG"};
+    } else if (profile == "fast") {
+        return {"-O3", "-g", "-DNDEBUG"};
+    }
+    return {};
+}
+
+bool ProjectConfig::UsesFastLibc(const std::string& profile) const {
+    // Debug builds keep newlib's, which step through line by line; the
+    // size profile saves the few hundred bytes
+    if (fast_libc == "auto") {
+        return profile == "release" || profile == "fast";
+    }
+    return fast_libc == "true";
+}
+
+std::string ProjectConfig::GetClockDefine(const std::string& clock) {
+    if (clock == "max") {
+        return "LUMOS_CLOCK_MAX";
+    } else if (clock == "balanced") {
+        return "LUMOS_CLOCK_BALANCED";
+    } else if (clock == "low_power") {
+        return "LUMOS_CLOCK_LOW_POWER";
+    }
+    return "";
+}
+
+std::vector<std::string> ProjectConfig::GetWrapperModules(const std::string& wrapper) {
+    // Wrappers not listed (sys, gpio, peripherals, trace, ...) are used by
+    // the board files and the framework in every build
+    static const std::map<std::string, std::vector<std::string>> modules = {
+        {"adc", {"adc"}},
+        {"bus_device", {"i2c", "spi"}},
+        {"can", {"fdcan", "can"}},
+        {"filesystem", {"sd", "sdmmc"}},
+        {"flash", {"flash"}},
+        {"i2c", {"i2c"}},
+        {"sd", {"sd", "sdmmc"}},
+        {"spi", {"spi"}},
+        {"timer", {"tim", "adc"}},  // ADC conversions are timer triggered
+        {"uart", {"uart", "usart"}},
+        {"usb", {"pcd"}},
+        {"usb_msc", {"pcd"}},  // Compiles to nothing without the sd module
+    };
+    auto it = modules.find(wrapper);
+    return it == modules.end() ? std::vector<std::string>() : it->second;
+}
+
+std::vector<std::string> ProjectConfig::SplitLauncher(const std::string& launcher) {
+    std::vector<std::string> words;
+    std::istringstream stream(launcher);
+    std::string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
 BoardConfig BoardConfig::GetConfig(const std::string& board_name) {
     BoardConfig config;
     config.name = board_name;
@@ -82,6 +359,10 @@ BoardConfig BoardConfig::GetConfig(const std::string& board_name) {
         config.float_abi = "hard";
         config.fpu = "fpv5-sp-d16";
     }
+    else if (board_name == "Host") {
+        // Native simulator: host compiler, no MCU
+        config.platform = "host";
+    }
     // Add more boards as needed
     else {
         std::cerr << "Warning: Unknown board '" << board_name << "', defaulting to H7" << std::endl;
@@ -95,4 +376,25 @@ BoardConfig BoardConfig::GetConfig(const std::string& board_name) {
     return config;
 }
 
+bool BoardConfig::LoadBoardYaml(const std::string& yaml_path) {
+    try {
+        YAML::Node config = YAML::LoadFile(yaml_path);
+
+        if (config["MAX_CPU"]) {
+            max_cpu = config["MAX_CPU"].as<std::string>();
+        }
+
+        if (config["CLOCK_PROFILES"]) {
+            for (const auto& entry : config["CLOCK_PROFILES"]) {
+                clock_profiles[entry.first.as<std::string>()] = entry.second.as<std::string>();
+            }
+        }
+
+        return true;
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Error parsing " << yaml_path << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
 } // namespace Lumos
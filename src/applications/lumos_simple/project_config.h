@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -7,21 +9,77 @@ namespace Lumos {
 
 struct ProjectConfig {
     std::vector<std::string> sources;
-    std::string board;
+    std::vector<std::string> source_entries;  // As written: files and patterns (see SourceGlob)
+    std::vector<std::string> source_dirs;     // Directories the patterns were matched in
+    bool sources_discovered = false;          // No 'sources' key: every .c/.cpp in the project directory
+    std::string board;                     // The first of boards
+    std::vector<std::string> boards;       // Every board listed; several build as a matrix into build/<board>
     std::vector<std::string> hal_modules;  // Optional: uart, spi, i2c, adc, etc.
+    std::string profile = "debug";         // Optional: debug, release, size, fast
+    bool lto = false;                      // Optional: link-time optimization
+    std::string fast_libc = "auto";        // Optional: auto (on in the release and fast profiles), true, false
+    bool pch = true;                       // Optional: precompile lumos.h
+    bool trace = false;                    // Optional: LUMOS_TRACE scopes (wrapper/trace.h)
+    bool dsp = false;                      // Optional: CMSIS-DSP (framework/dsp_pipeline.h)
+    bool event_loop = false;               // Optional: event-driven main loop (wrapper/event_loop.h)
+    int cxx_standard = 0;                  // Optional: 17 or 20 (0 = the compiler's default)
+    std::string clock = "max";             // Optional: max, balanced, low_power
+    std::vector<std::string> us_timers;    // Optional: Cortex-M0+ microsecond time base, a 32-bit timer and one it clocks
+    std::string rtos;                      // Optional: freertos (empty = setup()/loop() only)
+    uint32_t rtos_stack_pool = 4096;       // Words of static stack shared by RTOS tasks
+    uint32_t rtos_default_stack = 256;     // Words per task unless the app asks for more
+    std::vector<std::string> interfaces;   // Optional: interface files compiled to build/generated
+    std::vector<std::string> include_dirs; // Optional: extra include directories, relative to the project
+    std::string wrappers = "auto";         // Optional: auto (only src/wrapper sources the HAL modules use), all
+    bool hal_unity = false;                // Optional: compile HAL drivers as a few merged TUs
+    std::string compiler_launcher;         // Optional: ccache, sccache, "distcc" ... prefixed to compiles
+    std::string toolchain;                 // Optional: newest, bundled, system, a GCC version or a directory
 
     bool Load(const std::string& yaml_path, const std::string& project_dir);
+
+    // Expand source_entries into sources again, e.g. after creating a file
+    void ExpandSources(const std::string& project_dir);
+
+    // Only the board list of a project.yaml (false if it can't be read)
+    static bool ReadBoards(const std::string& yaml_path, std::vector<std::string>& boards);
+
+    // Only the toolchain setting of a project.yaml (empty if unset or unreadable)
+    static std::string ReadToolchain(const std::string& yaml_path);
+
+    // Optimization flags for a build profile (empty if the name is unknown)
+    static std::vector<std::string> GetProfileFlags(const std::string& profile);
+
+    // Whether wrapper/fast_libc.cpp replaces memcpy()/memset() in @p profile
+    bool UsesFastLibc(const std::string& profile) const;
+
+    // Board-file define selecting a system clock profile (empty if unknown)
+    static std::string GetClockDefine(const std::string& clock);
+
+    // HAL modules a src/wrapper source is written for, e.g. "spi" -> {"spi"}
+    // (empty if every build needs it)
+    static std::vector<std::string> GetWrapperModules(const std::string& wrapper);
+
+    // Words of a compiler_launcher setting, e.g. "ccache distcc" (split on whitespace)
+    static std::vector<std::string> SplitLauncher(const std::string& launcher);
 };
 
 struct BoardConfig {
     std::string name;
-    std::string platform;  // f4, g0, g4, h7
+    std::string platform;  // f4, g0, g4, h7, or host (native simulator)
     std::string mcu;       // STM32F407xx, etc.
     std::string cpu;       // cortex-m4, cortex-m0+, etc.
     std::string float_abi; // soft, hard
     std::string fpu;       // fpv4-sp-d16, etc.
+    std::string max_cpu;                              // From config.yaml MAX_CPU, e.g. "550 MHz"
+    std::map<std::string, std::string> clock_profiles; // From config.yaml CLOCK_PROFILES
 
     static BoardConfig GetConfig(const std::string& board_name);
+
+    // The Host board builds a native program instead of firmware
+    bool IsHost() const { return platform == "host"; }
+
+    // Read MAX_CPU and CLOCK_PROFILES from the board's config.yaml
+    bool LoadBoardYaml(const std::string& yaml_path);
 };
 
 } // namespace Lumos
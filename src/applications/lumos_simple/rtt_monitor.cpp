@@ -0,0 +1,178 @@
+#include "rtt_monitor.h"
+
+#ifndef _WIN32
+
+#include "elf_file.h"
+#include "interrupt_poll.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace Lumos {
+
+namespace {
+
+// RTT control block: "SEGGER RTT" id, up/down counts, one ring each
+constexpr uint32_t kControlBlockSize = 16 + 8 + 2 * 24;
+constexpr int kConnectTimeoutMs = 10000;
+
+int ConnectLocal(unsigned int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+RttMonitor::RttMonitor(const RttOptions& options) : options_(options) {}
+
+RttMonitor::~RttMonitor() {
+    Stop();
+}
+
+bool RttMonitor::FindControlBlock(const std::string& elf_path, uint32_t& address, std::string& error) {
+    ElfFile elf;
+    if (!elf.Load(elf_path, error)) {
+        return false;
+    }
+    for (const auto& symbol : elf.GetSymbols()) {
+        if (symbol.name == "_SEGGER_RTT") {
+            address = static_cast<uint32_t>(symbol.address);
+            return true;
+        }
+    }
+    error = elf_path + " has no _SEGGER_RTT; log through RTTCom (rtt.h)";
+    return false;
+}
+
+bool RttMonitor::Start(std::string& error) {
+    char block[64];
+    snprintf(block, sizeof(block), "rtt setup 0x%08X %u \"SEGGER RTT\"", options_.control_block,
+             kControlBlockSize);
+    std::vector<std::string> args = SwdFlasher::GetOpenOcdArgs(options_.probe);
+    for (const std::string& command : {std::string("init"), std::string(block), std::string("rtt start"),
+                                       std::string("rtt polling_interval 1"),
+                                       "rtt server start " + std::to_string(options_.tcp_port) + " 0"}) {
+        args.insert(args.end(), {"-c", command});
+    }
+
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // OpenOCD's chatter goes to the log, so only target output is printed
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    const std::string log_path = options_.log_path.empty() ? "/dev/null" : options_.log_path;
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    int rc = posix_spawnp(&pid_, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        pid_ = -1;
+        error = "Failed to start " + options_.probe.openocd + ": " + strerror(rc) +
+                " (is it installed and on the PATH?)";
+        return false;
+    }
+
+    // The server listens once OpenOCD has attached and found the block
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kConnectTimeoutMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+        int status = 0;
+        if (waitpid(pid_, &status, WNOHANG) == pid_) {
+            pid_ = -1;
+            error = "OpenOCD exited before the RTT server started";
+            if (!options_.log_path.empty()) {
+                error += "; see " + options_.log_path;
+            }
+            return false;
+        }
+        fd_ = ConnectLocal(options_.tcp_port);
+        if (fd_ >= 0) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    error = "No RTT server on port " + std::to_string(options_.tcp_port) + " after " +
+            std::to_string(kConnectTimeoutMs / 1000) + " s";
+    Stop();
+    return false;
+}
+
+void RttMonitor::Stop() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    if (pid_ > 0) {
+        kill(pid_, SIGTERM);
+        int status = 0;
+        while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+        }
+        pid_ = -1;
+    }
+}
+
+uint64_t RttMonitor::Run(const volatile bool& running) {
+    uint64_t received = 0;
+    uint8_t buffer[16384];
+    while (running && fd_ >= 0) {
+        pollfd poll_fd = {fd_, POLLIN, 0};
+        int count = poll(&poll_fd, 1, kInterruptPollMs);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        if (count <= 0) {
+            continue;
+        }
+        ssize_t n = read(fd_, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cout << std::flush;
+            std::cerr << "\nOpenOCD closed the RTT connection" << std::endl;
+            break;
+        }
+        received += static_cast<uint64_t>(n);
+        printer_.Feed(buffer, static_cast<size_t>(n));
+        std::cout << std::flush;
+    }
+    if (printer_.GetErrorCount() > 0) {
+        std::cerr << printer_.GetErrorCount() << " corrupt log frames dropped" << std::endl;
+    }
+    return received;
+}
+
+} // namespace Lumos
+
+#endif // _WIN32
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include "swd_flasher.h"
+#include "token_log_decoder.h"
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace Lumos {
+
+struct RttOptions {
+    SwdOptions probe;                 // OpenOCD, probe and target
+    uint32_t control_block = 0;       // Address of _SEGGER_RTT in the firmware
+    unsigned int tcp_port = 19021;    // OpenOCD's RTT server, on localhost
+    std::string log_path;             // OpenOCD's own output
+};
+
+/**
+ * @brief Print the RTT output of a running target (lumos monitor --rtt)
+ *
+ * Starts OpenOCD in the background with its RTT server on channel 0 of
+ * the firmware's control block (src/wrapper/rtt.h), then reads that
+ * server's TCP stream. The target keeps running; nothing is reset.
+ * Tokenized log frames are expanded as in the serial monitor. OpenOCD is
+ * stopped when the monitor is destroyed. Not available on Windows.
+ */
+class RttMonitor {
+public:
+    explicit RttMonitor(const RttOptions& options);
+    ~RttMonitor();
+
+    /**
+     * @brief Start OpenOCD and connect to its RTT server
+     * @return false with @p error set if OpenOCD failed or never listened
+     */
+    bool Start(std::string& error);
+
+    /**
+     * @brief Expand tokenized log frames with @p decoder (must outlive Run())
+     */
+    void SetTokenLogDecoder(const TokenLogDecoder* decoder) { printer_.SetDecoder(decoder); }
+
+    /**
+     * @brief Print output until @p running turns false or OpenOCD exits
+     * @return Bytes received
+     */
+    uint64_t Run(const volatile bool& running);
+
+    /**
+     * @brief Address of _SEGGER_RTT in @p elf_path
+     */
+    static bool FindControlBlock(const std::string& elf_path, uint32_t& address, std::string& error);
+
+private:
+    void Stop();
+
+    RttOptions options_;
+    TokenLogPrinter printer_;
+    pid_t pid_ = -1;
+    int fd_ = -1;
+};
+
+} // namespace Lumos
+
+#endif // _WIN32
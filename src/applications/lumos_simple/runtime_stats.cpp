@@ -0,0 +1,405 @@
+#include "runtime_stats.h"
+#include "serial.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+const uint8_t kFrameMarker = 0xFD;      // StatsEndpoint::kFrameMarker
+const uint8_t kStatsKind = 1;           // StatsEndpoint::kStatsRequest
+const uint8_t kNamesKind = 2;           // StatsEndpoint::kNamesRequest
+const size_t kHeaderBytes = 5;          // Marker, kind, sequence, length (after the 0x00)
+const size_t kMaxPayload = 4096;        // Far above what the firmware sends
+const size_t kStatsHeader = 12;
+const size_t kAppRecord = 24;
+const size_t kCounterRecord = 8;
+const size_t kPowerRecord = 12;
+
+// ApplicationState, in order
+const char* const kStateNames[] = {"created", "initialized", "running", "stopped", "error"};
+
+// CRC-8, polynomial 0x07, as the firmware computes it
+uint8_t Crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t ReadU16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t ReadU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+bool ParseStats(const uint8_t* data, size_t length, RuntimeStatsSnapshot& stats) {
+    if (length < kStatsHeader) {
+        return false;
+    }
+    const size_t apps = data[8];
+    const size_t isrs = data[9];
+    const size_t queues = data[10];
+    const size_t peripherals = data[11];
+    if (length != kStatsHeader + apps * kAppRecord + (isrs + queues + peripherals) * kCounterRecord + kPowerRecord) {
+        return false;
+    }
+
+    stats.time_us = ReadU32(data);
+    stats.tick_khz = std::max<uint32_t>(1, ReadU32(data + 4));
+    stats.apps.resize(apps);
+    stats.isrs.resize(isrs);
+    stats.queues.resize(queues);
+    stats.peripherals.resize(peripherals);
+    const uint8_t* record = data + kStatsHeader;
+    for (size_t i = 0; i < apps; ++i, record += kAppRecord) {
+        RuntimeStatsSnapshot::App& app = stats.apps[i];
+        app.state = record[0];
+        app.critical = record[1] != 0;
+        app.rate_hz = ReadU16(record + 2);
+        app.steps = ReadU32(record + 4);
+        app.busy_us = ReadU32(record + 8);
+        app.max_step_us = ReadU32(record + 12);
+        app.misses = ReadU32(record + 16);
+        app.errors = ReadU32(record + 20);
+    }
+    for (size_t i = 0; i < isrs; ++i, record += kCounterRecord) {
+        stats.isrs[i].count = ReadU32(record);
+        stats.isrs[i].busy_ticks = ReadU32(record + 4);
+    }
+    for (size_t i = 0; i < queues; ++i, record += kCounterRecord) {
+        stats.queues[i].depth = ReadU32(record);
+        stats.queues[i].capacity = ReadU32(record + 4);
+    }
+    stats.sleep_us = ReadU32(record);
+    stats.stop_us = ReadU32(record + 4);
+    stats.wakeups = ReadU32(record + 8);
+    record += kPowerRecord;
+    for (size_t i = 0; i < peripherals; ++i, record += kCounterRecord) {
+        stats.peripherals[i].run_us = ReadU32(record);
+        stats.peripherals[i].sleep_us = ReadU32(record + 4);
+    }
+    return true;
+}
+
+bool ParseNames(const uint8_t* data, size_t length, RuntimeStatsNames& names) {
+    if (length < 4) {
+        return false;
+    }
+    std::vector<std::string>* lists[] = {&names.apps, &names.isrs, &names.queues, &names.peripherals};
+    size_t offset = 4;
+    for (int list = 0; list < 4; ++list) {
+        lists[list]->resize(data[list]);
+        for (std::string& name : *lists[list]) {
+            if (offset >= length || offset + 1 + data[offset] > length) {
+                return false;
+            }
+            name.assign(reinterpret_cast<const char*>(data + offset + 1), data[offset]);
+            offset += 1 + data[offset];
+        }
+    }
+    return offset == length;
+}
+
+// Name @p index of @p names, or a placeholder until the names are in
+std::string NameOf(const std::vector<std::string>& names, size_t index, const char* kind) {
+    return index < names.size() ? names[index] : std::string(kind) + "#" + std::to_string(index);
+}
+
+} // namespace
+
+std::vector<uint8_t> MakeRuntimeStatsRequest(uint8_t kind, uint8_t sequence) {
+    std::vector<uint8_t> frame = {0x00, kFrameMarker, kind, sequence, 0};
+    frame[4] = Crc8(frame.data() + 1, 3);
+    return frame;
+}
+
+RuntimeStatsParser::Result RuntimeStatsParser::Feed(uint8_t byte) {
+    if (!in_frame_) {
+        if (byte != 0) {
+            return Result::Text;
+        }
+        in_frame_ = true;
+        pending_.clear();
+        return Result::Pending;
+    }
+
+    pending_.push_back(byte);
+    if (pending_[0] != kFrameMarker) {
+        // Another 0x00-framed stream (e.g. a token log); not ours
+        in_frame_ = false;
+        return Result::Pending;
+    }
+    if (pending_.size() < kHeaderBytes) {
+        return Result::Pending;
+    }
+    const size_t payload = ReadU16(pending_.data() + 3);
+    if (payload > kMaxPayload) {
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    if (pending_.size() < kHeaderBytes + payload + 1) {
+        return Result::Pending;
+    }
+
+    in_frame_ = false;
+    return Finish();
+}
+
+RuntimeStatsParser::Result RuntimeStatsParser::Finish() {
+    const size_t total = pending_.size();
+    if (Crc8(pending_.data(), total - 1) != pending_[total - 1]) {
+        ++errors_;
+        return Result::Error;
+    }
+
+    const uint8_t* payload = pending_.data() + kHeaderBytes;
+    const size_t length = total - kHeaderBytes - 1;
+    sequence_ = pending_[2];
+    if (pending_[1] == kStatsKind && ParseStats(payload, length, stats_)) {
+        return Result::Stats;
+    }
+    if (pending_[1] == kNamesKind && ParseNames(payload, length, names_)) {
+        return Result::Names;
+    }
+    ++errors_;
+    return Result::Error;
+}
+
+void RuntimeStatsView::Add(const RuntimeStatsSnapshot& snapshot) {
+    if (!have_start_ || snapshot.apps.size() != last_.apps.size() || snapshot.isrs.size() != last_.isrs.size() ||
+        snapshot.queues.size() != last_.queues.size() || snapshot.peripherals.size() != last_.peripherals.size()) {
+        // First answer, or the firmware changed what it reports: start over
+        start_ = snapshot;
+        have_start_ = true;
+        queue_peaks_.assign(snapshot.queues.size(), 0);
+    }
+    for (size_t i = 0; i < snapshot.queues.size(); ++i) {
+        queue_peaks_[i] = std::max(queue_peaks_[i], snapshot.queues[i].depth);
+    }
+    last_ = snapshot;
+}
+
+std::string RuntimeStatsView::Format(double polls_per_s, double round_trip_ms) {
+    // Differences are taken modulo 2^32, so wrapped counters still work
+    const uint32_t elapsed_us = last_.time_us - start_.time_us;
+    if (!have_start_ || elapsed_us == 0) {
+        return std::string();
+    }
+    const double elapsed_s = elapsed_us / 1e6;
+
+    std::ostringstream out;
+    char line[160];
+    snprintf(line, sizeof(line), "t=%.3f s  %.0f polls/s  round trip %.2f ms\n", last_.time_us / 1e6,
+             polls_per_s, round_trip_ms);
+    out << line;
+
+    const bool charge = currents_.IsSet();
+    if (!last_.apps.empty()) {
+        snprintf(line, sizeof(line), "  %-16s %-11s %6s %10s %7s %8s %7s %7s%s\n", "app", "state", "rate",
+                 "steps/s", "load", "max_us", "misses", "errors", charge ? "  uC/step" : "");
+        out << line;
+        double total_load = 0;
+        for (size_t i = 0; i < last_.apps.size(); ++i) {
+            const RuntimeStatsSnapshot::App& now = last_.apps[i];
+            const RuntimeStatsSnapshot::App& then = start_.apps[i];
+            const uint32_t busy_us = now.busy_us - then.busy_us;
+            const uint32_t steps = now.steps - then.steps;
+            const double load = 100.0 * busy_us / elapsed_us;
+            total_load += load;
+            const std::string state =
+                now.state < sizeof(kStateNames) / sizeof(kStateNames[0]) ? kStateNames[now.state] : "?";
+            snprintf(line, sizeof(line), "  %-16s %-11s %6u %10.1f %6.1f%% %8u %7u %7u",
+                     (NameOf(names_.apps, i, "app") + (now.critical ? "*" : "")).c_str(), state.c_str(),
+                     now.rate_hz, steps / elapsed_s, load, now.max_step_us,
+                     static_cast<uint32_t>(now.misses - then.misses), now.errors);
+            out << line;
+            if (charge) {
+                // mA x us = nC
+                snprintf(line, sizeof(line), " %9.3f", steps > 0 ? currents_.run_ma * busy_us / steps / 1000.0 : 0.0);
+                out << line;
+            }
+            out << "\n";
+        }
+        snprintf(line, sizeof(line), "  %-16s %-11s %6s %10s %6.1f%%\n", "(all apps)", "", "", "", total_load);
+        out << line;
+    }
+
+    if (!last_.isrs.empty()) {
+        snprintf(line, sizeof(line), "  %-16s %10s %7s %9s\n", "isr", "entries/s", "load", "mean_us");
+        out << line;
+        for (size_t i = 0; i < last_.isrs.size(); ++i) {
+            const uint32_t entries = last_.isrs[i].count - start_.isrs[i].count;
+            const double busy_us = static_cast<uint32_t>(last_.isrs[i].busy_ticks - start_.isrs[i].busy_ticks) *
+                                   1000.0 / last_.tick_khz;
+            snprintf(line, sizeof(line), "  %-16s %10.1f %6.2f%% %9.2f\n", NameOf(names_.isrs, i, "isr").c_str(),
+                     entries / elapsed_s, 100.0 * busy_us / elapsed_us, entries > 0 ? busy_us / entries : 0.0);
+            out << line;
+        }
+    }
+
+    if (!last_.queues.empty()) {
+        snprintf(line, sizeof(line), "  %-16s %8s %8s %9s\n", "queue", "depth", "peak", "capacity");
+        out << line;
+        for (size_t i = 0; i < last_.queues.size(); ++i) {
+            snprintf(line, sizeof(line), "  %-16s %8u %8u %9u%s\n", NameOf(names_.queues, i, "queue").c_str(),
+                     last_.queues[i].depth, queue_peaks_[i], last_.queues[i].capacity,
+                     queue_peaks_[i] >= last_.queues[i].capacity ? "  FULL" : "");
+            out << line;
+        }
+    }
+
+    // Run is what the sleeps leave; the counters wrap together
+    const double sleep_share = std::min(1.0, static_cast<uint32_t>(last_.sleep_us - start_.sleep_us) /
+                                                 static_cast<double>(elapsed_us));
+    const double stop_share = std::min(1.0 - sleep_share, static_cast<uint32_t>(last_.stop_us - start_.stop_us) /
+                                                               static_cast<double>(elapsed_us));
+    const double run_share = 1.0 - sleep_share - stop_share;
+    snprintf(line, sizeof(line), "  %-16s run %5.1f%%  sleep %5.1f%%  stop %5.1f%%  %.1f wake-ups/s\n", "power",
+             100.0 * run_share, 100.0 * sleep_share, 100.0 * stop_share,
+             static_cast<uint32_t>(last_.wakeups - start_.wakeups) / elapsed_s);
+    out << line;
+    if (charge) {
+        snprintf(line, sizeof(line), "  %-16s %.3f mA average\n", "",
+                 run_share * currents_.run_ma + sleep_share * currents_.sleep_ma + stop_share * currents_.stop_ma);
+        out << line;
+    }
+
+    if (!last_.peripherals.empty()) {
+        // Shares of the whole window, so a clock always on reads run% + sleep%
+        snprintf(line, sizeof(line), "  %-16s %8s %8s\n", "clock on", "run", "sleep");
+        out << line;
+        for (size_t i = 0; i < last_.peripherals.size(); ++i) {
+            const RuntimeStatsSnapshot::Peripheral& now = last_.peripherals[i];
+            const RuntimeStatsSnapshot::Peripheral& then = start_.peripherals[i];
+            snprintf(line, sizeof(line), "  %-16s %7.1f%% %7.1f%%\n",
+                     NameOf(names_.peripherals, i, "peripheral").c_str(),
+                     100.0 * static_cast<uint32_t>(now.run_us - then.run_us) / elapsed_us,
+                     100.0 * static_cast<uint32_t>(now.sleep_us - then.sleep_us) / elapsed_us);
+            out << line;
+        }
+    }
+
+    // The next window starts where this one ended
+    start_ = last_;
+    for (size_t i = 0; i < queue_peaks_.size(); ++i) {
+        queue_peaks_[i] = last_.queues[i].depth;
+    }
+    return out.str();
+}
+
+bool RunRuntimeStats(const std::string& port, int baud_rate, double rate_hz, double duration_s,
+                     const PowerStateCurrents& currents, const volatile bool& running, std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto poll_period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / std::max(rate_hz, 0.1)));
+    // An answer lost to a corrupt frame must not stall the polling
+    const auto answer_timeout = std::max(poll_period * 4, Clock::duration(std::chrono::milliseconds(200)));
+
+    RuntimeStatsParser parser;
+    RuntimeStatsView view;
+    view.SetCurrents(currents);
+    bool have_names = false;
+    bool waiting = false;
+    uint8_t sequence = 0;
+    auto sent_at = Clock::now();
+    auto next_poll = sent_at;
+    const auto start = sent_at;
+    auto next_print = start + std::chrono::seconds(1);
+    uint32_t answers = 0;
+    double round_trips_ms = 0;
+    uint64_t frames_seen = 0;
+
+    uint8_t buffer[1024];
+    while (running) {
+        const auto now = Clock::now();
+        if (duration_s > 0 && std::chrono::duration<double>(now - start).count() >= duration_s) {
+            break;
+        }
+
+        // One request in flight; names until they have arrived
+        if ((!waiting && now >= next_poll) || (waiting && now - sent_at > answer_timeout)) {
+            const std::vector<uint8_t> request = MakeRuntimeStatsRequest(have_names ? kStatsKind : kNamesKind,
+                                                                         ++sequence);
+            if (serial.Write(request) < 0) {
+                error = port + ": " + serial.GetLastError();
+                serial.Close();
+                return false;
+            }
+            waiting = true;
+            sent_at = now;
+            next_poll = std::max(next_poll + poll_period, now);
+        }
+
+        if (now >= next_print) {
+            next_print += std::chrono::seconds(1);
+            const std::string table = view.Format(answers, answers > 0 ? round_trips_ms / answers : 0.0);
+            if (!table.empty()) {
+                std::cout << table << std::endl;
+            } else if (frames_seen == 0) {
+                std::cerr << "No answer yet (is StatsEndpoint::Poll() called on this port?)" << std::endl;
+            }
+            answers = 0;
+            round_trips_ms = 0;
+        }
+
+        const int bytes_read = serial.Read(buffer, sizeof(buffer), 5);
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+        for (int i = 0; i < bytes_read; ++i) {
+            const RuntimeStatsParser::Result result = parser.Feed(buffer[i]);
+            if (result != RuntimeStatsParser::Result::Stats && result != RuntimeStatsParser::Result::Names) {
+                continue;
+            }
+            ++frames_seen;
+            if (parser.GetSequence() == sequence) {
+                waiting = false;
+                ++answers;
+                round_trips_ms += std::chrono::duration<double, std::milli>(Clock::now() - sent_at).count();
+            }
+            if (result == RuntimeStatsParser::Result::Names) {
+                view.SetNames(parser.GetNames());
+                have_names = true;
+                continue;
+            }
+            const RuntimeStatsSnapshot& stats = parser.GetStats();
+            const RuntimeStatsNames& names = view.GetNames();
+            if (stats.apps.size() != names.apps.size() || stats.isrs.size() != names.isrs.size() ||
+                stats.queues.size() != names.queues.size() || stats.peripherals.size() != names.peripherals.size()) {
+                have_names = false;   // The firmware registered more; ask again
+            }
+            view.Add(stats);
+        }
+    }
+
+    if (parser.GetErrorCount() > 0) {
+        std::cerr << parser.GetErrorCount() << " corrupt stats frames dropped" << std::endl;
+    }
+    serial.Close();
+    return true;
+}
+
+} // namespace Lumos
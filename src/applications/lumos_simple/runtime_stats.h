@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One answer of the firmware's StatsEndpoint (framework/stats_endpoint.h)
+ *
+ * Counters are the firmware's free-running 32-bit values; rates and loads
+ * come from the difference of two snapshots.
+ */
+struct RuntimeStatsSnapshot {
+    struct App {
+        uint8_t state = 0;          // ApplicationState
+        bool critical = false;
+        uint32_t rate_hz = 0;
+        uint32_t steps = 0;
+        uint32_t busy_us = 0;       // Time in Step()
+        uint32_t max_step_us = 0;
+        uint32_t misses = 0;
+        uint32_t errors = 0;
+    };
+    struct Isr {
+        uint32_t count = 0;
+        uint32_t busy_ticks = 0;
+    };
+    struct Queue {
+        uint32_t depth = 0;
+        uint32_t capacity = 0;
+    };
+    struct Peripheral {
+        uint32_t run_us = 0;        // Clock enabled while the core ran
+        uint32_t sleep_us = 0;      // ... while it slept
+    };
+
+    uint32_t time_us = 0;
+    uint32_t tick_khz = 1000;       // Rate of the ISR busy ticks
+    std::vector<App> apps;
+    std::vector<Isr> isrs;
+    std::vector<Queue> queues;
+    uint32_t sleep_us = 0;          // Core in WFI
+    uint32_t stop_us = 0;           // Core in Stop mode
+    uint32_t wakeups = 0;
+    std::vector<Peripheral> peripherals;   // Of the firmware's PowerTracker
+};
+
+/**
+ * @brief Names of what a StatsEndpoint reports, in its order
+ */
+struct RuntimeStatsNames {
+    std::vector<std::string> apps;
+    std::vector<std::string> isrs;
+    std::vector<std::string> queues;
+    std::vector<std::string> peripherals;
+};
+
+/**
+ * @brief Supply current in each power state (lumos stats --current)
+ *
+ * Measured once per board and clock profile, e.g. with a meter on a
+ * firmware that stays in one state; all 0 when not given.
+ */
+struct PowerStateCurrents {
+    double run_ma = 0;
+    double sleep_ma = 0;
+    double stop_ma = 0;
+
+    bool IsSet() const { return run_ma > 0 || sleep_ma > 0 || stop_ma > 0; }
+};
+
+/**
+ * @brief Request frame asking for stats or names
+ * @param kind StatsEndpoint::kStatsRequest (1) or kNamesRequest (2)
+ */
+std::vector<uint8_t> MakeRuntimeStatsRequest(uint8_t kind, uint8_t sequence);
+
+/**
+ * @brief Picks StatsEndpoint answers out of a serial byte stream
+ *
+ * Answers start with 0x00 0xFD; other bytes are ordinary output. A frame
+ * with a bad CRC or payload is dropped and counted.
+ */
+class RuntimeStatsParser {
+public:
+    enum class Result {
+        Text,       // The byte is ordinary output
+        Pending,    // Consumed as part of a frame
+        Stats,      // A stats answer completed, see GetStats()
+        Names,      // A names answer completed, see GetNames()
+        Error       // A corrupt frame was dropped
+    };
+
+    Result Feed(uint8_t byte);
+
+    const RuntimeStatsSnapshot& GetStats() const { return stats_; }
+    const RuntimeStatsNames& GetNames() const { return names_; }
+    uint8_t GetSequence() const { return sequence_; }
+    uint64_t GetErrorCount() const { return errors_; }
+
+private:
+    Result Finish();
+
+    std::vector<uint8_t> pending_;  // Frame bytes after the 0x00
+    bool in_frame_ = false;
+    RuntimeStatsSnapshot stats_;
+    RuntimeStatsNames names_;
+    uint8_t sequence_ = 0;
+    uint64_t errors_ = 0;
+};
+
+/**
+ * @brief Turns successive snapshots into loads and rates (lumos stats)
+ *
+ * Add() every answer; Format() prints the change since the previous
+ * Format(): per app the step rate, CPU load (time in Step() over elapsed
+ * device time), longest step, new deadline misses and errors; per ISR the
+ * entry rate and load; per queue the depth now and the deepest seen; the
+ * shares of Run, Sleep and Stop and per tracked peripheral the share of
+ * time its clock was on. With currents set, the average current and each
+ * app's charge per step (its mean step time at the run current).
+ */
+class RuntimeStatsView {
+public:
+    void SetNames(const RuntimeStatsNames& names) { names_ = names; }
+    const RuntimeStatsNames& GetNames() const { return names_; }
+    void SetCurrents(const PowerStateCurrents& currents) { currents_ = currents; }
+
+    void Add(const RuntimeStatsSnapshot& snapshot);
+
+    /**
+     * @brief Table of the window since the last call
+     * @param polls_per_s Answers per second in the window
+     * @param round_trip_ms Their mean time from request to answer
+     * @return Empty until two snapshots are in
+     */
+    std::string Format(double polls_per_s, double round_trip_ms);
+
+private:
+    RuntimeStatsNames names_;
+    PowerStateCurrents currents_;
+    bool have_start_ = false;
+    RuntimeStatsSnapshot start_;        // First snapshot of the window
+    RuntimeStatsSnapshot last_;
+    std::vector<uint32_t> queue_peaks_; // Deepest per queue in the window
+};
+
+/**
+ * @brief Poll @p port at @p rate_hz and print a table every second until
+ *        @p running turns false or @p duration_s (0: no limit) has passed
+ */
+bool RunRuntimeStats(const std::string& port, int baud_rate, double rate_hz, double duration_s,
+                     const PowerStateCurrents& currents, const volatile bool& running, std::string& error);
+
+} // namespace Lumos
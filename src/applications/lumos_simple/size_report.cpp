@@ -0,0 +1,462 @@
+#include "size_report.h"
+#include "elf_file.h"
+#include "json_util.h"
+#include "map_file.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const char* kSnapshotHeader = "lumos-size 1";
+const char* kSnapshotFile = "size.txt";
+const char* kPreviousSnapshotFile = "size.prev.txt";
+
+// "build/debug/main.o" -> "main.o", "/x/libhal.a(gpio.o)" -> "libhal.a(gpio.o)"
+std::string ShortObjectName(const std::string& object) {
+    size_t paren = object.find('(');
+    std::string path = paren == std::string::npos ? object : object.substr(0, paren);
+    std::string member = paren == std::string::npos ? "" : object.substr(paren);
+    return fs::path(path).filename().string() + member;
+}
+
+// "newlib printf" or "iostream" for library objects the wrapper's
+// formatter replaces, nullptr for anything else
+const char* LibraryCodeKind(const std::string& short_object) {
+    size_t paren = short_object.find('(');
+    if (paren == std::string::npos) {
+        return nullptr;
+    }
+    const std::string archive = short_object.substr(0, paren);
+    const std::string member = short_object.substr(paren + 1);
+    if (archive.rfind("libc", 0) == 0 &&
+        (member.find("printf") != std::string::npos || member.find("dtoa") != std::string::npos)) {
+        return "newlib printf";
+    }
+    if (archive.rfind("libstdc++", 0) == 0 &&
+        (member.find("stream") != std::string::npos || member.find("ios") == 0 ||
+         member.find("locale") == 0 || member.find("globals_io") == 0)) {
+        return "iostream";
+    }
+    return nullptr;
+}
+
+uint64_t Total(const std::map<std::string, uint64_t>& by_region) {
+    uint64_t total = 0;
+    for (const auto& item : by_region) {
+        total += item.second;
+    }
+    return total;
+}
+
+std::string FormatDelta(long long delta) {
+    if (delta == 0) {
+        return "";
+    }
+    return (delta > 0 ? "+" : "") + std::to_string(delta);
+}
+
+} // namespace
+
+std::string SizeReport::RegionFor(uint64_t address) const {
+    for (const auto& region : regions_) {
+        if (address >= region.origin && address - region.origin < region.length) {
+            return region.name;
+        }
+    }
+    return "other";
+}
+
+bool SizeReport::Load(const std::string& elf_file, const std::string& map_file, std::string& error) {
+    regions_.clear();
+    objects_.clear();
+    symbols_.clear();
+    library_code_.clear();
+
+    ElfFile elf;
+    if (!elf.Load(elf_file, error)) {
+        return false;
+    }
+    MapFile map;
+    if (!map.Load(map_file)) {
+        error = "cannot read " + map_file;
+        return false;
+    }
+    for (const auto& region : map.GetRegions()) {
+        regions_.push_back({region.name, region.origin, region.length, 0});
+    }
+
+    auto add = [this](const std::string& region, uint64_t size) {
+        for (auto& r : regions_) {
+            if (r.name == region) {
+                r.used += size;
+                return;
+            }
+        }
+        regions_.push_back({region, 0, 0, size});
+    };
+
+    std::map<std::string, const ElfSection*> by_name;
+    for (const auto& section : elf.GetSections()) {
+        by_name[section.name] = &section;
+        if (!section.alloc || section.size == 0) {
+            continue;
+        }
+        // Initialized data occupies RAM at run time and flash in the image
+        std::string run = RegionFor(section.address);
+        add(run, section.size);
+        if (!section.nobits) {
+            std::string load = RegionFor(section.load_address);
+            if (load != run) {
+                add(load, section.size);
+            }
+        }
+    }
+
+    for (const auto& contribution : map.GetContributions()) {
+        auto it = by_name.find(contribution.output_section);
+        if (it == by_name.end() || !it->second->alloc) {
+            continue;  // Debug info and discarded sections
+        }
+        const std::string object = ShortObjectName(contribution.object);
+        if (const char* kind = LibraryCodeKind(object)) {
+            library_code_[kind].bytes += contribution.size;
+        }
+        auto& usage = objects_[object];
+        std::string run = RegionFor(contribution.address);
+        usage[run] += contribution.size;
+        if (!it->second->nobits) {
+            std::string load = RegionFor(contribution.load_address);
+            if (load != run) {
+                usage[load] += contribution.size;
+            }
+        }
+    }
+
+    // Follow each library member back to the first reference from outside its kind
+    std::map<std::string, const ArchiveReference*> references;
+    for (const auto& reference : map.GetArchiveReferences()) {
+        references[ShortObjectName(reference.member)] = &reference;
+    }
+    for (const auto& item : references) {
+        const char* kind = LibraryCodeKind(item.first);
+        if (kind == nullptr || library_code_.count(kind) == 0) {
+            continue;
+        }
+        const ArchiveReference* reference = item.second;
+        for (size_t depth = 0; reference != nullptr && depth < references.size(); ++depth) {
+            if (reference->referenced_by.empty()) {
+                library_code_[kind].pulled_in_by.insert("-u " + reference->symbol);
+                break;
+            }
+            const std::string by = ShortObjectName(reference->referenced_by);
+            const char* by_kind = LibraryCodeKind(by);
+            if (by_kind == nullptr || std::string(by_kind) != kind) {
+                library_code_[kind].pulled_in_by.insert(by + " (" + reference->symbol + ")");
+                break;
+            }
+            auto next = references.find(by);
+            reference = next == references.end() ? nullptr : next->second;
+        }
+    }
+
+    const auto& sections = elf.GetSections();
+    for (const auto& symbol : elf.GetSymbols()) {
+        if (symbol.section < 0 || !sections[symbol.section].alloc) {
+            continue;
+        }
+        symbols_[symbol.name][RegionFor(symbol.address)] += symbol.size;
+    }
+
+    return true;
+}
+
+std::string SizeReport::Serialize() const {
+    std::ostringstream ss;
+    ss << kSnapshotHeader << "\n";
+    for (const auto& region : regions_) {
+        ss << "region\t" << region.name << "\t" << region.origin << "\t" << region.length << "\t"
+           << region.used << "\n";
+    }
+    for (const auto& object : objects_) {
+        for (const auto& usage : object.second) {
+            ss << "object\t" << object.first << "\t" << usage.first << "\t" << usage.second << "\n";
+        }
+    }
+    for (const auto& symbol : symbols_) {
+        for (const auto& usage : symbol.second) {
+            ss << "symbol\t" << symbol.first << "\t" << usage.first << "\t" << usage.second << "\n";
+        }
+    }
+    return ss.str();
+}
+
+bool SizeReport::Parse(const std::string& path) {
+    regions_.clear();
+    objects_.clear();
+    symbols_.clear();
+
+    std::ifstream file(path);
+    std::string line;
+    if (!file.is_open() || !std::getline(file, line) || line != kSnapshotHeader) {
+        return false;
+    }
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::istringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t')) {
+            fields.push_back(field);
+        }
+        try {
+            if (fields.size() == 5 && fields[0] == "region") {
+                regions_.push_back({fields[1], std::stoull(fields[2]), std::stoull(fields[3]),
+                                    std::stoull(fields[4])});
+            } else if (fields.size() == 4 && fields[0] == "object") {
+                objects_[fields[1]][fields[2]] = std::stoull(fields[3]);
+            } else if (fields.size() == 4 && fields[0] == "symbol") {
+                symbols_[fields[1]][fields[2]] = std::stoull(fields[3]);
+            }
+        } catch (...) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SizeReport::Record(const std::string& dir) const {
+    std::string latest = (fs::path(dir) / kSnapshotFile).string();
+    std::string content = Serialize();
+
+    std::ifstream existing(latest, std::ios::binary);
+    if (existing.is_open()) {
+        std::ostringstream previous;
+        previous << existing.rdbuf();
+        existing.close();
+        if (previous.str() == content) {
+            return true;
+        }
+        std::error_code ec;
+        fs::rename(latest, fs::path(dir) / kPreviousSnapshotFile, ec);
+    }
+
+    return WriteFileAtomically(latest, content);
+}
+
+bool SizeReport::LoadPrevious(const std::string& dir, const SizeReport& current) {
+    // size.txt is the current build once it has been recorded; if the
+    // firmware changed since, size.txt itself is the previous build
+    std::string latest = (fs::path(dir) / kSnapshotFile).string();
+    if (Parse(latest) && Serialize() != current.Serialize()) {
+        return true;
+    }
+    return Parse((fs::path(dir) / kPreviousSnapshotFile).string());
+}
+
+void SizeReport::PrintRegions(const SizeReport* previous) const {
+    std::cout << std::left << std::setw(12) << "  Region" << std::right
+              << std::setw(12) << "Used" << std::setw(12) << "Size" << std::setw(8) << "Use%";
+    if (previous != nullptr) {
+        std::cout << std::setw(10) << "Change";
+    }
+    std::cout << std::endl;
+
+    for (const auto& region : regions_) {
+        if (region.length == 0 && region.used == 0) {
+            continue;
+        }
+        std::ostringstream percent;
+        if (region.length > 0) {
+            percent << std::fixed << std::setprecision(1) << (100.0 * region.used / region.length) << "%";
+        }
+        std::cout << "  " << std::left << std::setw(10) << region.name << std::right
+                  << std::setw(12) << region.used << std::setw(12) << region.length
+                  << std::setw(8) << percent.str();
+        if (previous != nullptr) {
+            uint64_t before = 0;
+            for (const auto& old : previous->regions_) {
+                if (old.name == region.name) {
+                    before = old.used;
+                }
+            }
+            std::cout << std::setw(10) << FormatDelta(static_cast<long long>(region.used) -
+                                                      static_cast<long long>(before));
+        }
+        if (region.length > 0 && region.used > region.length) {
+            std::cout << "  OVERFLOW";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void SizeReport::PrintObjects(const SizeReport* previous, size_t top) const {
+    // One column per region that any object uses, in MEMORY order
+    std::vector<std::string> columns;
+    for (const auto& region : regions_) {
+        for (const auto& object : objects_) {
+            if (object.second.count(region.name)) {
+                columns.push_back(region.name);
+                break;
+            }
+        }
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> sorted;
+    for (const auto& object : objects_) {
+        sorted.push_back({Total(object.second), object.first});
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::cout << "  " << std::right;
+    for (const auto& column : columns) {
+        std::cout << std::setw(10) << column;
+    }
+    if (previous != nullptr) {
+        std::cout << std::setw(10) << "Change";
+    }
+    std::cout << "  Object" << std::endl;
+
+    for (size_t i = 0; i < sorted.size() && i < top; ++i) {
+        const auto& usage = objects_.at(sorted[i].second);
+        std::cout << "  ";
+        for (const auto& column : columns) {
+            auto it = usage.find(column);
+            std::cout << std::setw(10) << (it == usage.end() ? 0 : it->second);
+        }
+        if (previous != nullptr) {
+            auto old = previous->objects_.find(sorted[i].second);
+            std::string change = old == previous->objects_.end()
+                ? "new"
+                : FormatDelta(static_cast<long long>(sorted[i].first) - static_cast<long long>(Total(old->second)));
+            std::cout << std::setw(10) << change;
+        }
+        std::cout << "  " << sorted[i].second << std::endl;
+    }
+}
+
+void SizeReport::PrintSymbols(const SizeReport* previous, size_t top) const {
+    struct Row {
+        uint64_t size;
+        std::string region;
+        std::string name;
+    };
+    std::vector<Row> rows;
+    for (const auto& symbol : symbols_) {
+        for (const auto& usage : symbol.second) {
+            rows.push_back({usage.second, usage.first, symbol.first});
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return a.size != b.size ? a.size > b.size : a.name < b.name;
+    });
+
+    std::cout << "  " << std::right << std::setw(10) << "Size" << "  " << std::left << std::setw(10) << "Region";
+    if (previous != nullptr) {
+        std::cout << std::right << std::setw(10) << "Change";
+    }
+    std::cout << "  Symbol" << std::endl;
+
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+        std::cout << "  " << std::right << std::setw(10) << rows[i].size << "  "
+                  << std::left << std::setw(10) << rows[i].region;
+        if (previous != nullptr) {
+            uint64_t before = 0;
+            bool found = false;
+            auto old = previous->symbols_.find(rows[i].name);
+            if (old != previous->symbols_.end()) {
+                auto it = old->second.find(rows[i].region);
+                found = it != old->second.end();
+                before = found ? it->second : 0;
+            }
+            std::cout << std::right << std::setw(10)
+                      << (found ? FormatDelta(static_cast<long long>(rows[i].size) - static_cast<long long>(before))
+                                : "new");
+        }
+        std::cout << "  " << rows[i].name << std::endl;
+    }
+    std::cout << std::right;
+}
+
+void SizeReport::PrintChanges(const SizeReport& previous, size_t top) const {
+    struct Change {
+        long long delta;
+        std::string kind;
+        std::string name;
+        std::string region;
+    };
+    std::vector<Change> changes;
+
+    auto diff = [&changes](const Usage& now, const Usage& before, const std::string& kind) {
+        static const std::map<std::string, uint64_t> empty;
+        std::map<std::string, bool> names;
+        for (const auto& item : now) names[item.first] = true;
+        for (const auto& item : before) names[item.first] = true;
+        for (const auto& item : names) {
+            auto a = now.find(item.first);
+            auto b = before.find(item.first);
+            const auto& new_usage = a == now.end() ? empty : a->second;
+            const auto& old_usage = b == before.end() ? empty : b->second;
+            std::map<std::string, bool> regions;
+            for (const auto& r : new_usage) regions[r.first] = true;
+            for (const auto& r : old_usage) regions[r.first] = true;
+            for (const auto& r : regions) {
+                auto x = new_usage.find(r.first);
+                auto y = old_usage.find(r.first);
+                long long delta = static_cast<long long>(x == new_usage.end() ? 0 : x->second) -
+                                  static_cast<long long>(y == old_usage.end() ? 0 : y->second);
+                if (delta != 0) {
+                    changes.push_back({delta, kind, item.first, r.first});
+                }
+            }
+        }
+    };
+    diff(objects_, previous.objects_, "object");
+    diff(symbols_, previous.symbols_, "symbol");
+
+    if (changes.empty()) {
+        std::cout << "  No changes since the previous build" << std::endl;
+        return;
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) {
+        long long x = a.delta < 0 ? -a.delta : a.delta;
+        long long y = b.delta < 0 ? -b.delta : b.delta;
+        return x != y ? x > y : a.name < b.name;
+    });
+
+    for (size_t i = 0; i < changes.size() && i < top; ++i) {
+        std::cout << "  " << std::right << std::setw(10) << FormatDelta(changes[i].delta) << "  "
+                  << std::left << std::setw(10) << changes[i].region << std::setw(8) << changes[i].kind
+                  << changes[i].name << std::endl;
+    }
+    std::cout << std::right;
+}
+
+void SizeReport::PrintLibraryCode() const {
+    for (const auto& item : library_code_) {
+        std::cout << "  " << std::left << std::setw(14) << item.first << std::right << std::setw(8)
+                  << item.second.bytes << " bytes";
+        if (!item.second.pulled_in_by.empty()) {
+            std::cout << ", pulled in by ";
+            bool first = true;
+            for (const auto& by : item.second.pulled_in_by) {
+                std::cout << (first ? "" : ", ") << by;
+                first = false;
+            }
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  Serial and USB print()/printf() (wrapper/format.h) need none of it" << std::endl;
+}
+
+} // namespace Lumos
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Flash/RAM usage of a firmware image (lumos size)
+ *
+ * Usage per memory region comes from the ELF section headers, placed into
+ * the regions listed in the map file's memory configuration. Initialized
+ * data counts against both its RAM region and the flash region holding
+ * its image. Per-object usage comes from the map file's input sections,
+ * per-symbol usage from the ELF symbol table.
+ *
+ * Each build records a snapshot in build/size.txt and keeps the previous
+ * one in build/size.prev.txt, so reports can show what changed.
+ *
+ * C library code the wrapper makes unnecessary is picked out as well:
+ * newlib's printf family (with the dtoa behind %f) and libstdc++'s
+ * iostreams, both far larger than the formatter of Serial and USB
+ * (wrapper/format.h). The map file's archive member list gives the
+ * references that linked them in.
+ */
+class SizeReport {
+public:
+    /**
+     * @brief Analyze a linked firmware
+     * @param elf_file Path to firmware.elf
+     * @param map_file Path to firmware.map
+     * @param error Receives a description if analysis fails
+     * @return true on success
+     */
+    bool Load(const std::string& elf_file, const std::string& map_file, std::string& error);
+
+    /**
+     * @brief Save this report as the latest snapshot in @p dir
+     *
+     * The existing snapshot becomes the previous one unless it is identical
+     * (e.g. the firmware was not relinked).
+     */
+    bool Record(const std::string& dir) const;
+
+    /**
+     * @brief Load the snapshot of the build before @p current
+     * @return true if a snapshot was found
+     */
+    bool LoadPrevious(const std::string& dir, const SizeReport& current);
+
+    /**
+     * @brief Print usage per region
+     * @param previous Report to diff against (nullptr = no diff)
+     */
+    void PrintRegions(const SizeReport* previous) const;
+
+    /**
+     * @brief Print the largest objects, broken down by region
+     */
+    void PrintObjects(const SizeReport* previous, size_t top) const;
+
+    /**
+     * @brief Print the largest symbols
+     */
+    void PrintSymbols(const SizeReport* previous, size_t top) const;
+
+    /**
+     * @brief Print the objects and symbols whose size changed the most
+     */
+    void PrintChanges(const SizeReport& previous, size_t top) const;
+
+    /** True if the firmware links newlib printf or iostream code */
+    bool HasLibraryCode() const { return !library_code_.empty(); }
+
+    /**
+     * @brief Print the printf/iostream code linked in, and what pulled it in
+     */
+    void PrintLibraryCode() const;
+
+private:
+    struct Region {
+        std::string name;
+        uint64_t origin;
+        uint64_t length;
+        uint64_t used;
+    };
+
+    // name -> region -> bytes
+    using Usage = std::map<std::string, std::map<std::string, uint64_t>>;
+
+    struct LibraryCode {
+        uint64_t bytes = 0;
+        std::set<std::string> pulled_in_by;  // e.g. "main.o (snprintf)"
+    };
+
+    std::vector<Region> regions_;
+    Usage objects_;
+    Usage symbols_;
+    std::map<std::string, LibraryCode> library_code_;  // "newlib printf", "iostream" (not in snapshots)
+
+    std::string RegionFor(uint64_t address) const;
+    std::string Serialize() const;
+    bool Parse(const std::string& path);
+};
+
+} // namespace Lumos
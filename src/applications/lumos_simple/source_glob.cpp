@@ -0,0 +1,293 @@
+#include "source_glob.h"
+#include "json_util.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const char* const kCacheHeader = "lumos-source-cache 1";
+
+std::vector<std::string> SplitPath(const std::string& path) {
+    std::vector<std::string> segments;
+    std::istringstream stream(path);
+    std::string segment;
+    while (std::getline(stream, segment, '/')) {
+        if (!segment.empty() && segment != ".") {
+            segments.push_back(segment);
+        }
+    }
+    return segments;
+}
+
+std::string JoinPath(const std::string& dir, const std::string& name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+// `*` and `?` within one component
+bool MatchSegment(const char* pattern, const char* name) {
+    for (; *pattern != '\0'; ++pattern, ++name) {
+        if (*pattern == '*') {
+            for (const char* rest = name;; ++rest) {
+                if (MatchSegment(pattern + 1, rest)) {
+                    return true;
+                }
+                if (*rest == '\0') {
+                    return false;
+                }
+            }
+        }
+        if (*name == '\0' || (*pattern != '?' && *pattern != *name)) {
+            return false;
+        }
+    }
+    return *name == '\0';
+}
+
+bool MatchSegments(const std::vector<std::string>& pattern, size_t p,
+                   const std::vector<std::string>& path, size_t i) {
+    if (p == pattern.size()) {
+        return i == path.size();
+    }
+    if (pattern[p] == "**") {
+        for (size_t k = i; k <= path.size(); ++k) {
+            if (MatchSegments(pattern, p + 1, path, k)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return i < path.size() && MatchSegment(pattern[p].c_str(), path[i].c_str()) &&
+           MatchSegments(pattern, p + 1, path, i + 1);
+}
+
+// Patterns only pick up files the builder compiles
+bool IsSource(const std::string& path) {
+    std::string extension = fs::path(path).extension().string();
+    return extension == ".c" || extension == ".cpp" || extension == ".cc" || extension == ".s" || extension == ".S";
+}
+
+} // namespace
+
+SourceGlob::SourceGlob(const std::string& root, const std::string& cache_file)
+    : root_(root),
+      cache_file_(cache_file)
+{
+    if (!cache_file_.empty()) {
+        Load();
+    }
+}
+
+bool SourceGlob::IsPattern(const std::string& entry) {
+    return entry.find_first_of("*?") != std::string::npos || (!entry.empty() && entry[0] == '!');
+}
+
+bool SourceGlob::Match(const std::string& pattern, const std::string& path) {
+    return MatchSegments(SplitPath(pattern), 0, SplitPath(path), 0);
+}
+
+void SourceGlob::Load() {
+    std::ifstream file(cache_file_);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) {
+        // Unknown format, list again
+        dirty_ = true;
+        return;
+    }
+
+    // "<mtime>\t<dir>" followed by "f\t<name>" and "d\t<name>" entries
+    Listing* listing = nullptr;
+    while (std::getline(file, line)) {
+        if (line.size() >= 2 && (line[0] == 'f' || line[0] == 'd') && line[1] == '\t' && listing != nullptr) {
+            (line[0] == 'f' ? listing->files : listing->dirs).push_back(line.substr(2));
+            continue;
+        }
+        std::istringstream fields(line);
+        Listing parsed;
+        std::string dir;
+        if (!(fields >> parsed.mtime) || fields.get() != '\t') {
+            dirty_ = true;
+            return;
+        }
+        std::getline(fields, dir);
+        listing = &(listings_[dir] = parsed);
+    }
+}
+
+bool SourceGlob::Save() const {
+    bool unused = false;
+    for (const auto& item : listings_) {
+        unused = unused || !item.second.used;
+    }
+    if (cache_file_.empty() || (!dirty_ && !unused)) {
+        return true;
+    }
+
+    // Directories no pattern reached this time are dropped
+    std::ostringstream content;
+    content << kCacheHeader << "\n";
+    for (const auto& item : listings_) {
+        const Listing& listing = item.second;
+        if (!listing.used) {
+            continue;
+        }
+        content << listing.mtime << "\t" << item.first << "\n";
+        for (const auto& name : listing.files) {
+            content << "f\t" << name << "\n";
+        }
+        for (const auto& name : listing.dirs) {
+            content << "d\t" << name << "\n";
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(cache_file_).parent_path(), ec);
+    return WriteFileAtomically(cache_file_, content.str());
+}
+
+const SourceGlob::Listing& SourceGlob::List(const std::string& dir) {
+    std::error_code ec;
+    fs::path path = fs::path(root_) / dir;
+    fs::file_time_type time = fs::last_write_time(path, ec);
+    long long mtime = static_cast<long long>(time.time_since_epoch().count());
+    if (ec) {
+        mtime = -1;
+    }
+
+    auto it = listings_.find(dir);
+    if (it != listings_.end() && (it->second.used || (it->second.mtime == mtime && mtime != -1))) {
+        it->second.used = true;
+        return it->second;
+    }
+
+    // Timestamps are coarse: an entry added in the same tick as a listing
+    // this recent would leave the time unchanged, so list it again next time
+    Listing& listing = listings_[dir];
+    listing = Listing();
+    listing.mtime = (mtime != -1 && fs::file_time_type::clock::now() - time < std::chrono::seconds(2)) ? -1 : mtime;
+    listing.used = true;
+    for (const auto& entry : fs::directory_iterator(path, ec)) {
+        std::error_code type_ec;
+        std::string name = entry.path().filename().string();
+        if (entry.is_directory(type_ec)) {
+            listing.dirs.push_back(name);
+        } else if (entry.is_regular_file(type_ec)) {
+            listing.files.push_back(name);
+        }
+    }
+    std::sort(listing.files.begin(), listing.files.end());
+    std::sort(listing.dirs.begin(), listing.dirs.end());
+    dirty_ = true;
+    return listing;
+}
+
+void SourceGlob::Walk(const std::string& dir, const std::vector<std::string>& segments, size_t index,
+                      std::vector<std::string>& matches, std::vector<std::string>* directories) {
+    if (index == segments.size()) {
+        return;
+    }
+    const std::string& segment = segments[index];
+    const bool last = index + 1 == segments.size();
+
+    // A literal directory needs no listing of its parent
+    if (!last && segment != "**" && segment.find_first_of("*?") == std::string::npos) {
+        std::error_code ec;
+        if (fs::is_directory(fs::path(root_) / JoinPath(dir, segment), ec)) {
+            Walk(JoinPath(dir, segment), segments, index + 1, matches, directories);
+        }
+        return;
+    }
+
+    const Listing& listing = List(dir);
+    if (directories != nullptr) {
+        fs::path path = dir.empty() ? fs::path(root_) : fs::path(root_) / dir;
+        directories->push_back(path.lexically_normal().string());
+    }
+    // Map nodes stay put, and a listed directory isn't listed again
+    const std::vector<std::string>& files = listing.files;
+    const std::vector<std::string>& dirs = listing.dirs;
+
+    // Wildcards don't descend into hidden directories or the build output
+    auto skipped = [&](const std::string& name) {
+        return name[0] == '.' || (dir.empty() && name == "build");
+    };
+
+    if (segment == "**") {
+        Walk(dir, segments, index + 1, matches, directories);
+        for (const auto& name : dirs) {
+            if (!skipped(name)) {
+                Walk(JoinPath(dir, name), segments, index, matches, directories);
+            }
+        }
+        return;
+    }
+    for (const auto& name : last ? files : dirs) {
+        if (!MatchSegment(segment.c_str(), name.c_str())) {
+            continue;
+        }
+        if (last) {
+            matches.push_back(JoinPath(dir, name));
+        } else if (!skipped(name)) {
+            Walk(JoinPath(dir, name), segments, index + 1, matches, directories);
+        }
+    }
+}
+
+std::vector<std::string> SourceGlob::Expand(const std::vector<std::string>& entries,
+                                            std::vector<std::string>* directories) {
+    std::vector<std::string> sources;
+    std::set<std::string> listed;
+    for (const auto& entry : entries) {
+        if (!IsPattern(entry)) {
+            if (listed.insert(entry).second) {
+                sources.push_back(entry);
+            }
+            continue;
+        }
+        if (entry[0] == '!') {
+            const std::string pattern = entry.substr(1);
+            auto excluded = [&](const std::string& source) {
+                if (!Match(pattern, source)) {
+                    return false;
+                }
+                listed.erase(source);
+                return true;
+            };
+            sources.erase(std::remove_if(sources.begin(), sources.end(), excluded), sources.end());
+            continue;
+        }
+
+        // A trailing ** means every file below
+        std::vector<std::string> segments = SplitPath(entry);
+        if (!segments.empty() && segments.back() == "**") {
+            segments.push_back("*");
+        }
+        std::vector<std::string> matches;
+        Walk("", segments, 0, matches, directories);
+        std::sort(matches.begin(), matches.end());
+        for (const auto& match : matches) {
+            if (IsSource(match) && listed.insert(match).second) {
+                sources.push_back(match);
+            }
+        }
+    }
+
+    if (directories != nullptr) {
+        std::sort(directories->begin(), directories->end());
+        directories->erase(std::unique(directories->begin(), directories->end()), directories->end());
+    }
+    return sources;
+}
+
+} // namespace Lumos
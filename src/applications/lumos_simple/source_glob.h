@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Expands project.yaml source patterns over a cached directory snapshot
+ *
+ * Patterns are '/'-separated paths relative to the project, e.g.
+ * `drivers/uart?.c`: `*` and `?` match within one path component, and `**` as
+ * a whole component matches zero or more directories. A leading `!`
+ * removes the files a pattern matches from the ones listed before it.
+ * Patterns only match sources the builder compiles (.c, .cpp, .cc, .s,
+ * .S); entries without wildcards are passed through unchanged.
+ *
+ * Walking a large tree is what costs, so every directory's listing is
+ * kept in a cache file with the directory's modification time; adding,
+ * removing or renaming an entry changes that time. A later expansion
+ * stats each directory once and reads only those that changed. Hidden
+ * directories and the project's build/ are only entered when a pattern
+ * names them.
+ */
+class SourceGlob {
+public:
+    /**
+     * @param root Directory the patterns are relative to
+     * @param cache_file Directory snapshot (empty = list every directory)
+     */
+    SourceGlob(const std::string& root, const std::string& cache_file = "");
+
+    /**
+     * @brief Expand source entries in order, each pattern's matches sorted
+     * @param directories Receives every directory listed, absolute, so a
+     *        build plan can depend on them (optional)
+     */
+    std::vector<std::string> Expand(const std::vector<std::string>& entries,
+                                    std::vector<std::string>* directories = nullptr);
+
+    /**
+     * @brief Write the snapshot if any directory was read since loading
+     */
+    bool Save() const;
+
+    /**
+     * @brief Whether a source entry contains wildcards
+     */
+    static bool IsPattern(const std::string& entry);
+
+    /**
+     * @brief Match a relative '/'-separated path against a pattern
+     */
+    static bool Match(const std::string& pattern, const std::string& path);
+
+private:
+    struct Listing {
+        long long mtime = 0;
+        std::vector<std::string> files;
+        std::vector<std::string> dirs;
+        bool used = false;
+    };
+
+    std::string root_;
+    std::string cache_file_;
+    std::map<std::string, Listing> listings_;  // By directory, relative to root_ ("" = root_)
+    bool dirty_ = false;
+
+    void Load();
+    const Listing& List(const std::string& dir);
+    void Walk(const std::string& dir, const std::vector<std::string>& segments, size_t index,
+              std::vector<std::string>& matches, std::vector<std::string>* directories);
+};
+
+} // namespace Lumos
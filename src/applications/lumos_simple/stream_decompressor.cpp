@@ -0,0 +1,272 @@
+#include "stream_decompressor.h"
+#include "capture_file.h"
+#include <algorithm>
+#include <fstream>
+
+namespace Lumos {
+
+namespace {
+
+const size_t kFrameHeader = 10;
+const uint8_t kFlagLz4 = 0x01;
+const uint8_t kFlagDelta = 0x02;
+const size_t kMinMatch = 4;
+const size_t kGroup = 16;       // Samples sharing a bit width
+
+uint16_t Get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+// LZ4 block of exactly @p raw_length bytes
+bool DecodeLz4(const uint8_t* src, size_t length, size_t raw_length, std::vector<uint8_t>& block) {
+    size_t ip = 0;
+    while (ip < length) {
+        const uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= length) {
+                    return false;
+                }
+                extra = src[ip++];
+                literals += extra;
+            } while (extra == 255);
+        }
+        if (literals > length - ip || literals > raw_length - block.size()) {
+            return false;
+        }
+        block.insert(block.end(), src + ip, src + ip + literals);
+        ip += literals;
+        if (ip == length) {
+            break;  // The last sequence has no match
+        }
+
+        if (length - ip < 2) {
+            return false;
+        }
+        const size_t offset = Get16(src + ip);
+        ip += 2;
+        if (offset == 0 || offset > block.size()) {
+            return false;
+        }
+        size_t match = token & 0x0F;
+        if (match == 15) {
+            uint8_t extra;
+            do {
+                if (ip >= length) {
+                    return false;
+                }
+                extra = src[ip++];
+                match += extra;
+            } while (extra == 255);
+        }
+        match += kMinMatch;
+        if (match > raw_length - block.size()) {
+            return false;
+        }
+        // Byte by byte: a match may overlap what it copies
+        size_t from = block.size() - offset;
+        for (size_t i = 0; i < match; ++i) {
+            block.push_back(block[from + i]);
+        }
+    }
+    return block.size() == raw_length;
+}
+
+// Bit-packed zigzag deltas back to @p raw_length bytes of 16-bit samples
+bool DecodeDeltas(const uint8_t* src, size_t length, size_t raw_length, size_t channels,
+                  std::vector<uint8_t>& block) {
+    const size_t samples = raw_length / 2;
+    block.resize(raw_length);
+    size_t ip = 0;
+    for (size_t group = 0; group < samples; group += kGroup) {
+        const size_t count = std::min(kGroup, samples - group);
+        if (ip >= length) {
+            return false;
+        }
+        const unsigned width = src[ip++];
+        if (width > 16 || (count * width + 7) / 8 > length - ip) {
+            return false;
+        }
+
+        uint32_t bits = 0;
+        unsigned pending = 0;
+        for (size_t k = 0; k < count; ++k) {
+            while (pending < width) {
+                bits |= static_cast<uint32_t>(src[ip++]) << pending;
+                pending += 8;
+            }
+            const uint16_t value = static_cast<uint16_t>(bits & ((1u << width) - 1));
+            bits >>= width;
+            pending -= width;
+
+            const size_t i = group + k;
+            const uint16_t delta = static_cast<uint16_t>((value >> 1) ^ ((value & 1) ? 0xFFFF : 0));
+            const uint16_t previous = i >= channels ? Get16(&block[2 * (i - channels)]) : 0;
+            const uint16_t sample = static_cast<uint16_t>(previous + delta);
+            block[2 * i] = static_cast<uint8_t>(sample);
+            block[2 * i + 1] = static_cast<uint8_t>(sample >> 8);
+        }
+    }
+    if (raw_length & 1) {
+        if (ip >= length) {
+            return false;
+        }
+        block.back() = src[ip++];
+    }
+    return ip == length;
+}
+
+} // namespace
+
+bool StreamDecompressor::DecodeFrame(uint8_t flags, uint8_t delta_channels, const uint8_t* payload,
+                                     size_t payload_length, size_t raw_length, std::vector<uint8_t>& output) {
+    std::vector<uint8_t> block;
+    block.reserve(raw_length);
+    if (flags == kFlagLz4) {
+        if (!DecodeLz4(payload, payload_length, raw_length, block)) {
+            return false;
+        }
+    } else if (flags == kFlagDelta) {
+        if (delta_channels == 0 || !DecodeDeltas(payload, payload_length, raw_length, delta_channels, block)) {
+            return false;
+        }
+    } else if (flags == 0 && payload_length == raw_length) {
+        block.assign(payload, payload + payload_length);
+    } else {
+        return false;
+    }
+    output.insert(output.end(), block.begin(), block.end());
+    return true;
+}
+
+void StreamDecompressor::Feed(const uint8_t* data, size_t length, std::vector<uint8_t>& output) {
+    pending_.insert(pending_.end(), data, data + length);
+
+    size_t start = 0;
+    auto skip = [&](size_t bytes) {
+        // A run of bytes between frames counts once
+        if (!in_garbage_) {
+            stats_.corrupt++;
+            in_garbage_ = true;
+        }
+        start += bytes;
+    };
+
+    while (pending_.size() - start >= 2) {
+        const uint8_t* frame = pending_.data() + start;
+        if (frame[0] != 'L' || frame[1] != 'Z') {
+            skip(1);
+            continue;
+        }
+        if (pending_.size() - start < kFrameHeader) {
+            break;
+        }
+
+        const uint8_t flags = frame[2];
+        const uint8_t delta_channels = frame[3];
+        const size_t raw_length = Get16(frame + 4);
+        const size_t payload_length = Get16(frame + 6);
+        const uint16_t number = Get16(frame + 8);
+        if (flags != 0 && flags != kFlagLz4 && flags != kFlagDelta) {
+            skip(1);  // "LZ" inside other bytes
+            continue;
+        }
+        if (pending_.size() - start < kFrameHeader + payload_length) {
+            break;
+        }
+
+        if (!DecodeFrame(flags, delta_channels, frame + kFrameHeader, payload_length, raw_length, output)) {
+            skip(1);
+            continue;
+        }
+
+        if (have_frame_ && number != next_frame_) {
+            stats_.missing += static_cast<uint16_t>(number - next_frame_);
+        }
+        have_frame_ = true;
+        next_frame_ = static_cast<uint16_t>(number + 1);
+        in_garbage_ = false;
+        stats_.frames++;
+        stats_.packed_bytes += kFrameHeader + payload_length;
+        stats_.raw_bytes += raw_length;
+        start += kFrameHeader + payload_length;
+    }
+
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(start));
+}
+
+void StreamDecompressor::Finish() {
+    if (!pending_.empty()) {
+        if (!in_garbage_) {
+            stats_.corrupt++;
+        }
+        pending_.clear();
+    }
+    in_garbage_ = false;
+}
+
+bool UnpackStreamFile(const std::string& input, const std::string& output,
+                      StreamDecompressorStats& stats, std::string& error) {
+    std::ifstream in(input, std::ios::binary);
+    if (!in.is_open()) {
+        error = "Cannot open " + input;
+        return false;
+    }
+    char magic[4] = {};
+    in.read(magic, sizeof(magic));
+    const bool capture = in.gcount() == 4 && std::string(magic, 4) == "LCAP";
+    in.close();
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        error = "Cannot write " + output;
+        return false;
+    }
+
+    StreamDecompressor decompressor;
+    std::vector<uint8_t> restored;
+    auto feed = [&](const uint8_t* data, size_t length) {
+        restored.clear();
+        decompressor.Feed(data, length, restored);
+        out.write(reinterpret_cast<const char*>(restored.data()), static_cast<std::streamsize>(restored.size()));
+    };
+
+    if (capture) {
+        CaptureReader reader;
+        if (!reader.Open(input, error)) {
+            return false;
+        }
+        if (reader.GetPorts().size() != 1) {
+            error = input + " holds " + std::to_string(reader.GetPorts().size()) +
+                    " ports; unpack needs a capture of one";
+            return false;
+        }
+        CaptureRecord record;
+        while (reader.Next(record)) {
+            feed(record.data.data(), record.data.size());
+        }
+    } else {
+        in.open(input, std::ios::binary);
+        std::vector<char> chunk(1 << 20);
+        while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || in.gcount() > 0) {
+            feed(reinterpret_cast<const uint8_t*>(chunk.data()), static_cast<size_t>(in.gcount()));
+        }
+    }
+    decompressor.Finish();
+    stats = decompressor.GetStats();
+
+    if (!out.good()) {
+        error = "Failed to write " + output;
+        return false;
+    }
+    if (stats.frames == 0) {
+        error = input + " holds no compressed frames";
+        return false;
+    }
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Counters of a decompressed stream
+ */
+struct StreamDecompressorStats {
+    uint64_t frames = 0;
+    uint64_t packed_bytes = 0;     // Frame bytes read, headers included
+    uint64_t raw_bytes = 0;        // Bytes restored
+    uint64_t missing = 0;          // Frames skipped in the numbering (lost on the device or link)
+    uint64_t corrupt = 0;          // Frames that failed to decode, and runs of bytes between frames
+};
+
+/**
+ * @brief Restores a stream of StreamCompressor frames (framework/stream_compressor.h)
+ *
+ * Bytes can arrive in any chunking. Frames are found by their "LZ"
+ * marker, so after a corrupt frame or bytes that aren't frames decoding
+ * picks up again at the next one.
+ */
+class StreamDecompressor {
+public:
+    /**
+     * @brief Feed the next bytes; decoded blocks are appended to @p output
+     */
+    void Feed(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Count what is left over as corrupt (a stream cut mid-frame)
+     */
+    void Finish();
+
+    const StreamDecompressorStats& GetStats() const { return stats_; }
+
+    /**
+     * @brief Decode one frame's payload
+     * @return false if the payload doesn't decode to @p raw_length bytes
+     */
+    static bool DecodeFrame(uint8_t flags, uint8_t delta_channels, const uint8_t* payload,
+                            size_t payload_length, size_t raw_length, std::vector<uint8_t>& output);
+
+private:
+    std::vector<uint8_t> pending_;     // Bytes of a frame not yet complete
+    bool have_frame_ = false;          // A frame was decoded, next_frame_ is valid
+    uint16_t next_frame_ = 0;
+    bool in_garbage_ = false;          // Skipping bytes that aren't a frame
+    StreamDecompressorStats stats_;
+};
+
+/**
+ * @brief Decompress a file written through a StreamCompressor (lumos unpack)
+ *
+ * @p input is the raw stream (e.g. a log from the SD card) or a capture
+ * of one port (lumos monitor --usb --capture).
+ */
+bool UnpackStreamFile(const std::string& input, const std::string& output,
+                      StreamDecompressorStats& stats, std::string& error);
+
+} // namespace Lumos
@@ -0,0 +1,263 @@
+#include "swd_flasher.h"
+#include "process.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+std::string Hex(uint32_t value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%08X", value);
+    return buf;
+}
+
+// Tcl word for a path, which may contain spaces
+std::string TclPath(const std::string& path) {
+    return "{" + fs::path(path).generic_string() + "}";
+}
+
+// DBGMCU_IDCODE of a platform; DEV_ID is bits 11:0
+uint32_t GetIdCodeAddress(const std::string& platform) {
+    if (platform == "h7") {
+        return 0x5C001000;
+    }
+    if (platform == "g0") {
+        return 0x40015800;
+    }
+    if (platform == "h5") {
+        return 0x44024000;
+    }
+    return 0;
+}
+
+} // namespace
+
+SwdFlasher::SwdFlasher(const SwdOptions& options) : options_(options) {
+    if (options_.target_config.empty()) {
+        options_.target_config = GetTargetConfig(options_.platform);
+    }
+}
+
+std::string SwdFlasher::GetTargetConfig(const std::string& platform) {
+    if (platform == "h7") {
+        return "target/stm32h7x.cfg";
+    }
+    if (platform == "g0") {
+        return "target/stm32g0x.cfg";
+    }
+    if (platform == "h5") {
+        return "target/stm32h5x.cfg";
+    }
+    return "";
+}
+
+bool SwdFlasher::Flash(const std::vector<SimpleSerial::FirmwareData>& segments, bool delta, bool verify) {
+    if (options_.target_config.empty()) {
+        SetError("No OpenOCD target config for platform '" + options_.platform + "'");
+        return false;
+    }
+    std::error_code ec;
+    fs::create_directories(options_.work_dir, ec);
+
+    std::vector<const SimpleSerial::FirmwareData*> ranges;
+    for (const auto& segment : segments) {
+        ranges.push_back(&segment);
+    }
+    pending_.clear();
+    read_back_.clear();
+    if (!FlashRanges(ranges, delta)) {
+        return false;
+    }
+    read_back_.clear();
+    if (pending_.empty() && !verify) {
+        return true;
+    }
+
+    std::vector<std::string> commands = {"init", "reset halt"};
+    commands.insert(commands.end(), pending_.begin(), pending_.end());
+    if (verify) {
+        for (const auto& segment : segments) {
+            std::string file = WriteTempFile(segment.Bytes(), segment.Size());
+            if (file.empty()) {
+                return false;
+            }
+            commands.push_back("verify_image " + TclPath(file) + " " + Hex(segment.start_address) + " bin");
+        }
+    }
+    commands.push_back("reset run");
+    commands.push_back("shutdown");
+
+    std::cout << "\nProgramming through OpenOCD..." << std::endl;
+    return RunOpenOcd(commands);
+}
+
+std::vector<std::string> SwdFlasher::GetOpenOcdArgs(const SwdOptions& options) {
+    std::vector<std::string> args = {options.openocd, "-f", "interface/" + options.probe + ".cfg"};
+    if (options.probe == "cmsis-dap") {
+        args.insert(args.end(), {"-c", "transport select swd"});
+    }
+    if (!options.serial.empty()) {
+        args.insert(args.end(), {"-c", "adapter serial " + options.serial});
+    }
+    const std::string target = options.target_config.empty() ? GetTargetConfig(options.platform)
+                                                             : options.target_config;
+    args.insert(args.end(), {"-f", target});
+    args.insert(args.end(), {"-c", "adapter speed " + std::to_string(options.speed_khz)});
+    return args;
+}
+
+bool SwdFlasher::RunOpenOcd(const std::vector<std::string>& commands, std::string* output) {
+    std::vector<std::string> args = GetOpenOcdArgs(options_);
+    for (const auto& command : commands) {
+        args.insert(args.end(), {"-c", command});
+    }
+
+    ProcessResult result = Process::Run(args);
+    if (!result.Succeeded()) {
+        std::string error = "OpenOCD " + result.Describe();
+        if (!result.started) {
+            error += " (is " + options_.openocd + " installed and on the PATH?)";
+        } else if (!result.output.empty()) {
+            // The last lines say what went wrong
+            size_t start = result.output.size();
+            for (int lines = 0; lines < 6 && start > 1; lines++) {
+                size_t newline = result.output.rfind('\n', start - 2);
+                start = newline == std::string::npos ? 0 : newline + 1;
+            }
+            error += ":\n" + result.output.substr(start);
+        }
+        SetError(error);
+        return false;
+    }
+    if (output != nullptr) {
+        *output = result.output;
+    }
+    return true;
+}
+
+bool SwdFlasher::GetProductId(uint16_t& pid) {
+    const uint32_t idcode = GetIdCodeAddress(options_.platform);
+    if (idcode == 0) {
+        return false;
+    }
+    std::string output;
+    if (!RunOpenOcd({"init", "mdw " + Hex(idcode), "shutdown"}, &output)) {
+        return false;
+    }
+
+    // "0x5c001000: 10036483"
+    std::string address = Hex(idcode);
+    std::transform(address.begin(), address.end(), address.begin(), ::tolower);
+    size_t pos = output.find(address.substr(2) + ":");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    unsigned long value = std::strtoul(output.c_str() + pos + address.size() - 1, nullptr, 16);
+    pid = static_cast<uint16_t>(value & 0xFFF);
+    return true;
+}
+
+bool SwdFlasher::PrepareReadBack(const std::vector<SimpleSerial::FlashSector>& sectors) {
+    // One dump per run of adjacent sectors
+    std::vector<ReadBack> ranges;
+    for (const auto& sector : sectors) {
+        if (!ranges.empty() && ranges.back().address + ranges.back().data.size() == sector.address) {
+            ranges.back().data.resize(ranges.back().data.size() + sector.size);
+        } else {
+            ranges.push_back({sector.address, std::vector<uint8_t>(sector.size)});
+        }
+    }
+    return Dump(ranges);
+}
+
+bool SwdFlasher::Dump(const std::vector<ReadBack>& ranges) {
+    std::vector<std::string> commands = {"init", "reset halt"};
+    std::vector<std::string> files;
+    for (const auto& range : ranges) {
+        std::string file = (fs::path(options_.work_dir) / ("read_" + std::to_string(temp_files_++) + ".bin")).string();
+        files.push_back(file);
+        commands.push_back("dump_image " + TclPath(file) + " " + Hex(range.address) + " " +
+                           std::to_string(range.data.size()));
+    }
+    commands.push_back("shutdown");
+    if (!RunOpenOcd(commands)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        std::ifstream in(files[i], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.size() != ranges[i].data.size()) {
+            SetError("Short read-back at " + Hex(ranges[i].address));
+            return false;
+        }
+        read_back_.push_back({ranges[i].address, std::move(data)});
+    }
+    return true;
+}
+
+bool SwdFlasher::ReadMemory(uint32_t address, uint8_t* data, size_t length) {
+    for (const auto& range : read_back_) {
+        if (address >= range.address && address + length <= range.address + range.data.size()) {
+            memcpy(data, range.data.data() + (address - range.address), length);
+            return true;
+        }
+    }
+    if (!Dump({{address, std::vector<uint8_t>(length)}})) {
+        return false;
+    }
+    memcpy(data, read_back_.back().data.data(), length);
+    return true;
+}
+
+bool SwdFlasher::EraseMemory(bool full_erase) {
+    (void)full_erase;
+    pending_.push_back("flash erase_sector 0 0 last");
+    return true;
+}
+
+bool SwdFlasher::EraseSectors(const std::vector<SimpleSerial::FlashSector>& sectors) {
+    for (const auto& sector : sectors) {
+        pending_.push_back("flash erase_address " + Hex(sector.address) + " " + Hex(sector.size));
+    }
+    return true;
+}
+
+bool SwdFlasher::WriteImage(uint32_t address, const uint8_t* data, size_t length, bool skip_erased,
+                            size_t& written, size_t total) {
+    (void)skip_erased;
+    (void)total;
+    std::string file = WriteTempFile(data, length);
+    if (file.empty()) {
+        return false;
+    }
+    pending_.push_back("flash write_image " + TclPath(file) + " " + Hex(address) + " bin");
+    written += length;
+    return true;
+}
+
+std::string SwdFlasher::WriteTempFile(const uint8_t* data, size_t length) {
+    std::string file = (fs::path(options_.work_dir) / ("write_" + std::to_string(temp_files_++) + ".bin")).string();
+    std::ofstream out(file, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    if (!out) {
+        SetError("Failed to write " + file);
+        return "";
+    }
+    return file;
+}
+
+void SwdFlasher::SetError(const std::string& error) {
+    last_error_ = error;
+}
+
+} // namespace Lumos
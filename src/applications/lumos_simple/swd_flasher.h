@@ -0,0 +1,88 @@
+#pragma once
+
+#include "flash_target.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+struct SwdOptions {
+    std::string openocd = "openocd";  // OpenOCD executable
+    std::string probe = "stlink";     // stlink or cmsis-dap
+    std::string serial;               // Probe serial number, empty = the first one found
+    std::string platform;             // g0, h7 or h5: target config and DBGMCU address
+    std::string target_config;        // Overrides the OpenOCD target config of the platform
+    unsigned int speed_khz = 4000;    // SWD clock
+    std::string work_dir;             // Images passed to and read back from OpenOCD
+};
+
+/**
+ * @brief Flash over SWD with a debug probe (lumos flash --swd)
+ *
+ * Drives an ST-Link or CMSIS-DAP probe through OpenOCD, whose flash
+ * drivers program H7, G0 and H5 parts. Sector selection, sparse images
+ * and delta flashing are those of the serial flashers (FlashTarget);
+ * since every OpenOCD run connects to the target afresh, reads are
+ * fetched per sector run in one go and erases and writes are batched
+ * into a single programming run.
+ */
+class SwdFlasher : public SimpleSerial::FlashTarget {
+public:
+    explicit SwdFlasher(const SwdOptions& options);
+
+    /**
+     * @brief Program @p segments (in address order) and restart the target
+     * @param delta Only erase and write sectors whose contents differ
+     * @param verify Have OpenOCD read back every segment after writing
+     */
+    bool Flash(const std::vector<SimpleSerial::FirmwareData>& segments, bool delta, bool verify);
+
+    std::string GetLastError() const { return last_error_; }
+
+    /**
+     * @brief OpenOCD target config of a board platform (empty if unknown)
+     */
+    static std::string GetTargetConfig(const std::string& platform);
+
+    /**
+     * @brief OpenOCD command line selecting the probe and target of @p options
+     *
+     * Commands to run follow as "-c" arguments.
+     */
+    static std::vector<std::string> GetOpenOcdArgs(const SwdOptions& options);
+
+protected:
+    bool GetProductId(uint16_t& pid) override;
+    bool ReadMemory(uint32_t address, uint8_t* data, size_t length) override;
+    bool EraseMemory(bool full_erase) override;
+    bool EraseSectors(const std::vector<SimpleSerial::FlashSector>& sectors) override;
+    bool WriteImage(uint32_t address, const uint8_t* data, size_t length, bool skip_erased,
+                    size_t& written, size_t total) override;
+    bool PrepareReadBack(const std::vector<SimpleSerial::FlashSector>& sectors) override;
+    void SetError(const std::string& error) override;
+
+private:
+    struct ReadBack {
+        uint32_t address;
+        std::vector<uint8_t> data;
+    };
+
+    // Run OpenOCD with the probe and target set up, then @p commands
+    bool RunOpenOcd(const std::vector<std::string>& commands, std::string* output = nullptr);
+
+    // Fetch [address, address + size) of each range into read_back_
+    bool Dump(const std::vector<ReadBack>& ranges);
+
+    // Write @p data to a fresh file in the work directory
+    std::string WriteTempFile(const uint8_t* data, size_t length);
+
+    SwdOptions options_;
+    std::vector<std::string> pending_;  // Erase and write commands of the programming run
+    std::vector<ReadBack> read_back_;
+    std::string last_error_;
+    int temp_files_ = 0;
+};
+
+} // namespace Lumos
@@ -0,0 +1,260 @@
+#include "target_trace.h"
+#include "elf_file.h"
+#include "interrupt_poll.h"
+#include "json_util.h"
+#include "serial.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+namespace Lumos {
+
+namespace {
+
+const uint8_t kFrameMarker = 0xFE;      // FlushTrace() in wrapper/trace.h
+const size_t kHeaderBytes = 10;         // Marker, count, dropped, clock (after the 0x00)
+const size_t kEventBytes = 12;
+const size_t kMaxEventsPerFrame = 16;
+
+// CRC-8, polynomial 0x07, as the firmware computes it
+uint8_t Crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t ReadU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Track name of an exception number
+std::string GetContextName(uint16_t context) {
+    switch (context) {
+    case 0: return "thread";
+    case 2: return "NMI";
+    case 3: return "HardFault";
+    case 11: return "SVCall";
+    case 14: return "PendSV";
+    case 15: return "SysTick";
+    default: break;
+    }
+    if (context >= 16) {
+        return "IRQ " + std::to_string(context - 16);
+    }
+    return "exception " + std::to_string(context);
+}
+
+} // namespace
+
+TargetTraceParser::Result TargetTraceParser::Feed(uint8_t byte) {
+    if (!in_frame_) {
+        if (byte != 0) {
+            return Result::Text;
+        }
+        in_frame_ = true;
+        pending_.clear();
+        return Result::Pending;
+    }
+
+    pending_.push_back(byte);
+    if (pending_[0] != kFrameMarker) {
+        // Another 0x00-framed stream (token log, profiler); not ours
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    if (pending_.size() >= 2 && (pending_[1] == 0 || pending_[1] > kMaxEventsPerFrame)) {
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    if (pending_.size() < kHeaderBytes) {
+        return Result::Pending;
+    }
+    const size_t total = kHeaderBytes + pending_[1] * kEventBytes + 1;
+    if (pending_.size() < total) {
+        return Result::Pending;
+    }
+
+    in_frame_ = false;
+    if (Crc8(pending_.data() + 1, total - 2) != pending_[total - 1]) {
+        ++errors_;
+        return Result::Error;
+    }
+    dropped_total_ = ReadU32(pending_.data() + 2);
+    clock_khz_ = ReadU32(pending_.data() + 6);
+    events_.resize(pending_[1]);
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const uint8_t* data = pending_.data() + kHeaderBytes + i * kEventBytes;
+        events_[i].cycles = ReadU32(data);
+        events_[i].name = ReadU32(data + 4);
+        events_[i].context = static_cast<uint16_t>(data[8] | (data[9] << 8));
+        events_[i].type = data[10] <= 2 ? static_cast<TargetTraceEvent::Type>(data[10])
+                                        : TargetTraceEvent::Type::Instant;
+    }
+    return Result::Frame;
+}
+
+bool TargetTrace::LoadNames(const std::string& elf_path, std::string& error) {
+    sections_.clear();
+    names_.clear();
+
+    ElfFile elf;
+    if (!elf.Load(elf_path, error)) {
+        return false;
+    }
+    // Scope names are in .lumos_log, which is linked at 0 as an INFO
+    // section; the wrappers' ISR names are ordinary literals in .rodata.
+    // Debug info and the H7's .itcm_text also start at 0, so sections are
+    // picked by name, never by address: .lumos_log first, then .rodata.
+    for (const char* name : {".lumos_log", ".rodata"}) {
+        const ElfSection* section = elf.FindSection(name);
+        if (section != nullptr && !section->nobits && section->size > 0) {
+            sections_.push_back({section->address, elf.GetContents(*section)});
+        }
+    }
+    return true;
+}
+
+std::string TargetTrace::GetName(uint32_t address) const {
+    auto cached = names_.find(address);
+    if (cached != names_.end()) {
+        return cached->second;
+    }
+
+    std::string name;
+    for (const Section& section : sections_) {
+        if (address < section.address || address - section.address >= section.contents.size()) {
+            continue;
+        }
+        for (size_t i = address - section.address; i < section.contents.size() && section.contents[i] != 0; ++i) {
+            name += static_cast<char>(section.contents[i]);
+        }
+        break;
+    }
+    if (name.empty()) {
+        char text[16];
+        snprintf(text, sizeof(text), "0x%08x", static_cast<unsigned>(address));
+        name = text;
+    }
+    names_[address] = name;
+    return name;
+}
+
+void TargetTrace::Add(const std::vector<TargetTraceEvent>& events, uint32_t clock_khz, uint32_t dropped_total) {
+    // Drops before the first frame happened before the capture started
+    if (have_dropped_) {
+        dropped_ += dropped_total - last_dropped_;
+    }
+    have_dropped_ = true;
+    last_dropped_ = dropped_total;
+
+    if (clock_khz == 0) {
+        return;
+    }
+    for (const TargetTraceEvent& event : events) {
+        // Events come in cycle order, so the unsigned step extends the count
+        if (have_cycles_) {
+            cycles_ += event.cycles - last_cycles_;
+        }
+        have_cycles_ = true;
+        last_cycles_ = event.cycles;
+        events_.push_back({static_cast<double>(cycles_) * 1000.0 / clock_khz, event.name, event.context, event.type});
+    }
+}
+
+bool TargetTrace::WriteChromeTrace(const std::string& path) const {
+    std::set<uint16_t> contexts;
+    for (const Event& event : events_) {
+        contexts.insert(event.context);
+    }
+
+    std::ostringstream ss;
+    ss.precision(3);
+    ss << std::fixed;
+    ss << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    bool first = true;
+    for (uint16_t context : contexts) {
+        ss << (first ? "" : ",\n");
+        ss << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << context
+           << ", \"args\": {\"name\": " << JsonString(GetContextName(context)) << "}},\n";
+        // Thread mode on top, interrupts below in exception number order
+        ss << "  {\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << context
+           << ", \"args\": {\"sort_index\": " << context << "}}";
+        first = false;
+    }
+    for (const Event& event : events_) {
+        const char* phase = event.type == TargetTraceEvent::Type::Begin ? "B"
+                          : event.type == TargetTraceEvent::Type::End   ? "E"
+                                                                        : "i";
+        ss << (first ? "" : ",\n");
+        ss << "  {\"name\": " << JsonString(GetName(event.name)) << ", \"ph\": \"" << phase
+           << "\", \"ts\": " << event.time_us << ", \"pid\": 1, \"tid\": " << event.context;
+        if (event.type == TargetTraceEvent::Type::Instant) {
+            ss << ", \"s\": \"t\"";
+        }
+        ss << "}";
+        first = false;
+    }
+    ss << "\n]}\n";
+
+    return WriteFileAtomically(path, ss.str());
+}
+
+bool RunTargetTrace(const std::string& port, int baud_rate, double duration_s,
+                    const volatile bool& running, TargetTrace& trace, std::string& error) {
+    SimpleSerial::Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.baud_rate = baud_rate;
+    if (!serial.Open(port, config)) {
+        error = port + ": " + serial.GetLastError();
+        return false;
+    }
+
+    TargetTraceParser parser;
+    const auto start = std::chrono::steady_clock::now();
+    auto last_progress = start;
+    uint8_t buffer[1024];
+    while (running) {
+        const auto now = std::chrono::steady_clock::now();
+        if (duration_s > 0 && std::chrono::duration<double>(now - start).count() >= duration_s) {
+            break;
+        }
+        if (now - last_progress >= std::chrono::seconds(1)) {
+            last_progress = now;
+            std::cerr << "\r" << trace.GetEventCount() << " events" << std::flush;
+        }
+
+        int bytes_read = ReadPolled(serial, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            error = port + ": " + serial.GetLastError();
+            serial.Close();
+            return false;
+        }
+        for (int i = 0; i < bytes_read; ++i) {
+            const TargetTraceParser::Result result = parser.Feed(buffer[i]);
+            if (result == TargetTraceParser::Result::Frame) {
+                trace.Add(parser.GetEvents(), parser.GetClockKhz(), parser.GetDroppedTotal());
+            } else if (result == TargetTraceParser::Result::Text) {
+                std::cout << static_cast<char>(buffer[i]);
+            }
+        }
+    }
+    std::cerr << "\r" << trace.GetEventCount() << " events" << std::endl;
+    if (parser.GetErrorCount() > 0) {
+        std::cerr << parser.GetErrorCount() << " corrupt trace frames dropped" << std::endl;
+    }
+
+    serial.Close();
+    return true;
+}
+
+} // namespace Lumos
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Event of the firmware's scope trace (wrapper/trace.h)
+ */
+struct TargetTraceEvent {
+    enum class Type : uint8_t { Begin, End, Instant };
+
+    uint32_t cycles = 0;    // DWT->CYCCNT, wraps
+    uint32_t name = 0;      // Address of the name in firmware.elf
+    uint16_t context = 0;   // IPSR: 0 thread mode, else the exception number
+    Type type = Type::Instant;
+};
+
+/**
+ * @brief Picks trace frames out of a serial byte stream
+ *
+ * Frames start with 0x00 0xFE; other bytes are ordinary output. A frame
+ * with a bad CRC is dropped and counted.
+ */
+class TargetTraceParser {
+public:
+    enum class Result {
+        Text,       // The byte is ordinary output
+        Pending,    // Consumed as part of a frame
+        Frame,      // A frame completed, see GetEvents()
+        Error       // A corrupt or foreign frame was dropped
+    };
+
+    Result Feed(uint8_t byte);
+
+    const std::vector<TargetTraceEvent>& GetEvents() const { return events_; }
+    uint32_t GetDroppedTotal() const { return dropped_total_; }  // Firmware's count since startup
+    uint32_t GetClockKhz() const { return clock_khz_; }
+    uint64_t GetErrorCount() const { return errors_; }
+
+private:
+    std::vector<uint8_t> pending_;  // Frame bytes after the 0x00
+    bool in_frame_ = false;
+    std::vector<TargetTraceEvent> events_;
+    uint32_t dropped_total_ = 0;
+    uint32_t clock_khz_ = 0;
+    uint64_t errors_ = 0;
+};
+
+/**
+ * @brief Timeline of trace events, written as Chrome/Perfetto JSON (lumos trace)
+ *
+ * Cycle counts are extended past their 32-bit wrap, which assumes the
+ * firmware flushes at least once per wrap period (about 9 s at 480 MHz).
+ * Each exception number becomes its own track, thread mode the first.
+ */
+class TargetTrace {
+public:
+    /**
+     * @brief Read the strings the event names point at from @p elf_path
+     */
+    bool LoadNames(const std::string& elf_path, std::string& error);
+
+    void Add(const std::vector<TargetTraceEvent>& events, uint32_t clock_khz, uint32_t dropped_total);
+
+    size_t GetEventCount() const { return events_.size(); }
+    uint64_t GetDroppedCount() const { return dropped_; }
+
+    /**
+     * @brief Write the events in Chrome trace event format
+     */
+    bool WriteChromeTrace(const std::string& path) const;
+
+    /**
+     * @brief Name of the string at @p address, or its hex form if unknown
+     */
+    std::string GetName(uint32_t address) const;
+
+private:
+    struct Event {
+        double time_us;
+        uint32_t name;
+        uint16_t context;
+        TargetTraceEvent::Type type;
+    };
+
+    struct Section {
+        uint64_t address;
+        std::vector<uint8_t> contents;
+    };
+
+    std::vector<Section> sections_;     // .lumos_log and .rodata
+    std::vector<Event> events_;
+    bool have_cycles_ = false;
+    uint32_t last_cycles_ = 0;
+    uint64_t cycles_ = 0;               // Extended count of the last event
+    bool have_dropped_ = false;
+    uint32_t last_dropped_ = 0;
+    uint64_t dropped_ = 0;
+    mutable std::map<uint32_t, std::string> names_;
+};
+
+/**
+ * @brief Collect trace frames from @p port into @p trace
+ *
+ * Runs until @p running turns false or, if @p duration_s is positive,
+ * for that many seconds; other output of the firmware is passed through.
+ */
+bool RunTargetTrace(const std::string& port, int baud_rate, double duration_s,
+                    const volatile bool& running, TargetTrace& trace, std::string& error);
+
+} // namespace Lumos
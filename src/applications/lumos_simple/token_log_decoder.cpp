@@ -0,0 +1,214 @@
+#include "token_log_decoder.h"
+#include "elf_file.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace Lumos {
+
+namespace {
+
+const size_t kHeaderBytes = 9;          // Length, token, time (after the 0x00)
+const size_t kMaxArgumentBytes = 32;    // TokenLog::kMaxArgumentBytes
+
+// CRC-8, polynomial 0x07, as the firmware computes it
+uint8_t Crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint64_t ReadLittleEndian(const uint8_t* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+bool TokenLogDecoder::Load(const std::string& elf_path, std::string& error) {
+    formats_.clear();
+
+    ElfFile elf;
+    if (!elf.Load(elf_path, error)) {
+        return false;
+    }
+    const ElfSection* section = elf.FindSection(".lumos_log");
+    if (section == nullptr) {
+        error = elf_path + " has no .lumos_log section";
+        return false;
+    }
+
+    // Back-to-back NUL-terminated strings; a token is the address of one
+    const std::vector<uint8_t> contents = elf.GetContents(*section);
+    size_t start = 0;
+    for (size_t i = 0; i < contents.size(); ++i) {
+        if (contents[i] != 0) {
+            continue;
+        }
+        if (i > start) {
+            formats_[static_cast<uint32_t>(section->address + start)] =
+                std::string(reinterpret_cast<const char*>(contents.data() + start), i - start);
+        }
+        start = i + 1;
+    }
+    return true;
+}
+
+std::string TokenLogDecoder::Format(const TokenLogFrame& frame) const {
+    auto it = formats_.find(frame.token);
+    if (it == formats_.end()) {
+        char unknown[64];
+        snprintf(unknown, sizeof(unknown), "<unknown token 0x%08x, %zu argument bytes>",
+                 static_cast<unsigned>(frame.token), frame.args.size());
+        return unknown;
+    }
+
+    const std::string& format = it->second;
+    std::string out;
+    size_t arg = 0;
+    char piece[128];
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%') {
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            out += '%';
+            ++i;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < format.size() && strchr("-+ #0", format[j]) != nullptr) {
+            spec += format[j++];
+        }
+        while (j < format.size() && (isdigit(static_cast<unsigned char>(format[j])) || format[j] == '.')) {
+            spec += format[j++];
+        }
+        bool wide = false;
+        while (j < format.size() && strchr("hlLjztq", format[j]) != nullptr) {
+            if (format[j] == 'j' || format[j] == 'q' ||
+                (format[j] == 'l' && j + 1 < format.size() && format[j + 1] == 'l')) {
+                wide = true;
+            }
+            ++j;
+        }
+        if (j >= format.size()) {
+            out += format.substr(i);
+            break;
+        }
+        const char conversion = format[j];
+        i = j;
+
+        const bool is_float = strchr("fFeEgGaA", conversion) != nullptr;
+        const size_t bytes = (!is_float && wide) ? 8 : 4;
+        if (conversion == 's' || conversion == 'n') {
+            out += "<unsupported %" + std::string(1, conversion) + ">";
+            continue;
+        }
+        if (arg + bytes > frame.args.size()) {
+            out += "<missing>";
+            continue;
+        }
+        const uint64_t raw = ReadLittleEndian(frame.args.data() + arg, bytes);
+        arg += bytes;
+
+        if (is_float) {
+            float value;
+            const uint32_t bits = static_cast<uint32_t>(raw);
+            std::memcpy(&value, &bits, sizeof(value));
+            snprintf(piece, sizeof(piece), (spec + conversion).c_str(), static_cast<double>(value));
+        } else if (conversion == 'd' || conversion == 'i') {
+            const long long value = bytes == 8 ? static_cast<long long>(raw)
+                                               : static_cast<long long>(static_cast<int32_t>(raw));
+            snprintf(piece, sizeof(piece), (spec + "lld").c_str(), value);
+        } else if (conversion == 'u' || conversion == 'x' || conversion == 'X' || conversion == 'o') {
+            snprintf(piece, sizeof(piece), (spec + "ll" + conversion).c_str(), static_cast<unsigned long long>(raw));
+        } else if (conversion == 'c') {
+            snprintf(piece, sizeof(piece), (spec + "c").c_str(), static_cast<int>(raw & 0xFF));
+        } else if (conversion == 'p') {
+            snprintf(piece, sizeof(piece), "0x%08llx", static_cast<unsigned long long>(raw));
+        } else {
+            snprintf(piece, sizeof(piece), "<bad %%%c>", conversion);
+        }
+        out += piece;
+    }
+    return out;
+}
+
+TokenLogParser::Result TokenLogParser::Feed(uint8_t byte) {
+    if (!in_frame_) {
+        if (byte != 0) {
+            return Result::Text;
+        }
+        in_frame_ = true;
+        pending_.clear();
+        return Result::Pending;
+    }
+
+    pending_.push_back(byte);
+    if (pending_[0] > kMaxArgumentBytes) {
+        in_frame_ = false;
+        ++errors_;
+        return Result::Error;
+    }
+    const size_t total = kHeaderBytes + pending_[0] + 1;
+    if (pending_.size() < total) {
+        return Result::Pending;
+    }
+
+    in_frame_ = false;
+    if (Crc8(pending_.data(), total - 1) != pending_[total - 1]) {
+        ++errors_;
+        return Result::Error;
+    }
+    frame_.token = static_cast<uint32_t>(ReadLittleEndian(pending_.data() + 1, 4));
+    frame_.time_us = static_cast<uint32_t>(ReadLittleEndian(pending_.data() + 5, 4));
+    frame_.args.assign(pending_.begin() + kHeaderBytes, pending_.begin() + kHeaderBytes + pending_[0]);
+    return Result::Frame;
+}
+
+void TokenLogPrinter::Feed(const uint8_t* data, size_t length) {
+    if (decoder_ == nullptr) {
+        std::cout.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+        return;
+    }
+
+    size_t text_start = 0;
+    auto flush_text = [&](size_t end) {
+        if (end > text_start) {
+            std::cout.write(reinterpret_cast<const char*>(data + text_start),
+                            static_cast<std::streamsize>(end - text_start));
+            line_open_ = data[end - 1] != '\n';
+        }
+    };
+    for (size_t i = 0; i < length; ++i) {
+        const TokenLogParser::Result result = parser_.Feed(data[i]);
+        if (result == TokenLogParser::Result::Text) {
+            continue;
+        }
+        flush_text(i);
+        text_start = i + 1;
+        if (result == TokenLogParser::Result::Frame) {
+            const TokenLogFrame& frame = parser_.GetFrame();
+            char stamp[32];
+            snprintf(stamp, sizeof(stamp), "<%10.6f> ", frame.time_us / 1e6);
+            std::cout << (line_open_ ? "\n" : "") << stamp << decoder_->Format(frame) << '\n';
+            line_open_ = false;
+        }
+    }
+    flush_text(length);
+}
+
+} // namespace Lumos
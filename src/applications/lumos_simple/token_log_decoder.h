@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief Tokenized log frame (framework/token_log.h)
+ */
+struct TokenLogFrame {
+    uint32_t token = 0;
+    uint32_t time_us = 0;          // Low 32 bits of the firmware's GetCurrentTimeUs()
+    std::vector<uint8_t> args;
+};
+
+/**
+ * @brief Format strings of a firmware, read from its .lumos_log section
+ *
+ * The token of a message is the address of its format string, so the
+ * decoder needs the firmware.elf of exactly the running build.
+ */
+class TokenLogDecoder {
+public:
+    /**
+     * @brief Read the formats from @p elf_path
+     * @return false with @p error set if the file has no .lumos_log section
+     */
+    bool Load(const std::string& elf_path, std::string& error);
+
+    size_t GetFormatCount() const { return formats_.size(); }
+
+    /**
+     * @brief printf-style expansion of @p frame
+     *
+     * Integers are 4 bytes unless the conversion says ll/j, floating point
+     * is float32. Unknown tokens and short frames are printed as such.
+     */
+    std::string Format(const TokenLogFrame& frame) const;
+
+private:
+    std::map<uint32_t, std::string> formats_;
+};
+
+/**
+ * @brief Splits a serial byte stream into text and tokenized log frames
+ *
+ * Frames start with a 0x00 byte, which text output never contains; a
+ * frame with a bad CRC is dropped and counted.
+ */
+class TokenLogParser {
+public:
+    enum class Result {
+        Text,       // The byte is ordinary output
+        Pending,    // Consumed as part of a frame
+        Frame,      // A frame completed, see GetFrame()
+        Error       // A corrupt frame was dropped
+    };
+
+    Result Feed(uint8_t byte);
+
+    const TokenLogFrame& GetFrame() const { return frame_; }
+    uint64_t GetErrorCount() const { return errors_; }
+
+private:
+    std::vector<uint8_t> pending_;  // Frame bytes after the 0x00
+    bool in_frame_ = false;
+    TokenLogFrame frame_;
+    uint64_t errors_ = 0;
+};
+
+/**
+ * @brief Prints a byte stream to stdout with tokenized log frames expanded
+ *
+ * Text passes through as it arrives; each frame becomes a timestamped
+ * line of its own. Without a decoder everything is printed as is.
+ */
+class TokenLogPrinter {
+public:
+    /**
+     * @brief Expand frames with @p decoder (must outlive the printer)
+     */
+    void SetDecoder(const TokenLogDecoder* decoder) { decoder_ = decoder; }
+
+    void Feed(const uint8_t* data, size_t length);
+
+    uint64_t GetErrorCount() const { return parser_.GetErrorCount(); }
+
+private:
+    const TokenLogDecoder* decoder_ = nullptr;
+    TokenLogParser parser_;
+    bool line_open_ = false;   // Text since the last newline
+};
+
+} // namespace Lumos
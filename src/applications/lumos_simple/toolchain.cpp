@@ -0,0 +1,298 @@
+#include "toolchain.h"
+#include "json_util.h"
+#include "object_cache.h"
+#include "process.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Lumos {
+
+namespace {
+
+const char* const kCacheHeader = "lumos-toolchains 1";
+
+#ifdef _WIN32
+const char* const kCompiler = "arm-none-eabi-gcc.exe";
+const char kPathSeparator = ';';
+const char* const kNullFile = "NUL";
+#else
+const char* const kCompiler = "arm-none-eabi-gcc";
+const char kPathSeparator = ':';
+const char* const kNullFile = "/dev/null";
+#endif
+
+std::string Trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+// The "#include <...> search starts here:" list of `gcc -E -v`
+std::vector<std::string> ParseIncludeDirs(const std::string& output) {
+    std::vector<std::string> dirs;
+    std::istringstream lines(output);
+    std::string line;
+    bool in_list = false;
+    while (std::getline(lines, line)) {
+        if (line.find("#include <...> search starts here:") == 0) {
+            in_list = true;
+        } else if (line.find("End of search list.") == 0) {
+            break;
+        } else if (in_list && !line.empty() && line[0] == ' ') {
+            dirs.push_back(fs::path(Trim(line)).lexically_normal().string());
+        }
+    }
+    return dirs;
+}
+
+bool HasCompiler(const fs::path& dir) {
+    std::error_code ec;
+    return fs::is_regular_file(dir / kCompiler, ec);
+}
+
+} // namespace
+
+int Toolchain::GetMajorVersion() const {
+    return std::atoi(version.c_str());
+}
+
+ToolchainFinder::ToolchainFinder(const std::string& resource_base, const std::string& cache_file)
+    : resource_base_(resource_base),
+      cache_file_(cache_file)
+{
+    if (!cache_file_.empty()) {
+        Load();
+    }
+}
+
+std::string ToolchainFinder::DefaultCacheFile() {
+    std::string dir = ObjectCache::DefaultDirectory();
+    return dir.empty() ? "" : (fs::path(dir) / "toolchains").string();
+}
+
+int ToolchainFinder::CompareVersions(const std::string& a, const std::string& b) {
+    std::istringstream left(a);
+    std::istringstream right(b);
+    std::string left_part;
+    std::string right_part;
+    while (true) {
+        bool more_left = static_cast<bool>(std::getline(left, left_part, '.'));
+        bool more_right = static_cast<bool>(std::getline(right, right_part, '.'));
+        if (!more_left && !more_right) {
+            return 0;
+        }
+        int left_number = more_left ? std::atoi(left_part.c_str()) : 0;
+        int right_number = more_right ? std::atoi(right_part.c_str()) : 0;
+        if (left_number != right_number) {
+            return left_number < right_number ? -1 : 1;
+        }
+    }
+}
+
+void ToolchainFinder::Load() {
+    std::ifstream file(cache_file_);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) {
+        // Unknown format, probe again
+        dirty_ = true;
+        return;
+    }
+
+    // "gcc\t<mtime>\t<size>\t<version>\t<path>" followed by "c\t<dir>" and
+    // "cxx\t<dir>" lines of its include directories
+    Entry* entry = nullptr;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        std::getline(fields, kind, '\t');
+        if (kind == "gcc") {
+            Entry parsed;
+            std::string path;
+            if (!(fields >> parsed.mtime >> parsed.size) || fields.get() != '\t' ||
+                !std::getline(fields, parsed.version, '\t') || !std::getline(fields, path)) {
+                dirty_ = true;
+                return;
+            }
+            entry = &(entries_[path] = parsed);
+        } else if (entry != nullptr && (kind == "c" || kind == "cxx")) {
+            std::string dir;
+            std::getline(fields, dir);
+            (kind == "c" ? entry->c_includes : entry->cxx_includes).push_back(dir);
+        } else {
+            dirty_ = true;
+            return;
+        }
+    }
+}
+
+bool ToolchainFinder::Save() const {
+    if (cache_file_.empty() || !dirty_) {
+        return true;
+    }
+
+    std::ostringstream content;
+    content << kCacheHeader << "\n";
+    for (const auto& item : entries_) {
+        const Entry& entry = item.second;
+        content << "gcc\t" << entry.mtime << "\t" << entry.size << "\t" << entry.version << "\t" << item.first << "\n";
+        for (const auto& dir : entry.c_includes) {
+            content << "c\t" << dir << "\n";
+        }
+        for (const auto& dir : entry.cxx_includes) {
+            content << "cxx\t" << dir << "\n";
+        }
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(cache_file_).parent_path(), ec);
+    return WriteFileAtomically(cache_file_, content.str());
+}
+
+bool ToolchainFinder::Probe(const std::string& bin_dir, const std::string& origin, Toolchain& toolchain) {
+    std::error_code ec;
+    fs::path compiler = fs::absolute(fs::path(bin_dir) / kCompiler, ec).lexically_normal();
+    if (!HasCompiler(compiler.parent_path())) {
+        return false;
+    }
+    long long mtime = static_cast<long long>(fs::last_write_time(compiler, ec).time_since_epoch().count());
+    uintmax_t size = ec ? 0 : fs::file_size(compiler, ec);
+
+    toolchain.bin_dir = compiler.parent_path().string();
+    toolchain.origin = origin;
+
+    auto it = entries_.find(compiler.string());
+    if (it == entries_.end() || it->second.mtime != mtime || it->second.size != size) {
+        const std::string gcc = toolchain.bin_dir + "/arm-none-eabi-gcc";
+        ProcessResult version = Process::Run({gcc, "-dumpversion"});
+        if (!version.Succeeded() || Trim(version.output).empty()) {
+            return false;
+        }
+
+        Entry entry;
+        entry.mtime = mtime;
+        entry.size = size;
+        entry.version = Trim(version.output);
+        // -v prints the search list on stderr, which Run() captures too
+        entry.c_includes = ParseIncludeDirs(Process::Run({gcc, "-xc", "-E", "-v", kNullFile}).output);
+        entry.cxx_includes = ParseIncludeDirs(Process::Run({gcc, "-xc++", "-E", "-v", kNullFile}).output);
+        it = entries_.insert_or_assign(compiler.string(), entry).first;
+        dirty_ = true;
+    }
+
+    toolchain.version = it->second.version;
+    toolchain.c_includes = it->second.c_includes;
+    toolchain.cxx_includes = it->second.cxx_includes;
+    return true;
+}
+
+std::vector<Toolchain> ToolchainFinder::FindAll() {
+    std::vector<Toolchain> bundled;
+    std::vector<Toolchain> system;
+    std::vector<std::string> seen;
+    auto add = [&](const fs::path& dir, const std::string& origin, std::vector<Toolchain>& list) {
+        std::error_code ec;
+        fs::path canonical = fs::canonical(dir, ec);
+        if (ec || std::find(seen.begin(), seen.end(), canonical.string()) != seen.end()) {
+            return;
+        }
+        Toolchain toolchain;
+        if (Probe(dir.string(), origin, toolchain)) {
+            seen.push_back(canonical.string());
+            list.push_back(toolchain);
+        }
+    };
+
+    // toolchains/platform holds the per-family startup files, the rest
+    // are installations
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(fs::path(resource_base_) / "toolchains", ec)) {
+        if (entry.is_directory() && entry.path().filename() != "platform" && HasCompiler(entry.path() / "bin")) {
+            add(entry.path() / "bin", "bundled", bundled);
+        }
+    }
+
+    const char* path = std::getenv("PATH");
+    std::istringstream dirs(path != nullptr ? path : "");
+    std::string dir;
+    while (std::getline(dirs, dir, kPathSeparator)) {
+        if (!dir.empty() && HasCompiler(dir)) {
+            add(dir, "PATH", system);
+        }
+    }
+
+    auto newest_first = [](const Toolchain& a, const Toolchain& b) {
+        return CompareVersions(a.version, b.version) > 0;
+    };
+    std::stable_sort(bundled.begin(), bundled.end(), newest_first);
+    std::stable_sort(system.begin(), system.end(), newest_first);
+    bundled.insert(bundled.end(), system.begin(), system.end());
+    return bundled;
+}
+
+bool ToolchainFinder::Select(const std::string& request, Toolchain& toolchain, std::string& error) {
+    // A directory: arm-none-eabi-gcc's own or the installation above it
+    bool is_version = !request.empty() && std::isdigit(static_cast<unsigned char>(request[0]));
+    if (!request.empty() && !is_version && request != "newest" && request != "bundled" && request != "system") {
+        fs::path dir(request);
+        if (!HasCompiler(dir) && HasCompiler(dir / "bin")) {
+            dir /= "bin";
+        }
+        if (Probe(dir.string(), "configured", toolchain)) {
+            return true;
+        }
+        error = "No working " + std::string(kCompiler) + " in " + request;
+        return false;
+    }
+
+    // Bundled installations come first, so the first match is the newest
+    // bundled one unless a newer one was asked for
+    std::vector<Toolchain> found = FindAll();
+    if (request == "newest" && !found.empty()) {
+        toolchain = *std::max_element(found.begin(), found.end(), [](const Toolchain& a, const Toolchain& b) {
+            return CompareVersions(a.version, b.version) < 0;
+        });
+        return true;
+    }
+    for (const auto& candidate : found) {
+        bool match = true;
+        if (request == "bundled") {
+            match = candidate.origin == "bundled";
+        } else if (request == "system") {
+            match = candidate.origin == "PATH";
+        } else if (is_version) {
+            match = candidate.version == request || candidate.version.compare(0, request.size() + 1, request + ".") == 0;
+        }
+        if (match) {
+            toolchain = candidate;
+            return true;
+        }
+    }
+
+    std::ostringstream message;
+    if (found.empty()) {
+        message << "No arm-none-eabi toolchain found in " << resource_base_ << "/toolchains or on PATH";
+    } else {
+        message << "No toolchain matches '" << request << "' (found:";
+        for (const auto& candidate : found) {
+            message << " " << candidate.version << " [" << candidate.origin << "]";
+        }
+        message << ")";
+    }
+    error = message.str();
+    return false;
+}
+
+} // namespace Lumos
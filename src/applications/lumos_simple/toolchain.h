@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Lumos {
+
+/**
+ * @brief One arm-none-eabi GCC installation and what probing it found
+ */
+struct Toolchain {
+    std::string bin_dir;                    // Directory of arm-none-eabi-gcc, g++, ld, ...
+    std::string origin;                     // bundled, PATH or configured
+    std::string version;                    // arm-none-eabi-gcc -dumpversion, e.g. "13.2.1"
+    std::vector<std::string> c_includes;    // Built-in include directories for C
+    std::vector<std::string> cxx_includes;  // Built-in include directories for C++
+
+    // Path of an arm-none-eabi tool, e.g. Tool("g++")
+    std::string Tool(const std::string& name) const { return bin_dir + "/arm-none-eabi-" + name; }
+
+    // Leading number of the version, 0 if unknown
+    int GetMajorVersion() const;
+};
+
+/**
+ * @brief Finds arm-none-eabi toolchains and selects the one to build with
+ *
+ * Installations are looked for under the Lumos resources
+ * (toolchains/<name>/bin, "bundled") and on PATH. Each compiler is probed
+ * once for its -dumpversion and built-in include directories; the results
+ * are kept in a cache file keyed by the compiler's path, size and
+ * modification time, so later builds run no probes.
+ */
+class ToolchainFinder {
+public:
+    /**
+     * @param resource_base Lumos resource directory (parent of toolchains/)
+     * @param cache_file Probe cache (empty = probe every time)
+     */
+    ToolchainFinder(const std::string& resource_base, const std::string& cache_file);
+
+    /**
+     * @brief Every installation found, bundled ones first, newest first within each
+     */
+    std::vector<Toolchain> FindAll();
+
+    /**
+     * @brief Select the toolchain a build uses
+     * @param request "" (the newest bundled one, else the newest on PATH),
+     *        "newest", "bundled", "system" (PATH), a version or version prefix
+     *        such as "13" or "13.2", or a directory of arm-none-eabi-gcc or
+     *        the installation above it
+     * @param toolchain The selected toolchain
+     * @param error Why nothing matched
+     */
+    bool Select(const std::string& request, Toolchain& toolchain, std::string& error);
+
+    /**
+     * @brief Probe the compiler in @p bin_dir (through the cache)
+     * @return false if there is no working arm-none-eabi-gcc there
+     */
+    bool Probe(const std::string& bin_dir, const std::string& origin, Toolchain& toolchain);
+
+    /**
+     * @brief Write probes made since construction to the cache file
+     */
+    bool Save() const;
+
+    /**
+     * @brief The probe cache in the shared cache directory (empty if none)
+     */
+    static std::string DefaultCacheFile();
+
+    /**
+     * @brief Order two versions numerically, e.g. "9.2.1" < "10.3.1"
+     * @return Negative, zero or positive
+     */
+    static int CompareVersions(const std::string& a, const std::string& b);
+
+private:
+    struct Entry {
+        long long mtime = 0;
+        uintmax_t size = 0;
+        std::string version;
+        std::vector<std::string> c_includes;
+        std::vector<std::string> cxx_includes;
+    };
+
+    std::string resource_base_;
+    std::string cache_file_;
+    std::map<std::string, Entry> entries_;  // By compiler path
+    bool dirty_ = false;
+
+    void Load();
+};
+
+} // namespace Lumos
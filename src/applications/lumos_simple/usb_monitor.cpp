@@ -0,0 +1,75 @@
+#include "usb_monitor.h"
+#include <cstdio>
+#include <iostream>
+
+namespace Lumos {
+
+bool UsbMonitor::Open(const std::string& serial, std::string& error) {
+    if (!usb_.Open(SimpleSerial::kLumosUsbVid, SimpleSerial::kLumosUsbVendorPid, serial)) {
+        error = usb_.GetLastError();
+        return false;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "usb:%04x:%04x", SimpleSerial::kLumosUsbVid, SimpleSerial::kLumosUsbVendorPid);
+    name_ = serial.empty() ? name : std::string(name) + ":" + serial;
+    return true;
+}
+
+bool UsbMonitor::SetCaptureFile(const std::string& path, std::string& error) {
+    capture_.reset(new CaptureWriter());
+    if (!capture_->Open(path, {name_}, error)) {
+        capture_.reset();
+        return false;
+    }
+    return true;
+}
+
+double UsbMonitor::Now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+void UsbMonitor::PrintCaptureStats(double now, bool final) {
+    const uint64_t bytes = capture_->GetBytesCaptured();
+    char line[96];
+    snprintf(line, sizeof(line), "\r[%11.6f] captured %llu bytes (%.1f KB/s)", now,
+             static_cast<unsigned long long>(bytes), now > 0 ? bytes / now / 1024.0 : 0.0);
+    std::cout << line << (final ? "\n" : "") << std::flush;
+}
+
+void UsbMonitor::OnData(const uint8_t* data, size_t length) {
+    if (!capture_) {
+        printer_.Feed(data, length);
+        std::cout << std::flush;
+        return;
+    }
+    const double now = Now();
+    capture_->Append(0, static_cast<uint64_t>(now * 1e9), data, length);
+    if (now - last_stats_ >= 1.0) {
+        PrintCaptureStats(now, false);
+        last_stats_ = now;
+    }
+}
+
+uint64_t UsbMonitor::Run(const volatile bool& running) {
+    start_ = std::chrono::steady_clock::now();
+    last_stats_ = 0;
+    const uint64_t received = usb_.Stream(running, [this](const uint8_t* data, size_t length) {
+        OnData(data, length);
+    });
+    std::cout << std::flush;
+    if (!usb_.GetLastError().empty()) {
+        std::cerr << "\n" << usb_.GetLastError() << std::endl;
+    }
+    if (printer_.GetErrorCount() > 0) {
+        std::cerr << printer_.GetErrorCount() << " corrupt log frames dropped" << std::endl;
+    }
+    if (capture_) {
+        PrintCaptureStats(Now(), true);
+        if (!capture_->Close()) {
+            std::cerr << "Error: writing the capture file failed" << std::endl;
+        }
+    }
+    return received;
+}
+
+} // namespace Lumos
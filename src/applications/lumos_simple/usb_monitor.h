@@ -0,0 +1,60 @@
+#pragma once
+
+#include "capture_file.h"
+#include "token_log_decoder.h"
+#include "usb_bulk.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Lumos {
+
+/**
+ * @brief Print or capture a vendor bulk stream (lumos monitor --usb)
+ *
+ * For firmware that starts its port with USB::begin(USBInterface::Vendor):
+ * the stream is read with many large transfers queued (UsbBulk), which
+ * keeps up with the full bus rate where a CDC tty read loop falls behind.
+ * Output is printed like the serial monitor's, tokenized log frames
+ * included, or recorded raw to a capture file with the throughput shown
+ * once a second.
+ */
+class UsbMonitor {
+public:
+    /**
+     * @brief Open the device
+     * @param serial Only the device with this USB serial number (empty = any)
+     */
+    bool Open(const std::string& serial, std::string& error);
+
+    /**
+     * @brief Expand tokenized log frames with @p decoder (must outlive Run())
+     */
+    void SetTokenLogDecoder(const TokenLogDecoder* decoder) { printer_.SetDecoder(decoder); }
+
+    /**
+     * @brief Record the stream to @p path instead of printing it
+     */
+    bool SetCaptureFile(const std::string& path, std::string& error);
+
+    /**
+     * @brief Read until @p running turns false or the device goes away
+     * @return Bytes received
+     */
+    uint64_t Run(const volatile bool& running);
+
+private:
+    void OnData(const uint8_t* data, size_t length);
+    double Now() const;
+    void PrintCaptureStats(double now, bool final);
+
+    SimpleSerial::UsbBulk usb_;
+    std::string name_;
+    TokenLogPrinter printer_;
+    std::unique_ptr<CaptureWriter> capture_;
+    std::chrono::steady_clock::time_point start_;
+    double last_stats_ = 0;
+};
+
+} // namespace Lumos
@@ -1,27 +1,44 @@
 #include "flashworker.h"
-#include "lumos_bootloader.h"
 
 FlashWorker::FlashWorker(QObject* parent)
     : QThread(parent)
 {}
 
-void FlashWorker::setup(const QString& port, std::vector<uint8_t> firmware)
+void FlashWorker::setup(const QString& port, std::shared_ptr<const SimpleSerial::MappedFile> firmware)
 {
     m_port     = port;
     m_firmware = std::move(firmware);
 }
 
+void FlashWorker::cancel()
+{
+    m_loader.Cancel();
+}
+
 void FlashWorker::run()
 {
-    SimpleSerial::LumosBootloader bl;
+    m_loader.SetTransferCallback([this](size_t done, size_t total) {
+        if (done == 0) m_uploadTimer.start();
+        m_done  = done;
+        m_total = total;
+    });
 
-    const bool ok = bl.Flash(
+    const bool ok = m_loader.Flash(
         m_port.toStdString(),
-        m_firmware,
+        m_firmware->Data(), m_firmware->Size(),
         [this](int pct, const std::string& msg) {
-            emit progressUpdated(pct, QString::fromStdString(msg));
+            // Rate over the whole upload so far: steadier than per chunk,
+            // and windowed ACKs arrive in bursts anyway
+            double rate = -1.0;
+            int    eta  = -1;
+            const qint64 elapsed = m_uploadTimer.isValid() ? m_uploadTimer.elapsed() : 0;
+            if (m_done > 0 && m_done < m_total && elapsed > 0) {
+                rate = m_done * 1000.0 / elapsed;
+                eta  = static_cast<int>((m_total - m_done) / rate + 0.5);
+            }
+            emit progressUpdated(pct, QString::fromStdString(msg), rate, eta);
         }
     );
 
-    emit flashFinished(ok, ok ? QString() : QString::fromStdString(bl.GetLastError()));
+    emit flashFinished(ok, ok ? QString() : QString::fromStdString(m_loader.GetLastError()));
 }
@@ -1,13 +1,19 @@
 #pragma once
 
+#include "lumos_bootloader.h"
+#include "mapped_file.h"
+
+#include <QElapsedTimer>
 #include <QThread>
 #include <QString>
-#include <vector>
-#include <cstdint>
+#include <memory>
 
 /**
  * Background thread that runs the LumosBootloader flash sequence and
  * emits progress/completion signals back to the GUI thread.
+ *
+ * One worker flashes one port once; MainWindow runs several side by side
+ * for batch flashing.
  */
 class FlashWorker : public QThread
 {
@@ -16,14 +22,27 @@ class FlashWorker : public QThread
 public:
     explicit FlashWorker(QObject* parent = nullptr);
 
-    /** Call before start(). */
-    void setup(const QString& port, std::vector<uint8_t> firmware);
+    /**
+     * Call before start(). The mapped image is shared with the other jobs
+     * and streamed to the bootloader in place, never copied.
+     */
+    void setup(const QString& port, std::shared_ptr<const SimpleSerial::MappedFile> firmware);
 
-signals:
-    /** Emitted periodically during flashing (0-100, human-readable message). */
-    void progressUpdated(int percent, const QString& message);
+    const QString& port() const { return m_port; }
+
+    /** Thread-safe; the flash stops before its next packet and fails with "Cancelled". */
+    void cancel();
 
-    /** Emitted once when the operation completes or fails. */
+signals:
+    /**
+     * Emitted at each protocol step (0-100, human-readable message). While
+     * uploading, also the throughput so far and the time left; both are
+     * -1 outside the upload.
+     */
+    void progressUpdated(int percent, const QString& message,
+                         double bytesPerSecond, int etaSeconds);
+
+    /** Emitted once when the operation completes, fails or is cancelled. */
     void flashFinished(bool success, const QString& errorMessage);
 
 protected:
@@ -31,5 +50,11 @@ protected:
 
 private:
     QString              m_port;
-    std::vector<uint8_t> m_firmware;
+    std::shared_ptr<const SimpleSerial::MappedFile> m_firmware;
+    SimpleSerial::LumosBootloader m_loader;
+
+    // Upload phase only, measured on the worker thread
+    QElapsedTimer m_uploadTimer;
+    size_t        m_done  = 0;
+    size_t        m_total = 0;
 };
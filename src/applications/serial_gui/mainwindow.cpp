@@ -1,16 +1,23 @@
 #include "mainwindow.h"
 #include "flashworker.h"
+#include "plotwidget.h"
+#include "plotworker.h"
 #include "serialmonitor.h"
+#include "crc32.h"
+#include "port_watcher.h"
 #include "serial.h"
 
+#include <QCheckBox>
 #include <QComboBox>
 #include <QDateTime>
 #include <QSettings>
 #include <QFile>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QFont>
 #include <QGroupBox>
 #include <QHBoxLayout>
+#include <QHeaderView>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMessageBox>
@@ -19,17 +26,65 @@
 #include <QPushButton>
 #include <QScrollBar>
 #include <QSerialPortInfo>
+#include <QSpinBox>
 #include <QSplitter>
+#include <QTabWidget>
+#include <QTableWidget>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QWidget>
 
+namespace {
+
+// Terminal refresh period (~30 Hz)
+constexpr int kFlushIntervalMs = 33;
+
+// Lines kept in the terminal; older ones scroll out
+constexpr int kScrollbackLines = 2000;
+
+// Most output queued between refreshes (or while paused). Beyond that the
+// oldest bytes are dropped; at typical line lengths they would scroll out
+// of the scrollback on the next refresh anyway.
+constexpr int kMaxPendingBytes = 256 * 1024;
+
+// Flash queue table
+enum JobColumn { kColumnPort, kColumnFirmware, kColumnStatus, kColumnProgress,
+                 kColumnSpeed, kColumnEta, kJobColumns };
+
+// Most downloads at once; USB hubs and host serial drivers limit it anyway
+constexpr int kMaxParallelJobs = 16;
+
+// Plot time windows offered (seconds; 0 = everything held)
+constexpr double kPlotSpans[]      = {1.0, 10.0, 60.0, 600.0, 3600.0, 0.0};
+constexpr int    kDefaultPlotSpan  = 1;
+
+// App table, one row per "@app" name
+enum AppColumn { kAppName, kAppState, kAppRate, kAppSteps, kAppAvg, kAppMax,
+                 kAppJitter, kAppMisses, kAppErrors, kAppColumns };
+
+QString formatRate(double bytesPerSecond)
+{
+    if (bytesPerSecond < 0) return QString();
+    if (bytesPerSecond >= 1024.0 * 1024.0)
+        return QString("%1 MB/s").arg(bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1);
+    return QString("%1 KB/s").arg(bytesPerSecond / 1024.0, 0, 'f', 1);
+}
+
+QString formatEta(int seconds)
+{
+    if (seconds < 0) return QString();
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+} // namespace
+
 // ── Construction ──────────────────────────────────────────────────────────────
 
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent)
 {
     setWindowTitle("Lumos Firmware Downloader");
-    setMinimumSize(580, 700);
+    setMinimumSize(640, 820);
 
     QWidget*     central = new QWidget(this);
     QVBoxLayout* root    = new QVBoxLayout(central);
@@ -104,12 +159,47 @@ MainWindow::MainWindow(QWidget* parent)
         topLayout->addWidget(g);
     }
 
+    // Flash queue group: one row per download, several ports at once
+    {
+        QGroupBox*   g = new QGroupBox("Flash Queue", topWidget);
+        QVBoxLayout* v = new QVBoxLayout(g);
+
+        m_jobTable = new QTableWidget(0, kJobColumns, g);
+        m_jobTable->setHorizontalHeaderLabels({"Port", "Firmware", "Status", "Progress", "Speed", "ETA"});
+        m_jobTable->horizontalHeader()->setSectionResizeMode(kColumnStatus, QHeaderView::Stretch);
+        m_jobTable->verticalHeader()->setVisible(false);
+        m_jobTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+        m_jobTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        m_jobTable->setMaximumHeight(150);
+
+        QHBoxLayout* bar = new QHBoxLayout;
+        m_cancelButton    = new QPushButton("Cancel",         g);
+        m_clearJobsButton = new QPushButton("Clear Finished", g);
+        m_cancelButton->setToolTip("Cancel the selected downloads, or all of them if none is selected");
+
+        m_parallelSpin = new QSpinBox(g);
+        m_parallelSpin->setRange(1, kMaxParallelJobs);
+        m_parallelSpin->setValue(QSettings().value("flash/parallel", 4).toInt());
+        m_parallelSpin->setToolTip("Devices flashed at the same time");
+
+        bar->addWidget(m_cancelButton);
+        bar->addWidget(m_clearJobsButton);
+        bar->addStretch();
+        bar->addWidget(new QLabel("Parallel:", g));
+        bar->addWidget(m_parallelSpin);
+
+        v->addWidget(m_jobTable);
+        v->addLayout(bar);
+        topLayout->addWidget(g);
+    }
+
     // Download button
     m_downloadButton = new QPushButton("Download", topWidget);
     m_downloadButton->setFixedHeight(38);
     QFont bold = m_downloadButton->font();
     bold.setBold(true);
     m_downloadButton->setFont(bold);
+    m_downloadButton->setToolTip("Queue the selected firmware for the selected device");
     topLayout->addWidget(m_downloadButton);
 
     // ── Bottom half: terminal ─────────────────────────────────────────────
@@ -117,17 +207,26 @@ MainWindow::MainWindow(QWidget* parent)
     QVBoxLayout* termLayout = new QVBoxLayout(termGroup);
     termLayout->setSpacing(6);
 
-    // Toolbar row: Connect | Disconnect | Clear | Baud label + combo
+    // Toolbar row: Connect | Disconnect | Clear | Pause | Capture | Baud label + combo
     {
         QHBoxLayout* bar = new QHBoxLayout;
 
         m_connectButton    = new QPushButton("Connect",    termGroup);
         m_disconnectButton = new QPushButton("Disconnect", termGroup);
         m_clearButton      = new QPushButton("Clear",      termGroup);
+        m_pauseButton      = new QPushButton("Pause",      termGroup);
+        m_captureButton    = new QPushButton("Capture…",   termGroup);
+        m_formatsButton    = new QPushButton("Formats…",   termGroup);
 
         m_connectButton->setFixedWidth(90);
         m_disconnectButton->setFixedWidth(90);
         m_clearButton->setFixedWidth(60);
+        m_pauseButton->setFixedWidth(70);
+        m_pauseButton->setCheckable(true);
+        m_captureButton->setFixedWidth(90);
+        m_captureButton->setCheckable(true);
+        m_formatsButton->setFixedWidth(90);
+        m_formatsButton->setToolTip("Load firmware.elf to expand tokenized log frames");
 
         m_baudCombo = new QComboBox(termGroup);
         for (int baud : {9600, 19200, 38400, 57600, 115200, 230400})
@@ -138,6 +237,9 @@ MainWindow::MainWindow(QWidget* parent)
         bar->addWidget(m_connectButton);
         bar->addWidget(m_disconnectButton);
         bar->addWidget(m_clearButton);
+        bar->addWidget(m_pauseButton);
+        bar->addWidget(m_captureButton);
+        bar->addWidget(m_formatsButton);
         bar->addStretch();
         bar->addWidget(new QLabel("Baud:", termGroup));
         bar->addWidget(m_baudCombo);
@@ -150,7 +252,8 @@ MainWindow::MainWindow(QWidget* parent)
     m_terminal->setReadOnly(true);
     m_terminal->setMinimumHeight(160);
     m_terminal->setPlaceholderText("Serial output will appear here…");
-    m_terminal->setMaximumBlockCount(2000);   // keep last ~2000 lines
+    m_terminal->setMaximumBlockCount(kScrollbackLines);
+    m_terminal->setUndoRedoEnabled(false);
 
     QFont monoTerm;
     monoTerm.setFamily("Menlo");
@@ -164,7 +267,54 @@ MainWindow::MainWindow(QWidget* parent)
     pal.setColor(QPalette::Text,  QColor(0xd4, 0xd4, 0xd4));
     m_terminal->setPalette(pal);
 
-    termLayout->addWidget(m_terminal);
+    // Plot page: view controls over the plot
+    m_plotWorker = new PlotWorker(this);
+    QWidget* plotPage = new QWidget(termGroup);
+    {
+        QVBoxLayout* plotLayout = new QVBoxLayout(plotPage);
+        plotLayout->setContentsMargins(0, 0, 0, 0);
+        QHBoxLayout* bar = new QHBoxLayout;
+
+        m_followCheck = new QCheckBox("Follow", plotPage);
+        m_followCheck->setChecked(true);
+        m_followCheck->setToolTip("Keep the newest samples in view (double-click the plot)");
+
+        m_spanCombo = new QComboBox(plotPage);
+        for (double span : kPlotSpans)
+            m_spanCombo->addItem(span > 0.0 ? QString("%1 s").arg(span) : QString("All"), span);
+        m_spanCombo->setCurrentIndex(kDefaultPlotSpan);
+
+        m_clearPlotButton = new QPushButton("Clear", plotPage);
+        m_clearPlotButton->setFixedWidth(60);
+        m_plotStatus = new QLabel(plotPage);
+
+        bar->addWidget(m_followCheck);
+        bar->addWidget(new QLabel("Window:", plotPage));
+        bar->addWidget(m_spanCombo);
+        bar->addWidget(m_clearPlotButton);
+        bar->addStretch();
+        bar->addWidget(m_plotStatus);
+        plotLayout->addLayout(bar);
+
+        m_plot = new PlotWidget(m_plotWorker, plotPage);
+        m_plot->setSpan(kPlotSpans[kDefaultPlotSpan]);
+        plotLayout->addWidget(m_plot, 1);
+    }
+
+    // Apps page: the "@app" reports of framework firmware
+    m_appTable = new QTableWidget(0, kAppColumns, termGroup);
+    m_appTable->setHorizontalHeaderLabels({"App", "State", "Rate (Hz)", "Steps", "Avg (µs)", "Max (µs)",
+                                           "Jitter (µs)", "Misses", "Errors"});
+    m_appTable->horizontalHeader()->setSectionResizeMode(kAppName, QHeaderView::Stretch);
+    m_appTable->verticalHeader()->setVisible(false);
+    m_appTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_appTable->setSortingEnabled(false);
+
+    m_terminalTabs = new QTabWidget(termGroup);
+    m_terminalTabs->addTab(m_terminal, "Terminal");
+    m_terminalTabs->addTab(plotPage,   "Plot");
+    m_terminalTabs->addTab(m_appTable, "Apps");
+    termLayout->addWidget(m_terminalTabs);
 
     // Input row
     {
@@ -192,39 +342,97 @@ MainWindow::MainWindow(QWidget* parent)
 
     root->addWidget(splitter);
 
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setInterval(kFlushIntervalMs);
+
     // ── Signal connections ────────────────────────────────────────────────
     connect(m_refreshButton,      &QPushButton::clicked, this, &MainWindow::refreshPorts);
     connect(m_openFirmwareButton, &QPushButton::clicked, this, &MainWindow::openFirmware);
     connect(m_downloadButton,     &QPushButton::clicked, this, &MainWindow::downloadFirmware);
+    connect(m_cancelButton,       &QPushButton::clicked, this, &MainWindow::cancelFlash);
+    connect(m_clearJobsButton,    &QPushButton::clicked, this, &MainWindow::clearFinishedJobs);
+    connect(m_parallelSpin,       QOverload<int>::of(&QSpinBox::valueChanged),
+            this,                 &MainWindow::setParallelJobs);
     connect(m_connectButton,      &QPushButton::clicked, this, &MainWindow::connectTerminal);
     connect(m_disconnectButton,   &QPushButton::clicked, this, &MainWindow::disconnectTerminal);
     connect(m_clearButton,        &QPushButton::clicked, this, &MainWindow::clearTerminal);
+    connect(m_pauseButton,        &QPushButton::toggled, this, &MainWindow::togglePause);
+    connect(m_captureButton,      &QPushButton::toggled, this, &MainWindow::toggleCapture);
+    connect(m_flushTimer,         &QTimer::timeout,      this, &MainWindow::flushTerminal);
     connect(m_sendButton,         &QPushButton::clicked, this, &MainWindow::sendTerminalInput);
     connect(m_inputLine,          &QLineEdit::returnPressed, this, &MainWindow::sendTerminalInput);
+    connect(m_formatsButton,      &QPushButton::clicked, this, &MainWindow::loadFormats);
+    connect(m_clearPlotButton,    &QPushButton::clicked, this, &MainWindow::clearPlot);
+    connect(m_followCheck,        &QCheckBox::toggled,   m_plot, &PlotWidget::setFollow);
+    connect(m_plot,               &PlotWidget::followChanged, m_followCheck, &QCheckBox::setChecked);
+    connect(m_spanCombo,          QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this,                 &MainWindow::setPlotSpan);
+
+    connect(m_plotWorker,         &PlotWorker::frameReady, this, [this](PlotFramePtr frame) {
+        m_plotStatus->setText(QString("%1 channels, %2 samples").arg(frame->series.size()).arg(frame->samples));
+    });
+
+    m_clock.start();
+    m_plotWorker->start();
 
     refreshPorts();
     updateTerminalButtons();
+    updateQueueStatus();
+
+    // Keep the device list current as boards are plugged in and out. The
+    // watcher calls back on its own thread, so hop to the GUI thread.
+    m_portWatcher = std::make_unique<SimpleSerial::PortWatcher>();
+    m_portWatcher->Start([this](SimpleSerial::PortEvent event, const SimpleSerial::PortInfo& port) {
+        const QString name = QString::fromStdString(port.name);
+        const bool added = event == SimpleSerial::PortEvent::ADDED;
+        QMetaObject::invokeMethod(this, [this, name, added]() {
+            log(QString(added ? "Device connected: %1" : "Device removed: %1").arg(name));
+            refreshPorts();
+        }, Qt::QueuedConnection);
+    });
 
     QSettings settings;
     const QString savedFirmware = settings.value("firmware/lastPath").toString();
     if (!savedFirmware.isEmpty() && QFile::exists(savedFirmware)) {
         m_selectedFirmware = savedFirmware;
         m_firmwarePath->setText(savedFirmware);
+
+        // Load now so the first download starts straight away
+        QString error;
+        if (!loadFirmware(error)) log("Error: " + error);
     }
 }
 
 MainWindow::~MainWindow()
 {
+    // No hotplug callbacks may be queued against a half-destroyed window
+    m_portWatcher->Stop();
+
+    // Cancel everything first so the downloads wind down together
+    for (FlashJob& job : m_jobs) {
+        if (job.worker) job.worker->cancel();
+    }
+    for (FlashJob& job : m_jobs) {
+        if (job.worker) job.worker->wait();
+    }
+
     if (m_monitor) {
         m_monitor->stopMonitor();
         m_monitor->wait(2000);
     }
+    m_captureFile.close();
+
+    m_plotWorker->stopWorker();
+    m_plotWorker->wait();
 }
 
 // ── Port list ─────────────────────────────────────────────────────────────────
 
 void MainWindow::refreshPorts()
 {
+    // Also runs on hotplug, so keep the user's choice if it is still there
+    const QString selected = m_portCombo->currentData().toString();
+
     m_portCombo->clear();
     const auto ports = QSerialPortInfo::availablePorts();
     if (ports.isEmpty()) {
@@ -232,12 +440,31 @@ void MainWindow::refreshPorts()
         m_portCombo->setEnabled(false);
     } else {
         m_portCombo->setEnabled(true);
-        for (const QSerialPortInfo& info : ports) {
+        // One check for all ports, and only where it opens none: a refresh
+        // on every hotplug must not reset the boards on the other ports
+        std::vector<std::string> names;
+        for (const QSerialPortInfo& info : ports)
+            names.push_back(info.systemLocation().toStdString());
+        const auto statuses = SimpleSerial::Serial::CheckPortStatuses(names, false);
+
+        for (int i = 0; i < ports.size(); ++i) {
+            const QSerialPortInfo& info = ports[i];
             QString label = info.portName();
             if (!info.description().isEmpty())
                 label += "  –  " + info.description();
+            if (info.hasVendorIdentifier() && info.hasProductIdentifier())
+                label += QString("  (%1:%2)")
+                             .arg(info.vendorIdentifier(), 4, 16, QChar('0'))
+                             .arg(info.productIdentifier(), 4, 16, QChar('0'));
+            if (statuses[i] == SimpleSerial::PortStatus::IN_USE)
+                label += "  [in use]";
+            else if (statuses[i] == SimpleSerial::PortStatus::NO_PERMISSION)
+                label += "  [no permission]";
             m_portCombo->addItem(label, info.systemLocation());
         }
+        const int index = m_portCombo->findData(selected);
+        if (index >= 0)
+            m_portCombo->setCurrentIndex(index);
     }
 }
 
@@ -254,6 +481,44 @@ void MainWindow::openFirmware()
     m_firmwarePath->setText(path);
     QSettings().setValue("firmware/lastPath", path);
     log("Firmware selected: " + path);
+
+    QString error;
+    if (!loadFirmware(error)) log("Error: " + error);
+}
+
+std::shared_ptr<const SimpleSerial::MappedFile> MainWindow::loadFirmware(QString& error)
+{
+    // A rebuilt binary gets a new size or modification time; anything else
+    // is the image the running jobs already have mapped
+    const QFileInfo info(m_selectedFirmware);
+    const bool unchanged = m_imagePath == m_selectedFirmware &&
+                           info.size() == m_imageSize && info.lastModified() == m_imageModified;
+    if (unchanged) {
+        if (auto image = m_image.lock()) return image;
+    }
+
+    auto mapped = std::make_shared<SimpleSerial::MappedFile>();
+    if (!mapped->Open(m_selectedFirmware.toStdString())) {
+        error = "Cannot open firmware file:\n" + m_selectedFirmware + "\n\n" +
+                QString::fromStdString(mapped->GetLastError());
+        return nullptr;
+    }
+    m_image = mapped;
+    if (unchanged) return mapped;
+
+    // New or changed image: identify it once. This also reads it into the
+    // page cache, so the first download doesn't wait on the disk.
+    const bool reloaded = m_imagePath == m_selectedFirmware;
+    m_imagePath     = m_selectedFirmware;
+    m_imageSize     = info.size();
+    m_imageModified = info.lastModified();
+    m_imageCrc      = SimpleSerial::Crc32(mapped->Data(), mapped->Size());
+
+    const QString crc = QString("%1").arg(m_imageCrc, 8, 16, QChar('0')).toUpper();
+    m_firmwarePath->setToolTip(QString("%1 bytes, CRC32 %2").arg(mapped->Size()).arg(crc));
+    log(QString("%1 firmware: %2 bytes, CRC32 %3")
+            .arg(reloaded ? "Changed on disk, reloaded" : "Loaded").arg(mapped->Size()).arg(crc));
+    return mapped;
 }
 
 // ── Download / flash ──────────────────────────────────────────────────────────
@@ -270,76 +535,259 @@ void MainWindow::downloadFirmware()
         return;
     }
 
-    QFile file(m_selectedFirmware);
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(this, "File Error",
-            "Cannot open firmware file:\n" + m_selectedFirmware);
+    QString error;
+    std::shared_ptr<const SimpleSerial::MappedFile> image = loadFirmware(error);
+    if (!image) {
+        QMessageBox::critical(this, "File Error", error);
         return;
     }
-    const QByteArray raw = file.readAll();
-    file.close();
-    if (raw.isEmpty()) {
-        QMessageBox::critical(this, "File Error", "Firmware file is empty.");
-        return;
+
+    FlashJob job;
+    job.port         = portPath;
+    job.firmwarePath = m_selectedFirmware;
+    job.size         = static_cast<qint64>(image->Size());
+    job.firmware     = std::move(image);
+    m_jobs.push_back(std::move(job));
+
+    const int row = m_jobTable->rowCount();
+    m_jobTable->insertRow(row);
+    setJobCell(row, kColumnPort, portPath);
+    setJobCell(row, kColumnFirmware, QFileInfo(m_selectedFirmware).fileName());
+    setJobCell(row, kColumnStatus, "Queued");
+    m_jobTable->item(row, kColumnFirmware)->setToolTip(m_selectedFirmware);
+
+    log(QString("Queued download: %1 bytes → %2").arg(m_jobs.back().size).arg(portPath));
+    startQueuedJobs();
+}
+
+void MainWindow::cancelFlash()
+{
+    // The selected rows, or every unfinished job if none is selected
+    QList<int> rows;
+    for (const QModelIndex& index : m_jobTable->selectionModel()->selectedRows())
+        rows.append(index.row());
+    if (rows.isEmpty()) {
+        for (int row = 0; row < static_cast<int>(m_jobs.size()); ++row)
+            rows.append(row);
     }
 
+    for (int row : rows) {
+        FlashJob& job = m_jobs[row];
+        if (job.state == JobState::Queued) {
+            job.state = JobState::Cancelled;
+            job.firmware.reset();
+            setJobCell(row, kColumnStatus, "Cancelled");
+            log("Cancelled queued download → " + job.port);
+        } else if (job.state == JobState::Running && !job.cancelRequested) {
+            // Finishes through onFlashFinished() once the worker stops
+            job.cancelRequested = true;
+            job.worker->cancel();
+            setJobCell(row, kColumnStatus, "Cancelling…");
+        }
+    }
+    updateQueueStatus();
+}
+
+void MainWindow::clearFinishedJobs()
+{
+    for (int row = static_cast<int>(m_jobs.size()) - 1; row >= 0; --row) {
+        const JobState state = m_jobs[row].state;
+        if (state == JobState::Queued || state == JobState::Running) continue;
+        m_jobTable->removeRow(row);
+        m_jobs.erase(m_jobs.begin() + row);
+    }
+    updateQueueStatus();
+}
+
+void MainWindow::setParallelJobs(int jobs)
+{
+    QSettings().setValue("flash/parallel", jobs);
+    startQueuedJobs();
+}
+
+// ── Flash queue ───────────────────────────────────────────────────────────────
+
+void MainWindow::startQueuedJobs()
+{
+    // Oldest first; a port takes one download at a time, so a second job
+    // for a busy port waits (e.g. the next board on the same cable)
+    int running = 0;
+    for (const FlashJob& job : m_jobs) {
+        if (job.state == JobState::Running) running++;
+    }
+    for (int row = 0; row < static_cast<int>(m_jobs.size()); ++row) {
+        if (running >= m_parallelSpin->value()) break;
+        if (m_jobs[row].state != JobState::Queued || isPortBusy(m_jobs[row].port)) continue;
+        startJob(row);
+        running++;
+    }
+    updateQueueStatus();
+}
+
+void MainWindow::startJob(int row)
+{
+    FlashJob& job = m_jobs[row];
+
     // Disconnect terminal so the port is free for flashing
     if (m_monitor && m_monitor->isRunning()) {
         terminalPrint("\n[Terminal disconnected for flashing]\n");
         disconnectTerminal();
     }
 
-    std::vector<uint8_t> firmware(
-        reinterpret_cast<const uint8_t*>(raw.constData()),
-        reinterpret_cast<const uint8_t*>(raw.constData()) + raw.size());
+    log(QString("Starting download: %1 bytes → %2").arg(job.size).arg(job.port));
+
+    job.state  = JobState::Running;
+    job.worker = new FlashWorker(this);
+    job.worker->setup(job.port, std::move(job.firmware));
+    connect(job.worker, &FlashWorker::progressUpdated,
+            this,       &MainWindow::onProgress,     Qt::QueuedConnection);
+    connect(job.worker, &FlashWorker::flashFinished,
+            this,       &MainWindow::onFlashFinished, Qt::QueuedConnection);
+    setJobCell(row, kColumnStatus, "Connecting…");
+    setJobCell(row, kColumnProgress, "0%");
+    job.worker->start();
+}
+
+int MainWindow::findJob(const QObject* worker) const
+{
+    for (int row = 0; row < static_cast<int>(m_jobs.size()); ++row) {
+        if (m_jobs[row].worker == worker) return row;
+    }
+    return -1;
+}
+
+bool MainWindow::isPortBusy(const QString& port) const
+{
+    for (const FlashJob& job : m_jobs) {
+        if (job.state == JobState::Running && job.port == port) return true;
+    }
+    return false;
+}
+
+void MainWindow::setJobCell(int row, int column, const QString& text)
+{
+    QTableWidgetItem* item = m_jobTable->item(row, column);
+    if (!item) {
+        item = new QTableWidgetItem;
+        m_jobTable->setItem(row, column, item);
+    }
+    item->setText(text);
+}
 
-    log(QString("Starting download: %1 bytes → %2").arg(raw.size()).arg(portPath));
+void MainWindow::updateQueueStatus()
+{
+    int queued = 0, running = 0, done = 0, failed = 0, percent = 0;
+    double bytesPerSecond = 0.0;
+    for (const FlashJob& job : m_jobs) {
+        switch (job.state) {
+        case JobState::Queued:    queued++; break;
+        case JobState::Running:
+            running++;
+            percent += job.percent;
+            if (job.bytesPerSecond > 0) bytesPerSecond += job.bytesPerSecond;
+            break;
+        case JobState::Done:      done++;   percent += 100; break;
+        case JobState::Failed:
+        case JobState::Cancelled: failed++; percent += 100; break;
+        }
+    }
 
-    setFlashUiEnabled(false);
-    m_progressBar->setValue(0);
-    m_statusLabel->setText("Connecting…");
+    m_cancelButton->setEnabled(queued + running > 0);
+    m_clearJobsButton->setEnabled(done + failed > 0);
 
-    if (m_worker) { m_worker->wait(); delete m_worker; }
+    // A single download keeps the step-by-step status; a batch gets a summary
+    if (m_jobs.empty()) {
+        m_progressBar->setValue(0);
+        m_statusLabel->setText("Ready.");
+        return;
+    }
+    m_progressBar->setValue(percent / static_cast<int>(m_jobs.size()));
+    if (m_jobs.size() == 1) return;
 
-    m_worker = new FlashWorker(this);
-    m_worker->setup(portPath, std::move(firmware));
-    connect(m_worker, &FlashWorker::progressUpdated,
-            this,     &MainWindow::onProgress,     Qt::QueuedConnection);
-    connect(m_worker, &FlashWorker::flashFinished,
-            this,     &MainWindow::onFlashFinished, Qt::QueuedConnection);
-    m_worker->start();
+    QString text = QString("%1 running, %2 queued, %3 done, %4 failed or cancelled")
+                       .arg(running).arg(queued).arg(done).arg(failed);
+    if (bytesPerSecond > 0) text += " – " + formatRate(bytesPerSecond);
+    m_statusLabel->setText(text);
 }
 
 // ── Flash worker callbacks ────────────────────────────────────────────────────
 
-void MainWindow::onProgress(int percent, const QString& message)
+void MainWindow::onProgress(int percent, const QString& message, double bytesPerSecond, int etaSeconds)
 {
-    m_progressBar->setValue(percent);
-    m_statusLabel->setText(message);
-    log(message);
+    const int row = findJob(sender());
+    if (row < 0) return;
+
+    FlashJob& job = m_jobs[row];
+    job.percent = percent;
+    if (bytesPerSecond >= 0) job.bytesPerSecond = bytesPerSecond;
+
+    if (!job.cancelRequested) setJobCell(row, kColumnStatus, message);
+    setJobCell(row, kColumnProgress, QString("%1%").arg(percent));
+    setJobCell(row, kColumnSpeed, formatRate(job.bytesPerSecond));
+    setJobCell(row, kColumnEta, formatEta(etaSeconds));
+
+    if (m_jobs.size() == 1) {
+        QString status = message;
+        if (bytesPerSecond >= 0)
+            status += QString(" – %1, %2 left").arg(formatRate(bytesPerSecond), formatEta(etaSeconds));
+        m_statusLabel->setText(status);
+    }
+
+    // Upload steps come per chunk; with several ports they would bury the log
+    if (bytesPerSecond < 0) log(job.port + ": " + message);
+    updateQueueStatus();
 }
 
 void MainWindow::onFlashFinished(bool success, const QString& errorMessage)
 {
-    setFlashUiEnabled(true);
+    const int row = findJob(sender());
+    if (row < 0) return;
 
-    if (success) {
-        m_progressBar->setValue(100);
-        m_statusLabel->setText("Done! Firmware downloaded successfully.");
-        log("✓ Flash complete.");
+    FlashJob& job = m_jobs[row];
+    job.worker->wait();
+    job.worker->deleteLater();
+    job.worker = nullptr;
+    setJobCell(row, kColumnEta, QString());
 
-        // Auto-connect terminal so we can see the newly flashed firmware's output
-        const QString portPath = m_portCombo->currentData().toString();
-        if (!portPath.isEmpty()) {
-            terminalPrint("\n[Auto-connecting terminal after successful flash…]\n");
-            connectTerminal();
-        }
+    if (success) {
+        job.state   = JobState::Done;
+        job.percent = 100;
+        setJobCell(row, kColumnStatus, "Done");
+        setJobCell(row, kColumnProgress, "100%");
+        log("✓ " + job.port + ": Flash complete.");
+    } else if (job.cancelRequested) {
+        job.state = JobState::Cancelled;
+        setJobCell(row, kColumnStatus, "Cancelled");
+        log(job.port + ": Download cancelled.");
     } else {
-        m_progressBar->setValue(0);
+        job.state = JobState::Failed;
+        setJobCell(row, kColumnStatus, "Error: " + errorMessage);
+        log("✗ " + job.port + ": Error: " + errorMessage);
+    }
+
+    const QString port = job.port;
+    const bool single = m_jobs.size() == 1;
+    startQueuedJobs();
+
+    bool idle = true;
+    for (const FlashJob& other : m_jobs) {
+        if (other.state == JobState::Queued || other.state == JobState::Running) idle = false;
+    }
+
+    if (single && success) {
+        m_statusLabel->setText("Done! Firmware downloaded successfully.");
+    } else if (single && !job.cancelRequested) {
         m_statusLabel->setText("Error: " + errorMessage);
-        log("✗ Error: " + errorMessage);
         QMessageBox::critical(this, "Flash Failed",
             "Firmware download failed:\n\n" + errorMessage);
+    } else if (single) {
+        m_statusLabel->setText("Cancelled.");
+    }
+
+    // Auto-connect terminal so we can see the newly flashed firmware's output
+    if (success && idle && port == m_portCombo->currentData().toString()) {
+        terminalPrint("\n[Auto-connecting terminal after successful flash…]\n");
+        connectTerminal();
     }
 }
 
@@ -370,6 +818,7 @@ void MainWindow::connectTerminal()
     connect(m_monitor, &SerialMonitor::connectionLost,
             this,      &MainWindow::onConnectionLost, Qt::QueuedConnection);
     m_monitor->start();
+    m_flushTimer->start();
 
     terminalPrint(QString("[Connected to %1 @ %2 baud]\n").arg(portPath).arg(baud));
     updateTerminalButtons();
@@ -384,6 +833,8 @@ void MainWindow::disconnectTerminal()
     delete m_monitor;
     m_monitor = nullptr;
 
+    flushTerminal();
+    m_flushTimer->stop();
     terminalPrint("[Disconnected]\n");
     updateTerminalButtons();
 }
@@ -392,15 +843,50 @@ void MainWindow::disconnectTerminal()
 
 void MainWindow::onSerialData(const QByteArray& data)
 {
+    // The capture gets every byte, even while the display is paused
+    if (m_captureFile.isOpen())
+        m_captureFile.write(data);
+
+    // Tokenized frames come out expanded, numbers as samples for the plot
+    std::string text;
+    m_parser.feed(reinterpret_cast<const uint8_t*>(data.constData()), static_cast<size_t>(data.size()),
+                  m_clock.elapsed() / 1000.0, text);
+
+    // Only queue here; flushTerminal() renders on the next tick
+    m_pending.append(text.data(), static_cast<qsizetype>(text.size()));
+    if (m_pending.size() > kMaxPendingBytes) {
+        const int excess = m_pending.size() - kMaxPendingBytes;
+        m_pending.remove(0, excess);
+        m_droppedBytes += excess;
+    }
+}
+
+void MainWindow::flushTerminal()
+{
+    // The plot and app table keep updating while the terminal is paused
+    m_plotWorker->addSamples(m_parser.takeSamples());
+    m_plot->requestFrame();
+    if (m_parser.appsChanged()) updateAppTable();
+
+    if (m_paused || m_pending.isEmpty()) return;
+
+    if (m_droppedBytes > 0) {
+        terminalPrint(QString("\n[%1 bytes not shown]\n").arg(m_droppedBytes));
+        m_droppedBytes = 0;
+    }
+
     // Append raw bytes as text; replace \r to avoid double newlines on some
     // terminals but keep \n for line breaks.
-    QString text = QString::fromLatin1(data);
+    QString text = QString::fromLatin1(m_pending);
+    m_pending.clear();
     text.remove('\r');
     terminalPrint(text);
 }
 
 void MainWindow::onConnectionLost(const QString& reason)
 {
+    flushTerminal();
+    m_flushTimer->stop();
     terminalPrint("\n[Connection lost: " + reason + "]\n");
     if (m_monitor) {
         m_monitor->wait(2000);
@@ -441,19 +927,114 @@ void MainWindow::sendTerminalInput()
 void MainWindow::clearTerminal()
 {
     m_terminal->clear();
+    m_pending.clear();
+    m_droppedBytes = 0;
 }
 
-// ── Helpers ───────────────────────────────────────────────────────────────────
+// ── Terminal: pause / capture ─────────────────────────────────────────────────
+
+void MainWindow::togglePause(bool paused)
+{
+    // While paused the newest output keeps queueing (bounded by
+    // kMaxPendingBytes) and is shown on resume
+    m_paused = paused;
+    m_pauseButton->setText(paused ? "Resume" : "Pause");
+    if (!paused) flushTerminal();
+}
+
+void MainWindow::toggleCapture(bool capture)
+{
+    if (!capture) {
+        stopCapture();
+        return;
+    }
+
+    const QString path = QFileDialog::getSaveFileName(
+        this, "Capture Serial Output",
+        "capture-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".log",
+        "Log files (*.log *.txt);;All files (*)");
+    if (path.isEmpty()) {
+        m_captureButton->setChecked(false);
+        return;
+    }
+
+    m_captureFile.setFileName(path);
+    if (!m_captureFile.open(QIODevice::WriteOnly)) {
+        QMessageBox::critical(this, "File Error", "Cannot create capture file:\n" + path);
+        m_captureButton->setChecked(false);
+        return;
+    }
+    m_captureButton->setText("Stop Capture");
+    log("Capturing serial output to " + path);
+}
 
-void MainWindow::setFlashUiEnabled(bool enabled)
+void MainWindow::stopCapture()
 {
-    m_portCombo->setEnabled(enabled);
-    m_refreshButton->setEnabled(enabled);
-    m_openFirmwareButton->setEnabled(enabled);
-    m_downloadButton->setEnabled(enabled);
-    m_downloadButton->setText(enabled ? "Download" : "Downloading…");
+    if (!m_captureFile.isOpen()) return;
+
+    const qint64 size = m_captureFile.size();
+    m_captureFile.close();
+    m_captureButton->setText("Capture…");
+    log(QString("Capture saved: %1 (%2 bytes)").arg(m_captureFile.fileName()).arg(size));
 }
 
+// ── Telemetry ─────────────────────────────────────────────────────────────────
+
+void MainWindow::loadFormats()
+{
+    const QString path = QFileDialog::getOpenFileName(
+        this, "Load Log Formats", QString(), "Firmware ELF (*.elf);;All files (*)");
+    if (path.isEmpty()) return;
+
+    std::string error;
+    if (!m_parser.loadFormats(path.toStdString(), error)) {
+        QMessageBox::critical(this, "Formats", "Cannot load log formats:\n" + QString::fromStdString(error));
+        return;
+    }
+    log("Tokenized log formats loaded from " + path);
+    m_formatsButton->setToolTip("Log formats: " + path);
+}
+
+void MainWindow::clearPlot()
+{
+    m_plotWorker->clear();
+    m_plot->requestFrame();
+}
+
+void MainWindow::setPlotSpan(int index)
+{
+    m_plot->setSpan(m_spanCombo->itemData(index).toDouble());
+}
+
+void MainWindow::updateAppTable()
+{
+    // Rows follow the (sorted) map, so a new app only shifts rows below it
+    const std::map<std::string, AppStatsRow>& apps = m_parser.apps();
+    m_appTable->setRowCount(static_cast<int>(apps.size()));
+    int row = 0;
+    for (const auto& entry : apps) {
+        const AppStatsRow& app = entry.second;
+        const QString values[kAppColumns] = {
+            QString::fromStdString(entry.first), QString::fromStdString(app.state),
+            QString::number(app.rateHz),         QString::number(app.steps),
+            QString::number(app.avgUs),          QString::number(app.maxUs),
+            QString::number(app.jitterUs),       QString::number(app.misses),
+            QString::number(app.errors),
+        };
+        for (int column = 0; column < kAppColumns; ++column) {
+            QTableWidgetItem* item = m_appTable->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                m_appTable->setItem(row, column, item);
+            }
+            item->setText(values[column]);
+        }
+        ++row;
+    }
+}
+
+// ── Helpers ───────────────────────────────────────────────────────────────────
+
 void MainWindow::updateTerminalButtons()
 {
     const bool connected = m_monitor && m_monitor->isRunning();
@@ -1,17 +1,38 @@
 #pragma once
 
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QMainWindow>
 #include <QString>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
+#include "mapped_file.h"
+#include "telemetry.h"
+
+class QCheckBox;
 class QComboBox;
 class QLabel;
 class QLineEdit;
 class QPlainTextEdit;
 class QProgressBar;
 class QPushButton;
+class QSpinBox;
+class QTabWidget;
+class QTableWidget;
+class QTimer;
 class FlashWorker;
+class PlotWidget;
+class PlotWorker;
 class SerialMonitor;
 
+namespace SimpleSerial {
+class PortWatcher;
+}
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -24,9 +45,12 @@ private slots:
     void refreshPorts();
     void openFirmware();
     void downloadFirmware();
+    void cancelFlash();
+    void clearFinishedJobs();
+    void setParallelJobs(int jobs);
 
-    // FlashWorker callbacks
-    void onProgress(int percent, const QString& message);
+    // FlashWorker callbacks (the worker is sender())
+    void onProgress(int percent, const QString& message, double bytesPerSecond, int etaSeconds);
     void onFlashFinished(bool success, const QString& errorMessage);
 
     // Terminal callbacks
@@ -34,14 +58,46 @@ private slots:
     void disconnectTerminal();
     void sendTerminalInput();
     void clearTerminal();
+    void togglePause(bool paused);
+    void toggleCapture(bool capture);
     void onSerialData(const QByteArray& data);
+    void flushTerminal();
     void onConnectionLost(const QString& reason);
 
+    // Telemetry callbacks
+    void loadFormats();
+    void clearPlot();
+    void setPlotSpan(int index);
+
 private:
-    void setFlashUiEnabled(bool enabled);
+    enum class JobState { Queued, Running, Done, Failed, Cancelled };
+
+    /** One firmware download to one port; a row of m_jobTable */
+    struct FlashJob {
+        QString              port;
+        QString              firmwarePath;
+        std::shared_ptr<const SimpleSerial::MappedFile> firmware;   // Shared by every job of the same image
+        qint64               size            = 0;
+        FlashWorker*         worker          = nullptr;
+        JobState             state           = JobState::Queued;
+        bool                 cancelRequested = false;
+        int                  percent         = 0;
+        double               bytesPerSecond  = -1.0;
+    };
+
+    std::shared_ptr<const SimpleSerial::MappedFile> loadFirmware(QString& error);
+
+    void startQueuedJobs();
+    void startJob(int row);
+    int  findJob(const QObject* worker) const;
+    bool isPortBusy(const QString& port) const;
+    void setJobCell(int row, int column, const QString& text);
+    void updateQueueStatus();
     void updateTerminalButtons();
     void log(const QString& message);
     void terminalPrint(const QString& text);
+    void stopCapture();
+    void updateAppTable();
 
     // ── Flash controls ────────────────────────────────────────────────────
     QComboBox*     m_portCombo;
@@ -51,21 +107,69 @@ private:
     QPushButton*   m_downloadButton;
 
     // ── Flash status ──────────────────────────────────────────────────────
-    QProgressBar*  m_progressBar;
+    QProgressBar*  m_progressBar;       // All jobs in the queue
     QLabel*        m_statusLabel;
     QPlainTextEdit* m_logView;
 
+    // ── Flash queue ───────────────────────────────────────────────────────
+    QTableWidget*  m_jobTable;
+    QPushButton*   m_cancelButton;
+    QPushButton*   m_clearJobsButton;
+    QSpinBox*      m_parallelSpin;
+
     // ── Terminal ──────────────────────────────────────────────────────────
     QPushButton*   m_connectButton;
     QPushButton*   m_disconnectButton;
     QPushButton*   m_clearButton;
+    QPushButton*   m_pauseButton;
+    QPushButton*   m_captureButton;
+    QPushButton*   m_formatsButton;
     QComboBox*     m_baudCombo;
+    QTabWidget*    m_terminalTabs;      // Terminal | Plot | Apps
     QPlainTextEdit* m_terminal;
     QLineEdit*     m_inputLine;
     QPushButton*   m_sendButton;
 
+    // ── Telemetry ─────────────────────────────────────────────────────────
+    PlotWidget*    m_plot;
+    QCheckBox*     m_followCheck;
+    QComboBox*     m_spanCombo;
+    QPushButton*   m_clearPlotButton;
+    QLabel*        m_plotStatus;
+    QTableWidget*  m_appTable;
+
     // ── State ─────────────────────────────────────────────────────────────
     QString        m_selectedFirmware;
-    FlashWorker*   m_worker  = nullptr;
+
+    // ── Loaded image ──────────────────────────────────────────────────────
+    // One read-only mapping shared by every job until the file changes on
+    // disk (size or modification time), so a batch of hundreds of boards
+    // neither rereads nor copies it. Only the jobs own it: once they are
+    // done the file is unmapped, and Windows lets a rebuild replace it.
+    std::weak_ptr<const SimpleSerial::MappedFile> m_image;
+    QString        m_imagePath;
+    qint64         m_imageSize = -1;
+    QDateTime      m_imageModified;
+    uint32_t       m_imageCrc = 0;
+    std::vector<FlashJob> m_jobs;       // Same order as the table rows
     SerialMonitor* m_monitor = nullptr;
+    std::unique_ptr<SimpleSerial::PortWatcher> m_portWatcher;  // hotplug → refreshPorts()
+
+    // ── Terminal output batching ──────────────────────────────────────────
+    // Serial data is queued here and rendered by m_flushTimer, so the
+    // widget is updated at most ~30 times a second however fast data comes.
+    QTimer*        m_flushTimer;
+    QByteArray     m_pending;
+    qint64         m_droppedBytes = 0;   // not shown (paused / too fast)
+    bool           m_paused = false;
+    QFile          m_captureFile;
+
+    // ── Telemetry parsing ─────────────────────────────────────────────────
+    // Every received byte goes through m_parser on the GUI thread (a few
+    // compares per byte); the samples it yields are handed to m_plotWorker,
+    // which keeps and decimates them off this thread. m_clock is the time
+    // axis: seconds since the window opened, across reconnects.
+    TelemetryParser m_parser;
+    PlotWorker*    m_plotWorker;
+    QElapsedTimer  m_clock;
 };
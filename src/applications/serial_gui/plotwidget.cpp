@@ -0,0 +1,220 @@
+#include "plotwidget.h"
+
+#include <QFontMetrics>
+#include <QLineF>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QVector>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Series colours, reused in order past the eighth channel
+const QColor kSeriesColors[] = {
+    QColor(0x4f, 0xc1, 0xff), QColor(0xff, 0xb8, 0x4d), QColor(0x7e, 0xe0, 0x81), QColor(0xff, 0x6b, 0x6b),
+    QColor(0xc5, 0x8a, 0xf9), QColor(0xf9, 0xe2, 0x6b), QColor(0x4d, 0xd0, 0xc4), QColor(0xf4, 0x8f, 0xb1),
+};
+constexpr int kSeriesColorCount = sizeof(kSeriesColors) / sizeof(kSeriesColors[0]);
+
+constexpr int    kMarginLeft   = 64;   // Room for the value labels
+constexpr int    kMarginRight  = 8;
+constexpr int    kMarginTop    = 8;
+constexpr int    kMarginBottom = 20;   // Room for the time labels
+constexpr int    kGridLines    = 5;
+constexpr double kMinSpan      = 1e-3;
+constexpr double kMaxSpan      = 7 * 24 * 3600.0;
+
+} // namespace
+
+PlotWidget::PlotWidget(PlotWorker* worker, QWidget* parent)
+    : QWidget(parent)
+    , m_worker(worker)
+{
+    setMinimumHeight(160);
+    setMouseTracking(false);
+    connect(m_worker, &PlotWorker::frameReady, this, &PlotWidget::setFrame, Qt::QueuedConnection);
+}
+
+void PlotWidget::setSpan(double seconds)
+{
+    m_span = seconds;
+    requestFrame();
+}
+
+void PlotWidget::setFollow(bool follow)
+{
+    if (m_follow == follow) return;
+    m_follow = follow;
+    if (!follow && m_frame) m_end = m_frame->t1;
+    emit followChanged(follow);
+    requestFrame();
+}
+
+void PlotWidget::requestFrame()
+{
+    const int columns = plotArea().width();
+    if (m_waiting || !isVisible() || columns <= 0) return;
+    m_waiting = true;
+    m_worker->requestFrame(m_span, m_end, m_follow, columns);
+}
+
+void PlotWidget::setFrame(PlotFramePtr frame)
+{
+    m_waiting = false;
+    m_frame   = frame;
+    update();
+}
+
+QRect PlotWidget::plotArea() const
+{
+    return QRect(kMarginLeft, kMarginTop, width() - kMarginLeft - kMarginRight,
+                 height() - kMarginTop - kMarginBottom);
+}
+
+// ── Painting ──────────────────────────────────────────────────────────────────
+
+void PlotWidget::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(0x1e, 0x1e, 0x1e));
+
+    const QRect area = plotArea();
+    if (area.width() <= 0 || area.height() <= 0) return;
+
+    if (!m_frame || m_frame->series.empty()) {
+        painter.setPen(QColor(0x80, 0x80, 0x80));
+        painter.drawText(rect(), Qt::AlignCenter,
+                         "Numbers in the serial output are plotted here (\"name=value\", \"name: value\" or bare)");
+        return;
+    }
+
+    const PlotFrame& frame = *m_frame;
+    const double yRange = double(frame.yMax) - double(frame.yMin);
+    auto toY = [&](float value) {
+        return area.bottom() - (double(value) - frame.yMin) / yRange * (area.height() - 1);
+    };
+
+    // Grid and labels
+    painter.setPen(QColor(0x3a, 0x3a, 0x3a));
+    painter.drawRect(area.adjusted(0, 0, -1, -1));
+    const QFontMetrics metrics(font());
+    for (int i = 0; i <= kGridLines; ++i) {
+        const int    y     = area.bottom() - i * (area.height() - 1) / kGridLines;
+        const int    x     = area.left() + i * (area.width() - 1) / kGridLines;
+        const double value = frame.yMin + yRange * i / kGridLines;
+        const double time  = frame.t0 + (frame.t1 - frame.t0) * i / kGridLines;
+
+        painter.setPen(QColor(0x2c, 0x2c, 0x2c));
+        painter.drawLine(area.left(), y, area.right(), y);
+        painter.drawLine(x, area.top(), x, area.bottom());
+
+        painter.setPen(QColor(0x9a, 0x9a, 0x9a));
+        painter.drawText(QRect(0, y - metrics.height() / 2, kMarginLeft - 6, metrics.height()),
+                         Qt::AlignRight | Qt::AlignVCenter, QString::number(value, 'g', 5));
+        // Following: seconds before now; otherwise seconds since connecting
+        const QString label = m_follow ? QString("%1 s").arg(time - frame.t1, 0, 'g', 4)
+                                       : QString("%1 s").arg(time, 0, 'f', 3);
+        const int labelWidth = metrics.horizontalAdvance(label);
+        const int labelX = std::clamp(x - labelWidth / 2, area.left(), area.right() - labelWidth);
+        painter.drawText(labelX, area.bottom() + metrics.ascent() + 4, label);
+    }
+
+    // One vertical stroke per column, stretched to meet the previous one,
+    // and a straight line across columns without samples
+    painter.setClipRect(area);
+    QVector<QLineF> lines;
+    for (size_t s = 0; s < frame.series.size(); ++s) {
+        const PlotFrame::Series& series = frame.series[s];
+        lines.clear();
+        int   previous = -1;
+        float previousMin = 0.0f, previousMax = 0.0f;
+        for (int c = 0; c < int(series.columns.size()); ++c) {
+            const TelemetryChannel::MinMax& column = series.columns[size_t(c)];
+            if (column.min > column.max) continue;
+
+            const double x = area.left() + c + 0.5;
+            float low = column.min, high = column.max;
+            if (previous == c - 1) {
+                low  = std::min(low, previousMax);
+                high = std::max(high, previousMin);
+            } else if (previous >= 0) {
+                lines.append(QLineF(area.left() + previous + 0.5, toY((previousMin + previousMax) / 2), x,
+                                    toY((column.min + column.max) / 2)));
+            }
+            lines.append(QLineF(x, toY(low), x, toY(high) - 0.5));
+            previous    = c;
+            previousMin = column.min;
+            previousMax = column.max;
+        }
+        painter.setPen(QPen(kSeriesColors[s % kSeriesColorCount], 1.0));
+        painter.drawLines(lines);
+    }
+    painter.setClipping(false);
+
+    // Legend: name and newest value
+    int y = area.top() + 4 + metrics.ascent();
+    for (size_t s = 0; s < frame.series.size(); ++s) {
+        painter.setPen(kSeriesColors[s % kSeriesColorCount]);
+        painter.drawText(area.left() + 8, y,
+                         QString("%1 = %2").arg(frame.series[s].name).arg(frame.series[s].lastValue, 0, 'g', 6));
+        y += metrics.height();
+    }
+}
+
+// ── Zoom and pan ──────────────────────────────────────────────────────────────
+
+void PlotWidget::wheelEvent(QWheelEvent* event)
+{
+    if (!m_frame || m_frame->t1 <= m_frame->t0) return;
+
+    const double current = m_span > 0.0 ? m_span : m_frame->t1 - m_frame->t0;
+    const double factor  = std::pow(0.8, event->angleDelta().y() / 120.0);
+    const double span    = std::clamp(current * factor, kMinSpan, kMaxSpan);
+
+    // Not following: keep the time under the cursor where it is
+    if (!m_follow) {
+        const QRect  area     = plotArea();
+        const double fraction = std::clamp((event->position().x() - area.left()) / area.width(), 0.0, 1.0);
+        const double anchor   = m_frame->t0 + (m_frame->t1 - m_frame->t0) * fraction;
+        m_end = anchor + (m_end - anchor) * span / current;
+    }
+    m_span = span;
+    emit spanChanged(span);
+    requestFrame();
+    event->accept();
+}
+
+void PlotWidget::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton || !m_frame) return;
+    m_dragging  = true;
+    m_dragStart = event->pos();
+    m_dragEnd   = m_frame->t1;
+}
+
+void PlotWidget::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!m_dragging || !m_frame) return;
+    const QRect area = plotArea();
+    if (area.width() <= 0) return;
+
+    const double perPixel = (m_frame->t1 - m_frame->t0) / area.width();
+    m_end = m_dragEnd - (event->pos().x() - m_dragStart.x()) * perPixel;
+    if (m_follow) {
+        m_follow = false;
+        emit followChanged(false);
+    }
+    requestFrame();
+}
+
+void PlotWidget::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton) m_dragging = false;
+}
+
+void PlotWidget::mouseDoubleClickEvent(QMouseEvent*)
+{
+    setFollow(true);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "plotworker.h"
+
+#include <QPoint>
+#include <QWidget>
+
+/**
+ * Live plot of every telemetry channel, drawn from PlotWorker frames.
+ *
+ * Each pixel column shows the min/max envelope of the samples behind it,
+ * so spikes stay visible at any zoom. While following, the view ends at
+ * the newest sample; the wheel zooms the time window around the cursor,
+ * dragging pans (and stops following), double-click follows again.
+ *
+ * requestFrame() is cheap to call on every GUI tick: it asks the worker
+ * for a new frame only when the last one has arrived.
+ */
+class PlotWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PlotWidget(PlotWorker* worker, QWidget* parent = nullptr);
+
+    /** Visible time window in seconds; 0 shows everything held */
+    void setSpan(double seconds);
+    double span() const { return m_span; }
+
+    void setFollow(bool follow);
+    bool follow() const { return m_follow; }
+
+    /** Ask the worker for the current view, unless a frame is outstanding */
+    void requestFrame();
+
+    QSize sizeHint() const override { return QSize(640, 240); }
+
+signals:
+    void followChanged(bool follow);
+    void spanChanged(double seconds);
+
+public slots:
+    void setFrame(PlotFramePtr frame);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+private:
+    QRect plotArea() const;
+
+    PlotWorker*  m_worker;
+    PlotFramePtr m_frame;
+    bool         m_waiting = false;   // A request is with the worker
+
+    // ── View ──────────────────────────────────────────────────────────────
+    double       m_span   = 10.0;
+    double       m_end    = 0.0;      // Right edge when not following
+    bool         m_follow = true;
+    bool         m_dragging = false;
+    QPoint       m_dragStart;
+    double       m_dragEnd = 0.0;
+};
@@ -0,0 +1,149 @@
+#include "plotworker.h"
+
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+// Samples kept per channel; past it the older half is dropped. At 16 M
+// (12 bytes each plus the pyramid) a channel holds ~200 MB, and an hour
+// of a 1 kHz stream (3.6 M) fits four times over.
+constexpr size_t kMaxChannelSamples = size_t(1) << 24;
+
+} // namespace
+
+PlotWorker::PlotWorker(QObject* parent)
+    : QThread(parent)
+{
+    qRegisterMetaType<PlotFramePtr>();
+}
+
+void PlotWorker::addSamples(std::vector<TelemetryParser::Sample> samples)
+{
+    if (samples.empty()) return;
+
+    QMutexLocker lock(&m_mutex);
+    if (m_inbox.empty()) {
+        m_inbox.swap(samples);
+    } else {
+        m_inbox.insert(m_inbox.end(), std::make_move_iterator(samples.begin()),
+                       std::make_move_iterator(samples.end()));
+    }
+    m_wake.wakeOne();
+}
+
+void PlotWorker::requestFrame(double span, double end, bool follow, int columns)
+{
+    QMutexLocker lock(&m_mutex);
+    m_request     = {span, end, follow, columns};
+    m_haveRequest = true;
+    m_wake.wakeOne();
+}
+
+void PlotWorker::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_inbox.clear();
+    m_clear = true;
+    m_wake.wakeOne();
+}
+
+void PlotWorker::stopWorker()
+{
+    QMutexLocker lock(&m_mutex);
+    m_stop = true;
+    m_wake.wakeOne();
+}
+
+void PlotWorker::run()
+{
+    for (;;) {
+        std::vector<TelemetryParser::Sample> samples;
+        Request request;
+        bool    haveRequest = false;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (!m_stop && !m_clear && m_inbox.empty() && !m_haveRequest)
+                m_wake.wait(&m_mutex);
+            if (m_stop) return;
+            if (m_clear) {
+                m_channels.clear();
+                m_clear = false;
+            }
+            samples.swap(m_inbox);
+            request       = m_request;
+            haveRequest   = m_haveRequest;
+            m_haveRequest = false;
+        }
+
+        append(samples);
+        if (haveRequest && request.columns > 0) emit frameReady(build(request));
+    }
+}
+
+void PlotWorker::append(const std::vector<TelemetryParser::Sample>& samples)
+{
+    // Consecutive samples are mostly the same few channels: look each up once
+    TelemetryChannel*  channel = nullptr;
+    const std::string* name    = nullptr;
+    for (const TelemetryParser::Sample& sample : samples) {
+        if (!name || *name != sample.name) {
+            channel = &m_channels[sample.name];
+            name    = &sample.name;
+        }
+        // Text lines are stamped when they arrive; keep each channel ordered
+        const double time = std::max(sample.time, channel->lastTime());
+        channel->append(time, sample.value);
+        if (channel->size() > kMaxChannelSamples) channel->dropOldest(kMaxChannelSamples / 2);
+    }
+}
+
+PlotFramePtr PlotWorker::build(const Request& request) const
+{
+    auto frame = std::make_shared<PlotFrame>();
+
+    double first = std::numeric_limits<double>::infinity();
+    double last  = -std::numeric_limits<double>::infinity();
+    for (const auto& entry : m_channels) {
+        if (entry.second.size() == 0) continue;
+        first = std::min(first, entry.second.firstTime());
+        last  = std::max(last, entry.second.lastTime());
+        frame->samples += entry.second.size();
+    }
+    if (frame->samples == 0) return frame;
+
+    frame->t1 = request.follow ? last : request.end;
+    frame->t0 = request.span > 0.0 ? frame->t1 - request.span : first;
+    if (frame->t1 <= frame->t0) frame->t1 = frame->t0 + 1.0;
+
+    float yMin = std::numeric_limits<float>::infinity();
+    float yMax = -std::numeric_limits<float>::infinity();
+    frame->series.reserve(m_channels.size());
+    for (const auto& entry : m_channels) {
+        PlotFrame::Series series;
+        series.name      = QString::fromStdString(entry.first);
+        series.lastValue = entry.second.lastValue();
+        // Right edge inclusive, so the newest sample is drawn when following
+        entry.second.decimate(frame->t0, std::nextafter(frame->t1, frame->t1 + 1.0), request.columns, series.columns);
+        for (const TelemetryChannel::MinMax& column : series.columns) {
+            if (column.min > column.max) continue;
+            yMin = std::min(yMin, column.min);
+            yMax = std::max(yMax, column.max);
+        }
+        frame->series.push_back(std::move(series));
+    }
+
+    if (yMin > yMax) {
+        yMin = 0.0f;
+        yMax = 1.0f;
+    } else if (yMin == yMax) {
+        yMin -= 0.5f;
+        yMax += 0.5f;
+    }
+    frame->yMin = yMin;
+    frame->yMax = yMax;
+    return frame;
+}
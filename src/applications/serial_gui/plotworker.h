@@ -0,0 +1,100 @@
+#pragma once
+
+#include "telemetry.h"
+
+#include <QMetaType>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** One decimated view of every channel, ready to paint */
+struct PlotFrame {
+    struct Series {
+        QString name;
+        std::vector<TelemetryChannel::MinMax> columns;   // min > max: no samples
+        float   lastValue = 0.0f;
+    };
+
+    double t0 = 0.0;
+    double t1 = 0.0;
+    float  yMin = 0.0f;              // Over the visible columns of all series
+    float  yMax = 0.0f;
+    size_t samples = 0;              // Held by all channels together
+    std::vector<Series> series;      // Sorted by name
+};
+
+using PlotFramePtr = std::shared_ptr<const PlotFrame>;
+Q_DECLARE_METATYPE(PlotFramePtr)
+
+/**
+ * Background thread that owns the plot channels and decimates them.
+ *
+ * The GUI thread hands over parsed samples and asks for frames; the worker
+ * appends, reduces each channel to min/max per pixel column and emits
+ * frameReady(). Requests that arrive while one is being built collapse
+ * into the newest, so a slow frame never queues up stale ones behind it.
+ *
+ * Lifecycle:
+ *   worker->start();
+ *   worker->addSamples(parser.takeSamples());
+ *   worker->requestFrame(10.0, 0.0, true, width);
+ *   worker->stopWorker();
+ *   worker->wait();
+ */
+class PlotWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit PlotWorker(QObject* parent = nullptr);
+
+    /** Thread-safe; appended before the next frame is built */
+    void addSamples(std::vector<TelemetryParser::Sample> samples);
+
+    /**
+     * Thread-safe. Ask for @p columns columns over @p span seconds ending
+     * at @p end, or at the newest sample when @p follow is set (@p span 0:
+     * everything held).
+     */
+    void requestFrame(double span, double end, bool follow, int columns);
+
+    /** Thread-safe; drops every channel */
+    void clear();
+
+    /** Thread-safe: run() exits on its next wake-up. */
+    void stopWorker();
+
+signals:
+    void frameReady(PlotFramePtr frame);
+
+protected:
+    void run() override;
+
+private:
+    struct Request {
+        double span    = 0.0;
+        double end     = 0.0;
+        bool   follow  = true;
+        int    columns = 0;
+    };
+
+    void append(const std::vector<TelemetryParser::Sample>& samples);
+    PlotFramePtr build(const Request& request) const;
+
+    // Shared with the GUI thread
+    QMutex         m_mutex;
+    QWaitCondition m_wake;
+    std::vector<TelemetryParser::Sample> m_inbox;
+    Request        m_request;
+    bool           m_haveRequest = false;
+    bool           m_clear       = false;
+    bool           m_stop        = false;
+
+    // Worker thread only
+    std::map<std::string, TelemetryChannel> m_channels;
+};
@@ -39,7 +39,8 @@ void SerialMonitor::run()
         return;
     }
 
-    uint8_t buf[256];
+    // Large reads keep the number of queued signals low at high baud rates
+    uint8_t buf[4096];
 
     while (!m_stop) {
         const int n = serial.Read(buf, sizeof(buf));
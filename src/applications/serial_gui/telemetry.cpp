@@ -0,0 +1,288 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+// ── TelemetryChannel ──────────────────────────────────────────────────────────
+
+void TelemetryChannel::append(double time, float value)
+{
+    const size_t index = m_times.size();
+    m_times.push_back(time);
+    m_values.push_back(value);
+    for (size_t level = 0; level < kLevels; ++level) {
+        const size_t block = size_t(1) << (kBlockShift * (level + 1));
+        if (index % block == 0) {
+            m_levels[level].push_back({value, value});
+        } else {
+            MinMax& last = m_levels[level].back();
+            last.min = std::min(last.min, value);
+            last.max = std::max(last.max, value);
+        }
+    }
+}
+
+void TelemetryChannel::dropOldest(size_t count)
+{
+    count = std::min(count, m_times.size());
+    m_times.erase(m_times.begin(), m_times.begin() + static_cast<std::ptrdiff_t>(count));
+    m_values.erase(m_values.begin(), m_values.begin() + static_cast<std::ptrdiff_t>(count));
+    build();
+}
+
+void TelemetryChannel::clear()
+{
+    m_times.clear();
+    m_values.clear();
+    for (auto& level : m_levels) level.clear();
+}
+
+void TelemetryChannel::build()
+{
+    std::vector<double> times;
+    std::vector<float>  values;
+    times.swap(m_times);
+    values.swap(m_values);
+    clear();
+    m_times.reserve(times.size());
+    m_values.reserve(values.size());
+    for (size_t i = 0; i < times.size(); ++i) append(times[i], values[i]);
+}
+
+size_t TelemetryChannel::indexAt(double time) const
+{
+    return static_cast<size_t>(std::lower_bound(m_times.begin(), m_times.end(), time) - m_times.begin());
+}
+
+TelemetryChannel::MinMax TelemetryChannel::rangeOf(size_t begin, size_t end) const
+{
+    MinMax result = {std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+    size_t i = begin;
+    while (i < end) {
+        // The coarsest whole block that starts here and ends in range
+        bool used = false;
+        for (size_t level = kLevels; level-- > 0;) {
+            const unsigned shift = kBlockShift * static_cast<unsigned>(level + 1);
+            const size_t   block = size_t(1) << shift;
+            if ((i & (block - 1)) == 0 && i + block <= end) {
+                const MinMax& entry = m_levels[level][i >> shift];
+                result.min = std::min(result.min, entry.min);
+                result.max = std::max(result.max, entry.max);
+                i += block;
+                used = true;
+                break;
+            }
+        }
+        if (!used) {
+            result.min = std::min(result.min, m_values[i]);
+            result.max = std::max(result.max, m_values[i]);
+            ++i;
+        }
+    }
+    return result;
+}
+
+void TelemetryChannel::decimate(double t0, double t1, int columns, std::vector<MinMax>& out) const
+{
+    out.resize(columns > 0 ? static_cast<size_t>(columns) : 0);
+    if (columns <= 0) return;
+
+    const double step  = (t1 - t0) / columns;
+    size_t       begin = indexAt(t0);
+    for (int c = 0; c < columns; ++c) {
+        const size_t end = (c + 1 == columns) ? indexAt(t1) : indexAt(t0 + step * (c + 1));
+        out[static_cast<size_t>(c)] = rangeOf(begin, std::max(begin, end));
+        begin = std::max(begin, end);
+    }
+}
+
+bool TelemetryChannel::range(double t0, double t1, MinMax& out) const
+{
+    const size_t begin = indexAt(t0);
+    const size_t end   = indexAt(t1);
+    if (end <= begin) return false;
+    out = rangeOf(begin, end);
+    return true;
+}
+
+// ── TelemetryParser ───────────────────────────────────────────────────────────
+
+namespace {
+
+// Whole token as a number, allowing a unit after it ("3.3V", "12ms", "50%")
+bool parseNumber(const std::string& token, double& value)
+{
+    if (token.empty()) return false;
+    const char* begin = token.c_str();
+    char*       end   = nullptr;
+    value = std::strtod(begin, &end);
+    if (end == begin) return false;
+    for (const char* p = end; *p != '\0'; ++p) {
+        if (!std::isalpha(static_cast<unsigned char>(*p)) && *p != '%') return false;
+    }
+    return true;
+}
+
+bool isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '|';
+}
+
+} // namespace
+
+bool TelemetryParser::loadFormats(const std::string& elfPath, std::string& error)
+{
+    Lumos::TokenLogDecoder decoder;
+    if (!decoder.Load(elfPath, error)) return false;
+    m_decoder = decoder;
+    return true;
+}
+
+void TelemetryParser::feed(const uint8_t* data, size_t length, double now, std::string& text)
+{
+    for (size_t i = 0; i < length; ++i) {
+        const uint8_t byte = data[i];
+
+        // Without formats, frames could not be expanded anyway: all text
+        const Lumos::TokenLogParser::Result result =
+            hasFormats() ? m_frames.Feed(byte) : Lumos::TokenLogParser::Result::Text;
+
+        if (result == Lumos::TokenLogParser::Result::Text) {
+            text.push_back(static_cast<char>(byte));
+            if (byte == '\n') {
+                handleLine(m_line, now);
+                m_line.clear();
+            } else if (byte != '\r') {
+                m_line.push_back(static_cast<char>(byte));
+            }
+            continue;
+        }
+        if (result != Lumos::TokenLogParser::Result::Frame) continue;
+
+        // Unwrap the 32-bit stamp, then put it on the host clock
+        const Lumos::TokenLogFrame& frame = m_frames.GetFrame();
+        if (m_haveFrameTime && frame.time_us < m_lastFrameUs) m_frameUsHigh += uint64_t(1) << 32;
+        m_lastFrameUs = frame.time_us;
+        const double deviceTime = static_cast<double>(m_frameUsHigh + frame.time_us) / 1e6;
+        if (!m_haveFrameTime) {
+            m_frameOffset   = now - deviceTime;
+            m_haveFrameTime = true;
+        }
+
+        const std::string line = m_decoder.Format(frame);
+        char stamp[32];
+        std::snprintf(stamp, sizeof(stamp), "<%10.6f> ", deviceTime);
+        if (!m_line.empty()) text.push_back('\n');
+        text += stamp;
+        text += line;
+        text.push_back('\n');
+        handleLine(line, deviceTime + m_frameOffset);
+    }
+}
+
+std::vector<TelemetryParser::Sample> TelemetryParser::takeSamples()
+{
+    std::vector<Sample> samples;
+    samples.swap(m_samples);
+    return samples;
+}
+
+bool TelemetryParser::appsChanged()
+{
+    const bool changed = m_appsChanged;
+    m_appsChanged = false;
+    return changed;
+}
+
+void TelemetryParser::parseLine(const std::string& line, std::vector<std::pair<std::string, double>>& values)
+{
+    values.clear();
+    std::string name;        // Word waiting for its number
+    int         position = 0;
+    size_t      i        = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isSeparator(line[i])) ++i;
+        size_t end = i;
+        while (end < line.size() && !isSeparator(line[end])) ++end;
+        if (end == i) break;
+        std::string token = line.substr(i, end - i);
+        i = end;
+
+        // "name=value" / "name:value" in one token
+        const size_t split = token.find_first_of("=:");
+        if (split != std::string::npos && split > 0 && split + 1 < token.size()) {
+            double value;
+            if (parseNumber(token.substr(split + 1), value)) {
+                values.emplace_back(token.substr(0, split), value);
+                ++position;
+                name.clear();
+                continue;
+            }
+        }
+
+        double value;
+        if (parseNumber(token, value)) {
+            ++position;
+            values.emplace_back(name.empty() ? "#" + std::to_string(position) : name, value);
+            name.clear();
+            continue;
+        }
+
+        // A word names the number after it ("temp: 21.5", "err 0.01")
+        while (!token.empty() && (token.back() == '=' || token.back() == ':')) token.pop_back();
+        name = token;
+    }
+}
+
+void TelemetryParser::handleLine(const std::string& line, double time)
+{
+    if (!line.empty() && line[0] == '@') {
+        handleReport(line, time);
+        return;
+    }
+
+    std::vector<std::pair<std::string, double>> values;
+    parseLine(line, values);
+    for (const auto& value : values) {
+        m_samples.push_back({value.first, time, static_cast<float>(value.second)});
+    }
+}
+
+void TelemetryParser::handleReport(const std::string& line, double time)
+{
+    // Only "@app" feeds the dashboard; other reports belong to `lumos` tools
+    if (line.compare(0, 5, "@app ") != 0) return;
+
+    std::map<std::string, std::string> fields;
+    size_t i = 5;
+    while (i < line.size()) {
+        while (i < line.size() && line[i] == ' ') ++i;
+        size_t end = line.find(' ', i);
+        if (end == std::string::npos) end = line.size();
+        const std::string token = line.substr(i, end - i);
+        const size_t split = token.find('=');
+        if (split != std::string::npos) fields[token.substr(0, split)] = token.substr(split + 1);
+        i = end;
+    }
+    const auto name = fields.find("name");
+    if (name == fields.end() || name->second.empty()) return;
+
+    auto number = [&fields](const char* key) -> uint64_t {
+        const auto it = fields.find(key);
+        return it == fields.end() ? 0 : std::strtoull(it->second.c_str(), nullptr, 10);
+    };
+    AppStatsRow& row = m_apps[name->second];
+    row.state    = fields["state"];
+    row.rateHz   = static_cast<uint32_t>(number("rate"));
+    row.steps    = number("steps");
+    row.avgUs    = number("avg_us");
+    row.maxUs    = number("max_us");
+    row.jitterUs = number("jitter_us");
+    row.misses   = number("misses");
+    row.errors   = number("errors");
+    row.updated  = time;
+    m_appsChanged = true;
+}
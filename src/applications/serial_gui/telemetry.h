@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "token_log_decoder.h"
+
+/**
+ * One channel of samples with a min/max pyramid for plotting.
+ *
+ * Samples are appended in time order. Level k of the pyramid holds the
+ * min and max of each block of 64^(k+1) samples, updated as samples come
+ * in, so reducing any time range to a few thousand pixel columns reads
+ * at most ~128 entries per column and level, however many millions of
+ * samples the range covers.
+ */
+class TelemetryChannel
+{
+public:
+    struct MinMax {
+        float min;
+        float max;
+    };
+
+    void append(double time, float value);
+
+    /** Drop the oldest @p count samples (rebuilds the pyramid) */
+    void dropOldest(size_t count);
+    void clear();
+
+    size_t size() const { return m_times.size(); }
+    double firstTime() const { return m_times.empty() ? 0.0 : m_times.front(); }
+    double lastTime() const { return m_times.empty() ? 0.0 : m_times.back(); }
+    float lastValue() const { return m_values.empty() ? 0.0f : m_values.back(); }
+
+    /**
+     * Min and max of the samples in each of @p columns equal slices of
+     * [@p t0, @p t1). Columns without samples get min > max.
+     */
+    void decimate(double t0, double t1, int columns, std::vector<MinMax>& out) const;
+
+    /** Min and max over [@p t0, @p t1); false if it holds no samples */
+    bool range(double t0, double t1, MinMax& out) const;
+
+private:
+    static constexpr unsigned kBlockShift = 6;   // 64 entries per block, per level
+    static constexpr size_t   kLevels     = 4;   // Blocks of 64 up to 16M samples
+
+    MinMax rangeOf(size_t begin, size_t end) const;
+    size_t indexAt(double time) const;
+    void   build();
+
+    std::vector<double> m_times;
+    std::vector<float>  m_values;
+    std::vector<MinMax> m_levels[kLevels];
+};
+
+/** Counters of a framework app, from an "@app" line (PrintApplicationStats()) */
+struct AppStatsRow {
+    std::string state;
+    uint32_t    rateHz    = 0;
+    uint64_t    steps     = 0;
+    uint64_t    avgUs     = 0;
+    uint64_t    maxUs     = 0;
+    uint64_t    jitterUs  = 0;
+    uint64_t    misses    = 0;
+    uint64_t    errors    = 0;
+    double      updated   = 0.0;   // Time of the last report
+};
+
+/**
+ * Turns a serial byte stream into terminal text, plot samples and app stats.
+ *
+ * Text lines are split into numbers; a number takes its name from a
+ * "name=", "name:" or "name " before it, otherwise its position on the
+ * line ("#1", "#2", ...). Tokenized log frames (framework/token_log.h)
+ * are expanded with the formats of the loaded firmware.elf and parsed the
+ * same way, stamped with the firmware's own microsecond clock. "@app"
+ * lines fill the app table; other "@" report lines are left alone.
+ */
+class TelemetryParser
+{
+public:
+    struct Sample {
+        std::string name;
+        double      time;
+        float       value;
+    };
+
+    /** Expand tokenized frames with the formats in @p elfPath */
+    bool loadFormats(const std::string& elfPath, std::string& error);
+    bool hasFormats() const { return m_decoder.GetFormatCount() > 0; }
+
+    /**
+     * Feed bytes received at host time @p now (seconds).
+     * Appends what to show in the terminal to @p text, and new samples
+     * and app reports to the queues taken with takeSamples()/apps().
+     */
+    void feed(const uint8_t* data, size_t length, double now, std::string& text);
+
+    /** Samples parsed since the last call */
+    std::vector<Sample> takeSamples();
+
+    const std::map<std::string, AppStatsRow>& apps() const { return m_apps; }
+    bool appsChanged();
+
+    uint64_t frameErrors() const { return m_frames.GetErrorCount(); }
+
+    /** Numbers on one line, named as described above (exposed for tests) */
+    static void parseLine(const std::string& line, std::vector<std::pair<std::string, double>>& values);
+
+private:
+    void handleLine(const std::string& line, double time);
+    void handleReport(const std::string& line, double time);
+
+    Lumos::TokenLogDecoder m_decoder;
+    Lumos::TokenLogParser  m_frames;
+    std::string            m_line;            // Text since the last newline
+    std::vector<Sample>    m_samples;
+    std::map<std::string, AppStatsRow> m_apps;
+    bool                   m_appsChanged = false;
+
+    // The firmware stamps frames with 32-bit microseconds; unwrapped here
+    // and placed on the host clock at the first frame
+    bool     m_haveFrameTime = false;
+    uint32_t m_lastFrameUs   = 0;
+    uint64_t m_frameUsHigh   = 0;
+    double   m_frameOffset   = 0.0;
+};
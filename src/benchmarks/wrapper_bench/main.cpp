@@ -0,0 +1,303 @@
+/**
+ * @file main.cpp
+ * @brief Cycle counts of the wrapper's hot paths, run by `lumos bench`
+ *
+ * Measures on the board:
+ * - GPIO::write() and FastPin::write()
+ * - Serial::write() of one byte and of a 16 byte frame
+ * - SPI::transfer() of one byte and of a 16 byte frame
+ * - CAN::send() and CAN::read() (internal loopback, no bus needed)
+ * - AnalogInput::read()
+ * - Timer update interrupt latency (raw handler entry)
+ * - memcpy() of 1 KB (aligned and misaligned), memset() of 1 KB,
+ *   Crc32() of 1 KB and Crc8() of a 64 byte frame (see fast_libc.h;
+ *   `lumos bench --no-fast-libc` gives newlib's for comparison)
+ * - printf() of Serial/USB (format.h) with an integer and with a mixed
+ *   line, into a sink that drops the text, beside newlib's snprintf()
+ *
+ * The whole set is measured and printed as "@bench" lines (see bench.h)
+ * every two seconds, so the host picks up a complete run whenever it
+ * connects. Nothing needs to be wired up; the benchmark pins are
+ * driven as outputs, so leave them unconnected.
+ */
+#include "lumos.h"
+#include "sys.h"
+#include "gpio.h"
+#include "uart.h"
+#include "spi.h"
+#include "can.h"
+#include "adc.h"
+#include "timer.h"
+#include "bench.h"
+#include "fast_libc.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(STM32G0)
+#include "lumos_micro_brain.h"
+
+// LumosMicroBrain: SerialPgm reports, the bottom connector is measured
+#define BENCH_BOARD "LumosMicroBrain"
+#define BENCH_CONSOLE SerialPgm
+#define BENCH_SERIAL SerialBottom
+#define BENCH_SPI SPI_Bottom
+#define BENCH_CAN CAN1
+#define BENCH_ADC_CHANNEL 1, GPIOA, GPIO_PIN_1
+#define BENCH_PIN_PORT GPIOA
+#define BENCH_PIN_BASE GPIOA_BASE
+#define BENCH_PIN GPIO_PIN_15
+#define BENCH_TIMER TIM14
+#define BENCH_TIMER_IRQn TIM14_IRQn
+#define BENCH_TIMER_HANDLER TIM14_IRQHandler
+
+#elif defined(STM32H7)
+#include "lumos_brain.h"
+#include "jst_shield.h"
+
+// LumosBrain: SerialCom reports, SerialESP is measured through its DMA ring
+#define BENCH_BOARD "LumosBrain"
+#define BENCH_CONSOLE SerialCom
+#define BENCH_SERIAL SerialESP
+#define BENCH_SERIAL_DMA
+#define BENCH_CAN CAN1
+#define BENCH_ADC_CHANNEL 10, GPIOC, GPIO_PIN_0
+#define BENCH_PIN_PORT GPIOE
+#define BENCH_PIN_BASE GPIOE_BASE
+#define BENCH_PIN GPIO_PIN_2
+#define BENCH_TIMER TIM7
+#define BENCH_TIMER_IRQn TIM7_IRQn
+#define BENCH_TIMER_HANDLER TIM7_IRQHandler
+
+#else
+#error "wrapper_bench supports LumosMicroBrain and LumosBrain"
+#endif
+
+static const uint32_t kReportIntervalMs = 2000;
+static const uint32_t kTimerSamples = 200;
+
+static GPIO bench_pin(BENCH_PIN_PORT, BENCH_PIN);
+using BenchFastPin = FastPin<BENCH_PIN_BASE, BENCH_PIN>;
+
+static AnalogInput bench_adc(ADC1);
+static bool adc_ready = false;
+
+static Timer bench_timer(BENCH_TIMER);
+static BenchStats timer_latency("timer_isr_latency");
+static volatile uint32_t timer_samples = 0;
+
+extern "C" void BENCH_TIMER_HANDLER(void) { bench_timer.handleUpdateInterrupt(); }
+
+static void onTimerUpdate(void* context)
+{
+    (void)context;
+    if (timer_samples < kTimerSamples) {
+        timer_latency.add(bench_timer.getLatencyCycles());
+        timer_samples = timer_samples + 1;
+    }
+}
+
+static void benchGpio()
+{
+    bool level = false;
+    PrintBench(BENCH_CONSOLE, RunBench("gpio_write", 1000, [&]() {
+        bench_pin.write(level);
+        level = !level;
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("fastpin_write", 1000, [&]() {
+        BenchFastPin::write(level);
+        level = !level;
+    }));
+}
+
+static void benchSerial()
+{
+    static const uint8_t frame[16] = {0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
+                                      0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55};
+    PrintBench(BENCH_CONSOLE, RunBench("serial_write_byte", 100, []() {
+        BENCH_SERIAL.write((uint8_t)0x55);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("serial_write_16", 100, []() {
+        BENCH_SERIAL.write(frame, sizeof(frame));
+    }));
+    // Let the DMA ring drain before the next benchmark
+    DelayMs(20);
+}
+
+static void benchSpi()
+{
+#ifdef BENCH_SPI
+    static const uint8_t tx[16] = {};
+    static uint8_t rx[16];
+    PrintBench(BENCH_CONSOLE, RunBench("spi_transfer_byte", 500, []() {
+        BENCH_SPI.transfer((uint8_t)0xA5);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("spi_transfer_16", 500, []() {
+        BENCH_SPI.transfer(tx, rx, sizeof(tx));
+    }));
+#else
+    PrintBenchSkip(BENCH_CONSOLE, "spi_transfer_byte", "no_spi_port");
+    PrintBenchSkip(BENCH_CONSOLE, "spi_transfer_16", "no_spi_port");
+#endif
+}
+
+// Waits for the loopback copy of the last frame, outside any region
+static bool waitForFrame()
+{
+    const uint32_t start_ms = GetCurrentTimeMs();
+    while (!BENCH_CAN.available()) {
+        if (GetCurrentTimeMs() - start_ms > 10) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchCan()
+{
+    const uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    BenchStats send_stats("can_send");
+    BenchStats read_stats("can_read");
+    CANFrame frame;
+
+    for (uint32_t i = 0; i < 100; i++) {
+        uint32_t start = BenchCycles();
+        const bool sent = BENCH_CAN.send(0x123, data, sizeof(data));
+        const uint32_t send_cycles = BenchElapsed(start);
+        if (!sent || !waitForFrame()) {
+            continue;
+        }
+        send_stats.add(send_cycles);
+
+        start = BenchCycles();
+        BENCH_CAN.read(frame);
+        read_stats.add(BenchElapsed(start));
+    }
+    PrintBench(BENCH_CONSOLE, send_stats);
+    PrintBench(BENCH_CONSOLE, read_stats);
+}
+
+static void benchAdc()
+{
+    if (!adc_ready) {
+        PrintBenchSkip(BENCH_CONSOLE, "adc_read", "init_failed");
+        return;
+    }
+    PrintBench(BENCH_CONSOLE, RunBench("adc_read", 200, []() {
+        bench_adc.read();
+    }));
+}
+
+static uint32_t memory_src[257];
+static uint32_t memory_dst[256];
+static volatile size_t memory_length = sizeof(memory_dst);   // Volatile: keeps the calls real
+
+static void benchMemory()
+{
+    uint8_t* src = reinterpret_cast<uint8_t*>(memory_src);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(memory_dst);
+    PrintBench(BENCH_CONSOLE, RunBench("memcpy_1k", 200, [&]() {
+        memcpy(dst, src, memory_length);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("memcpy_1k_misaligned", 200, [&]() {
+        memcpy(dst, src + 1, memory_length);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("memset_1k", 200, [&]() {
+        memset(dst, 0x5A, memory_length);
+    }));
+
+    volatile uint32_t crc32 = 0;
+    volatile uint8_t crc8 = 0;
+    PrintBench(BENCH_CONSOLE, RunBench("crc32_1k", 50, [&]() {
+        crc32 = Crc32(0, src, memory_length);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("crc8_64", 200, [&]() {
+        crc8 = Crc8(0, src, 64);
+    }));
+    (void)crc32;
+    (void)crc8;
+}
+
+// Drops the text, so only the formatting is timed
+class NullPrint : public Print<NullPrint>
+{
+public:
+    bool write(const uint8_t* data, uint16_t length, uint32_t timeout)
+    {
+        (void)data;
+        (void)length;
+        (void)timeout;
+        return true;
+    }
+};
+
+static volatile uint32_t format_value = 1234567;
+
+static void benchFormat()
+{
+    static NullPrint null_print;
+    static char text[32];
+    PrintBench(BENCH_CONSOLE, RunBench("format_u32", 200, []() {
+        null_print.printf("%u", (uint32_t)format_value);
+    }));
+    PrintBench(BENCH_CONSOLE, RunBench("format_line", 200, []() {
+        null_print.printf("t=%u ms  temp=%.1f C  state=%s\r\n", (uint32_t)format_value, 23.5f, "idle");
+    }));
+    // newlib-nano for comparison; it has no %f without -u _printf_float
+    PrintBench(BENCH_CONSOLE, RunBench("snprintf_u32", 200, []() {
+        snprintf(text, sizeof(text), "%u", (unsigned)format_value);
+    }));
+}
+
+static void benchTimer()
+{
+    timer_latency = BenchStats("timer_isr_latency");
+    timer_samples = 0;
+    bench_timer.start();
+    const uint32_t start_ms = GetCurrentTimeMs();
+    while (timer_samples < kTimerSamples && GetCurrentTimeMs() - start_ms < 2 * kTimerSamples) {
+    }
+    bench_timer.stop();
+    PrintBench(BENCH_CONSOLE, timer_latency);
+}
+
+void setup(void)
+{
+    InitMicrosecondTiming();
+    BENCH_CONSOLE.begin(115200);
+
+    bench_pin.mode(GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_HIGH);
+
+#ifdef BENCH_SERIAL_DMA
+    beginSerialDma(BENCH_SERIAL, 1000000);
+#else
+    BENCH_SERIAL.begin(1000000);
+#endif
+
+#ifdef BENCH_SPI
+    BENCH_SPI.begin(8000000);
+#endif
+
+    BENCH_CAN.setMode(FDCAN_MODE_INTERNAL_LOOPBACK).begin(500000);
+
+    adc_ready = bench_adc.init() && bench_adc.calibrate() && bench_adc.configureChannel(BENCH_ADC_CHANNEL);
+
+    bench_timer.initPeriodic(1, onTimerUpdate, nullptr);
+    bench_timer.enableLatencyMeasurement();
+    bench_timer.enableInterrupt(BENCH_TIMER_IRQn, 0);
+}
+
+void loop(void)
+{
+    BENCH_CONSOLE.printf("@bench_begin board=%s\r\n", BENCH_BOARD);
+    benchGpio();
+    benchSerial();
+    benchSpi();
+    benchCan();
+    benchAdc();
+    benchTimer();
+    benchMemory();
+    benchFormat();
+    PrintBenchDone(BENCH_CONSOLE, BENCH_BOARD);
+
+    DelayMs(kReportIntervalMs);
+}
@@ -0,0 +1,394 @@
+#include "can.h"
+#include "sys.h"
+#include "event_loop.h"
+
+#include <cstring>
+
+// CAN Class Implementation (host simulator)
+
+// Ports on the simulated bus, see CAN::begin()
+static CAN* bus_members = nullptr;
+
+// Estimated bits of a frame on the wire (no stuff bits), as on the device
+static uint32_t frameBits(uint8_t length, bool extended)
+{
+    return (extended ? 67u : 47u) + 8u * length;
+}
+
+CAN::CAN(FDCAN_GlobalTypeDef* fdcan_instance,
+         GPIO_TypeDef* tx_port, uint16_t tx_pin,
+         GPIO_TypeDef* rx_port, uint16_t rx_pin,
+         uint32_t alternate_function)
+    : instance_(fdcan_instance),
+      started_(false),
+      fd_(false),
+      bitrate_(500000),
+      rx_capacity_(RX_FIFO_DEPTH),
+      rx_interrupt_(false),
+      rx_queue_overflows_(0),
+      rx_fifo_overflows_(0),
+      handlers_{},
+      handler_count_(0),
+      forwards_{},
+      forward_count_(0),
+      forwarded_frames_(0),
+      tx_queue_(false),
+      filters_{},
+      filter_count_(0),
+      accept_non_matching_(true),
+      tx_frames_(0),
+      tx_dropped_(0),
+      rx_frames_(0),
+      bus_bits_(0),
+      rx_queue_high_water_(0),
+      next_(nullptr)
+{
+    (void)tx_port;
+    (void)tx_pin;
+    (void)rx_port;
+    (void)rx_pin;
+    (void)alternate_function;
+}
+
+CAN::~CAN()
+{
+    end();
+}
+
+void CAN::begin(const uint32_t bitrate)
+{
+    if (bitrate != 0) {
+        bitrate_ = bitrate;
+    }
+    setAcceptAll();
+    if (!started_) {
+        next_ = bus_members;
+        bus_members = this;
+        started_ = true;
+    }
+}
+
+void CAN::end()
+{
+    if (!started_) {
+        return;
+    }
+    for (CAN** member = &bus_members; *member != nullptr; member = &(*member)->next_) {
+        if (*member == this) {
+            *member = next_;
+            break;
+        }
+    }
+    next_ = nullptr;
+    started_ = false;
+    rx_.clear();
+}
+
+bool CAN::transmit(uint32_t id, const uint8_t* data, uint8_t length, bool extended, bool remote)
+{
+    const uint8_t max_length = fd_ ? 64 : 8;
+    if (!started_ || length > max_length) {
+        tx_dropped_++;
+        return false;
+    }
+
+    CANFrame frame = {};
+    frame.id = id;
+    frame.length = length;
+    frame.extended = extended;
+    frame.fd = fd_ && length > 8;
+    frame.handler = NO_HANDLER;
+    if (!remote && length > 0) {
+        memcpy(frame.data, data, length);
+    }
+
+    tx_frames_++;
+    bus_bits_ += frameBits(length, extended);
+    for (CAN* member = bus_members; member != nullptr; member = member->next_) {
+        if (member != this) {
+            member->deliver(frame);
+        }
+    }
+    return true;
+}
+
+bool CAN::accepts(const CANFrame& frame) const
+{
+    for (uint8_t i = 0; i < filter_count_; i++) {
+        const CANFilter& filter = filters_[i];
+        if (filter.extended != frame.extended) {
+            continue;
+        }
+        bool match = false;
+        switch (filter.type) {
+        case CANFilter::EXACT: match = frame.id == filter.id1; break;
+        case CANFilter::RANGE: match = frame.id >= filter.id1 && frame.id <= filter.id2; break;
+        case CANFilter::MASK: match = (frame.id & filter.id2) == (filter.id1 & filter.id2); break;
+        case CANFilter::DUAL: match = frame.id == filter.id1 || frame.id == filter.id2; break;
+        }
+        if (match) {
+            return filter.action != CANFilter::REJECT;
+        }
+    }
+    return accept_non_matching_;
+}
+
+// Reception side of the simulated bus: filter, claim and queue
+void CAN::deliver(const CANFrame& frame)
+{
+    if (!accepts(frame)) {
+        return;
+    }
+    for (uint8_t i = 0; i < forward_count_; i++) {
+        const Forward& rule = forwards_[i];
+        if (rule.extended == frame.extended && (frame.id & rule.mask) == rule.id) {
+            forwarded_frames_++;   // The target is on this bus already
+            break;
+        }
+    }
+
+    if (rx_.size() >= rx_capacity_) {
+        if (rx_interrupt_) {
+            rx_queue_overflows_++;
+        } else {
+            rx_fifo_overflows_++;
+        }
+        return;
+    }
+
+    CANFrame received = frame;
+    received.timestamp = getTimestamp();
+    received.handler = NO_HANDLER;
+    for (uint8_t i = 0; i < handler_count_; i++) {
+        const Handler& handler = handlers_[i];
+        if (handler.extended == frame.extended && (frame.id & handler.mask) == (handler.id & handler.mask)) {
+            received.handler = i;
+            break;
+        }
+    }
+
+    rx_.push_back(received);
+    rx_frames_++;
+    LUMOS_POST_EVENT(EVENT_CAN_RX);
+    bus_bits_ += frameBits(frame.length, frame.extended);
+    if (rx_.size() > rx_queue_high_water_) {
+        rx_queue_high_water_ = (uint16_t)rx_.size();
+    }
+}
+
+bool CAN::send(uint32_t id, const uint8_t* data, uint8_t length, bool extended)
+{
+    return transmit(id, data, length, extended, false);
+}
+
+bool CAN::sendRemote(uint32_t id, bool extended)
+{
+    return transmit(id, nullptr, 0, extended, true);
+}
+
+bool CAN::beginTxQueue(CANFrame* queue, uint16_t size, IRQn_Type irq)
+{
+    (void)irq;
+    tx_queue_ = tx_queue_ || (queue != nullptr && size > 0);
+    return queue != nullptr && size > 0;
+}
+
+uint16_t CAN::sendBatch(const CANFrame* frames, uint16_t count)
+{
+    uint16_t sent = 0;
+    while (sent < count && transmit(frames[sent].id, frames[sent].data, frames[sent].length,
+                                     frames[sent].extended, false)) {
+        sent++;
+    }
+    return sent;
+}
+
+bool CAN::sendTimestamped(uint32_t id, const uint8_t* data, uint8_t length, uint8_t marker, bool extended)
+{
+    if (marker == 0) {
+        return false;
+    }
+    const uint16_t timestamp = getTimestamp();
+    if (!transmit(id, data, length, extended, false)) {
+        return false;
+    }
+    tx_events_.push_back(TxEvent{marker, timestamp});
+    return true;
+}
+
+bool CAN::readTxEvent(uint8_t& marker, uint16_t& timestamp)
+{
+    if (tx_events_.empty()) {
+        return false;
+    }
+    marker = tx_events_.front().marker;
+    timestamp = tx_events_.front().timestamp;
+    tx_events_.pop_front();
+    return true;
+}
+
+bool CAN::available()
+{
+    if (rx_interrupt_) {
+        dispatch();
+    }
+    return !rx_.empty();
+}
+
+bool CAN::read(uint32_t& id, uint8_t* data, uint8_t& length, bool& extended)
+{
+    CANFrame frame;
+    if (!read(frame)) {
+        return false;
+    }
+
+    id = frame.id;
+    extended = frame.extended;
+    length = frame.length;
+    memcpy(data, frame.data, frame.length);
+    return true;
+}
+
+bool CAN::read(CANFrame& frame)
+{
+    if (rx_interrupt_) {
+        dispatch();
+    }
+    if (rx_.empty()) {
+        return false;
+    }
+    frame = rx_.front();
+    rx_.pop_front();
+    return true;
+}
+
+bool CAN::beginRxInterrupt(CANFrame* queue, uint16_t size, IRQn_Type irq)
+{
+    (void)irq;
+    if (queue == nullptr || size < 2) {
+        return false;
+    }
+    rx_capacity_ = (uint16_t)(size - 1);   // One slot stays unused
+    rx_interrupt_ = true;
+    return true;
+}
+
+bool CAN::setMessageRam(const CANMessageRam& layout)
+{
+    static const uint8_t sizes[] = {8, 12, 16, 20, 24, 32, 48, 64};
+    bool size_ok = false;
+    for (uint8_t size : sizes) {
+        size_ok = size_ok || layout.data_bytes == size;
+    }
+    return size_ok && layout.std_filters <= 128 && layout.ext_filters <= 64 &&
+           layout.rx_fifo0 >= 1 && layout.rx_fifo0 <= 64 && layout.rx_fifo1 <= 64 &&
+           layout.tx_events <= 32 && layout.tx_fifo >= 1 && layout.tx_fifo <= 32 &&
+           layout.end() <= CANMessageRam::TOTAL_WORDS;
+}
+
+bool CAN::forwardTo(CAN& target, uint32_t id, uint32_t mask, bool extended)
+{
+    if (forward_count_ >= MAX_FORWARDS || !rx_interrupt_ || !target.tx_queue_ || &target == this) {
+        return false;
+    }
+    forwards_[forward_count_] = Forward{id & mask, mask, extended};
+    forward_count_++;
+    return true;
+}
+
+bool CAN::onReceive(uint32_t id, uint32_t mask, CANCallback callback, bool extended)
+{
+    if (handler_count_ >= MAX_HANDLERS || !callback) {
+        return false;
+    }
+    handlers_[handler_count_] = Handler{id, mask, extended, callback};
+    handler_count_++;
+    return true;
+}
+
+uint16_t CAN::dispatch()
+{
+    if (!rx_interrupt_) {
+        return 0;
+    }
+
+    uint16_t handled = 0;
+    while (!rx_.empty() && rx_.front().handler != NO_HANDLER) {
+        // Copied out, a handler may send and so receive on this port
+        const CANFrame frame = rx_.front();
+        rx_.pop_front();
+        handlers_[frame.handler].callback(frame);
+        handled++;
+    }
+    return handled;
+}
+
+void CAN::setFilter(uint32_t id, uint32_t mask, bool extended, uint8_t fifo)
+{
+    filters_[0] = CANFilter::mask(id, mask, extended).toFifo(fifo);
+    filter_count_ = 1;
+    accept_non_matching_ = false;
+}
+
+void CAN::setAcceptAll()
+{
+    filter_count_ = 0;
+    accept_non_matching_ = true;
+}
+
+bool CAN::setFilters(const CANFilter* filters, uint8_t count, bool accept_non_matching)
+{
+    if (count > MAX_STD_FILTERS + MAX_EXT_FILTERS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        filters_[i] = filters[i];
+    }
+    filter_count_ = count;
+    accept_non_matching_ = accept_non_matching;
+    return true;
+}
+
+CANStats CAN::getStats()
+{
+    CANStats stats = {};
+    stats.tx_frames = tx_frames_;
+    stats.tx_dropped = tx_dropped_;
+    stats.rx_frames = rx_frames_;
+    stats.rx_dropped = rx_queue_overflows_ + rx_fifo_overflows_;
+    stats.bus_bits = bus_bits_;
+    if (rx_interrupt_) {
+        stats.rx_queue_high_water = rx_queue_high_water_;
+    } else {
+        stats.rx_fifo_high_water[0] = rx_queue_high_water_;
+    }
+    return stats;
+}
+
+void CAN::resetStats()
+{
+    tx_frames_ = 0;
+    tx_dropped_ = 0;
+    rx_frames_ = 0;
+    bus_bits_ = 0;
+    rx_queue_overflows_ = 0;
+    rx_fifo_overflows_ = 0;
+    rx_queue_high_water_ = 0;
+}
+
+uint16_t CAN::getTimestamp()
+{
+    // One tick per nominal bit time of the simulated clock
+    return (uint16_t)(GetCurrentTimeUs() * bitrate_ / 1000000);
+}
+
+uint32_t CAN::timestampToMicros(uint32_t ticks) const
+{
+    return (uint32_t)((uint64_t)ticks * 1000000 / bitrate_);
+}
+
+uint64_t CAN::timestampToTimeUs(uint16_t timestamp)
+{
+    const uint16_t counter = getTimestamp();
+    return GetCurrentTimeUs() - timestampToMicros((uint16_t)(counter - timestamp));
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include "host_hal.h"
+
+// Received frame, as queued by the interrupt-driven receive mode
+struct CANFrame
+{
+    uint32_t id;
+    uint8_t length;       // Payload bytes (0-8, FD up to 64)
+    bool extended;
+    bool fd;
+    uint8_t handler;      // Index of the onReceive() handler that claimed it
+    uint16_t timestamp;   // FDCAN timestamp counter at reception
+    uint8_t data[64];
+};
+
+// Bus health counters of one CAN port (CAN::getStats())
+struct CANStats
+{
+    uint32_t tx_frames;            // Frames handed to the hardware
+    uint32_t tx_dropped;           // Frames send()/sendBatch() refused
+    uint32_t rx_frames;            // Frames taken from the RX FIFOs
+    uint32_t rx_dropped;           // Hardware FIFO plus software queue overflows
+    uint32_t bus_bits;             // Estimated bits of all TX and RX frames (no stuff bits)
+    uint16_t rx_fifo_high_water[2];  // Highest RX FIFO0/FIFO1 fill level seen
+    uint16_t rx_queue_high_water;  // Highest software RX queue depth
+    uint16_t tx_queue_high_water;  // Highest software TX queue depth
+    uint8_t tx_error_count;        // Current TEC
+    uint8_t rx_error_count;        // Current REC
+    uint32_t error_passive_ms;     // Total time spent error passive
+    uint32_t bus_off_count;        // Times the port went bus-off
+};
+
+// One entry of a hardware filter list for CAN::setFilters()
+//
+//   static const CANFilter filters[] = {
+//       CANFilter::exact(0x010).toFifo(1).highPriority(),  // E-stop
+//       CANFilter::range(0x100, 0x17F),
+//       CANFilter::exact(0x200),                           // Consecutive exact IDs
+//       CANFilter::exact(0x210),                           // share one element
+//       CANFilter::mask(0x18FF0000, 0x1FFF0000, true),
+//   };
+//   CAN1.setFilters(filters, 5);
+struct CANFilter
+{
+    enum Type : uint8_t { EXACT, RANGE, MASK, DUAL };
+    enum Action : uint8_t { FIFO0, FIFO1, REJECT };
+
+    Type type;
+    uint32_t id1;
+    uint32_t id2;
+    bool extended;
+    Action action;
+    bool high_priority;
+
+    // Accept a single ID
+    static constexpr CANFilter exact(uint32_t id, bool extended = false)
+    {
+        return CANFilter{EXACT, id, id, extended, FIFO0, false};
+    }
+    // Accept IDs from first to last (inclusive)
+    static constexpr CANFilter range(uint32_t first, uint32_t last, bool extended = false)
+    {
+        return CANFilter{RANGE, first, last, extended, FIFO0, false};
+    }
+    // Accept IDs where (ID & mask) == (id & mask)
+    static constexpr CANFilter mask(uint32_t id, uint32_t mask, bool extended = false)
+    {
+        return CANFilter{MASK, id, mask, extended, FIFO0, false};
+    }
+    // Accept either of two IDs
+    static constexpr CANFilter dual(uint32_t id1, uint32_t id2, bool extended = false)
+    {
+        return CANFilter{DUAL, id1, id2, extended, FIFO0, false};
+    }
+
+    // Store matching frames in RX FIFO 1 instead of 0
+    constexpr CANFilter toFifo(uint8_t fifo) const
+    {
+        return CANFilter{type, id1, id2, extended, fifo == 1 ? FIFO1 : FIFO0, high_priority};
+    }
+    // Drop matching frames (checked in list order, so put it before the
+    // entries it makes exceptions to)
+    constexpr CANFilter reject() const
+    {
+        return CANFilter{type, id1, id2, extended, REJECT, false};
+    }
+    // Flag matching frames as high priority (FDCAN HPM status and interrupt)
+    constexpr CANFilter highPriority() const
+    {
+        return CANFilter{type, id1, id2, extended, action, true};
+    }
+};
+
+// Message RAM of one FDCAN port, for CAN::setMessageRam() (H7)
+//
+//   // Gateway: CAN1 filters finely and buffers deep, CAN2 mostly transmits
+//   //   offset, std/ext filters, RX FIFO0/FIFO1, TX events, TX FIFO, payload
+//   static constexpr CANMessageRam can1_ram = {0, 64, 16, 32, 8, 0, 16, 8};
+//   static constexpr CANMessageRam can2_ram = {can1_ram.end(), 4, 0, 8, 0, 4, 32, 8};
+//   CAN1.setMessageRam(can1_ram);
+//   CAN2.setMessageRam(can2_ram);
+//
+// The H7's FDCAN ports share 2560 words of message RAM; by default each
+// gets a third with 28/8 filters, 8 + 8 RX and 8 TX elements of 8 bytes.
+// Offsets are not checked against the other ports, so lay them out one
+// after another with end(). The G0, G4 and H5 have a fixed layout per
+// port (28/8 filters, 3 + 3 RX and 3 TX elements) that needs no setting.
+struct CANMessageRam
+{
+    static constexpr uint32_t TOTAL_WORDS = 2560;
+
+    uint16_t offset;      // First word in the shared message RAM
+    uint8_t std_filters;  // Standard ID filter elements (0-128)
+    uint8_t ext_filters;  // Extended ID filter elements (0-64)
+    uint8_t rx_fifo0;     // RX FIFO 0 elements (1-64)
+    uint8_t rx_fifo1;     // RX FIFO 1 elements (0-64)
+    uint8_t tx_events;    // TX event elements, for sendTimestamped() (0-32)
+    uint8_t tx_fifo;      // TX FIFO elements (1-32)
+    uint8_t data_bytes;   // Payload per RX/TX element: 8, 12, 16, 20, 24, 32, 48 or 64 (FD)
+
+    // Words taken: a word per standard filter, two per extended filter and
+    // TX event, a two word header plus the payload per RX/TX element
+    constexpr uint32_t words() const
+    {
+        return std_filters + 2u * ext_filters + 2u * tx_events +
+               (rx_fifo0 + rx_fifo1 + tx_fifo) * (2u + (data_bytes + 3u) / 4u);
+    }
+
+    // Offset for the next port's layout
+    constexpr uint16_t end() const { return static_cast<uint16_t>(offset + words()); }
+};
+
+// CAN Class - host simulator version of the wrapper's FDCAN CAN
+// Usage Example:
+//   CAN1.begin(500000);
+//   CAN2.begin(500000);
+//   CAN1.send(0x123, data, 3);     // CAN2.available() is now true
+//
+// Every begun CAN in the process sits on one simulated bus: a frame sent
+// by one port is received by all others whose filters accept it, at
+// once (the bus has no bit timing). Several nodes of a network can so
+// run in one host program, or test code can play the other nodes with a
+// port of its own. Ports that are not begun neither send nor receive.
+//
+// Reception matches the device: without beginRxInterrupt() a port holds
+// RX_FIFO_DEPTH frames like the hardware FIFO and further frames are lost
+// (rxFifoOverflows()); with it frames go into the given queue and
+// onReceive() handlers run from dispatch(). The TX queue is accepted but
+// never needed, as the simulated bus takes every frame. Timestamps count
+// nominal bit times of the simulated clock.
+//
+// setMessageRam() checks the layout as on the H7 and otherwise changes
+// nothing. All ports share the one simulated bus, so a gateway's other
+// port already sees every frame: forwardTo() rules count the frames they
+// match (forwardedFrames()) without sending them again, and the frames are
+// still queued here, so no frame the bus carried is lost on the host.
+class CAN
+{
+public:
+    using CANCallback = std::function<void(const CANFrame&)>;
+    static constexpr uint8_t MAX_HANDLERS = 8;
+    static constexpr uint8_t NO_HANDLER = 0xFF;
+    static constexpr uint8_t MAX_STD_FILTERS = 28;
+    static constexpr uint8_t MAX_EXT_FILTERS = 8;
+    static constexpr uint8_t MAX_FORWARDS = 4;
+    using TxCompleteHook = void (*)(void* context);
+    // Frames a port without RX interrupt holds (FIFO0 plus FIFO1 on the G0)
+    static constexpr uint16_t RX_FIFO_DEPTH = 6;
+
+private:
+    FDCAN_GlobalTypeDef* instance_;
+    bool started_;
+    bool fd_;
+    uint32_t bitrate_;
+
+    std::deque<CANFrame> rx_;
+    uint16_t rx_capacity_;
+    bool rx_interrupt_;
+    uint32_t rx_queue_overflows_;
+    uint32_t rx_fifo_overflows_;
+
+    struct Handler
+    {
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+        CANCallback callback;
+    };
+    Handler handlers_[MAX_HANDLERS];
+    uint8_t handler_count_;
+
+    struct Forward
+    {
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+    };
+    Forward forwards_[MAX_FORWARDS];
+    uint8_t forward_count_;
+    uint32_t forwarded_frames_;
+    bool tx_queue_;
+
+    CANFilter filters_[MAX_STD_FILTERS + MAX_EXT_FILTERS];
+    uint8_t filter_count_;
+    bool accept_non_matching_;
+
+    struct TxEvent
+    {
+        uint8_t marker;
+        uint16_t timestamp;
+    };
+    std::deque<TxEvent> tx_events_;
+
+    uint32_t tx_frames_;
+    uint32_t tx_dropped_;
+    uint32_t rx_frames_;
+    uint32_t bus_bits_;
+    uint16_t rx_queue_high_water_;
+
+    CAN* next_;   // Simulated bus membership
+
+    bool transmit(uint32_t id, const uint8_t* data, uint8_t length, bool extended, bool remote);
+    bool accepts(const CANFrame& frame) const;
+    void deliver(const CANFrame& frame);
+
+public:
+    CAN() = delete;
+    CAN(FDCAN_GlobalTypeDef* fdcan_instance,
+        GPIO_TypeDef* tx_port, uint16_t tx_pin,
+        GPIO_TypeDef* rx_port, uint16_t rx_pin,
+        uint32_t alternate_function);
+    ~CAN();
+
+    CAN(const CAN&) = delete;
+    CAN& operator=(const CAN&) = delete;
+
+    void begin(const uint32_t bitrate = 500000);
+    void end();
+
+    // Accepted for source compatibility; only the bitrate matters here
+    CAN& setMode(const uint32_t mode) { (void)mode; return *this; }
+    CAN& setNominalBitrate(const uint32_t prescaler, const uint32_t seg1, const uint32_t seg2)
+    {
+        // 80 MHz kernel clock, as on the device
+        bitrate_ = 80000000u / (prescaler * (1 + seg1 + seg2));
+        return *this;
+    }
+    CAN& setDataBitrate(const uint32_t prescaler, const uint32_t seg1, const uint32_t seg2)
+    {
+        (void)prescaler;
+        (void)seg1;
+        (void)seg2;
+        return *this;
+    }
+    CAN& enableFD(bool enable_brs = true)
+    {
+        (void)enable_brs;
+        fd_ = true;
+        return *this;
+    }
+    CAN& disableFD()
+    {
+        fd_ = false;
+        return *this;
+    }
+    bool isFD() const { return fd_; }
+
+    bool setMessageRam(const CANMessageRam& layout);
+
+    // Message transmission
+    bool send(uint32_t id, const uint8_t* data, uint8_t length, bool extended = false);
+    bool sendRemote(uint32_t id, bool extended = false);
+    bool beginTxQueue(CANFrame* queue, uint16_t size, IRQn_Type irq);
+    uint16_t sendBatch(const CANFrame* frames, uint16_t count);
+    uint16_t txPending() const { return 0; }
+    // Never called: the simulated bus takes every frame at once
+    bool setTxCompleteHook(TxCompleteHook hook, void* context = nullptr)
+    {
+        (void)hook;
+        (void)context;
+        return true;
+    }
+    bool sendTimestamped(uint32_t id, const uint8_t* data, uint8_t length, uint8_t marker, bool extended = false);
+    bool readTxEvent(uint8_t& marker, uint16_t& timestamp);
+
+    // Message reception
+    bool available();
+    bool read(uint32_t& id, uint8_t* data, uint8_t& length, bool& extended);
+    bool read(CANFrame& frame);
+
+    /**
+     * @brief Receive into a queue of @p size - 1 frames (the storage itself is unused)
+     */
+    bool beginRxInterrupt(CANFrame* queue, uint16_t size, IRQn_Type irq);
+    bool onReceive(uint32_t id, uint32_t mask, CANCallback callback, bool extended = false);
+    uint16_t dispatch();
+
+    bool forwardTo(CAN& target, uint32_t id, uint32_t mask, bool extended = false);
+    uint32_t forwardedFrames() const { return forwarded_frames_; }
+
+    uint32_t rxQueueOverflows() const { return rx_queue_overflows_; }
+    uint32_t rxFifoOverflows() const { return rx_fifo_overflows_; }
+
+    // Nothing to forward on the host
+    void handleInterrupt() {}
+
+    // Filter configuration
+    void setFilter(uint32_t id, uint32_t mask, bool extended = false, uint8_t fifo = 0);
+    void setAcceptAll();
+    bool setFilters(const CANFilter* filters, uint8_t count, bool accept_non_matching = false);
+
+    // Status: the simulated bus has no errors
+    uint32_t getErrorCount() { return 0; }
+    bool isBusOff() { return false; }
+
+    CANStats getStats();
+    void resetStats();
+
+    template <typename Out>
+    void printStats(Out& out, uint8_t port)
+    {
+        const CANStats stats = getStats();
+        out.printf("@canstats port=%u t=%u bitrate=%u tx=%u tx_drop=%u rx=%u rx_drop=%u bits=%u "
+                   "fifo0_hw=%u fifo1_hw=%u rxq_hw=%u txq_hw=%u tec=%u rec=%u ep_ms=%u busoff=%u\r\n",
+                   port, HAL_GetTick(), getNominalBitrate(), stats.tx_frames, stats.tx_dropped,
+                   stats.rx_frames, stats.rx_dropped, stats.bus_bits,
+                   stats.rx_fifo_high_water[0], stats.rx_fifo_high_water[1],
+                   stats.rx_queue_high_water, stats.tx_queue_high_water,
+                   stats.tx_error_count, stats.rx_error_count,
+                   stats.error_passive_ms, stats.bus_off_count);
+    }
+
+    uint32_t getNominalBitrate() const { return bitrate_; }
+    uint16_t getTimestamp();
+    uint32_t timestampToMicros(uint32_t ticks) const;
+    uint64_t timestampToTimeUs(uint16_t timestamp);
+
+    FDCAN_GlobalTypeDef* getInstance() const { return instance_; }
+};
@@ -0,0 +1,154 @@
+#include "event_loop.h"
+#include "sys.h"
+
+#include <mutex>
+
+extern "C" void loop(void);
+
+// Longest idle pass without a loop interval, so simulated time does not
+// run off to the far future while only a serial thread could post
+static const uint32_t MAX_IDLE_MS = 10;
+
+struct EventSlot
+{
+    EventHandler handler;
+    void* context;
+    uint64_t posted_us;   // First post since the last dispatch
+    EventStats stats;
+};
+
+static std::mutex event_mutex;
+static EventSlot event_slots[EVENT_TYPE_COUNT];
+static uint32_t event_pending = 0;   // One bit per EventType
+static uint32_t loop_interval_ms = 1;
+static uint64_t last_loop_ms = 0;
+
+static const char* const event_names[EVENT_TYPE_COUNT] = {
+    "uart_rx", "can_rx", "timer", "exti", "usb_rx", "user"
+};
+
+static uint32_t MsUntilLoop(uint64_t now_ms)
+{
+    if (loop_interval_ms == 0) {
+        return MAX_IDLE_MS;
+    }
+    const uint64_t elapsed = now_ms - last_loop_ms;
+    return elapsed >= loop_interval_ms ? 0 : (uint32_t)(loop_interval_ms - elapsed);
+}
+
+extern "C" {
+
+void PostEvent(EventType type)
+{
+    if ((unsigned)type >= EVENT_TYPE_COUNT) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        const uint32_t bit = 1u << type;
+        EventSlot& slot = event_slots[type];
+        if ((event_pending & bit) == 0) {
+            slot.posted_us = GetCurrentTimeUs();
+            event_pending |= bit;
+        }
+        slot.stats.posts++;
+    }
+    HostNotify();   // A real-time Idle() returns, as on an interrupt
+}
+
+void OnEvent(EventType type, EventHandler handler, void* context)
+{
+    if ((unsigned)type >= EVENT_TYPE_COUNT) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(event_mutex);
+    event_slots[type].handler = handler;
+    event_slots[type].context = context;
+}
+
+void SetLoopInterval(uint32_t ms)
+{
+    loop_interval_ms = ms;
+}
+
+void ServiceEventLoop(void)
+{
+    // Timers that are due post their events first, as they would have
+    // interrupted the device by now
+    HostServiceEvents();
+
+    EventSlot taken[EVENT_TYPE_COUNT];
+    uint32_t pending;
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        pending = event_pending;
+        event_pending = 0;
+        for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+            taken[i] = event_slots[i];
+        }
+    }
+    if (pending == 0) {
+        // A post from now on notifies, so the wait returns at once
+        const uint32_t wait_ms = MsUntilLoop(GetCurrentTimeMs());
+        if (wait_ms > 0) {
+            Idle(wait_ms);
+            return;
+        }
+    }
+
+    const uint64_t now_us = GetCurrentTimeUs();
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        if ((pending & (1u << i)) == 0) {
+            continue;
+        }
+        const uint64_t latency = now_us - taken[i].posted_us;
+        {
+            std::lock_guard<std::mutex> lock(event_mutex);
+            EventStats& stats = event_slots[i].stats;
+            stats.dispatches++;
+            stats.total_latency_us += latency;
+            if (latency > stats.max_latency_us) {
+                stats.max_latency_us = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+            }
+        }
+        if (taken[i].handler != nullptr) {
+            taken[i].handler(taken[i].context);
+        }
+    }
+
+    last_loop_ms = GetCurrentTimeMs();
+    loop();
+}
+
+void RunEventLoop(void)
+{
+    last_loop_ms = GetCurrentTimeMs();
+    for (;;) {
+        ServiceEventLoop();
+    }
+}
+
+EventStats GetEventStats(EventType type)
+{
+    EventStats stats = {};
+    if ((unsigned)type < EVENT_TYPE_COUNT) {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        stats = event_slots[type].stats;
+    }
+    return stats;
+}
+
+void ResetEventStats(void)
+{
+    std::lock_guard<std::mutex> lock(event_mutex);
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        event_slots[i].stats = EventStats{};
+    }
+}
+
+const char* GetEventName(EventType type)
+{
+    return ((unsigned)type < EVENT_TYPE_COUNT) ? event_names[type] : "";
+}
+
+}  // extern "C"
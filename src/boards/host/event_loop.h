@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Event-driven superloop (host simulator)
+// Same interface as the device's event_loop.h: with LUMOS_EVENT_LOOP the
+// host main() runs ServiceEventLoop() instead of calling loop() back to
+// back, and serial data, CAN deliveries, host timers and simulated GPIO
+// edges post events. Idle passes wait in Idle(), so simulated time jumps
+// to the next timer or loop interval and a real-time run wakes on serial
+// data (HostNotify()). Serial reader threads post too, hence a mutex in
+// place of PRIMASK; latencies are in simulated microseconds.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    EVENT_UART_RX = 0,   // Serial received data (DMA idle line / half / full)
+    EVENT_CAN_RX,        // CAN frames queued by the FDCAN interrupt
+    EVENT_TIMER,         // Periodic timer update (Timer::initPeriodic())
+    EVENT_EXTI,          // Edge queued on an EXTI line (GPIO::attachInterrupt())
+    EVENT_USB_RX,        // USB CDC / vendor data received
+    EVENT_USER,          // Posted by the application
+    EVENT_TYPE_COUNT
+} EventType;
+
+typedef void (*EventHandler)(void* context);
+
+typedef struct {
+    uint32_t posts;              // PostEvent() calls, merged ones included
+    uint32_t dispatches;         // Passes that took it (one per batch of posts)
+    uint32_t max_latency_us;     // First post to dispatch, worst case
+    uint64_t total_latency_us;   // Sum over dispatches, for the mean
+} EventStats;
+
+// Mark @p type pending; callable from any context
+void PostEvent(EventType type);
+
+// Run @p handler (nullptr for none) in thread mode when @p type was posted
+void OnEvent(EventType type, EventHandler handler, void* context);
+
+// Run loop() at least every @p ms (default 1) besides after events;
+// 0 runs it only after events
+void SetLoopInterval(uint32_t ms);
+
+// One pass: dispatch pending events and run loop() if any were pending
+// or it is due, otherwise sleep until the next interrupt
+void ServiceEventLoop(void);
+
+// ServiceEventLoop() forever; what main() calls after setup()
+void RunEventLoop(void);
+
+// Copy of the counters for @p type
+EventStats GetEventStats(EventType type);
+void ResetEventStats(void);
+
+const char* GetEventName(EventType type);
+
+#ifdef __cplusplus
+}
+
+// One "@event" line per type that was posted
+template <typename Out>
+void PrintEventStats(Out& out)
+{
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        const EventType type = static_cast<EventType>(i);
+        const EventStats stats = GetEventStats(type);
+        if (stats.posts == 0) {
+            continue;
+        }
+        const uint32_t mean_us = stats.dispatches > 0 ? (uint32_t)(stats.total_latency_us / stats.dispatches) : 0;
+        out.printf("@event type=%s posts=%lu dispatches=%lu mean_us=%lu max_us=%lu\r\n", GetEventName(type),
+                   (unsigned long)stats.posts, (unsigned long)stats.dispatches, (unsigned long)mean_us,
+                   (unsigned long)stats.max_latency_us);
+    }
+}
+#endif
+
+// Post from a wrapper interrupt; nothing without the event loop
+#ifdef LUMOS_EVENT_LOOP
+#define LUMOS_POST_EVENT(type) PostEvent(type)
+#else
+#define LUMOS_POST_EVENT(type) do {} while (0)
+#endif
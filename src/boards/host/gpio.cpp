@@ -0,0 +1,225 @@
+#include "gpio.h"
+#include "sys.h"
+#include "event_loop.h"
+
+// GPIO Class Implementation (host simulator)
+
+GPIO::GPIO(GPIO_TypeDef* port, uint16_t pin)
+    : port_(port),
+      pin_(pin),
+      initialized_(false)
+{
+}
+
+GPIO::~GPIO()
+{
+    detachInterrupt();
+}
+
+void GPIO::mode(uint32_t mode, uint32_t pull, uint32_t speed)
+{
+    initGPIOPins(port_, pin_, mode, pull, speed);
+    initialized_ = true;
+}
+
+void GPIO::write(bool value)
+{
+    digitalWrite(port_, pin_, value);
+}
+
+// ===== Edge events =====
+
+struct ExtiLine
+{
+    GPIO* gpio;
+    GPIO::Handler handler;
+    void* context;
+    GPIO::Edge edge;
+    uint32_t debounce_us;
+    uint32_t settle_at;    // Debounce deadline, while the line is pending
+    uint32_t edge_at;      // Time of the edge that started the deadline
+    bool level;            // Last reported level (debounced lines)
+};
+
+struct ExtiRecord
+{
+    uint32_t time_us;
+    uint8_t line;
+    bool level;
+};
+
+// Same queue depth as on the device, so tests see the same drops
+static const uint32_t EXTI_QUEUE_SIZE = 32;   // Power of two
+
+static ExtiLine exti_lines[16];
+static uint16_t exti_settling = 0;         // Debounced lines waiting out their time
+static ExtiRecord exti_queue[EXTI_QUEUE_SIZE];
+static uint32_t exti_head = 0;
+static uint32_t exti_tail = 0;
+static uint32_t exti_dropped = 0;
+
+static uint8_t pinToLine(uint16_t pin)
+{
+    return (uint8_t)__builtin_ctz(pin);
+}
+
+bool GPIO::attachInterrupt(Edge edge, Handler handler, void* context, uint32_t debounce_us, uint32_t pull)
+{
+    if (handler == nullptr || pin_ == 0 || (pin_ & (pin_ - 1)) != 0) {
+        return false;
+    }
+
+    ExtiLine& slot = exti_lines[pinToLine(pin_)];
+    if (slot.gpio != nullptr && slot.gpio != this) {
+        return false;
+    }
+
+    slot.gpio = this;
+    slot.handler = handler;
+    slot.context = context;
+    slot.edge = edge;
+    slot.debounce_us = debounce_us;
+    exti_settling &= ~pin_;
+
+    mode(GPIO_MODE_INPUT, pull);
+    slot.level = read();
+    return true;
+}
+
+void GPIO::detachInterrupt()
+{
+    if (pin_ == 0 || (pin_ & (pin_ - 1)) != 0) {
+        return;
+    }
+
+    ExtiLine& slot = exti_lines[pinToLine(pin_)];
+    if (slot.gpio != this) {
+        return;
+    }
+    slot.gpio = nullptr;
+    slot.handler = nullptr;
+    exti_settling &= ~pin_;
+}
+
+void GPIO::dispatchInterrupts()
+{
+    while (exti_tail != exti_head) {
+        const ExtiRecord record = exti_queue[exti_tail & (EXTI_QUEUE_SIZE - 1)];
+        exti_tail++;
+
+        ExtiLine& slot = exti_lines[record.line];
+        if (slot.handler == nullptr) {
+            continue;   // Detached since the edge
+        }
+
+        if (slot.debounce_us == 0) {
+            if ((slot.edge == Edge::RISING && !record.level) || (slot.edge == Edge::FALLING && record.level)) {
+                continue;
+            }
+            const Event event = {(uint16_t)(1u << record.line), record.level, record.time_us};
+            slot.handler(slot.context, event);
+        } else {
+            // Every edge, bounces included, restarts the settle time
+            slot.settle_at = record.time_us + slot.debounce_us;
+            slot.edge_at = record.time_us;
+            exti_settling |= (uint16_t)(1u << record.line);
+        }
+    }
+
+    if (exti_settling == 0) {
+        return;
+    }
+
+    const uint32_t now = (uint32_t)GetCurrentTimeUs();
+    for (uint8_t line = 0; line < 16; line++) {
+        const uint16_t pin = (uint16_t)(1u << line);
+        ExtiLine& slot = exti_lines[line];
+        if ((exti_settling & pin) == 0 || (int32_t)(now - slot.settle_at) < 0) {
+            continue;
+        }
+        exti_settling &= ~pin;
+
+        const bool level = slot.gpio->read();
+        if (level == slot.level) {
+            continue;   // Bounced back to where it was
+        }
+        slot.level = level;
+
+        if ((slot.edge == Edge::RISING && !level) || (slot.edge == Edge::FALLING && level)) {
+            continue;
+        }
+        const Event event = {pin, level, slot.edge_at};
+        slot.handler(slot.context, event);
+    }
+}
+
+uint32_t GPIO::getDroppedInterrupts()
+{
+    return exti_dropped;
+}
+
+void GPIO::setInput(GPIO_TypeDef* port, uint16_t pin, bool level)
+{
+    const bool previous = (port->IDR & pin) != 0;
+    if (level) {
+        port->IDR |= pin;
+    } else {
+        port->IDR &= ~(uint32_t)pin;
+    }
+    if (previous == level || pin == 0 || (pin & (pin - 1)) != 0) {
+        return;
+    }
+
+    // The EXTI line only sees the port the attached GPIO is on
+    const uint8_t line = pinToLine(pin);
+    if (exti_lines[line].gpio == nullptr || exti_lines[line].gpio->getPort() != port) {
+        return;
+    }
+    if (exti_head - exti_tail >= EXTI_QUEUE_SIZE) {
+        exti_dropped++;
+        return;
+    }
+    ExtiRecord& record = exti_queue[exti_head & (EXTI_QUEUE_SIZE - 1)];
+    record.time_us = (uint32_t)GetCurrentTimeUs();
+    record.line = line;
+    record.level = level;
+    exti_head++;
+    LUMOS_POST_EVENT(EVENT_EXTI);
+}
+
+// ===== Helper functions =====
+
+void initGPIOPins(GPIO_TypeDef* port, uint16_t pins, uint32_t mode, uint32_t pull, uint32_t speed)
+{
+    (void)speed;
+    const bool output = mode == GPIO_MODE_OUTPUT_PP || mode == GPIO_MODE_OUTPUT_OD;
+    if (output) {
+        port->MODER |= pins;
+        // Outputs read back their driven level
+        port->IDR = (port->IDR & ~(uint32_t)pins) | (port->ODR & pins);
+    } else {
+        port->MODER &= ~(uint32_t)pins;
+        // An undriven input settles at its pull level
+        if (pull == GPIO_PULLUP) {
+            port->IDR |= pins;
+        } else if (pull == GPIO_PULLDOWN) {
+            port->IDR &= ~(uint32_t)pins;
+        }
+    }
+}
+
+void pinMode(GPIO_TypeDef* port, uint16_t pin, uint32_t mode, uint32_t pull)
+{
+    initGPIOPins(port, pin, mode, pull, GPIO_SPEED_FREQ_LOW);
+}
+
+void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value)
+{
+    if (value) {
+        port->ODR |= pin;
+    } else {
+        port->ODR &= ~(uint32_t)pin;
+    }
+    const uint32_t outputs = port->MODER & pin;
+    port->IDR = (port->IDR & ~outputs) | (port->ODR & outputs);
+}
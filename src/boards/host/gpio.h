@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+#include "host_hal.h"
+
+// GPIO Class - host simulator version of the wrapper's GPIO
+// Usage Example:
+//   GPIO led(GPIOA, GPIO_PIN_5);
+//   led.mode(GPIO_MODE_OUTPUT_PP);
+//   led.toggle();
+//
+//   GPIO button(GPIOB, GPIO_PIN_0);
+//   button.attachInterrupt(GPIO::Edge::FALLING, onButton, nullptr, 5000, GPIO_PULLUP);
+//   GPIO::setInput(GPIOB, GPIO_PIN_0, false);   // Test code: press the button
+//   GPIO::dispatchInterrupts();                 // onButton() runs
+//
+// Pins live in the port structs of host_hal.h: outputs read back what
+// they drive, inputs keep their pull level until test code drives them
+// with setInput(). Edges on attached pins are queued with the simulated
+// time and debounced as on the device. FastPin, FastPort and FastBus
+// address the port registers directly and are not available on the host.
+class GPIO
+{
+private:
+    GPIO_TypeDef* port_;
+    uint16_t pin_;
+    bool initialized_;
+
+public:
+    enum class Edge {
+        RISING,
+        FALLING,
+        BOTH
+    };
+
+    struct Event
+    {
+        uint16_t pin;       // GPIO_PIN_x
+        bool level;         // Pin level after the edge
+        uint32_t time_us;   // Low 32 bits of GetCurrentTimeUs() at the edge
+    };
+
+    using Handler = void (*)(void* context, const Event& event);
+
+    GPIO() = delete;
+    GPIO(GPIO_TypeDef* port, uint16_t pin);
+    ~GPIO();
+
+    // Configuration
+    void mode(uint32_t mode, uint32_t pull = GPIO_NOPULL, uint32_t speed = GPIO_SPEED_FREQ_LOW);
+    void setAlternateFunction(uint32_t alternate) { (void)alternate; }
+
+    // Digital I/O
+    void write(bool value);
+    bool read() const { return (port_->IDR & pin_) != 0; }
+    void toggle() { write((port_->ODR & pin_) == 0); }
+    void high() { write(true); }
+    void low() { write(false); }
+
+    bool attachInterrupt(Edge edge, Handler handler, void* context = nullptr,
+                         uint32_t debounce_us = 0, uint32_t pull = GPIO_NOPULL);
+    void detachInterrupt();
+
+    static void dispatchInterrupts();
+    static uint32_t getDroppedInterrupts();
+
+    /**
+     * @brief Drive an input from test code, as the outside world would
+     *
+     * Queues an edge for an attached pin, like the EXTI interrupt.
+     */
+    static void setInput(GPIO_TypeDef* port, uint16_t pin, bool level);
+
+    // Utilities
+    GPIO_TypeDef* getPort() const { return port_; }
+    uint16_t getPin() const { return pin_; }
+};
+
+void initGPIOPins(GPIO_TypeDef* port, uint16_t pins, uint32_t mode, uint32_t pull, uint32_t speed);
+
+void pinMode(GPIO_TypeDef* port, uint16_t pin, uint32_t mode, uint32_t pull = GPIO_NOPULL);
+
+void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value);
+
+inline bool digitalRead(GPIO_TypeDef* port, uint16_t pin)
+{
+    return (port->IDR & pin) != 0;
+}
+
+inline void togglePin(GPIO_TypeDef* port, uint16_t pin)
+{
+    digitalWrite(port, pin, (port->ODR & pin) == 0);
+}
@@ -0,0 +1,58 @@
+#include "host.h"
+
+// ===========================
+// Peripheral instances (host_hal.h)
+// ===========================
+
+GPIO_TypeDef HostGPIOA = {"GPIOA", 0, 0, 0};
+GPIO_TypeDef HostGPIOB = {"GPIOB", 0, 0, 0};
+GPIO_TypeDef HostGPIOC = {"GPIOC", 0, 0, 0};
+GPIO_TypeDef HostGPIOD = {"GPIOD", 0, 0, 0};
+GPIO_TypeDef HostGPIOE = {"GPIOE", 0, 0, 0};
+GPIO_TypeDef HostGPIOF = {"GPIOF", 0, 0, 0};
+GPIO_TypeDef HostGPIOG = {"GPIOG", 0, 0, 0};
+GPIO_TypeDef HostGPIOH = {"GPIOH", 0, 0, 0};
+
+USART_TypeDef HostUSART1 = {"USART1"};
+USART_TypeDef HostUSART2 = {"USART2"};
+USART_TypeDef HostUSART3 = {"USART3"};
+USART_TypeDef HostUART4 = {"UART4"};
+USART_TypeDef HostUART5 = {"UART5"};
+USART_TypeDef HostUSART6 = {"USART6"};
+
+TIM_TypeDef HostTIM1 = {"TIM1"};
+TIM_TypeDef HostTIM2 = {"TIM2"};
+TIM_TypeDef HostTIM3 = {"TIM3"};
+TIM_TypeDef HostTIM4 = {"TIM4"};
+TIM_TypeDef HostTIM5 = {"TIM5"};
+TIM_TypeDef HostTIM6 = {"TIM6"};
+TIM_TypeDef HostTIM7 = {"TIM7"};
+TIM_TypeDef HostTIM14 = {"TIM14"};
+TIM_TypeDef HostTIM15 = {"TIM15"};
+TIM_TypeDef HostTIM16 = {"TIM16"};
+TIM_TypeDef HostTIM17 = {"TIM17"};
+
+FDCAN_GlobalTypeDef HostFDCAN1 = {"FDCAN1"};
+FDCAN_GlobalTypeDef HostFDCAN2 = {"FDCAN2"};
+FDCAN_GlobalTypeDef HostFDCAN3 = {"FDCAN3"};
+
+// ===========================
+// UART Instances
+// ===========================
+
+// Pins and alternate functions only matter on the device
+Serial SerialCom{USART6, GPIOC, GPIO_PIN_6, GPIOC, GPIO_PIN_7, 0};
+Serial SerialAux{USART1, GPIOA, GPIO_PIN_9, GPIOA, GPIO_PIN_10, 0};
+
+bool beginSerialDma(Serial& serial, uint32_t baudrate)
+{
+    serial.begin(baudrate);
+    return true;
+}
+
+// ===========================
+// CAN Instances
+// ===========================
+
+CAN CAN1{FDCAN1, GPIOB, GPIO_PIN_9, GPIOB, GPIO_PIN_8, 0};
+CAN CAN2{FDCAN2, GPIOB, GPIO_PIN_13, GPIOB, GPIO_PIN_12, 0};
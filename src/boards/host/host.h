@@ -0,0 +1,49 @@
+#pragma once
+
+#include "host_hal.h"
+#include <uart.h>
+#include <can.h>
+#include <gpio.h>
+#include <timer.h>
+#include <sys.h>
+
+/*
+================================
+ Host Simulator Board
+================================
+Builds setup()/loop() and ApplicationBase apps as a native program
+(project.yaml: board: Host) to run them without hardware, faster than
+real time, e.g. in CI or to benchmark algorithms:
+
+  lumos build && ./build/firmware --duration 60
+
+Serial ports:
+  SerialCom  (USART6) - console (stdout/stdin), or LUMOS_HOST_USART6=<port>
+  SerialAux  (USART1) - console (output only), or LUMOS_HOST_USART1=<port>
+
+CAN ports on one simulated bus (any other CAN the program begins joins it):
+  CAN1 (FDCAN1), CAN2 (FDCAN2)
+
+GPIO ports GPIOA-GPIOH, timers TIM1-TIM7 and TIM14-TIM17 as on the
+STM32 boards. Test code drives inputs with GPIO::setInput() and serial
+input with Serial::inject().
+
+Program options (host main()):
+  --duration <s>   Stop after this much simulated time
+  --realtime       Sleep through waits instead of skipping them
+*/
+
+// ===========================
+// UART Instances
+// ===========================
+extern Serial SerialCom;    // USART6
+extern Serial SerialAux;    // USART1
+
+// Same call as on the LumosBrain; the ports never block on the host
+bool beginSerialDma(Serial& serial, uint32_t baudrate = 115200);
+
+// ===========================
+// CAN Instances
+// ===========================
+extern CAN CAN1;            // FDCAN1
+extern CAN CAN2;            // FDCAN2
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+
+// Stand-ins for the parts of the STM32 HAL that application code and the
+// wrapper interfaces name: peripheral instances, pin and mode constants,
+// IRQ numbers and a few core functions. Instances are plain structs that
+// carry their name (the host wrappers use it, e.g. SerialCom on USART6
+// reads LUMOS_HOST_USART6); registers are only modelled where a host
+// wrapper needs them (GPIO levels).
+//
+// Nothing runs asynchronously to loop() on the host: timer callbacks and
+// CAN deliveries happen at wait points (DelayMs(), Idle(), between loop()
+// calls), so masking interrupts has nothing to mask.
+
+typedef enum
+{
+    HAL_OK = 0x00,
+    HAL_ERROR = 0x01,
+    HAL_BUSY = 0x02,
+    HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef struct
+{
+    const char* name;
+    uint32_t MODER;   // One bit per pin: set for outputs
+    uint32_t IDR;     // Input levels (outputs read back what they drive)
+    uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+    const char* name;
+} USART_TypeDef;
+
+typedef struct
+{
+    const char* name;
+} TIM_TypeDef;
+
+typedef struct
+{
+    const char* name;
+} FDCAN_GlobalTypeDef;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern GPIO_TypeDef HostGPIOA, HostGPIOB, HostGPIOC, HostGPIOD, HostGPIOE, HostGPIOF, HostGPIOG, HostGPIOH;
+#define GPIOA (&HostGPIOA)
+#define GPIOB (&HostGPIOB)
+#define GPIOC (&HostGPIOC)
+#define GPIOD (&HostGPIOD)
+#define GPIOE (&HostGPIOE)
+#define GPIOF (&HostGPIOF)
+#define GPIOG (&HostGPIOG)
+#define GPIOH (&HostGPIOH)
+
+extern USART_TypeDef HostUSART1, HostUSART2, HostUSART3, HostUART4, HostUART5, HostUSART6;
+#define USART1 (&HostUSART1)
+#define USART2 (&HostUSART2)
+#define USART3 (&HostUSART3)
+#define UART4 (&HostUART4)
+#define UART5 (&HostUART5)
+#define USART5 (&HostUART5)
+#define USART6 (&HostUSART6)
+
+extern TIM_TypeDef HostTIM1, HostTIM2, HostTIM3, HostTIM4, HostTIM5, HostTIM6, HostTIM7,
+                   HostTIM14, HostTIM15, HostTIM16, HostTIM17;
+#define TIM1 (&HostTIM1)
+#define TIM2 (&HostTIM2)
+#define TIM3 (&HostTIM3)
+#define TIM4 (&HostTIM4)
+#define TIM5 (&HostTIM5)
+#define TIM6 (&HostTIM6)
+#define TIM7 (&HostTIM7)
+#define TIM14 (&HostTIM14)
+#define TIM15 (&HostTIM15)
+#define TIM16 (&HostTIM16)
+#define TIM17 (&HostTIM17)
+
+extern FDCAN_GlobalTypeDef HostFDCAN1, HostFDCAN2, HostFDCAN3;
+#define FDCAN1 (&HostFDCAN1)
+#define FDCAN2 (&HostFDCAN2)
+#define FDCAN3 (&HostFDCAN3)
+
+#ifdef __cplusplus
+}
+#endif
+
+// Interrupt numbers are accepted and ignored by the host wrappers
+typedef enum
+{
+    USART1_IRQn, USART2_IRQn, USART3_IRQn, UART4_IRQn, UART5_IRQn, USART6_IRQn,
+    TIM1_UP_IRQn, TIM2_IRQn, TIM3_IRQn, TIM4_IRQn, TIM5_IRQn, TIM6_DAC_IRQn, TIM7_IRQn,
+    TIM14_IRQn, TIM15_IRQn, TIM16_IRQn, TIM17_IRQn,
+    FDCAN1_IT0_IRQn, FDCAN2_IT0_IRQn, FDCAN3_IT0_IRQn,
+    EXTI0_IRQn
+} IRQn_Type;
+
+#define GPIO_PIN_0   ((uint16_t)0x0001)
+#define GPIO_PIN_1   ((uint16_t)0x0002)
+#define GPIO_PIN_2   ((uint16_t)0x0004)
+#define GPIO_PIN_3   ((uint16_t)0x0008)
+#define GPIO_PIN_4   ((uint16_t)0x0010)
+#define GPIO_PIN_5   ((uint16_t)0x0020)
+#define GPIO_PIN_6   ((uint16_t)0x0040)
+#define GPIO_PIN_7   ((uint16_t)0x0080)
+#define GPIO_PIN_8   ((uint16_t)0x0100)
+#define GPIO_PIN_9   ((uint16_t)0x0200)
+#define GPIO_PIN_10  ((uint16_t)0x0400)
+#define GPIO_PIN_11  ((uint16_t)0x0800)
+#define GPIO_PIN_12  ((uint16_t)0x1000)
+#define GPIO_PIN_13  ((uint16_t)0x2000)
+#define GPIO_PIN_14  ((uint16_t)0x4000)
+#define GPIO_PIN_15  ((uint16_t)0x8000)
+#define GPIO_PIN_All ((uint16_t)0xFFFF)
+
+#define GPIO_MODE_INPUT        0x00000000u
+#define GPIO_MODE_OUTPUT_PP    0x00000001u
+#define GPIO_MODE_OUTPUT_OD    0x00000011u
+#define GPIO_MODE_AF_PP        0x00000002u
+#define GPIO_MODE_AF_OD        0x00000012u
+#define GPIO_MODE_ANALOG       0x00000003u
+#define GPIO_MODE_IT_RISING    0x10110000u
+#define GPIO_MODE_IT_FALLING   0x10210000u
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000u
+
+#define GPIO_NOPULL            0x00000000u
+#define GPIO_PULLUP            0x00000001u
+#define GPIO_PULLDOWN          0x00000002u
+
+#define GPIO_SPEED_FREQ_LOW       0x00000000u
+#define GPIO_SPEED_FREQ_MEDIUM    0x00000001u
+#define GPIO_SPEED_FREQ_HIGH      0x00000002u
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003u
+
+// Nothing interrupts application code on the host (see above)
+#define __NOP() do {} while (0)
+#define __disable_irq() do {} while (0)
+#define __enable_irq() do {} while (0)
+#define __get_PRIMASK() 0u
+#define __set_PRIMASK(value) ((void)(value))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated milliseconds (sys.h), as SysTick counts them on the device
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
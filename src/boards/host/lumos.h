@@ -0,0 +1,40 @@
+/**
+ * @file lumos.h
+ * @brief Lumos framework header - provides setup/loop interface
+ *
+ * Include this header in your user code to use the setup/loop pattern.
+ * This header automatically handles C/C++ linkage, so you don't need
+ * to use extern "C" in your code.
+ */
+
+#ifndef LUMOS_H
+#define LUMOS_H
+
+// Stand-ins for the STM32 HAL (native simulator build)
+#include "host_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Setup function - called once at startup
+ *
+ * This function is called once by the host main() before the first loop()
+ * Use this to initialize your peripherals, variables, and application state.
+ */
+void setup(void);
+
+/**
+ * @brief Loop function - called repeatedly
+ *
+ * This function is called continuously in an infinite loop after setup().
+ * Put your main application logic here.
+ */
+void loop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LUMOS_H
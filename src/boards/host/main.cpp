@@ -0,0 +1,106 @@
+// Host simulator entry point: runs setup()/loop() as a native program
+//
+//   build/firmware                  # Until Ctrl+C
+//   build/firmware --duration 60    # 60 s of simulated time, then exit
+//   build/firmware --realtime       # Waits sleep instead of being skipped
+//
+// With event_loop: true, passes of ServiceEventLoop() take the place of
+// loop() calls and are what the summary counts.
+
+#include "lumos.h"
+#include "sys.h"
+#include "event_loop.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static std::atomic<bool> stop_requested{false};
+static uint64_t loops = 0;
+
+#ifdef LUMOS_EVENT_LOOP
+static const char* const LOOPS_NAME = "event loop passes";
+#else
+static const char* const LOOPS_NAME = "loop() calls";
+#endif
+
+static void onSignal(int signal_number)
+{
+    // A second Ctrl+C ends a program that never returns from setup()
+    signal(signal_number, SIG_DFL);
+    stop_requested = true;
+    HostNotify();
+}
+
+// Summary and exit, also from the --duration timer inside a wait
+[[noreturn]] static void finish()
+{
+    fflush(stdout);
+    const double simulated_s = GetCurrentTimeUs() / 1e6;
+    const double wall_s = HostGetWallTimeUs() / 1e6;
+    fprintf(stderr, "[host] %.3f s simulated in %.3f s (%.1fx), %llu %s\n",
+            simulated_s, wall_s, wall_s > 0 ? simulated_s / wall_s : 0.0,
+            (unsigned long long)loops, LOOPS_NAME);
+
+    // Firmware never returns from main(), so apps and board peripherals
+    // are never destroyed; skip the global destructors here as well
+    fflush(stderr);
+    std::_Exit(0);
+}
+
+static void onDuration(void* context)
+{
+    (void)context;
+    finish();
+}
+
+static void printUsage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [--duration <seconds>] [--realtime]\n"
+            "  --duration <s>  Stop after this much simulated time\n"
+            "  --realtime      Sleep through waits instead of skipping them\n",
+            program);
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t duration_us = 0;   // 0 = until interrupted
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--realtime") == 0) {
+            HostSetRealTime(true);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_us = (uint64_t)(atof(argv[++i]) * 1e6);
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // Fires in the first wait past the end, so it also stops programs that
+    // stay in setup() (Scheduler::Run())
+    if (duration_us > 0) {
+        HostStartPeriodic(duration_us, onDuration, nullptr);
+    }
+
+    setup();
+
+#ifdef LUMOS_EVENT_LOOP
+    while (!stop_requested) {
+        ServiceEventLoop();   // Idle passes wait, so this does not spin
+        loops++;
+    }
+#else
+    while (!stop_requested) {
+        loop();
+        HostServiceEvents();
+        loops++;
+    }
+#endif
+    finish();
+}
@@ -0,0 +1,241 @@
+#include "sys.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using HostClock = std::chrono::steady_clock;
+
+// Simulated time = host time since startup + the waits that were skipped
+static std::atomic<uint64_t> skipped_us{0};
+static std::atomic<bool> real_time{false};
+
+// Periodic host timers, see HostStartPeriodic()
+struct PeriodicSlot
+{
+    bool active;
+    uint64_t period_us;
+    uint64_t next_us;
+    HostEventHandler handler;
+    void* context;
+};
+static constexpr int MAX_PERIODIC = 16;
+static PeriodicSlot periodic_slots[MAX_PERIODIC];
+static bool servicing = false;
+
+// Sleep accounting, see GetPowerStateTimes()
+static PowerStateTimes power_times = {0, 0, 0, 0};
+static PowerStateHook power_hook = nullptr;
+static void* power_hook_context = nullptr;
+
+// Wakes real-time waits early (HostNotify())
+static std::mutex notify_mutex;
+static std::condition_variable notify_cv;
+static bool notified = false;
+
+static HostClock::time_point StartTime()
+{
+    // Function-local, so it is set before other constructors ask for the time
+    static const HostClock::time_point start = HostClock::now();
+    return start;
+}
+
+// Earliest due timer (ignored while a timer callback runs)
+static bool NextDue(uint64_t& due_us)
+{
+    bool found = false;
+    for (const PeriodicSlot& slot : periodic_slots) {
+        if (slot.active && (!found || slot.next_us < due_us)) {
+            due_us = slot.next_us;
+            found = true;
+        }
+    }
+    return found && !servicing;
+}
+
+// Pass simulated time up to @p deadline_us, firing timers on the way;
+// returns early after a HostNotify() if @p wake_on_notify
+static void WaitUntil(uint64_t deadline_us, bool wake_on_notify)
+{
+    for (;;) {
+        HostServiceEvents();
+        const uint64_t now = GetCurrentTimeUs();
+        if (now >= deadline_us) {
+            return;
+        }
+
+        uint64_t target = deadline_us;
+        uint64_t due;
+        if (NextDue(due) && due < target) {
+            target = due;
+        }
+
+        if (power_hook != nullptr) {
+            power_hook(PowerState::Sleep, power_hook_context);
+        }
+        power_times.sleeps++;
+        if (!real_time) {
+            skipped_us += target - now;
+            power_times.sleep_us += target - now;
+            if (power_hook != nullptr) {
+                power_hook(PowerState::Run, power_hook_context);
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(notify_mutex);
+        const bool woken = notify_cv.wait_for(lock, std::chrono::microseconds(target - now),
+                                              [] { return notified; });
+        notified = false;
+        power_times.sleep_us += GetCurrentTimeUs() - now;
+        if (power_hook != nullptr) {
+            power_hook(PowerState::Run, power_hook_context);
+        }
+        if (woken && wake_on_notify) {
+            lock.unlock();
+            HostServiceEvents();
+            return;
+        }
+    }
+}
+
+void DelayMs(uint32_t ms)
+{
+    WaitUntil(GetCurrentTimeUs() + (uint64_t)ms * 1000, false);
+}
+
+void DelayUs(uint32_t us)
+{
+    WaitUntil(GetCurrentTimeUs() + us, false);
+}
+
+void Idle(uint32_t max_ms)
+{
+    if (max_ms == 0) {
+        HostServiceEvents();
+        return;
+    }
+
+    // Like WFI, return after the first timer that fires
+    uint64_t deadline = GetCurrentTimeUs() + (uint64_t)max_ms * 1000;
+    uint64_t due;
+    if (NextDue(due) && due < deadline) {
+        deadline = due;
+    }
+    WaitUntil(deadline, true);
+}
+
+void SetStopModeHandler(StopModeHandler handler, uint32_t min_ms)
+{
+    (void)handler;
+    (void)min_ms;
+}
+
+PowerStateTimes GetPowerStateTimes()
+{
+    return power_times;
+}
+
+void SetPowerStateHook(PowerStateHook hook, void* context)
+{
+    power_hook = hook;
+    power_hook_context = context;
+}
+
+uint64_t GetCurrentTimeMs()
+{
+    return GetCurrentTimeUs() / 1000;
+}
+
+uint64_t GetCurrentTimeUs()
+{
+    return HostGetWallTimeUs() + skipped_us;
+}
+
+void InitMicrosecondTiming()
+{
+}
+
+extern "C" uint32_t HAL_GetTick(void)
+{
+    return (uint32_t)GetCurrentTimeMs();
+}
+
+extern "C" void HAL_Delay(uint32_t ms)
+{
+    DelayMs(ms);
+}
+
+// ===== Host simulation controls =====
+
+void HostSetRealTime(bool enable)
+{
+    real_time = enable;
+}
+
+bool HostIsRealTime()
+{
+    return real_time;
+}
+
+uint64_t HostGetWallTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(HostClock::now() - StartTime()).count();
+}
+
+void HostNotify()
+{
+    {
+        std::lock_guard<std::mutex> lock(notify_mutex);
+        notified = true;
+    }
+    notify_cv.notify_all();
+}
+
+int HostStartPeriodic(uint64_t period_us, HostEventHandler handler, void* context)
+{
+    if (period_us == 0 || handler == nullptr) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_PERIODIC; i++) {
+        PeriodicSlot& slot = periodic_slots[i];
+        if (!slot.active) {
+            slot.period_us = period_us;
+            slot.next_us = GetCurrentTimeUs() + period_us;
+            slot.handler = handler;
+            slot.context = context;
+            slot.active = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void HostStopPeriodic(int slot)
+{
+    if (slot >= 0 && slot < MAX_PERIODIC) {
+        periodic_slots[slot].active = false;
+    }
+}
+
+void HostServiceEvents()
+{
+    if (servicing) {
+        return;
+    }
+    servicing = true;
+    const uint64_t now = GetCurrentTimeUs();
+    for (PeriodicSlot& slot : periodic_slots) {
+        if (!slot.active || slot.next_us > now) {
+            continue;
+        }
+        // Updates missed while code ran coalesce into one, as the timer's
+        // single pending flag would on the device
+        while (slot.next_us <= now) {
+            slot.next_us += slot.period_us;
+        }
+        slot.handler(slot.context);
+    }
+    servicing = false;
+}
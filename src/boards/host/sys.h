@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+
+#include "host_hal.h"
+
+// System Utility Functions (host simulator)
+// Same interface as the device's sys.h, on a simulated clock:
+//   DelayMs(1000);                        // Returns at once, the clock moves 1 s
+//   uint64_t t0 = GetCurrentTimeUs();     // Simulated microseconds
+//
+// The simulated clock runs with the host's steady clock while code
+// executes, so computation takes as long as it does on the host, and
+// jumps over waits (DelayMs(), DelayUs(), Idle(), HAL_Delay()). A
+// program that mostly waits therefore runs much faster than real time;
+// with real time (HostSetRealTime(), `--realtime`) waits sleep instead.
+//
+// Host timers (Timer::initPeriodic()) are due at simulated times and fire
+// inside the waits, at their due time, like interrupts taken while the
+// device sleeps; the host main() also fires due timers between loop()
+// calls. They never fire in the middle of other code, so there are no
+// data races with them.
+
+/**
+ * @brief Delay for specified milliseconds of simulated time
+ *
+ * Fires host timers that fall due during the wait.
+ */
+void DelayMs(uint32_t ms);
+
+/**
+ * @brief Delay for specified microseconds of simulated time
+ */
+void DelayUs(uint32_t us);
+
+/**
+ * @brief Wait until the next host timer is due, at most @p max_ms
+ * @param max_ms 0 only fires timers that are already due
+ */
+void Idle(uint32_t max_ms = 0);
+
+// Accepted for source compatibility; there is no Stop mode on the host
+using StopModeHandler = uint32_t (*)(uint32_t max_ms);
+void SetStopModeHandler(StopModeHandler handler, uint32_t min_ms = 10);
+
+// Power states as on the device (power_tracker.h); the waits count as
+// Sleep, and there is no Stop
+enum class PowerState : uint8_t
+{
+    Run,
+    Sleep,
+    Stop
+};
+
+struct PowerStateTimes
+{
+    uint64_t sleep_us;   // Simulated time passed in the waits
+    uint64_t stop_us;    // Always 0
+    uint32_t sleeps;
+    uint32_t stops;
+};
+
+PowerStateTimes GetPowerStateTimes();
+
+using PowerStateHook = void (*)(PowerState state, void* context);
+void SetPowerStateHook(PowerStateHook hook, void* context = nullptr);
+
+/**
+ * @brief Simulated time in milliseconds since startup
+ */
+uint64_t GetCurrentTimeMs();
+
+/**
+ * @brief Simulated time in microseconds since startup, monotonic
+ */
+uint64_t GetCurrentTimeUs();
+
+// Nothing to set up on the host
+void InitMicrosecondTiming();
+
+// ===========================
+// Host simulation controls
+// ===========================
+
+/**
+ * @brief Sleep through waits (true) instead of skipping them (default)
+ */
+void HostSetRealTime(bool real_time);
+bool HostIsRealTime();
+
+/**
+ * @brief Host steady-clock microseconds since startup, for speed-up figures
+ */
+uint64_t HostGetWallTimeUs();
+
+/**
+ * @brief Wake a real-time Idle() early, e.g. when serial data arrived
+ *
+ * Safe to call from any thread.
+ */
+void HostNotify();
+
+// Interrupt source of a host wrapper (Timer): fire() runs at each due time
+using HostEventHandler = void (*)(void* context);
+
+/**
+ * @brief Call @p handler every @p period_us of simulated time
+ * @return Slot for HostStopPeriodic(), -1 if all slots are in use
+ */
+int HostStartPeriodic(uint64_t period_us, HostEventHandler handler, void* context);
+void HostStopPeriodic(int slot);
+
+/**
+ * @brief Fire the host timers that are due now
+ *
+ * Called by the waits and by the host main() between loop() calls.
+ * Timer callbacks that wait themselves do not fire timers again.
+ */
+void HostServiceEvents();
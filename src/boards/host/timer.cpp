@@ -0,0 +1,207 @@
+#include "timer.h"
+#include "sys.h"
+#include "event_loop.h"
+
+#include <cstring>
+
+// Timer Class Implementation (host simulator)
+
+Timer::Timer(TIM_TypeDef* timer)
+    : timer_(timer),
+      initialized_(false),
+      periodic_(false),
+      frequency_hz_(0),
+      period_ticks_(0),
+      period_ms_(0),
+      handler_(nullptr),
+      handler_context_(nullptr),
+      slot_(-1),
+      counter_base_us_(0),
+      compare_{},
+      channel_enabled_{}
+{
+}
+
+Timer::~Timer()
+{
+    stop();
+}
+
+// 32-bit counters on TIM2 and TIM5, as on the STM32 parts
+uint32_t Timer::getMaxPeriod() const
+{
+    if (timer_ == TIM2 || timer_ == TIM5) {
+        return 0xFFFFFFFFu;
+    }
+    return 0xFFFFu;
+}
+
+bool Timer::initPWM(uint32_t frequency_hz, float duty_cycle)
+{
+    if (frequency_hz == 0 || frequency_hz > HOST_TIMER_CLOCK_HZ) {
+        return false;
+    }
+    stop();
+    frequency_hz_ = frequency_hz;
+    period_ticks_ = HOST_TIMER_CLOCK_HZ / frequency_hz;
+    periodic_ = false;
+    initialized_ = true;
+    for (uint32_t channel = 1; channel <= 4; channel++) {
+        setDutyCycle(channel, duty_cycle);
+    }
+    return true;
+}
+
+bool Timer::initPeriodic(uint32_t period_ms, TimerCallback callback)
+{
+    if (!initPeriodic(period_ms, &Timer::invokeCallback, this)) {
+        return false;
+    }
+    callback_ = callback;
+    return true;
+}
+
+bool Timer::initPeriodic(uint32_t period_ms, TimerHandler handler, void* context)
+{
+    if (period_ms == 0) {
+        return false;
+    }
+    stop();
+    frequency_hz_ = 1000 / period_ms;
+    period_ticks_ = 0;
+    period_ms_ = period_ms;
+    handler_ = handler;
+    handler_context_ = context;
+    callback_ = nullptr;
+    periodic_ = true;
+    counter_base_us_ = GetCurrentTimeUs();
+    initialized_ = true;
+    return true;
+}
+
+bool Timer::initFrequency(uint32_t frequency_hz)
+{
+    if (frequency_hz == 0 || frequency_hz > HOST_TIMER_CLOCK_HZ) {
+        return false;
+    }
+    stop();
+    frequency_hz_ = frequency_hz;
+    period_ticks_ = getMaxPeriod();
+    periodic_ = false;
+    counter_base_us_ = GetCurrentTimeUs();
+    initialized_ = true;
+    return true;
+}
+
+bool Timer::initTickPeriod(uint32_t tick_period_us)
+{
+    if (tick_period_us == 0) {
+        return false;
+    }
+    return initFrequency(1000000 / tick_period_us);
+}
+
+bool Timer::setPWMChannel(uint32_t channel, GPIO_TypeDef* port, uint16_t pin, uint32_t alternate)
+{
+    (void)port;
+    (void)pin;
+    (void)alternate;
+    if (!initialized_ || channel < 1 || channel > 4) {
+        return false;
+    }
+    channel_enabled_[channel - 1] = true;
+    return true;
+}
+
+void Timer::setDutyCycle(uint32_t channel, float duty_cycle)
+{
+    if (duty_cycle < 0.0f) duty_cycle = 0.0f;
+    if (duty_cycle > 100.0f) duty_cycle = 100.0f;
+    setCompare(channel, (uint32_t)(period_ticks_ * duty_cycle / 100.0f));
+}
+
+float Timer::getDutyCycle(uint32_t channel) const
+{
+    if (channel < 1 || channel > 4 || period_ticks_ == 0) {
+        return 0.0f;
+    }
+    return 100.0f * compare_[channel - 1] / period_ticks_;
+}
+
+void Timer::setCompare(uint32_t channel, uint32_t compare)
+{
+    if (channel < 1 || channel > 4 || periodic_) {
+        return;
+    }
+    compare_[channel - 1] = compare > period_ticks_ ? period_ticks_ : compare;
+}
+
+void Timer::setDutyCycleQ16(uint32_t channel, uint32_t duty)
+{
+    setCompare(channel, (uint32_t)(((uint64_t)period_ticks_ * duty) >> 16));
+}
+
+void Timer::start()
+{
+    if (!initialized_ || !periodic_ || slot_ >= 0) {
+        return;
+    }
+    slot_ = HostStartPeriodic((uint64_t)period_ms_ * 1000, &Timer::onPeriod, this);
+}
+
+void Timer::stop()
+{
+    if (slot_ >= 0) {
+        HostStopPeriodic(slot_);
+        slot_ = -1;
+    }
+}
+
+void Timer::startChannel(uint32_t channel)
+{
+    if (channel >= 1 && channel <= 4) {
+        channel_enabled_[channel - 1] = true;
+    }
+}
+
+void Timer::stopChannel(uint32_t channel)
+{
+    if (channel >= 1 && channel <= 4) {
+        channel_enabled_[channel - 1] = false;
+    }
+}
+
+uint32_t Timer::getCounter() const
+{
+    if (frequency_hz_ == 0) {
+        return 0;
+    }
+    const uint64_t ticks = (GetCurrentTimeUs() - counter_base_us_) * frequency_hz_ / 1000000;
+    return (uint32_t)(ticks & getMaxPeriod());
+}
+
+void Timer::setCounter(uint32_t value)
+{
+    if (frequency_hz_ == 0) {
+        return;
+    }
+    counter_base_us_ = GetCurrentTimeUs() - (uint64_t)value * 1000000 / frequency_hz_;
+}
+
+// Host timer slot handler: the update interrupt of a periodic timer
+void Timer::onPeriod(void* context)
+{
+    Timer* timer = static_cast<Timer*>(context);
+    if (timer->handler_ != nullptr) {
+        timer->handler_(timer->handler_context_);
+    }
+    LUMOS_POST_EVENT(EVENT_TIMER);
+}
+
+void Timer::invokeCallback(void* context)
+{
+    Timer* timer = static_cast<Timer*>(context);
+    if (timer->callback_) {
+        timer->callback_();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "fixed_point.h"
+#include "host_hal.h"
+
+// Timer Class - host simulator version of the wrapper's Timer
+// Usage Example:
+//   Timer periodic(TIM14);
+//   periodic.initPeriodic(500, []() { led.toggle(); });
+//   periodic.start();      // Fires every 500 ms of simulated time
+//
+//   Timer pwm(TIM2);
+//   pwm.initPWM(1000, 25.0f);
+//   pwm.getDutyCycle(1);   // 25.0, for checks in test code
+//
+// Periodic timers run on the simulated clock (sys.h): their callbacks
+// fire inside waits and between loop() calls, never in the middle of
+// other code. Counters count simulated time at the configured rate and
+// wrap at 16 bits, 32 on TIM2 and TIM5. PWM channels only record their
+// settings; the tick clock is HOST_TIMER_CLOCK_HZ. Encoder, input capture
+// and DMA burst modes are not simulated.
+class Timer
+{
+public:
+    using TimerCallback = std::function<void()>;
+    using TimerHandler = void (*)(void* context);
+
+    // Tick clock the PWM periods and compare values are in
+    static constexpr uint32_t HOST_TIMER_CLOCK_HZ = 64000000;
+
+private:
+    TIM_TypeDef* timer_;
+    bool initialized_;
+    bool periodic_;
+    uint32_t frequency_hz_;     // Update rate (PWM, periodic) or tick rate (counter)
+    uint32_t period_ticks_;     // PWM period in HOST_TIMER_CLOCK_HZ ticks
+    uint32_t period_ms_;        // Periodic mode
+    TimerCallback callback_;
+    TimerHandler handler_;
+    void* handler_context_;
+    int slot_;                  // HostStartPeriodic() slot while running
+    uint64_t counter_base_us_;  // Simulated time the counter read 0
+    uint32_t compare_[4];
+    bool channel_enabled_[4];
+
+    uint32_t getMaxPeriod() const;
+    static void invokeCallback(void* context);
+    static void onPeriod(void* context);
+
+public:
+    Timer() = delete;
+    Timer(TIM_TypeDef* timer);
+    ~Timer();
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    // ===== Basic Timer Configuration =====
+    bool initPWM(uint32_t frequency_hz, float duty_cycle = 50.0f);
+    bool initPeriodic(uint32_t period_ms, TimerCallback callback);
+    bool initPeriodic(uint32_t period_ms, TimerHandler handler, void* context = nullptr);
+    bool initFrequency(uint32_t frequency_hz);
+    bool initTickPeriod(uint32_t tick_period_us);
+    bool initMicrosecondCounter() { return initTickPeriod(1); }
+    bool initMillisecondCounter() { return initTickPeriod(1000); }
+
+    // ===== PWM Channel Configuration =====
+    bool setPWMChannel(uint32_t channel, GPIO_TypeDef* port, uint16_t pin, uint32_t alternate);
+    void setDutyCycle(uint32_t channel, float duty_cycle);
+    float getDutyCycle(uint32_t channel) const;
+    void setCompare(uint32_t channel, uint32_t compare);
+    void setDutyCycleQ16(uint32_t channel, uint32_t duty);
+    void setDutyCycle(uint32_t channel, Fixed duty_cycle)
+    {
+        const int32_t percent = duty_cycle.raw();
+        setDutyCycleQ16(channel, percent > 0 ? (uint32_t)percent / 100 : 0);
+    }
+    uint32_t getPeriodTicks() const { return period_ticks_; }
+    uint32_t getCounterMask() const { return getMaxPeriod(); }
+
+    // ===== Timer Control =====
+    void start();
+    void stop();
+    void startChannel(uint32_t channel);
+    void stopChannel(uint32_t channel);
+
+    // ===== Timer Information =====
+    uint32_t getFrequency() const { return frequency_hz_; }
+    float getUpdateRate() const { return (float)frequency_hz_; }
+    uint32_t getCounter() const;
+    void setCounter(uint32_t value);
+    bool isInitialized() const { return initialized_; }
+
+    // Nothing to forward on the host
+    void handleInterrupt() {}
+    void enableInterrupt(IRQn_Type irq, uint32_t priority = 5)
+    {
+        (void)irq;
+        (void)priority;
+    }
+    void handleUpdateInterrupt() {}
+
+    // Host timers have no interrupt latency
+    void enableLatencyMeasurement(bool enable = true) { (void)enable; }
+    uint32_t getLatencyCycles() const { return 0; }
+    uint32_t getMaxLatencyCycles() const { return 0; }
+};
@@ -0,0 +1,292 @@
+#include "uart.h"
+#include "sys.h"
+#include "event_loop.h"
+#include "serial.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Received bytes held for one port, about what a DMA ring holds
+static const size_t RX_CAPACITY = 4096;
+
+// Only one console port reads stdin
+static std::atomic<bool> stdin_taken{false};
+
+struct HostSerialPort
+{
+    SimpleSerial::Serial serial;   // Unused for the console
+    bool console = false;
+    bool reads_stdin = false;
+    std::thread reader;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::deque<uint8_t> rx;
+    uint32_t overflows = 0;
+
+    // Pending readAsync()
+    uint8_t* async_buffer = nullptr;
+    uint16_t async_size = 0;
+    SerialCallback async_done = nullptr;
+    void* async_context = nullptr;
+
+    void receive(const uint8_t* data, size_t length)
+    {
+        SerialCallback done = nullptr;
+        void* context = nullptr;
+        uint16_t delivered = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (async_buffer != nullptr) {
+                delivered = length < async_size ? (uint16_t)length : async_size;
+                memcpy(async_buffer, data, delivered);
+                data += delivered;
+                length -= delivered;
+                done = async_done;
+                context = async_context;
+                async_buffer = nullptr;
+            }
+            for (size_t i = 0; i < length; i++) {
+                if (rx.size() >= RX_CAPACITY) {
+                    overflows++;
+                    break;
+                }
+                rx.push_back(data[i]);
+            }
+        }
+        if (done != nullptr) {
+            done(context, delivered);
+        }
+        LUMOS_POST_EVENT(EVENT_UART_RX);
+        HostNotify();   // An Idle() in real time returns, as on the RX interrupt
+    }
+
+    void readLoop()
+    {
+        uint8_t buffer[256];
+        while (running) {
+            int count = 0;
+            if (!console) {
+                // The timeout only bounds how long end() waits
+                count = serial.Read(buffer, sizeof(buffer), 100);
+            }
+#ifndef _WIN32
+            else {
+                pollfd fd = {STDIN_FILENO, POLLIN, 0};
+                if (poll(&fd, 1, 100) > 0) {
+                    count = (int)::read(STDIN_FILENO, buffer, sizeof(buffer));
+                    if (count == 0) {
+                        return;   // End of input
+                    }
+                }
+            }
+#endif
+            if (count < 0) {
+                return;
+            }
+            if (count > 0) {
+                receive(buffer, (size_t)count);
+            }
+        }
+    }
+};
+
+Serial::Serial(USART_TypeDef* usart_def,
+               GPIO_TypeDef* tx_port, uint16_t tx_pin,
+               GPIO_TypeDef* rx_port, uint16_t rx_pin,
+               uint32_t alternate_function)
+    : usart_(usart_def),
+      baudrate_(115200),
+      port_(nullptr)
+{
+    (void)tx_port;
+    (void)tx_pin;
+    (void)rx_port;
+    (void)rx_pin;
+    (void)alternate_function;
+}
+
+Serial::~Serial()
+{
+    end();
+}
+
+void Serial::begin(const uint32_t baudrate)
+{
+    end();
+    baudrate_ = baudrate;
+    port_ = new HostSerialPort;
+
+    const std::string variable = std::string("LUMOS_HOST_") + usart_->name;
+    const char* device = std::getenv(variable.c_str());
+    if (device != nullptr && device[0] != '\0') {
+        SimpleSerial::SerialConfig config;
+        config.baud_rate = (int)baudrate;
+        if (!port_->serial.Open(device, config)) {
+            fprintf(stderr, "[host] %s: cannot open %s (%s), using the console\n",
+                    usart_->name, device, port_->serial.GetLastError().c_str());
+            port_->console = true;
+        }
+    } else {
+        port_->console = true;
+    }
+
+    if (port_->console) {
+        bool expected = false;
+        port_->reads_stdin = stdin_taken.compare_exchange_strong(expected, true);
+    }
+    if (!port_->console || port_->reads_stdin) {
+        port_->running = true;
+        port_->reader = std::thread([this] { port_->readLoop(); });
+    }
+}
+
+void Serial::end()
+{
+    if (port_ == nullptr) {
+        return;
+    }
+    port_->running = false;
+    if (port_->reader.joinable()) {
+        port_->reader.join();
+    }
+    if (port_->reads_stdin) {
+        stdin_taken = false;
+    }
+    port_->serial.Close();
+    delete port_;
+    port_ = nullptr;
+}
+
+uint32_t Serial::rxOverflows() const
+{
+    if (port_ == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(port_->mutex);
+    return port_->overflows;
+}
+
+bool Serial::flush(uint32_t timeout)
+{
+    (void)timeout;
+    if (port_ != nullptr && port_->console) {
+        fflush(stdout);
+    }
+    return true;
+}
+
+bool Serial::write(const uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    (void)timeout;
+    if (port_ == nullptr) {
+        return false;   // Not begun, as HAL_UART_Transmit() would fail
+    }
+    if (port_->console) {
+        return fwrite(data, 1, length, stdout) == length;
+    }
+    return port_->serial.Write(data, length) == (int)length;
+}
+
+bool Serial::write(Span<const uint8_t> data, uint32_t timeout)
+{
+    const uint8_t* next = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        const uint16_t chunk = remaining > 0xFFFF ? 0xFFFF : (uint16_t)remaining;
+        if (!write(next, chunk, timeout)) {
+            return false;
+        }
+        next += chunk;
+        remaining -= chunk;
+    }
+    return true;
+}
+
+bool Serial::writeAsync(Span<const uint8_t> data, SerialCallback done, void* context)
+{
+    if (data.empty() || data.size() > 0xFFFF || !write(data)) {
+        return false;
+    }
+    if (done != nullptr) {
+        done(context, (uint16_t)data.size());
+    }
+    return true;
+}
+
+bool Serial::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+uint16_t Serial::available()
+{
+    if (port_ == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(port_->mutex);
+    return (uint16_t)(port_->rx.size() > 0xFFFF ? 0xFFFF : port_->rx.size());
+}
+
+uint16_t Serial::read(uint8_t* buffer, uint16_t length)
+{
+    if (port_ == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(port_->mutex);
+    uint16_t count = 0;
+    while (count < length && !port_->rx.empty()) {
+        buffer[count++] = port_->rx.front();
+        port_->rx.pop_front();
+    }
+    return count;
+}
+
+bool Serial::readAsync(Span<uint8_t> buffer, SerialCallback done, void* context)
+{
+    if (port_ == nullptr || buffer.empty() || buffer.size() > 0xFFFF) {
+        return false;
+    }
+    uint16_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(port_->mutex);
+        if (port_->async_buffer != nullptr) {
+            return false;
+        }
+        if (port_->rx.empty()) {
+            port_->async_buffer = buffer.data();
+            port_->async_size = (uint16_t)buffer.size();
+            port_->async_done = done;
+            port_->async_context = context;
+            return true;
+        }
+        while (count < buffer.size() && !port_->rx.empty()) {
+            buffer[count++] = port_->rx.front();
+            port_->rx.pop_front();
+        }
+    }
+    if (done != nullptr) {
+        done(context, count);
+    }
+    return true;
+}
+
+int Serial::read()
+{
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+void Serial::inject(const uint8_t* data, uint16_t length)
+{
+    if (port_ != nullptr) {
+        port_->receive(data, length);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "host_hal.h"
+#include "format.h"
+#include "span.h"
+
+struct HostSerialPort;
+
+// Completion of writeAsync()/readAsync(), with the bytes sent or received
+typedef void (*SerialCallback)(void* context, uint16_t length);
+
+// Serial port - host simulator version of the wrapper's Serial
+// Usage Example:
+//   SerialCom.begin(115200);
+//   SerialCom.printf("t=%u\r\n", HAL_GetTick());
+//
+//   $ LUMOS_HOST_USART6=/dev/pts/3 build/firmware   # SerialCom on a pty
+//
+// begin() opens the host serial port named by LUMOS_HOST_<instance>
+// (LUMOS_HOST_USART6 for a Serial on USART6) through the serial module,
+// e.g. one end of a socat pty pair or a USB adapter. Without it the port
+// is the console: output goes to stdout and input comes from stdin. A
+// reader thread collects received bytes, so available() and read() never
+// block, as with RX DMA on the device; the DMA setup calls just begin().
+// writeAsync() sends at once and then calls back; readAsync() completes
+// from the reader thread with the next bytes that arrive, as the IDLE-line
+// event would on the device.
+class Serial : public Print<Serial>
+{
+private:
+    USART_TypeDef* usart_;
+    uint32_t baudrate_;
+    HostSerialPort* port_;
+
+public:
+    Serial() = delete;
+    Serial(USART_TypeDef* usart_def,
+           GPIO_TypeDef* tx_port, uint16_t tx_pin,
+           GPIO_TypeDef* rx_port, uint16_t rx_pin,
+           uint32_t alternate_function);
+    ~Serial();
+
+    Serial(const Serial&) = delete;
+    Serial& operator=(const Serial&) = delete;
+
+    void begin(const uint32_t baudrate = 115200);
+    void end();
+
+    Serial& setParity(const uint32_t parity)
+    {
+        (void)parity;
+        return *this;
+    }
+
+    void beginAsync(IRQn_Type uart_irq) { (void)uart_irq; }
+
+    // Received bytes the reader thread had no room for
+    uint32_t rxOverflows() const;
+
+    bool flush(uint32_t timeout = 1000);
+
+    // Data transmission
+    bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 100);
+    bool write(Span<const uint8_t> data, uint32_t timeout = 100);
+    bool write(uint8_t byte);
+    // print(), println() and printf() are inherited from Print (format.h)
+
+    bool writeAsync(Span<const uint8_t> data, SerialCallback done = nullptr, void* context = nullptr);
+
+    // Data reception, never blocking
+    uint16_t available();
+    uint16_t read(uint8_t* buffer, uint16_t length);
+    uint16_t read(Span<uint8_t> buffer)
+    {
+        return read(buffer.data(), buffer.size() > 0xFFFF ? 0xFFFF : (uint16_t)buffer.size());
+    }
+    int read();  // Read single byte, returns -1 if no data
+
+    // Queued bytes are delivered first, otherwise the next that arrive
+    bool readAsync(Span<uint8_t> buffer, SerialCallback done, void* context = nullptr);
+
+    /**
+     * @brief Deliver @p length bytes as if they had arrived on the line
+     *
+     * For test code driving an app without a real port.
+     */
+    void inject(const uint8_t* data, uint16_t length);
+
+    USART_TypeDef* getInstance() const { return usart_; }
+};
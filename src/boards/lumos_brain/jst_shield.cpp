@@ -1,11 +1,15 @@
 #include "jst_shield.h"
 
+// Defined per HAL module in the build, see lumos_brain.cpp
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_UART)
 // UART7: PE8 (TX), PE7 (RX)
 Serial Serial7{UART7, GPIOE, GPIO_PIN_8, GPIOE, GPIO_PIN_7, GPIO_AF7_UART7};
 
 // UART8: PE1 (TX), PE0 (RX)
 Serial Serial8{UART8, GPIOE, GPIO_PIN_1, GPIOE, GPIO_PIN_0, GPIO_AF8_UART8};
+#endif
 
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_FDCAN)
 // Create global CAN instances
 // FDCAN1: PD1 (TX), PD0 (RX)
 CAN CAN1{FDCAN1, GPIOD, GPIO_PIN_1, GPIOD, GPIO_PIN_0, GPIO_AF9_FDCAN1};
@@ -16,6 +20,26 @@ CAN CAN2{FDCAN2, GPIOB, GPIO_PIN_13, GPIOB, GPIO_PIN_12, GPIO_AF9_FDCAN2};
 // FDCAN3: PD13 (TX), PD12 (RX)
 CAN CAN3{FDCAN3, GPIOD, GPIO_PIN_13, GPIOD, GPIO_PIN_12, GPIO_AF2_FDCAN3};
 
+// Receive queues and interrupts for beginCanInterrupt()
+static CANFrame can1_rx_queue[32];
+static CANFrame can2_rx_queue[32];
+static CANFrame can3_rx_queue[32];
+
+bool beginCanInterrupt(CAN& can, uint32_t bitrate)
+{
+    can.begin(bitrate);
+    if (&can == &CAN1) return can.beginRxInterrupt(can1_rx_queue, 32, FDCAN1_IT0_IRQn);
+    if (&can == &CAN2) return can.beginRxInterrupt(can2_rx_queue, 32, FDCAN2_IT0_IRQn);
+    if (&can == &CAN3) return can.beginRxInterrupt(can3_rx_queue, 32, FDCAN3_IT0_IRQn);
+    return false;
+}
+
+extern "C" void FDCAN1_IT0_IRQHandler(void) { CAN1.handleInterrupt(); }
+extern "C" void FDCAN2_IT0_IRQHandler(void) { CAN2.handleInterrupt(); }
+extern "C" void FDCAN3_IT0_IRQHandler(void) { CAN3.handleInterrupt(); }
+#endif
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_I2C)
 // Create global I2C instances (lowercase names to avoid HAL macro conflicts)
 // I2C1: PB6 (SCL), PB7 (SDA)
 I2C i2c1{I2C1, GPIOB, GPIO_PIN_6, GPIOB, GPIO_PIN_7, GPIO_AF4_I2C1};
@@ -25,3 +49,20 @@ I2C i2c2{I2C2, GPIOB, GPIO_PIN_10, GPIOB, GPIO_PIN_11, GPIO_AF4_I2C2};
 
 // I2C4: PB8 (SCL), PB9 (SDA)
 I2C i2c4{I2C4, GPIOB, GPIO_PIN_8, GPIOB, GPIO_PIN_9, GPIO_AF4_I2C4};
+
+bool beginI2cInterrupt(I2C& i2c, uint32_t clock_speed)
+{
+    i2c.begin(clock_speed);
+    if (&i2c == &i2c1) return i2c.beginInterrupt(I2C1_EV_IRQn, I2C1_ER_IRQn);
+    if (&i2c == &i2c2) return i2c.beginInterrupt(I2C2_EV_IRQn, I2C2_ER_IRQn);
+    if (&i2c == &i2c4) return i2c.beginInterrupt(I2C4_EV_IRQn, I2C4_ER_IRQn);
+    return false;
+}
+
+extern "C" void I2C1_EV_IRQHandler(void) { i2c1.handleEventInterrupt(); }
+extern "C" void I2C1_ER_IRQHandler(void) { i2c1.handleErrorInterrupt(); }
+extern "C" void I2C2_EV_IRQHandler(void) { i2c2.handleEventInterrupt(); }
+extern "C" void I2C2_ER_IRQHandler(void) { i2c2.handleErrorInterrupt(); }
+extern "C" void I2C4_EV_IRQHandler(void) { i2c4.handleEventInterrupt(); }
+extern "C" void I2C4_ER_IRQHandler(void) { i2c4.handleErrorInterrupt(); }
+#endif
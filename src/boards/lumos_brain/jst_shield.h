@@ -12,11 +12,21 @@ extern CAN CAN1;
 extern CAN CAN2;
 extern CAN CAN3;
 
+// Start CAN1/CAN2/CAN3 with interrupt-driven receive into a 32 frame queue
+// (FDCANx_IT0 interrupts are forwarded to the port)
+bool beginCanInterrupt(CAN& can, uint32_t bitrate = 500000);
+
 // Using lowercase names to avoid conflict with HAL I2C1/I2C2/I2C4 macros
 extern I2C i2c1;
 extern I2C i2c2;
 extern I2C i2c4;
 
+// Start i2c1/i2c2/i2c4 with interrupt-driven transfers for I2C::queue()
+// and I2CDevice (I2Cx_EV/ER interrupts are forwarded to the port)
+bool beginI2cInterrupt(I2C& i2c, uint32_t clock_speed = 100000);
+
+// Timed sampling of sensors on these buses into topics: shield_sampler.h
+
 /*
 SpiPort Spi1
 Spi1.begin(200000r);
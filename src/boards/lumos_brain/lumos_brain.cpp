@@ -1,22 +1,79 @@
 #include "lumos_brain.h"
+#include "board_pins.h"   // Generated from config.yaml
 
+// Each global is only defined when its HAL module is part of the build
+// (the builder passes LUMOS_BOARD_MODULES and LUMOS_HAL_<MODULE>), so a
+// sketch that never touches the SD card or USB does not link their drivers
+// or construct them before setup(). Hardware setup stays in begin().
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_SD)
 // Create global SD card instance
 // SDMMC1: PD2 (CMD), PC12 (CLK), PC8 (D0), PC9 (D1), PC10 (D2), PC11 (D3)
+using SdPins = BoardPins::SD_CARD_PINS;
 SDCard sdcard{SDMMC1,
-              GPIOD, GPIO_PIN_2,   // CMD
-              GPIOC, GPIO_PIN_12,  // CLK
-              GPIOC, GPIO_PIN_8,   // D0
-              GPIOC, GPIO_PIN_9,   // D1
-              GPIOC, GPIO_PIN_10,  // D2
-              GPIOC, GPIO_PIN_11,  // D3
-              GPIO_AF12_SDMMC1};
+              SdPins::CMD.port(), SdPins::CMD.pin,
+              SdPins::CK.port(), SdPins::CK.pin,
+              SdPins::D0.port(), SdPins::D0.pin,
+              SdPins::D1.port(), SdPins::D1.pin,
+              SdPins::D2.port(), SdPins::D2.pin,
+              SdPins::D3.port(), SdPins::D3.pin,
+              SdPins::AF};
+
+extern "C" void SDMMC1_IRQHandler(void) { sdcard.handleInterrupt(); }
+#endif
 
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_PCD)
 // Create global USB instance
 // USB_DP (D+) == PA12, USB_DM (D-) == PA11
-USB usb{USB_OTG_HS, GPIOA, GPIO_PIN_12, GPIOA, GPIO_PIN_11, GPIO_AF10_OTG1_HS};
+using UsbPins = BoardPins::USB_PINS;
+USB usb{USB_OTG_HS, UsbPins::USB_DP.port(), UsbPins::USB_DP.pin,
+        UsbPins::USB_DN.port(), UsbPins::USB_DN.pin, UsbPins::AF};
 
+extern "C" void OTG_HS_IRQHandler(void) { usb.handleInterrupt(); }
+#endif
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_UART)
 // UART4 (ESP32): PA0 (TX), PA1 (RX)
-Serial SerialESP{UART4, GPIOA, GPIO_PIN_0, GPIOA, GPIO_PIN_1, GPIO_AF8_UART4};
+using EspPins = BoardPins::UART4_ESP32;
+Serial SerialESP{UART4, EspPins::TX.port(), EspPins::TX.pin, EspPins::RX.port(), EspPins::RX.pin, EspPins::AF};
 
 // USART6 (CP2102): PC6 (TX), PC7 (RX)
-Serial SerialCom{USART6, GPIOC, GPIO_PIN_6, GPIOC, GPIO_PIN_7, GPIO_AF7_USART6};
+using ComPins = BoardPins::USART6_USB_SERIAL;
+Serial SerialCom{USART6, ComPins::TX.port(), ComPins::TX.pin, ComPins::RX.port(), ComPins::RX.pin, ComPins::AF};
+
+// DMA streams and interrupts of each port, bound at compile time
+using SerialComDma = SerialDma<SerialCom, USART6_IRQn,
+                               ComPins::DMA_TX, DMA_REQUEST_USART6_TX, ComPins::DMA_TX_IRQ,
+                               ComPins::DMA_RX, DMA_REQUEST_USART6_RX, ComPins::DMA_RX_IRQ>;
+using SerialESPDma = SerialDma<SerialESP, UART4_IRQn,
+                               EspPins::DMA_TX, DMA_REQUEST_UART4_TX, EspPins::DMA_TX_IRQ,
+                               EspPins::DMA_RX, DMA_REQUEST_UART4_RX, EspPins::DMA_RX_IRQ>;
+
+// DMA rings for beginSerialDma(); .bss is in RAM_D1, which DMA1 can reach
+alignas(32) static uint8_t com_tx_buffer[1024];
+alignas(32) static uint8_t com_rx_buffer[1024];
+alignas(32) static uint8_t esp_tx_buffer[1024];
+alignas(32) static uint8_t esp_rx_buffer[1024];
+
+bool beginSerialDma(Serial& serial, uint32_t baudrate)
+{
+    if (&serial == &SerialCom) {
+        return SerialComDma::begin(baudrate, com_tx_buffer, com_rx_buffer);
+    }
+    if (&serial == &SerialESP) {
+        return SerialESPDma::begin(baudrate, esp_tx_buffer, esp_rx_buffer);
+    }
+    serial.begin(baudrate);
+    return false;
+}
+
+// Weak, so an application that gives these streams or ports to something
+// else (SPI DMA, its own UART driver) defines its handlers instead; the
+// ports then run without beginSerialDma(). startup.o links after this file.
+extern "C" __weak void DMA1_Stream0_IRQHandler(void) { SerialComDma::txDmaInterrupt(); }
+extern "C" __weak void DMA1_Stream1_IRQHandler(void) { SerialComDma::rxDmaInterrupt(); }
+extern "C" __weak void DMA1_Stream2_IRQHandler(void) { SerialESPDma::txDmaInterrupt(); }
+extern "C" __weak void DMA1_Stream3_IRQHandler(void) { SerialESPDma::rxDmaInterrupt(); }
+extern "C" __weak void USART6_IRQHandler(void) { SerialComDma::uartInterrupt(); }
+extern "C" __weak void UART4_IRQHandler(void) { SerialESPDma::uartInterrupt(); }
+#endif
@@ -16,6 +16,9 @@ PC8  == SD_D0      (Data 0)
 */
 
 // Global SD card instance
+// After sdcard.begin(), sdcard.beginDma(SDMMC1_IRQn) enables async IDMA
+// transfers; the SDMMC1 interrupt is forwarded to it. DMA buffers must be
+// in AXI SRAM (RAM_D1, the default for .bss).
 extern SDCard sdcard;
 
 // Global UART instance connected to ESP32
@@ -30,9 +33,17 @@ PC6 == TX
 extern Serial SerialESP;
 extern Serial SerialCom;
 
+// Start SerialCom or SerialESP with DMA transmit and circular DMA receive
+// (1 KB rings each), so print() never blocks loop() and no received byte
+// is lost while it is busy. Use instead of begin().
+//   SerialCom: DMA1 Stream0 (TX), Stream1 (RX)
+//   SerialESP: DMA1 Stream2 (TX), Stream3 (RX)
+bool beginSerialDma(Serial& serial, uint32_t baudrate = 115200);
+
 /*
 USB DP == PA12
 USB DM == PA11
+Full speed (internal PHY): 64-byte packets, about 1 MB/s of CDC data
 */
 
 
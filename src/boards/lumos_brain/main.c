@@ -21,6 +21,11 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "boot_profile.h"
+#include "memory_usage.h"
+#ifdef LUMOS_EVENT_LOOP
+#include "event_loop.h"
+#endif
 
 /* USER CODE END Includes */
 
@@ -31,7 +36,31 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+/* System clock profile, selected with 'clock:' in project.yaml (the builder
+ * defines LUMOS_CLOCK_<PROFILE>). HSE = 16 MHz, PLL1 input = 2 MHz.
+ *   max:       550 MHz core, 275 MHz AXI/AHB, VOS0
+ *   balanced:  400 MHz core, 200 MHz AXI/AHB, VOS1
+ *   low_power: 100 MHz core,  50 MHz AXI/AHB, VOS3
+ * SDMMC and USB run from PLL2/PLL3 and are not affected. */
+#if defined(LUMOS_CLOCK_LOW_POWER)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE3
+#define CLOCK_PLL1N           200
+#define CLOCK_PLL1P           4
+#define CLOCK_PLL1Q           4
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_1
+#elif defined(LUMOS_CLOCK_BALANCED)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE1
+#define CLOCK_PLL1N           200
+#define CLOCK_PLL1P           1
+#define CLOCK_PLL1Q           2
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_2
+#else
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE0
+#define CLOCK_PLL1N           275
+#define CLOCK_PLL1P           1
+#define CLOCK_PLL1Q           2
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_3
+#endif
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -75,26 +104,35 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  BootProfileMark(BOOT_STAGE_MAIN);
+  PaintMainStack();
   /* USER CODE END 1 */
 
   /* MPU Configuration--------------------------------------------------------*/
   MPU_Config();
 
+  /* Enable the CPU Cache */
+
+  /* Enable I-Cache---------------------------------------------------------*/
+  SCB_EnableICache();
+
+  /* Enable D-Cache---------------------------------------------------------*/
+  SCB_EnableDCache();
+
   /* MCU Configuration--------------------------------------------------------*/
 
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  BootProfileMark(BOOT_STAGE_HAL);
   /* USER CODE END Init */
 
   /* Configure the system clock */
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  BootProfileMark(BOOT_STAGE_CLOCK);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -104,18 +142,24 @@ int main(void)
   // MX_USB_OTG_HS_PCD_Init();
   // MX_SDMMC1_SD_Init();
   /* USER CODE BEGIN 2 */
-
+  BootProfileMark(BOOT_STAGE_PERIPHERALS);
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
 
+  BootProfileMark(BOOT_STAGE_SETUP);
   setup();
 
+#ifdef LUMOS_EVENT_LOOP
+  /* Handlers and loop() on events, WFI in between (event_loop.h) */
+  RunEventLoop();
+#else
   while (1)
   {
       loop();
   }
+#endif
   return 0;
   /* USER CODE END 3 */
 }
@@ -135,7 +179,7 @@ void SystemClock_Config(void)
 
   /** Configure the main internal regulator output voltage
   */
-  __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE0);
+  __HAL_PWR_VOLTAGESCALING_CONFIG(CLOCK_VOLTAGE_SCALE);
 
   while(!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
 
@@ -147,9 +191,9 @@ void SystemClock_Config(void)
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
   RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
   RCC_OscInitStruct.PLL.PLLM = 8;
-  RCC_OscInitStruct.PLL.PLLN = 275;
-  RCC_OscInitStruct.PLL.PLLP = 1;
-  RCC_OscInitStruct.PLL.PLLQ = 2;
+  RCC_OscInitStruct.PLL.PLLN = CLOCK_PLL1N;
+  RCC_OscInitStruct.PLL.PLLP = CLOCK_PLL1P;
+  RCC_OscInitStruct.PLL.PLLQ = CLOCK_PLL1Q;
   RCC_OscInitStruct.PLL.PLLR = 2;
   RCC_OscInitStruct.PLL.PLLRGE = RCC_PLL1VCIRANGE_1;
   RCC_OscInitStruct.PLL.PLLVCOSEL = RCC_PLL1VCOWIDE;
@@ -172,7 +216,7 @@ void SystemClock_Config(void)
   RCC_ClkInitStruct.APB2CLKDivider = RCC_APB2_DIV2;
   RCC_ClkInitStruct.APB4CLKDivider = RCC_APB4_DIV2;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_3) != HAL_OK)
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, CLOCK_FLASH_LATENCY) != HAL_OK)
   {
     Error_Handler();
   }
@@ -292,6 +336,23 @@ void MPU_Config(void)
   MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
   MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
 
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** D2 SRAM (RAM_D2: LUMOS_DMA_BUFFER and the DMA pool) is normal memory,
+  * not cacheable, so DMA buffers there need no cache maintenance
+  */
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER1;
+  MPU_InitStruct.BaseAddress = 0x30000000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_32KB;
+  MPU_InitStruct.SubRegionDisable = 0x0;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
   HAL_MPU_ConfigRegion(&MPU_InitStruct);
   /* Enables the MPU */
   HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
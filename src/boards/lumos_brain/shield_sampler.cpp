@@ -0,0 +1,205 @@
+#include "shield_sampler.h"
+
+// Needs every bus it can sample; the module detector selects them all
+// for shield_sampler.h
+#if !defined(LUMOS_BOARD_MODULES) || \
+    (defined(LUMOS_HAL_I2C) && defined(LUMOS_HAL_SPI) && defined(LUMOS_HAL_ADC) && defined(LUMOS_HAL_TIM))
+
+#include <memory_sections.h>
+#include <cstring>
+
+static constexpr uint8_t SPI_READ = 0x80;
+
+static void onSamplerTick(void* context)
+{
+    static_cast<ShieldSampler*>(context)->handleTick();
+}
+
+ShieldSampler::ShieldSampler()
+    : sensors_{},
+      sensor_count_(0),
+      reads_{},
+      read_count_(0),
+      running_(false),
+      tick_(0),
+      published_(0),
+      dropped_(0),
+      errors_(0),
+      overruns_(0)
+{
+}
+
+bool ShieldSampler::addSensor(Bus bus, void* device, uint8_t reg, uint8_t length, uint16_t rate_hz, void* topic,
+                              RawDecode decode, PublishFunction publish)
+{
+    if (running_ || sensor_count_ >= MAX_SENSORS || length == 0 || length > MAX_READ || rate_hz == 0 ||
+        rate_hz > TICK_HZ) {
+        return false;
+    }
+
+    // Join a transfer of the same device and rate if the blocks are close;
+    // ADC channels only share a conversion of the same channel
+    uint8_t index = read_count_;
+    for (uint8_t r = 0; r < read_count_; r++) {
+        Read& read = reads_[r];
+        if (read.bus != bus || read.device != device || read.rate_hz != rate_hz) {
+            continue;
+        }
+        const int start = reg < read.reg ? reg : read.reg;
+        const int end = reg + length > read.reg + read.length ? reg + length : read.reg + read.length;
+        const int gap = reg >= read.reg + read.length ? reg - (read.reg + read.length)
+                      : read.reg >= reg + length ? read.reg - (reg + length) : 0;
+        if ((bus == Bus::ADC && reg != read.reg) || gap > MAX_GAP || end - start > MAX_READ) {
+            continue;
+        }
+        read.reg = static_cast<uint8_t>(start);
+        read.length = static_cast<uint8_t>(end - start);
+        index = r;
+        break;
+    }
+
+    if (index == read_count_) {
+        if (read_count_ >= MAX_READS) {
+            return false;
+        }
+        Read& read = reads_[read_count_++];
+        read.device = device;
+        read.bus = bus;
+        read.reg = reg;
+        read.length = length;
+        read.rate_hz = rate_hz;
+        read.busy = false;
+    }
+
+    Sensor& sensor = sensors_[sensor_count_++];
+    sensor.topic = topic;
+    sensor.decode = decode;
+    sensor.publish = publish;
+    sensor.read = index;
+    sensor.reg = reg;
+    sensor.length = length;
+    return true;
+}
+
+bool ShieldSampler::begin(Timer& timer, IRQn_Type irq)
+{
+    if (running_) {
+        return false;
+    }
+
+    for (uint8_t r = 0; r < read_count_; r++) {
+        Read& read = reads_[r];
+        read.period = static_cast<uint16_t>(TICK_HZ / read.rate_hz);
+        memset(read.tx, 0, sizeof(read.tx));
+        read.tx[0] = static_cast<uint8_t>(read.reg | SPI_READ);
+
+        // Reads of one period take turns on its ticks
+        uint8_t same_period = 0;
+        for (uint8_t other = 0; other < r; other++) {
+            if (reads_[other].period == read.period) {
+                same_period++;
+            }
+        }
+        read.next_tick = 1 + same_period % read.period;
+    }
+
+    tick_ = 0;
+    running_ = true;
+    if (!timer.initPeriodic(1, onSamplerTick, this)) {
+        running_ = false;
+        return false;
+    }
+    timer.enableInterrupt(irq);
+    timer.start();
+    return true;
+}
+
+void ShieldSampler::handleTick()
+{
+    const uint32_t tick = tick_ + 1;
+    tick_ = tick;
+    for (uint8_t r = 0; r < read_count_; r++) {
+        Read& read = reads_[r];
+        if (static_cast<int32_t>(tick - read.next_tick) < 0) {
+            continue;
+        }
+        read.next_tick += read.period;
+        if (read.busy) {
+            overruns_ = overruns_ + 1;
+            continue;
+        }
+        startRead(r);
+    }
+}
+
+// Queue one transfer on its bus; runs in the tick interrupt
+bool ShieldSampler::startRead(uint8_t index)
+{
+    Read& read = reads_[index];
+    read.busy = true;
+
+    bool queued = false;
+    switch (read.bus) {
+        case Bus::I2C:
+            queued = static_cast<I2CDevice*>(read.device)->readRegistersAsync(
+                read.reg, read.rx, read.length, [this, index](bool ok) { onReadDone(index, ok); });
+            break;
+        case Bus::SPI:
+            queued = static_cast<SPIDevice*>(read.device)->transferAsync(
+                read.tx, read.rx, read.length + 1, [this, index](bool ok) { onReadDone(index, ok); });
+            break;
+        case Bus::ADC: {
+            const uint16_t value = static_cast<AnalogInput*>(read.device)->readRaw(read.reg);
+            read.rx[0] = static_cast<uint8_t>(value);
+            read.rx[1] = static_cast<uint8_t>(value >> 8);
+            onReadDone(index, true);
+            return true;
+        }
+    }
+
+    if (!queued) {
+        read.busy = false;
+        errors_ = errors_ + 1;
+    }
+    return queued;
+}
+
+// Completion interrupt: decode and publish every sensor of the transfer
+void ShieldSampler::onReadDone(uint8_t index, bool ok)
+{
+    Read& read = reads_[index];
+    if (!ok) {
+        read.busy = false;
+        errors_ = errors_ + 1;
+        return;
+    }
+
+    // SPI clocks in one byte during the command
+    const uint8_t* data = read.rx + (read.bus == Bus::SPI ? 1 : 0);
+    for (uint8_t s = 0; s < sensor_count_; s++) {
+        const Sensor& sensor = sensors_[s];
+        if (sensor.read != index) {
+            continue;
+        }
+        if (sensor.publish(sensor.topic, sensor.decode, data + (sensor.reg - read.reg))) {
+            published_ = published_ + 1;
+        } else {
+            dropped_ = dropped_ + 1;
+        }
+    }
+    read.busy = false;
+}
+
+// TIM7 is a basic timer, free for the sampler on this board. The sampler
+// lives in D2 SRAM: uncached, so reads of any length can use DMA
+static Timer sampler_timer{TIM7};
+LUMOS_DMA_BUFFER ShieldSampler shield_sampler;
+
+bool beginShieldSampler()
+{
+    return shield_sampler.begin(sampler_timer, TIM7_IRQn);
+}
+
+void shieldSamplerInterrupt() { sampler_timer.handleUpdateInterrupt(); }
+
+#endif
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "stm32h7xx_hal.h"
+#include <bus_device.h>
+#include <adc.h>
+#include <timer.h>
+#include <message_bus.h>
+#include <cstddef>
+#include <cstdint>
+
+// Samples the shield's sensors from one timer interrupt and publishes
+// them to framework topics
+//
+// Each sensor is a register block on an I2C or SPI device, or an ADC
+// channel, with a rate and a decode function that turns its raw bytes
+// into the topic's message. On every tick the timer interrupt queues the
+// reads that are due on the buses' transfer queues, and the completion
+// interrupts decode and publish, so the main loop does no sampling work
+// however many sensors there are.
+//
+// Blocks of one device read at the same rate share a single transfer when
+// they are at most MAX_GAP bytes apart (accelerometer and gyro registers
+// of an IMU, say), and reads with the same rate are spread over different
+// ticks instead of all landing on the first one. The tick is 1 ms, so
+// rates are rounded to a whole number of milliseconds.
+//
+// Usage Example:
+//   struct Accel { int16_t x, y, z; };
+//   Lumos::Topic<Accel> accel_topic;
+//   Lumos::Topic<Gyro> gyro_topic;
+//   Lumos::Topic<Battery> battery_topic;
+//
+//   bool decodeAccel(const uint8_t* raw, Accel& out) {   // Runs in an interrupt
+//       out.x = static_cast<int16_t>(raw[0] << 8 | raw[1]); ...
+//       return true;
+//   }
+//
+//   I2CDevice imu{i2c1, 0x68, 400000};
+//   shield_sampler.addI2C(imu, 0x3B, 6, 1000, accel_topic, decodeAccel);   // 1 kHz
+//   shield_sampler.addI2C(imu, 0x43, 6, 1000, gyro_topic, decodeGyro);     // Same transfer
+//   shield_sampler.addADC(adc1, 3, 10, battery_topic, decodeBattery);      // raw: 2 bytes, LE
+//   beginI2cInterrupt(i2c1, 400000);
+//   beginShieldSampler();   // Ticks at 1 kHz on TIM7
+//
+//   LUMOS_SHIELD_SAMPLER_IRQ_HANDLER(TIM7_IRQHandler)   // At file scope
+//
+//   Subscriber<Accel> accel{accel_topic};   // Anywhere, as usual
+//
+// Buses must run their interrupt (or DMA) transfers: beginI2cInterrupt(),
+// SPI::beginInterrupt() or beginDma(). ADC channels are converted in the
+// tick interrupt with readRaw(), a few microseconds each. A read still in
+// flight when it is due again is skipped and counted in getOverruns().
+class ShieldSampler
+{
+public:
+    static constexpr uint8_t MAX_SENSORS = 16;
+    static constexpr uint8_t MAX_READS = 12;   // Transfers after merging
+    static constexpr uint8_t MAX_READ = 32;    // Bytes per transfer
+    static constexpr uint8_t MAX_GAP = 8;      // Unused bytes a merged transfer may read
+    static constexpr uint16_t TICK_HZ = 1000;
+
+    template <typename T>
+    using Decode = bool (*)(const uint8_t* raw, T& out);
+
+    ShieldSampler();
+
+    ShieldSampler(const ShieldSampler&) = delete;
+    ShieldSampler& operator=(const ShieldSampler&) = delete;
+
+    /**
+     * @brief Sample @p length bytes from register @p reg at @p rate_hz
+     * @return false if the tables are full, the block is larger than
+     *         MAX_READ, the rate is 0 or above TICK_HZ, or sampling runs
+     */
+    template <typename T, size_t Slots>
+    bool addI2C(I2CDevice& device, uint8_t reg, uint8_t length, uint16_t rate_hz, Lumos::Topic<T, Slots>& topic,
+                Decode<T> decode)
+    {
+        return addSensor(Bus::I2C, &device, reg, length, rate_hz, &topic, reinterpret_cast<RawDecode>(decode),
+                         &publishSample<T, Slots>);
+    }
+
+    // SPI registers are read with the usual read bit: @p reg | 0x80
+    template <typename T, size_t Slots>
+    bool addSPI(SPIDevice& device, uint8_t reg, uint8_t length, uint16_t rate_hz, Lumos::Topic<T, Slots>& topic,
+                Decode<T> decode)
+    {
+        return addSensor(Bus::SPI, &device, reg, length, rate_hz, &topic, reinterpret_cast<RawDecode>(decode),
+                         &publishSample<T, Slots>);
+    }
+
+    // The decode function gets the conversion as 2 bytes, little-endian
+    template <typename T, size_t Slots>
+    bool addADC(AnalogInput& adc, uint8_t channel, uint16_t rate_hz, Lumos::Topic<T, Slots>& topic,
+                Decode<T> decode)
+    {
+        return addSensor(Bus::ADC, &adc, channel, 2, rate_hz, &topic, reinterpret_cast<RawDecode>(decode),
+                         &publishSample<T, Slots>);
+    }
+
+    /**
+     * @brief Start sampling on @p timer's update interrupt, every 1 ms
+     *
+     * Forward the timer's IRQ to timer.handleUpdateInterrupt(). Sensors
+     * cannot be added once it runs.
+     */
+    bool begin(Timer& timer, IRQn_Type irq);
+
+    // Queue the reads due now (the timer handler begin() installs)
+    void handleTick();
+
+    uint32_t getTick() const { return tick_; }
+    uint8_t getReadCount() const { return read_count_; }
+
+    // Samples published, and samples lost (decode rejected them or the
+    // topic had no free slot)
+    uint32_t getPublished() const { return published_; }
+    uint32_t getDropped() const { return dropped_; }
+    uint32_t getErrors() const { return errors_; }
+    uint32_t getOverruns() const { return overruns_; }
+
+private:
+    enum class Bus : uint8_t { I2C, SPI, ADC };
+
+    using RawDecode = void (*)();
+    using PublishFunction = bool (*)(void* topic, RawDecode decode, const uint8_t* raw);
+
+    struct Sensor
+    {
+        void* topic;
+        RawDecode decode;
+        PublishFunction publish;
+        uint8_t read;     // Index in reads_
+        uint8_t reg;
+        uint8_t length;
+    };
+
+    // One transfer covering the blocks of one or more sensors
+    struct Read
+    {
+        alignas(32) uint8_t rx[64];   // Cache line multiple for D-cache maintenance
+        uint8_t tx[MAX_READ + 1];     // SPI command and padding
+        void* device;
+        Bus bus;
+        uint8_t reg;
+        uint8_t length;
+        uint16_t rate_hz;
+        uint16_t period;              // Ticks
+        volatile bool busy;
+        uint32_t next_tick;
+    };
+
+    Sensor sensors_[MAX_SENSORS];
+    uint8_t sensor_count_;
+    Read reads_[MAX_READS];
+    uint8_t read_count_;
+    bool running_;
+    volatile uint32_t tick_;
+
+    volatile uint32_t published_;
+    volatile uint32_t dropped_;
+    volatile uint32_t errors_;
+    volatile uint32_t overruns_;
+
+    bool addSensor(Bus bus, void* device, uint8_t reg, uint8_t length, uint16_t rate_hz, void* topic,
+                   RawDecode decode, PublishFunction publish);
+    bool startRead(uint8_t index);
+    void onReadDone(uint8_t index, bool ok);
+
+    template <typename T, size_t Slots>
+    static bool publishSample(void* topic, RawDecode decode, const uint8_t* raw)
+    {
+        Lumos::Topic<T, Slots>& typed = *static_cast<Lumos::Topic<T, Slots>*>(topic);
+        auto loan = typed.Loan();
+        if (!loan || !reinterpret_cast<Decode<T>>(decode)(raw, *loan)) {
+            return false;
+        }
+        return typed.Publish(std::move(loan));
+    }
+};
+
+// The board's sampler, ticking on TIM7
+extern ShieldSampler shield_sampler;
+
+// Start shield_sampler once its sensors are added
+bool beginShieldSampler();
+
+// TIM7 update interrupt of shield_sampler
+void shieldSamplerInterrupt();
+
+// Define @p handler (TIM7_IRQHandler) as the sampler's tick. The
+// application maps the vector, so one that uses TIM7 otherwise (e.g. for
+// LUMOS_PROFILER_IRQ_HANDLER) keeps it.
+#define LUMOS_SHIELD_SAMPLER_IRQ_HANDLER(handler) \
+    extern "C" void handler(void) { shieldSamplerInterrupt(); }
@@ -20,6 +20,12 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "stm32h7xx_it.h"
+#ifdef LUMOS_RTOS_FREERTOS
+/* SVC and PendSV come from the FreeRTOS port (see FreeRTOSConfig.h) */
+#include "FreeRTOS.h"
+#include "task.h"
+extern void xPortSysTickHandler(void);
+#endif
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 /* USER CODE END Includes */
@@ -138,6 +144,7 @@ void UsageFault_Handler(void)
   }
 }
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles System service call via SWI instruction.
   */
@@ -150,6 +157,7 @@ void SVC_Handler(void)
 
   /* USER CODE END SVCall_IRQn 1 */
 }
+#endif
 
 /**
   * @brief This function handles Debug monitor.
@@ -164,6 +172,7 @@ void DebugMon_Handler(void)
   /* USER CODE END DebugMonitor_IRQn 1 */
 }
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles Pendable request for system service.
   */
@@ -176,6 +185,7 @@ void PendSV_Handler(void)
 
   /* USER CODE END PendSV_IRQn 1 */
 }
+#endif
 
 /**
   * @brief This function handles System tick timer.
@@ -186,6 +196,12 @@ void SysTick_Handler(void)
 
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
+#ifdef LUMOS_RTOS_FREERTOS
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+  {
+    xPortSysTickHandler();
+  }
+#endif
   /* USER CODE BEGIN SysTick_IRQn 1 */
 
   /* USER CODE END SysTick_IRQn 1 */
@@ -0,0 +1,38 @@
+#pragma once
+
+// USB Device Library configuration for the USB wrapper's CDC device
+// (see wrapper/usb.h). A project can replace it with include/usbd_conf.h.
+
+#include <stdlib.h>
+#include <string.h>
+#include "stm32h7xx_hal.h"
+
+#define USBD_MAX_NUM_INTERFACES     1
+#define USBD_MAX_NUM_CONFIGURATION  1
+#define USBD_MAX_STR_DESC_SIZ       512
+#define USBD_DEBUG_LEVEL            0
+#define USBD_LPM_ENABLED            0
+#define USBD_SELF_POWERED           1
+
+#define DEVICE_FS                   0
+#define DEVICE_HS                   1
+
+// The CDC class allocates its handle once; keep it off the heap
+#ifdef __cplusplus
+extern "C" {
+#endif
+void* USBD_static_malloc(uint32_t size);
+void USBD_static_free(void* memory);
+#ifdef __cplusplus
+}
+#endif
+
+#define USBD_malloc                 USBD_static_malloc
+#define USBD_free                   USBD_static_free
+#define USBD_memset                 memset
+#define USBD_memcpy                 memcpy
+#define USBD_Delay                  HAL_Delay
+
+#define USBD_UsrLog(...)
+#define USBD_ErrLog(...)
+#define USBD_DbgLog(...)
@@ -1,41 +1,66 @@
 #include "lumos_micro_brain.h"
+#include "board_pins.h"   // Generated from config.yaml
 
+// Each group is only defined when its HAL module is part of the build
+// (LUMOS_BOARD_MODULES / LUMOS_HAL_<MODULE> from the builder)
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_UART)
 // ===========================
 // UART Instances
 // ===========================
 
 // USART1 (Programming Port): PA9 (TX), PA10 (RX)
-Serial SerialPgm{USART1, GPIOA, GPIO_PIN_9, GPIOA, GPIO_PIN_10, GPIO_AF1_USART1};
+using PgmPins = BoardPins::UART1_PGM;
+Serial SerialPgm{USART1, PgmPins::TX.port(), PgmPins::TX.pin, PgmPins::RX.port(), PgmPins::RX.pin, PgmPins::AF};
 
 // USART3 (JST Connector): PB8 (TX), PB9 (RX)
 // Note: Shares pins with I2C1. Use only one peripheral at a time.
-Serial SerialJst{USART3, GPIOB, GPIO_PIN_8, GPIOB, GPIO_PIN_9, GPIO_AF4_USART3};
+using JstUartPins = BoardPins::UART3_JST;
+Serial SerialJst{USART3, JstUartPins::TX.port(), JstUartPins::TX.pin,
+                 JstUartPins::RX.port(), JstUartPins::RX.pin, JstUartPins::AF};
 
 // USART5 (Bottom Connector): PB2 (TX), PB1 (RX)
-Serial SerialBottom{USART5, GPIOB, GPIO_PIN_2, GPIOB, GPIO_PIN_1, GPIO_AF3_USART5};
+using BottomUartPins = BoardPins::UART5_BOTTOMCONNECTOR;
+Serial SerialBottom{USART5, BottomUartPins::TX.port(), BottomUartPins::TX.pin,
+                    BottomUartPins::RX.port(), BottomUartPins::RX.pin, BottomUartPins::AF};
+#endif
 
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_I2C)
 // ===========================
 // I2C Instances
 // ===========================
 
 // I2C1 (JST Connector): PB8 (SCL), PB9 (SDA)
 // Note: Shares pins with UART3/UART6. Use only one peripheral at a time.
-I2C I2C_Jst{I2C1, GPIOB, GPIO_PIN_8, GPIOB, GPIO_PIN_9, GPIO_AF6_I2C1};
+using JstI2CPins = BoardPins::I2C1_JST;
+I2C I2C_Jst{I2C1, JstI2CPins::SCL.port(), JstI2CPins::SCL.pin,
+            JstI2CPins::SDA.port(), JstI2CPins::SDA.pin, JstI2CPins::AF};
 
 // I2C3 (Bottom Connector): PA7 (SCL), PA6 (SDA)
-I2C I2C_Bottom{I2C3, GPIOA, GPIO_PIN_7, GPIOA, GPIO_PIN_6, GPIO_AF6_I2C3};
+using BottomI2CPins = BoardPins::I2C3_BOTTOMCONNECTOR;
+I2C I2C_Bottom{I2C3, BottomI2CPins::SCL.port(), BottomI2CPins::SCL.pin,
+               BottomI2CPins::SDA.port(), BottomI2CPins::SDA.pin, BottomI2CPins::AF};
+#endif
 
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_SPI)
 // ===========================
 // SPI Instances
 // ===========================
 
 // SPI3 (Bottom Connector): PB3 (SCK), PB4 (MISO), PB5 (MOSI)
-SPI SPI_Bottom{SPI3, GPIOB, GPIO_PIN_5, GPIOB, GPIO_PIN_4, GPIOB, GPIO_PIN_3, GPIO_AF9_SPI3};
+using BottomSPIPins = BoardPins::SPI3_BOTTOMCONNECTOR;
+SPI SPI_Bottom{SPI3, BottomSPIPins::MOSI.port(), BottomSPIPins::MOSI.pin,
+               BottomSPIPins::MISO.port(), BottomSPIPins::MISO.pin,
+               BottomSPIPins::SCK.port(), BottomSPIPins::SCK.pin, BottomSPIPins::AF};
+#endif
 
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_FDCAN)
 // ===========================
 // CAN Instance
 // ===========================
 
 // FDCAN1: PB11 (TX), PB12 (RX)
 // Note: Alternate pins PA9 (TX), PA10 (RX) are available but share with UART1
-CAN CAN1{FDCAN1, GPIOB, GPIO_PIN_11, GPIOB, GPIO_PIN_12, GPIO_AF3_FDCAN1};
\ No newline at end of file
+using CanPins = BoardPins::FDCAN1_PINS;
+CAN CAN1{FDCAN1, CanPins::TX.port(), CanPins::TX.pin, CanPins::RX.port(), CanPins::RX.pin, CanPins::AF};
+#endif
@@ -21,6 +21,11 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "boot_profile.h"
+#include "memory_usage.h"
+#ifdef LUMOS_EVENT_LOOP
+#include "event_loop.h"
+#endif
 
 /* USER CODE END Includes */
 
@@ -31,7 +36,24 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+/* System clock profile, selected with 'clock:' in project.yaml (the builder
+ * defines LUMOS_CLOCK_<PROFILE>). HSE = 16 MHz.
+ *   max:       64 MHz from PLLR, range 1
+ *   balanced:  32 MHz from PLLR, range 1
+ *   low_power: 16 MHz straight from HSE, PLL off, range 2
+ * Range 2 allows zero wait states only up to 8 MHz, so 16 MHz needs one. */
+#if defined(LUMOS_CLOCK_LOW_POWER)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE2
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_1
+#elif defined(LUMOS_CLOCK_BALANCED)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE1
+#define CLOCK_PLLR            RCC_PLLR_DIV8
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_1
+#else
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE1
+#define CLOCK_PLLR            RCC_PLLR_DIV4
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_2
+#endif
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -65,7 +87,8 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  BootProfileMark(BOOT_STAGE_MAIN);
+  PaintMainStack();
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -74,28 +97,34 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  BootProfileMark(BOOT_STAGE_HAL);
   /* USER CODE END Init */
 
   /* Configure the system clock */
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  BootProfileMark(BOOT_STAGE_CLOCK);
   /* USER CODE END SysInit */
 
   /* USER CODE BEGIN 2 */
-
+  BootProfileMark(BOOT_STAGE_PERIPHERALS);
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
+  BootProfileMark(BOOT_STAGE_SETUP);
   setup();
 
+#ifdef LUMOS_EVENT_LOOP
+  /* Handlers and loop() on events, WFI in between (event_loop.h) */
+  RunEventLoop();
+#else
   while (1)
   {
       loop();
   }
+#endif
   return 0;
   /* USER CODE END 3 */
 }
@@ -111,20 +140,24 @@ void SystemClock_Config(void)
 
   /** Configure the main internal regulator output voltage
   */
-  HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1);
+  HAL_PWREx_ControlVoltageScaling(CLOCK_VOLTAGE_SCALE);
 
   /** Initializes the RCC Oscillators according to the specified parameters
   * in the RCC_OscInitTypeDef structure.
   */
   RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
   RCC_OscInitStruct.HSEState = RCC_HSE_ON;
+#if defined(LUMOS_CLOCK_LOW_POWER)
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+#else
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
   RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
   RCC_OscInitStruct.PLL.PLLM = RCC_PLLM_DIV1;
   RCC_OscInitStruct.PLL.PLLN = 16;
   RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
   RCC_OscInitStruct.PLL.PLLQ = RCC_PLLQ_DIV2;
-  RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV4;
+  RCC_OscInitStruct.PLL.PLLR = CLOCK_PLLR;
+#endif
   if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
   {
     Error_Handler();
@@ -134,11 +167,15 @@ void SystemClock_Config(void)
   */
   RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
                               |RCC_CLOCKTYPE_PCLK1;
+#if defined(LUMOS_CLOCK_LOW_POWER)
+  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSE;
+#else
   RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+#endif
   RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
   RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_2) != HAL_OK)
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, CLOCK_FLASH_LATENCY) != HAL_OK)
   {
     Error_Handler();
   }
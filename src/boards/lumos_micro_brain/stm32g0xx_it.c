@@ -20,6 +20,12 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "stm32g0xx_it.h"
+#ifdef LUMOS_RTOS_FREERTOS
+/* SVC and PendSV come from the FreeRTOS port (see FreeRTOSConfig.h) */
+#include "FreeRTOS.h"
+#include "task.h"
+extern void xPortSysTickHandler(void);
+#endif
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 /* USER CODE END Includes */
@@ -93,6 +99,7 @@ void HardFault_Handler(void)
   }
 }
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles System service call via SWI instruction.
   */
@@ -105,7 +112,9 @@ void SVC_Handler(void)
 
   /* USER CODE END SVC_IRQn 1 */
 }
+#endif
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles Pendable request for system service.
   */
@@ -118,6 +127,7 @@ void PendSV_Handler(void)
 
   /* USER CODE END PendSV_IRQn 1 */
 }
+#endif
 
 /**
   * @brief This function handles System tick timer.
@@ -128,6 +138,12 @@ void SysTick_Handler(void)
 
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
+#ifdef LUMOS_RTOS_FREERTOS
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+  {
+    xPortSysTickHandler();
+  }
+#endif
   /* USER CODE BEGIN SysTick_IRQn 1 */
 
   /* USER CODE END SysTick_IRQn 1 */
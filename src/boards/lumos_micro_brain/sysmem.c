@@ -29,6 +29,11 @@
  */
 static uint8_t *__sbrk_heap_end = NULL;
 
+/**
+ * Highest heap end so far, for GetHeapPeak() (memory_usage.h)
+ */
+static uint8_t *__sbrk_heap_peak = NULL;
+
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
  *        and others from the C library
@@ -74,6 +79,24 @@ void *_sbrk(ptrdiff_t incr)
 
   prev_heap_end = __sbrk_heap_end;
   __sbrk_heap_end += incr;
+  if (__sbrk_heap_end > __sbrk_heap_peak)
+  {
+    __sbrk_heap_peak = __sbrk_heap_end;
+  }
 
   return (void *)prev_heap_end;
 }
+
+/**
+ * @brief Current and highest heap end for memory_usage.h (NULL before the
+ *        first allocation)
+ */
+uint8_t *SysmemGetHeapEnd(void)
+{
+  return __sbrk_heap_end;
+}
+
+uint8_t *SysmemGetHeapPeak(void)
+{
+  return __sbrk_heap_peak;
+}
@@ -17,6 +17,11 @@
 
 #include "main.h"
 #include "sx1281_module.h"
+#include "boot_profile.h"
+#include "memory_usage.h"
+#ifdef LUMOS_EVENT_LOOP
+#include "event_loop.h"
+#endif
 
 /* External user functions */
 extern void setup(void);
@@ -28,23 +33,35 @@ extern void loop(void);
   */
 int main(void)
 {
+  BootProfileMark(BOOT_STAGE_MAIN);
+  PaintMainStack();
+
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
+  BootProfileMark(BOOT_STAGE_HAL);
 
   /* Configure the system clock */
   SystemClock_Config();
+  BootProfileMark(BOOT_STAGE_CLOCK);
 
   /* Initialize board-specific hardware */
   SX1281Module_Init();
+  BootProfileMark(BOOT_STAGE_PERIPHERALS);
 
   /* Call user setup function */
+  BootProfileMark(BOOT_STAGE_SETUP);
   setup();
 
   /* Infinite loop */
+#ifdef LUMOS_EVENT_LOOP
+  /* Handlers and loop() on events, WFI in between (event_loop.h) */
+  RunEventLoop();
+#else
   while (1)
   {
     loop();
   }
+#endif
 }
 
 /**
@@ -7,6 +7,12 @@
 
 #include "main.h"
 #include "stm32h5xx_it.h"
+#ifdef LUMOS_RTOS_FREERTOS
+/* SVC and PendSV come from the FreeRTOS port (see FreeRTOSConfig.h) */
+#include "FreeRTOS.h"
+#include "task.h"
+extern void xPortSysTickHandler(void);
+#endif
 
 /******************************************************************************/
 /*           Cortex-M33 Processor Interruption and Exception Handlers          */
@@ -62,12 +68,14 @@ void UsageFault_Handler(void)
   }
 }
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles System service call via SWI instruction.
   */
 void SVC_Handler(void)
 {
 }
+#endif
 
 /**
   * @brief This function handles Debug monitor.
@@ -76,12 +84,14 @@ void DebugMon_Handler(void)
 {
 }
 
+#ifndef LUMOS_RTOS_FREERTOS
 /**
   * @brief This function handles Pendable request for system service.
   */
 void PendSV_Handler(void)
 {
 }
+#endif
 
 /**
   * @brief This function handles System tick timer.
@@ -89,6 +99,12 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   HAL_IncTick();
+#ifdef LUMOS_RTOS_FREERTOS
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+  {
+    xPortSysTickHandler();
+  }
+#endif
 }
 
 /******************************************************************************/
@@ -0,0 +1,633 @@
+#include "sx1281.h"
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_SPI)
+
+#include <cstring>
+
+// Commands (datasheet section 11)
+static constexpr uint8_t CMD_GET_STATUS = 0xC0;
+static constexpr uint8_t CMD_WRITE_REGISTER = 0x18;
+static constexpr uint8_t CMD_WRITE_BUFFER = 0x1A;
+static constexpr uint8_t CMD_READ_BUFFER = 0x1B;
+static constexpr uint8_t CMD_SET_STANDBY = 0x80;
+static constexpr uint8_t CMD_SET_TX = 0x83;
+static constexpr uint8_t CMD_SET_RX = 0x82;
+static constexpr uint8_t CMD_SET_PACKET_TYPE = 0x8A;
+static constexpr uint8_t CMD_SET_RF_FREQUENCY = 0x86;
+static constexpr uint8_t CMD_SET_TX_PARAMS = 0x8E;
+static constexpr uint8_t CMD_SET_BUFFER_BASE_ADDRESS = 0x8F;
+static constexpr uint8_t CMD_SET_MODULATION_PARAMS = 0x8B;
+static constexpr uint8_t CMD_SET_PACKET_PARAMS = 0x8C;
+static constexpr uint8_t CMD_GET_RX_BUFFER_STATUS = 0x17;
+static constexpr uint8_t CMD_GET_PACKET_STATUS = 0x1D;
+static constexpr uint8_t CMD_SET_DIO_IRQ_PARAMS = 0x8D;
+static constexpr uint8_t CMD_GET_IRQ_STATUS = 0x15;
+static constexpr uint8_t CMD_CLR_IRQ_STATUS = 0x97;
+static constexpr uint8_t CMD_SET_REGULATOR_MODE = 0x96;
+static constexpr uint8_t CMD_SET_AUTO_FS = 0x9E;
+
+static constexpr uint8_t STANDBY_RC = 0x00;
+static constexpr uint8_t STANDBY_XOSC = 0x01;   // Crystal kept running for a quick SetTx
+static constexpr uint8_t PERIOD_BASE_1_MS = 0x02;
+
+// IRQ bits
+static constexpr uint16_t IRQ_TX_DONE = 0x0001;
+static constexpr uint16_t IRQ_RX_DONE = 0x0002;
+static constexpr uint16_t IRQ_HEADER_ERROR = 0x0020;
+static constexpr uint16_t IRQ_CRC_ERROR = 0x0040;
+static constexpr uint16_t IRQ_RX_TX_TIMEOUT = 0x4000;
+static constexpr uint16_t IRQ_STREAMING = IRQ_TX_DONE | IRQ_RX_DONE | IRQ_HEADER_ERROR | IRQ_CRC_ERROR |
+                                          IRQ_RX_TX_TIMEOUT;
+
+// Registers
+static constexpr uint16_t REG_SYNC_WORD_1 = 0x09CF;     // 4 bytes, GFSK and FLRC
+static constexpr uint16_t REG_LORA_SF_CONFIG = 0x0925;
+static constexpr uint16_t REG_LORA_FREQ_ERROR_CORRECTION = 0x093C;
+
+// Read commands return the status on the opcode and NOP bytes, data after
+static constexpr uint8_t READ_DATA_OFFSET = 2;
+// Payload position in the ReadBuffer (opcode, offset, NOP) and
+// WriteBuffer (opcode, offset) frames
+static constexpr uint8_t RX_PAYLOAD_OFFSET = 3;
+static constexpr uint8_t TX_PAYLOAD_OFFSET = 2;
+
+static void onDio1Edge(void* context, const GPIO::Event&)
+{
+    static_cast<SX1281*>(context)->handleDio1();
+}
+
+SX1281::Config SX1281::Config::flrc(uint8_t bitrate_bandwidth, uint8_t coding_rate)
+{
+    Config config;
+    config.modem = Modem::FLRC;
+    config.modulation[0] = bitrate_bandwidth;
+    config.modulation[1] = coding_rate;
+    config.modulation[2] = SHAPING_BT_0_5;
+    config.preamble = 0x30;
+    config.crc = 0x10;
+    return config;
+}
+
+SX1281::Config SX1281::Config::gfsk(uint8_t bitrate_bandwidth, uint8_t modulation_index)
+{
+    Config config;
+    config.modem = Modem::GFSK;
+    config.modulation[0] = bitrate_bandwidth;
+    config.modulation[1] = modulation_index;
+    config.modulation[2] = SHAPING_BT_0_5;
+    config.preamble = 0x30;
+    config.crc = 0x20;
+    return config;
+}
+
+SX1281::Config SX1281::Config::lora(uint8_t spreading_factor, uint8_t bandwidth, uint8_t coding_rate)
+{
+    Config config;
+    config.modem = Modem::LORA;
+    config.modulation[0] = spreading_factor;
+    config.modulation[1] = bandwidth;
+    config.modulation[2] = coding_rate;
+    config.preamble = 0x0C;   // 12 symbols
+    config.crc = 0x20;
+    return config;
+}
+
+SX1281::SX1281(SPIDevice& device, GPIO& busy, GPIO& reset, GPIO& dio1, GPIO* tx_enable, GPIO* rx_enable)
+    : device_(device),
+      busy_(busy),
+      reset_(reset),
+      dio1_(dio1),
+      tx_enable_(tx_enable),
+      rx_enable_(rx_enable),
+      config_{},
+      op_(Op::IDLE),
+      dio1_pending_(false),
+      waiting_busy_(false),
+      receiving_(false),
+      in_rx_(false),
+      tx_on_air_(false),
+      irq_status_(0),
+      rx_length_(0),
+      rx_offset_(0),
+      packet_length_(0),
+      tx_buffer_{},
+      rx_buffer_{},
+      tx_queue_{},
+      tx_head_(0),
+      tx_count_(0),
+      rx_queue_{},
+      rx_head_(0),
+      rx_count_(0),
+      stats_{}
+{
+}
+
+bool SX1281::begin(const Config& config)
+{
+    device_.begin();
+    busy_.mode(GPIO_MODE_INPUT);
+    if (tx_enable_ != nullptr) {
+        tx_enable_->low();
+        tx_enable_->mode(GPIO_MODE_OUTPUT_PP);
+    }
+    if (rx_enable_ != nullptr) {
+        rx_enable_->low();
+        rx_enable_->mode(GPIO_MODE_OUTPUT_PP);
+    }
+
+    // Hardware reset; BUSY stays high until the radio is in STDBY_RC
+    reset_.low();
+    reset_.mode(GPIO_MODE_OUTPUT_PP);
+    HAL_Delay(2);
+    reset_.high();
+    HAL_Delay(2);
+    if (!waitBusy(100)) {
+        return false;
+    }
+
+    // No radio on the bus reads as all zeros or all ones
+    const uint8_t get_status[2] = {CMD_GET_STATUS, 0x00};
+    uint8_t status[2] = {};
+    if (!device_.transfer(get_status, status, 2) || status[1] == 0x00 || status[1] == 0xFF) {
+        return false;
+    }
+
+    if (!dio1_.attachInterrupt(GPIO::Edge::RISING, onDio1Edge, this)) {
+        return false;
+    }
+    return configure(config);
+}
+
+bool SX1281::configure(const Config& config)
+{
+    if (!isIdle()) {
+        return false;
+    }
+    config_ = config;
+    if (!applyConfig()) {
+        return false;
+    }
+    kick();   // Back to RX if startReceive() is in effect
+    return true;
+}
+
+bool SX1281::waitBusy(uint32_t timeout)
+{
+    const uint32_t start = HAL_GetTick();
+    while (busy_.read()) {
+        if (HAL_GetTick() - start >= timeout) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SX1281::command(uint8_t opcode, const uint8_t* params, uint8_t length)
+{
+    uint8_t frame[16];
+    frame[0] = opcode;
+    memcpy(frame + 1, params, length);
+    return waitBusy(10) && device_.write(frame, length + 1);
+}
+
+bool SX1281::writeRegister(uint16_t address, const uint8_t* data, uint8_t length)
+{
+    uint8_t params[15];
+    params[0] = static_cast<uint8_t>(address >> 8);
+    params[1] = static_cast<uint8_t>(address);
+    memcpy(params + 2, data, length);
+    return command(CMD_WRITE_REGISTER, params, length + 2);
+}
+
+uint8_t SX1281::buildPacketParams(uint8_t* params, uint8_t payload_length) const
+{
+    memset(params, 0, 7);
+    params[0] = config_.preamble;
+    if (config_.modem == Modem::LORA) {
+        params[1] = 0x00;             // Explicit header
+        params[2] = payload_length;
+        params[3] = config_.crc;
+        params[4] = 0x40;             // Standard IQ
+    } else {
+        params[1] = config_.modem == Modem::FLRC ? 0x04 : 0x06;   // 32-bit / 4-byte sync word
+        params[2] = 0x10;             // Match sync word 1
+        params[3] = 0x20;             // Variable length
+        params[4] = payload_length;
+        params[5] = config_.crc;
+        params[6] = config_.modem == Modem::FLRC ? 0x08 : 0x00;   // FLRC needs whitening off
+    }
+    return 7;   // The command always takes seven parameters
+}
+
+bool SX1281::applyConfig()
+{
+    in_rx_ = false;
+    const uint32_t frequency = static_cast<uint32_t>((static_cast<uint64_t>(config_.frequency) << 18) / 52000000ULL);
+    const uint8_t standby[] = {STANDBY_RC};
+    const uint8_t regulator[] = {0x00};   // LDO; DC-DC needs the inductor fitted
+    const uint8_t packet_type[] = {static_cast<uint8_t>(config_.modem)};
+    const uint8_t rf_frequency[] = {static_cast<uint8_t>(frequency >> 16), static_cast<uint8_t>(frequency >> 8),
+                                    static_cast<uint8_t>(frequency)};
+    const uint8_t base_address[] = {0x00, 0x00};   // Half duplex: TX and RX share the 256 byte buffer
+    uint8_t power = static_cast<uint8_t>((config_.power < -18 ? -18 : config_.power > 13 ? 13 : config_.power) + 18);
+    const uint8_t tx_params[] = {power, 0x20};     // 4 us ramp
+    const uint8_t dio_irq[] = {IRQ_STREAMING >> 8, IRQ_STREAMING & 0xFF, IRQ_STREAMING >> 8, IRQ_STREAMING & 0xFF,
+                               0, 0, 0, 0};
+    const uint8_t auto_fs[] = {0x01};              // Stay in FS after TX/RX for a quick turnaround
+    const uint8_t clear_irq[] = {0xFF, 0xFF};
+    uint8_t packet_params[7];
+    buildPacketParams(packet_params, static_cast<uint8_t>(maxPayload()));
+
+    bool ok = command(CMD_SET_STANDBY, standby, 1) &&
+              command(CMD_SET_REGULATOR_MODE, regulator, 1) &&
+              command(CMD_SET_PACKET_TYPE, packet_type, 1) &&
+              command(CMD_SET_RF_FREQUENCY, rf_frequency, 3) &&
+              command(CMD_SET_BUFFER_BASE_ADDRESS, base_address, 2) &&
+              command(CMD_SET_MODULATION_PARAMS, config_.modulation, 3) &&
+              command(CMD_SET_PACKET_PARAMS, packet_params, 7) &&
+              command(CMD_SET_TX_PARAMS, tx_params, 2) &&
+              command(CMD_SET_DIO_IRQ_PARAMS, dio_irq, 8) &&
+              command(CMD_SET_AUTO_FS, auto_fs, 1) &&
+              command(CMD_CLR_IRQ_STATUS, clear_irq, 2);
+
+    if (ok && config_.modem == Modem::LORA) {
+        // Spreading factor dependent settings (datasheet section 14.4.1)
+        const uint8_t sf = config_.modulation[0];
+        const uint8_t sf_config[] = {static_cast<uint8_t>(sf <= 0x60 ? 0x1E : sf <= 0x80 ? 0x37 : 0x32)};
+        const uint8_t correction[] = {0x01};
+        ok = writeRegister(REG_LORA_SF_CONFIG, sf_config, 1) &&
+             writeRegister(REG_LORA_FREQ_ERROR_CORRECTION, correction, 1);
+    } else if (ok) {
+        const uint8_t sync_word[] = {static_cast<uint8_t>(config_.sync_word >> 24),
+                                     static_cast<uint8_t>(config_.sync_word >> 16),
+                                     static_cast<uint8_t>(config_.sync_word >> 8),
+                                     static_cast<uint8_t>(config_.sync_word)};
+        ok = writeRegister(REG_SYNC_WORD_1, sync_word, 4);
+    }
+    packet_length_ = static_cast<uint8_t>(maxPayload());
+    return ok;
+}
+
+bool SX1281::startReceive()
+{
+    receiving_ = true;
+    kick();
+    return true;
+}
+
+void SX1281::stopReceive()
+{
+    receiving_ = false;
+    kick();   // Standby once the running sequence is done
+}
+
+bool SX1281::send(const uint8_t* data, uint16_t length)
+{
+    const uint16_t min_length = config_.modem == Modem::FLRC ? 6 : 1;
+    if (data == nullptr || length < min_length || length > maxPayload()) {
+        return false;
+    }
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (tx_count_ == TX_QUEUE_SIZE) {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    TxSlot& slot = tx_queue_[(tx_head_ + tx_count_) % TX_QUEUE_SIZE];
+    __set_PRIMASK(primask);
+
+    // The slot is not the interrupt's until it is counted
+    slot.frame[0] = CMD_WRITE_BUFFER;
+    slot.frame[1] = 0x00;   // Buffer offset
+    memcpy(slot.frame + TX_PAYLOAD_OFFSET, data, length);
+    slot.length = static_cast<uint8_t>(length);
+
+    __disable_irq();
+    tx_count_ = tx_count_ + 1;
+    if (op_ == Op::IDLE && !waiting_busy_) {
+        nextOp();
+    }
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool SX1281::receive(Packet& packet)
+{
+    const uint8_t* data = peek(packet.length, &packet.rssi, &packet.snr);
+    if (data == nullptr) {
+        return false;
+    }
+    memcpy(packet.data, data, packet.length);
+    release();
+    return true;
+}
+
+const uint8_t* SX1281::peek(uint8_t& length, int16_t* rssi, int8_t* snr) const
+{
+    // The interrupt only fills slots past the counted ones
+    if (rx_count_ == 0) {
+        return nullptr;
+    }
+    const RxSlot& slot = rx_queue_[rx_head_];
+    length = slot.length;
+    if (rssi != nullptr) *rssi = slot.rssi;
+    if (snr != nullptr) *snr = slot.snr;
+    return slot.frame + RX_PAYLOAD_OFFSET;
+}
+
+void SX1281::release()
+{
+    if (rx_count_ == 0) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rx_head_ = (rx_head_ + 1) % RX_QUEUE_SIZE;
+    rx_count_ = rx_count_ - 1;
+    __set_PRIMASK(primask);
+}
+
+void SX1281::handleDio1()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    dio1_pending_ = true;
+    if (op_ == Op::IDLE && !waiting_busy_) {
+        nextOp();
+    }
+    __set_PRIMASK(primask);
+}
+
+void SX1281::update()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (waiting_busy_ && !busy_.read()) {
+        waiting_busy_ = false;
+        startOp(op_);
+    } else if (op_ == Op::IDLE && !waiting_busy_) {
+        // DIO1 stays high until cleared, so a missed edge is still seen here
+        if (dio1_.read()) {
+            dio1_pending_ = true;
+        }
+        nextOp();
+    }
+    __set_PRIMASK(primask);
+}
+
+void SX1281::kick()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (op_ == Op::IDLE && !waiting_busy_) {
+        nextOp();
+    }
+    __set_PRIMASK(primask);
+}
+
+void SX1281::setFrontEnd(bool tx, bool rx)
+{
+    if (tx_enable_ != nullptr) tx_enable_->write(tx);
+    if (rx_enable_ != nullptr) rx_enable_->write(rx);
+}
+
+// Pick the next streaming command with the sequence idle: interrupt status
+// first, then a queued packet, then back to RX. Runs with interrupts
+// disabled or from the SPI completion interrupt.
+void SX1281::nextOp()
+{
+    op_ = Op::IDLE;
+    if (dio1_pending_) {
+        dio1_pending_ = false;
+        startOp(Op::GET_IRQ);
+    } else if (tx_count_ > 0 && !tx_on_air_) {
+        startOp(in_rx_ ? Op::STANDBY : Op::WRITE_BUFFER);
+    } else if (receiving_ && !in_rx_ && !tx_on_air_) {
+        startOp(packet_length_ == maxPayload() ? Op::SET_RX : Op::RX_PACKET_PARAMS);
+    } else if (!receiving_ && in_rx_) {
+        startOp(Op::STANDBY);
+    }
+}
+
+// Start one command's DMA transfer, or leave it for update() while BUSY
+// is high
+bool SX1281::startOp(Op op)
+{
+    op_ = op;
+    if (busy_.read()) {
+        waiting_busy_ = true;
+        return true;
+    }
+
+    uint16_t length = 0;
+    const uint8_t* tx = tx_buffer_;
+    uint8_t* rx = nullptr;
+    const TxSlot& tx_slot = tx_queue_[tx_head_];
+    switch (op) {
+        case Op::GET_IRQ:
+            tx_buffer_[0] = CMD_GET_IRQ_STATUS;
+            memset(tx_buffer_ + 1, 0, 3);
+            length = 4;
+            rx = rx_buffer_;
+            break;
+        case Op::CLEAR_IRQ:
+            tx_buffer_[0] = CMD_CLR_IRQ_STATUS;
+            tx_buffer_[1] = static_cast<uint8_t>(irq_status_ >> 8);
+            tx_buffer_[2] = static_cast<uint8_t>(irq_status_);
+            length = 3;
+            break;
+        case Op::RX_BUFFER_STATUS:
+            tx_buffer_[0] = CMD_GET_RX_BUFFER_STATUS;
+            memset(tx_buffer_ + 1, 0, 3);
+            length = 4;
+            rx = rx_buffer_;
+            break;
+        case Op::READ_BUFFER:
+            tx_buffer_[0] = CMD_READ_BUFFER;
+            tx_buffer_[1] = rx_offset_;
+            memset(tx_buffer_ + 2, 0, rx_length_ + 1);
+            length = rx_length_ + RX_PAYLOAD_OFFSET;
+            rx = rx_queue_[(rx_head_ + rx_count_) % RX_QUEUE_SIZE].frame;
+            break;
+        case Op::PACKET_STATUS:
+            tx_buffer_[0] = CMD_GET_PACKET_STATUS;
+            memset(tx_buffer_ + 1, 0, 6);
+            length = 7;
+            rx = rx_buffer_;
+            break;
+        case Op::STANDBY:
+            tx_buffer_[0] = CMD_SET_STANDBY;
+            tx_buffer_[1] = STANDBY_XOSC;
+            length = 2;
+            break;
+        case Op::WRITE_BUFFER:
+            tx = tx_slot.frame;
+            length = tx_slot.length + TX_PAYLOAD_OFFSET;
+            break;
+        case Op::TX_PACKET_PARAMS:
+            tx_buffer_[0] = CMD_SET_PACKET_PARAMS;
+            length = buildPacketParams(tx_buffer_ + 1, tx_slot.length) + 1;
+            break;
+        case Op::SET_TX:
+            setFrontEnd(true, false);
+            tx_buffer_[0] = CMD_SET_TX;
+            tx_buffer_[1] = PERIOD_BASE_1_MS;
+            tx_buffer_[2] = 0x00;   // No timeout, TX done always comes
+            tx_buffer_[3] = 0x00;
+            length = 4;
+            break;
+        case Op::RX_PACKET_PARAMS:
+            tx_buffer_[0] = CMD_SET_PACKET_PARAMS;
+            length = buildPacketParams(tx_buffer_ + 1, static_cast<uint8_t>(maxPayload())) + 1;
+            break;
+        case Op::SET_RX:
+            setFrontEnd(false, true);
+            tx_buffer_[0] = CMD_SET_RX;
+            tx_buffer_[1] = PERIOD_BASE_1_MS;
+            tx_buffer_[2] = 0xFF;   // Continuous: stays in RX after each packet
+            tx_buffer_[3] = 0xFF;
+            length = 4;
+            break;
+        case Op::IDLE:
+            return true;
+    }
+
+    if (!device_.transferAsync(tx, rx, length,
+                               [this](bool ok) { onTransferDone(ok); })) {
+        stats_.spi_errors++;
+        op_ = Op::IDLE;
+        return false;
+    }
+    return true;
+}
+
+// SPI completion interrupt: act on the finished command, start the next
+void SX1281::onTransferDone(bool ok)
+{
+    const Op done = op_;
+    if (!ok) {
+        stats_.spi_errors++;
+        if (done == Op::GET_IRQ || done == Op::CLEAR_IRQ) {
+            dio1_pending_ = true;   // Try the interrupt status again
+        }
+        nextOp();
+        return;
+    }
+
+    switch (done) {
+        case Op::GET_IRQ:
+            irq_status_ = static_cast<uint16_t>((rx_buffer_[READ_DATA_OFFSET] << 8) |
+                                                rx_buffer_[READ_DATA_OFFSET + 1]);
+            if (irq_status_ == 0) {
+                break;
+            }
+            startOp(Op::CLEAR_IRQ);
+            return;
+
+        case Op::CLEAR_IRQ:
+            // An interrupt raised after GetIrqStatus keeps DIO1 high
+            // without a new edge
+            if (dio1_.read()) {
+                dio1_pending_ = true;
+            }
+            if (irq_status_ & IRQ_TX_DONE) {
+                tx_on_air_ = false;
+                tx_head_ = (tx_head_ + 1) % TX_QUEUE_SIZE;
+                tx_count_ = tx_count_ - 1;
+                stats_.sent++;
+                setFrontEnd(false, false);
+            }
+            if (irq_status_ & IRQ_RX_TX_TIMEOUT) {
+                stats_.timeouts++;
+                if (tx_on_air_) {
+                    tx_on_air_ = false;
+                    tx_head_ = (tx_head_ + 1) % TX_QUEUE_SIZE;
+                    tx_count_ = tx_count_ - 1;
+                } else {
+                    in_rx_ = false;
+                }
+                setFrontEnd(false, false);
+            }
+            if (irq_status_ & IRQ_RX_DONE) {
+                if (irq_status_ & (IRQ_CRC_ERROR | IRQ_HEADER_ERROR)) {
+                    stats_.crc_errors++;
+                } else {
+                    startOp(Op::RX_BUFFER_STATUS);
+                    return;
+                }
+            }
+            break;
+
+        case Op::RX_BUFFER_STATUS:
+            rx_length_ = rx_buffer_[READ_DATA_OFFSET];
+            rx_offset_ = rx_buffer_[READ_DATA_OFFSET + 1];
+            if (rx_length_ == 0) {
+                break;
+            }
+            if (rx_count_ == RX_QUEUE_SIZE) {
+                stats_.rx_dropped++;
+                break;
+            }
+            startOp(Op::READ_BUFFER);
+            return;
+
+        case Op::READ_BUFFER:
+            // The payload is in its slot already; counted after its status
+            rx_queue_[(rx_head_ + rx_count_) % RX_QUEUE_SIZE].length = rx_length_;
+            startOp(Op::PACKET_STATUS);
+            return;
+
+        case Op::PACKET_STATUS: {
+            RxSlot& slot = rx_queue_[(rx_head_ + rx_count_) % RX_QUEUE_SIZE];
+            const uint8_t* status = rx_buffer_ + READ_DATA_OFFSET;
+            if (config_.modem == Modem::LORA) {
+                slot.rssi = static_cast<int16_t>(-(status[0] / 2));
+                slot.snr = static_cast<int8_t>(static_cast<int8_t>(status[1]) / 4);
+            } else {
+                slot.rssi = static_cast<int16_t>(-(status[1] / 2));
+                slot.snr = 0;
+            }
+            rx_count_ = rx_count_ + 1;
+            stats_.received++;
+            break;
+        }
+
+        case Op::STANDBY:
+            in_rx_ = false;
+            setFrontEnd(false, false);
+            if (tx_count_ > 0) {
+                startOp(Op::WRITE_BUFFER);
+                return;
+            }
+            break;
+
+        case Op::WRITE_BUFFER:
+            startOp(packet_length_ == tx_queue_[tx_head_].length ? Op::SET_TX : Op::TX_PACKET_PARAMS);
+            return;
+
+        case Op::TX_PACKET_PARAMS:
+            packet_length_ = tx_queue_[tx_head_].length;
+            startOp(Op::SET_TX);
+            return;
+
+        case Op::SET_TX:
+            tx_on_air_ = true;
+            break;
+
+        case Op::RX_PACKET_PARAMS:
+            packet_length_ = static_cast<uint8_t>(maxPayload());
+            startOp(Op::SET_RX);
+            return;
+
+        case Op::SET_RX:
+            in_rx_ = true;
+            break;
+
+        case Op::IDLE:
+            break;
+    }
+    nextOp();
+}
+
+#endif
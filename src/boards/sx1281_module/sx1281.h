@@ -0,0 +1,254 @@
+#pragma once
+
+#include "stm32h5xx_hal.h"
+#include <bus_device.h>
+#include <gpio.h>
+#include <cstdint>
+
+// SX1281 2.4 GHz transceiver (GFSK, FLRC and LoRa)
+//
+// Configuration (begin(), configure()) uses blocking SPI commands. After
+// that the radio streams from interrupts: DIO1 signals TX done, RX done
+// and errors, and every command after it (status, buffer reads and
+// writes, the next TX or RX) is a queued DMA transfer started from the
+// previous one's completion. When BUSY is still high at that point the
+// sequence pauses until the next update() instead of spinning on it.
+// Usage Example:
+//   radio.begin(SX1281::Config::flrc());   // 1.3 Mb/s, 2440 MHz
+//   radio.startReceive();
+//
+//   void loop() {
+//       GPIO::dispatchInterrupts();   // Delivers DIO1
+//       radio.update();
+//
+//       SX1281::Packet packet;
+//       while (radio.receive(packet)) { ... packet.data, packet.length, packet.rssi ... }
+//
+//       radio.send(telemetry, sizeof(telemetry));  // false while the TX queue is full
+//   }
+//
+// Sending leaves receive mode for the packet and returns to it after
+// TX done. FLRC payloads are 6 to 127 bytes, GFSK and LoRa 1 to 255.
+//
+// The queue slots are the DMA buffers: a packet is read from the radio
+// straight into its RX slot and sent from its TX slot, so send() is the
+// only copy on the way out and peek()/release() none on the way in.
+class SX1281
+{
+public:
+    enum class Modem : uint8_t {
+        GFSK = 0x00,
+        LORA = 0x01,
+        FLRC = 0x03
+    };
+
+    // SetModulationParams values (datasheet section 14.4)
+    static constexpr uint8_t GFSK_BR_2_000_BW_2_4 = 0x04;
+    static constexpr uint8_t GFSK_BR_1_000_BW_1_2 = 0x45;
+    static constexpr uint8_t GFSK_BR_0_500_BW_0_6 = 0x8E;
+    static constexpr uint8_t GFSK_BR_0_250_BW_0_3 = 0xC7;
+    static constexpr uint8_t GFSK_MOD_IND_0_5 = 0x01;
+    static constexpr uint8_t GFSK_MOD_IND_1_0 = 0x03;
+    static constexpr uint8_t FLRC_BR_1_300_BW_1_2 = 0x45;
+    static constexpr uint8_t FLRC_BR_1_040_BW_1_2 = 0x69;
+    static constexpr uint8_t FLRC_BR_0_650_BW_0_6 = 0x86;
+    static constexpr uint8_t FLRC_BR_0_325_BW_0_3 = 0xC7;
+    static constexpr uint8_t FLRC_CR_1_2 = 0x00;
+    static constexpr uint8_t FLRC_CR_3_4 = 0x02;
+    static constexpr uint8_t FLRC_CR_1_0 = 0x04;
+    static constexpr uint8_t SHAPING_OFF = 0x00;
+    static constexpr uint8_t SHAPING_BT_0_5 = 0x20;
+    static constexpr uint8_t LORA_SF5 = 0x50;
+    static constexpr uint8_t LORA_SF7 = 0x70;
+    static constexpr uint8_t LORA_SF9 = 0x90;
+    static constexpr uint8_t LORA_SF12 = 0xC0;
+    static constexpr uint8_t LORA_BW_1600 = 0x0A;
+    static constexpr uint8_t LORA_BW_800 = 0x18;
+    static constexpr uint8_t LORA_BW_400 = 0x26;
+    static constexpr uint8_t LORA_BW_200 = 0x34;
+    static constexpr uint8_t LORA_CR_4_5 = 0x01;
+    static constexpr uint8_t LORA_CR_4_8 = 0x04;
+
+    struct Config
+    {
+        Modem modem = Modem::FLRC;
+        uint32_t frequency = 2440000000;   // Hz
+        int8_t power = 10;                 // dBm, -18 to 13
+        uint8_t modulation[3] = {FLRC_BR_1_300_BW_1_2, FLRC_CR_3_4, SHAPING_BT_0_5};
+        uint8_t preamble = 0x30;           // GFSK/FLRC: 16 bits; LoRa: symbols (mantissa | exponent << 4)
+        uint8_t crc = 0x10;                // GFSK: 0x20 = 2 bytes, FLRC 0x10 = 2 bytes, LoRa 0x20 = on
+        uint32_t sync_word = 0x2D30AC59;   // GFSK/FLRC; must match on both ends
+
+        static Config flrc(uint8_t bitrate_bandwidth = FLRC_BR_1_300_BW_1_2, uint8_t coding_rate = FLRC_CR_3_4);
+        static Config gfsk(uint8_t bitrate_bandwidth = GFSK_BR_2_000_BW_2_4,
+                           uint8_t modulation_index = GFSK_MOD_IND_0_5);
+        static Config lora(uint8_t spreading_factor = LORA_SF7, uint8_t bandwidth = LORA_BW_1600,
+                           uint8_t coding_rate = LORA_CR_4_5);
+    };
+
+    static constexpr uint16_t MAX_PAYLOAD = 255;
+
+    struct Packet
+    {
+        uint8_t length;
+        uint8_t data[MAX_PAYLOAD];
+        int16_t rssi;   // dBm at the sync word / header
+        int8_t snr;     // dB, LoRa only
+    };
+
+    struct Stats
+    {
+        uint32_t sent;
+        uint32_t received;
+        uint32_t crc_errors;
+        uint32_t timeouts;
+        uint32_t rx_dropped;   // Received while the RX queue was full
+        uint32_t spi_errors;
+    };
+
+    SX1281() = delete;
+    SX1281(SPIDevice& device, GPIO& busy, GPIO& reset, GPIO& dio1, GPIO* tx_enable = nullptr,
+           GPIO* rx_enable = nullptr);
+
+    /**
+     * @brief Reset the radio and apply @p config
+     * @return false if the radio does not answer or a command fails
+     *
+     * The SPI bus must be started with DMA (SPI::beginDma()) first.
+     */
+    bool begin(const Config& config);
+
+    /**
+     * @brief Switch modem or channel settings (blocking)
+     * @return false while packets are queued or in flight, or on a command error
+     */
+    bool configure(const Config& config);
+
+    // Listen continuously; received packets go to the RX queue
+    bool startReceive();
+    // Leave RX (standby) once the running command sequence is done
+    void stopReceive();
+
+    /**
+     * @brief Queue a packet for transmission
+     * @return false if the TX queue is full or @p length is out of range
+     */
+    bool send(const uint8_t* data, uint16_t length);
+
+    // Take the oldest received packet
+    bool receive(Packet& packet);
+
+    /**
+     * @brief The oldest received packet, in place in the RX queue
+     * @return Its payload, valid until release(); nullptr if none
+     */
+    const uint8_t* peek(uint8_t& length, int16_t* rssi = nullptr, int8_t* snr = nullptr) const;
+
+    // Free the packet peek() returned
+    void release();
+
+    /**
+     * @brief Resume a command sequence that found BUSY high
+     *
+     * Call from the main loop. With the sequence idle it only checks the
+     * DIO1 level, which catches an interrupt whose edge was missed.
+     */
+    void update();
+
+    // Packets waiting to be sent, including the one on air
+    uint8_t txPending() const { return tx_count_; }
+    uint8_t rxAvailable() const { return rx_count_; }
+    bool isIdle() const { return op_ == Op::IDLE && tx_count_ == 0 && !dio1_pending_; }
+    const Stats& getStats() const { return stats_; }
+
+    // Called for DIO1 rising edges (begin() attaches it)
+    void handleDio1();
+
+private:
+    // Streaming command being transferred (or waiting for BUSY)
+    enum class Op : uint8_t {
+        IDLE,
+        GET_IRQ,
+        CLEAR_IRQ,
+        RX_BUFFER_STATUS,
+        READ_BUFFER,
+        PACKET_STATUS,
+        STANDBY,
+        WRITE_BUFFER,
+        TX_PACKET_PARAMS,
+        SET_TX,
+        RX_PACKET_PARAMS,
+        SET_RX
+    };
+
+    static constexpr uint8_t TX_QUEUE_SIZE = 4;
+    static constexpr uint8_t RX_QUEUE_SIZE = 4;
+    static constexpr uint16_t BUFFER_SIZE = MAX_PAYLOAD + 3;
+
+    // Queue slots hold the whole SPI frame: WriteBuffer's opcode and
+    // offset before the payload, ReadBuffer's status bytes before it
+    struct TxSlot
+    {
+        uint8_t frame[BUFFER_SIZE];
+        uint8_t length;
+    };
+
+    struct RxSlot
+    {
+        uint8_t frame[BUFFER_SIZE];
+        uint8_t length;
+        int16_t rssi;
+        int8_t snr;
+    };
+
+    SPIDevice& device_;
+    GPIO& busy_;
+    GPIO& reset_;
+    GPIO& dio1_;
+    GPIO* tx_enable_;
+    GPIO* rx_enable_;
+    Config config_;
+
+    // State of the streaming sequence, shared with the SPI interrupt and
+    // changed with interrupts disabled
+    volatile Op op_;
+    volatile bool dio1_pending_;
+    volatile bool waiting_busy_;
+    bool receiving_;       // startReceive() is in effect
+    bool in_rx_;           // The radio is in RX mode
+    bool tx_on_air_;       // SetTx issued, TX done not seen yet
+    uint16_t irq_status_;
+    uint8_t rx_length_;
+    uint8_t rx_offset_;
+    uint8_t packet_length_;   // Payload length in the radio's packet params
+
+    // Commands (ReadBuffer's padded to the packet length) and short
+    // responses; packets use the queue slots
+    uint8_t tx_buffer_[BUFFER_SIZE];
+    uint8_t rx_buffer_[16];
+
+    TxSlot tx_queue_[TX_QUEUE_SIZE];
+    uint8_t tx_head_;
+    volatile uint8_t tx_count_;
+    RxSlot rx_queue_[RX_QUEUE_SIZE];
+    uint8_t rx_head_;
+    volatile uint8_t rx_count_;
+
+    Stats stats_;
+
+    // Blocking commands for configuration
+    bool waitBusy(uint32_t timeout);
+    bool command(uint8_t opcode, const uint8_t* params, uint8_t length);
+    bool writeRegister(uint16_t address, const uint8_t* data, uint8_t length);
+    bool applyConfig();
+
+    uint16_t maxPayload() const { return config_.modem == Modem::FLRC ? 127 : MAX_PAYLOAD; }
+    uint8_t buildPacketParams(uint8_t* params, uint8_t payload_length) const;
+    void setFrontEnd(bool tx, bool rx);
+
+    // Streaming sequence
+    void kick();
+    void nextOp();
+    bool startOp(Op op);
+    void onTransferDone(bool ok);
+};
@@ -7,6 +7,30 @@
 
 #include "sx1281_module.h"
 #include "main.h"
+#include "board_pins.h"   // Generated from config.yaml
+
+/* System clock profile, selected with 'clock:' in project.yaml (the builder
+ * defines LUMOS_CLOCK_<PROFILE>). PLL1 input = HSI 64 MHz / 32 = 2 MHz.
+ *   max:       250 MHz, VOS0
+ *   balanced:  150 MHz, VOS2
+ *   low_power:  50 MHz, VOS3
+ * PLL1Q stays on in every profile, it is the SPI kernel clock. */
+#if defined(LUMOS_CLOCK_LOW_POWER)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE3
+#define CLOCK_PLL1N           100
+#define CLOCK_PLL1PQ          4
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_2
+#elif defined(LUMOS_CLOCK_BALANCED)
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE2
+#define CLOCK_PLL1N           150
+#define CLOCK_PLL1PQ          2
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_4
+#else
+#define CLOCK_VOLTAGE_SCALE   PWR_REGULATOR_VOLTAGE_SCALE0
+#define CLOCK_PLL1N           250
+#define CLOCK_PLL1PQ          2
+#define CLOCK_FLASH_LATENCY   FLASH_LATENCY_5
+#endif
 
 /**
   * @brief System Clock Configuration
@@ -19,7 +43,7 @@ void SystemClock_Config(void)
 
   /** Configure the main internal regulator output voltage
   */
-  __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE0);
+  __HAL_PWR_VOLTAGESCALING_CONFIG(CLOCK_VOLTAGE_SCALE);
 
   while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
 
@@ -33,9 +57,9 @@ void SystemClock_Config(void)
   RCC_OscInitStruct.PLL1.PLLState = RCC_PLL_ON;
   RCC_OscInitStruct.PLL1.PLLSource = RCC_PLLSOURCE_HSI;
   RCC_OscInitStruct.PLL1.PLLM = 32;
-  RCC_OscInitStruct.PLL1.PLLN = 250;
-  RCC_OscInitStruct.PLL1.PLLP = 2;
-  RCC_OscInitStruct.PLL1.PLLQ = 2;
+  RCC_OscInitStruct.PLL1.PLLN = CLOCK_PLL1N;
+  RCC_OscInitStruct.PLL1.PLLP = CLOCK_PLL1PQ;
+  RCC_OscInitStruct.PLL1.PLLQ = CLOCK_PLL1PQ;
   RCC_OscInitStruct.PLL1.PLLR = 2;
   RCC_OscInitStruct.PLL1.PLLS = 2;
   RCC_OscInitStruct.PLL1.PLLT = 2;
@@ -59,7 +83,7 @@ void SystemClock_Config(void)
   RCC_ClkInitStruct.APB2CLKDivider = RCC_APB2_DIV1;
   RCC_ClkInitStruct.APB3CLKDivider = RCC_APB3_DIV1;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_5) != HAL_OK)
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, CLOCK_FLASH_LATENCY) != HAL_OK)
   {
     Error_Handler();
   }
@@ -88,3 +112,41 @@ extern "C" void SX1281Module_Init(void)
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
 }
+
+#if !defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_SPI)
+// ===========================
+// SX1281 Radio
+// ===========================
+
+using RadioPins = BoardPins::SPI1_SX1281;
+using RadioCtrlPins = BoardPins::SX1281_CTRL_PINS;
+
+SPI spi_radio{SPI1, RadioPins::MOSI.port(), RadioPins::MOSI.pin, RadioPins::MISO.port(), RadioPins::MISO.pin,
+              RadioPins::SCK.port(), RadioPins::SCK.pin, RadioPins::AF};
+
+// Mode 0, up to 18 MHz on the SX1281
+static SPIDevice radio_device{spi_radio, RadioPins::NSS.port(), RadioPins::NSS.pin, SPIConfig{10000000}};
+static GPIO radio_busy{RadioCtrlPins::BUSY.port(), RadioCtrlPins::BUSY.pin};
+static GPIO radio_reset{RadioCtrlPins::NRESET.port(), RadioCtrlPins::NRESET.pin};
+static GPIO radio_dio1{RadioCtrlPins::DIO1.port(), RadioCtrlPins::DIO1.pin};
+static GPIO radio_tx_enable{RadioCtrlPins::TX_EN.port(), RadioCtrlPins::TX_EN.pin};
+static GPIO radio_rx_enable{RadioCtrlPins::RX_EN.port(), RadioCtrlPins::RX_EN.pin};
+
+SX1281 radio{radio_device, radio_busy, radio_reset, radio_dio1, &radio_tx_enable, &radio_rx_enable};
+
+bool beginRadio(const SX1281::Config& config)
+{
+  spi_radio.begin(10000000);
+  if (!spi_radio.beginDma(reinterpret_cast<SpiDmaInstance*>(RadioPins::DMA_TX), GPDMA1_REQUEST_SPI1_TX,
+                          RadioPins::DMA_TX_IRQ,
+                          reinterpret_cast<SpiDmaInstance*>(RadioPins::DMA_RX), GPDMA1_REQUEST_SPI1_RX,
+                          RadioPins::DMA_RX_IRQ, SPI1_IRQn)) {
+    return false;
+  }
+  return radio.begin(config);
+}
+
+extern "C" void GPDMA1_Channel0_IRQHandler(void) { spi_radio.handleTxDmaInterrupt(); }
+extern "C" void GPDMA1_Channel1_IRQHandler(void) { spi_radio.handleRxDmaInterrupt(); }
+extern "C" void SPI1_IRQHandler(void) { spi_radio.handleInterrupt(); }
+#endif
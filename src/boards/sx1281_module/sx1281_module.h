@@ -21,4 +21,18 @@ void SX1281Module_Init(void);
 }
 #endif
 
+#ifdef __cplusplus
+#include "sx1281.h"
+
+/* SX1281 on SPI1: PA5 (SCK), PA6 (MISO), PA7 (MOSI), PA4 (NSS)
+ * BUSY PA8, NRESET PA9, DIO1 PB15, TX_EN PA10, RX_EN PA1
+ * SPI1 moves data with GPDMA1 Channel0 (TX) and Channel1 (RX); the DMA
+ * and SPI1 interrupts are forwarded to spi_radio. */
+extern SPI spi_radio;
+extern SX1281 radio;
+
+/* Start SPI1 with DMA at 10 MHz, reset the radio and apply config */
+bool beginRadio(const SX1281::Config& config = SX1281::Config::flrc());
+#endif
+
 #endif /* __SX1281_MODULE_H */
@@ -110,6 +110,7 @@
   */
 
 #include "stm32h5xx.h"
+#include "boot_profile.h"
 
 /**
   * @}
@@ -200,6 +201,9 @@ void SystemInit(void)
 {
   uint32_t reg_opsr;
 
+  /* Cycle count from reset, for the boot time breakdown */
+  BootProfileStart();
+
   /* FPU settings ------------------------------------------------------------*/
   #if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
    SCB->CPACR |= ((3UL << 20U)|(3UL << 22U));  /* set CP10 and CP11 Full Access */
@@ -1,23 +1,58 @@
 #include "application.h"
 
-#include <iostream>
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+// Steps are timed with the DWT cycle counter where there is one
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+#define LUMOS_CYCLE_STEP_CLOCK
+#endif
+#else
 #include <chrono>
-#include <iomanip>
-#include <ctime>
+#endif
+
+// Firmware is built with -fno-exceptions, so exceptions from Init(), Step()
+// and DeInit() are only caught in host builds
+#if defined(__cpp_exceptions)
+#define LUMOS_FRAMEWORK_EXCEPTIONS
+#include <exception>
+#endif
 
 namespace Lumos
 {
 
+    namespace
+    {
+        LUMOS_LOG_MESSAGE(kInitializing, Info, "Initializing application");
+        LUMOS_LOG_MESSAGE(kInitialized, Info, "Application initialized successfully");
+        LUMOS_LOG_MESSAGE(kShuttingDown, Info, "Shutting down application");
+        LUMOS_LOG_MESSAGE(kShutDown, Info, "Application shut down successfully");
+        LUMOS_LOG_MESSAGE(kStatistics, Info, "Application statistics: %ld steps, average step time %ld us");
+        LUMOS_LOG_MESSAGE(kStepTimeRange, Info, "  Min step time: %ld us, max step time: %ld us");
+        LUMOS_LOG_MESSAGE(kJitter, Info, "  Average jitter: %ld us, max jitter: %ld us");
+        LUMOS_LOG_MESSAGE(kPercentile, Info, "  99th percentile step time: <= %ld us");
+        LUMOS_LOG_MESSAGE(kDeadlines, Info, "  Deadline misses: %ld, max lateness %ld us");
+        LUMOS_LOG_MESSAGE(kRateDegraded, Warning, "Missed %ld deadlines in a row, rate lowered to %ld Hz");
+
+        int32_t ToLogArgument(uint64_t value)
+        {
+            return value > INT32_MAX ? INT32_MAX : static_cast<int32_t>(value);
+        }
+    }
+
     // Constructor
     ApplicationBase::ApplicationBase()
-        : state_(ApplicationState::CREATED), metadata_(), stats_(), last_error_("")
+        : state_(ApplicationState::CREATED), metadata_(), stats_(), last_error_(),
+          log_source_(static_cast<uint16_t>(GetLogMessageId(metadata_.name.c_str()))),
+          histogram_enabled_(false), ticks_per_us_(1), last_start_ticks_(0), has_last_start_(false)
     {
     }
 
-    ApplicationBase::ApplicationBase(const std::string &name, const std::string &version)
-        : state_(ApplicationState::CREATED), metadata_(), stats_(), last_error_("")
+    ApplicationBase::ApplicationBase(const char *name, const char *version)
+        : state_(ApplicationState::CREATED), metadata_(), stats_(), last_error_(),
+          log_source_(0), histogram_enabled_(false), ticks_per_us_(1), last_start_ticks_(0), has_last_start_(false)
     {
-        metadata_.name = name;
+        SetName(name);
         metadata_.version = version;
     }
 
@@ -40,29 +75,45 @@ namespace Lumos
             return;
         }
 
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         try
+#endif
         {
-            LogInfo("Initializing application: " + metadata_.name);
+            Log(kInitializing);
 
             state_ = ApplicationState::INITIALIZED;
 
+            // The core clock is final by now; without the cycle counter
+            // (not enabled, or Cortex-M0+) steps are timed in microseconds
+            ticks_per_us_ = 1;
+#ifdef LUMOS_CYCLE_STEP_CLOCK
+            if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0 && SystemCoreClock >= 1000000)
+            {
+                ticks_per_us_ = SystemCoreClock / 1000000;
+            }
+#endif
+            has_last_start_ = false;
+
             // Call user implementation
             Init();
 
             stats_.init_count++;
 
-            LogInfo("Application initialized successfully");
+            Log(kInitialized);
         }
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         catch (const std::exception &e)
         {
-            SetError(std::string("Exception during Init(): ") + e.what());
-            LogError("Initialization failed: " + last_error_);
+            ApplicationError error("Exception during Init(): ");
+            SetError(error.Append(e.what()).c_str());
+            LogFailure("Initialization failed: ");
         }
         catch (...)
         {
             SetError("Unknown exception during Init()");
-            LogError("Initialization failed: " + last_error_);
+            LogFailure("Initialization failed: ");
         }
+#endif
     }
 
     void ApplicationBase::Execute()
@@ -81,31 +132,35 @@ namespace Lumos
             state_ = ApplicationState::RUNNING;
         }
 
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         try
+#endif
         {
             // Measure execution time
-            uint64_t start_time = GetCurrentTimeUs();
+            const uint32_t start_ticks = GetStepTicks();
 
             // Call user implementation
             Step();
 
-            uint64_t end_time = GetCurrentTimeUs();
-            uint64_t step_time = end_time - start_time;
+            const uint32_t end_ticks = GetStepTicks();
 
             // Update statistics
             stats_.step_count++;
-            UpdateStepTiming(step_time);
+            UpdateStepTiming(start_ticks, end_ticks);
         }
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         catch (const std::exception &e)
         {
-            SetError(std::string("Exception during Step(): ") + e.what());
-            LogError("Step execution failed: " + last_error_);
+            ApplicationError error("Exception during Step(): ");
+            SetError(error.Append(e.what()).c_str());
+            LogFailure("Step execution failed: ");
         }
         catch (...)
         {
             SetError("Unknown exception during Step()");
-            LogError("Step execution failed: " + last_error_);
+            LogFailure("Step execution failed: ");
         }
+#endif
     }
 
     void ApplicationBase::Shutdown()
@@ -116,9 +171,11 @@ namespace Lumos
             return;
         }
 
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         try
+#endif
         {
-            LogInfo("Shutting down application: " + metadata_.name);
+            Log(kShuttingDown);
 
             // Call user implementation
             DeInit();
@@ -126,32 +183,90 @@ namespace Lumos
             state_ = ApplicationState::STOPPED;
             stats_.deinit_count++;
 
-            LogInfo("Application shut down successfully");
+            Log(kShutDown);
 
             // Print statistics if any steps were executed
             if (stats_.step_count > 0)
             {
-                LogInfo("Application statistics:");
-                LogInfo("  Total steps: " + std::to_string(stats_.step_count));
-                LogInfo("  Average step time: " + std::to_string(stats_.GetAverageStepTimeUs()) + " us");
-                LogInfo("  Min step time: " + std::to_string(stats_.min_step_time_us) + " us");
-                LogInfo("  Max step time: " + std::to_string(stats_.max_step_time_us) + " us");
+                Log(kStatistics, ToLogArgument(stats_.step_count), ToLogArgument(stats_.total_step_time_us / stats_.step_count));
+                Log(kStepTimeRange, ToLogArgument(stats_.min_step_time_us), ToLogArgument(stats_.max_step_time_us));
+                if (stats_.jitter_samples > 0)
+                {
+                    Log(kJitter, ToLogArgument(stats_.total_jitter_us / stats_.jitter_samples), ToLogArgument(stats_.max_jitter_us));
+                }
+                if (histogram_enabled_)
+                {
+                    Log(kPercentile, ToLogArgument(stats_.GetStepTimePercentileUs(0.99)));
+                }
+                if (stats_.deadline_misses > 0)
+                {
+                    Log(kDeadlines, ToLogArgument(stats_.deadline_misses), ToLogArgument(stats_.max_lateness_us));
+                }
             }
         }
+#ifdef LUMOS_FRAMEWORK_EXCEPTIONS
         catch (const std::exception &e)
         {
-            SetError(std::string("Exception during DeInit(): ") + e.what());
-            LogError("Shutdown failed: " + last_error_);
+            ApplicationError error("Exception during DeInit(): ");
+            SetError(error.Append(e.what()).c_str());
+            LogFailure("Shutdown failed: ");
         }
         catch (...)
         {
             SetError("Unknown exception during DeInit()");
-            LogError("Shutdown failed: " + last_error_);
+            LogFailure("Shutdown failed: ");
         }
+#endif
+    }
+
+    void ApplicationBase::ReportDeadline(bool met, uint64_t lateness_us)
+    {
+        if (met)
+        {
+            stats_.consecutive_misses = 0;
+            return;
+        }
+
+        stats_.deadline_misses++;
+        stats_.consecutive_misses++;
+        if (lateness_us > stats_.max_lateness_us)
+        {
+            stats_.max_lateness_us = lateness_us;
+        }
+        if (stats_.consecutive_misses < metadata_.miss_limit)
+        {
+            return;
+        }
+
+        switch (metadata_.deadline_policy)
+        {
+        case DeadlinePolicy::SKIP:
+            break;
+        case DeadlinePolicy::DEGRADE:
+            // Each further run of misses halves the rate again
+            if (metadata_.rate_hz > 1)
+            {
+                metadata_.rate_hz /= 2;
+                stats_.rate_degradations++;
+                Log(kRateDegraded, ToLogArgument(stats_.consecutive_misses), ToLogArgument(metadata_.rate_hz));
+            }
+            stats_.consecutive_misses = 0;
+            break;
+        case DeadlinePolicy::ERROR:
+            SetError("Deadline missed");
+            LogFailure("Step overran its period: ");
+            break;
+        }
+    }
+
+    void ApplicationBase::SetName(const char *name)
+    {
+        metadata_.name = name;
+        log_source_ = static_cast<uint16_t>(GetLogMessageId(metadata_.name.c_str()));
     }
 
     // Error handling
-    void ApplicationBase::SetError(const std::string &error_msg)
+    void ApplicationBase::SetError(const char *error_msg)
     {
         last_error_ = error_msg;
         state_ = ApplicationState::ERROR;
@@ -168,48 +283,34 @@ namespace Lumos
     }
 
     // Logging helpers
-    void ApplicationBase::LogInfo(const std::string &message)
+    void ApplicationBase::LogInfo(const char *message)
     {
-        auto now = std::chrono::system_clock::now();
-        auto time = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      now.time_since_epoch()) %
-                  1000;
-
-        std::cout << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
-                  << "." << std::setfill('0') << std::setw(3) << ms.count()
-                  << "] [" << metadata_.name << "] [INFO] " << message << std::endl;
+        WriteLogText(LogLevel::Info, metadata_.name.c_str(), log_source_, message);
     }
 
-    void ApplicationBase::LogWarning(const std::string &message)
+    void ApplicationBase::LogWarning(const char *message)
     {
-        auto now = std::chrono::system_clock::now();
-        auto time = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      now.time_since_epoch()) %
-                  1000;
-
-        std::cout << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
-                  << "." << std::setfill('0') << std::setw(3) << ms.count()
-                  << "] [" << metadata_.name << "] [WARN] " << message << std::endl;
+        WriteLogText(LogLevel::Warning, metadata_.name.c_str(), log_source_, message);
     }
 
-    void ApplicationBase::LogError(const std::string &message)
+    void ApplicationBase::LogError(const char *message)
     {
-        auto now = std::chrono::system_clock::now();
-        auto time = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      now.time_since_epoch()) %
-                  1000;
+        WriteLogText(LogLevel::Error, metadata_.name.c_str(), log_source_, message);
+    }
 
-        std::cerr << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
-                  << "." << std::setfill('0') << std::setw(3) << ms.count()
-                  << "] [" << metadata_.name << "] [ERROR] " << message << std::endl;
+    void ApplicationBase::LogFailure(const char *what)
+    {
+        FixedString<ApplicationError::capacity() + 32> message(what);
+        message.Append(last_error_.c_str());
+        LogError(message.c_str());
     }
 
     // Internal helpers
-    void ApplicationBase::UpdateStepTiming(uint64_t step_time_us)
+    void ApplicationBase::UpdateStepTiming(uint32_t start_ticks, uint32_t end_ticks)
     {
+        // Unsigned differences stay right across a counter wrap; a division
+        // is the only conversion cost per step
+        const uint32_t step_time_us = (end_ticks - start_ticks) / ticks_per_us_;
         stats_.total_step_time_us += step_time_us;
 
         if (step_time_us > stats_.max_step_time_us)
@@ -221,13 +322,56 @@ namespace Lumos
         {
             stats_.min_step_time_us = step_time_us;
         }
+
+        if (histogram_enabled_)
+        {
+            size_t bucket = step_time_us == 0 ? 0 : static_cast<size_t>(32 - __builtin_clz(step_time_us));
+            if (bucket >= ApplicationStats::kHistogramBuckets)
+            {
+                bucket = ApplicationStats::kHistogramBuckets - 1;
+            }
+            stats_.step_histogram[bucket]++;
+        }
+
+        // Jitter: how far the start-to-start interval is off the period.
+        // Periods beyond half a counter wrap (4 s at 480 MHz) are not measured.
+        const uint32_t rate_hz = metadata_.rate_hz;
+        if (rate_hz > 0 && 1000000u / rate_hz < 0x80000000u / ticks_per_us_)
+        {
+            if (has_last_start_)
+            {
+                const uint32_t interval_us = (start_ticks - last_start_ticks_) / ticks_per_us_;
+                const uint32_t period_us = 1000000u / rate_hz;
+                const uint32_t jitter_us = interval_us > period_us ? interval_us - period_us : period_us - interval_us;
+                stats_.jitter_samples++;
+                stats_.total_jitter_us += jitter_us;
+                if (jitter_us > stats_.max_jitter_us)
+                {
+                    stats_.max_jitter_us = jitter_us;
+                }
+            }
+            last_start_ticks_ = start_ticks;
+            has_last_start_ = true;
+        }
     }
 
-    uint64_t ApplicationBase::GetCurrentTimeUs() const
+    uint32_t ApplicationBase::GetStepTicks() const
     {
+#ifdef LUMOS_CYCLE_STEP_CLOCK
+        // A single register read; CPU cycles once Initialize() found the
+        // counter running (InitMicrosecondTiming() starts it)
+        if (ticks_per_us_ > 1)
+        {
+            return DWT->CYCCNT;
+        }
+#endif
+#ifdef LUMOS_DEVICE_TIME_BASE
+        return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
         auto now = std::chrono::steady_clock::now();
         auto duration = now.time_since_epoch();
-        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
     }
 
 } // namespace Lumos
\ No newline at end of file
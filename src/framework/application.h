@@ -1,6 +1,9 @@
 #pragma once
 
-#include <string>
+#include "fixed_string.h"
+#include "logging.h"
+
+#include <cstddef>
 #include <cstdint>
 
 namespace Lumos
@@ -14,21 +17,44 @@ namespace Lumos
         ERROR         // Error state
     };
 
+    // What the scheduler does once an app has missed miss_limit deadlines
+    // in a row (a step ending after the next release)
+    enum class DeadlinePolicy {
+        SKIP,         // Drop the releases it ran over and carry on (default)
+        DEGRADE,      // Also halve the rate, down to 1 Hz
+        ERROR         // SetError(): the app is not run again until restarted
+    };
+
+    // Names, versions and errors live inside the app; nothing allocates
+    typedef FixedString<24> ApplicationName;
+    typedef FixedString<15> ApplicationVersion;
+    typedef FixedString<63> ApplicationError;
+
     struct ApplicationMetadata {
-        std::string name;
-        std::string version;
+        ApplicationName name;
+        ApplicationVersion version;
         uint32_t rate_hz;        // Desired execution rate in Hz (0 = event-driven)
         uint8_t priority;        // Priority level (0-255, higher = more important)
+        DeadlinePolicy deadline_policy;
+        uint8_t miss_limit;      // Consecutive misses that trigger the policy
+        bool critical;           // The scheduler's watchdog waits for its deadlines
 
         ApplicationMetadata()
             : name("UnnamedApp")
             , version("1.0.0")
             , rate_hz(10)
             , priority(128)
+            , deadline_policy(DeadlinePolicy::SKIP)
+            , miss_limit(1)
+            , critical(false)
         {}
     };
 
     struct ApplicationStats {
+        // Bucket 0 counts steps under 1 us, bucket n steps of 2^(n-1) up to
+        // 2^n us, the last bucket everything from 16 ms
+        static constexpr size_t kHistogramBuckets = 16;
+
         uint64_t init_count;           // Number of times Init() was called
         uint64_t step_count;           // Number of times Step() was called
         uint64_t deinit_count;         // Number of times DeInit() was called
@@ -36,6 +62,14 @@ namespace Lumos
         uint64_t total_step_time_us;   // Total time spent in Step() (microseconds)
         uint64_t max_step_time_us;     // Maximum Step() execution time
         uint64_t min_step_time_us;     // Minimum Step() execution time
+        uint64_t jitter_samples;       // Step-to-step intervals measured (periodic apps)
+        uint64_t total_jitter_us;      // Sum of |interval - period|
+        uint64_t max_jitter_us;        // Largest |interval - period|
+        uint64_t deadline_misses;      // Steps that ended after the next release
+        uint64_t max_lateness_us;      // Furthest a step ended past its deadline
+        uint32_t consecutive_misses;   // Current run of misses (0 after a met deadline)
+        uint32_t rate_degradations;    // Halvings by DeadlinePolicy::DEGRADE
+        uint32_t step_histogram[kHistogramBuckets];   // With EnableStepHistogram()
 
         ApplicationStats()
             : init_count(0)
@@ -45,18 +79,51 @@ namespace Lumos
             , total_step_time_us(0)
             , max_step_time_us(0)
             , min_step_time_us(UINT64_MAX)
+            , jitter_samples(0)
+            , total_jitter_us(0)
+            , max_jitter_us(0)
+            , deadline_misses(0)
+            , max_lateness_us(0)
+            , consecutive_misses(0)
+            , rate_degradations(0)
+            , step_histogram()
         {}
 
         double GetAverageStepTimeUs() const {
             return step_count > 0 ? static_cast<double>(total_step_time_us) / step_count : 0.0;
         }
+
+        double GetAverageJitterUs() const {
+            return jitter_samples > 0 ? static_cast<double>(total_jitter_us) / jitter_samples : 0.0;
+        }
+
+        // Step time that @p fraction (e.g. 0.99) of the steps stayed below,
+        // rounded up to the histogram's bucket bound; 0 without a histogram
+        uint64_t GetStepTimePercentileUs(double fraction) const {
+            uint64_t total = 0;
+            for (size_t i = 0; i < kHistogramBuckets; i++) {
+                total += step_histogram[i];
+            }
+            if (total == 0) {
+                return 0;
+            }
+            const double target = fraction * static_cast<double>(total);
+            uint64_t count = 0;
+            for (size_t i = 0; i + 1 < kHistogramBuckets; i++) {
+                count += step_histogram[i];
+                if (static_cast<double>(count) >= target) {
+                    return static_cast<uint64_t>(1) << i;
+                }
+            }
+            return max_step_time_us;
+        }
     };
 
     class ApplicationBase
     {
     public:
         ApplicationBase();
-        ApplicationBase(const std::string& name, const std::string& version = "1.0.0");
+        ApplicationBase(const char* name, const char* version = "1.0.0");
         virtual ~ApplicationBase();
 
         // Lifecycle methods - override these in your application
@@ -69,17 +136,35 @@ namespace Lumos
         void Execute();      // Called by framework to run Step()
         void Shutdown();     // Called by framework to run DeInit()
 
+        // Called by the scheduler after each periodic step: counts misses
+        // and applies the deadline policy (may change the rate or state)
+        void ReportDeadline(bool met, uint64_t lateness_us);
+
         // Configuration
-        void SetName(const std::string& name) { metadata_.name = name; }
-        void SetVersion(const std::string& version) { metadata_.version = version; }
+        void SetName(const char* name);
+        void SetVersion(const char* version) { metadata_.version = version; }
         void SetUpdateRate(uint32_t rate_hz) { metadata_.rate_hz = rate_hz; }
         void SetPriority(uint8_t priority) { metadata_.priority = priority; }
+        void SetDeadlinePolicy(DeadlinePolicy policy, uint8_t miss_limit = 1)
+        {
+            metadata_.deadline_policy = policy;
+            metadata_.miss_limit = miss_limit > 0 ? miss_limit : 1;
+        }
+
+        // Critical apps must meet their deadlines for Scheduler::SetWatchdog()
+        // to feed the watchdog
+        void SetCritical(bool critical = true) { metadata_.critical = critical; }
+
+        // Count steps per log2 time bucket in ApplicationStats::step_histogram
+        void EnableStepHistogram(bool enable = true) { histogram_enabled_ = enable; }
 
         // Getters
-        const std::string& GetName() const { return metadata_.name; }
-        const std::string& GetVersion() const { return metadata_.version; }
+        const ApplicationName& GetName() const { return metadata_.name; }
+        const ApplicationVersion& GetVersion() const { return metadata_.version; }
         uint32_t GetUpdateRate() const { return metadata_.rate_hz; }
         uint8_t GetPriority() const { return metadata_.priority; }
+        DeadlinePolicy GetDeadlinePolicy() const { return metadata_.deadline_policy; }
+        bool IsCritical() const { return metadata_.critical; }
         ApplicationState GetState() const { return state_; }
         const ApplicationStats& GetStats() const { return stats_; }
 
@@ -90,15 +175,25 @@ namespace Lumos
         bool HasError() const { return state_ == ApplicationState::ERROR; }
 
         // Error handling
-        void SetError(const std::string& error_msg);
-        const std::string& GetLastError() const { return last_error_; }
+        // Longer messages are truncated to ApplicationError's capacity
+        void SetError(const char* error_msg);
+        const ApplicationError& GetLastError() const { return last_error_; }
         void ClearError();
 
     protected:
-        // Helper methods for derived classes
-        void LogInfo(const std::string& message);
-        void LogWarning(const std::string& message);
-        void LogError(const std::string& message);
+        // Helper methods for derived classes: plain text to the log sink
+        void LogInfo(const char* message);
+        void LogWarning(const char* message);
+        void LogError(const char* message);
+
+        // Binary record of a LUMOS_LOG_MESSAGE with up to two arguments;
+        // no formatting happens on the device
+        void Log(const LogMessage& message) { WriteLog(message, metadata_.name.c_str(), log_source_, 0, 0, 0); }
+        void Log(const LogMessage& message, int32_t arg0) { WriteLog(message, metadata_.name.c_str(), log_source_, 1, arg0, 0); }
+        void Log(const LogMessage& message, int32_t arg0, int32_t arg1)
+        {
+            WriteLog(message, metadata_.name.c_str(), log_source_, 2, arg0, arg1);
+        }
 
         // Access to metadata for derived classes
         ApplicationMetadata& GetMetadata() { return metadata_; }
@@ -107,11 +202,52 @@ namespace Lumos
         ApplicationState state_;
         ApplicationMetadata metadata_;
         ApplicationStats stats_;
-        std::string last_error_;
+        ApplicationError last_error_;
+        uint16_t log_source_;          // LogRecord::source of this app
+        bool histogram_enabled_;
+        uint32_t ticks_per_us_;        // Step clock rate, set by Initialize()
+        uint32_t last_start_ticks_;
+        bool has_last_start_;
 
         // Internal helpers
-        void UpdateStepTiming(uint64_t step_time_us);
-        uint64_t GetCurrentTimeUs() const;
+        void LogFailure(const char* what);   // @p what followed by the last error
+        void UpdateStepTiming(uint32_t start_ticks, uint32_t end_ticks);
+        uint32_t GetStepTicks() const;
     };
 
+    inline const char* GetStateName(ApplicationState state)
+    {
+        switch (state)
+        {
+        case ApplicationState::CREATED: return "created";
+        case ApplicationState::INITIALIZED: return "initialized";
+        case ApplicationState::RUNNING: return "running";
+        case ApplicationState::STOPPED: return "stopped";
+        case ApplicationState::ERROR: return "error";
+        }
+        return "unknown";
+    }
+
+    // Report an app's stats as one line, for serial_gui's app table
+    // Usage Example:
+    //   PrintApplicationStats(Serial1, control);
+    //   PrintApplicationStats(Serial1, scheduler);   // Every app (scheduler.h)
+    //
+    // "@app name=NAME state=STATE rate=HZ steps=N avg_us=US max_us=US
+    // jitter_us=US misses=N errors=N"; jitter is the mean |interval -
+    // period|. @p out is Serial, USB or anything else with printf().
+    template <typename Out>
+    void PrintApplicationStats(Out& out, const ApplicationBase& app)
+    {
+        const ApplicationStats& stats = app.GetStats();
+        out.printf("@app name=%s state=%s rate=%u steps=%lu avg_us=%lu max_us=%lu jitter_us=%lu misses=%lu errors=%lu\r\n",
+                   app.GetName().c_str(), GetStateName(app.GetState()), static_cast<unsigned>(app.GetUpdateRate()),
+                   static_cast<unsigned long>(stats.step_count),
+                   static_cast<unsigned long>(stats.GetAverageStepTimeUs()),
+                   static_cast<unsigned long>(stats.max_step_time_us),
+                   static_cast<unsigned long>(stats.GetAverageJitterUs()),
+                   static_cast<unsigned long>(stats.deadline_misses),
+                   static_cast<unsigned long>(stats.error_count));
+    }
+
 } // namespace Lumos
\ No newline at end of file
@@ -0,0 +1,593 @@
+#pragma once
+
+// Needs 'cxx_standard: 20' in project.yaml (adds -fcoroutines on the
+// bundled GCC 10)
+#if !defined(__cpp_impl_coroutine) && !defined(__cpp_coroutines)
+#error "coroutine.h needs C++20 coroutines: add 'cxx_standard: 20' to project.yaml"
+#endif
+
+#include "lockfree.h"
+#include "sync.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_COROUTINE_TIME_BASE
+#else
+#include <chrono>
+#endif
+
+// Coroutine frames come from a static pool of this many slots of this
+// size; the largest frame requested so far is in CoFramePool::GetStats()
+#ifndef LUMOS_COROUTINE_FRAMES
+#define LUMOS_COROUTINE_FRAMES 8
+#endif
+#ifndef LUMOS_COROUTINE_FRAME_SIZE
+#define LUMOS_COROUTINE_FRAME_SIZE 256
+#endif
+
+namespace Lumos
+{
+
+    // Non-blocking tasks written as straight-line code
+    // Usage Example:
+    //   CoExecutor executor;
+    //   CoEvent adc_done;
+    //   CoChannel<CANFrame, 16> commands;        // Filled by CAN1.onReceive() or an ISR
+    //
+    //   CoTask Sample()
+    //   {
+    //       for (;;)
+    //       {
+    //           spi1.transferAsync(cmd, reply, 4, [](bool ok) { adc_done.Set(ok); });
+    //           if (co_await adc_done) { Publish(reply); }
+    //           co_await CoSleep(10);            // 100 Hz, without blocking
+    //       }
+    //   }
+    //
+    //   CoTask Serve()
+    //   {
+    //       for (;;)
+    //       {
+    //           CANFrame frame = co_await commands.Receive();
+    //           CoEvent sent;
+    //           SerialCom.writeAsync(Span<const uint8_t>(frame.data, frame.length), CoEvent::OnSerial, &sent);
+    //           co_await sent;                   // Returns the bytes sent
+    //       }
+    //   }
+    //
+    //   void setup() { executor.Spawn(Sample()); executor.Spawn(Serve()); }
+    //   void loop()  { executor.RunReady(); Idle(executor.GetTimeUntilNextWakeUs() / 1000); }
+    //
+    // A task runs until it co_awaits something that is not ready, then
+    // returns to RunReady(), so other tasks, apps or loop() work go on
+    // while a transfer, a sleep or a frame is pending instead of spinning
+    // in a HAL timeout. Completion callbacks (interrupts) only queue the
+    // waiting task; it resumes on the next RunReady(), in the executor's
+    // context. RunReady() also fits in an app's Step(), or an event-driven
+    // app's with SetWakeHook() calling Scheduler::Trigger().
+    //
+    // Frames are fixed slots from CoFramePool, never the heap. A task whose
+    // frame does not fit (or finds no free slot) is not started: Spawn()
+    // returns false. Tasks may co_await other CoTasks, which then use a
+    // slot of their own until they return (one that got no slot returns
+    // at once; IsValid() tells). Each event or channel has one waiting
+    // task at a time.
+    //
+    // Host builds (and simulated boards) need nothing besides C++20.
+
+    struct CoFramePoolStats {
+        uint32_t slots;
+        uint32_t slot_size;
+        uint32_t used;
+        uint32_t peak;
+        uint32_t failures;       // Frames not allocated: too large or no free slot
+        uint32_t largest;        // Largest frame requested, to size LUMOS_COROUTINE_FRAME_SIZE
+    };
+
+    // Static storage for coroutine frames
+    class CoFramePool
+    {
+    public:
+        static void* Allocate(size_t size)
+        {
+            CriticalSection lock;
+            if (size > largest_)
+            {
+                largest_ = static_cast<uint32_t>(size);
+            }
+            if (size > kSlotSize || free_mask_ == 0)
+            {
+                failures_++;
+                return nullptr;
+            }
+            const uint32_t slot = static_cast<uint32_t>(__builtin_ctz(free_mask_));
+            free_mask_ &= ~(1u << slot);
+            used_++;
+            if (used_ > peak_)
+            {
+                peak_ = used_;
+            }
+            return storage_[slot].bytes;
+        }
+
+        static void Free(void* frame)
+        {
+            const uintptr_t offset = reinterpret_cast<uintptr_t>(frame) - reinterpret_cast<uintptr_t>(storage_);
+            CriticalSection lock;
+            free_mask_ |= 1u << (offset / sizeof(Slot));
+            used_--;
+        }
+
+        static CoFramePoolStats GetStats()
+        {
+            CriticalSection lock;
+            return CoFramePoolStats{kSlots, kSlotSize, used_, peak_, failures_, largest_};
+        }
+
+    private:
+        static constexpr uint32_t kSlots = LUMOS_COROUTINE_FRAMES;
+        static constexpr uint32_t kSlotSize = LUMOS_COROUTINE_FRAME_SIZE;
+        static_assert(kSlots >= 1 && kSlots <= 32, "LUMOS_COROUTINE_FRAMES must be 1 to 32");
+
+        struct Slot {
+            alignas(8) uint8_t bytes[(kSlotSize + 7) / 8 * 8];
+        };
+
+        static inline Slot storage_[kSlots];
+        static inline uint32_t free_mask_ = kSlots == 32 ? 0xFFFFFFFFu : (1u << kSlots) - 1;
+        static inline uint32_t used_ = 0;
+        static inline uint32_t peak_ = 0;
+        static inline uint32_t failures_ = 0;
+        static inline uint32_t largest_ = 0;
+    };
+
+    class CoExecutor;
+
+    // Coroutine returning nothing; co_await it from another CoTask, or
+    // hand it to CoExecutor::Spawn()
+    class CoTask
+    {
+    public:
+        struct promise_type {
+            CoExecutor* executor = nullptr;
+            std::coroutine_handle<> continuation;   // Task awaiting this one
+
+            static void* operator new(size_t size) noexcept { return CoFramePool::Allocate(size); }
+            static void operator delete(void* frame) noexcept { CoFramePool::Free(frame); }
+            static CoTask get_return_object_on_allocation_failure() { return CoTask(); }
+
+            CoTask get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    // Back to the awaiting task; a spawned task stays suspended
+                    // here until the executor destroys it
+                    const std::coroutine_handle<> next = handle.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        CoTask() : handle_(nullptr) {}
+        CoTask(CoTask&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+        CoTask& operator=(CoTask&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                handle_ = other.handle_;
+                other.handle_ = nullptr;
+            }
+            return *this;
+        }
+        ~CoTask() { Reset(); }
+
+        CoTask(const CoTask&) = delete;
+        CoTask& operator=(const CoTask&) = delete;
+
+        // False if the frame could not be allocated
+        bool IsValid() const { return static_cast<bool>(handle_); }
+
+        // Awaiting runs the task at once and resumes the caller when it returns
+        bool await_ready() const noexcept { return !handle_; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> caller) noexcept
+        {
+            handle_.promise().executor = caller.promise().executor;
+            handle_.promise().continuation = caller;
+            return handle_;
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        friend class CoExecutor;
+        explicit CoTask(Handle handle) : handle_(handle) {}
+
+        Handle Release()
+        {
+            Handle handle = handle_;
+            handle_ = nullptr;
+            return handle;
+        }
+
+        void Reset()
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+                handle_ = nullptr;
+            }
+        }
+
+        Handle handle_;
+    };
+
+    struct CoExecutorStats {
+        uint32_t spawned;
+        uint32_t finished;
+        uint32_t resumes;
+        uint32_t wake_overflows;   // Post()s that found the ready queue full (should stay 0)
+    };
+
+    // Runs CoTasks: resumes tasks woken by events, channels and sleeps
+    class CoExecutor
+    {
+    public:
+        CoExecutor()
+            : sleepers_()
+            , sleeper_count_(0)
+            , active_count_(0)
+            , wake_hook_(nullptr)
+            , wake_context_(nullptr)
+            , stats_()
+        {
+        }
+
+        CoExecutor(const CoExecutor&) = delete;
+        CoExecutor& operator=(const CoExecutor&) = delete;
+
+        // Start @p task on the next RunReady(); false if its frame could not
+        // be allocated or too many tasks are running
+        bool Spawn(CoTask task)
+        {
+            if (!task.IsValid() || active_count_ >= kMaxTasks)
+            {
+                return false;
+            }
+            CoTask::Handle handle = task.Release();
+            handle.promise().executor = this;
+            active_[active_count_++] = handle;
+            stats_.spawned++;
+            Post(handle);
+            return true;
+        }
+
+        // Resume every task that is ready now, including sleepers that are
+        // due; tasks woken meanwhile wait for the next call. Returns the
+        // number of resumes.
+        size_t RunReady()
+        {
+            WakeSleepers(NowUs());
+
+            size_t resumed = 0;
+            size_t pending = ready_.Size();
+            std::coroutine_handle<> handle;
+            while (pending-- > 0 && ready_.Pop(handle))
+            {
+                handle.resume();
+                resumed++;
+            }
+            stats_.resumes += static_cast<uint32_t>(resumed);
+            ReapFinished();
+            return resumed;
+        }
+
+        // Queue @p handle for resumption; safe from interrupts
+        void Post(std::coroutine_handle<> handle)
+        {
+            if (!ready_.Push(handle))
+            {
+                stats_.wake_overflows++;
+                return;
+            }
+            if (wake_hook_ != nullptr)
+            {
+                wake_hook_(wake_context_);
+            }
+        }
+
+        // Called (possibly from an interrupt) whenever a task becomes ready,
+        // e.g. to Trigger() the event-driven app that runs RunReady()
+        void SetWakeHook(void (*hook)(void* context), void* context)
+        {
+            wake_context_ = context;
+            wake_hook_ = hook;
+        }
+
+        // Microseconds until the next sleeper is due (0 if a task is ready,
+        // UINT32_MAX if none sleeps)
+        uint32_t GetTimeUntilNextWakeUs() const
+        {
+            if (!ready_.Empty())
+            {
+                return 0;
+            }
+            const uint32_t now = NowUs();
+            uint32_t wait = UINT32_MAX;
+            for (size_t i = 0; i < sleeper_count_; i++)
+            {
+                const int32_t left = static_cast<int32_t>(sleepers_[i].wake_us - now);
+                if (left <= 0)
+                {
+                    return 0;
+                }
+                if (static_cast<uint32_t>(left) < wait)
+                {
+                    wait = static_cast<uint32_t>(left);
+                }
+            }
+            return wait;
+        }
+
+        size_t GetTaskCount() const { return active_count_; }
+        const CoExecutorStats& GetStats() const { return stats_; }
+
+        // Executor context only (used by CoSleep)
+        void SleepUntil(std::coroutine_handle<> handle, uint32_t wake_us)
+        {
+            // Every suspended task sleeps at most once, so there is room
+            sleepers_[sleeper_count_++] = Sleeper{handle, wake_us};
+        }
+
+        static uint32_t NowUs()
+        {
+#ifdef LUMOS_COROUTINE_TIME_BASE
+            return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
+            const auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+        }
+
+    private:
+        static constexpr size_t kMaxTasks = LUMOS_COROUTINE_FRAMES;
+        // Room for one pending wake per frame, rounded up to a power of two
+        static constexpr size_t kReadyDepth = kMaxTasks <= 2 ? 2 : kMaxTasks <= 4 ? 4 : kMaxTasks <= 8 ? 8
+                                            : kMaxTasks <= 16 ? 16 : 32;
+
+        struct Sleeper {
+            std::coroutine_handle<> handle;
+            uint32_t wake_us;
+        };
+
+        void WakeSleepers(uint32_t now)
+        {
+            size_t i = 0;
+            while (i < sleeper_count_)
+            {
+                if (static_cast<int32_t>(now - sleepers_[i].wake_us) >= 0)
+                {
+                    Post(sleepers_[i].handle);
+                    sleepers_[i] = sleepers_[--sleeper_count_];
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+
+        void ReapFinished()
+        {
+            size_t i = 0;
+            while (i < active_count_)
+            {
+                if (active_[i].done())
+                {
+                    active_[i].destroy();
+                    active_[i] = active_[--active_count_];
+                    stats_.finished++;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+
+        MpscQueue<std::coroutine_handle<>, kReadyDepth> ready_;
+        CoTask::Handle active_[kMaxTasks];
+        Sleeper sleepers_[kMaxTasks];
+        size_t sleeper_count_;
+        size_t active_count_;
+        void (*volatile wake_hook_)(void* context);
+        void* volatile wake_context_;
+        CoExecutorStats stats_;
+    };
+
+    // co_await CoSleep(ms) or CoSleepUs(us): resume after that long
+    class CoSleepUs
+    {
+    public:
+        explicit CoSleepUs(uint32_t us) : us_(us) {}
+
+        bool await_ready() const noexcept { return us_ == 0; }
+        void await_suspend(CoTask::Handle handle) noexcept
+        {
+            handle.promise().executor->SleepUntil(handle, CoExecutor::NowUs() + us_);
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        uint32_t us_;
+    };
+
+    inline CoSleepUs CoSleep(uint32_t ms)
+    {
+        return CoSleepUs(ms * 1000u);
+    }
+
+    // co_await CoYield(): let every other ready task run first
+    struct CoYield {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(CoTask::Handle handle) noexcept { handle.promise().executor->Post(handle); }
+        void await_resume() const noexcept {}
+    };
+
+    // One-shot completion with a result, set from a callback or interrupt;
+    // co_await returns the result (true/false for bool callbacks, the byte
+    // count for SerialCallback) and re-arms the event
+    class CoEvent
+    {
+    public:
+        CoEvent() : waiter_(), executor_(nullptr), value_(0), set_(false) {}
+
+        CoEvent(const CoEvent&) = delete;
+        CoEvent& operator=(const CoEvent&) = delete;
+
+        // Any context
+        void Set(int32_t value = 1)
+        {
+            std::coroutine_handle<> waiter;
+            CoExecutor* executor;
+            {
+                CriticalSection lock;
+                value_ = value;
+                set_ = true;
+                waiter = waiter_;
+                executor = executor_;
+                waiter_ = nullptr;
+            }
+            if (waiter)
+            {
+                executor->Post(waiter);
+            }
+        }
+
+        // SerialCallback for UART writeAsync()/readAsync() with the event as context
+        static void OnSerial(void* context, uint16_t length)
+        {
+            static_cast<CoEvent*>(context)->Set(length);
+        }
+
+        bool IsSet() const { return set_; }
+
+        bool await_ready() const noexcept { return set_; }
+        bool await_suspend(CoTask::Handle handle) noexcept
+        {
+            CriticalSection lock;
+            if (set_)
+            {
+                return false;   // Set between await_ready() and now
+            }
+            waiter_ = handle;
+            executor_ = handle.promise().executor;
+            return true;
+        }
+        int32_t await_resume() noexcept
+        {
+            CriticalSection lock;
+            set_ = false;
+            return value_;
+        }
+
+    private:
+        std::coroutine_handle<> waiter_;
+        CoExecutor* executor_;
+        volatile int32_t value_;
+        volatile bool set_;
+    };
+
+    // Queue of values from one producer (an interrupt, a CAN handler) to
+    // one task, which co_awaits Receive() for the next value
+    template <typename T, size_t Capacity>
+    class CoChannel
+    {
+    public:
+        CoChannel() : waiter_(), executor_(nullptr), dropped_(0) {}
+
+        CoChannel(const CoChannel&) = delete;
+        CoChannel& operator=(const CoChannel&) = delete;
+
+        // Producer side; false (and a drop counted) if full
+        bool Push(const T& item)
+        {
+            if (!queue_.Push(item))
+            {
+                dropped_ = dropped_ + 1;
+                return false;
+            }
+            std::coroutine_handle<> waiter;
+            CoExecutor* executor;
+            {
+                CriticalSection lock;
+                waiter = waiter_;
+                executor = executor_;
+                waiter_ = nullptr;
+            }
+            if (waiter)
+            {
+                executor->Post(waiter);
+            }
+            return true;
+        }
+
+        // Consumer side without waiting
+        bool TryPop(T& item) { return queue_.Pop(item); }
+
+        class Awaiter
+        {
+        public:
+            explicit Awaiter(CoChannel& channel) : channel_(channel) {}
+
+            bool await_ready() const noexcept { return !channel_.queue_.Empty(); }
+            bool await_suspend(CoTask::Handle handle) noexcept
+            {
+                CriticalSection lock;
+                if (!channel_.queue_.Empty())
+                {
+                    return false;   // Pushed between await_ready() and now
+                }
+                channel_.waiter_ = handle;
+                channel_.executor_ = handle.promise().executor;
+                return true;
+            }
+            T await_resume() noexcept
+            {
+                T item{};
+                channel_.queue_.Pop(item);
+                return item;
+            }
+
+        private:
+            CoChannel& channel_;
+        };
+
+        Awaiter Receive() { return Awaiter(*this); }
+
+        size_t Size() const { return queue_.Size(); }
+        uint32_t GetDropped() const { return dropped_; }
+
+    private:
+        SpscQueue<T, Capacity> queue_;
+        std::coroutine_handle<> waiter_;
+        CoExecutor* executor_;
+        volatile uint32_t dropped_;
+    };
+
+} // namespace Lumos
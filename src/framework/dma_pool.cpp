@@ -0,0 +1,147 @@
+#include "dma_pool.h"
+
+namespace Lumos
+{
+
+    namespace
+    {
+        size_t RoundToLine(size_t bytes)
+        {
+            return (bytes + DmaArena::kAlignment - 1) & ~(DmaArena::kAlignment - 1);
+        }
+    }
+
+#ifdef LUMOS_DEVICE_SYNC
+    // .dma_pool in the board linker script; weak, so a board without the
+    // section links with an empty arena
+    extern "C" __attribute__((weak)) uint8_t _sdma_pool[];
+    extern "C" __attribute__((weak)) uint8_t _edma_pool[];
+
+    // Constant-initialized, so usable from other constructors
+    static DmaArena dma_arena(_sdma_pool, _edma_pool);
+#else
+    alignas(DmaArena::kAlignment) static uint8_t host_dma_region[LUMOS_DMA_POOL_HOST_SIZE];
+    static DmaArena dma_arena(host_dma_region, host_dma_region + LUMOS_DMA_POOL_HOST_SIZE);
+#endif
+
+    DmaArena& GetDmaArena()
+    {
+        return dma_arena;
+    }
+
+    uint8_t* DmaArena::Allocate(size_t bytes)
+    {
+        if (bytes == 0)
+        {
+            return nullptr;
+        }
+        const size_t size = RoundToLine(bytes);
+
+        CriticalSection lock;
+        // The linker aligns the region; this covers a region that is not
+        const uintptr_t address = reinterpret_cast<uintptr_t>(next_);
+        const size_t skip = RoundToLine(address) - address;
+        if (skip + size > static_cast<size_t>(end_ - next_))
+        {
+            failures_++;
+            return nullptr;
+        }
+        uint8_t* block = next_ + skip;
+        next_ = block + size;
+        return block;
+    }
+
+    DmaPool::DmaPool()
+        : blocks_(nullptr)
+        , block_size_(0)
+        , block_count_(0)
+        , free_(nullptr)
+        , used_(0)
+        , peak_(0)
+        , failures_(0)
+    {
+    }
+
+    bool DmaPool::Init(DmaArena& arena, size_t block_size, size_t block_count)
+    {
+        if (blocks_ != nullptr || block_size == 0 || block_count == 0)
+        {
+            return false;
+        }
+        const size_t size = RoundToLine(block_size);
+        uint8_t* blocks = arena.Allocate(size * block_count);
+        if (blocks == nullptr)
+        {
+            return false;
+        }
+
+        // Thread the free list through the blocks, first block first
+        FreeBlock* free = nullptr;
+        for (size_t i = block_count; i > 0; i--)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(blocks + (i - 1) * size);
+            block->next = free;
+            free = block;
+        }
+
+        CriticalSection lock;
+        blocks_ = blocks;
+        block_size_ = size;
+        block_count_ = block_count;
+        free_ = free;
+        return true;
+    }
+
+    uint8_t* DmaPool::Allocate()
+    {
+        CriticalSection lock;
+        FreeBlock* block = free_;
+        if (block == nullptr)
+        {
+            failures_++;
+            return nullptr;
+        }
+        free_ = block->next;
+        used_ = used_ + 1;
+        if (used_ > peak_)
+        {
+            peak_ = used_;
+        }
+        return reinterpret_cast<uint8_t*>(block);
+    }
+
+    bool DmaPool::Free(void* block)
+    {
+        uint8_t* byte = static_cast<uint8_t*>(block);
+        if (!Owns(byte) || static_cast<size_t>(byte - blocks_) % block_size_ != 0)
+        {
+            return false;
+        }
+
+        CriticalSection lock;
+        FreeBlock* free = reinterpret_cast<FreeBlock*>(byte);
+        free->next = free_;
+        free_ = free;
+        used_ = used_ - 1;
+        return true;
+    }
+
+    bool DmaPool::Owns(const void* pointer) const
+    {
+        const uint8_t* byte = static_cast<const uint8_t*>(pointer);
+        return blocks_ != nullptr && byte >= blocks_ && byte < blocks_ + block_size_ * block_count_;
+    }
+
+    DmaPoolStats DmaPool::GetStats() const
+    {
+        CriticalSection lock;
+        DmaPoolStats stats;
+        stats.block_size = static_cast<uint32_t>(block_size_);
+        stats.block_count = static_cast<uint32_t>(block_count_);
+        stats.used = used_;
+        stats.peak = peak_;
+        stats.failures = failures_;
+        return stats;
+    }
+
+} // namespace Lumos
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Host builds carve the DMA region from a static array of this size
+#ifndef LUMOS_DMA_POOL_HOST_SIZE
+#define LUMOS_DMA_POOL_HOST_SIZE 16384
+#endif
+
+namespace Lumos
+{
+
+    // Buffers for DMA from the board's DMA region
+    // Usage Example:
+    //   DmaPool frame_pool;                       // Fixed-size blocks
+    //
+    //   void setup() {
+    //       frame_pool.Init(GetDmaArena(), 256, 8);              // 8 x 256 bytes
+    //       uint8_t* table = GetDmaArena().Allocate(1024);        // Once, kept for good
+    //   }
+    //
+    //   // Driver (e.g. a receive-complete interrupt) fills a block and
+    //   // hands the pointer on; the app frees it when done
+    //   uint8_t* block = frame_pool.Allocate();
+    //   spi1.transferAsync(cmd, block, 256, ...);
+    //   rx_queue.Push(block);                     // SpscQueue<uint8_t*>, no copy
+    //   ...
+    //   frame_pool.Free(block);
+    //
+    //   DmaBuffer buffer = frame_pool.Take();    // Or owned: freed at end of scope
+    //
+    // The region is defined per board by the linker script (.dma_pool,
+    // _sdma_pool to _edma_pool): on the H7 the rest of D2 SRAM after the
+    // LUMOS_DMA_BUFFER variables, where DMA1/DMA2 reach and the DTCM is
+    // not; elsewhere a reservation (_Dma_Pool_Size) in main RAM. Blocks
+    // are 32-byte aligned and their size a multiple of 32, so D-cache
+    // maintenance on one never touches a neighbour. Memory is not zeroed.
+    //
+    // DmaArena hands out memory that is never returned, for buffers that
+    // live as long as the program; DmaPool carves fixed-size blocks from it
+    // once and then allocates and frees them in O(1) from apps and
+    // interrupts alike (a free list threaded through the free blocks).
+    class DmaArena
+    {
+    public:
+        static constexpr size_t kAlignment = 32;   // Cortex-M7 cache line
+
+        constexpr DmaArena(uint8_t* begin, uint8_t* end)
+            : begin_(begin)
+            , end_(end)
+            , next_(begin)
+            , failures_(0)
+        {
+        }
+
+        DmaArena(const DmaArena&) = delete;
+        DmaArena& operator=(const DmaArena&) = delete;
+
+        // @p bytes rounded up to whole cache lines; nullptr if they do not fit
+        uint8_t* Allocate(size_t bytes);
+
+        size_t GetSize() const { return static_cast<size_t>(end_ - begin_); }
+        size_t GetUsed() const { return static_cast<size_t>(next_ - begin_); }
+        uint32_t GetFailures() const { return failures_; }
+
+        // True if @p pointer lies in the arena
+        bool Contains(const void* pointer) const
+        {
+            const uint8_t* byte = static_cast<const uint8_t*>(pointer);
+            return byte >= begin_ && byte < end_;
+        }
+
+    private:
+        uint8_t* begin_;
+        uint8_t* end_;
+        uint8_t* next_;
+        uint32_t failures_;
+    };
+
+    // The board's DMA region
+    DmaArena& GetDmaArena();
+
+    class DmaPool;
+
+    // Owned pool block; move-only, returned to its pool when destroyed
+    class DmaBuffer
+    {
+    public:
+        DmaBuffer() : pool_(nullptr), data_(nullptr) {}
+        DmaBuffer(DmaBuffer&& other) : pool_(other.pool_), data_(other.data_) { other.data_ = nullptr; }
+        DmaBuffer& operator=(DmaBuffer&& other)
+        {
+            if (this != &other)
+            {
+                Reset();
+                pool_ = other.pool_;
+                data_ = other.data_;
+                other.data_ = nullptr;
+            }
+            return *this;
+        }
+        ~DmaBuffer() { Reset(); }
+
+        DmaBuffer(const DmaBuffer&) = delete;
+        DmaBuffer& operator=(const DmaBuffer&) = delete;
+
+        explicit operator bool() const { return data_ != nullptr; }
+        uint8_t* Data() const { return data_; }
+        size_t Size() const;
+
+        // Give up ownership, e.g. to pass the block through a queue; the
+        // receiver frees it with DmaPool::Free()
+        uint8_t* Release()
+        {
+            uint8_t* data = data_;
+            data_ = nullptr;
+            return data;
+        }
+
+        void Reset();
+
+    private:
+        friend class DmaPool;
+        DmaBuffer(DmaPool* pool, uint8_t* data) : pool_(pool), data_(data) {}
+
+        DmaPool* pool_;
+        uint8_t* data_;
+    };
+
+    struct DmaPoolStats {
+        uint32_t block_size;
+        uint32_t block_count;
+        uint32_t used;
+        uint32_t peak;       // Most blocks in use at once
+        uint32_t failures;   // Allocate() calls that found no free block
+    };
+
+    class DmaPool
+    {
+    public:
+        DmaPool();
+
+        DmaPool(const DmaPool&) = delete;
+        DmaPool& operator=(const DmaPool&) = delete;
+
+        // Carve @p block_count blocks of @p block_size bytes (rounded up
+        // to cache lines) from @p arena; once per pool
+        bool Init(DmaArena& arena, size_t block_size, size_t block_count);
+
+        // A free block, or nullptr if all are in use
+        uint8_t* Allocate();
+
+        // Return a block from Allocate(); false for a pointer not from this pool
+        bool Free(void* block);
+
+        // Allocate() with ownership tracked by the returned handle
+        DmaBuffer Take() { return DmaBuffer(this, Allocate()); }
+
+        // True if @p pointer is inside one of this pool's blocks
+        bool Owns(const void* pointer) const;
+
+        size_t GetBlockSize() const { return block_size_; }
+        size_t GetBlockCount() const { return block_count_; }
+        size_t GetFreeCount() const { return block_count_ - used_; }
+        DmaPoolStats GetStats() const;
+
+    private:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        uint8_t* blocks_;
+        size_t block_size_;
+        size_t block_count_;
+        FreeBlock* free_;
+        volatile uint32_t used_;
+        uint32_t peak_;
+        uint32_t failures_;
+    };
+
+    inline size_t DmaBuffer::Size() const
+    {
+        return data_ != nullptr ? pool_->GetBlockSize() : 0;
+    }
+
+    inline void DmaBuffer::Reset()
+    {
+        if (data_ != nullptr)
+        {
+            pool_->Free(data_);
+            data_ = nullptr;
+        }
+    }
+
+    // Report pool use as a line for `lumos memory`, with PrintMemoryUsage():
+    // "@dmapool name=NAME block=B count=N used=N peak=N failures=N
+    //  arena=B arena_size=B"
+    template <typename Out>
+    void PrintDmaPoolUsage(Out& out, const char* name, const DmaPool& pool)
+    {
+        const DmaPoolStats stats = pool.GetStats();
+        const DmaArena& arena = GetDmaArena();
+        out.printf("@dmapool name=%s block=%u count=%u used=%u peak=%u failures=%u arena=%u arena_size=%u\r\n",
+                   name, static_cast<unsigned>(stats.block_size), static_cast<unsigned>(stats.block_count),
+                   static_cast<unsigned>(stats.used), static_cast<unsigned>(stats.peak),
+                   static_cast<unsigned>(stats.failures), static_cast<unsigned>(arena.GetUsed()),
+                   static_cast<unsigned>(arena.GetSize()));
+    }
+
+} // namespace Lumos
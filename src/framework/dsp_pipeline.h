@@ -0,0 +1,274 @@
+#pragma once
+
+// Needs 'dsp: true' in project.yaml, which links the CMSIS-DSP build for
+// the board's core and defines LUMOS_DSP
+#ifndef LUMOS_DSP
+#error "dsp_pipeline.h needs CMSIS-DSP: add 'dsp: true' to project.yaml"
+#endif
+
+#include "arm_math.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    // Filter, decimation and FFT stages for blocks of ADC samples
+    // Usage Example:
+    //   // Two-channel scan; each DMA half holds 256 samples per channel
+    //   const DspSample kLowpass[32] = { ... };        // Time-reversed, as CMSIS-DSP takes them
+    //   LUMOS_FAST_BSS FirStage<32, 256> lowpass(kLowpass);
+    //   LUMOS_FAST_BSS DecimatorStage<32, 256, 4> decimate(kAntiAlias);  // 256 in, 64 out
+    //   LUMOS_FAST_BSS RfftStage<64> spectrum;
+    //
+    //   void OnBlock(const uint16_t* block)           // From AnalogInput::startScan()
+    //   {
+    //       DspSample x[256], y[256], z[64];
+    //       AdcToSamples(block, 256, x, 12, 0, 2);    // Channel 0 of 2
+    //       lowpass.Process(x, y);
+    //       decimate.Process(y, z);
+    //       const DspSample* bins = spectrum.Process(z);  // 32 magnitudes
+    //   }
+    //
+    // DspSample follows the core: float32_t where there is an FPU (the M7
+    // of LumosBrain, the M33, M4F parts) and q15_t on the M0+ of
+    // LumosMicroBrain, whose q15 kernels use the single-cycle multiplier
+    // instead of soft floats. Coefficients are DspSamples too; a q15 set is
+    // the float set times 32768, saturated. The library the build links is
+    // the one for the core and FPU (libarm_cortexM7lfdp_math.a on the M7,
+    // unrolled for its dual-issue pipeline).
+    //
+    // Stages own their state and process fixed-size blocks, so nothing is
+    // allocated; Block should be the DMA half-block size per channel. On
+    // the H7 keep stages and working blocks in the DTCM (LUMOS_FAST_BSS,
+    // memory_sections.h): the kernels then run without cache misses.
+    //
+    // Older CMSIS-DSP versions take non-const input pointers, hence the
+    // const_casts; no stage writes to its input.
+#if defined(__ARM_FP)
+    using DspSample = float32_t;
+#else
+    using DspSample = q15_t;
+#endif
+
+    // One channel of an interleaved scan block as DspSamples centred on
+    // zero: [-1, 1) as float, full scale as q15. @p count is per channel
+    inline void AdcToSamples(const uint16_t* block, size_t count, DspSample* out, unsigned bits = 12,
+                             size_t channel = 0, size_t channels = 1)
+    {
+        const uint16_t* in = block + channel;
+#if defined(__ARM_FP)
+        const float32_t half = static_cast<float32_t>(1u << (bits - 1));
+        const float32_t scale = 1.0f / half;
+        for (size_t i = 0; i < count; i++, in += channels)
+        {
+            out[i] = (static_cast<float32_t>(*in) - half) * scale;
+        }
+#else
+        const unsigned shift = 16 - bits;
+        for (size_t i = 0; i < count; i++, in += channels)
+        {
+            out[i] = static_cast<q15_t>((static_cast<int32_t>(*in) << shift) - 32768);
+        }
+#endif
+    }
+
+    // FIR filter of Taps coefficients over blocks of Block samples
+    template <size_t Taps, size_t Block>
+    class FirStage
+    {
+#if !defined(__ARM_FP)
+        static_assert(Taps >= 4 && Taps % 2 == 0, "arm_fir_q15 needs an even number of taps, at least 4");
+#endif
+
+    public:
+        // @p coefficients are time-reversed (b[Taps-1] first) and must outlive the stage
+        explicit FirStage(const DspSample* coefficients)
+        {
+#if defined(__ARM_FP)
+            arm_fir_init_f32(&fir_, Taps, const_cast<DspSample*>(coefficients), state_, Block);
+#else
+            arm_fir_init_q15(&fir_, Taps, const_cast<DspSample*>(coefficients), state_, Block);
+#endif
+        }
+
+        FirStage(const FirStage&) = delete;
+        FirStage& operator=(const FirStage&) = delete;
+
+        // Block samples from @p in to @p out
+        void Process(const DspSample* in, DspSample* out)
+        {
+#if defined(__ARM_FP)
+            arm_fir_f32(&fir_, const_cast<DspSample*>(in), out, Block);
+#else
+            arm_fir_q15(&fir_, const_cast<DspSample*>(in), out, Block);
+#endif
+        }
+
+    private:
+#if defined(__ARM_FP)
+        arm_fir_instance_f32 fir_;
+#else
+        arm_fir_instance_q15 fir_;
+#endif
+        DspSample state_[Taps + Block - 1];
+    };
+
+    // Cascade of Stages second-order IIR sections over blocks of Block samples
+    //
+    // Coefficients per section are {b0, b1, b2, a1, a2} as float (direct
+    // form II transposed) and {b0, 0, b1, b2, a1, a2} as q15 (direct form
+    // I), with a1 and a2 negated from the usual form, as CMSIS-DSP takes
+    // them. q15 sets scaled down by 2^post_shift to fit are scaled back
+    // up by the stage; float stages ignore post_shift.
+    template <size_t Stages, size_t Block>
+    class BiquadStage
+    {
+    public:
+#if defined(__ARM_FP)
+        static constexpr size_t kCoefficientsPerSection = 5;
+#else
+        static constexpr size_t kCoefficientsPerSection = 6;
+#endif
+
+        // @p coefficients hold Stages * kCoefficientsPerSection values and must outlive the stage
+        explicit BiquadStage(const DspSample* coefficients, int8_t post_shift = 0)
+        {
+#if defined(__ARM_FP)
+            (void)post_shift;
+            arm_biquad_cascade_df2T_init_f32(&biquad_, Stages, const_cast<DspSample*>(coefficients), state_);
+#else
+            arm_biquad_cascade_df1_init_q15(&biquad_, Stages, const_cast<DspSample*>(coefficients), state_,
+                                            post_shift);
+#endif
+        }
+
+        BiquadStage(const BiquadStage&) = delete;
+        BiquadStage& operator=(const BiquadStage&) = delete;
+
+        // Block samples from @p in to @p out
+        void Process(const DspSample* in, DspSample* out)
+        {
+#if defined(__ARM_FP)
+            arm_biquad_cascade_df2T_f32(&biquad_, const_cast<DspSample*>(in), out, Block);
+#else
+            arm_biquad_cascade_df1_q15(&biquad_, const_cast<DspSample*>(in), out, Block);
+#endif
+        }
+
+    private:
+#if defined(__ARM_FP)
+        arm_biquad_cascade_df2T_instance_f32 biquad_;
+        DspSample state_[2 * Stages];
+#else
+        arm_biquad_casd_df1_inst_q15 biquad_;
+        DspSample state_[4 * Stages];
+#endif
+    };
+
+    // Anti-alias FIR and downsampling by Factor: Block samples in,
+    // Block / Factor out
+    template <size_t Taps, size_t Block, size_t Factor>
+    class DecimatorStage
+    {
+        static_assert(Factor > 0 && Block % Factor == 0, "The block size must be a multiple of the factor");
+
+    public:
+        static constexpr size_t kOutputSize = Block / Factor;
+
+        // @p coefficients are time-reversed (b[Taps-1] first) and must outlive the stage
+        explicit DecimatorStage(const DspSample* coefficients)
+        {
+#if defined(__ARM_FP)
+            arm_fir_decimate_init_f32(&decimate_, Taps, Factor, const_cast<DspSample*>(coefficients), state_, Block);
+#else
+            arm_fir_decimate_init_q15(&decimate_, Taps, Factor, const_cast<DspSample*>(coefficients), state_, Block);
+#endif
+        }
+
+        DecimatorStage(const DecimatorStage&) = delete;
+        DecimatorStage& operator=(const DecimatorStage&) = delete;
+
+        // Block samples from @p in, kOutputSize to @p out
+        void Process(const DspSample* in, DspSample* out)
+        {
+#if defined(__ARM_FP)
+            arm_fir_decimate_f32(&decimate_, const_cast<DspSample*>(in), out, Block);
+#else
+            arm_fir_decimate_q15(&decimate_, const_cast<DspSample*>(in), out, Block);
+#endif
+        }
+
+    private:
+#if defined(__ARM_FP)
+        arm_fir_decimate_instance_f32 decimate_;
+#else
+        arm_fir_decimate_instance_q15 decimate_;
+#endif
+        DspSample state_[Taps + Block - 1];
+    };
+
+    // Magnitude spectrum of a real block of Size samples: Size / 2 bins
+    // from DC up to just below Nyquist
+    //
+    // q15 magnitudes come out scaled down by the FFT length, as
+    // arm_rfft_q15 scales them, in 2.14 format. Older CMSIS-DSP versions
+    // support fewer q15 lengths; IsValid() is false for one they don't.
+    template <size_t Size>
+    class RfftStage
+    {
+        static_assert(Size >= 32 && Size <= 4096 && (Size & (Size - 1)) == 0,
+                      "The FFT length must be a power of two from 32 to 4096");
+
+    public:
+        static constexpr size_t kBins = Size / 2;
+
+        RfftStage()
+        {
+#if defined(__ARM_FP)
+            valid_ = arm_rfft_fast_init_f32(&fft_, Size) == ARM_MATH_SUCCESS;
+#else
+            valid_ = arm_rfft_init_q15(&fft_, Size, 0, 1) == ARM_MATH_SUCCESS;
+#endif
+        }
+
+        RfftStage(const RfftStage&) = delete;
+        RfftStage& operator=(const RfftStage&) = delete;
+
+        bool IsValid() const { return valid_; }
+
+        // Size samples from @p in; returns kBins magnitudes, valid until the next call
+        const DspSample* Process(const DspSample* in)
+        {
+            // The transform overwrites its input
+            for (size_t i = 0; i < Size; i++)
+            {
+                work_[i] = in[i];
+            }
+#if defined(__ARM_FP)
+            // Packed output: DC and Nyquist (both real) first, then bins 1..
+            arm_rfft_fast_f32(&fft_, work_, spectrum_, 0);
+            magnitude_[0] = spectrum_[0] < 0.0f ? -spectrum_[0] : spectrum_[0];
+            arm_cmplx_mag_f32(spectrum_ + 2, magnitude_ + 1, kBins - 1);
+#else
+            arm_rfft_q15(&fft_, work_, spectrum_);
+            arm_cmplx_mag_q15(spectrum_, magnitude_, kBins);
+#endif
+            return magnitude_;
+        }
+
+    private:
+#if defined(__ARM_FP)
+        arm_rfft_fast_instance_f32 fft_;
+        DspSample spectrum_[Size];
+#else
+        arm_rfft_instance_q15 fft_;
+        DspSample spectrum_[2 * Size];
+#endif
+        DspSample work_[Size];
+        DspSample magnitude_[kBins];
+        bool valid_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Lumos
+{
+
+    // String with inline storage for up to @p Capacity characters
+    // Usage Example:
+    //   FixedString<32> error("Sensor timeout on bus ");
+    //   error.Append(bus_name);          // Truncates instead of allocating
+    //   error.AppendNumber(retry_count);
+    //   LogError(error.c_str());
+    //
+    // Assignments and appends that do not fit are cut at the capacity, so
+    // nothing allocates and nothing fails; the text is always terminated.
+    template <size_t Capacity>
+    class FixedString
+    {
+        static_assert(Capacity > 0, "FixedString needs a capacity");
+
+    public:
+        FixedString()
+            : length_(0)
+        {
+            data_[0] = '\0';
+        }
+
+        FixedString(const char* text)
+            : length_(0)
+        {
+            data_[0] = '\0';
+            Append(text);
+        }
+
+        FixedString& operator=(const char* text)
+        {
+            clear();
+            return Append(text);
+        }
+
+        FixedString& Append(const char* text)
+        {
+            if (text == nullptr)
+            {
+                return *this;
+            }
+            while (*text != '\0' && length_ < Capacity)
+            {
+                data_[length_++] = *text++;
+            }
+            data_[length_] = '\0';
+            return *this;
+        }
+
+        FixedString& AppendNumber(int64_t value)
+        {
+            char digits[21];
+            size_t count = 0;
+            uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+            do
+            {
+                digits[count++] = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+            if (value < 0)
+            {
+                digits[count++] = '-';
+            }
+
+            char text[22];
+            for (size_t i = 0; i < count; i++)
+            {
+                text[i] = digits[count - 1 - i];
+            }
+            text[count] = '\0';
+            return Append(text);
+        }
+
+        void clear()
+        {
+            length_ = 0;
+            data_[0] = '\0';
+        }
+
+        const char* c_str() const { return data_; }
+        size_t size() const { return length_; }
+        bool empty() const { return length_ == 0; }
+        static constexpr size_t capacity() { return Capacity; }
+
+        bool operator==(const char* text) const { return text != nullptr && std::strcmp(data_, text) == 0; }
+        bool operator!=(const char* text) const { return !(*this == text); }
+
+    private:
+        char data_[Capacity + 1];
+        size_t length_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "sync.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Cortex-M0+ (ARMv6-M) has no exclusive load/store, so compare-and-swap
+// is not lock-free there; MpscQueue falls back to a CriticalSection
+#if defined(__ARM_ARCH_6M__)
+#define LUMOS_LOCKFREE_NO_CAS
+#endif
+
+// Keeps producer and consumer indexes out of each other's cache line
+// (32 bytes on the Cortex-M7 L1 cache, 64 on typical host CPUs)
+#ifdef LUMOS_DEVICE_SYNC
+#define LUMOS_CACHE_LINE 32
+#else
+#define LUMOS_CACHE_LINE 64
+#endif
+
+namespace Lumos
+{
+
+    // Fixed-capacity single-producer single-consumer queue
+    // Usage Example:
+    //   SpscQueue<CanMessage, 32> rx_queue;
+    //
+    //   void OnCanRx(const CanMessage& msg) {   // Producer, e.g. an ISR
+    //       if (!rx_queue.Push(msg)) { dropped++; }
+    //   }
+    //
+    //   void Step() override {                   // Consumer app
+    //       CanMessage msg;
+    //       while (rx_queue.Pop(msg)) { Handle(msg); }
+    //   }
+    //
+    // Exactly one context may Push() and exactly one may Pop(); either may
+    // be an interrupt. Capacity must be a power of two and all of it is
+    // usable. The indexes are free-running 32-bit counters published with
+    // release/acquire ordering, which emits a DMB on the Cortex-M7 so the
+    // element is written before the other side sees the new index.
+    template <typename T, size_t Capacity>
+    class SpscQueue
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscQueue() : head_(0), tail_(0) {}
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // Producer side; false if the queue is full
+        bool Push(const T& item)
+        {
+            const uint32_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= Capacity)
+            {
+                return false;
+            }
+            items_[head & kMask] = item;
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side; false if the queue is empty
+        bool Pop(T& item)
+        {
+            const uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if (head_.load(std::memory_order_acquire) == tail)
+            {
+                return false;
+            }
+            item = items_[tail & kMask];
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side; oldest element without removing it, nullptr if empty
+        const T* Peek() const
+        {
+            const uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if (head_.load(std::memory_order_acquire) == tail)
+            {
+                return nullptr;
+            }
+            return &items_[tail & kMask];
+        }
+
+        // Exact on either side, a snapshot anywhere else
+        size_t Size() const
+        {
+            return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+        }
+
+        bool Empty() const { return Size() == 0; }
+        bool Full() const { return Size() >= Capacity; }
+        static constexpr size_t GetCapacity() { return Capacity; }
+
+    private:
+        static constexpr uint32_t kMask = Capacity - 1;
+
+        alignas(LUMOS_CACHE_LINE) std::atomic<uint32_t> head_;   // Written by the producer
+        alignas(LUMOS_CACHE_LINE) std::atomic<uint32_t> tail_;   // Written by the consumer
+        alignas(LUMOS_CACHE_LINE) T items_[Capacity];
+    };
+
+    // Fixed-capacity multi-producer single-consumer queue
+    // Usage Example:
+    //   MpscQueue<LogEntry, 64> log_queue;       // Any app or ISR logs
+    //
+    //   log_queue.Push(entry);                   // From any context
+    //
+    //   LogEntry entry;                          // One logger app drains it
+    //   while (log_queue.Pop(entry)) { Write(entry); }
+    //
+    // Bounded queue with a sequence number per cell: producers claim a cell
+    // with compare-and-swap on the head and mark it filled by advancing its
+    // sequence, so a producer interrupted between claim and fill only holds
+    // back the consumer at that cell, never the other producers. On the
+    // Cortex-M0+ the claim and fill run in a CriticalSection instead.
+    template <typename T, size_t Capacity>
+    class MpscQueue
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        MpscQueue() : head_(0), tail_(0)
+        {
+            for (size_t i = 0; i < Capacity; i++)
+            {
+                cells_[i].sequence.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+            }
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        // Any context; false if the queue is full
+        bool Push(const T& item)
+        {
+#ifdef LUMOS_LOCKFREE_NO_CAS
+            CriticalSection lock;
+            const uint32_t head = head_.load(std::memory_order_relaxed);
+            Cell& cell = cells_[head & kMask];
+            if (cell.sequence.load(std::memory_order_acquire) != head)
+            {
+                return false;
+            }
+            head_.store(head + 1, std::memory_order_relaxed);
+#else
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            Cell* claimed = nullptr;
+            while (claimed == nullptr)
+            {
+                Cell& cell = cells_[head & kMask];
+                const int32_t diff = static_cast<int32_t>(cell.sequence.load(std::memory_order_acquire) - head);
+                if (diff == 0)
+                {
+                    // Free cell: take it unless another producer got there first
+                    if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                    {
+                        claimed = &cell;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;   // The consumer has not freed this cell yet
+                }
+                else
+                {
+                    head = head_.load(std::memory_order_relaxed);
+                }
+            }
+            Cell& cell = *claimed;
+#endif
+            cell.item = item;
+            cell.sequence.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // The single consumer; false if empty (or the oldest cell is still
+        // being filled by an interrupted producer)
+        bool Pop(T& item)
+        {
+            const uint32_t tail = tail_.load(std::memory_order_relaxed);
+            Cell& cell = cells_[tail & kMask];
+            if (cell.sequence.load(std::memory_order_acquire) != tail + 1)
+            {
+                return false;
+            }
+            item = cell.item;
+            cell.sequence.store(tail + Capacity, std::memory_order_release);
+            tail_.store(tail + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Snapshot; includes cells that are claimed but not yet filled
+        size_t Size() const
+        {
+            return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+        }
+
+        bool Empty() const { return Size() == 0; }
+        static constexpr size_t GetCapacity() { return Capacity; }
+
+    private:
+        static constexpr uint32_t kMask = Capacity - 1;
+
+        struct Cell {
+            std::atomic<uint32_t> sequence;   // == index: free, index + 1: filled
+            T item;
+        };
+
+        alignas(LUMOS_CACHE_LINE) std::atomic<uint32_t> head_;   // Shared by the producers
+        alignas(LUMOS_CACHE_LINE) std::atomic<uint32_t> tail_;   // Consumer only
+        alignas(LUMOS_CACHE_LINE) Cell cells_[Capacity];
+    };
+
+    // Latest-value topic with a sequence lock
+    // Usage Example:
+    //   SeqLockTopic<Attitude> attitude;
+    //
+    //   attitude.Publish(estimate);              // The one writer, e.g. at 1 kHz
+    //
+    //   Attitude a;                              // Any number of readers
+    //   if (attitude.Read(a)) { Use(a); }
+    //
+    // Readers copy the value out and retry if a write happened meanwhile,
+    // so the writer never waits and there is no slot pool as in Topic
+    // (message_bus.h); best for small values read often. A reader that
+    // interrupts the writer mid-write cannot make progress until the writer
+    // resumes, so Read() gives up after a few attempts and returns false;
+    // read from the writer's priority or lower to never see that. T must
+    // be trivially copyable.
+    template <typename T>
+    class SeqLockTopic
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SeqLockTopic needs a trivially copyable type");
+
+    public:
+        static constexpr int kReadAttempts = 4;
+
+        SeqLockTopic() : sequence_(0), value_() {}
+
+        SeqLockTopic(const SeqLockTopic&) = delete;
+        SeqLockTopic& operator=(const SeqLockTopic&) = delete;
+
+        // Single writer only
+        void Publish(const T& value)
+        {
+            const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1, std::memory_order_relaxed);   // Odd: write in progress
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(value_, &value, sizeof(T));
+            sequence_.store(sequence + 2, std::memory_order_release);
+        }
+
+        // Copy of the latest value; false if nothing was published yet or
+        // every attempt overlapped a write
+        bool Read(T& value) const
+        {
+            for (int attempt = 0; attempt < kReadAttempts; attempt++)
+            {
+                const uint32_t before = sequence_.load(std::memory_order_acquire);
+                if (before & 1)
+                {
+                    continue;
+                }
+                std::memcpy(&value, value_, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == before)
+                {
+                    return before != 0;
+                }
+            }
+            return false;
+        }
+
+        // Number of Publish() calls so far
+        uint32_t GetSequence() const { return sequence_.load(std::memory_order_acquire) / 2; }
+
+    private:
+        alignas(LUMOS_CACHE_LINE) std::atomic<uint32_t> sequence_;
+        alignas(alignof(T)) unsigned char value_[sizeof(T)];
+    };
+
+} // namespace Lumos
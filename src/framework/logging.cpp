@@ -0,0 +1,130 @@
+#include "logging.h"
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+#endif
+
+// The host simulator board keeps the console default, on its simulated clock
+#if !defined(LUMOS_DEVICE_TIME_BASE) || defined(LUMOS_HOST)
+#define LUMOS_CONSOLE_LOG_SINK
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#endif
+
+namespace Lumos
+{
+
+    namespace
+    {
+
+#ifdef LUMOS_CONSOLE_LOG_SINK
+        // Host default: the console, in the format the framework always used
+        class ConsoleLogSink : public LogSink
+        {
+        public:
+            void Write(const LogRecord& record, const char* source, const char* text) override
+            {
+                char message[160];
+                if (text == nullptr)
+                {
+                    std::snprintf(message, sizeof(message), "message 0x%08lx (%ld, %ld)",
+                                  static_cast<unsigned long>(record.message_id),
+                                  static_cast<long>(record.args[0]), static_cast<long>(record.args[1]));
+                }
+                else if (record.message_id == 0)
+                {
+                    std::snprintf(message, sizeof(message), "%s", text);
+                }
+                else
+                {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+                    std::snprintf(message, sizeof(message), text,
+                                  static_cast<long>(record.args[0]), static_cast<long>(record.args[1]));
+#pragma GCC diagnostic pop
+                }
+
+                static const char* const kLevels[] = {"INFO", "WARN", "ERROR"};
+                auto now = std::chrono::system_clock::now();
+                auto time = std::chrono::system_clock::to_time_t(now);
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+
+                std::ostream& out = record.level == LogLevel::Error ? std::cerr : std::cout;
+                out << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
+                    << "." << std::setfill('0') << std::setw(3) << ms.count()
+                    << "] [" << (source != nullptr ? source : "") << "] ["
+                    << kLevels[static_cast<uint8_t>(record.level)] << "] " << message << std::endl;
+            }
+        };
+
+        ConsoleLogSink console_sink;
+        LogSink* log_sink = &console_sink;
+#else
+        LogSink* log_sink = nullptr;
+#endif
+
+        uint32_t GetLogTimeUs()
+        {
+#ifdef LUMOS_DEVICE_TIME_BASE
+            return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
+            auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+        }
+
+    } // namespace
+
+    void SetLogSink(LogSink* sink)
+    {
+        log_sink = sink;
+    }
+
+    LogSink* GetLogSink()
+    {
+        return log_sink;
+    }
+
+    void WriteLog(const LogMessage& message, const char* source, uint16_t source_id,
+                  uint8_t arg_count, int32_t arg0, int32_t arg1)
+    {
+        LogSink* sink = log_sink;
+        if (sink == nullptr)
+        {
+            return;
+        }
+        LogRecord record;
+        record.time_us = GetLogTimeUs();
+        record.message_id = message.id;
+        record.source = source_id;
+        record.level = message.level;
+        record.arg_count = arg_count;
+        record.args[0] = arg0;
+        record.args[1] = arg1;
+        sink->Write(record, source, message.text);
+    }
+
+    void WriteLogText(LogLevel level, const char* source, uint16_t source_id, const char* text)
+    {
+        LogSink* sink = log_sink;
+        if (sink == nullptr)
+        {
+            return;
+        }
+        LogRecord record;
+        record.time_us = GetLogTimeUs();
+        record.message_id = 0;
+        record.source = source_id;
+        record.level = level;
+        record.arg_count = 0;
+        record.args[0] = 0;
+        record.args[1] = 0;
+        sink->Write(record, source, text);
+    }
+
+} // namespace Lumos
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "lockfree.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    enum class LogLevel : uint8_t { Info, Warning, Error };
+
+    // FNV-1a of a message's text, evaluated by the compiler for LUMOS_LOG_MESSAGE
+    constexpr uint32_t GetLogMessageId(const char* text)
+    {
+        uint32_t hash = 2166136261u;
+        while (*text != '\0')
+        {
+            hash = (hash ^ static_cast<uint8_t>(*text++)) * 16777619u;
+        }
+        return hash == 0 ? 1 : hash;   // 0 marks a plain text message
+    }
+
+    struct LogMessage {
+        uint32_t id;
+        LogLevel level;
+        const char* text;      // printf format for the arguments, nullptr when stripped
+    };
+
+    // Binary log entry: what a LogSink gets for every message
+    struct LogRecord {
+        uint32_t time_us;      // Low 32 bits of GetCurrentTimeUs()
+        uint32_t message_id;   // LogMessage::id, 0 for a plain text message
+        uint16_t source;       // GetLogMessageId() of the app name, truncated
+        LogLevel level;
+        uint8_t arg_count;
+        int32_t args[2];
+    };
+
+    // Where log records go (SetLogSink()); called from the logging context
+    class LogSink
+    {
+    public:
+        virtual ~LogSink() {}
+
+        // @p source is the app name; @p text the message format string (or
+        // the text itself when record.message_id is 0), nullptr if stripped
+        virtual void Write(const LogRecord& record, const char* source, const char* text) = 0;
+    };
+
+    // Sink for every log message; nullptr drops them. The default on the
+    // host prints to the console, on the device it is nullptr.
+    void SetLogSink(LogSink* sink);
+    LogSink* GetLogSink();
+
+    // Send one record to the sink; ApplicationBase::Log() is the usual entry point
+    void WriteLog(const LogMessage& message, const char* source, uint16_t source_id,
+                  uint8_t arg_count, int32_t arg0, int32_t arg1);
+    void WriteLogText(LogLevel level, const char* source, uint16_t source_id, const char* text);
+
+    // Log records kept in RAM for a logger app or the transport to drain
+    // Usage Example:
+    //   LogBuffer<64> log_buffer;
+    //   SetLogSink(&log_buffer);
+    //
+    //   LogRecord record;                 // In a low-priority app
+    //   while (log_buffer.Pop(record)) { Serial1.write(reinterpret_cast<uint8_t*>(&record), sizeof(record)); }
+    //
+    // Any app, task or interrupt may log (one MpscQueue); when the buffer is
+    // full the newest records are dropped and counted. Only the records are
+    // kept, so plain text messages arrive as message id 0.
+    template <size_t Capacity>
+    class LogBuffer : public LogSink
+    {
+    public:
+        LogBuffer()
+            : dropped_(0)
+        {
+        }
+
+        void Write(const LogRecord& record, const char* source, const char* text) override
+        {
+            (void)source;
+            (void)text;
+            if (!queue_.Push(record))
+            {
+                dropped_ = dropped_ + 1;
+            }
+        }
+
+        bool Pop(LogRecord& record) { return queue_.Pop(record); }
+        uint32_t GetDroppedCount() const { return dropped_; }
+
+    private:
+        MpscQueue<LogRecord, Capacity> queue_;
+        volatile uint32_t dropped_;
+    };
+
+} // namespace Lumos
+
+// Message texts stay out of the firmware with LUMOS_LOG_STRIP_TEXT: the
+// records carry only the id, which the host maps back by hashing the same
+// texts from the sources
+#ifdef LUMOS_LOG_STRIP_TEXT
+#define LUMOS_LOG_TEXT(text) nullptr
+#else
+#define LUMOS_LOG_TEXT(text) text
+#endif
+
+// Declare a log message with an id computed at compile time
+// Usage Example:
+//   LUMOS_LOG_MESSAGE(kMotorStalled, Error, "Motor %ld stalled at %ld rpm");
+//   Log(kMotorStalled, motor_index, rpm);      // In an ApplicationBase
+//
+// Arguments are int32_t; format them with %ld in the text.
+#define LUMOS_LOG_MESSAGE(name, level, text) \
+    static constexpr ::Lumos::LogMessage name = {::Lumos::GetLogMessageId(text), ::Lumos::LogLevel::level, LUMOS_LOG_TEXT(text)}
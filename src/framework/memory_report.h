@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstdint>
+
+#ifdef LUMOS_DEVICE_SYNC
+#include "memory_usage.h"
+#include "sys.h"
+#endif
+
+#ifdef LUMOS_RTOS_FREERTOS
+#include "rtos_executor.h"
+#endif
+
+namespace Lumos
+{
+
+    struct MemoryUsage {
+        uint32_t main_stack_peak;   // Bytes, since PaintMainStack() at startup
+        uint32_t main_stack_size;   // Reserved by the linker script
+        uint32_t heap_used;         // Bytes handed out by _sbrk() now
+        uint32_t heap_peak;         // ... at most so far
+        uint32_t heap_limit;        // Room between the heap start and the stack reserve
+    };
+
+    // Main stack and heap high-water marks; zero on the host
+    inline MemoryUsage GetMemoryUsage()
+    {
+        MemoryUsage usage = {0, 0, 0, 0, 0};
+#ifdef LUMOS_DEVICE_SYNC
+        usage.main_stack_peak = ::GetMainStackPeak();
+        usage.main_stack_size = ::GetMainStackSize();
+        usage.heap_used = ::GetHeapUsed();
+        usage.heap_peak = ::GetHeapPeak();
+        usage.heap_limit = ::GetHeapLimit();
+#endif
+        return usage;
+    }
+
+    // Report memory use as lines for `lumos memory`
+    // Usage Example:
+    //   void TelemetryApp::Step() {        // SetUpdateRate(1)
+    //       PrintMemoryUsage(Serial1);
+    //   }
+    //
+    //   executor.UpdateStats();            // With the RTOS executor, also per app
+    //   PrintMemoryUsage(Serial1, executor);
+    //
+    // "@memory t=MS stack=B stack_size=B heap=B heap_peak=B heap_limit=B"
+    // and, per RTOS app, "@taskstack app=NAME used=B size=B" from the
+    // high-water marks of the last UpdateStats(). @p out is Serial, USB or
+    // anything else with printf().
+    template <typename Out>
+    void PrintMemoryUsage(Out& out)
+    {
+        const MemoryUsage usage = GetMemoryUsage();
+        uint32_t now_ms = 0;
+#ifdef LUMOS_DEVICE_SYNC
+        now_ms = HAL_GetTick();
+#endif
+        out.printf("@memory t=%u stack=%u stack_size=%u heap=%u heap_peak=%u heap_limit=%u\r\n",
+                   now_ms, usage.main_stack_peak, usage.main_stack_size,
+                   usage.heap_used, usage.heap_peak, usage.heap_limit);
+    }
+
+#ifdef LUMOS_RTOS_FREERTOS
+    template <typename Out>
+    void PrintMemoryUsage(Out& out, const RtosExecutor& executor)
+    {
+        PrintMemoryUsage(out);
+        for (size_t i = 0; i < executor.GetApplicationCount(); i++)
+        {
+            const ApplicationBase& app = executor.GetApplication(i);
+            const RtosTaskStats* stats = executor.GetTaskStats(app);
+            if (stats == nullptr)
+            {
+                continue;
+            }
+            const uint32_t size = stats->stack_words * sizeof(StackType_t);
+            const uint32_t free_bytes = stats->stack_free_words * sizeof(StackType_t);
+            out.printf("@taskstack app=%s used=%u size=%u\r\n", app.GetName().c_str(), size - free_bytes, size);
+        }
+    }
+#endif
+
+} // namespace Lumos
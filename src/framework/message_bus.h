@@ -0,0 +1,292 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Lumos
+{
+
+    // Zero-copy publish/subscribe between applications on the same MCU
+    // Usage Example:
+    //   struct ImuSample { float accel[3]; float gyro[3]; uint64_t time_us; };
+    //   Topic<ImuSample> imu_topic;              // Global, shared via a header
+    //
+    //   // Publisher (e.g. a 1 kHz sensor app or an ISR)
+    //   auto loan = imu_topic.Loan();
+    //   if (loan) {
+    //       loan->time_us = GetCurrentTimeUs();   // Written in place
+    //       imu_topic.Publish(std::move(loan));
+    //   }
+    //
+    //   // Subscriber (e.g. a 50 Hz control app)
+    //   Subscriber<ImuSample> imu{imu_topic};
+    //   if (auto sample = imu.TakeNew()) {
+    //       Use(sample->gyro);                   // Read-only, no copy
+    //   }                                        // Released at end of scope
+    //
+    // Each topic owns a static pool of Slots messages. Publish() makes the
+    // loaned slot the latest message; a Sample pins its slot with a
+    // reference count, so a slow subscriber keeps reading a consistent
+    // message while the publisher fills other slots. Loan() fails (and
+    // GetDropCount() goes up) only if every slot is either the latest or
+    // held by a loan or sample, so Slots should be at least 2 plus the
+    // number of samples held at the same time. Subscribers see the latest
+    // message, not every message: a subscriber slower than its publisher
+    // skips the ones in between (GetSequence() tells how many).
+    //
+    // Only the slot bookkeeping takes a CriticalSection; message data is
+    // never copied or locked.
+    template <typename T, size_t Slots = 4>
+    class Topic
+    {
+        static_assert(Slots >= 2, "A topic needs at least two slots");
+
+    public:
+        // Writable message slot; publish it or let it go out of scope
+        class LoanedMessage
+        {
+        public:
+            LoanedMessage() : topic_(nullptr), slot_(0) {}
+            LoanedMessage(LoanedMessage&& other) : topic_(other.topic_), slot_(other.slot_) { other.topic_ = nullptr; }
+            LoanedMessage& operator=(LoanedMessage&& other)
+            {
+                if (this != &other)
+                {
+                    Reset();
+                    topic_ = other.topic_;
+                    slot_ = other.slot_;
+                    other.topic_ = nullptr;
+                }
+                return *this;
+            }
+            ~LoanedMessage() { Reset(); }
+
+            LoanedMessage(const LoanedMessage&) = delete;
+            LoanedMessage& operator=(const LoanedMessage&) = delete;
+
+            explicit operator bool() const { return topic_ != nullptr; }
+            T& operator*() const { return topic_->Data(slot_); }
+            T* operator->() const { return &topic_->Data(slot_); }
+
+            // Return the slot unpublished
+            void Reset()
+            {
+                if (topic_ != nullptr)
+                {
+                    topic_->Release(slot_);
+                    topic_ = nullptr;
+                }
+            }
+
+        private:
+            friend class Topic;
+            LoanedMessage(Topic* topic, size_t slot) : topic_(topic), slot_(slot) {}
+
+            Topic* topic_;
+            size_t slot_;
+        };
+
+        // Read-only reference to a published message
+        class Sample
+        {
+        public:
+            Sample() : topic_(nullptr), slot_(0), sequence_(0) {}
+            Sample(Sample&& other) : topic_(other.topic_), slot_(other.slot_), sequence_(other.sequence_)
+            {
+                other.topic_ = nullptr;
+            }
+            Sample& operator=(Sample&& other)
+            {
+                if (this != &other)
+                {
+                    Reset();
+                    topic_ = other.topic_;
+                    slot_ = other.slot_;
+                    sequence_ = other.sequence_;
+                    other.topic_ = nullptr;
+                }
+                return *this;
+            }
+            ~Sample() { Reset(); }
+
+            Sample(const Sample&) = delete;
+            Sample& operator=(const Sample&) = delete;
+
+            explicit operator bool() const { return topic_ != nullptr; }
+            const T& operator*() const { return topic_->Data(slot_); }
+            const T* operator->() const { return &topic_->Data(slot_); }
+
+            // Publish count of the topic when this message was published
+            uint32_t GetSequence() const { return sequence_; }
+
+            void Reset()
+            {
+                if (topic_ != nullptr)
+                {
+                    topic_->Release(slot_);
+                    topic_ = nullptr;
+                }
+            }
+
+        private:
+            friend class Topic;
+            Sample(Topic* topic, size_t slot, uint32_t sequence)
+                : topic_(topic), slot_(slot), sequence_(sequence) {}
+
+            Topic* topic_;
+            size_t slot_;
+            uint32_t sequence_;
+        };
+
+        Topic() : latest_(kNone), sequence_(0), drops_(0)
+        {
+            for (size_t i = 0; i < Slots; i++)
+            {
+                refs_[i] = 0;
+                sequences_[i] = 0;
+                new (&storage_[i]) T();
+            }
+        }
+
+        ~Topic()
+        {
+            for (size_t i = 0; i < Slots; i++)
+            {
+                Data(i).~T();
+            }
+        }
+
+        Topic(const Topic&) = delete;
+        Topic& operator=(const Topic&) = delete;
+
+        // Get a free slot to write the next message into (empty if none);
+        // it still holds whatever was published in it before
+        LoanedMessage Loan()
+        {
+            CriticalSection lock;
+            for (size_t i = 0; i < Slots; i++)
+            {
+                if (refs_[i] == 0 && i != latest_)
+                {
+                    refs_[i] = 1;
+                    return LoanedMessage(this, i);
+                }
+            }
+            drops_++;
+            return LoanedMessage();
+        }
+
+        // Make a loaned message the latest one
+        bool Publish(LoanedMessage&& loan)
+        {
+            if (loan.topic_ != this)
+            {
+                return false;
+            }
+            {
+                CriticalSection lock;
+                latest_ = loan.slot_;
+                sequences_[loan.slot_] = ++sequence_;
+            }
+            loan.Reset();   // The latest mark keeps the slot from reuse
+            return true;
+        }
+
+        // Copy a message in (for small messages and ISR producers)
+        bool Publish(const T& message)
+        {
+            auto loan = Loan();
+            if (!loan)
+            {
+                return false;
+            }
+            *loan = message;
+            return Publish(std::move(loan));
+        }
+
+        // Reference to the latest message (empty before the first Publish())
+        Sample Latest()
+        {
+            CriticalSection lock;
+            if (latest_ == kNone)
+            {
+                return Sample();
+            }
+            refs_[latest_]++;
+            return Sample(this, latest_, sequences_[latest_]);
+        }
+
+        // Number of Publish() calls so far
+        uint32_t GetSequence() const
+        {
+            CriticalSection lock;
+            return sequence_;
+        }
+
+        // Loan() calls that found no free slot
+        uint32_t GetDropCount() const
+        {
+            CriticalSection lock;
+            return drops_;
+        }
+
+    private:
+        static constexpr size_t kNone = Slots;
+
+        T& Data(size_t slot) { return *reinterpret_cast<T*>(&storage_[slot]); }
+
+        void Release(size_t slot)
+        {
+            CriticalSection lock;
+            refs_[slot]--;
+        }
+
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_[Slots];
+        uint16_t refs_[Slots];          // Loans and samples holding each slot
+        uint32_t sequences_[Slots];     // Sequence each slot was published with
+        size_t latest_;                 // kNone before the first publish
+        uint32_t sequence_;
+        uint32_t drops_;
+    };
+
+    // Per-subscriber view of a topic that tracks what it has already seen
+    template <typename T, size_t Slots = 4>
+    class Subscriber
+    {
+    public:
+        explicit Subscriber(Topic<T, Slots>& topic) : topic_(topic), last_sequence_(0), missed_(0) {}
+
+        // Messages published since the last TakeNew()
+        bool HasNew() const { return topic_.GetSequence() != last_sequence_; }
+
+        // Latest message if it is newer than the last one taken, else empty
+        typename Topic<T, Slots>::Sample TakeNew()
+        {
+            auto sample = topic_.Latest();
+            if (!sample || sample.GetSequence() == last_sequence_)
+            {
+                return typename Topic<T, Slots>::Sample();
+            }
+            missed_ += sample.GetSequence() - last_sequence_ - 1;
+            last_sequence_ = sample.GetSequence();
+            return sample;
+        }
+
+        // Latest message, new or not
+        typename Topic<T, Slots>::Sample Latest() { return topic_.Latest(); }
+
+        // Messages that were overwritten before this subscriber took them
+        uint32_t GetMissedCount() const { return missed_; }
+
+    private:
+        Topic<T, Slots>& topic_;
+        uint32_t last_sequence_;
+        uint32_t missed_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,142 @@
+#include "power_tracker.h"
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+#else
+#include <chrono>
+#endif
+
+#ifdef LUMOS_DEVICE_SYNC
+#include "peripherals.h"
+#endif
+
+namespace Lumos
+{
+
+    static_assert(PowerTracker::kMaxPeripherals <= 32, "One bit per peripheral in clocked_");
+
+    namespace
+    {
+        uint64_t NowUs()
+        {
+#ifdef LUMOS_DEVICE_TIME_BASE
+            return ::GetCurrentTimeUs();
+#else
+            auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+        }
+    }
+
+    PowerTracker::PowerTracker()
+        : peripherals_()
+        , count_(0)
+        , clocked_(0)
+        , phase_(Phase::RUN)
+        , last_us_(0)
+        , started_(false)
+    {
+    }
+
+    bool PowerTracker::AddPeripheral(const char* name, ClockProbe probe, const void* context)
+    {
+        if (probe == nullptr)
+        {
+            return false;
+        }
+
+        CriticalSection lock;
+        if (count_ >= kMaxPeripherals)
+        {
+            return false;
+        }
+        Tracked& tracked = peripherals_[count_];
+        tracked.power.name = name;
+        tracked.power.run_us = 0;
+        tracked.power.sleep_us = 0;
+        tracked.probe = probe;
+        tracked.context = context;
+        if (started_ && probe(context))
+        {
+            clocked_ |= 1u << count_;
+        }
+        count_++;
+        return true;
+    }
+
+#ifdef LUMOS_DEVICE_SYNC
+    bool PowerTracker::AddPeripheral(const char* name, const void* instance)
+    {
+        if (findPeripheral(instance) == nullptr)
+        {
+            return false;
+        }
+        return AddPeripheral(name, [](const void* context) { return isPeripheralClockEnabled(context); }, instance);
+    }
+#endif
+
+    void PowerTracker::Begin()
+    {
+        {
+            CriticalSection lock;
+            last_us_ = NowUs();
+            phase_ = Phase::RUN;
+            clocked_ = 0;
+            for (size_t i = 0; i < count_; i++)
+            {
+                if (peripherals_[i].probe(peripherals_[i].context))
+                {
+                    clocked_ |= 1u << i;
+                }
+            }
+            started_ = true;
+        }
+#ifdef LUMOS_DEVICE_TIME_BASE
+        // Called with interrupts masked around each WFI and Stop entry
+        SetPowerStateHook([](PowerState state, void* context) {
+            static_cast<PowerTracker*>(context)->Account(static_cast<Phase>(state));
+        }, this);
+#endif
+    }
+
+    void PowerTracker::Update()
+    {
+        CriticalSection lock;
+        if (started_)
+        {
+            Account(phase_);
+        }
+    }
+
+    void PowerTracker::Account(Phase next)
+    {
+        const uint64_t now = NowUs();
+        const uint32_t elapsed = static_cast<uint32_t>(now - last_us_);
+        last_us_ = now;
+
+        uint32_t clocked = 0;
+        for (size_t i = 0; i < count_; i++)
+        {
+            Tracked& tracked = peripherals_[i];
+            if ((clocked_ & (1u << i)) != 0)
+            {
+                if (phase_ == Phase::RUN)
+                {
+                    tracked.power.run_us += elapsed;
+                }
+                else if (phase_ == Phase::SLEEP)
+                {
+                    tracked.power.sleep_us += elapsed;
+                }
+            }
+            if (tracked.probe(tracked.context))
+            {
+                clocked |= 1u << i;
+            }
+        }
+        clocked_ = clocked;
+        phase_ = next;
+    }
+
+} // namespace Lumos
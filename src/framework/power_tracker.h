@@ -0,0 +1,115 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Peripherals a PowerTracker follows
+#ifndef LUMOS_POWER_PERIPHERALS
+#define LUMOS_POWER_PERIPHERALS 8
+#endif
+
+namespace Lumos
+{
+
+    // Time one peripheral's clock was enabled, in free-running microseconds
+    struct PeripheralPower {
+        const char* name;
+        uint32_t run_us;     // While the core ran
+        uint32_t sleep_us;   // While it slept (WFI); in Stop every clock is off
+    };
+
+    // Per-peripheral clock time in each power state, for `lumos stats`
+    // Usage Example:
+    //   Scheduler scheduler;
+    //   StatsEndpoint stats(scheduler);
+    //   PowerTracker power;
+    //
+    //   void setup() {
+    //       power.AddPeripheral("SPI1", SPI1);      // RCC table (wrapper/peripherals.h)
+    //       power.AddPeripheral("USART2", USART2);
+    //       power.Begin();
+    //       stats.SetPowerTracker(power);
+    //   }
+    //
+    //   void loop() {
+    //       scheduler.RunOnce();
+    //       stats.Poll(Serial1);
+    //       Idle(scheduler.GetTimeUntilNextReleaseUs() / 1000);   // Sleep or Stop
+    //   }
+    //
+    // The time the core spends in Run, Sleep and Stop is counted by the
+    // wrapper's sys.cpp around every WFI and Stop entry (GetPowerStateTimes())
+    // and sent by StatsEndpoint with or without a tracker. The tracker adds
+    // the peripherals: it reads each one's RCC enable bit at every change
+    // of state, through the hook of SetPowerStateHook(), and adds the time
+    // since the last change to the ones that were clocked. A clock left
+    // on through the sleeps then shows up next to the apps' CPU load, and
+    // `lumos stats --current` turns the state times into average current
+    // and charge per app step. Sleep and Stop are states of the whole
+    // chip, so an app's share is its time in Step(); the same sleeps
+    // appear as "sleep" scopes in `lumos trace`.
+    //
+    // The enable bit is what is read: a peripheral whose clock is gated
+    // in Sleep by its RCC low-power enable counts as clocked. Each change
+    // of state reads every probe with interrupts masked, so keep the list
+    // to the peripherals in question. One tracker per firmware, as the
+    // hook has one slot.
+    class PowerTracker
+    {
+    public:
+        static constexpr size_t kMaxPeripherals = LUMOS_POWER_PERIPHERALS;
+
+        // True while the peripheral's clock is enabled
+        using ClockProbe = bool (*)(const void* context);
+
+        PowerTracker();
+
+        PowerTracker(const PowerTracker&) = delete;
+        PowerTracker& operator=(const PowerTracker&) = delete;
+
+        // Follow a clock read by @p probe; false once kMaxPeripherals are added
+        bool AddPeripheral(const char* name, ClockProbe probe, const void* context);
+
+#ifdef LUMOS_DEVICE_SYNC
+        // Follow @p instance's RCC enable bit (USART1, SPI2, TIM3, ...)
+        bool AddPeripheral(const char* name, const void* instance);
+#endif
+
+        // Install the power state hook and start counting from now
+        void Begin();
+
+        // Add the time since the last change of state, e.g. before reading
+        void Update();
+
+        size_t GetPeripheralCount() const { return count_; }
+
+        // Counters of peripheral @p index, as of the last Update() or change of state
+        const PeripheralPower& GetPeripheral(size_t index) const { return peripherals_[index].power; }
+
+    private:
+        // PowerState's values, from sys.h
+        enum class Phase : uint8_t {
+            RUN,
+            SLEEP,
+            STOP
+        };
+
+        struct Tracked {
+            PeripheralPower power;
+            ClockProbe probe;
+            const void* context;
+        };
+
+        void Account(Phase next);
+
+        Tracked peripherals_[kMaxPeripherals];
+        size_t count_;
+        uint32_t clocked_;       // Bit per peripheral, as read at the last change
+        Phase phase_;
+        uint64_t last_us_;
+        bool started_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "lockfree.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    // One profiler sample: where the timer interrupt found the CPU
+    struct ProfileSample {
+        uint32_t pc;           // Interrupted instruction
+        uint32_t lr;           // Link register at that point, usually the caller
+    };
+
+    // Sampling profiler driven by a periodic timer interrupt
+    // Usage Example:
+    //   Timer profile_timer(TIM7);
+    //   Profiler<512> profiler;
+    //   LUMOS_PROFILER_IRQ_HANDLER(TIM7_IRQHandler, profiler)
+    //
+    //   void setup() { profiler.Begin(profile_timer, TIM7_IRQn); }   // 1 kHz, top priority
+    //   void loop() { profiler.Flush(Serial1); }
+    //
+    // `lumos profile` reads the samples, looks them up in build/firmware.elf
+    // and prints a flat profile, the caller -> callee pairs and, with
+    // --folded, a collapsed-stack file for flame graph tools.
+    //
+    // LUMOS_PROFILER_IRQ_HANDLER defines the timer's interrupt handler: it
+    // finds the exception frame on the main or process stack, records the
+    // stacked PC and LR and then acknowledges the timer. The LR only names
+    // the caller while the interrupted function has not yet called anything
+    // itself, so the call profile is one level deep and approximate; the
+    // flat profile is exact. Give the timer the highest priority so that
+    // other interrupt handlers are sampled too. Samples wait in an SPSC
+    // queue (the timer interrupt is the only producer); when it is full new
+    // samples are dropped and counted, which shows up in the report.
+    //
+    // Frame: 0x00, 0xFF, sample count, dropped count (saturated to 255),
+    // count x (PC u32, LR u32), CRC-8 of everything after the 0xFF.
+    template <size_t Capacity = 512>
+    class Profiler
+    {
+    public:
+        static constexpr size_t kSamplesPerFrame = 16;
+        static constexpr size_t kMaxFrame = 4 + kSamplesPerFrame * 8 + 1;
+        static constexpr uint8_t kFrameMarker = 0xFF;
+
+        Profiler()
+            : acknowledge_(nullptr)
+            , timer_(nullptr)
+            , enabled_(true)
+            , dropped_(0)
+            , reported_dropped_(0)
+            , frame_length_(0)
+        {
+        }
+
+        // Sample every @p period_ms with @p timer (a Timer whose interrupt
+        // handler is LUMOS_PROFILER_IRQ_HANDLER)
+        template <typename Timer, typename Irq>
+        bool Begin(Timer& timer, Irq irq, uint32_t period_ms = 1)
+        {
+            timer_ = &timer;
+            acknowledge_ = [](void* context) { static_cast<Timer*>(context)->handleUpdateInterrupt(); };
+            if (!timer.initPeriodic(period_ms, &Profiler::OnTimer, nullptr))
+            {
+                return false;
+            }
+            timer.enableInterrupt(irq, 0);
+            timer.start();
+            return true;
+        }
+
+        // Pause (false) or resume sampling; the timer keeps running
+        void SetEnabled(bool enabled) { enabled_ = enabled; }
+        bool IsEnabled() const { return enabled_; }
+
+        // Called by LUMOS_PROFILER_IRQ_HANDLER with the exception frame
+        void OnInterrupt(const uint32_t* frame)
+        {
+            if (enabled_)
+            {
+                // Frame: r0-r3, r12, lr, pc, xpsr
+                ProfileSample sample = {frame[6], frame[5]};
+                if (!queue_.Push(sample))
+                {
+                    dropped_ = dropped_ + 1;
+                }
+            }
+            if (acknowledge_ != nullptr)
+            {
+                acknowledge_(timer_);
+            }
+        }
+
+        // Pass buffered samples to @p stream (write(data, length) returning
+        // false when busy); call from one context, e.g. loop() or a
+        // low-priority app
+        template <typename Stream>
+        void Flush(Stream& stream)
+        {
+            for (;;)
+            {
+                if (frame_length_ == 0 && !BuildFrame())
+                {
+                    return;
+                }
+                // A frame the stream did not take is offered again next time
+                if (!stream.write(frame_, static_cast<uint16_t>(frame_length_)))
+                {
+                    return;
+                }
+                frame_length_ = 0;
+            }
+        }
+
+        uint32_t GetDroppedCount() const { return dropped_; }
+        size_t GetPending() const { return queue_.Size(); }
+
+    private:
+        SpscQueue<ProfileSample, Capacity> queue_;
+        void (*acknowledge_)(void* timer);
+        void* timer_;
+        volatile bool enabled_;
+        volatile uint32_t dropped_;
+        uint32_t reported_dropped_;
+        uint8_t frame_[kMaxFrame];
+        size_t frame_length_;
+
+        // Sampling happens before the timer handler runs; nothing left to do
+        static void OnTimer(void*) {}
+
+        bool BuildFrame()
+        {
+            const uint32_t dropped = dropped_;
+            const uint32_t new_drops = dropped - reported_dropped_;
+            size_t count = 0;
+            ProfileSample sample;
+            while (count < kSamplesPerFrame && queue_.Pop(sample))
+            {
+                PutU32(frame_ + 4 + count * 8, sample.pc);
+                PutU32(frame_ + 8 + count * 8, sample.lr);
+                count++;
+            }
+            if (count == 0 && new_drops == 0)
+            {
+                return false;
+            }
+            reported_dropped_ = dropped;
+
+            frame_[0] = 0x00;
+            frame_[1] = kFrameMarker;
+            frame_[2] = static_cast<uint8_t>(count);
+            frame_[3] = static_cast<uint8_t>(new_drops > 255 ? 255 : new_drops);
+            frame_length_ = 4 + count * 8;
+            frame_[frame_length_] = Crc8(frame_ + 2, frame_length_ - 2);
+            frame_length_++;
+            return true;
+        }
+
+        static void PutU32(uint8_t* out, uint32_t value)
+        {
+            out[0] = static_cast<uint8_t>(value);
+            out[1] = static_cast<uint8_t>(value >> 8);
+            out[2] = static_cast<uint8_t>(value >> 16);
+            out[3] = static_cast<uint8_t>(value >> 24);
+        }
+
+        // CRC-8 (polynomial 0x07), as in TokenLog
+        static uint8_t Crc8(const uint8_t* data, size_t length)
+        {
+            uint8_t crc = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                crc ^= data[i];
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+                }
+            }
+            return crc;
+        }
+    };
+
+} // namespace Lumos
+
+// Define @p handler (e.g. TIM7_IRQHandler) as the sampling interrupt of
+// @p profiler. Bit 2 of EXC_RETURN tells whether the interrupted code ran
+// on the process stack (RTOS task) or the main stack; the naked entry
+// passes that stack pointer, which is the exception frame, on in r0.
+// Uses only Thumb-1 instructions so it also assembles for the Cortex-M0+.
+#define LUMOS_PROFILER_IRQ_HANDLER(handler, profiler)                   \
+    extern "C" void handler##_LumosSample(const uint32_t* frame)        \
+    {                                                                   \
+        (profiler).OnInterrupt(frame);                                  \
+    }                                                                   \
+    extern "C" __attribute__((naked)) void handler(void)                \
+    {                                                                   \
+        __asm volatile("movs r0, #4\n"                                  \
+                       "mov r1, lr\n"                                   \
+                       "tst r0, r1\n"                                   \
+                       "beq 1f\n"                                       \
+                       "mrs r0, psp\n"                                  \
+                       "b 2f\n"                                         \
+                       "1:\n"                                           \
+                       "mrs r0, msp\n"                                  \
+                       "2:\n"                                           \
+                       "ldr r2, =" #handler "_LumosSample\n"            \
+                       "bx r2\n"                                        \
+                       ".ltorg\n");                                     \
+    }
@@ -0,0 +1,290 @@
+#include "rtos_executor.h"
+
+#ifdef LUMOS_RTOS_FREERTOS
+
+#include "sys.h"
+
+// Task stacks for all executors; RtosExecutor::Add() hands out slices
+static StackType_t stack_pool[LUMOS_RTOS_STACK_POOL_WORDS];
+
+// Static allocation needs the idle task's memory from the application
+static StaticTask_t idle_task_tcb;
+static StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+
+extern "C" void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_words)
+{
+    *tcb = &idle_task_tcb;
+    *stack = idle_task_stack;
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+extern "C" uint32_t LumosRtosRunTimeCounter(void)
+{
+    // Wraps after ~71 minutes; FreeRTOS accumulates differences, and
+    // UpdateStats() only looks at the change since its previous call
+    return static_cast<uint32_t>(GetCurrentTimeUs());
+}
+
+namespace Lumos
+{
+
+    RtosExecutor::RtosExecutor()
+        : tasks_()
+        , count_(0)
+        , stack_used_(0)
+        , started_(false)
+        , last_total_time_(0)
+        , last_idle_time_(0)
+        , idle_percent_(0.0f)
+    {
+    }
+
+    bool RtosExecutor::Add(ApplicationBase &app, uint32_t stack_words)
+    {
+        if (started_ || count_ >= kMaxApplications || FindTask(app) != nullptr)
+        {
+            return false;
+        }
+        if (stack_words < configMINIMAL_STACK_SIZE || stack_words > LUMOS_RTOS_STACK_POOL_WORDS - stack_used_)
+        {
+            return false;
+        }
+
+        Task &task = tasks_[count_];
+        task.app = &app;
+        task.period_ticks = 0;
+        if (app.GetUpdateRate() > 0)
+        {
+            task.period_ticks = configTICK_RATE_HZ / app.GetUpdateRate();
+            if (task.period_ticks == 0)
+            {
+                task.period_ticks = 1;   // Faster than the tick: run every tick
+            }
+        }
+        task.priority = tskIDLE_PRIORITY + 1;
+        task.stack = &stack_pool[stack_used_];
+        task.stack_words = stack_words;
+        task.handle = nullptr;
+        task.last_run_time = 0;
+        task.stats = RtosTaskStats();
+        task.stats.stack_words = stack_words;
+
+        stack_used_ += stack_words;
+        count_++;
+        return true;
+    }
+
+    void RtosExecutor::Start()
+    {
+        if (started_)
+        {
+            return;
+        }
+        started_ = true;
+
+        // Run-time stats and the apps' step timing use the microsecond base
+        InitMicrosecondTiming();
+        AssignPriorities();
+
+        for (size_t i = 0; i < count_; i++)
+        {
+            Task &task = tasks_[i];
+            task.handle = xTaskCreateStatic(TaskMain, task.app->GetName().c_str(), task.stack_words,
+                                            &task, task.priority, task.stack, &task.tcb);
+        }
+
+        vTaskStartScheduler();
+
+        // Only reached if the idle task could not be created
+        for (;;)
+        {
+        }
+    }
+
+    void RtosExecutor::Trigger(ApplicationBase &app)
+    {
+        Task *task = FindTask(app);
+        if (task != nullptr && task->period_ticks == 0 && task->handle != nullptr)
+        {
+            xTaskNotifyGive(task->handle);
+        }
+    }
+
+    void RtosExecutor::TriggerFromISR(ApplicationBase &app)
+    {
+        Task *task = FindTask(app);
+        if (task != nullptr && task->period_ticks == 0 && task->handle != nullptr)
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(task->handle, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+    }
+
+    void RtosExecutor::UpdateStats()
+    {
+        static TaskStatus_t status[kMaxApplications + 1];   // Apps and the idle task
+
+        uint32_t total_time = 0;
+        const UBaseType_t n = uxTaskGetSystemState(status, kMaxApplications + 1, &total_time);
+        const uint32_t total_delta = total_time - last_total_time_;
+        last_total_time_ = total_time;
+
+        for (UBaseType_t s = 0; s < n; s++)
+        {
+            const uint32_t run_time = status[s].ulRunTimeCounter;
+
+            Task *task = nullptr;
+            for (size_t i = 0; i < count_; i++)
+            {
+                if (tasks_[i].handle == status[s].xHandle)
+                {
+                    task = &tasks_[i];
+                    break;
+                }
+            }
+
+            if (task == nullptr)
+            {
+                // The only other task is the idle task
+                if (total_delta > 0)
+                {
+                    idle_percent_ = 100.0f * (run_time - last_idle_time_) / total_delta;
+                }
+                last_idle_time_ = run_time;
+                continue;
+            }
+
+            if (total_delta > 0)
+            {
+                task->stats.cpu_percent = 100.0f * (run_time - task->last_run_time) / total_delta;
+            }
+            task->last_run_time = run_time;
+            task->stats.stack_free_words = status[s].usStackHighWaterMark;
+        }
+    }
+
+    const RtosTaskStats *RtosExecutor::GetTaskStats(const ApplicationBase &app) const
+    {
+        const Task *task = FindTask(app);
+        return task != nullptr ? &task->stats : nullptr;
+    }
+
+    void RtosExecutor::AssignPriorities()
+    {
+        // Rank the apps; each distinct rank gets the next lower priority,
+        // starting at the top. If the levels run out, the remaining ranks
+        // share the lowest one above the idle task.
+        Task *order[kMaxApplications];
+        for (size_t i = 0; i < count_; i++)
+        {
+            order[i] = &tasks_[i];
+        }
+        for (size_t i = 1; i < count_; i++)
+        {
+            Task *task = order[i];
+            size_t j = i;
+            while (j > 0 && RunsBefore(*task, *order[j - 1]))
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = task;
+        }
+
+        UBaseType_t priority = configMAX_PRIORITIES - 1;
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (i > 0 && RunsBefore(*order[i - 1], *order[i]) && priority > tskIDLE_PRIORITY + 1)
+            {
+                priority--;
+            }
+            order[i]->priority = priority;
+        }
+    }
+
+    RtosExecutor::Task *RtosExecutor::FindTask(const ApplicationBase &app)
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].app == &app)
+            {
+                return &tasks_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const RtosExecutor::Task *RtosExecutor::FindTask(const ApplicationBase &app) const
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].app == &app)
+            {
+                return &tasks_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool RtosExecutor::RunsBefore(const Task &a, const Task &b)
+    {
+        // Periodic before event-driven, shorter period first, then priority
+        if ((a.period_ticks == 0) != (b.period_ticks == 0))
+        {
+            return a.period_ticks != 0;
+        }
+        if (a.period_ticks != b.period_ticks)
+        {
+            return a.period_ticks < b.period_ticks;
+        }
+        return a.app->GetPriority() > b.app->GetPriority();
+    }
+
+    void RtosExecutor::TaskMain(void *argument)
+    {
+        Task &task = *static_cast<Task *>(argument);
+
+        if (!task.app->IsInitialized())
+        {
+            task.app->Initialize();
+        }
+
+        TickType_t last_wake = xTaskGetTickCount();
+        for (;;)
+        {
+            // Failed Init() or Step() error: the task has nothing left to do
+            if (!task.app->IsInitialized())
+            {
+                vTaskSuspend(nullptr);
+                continue;
+            }
+
+            if (task.period_ticks == 0)
+            {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                task.stats.releases++;
+                task.app->Execute();
+                continue;
+            }
+
+            task.stats.releases++;
+            task.app->Execute();
+
+            // Past the next release: count the overrun and drop the periods
+            // it ran into, so the app keeps its phase instead of catching up
+            const TickType_t elapsed = xTaskGetTickCount() - last_wake;
+            if (elapsed >= task.period_ticks)
+            {
+                const TickType_t missed = elapsed / task.period_ticks;
+                task.stats.overruns++;
+                task.stats.skipped += missed;
+                last_wake += missed * task.period_ticks;
+            }
+            vTaskDelayUntil(&last_wake, task.period_ticks);
+        }
+    }
+
+} // namespace Lumos
+
+#endif // LUMOS_RTOS_FREERTOS
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "application.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef LUMOS_RTOS_FREERTOS
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifndef LUMOS_RTOS_STACK_POOL_WORDS
+#define LUMOS_RTOS_STACK_POOL_WORDS 4096
+#endif
+
+#ifndef LUMOS_RTOS_DEFAULT_STACK_WORDS
+#define LUMOS_RTOS_DEFAULT_STACK_WORDS 256
+#endif
+
+namespace Lumos
+{
+
+    struct RtosTaskStats {
+        uint64_t releases;          // Periods started (or triggers for event-driven apps)
+        uint64_t overruns;          // Steps that ran into the next period
+        uint64_t skipped;           // Periods dropped because of an overrun
+        uint32_t stack_words;       // Stack size given to the task
+        uint32_t stack_free_words;  // Least free stack seen (high-water mark)
+        float cpu_percent;          // Share of CPU time since the previous UpdateStats()
+
+        RtosTaskStats()
+            : releases(0)
+            , overruns(0)
+            , skipped(0)
+            , stack_words(0)
+            , stack_free_words(0)
+            , cpu_percent(0.0f)
+        {}
+    };
+
+    // Preemptive execution of ApplicationBase instances as FreeRTOS tasks
+    // Usage Example (project.yaml):
+    //   rtos:
+    //     kernel: freertos
+    //     stack_pool: 8192       # Words shared by all app stacks
+    //     default_stack: 512     # Words per app unless given to Add()
+    //
+    //   ControlApp control;      // SetUpdateRate(500)
+    //   TelemetryApp telemetry;  // SetUpdateRate(1)
+    //   RtosExecutor executor;
+    //
+    //   void setup() {
+    //       executor.Add(control, 1024);
+    //       executor.Add(telemetry);
+    //       executor.Start();    // Does not return
+    //   }
+    //
+    // Each app becomes a task that runs Initialize() and then Step() once per
+    // period (vTaskDelayUntil() on the 1 ms tick, so up to 1000 Hz). Task
+    // priorities are rate-monotonic: the highest rate gets the highest
+    // FreeRTOS priority, and GetPriority() orders apps with the same rate.
+    // Apps with a rate of 0 are event-driven, below all periodic apps, and
+    // run once per Trigger()/TriggerFromISR().
+    //
+    // Stacks and task control blocks are static: the stacks are carved
+    // from one pool of LUMOS_RTOS_STACK_POOL_WORDS, and Add() fails once it
+    // is used up. UpdateStats() samples the FreeRTOS run-time counters
+    // (microsecond time base) for per-task CPU usage and stack high-water
+    // marks; call it periodically, e.g. from a telemetry app.
+    class RtosExecutor
+    {
+    public:
+        static constexpr size_t kMaxApplications = 12;
+
+        RtosExecutor();
+
+        // Register an application with a stack of @p stack_words words;
+        // false if the table or the stack pool is full, or after Start()
+        bool Add(ApplicationBase& app, uint32_t stack_words = LUMOS_RTOS_DEFAULT_STACK_WORDS);
+
+        // Create the tasks and start the FreeRTOS scheduler; does not return
+        void Start();
+
+        // Release an event-driven app (rate 0)
+        void Trigger(ApplicationBase& app);
+        void TriggerFromISR(ApplicationBase& app);
+
+        // Refresh cpu_percent and stack_free_words of every task
+        void UpdateStats();
+
+        // CPU share of the idle task over the last UpdateStats() interval
+        float GetIdlePercent() const { return idle_percent_; }
+
+        size_t GetApplicationCount() const { return count_; }
+        const ApplicationBase& GetApplication(size_t index) const { return *tasks_[index].app; }
+        const RtosTaskStats* GetTaskStats(const ApplicationBase& app) const;
+
+    private:
+        struct Task {
+            ApplicationBase* app;
+            TickType_t period_ticks;     // 0 = event-driven
+            UBaseType_t priority;
+            StackType_t* stack;
+            uint32_t stack_words;
+            StaticTask_t tcb;
+            TaskHandle_t handle;
+            uint32_t last_run_time;
+            RtosTaskStats stats;
+        };
+
+        Task tasks_[kMaxApplications];
+        size_t count_;
+        size_t stack_used_;
+        bool started_;
+        uint32_t last_total_time_;
+        uint32_t last_idle_time_;
+        float idle_percent_;
+
+        void AssignPriorities();
+        Task* FindTask(const ApplicationBase& app);
+        const Task* FindTask(const ApplicationBase& app) const;
+        static bool RunsBefore(const Task& a, const Task& b);
+        static void TaskMain(void* argument);
+    };
+
+} // namespace Lumos
+
+#endif // LUMOS_RTOS_FREERTOS
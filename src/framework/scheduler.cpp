@@ -0,0 +1,369 @@
+#include "scheduler.h"
+#include "time_sync.h"
+
+#include <cmath>
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace Lumos
+{
+
+    Scheduler::Scheduler()
+        : tasks_(), count_(0), started_(false), stop_requested_(false), time_base_(nullptr),
+          watchdog_feed_(nullptr), watchdog_context_(nullptr), watchdog_feeds_(0)
+    {
+    }
+
+    bool Scheduler::Add(ApplicationBase &app)
+    {
+        if (count_ >= kMaxApplications || FindTask(app) != nullptr)
+        {
+            return false;
+        }
+
+        Task &task = tasks_[count_];
+        task.app = &app;
+        task.period_us = app.GetUpdateRate() > 0 ? 1000000u / app.GetUpdateRate() : 0;
+        task.next_release_us = 0;
+        task.triggered = false;
+        task.on_time = false;
+        task.stats = TaskStats();
+        count_++;
+
+        if (started_)
+        {
+            if (!app.IsInitialized())
+            {
+                app.Initialize();
+            }
+            task.next_release_us = GetFirstRelease(task, NowUs());
+        }
+        return true;
+    }
+
+    void Scheduler::Start()
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (!tasks_[i].app->IsInitialized())
+            {
+                tasks_[i].app->Initialize();
+            }
+        }
+
+        // All periodic apps share the first release (the critical instant)
+        const uint64_t now = NowUs();
+        for (size_t i = 0; i < count_; i++)
+        {
+            tasks_[i].next_release_us = GetFirstRelease(tasks_[i], now);
+        }
+        started_ = true;
+        stop_requested_ = false;
+    }
+
+    bool Scheduler::RunOnce()
+    {
+        if (!started_)
+        {
+            Start();
+        }
+
+        const uint64_t now = NowUs();
+        Task *next = nullptr;
+        for (size_t i = 0; i < count_; i++)
+        {
+            Task &task = tasks_[i];
+            if (!task.app->IsInitialized())
+            {
+                continue;   // Failed Init(), Step() error or shut down
+            }
+            if (time_base_ != nullptr && task.period_us > 0 && task.next_release_us > now + task.period_us)
+            {
+                task.next_release_us = GetFirstRelease(task, now);   // Time base stepped back
+            }
+            const bool ready = task.period_us > 0 ? now >= task.next_release_us : task.triggered;
+            if (ready && (next == nullptr || RunsBefore(task, *next)))
+            {
+                next = &task;
+            }
+        }
+
+        if (next == nullptr)
+        {
+            ServiceWatchdog();
+            return false;
+        }
+        RunTask(*next, now);
+        ServiceWatchdog();
+        return true;
+    }
+
+    void Scheduler::Run()
+    {
+        if (count_ == 0)
+        {
+            return;
+        }
+        if (!started_)
+        {
+            Start();
+        }
+
+        while (!stop_requested_)
+        {
+            if (!RunOnce())
+            {
+                IdleUntilNextRelease();
+            }
+        }
+
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].app->IsInitialized())
+            {
+                tasks_[i].app->Shutdown();
+            }
+        }
+        started_ = false;
+    }
+
+    void Scheduler::Stop()
+    {
+        stop_requested_ = true;
+    }
+
+    void Scheduler::Trigger(ApplicationBase &app)
+    {
+        Task *task = FindTask(app);
+        if (task != nullptr && task->period_us == 0)
+        {
+            task->triggered = true;
+        }
+    }
+
+    uint64_t Scheduler::GetTimeUntilNextReleaseUs() const
+    {
+        const uint64_t now = NowUs();
+        uint64_t wait = UINT64_MAX;
+        for (size_t i = 0; i < count_; i++)
+        {
+            const Task &task = tasks_[i];
+            if (task.triggered)
+            {
+                return 0;
+            }
+            if (task.period_us == 0 || !task.app->IsInitialized())
+            {
+                continue;
+            }
+            if (task.next_release_us <= now)
+            {
+                return 0;
+            }
+            if (task.next_release_us - now < wait)
+            {
+                wait = task.next_release_us - now;
+            }
+        }
+        return wait;
+    }
+
+    double Scheduler::GetUtilization() const
+    {
+        double utilization = 0.0;
+        for (size_t i = 0; i < count_; i++)
+        {
+            const Task &task = tasks_[i];
+            if (task.period_us > 0)
+            {
+                utilization += static_cast<double>(task.app->GetStats().max_step_time_us) / task.period_us;
+            }
+        }
+        return utilization;
+    }
+
+    bool Scheduler::IsSchedulable() const
+    {
+        size_t periodic = 0;
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].period_us > 0)
+            {
+                periodic++;
+            }
+        }
+        if (periodic == 0)
+        {
+            return true;
+        }
+        const double n = static_cast<double>(periodic);
+        return GetUtilization() <= n * (std::pow(2.0, 1.0 / n) - 1.0);
+    }
+
+    const TaskStats *Scheduler::GetTaskStats(const ApplicationBase &app) const
+    {
+        const Task *task = FindTask(app);
+        return task != nullptr ? &task->stats : nullptr;
+    }
+
+    void Scheduler::RunTask(Task &task, uint64_t now_us)
+    {
+        task.stats.releases++;
+
+        if (task.period_us == 0)
+        {
+            task.triggered = false;
+            task.app->Execute();
+            return;
+        }
+
+        const uint64_t release = task.next_release_us;
+        if (now_us - release > task.stats.max_latency_us)
+        {
+            task.stats.max_latency_us = now_us - release;
+        }
+
+        task.app->Execute();
+
+        // The deadline is the next release; releases that passed while the
+        // step ran are dropped so the app keeps its phase
+        task.next_release_us = release + task.period_us;
+        const uint64_t end = NowUs();
+        const bool met = end <= task.next_release_us;
+        task.app->ReportDeadline(met, met ? 0 : end - task.next_release_us);
+        if (!met)
+        {
+            task.stats.overruns++;
+            const uint64_t missed = (end - task.next_release_us) / task.period_us;
+            task.stats.skipped += missed;
+            task.next_release_us += (missed + 1) * task.period_us;
+        }
+        task.on_time = task.on_time || met;
+
+        // DeadlinePolicy::DEGRADE lowered the rate: later releases use it
+        const uint32_t rate_hz = task.app->GetUpdateRate();
+        if (rate_hz > 0 && 1000000u / rate_hz != task.period_us)
+        {
+            task.period_us = 1000000u / rate_hz;
+        }
+    }
+
+    void Scheduler::ServiceWatchdog()
+    {
+        if (watchdog_feed_ == nullptr)
+        {
+            return;
+        }
+        for (size_t i = 0; i < count_; i++)
+        {
+            const Task &task = tasks_[i];
+            if (task.period_us > 0 && task.app->IsCritical() && !task.on_time)
+            {
+                return;   // Includes critical apps in ERROR, which never step again
+            }
+        }
+        watchdog_feed_(watchdog_context_);
+        watchdog_feeds_++;
+        for (size_t i = 0; i < count_; i++)
+        {
+            tasks_[i].on_time = false;
+        }
+    }
+
+    void Scheduler::IdleUntilNextRelease()
+    {
+        const uint64_t wait_us = GetTimeUntilNextReleaseUs();
+        if (wait_us == 0)
+        {
+            return;
+        }
+
+#ifdef LUMOS_DEVICE_TIME_BASE
+        // Sleep through whole milliseconds (WFI wakes at the latest on the
+        // next SysTick, Stop mode for long gaps); spin the remainder for the
+        // release to start on time. Triggers from interrupts end the sleep.
+        if (wait_us >= 1000)
+        {
+            Idle(wait_us == UINT64_MAX ? UINT32_MAX : static_cast<uint32_t>(wait_us / 1000));
+        }
+#ifdef LUMOS_HOST
+        else
+        {
+            DelayUs(static_cast<uint32_t>(wait_us));   // The simulated clock skips the spin
+        }
+#endif
+#else
+        const uint64_t sleep_us = wait_us == UINT64_MAX ? 1000 : wait_us;
+        std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+#endif
+    }
+
+    Scheduler::Task *Scheduler::FindTask(const ApplicationBase &app)
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].app == &app)
+            {
+                return &tasks_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const Scheduler::Task *Scheduler::FindTask(const ApplicationBase &app) const
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if (tasks_[i].app == &app)
+            {
+                return &tasks_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    uint64_t Scheduler::GetFirstRelease(const Task &task, uint64_t now_us) const
+    {
+        if (time_base_ == nullptr || task.period_us == 0 || now_us % task.period_us == 0)
+        {
+            return now_us;
+        }
+        return now_us - now_us % task.period_us + task.period_us;
+    }
+
+    bool Scheduler::RunsBefore(const Task &a, const Task &b)
+    {
+        // Periodic before event-driven, shorter period first, then priority
+        if ((a.period_us == 0) != (b.period_us == 0))
+        {
+            return a.period_us != 0;
+        }
+        if (a.period_us != b.period_us)
+        {
+            return a.period_us < b.period_us;
+        }
+        return a.app->GetPriority() > b.app->GetPriority();
+    }
+
+    uint64_t Scheduler::NowUs() const
+    {
+        if (time_base_ != nullptr)
+        {
+            return time_base_->GetTimeUs();
+        }
+#ifdef LUMOS_DEVICE_TIME_BASE
+        return ::GetCurrentTimeUs();
+#else
+        auto now = std::chrono::steady_clock::now();
+        auto duration = now.time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+#endif
+    }
+
+} // namespace Lumos
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "application.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    class TimeBase;
+
+    struct TaskStats {
+        uint64_t releases;         // Periods started (or triggers for event-driven apps)
+        uint64_t overruns;         // Steps that finished after their deadline
+        uint64_t skipped;          // Releases dropped because the previous step overran
+        uint64_t max_latency_us;   // Longest delay from release to the start of Step()
+
+        TaskStats()
+            : releases(0)
+            , overruns(0)
+            , skipped(0)
+            , max_latency_us(0)
+        {}
+    };
+
+    // Rate-monotonic scheduler for ApplicationBase instances
+    // Usage Example:
+    //   SensorApp sensors;    // SetUpdateRate(100)
+    //   TelemetryApp telemetry;   // SetUpdateRate(1)
+    //
+    //   Scheduler scheduler;
+    //   scheduler.Add(sensors);
+    //   scheduler.Add(telemetry);
+    //   scheduler.Run();      // Never returns while an app is registered
+    //
+    //   // Or from loop(), next to other polled work
+    //   void setup() { scheduler.Start(); }
+    //   void loop()  { scheduler.RunOnce(); Idle(scheduler.GetTimeUntilNextReleaseUs() / 1000); }
+    //
+    // Each app with a non-zero GetUpdateRate() is released once per period,
+    // on the microsecond time base (GetCurrentTimeUs(), driven by SysTick and
+    // the cycle counter on the device). Among ready apps the one with the
+    // shortest period runs first; GetPriority() breaks ties. Steps are not
+    // preempted, so a step's latency includes the longest step of any other
+    // app. A step that ends past the next release counts as an overrun, and
+    // releases it ran over are skipped rather than run back to back.
+    //
+    // Apps with a rate of 0 are event-driven: they run once per Trigger()
+    // (safe from interrupts), after all ready periodic apps.
+    //
+    // With SetTimeBase() releases follow that clock instead and fall on
+    // whole multiples of each period, so apps with the same rate on nodes
+    // sharing a network time (TimeSync) run in phase.
+    //
+    // Overruns are also deadline misses in the app's ApplicationStats, and
+    // its DeadlinePolicy decides what happens after miss_limit of them in
+    // a row: keep skipping (default), halve the rate, or put the app in
+    // ERROR. With a watchdog the scheduler feeds it only once every
+    // critical app (SetCritical()) has completed a step on time since the
+    // last feed, so a hung, overrunning or failed control loop lets it
+    // reset the board:
+    //   control.SetCritical();
+    //   control.SetDeadlinePolicy(DeadlinePolicy::ERROR, 3);
+    //   Watchdog::start(50);          // wrapper/watchdog.h (IWDG)
+    //   scheduler.SetWatchdog(Watchdog::feedHandler);
+    // The timeout must exceed the longest critical period plus its worst
+    // step. Without critical apps every scheduler pass feeds it.
+    class Scheduler
+    {
+    public:
+        static constexpr size_t kMaxApplications = 16;
+
+        Scheduler();
+
+        // Register an application; false if the table is full or the
+        // app is already registered. Apps added after Start() are
+        // initialized and released right away.
+        bool Add(ApplicationBase& app);
+
+        // Release on @p time_base (nullptr: local time); call before Start()
+        void SetTimeBase(const TimeBase* time_base) { time_base_ = time_base; }
+
+        // Feed a watchdog through @p feed (nullptr: none) while all critical
+        // apps meet their deadlines
+        void SetWatchdog(void (*feed)(void* context), void* context = nullptr)
+        {
+            watchdog_feed_ = feed;
+            watchdog_context_ = context;
+        }
+        uint64_t GetWatchdogFeeds() const { return watchdog_feeds_; }
+
+        // Initialize all apps and release them at the current time, or at
+        // the next multiple of their period with a time base
+        void Start();
+
+        // Run the highest priority ready app once; false if none was ready
+        bool RunOnce();
+
+        // Start() if needed, then run apps and idle between releases until
+        // Stop(); returns immediately if no app is registered
+        void Run();
+
+        // Make Run() return after the current step, then shut every app down
+        void Stop();
+
+        // Release an event-driven app (rate 0); callable from interrupts
+        void Trigger(ApplicationBase& app);
+
+        // Microseconds until the next periodic release (0 if one is ready,
+        // UINT64_MAX if there are only event-driven apps)
+        uint64_t GetTimeUntilNextReleaseUs() const;
+
+        // Sum of max step time / period over periodic apps, and whether it
+        // is within the Liu & Layland bound n * (2^(1/n) - 1)
+        double GetUtilization() const;
+        bool IsSchedulable() const;
+
+        size_t GetApplicationCount() const { return count_; }
+        ApplicationBase& GetApplication(size_t index) const { return *tasks_[index].app; }
+        const TaskStats* GetTaskStats(const ApplicationBase& app) const;
+
+    private:
+        struct Task {
+            ApplicationBase* app;
+            uint64_t period_us;          // 0 = event-driven
+            uint64_t next_release_us;
+            volatile bool triggered;
+            bool on_time;                // A step met its deadline since the last feed
+            TaskStats stats;
+        };
+
+        Task tasks_[kMaxApplications];
+        size_t count_;
+        bool started_;
+        volatile bool stop_requested_;
+        const TimeBase* time_base_;
+        void (*watchdog_feed_)(void* context);
+        void* watchdog_context_;
+        uint64_t watchdog_feeds_;
+
+        void ServiceWatchdog();
+        void RunTask(Task& task, uint64_t now_us);
+        void IdleUntilNextRelease();
+        Task* FindTask(const ApplicationBase& app);
+        const Task* FindTask(const ApplicationBase& app) const;
+        uint64_t GetFirstRelease(const Task& task, uint64_t now_us) const;
+        static bool RunsBefore(const Task& a, const Task& b);
+        uint64_t NowUs() const;
+    };
+
+    // One "@app" line per registered app (see application.h)
+    template <typename Out>
+    void PrintApplicationStats(Out& out, const Scheduler& scheduler)
+    {
+        for (size_t i = 0; i < scheduler.GetApplicationCount(); i++)
+        {
+            PrintApplicationStats(out, scheduler.GetApplication(i));
+        }
+    }
+
+} // namespace Lumos
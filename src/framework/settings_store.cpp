@@ -0,0 +1,774 @@
+#include "settings_store.h"
+
+#include <cstring>
+
+#ifdef LUMOS_DEVICE_SYNC
+#include "flash.h"
+#endif
+
+namespace Lumos
+{
+
+    namespace
+    {
+        constexpr uint32_t kMagic = 0x5445534C;     // "LSET", the first word of a live sector
+        constexpr uint16_t kRemoved = 0x8000;       // Length flag of a Remove() record
+
+#ifdef LUMOS_DEVICE_SYNC
+        constexpr size_t kProgramSize = Flash::PROGRAM_SIZE;
+
+        const uint8_t* RegionBase() { return reinterpret_cast<const uint8_t*>(Flash::regionStart()); }
+        uint32_t RegionSize() { return Flash::regionSize(); }
+        uint32_t SectorSize() { return Flash::sectorSize(); }
+        bool StartErase(uint32_t offset) { return Flash::eraseAsync(Flash::regionStart() + offset); }
+        bool Erasing() { return Flash::busy(); }
+        bool EraseFailed() { return Flash::failed(); }
+        bool Program(uint32_t offset, const uint8_t* data) { return Flash::program(Flash::regionStart() + offset, data); }
+#else
+        // NOR flash in RAM: erases finish at once, programming only clears bits
+        constexpr size_t kProgramSize = 8;
+        constexpr size_t kHostRegionSize = LUMOS_SETTINGS_HOST_SECTOR_SIZE * LUMOS_SETTINGS_HOST_SECTORS;
+
+        uint8_t* HostRegion()
+        {
+            alignas(8) static uint8_t region[kHostRegionSize];
+            static bool erased = false;
+            if (!erased)
+            {
+                memset(region, 0xFF, sizeof(region));
+                erased = true;
+            }
+            return region;
+        }
+
+        const uint8_t* RegionBase() { return HostRegion(); }
+        uint32_t RegionSize() { return kHostRegionSize; }
+        uint32_t SectorSize() { return LUMOS_SETTINGS_HOST_SECTOR_SIZE; }
+        bool StartErase(uint32_t offset)
+        {
+            memset(HostRegion() + offset, 0xFF, LUMOS_SETTINGS_HOST_SECTOR_SIZE);
+            return true;
+        }
+        bool Erasing() { return false; }
+        bool EraseFailed() { return false; }
+        bool Program(uint32_t offset, const uint8_t* data)
+        {
+            uint8_t* word = HostRegion() + offset;
+            for (size_t i = 0; i < kProgramSize; i++)
+            {
+                word[i] &= data[i];
+            }
+            return true;
+        }
+#endif
+
+        size_t RecordSize(size_t length)
+        {
+            return (8 + length + kProgramSize - 1) / kProgramSize * kProgramSize;
+        }
+
+        uint16_t Load16(const uint8_t* bytes)
+        {
+            uint16_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+
+        uint32_t Load32(const uint8_t* bytes)
+        {
+            uint32_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+
+        bool IsErased(const uint8_t* bytes, size_t length)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                if (bytes[i] != 0xFF)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // CRC-32 (ISO-HDLC) of the key, length and value; bitwise, as records are short
+        uint32_t RecordCrc(const uint8_t* header, const uint8_t* value, size_t length)
+        {
+            uint32_t crc = 0xFFFFFFFF;
+            auto add = [&crc](const uint8_t* data, size_t count) {
+                for (size_t i = 0; i < count; i++)
+                {
+                    crc ^= data[i];
+                    for (int bit = 0; bit < 8; bit++)
+                    {
+                        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+                    }
+                }
+            };
+            add(header, 4);
+            add(value, length);
+            return ~crc;
+        }
+    }
+
+    SettingsStore::SettingsStore()
+        : entries_()
+        , slots_()
+        , next_ticket_(0)
+        , stage_()
+        , stage_size_(0)
+        , stage_written_(0)
+        , stage_location_(0)
+        , stage_key_(0)
+        , stage_slot_(-1)
+        , state_()
+        , sequence_()
+        , sector_count_(0)
+        , sector_size_(0)
+        , head_(kNone)
+        , write_(0)
+        , last_sequence_(0)
+        , compacting_(false)
+        , compact_sector_(0)
+        , compact_offset_(0)
+        , compact_next_(0)
+        , erasing_(kNone)
+        , live_bytes_(0)
+        , capacity_(0)
+        , erases_(0)
+        , failures_(0)
+        , ready_(false)
+        , failed_(false)
+        , gate_(nullptr)
+        , gate_context_(nullptr)
+    {
+    }
+
+    bool SettingsStore::Init()
+    {
+        ready_ = false;
+        failed_ = false;
+        for (auto& entry : entries_)
+        {
+            entry.location = kNone;
+            entry.size = 0;
+            entry.slot = -1;
+        }
+        for (auto& slot : slots_)
+        {
+            slot.state = SlotState::FREE;
+        }
+        stage_size_ = 0;
+        stage_slot_ = -1;
+        head_ = kNone;
+        write_ = 0;
+        last_sequence_ = 0;
+        compacting_ = false;
+        erasing_ = kNone;
+        live_bytes_ = 0;
+        capacity_ = 0;
+        erases_ = 0;
+        failures_ = 0;
+
+        sector_size_ = SectorSize();
+        sector_count_ = sector_size_ > 0 ? RegionSize() / sector_size_ : 0;
+        if (sector_count_ > kMaxSectors)
+        {
+            sector_count_ = kMaxSectors;
+        }
+        const size_t record = RecordSize(kMaxValueSize);
+        if (sector_count_ < 2 || sector_size_ < kProgramSize + 2 * record)
+        {
+            return false;
+        }
+        // Every sector but the spare, less a header and the space a record
+        // too long for the rest of a sector may leave
+        capacity_ = (sector_count_ - 1) * (sector_size_ - kProgramSize - record);
+
+        // Live sectors (with a header), erased ones and the rest
+        uint32_t order[kMaxSectors];
+        uint32_t live = 0;
+        const uint8_t* base = RegionBase();
+        for (uint32_t sector = 0; sector < sector_count_; sector++)
+        {
+            const uint8_t* header = base + sector * sector_size_;
+            if (Load32(header) == kMagic)
+            {
+                state_[sector] = SectorState::LIVE;
+                sequence_[sector] = Load32(header + 4);
+                // Oldest first
+                uint32_t i = live++;
+                while (i > 0 && sequence_[order[i - 1]] > sequence_[sector])
+                {
+                    order[i] = order[i - 1];
+                    i--;
+                }
+                order[i] = sector;
+            }
+            else
+            {
+                state_[sector] = IsErased(header, sector_size_) ? SectorState::ERASED : SectorState::DIRTY;
+            }
+        }
+
+        // Replay the log: later records replace earlier ones
+        for (uint32_t i = 0; i < live; i++)
+        {
+            head_ = order[i];
+            last_sequence_ = sequence_[head_];
+            ScanSector(head_);
+        }
+        for (const auto& entry : entries_)
+        {
+            live_bytes_ += entry.size;
+        }
+
+        // A reset during compaction or before its erase leaves no spare
+        bool spare = false;
+        for (uint32_t sector = 0; sector < sector_count_; sector++)
+        {
+            spare = spare || state_[sector] != SectorState::LIVE;
+        }
+        if (!spare)
+        {
+            StartCompaction();
+        }
+        ready_ = true;
+        return true;
+    }
+
+    void SettingsStore::ScanSector(uint32_t sector)
+    {
+        const uint8_t* base = RegionBase() + sector * sector_size_;
+        uint32_t offset = kProgramSize;
+        while (offset + kRecordHeader <= sector_size_)
+        {
+            const uint8_t* record = base + offset;
+            if (IsErased(record, kRecordHeader))
+            {
+                break;
+            }
+            const uint16_t key = Load16(record);
+            const uint16_t flags = Load16(record + 2);
+            const size_t length = flags & ~kRemoved;
+            const size_t size = RecordSize(length);
+            if (length > kMaxValueSize || offset + size > sector_size_)
+            {
+                // No way past it: not appended to again
+                offset = sector_size_;
+                break;
+            }
+            if (RecordCrc(record, record + kRecordHeader, length) != Load32(record + 4))
+            {
+                // Interrupted while programming; its words are not reused
+                offset += static_cast<uint32_t>(size);
+                continue;
+            }
+            if (key < kMaxKeys)
+            {
+                Entry& entry = entries_[key];
+                const bool removed = (flags & kRemoved) != 0;
+                entry.location = removed ? kNone : sector * sector_size_ + offset;
+                entry.size = removed ? 0 : static_cast<uint16_t>(size);
+            }
+            offset += size;
+        }
+        write_ = offset;
+    }
+
+    const uint8_t* SettingsStore::Record(uint32_t location) const
+    {
+        return RegionBase() + location;
+    }
+
+    bool SettingsStore::SameValue(const Entry& entry, const void* data, size_t length) const
+    {
+        if (entry.slot >= 0)
+        {
+            const Slot& slot = slots_[entry.slot];
+            return !slot.removed && slot.length == length && (length == 0 || memcmp(slot.data, data, length) == 0);
+        }
+        if (entry.location == kNone)
+        {
+            return false;
+        }
+        const uint8_t* record = Record(entry.location);
+        return Load16(record + 2) == length && (length == 0 || memcmp(record + kRecordHeader, data, length) == 0);
+    }
+
+    int SettingsStore::GetLength(uint16_t key) const
+    {
+        if (key >= kMaxKeys)
+        {
+            return -1;
+        }
+        CriticalSection lock;
+        const Entry& entry = entries_[key];
+        if (entry.slot >= 0)
+        {
+            const Slot& slot = slots_[entry.slot];
+            return slot.removed ? -1 : slot.length;
+        }
+        if (entry.location == kNone)
+        {
+            return -1;
+        }
+        return Load16(Record(entry.location) + 2);
+    }
+
+    int SettingsStore::Get(uint16_t key, void* data, size_t capacity) const
+    {
+        if (key >= kMaxKeys)
+        {
+            return -1;
+        }
+        CriticalSection lock;
+        const Entry& entry = entries_[key];
+        const uint8_t* value;
+        size_t length;
+        if (entry.slot >= 0)
+        {
+            const Slot& slot = slots_[entry.slot];
+            if (slot.removed)
+            {
+                return -1;
+            }
+            value = slot.data;
+            length = slot.length;
+        }
+        else if (entry.location != kNone)
+        {
+            const uint8_t* record = Record(entry.location);
+            value = record + kRecordHeader;
+            length = Load16(record + 2);
+        }
+        else
+        {
+            return -1;
+        }
+        if (length > 0 && length <= capacity)
+        {
+            memcpy(data, value, length);
+        }
+        return static_cast<int>(length);
+    }
+
+    int SettingsStore::FreeSlot() const
+    {
+        for (size_t i = 0; i < kPendingSlots; i++)
+        {
+            if (slots_[i].state == SlotState::FREE)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    bool SettingsStore::Set(uint16_t key, const void* data, size_t length)
+    {
+        if (!ready_ || failed_ || key >= kMaxKeys || length > kMaxValueSize)
+        {
+            return false;
+        }
+
+        CriticalSection lock;
+        Entry& entry = entries_[key];
+        if (SameValue(entry, data, length))
+        {
+            return true;
+        }
+        const size_t size = RecordSize(length);
+        if (live_bytes_ - entry.size + size > capacity_)
+        {
+            return false;
+        }
+
+        // A queued value is replaced, one being programmed is not
+        int index = entry.slot;
+        if (index < 0 || slots_[index].state != SlotState::PENDING)
+        {
+            index = FreeSlot();
+            if (index < 0)
+            {
+                return false;
+            }
+            slots_[index].ticket = next_ticket_++;
+        }
+        Slot& slot = slots_[index];
+        slot.key = key;
+        slot.length = static_cast<uint16_t>(length);
+        slot.removed = false;
+        slot.state = SlotState::PENDING;
+        if (length > 0)
+        {
+            memcpy(slot.data, data, length);
+        }
+
+        live_bytes_ = live_bytes_ - entry.size + size;
+        entry.size = static_cast<uint16_t>(size);
+        entry.slot = static_cast<int8_t>(index);
+        return true;
+    }
+
+    bool SettingsStore::Remove(uint16_t key)
+    {
+        if (!ready_ || failed_ || key >= kMaxKeys)
+        {
+            return false;
+        }
+
+        CriticalSection lock;
+        Entry& entry = entries_[key];
+        const bool queued = entry.slot >= 0 && slots_[entry.slot].state == SlotState::PENDING;
+        const bool writing = stage_size_ > 0 && stage_key_ == key;
+        if (entry.location == kNone && !writing && (entry.slot < 0 || queued))
+        {
+            // Nothing in flash (or being programmed) to override
+            if (queued)
+            {
+                slots_[entry.slot].state = SlotState::FREE;
+            }
+            entry.slot = -1;
+            live_bytes_ -= entry.size;
+            entry.size = 0;
+            return true;
+        }
+        if (entry.slot >= 0 && slots_[entry.slot].removed)
+        {
+            return true;
+        }
+
+        int index = queued ? entry.slot : FreeSlot();
+        if (index < 0)
+        {
+            return false;
+        }
+        if (!queued)
+        {
+            slots_[index].ticket = next_ticket_++;
+        }
+        Slot& slot = slots_[index];
+        slot.key = key;
+        slot.length = 0;
+        slot.removed = true;
+        slot.state = SlotState::PENDING;
+
+        live_bytes_ -= entry.size;
+        entry.size = 0;
+        entry.slot = static_cast<int8_t>(index);
+        return true;
+    }
+
+    int SettingsStore::OldestPending() const
+    {
+        int oldest = -1;
+        for (size_t i = 0; i < kPendingSlots; i++)
+        {
+            if (slots_[i].state == SlotState::PENDING &&
+                (oldest < 0 || static_cast<int32_t>(slots_[i].ticket - slots_[oldest].ticket) < 0))
+            {
+                oldest = static_cast<int>(i);
+            }
+        }
+        return oldest;
+    }
+
+    bool SettingsStore::IsIdle() const
+    {
+        return stage_size_ == 0 && !compacting_ && OldestPending() < 0;
+    }
+
+    bool SettingsStore::Poll()
+    {
+        return Step(true);
+    }
+
+    bool SettingsStore::Flush()
+    {
+        while (Step(false))
+        {
+        }
+        return !failed_;
+    }
+
+    bool SettingsStore::Step(bool use_gate)
+    {
+        if (!ready_ || failed_)
+        {
+            return false;
+        }
+
+        // The erase runs from the flash interrupt; nothing else is
+        // programmed meanwhile
+        if (erasing_ != kNone)
+        {
+            if (Erasing())
+            {
+                return true;
+            }
+            if (EraseFailed())
+            {
+                Fail();
+                return false;
+            }
+            state_[erasing_] = SectorState::ERASED;
+            erasing_ = kNone;
+            erases_++;
+        }
+
+        // The next flash word of the record in progress
+        if (stage_size_ > 0)
+        {
+            if (!Program(stage_location_ + stage_written_, stage_ + stage_written_))
+            {
+                Fail();
+                return false;
+            }
+            stage_written_ += kProgramSize;
+            if (stage_written_ == stage_size_)
+            {
+                Commit();
+            }
+            return true;
+        }
+
+        // Erase sectors whose values have moved on
+        uint32_t dirty = kNone;
+        for (uint32_t sector = 0; sector < sector_count_ && dirty == kNone; sector++)
+        {
+            if (state_[sector] == SectorState::DIRTY)
+            {
+                dirty = sector;
+            }
+        }
+        if (dirty != kNone && (!use_gate || gate_ == nullptr || gate_(gate_context_)))
+        {
+            if (!StartErase(dirty * sector_size_))
+            {
+                Fail();
+                return false;
+            }
+            erasing_ = dirty;
+            return true;
+        }
+
+        // Moving the oldest sector's values goes before new ones
+        if (compacting_)
+        {
+            return CompactStep() || dirty != kNone;
+        }
+
+        int oldest;
+        {
+            CriticalSection lock;
+            oldest = OldestPending();
+            if (oldest >= 0)
+            {
+                const Slot& slot = slots_[oldest];
+                const size_t size = RecordSize(slot.removed ? 0 : slot.length);
+                if (head_ != kNone && write_ + size <= sector_size_)
+                {
+                    Stage(slot, static_cast<int8_t>(oldest));
+                    return true;
+                }
+            }
+        }
+        if (oldest < 0)
+        {
+            return dirty != kNone;
+        }
+        // The head is full: on to an erased sector, if there is one yet
+        if (!Advance())
+        {
+            return dirty != kNone || erasing_ != kNone;
+        }
+        return true;
+    }
+
+    bool SettingsStore::Advance()
+    {
+        // The next erased sector after the head, round the region
+        const uint32_t start = head_ == kNone ? 0 : head_ + 1;
+        uint32_t next = kNone;
+        for (uint32_t i = 0; i < sector_count_ && next == kNone; i++)
+        {
+            const uint32_t sector = (start + i) % sector_count_;
+            if (state_[sector] == SectorState::ERASED)
+            {
+                next = sector;
+            }
+        }
+        if (next == kNone)
+        {
+            return false;
+        }
+
+        alignas(4) uint8_t header[kProgramSize];
+        memset(header, 0xFF, sizeof(header));
+        const uint32_t magic = kMagic;
+        const uint32_t sequence = last_sequence_ + 1;
+        memcpy(header, &magic, sizeof(magic));
+        memcpy(header + 4, &sequence, sizeof(sequence));
+        if (!Program(next * sector_size_, header))
+        {
+            Fail();
+            return false;
+        }
+        state_[next] = SectorState::LIVE;
+        sequence_[next] = sequence;
+        last_sequence_ = sequence;
+        head_ = next;
+        write_ = kProgramSize;
+
+        // The last spare is taken: reclaim the oldest sector
+        bool spare = false;
+        for (uint32_t sector = 0; sector < sector_count_; sector++)
+        {
+            spare = spare || state_[sector] != SectorState::LIVE;
+        }
+        if (!spare)
+        {
+            StartCompaction();
+        }
+        return true;
+    }
+
+    void SettingsStore::StartCompaction()
+    {
+        uint32_t oldest = kNone;
+        for (uint32_t sector = 0; sector < sector_count_; sector++)
+        {
+            if (sector != head_ && state_[sector] == SectorState::LIVE &&
+                (oldest == kNone || sequence_[sector] < sequence_[oldest]))
+            {
+                oldest = sector;
+            }
+        }
+        if (oldest == kNone)
+        {
+            return;
+        }
+        compacting_ = true;
+        compact_sector_ = oldest;
+        compact_offset_ = kProgramSize;
+    }
+
+    bool SettingsStore::CompactStep()
+    {
+        const uint32_t first = compact_sector_ * sector_size_;
+        while (compact_offset_ + kRecordHeader <= sector_size_)
+        {
+            const uint8_t* record = Record(first + compact_offset_);
+            if (IsErased(record, kRecordHeader))
+            {
+                break;
+            }
+            const uint16_t key = Load16(record);
+            const size_t length = Load16(record + 2) & ~kRemoved;
+            const size_t size = RecordSize(length);
+            if (length > kMaxValueSize || compact_offset_ + size > sector_size_)
+            {
+                break;
+            }
+
+            CriticalSection lock;
+            if (key < kMaxKeys && entries_[key].location == first + compact_offset_)
+            {
+                if (write_ + size > sector_size_)
+                {
+                    // Cannot happen within Capacity(); never erase a value
+                    Fail();
+                    return false;
+                }
+                memcpy(stage_, record, size);
+                stage_size_ = static_cast<uint32_t>(size);
+                stage_written_ = 0;
+                stage_location_ = head_ * sector_size_ + write_;
+                stage_key_ = key;
+                stage_slot_ = -1;
+                compact_next_ = compact_offset_ + static_cast<uint32_t>(size);
+                return true;
+            }
+            compact_offset_ += static_cast<uint32_t>(size);
+        }
+
+        // Everything current has moved
+        state_[compact_sector_] = SectorState::DIRTY;
+        compacting_ = false;
+        return true;
+    }
+
+    void SettingsStore::Stage(const Slot& slot, int8_t index)
+    {
+        const size_t length = slot.removed ? 0 : slot.length;
+        const size_t size = RecordSize(length);
+        const uint16_t flags = static_cast<uint16_t>(length | (slot.removed ? kRemoved : 0));
+        memset(stage_, 0xFF, size);
+        memcpy(stage_, &slot.key, sizeof(slot.key));
+        memcpy(stage_ + 2, &flags, sizeof(flags));
+        memcpy(stage_ + kRecordHeader, slot.data, length);
+        const uint32_t crc = RecordCrc(stage_, stage_ + kRecordHeader, length);
+        memcpy(stage_ + 4, &crc, sizeof(crc));
+
+        stage_size_ = static_cast<uint32_t>(size);
+        stage_written_ = 0;
+        stage_location_ = head_ * sector_size_ + write_;
+        stage_key_ = slot.key;
+        stage_slot_ = index;
+        slots_[index].state = SlotState::WRITING;
+    }
+
+    void SettingsStore::Commit()
+    {
+        CriticalSection lock;
+        Entry& entry = entries_[stage_key_];
+        if (stage_slot_ >= 0)
+        {
+            Slot& slot = slots_[stage_slot_];
+            entry.location = slot.removed ? kNone : stage_location_;
+            if (entry.slot == stage_slot_)
+            {
+                entry.slot = -1;
+            }
+            slot.state = SlotState::FREE;
+        }
+        else
+        {
+            entry.location = stage_location_;
+            compact_offset_ = compact_next_;
+        }
+        write_ += stage_size_;
+        stage_size_ = 0;
+        stage_slot_ = -1;
+    }
+
+    void SettingsStore::Fail()
+    {
+        // The region is left as it is; Init() picks up from there
+        failed_ = true;
+        failures_++;
+    }
+
+    SettingsStats SettingsStore::GetStats() const
+    {
+        CriticalSection lock;
+        SettingsStats stats = {};
+        for (const auto& entry : entries_)
+        {
+            stats.keys += entry.size > 0 ? 1 : 0;
+        }
+        for (const auto& slot : slots_)
+        {
+            stats.pending += slot.state != SlotState::FREE ? 1 : 0;
+        }
+        stats.used = static_cast<uint32_t>(live_bytes_);
+        stats.capacity = static_cast<uint32_t>(capacity_);
+        stats.erases = erases_;
+        stats.failures = failures_;
+        return stats;
+    }
+
+} // namespace Lumos
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Keys are 0 to LUMOS_SETTINGS_MAX_KEYS - 1
+#ifndef LUMOS_SETTINGS_MAX_KEYS
+#define LUMOS_SETTINGS_MAX_KEYS 64
+#endif
+
+// Largest value in bytes
+#ifndef LUMOS_SETTINGS_MAX_VALUE
+#define LUMOS_SETTINGS_MAX_VALUE 64
+#endif
+
+// Values Set() can hold before Poll() has written them
+#ifndef LUMOS_SETTINGS_PENDING
+#define LUMOS_SETTINGS_PENDING 8
+#endif
+
+// Sectors of the region used; the rest is left alone
+#ifndef LUMOS_SETTINGS_MAX_SECTORS
+#define LUMOS_SETTINGS_MAX_SECTORS 16
+#endif
+
+// Host builds emulate the region with a static array of these sectors
+#ifndef LUMOS_SETTINGS_HOST_SECTOR_SIZE
+#define LUMOS_SETTINGS_HOST_SECTOR_SIZE 2048
+#endif
+#ifndef LUMOS_SETTINGS_HOST_SECTORS
+#define LUMOS_SETTINGS_HOST_SECTORS 4
+#endif
+
+namespace Lumos
+{
+
+    struct SettingsStats {
+        uint32_t keys;         // Keys with a value
+        uint32_t used;         // Flash bytes their records take
+        uint32_t capacity;     // Most bytes of records the store accepts
+        uint32_t pending;      // Values Poll() has not written yet
+        uint32_t erases;       // Sector erases since Init()
+        uint32_t failures;     // Flash errors; the store stops writing after one
+    };
+
+    // Calibration and settings in the board's reserved flash region
+    // Usage Example:
+    //   enum SettingKey : uint16_t { kGyroOffset, kMotorGains, kNodeName };
+    //   SettingsStore settings;
+    //
+    //   void setup() {
+    //       settings.Init();                          // Reads the index once
+    //       settings.Get(kGyroOffset, gyro_offset);   // false if never set
+    //   }
+    //
+    //   void calibrate() {
+    //       settings.Set(kGyroOffset, gyro_offset);   // Returns at once
+    //   }
+    //
+    //   void loop() { settings.Poll(); }              // Writes in the background
+    //
+    //   // Erase only while the motors are off (or nothing else runs from
+    //   // flash on a single-bank chip)
+    //   settings.SetEraseGate([](void*) { return !motors.armed(); });
+    //
+    // The region is defined per board by the linker script (.settings,
+    // _ssettings to _esettings) and left alone by `lumos flash`, so the
+    // values survive firmware updates. Host builds keep it in RAM.
+    //
+    // Values are appended to a log, each as a record with its key, length
+    // and CRC-32, padded to the flash word. An index of every key's latest
+    // record is built by Init() and kept in RAM, so Get() is a copy from
+    // flash without a search. Set() only queues the value; Poll() writes
+    // one flash word per call and never waits for an erase, which runs
+    // from the flash interrupt. Get() sees a value as soon as it is set.
+    //
+    // Sectors are used in turn. When the last erased one becomes the head
+    // of the log, Poll() copies the values still current in the oldest
+    // sector there, one record per call, and erases it, so each sector is
+    // erased once per round of the region and there is always one to move
+    // to. A reset at any point keeps every value written before it: a
+    // record is only current once its CRC matches, and a sector is only
+    // erased after its values have been copied. Capacity() leaves room for
+    // that copy, so not the whole region holds values; near it, each Set()
+    // can cost an erase, so leave headroom for values that change often.
+    //
+    // Set() and Get() may be called from interrupts; Poll() from one
+    // context only (the loop or a low-priority app).
+    class SettingsStore
+    {
+    public:
+        static constexpr size_t kMaxKeys = LUMOS_SETTINGS_MAX_KEYS;
+        static constexpr size_t kMaxValueSize = LUMOS_SETTINGS_MAX_VALUE;
+        static constexpr size_t kPendingSlots = LUMOS_SETTINGS_PENDING;
+        static constexpr size_t kMaxSectors = LUMOS_SETTINGS_MAX_SECTORS;
+
+        // Poll() starts an erase only when this returns true
+        using EraseGate = bool (*)(void* context);
+
+        SettingsStore();
+
+        SettingsStore(const SettingsStore&) = delete;
+        SettingsStore& operator=(const SettingsStore&) = delete;
+
+        // Scan the region and build the index; false without a region of
+        // at least two sectors
+        bool Init();
+
+        // Length of @p key's value, or -1 if it has none
+        int GetLength(uint16_t key) const;
+
+        // Copy @p key's value to @p data if it fits in @p capacity bytes;
+        // returns its length, or -1 if it has none
+        int Get(uint16_t key, void* data, size_t capacity) const;
+
+        // @p value if @p key holds exactly sizeof(T) bytes
+        template <typename T>
+        bool Get(uint16_t key, T& value) const
+        {
+            return GetLength(key) == static_cast<int>(sizeof(T)) &&
+                   Get(key, &value, sizeof(T)) == static_cast<int>(sizeof(T));
+        }
+
+        // Queue @p length bytes as @p key's value; an unchanged value is not
+        // written again. False for a bad key or length, when no pending
+        // slot is free, when the store is full or after a flash error
+        bool Set(uint16_t key, const void* data, size_t length);
+
+        template <typename T>
+        bool Set(uint16_t key, const T& value)
+        {
+            return Set(key, &value, sizeof(T));
+        }
+
+        // Forget @p key's value (queued like Set())
+        bool Remove(uint16_t key);
+
+        // One step of background work: a flash word, a record of
+        // compaction, or starting an erase. True while work remains
+        bool Poll();
+
+        // Write everything queued, waiting for erases (and ignoring the
+        // gate): before a reset, for example. False after a flash error
+        bool Flush();
+
+        // Nothing is queued or being moved
+        bool IsIdle() const;
+
+        void SetEraseGate(EraseGate gate, void* context = nullptr)
+        {
+            gate_ = gate;
+            gate_context_ = context;
+        }
+
+        // Most bytes of records (value, 8-byte header, padding to the
+        // flash word) the store holds; 0 before Init()
+        size_t Capacity() const { return capacity_; }
+
+        SettingsStats GetStats() const;
+
+    private:
+        static constexpr uint32_t kNone = 0xFFFFFFFF;
+        static constexpr size_t kRecordHeader = 8;
+        static constexpr size_t kMaxRecordSize = (kRecordHeader + kMaxValueSize + 31) / 32 * 32;
+
+        enum class SectorState : uint8_t {
+            ERASED,   // Ready to become the head
+            DIRTY,    // To be erased
+            LIVE      // Holds records; sequence_ orders them
+        };
+
+        enum class SlotState : uint8_t {
+            FREE,
+            PENDING,
+            WRITING   // Being programmed from stage_
+        };
+
+        struct Entry {
+            uint32_t location;   // Region offset of the latest written record, or kNone
+            uint16_t size;       // Record bytes of the latest value (0 without one)
+            int8_t slot;         // Pending slot with a newer value, or -1
+        };
+
+        struct Slot {
+            uint32_t ticket;     // Queue order
+            uint16_t key;
+            uint16_t length;
+            bool removed;
+            SlotState state;
+            uint8_t data[kMaxValueSize];
+        };
+
+        bool Step(bool use_gate);
+        void ScanSector(uint32_t sector);
+        bool Advance();
+        void StartCompaction();
+        bool CompactStep();
+        void Stage(const Slot& slot, int8_t index);
+        void Commit();
+        void Fail();
+        int FreeSlot() const;
+        int OldestPending() const;
+        bool SameValue(const Entry& entry, const void* data, size_t length) const;
+        const uint8_t* Record(uint32_t location) const;
+
+        Entry entries_[kMaxKeys];
+        Slot slots_[kPendingSlots];
+        uint32_t next_ticket_;
+
+        // The record being programmed, a flash word per Poll()
+        alignas(4) uint8_t stage_[kMaxRecordSize];
+        uint32_t stage_size_;
+        uint32_t stage_written_;
+        uint32_t stage_location_;
+        uint16_t stage_key_;
+        int8_t stage_slot_;          // -1 for a compaction copy
+
+        SectorState state_[kMaxSectors];
+        uint32_t sequence_[kMaxSectors];
+        uint32_t sector_count_;
+        uint32_t sector_size_;
+        uint32_t head_;              // Sector appended to, or kNone
+        uint32_t write_;             // Next free offset in the head
+        uint32_t last_sequence_;
+
+        bool compacting_;
+        uint32_t compact_sector_;
+        uint32_t compact_offset_;
+        uint32_t compact_next_;      // Offset after the record being copied
+        uint32_t erasing_;           // Sector being erased, or kNone
+
+        size_t live_bytes_;
+        size_t capacity_;
+        uint32_t erases_;
+        uint32_t failures_;
+        bool ready_;
+        bool failed_;
+
+        EraseGate gate_;
+        void* gate_context_;
+    };
+
+} // namespace Lumos
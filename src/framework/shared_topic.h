@@ -0,0 +1,306 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace Lumos
+{
+
+    // Latest-value topic between contexts that share no lock: interrupts
+    // that must never be masked, a DMA stream, or another core
+    // Usage Example:
+    //   // Radio packets from the SX1281 interrupt, read in place by an app
+    //   LUMOS_DMA_BUFFER SharedTopic<RadioPacket> packets;   // D2 SRAM on the H7
+    //
+    //   void onRadioDone() {                      // The one writer
+    //       auto loan = packets.Loan();
+    //       if (loan) {
+    //           radio.readPayload(loan->data, &loan->length);
+    //           packets.Publish(std::move(loan));
+    //       }
+    //   }
+    //
+    //   SharedSubscriber<RadioPacket> rx{packets};
+    //   void Step() override {
+    //       if (auto packet = rx.TakeNew()) {
+    //           Decode(*packet);                  // No copy
+    //           if (!packet.Valid()) { Discard(); }   // Overwritten meanwhile
+    //       }
+    //   }
+    //
+    //   // Wake the reader instead of polling (wrapper/doorbell.h)
+    //   packets.SetNotify([](void*) { Doorbell::ring(0); });
+    //   Doorbell::attach(0, [](void*) { scheduler.Trigger(decoder); }, nullptr);
+    //
+    // Topic (message_bus.h) keeps its slot counts under a CriticalSection,
+    // which masks interrupts on the local core only and holds off the
+    // radio or motor interrupt while an app takes a sample. Here nothing
+    // is locked: each slot carries the sequence of the message in it, odd
+    // while the writer fills it. The writer moves round Slots slots, so a
+    // message stays in place for Slots - 1 further publishes; a reader
+    // uses it where it is and checks Valid() when done (or copies it with
+    // Read(), which retries). Readers never delay the writer and the
+    // writer never waits.
+    //
+    // Only 32-bit loads and stores are used, with the same fences as
+    // SeqLockTopic (a DMB on the Cortex-M7), so it works on the M0+ and
+    // between bus masters. One context writes; a loaned slot may be handed
+    // to a DMA stream and published from its completion interrupt. Other
+    // bus masters see the topic only if the cache does not hold it: put it
+    // in LUMOS_DMA_BUFFER memory (non-cacheable D2 SRAM on the H7, which a
+    // second core also reaches). Contexts on one core need nothing special.
+    // T must be trivially copyable.
+    template <typename T, size_t Slots = 3>
+    class SharedTopic
+    {
+        static_assert(Slots >= 2, "A shared topic needs at least two slots");
+        static_assert(std::is_trivially_copyable<T>::value, "SharedTopic needs a trivially copyable type");
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "SharedTopic needs lock-free 32-bit atomics");
+
+    public:
+        static constexpr int kReadAttempts = 4;
+
+        // Called by Publish(), in the writer's context
+        using Notify = void (*)(void* context);
+
+        // Slot being written by the writer; publish it or let it go
+        class LoanedMessage
+        {
+        public:
+            LoanedMessage() : topic_(nullptr), slot_(0) {}
+            LoanedMessage(LoanedMessage&& other) : topic_(other.topic_), slot_(other.slot_) { other.topic_ = nullptr; }
+            LoanedMessage& operator=(LoanedMessage&& other)
+            {
+                if (this != &other)
+                {
+                    Reset();
+                    topic_ = other.topic_;
+                    slot_ = other.slot_;
+                    other.topic_ = nullptr;
+                }
+                return *this;
+            }
+            ~LoanedMessage() { Reset(); }
+
+            LoanedMessage(const LoanedMessage&) = delete;
+            LoanedMessage& operator=(const LoanedMessage&) = delete;
+
+            explicit operator bool() const { return topic_ != nullptr; }
+            T& operator*() const { return topic_->Data(slot_); }
+            T* operator->() const { return &topic_->Data(slot_); }
+
+            // Give the slot up unpublished; the message it held is lost
+            void Reset()
+            {
+                if (topic_ != nullptr)
+                {
+                    topic_->loaned_ = false;
+                    topic_ = nullptr;
+                }
+            }
+
+        private:
+            friend class SharedTopic;
+            LoanedMessage(SharedTopic* topic, size_t slot) : topic_(topic), slot_(slot) {}
+
+            SharedTopic* topic_;
+            size_t slot_;
+        };
+
+        // Published message, read in place
+        class Sample
+        {
+        public:
+            Sample() : topic_(nullptr), slot_(0), sequence_(0) {}
+
+            explicit operator bool() const { return topic_ != nullptr; }
+            const T& operator*() const { return topic_->Data(slot_); }
+            const T* operator->() const { return &topic_->Data(slot_); }
+
+            // Publish count of the topic when this message was published
+            uint32_t GetSequence() const { return sequence_; }
+
+            // The writer has not started overwriting the message; check
+            // after reading it
+            bool Valid() const
+            {
+                if (topic_ == nullptr)
+                {
+                    return false;
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return topic_->slot_sequences_[slot_].load(std::memory_order_relaxed) == 2 * sequence_;
+            }
+
+        private:
+            friend class SharedTopic;
+            Sample(const SharedTopic* topic, size_t slot, uint32_t sequence)
+                : topic_(topic), slot_(slot), sequence_(sequence) {}
+
+            const SharedTopic* topic_;
+            size_t slot_;
+            uint32_t sequence_;
+        };
+
+        SharedTopic() : latest_(0), loaned_(false), drops_(0), notify_(nullptr), notify_context_(nullptr)
+        {
+            for (size_t i = 0; i < Slots; i++)
+            {
+                slot_sequences_[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        SharedTopic(const SharedTopic&) = delete;
+        SharedTopic& operator=(const SharedTopic&) = delete;
+
+        // Writer: the slot for the next message, written in place (empty
+        // while another loan is open)
+        LoanedMessage Loan()
+        {
+            if (loaned_)
+            {
+                drops_++;
+                return LoanedMessage();
+            }
+            const uint32_t next = latest_.load(std::memory_order_relaxed) + 1;
+            const size_t slot = next % Slots;
+            slot_sequences_[slot].store(2 * next - 1, std::memory_order_relaxed);   // Odd: being written
+            std::atomic_thread_fence(std::memory_order_release);
+            loaned_ = true;
+            return LoanedMessage(this, slot);
+        }
+
+        // Writer: make the loaned message the latest one and notify
+        bool Publish(LoanedMessage&& loan)
+        {
+            if (loan.topic_ != this)
+            {
+                return false;
+            }
+            const uint32_t next = latest_.load(std::memory_order_relaxed) + 1;
+            slot_sequences_[loan.slot_].store(2 * next, std::memory_order_release);
+            latest_.store(next, std::memory_order_release);
+            loan.Reset();
+            if (notify_ != nullptr)
+            {
+                notify_(notify_context_);
+            }
+            return true;
+        }
+
+        // Writer: copy a message in
+        bool Publish(const T& message)
+        {
+            auto loan = Loan();
+            if (!loan)
+            {
+                return false;
+            }
+            std::memcpy(&*loan, &message, sizeof(T));
+            return Publish(std::move(loan));
+        }
+
+        // Latest message in place (empty before the first Publish(), or if
+        // the writer kept overwriting it)
+        Sample Latest() const
+        {
+            for (int attempt = 0; attempt < kReadAttempts; attempt++)
+            {
+                const uint32_t sequence = latest_.load(std::memory_order_acquire);
+                if (sequence == 0)
+                {
+                    return Sample();
+                }
+                const size_t slot = sequence % Slots;
+                if (slot_sequences_[slot].load(std::memory_order_acquire) == 2 * sequence)
+                {
+                    return Sample(this, slot, sequence);
+                }
+            }
+            return Sample();
+        }
+
+        // Copy of the latest message; false before the first Publish() or
+        // if every attempt overlapped a write
+        bool Read(T& message) const
+        {
+            for (int attempt = 0; attempt < kReadAttempts; attempt++)
+            {
+                const Sample sample = Latest();
+                if (!sample)
+                {
+                    return false;
+                }
+                std::memcpy(&message, &*sample, sizeof(T));
+                if (sample.Valid())
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Number of Publish() calls so far
+        uint32_t GetSequence() const { return latest_.load(std::memory_order_acquire); }
+
+        // Loan() calls made while a loan was open (writer side)
+        uint32_t GetDropCount() const { return drops_; }
+
+        // Set by the writer's side before the first Publish()
+        void SetNotify(Notify notify, void* context = nullptr)
+        {
+            notify_ = notify;
+            notify_context_ = context;
+        }
+
+    private:
+        T& Data(size_t slot) { return *reinterpret_cast<T*>(&storage_[slot]); }
+        const T& Data(size_t slot) const { return *reinterpret_cast<const T*>(&storage_[slot]); }
+
+        std::atomic<uint32_t> latest_;                  // Sequence of the latest message, 0 before any
+        std::atomic<uint32_t> slot_sequences_[Slots];   // 2 x sequence, odd while being written
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_[Slots];
+
+        // Writer only
+        bool loaned_;
+        uint32_t drops_;
+        Notify notify_;
+        void* notify_context_;
+    };
+
+    // Per-subscriber view of a shared topic that tracks what it has seen
+    template <typename T, size_t Slots = 3>
+    class SharedSubscriber
+    {
+    public:
+        explicit SharedSubscriber(const SharedTopic<T, Slots>& topic) : topic_(topic), last_sequence_(0), missed_(0) {}
+
+        // Messages published since the last TakeNew()
+        bool HasNew() const { return topic_.GetSequence() != last_sequence_; }
+
+        // Latest message if it is newer than the last one taken, else empty
+        typename SharedTopic<T, Slots>::Sample TakeNew()
+        {
+            auto sample = topic_.Latest();
+            if (!sample || sample.GetSequence() == last_sequence_)
+            {
+                return typename SharedTopic<T, Slots>::Sample();
+            }
+            missed_ += sample.GetSequence() - last_sequence_ - 1;
+            last_sequence_ = sample.GetSequence();
+            return sample;
+        }
+
+        // Messages that were overwritten before this subscriber took them
+        uint32_t GetMissedCount() const { return missed_; }
+
+    private:
+        const SharedTopic<T, Slots>& topic_;
+        uint32_t last_sequence_;
+        uint32_t missed_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,355 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_STATIC_SCHEDULER_TIME_BASE
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace Lumos
+{
+
+    // Base for apps dispatched at compile time by StaticScheduler
+    // Usage Example:
+    //   class BlinkApp : public StaticApplication<BlinkApp>
+    //   {
+    //   public:
+    //       static constexpr const char* kName = "Blink";
+    //       static constexpr uint32_t kRateHz = 1000;     // Default 10, 0 = event-driven
+    //       static constexpr uint8_t kPriority = 200;     // Default 128
+    //
+    //       void Init() { ... }                           // Optional, like DeInit()
+    //       void Step() { ... }
+    //   };
+    //
+    //   BlinkApp blink;
+    //   ControlApp control;
+    //   StaticScheduler<BlinkApp, ControlApp> scheduler(blink, control);
+    //   scheduler.Run();
+    //
+    // The same lifecycle as ApplicationBase without a vtable or per-app
+    // metadata in RAM: name, rate and priority are constexpr members
+    // (shadowing the defaults below), the scheduler calls Init(), Step()
+    // and DeInit() on the concrete type, so they inline into its dispatch
+    // code, and an app costs no more RAM than its own members. Apps that
+    // need stats, error state or logging, or are added at run time, stay
+    // on ApplicationBase and Scheduler.
+    template <typename Derived>
+    class StaticApplication
+    {
+    public:
+        static constexpr const char* kName = "UnnamedApp";
+        static constexpr uint32_t kRateHz = 10;
+        static constexpr uint8_t kPriority = 128;
+
+        void Init() {}
+        void DeInit() {}
+
+    protected:
+        StaticApplication() = default;
+        ~StaticApplication() = default;
+
+        Derived& Self() { return static_cast<Derived&>(*this); }
+    };
+
+    namespace detail
+    {
+        template <size_t N>
+        struct StaticOrder {
+            size_t index[N];
+        };
+
+        // Periodic before event-driven, shorter period first, then priority
+        constexpr bool RunsBefore(uint32_t period_a, uint8_t priority_a, uint32_t period_b, uint8_t priority_b)
+        {
+            if ((period_a == 0) != (period_b == 0))
+            {
+                return period_a != 0;
+            }
+            if (period_a != period_b)
+            {
+                return period_a < period_b;
+            }
+            return priority_a > priority_b;
+        }
+
+        // List indexes in schedule order (stable insertion sort)
+        template <size_t N>
+        constexpr StaticOrder<N> MakeStaticOrder(const uint32_t (&periods)[N], const uint8_t (&priorities)[N])
+        {
+            StaticOrder<N> order = {};
+            for (size_t i = 0; i < N; i++)
+            {
+                size_t j = i;
+                while (j > 0 && RunsBefore(periods[i], priorities[i], periods[order.index[j - 1]],
+                                           priorities[order.index[j - 1]]))
+                {
+                    order.index[j] = order.index[j - 1];
+                    j--;
+                }
+                order.index[j] = i;
+            }
+            return order;
+        }
+    }
+
+    // Rate-monotonic scheduler over a fixed list of StaticApplications
+    //
+    // Same policy as Scheduler: periodic apps are released once per period,
+    // the shortest period runs first with kPriority breaking ties, steps
+    // are not preempted, a step that ends past its next release counts an
+    // overrun and skips the releases it ran over, and event-driven apps
+    // (kRateHz 0) run once per Trigger() after all ready periodic apps.
+    //
+    // The run order and the periods are worked out at compile time; the
+    // period table is constexpr and lands in flash, and RunOnce() is an
+    // unrolled chain of due-checks in that order with each Step() called
+    // directly. Release times are kept as the low 32 bits of the
+    // microsecond clock (rates down to 1 Hz, wrap-safe over 71 minutes),
+    // so a check is a subtract and a compare even on the Cortex-M0+.
+    template <typename... Apps>
+    class StaticScheduler
+    {
+        static_assert(sizeof...(Apps) > 0, "StaticScheduler needs at least one app");
+
+    public:
+        static constexpr size_t kCount = sizeof...(Apps);
+
+        explicit StaticScheduler(Apps&... apps)
+            : apps_(apps...)
+            , next_release_us_()
+            , triggered_()
+            , stats_()
+            , started_(false)
+            , stop_requested_(false)
+        {
+        }
+
+        StaticScheduler(const StaticScheduler&) = delete;
+        StaticScheduler& operator=(const StaticScheduler&) = delete;
+
+        // Initialize all apps in list order and release them now
+        void Start()
+        {
+            if (started_)
+            {
+                return;
+            }
+            InitAll(std::index_sequence_for<Apps...>{});
+            const uint32_t now = NowUs();
+            for (size_t i = 0; i < kCount; i++)
+            {
+                next_release_us_[i] = now;
+            }
+            started_ = true;
+        }
+
+        // Run the first ready app in schedule order once; false if none was ready
+        bool RunOnce()
+        {
+            return RunFirstReady(NowUs(), std::make_index_sequence<kCount>{});
+        }
+
+        // Start() if needed, then run apps and idle between releases until
+        // Stop(); DeInit()s every app in reverse list order on the way out
+        void Run()
+        {
+            Start();
+            while (!stop_requested_)
+            {
+                if (!RunOnce())
+                {
+                    IdleUntilNextRelease();
+                }
+            }
+            DeInitAll(std::index_sequence_for<Apps...>{});
+            started_ = false;
+            stop_requested_ = false;
+        }
+
+        // Make Run() return after the current step
+        void Stop() { stop_requested_ = true; }
+
+        // Release event-driven @p App (kRateHz 0); callable from interrupts
+        template <typename App>
+        void Trigger()
+        {
+            static_assert(IndexOf<App>() < kCount, "App is not in this scheduler's list");
+            static_assert(kPeriodsUs[IndexOf<App>()] == 0, "Only event-driven apps (kRateHz 0) are triggered");
+            triggered_[IndexOf<App>()] = true;
+        }
+
+        // Microseconds until the next periodic release (0 if an app is
+        // ready, UINT32_MAX if there are only event-driven apps)
+        uint32_t GetTimeUntilNextReleaseUs() const
+        {
+            const uint32_t now = NowUs();
+            uint32_t wait = UINT32_MAX;
+            for (size_t i = 0; i < kCount; i++)
+            {
+                if (kPeriodsUs[i] == 0)
+                {
+                    if (triggered_[i])
+                    {
+                        return 0;
+                    }
+                    continue;
+                }
+                const int32_t left = static_cast<int32_t>(next_release_us_[i] - now);
+                if (left <= 0)
+                {
+                    return 0;
+                }
+                if (static_cast<uint32_t>(left) < wait)
+                {
+                    wait = static_cast<uint32_t>(left);
+                }
+            }
+            return wait;
+        }
+
+        template <typename App>
+        const TaskStats& GetTaskStats() const
+        {
+            static_assert(IndexOf<App>() < kCount, "App is not in this scheduler's list");
+            return stats_[IndexOf<App>()];
+        }
+
+        // Period of each app in list order, 0 for event-driven ones
+        static constexpr uint32_t kPeriodsUs[kCount] = {(Apps::kRateHz > 0 ? 1000000u / Apps::kRateHz : 0u)...};
+
+    private:
+        static constexpr uint8_t kPriorities[kCount] = {Apps::kPriority...};
+
+        static constexpr detail::StaticOrder<kCount> kOrder = detail::MakeStaticOrder(kPeriodsUs, kPriorities);
+
+        template <typename App>
+        static constexpr size_t IndexOf()
+        {
+            constexpr bool matches[kCount] = {std::is_same<App, Apps>::value...};
+            size_t found = kCount;
+            for (size_t i = 0; i < kCount; i++)
+            {
+                if (matches[i])
+                {
+                    found = i;
+                }
+            }
+            return found;
+        }
+
+        template <size_t... I>
+        void InitAll(std::index_sequence<I...>)
+        {
+            (std::get<I>(apps_).Init(), ...);
+        }
+
+        template <size_t... I>
+        void DeInitAll(std::index_sequence<I...>)
+        {
+            // Reverse list order: later apps may use earlier ones
+            (std::get<kCount - 1 - I>(apps_).DeInit(), ...);
+        }
+
+        template <size_t... Slot>
+        bool RunFirstReady(uint32_t now, std::index_sequence<Slot...>)
+        {
+            return (RunIfReady<kOrder.index[Slot]>(now) || ...);
+        }
+
+        template <size_t I>
+        bool RunIfReady(uint32_t now)
+        {
+            TaskStats& stats = stats_[I];
+            if constexpr (kPeriodsUs[I] == 0)
+            {
+                if (!triggered_[I])
+                {
+                    return false;
+                }
+                triggered_[I] = false;
+                stats.releases++;
+                std::get<I>(apps_).Step();
+                return true;
+            }
+            else
+            {
+                const uint32_t release = next_release_us_[I];
+                if (static_cast<int32_t>(now - release) < 0)
+                {
+                    return false;
+                }
+                if (now - release > stats.max_latency_us)
+                {
+                    stats.max_latency_us = now - release;
+                }
+                stats.releases++;
+
+                std::get<I>(apps_).Step();
+
+                uint32_t next = release + kPeriodsUs[I];
+                const uint32_t end = NowUs();
+                if (static_cast<int32_t>(end - next) >= 0)
+                {
+                    const uint32_t missed = (end - next) / kPeriodsUs[I] + 1;
+                    stats.overruns++;
+                    stats.skipped += missed;
+                    next += missed * kPeriodsUs[I];
+                }
+                next_release_us_[I] = next;
+                return true;
+            }
+        }
+
+        void IdleUntilNextRelease()
+        {
+            const uint32_t wait_us = GetTimeUntilNextReleaseUs();
+            if (wait_us == 0)
+            {
+                return;
+            }
+#ifdef LUMOS_STATIC_SCHEDULER_TIME_BASE
+            // As Scheduler: sleep whole milliseconds, spin the rest
+            if (wait_us >= 1000)
+            {
+                Idle(wait_us / 1000);
+            }
+#ifdef LUMOS_HOST
+            else
+            {
+                DelayUs(wait_us);
+            }
+#endif
+#else
+            std::this_thread::sleep_for(std::chrono::microseconds(wait_us == UINT32_MAX ? 1000 : wait_us));
+#endif
+        }
+
+        static uint32_t NowUs()
+        {
+#ifdef LUMOS_STATIC_SCHEDULER_TIME_BASE
+            return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
+            const auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+        }
+
+        std::tuple<Apps&...> apps_;
+        uint32_t next_release_us_[kCount];
+        volatile bool triggered_[kCount];
+        TaskStats stats_[kCount];
+        bool started_;
+        volatile bool stop_requested_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,296 @@
+#include "stats_endpoint.h"
+#include "power_tracker.h"
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+#else
+#include <chrono>
+#endif
+
+namespace Lumos
+{
+
+    namespace
+    {
+        void PutU16(uint8_t* out, uint32_t value)
+        {
+            out[0] = static_cast<uint8_t>(value);
+            out[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        void PutU32(uint8_t* out, uint32_t value)
+        {
+            out[0] = static_cast<uint8_t>(value);
+            out[1] = static_cast<uint8_t>(value >> 8);
+            out[2] = static_cast<uint8_t>(value >> 16);
+            out[3] = static_cast<uint8_t>(value >> 24);
+        }
+
+        // CRC-8 (polynomial 0x07), as in TokenLog
+        uint8_t Crc8(const uint8_t* data, size_t length)
+        {
+            uint8_t crc = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                crc ^= data[i];
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+                }
+            }
+            return crc;
+        }
+
+        uint32_t Saturate16(uint32_t value) { return value > 0xFFFF ? 0xFFFF : value; }
+
+        // Length byte and at most StatsEndpoint::kMaxNameLength characters
+        size_t PutName(uint8_t* out, const char* name)
+        {
+            size_t length = 0;
+            while (name != nullptr && name[length] != '\0' && length < StatsEndpoint::kMaxNameLength)
+            {
+                out[1 + length] = static_cast<uint8_t>(name[length]);
+                length++;
+            }
+            out[0] = static_cast<uint8_t>(length);
+            return 1 + length;
+        }
+
+        // 1 MHz unless the cycle counter runs (see GetLoadTicks())
+        uint32_t GetLoadTickKhz()
+        {
+#if defined(LUMOS_DEVICE_SYNC) && defined(__CORTEX_M) && (__CORTEX_M >= 3)
+            if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0)
+            {
+                return SystemCoreClock / 1000;
+            }
+#endif
+            return 1000;
+        }
+    }
+
+    uint32_t GetLoadTicksUs()
+    {
+#ifdef LUMOS_DEVICE_TIME_BASE
+        return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
+        auto now = std::chrono::steady_clock::now();
+        auto duration = now.time_since_epoch();
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+    }
+
+    StatsEndpoint::StatsEndpoint(const Scheduler& scheduler)
+        : scheduler_(scheduler)
+        , isrs_()
+        , isr_count_(0)
+        , queues_()
+        , queue_count_(0)
+        , power_(nullptr)
+        , request_()
+        , request_length_(0)
+        , in_request_(false)
+        , pending_kind_(0)
+        , pending_sequence_(0)
+        , requests_(0)
+        , frame_()
+        , frame_length_(0)
+    {
+    }
+
+    bool StatsEndpoint::AddIsr(const IsrLoad& load)
+    {
+        if (isr_count_ >= kMaxIsrs)
+        {
+            return false;
+        }
+        isrs_[isr_count_++] = &load;
+        return true;
+    }
+
+    bool StatsEndpoint::AddQueue(const char* name, const void* queue, uint32_t (*depth)(const void*), uint32_t capacity)
+    {
+        if (queue_count_ >= kMaxQueues)
+        {
+            return false;
+        }
+        QueueEntry& entry = queues_[queue_count_++];
+        entry.name = name;
+        entry.queue = queue;
+        entry.depth = depth;
+        entry.capacity = capacity;
+        return true;
+    }
+
+    void StatsEndpoint::Feed(uint8_t byte)
+    {
+        if (!in_request_)
+        {
+            if (byte == 0x00)
+            {
+                in_request_ = true;
+                request_length_ = 0;
+            }
+            return;
+        }
+
+        request_[request_length_++] = byte;
+        if (request_[0] != kFrameMarker)
+        {
+            // Text after a 0x00, or another frame; a 0x00 here starts over
+            in_request_ = byte == 0x00;
+            request_length_ = 0;
+            return;
+        }
+        if (request_length_ < sizeof(request_))
+        {
+            return;
+        }
+
+        in_request_ = false;
+        if (Crc8(request_, 3) != request_[3])
+        {
+            return;
+        }
+        // Never more than one answer waiting: a newer request replaces it
+        pending_kind_ = request_[1];
+        pending_sequence_ = request_[2];
+        requests_++;
+    }
+
+    bool StatsEndpoint::BuildFrame()
+    {
+        if (pending_kind_ == 0)
+        {
+            return false;
+        }
+
+        size_t payload = 0;
+        if (pending_kind_ == kStatsRequest)
+        {
+            payload = BuildStats(frame_ + kFrameHeader);
+        }
+        else if (pending_kind_ == kNamesRequest)
+        {
+            payload = BuildNames(frame_ + kFrameHeader);
+        }
+        else
+        {
+            pending_kind_ = 0;
+            return false;
+        }
+
+        frame_[0] = 0x00;
+        frame_[1] = kFrameMarker;
+        frame_[2] = pending_kind_;
+        frame_[3] = pending_sequence_;
+        PutU16(frame_ + 4, static_cast<uint32_t>(payload));
+        frame_length_ = kFrameHeader + payload;
+        frame_[frame_length_] = Crc8(frame_ + 1, frame_length_ - 1);
+        frame_length_++;
+        pending_kind_ = 0;
+        return true;
+    }
+
+    size_t StatsEndpoint::AppCount() const
+    {
+        const size_t count = scheduler_.GetApplicationCount();
+        return count < kMaxApps ? count : kMaxApps;
+    }
+
+    size_t StatsEndpoint::PeripheralCount() const
+    {
+        const size_t count = power_ != nullptr ? power_->GetPeripheralCount() : 0;
+        return count < kMaxPeripherals ? count : kMaxPeripherals;
+    }
+
+    size_t StatsEndpoint::BuildStats(uint8_t* out) const
+    {
+        const size_t apps = AppCount();
+        const size_t peripherals = PeripheralCount();
+        if (power_ != nullptr)
+        {
+            power_->Update();
+        }
+        PutU32(out, GetLoadTicksUs());
+        PutU32(out + 4, GetLoadTickKhz());
+        out[8] = static_cast<uint8_t>(apps);
+        out[9] = static_cast<uint8_t>(isr_count_);
+        out[10] = static_cast<uint8_t>(queue_count_);
+        out[11] = static_cast<uint8_t>(peripherals);
+
+        uint8_t* record = out + kStatsHeader;
+        for (size_t i = 0; i < apps; i++, record += kAppRecord)
+        {
+            const ApplicationBase& app = scheduler_.GetApplication(i);
+            const ApplicationStats& stats = app.GetStats();
+            record[0] = static_cast<uint8_t>(app.GetState());
+            record[1] = app.IsCritical() ? 1 : 0;
+            PutU16(record + 2, Saturate16(app.GetUpdateRate()));
+            PutU32(record + 4, static_cast<uint32_t>(stats.step_count));
+            PutU32(record + 8, static_cast<uint32_t>(stats.total_step_time_us));
+            PutU32(record + 12, static_cast<uint32_t>(stats.max_step_time_us));
+            PutU32(record + 16, static_cast<uint32_t>(stats.deadline_misses));
+            PutU32(record + 20, static_cast<uint32_t>(stats.error_count));
+        }
+        for (size_t i = 0; i < isr_count_; i++, record += kCounterRecord)
+        {
+            PutU32(record, isrs_[i]->count);
+            PutU32(record + 4, isrs_[i]->busy_ticks);
+        }
+        for (size_t i = 0; i < queue_count_; i++, record += kCounterRecord)
+        {
+            PutU32(record, queues_[i].depth(queues_[i].queue));
+            PutU32(record + 4, queues_[i].capacity);
+        }
+
+#ifdef LUMOS_DEVICE_TIME_BASE
+        const PowerStateTimes power = ::GetPowerStateTimes();
+        PutU32(record, static_cast<uint32_t>(power.sleep_us));
+        PutU32(record + 4, static_cast<uint32_t>(power.stop_us));
+        PutU32(record + 8, power.sleeps + power.stops);
+#else
+        PutU32(record, 0);
+        PutU32(record + 4, 0);
+        PutU32(record + 8, 0);
+#endif
+        record += kPowerRecord;
+        for (size_t i = 0; i < peripherals; i++, record += kCounterRecord)
+        {
+            const PeripheralPower& peripheral = power_->GetPeripheral(i);
+            PutU32(record, peripheral.run_us);
+            PutU32(record + 4, peripheral.sleep_us);
+        }
+        return static_cast<size_t>(record - out);
+    }
+
+    size_t StatsEndpoint::BuildNames(uint8_t* out) const
+    {
+        const size_t apps = AppCount();
+        out[0] = static_cast<uint8_t>(apps);
+        out[1] = static_cast<uint8_t>(isr_count_);
+        out[2] = static_cast<uint8_t>(queue_count_);
+        out[3] = static_cast<uint8_t>(PeripheralCount());
+
+        size_t length = 4;
+        for (size_t i = 0; i < apps; i++)
+        {
+            length += PutName(out + length, scheduler_.GetApplication(i).GetName().c_str());
+        }
+        for (size_t i = 0; i < isr_count_; i++)
+        {
+            length += PutName(out + length, isrs_[i]->name);
+        }
+        for (size_t i = 0; i < queue_count_; i++)
+        {
+            length += PutName(out + length, queues_[i].name);
+        }
+        for (size_t i = 0; i < PeripheralCount(); i++)
+        {
+            length += PutName(out + length, power_->GetPeripheral(i).name);
+        }
+        return length;
+    }
+
+} // namespace Lumos
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "scheduler.h"
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    // Load ticks: CPU cycles where the DWT cycle counter runs, else
+    // microseconds (Cortex-M0+, host)
+    uint32_t GetLoadTicksUs();
+
+    inline uint32_t GetLoadTicks()
+    {
+#if defined(LUMOS_DEVICE_SYNC) && defined(__CORTEX_M) && (__CORTEX_M >= 3)
+        if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0)
+        {
+            return DWT->CYCCNT;
+        }
+#endif
+        return GetLoadTicksUs();
+    }
+
+    // Time spent in one interrupt handler, measured by LUMOS_STATS_ISR
+    struct IsrLoad {
+        const char* name;
+        volatile uint32_t count;        // Handler entries
+        volatile uint32_t busy_ticks;   // Free-running sum of GetLoadTicks()
+
+        explicit IsrLoad(const char* handler_name)
+            : name(handler_name)
+            , count(0)
+            , busy_ticks(0)
+        {
+        }
+    };
+
+    class IsrLoadScope
+    {
+    public:
+        explicit IsrLoadScope(IsrLoad& load)
+            : load_(load)
+            , start_(GetLoadTicks())
+        {
+        }
+
+        ~IsrLoadScope()
+        {
+            // Only this handler writes the counters; it does not preempt itself
+            load_.busy_ticks = load_.busy_ticks + (GetLoadTicks() - start_);
+            load_.count = load_.count + 1;
+        }
+
+        IsrLoadScope(const IsrLoadScope&) = delete;
+        IsrLoadScope& operator=(const IsrLoadScope&) = delete;
+
+    private:
+        IsrLoad& load_;
+        uint32_t start_;
+    };
+
+    // Binary runtime stats for `lumos stats`, answered on request
+    // Usage Example:
+    //   Scheduler scheduler;
+    //   StatsEndpoint stats(scheduler);
+    //   IsrLoad uart_load("USART1");
+    //
+    //   void USART1_IRQHandler() {
+    //       LUMOS_STATS_ISR(uart_load);
+    //       Serial1.handleInterrupt();
+    //   }
+    //
+    //   void setup() {
+    //       stats.AddIsr(uart_load);
+    //       stats.AddQueue("commands", command_queue);   // Size(), GetCapacity()
+    //       stats.SetPowerTracker(power);                // Optional, power_tracker.h
+    //   }
+    //
+    //   void loop() { scheduler.RunOnce(); stats.Poll(Serial1); }
+    //
+    // The host sends a short request frame, Poll() answers it with one
+    // frame holding every app's state, rate, step count, step time total
+    // and maximum, deadline misses and errors, each ISR's entry count and
+    // busy ticks and each queue's depth, the core's time in Sleep and Stop
+    // and, with a PowerTracker, each tracked peripheral's clocked time. The
+    // counters are free-running, so `lumos stats` turns two answers into
+    // per-app CPU load, ISR load, power state shares and rates; the
+    // firmware does no arithmetic beyond copying them. Names are
+    // sent once, in answer to a separate request. Nothing is sent unasked,
+    // so an idle endpoint costs one empty read per Poll().
+    //
+    // Poll() reads everything the stream has received; when the firmware
+    // reads its own commands from the same port, hand each received byte
+    // to Feed() instead and call Poll() to send the answer. Other bytes are
+    // ignored, and a frame the stream did not take is offered again on the
+    // next Poll().
+    //
+    // Request: 0x00, 0xFD, kind (1 stats, 2 names), sequence, CRC-8 of the
+    // three bytes after the 0x00. Answer: 0x00, 0xFD, kind, sequence,
+    // payload length (u16), payload, CRC-8 of everything after the 0x00.
+    // Stats payload: time (u32 us), load tick rate (u32 kHz), app, ISR,
+    // queue and peripheral counts (u8 each); per app state (u8), critical
+    // (u8), rate (u16 Hz), steps, step time total (us), step time max (us),
+    // deadline misses, errors (u32 each, low bits); per ISR entries and busy
+    // ticks (u32 each); per queue depth and capacity (u32 each); time in
+    // Sleep and in Stop (us) and wake-ups (u32 each); per peripheral time
+    // clocked in Run and in Sleep (us, u32 each). Names payload: the four
+    // counts, then each name as a length byte and its characters.
+    class PowerTracker;
+
+    class StatsEndpoint
+    {
+    public:
+        static constexpr uint8_t kFrameMarker = 0xFD;
+        static constexpr uint8_t kStatsRequest = 1;
+        static constexpr uint8_t kNamesRequest = 2;
+
+        static constexpr size_t kMaxApps = 16;
+        static constexpr size_t kMaxIsrs = 8;
+        static constexpr size_t kMaxQueues = 8;
+        static constexpr size_t kMaxPeripherals = 8;   // Of the PowerTracker; more are not sent
+        static constexpr size_t kMaxNameLength = 15;   // Longer names are cut
+
+        explicit StatsEndpoint(const Scheduler& scheduler);
+
+        // Report @p load's handler; false once kMaxIsrs are registered
+        bool AddIsr(const IsrLoad& load);
+
+        // Report the depth of @p queue (anything with Size() and a static
+        // GetCapacity(), e.g. SpscQueue, MpscQueue); false once full
+        template <typename Queue>
+        bool AddQueue(const char* name, const Queue& queue)
+        {
+            uint32_t (*depth)(const void*) = [](const void* q) {
+                return static_cast<uint32_t>(static_cast<const Queue*>(q)->Size());
+            };
+            return AddQueue(name, &queue, depth, static_cast<uint32_t>(Queue::GetCapacity()));
+        }
+
+        // Report @p tracker's peripherals (Update() is called before each answer)
+        void SetPowerTracker(PowerTracker& tracker) { power_ = &tracker; }
+
+        // One received byte of the link
+        void Feed(uint8_t byte);
+
+        // Read requests from @p stream (read(buffer, length)) and send the
+        // answer with write(data, length), which returns false when busy
+        template <typename Stream>
+        void Poll(Stream& stream)
+        {
+            uint8_t buffer[16];
+            for (;;)
+            {
+                const uint16_t count = stream.read(buffer, static_cast<uint16_t>(sizeof(buffer)));
+                if (count == 0)
+                {
+                    break;
+                }
+                for (uint16_t i = 0; i < count; i++)
+                {
+                    Feed(buffer[i]);
+                }
+            }
+
+            if (frame_length_ == 0 && !BuildFrame())
+            {
+                return;
+            }
+            if (stream.write(frame_, static_cast<uint16_t>(frame_length_)))
+            {
+                frame_length_ = 0;
+            }
+        }
+
+        uint32_t GetRequestCount() const { return requests_; }
+
+    private:
+        struct QueueEntry {
+            const char* name;
+            const void* queue;
+            uint32_t (*depth)(const void* queue);
+            uint32_t capacity;
+        };
+
+        static constexpr size_t kStatsHeader = 12;
+        static constexpr size_t kAppRecord = 24;
+        static constexpr size_t kCounterRecord = 8;
+        static constexpr size_t kPowerRecord = 12;
+        static constexpr size_t kFrameHeader = 6;     // 0x00, marker, kind, sequence, length
+        static constexpr size_t kMaxStatsPayload =
+            kStatsHeader + kMaxApps * kAppRecord + (kMaxIsrs + kMaxQueues + kMaxPeripherals) * kCounterRecord +
+            kPowerRecord;
+        static constexpr size_t kMaxNamesPayload =
+            4 + (kMaxApps + kMaxIsrs + kMaxQueues + kMaxPeripherals) * (kMaxNameLength + 1);
+        static constexpr size_t kMaxPayload =
+            kMaxStatsPayload > kMaxNamesPayload ? kMaxStatsPayload : kMaxNamesPayload;
+        static constexpr size_t kMaxFrame = kFrameHeader + kMaxPayload + 1;
+
+        bool AddQueue(const char* name, const void* queue, uint32_t (*depth)(const void*), uint32_t capacity);
+        bool BuildFrame();
+        size_t BuildStats(uint8_t* out) const;
+        size_t BuildNames(uint8_t* out) const;
+        size_t AppCount() const;
+        size_t PeripheralCount() const;
+
+        const Scheduler& scheduler_;
+        const IsrLoad* isrs_[kMaxIsrs];
+        size_t isr_count_;
+        QueueEntry queues_[kMaxQueues];
+        size_t queue_count_;
+        PowerTracker* power_;
+
+        // Request parser: marker, kind, sequence and CRC after the 0x00
+        uint8_t request_[4];
+        size_t request_length_;
+        bool in_request_;
+        uint8_t pending_kind_;        // 0: nothing asked
+        uint8_t pending_sequence_;
+        uint32_t requests_;
+
+        uint8_t frame_[kMaxFrame];
+        size_t frame_length_;
+    };
+
+} // namespace Lumos
+
+// Measure the rest of the enclosing interrupt handler into @p load
+#define LUMOS_STATS_ISR(load) Lumos::IsrLoadScope lumos_isr_load_scope_(load)
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Lumos
+{
+
+    struct StreamCompressorStats {
+        uint32_t frames;            // Blocks passed on
+        uint32_t raw_bytes;         // Input of those blocks
+        uint32_t packed_bytes;      // Output, frame headers included
+        uint32_t stored;            // Frames left uncompressed (no gain)
+        uint32_t dropped;           // Blocks that didn't fit the output block
+    };
+
+    // Compression stage for stream_pipeline.h: each block becomes one
+    // self-contained frame, so a block lost downstream costs only itself
+    // Usage Example:
+    //   static StreamCompressor<> compressor(4);         // 4 interleaved 16-bit channels
+    //   StreamStage compress(raw, packed_pool, packed,
+    //       [](const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    //           return compressor.Compress(in, length, out, capacity);
+    //       });
+    //   StreamSink sink(packed, FileStreamWriter(log));
+    //
+    //   lumos unpack LOG.BIN                             // On the host: LOG.raw
+    //
+    // Two codings, picked by @p delta_channels:
+    //   - Samples (delta_channels > 0): the block is little-endian 16-bit
+    //     samples of that many interleaved channels. Each sample becomes
+    //     its difference to the channel's previous one, zigzag coded, and
+    //     every group of 16 is bit-packed at the width of its largest
+    //     value, so a signal moving by a few LSBs takes 3-5 bits a sample.
+    //   - Bytes (text logs, records): an LZ4 block encoder, greedy with one
+    //     hash probe per position, which turns repeated messages and fields
+    //     into back references.
+    // A frame is sent stored whenever the coding doesn't make it smaller.
+    //
+    // Frame, integers little-endian:
+    //   "LZ" | flags u8 | delta channels u8 | raw length u16 |
+    //   payload length u16 | frame number u16 | payload
+    // flags: bit 0 LZ4 payload, bit 1 packed deltas, neither: stored
+    // Packed deltas: per group a width u8 and 16 values of that many bits
+    // (LSB first, the last group shorter), then an odd last byte as is.
+    //
+    // Memory is the LZ4 hash table, 2 << HashBits bytes (8 KB with the
+    // default), which fits next to the pools on the G0. Declare the
+    // compressor static; on the H7 that puts it in AXI SRAM with the rest
+    // of .bss, or in DTCM with LUMOS_FAST_BSS (wrapper/memory_sections.h)
+    // for the fastest lookups. Output blocks should be FRAME_OVERHEAD bytes
+    // larger than input blocks, so incompressible data still fits stored.
+    template <unsigned HashBits = 12>
+    class StreamCompressor
+    {
+        static_assert(HashBits >= 8 && HashBits <= 16, "Hash table of 256 to 65536 entries");
+
+    public:
+        static constexpr size_t FRAME_OVERHEAD = 10;
+        static constexpr uint8_t FLAG_LZ4 = 0x01;
+        static constexpr uint8_t FLAG_DELTA = 0x02;
+        static constexpr size_t MAX_BLOCK = 0xFFFF;     // Frames carry 16-bit lengths
+
+        explicit StreamCompressor(uint8_t delta_channels = 0)
+            : delta_channels_(delta_channels)
+            , frame_(0)
+        {
+            std::memset(table_, 0, sizeof(table_));
+            ResetStats();
+        }
+
+        StreamCompressor(const StreamCompressor&) = delete;
+        StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+        // Frame @p length bytes of @p in into @p out; returns the frame's
+        // size, 0 (a drop counted) if the block is too large or even the
+        // stored frame doesn't fit @p capacity
+        size_t Compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+        {
+            if (length > MAX_BLOCK || capacity < FRAME_OVERHEAD)
+            {
+                dropped_ = dropped_ + 1;
+                return 0;
+            }
+
+            uint8_t flags;
+            size_t payload;
+            if (delta_channels_ > 0)
+            {
+                flags = FLAG_DELTA;
+                payload = EncodeDeltas(in, length, out + FRAME_OVERHEAD, capacity - FRAME_OVERHEAD);
+            }
+            else
+            {
+                flags = FLAG_LZ4;
+                payload = EncodeLz4(in, length, out + FRAME_OVERHEAD, capacity - FRAME_OVERHEAD);
+            }
+            if (payload == 0 || payload >= length)
+            {
+                if (length > capacity - FRAME_OVERHEAD)
+                {
+                    dropped_ = dropped_ + 1;
+                    return 0;
+                }
+                std::memcpy(out + FRAME_OVERHEAD, in, length);
+                payload = length;
+                flags = 0;
+                stored_ = stored_ + 1;
+            }
+
+            out[0] = 'L';
+            out[1] = 'Z';
+            out[2] = flags;
+            out[3] = (flags & FLAG_DELTA) ? delta_channels_ : 0;
+            WriteLe16(out + 4, static_cast<uint16_t>(length));
+            WriteLe16(out + 6, static_cast<uint16_t>(payload));
+            WriteLe16(out + 8, frame_++);
+
+            frames_ = frames_ + 1;
+            raw_bytes_ = raw_bytes_ + static_cast<uint32_t>(length);
+            packed_bytes_ = packed_bytes_ + static_cast<uint32_t>(payload + FRAME_OVERHEAD);
+            return payload + FRAME_OVERHEAD;
+        }
+
+        StreamCompressorStats GetStats() const
+        {
+            StreamCompressorStats stats;
+            stats.frames = frames_;
+            stats.raw_bytes = raw_bytes_;
+            stats.packed_bytes = packed_bytes_;
+            stats.stored = stored_;
+            stats.dropped = dropped_;
+            return stats;
+        }
+
+        void ResetStats()
+        {
+            frames_ = 0;
+            raw_bytes_ = 0;
+            packed_bytes_ = 0;
+            stored_ = 0;
+            dropped_ = 0;
+        }
+
+    private:
+        static constexpr size_t kGroup = 16;           // Samples sharing a bit width
+        static constexpr size_t kMinMatch = 4;
+        static constexpr size_t kLastLiterals = 5;     // LZ4: a block ends in literals
+        static constexpr size_t kMatchStartLimit = 12; // LZ4: no match starts closer to the end
+
+        static void WriteLe16(uint8_t* p, uint16_t value)
+        {
+            p[0] = static_cast<uint8_t>(value);
+            p[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        static uint32_t Read32(const uint8_t* p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        static uint32_t Hash(uint32_t sequence)
+        {
+            return (sequence * 2654435761u) >> (32 - HashBits);
+        }
+
+        static uint16_t Read16(const uint8_t* p)
+        {
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        // Zigzag coded channel deltas of the 16-bit samples, bit-packed in
+        // groups; 0 if the output doesn't fit @p capacity
+        size_t EncodeDeltas(const uint8_t* in, size_t length, uint8_t* dst, size_t capacity) const
+        {
+            const size_t samples = length / 2;
+            const size_t channels = delta_channels_;
+            size_t op = 0;
+            for (size_t group = 0; group < samples; group += kGroup)
+            {
+                const size_t count = samples - group < kGroup ? samples - group : kGroup;
+                uint16_t values[kGroup];
+                uint16_t all = 0;
+                for (size_t k = 0; k < count; ++k)
+                {
+                    const size_t i = group + k;
+                    const uint16_t previous = i >= channels ? Read16(in + 2 * (i - channels)) : 0;
+                    const uint16_t delta = static_cast<uint16_t>(Read16(in + 2 * i) - previous);
+                    // Small steps either way become small values
+                    values[k] = static_cast<uint16_t>((delta << 1) ^ ((delta & 0x8000) ? 0xFFFF : 0));
+                    all |= values[k];
+                }
+                uint8_t width = 0;
+                while (width < 16 && (all >> width) != 0)
+                {
+                    width++;
+                }
+
+                if (capacity - op < 1 + (count * width + 7) / 8)
+                {
+                    return 0;
+                }
+                dst[op++] = width;
+                uint32_t bits = 0;
+                unsigned pending = 0;
+                for (size_t k = 0; k < count; ++k)
+                {
+                    bits |= static_cast<uint32_t>(values[k]) << pending;
+                    pending += width;
+                    while (pending >= 8)
+                    {
+                        dst[op++] = static_cast<uint8_t>(bits);
+                        bits >>= 8;
+                        pending -= 8;
+                    }
+                }
+                if (pending > 0)
+                {
+                    dst[op++] = static_cast<uint8_t>(bits);
+                }
+            }
+            if (length & 1)
+            {
+                if (op >= capacity)
+                {
+                    return 0;
+                }
+                dst[op++] = in[length - 1];
+            }
+            return op;
+        }
+
+        // Length continuation bytes of an LZ4 token field
+        static uint8_t* WriteLength(uint8_t* op, size_t length)
+        {
+            while (length >= 255)
+            {
+                *op++ = 255;
+                length -= 255;
+            }
+            *op++ = static_cast<uint8_t>(length);
+            return op;
+        }
+
+        // LZ4 block format; 0 if the output doesn't fit @p capacity
+        size_t EncodeLz4(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity)
+        {
+            uint8_t* op = dst;
+            uint8_t* const end = dst + capacity;
+            size_t anchor = 0;
+
+            if (length > kMatchStartLimit)
+            {
+                const size_t match_limit = length - kLastLiterals;
+                size_t pos = 0;
+                while (pos < length - kMatchStartLimit)
+                {
+                    // Entries left from earlier blocks are only candidates:
+                    // the compare below rejects what doesn't match here
+                    const uint32_t sequence = Read32(src + pos);
+                    const uint32_t hash = Hash(sequence);
+                    size_t candidate = table_[hash];
+                    table_[hash] = static_cast<uint16_t>(pos);
+                    if (candidate >= pos || Read32(src + candidate) != sequence)
+                    {
+                        // Skip faster through data that doesn't compress
+                        pos += 1 + ((pos - anchor) >> 6);
+                        continue;
+                    }
+
+                    while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1])
+                    {
+                        pos--;
+                        candidate--;
+                    }
+                    size_t match = kMinMatch;
+                    while (pos + match < match_limit && src[pos + match] == src[candidate + match])
+                    {
+                        match++;
+                    }
+
+                    const size_t literals = pos - anchor;
+                    if (static_cast<size_t>(end - op) < 1 + literals / 255 + 1 + literals + 2 + (match - kMinMatch) / 255 + 1)
+                    {
+                        return 0;
+                    }
+                    uint8_t* token = op++;
+                    *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+                    if (literals >= 15)
+                    {
+                        op = WriteLength(op, literals - 15);
+                    }
+                    std::memcpy(op, src + anchor, literals);
+                    op += literals;
+                    WriteLe16(op, static_cast<uint16_t>(pos - candidate));
+                    op += 2;
+                    const size_t extra = match - kMinMatch;
+                    *token |= static_cast<uint8_t>(extra < 15 ? extra : 15);
+                    if (extra >= 15)
+                    {
+                        op = WriteLength(op, extra - 15);
+                    }
+
+                    pos += match;
+                    anchor = pos;
+                }
+            }
+
+            const size_t literals = length - anchor;
+            if (static_cast<size_t>(end - op) < 1 + literals / 255 + 1 + literals)
+            {
+                return 0;
+            }
+            uint8_t* token = op++;
+            *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+            if (literals >= 15)
+            {
+                op = WriteLength(op, literals - 15);
+            }
+            std::memcpy(op, src + anchor, literals);
+            op += literals;
+            return static_cast<size_t>(op - dst);
+        }
+
+        uint8_t delta_channels_;
+        uint16_t frame_;
+        uint16_t table_[1u << HashBits];   // Block offsets by hash of 4 bytes
+
+        volatile uint32_t frames_;
+        volatile uint32_t raw_bytes_;
+        volatile uint32_t packed_bytes_;
+        volatile uint32_t stored_;
+        volatile uint32_t dropped_;
+    };
+
+    // Report a compressor's counters as a line:
+    // "@compress name=NAME frames=N raw=B packed=B stored=N drops=N ratio=R.RR"
+    template <typename Out, typename Compressor>
+    void PrintCompressorStats(Out& out, const char* name, const Compressor& compressor)
+    {
+        const StreamCompressorStats stats = compressor.GetStats();
+        const uint32_t ratio = stats.packed_bytes > 0
+            ? static_cast<uint32_t>(static_cast<uint64_t>(stats.raw_bytes) * 100 / stats.packed_bytes)
+            : 0;
+        out.printf("@compress name=%s frames=%u raw=%u packed=%u stored=%u drops=%u ratio=%u.%02u\r\n",
+                   name, static_cast<unsigned>(stats.frames), static_cast<unsigned>(stats.raw_bytes),
+                   static_cast<unsigned>(stats.packed_bytes), static_cast<unsigned>(stats.stored),
+                   static_cast<unsigned>(stats.dropped), static_cast<unsigned>(ratio / 100),
+                   static_cast<unsigned>(ratio % 100));
+    }
+
+} // namespace Lumos
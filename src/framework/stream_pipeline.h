@@ -0,0 +1,548 @@
+#pragma once
+
+#include "dma_pool.h"
+#include "lockfree.h"
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef LUMOS_DEVICE_SYNC
+#include "sys.h"
+#else
+#include <chrono>
+#endif
+
+namespace Lumos
+{
+
+    // Pipeline of pooled blocks: a producer, processing stages and a sink
+    // exchanging DmaPool blocks through lock-free queues
+    // Usage Example:
+    //   DmaPool raw_pool, out_pool;              // Init() both in setup()
+    //   StreamChannel<8> raw, filtered;
+    //   StreamSource<8> source(raw_pool, raw);
+    //   StreamStage filter(raw, out_pool, filtered,
+    //       [](const uint8_t* in, size_t length, uint8_t* out, size_t capacity) -> size_t {
+    //           ...                              // Bytes written to out
+    //       });
+    //   File log;                                 // Opened, setWriteBuffer()
+    //   StreamSink sink(filtered, FileStreamWriter(log));
+    //
+    //   adc.startScan(samples, 2 * 256,         // Producer: the DMA interrupt
+    //       [](const uint16_t* block, uint16_t count) { source.Submit(block, count * 2u); },
+    //       sample_timer);
+    //
+    //   void Step() override {                   // Consumers: an app
+    //       filter.Step();
+    //       sink.Step();
+    //   }
+    //
+    // Each channel has one producer and one consumer, either of which may
+    // be an interrupt. A block belongs to whoever holds it: the source
+    // fills one from its pool and pushes it, a stage pops it, writes its
+    // result to a block from its own pool and frees the input, and the
+    // sink frees it once the writer has taken every byte.
+    //
+    // Backpressure runs upstream: a writer that is busy (USB host slow,
+    // card in a long erase) leaves the block at the head of its channel,
+    // a stage whose output channel is full or whose pool is empty leaves
+    // its input where it is, so the queues fill from the back. Only the
+    // source drops, since the DMA can't wait: Submit() returns false and
+    // counts a drop when no block or queue slot is free. Size the pools
+    // and queues for the longest stall of the slowest sink; a sustained
+    // chain shows no drops, and the stalls and queue peaks say how close
+    // it came. Pool blocks are freed by whichever context ends with them,
+    // which DmaPool allows from apps and interrupts alike.
+    struct StreamBlock {
+        uint8_t* data;
+        uint32_t length;     // Bytes used
+        uint32_t sequence;   // Numbered by the source; gaps are drops
+        DmaPool* pool;       // Where the block goes back to
+    };
+
+    struct StreamStats {
+        uint32_t blocks;            // Passed on downstream (or written, for a sink)
+        uint32_t bytes;
+        uint32_t drops;             // Blocks lost: no buffer or queue slot (source), writer error (sink)
+        uint32_t stalls;            // Step() calls held back by a full queue, empty pool or busy writer
+        uint32_t queue_peak;        // Most blocks waiting in the output (sink: input) channel
+        uint32_t elapsed_ms;        // Since construction or ResetStats()
+        uint32_t bytes_per_second;
+    };
+
+    namespace detail
+    {
+        inline uint32_t StreamMillis()
+        {
+#ifdef LUMOS_DEVICE_SYNC
+            return HAL_GetTick();
+#else
+            const auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+#endif
+        }
+
+        // Counters shared by all pipeline roles; written by the role's
+        // own context, read from anywhere
+        class StreamCounters
+        {
+        public:
+            StreamCounters() { Reset(); }
+
+            StreamStats Get(uint32_t queue_peak) const
+            {
+                StreamStats stats;
+                stats.blocks = blocks_;
+                stats.bytes = bytes_;
+                stats.drops = drops_;
+                stats.stalls = stalls_;
+                stats.queue_peak = queue_peak;
+                stats.elapsed_ms = StreamMillis() - start_ms_;
+                stats.bytes_per_second = stats.elapsed_ms > 0
+                    ? static_cast<uint32_t>(static_cast<uint64_t>(stats.bytes) * 1000 / stats.elapsed_ms)
+                    : 0;
+                return stats;
+            }
+
+            void Reset()
+            {
+                blocks_ = 0;
+                bytes_ = 0;
+                drops_ = 0;
+                stalls_ = 0;
+                start_ms_ = StreamMillis();
+            }
+
+            void Passed(size_t bytes)
+            {
+                blocks_ = blocks_ + 1;
+                bytes_ = bytes_ + static_cast<uint32_t>(bytes);
+            }
+            void Dropped() { drops_ = drops_ + 1; }
+            void Stalled() { stalls_ = stalls_ + 1; }
+
+        private:
+            volatile uint32_t blocks_;
+            volatile uint32_t bytes_;
+            volatile uint32_t drops_;
+            volatile uint32_t stalls_;
+            uint32_t start_ms_;
+        };
+
+        inline void FreeStreamBlock(const StreamBlock& block)
+        {
+            if (block.pool != nullptr)
+            {
+                block.pool->Free(block.data);
+            }
+        }
+    }
+
+    // Queue of blocks between two pipeline roles
+    template <size_t Depth>
+    class StreamChannel
+    {
+    public:
+        StreamChannel() : peak_(0) {}
+
+        StreamChannel(const StreamChannel&) = delete;
+        StreamChannel& operator=(const StreamChannel&) = delete;
+
+        // Producer side; false if full
+        bool Push(const StreamBlock& block)
+        {
+            if (!queue_.Push(block))
+            {
+                return false;
+            }
+            const uint32_t size = static_cast<uint32_t>(queue_.Size());
+            if (size > peak_)
+            {
+                peak_ = size;
+            }
+            return true;
+        }
+
+        // Consumer side
+        bool Pop(StreamBlock& block) { return queue_.Pop(block); }
+        const StreamBlock* Peek() const { return queue_.Peek(); }
+
+        size_t Size() const { return queue_.Size(); }
+        bool Full() const { return queue_.Full(); }
+        uint32_t GetPeak() const { return peak_; }
+        void ResetPeak() { peak_ = static_cast<uint32_t>(queue_.Size()); }
+        static constexpr size_t GetCapacity() { return Depth; }
+
+    private:
+        SpscQueue<StreamBlock, Depth> queue_;
+        volatile uint32_t peak_;
+    };
+
+    // Producer: fills pool blocks and pushes them into a channel, typically
+    // from a DMA half-transfer callback
+    template <size_t Depth>
+    class StreamSource
+    {
+    public:
+        StreamSource(DmaPool& pool, StreamChannel<Depth>& out)
+            : pool_(pool)
+            , out_(out)
+            , sequence_(0)
+        {
+        }
+
+        StreamSource(const StreamSource&) = delete;
+        StreamSource& operator=(const StreamSource&) = delete;
+
+        // Copy @p length bytes (at most the pool's block size) into a block
+        // and push it; false, and a drop counted, if there is no room
+        bool Submit(const void* data, size_t length)
+        {
+            if (length > pool_.GetBlockSize())
+            {
+                counters_.Dropped();
+                sequence_++;
+                return false;
+            }
+            uint8_t* block = Acquire();
+            if (block == nullptr)
+            {
+                return false;
+            }
+            std::memcpy(block, data, length);
+            return Commit(block, length);
+        }
+
+        // Zero-copy: a block to fill, nullptr (a drop counted) if the pool
+        // is empty; pass it to Commit() when filled
+        uint8_t* Acquire()
+        {
+            uint8_t* block = pool_.Allocate();
+            if (block == nullptr)
+            {
+                counters_.Dropped();
+                sequence_++;
+            }
+            return block;
+        }
+
+        // Push a block from Acquire() holding @p length bytes; false, the
+        // block freed and a drop counted, if the channel is full
+        bool Commit(uint8_t* block, size_t length)
+        {
+            const StreamBlock item = {block, static_cast<uint32_t>(length), sequence_++, &pool_};
+            if (!out_.Push(item))
+            {
+                pool_.Free(block);
+                counters_.Dropped();
+                return false;
+            }
+            counters_.Passed(length);
+            return true;
+        }
+
+        StreamStats GetStats() const { return counters_.Get(out_.GetPeak()); }
+        void ResetStats()
+        {
+            counters_.Reset();
+            out_.ResetPeak();
+        }
+
+    private:
+        DmaPool& pool_;
+        StreamChannel<Depth>& out_;
+        uint32_t sequence_;
+        detail::StreamCounters counters_;
+    };
+
+    // Processing stage: @p Process is called as
+    //   size_t process(const uint8_t* in, size_t length, uint8_t* out, size_t capacity)
+    // and returns the bytes written to @p out (capacity is the output
+    // pool's block size); 0 consumes the input without passing anything on
+    template <typename Process, size_t InDepth, size_t OutDepth>
+    class StreamStage
+    {
+    public:
+        StreamStage(StreamChannel<InDepth>& in, DmaPool& pool, StreamChannel<OutDepth>& out, Process process)
+            : in_(in)
+            , pool_(pool)
+            , out_(out)
+            , process_(process)
+        {
+        }
+
+        StreamStage(const StreamStage&) = delete;
+        StreamStage& operator=(const StreamStage&) = delete;
+
+        // Process up to @p max_blocks waiting blocks; returns how many
+        size_t Step(size_t max_blocks = InDepth)
+        {
+            size_t done = 0;
+            while (done < max_blocks)
+            {
+                const StreamBlock* input = in_.Peek();
+                if (input == nullptr)
+                {
+                    break;
+                }
+                if (out_.Full())
+                {
+                    counters_.Stalled();
+                    break;
+                }
+                uint8_t* output = pool_.Allocate();
+                if (output == nullptr)
+                {
+                    counters_.Stalled();
+                    break;
+                }
+
+                StreamBlock block;
+                in_.Pop(block);
+                const size_t length = process_(block.data, block.length, output, pool_.GetBlockSize());
+                const StreamBlock result = {output, static_cast<uint32_t>(length), block.sequence, &pool_};
+                detail::FreeStreamBlock(block);
+                done++;
+
+                if (length == 0)
+                {
+                    pool_.Free(output);
+                    continue;
+                }
+                // Only this stage pushes, so the room checked above is still there
+                out_.Push(result);
+                counters_.Passed(length);
+            }
+            return done;
+        }
+
+        StreamStats GetStats() const { return counters_.Get(out_.GetPeak()); }
+        void ResetStats()
+        {
+            counters_.Reset();
+            out_.ResetPeak();
+        }
+
+    private:
+        StreamChannel<InDepth>& in_;
+        DmaPool& pool_;
+        StreamChannel<OutDepth>& out_;
+        Process process_;
+        detail::StreamCounters counters_;
+    };
+
+    // Sink: hands blocks to @p Writer, called as
+    //   int write(const uint8_t* data, size_t length)
+    // returning the bytes it took (a block may go out in several calls),
+    // 0 if busy (the block waits for the next Step()) or -1 on an error
+    // (the rest of the block is dropped)
+    template <typename Writer, size_t Depth>
+    class StreamSink
+    {
+    public:
+        StreamSink(StreamChannel<Depth>& in, Writer writer)
+            : in_(in)
+            , writer_(writer)
+            , offset_(0)
+            , next_sequence_(0)
+            , gaps_(0)
+        {
+        }
+
+        StreamSink(const StreamSink&) = delete;
+        StreamSink& operator=(const StreamSink&) = delete;
+
+        // Write up to @p max_blocks waiting blocks; returns how many finished
+        size_t Step(size_t max_blocks = Depth)
+        {
+            size_t done = 0;
+            while (done < max_blocks)
+            {
+                const StreamBlock* block = in_.Peek();
+                if (block == nullptr)
+                {
+                    break;
+                }
+                const int taken = writer_(block->data + offset_, block->length - offset_);
+                if (taken == 0)
+                {
+                    counters_.Stalled();
+                    break;
+                }
+                if (taken > 0)
+                {
+                    offset_ += static_cast<uint32_t>(taken);
+                    if (offset_ < block->length)
+                    {
+                        continue;
+                    }
+                }
+
+                StreamBlock finished;
+                in_.Pop(finished);
+                if (taken > 0)
+                {
+                    counters_.Passed(finished.length);
+                }
+                else
+                {
+                    counters_.Dropped();
+                }
+                if (finished.sequence != next_sequence_)
+                {
+                    gaps_ = gaps_ + 1;
+                }
+                next_sequence_ = finished.sequence + 1;
+                offset_ = 0;
+                detail::FreeStreamBlock(finished);
+                done++;
+            }
+            return done;
+        }
+
+        // Breaks in the source's numbering seen here: each is a run of
+        // blocks lost anywhere upstream
+        uint32_t GetGaps() const { return gaps_; }
+
+        StreamStats GetStats() const { return counters_.Get(in_.GetPeak()); }
+        void ResetStats()
+        {
+            counters_.Reset();
+            gaps_ = 0;
+        }
+
+        Writer& GetWriter() { return writer_; }
+
+    private:
+        StreamChannel<Depth>& in_;
+        Writer writer_;
+        uint32_t offset_;          // Bytes of the head block already written
+        uint32_t next_sequence_;
+        volatile uint32_t gaps_;
+        detail::StreamCounters counters_;
+    };
+
+    // Writer for a File (wrapper/filesystem.h): with a write buffer set
+    // (File::setWriteBuffer()) blocks collect into whole clusters; a short
+    // write is a card error
+    template <typename FileType>
+    class FileStreamWriter
+    {
+    public:
+        explicit FileStreamWriter(FileType& file) : file_(file) {}
+
+        int operator()(const uint8_t* data, size_t length)
+        {
+            const uint32_t written = file_.write(data, static_cast<uint32_t>(length));
+            return written == length ? static_cast<int>(written) : -1;
+        }
+
+    private:
+        FileType& file_;
+    };
+
+    // Writer for USB (wrapper/usb.h), CDC or the vendor bulk interface:
+    // takes what fits in the transmit buffer without waiting; blocks are
+    // dropped while no host is connected
+    template <typename Port>
+    class UsbStreamWriter
+    {
+    public:
+        explicit UsbStreamWriter(Port& port) : port_(port) {}
+
+        int operator()(const uint8_t* data, size_t length)
+        {
+            if (!port_.isConnected())
+            {
+                return -1;
+            }
+            size_t chunk = port_.availableForWrite();
+            if (chunk > length)
+            {
+                chunk = length;
+            }
+            if (chunk == 0)
+            {
+                return 0;
+            }
+            return port_.write(data, static_cast<uint16_t>(chunk), 0) ? static_cast<int>(chunk) : 0;
+        }
+
+    private:
+        Port& port_;
+    };
+
+    // Writer for CAN (wrapper/can.h): frames of up to 8 bytes (64 with FD,
+    // the last padded to a valid FD length) on @p id; stops at the first
+    // frame the controller or transmit queue refuses
+    template <typename Port>
+    class CanStreamWriter
+    {
+    public:
+        CanStreamWriter(Port& port, uint32_t id, bool fd = false, bool extended = false)
+            : port_(port)
+            , id_(id)
+            , fd_(fd)
+            , extended_(extended)
+        {
+        }
+
+        int operator()(const uint8_t* data, size_t length)
+        {
+            const size_t mtu = fd_ ? 64 : 8;
+            size_t sent = 0;
+            while (sent < length)
+            {
+                const size_t chunk = length - sent < mtu ? length - sent : mtu;
+                uint8_t frame[64];
+                const size_t frame_length = FrameLength(chunk);
+                std::memcpy(frame, data + sent, chunk);
+                std::memset(frame + chunk, 0, frame_length - chunk);
+                if (!port_.send(id_, frame, static_cast<uint8_t>(frame_length), extended_))
+                {
+                    break;
+                }
+                sent += chunk;
+            }
+            return static_cast<int>(sent);
+        }
+
+    private:
+        static size_t FrameLength(size_t length)
+        {
+            static const uint8_t kFdLengths[] = {12, 16, 20, 24, 32, 48, 64};
+            if (length <= 8)
+            {
+                return length;
+            }
+            for (uint8_t valid : kFdLengths)
+            {
+                if (length <= valid)
+                {
+                    return valid;
+                }
+            }
+            return 64;
+        }
+
+        Port& port_;
+        uint32_t id_;
+        bool fd_;
+        bool extended_;
+    };
+
+    // Report a pipeline role's counters as a line:
+    // "@stream name=NAME blocks=N bytes=B drops=N stalls=N peak=N ms=N bps=N"
+    template <typename Out>
+    void PrintStreamStats(Out& out, const char* name, const StreamStats& stats)
+    {
+        out.printf("@stream name=%s blocks=%u bytes=%u drops=%u stalls=%u peak=%u ms=%u bps=%u\r\n",
+                   name, static_cast<unsigned>(stats.blocks), static_cast<unsigned>(stats.bytes),
+                   static_cast<unsigned>(stats.drops), static_cast<unsigned>(stats.stalls),
+                   static_cast<unsigned>(stats.queue_peak), static_cast<unsigned>(stats.elapsed_ms),
+                   static_cast<unsigned>(stats.bytes_per_second));
+    }
+
+} // namespace Lumos
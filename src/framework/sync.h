@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5)
+#define LUMOS_DEVICE_SYNC
+#if defined(STM32H7)
+    #include "stm32h7xx.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx.h"
+#endif
+#else
+#include <atomic>
+#endif
+
+namespace Lumos
+{
+
+    // Short mutual exclusion between applications, tasks and interrupts
+    // Usage Example:
+    //   {
+    //       CriticalSection lock;   // Interrupts masked until the end of scope
+    //       count++;
+    //   }
+    //
+    // On the device this masks interrupts (PRIMASK) and restores the
+    // previous state, so it nests and works on every core including the
+    // Cortex-M0+, which has no exclusive load/store. On the host a single
+    // process-wide spin lock stands in for it. Keep the protected code to a
+    // few instructions: it delays every interrupt.
+    class CriticalSection
+    {
+    public:
+#ifdef LUMOS_DEVICE_SYNC
+        CriticalSection()
+            : primask_(__get_PRIMASK())
+        {
+            __disable_irq();
+        }
+
+        ~CriticalSection()
+        {
+            __set_PRIMASK(primask_);
+        }
+#else
+        CriticalSection()
+        {
+            // Nested sections on the same thread are not supported on the host
+            while (Lock().test_and_set(std::memory_order_acquire))
+            {
+            }
+        }
+
+        ~CriticalSection()
+        {
+            Lock().clear(std::memory_order_release);
+        }
+#endif
+
+        CriticalSection(const CriticalSection&) = delete;
+        CriticalSection& operator=(const CriticalSection&) = delete;
+
+    private:
+#ifdef LUMOS_DEVICE_SYNC
+        uint32_t primask_;
+#else
+        static std::atomic_flag& Lock()
+        {
+            static std::atomic_flag lock = ATOMIC_FLAG_INIT;
+            return lock;
+        }
+#endif
+    };
+
+} // namespace Lumos
@@ -0,0 +1,132 @@
+#include "time_sync.h"
+#include "sync.h"
+
+#if defined(STM32H7) || defined(STM32G0) || defined(STM32G4) || defined(STM32F4) || defined(STM32H5) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_DEVICE_TIME_BASE
+#else
+#include <chrono>
+#endif
+
+namespace Lumos
+{
+
+    TimeSync::TimeSync(Role role)
+        : role_(role)
+        , base_local_us_(0)
+        , base_global_us_(0)
+        , rate_ppb_(0)
+        , frequency_ppb_(0)
+        , last_error_us_(0)
+        , sync_count_(0)
+        , step_count_(0)
+        , stepped_(false)
+    {
+    }
+
+    uint64_t TimeSync::GetTimeUs() const
+    {
+        return ToGlobalUs(GetLocalTimeUs());
+    }
+
+    uint64_t TimeSync::ToGlobalUs(uint64_t local_us) const
+    {
+        if (role_ == Role::Master)
+        {
+            return local_us;
+        }
+        CriticalSection lock;
+        return MapLocked(local_us);
+    }
+
+    void TimeSync::OnSync(uint64_t master_us, uint64_t local_us)
+    {
+        if (role_ == Role::Master)
+        {
+            return;
+        }
+
+        CriticalSection lock;
+        const int64_t interval_us = static_cast<int64_t>(local_us - base_local_us_);
+        const int64_t error_us = static_cast<int64_t>(master_us - MapLocked(local_us));
+        last_error_us_ = error_us;
+        sync_count_++;
+
+        const int64_t magnitude = error_us < 0 ? -error_us : error_us;
+        if (sync_count_ == 1 || magnitude > kStepThresholdUs || interval_us <= 0)
+        {
+            // Start over from this pair, keeping the learned frequency
+            base_local_us_ = local_us;
+            base_global_us_ = master_us;
+            rate_ppb_ = frequency_ppb_;
+            step_count_++;
+            stepped_ = true;
+            return;
+        }
+
+        // Error as a rate over the last interval, then PI: half of it
+        // corrects the phase over the next interval and an eighth goes
+        // into the frequency estimate. Right after a step the phase was
+        // exact, so the whole error is the crystal's frequency error.
+        const int64_t error_ppb = error_us * 1000000000 / interval_us;
+        if (stepped_)
+        {
+            frequency_ppb_ = Clamp(frequency_ppb_ + error_ppb);
+            stepped_ = false;
+        }
+        else
+        {
+            frequency_ppb_ = Clamp(frequency_ppb_ + error_ppb / 8);
+        }
+
+        // Rebase at this sync without a jump, then slew
+        base_global_us_ = MapLocked(local_us);
+        base_local_us_ = local_us;
+        rate_ppb_ = Clamp(static_cast<int64_t>(frequency_ppb_) + error_ppb / 2);
+    }
+
+    bool TimeSync::IsLocked() const
+    {
+        if (role_ == Role::Master)
+        {
+            return true;
+        }
+        const int64_t error_us = last_error_us_;
+        return sync_count_ >= 2 && !stepped_ && error_us <= kLockThresholdUs && error_us >= -static_cast<int64_t>(kLockThresholdUs);
+    }
+
+    uint64_t TimeSync::GetLocalTimeUs()
+    {
+#ifdef LUMOS_DEVICE_TIME_BASE
+        return ::GetCurrentTimeUs();
+#else
+        auto now = std::chrono::steady_clock::now();
+        auto duration = now.time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+#endif
+    }
+
+    uint64_t TimeSync::MapLocked(uint64_t local_us) const
+    {
+        if (sync_count_ == 0)
+        {
+            return local_us;   // Free running until the first sync
+        }
+        const int64_t elapsed = static_cast<int64_t>(local_us - base_local_us_);
+        return base_global_us_ + elapsed + elapsed * rate_ppb_ / 1000000000;
+    }
+
+    int32_t TimeSync::Clamp(int64_t ppb)
+    {
+        if (ppb > kMaxRatePpb)
+        {
+            return kMaxRatePpb;
+        }
+        if (ppb < -kMaxRatePpb)
+        {
+            return -kMaxRatePpb;
+        }
+        return static_cast<int32_t>(ppb);
+    }
+
+} // namespace Lumos
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Lumos
+{
+
+    // Source of the time the Scheduler releases apps on (see Scheduler::SetTimeBase())
+    class TimeBase
+    {
+    public:
+        virtual ~TimeBase() {}
+
+        // Microseconds; never decreases except when the clock is stepped
+        virtual uint64_t GetTimeUs() const = 0;
+    };
+
+    // Network time shared by several nodes: the master's clock
+    // Usage Example:
+    //   TimeSync clock(TimeSync::Role::Slave);   // Role::Master on one node
+    //   CanTimeSync<CAN> can_sync(CAN1, clock, 0x080);
+    //   Scheduler scheduler;
+    //
+    //   void setup() {
+    //       CAN1.begin(1000000);
+    //       scheduler.SetTimeBase(&clock);       // Releases on network time
+    //       scheduler.Start();
+    //   }
+    //
+    //   void loop() {
+    //       CANFrame frame;
+    //       while (CAN1.read(frame)) { can_sync.HandleFrame(frame); }
+    //       can_sync.Poll();
+    //       scheduler.RunOnce();
+    //   }
+    //
+    // The master's GetTimeUs() is its local GetCurrentTimeUs(). A slave
+    // maps its local time onto the master's from the (master time, local
+    // time) pairs OnSync() receives: the first pair, and any error above
+    // kStepThresholdUs, steps the clock; smaller errors are slewed out by a
+    // PI servo that also learns the crystal's frequency error, so the
+    // slave's time stays continuous and monotonic and keeps the master's
+    // rate between syncs.
+    class TimeSync : public TimeBase
+    {
+    public:
+        enum class Role { Master, Slave };
+
+        static constexpr uint32_t kStepThresholdUs = 1000;   // Larger errors step the clock
+        static constexpr uint32_t kLockThresholdUs = 20;     // IsLocked() below this error
+        static constexpr int32_t kMaxRatePpb = 500000;       // Slew limit, 500 ppm
+
+        explicit TimeSync(Role role);
+
+        Role GetRole() const { return role_; }
+
+        // Network time now
+        uint64_t GetTimeUs() const override;
+
+        // Network time at local time @p local_us (from GetCurrentTimeUs())
+        uint64_t ToGlobalUs(uint64_t local_us) const;
+
+        // Slave: the master's clock read @p master_us when the local clock
+        // read @p local_us; ignored by the master
+        void OnSync(uint64_t master_us, uint64_t local_us);
+
+        // Master, or a slave whose last sync was within kLockThresholdUs
+        bool IsLocked() const;
+
+        // Error of the last sync (master - slave) and the current rate
+        // correction; 0 on the master
+        int64_t GetLastErrorUs() const { return last_error_us_; }
+        int32_t GetRateCorrectionPpb() const { return rate_ppb_; }
+        uint32_t GetSyncCount() const { return sync_count_; }
+        uint32_t GetStepCount() const { return step_count_; }
+
+        // Local time base, GetCurrentTimeUs() on the device
+        static uint64_t GetLocalTimeUs();
+
+    private:
+        Role role_;
+        uint64_t base_local_us_;     // Mapping: global = base_global + dt * (1 + rate)
+        uint64_t base_global_us_;
+        int32_t rate_ppb_;           // Frequency plus phase correction
+        int32_t frequency_ppb_;      // Integral term: learned frequency error
+        int64_t last_error_us_;
+        uint32_t sync_count_;
+        uint32_t step_count_;
+        bool stepped_;               // Last sync stepped, the next one only measures
+
+        uint64_t MapLocked(uint64_t local_us) const;
+        static int32_t Clamp(int64_t ppb);
+    };
+
+    // Time sync over one CAN port (the CAN wrapper or anything with its
+    // sendTimestamped()/readTxEvent()/timestampToTimeUs() signatures)
+    //
+    // Two-step protocol on @p sync_id and @p sync_id + 1 (classic frames):
+    // the master sends SYNC (one sequence byte) and reads the hardware
+    // timestamp of its start of frame back from the TX event FIFO, then
+    // sends FOLLOW_UP with the sequence and its network time at that
+    // instant (7 bytes, little-endian). Every receiver timestamps the same
+    // start of frame in hardware, so queueing and interrupt latency on
+    // either side cancel out and the slaves align to a few microseconds.
+    //
+    // The master calls Poll() often; slaves pass received frames to
+    // HandleFrame() within one timestamp counter wrap (65 ms at 1 Mbit/s)
+    // of their reception. Use one master per bus and keep the ids free of
+    // other traffic; a lower id than the application frames keeps the SYNC
+    // from waiting for the bus.
+    template <typename Port>
+    class CanTimeSync
+    {
+    public:
+        CanTimeSync(Port& port, TimeSync& clock, uint32_t sync_id, uint32_t interval_ms = 100)
+            : port_(port)
+            , clock_(clock)
+            , sync_id_(sync_id)
+            , interval_us_(static_cast<uint64_t>(interval_ms) * 1000)
+            , next_sync_us_(0)
+            , sequence_(0)
+            , pending_(false)
+            , pending_since_us_(0)
+            , rx_sequence_(0)
+            , rx_local_us_(0)
+            , rx_valid_(false)
+        {
+        }
+
+        // Master: send SYNC every interval and FOLLOW_UP once its timestamp is known
+        void Poll()
+        {
+            if (clock_.GetRole() != TimeSync::Role::Master)
+            {
+                return;
+            }
+            const uint64_t now = TimeSync::GetLocalTimeUs();
+
+            uint8_t marker;
+            uint16_t timestamp;
+            while (pending_ && port_.readTxEvent(marker, timestamp))
+            {
+                if (marker != kSyncMarker)
+                {
+                    continue;
+                }
+                pending_ = false;
+                const uint64_t sent_us = clock_.ToGlobalUs(port_.timestampToTimeUs(timestamp));
+                uint8_t data[8];
+                data[0] = sequence_;
+                for (size_t i = 0; i < 7; i++)
+                {
+                    data[1 + i] = static_cast<uint8_t>(sent_us >> (8 * i));
+                }
+                port_.send(sync_id_ + 1, data, 8);
+            }
+            if (pending_ && now - pending_since_us_ > interval_us_)
+            {
+                pending_ = false;   // Never went out (bus off, no ACK)
+            }
+
+            if (!pending_ && now >= next_sync_us_)
+            {
+                const uint8_t sequence = static_cast<uint8_t>(sequence_ + 1);
+                if (port_.sendTimestamped(sync_id_, &sequence, 1, kSyncMarker))
+                {
+                    sequence_ = sequence;
+                    pending_ = true;
+                    pending_since_us_ = now;
+                }
+                next_sync_us_ = now + interval_us_;
+            }
+        }
+
+        // Slave: consume SYNC and FOLLOW_UP frames; false for other frames
+        template <typename Frame>
+        bool HandleFrame(const Frame& frame)
+        {
+            if (frame.extended || (frame.id != sync_id_ && frame.id != sync_id_ + 1))
+            {
+                return false;
+            }
+            if (clock_.GetRole() != TimeSync::Role::Slave)
+            {
+                return true;
+            }
+
+            if (frame.id == sync_id_)
+            {
+                if (frame.length >= 1)
+                {
+                    rx_sequence_ = frame.data[0];
+                    rx_local_us_ = port_.timestampToTimeUs(frame.timestamp);
+                    rx_valid_ = true;
+                }
+                return true;
+            }
+
+            // FOLLOW_UP of the last SYNC
+            if (rx_valid_ && frame.length >= 8 && frame.data[0] == rx_sequence_)
+            {
+                uint64_t master_us = 0;
+                for (size_t i = 0; i < 7; i++)
+                {
+                    master_us |= static_cast<uint64_t>(frame.data[1 + i]) << (8 * i);
+                }
+                clock_.OnSync(master_us, rx_local_us_);
+            }
+            rx_valid_ = false;
+            return true;
+        }
+
+    private:
+        static constexpr uint8_t kSyncMarker = 0x5A;
+
+        Port& port_;
+        TimeSync& clock_;
+        uint32_t sync_id_;
+        uint64_t interval_us_;
+        uint64_t next_sync_us_;
+        uint8_t sequence_;
+        bool pending_;                // SYNC sent, TX event not read yet
+        uint64_t pending_since_us_;
+        uint8_t rx_sequence_;
+        uint64_t rx_local_us_;        // Local time of the last SYNC
+        bool rx_valid_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(LUMOS_DEVICE_SYNC) || defined(LUMOS_HOST)
+#include "sys.h"
+#define LUMOS_TOKEN_LOG_DEVICE_TIME
+#else
+#include <chrono>
+#endif
+
+#ifdef LUMOS_DEVICE_SYNC
+// Format strings go to a section the linker scripts mark INFO: it stays in
+// firmware.elf for the decoder but takes no flash
+#ifndef LUMOS_TOKEN_LOG_SECTION
+#define LUMOS_TOKEN_LOG_SECTION __attribute__((section(".lumos_log"), used))
+#endif
+#endif
+
+#ifndef LUMOS_TOKEN_LOG_SECTION
+#define LUMOS_TOKEN_LOG_SECTION
+#endif
+
+namespace Lumos
+{
+
+    // Compile-time check of the arguments against the format (never called)
+    inline void CheckTokenLogFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    inline void CheckTokenLogFormat(const char* format, ...) { (void)format; }
+
+    // Tokenized log: only a token and the raw arguments leave the MCU
+    // Usage Example:
+    //   TokenLog<1024> tlog;
+    //
+    //   void ControlApp::Step() {
+    //       LUMOS_TOKEN_LOG(tlog, "pos %ld err %f", position, error);   // ~20 cycles, no formatting
+    //   }
+    //
+    //   void loop() { tlog.Flush(Serial1); }    // Serial1.beginTxDma(...) sends it by DMA
+    //
+    // The format string is placed in the .lumos_log section, which the
+    // linker keeps in firmware.elf without loading it, and its address is
+    // the token. Write() packs the token, the time and the arguments into
+    // a frame in a ring buffer (safe from any context); Flush() hands the
+    // frames to a stream, and `lumos monitor` looks the tokens up in
+    // build/firmware.elf and prints the formatted lines between the normal
+    // text output. Integers travel as 4 or 8 bytes as declared, floating
+    // point as float32; strings (%s) are not supported. When the ring is
+    // full new frames are dropped and counted.
+    //
+    // Frame: 0x00, argument bytes, token (u32), time (u32, low bits of
+    // GetCurrentTimeUs()), arguments, CRC-8 of everything after the 0x00.
+    // Text output never contains a 0x00, so the monitor can tell them apart.
+    template <size_t Capacity = 1024>
+    class TokenLog
+    {
+        static_assert(Capacity >= 128 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two of at least 128");
+
+    public:
+        static constexpr size_t kMaxArgumentBytes = 32;
+        static constexpr size_t kHeaderBytes = 10;
+        static constexpr size_t kMaxFrame = kHeaderBytes + kMaxArgumentBytes + 1;
+
+        TokenLog()
+            : head_(0)
+            , tail_(0)
+            , dropped_(0)
+        {
+        }
+
+        // Use through LUMOS_TOKEN_LOG, which supplies the token
+        template <typename... Args>
+        void Write(uint32_t token, const char* format, const Args&... args)
+        {
+            (void)format;   // Only the token is sent; the text stays in the ELF
+            static_assert(ArgumentBytes<Args...>() <= kMaxArgumentBytes, "Too many token log arguments");
+
+            uint8_t frame[kMaxFrame];
+            size_t length = kHeaderBytes;
+            Pack(frame, length, args...);
+            frame[0] = 0x00;
+            frame[1] = static_cast<uint8_t>(length - kHeaderBytes);
+            PutU32(frame + 2, token);
+            uint32_t time_us = GetTimeUs();
+            PutU32(frame + 6, time_us);
+            frame[length] = Crc8(frame + 1, length - 1);
+            length++;
+
+            CriticalSection lock;
+            if (Capacity - (head_ - tail_) < length)
+            {
+                dropped_++;
+                return;
+            }
+            for (size_t i = 0; i < length; i++)
+            {
+                buffer_[(head_ + i) & (Capacity - 1)] = frame[i];
+            }
+            head_ += static_cast<uint32_t>(length);
+        }
+
+        // Pass buffered frames to @p stream (write(data, length) returning
+        // false when busy); call from one context, e.g. loop() or a
+        // low-priority app
+        template <typename Stream>
+        void Flush(Stream& stream)
+        {
+            for (int chunk = 0; chunk < 2; chunk++)
+            {
+                uint32_t head;
+                {
+                    CriticalSection lock;
+                    head = head_;
+                }
+                const uint32_t tail = tail_;
+                if (head == tail)
+                {
+                    return;
+                }
+                // Contiguous part up to the end of the ring
+                const uint32_t start = tail & (Capacity - 1);
+                uint32_t length = head - tail;
+                if (start + length > Capacity)
+                {
+                    length = static_cast<uint32_t>(Capacity - start);
+                }
+                if (length > 0x8000)
+                {
+                    length = 0x8000;
+                }
+                if (!stream.write(buffer_ + start, static_cast<uint16_t>(length)))
+                {
+                    return;
+                }
+                CriticalSection lock;
+                tail_ = tail + length;
+            }
+        }
+
+        uint32_t GetDroppedCount() const { return dropped_; }
+
+        // Bytes waiting for Flush()
+        size_t GetPending() const
+        {
+            CriticalSection lock;
+            return head_ - tail_;
+        }
+
+    private:
+        uint8_t buffer_[Capacity];
+        uint32_t head_;
+        volatile uint32_t tail_;
+        uint32_t dropped_;
+
+        static void PutU32(uint8_t* out, uint32_t value)
+        {
+            out[0] = static_cast<uint8_t>(value);
+            out[1] = static_cast<uint8_t>(value >> 8);
+            out[2] = static_cast<uint8_t>(value >> 16);
+            out[3] = static_cast<uint8_t>(value >> 24);
+        }
+
+        template <typename T>
+        static constexpr size_t WireSize()
+        {
+            static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                          "Token log arguments must be numbers or pointers");
+            static_assert(!std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value,
+                          "Token log arguments cannot be strings");
+            return std::is_floating_point<T>::value ? 4 : (sizeof(T) > 4 ? 8 : 4);
+        }
+
+        template <typename... Args>
+        static constexpr size_t ArgumentBytes()
+        {
+            size_t total = 0;
+            const size_t sizes[] = {0, WireSize<Args>()...};
+            for (size_t size : sizes)
+            {
+                total += size;
+            }
+            return total;
+        }
+
+        static void Pack(uint8_t*, size_t&) {}
+
+        template <typename T, typename... Rest>
+        static void Pack(uint8_t* frame, size_t& length, const T& value, const Rest&... rest)
+        {
+            PackOne(frame, length, value);
+            Pack(frame, length, rest...);
+        }
+
+        template <typename T>
+        static typename std::enable_if<std::is_floating_point<T>::value>::type
+        PackOne(uint8_t* frame, size_t& length, const T& value)
+        {
+            const float narrow = static_cast<float>(value);
+            std::memcpy(frame + length, &narrow, 4);
+            length += 4;
+        }
+
+        template <typename T>
+        static typename std::enable_if<!std::is_floating_point<T>::value && !std::is_pointer<T>::value>::type
+        PackOne(uint8_t* frame, size_t& length, const T& value)
+        {
+            // Sign- or zero-extended to the wire width, little-endian
+            if (sizeof(T) > 4)
+            {
+                const uint64_t wide = static_cast<uint64_t>(value);
+                PutU32(frame + length, static_cast<uint32_t>(wide));
+                PutU32(frame + length + 4, static_cast<uint32_t>(wide >> 32));
+                length += 8;
+            }
+            else
+            {
+                PutU32(frame + length, static_cast<uint32_t>(value));
+                length += 4;
+            }
+        }
+
+        template <typename T>
+        static typename std::enable_if<std::is_pointer<T>::value>::type
+        PackOne(uint8_t* frame, size_t& length, const T& value)
+        {
+            PutU32(frame + length, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(value)));
+            length += 4;
+        }
+
+        // CRC-8 (polynomial 0x07)
+        static uint8_t Crc8(const uint8_t* data, size_t length)
+        {
+            uint8_t crc = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                crc ^= data[i];
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+                }
+            }
+            return crc;
+        }
+
+        static uint32_t GetTimeUs()
+        {
+#ifdef LUMOS_TOKEN_LOG_DEVICE_TIME
+            return static_cast<uint32_t>(::GetCurrentTimeUs());
+#else
+            auto duration = std::chrono::steady_clock::now().time_since_epoch();
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+#endif
+        }
+    };
+
+} // namespace Lumos
+
+#define LUMOS_TOKEN_LOG_FIRST(first, ...) first
+
+// Log through @p log (a TokenLog) with a printf format and number arguments
+#define LUMOS_TOKEN_LOG(log, ...)                                                                       \
+    do                                                                                                  \
+    {                                                                                                   \
+        LUMOS_TOKEN_LOG_SECTION static const char lumos_token_format[] = LUMOS_TOKEN_LOG_FIRST(__VA_ARGS__, 0); \
+        if (false)                                                                                      \
+        {                                                                                               \
+            ::Lumos::CheckTokenLogFormat(__VA_ARGS__);                                                  \
+        }                                                                                               \
+        (log).Write(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(lumos_token_format)), __VA_ARGS__); \
+    } while (0)
@@ -0,0 +1,581 @@
+#include "transport.h"
+
+#include <cstring>
+
+namespace Lumos
+{
+
+    namespace
+    {
+        constexpr size_t kRecordHeader = 3;      // Id (2 bytes) and length
+        constexpr size_t kSegmentHeader = 4;     // Plus the segment byte
+        constexpr uint8_t kSegmented = 0x80;     // Length byte: a segment byte follows
+        constexpr uint8_t kLastSegment = 0x80;   // Segment byte: final segment
+        constexpr size_t kMinMtu = 8;
+        constexpr size_t kMaxReceivePerPoll = 16;   // Frames taken from each link per Poll()
+        constexpr uint64_t kBurstUs = 10000;        // Bandwidth that may accrue while idle
+    }
+
+    Transport::Transport()
+        : channels_()
+        , link_count_(0)
+        , publications_()
+        , publication_count_(0)
+        , subscriptions_()
+        , subscription_count_(0)
+        , reassembly_()
+        , staging_()
+        , now_us_(0)
+    {
+    }
+
+    bool Transport::AddLink(Link &link)
+    {
+        const size_t mtu = link.GetMtu();
+        if (link_count_ >= kMaxLinks || mtu < kMinMtu || mtu > kMaxFrame)
+        {
+            return false;
+        }
+
+        Channel &channel = channels_[link_count_];
+        channel.link = &link;
+        channel.stats = TransportLinkStats();
+        channel.frame_length = 0;
+        channel.budget_bytes = 0;
+        channel.last_poll_us = 0;
+        channel.route_mask = 0;
+        channel.batch_delay_us = 0;
+        channel.frame_start_us = 0;
+        link_count_++;
+        return true;
+    }
+
+    bool Transport::AddRoute(size_t from_link, uint32_t to_mask)
+    {
+        if (from_link >= link_count_)
+        {
+            return false;
+        }
+        channels_[from_link].route_mask |= to_mask & ~(1u << from_link);
+        return true;
+    }
+
+    bool Transport::SetBatchDelay(size_t link_index, uint32_t delay_us)
+    {
+        if (link_index >= link_count_)
+        {
+            return false;
+        }
+        channels_[link_index].batch_delay_us = delay_us;
+        return true;
+    }
+
+    bool Transport::AddPublication(uint16_t id, size_t size, void *topic, SerializeFunction serialize,
+                                   SequenceFunction sequence, uint32_t rate_hz, uint32_t link_mask)
+    {
+        if (id == 0 || publication_count_ >= kMaxPublications)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < publication_count_; i++)
+        {
+            if (publications_[i].id == id)
+            {
+                return false;
+            }
+        }
+
+        Publication publication;
+        publication.id = id;
+        publication.size = static_cast<uint16_t>(size);
+        publication.topic = topic;
+        publication.serialize = serialize;
+        publication.sequence = sequence;
+        publication.rate_hz = rate_hz;
+        publication.period_us = rate_hz > 0 ? 1000000ULL / rate_hz : 0;
+        publication.next_due_us = 0;
+        publication.link_mask = link_mask;
+        publication.last_sequence = sequence(topic);   // Only send what is published from now on
+
+        // Keep the table in rate-monotonic order; rate 0 (on change) goes last
+        size_t index = publication_count_;
+        while (index > 0)
+        {
+            const uint32_t other = publications_[index - 1].rate_hz;
+            if (other != 0 && (rate_hz == 0 || other >= rate_hz))
+            {
+                break;
+            }
+            publications_[index] = publications_[index - 1];
+            index--;
+        }
+        publications_[index] = publication;
+        publication_count_++;
+        return true;
+    }
+
+    bool Transport::AddSubscription(uint16_t id, size_t size, void *topic, DeliverFunction deliver,
+                                    SequenceFunction sequence)
+    {
+        if (id == 0 || subscription_count_ >= kMaxSubscriptions || FindSubscription(id) != nullptr)
+        {
+            return false;
+        }
+
+        Subscription &subscription = subscriptions_[subscription_count_];
+        subscription.id = id;
+        subscription.size = static_cast<uint16_t>(size);
+        subscription.topic = topic;
+        subscription.deliver = deliver;
+        subscription.sequence = sequence;
+        subscription_count_++;
+        return true;
+    }
+
+    void Transport::Poll(uint64_t now_us)
+    {
+        now_us_ = now_us;
+
+        // Receive first, so messages bridged onward go out in the same Poll()
+        uint8_t frame[kMaxFrame];
+        for (size_t l = 0; l < link_count_; l++)
+        {
+            Link &link = *channels_[l].link;
+            for (size_t n = 0; n < kMaxReceivePerPoll; n++)
+            {
+                size_t length = 0;
+                const uint8_t *in_place = link.PeekFrame(length);
+                if (in_place != nullptr)
+                {
+                    Deliver(l, in_place, length);
+                    link.ReleaseFrame();
+                    continue;
+                }
+                if (!link.Receive(frame, length))
+                {
+                    break;
+                }
+                Deliver(l, frame, length);
+            }
+            AccrueBandwidth(channels_[l], now_us);
+        }
+
+        for (size_t p = 0; p < publication_count_; p++)
+        {
+            Publication &publication = publications_[p];
+            if (publication.period_us > 0 && now_us < publication.next_due_us)
+            {
+                continue;
+            }
+            if (publication.sequence(publication.topic) == publication.last_sequence)
+            {
+                continue;   // Nothing new; sent as soon as there is
+            }
+
+            // All links get the message or none does, so it is never sent twice
+            bool fits = true;
+            size_t targets = 0;
+            size_t target = 0;
+            for (size_t l = 0; l < link_count_; l++)
+            {
+                if (!(publication.link_mask & (1u << l)))
+                {
+                    continue;
+                }
+                const uint64_t cost = GetWireBytes(publication.size, channels_[l].link->GetMtu()) * 1000000ULL;
+                if (channels_[l].budget_bytes < cost)
+                {
+                    channels_[l].stats.deferred++;
+                    fits = false;
+                }
+                targets++;
+                target = l;
+            }
+            if (!fits || targets == 0)
+            {
+                continue;
+            }
+
+            const size_t size = publication.size;
+            if (targets == 1 && size + kRecordHeader <= channels_[target].link->GetMtu())
+            {
+                // Serialize straight into the frame
+                Channel &channel = channels_[target];
+                uint8_t *record = Reserve(channel, kRecordHeader + size);
+                if (publication.serialize(publication.topic, publication.last_sequence, record + kRecordHeader) == 0)
+                {
+                    continue;
+                }
+                record[0] = static_cast<uint8_t>(publication.id);
+                record[1] = static_cast<uint8_t>(publication.id >> 8);
+                record[2] = static_cast<uint8_t>(size);
+                channel.frame_length += kRecordHeader + size;
+                channel.budget_bytes -= (kRecordHeader + size) * 1000000ULL;
+                channel.stats.messages_sent++;
+            }
+            else
+            {
+                if (publication.serialize(publication.topic, publication.last_sequence, staging_) == 0)
+                {
+                    continue;
+                }
+                for (size_t l = 0; l < link_count_; l++)
+                {
+                    if (publication.link_mask & (1u << l))
+                    {
+                        Channel &channel = channels_[l];
+                        Append(channel, publication.id, staging_, size);
+                        channel.budget_bytes -= GetWireBytes(size, channel.link->GetMtu()) * 1000000ULL;
+                        channel.stats.messages_sent++;
+                    }
+                }
+            }
+
+            // Keep the average rate through jitter, but do not catch up after a stall
+            if (publication.period_us > 0)
+            {
+                publication.next_due_us += publication.period_us;
+                if (publication.next_due_us <= now_us)
+                {
+                    publication.next_due_us = now_us + publication.period_us;
+                }
+            }
+        }
+
+        for (size_t l = 0; l < link_count_; l++)
+        {
+            Channel &channel = channels_[l];
+            if (channel.batch_delay_us == 0 || now_us_ - channel.frame_start_us >= channel.batch_delay_us)
+            {
+                Flush(channel);
+            }
+        }
+    }
+
+    void Transport::Deliver(size_t link_index, const uint8_t *frame, size_t length)
+    {
+        if (link_index >= link_count_)
+        {
+            return;
+        }
+        channels_[link_index].stats.frames_received++;
+        channels_[link_index].stats.bytes_received += static_cast<uint32_t>(length);
+        Parse(link_index, frame, length);
+    }
+
+    bool Transport::IsFeasible(size_t link_index) const
+    {
+        return link_index < link_count_ &&
+               GetRequiredBytesPerSecond(link_index) <= channels_[link_index].link->GetBytesPerSecond();
+    }
+
+    uint32_t Transport::GetRequiredBytesPerSecond(size_t link_index) const
+    {
+        if (link_index >= link_count_)
+        {
+            return 0;
+        }
+        const size_t mtu = channels_[link_index].link->GetMtu();
+        uint32_t required = 0;
+        for (size_t p = 0; p < publication_count_; p++)
+        {
+            const Publication &publication = publications_[p];
+            if ((publication.link_mask & (1u << link_index)) && publication.rate_hz > 0)
+            {
+                required += publication.rate_hz * static_cast<uint32_t>(GetWireBytes(publication.size, mtu));
+            }
+        }
+        return required;
+    }
+
+    const TransportLinkStats *Transport::GetStats(size_t link_index) const
+    {
+        return link_index < link_count_ ? &channels_[link_index].stats : nullptr;
+    }
+
+    void Transport::AccrueBandwidth(Channel &channel, uint64_t now_us)
+    {
+        // Allow a short burst, and always enough for the largest message
+        const uint64_t bytes_per_second = channel.link->GetBytesPerSecond();
+        const size_t mtu = channel.link->GetMtu();
+        const size_t link_bit = static_cast<size_t>(&channel - channels_);
+        uint64_t limit = bytes_per_second * kBurstUs;
+        for (size_t p = 0; p < publication_count_; p++)
+        {
+            const uint64_t largest = GetWireBytes(publications_[p].size, mtu) * 1000000ULL;
+            if ((publications_[p].link_mask & (1u << link_bit)) && limit < largest)
+            {
+                limit = largest;
+            }
+        }
+
+        if (channel.last_poll_us == 0)
+        {
+            channel.budget_bytes = limit;   // First Poll()
+        }
+        else if (now_us > channel.last_poll_us)
+        {
+            channel.budget_bytes += bytes_per_second * (now_us - channel.last_poll_us);
+        }
+        channel.last_poll_us = now_us;
+
+        if (channel.budget_bytes > limit)
+        {
+            channel.budget_bytes = limit;
+        }
+    }
+
+    size_t Transport::GetWireBytes(size_t size, size_t mtu)
+    {
+        if (size + kRecordHeader <= mtu)
+        {
+            return size + kRecordHeader;
+        }
+        const size_t chunk = mtu - kSegmentHeader;
+        const size_t segments = (size + chunk - 1) / chunk;
+        return size + segments * kSegmentHeader;
+    }
+
+    void Transport::Append(Channel &channel, uint16_t id, const uint8_t *data, size_t size)
+    {
+        const size_t mtu = channel.link->GetMtu();
+        if (size + kRecordHeader <= mtu)
+        {
+            uint8_t *record = Reserve(channel, kRecordHeader + size);
+            record[0] = static_cast<uint8_t>(id);
+            record[1] = static_cast<uint8_t>(id >> 8);
+            record[2] = static_cast<uint8_t>(size);
+            std::memcpy(record + kRecordHeader, data, size);
+            channel.frame_length += kRecordHeader + size;
+            return;
+        }
+
+        // Segments share frames with other records like any record does
+        const size_t chunk = mtu - kSegmentHeader;
+        uint8_t index = 0;
+        for (size_t offset = 0; offset < size; offset += chunk, index++)
+        {
+            const size_t length = size - offset < chunk ? size - offset : chunk;
+            const bool last = offset + length == size;
+            uint8_t *record = Reserve(channel, kSegmentHeader + length);
+            record[0] = static_cast<uint8_t>(id);
+            record[1] = static_cast<uint8_t>(id >> 8);
+            record[2] = static_cast<uint8_t>((length + 1) | kSegmented);
+            record[3] = static_cast<uint8_t>(index | (last ? kLastSegment : 0));
+            std::memcpy(record + kSegmentHeader, data + offset, length);
+            channel.frame_length += kSegmentHeader + length;
+        }
+    }
+
+    uint8_t *Transport::Reserve(Channel &channel, size_t bytes)
+    {
+        if (channel.frame_length + bytes > channel.link->GetMtu())
+        {
+            Flush(channel);
+        }
+        if (channel.frame_length == 0)
+        {
+            channel.frame_start_us = now_us_;
+        }
+        return channel.frame + channel.frame_length;
+    }
+
+    void Transport::Flush(Channel &channel)
+    {
+        if (channel.frame_length == 0)
+        {
+            return;
+        }
+        if (channel.link->Send(channel.frame, channel.frame_length))
+        {
+            const uint64_t latency = now_us_ > channel.frame_start_us ? now_us_ - channel.frame_start_us : 0;
+            channel.stats.frames_sent++;
+            channel.stats.bytes_sent += static_cast<uint32_t>(channel.frame_length);
+            channel.stats.latency_total_us += latency;
+            if (latency > channel.stats.latency_max_us)
+            {
+                channel.stats.latency_max_us = static_cast<uint32_t>(latency);
+            }
+        }
+        else
+        {
+            // Topics carry the latest value; the next one replaces it
+            channel.stats.send_failures++;
+        }
+        channel.frame_length = 0;
+    }
+
+    void Transport::Parse(size_t link_index, const uint8_t *frame, size_t length)
+    {
+        Channel &channel = channels_[link_index];
+        size_t position = 0;
+        while (position + kRecordHeader <= length)
+        {
+            const uint16_t id = static_cast<uint16_t>(frame[position] | (frame[position + 1] << 8));
+            if (id == 0)
+            {
+                break;   // Padding
+            }
+            const uint8_t info = frame[position + 2];
+            const size_t record_length = info & ~kSegmented;
+            position += kRecordHeader;
+            if (position + record_length > length)
+            {
+                channel.stats.errors++;
+                break;
+            }
+
+            // Records nobody here subscribes to are skipped unless routed on
+            const Subscription *subscription = FindSubscription(id);
+            if (info & kSegmented)
+            {
+                if (subscription != nullptr || channel.route_mask != 0)
+                {
+                    ReceiveSegment(link_index, id, subscription, frame + position, record_length);
+                }
+            }
+            else
+            {
+                if (subscription != nullptr)
+                {
+                    Receive(channel, *subscription, frame + position, record_length);
+                }
+                Forward(link_index, id, frame + position, record_length);
+            }
+            position += record_length;
+        }
+    }
+
+    void Transport::Receive(Channel &channel, const Subscription &subscription, const uint8_t *data, size_t length)
+    {
+        if (length != subscription.size || !subscription.deliver(subscription.topic, data, length))
+        {
+            channel.stats.errors++;
+            return;
+        }
+        channel.stats.messages_received++;
+
+        // A topic that is also advertised must not echo what it just received
+        for (size_t p = 0; p < publication_count_; p++)
+        {
+            if (publications_[p].topic == subscription.topic)
+            {
+                publications_[p].last_sequence = subscription.sequence(subscription.topic);
+            }
+        }
+    }
+
+    void Transport::ReceiveSegment(size_t link_index, uint16_t id, const Subscription *subscription, const uint8_t *data,
+                                   size_t length)
+    {
+        Channel &channel = channels_[link_index];
+        if (length < 1)
+        {
+            channel.stats.errors++;
+            return;
+        }
+        const uint8_t index = data[0] & ~kLastSegment;
+        const bool last = (data[0] & kLastSegment) != 0;
+        data++;
+        length--;
+
+        // Forwarded messages are only bounded by the reassembly buffer
+        const size_t limit = subscription != nullptr ? subscription->size : LUMOS_TRANSPORT_MAX_MESSAGE;
+        Reassembly *reassembly = FindReassembly(link_index, id);
+        if (index == 0)
+        {
+            if (reassembly != nullptr)
+            {
+                channel.stats.errors++;   // The previous chain never finished
+            }
+            else
+            {
+                for (size_t r = 0; r < LUMOS_TRANSPORT_REASSEMBLY && reassembly == nullptr; r++)
+                {
+                    if (reassembly_[r].id == 0)
+                    {
+                        reassembly = &reassembly_[r];
+                    }
+                }
+            }
+            if (reassembly != nullptr)
+            {
+                reassembly->id = id;
+                reassembly->link_index = link_index;
+                reassembly->next_segment = 0;
+                reassembly->received = 0;
+            }
+        }
+
+        if (reassembly == nullptr || index != reassembly->next_segment ||
+            reassembly->received + length > limit)
+        {
+            // Lost or reordered segment, or no free buffer: drop the chain
+            channel.stats.errors++;
+            if (reassembly != nullptr)
+            {
+                reassembly->id = 0;
+            }
+            return;
+        }
+
+        std::memcpy(reassembly->data + reassembly->received, data, length);
+        reassembly->received += length;
+        reassembly->next_segment++;
+
+        if (last)
+        {
+            if (subscription != nullptr)
+            {
+                Receive(channel, *subscription, reassembly->data, reassembly->received);
+            }
+            Forward(link_index, id, reassembly->data, reassembly->received);
+            reassembly->id = 0;
+        }
+    }
+
+    void Transport::Forward(size_t link_index, uint16_t id, const uint8_t *data, size_t size)
+    {
+        const uint32_t route_mask = channels_[link_index].route_mask;
+        for (size_t l = 0; l < link_count_ && route_mask != 0; l++)
+        {
+            if (!(route_mask & (1u << l)))
+            {
+                continue;
+            }
+
+            // Forwarded records are never deferred, there is nowhere to keep
+            // them; they take the bandwidth from the link's own topics
+            Channel &target = channels_[l];
+            const uint64_t cost = GetWireBytes(size, target.link->GetMtu()) * 1000000ULL;
+            Append(target, id, data, size);
+            target.budget_bytes = target.budget_bytes > cost ? target.budget_bytes - cost : 0;
+            target.stats.messages_forwarded++;
+        }
+    }
+
+    Transport::Reassembly *Transport::FindReassembly(size_t link_index, uint16_t id)
+    {
+        for (size_t r = 0; r < LUMOS_TRANSPORT_REASSEMBLY; r++)
+        {
+            if (reassembly_[r].id == id && reassembly_[r].link_index == link_index)
+            {
+                return &reassembly_[r];
+            }
+        }
+        return nullptr;
+    }
+
+    const Transport::Subscription *Transport::FindSubscription(uint16_t id) const
+    {
+        for (size_t s = 0; s < subscription_count_; s++)
+        {
+            if (subscriptions_[s].id == id)
+            {
+                return &subscriptions_[s];
+            }
+        }
+        return nullptr;
+    }
+
+} // namespace Lumos
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "message_bus.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Largest message Advertise()/Subscribe() accept; bigger ones are split
+// into segments, reassembled in one of LUMOS_TRANSPORT_REASSEMBLY buffers
+#ifndef LUMOS_TRANSPORT_MAX_MESSAGE
+#define LUMOS_TRANSPORT_MAX_MESSAGE 512
+#endif
+
+#ifndef LUMOS_TRANSPORT_REASSEMBLY
+#define LUMOS_TRANSPORT_REASSEMBLY 2
+#endif
+
+// At most 128 segments of 4 bytes on the smallest (classic CAN) frames
+static_assert(LUMOS_TRANSPORT_MAX_MESSAGE <= 512, "LUMOS_TRANSPORT_MAX_MESSAGE is limited to 512 bytes");
+
+namespace Lumos
+{
+
+    // One frame-based connection to other nodes (see transport_links.h)
+    class Link
+    {
+    public:
+        virtual ~Link() {}
+
+        // Payload bytes per frame: 8 for classic CAN, 64 for CAN FD
+        virtual size_t GetMtu() const = 0;
+
+        // Payload bytes per second the transport may use on this link
+        virtual uint32_t GetBytesPerSecond() const = 0;
+
+        // Send one frame of at most GetMtu() bytes; false if the link is busy
+        virtual bool Send(const uint8_t* frame, size_t length) = 0;
+
+        // Poll for one received frame (@p frame holds GetMtu() bytes); links
+        // that are fed by their own receive handler through
+        // Transport::Deliver() keep this default
+        virtual bool Receive(uint8_t* frame, size_t& length)
+        {
+            (void)frame;
+            (void)length;
+            return false;
+        }
+
+        // Zero-copy alternative to Receive() for links with their own frame
+        // buffers: the next frame in place, valid until ReleaseFrame();
+        // nullptr if there is none
+        virtual const uint8_t* PeekFrame(size_t& length)
+        {
+            (void)length;
+            return nullptr;
+        }
+
+        virtual void ReleaseFrame() {}
+    };
+
+    struct TransportLinkStats {
+        uint32_t frames_sent;
+        uint32_t frames_received;
+        uint32_t messages_sent;
+        uint32_t messages_received;
+        uint32_t send_failures;     // Frames the link refused
+        uint32_t deferred;          // Sends postponed for lack of bandwidth
+        uint32_t errors;            // Malformed records and broken segment chains
+        uint32_t bytes_sent;        // Frame bytes, for throughput
+        uint32_t bytes_received;
+        uint32_t messages_forwarded;   // Sent on this link by a route (AddRoute())
+        uint32_t latency_max_us;    // Longest a record waited in an unsent frame
+        uint64_t latency_total_us;  // Over frames_sent, for the average
+
+        TransportLinkStats()
+            : frames_sent(0)
+            , frames_received(0)
+            , messages_sent(0)
+            , messages_received(0)
+            , send_failures(0)
+            , deferred(0)
+            , errors(0)
+            , bytes_sent(0)
+            , bytes_received(0)
+            , messages_forwarded(0)
+            , latency_max_us(0)
+            , latency_total_us(0)
+        {}
+    };
+
+    // Location-transparent routing of topics between nodes
+    // Usage Example:
+    //   #include "sensor_messages.h"          // From 'lumos interface generate'
+    //
+    //   Topic<sensor::ImuSample> imu_topic;  // Apps use the topics as usual
+    //   Topic<sensor::Command> command_topic;
+    //
+    //   CanLink<CAN> can_link(CAN1, 0x100, 0x200, true, 1000000);   // transport_links.h
+    //   StreamLink<Serial> uart_link(Serial1, 921600);
+    //   Transport transport;
+    //
+    //   void setup() {
+    //       transport.AddLink(can_link);
+    //       transport.AddLink(uart_link);
+    //       transport.Advertise(imu_topic, 200);        // Sent at up to 200 Hz
+    //       transport.Subscribe(command_topic);         // Published when received
+    //   }
+    //
+    //   void loop() { transport.Poll(GetCurrentTimeUs()); }
+    //
+    // Apps on the same MCU exchange messages through the Topic itself; the
+    // transport only bridges topics to other nodes, so an app does not
+    // change when its peer moves across a bus. Messages are the structs
+    // generated from an interface file (kId, kSize, Serialize(),
+    // Deserialize()) and are identified by their id, which must not be 0.
+    //
+    // A frame holds one or more records: the message id (2 bytes,
+    // little-endian), a length byte and the serialized message. Small
+    // messages due in the same Poll() are batched into one frame; messages
+    // that do not fit are split into numbered segments (the length byte's
+    // top bit is set and a segment byte follows it) and reassembled by the
+    // receiver. Id 0 pads a frame to its end.
+    //
+    // Each advertised topic has a rate; Poll() sends topics in
+    // rate-monotonic order (highest rate first) within each link's
+    // bandwidth, so when a link is saturated the slow topics are deferred
+    // (TransportLinkStats::deferred) and the fast ones keep their rate.
+    // IsFeasible() checks the configured rates against the bandwidth.
+    //
+    // A gateway forwards records between links without knowing their
+    // types: AddRoute() re-queues every record received on one link into
+    // the frames of others, so small messages from several CAN frames
+    // leave in one radio frame, and a message too large for the target's
+    // MTU is reassembled and split again. SetBatchDelay() holds a frame
+    // back to collect more records; latency_max_us shows what it costs.
+    //   transport.AddLink(radio_link);    // Link 0
+    //   transport.AddLink(uart_link);     // Link 1
+    //   transport.AddRoute(0, 1u << 1);   // Radio -> UART
+    //   transport.AddRoute(1, 1u << 0);   // UART -> radio
+    //   transport.SetBatchDelay(0, 2000); // Up to 2 ms to fill a radio frame
+    class Transport
+    {
+    public:
+        static constexpr size_t kMaxLinks = 4;
+        static constexpr size_t kMaxPublications = 16;
+        static constexpr size_t kMaxSubscriptions = 16;
+        static constexpr size_t kMaxFrame = 128;             // Largest supported GetMtu()
+        static constexpr uint32_t kAllLinks = 0xFFFFFFFF;
+
+        Transport();
+
+        // Register a link; false if the table is full or its MTU is outside 8..kMaxFrame
+        bool AddLink(Link& link);
+
+        // Send @p topic to the links in @p link_mask (bit n = n-th AddLink())
+        // whenever it has a new message, at most @p rate_hz times per second
+        // (0 = every Poll() with a new message)
+        template <typename T, size_t Slots>
+        bool Advertise(Topic<T, Slots>& topic, uint32_t rate_hz, uint32_t link_mask = kAllLinks)
+        {
+            static_assert(T::kSize <= LUMOS_TRANSPORT_MAX_MESSAGE, "Message larger than LUMOS_TRANSPORT_MAX_MESSAGE");
+            return AddPublication(T::kId, T::kSize, &topic, &SerializeLatest<T, Slots>,
+                                  &GetTopicSequence<T, Slots>, rate_hz, link_mask);
+        }
+
+        // Publish messages received for @p topic's id into @p topic
+        template <typename T, size_t Slots>
+        bool Subscribe(Topic<T, Slots>& topic)
+        {
+            static_assert(T::kSize <= LUMOS_TRANSPORT_MAX_MESSAGE, "Message larger than LUMOS_TRANSPORT_MAX_MESSAGE");
+            return AddSubscription(T::kId, T::kSize, &topic, &DeliverMessage<T, Slots>,
+                                   &GetTopicSequence<T, Slots>);
+        }
+
+        // Forward every record received on link @p from_link to the links in
+        // @p to_mask (never back to @p from_link), besides delivering it to
+        // local subscribers
+        bool AddRoute(size_t from_link, uint32_t to_mask);
+
+        // Send a partly filled frame on link @p link_index only once its
+        // oldest record has waited @p delay_us (0, the default: every Poll())
+        bool SetBatchDelay(size_t link_index, uint32_t delay_us);
+
+        // Receive from every link, then send what is due; call often
+        void Poll(uint64_t now_us);
+
+        // Hand in a frame received on link @p link_index outside of Poll(),
+        // e.g. from a CAN onReceive() handler
+        void Deliver(size_t link_index, const uint8_t* frame, size_t length);
+
+        // True if the advertised rates fit the bandwidth of link @p link_index
+        bool IsFeasible(size_t link_index) const;
+
+        // Bytes per second the advertised rates need on link @p link_index
+        uint32_t GetRequiredBytesPerSecond(size_t link_index) const;
+
+        const TransportLinkStats* GetStats(size_t link_index) const;
+
+    private:
+        typedef size_t (*SerializeFunction)(void* topic, uint32_t& last_sequence, uint8_t* out);
+        typedef bool (*DeliverFunction)(void* topic, const uint8_t* data, size_t length);
+        typedef uint32_t (*SequenceFunction)(void* topic);
+
+        struct Publication {
+            uint16_t id;
+            uint16_t size;
+            void* topic;
+            SerializeFunction serialize;
+            SequenceFunction sequence;
+            uint32_t rate_hz;
+            uint64_t period_us;
+            uint64_t next_due_us;
+            uint32_t link_mask;
+            uint32_t last_sequence;
+        };
+
+        struct Subscription {
+            uint16_t id;
+            uint16_t size;
+            void* topic;
+            DeliverFunction deliver;
+            SequenceFunction sequence;
+        };
+
+        struct Reassembly {
+            uint16_t id;   // 0 when free
+            size_t link_index;
+            uint8_t next_segment;
+            size_t received;
+            uint8_t data[LUMOS_TRANSPORT_MAX_MESSAGE];
+        };
+
+        struct Channel {
+            Link* link;
+            TransportLinkStats stats;
+            uint8_t frame[kMaxFrame];
+            size_t frame_length;
+            uint64_t budget_bytes;   // Bandwidth accrued since the last send, in bytes x 10^6
+            uint64_t last_poll_us;
+            uint32_t route_mask;     // Links that get the records received here
+            uint32_t batch_delay_us;
+            uint64_t frame_start_us; // When the first record went into frame
+        };
+
+        Channel channels_[kMaxLinks];
+        size_t link_count_;
+        Publication publications_[kMaxPublications];
+        size_t publication_count_;
+        Subscription subscriptions_[kMaxSubscriptions];
+        size_t subscription_count_;
+        Reassembly reassembly_[LUMOS_TRANSPORT_REASSEMBLY];
+        uint8_t staging_[LUMOS_TRANSPORT_MAX_MESSAGE];
+        uint64_t now_us_;   // Time of the running (or last) Poll()
+
+        bool AddPublication(uint16_t id, size_t size, void* topic, SerializeFunction serialize,
+                            SequenceFunction sequence, uint32_t rate_hz, uint32_t link_mask);
+        bool AddSubscription(uint16_t id, size_t size, void* topic, DeliverFunction deliver,
+                             SequenceFunction sequence);
+
+        void AccrueBandwidth(Channel& channel, uint64_t now_us);
+        static size_t GetWireBytes(size_t size, size_t mtu);
+        void Append(Channel& channel, uint16_t id, const uint8_t* data, size_t size);
+        uint8_t* Reserve(Channel& channel, size_t bytes);
+        void Flush(Channel& channel);
+        void Parse(size_t link_index, const uint8_t* frame, size_t length);
+        void Receive(Channel& channel, const Subscription& subscription, const uint8_t* data, size_t length);
+        void ReceiveSegment(size_t link_index, uint16_t id, const Subscription* subscription, const uint8_t* data,
+                            size_t length);
+        void Forward(size_t link_index, uint16_t id, const uint8_t* data, size_t size);
+        Reassembly* FindReassembly(size_t link_index, uint16_t id);
+        const Subscription* FindSubscription(uint16_t id) const;
+
+        template <typename T, size_t Slots>
+        static size_t SerializeLatest(void* topic, uint32_t& last_sequence, uint8_t* out)
+        {
+            auto sample = static_cast<Topic<T, Slots>*>(topic)->Latest();
+            if (!sample || sample.GetSequence() == last_sequence)
+            {
+                return 0;
+            }
+            last_sequence = sample.GetSequence();
+            return sample->Serialize(out);
+        }
+
+        template <typename T, size_t Slots>
+        static bool DeliverMessage(void* topic, const uint8_t* data, size_t length)
+        {
+            Topic<T, Slots>& typed = *static_cast<Topic<T, Slots>*>(topic);
+            auto loan = typed.Loan();
+            if (!loan || !loan->Deserialize(data, length))
+            {
+                return false;
+            }
+            return typed.Publish(std::move(loan));
+        }
+
+        template <typename T, size_t Slots>
+        static uint32_t GetTopicSequence(void* topic)
+        {
+            return static_cast<Topic<T, Slots>*>(topic)->GetSequence();
+        }
+    };
+
+} // namespace Lumos
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Lumos
+{
+
+    // Transport link over one CAN port (the CAN wrapper or anything with
+    // its send()/read() signatures)
+    // Usage Example:
+    //   CAN1.enableFD().begin(1000000);
+    //   CanLink<CAN> can_link(CAN1, 0x100, 0x200, true, 1000000);   // Send 0x100, receive 0x200
+    //   transport.AddLink(can_link);
+    //
+    // Every frame of this node uses @p tx_id, so give each node on the bus
+    // its own id; the lower id wins arbitration, so give the node with the
+    // most urgent traffic the lowest. Receive() reads the port and keeps
+    // frames matching @p rx_id/@p rx_mask, dropping the rest; if the port
+    // is shared, leave Receive() unused and pass the transport's frames to
+    // Transport::Deliver() from an onReceive() handler instead. FD frames
+    // are padded to the next valid length. @p share_percent is the part of
+    // the bus the transport schedules its topics into.
+    template <typename Port>
+    class CanLink : public Link
+    {
+    public:
+        CanLink(Port& port, uint32_t tx_id, uint32_t rx_id, bool fd, uint32_t bitrate = 500000,
+                uint32_t rx_mask = 0x7FF, bool extended = false, uint8_t share_percent = 50)
+            : port_(port)
+            , tx_id_(tx_id)
+            , rx_id_(rx_id)
+            , rx_mask_(rx_mask)
+            , fd_(fd)
+            , extended_(extended)
+            , bitrate_(bitrate)
+            , share_percent_(share_percent)
+        {
+        }
+
+        size_t GetMtu() const override { return fd_ ? 64 : 8; }
+
+        uint32_t GetBytesPerSecond() const override
+        {
+            // Full frames at the nominal bitrate including arbitration, CRC
+            // and stuffing (about 135 bits classic, 620 bits FD without
+            // bit rate switching), so BRS only adds headroom
+            const uint32_t frame_bits = fd_ ? 620 : 135;
+            const uint64_t bytes = static_cast<uint64_t>(bitrate_) * GetMtu() / frame_bits;
+            return static_cast<uint32_t>(bytes * share_percent_ / 100);
+        }
+
+        bool Send(const uint8_t* frame, size_t length) override
+        {
+            uint8_t padded[64];
+            const size_t padded_length = GetFrameLength(length);
+            std::memcpy(padded, frame, length);
+            std::memset(padded + length, 0, padded_length - length);
+            return port_.send(tx_id_, padded, static_cast<uint8_t>(padded_length), extended_);
+        }
+
+        bool Receive(uint8_t* frame, size_t& length) override
+        {
+            uint32_t id;
+            uint8_t frame_length;
+            bool extended;
+            while (port_.read(id, frame, frame_length, extended))
+            {
+                if (extended == extended_ && (id & rx_mask_) == (rx_id_ & rx_mask_))
+                {
+                    length = frame_length;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        Port& port_;
+        uint32_t tx_id_;
+        uint32_t rx_id_;
+        uint32_t rx_mask_;
+        bool fd_;
+        bool extended_;
+        uint32_t bitrate_;
+        uint8_t share_percent_;
+
+        // CAN FD data lengths above 8 bytes: 12, 16, 20, 24, 32, 48, 64
+        static size_t GetFrameLength(size_t length)
+        {
+            static const uint8_t kLengths[] = {12, 16, 20, 24, 32, 48, 64};
+            if (length <= 8)
+            {
+                return length;
+            }
+            for (uint8_t valid : kLengths)
+            {
+                if (length <= valid)
+                {
+                    return valid;
+                }
+            }
+            return 64;
+        }
+    };
+
+    // Transport link over a byte stream: Serial, USB or anything with
+    // write(data, length) and read() returning -1 when empty
+    // Usage Example:
+    //   Serial1.begin(921600);
+    //   StreamLink<Serial> uart_link(Serial1, 921600);
+    //   transport.AddLink(uart_link);
+    //
+    // Frames are COBS-encoded with a CRC-16/CCITT and end in a zero byte,
+    // so a receiver that starts mid-stream or loses bytes resynchronizes at
+    // the next frame. Bandwidth is scheduled from @p baudrate (10 bits per
+    // byte) less the framing overhead; for USB pass the rate to plan for.
+    template <typename Stream, size_t Mtu = 128>
+    class StreamLink : public Link
+    {
+        static_assert(Mtu >= 8 && Mtu <= Transport::kMaxFrame, "StreamLink MTU must be 8..Transport::kMaxFrame");
+
+    public:
+        StreamLink(Stream& stream, uint32_t baudrate, uint8_t share_percent = 80)
+            : stream_(stream)
+            , bytes_per_second_(baudrate / 10)
+            , share_percent_(share_percent)
+            , rx_length_(0)
+            , rx_overflow_(false)
+            , crc_errors_(0)
+        {
+        }
+
+        size_t GetMtu() const override { return Mtu; }
+
+        uint32_t GetBytesPerSecond() const override
+        {
+            // COBS overhead byte, CRC and delimiter per full frame
+            const uint64_t bytes = static_cast<uint64_t>(bytes_per_second_) * Mtu / (Mtu + kFrameOverhead);
+            return static_cast<uint32_t>(bytes * share_percent_ / 100);
+        }
+
+        bool Send(const uint8_t* frame, size_t length) override
+        {
+            uint8_t raw[Mtu + 2];
+            std::memcpy(raw, frame, length);
+            const uint16_t crc = Crc16(frame, length);
+            raw[length] = static_cast<uint8_t>(crc);
+            raw[length + 1] = static_cast<uint8_t>(crc >> 8);
+
+            uint8_t encoded[Mtu + kFrameOverhead];
+            const size_t encoded_length = Encode(raw, length + 2, encoded);
+            encoded[encoded_length] = 0;
+            return stream_.write(encoded, static_cast<uint16_t>(encoded_length + 1));
+        }
+
+        bool Receive(uint8_t* frame, size_t& length) override
+        {
+            int byte;
+            while ((byte = stream_.read()) >= 0)
+            {
+                if (byte != 0)
+                {
+                    if (rx_length_ < sizeof(rx_buffer_))
+                    {
+                        rx_buffer_[rx_length_++] = static_cast<uint8_t>(byte);
+                    }
+                    else
+                    {
+                        rx_overflow_ = true;
+                    }
+                    continue;
+                }
+
+                // End of frame
+                uint8_t raw[Mtu + 2];
+                const size_t raw_length = rx_overflow_ ? 0 : Decode(rx_buffer_, rx_length_, raw);
+                rx_length_ = 0;
+                rx_overflow_ = false;
+                if (raw_length < 3 || raw_length > Mtu + 2)
+                {
+                    continue;   // Empty, truncated or garbled
+                }
+                const uint16_t crc = static_cast<uint16_t>(raw[raw_length - 2] | (raw[raw_length - 1] << 8));
+                if (Crc16(raw, raw_length - 2) != crc)
+                {
+                    crc_errors_++;
+                    continue;
+                }
+                length = raw_length - 2;
+                std::memcpy(frame, raw, length);
+                return true;
+            }
+            return false;
+        }
+
+        // Frames dropped for a bad checksum
+        uint32_t GetCrcErrors() const { return crc_errors_; }
+
+    private:
+        static constexpr size_t kFrameOverhead = 2 + 1 + (Mtu + 2) / 254 + 1;   // CRC, delimiter, COBS
+
+        Stream& stream_;
+        uint32_t bytes_per_second_;
+        uint8_t share_percent_;
+        uint8_t rx_buffer_[Mtu + kFrameOverhead];
+        size_t rx_length_;
+        bool rx_overflow_;
+        uint32_t crc_errors_;
+
+        // Consistent Overhead Byte Stuffing: no zero bytes in the output
+        static size_t Encode(const uint8_t* data, size_t length, uint8_t* out)
+        {
+            size_t code_index = 0;
+            size_t out_index = 1;
+            uint8_t code = 1;
+            for (size_t i = 0; i < length; i++)
+            {
+                if (data[i] == 0)
+                {
+                    out[code_index] = code;
+                    code_index = out_index++;
+                    code = 1;
+                    continue;
+                }
+                out[out_index++] = data[i];
+                if (++code == 0xFF)
+                {
+                    out[code_index] = code;
+                    code_index = out_index++;
+                    code = 1;
+                }
+            }
+            out[code_index] = code;
+            return out_index;
+        }
+
+        // Returns 0 for malformed input
+        static size_t Decode(const uint8_t* data, size_t length, uint8_t* out)
+        {
+            size_t in_index = 0;
+            size_t out_index = 0;
+            while (in_index < length)
+            {
+                const uint8_t code = data[in_index++];
+                if (code == 0 || in_index + code - 1 > length || out_index + code - 1 > Mtu + 2)
+                {
+                    return 0;
+                }
+                for (uint8_t i = 1; i < code; i++)
+                {
+                    out[out_index++] = data[in_index++];
+                }
+                if (code != 0xFF && in_index < length)
+                {
+                    if (out_index >= Mtu + 2)
+                    {
+                        return 0;
+                    }
+                    out[out_index++] = 0;
+                }
+            }
+            return out_index;
+        }
+
+        // CRC-16/CCITT-FALSE
+        static uint16_t Crc16(const uint8_t* data, size_t length)
+        {
+            uint16_t crc = 0xFFFF;
+            for (size_t i = 0; i < length; i++)
+            {
+                crc ^= static_cast<uint16_t>(data[i]) << 8;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+                }
+            }
+            return crc;
+        }
+    };
+
+    // Transport link over a packet radio: the SX1281 driver or anything
+    // with send(data, length), peek(length) and release()
+    // Usage Example:
+    //   beginRadio(SX1281::Config::flrc());   // sx1281_module
+    //   radio.startReceive();
+    //   RadioLink<SX1281> radio_link(radio, 975000);   // FLRC 1.3 Mb/s, CR 3/4
+    //   transport.AddLink(radio_link);
+    //
+    // Received packets are parsed where the driver put them (PeekFrame()),
+    // so a gateway copies a record once, into the outgoing frame. Every
+    // node on the channel receives every frame, and the radio is half
+    // duplex: @p share_percent of @p bitrate (the data rate after coding)
+    // is what this node schedules, so split the channel between the nodes.
+    // Each frame also pays for preamble, sync word, header, CRC and the
+    // TX/RX turnaround.
+    template <typename Radio, size_t Mtu = 127>
+    class RadioLink : public Link
+    {
+        static_assert(Mtu >= 8 && Mtu <= Transport::kMaxFrame, "RadioLink MTU must be 8..Transport::kMaxFrame");
+
+    public:
+        RadioLink(Radio& radio, uint32_t bitrate, uint8_t share_percent = 50)
+            : radio_(radio)
+            , bitrate_(bitrate)
+            , share_percent_(share_percent)
+        {
+        }
+
+        size_t GetMtu() const override { return Mtu; }
+
+        uint32_t GetBytesPerSecond() const override
+        {
+            const uint64_t bytes = static_cast<uint64_t>(bitrate_ / 8) * Mtu / (Mtu + kFrameOverhead);
+            return static_cast<uint32_t>(bytes * share_percent_ / 100);
+        }
+
+        bool Send(const uint8_t* frame, size_t length) override
+        {
+            return radio_.send(frame, static_cast<uint16_t>(length));
+        }
+
+        const uint8_t* PeekFrame(size_t& length) override
+        {
+            uint8_t packet_length = 0;
+            const uint8_t* packet = radio_.peek(packet_length);
+            while (packet != nullptr && packet_length > Mtu)
+            {
+                radio_.release();   // From a node with a larger MTU
+                packet = radio_.peek(packet_length);
+            }
+            length = packet_length;
+            return packet;
+        }
+
+        void ReleaseFrame() override { radio_.release(); }
+
+    private:
+        // Preamble, sync word, header and CRC (about 10 bytes) and roughly
+        // as much again for switching between RX and TX
+        static constexpr size_t kFrameOverhead = 20;
+
+        Radio& radio_;
+        uint32_t bitrate_;
+        uint8_t share_percent_;
+    };
+
+} // namespace Lumos
@@ -0,0 +1,175 @@
+#include "async_serial.h"
+
+namespace SimpleSerial {
+
+namespace {
+
+// Upper bound on an idle wait; WakeUp() cuts it short for new writes
+constexpr int IDLE_WAIT_MS = 100;
+constexpr size_t IO_CHUNK = 4096;
+
+} // namespace
+
+AsyncSerial::AsyncSerial(size_t buffer_size)
+    : running_(false)
+    , tx_(buffer_size)
+    , rx_(buffer_size)
+    , completions_(256)
+    , tx_queued_(0)
+    , tx_sent_(0)
+    , ignore_reply_at_(0)
+    , dropped_(0)
+{
+}
+
+AsyncSerial::~AsyncSerial() {
+    Close();
+}
+
+bool AsyncSerial::Open(const std::string& port_name, const SerialConfig& config) {
+    if (running_) {
+        last_error_ = "Serial port already open";
+        return false;
+    }
+
+    if (!serial_.Open(port_name, config)) {
+        last_error_ = serial_.GetLastError();
+        return false;
+    }
+
+    Reset();
+    last_error_.clear();
+    running_ = true;
+    io_thread_ = std::thread(&AsyncSerial::IoThreadFunc, this);
+    return true;
+}
+
+void AsyncSerial::Close() {
+    running_ = false;
+    if (io_thread_.joinable()) {
+        serial_.WakeUp();
+        io_thread_.join();
+    }
+    serial_.Close();
+    Reset();
+}
+
+void AsyncSerial::Reset() {
+    // Nothing runs on either side of the rings now
+    tx_.Clear();
+    rx_.Clear();
+    completions_.Clear();
+    tx_queued_ = 0;
+    tx_sent_ = 0;
+    ignore_reply_at_ = 0;
+    dropped_ = 0;
+}
+
+bool AsyncSerial::AsyncWrite(const uint8_t* data, size_t length, WriteCallback done) {
+    if (!running_) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    // Reserve the completion slot first so a full completion ring can't
+    // leave bytes queued without their callback
+    if (done && completions_.Size() == completions_.Capacity()) {
+        return false;
+    }
+    if (!tx_.PushAll(data, length)) {
+        return false;
+    }
+    tx_queued_ += length;
+    if (done) {
+        PendingWrite pending;
+        pending.end = tx_queued_;
+        pending.done = std::move(done);
+        completions_.Push(std::move(pending));
+    }
+
+    serial_.WakeUp();
+    return true;
+}
+
+std::string AsyncSerial::GetLastError() const {
+    // The I/O thread only sets last_error_ right before it exits
+    return running_ ? std::string() : last_error_;
+}
+
+bool AsyncSerial::Transmit() {
+    // One chunk per pass, so a long write can't starve the receive side
+    uint8_t chunk[IO_CHUNK];
+    const size_t length = tx_.Pop(chunk, sizeof(chunk));
+    size_t offset = 0;
+    while (offset < length) {
+        int n = serial_.Write(chunk + offset, length - offset);
+        if (n <= 0) {
+            return false;
+        }
+        offset += n;
+    }
+    tx_sent_ += length;
+    return true;
+}
+
+void AsyncSerial::CompleteWrites(bool success) {
+    PendingWrite* pending;
+    while ((pending = completions_.Front()) != nullptr && (!success || pending->end <= tx_sent_)) {
+        PendingWrite finished;
+        completions_.Pop(finished);
+        finished.done(success);
+    }
+}
+
+void AsyncSerial::IoThreadFunc() {
+    uint8_t buffer[IO_CHUNK];
+
+    while (running_) {
+        if (!Transmit()) {
+            last_error_ = "Write failed: " + serial_.GetLastError();
+            break;
+        }
+        // Completions may be published after their bytes went out
+        CompleteWrites(true);
+        uint64_t ignore_at = ignore_reply_at_.load();
+        if (ignore_at != 0 && tx_sent_ >= ignore_at) {
+            serial_.IgnoreNextReply();
+            ignore_reply_at_.compare_exchange_strong(ignore_at, 0);
+        }
+
+        // Sleep until data arrives or AsyncWrite()/Close() wakes us; only
+        // check for input if there is more to transmit
+        int ready = serial_.WaitForData(tx_.Size() > 0 ? 0 : IDLE_WAIT_MS);
+        if (ready < 0) {
+            last_error_ = serial_.GetLastError();
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        int bytes_read = serial_.Read(buffer, sizeof(buffer), 0);
+        if (bytes_read < 0) {
+            last_error_ = serial_.GetLastError();
+            break;
+        }
+        if (bytes_read == 0) {
+            continue;
+        }
+
+        if (data_callback_) {
+            data_callback_(buffer, bytes_read);
+        } else if (!rx_.PushAll(buffer, bytes_read)) {
+            dropped_ += bytes_read;
+        }
+    }
+
+    // Fail whatever is still queued; CompleteWrites only touches writes
+    // whose callbacks were published before this point
+    running_ = false;
+    CompleteWrites(false);
+}
+
+} // namespace SimpleSerial
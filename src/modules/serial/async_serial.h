@@ -0,0 +1,145 @@
+#pragma once
+
+#include "serial.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Serial port driven by a dedicated I/O thread
+ *
+ * Writes are queued into a lock-free ring and transmitted by the I/O
+ * thread; received data is either handed to a callback on the I/O thread
+ * or buffered in a second ring for Read(). No mutex is taken per call.
+ *
+ * Each ring has exactly one producer and one consumer: AsyncWrite() must
+ * be called from one thread at a time, and so must Read().
+ */
+class AsyncSerial {
+public:
+    /** Received data, called on the I/O thread */
+    using DataCallback = std::function<void(const uint8_t* data, size_t length)>;
+
+    /** Write completion, called on the I/O thread once the bytes left the host */
+    using WriteCallback = std::function<void(bool success)>;
+
+    /**
+     * @param buffer_size Capacity of each of the TX and RX rings in bytes
+     */
+    explicit AsyncSerial(size_t buffer_size = 64 * 1024);
+    ~AsyncSerial();
+
+    AsyncSerial(const AsyncSerial&) = delete;
+    AsyncSerial& operator=(const AsyncSerial&) = delete;
+
+    /**
+     * @brief Open the port and start the I/O thread
+     * @param port_name Name of the serial port (e.g., "/dev/ttyUSB0", "COM3")
+     * @param config Serial port configuration
+     * @return true if successful, false otherwise
+     */
+    bool Open(const std::string& port_name, const SerialConfig& config = SerialConfig());
+
+    /**
+     * @brief Stop the I/O thread and close the port
+     *
+     * Pending writes are abandoned and complete with success = false.
+     * Both rings are emptied, so a reopened port starts without the
+     * previous connection's bytes.
+     */
+    void Close();
+
+    bool IsOpen() const { return running_; }
+
+    /**
+     * @brief Deliver received data to @p callback instead of buffering it
+     *
+     * Must be called before Open(). The callback runs on the I/O thread and
+     * should return quickly; while it runs, nothing else is transmitted.
+     */
+    void AsyncRead(DataCallback callback) { data_callback_ = std::move(callback); }
+
+    /**
+     * @brief Queue bytes for transmission
+     * @param data Bytes to send (copied)
+     * @param length Number of bytes
+     * @param done Optional completion callback
+     * @return false if the port is closed or the TX ring lacks room
+     *         (nothing is queued and @p done is not called)
+     */
+    bool AsyncWrite(const uint8_t* data, size_t length, WriteCallback done = nullptr);
+
+    bool AsyncWrite(const std::string& str, WriteCallback done = nullptr)
+    {
+        return AsyncWrite(reinterpret_cast<const uint8_t*>(str.data()), str.size(), std::move(done));
+    }
+
+    /**
+     * @brief Take buffered received data (when no AsyncRead callback is set)
+     * @return Number of bytes copied, 0 if nothing is buffered
+     */
+    size_t Read(uint8_t* buffer, size_t max_length) { return rx_.Pop(buffer, max_length); }
+
+    /** Bytes buffered for Read() */
+    size_t Available() const { return rx_.Size(); }
+
+    /** Received bytes dropped because Read() did not keep up */
+    size_t GetDroppedBytes() const { return dropped_; }
+
+    /**
+     * @brief Pulse DTR to reset the MCU (see Serial::PulseDTR())
+     *
+     * Only touches the modem lines, so it may run next to the I/O thread.
+     */
+    bool PulseDTR(int duration_ms = 100, bool active_low = true) { return serial_.PulseDTR(duration_ms, active_low); }
+
+    /**
+     * @brief Don't count the reply to the bytes queued so far as a round
+     * trip (e.g. an ACK that waits for a flash erase); from the thread
+     * that calls AsyncWrite()
+     */
+    void IgnoreNextReply() { ignore_reply_at_ = tx_queued_; }
+
+    /** Write-to-reply times measured by the I/O thread since Open() */
+    const RoundTripStats& GetRoundTrip() const { return serial_.GetRoundTrip(); }
+
+    bool IsLowLatency() const { return serial_.IsLowLatency(); }
+
+    /**
+     * @brief Last error reported by Open() or the I/O thread
+     */
+    std::string GetLastError() const;
+
+private:
+    struct PendingWrite {
+        uint64_t end = 0;  // tx byte count at which this write is complete
+        WriteCallback done;
+    };
+
+    void Reset();
+    void IoThreadFunc();
+    bool Transmit();
+    void CompleteWrites(bool success);
+
+    Serial serial_;
+    std::thread io_thread_;
+    std::atomic<bool> running_;
+    DataCallback data_callback_;
+
+    SpscRing<uint8_t> tx_;
+    SpscRing<uint8_t> rx_;
+    SpscRing<PendingWrite> completions_;
+    uint64_t tx_queued_;           // producer side only
+    uint64_t tx_sent_;             // I/O thread only
+    std::atomic<uint64_t> ignore_reply_at_;  // tx_queued_ at IgnoreNextReply(), 0 = none
+    std::atomic<size_t> dropped_;
+
+    std::string last_error_;       // written before running_ is cleared
+};
+
+} // namespace SimpleSerial
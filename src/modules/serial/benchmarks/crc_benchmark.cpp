@@ -0,0 +1,85 @@
+/**
+ * @file crc_benchmark.cpp
+ * @brief Throughput of the host-side bootloader checksums
+ *
+ * Compares checksumming an image the way the flasher used to (CRC16 per
+ * chunk, then a second CRC16 pass over the whole image for END) with
+ * Crc16Chunk(), which advances the image CRC in the same pass, and the
+ * slice-by-8 CRC32 used for the post-flash verify.
+ *
+ * Usage: crc_benchmark [size_kb] [iterations] [chunk_size]
+ */
+
+#include "crc32.h"
+#include "lumos_bootloader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+using SimpleSerial::LumosBootloader;
+
+static double MeasureMBps(size_t bytes, int iterations, const std::function<uint32_t()>& fn,
+                          uint32_t& sink)
+{
+    sink ^= fn();  // warm up tables and caches
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        sink ^= fn();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (static_cast<double>(bytes) * iterations) / (seconds * 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t size_kb    = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2048;
+    const int    iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+    const size_t chunk      = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1024;
+
+    std::vector<uint8_t> image(size_kb * 1024);
+    std::mt19937 rng(42);
+    for (auto& b : image) {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    // Per-chunk CRCs followed by a full second pass for the END packet
+    auto two_pass = [&]() -> uint32_t {
+        uint32_t acc = 0;
+        for (size_t off = 0; off < image.size(); off += chunk) {
+            const auto n = static_cast<uint32_t>(std::min(chunk, image.size() - off));
+            acc ^= LumosBootloader::Crc16(image.data() + off, n);
+        }
+        return acc ^ LumosBootloader::Crc16(image.data(), static_cast<uint32_t>(image.size()));
+    };
+
+    // Per-chunk CRCs with the image CRC advanced in the same pass
+    auto running = [&]() -> uint32_t {
+        uint32_t acc = 0;
+        uint16_t image_crc = 0;
+        for (size_t off = 0; off < image.size(); off += chunk) {
+            const auto n = static_cast<uint32_t>(std::min(chunk, image.size() - off));
+            acc ^= LumosBootloader::Crc16Chunk(image.data() + off, n, image_crc);
+        }
+        return acc ^ image_crc;
+    };
+
+    if (two_pass() != running()) {
+        std::fprintf(stderr, "Running image CRC does not match the full pass\n");
+        return 1;
+    }
+
+    uint32_t sink = 0;
+    std::printf("%zu KB image, %zu byte chunks, %d iterations\n", size_kb, chunk, iterations);
+    std::printf("  crc16 chunks + image pass : %8.1f MB/s\n",
+                MeasureMBps(image.size(), iterations, two_pass, sink));
+    std::printf("  crc16 single pass         : %8.1f MB/s\n",
+                MeasureMBps(image.size(), iterations, running, sink));
+    std::printf("  crc32 slice-by-8          : %8.1f MB/s\n",
+                MeasureMBps(image.size(), iterations,
+                            [&] { return SimpleSerial::Crc32(image.data(), image.size()); }, sink));
+    return sink == 0xFFFFFFFF ? 2 : 0;  // keep results observable
+}
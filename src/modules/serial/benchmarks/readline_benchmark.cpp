@@ -0,0 +1,116 @@
+/**
+ * @file readline_benchmark.cpp
+ * @brief Lines per second through Serial::ReadLine on a pseudo-terminal
+ *
+ * A writer thread feeds log-style lines into the master side of a pty;
+ * the slave is opened with Serial and read back either one byte per
+ * Read() call (how ReadUntil used to work) or with the buffered
+ * ReadLine(), which pulls whole blocks and scans them with memchr.
+ *
+ * POSIX only. Usage: readline_benchmark [lines] [line_length]
+ */
+
+#include "serial.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using SimpleSerial::Serial;
+
+// ReadLine as it was before the read-ahead buffer: a Read() per byte
+static bool ReadLineBytewise(Serial& serial, std::string& line, size_t max_length)
+{
+    line.clear();
+    size_t taken = 0;
+    uint8_t byte;
+    while (taken < max_length && serial.Read(&byte, 1) > 0) {
+        taken++;
+        if (byte == '\n') {
+            break;
+        }
+        line.push_back(static_cast<char>(byte));
+    }
+    while (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    return taken > 0;
+}
+
+static double Run(const char* name, size_t lines, size_t length, bool buffered)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::perror("posix_openpt");
+        std::exit(1);
+    }
+
+    Serial serial;
+    SimpleSerial::SerialConfig config;
+    config.timeout_ms = 1000;
+    if (!serial.Open(ptsname(master), config)) {
+        std::fprintf(stderr, "%s\n", serial.GetLastError().c_str());
+        std::exit(1);
+    }
+
+    std::string text(length - 2, 'x');
+    text += "\r\n";
+    std::string block;
+    for (int i = 0; i < 64; i++) {
+        block += text;
+    }
+
+    std::thread writer([&]() {
+        size_t sent = 0;
+        while (sent < lines) {
+            const size_t count = std::min<size_t>(64, lines - sent);
+            size_t offset = 0;
+            const size_t bytes = count * text.size();
+            while (offset < bytes) {
+                ssize_t n = write(master, block.data() + offset, bytes - offset);
+                if (n <= 0) {
+                    return;
+                }
+                offset += static_cast<size_t>(n);
+            }
+            sent += count;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    size_t received = 0;
+    std::string line;
+    while (received < lines) {
+        bool ok = buffered ? serial.ReadLine(line, 1024) : ReadLineBytewise(serial, line, 1024);
+        if (!ok) {
+            break;
+        }
+        received++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Closing both ends first also releases a writer stuck on a short read
+    serial.Close();
+    close(master);
+    writer.join();
+
+    double rate = received / seconds;
+    std::printf("%-10s %8zu lines  %6.3f s  %10.0f lines/s\n", name, received, seconds, rate);
+    return rate;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t lines  = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+    const size_t length = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+
+    std::printf("%zu lines of %zu bytes\n\n", lines, length);
+    double bytewise = Run("bytewise", lines, length, false);
+    double buffered = Run("buffered", lines, length, true);
+    std::printf("\nspeedup: %.1fx\n", buffered / bytewise);
+    return 0;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Byte stream from one producer to any number of readers
+ *
+ * The producer never waits: Write() copies into the ring and moves the
+ * head on, overwriting the oldest bytes whether or not every reader has
+ * had them. Each Reader keeps its own cursor, so a reader that stalls
+ * (a GUI repainting, a file on a slow disk) loses the bytes it fell more
+ * than Capacity() behind on and counts them in GetDropped(), while the
+ * port keeps being drained and the other readers see every byte.
+ *
+ * A reader copies first and checks afterwards that the producer had not
+ * started overwriting what it copied, as a seqlock does: the producer
+ * announces the end of each write in reserve_ before touching the bytes.
+ * The capacity is rounded up to a power of two.
+ */
+class BroadcastRing {
+public:
+    class Reader;
+
+    explicit BroadcastRing(size_t capacity)
+        : buffer_(RoundUp(capacity))
+        , mask_(buffer_.size() - 1)
+        , head_(0)
+        , reserve_(0)
+        , readers_(0)
+        , waiters_(0)
+        , closed_(false)
+    {
+    }
+
+    BroadcastRing(const BroadcastRing&) = delete;
+    BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+    size_t Capacity() const { return buffer_.size(); }
+
+    /** Bytes written since construction */
+    uint64_t GetWritten() const { return head_.load(std::memory_order_acquire); }
+
+    /** Readers attached right now (a snapshot) */
+    size_t GetReaderCount() const { return readers_.load(std::memory_order_acquire); }
+
+    // ── Producer ────────────────────────────────────────────────────────────
+
+    /**
+     * @brief Append @p length bytes, overwriting the oldest if needed
+     *
+     * Of a write longer than the ring only the last Capacity() bytes are
+     * kept. Takes the wait mutex only while a reader sleeps in Wait().
+     */
+    void Write(const uint8_t* data, size_t length)
+    {
+        if (length == 0) {
+            return;
+        }
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        const uint64_t end = head + length;
+        reserve_.store(end, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const size_t kept = std::min(length, buffer_.size());
+        const size_t start = static_cast<size_t>(end - kept) & mask_;
+        const size_t first = std::min(kept, buffer_.size() - start);
+        data += length - kept;
+        std::memcpy(&buffer_[start], data, first);
+        std::memcpy(&buffer_[0], data + first, kept - first);
+
+        head_.store(end, std::memory_order_release);
+        WakeReaders();
+    }
+
+    /** Wake every waiting reader for good, e.g. when the stream ends */
+    void Close()
+    {
+        closed_.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        wake_.notify_all();
+    }
+
+    /** Undo Close() before the stream starts again */
+    void Reopen() { closed_.store(false, std::memory_order_release); }
+
+    bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+    // ── Consumer ────────────────────────────────────────────────────────────
+
+    /**
+     * @brief One reader's cursor into the ring
+     *
+     * Starts at the bytes written after it was made. Each Reader is used
+     * by one thread at a time; any number of them read concurrently.
+     */
+    class Reader {
+    public:
+        explicit Reader(BroadcastRing& ring)
+            : ring_(ring)
+            , cursor_(ring.head_.load(std::memory_order_acquire))
+            , dropped_(0)
+        {
+            ring_.readers_.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        ~Reader() { ring_.readers_.fetch_sub(1, std::memory_order_acq_rel); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        /** Bytes written that this reader has not taken yet, up to Capacity() */
+        size_t Available() const
+        {
+            const uint64_t behind = ring_.head_.load(std::memory_order_acquire) - cursor_;
+            return static_cast<size_t>(std::min<uint64_t>(behind, ring_.buffer_.size()));
+        }
+
+        /** @return Number of bytes copied into @p data (at most @p max), without waiting */
+        size_t Read(uint8_t* data, size_t max)
+        {
+            const uint64_t capacity = ring_.buffer_.size();
+            for (;;) {
+                const uint64_t head = ring_.head_.load(std::memory_order_acquire);
+                if (head - cursor_ > capacity) {
+                    Skip(head - capacity - cursor_);
+                }
+                const size_t count = static_cast<size_t>(std::min<uint64_t>(max, head - cursor_));
+                if (count == 0) {
+                    return 0;
+                }
+                const size_t start = static_cast<size_t>(cursor_) & ring_.mask_;
+                const size_t first = std::min(count, ring_.buffer_.size() - start);
+                std::memcpy(data, &ring_.buffer_[start], first);
+                std::memcpy(data + first, &ring_.buffer_[0], count - first);
+
+                // Whatever lies behind the write in progress was intact
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const uint64_t reserve = ring_.reserve_.load(std::memory_order_relaxed);
+                const uint64_t oldest = reserve > capacity ? reserve - capacity : 0;
+                const size_t torn = static_cast<size_t>(std::min<uint64_t>(
+                    count, oldest > cursor_ ? oldest - cursor_ : 0));
+                Skip(torn);
+                if (torn < count) {
+                    std::memmove(data, data + torn, count - torn);
+                    cursor_ += count - torn;
+                    return count - torn;
+                }
+                // All of it was overwritten meanwhile; take what is there now
+            }
+        }
+
+        /**
+         * @brief Read(), sleeping up to @p timeout_ms until there is something
+         * @return Bytes copied; 0 on timeout or once the ring is closed and drained
+         */
+        size_t Wait(uint8_t* data, size_t max, int timeout_ms)
+        {
+            size_t count = Read(data, max);
+            if (count > 0 || ring_.IsClosed()) {
+                return count;
+            }
+            {
+                std::unique_lock<std::mutex> lock(ring_.wait_mutex_);
+                ring_.waiters_.fetch_add(1, std::memory_order_seq_cst);
+                ring_.wake_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] {
+                    return ring_.head_.load(std::memory_order_seq_cst) != cursor_ || ring_.IsClosed();
+                });
+                ring_.waiters_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            return Read(data, max);
+        }
+
+        /** Skip what has been written so far, e.g. stale replies before a command */
+        void Discard() { cursor_ = ring_.head_.load(std::memory_order_acquire); }
+
+        /** Bytes overwritten before this reader took them; any thread may ask */
+        uint64_t GetDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        void Skip(uint64_t count)
+        {
+            cursor_ += count;
+            // Only the reading thread writes it, so no read-modify-write
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        }
+
+        BroadcastRing& ring_;
+        uint64_t cursor_;
+        std::atomic<uint64_t> dropped_;
+    };
+
+private:
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    void WakeReaders()
+    {
+        // Pairs with the waiter's increment before it checks head_
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            wake_.notify_all();
+        }
+    }
+
+    std::vector<uint8_t> buffer_;
+    const size_t mask_;
+
+    // Free-running byte counts, written by the producer only: head_ ends
+    // the bytes readers may take, reserve_ the write in progress
+    alignas(64) std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> reserve_;
+
+    alignas(64) std::atomic<size_t> readers_;
+    std::atomic<int> waiters_;
+    std::atomic<bool> closed_;
+    std::mutex wait_mutex_;
+    std::condition_variable wake_;
+};
+
+} // namespace SimpleSerial
@@ -0,0 +1,65 @@
+#include "crc32.h"
+
+namespace SimpleSerial {
+
+namespace {
+
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+        // table[k][i]: CRC of byte i followed by k zero bytes
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                const uint32_t prev = table[k - 1][i];
+                table[k][i] = (prev >> 8) ^ table[0][prev & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables& Tables()
+{
+    static const Crc32Tables tables;
+    return tables;
+}
+
+} // namespace
+
+uint32_t Crc32(const uint8_t* data, size_t length, uint32_t crc)
+{
+    const auto& t = Tables().table;
+    crc = ~crc;
+
+    while (length >= 8) {
+        const uint32_t lo = crc ^ (static_cast<uint32_t>(data[0]) |
+                                   static_cast<uint32_t>(data[1]) << 8 |
+                                   static_cast<uint32_t>(data[2]) << 16 |
+                                   static_cast<uint32_t>(data[3]) << 24);
+        const uint32_t hi = static_cast<uint32_t>(data[4]) |
+                            static_cast<uint32_t>(data[5]) << 8 |
+                            static_cast<uint32_t>(data[6]) << 16 |
+                            static_cast<uint32_t>(data[7]) << 24;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+              t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+              t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+}
+
+} // namespace SimpleSerial
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SimpleSerial {
+
+/**
+ * @brief CRC-32 (ISO-HDLC, as used by zlib/Ethernet) using slice-by-8
+ *
+ * Matches the STM32 hardware CRC unit configured with the default
+ * polynomial, byte-wise input reversal, output reversal and a final
+ * inversion. Processes eight bytes per table round.
+ *
+ * @param data Input bytes
+ * @param length Number of bytes
+ * @param crc Result of a previous call to continue a running CRC (0 to start)
+ * @return Updated CRC
+ */
+uint32_t Crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+} // namespace SimpleSerial
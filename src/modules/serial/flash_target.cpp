@@ -0,0 +1,303 @@
+#include "flash_target.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+namespace SimpleSerial {
+
+std::vector<FlashSector> FlashTarget::GetSectorLayout(uint16_t pid, uint32_t flash_kb) {
+    std::vector<FlashSector> layout;
+    auto add = [&layout](uint32_t address, uint32_t size, uint16_t first, int count) {
+        for (int i = 0; i < count; i++) {
+            layout.push_back({address + i * size, size, static_cast<uint16_t>(first + i)});
+        }
+    };
+
+    switch (pid) {
+        case 0x483:  // STM32H72x/H73x: 128 KB sectors, one bank (1 MB unless told)
+            add(0x08000000, 128 * 1024, 0, flash_kb != 0 ? static_cast<int>(flash_kb / 128) : 8);
+            break;
+        case 0x467:  // STM32G0Bx/G0Cx: 2 KB pages in two banks, bank 2 numbered from 256
+            if (flash_kb == 0) {
+                // Without the size only the first 64 KB is known to be bank 1
+                add(0x08000000, 2 * 1024, 0, 32);
+            } else {
+                const uint32_t bank = flash_kb * 1024 / 2;
+                add(0x08000000, 2 * 1024, 0, static_cast<int>(bank / 2048));
+                add(0x08000000 + bank, 2 * 1024, 256, static_cast<int>(bank / 2048));
+            }
+            break;
+        case 0x484:  // STM32H52x/H53x: 8 KB sectors in two banks (512 KB unless told)
+        case 0x474:  // STM32H503: the same, 128 KB
+        case 0x480:  // STM32H56x/H57x: the same, 2 MB
+        {
+            uint32_t kb = flash_kb;
+            if (kb == 0) {
+                kb = pid == 0x474 ? 128 : (pid == 0x480 ? 2048 : 512);
+            }
+            // The ROM bootloader numbers the sectors of both banks in one run
+            add(0x08000000, 8 * 1024, 0, static_cast<int>(kb / 8));
+            break;
+        }
+        default:
+            break;
+    }
+    return layout;
+}
+
+bool FlashTarget::ReadSectorLayout(uint16_t& pid, std::vector<FlashSector>& layout) {
+    layout.clear();
+    pid = 0;
+    if (!GetProductId(pid)) {
+        return false;
+    }
+
+    // Flash size in KB, from the part's flash size data register
+    uint32_t size_address = 0;
+    switch (pid) {
+        case 0x483: size_address = 0x1FF1E880; break;
+        case 0x467: size_address = 0x1FFF75E0; break;
+        case 0x474:
+        case 0x480:
+        case 0x484: size_address = 0x08FFF80C; break;
+        default: break;
+    }
+    uint32_t flash_kb = 0;
+    uint8_t size[2];
+    if (size_address != 0 && ReadMemory(size_address, size, sizeof(size))) {
+        flash_kb = static_cast<uint32_t>(size[0] | (size[1] << 8));
+        if (flash_kb == 0xFFFF) {
+            flash_kb = 0;
+        }
+    }
+    layout = GetSectorLayout(pid, flash_kb);
+    return !layout.empty();
+}
+
+bool FlashTarget::FlashRanges(const std::vector<const FirmwareData*>& ranges, bool delta) {
+    size_t image_size = 0;
+    for (const FirmwareData* range : ranges) {
+        image_size += range->Size();
+    }
+    if (ranges.empty() || image_size == 0) {
+        SetError("Firmware data is empty");
+        return false;
+    }
+
+    uint16_t pid = 0;
+    std::vector<FlashSector> layout;
+    ReadSectorLayout(pid, layout);
+
+    // Sectors covered by the ranges; all of them must lie in known sectors
+    std::vector<FlashSector> sectors;
+    bool known = !layout.empty();
+    for (const FirmwareData* range : ranges) {
+        const uint32_t range_start = range->start_address;
+        const uint32_t range_end = range_start + static_cast<uint32_t>(range->Size());
+        uint32_t covered = range_start;
+        for (const auto& sector : layout) {
+            if (sector.address + sector.size <= range_start || sector.address >= range_end) {
+                continue;
+            }
+            if (sector.address > covered) {
+                break;
+            }
+            // Ranges sharing a sector must not erase it twice
+            if (sectors.empty() || sectors.back().address < sector.address) {
+                sectors.push_back(sector);
+            }
+            covered = sector.address + sector.size;
+        }
+        known = known && covered >= range_end;
+    }
+
+    if (!known) {
+        char id[8];
+        snprintf(id, sizeof(id), "0x%03X", pid);
+        if (preserved_size_ > 0) {
+            char range[64];
+            snprintf(range, sizeof(range), "0x%08X-0x%08X", preserved_address_,
+                     preserved_address_ + preserved_size_);
+            SetError(std::string("Sector layout unknown for product ID ") + id +
+                     ": a full erase would wipe the settings at " + range);
+            return false;
+        }
+        std::cout << "Sector layout unknown for product ID " << id
+                  << ", flashing full image" << std::endl;
+        std::cout << "Erasing flash memory..." << std::endl;
+        if (!EraseMemory(true)) {
+            SetError("Failed to erase memory");
+            return false;
+        }
+        size_t written = 0;
+        for (const FirmwareData* range : ranges) {
+            if (!WriteImage(range->start_address, range->Bytes(), range->Size(), false,
+                            written, image_size)) {
+                return false;
+            }
+        }
+        std::cout << "\nFlashing completed successfully!" << std::endl;
+        return true;
+    }
+
+    // The part of each range that falls into a sector
+    auto for_each_part = [&ranges](const FlashSector& sector,
+                                   const std::function<bool(uint32_t, const uint8_t*, size_t)>& part) {
+        for (const FirmwareData* range : ranges) {
+            const uint32_t range_start = range->start_address;
+            const uint32_t range_end = range_start + static_cast<uint32_t>(range->Size());
+            const uint32_t begin = std::max(sector.address, range_start);
+            const uint32_t end = std::min(sector.address + sector.size, range_end);
+            if (begin < end && !part(begin, range->Bytes() + (begin - range_start), end - begin)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Compare each sector's share of the image with the flash contents
+    std::vector<FlashSector> changed;
+    if (delta) {
+        std::cout << "Comparing " << sectors.size() << " sectors with flash contents..." << std::endl;
+        if (!PrepareReadBack(sectors)) {
+            return false;
+        }
+        const size_t CHUNK_SIZE = 256;
+        uint8_t current[CHUNK_SIZE];
+        for (const auto& sector : sectors) {
+            bool differs = false;
+            bool ok = for_each_part(sector, [&](uint32_t begin, const uint8_t* data, size_t length) {
+                for (size_t offset = 0; offset < length && !differs; offset += CHUNK_SIZE) {
+                    const size_t chunk = std::min(CHUNK_SIZE, length - offset);
+                    const uint32_t address = begin + static_cast<uint32_t>(offset);
+                    if (!ReadMemory(address, current, chunk)) {
+                        SetError("Failed to read memory at address 0x" + std::to_string(address));
+                        return false;
+                    }
+                    differs = memcmp(current, data + offset, chunk) != 0;
+                }
+                return true;
+            });
+            if (!ok) {
+                return false;
+            }
+            if (differs) {
+                changed.push_back(sector);
+            }
+        }
+
+        if (changed.empty()) {
+            std::cout << "Flash contents unchanged, nothing to write" << std::endl;
+            return true;
+        }
+    } else {
+        changed = sectors;
+    }
+
+    // Sectors erased ahead of the image read back blank and differ, but
+    // need no second erase
+    std::vector<FlashSector> erase;
+    for (const auto& sector : changed) {
+        if (std::find(erased_ahead_.begin(), erased_ahead_.end(), sector.address) == erased_ahead_.end()) {
+            erase.push_back(sector);
+        }
+    }
+    erased_ahead_.clear();
+    if (erase.size() < changed.size()) {
+        std::cout << "Erasing " << erase.size() << " more of " << sectors.size() << " sectors ("
+                  << changed.size() - erase.size() << " erased ahead)..." << std::endl;
+    } else {
+        std::cout << "Erasing " << changed.size() << " of " << sectors.size() << " sectors..." << std::endl;
+    }
+    if (!EraseSectors(erase)) {
+        SetError("Failed to erase sectors");
+        return false;
+    }
+
+    size_t total = 0;
+    for (const auto& sector : changed) {
+        for_each_part(sector, [&total](uint32_t, const uint8_t*, size_t length) {
+            total += length;
+            return true;
+        });
+    }
+    std::cout << "Writing " << total << " bytes..." << std::endl;
+
+    size_t written = 0;
+    for (const auto& sector : changed) {
+        bool ok = for_each_part(sector, [&](uint32_t begin, const uint8_t* data, size_t length) {
+            return WriteImage(begin, data, length, true, written, total);
+        });
+        if (!ok) {
+            return false;
+        }
+    }
+
+    std::cout << "\nUpdated " << written << " of " << image_size
+              << " bytes successfully!" << std::endl;
+    return true;
+}
+
+bool FlashTarget::EraseRangeAhead(uint32_t address, size_t length) {
+    uint16_t pid = 0;
+    std::vector<FlashSector> layout;
+    if (!ReadSectorLayout(pid, layout)) {
+        SetError("Sector layout unknown, nothing erased ahead");
+        return false;
+    }
+
+    const uint32_t end = address + static_cast<uint32_t>(length);
+    std::vector<FlashSector> sectors;
+    for (const auto& sector : layout) {
+        if (sector.address + sector.size > address && sector.address < end &&
+            std::find(erased_ahead_.begin(), erased_ahead_.end(), sector.address) == erased_ahead_.end()) {
+            sectors.push_back(sector);
+        }
+    }
+    if (!EraseSectors(sectors)) {
+        SetError("Failed to erase sectors");
+        return false;
+    }
+    for (const auto& sector : sectors) {
+        erased_ahead_.push_back(sector.address);
+    }
+    return true;
+}
+
+bool FlashTarget::VerifyRange(const FirmwareData& firmware, size_t stride) {
+    const size_t CHUNK_SIZE = 256;
+    const size_t blocks = (firmware.Size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (stride == 0) {
+        stride = 1;
+    }
+
+    // Every stride-th block plus the last one, which holds the image tail
+    uint8_t current[CHUNK_SIZE];
+    size_t checked = 0;
+    for (size_t block = 0; block < blocks; block++) {
+        if (block % stride != 0 && block != blocks - 1) {
+            continue;
+        }
+        const size_t offset = block * CHUNK_SIZE;
+        const size_t length = std::min(CHUNK_SIZE, firmware.Size() - offset);
+        const uint32_t address = firmware.start_address + static_cast<uint32_t>(offset);
+        if (!ReadMemory(address, current, length)) {
+            SetError("Failed to read memory at address 0x" + std::to_string(address));
+            return false;
+        }
+        if (memcmp(current, firmware.Bytes() + offset, length) != 0) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "Verify failed at address 0x%08X", address);
+            SetError(buf);
+            return false;
+        }
+        checked++;
+    }
+
+    std::cout << "Verified " << checked << " of " << blocks << " blocks" << std::endl;
+    return true;
+}
+
+} // namespace SimpleSerial
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Firmware data structure for flashing
+ *
+ * The image is either owned in @c data or, to avoid a copy, borrowed
+ * from @c image (e.g. a MappedFile) which then takes precedence.
+ */
+struct FirmwareData {
+    uint32_t start_address;
+    std::vector<uint8_t> data;
+    const uint8_t* image = nullptr;
+    size_t image_size = 0;
+
+    const uint8_t* Bytes() const { return image ? image : data.data(); }
+    size_t Size() const { return image ? image_size : data.size(); }
+};
+
+/**
+ * @brief One erase unit of on-chip flash
+ */
+struct FlashSector {
+    uint32_t address;
+    uint32_t size;
+    uint16_t number;  // Sector/page code for the ROM bootloader's Extended Erase
+};
+
+/**
+ * @brief Segment-aware, delta-capable flashing over any link to the MCU
+ *
+ * A subclass supplies the primitive operations of its link (ROM
+ * bootloader over UART, SWD probe); FlashRanges() decides which sectors
+ * to compare, erase and write, so every flasher treats sparse images and
+ * delta flashes the same way.
+ */
+class FlashTarget {
+public:
+    virtual ~FlashTarget() = default;
+
+    /**
+     * @brief Sector layout of an STM32 by product ID (DBGMCU DEV_ID)
+     * @param flash_kb Flash size from the part's size register, 0 for
+     *        the family's default (G0B1: only the first 64 KB)
+     * @return Sectors in address order, empty if the part is unknown
+     */
+    static std::vector<FlashSector> GetSectorLayout(uint16_t pid, uint32_t flash_kb = 0);
+
+    /**
+     * @brief Flash that flashing must not erase, e.g. the image's .settings
+     *
+     * With a range set, a flash that would need a full erase (unknown
+     * sector layout) fails instead.
+     */
+    void SetPreservedRange(uint32_t address, uint32_t size)
+    {
+        preserved_address_ = address;
+        preserved_size_ = size;
+    }
+
+    bool HasPreservedRange() const { return preserved_size_ > 0; }
+
+protected:
+    /**
+     * @brief Flash @p ranges, erasing only the sectors they cover
+     *
+     * With @p delta, only the covered sectors whose contents differ are
+     * erased and rewritten. Falls back to a full erase if the sector
+     * layout of the MCU is unknown, unless a preserved range is set.
+     *
+     * @param ranges Populated ranges, in address order
+     */
+    bool FlashRanges(const std::vector<const FirmwareData*>& ranges, bool delta);
+
+    /**
+     * @brief Compare every @p stride-th 256-byte block and the last one
+     */
+    bool VerifyRange(const FirmwareData& firmware, size_t stride);
+
+    /**
+     * @brief Erase the sectors under [@p address, @p address + @p length) now
+     *
+     * For erasing while the image is still being built: the next
+     * FlashRanges() writes these sectors without erasing them again.
+     *
+     * @return false if the sector layout is unknown or the erase failed
+     */
+    bool EraseRangeAhead(uint32_t address, size_t length);
+
+    virtual bool GetProductId(uint16_t& pid) = 0;
+    virtual bool ReadMemory(uint32_t address, uint8_t* data, size_t length) = 0;
+    virtual bool EraseMemory(bool full_erase) = 0;
+    virtual bool EraseSectors(const std::vector<FlashSector>& sectors) = 0;
+
+    /**
+     * @brief Program @p length bytes at @p address (already erased)
+     * @param skip_erased Blocks that are all 0xFF may be left out
+     * @param written Running byte count for progress, advanced by @p length
+     * @param total Bytes of the whole operation, for progress
+     */
+    virtual bool WriteImage(uint32_t address, const uint8_t* data, size_t length, bool skip_erased,
+                            size_t& written, size_t total) = 0;
+
+    /**
+     * @brief Called before @p sectors are read back for comparison
+     *
+     * A link with costly round trips can fetch them in one go here;
+     * ReadMemory() then serves them.
+     */
+    virtual bool PrepareReadBack(const std::vector<FlashSector>& sectors) {
+        (void)sectors;
+        return true;
+    }
+
+    virtual void SetError(const std::string& error) = 0;
+
+private:
+    std::vector<uint32_t> erased_ahead_;  // Sector addresses erased by EraseRangeAhead()
+    uint32_t preserved_address_ = 0;      // SetPreservedRange()
+    uint32_t preserved_size_ = 0;
+
+    // Layout of the connected part, sized by its flash size register
+    bool ReadSectorLayout(uint16_t& pid, std::vector<FlashSector>& layout);
+};
+
+} // namespace SimpleSerial
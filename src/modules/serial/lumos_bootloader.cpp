@@ -1,8 +1,12 @@
 #include "lumos_bootloader.h"
+#include "crc32.h"
+#include "lz4_block.h"
 
 #include <algorithm>
 #include <chrono>
+#include <deque>
 #include <thread>
+#include <utility>
 
 namespace SimpleSerial {
 
@@ -43,9 +47,12 @@ static const uint16_t crc16_table[256] = {
     0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
-uint16_t LumosBootloader::Crc16(const uint8_t* data, uint32_t len)
+uint16_t LumosBootloader::Crc16(const uint8_t* data, uint32_t len, uint16_t crc)
 {
-    uint16_t crc = 0;
+    // One byte per lookup.  Slice-by-N tables (and combining per-chunk CRCs)
+    // only work for a linear table; crc16_table differs from the generated
+    // CCITT table in 37 entries and the MCU uses the same copy, so the
+    // classic byte loop is the fastest form that still matches it.
     for (uint32_t i = 0; i < len; i++) {
         uint8_t idx = static_cast<uint8_t>(crc >> 8) ^ data[i];
         crc = static_cast<uint16_t>(crc << 8) ^ crc16_table[idx];
@@ -53,6 +60,21 @@ uint16_t LumosBootloader::Crc16(const uint8_t* data, uint32_t len)
     return crc;
 }
 
+uint16_t LumosBootloader::Crc16Chunk(const uint8_t* data, uint32_t len, uint16_t& running)
+{
+    // Two independent dependency chains over the same bytes, so the CPU
+    // overlaps their table lookups
+    uint16_t crc   = 0;
+    uint16_t image = running;
+    for (uint32_t i = 0; i < len; i++) {
+        const uint8_t b = data[i];
+        crc   = static_cast<uint16_t>(crc << 8)   ^ crc16_table[static_cast<uint8_t>(crc >> 8) ^ b];
+        image = static_cast<uint16_t>(image << 8) ^ crc16_table[static_cast<uint8_t>(image >> 8) ^ b];
+    }
+    running = image;
+    return crc;
+}
+
 // ── Helpers ──────────────────────────────────────────────────────────────────
 
 void LumosBootloader::SetError(const std::string& error)
@@ -65,6 +87,13 @@ void LumosBootloader::Report(const ProgressCallback& cb, int percent, const std:
     if (cb) cb(percent, msg);
 }
 
+bool LumosBootloader::IsCancelled()
+{
+    if (!cancelled_) return false;
+    SetError("Cancelled");
+    return true;
+}
+
 /** Read exactly one byte, return false on timeout or error. */
 static bool ReadByte(Serial& serial, uint8_t& out)
 {
@@ -72,6 +101,20 @@ static bool ReadByte(Serial& serial, uint8_t& out)
     return n == 1;
 }
 
+/**
+ * Discard input until the line has been quiet for @p idle_ms (at most
+ * @p limit_ms in all), so late replies of an older bootloader to a packet
+ * it did not know are not taken for the answer to the next one.
+ */
+static void DrainUntilIdle(Serial& serial, int idle_ms, int limit_ms)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(limit_ms);
+    uint8_t discard[64];
+    while (serial.Read(discard, sizeof(discard), idle_ms) > 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+    }
+}
+
 // ── Protocol steps ────────────────────────────────────────────────────────────
 
 bool LumosBootloader::WaitBootloaderAck(Serial& serial)
@@ -116,6 +159,89 @@ bool LumosBootloader::WaitAck(Serial& serial)
     return true;
 }
 
+bool LumosBootloader::SendHelloPacket(Serial& serial)
+{
+    window_     = 1;
+    chunk_size_ = CHUNK_SIZE;
+    features_   = 0;
+
+    // Only offer a baud rate the local adapter accepts
+    uint32_t baud = BOOT_BAUD;
+    if (requested_baud_ > BOOT_BAUD) {
+        if (serial.SetBaudRate(static_cast<int>(requested_baud_))) {
+            baud = requested_baud_;
+        }
+        serial.SetBaudRate(BOOT_BAUD);
+    }
+
+    if (requested_window_ <= 1 && requested_chunk_ <= CHUNK_SIZE && baud == BOOT_BAUD &&
+        requested_features_ == 0) {
+        return true;
+    }
+
+    // Packet: type | version | window | chunk_lo | chunk_hi | baud (4 bytes LE) | features
+    const uint8_t buf[10] = {
+        PKT_HELLO, PROTOCOL_VERSION, requested_window_,
+        static_cast<uint8_t>(requested_chunk_ >> 0),
+        static_cast<uint8_t>(requested_chunk_ >> 8),
+        static_cast<uint8_t>(baud >>  0), static_cast<uint8_t>(baud >>  8),
+        static_cast<uint8_t>(baud >> 16), static_cast<uint8_t>(baud >> 24),
+        requested_features_,
+    };
+    // Nothing left over from the handshake may pass for the reply
+    DrainUntilIdle(serial, 5, 100);
+    if (serial.Write(buf, sizeof(buf)) != static_cast<int>(sizeof(buf))) {
+        SetError("Failed to write HELLO packet");
+        return false;
+    }
+
+    // Reply: ACK | version | window [| chunk (2) | baud (4) from version 2]
+    // [| features from version 3]. Older bootloaders NACK the unknown packet
+    // type (or ignore it); either way keep stop-and-wait at the boot baud rate.
+    uint8_t reply[10] = {};
+    if (!ReadByte(serial, reply[0]) || reply[0] != RESP_ACK ||
+        !ReadByte(serial, reply[1]) || !ReadByte(serial, reply[2])) {
+        DrainUntilIdle(serial, 20, 500);
+        return true;
+    }
+    const int reply_size = reply[1] >= 3 ? 10 : reply[1] == 2 ? 9 : 3;
+    for (int i = 3; i < reply_size; i++) {
+        if (!ReadByte(serial, reply[i])) {
+            SetError("Truncated HELLO reply");
+            return false;
+        }
+    }
+
+    if (reply[1] >= 1 && reply[2] > 1) {
+        window_ = std::min(reply[2], requested_window_);
+    }
+    const uint16_t chunk = static_cast<uint16_t>(reply[3] | (reply[4] << 8));
+    if (chunk > CHUNK_SIZE && chunk <= requested_chunk_) {
+        chunk_size_ = chunk;
+    }
+    features_ = reply[9] & requested_features_;
+    if (reply[1] < 4) {
+        features_ &= static_cast<uint8_t>(~FEATURE_LAZY_ERASE);
+    }
+
+    // The MCU switches right after sending its reply; the START ACK that
+    // follows confirms the link at the new rate.
+    const uint32_t granted = static_cast<uint32_t>(reply[5]) |
+                             (static_cast<uint32_t>(reply[6]) <<  8) |
+                             (static_cast<uint32_t>(reply[7]) << 16) |
+                             (static_cast<uint32_t>(reply[8]) << 24);
+    if (granted > BOOT_BAUD && granted <= baud) {
+        if (!serial.SetBaudRate(static_cast<int>(granted))) {
+            SetError("Cannot switch to " + std::to_string(granted) + " baud: " +
+                     serial.GetLastError());
+            return false;
+        }
+        baud_rate_ = granted;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
 bool LumosBootloader::SendStartPacket(Serial& serial, uint32_t firmware_size)
 {
     uint8_t buf[5];
@@ -129,29 +255,94 @@ bool LumosBootloader::SendStartPacket(Serial& serial, uint32_t firmware_size)
         SetError("Failed to write START packet");
         return false;
     }
-    return WaitAck(serial);
+    if (!WaitAck(serial)) {
+        if (baud_rate_ != BOOT_BAUD) {
+            last_error_ += " after switching to " + std::to_string(baud_rate_) + " baud";
+        }
+        return false;
+    }
+    return true;
+}
+
+void LumosBootloader::ReportUpload(const ProgressCallback& cb, size_t offset, size_t total)
+{
+    // Progress mapped to 20 – 95 %
+    const int pct = 20 + static_cast<int>((offset * 75) / total);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Uploading: %zu / %zu bytes",
+             offset, total);
+    if (transfer_cb_) transfer_cb_(offset, total);
+    Report(cb, pct, msg);
+}
+
+void LumosBootloader::AppendPayload(std::vector<uint8_t>& pkt, const uint8_t* chunk,
+                                    uint16_t chunk_size)
+{
+    // Compressed payloads set the top bit of the size field; the CRC always
+    // covers the uncompressed chunk so the MCU checks its decoder output.
+    const size_t size_at = pkt.size();
+    pkt.push_back(static_cast<uint8_t>(chunk_size >> 0));
+    pkt.push_back(static_cast<uint8_t>(chunk_size >> 8));
+
+    if (features_ & FEATURE_LZ4) {
+        // Compress in place behind the size field; fall back to the raw
+        // chunk if that doesn't make it smaller
+        const size_t payload_at = pkt.size();
+        Lz4CompressBlock(chunk, chunk_size, pkt);
+        const size_t packed = pkt.size() - payload_at;
+        if (packed < chunk_size) {
+            const auto size = static_cast<uint16_t>(packed | SIZE_COMPRESSED);
+            pkt[size_at + 0] = static_cast<uint8_t>(size >> 0);
+            pkt[size_at + 1] = static_cast<uint8_t>(size >> 8);
+            bytes_sent_ += packed;
+            return;
+        }
+        pkt.resize(payload_at);
+    }
+    pkt.insert(pkt.end(), chunk, chunk + chunk_size);
+    bytes_sent_ += chunk_size;
+}
+
+uint16_t LumosBootloader::ChunkCrc(const uint8_t* chunk, uint16_t chunk_size, size_t offset)
+{
+    // Chunks go out in order the first time, so the image CRC for END is
+    // advanced in the same pass instead of a second pass over the image;
+    // resends only need the chunk CRC
+    if (offset != image_crc_bytes_) {
+        return Crc16(chunk, chunk_size);
+    }
+    image_crc_bytes_ += chunk_size;
+    return Crc16Chunk(chunk, chunk_size, image_crc_);
 }
 
 bool LumosBootloader::SendDataPackets(Serial& serial,
-                                       const std::vector<uint8_t>& firmware,
+                                       const uint8_t* firmware, size_t size,
                                        const ProgressCallback& cb)
 {
-    const size_t total  = firmware.size();
+    // Worst case: sequenced header, incompressible LZ4 attempt, CRC
+    packet_.reserve(1 + 2 + 2 + chunk_size_ + chunk_size_ / 255 + 16 + 2);
+    if (transfer_cb_) transfer_cb_(0, size);
+
+    if (window_ > 1) {
+        return SendWindowedPackets(serial, firmware, size, cb);
+    }
+
+    const size_t total  = size;
     size_t       offset = 0;
 
     while (offset < total) {
+        if (IsCancelled()) return false;
+
         const auto chunk_size = static_cast<uint16_t>(
-            std::min<size_t>(CHUNK_SIZE, total - offset));
-        const uint8_t* chunk = firmware.data() + offset;
-        const uint16_t crc   = Crc16(chunk, chunk_size);
+            std::min<size_t>(chunk_size_, total - offset));
+        const uint8_t* chunk = firmware + offset;
+        const uint16_t crc   = ChunkCrc(chunk, chunk_size, offset);
 
         // Packet: type(1) | size_lo | size_hi | data(chunk_size) | crc_lo | crc_hi
-        std::vector<uint8_t> pkt;
-        pkt.reserve(1 + 2 + chunk_size + 2);
+        std::vector<uint8_t>& pkt = packet_;
+        pkt.clear();
         pkt.push_back(PKT_DATA);
-        pkt.push_back(static_cast<uint8_t>(chunk_size >> 0));
-        pkt.push_back(static_cast<uint8_t>(chunk_size >> 8));
-        pkt.insert(pkt.end(), chunk, chunk + chunk_size);
+        AppendPayload(pkt, chunk, chunk_size);
         pkt.push_back(static_cast<uint8_t>(crc >> 0));
         pkt.push_back(static_cast<uint8_t>(crc >> 8));
 
@@ -167,23 +358,167 @@ bool LumosBootloader::SendDataPackets(Serial& serial,
         }
 
         offset += chunk_size;
+        ReportUpload(cb, offset, total);
+    }
+
+    return true;
+}
+
+bool LumosBootloader::SendSequencedPacket(Serial& serial,
+                                           const uint8_t* firmware, size_t size,
+                                           uint16_t seq)
+{
+    const size_t offset = static_cast<size_t>(seq) * chunk_size_;
+    const auto chunk_size = static_cast<uint16_t>(
+        std::min<size_t>(chunk_size_, size - offset));
+    const uint8_t* chunk = firmware + offset;
+    const uint16_t crc   = ChunkCrc(chunk, chunk_size, offset);
+
+    // Packet: type(1) | seq_lo | seq_hi | size_lo | size_hi | data | crc_lo | crc_hi
+    std::vector<uint8_t>& pkt = packet_;
+    pkt.clear();
+    pkt.push_back(PKT_DATA_SEQ);
+    pkt.push_back(static_cast<uint8_t>(seq >> 0));
+    pkt.push_back(static_cast<uint8_t>(seq >> 8));
+    AppendPayload(pkt, chunk, chunk_size);
+    pkt.push_back(static_cast<uint8_t>(crc >> 0));
+    pkt.push_back(static_cast<uint8_t>(crc >> 8));
+
+    if (serial.Write(pkt) != static_cast<int>(pkt.size())) {
+        SetError("Failed to write DATA packet at offset " + std::to_string(offset));
+        return false;
+    }
+    return true;
+}
+
+bool LumosBootloader::SendWindowedPackets(Serial& serial,
+                                           const uint8_t* firmware, size_t size,
+                                           const ProgressCallback& cb)
+{
+    const size_t total = size;
+    const size_t count = (total + chunk_size_ - 1) / chunk_size_;
+    if (count > 0xFFFF) {
+        SetError("Firmware too large for sequenced transfer");
+        return false;
+    }
+
+    size_t base = 0;   // lowest chunk not yet acknowledged
+    size_t next = 0;   // next chunk to send for the first time
+    std::deque<size_t> resend;
+    std::vector<int> retries(count, 0);
+
+    while (base < count) {
+        if (IsCancelled()) return false;
+
+        // Resend rejected chunks first, then fill the window
+        while (!resend.empty()) {
+            const size_t seq = resend.front();
+            resend.pop_front();
+            if (seq >= base && !SendSequencedPacket(serial, firmware, size, static_cast<uint16_t>(seq))) {
+                return false;
+            }
+        }
+        while (next < count && next < base + window_) {
+            if (!SendSequencedPacket(serial, firmware, size, static_cast<uint16_t>(next))) {
+                return false;
+            }
+            next++;
+        }
+
+        uint8_t resp[3];
+        if (!ReadByte(serial, resp[0])) {
+            // Lost packet or lost ACK: resend the oldest outstanding chunk
+            if (++retries[base] > MAX_RETRIES) {
+                SetError("Timeout waiting for ACK (at offset " +
+                         std::to_string(base * chunk_size_) + ")");
+                return false;
+            }
+            resend.push_back(base);
+            continue;
+        }
+        if (resp[0] == RESP_NACK) {
+            SetError("Received NACK from MCU (at offset " +
+                     std::to_string(base * chunk_size_) + ")");
+            return false;
+        }
+        if ((resp[0] != RESP_WINDOW_ACK && resp[0] != RESP_WINDOW_NACK) ||
+            !ReadByte(serial, resp[1]) || !ReadByte(serial, resp[2])) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "Unexpected response byte: 0x%02X", resp[0]);
+            SetError(buf);
+            return false;
+        }
+
+        const size_t seq = resp[1] | (static_cast<size_t>(resp[2]) << 8);
+        if (resp[0] == RESP_WINDOW_ACK) {
+            if (seq > next) {
+                SetError("ACK for unsent packet " + std::to_string(seq));
+                return false;
+            }
+            if (seq > base) {
+                base = seq;
+                ReportUpload(cb, std::min(base * chunk_size_, total), total);
+            }
+        } else if (seq >= base && seq < next) {
+            if (++retries[seq] > MAX_RETRIES) {
+                SetError("Too many NACKs from MCU (at offset " +
+                         std::to_string(seq * chunk_size_) + ")");
+                return false;
+            }
+            resend.push_back(seq);
+        }
+    }
+
+    return true;
+}
 
-        // Progress mapped to 20 – 95 %
-        const int pct = 20 + static_cast<int>((offset * 75) / total);
-        char msg[64];
-        snprintf(msg, sizeof(msg), "Uploading: %zu / %zu bytes",
-                 offset, total);
-        Report(cb, pct, msg);
+bool LumosBootloader::SendVerifyPacket(Serial& serial,
+                                        const uint8_t* firmware, size_t size)
+{
+    const auto length = static_cast<uint32_t>(size);
+    const uint8_t buf[5] = {
+        PKT_VERIFY,
+        static_cast<uint8_t>(length >>  0), static_cast<uint8_t>(length >>  8),
+        static_cast<uint8_t>(length >> 16), static_cast<uint8_t>(length >> 24),
+    };
+    if (serial.Write(buf, 5) != 5) {
+        SetError("Failed to write VERIFY packet");
+        return false;
     }
 
+    // Reply: ACK | CRC32 of the written range (4 bytes LE), computed by the
+    // MCU's CRC peripheral straight from flash
+    if (!WaitAck(serial)) {
+        last_error_ = "Flash verify failed: " + last_error_;
+        return false;
+    }
+    uint32_t device_crc = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t b;
+        if (!ReadByte(serial, b)) {
+            SetError("Timeout waiting for flash CRC");
+            return false;
+        }
+        device_crc |= static_cast<uint32_t>(b) << (8 * i);
+    }
+
+    const uint32_t expected = Crc32(firmware, size);
+    if (device_crc != expected) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Flash verify failed: device CRC32 0x%08X, expected 0x%08X",
+                 device_crc, expected);
+        SetError(msg);
+        return false;
+    }
     return true;
 }
 
 bool LumosBootloader::SendEndPacket(Serial& serial,
-                                     const std::vector<uint8_t>& firmware)
+                                     const uint8_t* firmware, size_t size)
 {
-    const uint16_t crc = Crc16(firmware.data(),
-                                static_cast<uint32_t>(firmware.size()));
+    const uint16_t crc = image_crc_bytes_ == size
+        ? image_crc_
+        : Crc16(firmware, static_cast<uint32_t>(size));
 
     // MCU receives 4 bytes but only uses bytes_received == app_size check;
     // send CRC16 zero-padded to 4 bytes for protocol completeness.
@@ -206,18 +541,33 @@ bool LumosBootloader::SendEndPacket(Serial& serial,
 bool LumosBootloader::Flash(const std::string& port_name,
                              const std::vector<uint8_t>& firmware,
                              ProgressCallback cb)
+{
+    return Flash(port_name, firmware.data(), firmware.size(), std::move(cb));
+}
+
+bool LumosBootloader::Flash(const std::string& port_name,
+                             const uint8_t* firmware, size_t size,
+                             ProgressCallback cb)
 {
     last_error_.clear();
+    baud_rate_  = BOOT_BAUD;
+    bytes_sent_ = 0;
+    round_trip_ = RoundTripStats();
+    image_crc_  = 0;
+    image_crc_bytes_ = 0;
 
-    if (firmware.empty()) {
+    if (size == 0) {
         SetError("Firmware is empty");
         return false;
     }
+    if (IsCancelled()) return false;
 
     // Use a 5-second read timeout to comfortably cover the flash erase step
-    // (~1-2 s for 96 KB on STM32G0).  Normal ACK bytes arrive in <100 ms.
+    // (~1-2 s for 96 KB on STM32G0, before ERASE_DONE or the START ACK) and
+    // a single sector erase delaying an ACK with lazy erase.  Normal ACK
+    // bytes arrive in <100 ms.
     SerialConfig cfg;
-    cfg.baud_rate  = 115200;
+    cfg.baud_rate  = BOOT_BAUD;
     cfg.data_bits  = 8;
     cfg.stop_bits  = 1;
     cfg.parity     = 'N';
@@ -268,30 +618,55 @@ bool LumosBootloader::Flash(const std::string& port_name,
     }
 
     // ── Step 4: Wait for ERASE_DONE byte ────────────────────────────────────
-    Report(cb, 10, "Erasing flash (this takes ~1-2 s)...");
+    // Immediate from version 4 bootloaders, which erase after START
+    Report(cb, 10, "Waiting for flash erase...");
     if (!WaitAck(serial)) {
         last_error_ = "Flash erase failed or timed out: " + last_error_;
         serial.Close();
         return false;
     }
 
-    // ── Step 5: START packet ─────────────────────────────────────────────────
-    Report(cb, 15, "Sending firmware size...");
-    if (!SendStartPacket(serial, static_cast<uint32_t>(firmware.size()))) {
+    // ── Step 5: Negotiate window, chunk size and baud rate ──────────────────
+    Report(cb, 12, "Negotiating transfer mode...");
+    if (IsCancelled() || !SendHelloPacket(serial)) {
+        serial.Close();
+        return false;
+    }
+
+    // ── Step 6: START packet ─────────────────────────────────────────────────
+    // Without lazy erase a version 4 bootloader erases before its ACK
+    Report(cb, 15, (features_ & FEATURE_LAZY_ERASE) ? "Sending firmware size..."
+                                                    : "Sending firmware size (erasing flash)...");
+    if (!SendStartPacket(serial, static_cast<uint32_t>(size))) {
         serial.Close();
         return false;
     }
 
-    // ── Step 6: DATA packets ─────────────────────────────────────────────────
-    Report(cb, 20, "Uploading firmware...");
-    if (!SendDataPackets(serial, firmware, cb)) {
+    // ── Step 7: DATA packets ─────────────────────────────────────────────────
+    Report(cb, 20, "Uploading firmware (" + std::to_string(chunk_size_) + " byte chunks, window " +
+                   std::to_string(window_) + ", " + std::to_string(baud_rate_) + " baud" +
+                   ((features_ & FEATURE_LZ4) ? ", compressed" : "") +
+                   ((features_ & FEATURE_LAZY_ERASE) ? ", erasing on the fly" : "") + ")...");
+    serial.ResetRoundTrip();
+    const bool uploaded = SendDataPackets(serial, firmware, size, cb);
+    round_trip_ = serial.GetRoundTrip();
+    if (!uploaded) {
         serial.Close();
         return false;
     }
 
-    // ── Step 7: END packet ───────────────────────────────────────────────────
+    // ── Step 8: Verify flash contents ───────────────────────────────────────
+    if (features_ & FEATURE_CRC32_VERIFY) {
+        Report(cb, 96, "Verifying flash CRC32...");
+        if (IsCancelled() || !SendVerifyPacket(serial, firmware, size)) {
+            serial.Close();
+            return false;
+        }
+    }
+
+    // ── Step 9: END packet ───────────────────────────────────────────────────
     Report(cb, 97, "Finalising transfer...");
-    if (!SendEndPacket(serial, firmware)) {
+    if (!SendEndPacket(serial, firmware, size)) {
         serial.Close();
         return false;
     }
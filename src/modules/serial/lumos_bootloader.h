@@ -1,6 +1,8 @@
 #pragma once
 
 #include "serial.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <string>
@@ -18,11 +20,54 @@ namespace SimpleSerial {
  *   2. Send magic bytes (0x7E 0x5B 0x9C) within 300 ms window
  *   3. Receive bootloader ACK (0xAC 0xCE 0x55)
  *   4. Receive READY byte (0xAA) – bootloader entered
- *   5. Receive ERASE_DONE byte (0xAA) – flash erased (~1-2 s)
- *   6. Send START packet: 0x01 + uint32 firmware_size (LE)
- *   7. Send DATA packets: 0x02 + uint16 size (LE) + <size> bytes + CRC16 (LE)
- *   8. Send END packet:   0x03 + uint32 firmware_crc16 (LE, zero-padded)
+ *   5. Receive ERASE_DONE byte (0xAA) – flash erased (~1-2 s); version 4
+ *      bootloaders send it at once and erase after START (see below)
+ *   6. Send HELLO packet: 0x04 + uint8 version + uint8 window
+ *      + uint16 chunk size (LE) + uint32 baud rate (LE) + uint8 features
+ *      (see below)
+ *   7. Send START packet: 0x01 + uint32 firmware_size (LE)
+ *   8. Send DATA packets: 0x02 + uint16 size (LE) + <size> bytes + CRC16 (LE)
+ *   9. Send VERIFY packet: 0x06 + uint32 firmware_size (LE), if negotiated
+ *  10. Send END packet:   0x03 + uint32 firmware_crc16 (LE, zero-padded)
  *   Each step waits for an ACK byte (0xAA) before continuing.
+ *
+ * Capabilities (protocol version 2):
+ *   The HELLO reply is ACK + uint8 version + uint8 window + uint16 chunk
+ *   size + uint32 baud rate + uint8 features, each no larger than requested
+ *   (version 1 bootloaders reply with the window only, version 2 without
+ *   features). The MCU switches to the granted baud rate right after the
+ *   reply; DATA packets then carry up to `chunk size` bytes.
+ *
+ * Compression (feature bit 0):
+ *   A DATA size field with bit 15 set marks a payload of (size & 0x7FFF)
+ *   bytes holding one LZ4 block that decodes to the chunk. The CRC16 is
+ *   over the decoded chunk. Chunks that don't shrink are sent raw.
+ *
+ * Flash verify (feature bit 1):
+ *   Before END the host sends VERIFY; the MCU runs its CRC peripheral over
+ *   the first firmware_size bytes of the application area and replies
+ *   ACK + uint32 CRC-32 (LE, zlib polynomial and bit order), which must
+ *   match Crc32() over the image.
+ *
+ * Lazy erase (feature bit 2, protocol version 4):
+ *   Version 4 bootloaders erase nothing before HELLO. Without this feature
+ *   they erase the image's sectors before ACKing START. With it they ACK
+ *   START at once and erase each sector just ahead of the write pointer.
+ *   A DATA chunk is ACKed as soon as its CRC checks. It is programmed from
+ *   one half of a double RX buffer while the next packet arrives in the
+ *   other. An erase or write that fails NACKs the next packet (or VERIFY).
+ *   Erase, transfer and programming overlap instead of running back to back;
+ *   an ACK can take one sector erase longer than usual.
+ *
+ * Windowed transfer:
+ *   With a window above 1, DATA packets become 0x05 + uint16 seq (LE) + uint16 size
+ *   (LE) + <size> bytes + CRC16 (LE), where seq is the chunk index. Up to
+ *   `window` packets are in flight; the MCU answers with
+ *     0xA5 + uint16 seq – cumulative ACK, all chunks below seq are written
+                          (with lazy erase: received and queued for writing)
+ *     0x5A + uint16 seq – chunk seq failed its CRC and must be resent
+ *   Bootloaders that predate HELLO answer it with NACK (or not at all) and
+ *   the transfer falls back to one packet per ACK.
  */
 class LumosBootloader {
 public:
@@ -33,8 +78,84 @@ public:
      */
     using ProgressCallback = std::function<void(int percent, const std::string& message)>;
 
+    /**
+     * @brief Byte-level upload progress, for throughput and ETA displays
+     * @param done   Image bytes acknowledged by the MCU so far
+     * @param total  Image size
+     *
+     * Called with done = 0 just before the first DATA packet, so the rate
+     * excludes the reset and handshake before it; with lazy erase it
+     * includes the erase, which then overlaps the transfer.
+     */
+    using TransferCallback = std::function<void(size_t done, size_t total)>;
+
     LumosBootloader() = default;
 
+    void SetTransferCallback(TransferCallback cb) { transfer_cb_ = std::move(cb); }
+
+    /**
+     * @brief Abort a Flash() running on another thread
+     *
+     * Takes effect before the next packet or protocol step; Flash() then
+     * returns false with "Cancelled". Sticky: later Flash() calls on this
+     * object fail straight away. An MCU left mid-download stays in its
+     * bootloader until it is flashed again.
+     */
+    void Cancel() { cancelled_ = true; }
+
+    /**
+     * @brief Set the number of DATA packets to keep in flight
+     *
+     * The bootloader may grant a smaller window. 1 disables the windowed
+     * transfer and always uses one packet per ACK.
+     */
+    void SetWindowSize(uint8_t window) { requested_window_ = window == 0 ? 1 : window; }
+
+    /**
+     * @brief Set the largest DATA payload to offer the bootloader
+     *
+     * The bootloader grants at most its flash write buffer size; the
+     * default of 256 bytes is always supported, the maximum is 16 KB.
+     */
+    void SetChunkSize(uint16_t chunk)
+    {
+        requested_chunk_ = std::min(std::max(chunk, CHUNK_SIZE), MAX_CHUNK_SIZE);
+    }
+
+    /**
+     * @brief Set the baud rate to switch to after the handshake
+     *
+     * The handshake itself always runs at 115200. The rate is only offered
+     * if the local adapter accepts it.
+     */
+    void SetBaudRate(uint32_t baud) { requested_baud_ = std::max(baud, BOOT_BAUD); }
+
+    /**
+     * @brief Offer LZ4-compressed DATA payloads (enabled by default)
+     */
+    void SetCompression(bool enable) { SetFeature(FEATURE_LZ4, enable); }
+
+    /**
+     * @brief Ask the MCU for a CRC32 of the written flash (enabled by default)
+     */
+    void SetVerify(bool enable) { SetFeature(FEATURE_CRC32_VERIFY, enable); }
+
+    /**
+     * @brief Let the MCU erase while the image arrives (enabled by default)
+     */
+    void SetLazyErase(bool enable) { SetFeature(FEATURE_LAZY_ERASE, enable); }
+
+    /** Payload bytes put on the wire by the last Flash() (after compression) */
+    size_t GetBytesSent() const { return bytes_sent_; }
+
+    /** DATA packet to ACK round trips of the last Flash() */
+    const RoundTripStats& GetRoundTrip() const { return round_trip_; }
+
+    /** Link settings granted in the HELLO reply of the last Flash() */
+    uint32_t GetGrantedBaudRate() const { return baud_rate_; }
+    uint8_t  GetGrantedWindow() const { return window_; }
+    uint16_t GetGrantedChunkSize() const { return chunk_size_; }
+
     /**
      * @brief Flash firmware to the MCU via the custom Lumos bootloader protocol.
      *
@@ -50,23 +171,83 @@ public:
                const std::vector<uint8_t>& firmware,
                ProgressCallback progress = nullptr);
 
+    /**
+     * @brief Flash firmware from a caller-owned buffer (e.g. a MappedFile)
+     *
+     * Same as above; the image is read in place and never copied.
+     */
+    bool Flash(const std::string& port_name,
+               const uint8_t* firmware, size_t size,
+               ProgressCallback progress = nullptr);
+
     std::string GetLastError() const { return last_error_; }
 
-    /** CRC16-CCITT (XMODEM) – same table used on the MCU side */
-    static uint16_t Crc16(const uint8_t* data, uint32_t len);
+    /**
+     * @brief CRC16-CCITT (XMODEM) – same table used on the MCU side
+     * @param crc Result of a previous call to continue a running CRC
+     */
+    static uint16_t Crc16(const uint8_t* data, uint32_t len, uint16_t crc = 0);
+
+    /**
+     * @brief CRC16 of a chunk, advancing a running CRC over the same bytes
+     *
+     * Equivalent to Crc16(data, len) plus running = Crc16(data, len, running),
+     * but in a single pass.
+     *
+     * @param running Running CRC, updated in place
+     * @return CRC16 of the chunk alone
+     */
+    static uint16_t Crc16Chunk(const uint8_t* data, uint32_t len, uint16_t& running);
 
 private:
     bool WaitBootloaderAck(Serial& serial);
     bool WaitAck(Serial& serial);
+    bool SendHelloPacket(Serial& serial);
     bool SendStartPacket(Serial& serial, uint32_t firmware_size);
-    bool SendDataPackets(Serial& serial, const std::vector<uint8_t>& firmware,
+    bool SendDataPackets(Serial& serial, const uint8_t* firmware, size_t size,
                          const ProgressCallback& cb);
-    bool SendEndPacket(Serial& serial, const std::vector<uint8_t>& firmware);
+    bool SendWindowedPackets(Serial& serial, const uint8_t* firmware, size_t size,
+                             const ProgressCallback& cb);
+    bool SendSequencedPacket(Serial& serial, const uint8_t* firmware, size_t size,
+                             uint16_t seq);
+    void ReportUpload(const ProgressCallback& cb, size_t offset, size_t total);
+    void AppendPayload(std::vector<uint8_t>& pkt, const uint8_t* chunk, uint16_t chunk_size);
+    uint16_t ChunkCrc(const uint8_t* chunk, uint16_t chunk_size, size_t offset);
+    bool SendVerifyPacket(Serial& serial, const uint8_t* firmware, size_t size);
+    bool SendEndPacket(Serial& serial, const uint8_t* firmware, size_t size);
+
+    void SetFeature(uint8_t feature, bool enable)
+    {
+        requested_features_ = static_cast<uint8_t>(enable ? (requested_features_ | feature)
+                                                          : (requested_features_ & ~feature));
+    }
 
     void Report(const ProgressCallback& cb, int percent, const std::string& msg);
     void SetError(const std::string& error);
+    bool IsCancelled();
 
     std::string last_error_;
+    TransferCallback  transfer_cb_;
+    std::atomic<bool> cancelled_{false};
+    uint8_t  requested_window_   = DEFAULT_WINDOW;
+    uint16_t requested_chunk_    = DEFAULT_CHUNK_SIZE;
+    uint32_t requested_baud_     = DEFAULT_BAUD;
+    uint8_t  requested_features_ = FEATURE_LZ4 | FEATURE_CRC32_VERIFY | FEATURE_LAZY_ERASE;
+
+    // Granted by the bootloader in the HELLO reply
+    uint8_t  window_     = 1;
+    uint16_t chunk_size_ = CHUNK_SIZE;
+    uint32_t baud_rate_  = BOOT_BAUD;
+    uint8_t  features_   = 0;
+    size_t   bytes_sent_ = 0;
+    RoundTripStats round_trip_;
+
+    // DATA packet under construction, reused so uploads don't allocate per chunk
+    std::vector<uint8_t> packet_;
+
+    // Running CRC16 over the image, advanced as chunks are first sent
+    uint16_t image_crc_       = 0;
+    size_t   image_crc_bytes_ = 0;
 
     // Protocol constants (mirror bootloader.h)
     static constexpr uint8_t  MAGIC_1     = 0x7E;
@@ -81,6 +262,24 @@ private:
     static constexpr uint8_t  RESP_ACK    = 0xAA;
     static constexpr uint8_t  RESP_NACK   = 0x55;
     static constexpr uint16_t CHUNK_SIZE  = 256;
+    static constexpr uint32_t BOOT_BAUD   = 115200;
+
+    // HELLO capabilities and windowed transfer
+    static constexpr uint8_t  PKT_HELLO            = 0x04;
+    static constexpr uint8_t  PKT_DATA_SEQ         = 0x05;
+    static constexpr uint8_t  PKT_VERIFY           = 0x06;
+    static constexpr uint8_t  RESP_WINDOW_ACK      = 0xA5;
+    static constexpr uint8_t  RESP_WINDOW_NACK     = 0x5A;
+    static constexpr uint8_t  PROTOCOL_VERSION     = 4;
+    static constexpr uint8_t  FEATURE_LZ4          = 0x01;
+    static constexpr uint8_t  FEATURE_CRC32_VERIFY = 0x02;
+    static constexpr uint8_t  FEATURE_LAZY_ERASE   = 0x04;
+    static constexpr uint16_t SIZE_COMPRESSED      = 0x8000;
+    static constexpr uint8_t  DEFAULT_WINDOW       = 8;
+    static constexpr uint16_t DEFAULT_CHUNK_SIZE   = 1024;
+    static constexpr uint16_t MAX_CHUNK_SIZE       = 16384;
+    static constexpr uint32_t DEFAULT_BAUD         = 921600;
+    static constexpr int      MAX_RETRIES          = 5;
 };
 
 } // namespace SimpleSerial
@@ -0,0 +1,170 @@
+#include "lz4_block.h"
+
+#include <cstring>
+
+namespace SimpleSerial {
+
+namespace {
+
+constexpr size_t MIN_MATCH    = 4;
+constexpr size_t LAST_LITERALS = 5;   // Block must end with >= 5 literals
+constexpr size_t MF_LIMIT     = 12;   // Last match must start >= 12 bytes before the end
+constexpr size_t MAX_OFFSET   = 65535;
+constexpr int    HASH_BITS    = 12;
+
+uint32_t Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/** Length beyond the 4-bit token field: runs of 255 plus a remainder */
+void PutLength(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+/** Inverse of PutLength, added to the 4-bit token field; false past @p end */
+bool GetLength(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+    if (length != 15) {
+        return true;
+    }
+    uint8_t more;
+    do {
+        if (in == end) {
+            return false;
+        }
+        more = *in++;
+        length += more;
+    } while (more == 255);
+    return true;
+}
+
+void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_length,
+                 size_t offset, size_t match_length)
+{
+    const bool has_match = match_length >= MIN_MATCH;
+    const size_t match_code = has_match ? match_length - MIN_MATCH : 0;
+
+    uint8_t token = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15) << 4);
+    if (has_match) {
+        token |= static_cast<uint8_t>(match_code < 15 ? match_code : 15);
+    }
+    out.push_back(token);
+    if (literal_length >= 15) {
+        PutLength(out, literal_length - 15);
+    }
+    out.insert(out.end(), literals, literals + literal_length);
+
+    if (has_match) {
+        out.push_back(static_cast<uint8_t>(offset >> 0));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15) {
+            PutLength(out, match_code - 15);
+        }
+    }
+}
+
+} // namespace
+
+std::vector<uint8_t> Lz4CompressBlock(const uint8_t* data, size_t length)
+{
+    std::vector<uint8_t> out;
+    out.reserve(length + length / 255 + 16);
+    Lz4CompressBlock(data, length, out);
+    return out;
+}
+
+void Lz4CompressBlock(const uint8_t* data, size_t length, std::vector<uint8_t>& out)
+{
+
+    size_t anchor = 0;   // start of pending literals
+    if (length > MF_LIMIT) {
+        // Positions + 1 of the last occurrence of each 4-byte hash (0 = empty)
+        uint32_t table[1u << HASH_BITS] = {};
+        const size_t match_limit = length - LAST_LITERALS;
+        size_t pos = 0;
+
+        while (pos + MF_LIMIT <= length) {
+            const uint32_t sequence = Read32(data + pos);
+            const uint32_t h = Hash(sequence);
+            const size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(pos + 1);
+
+            if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET ||
+                Read32(data + candidate - 1) != sequence) {
+                pos++;
+                continue;
+            }
+
+            const size_t ref = candidate - 1;
+            size_t match_length = MIN_MATCH;
+            while (pos + match_length < match_limit &&
+                   data[ref + match_length] == data[pos + match_length]) {
+                match_length++;
+            }
+
+            PutSequence(out, data + anchor, pos - anchor, pos - ref, match_length);
+            pos += match_length;
+            anchor = pos;
+        }
+    }
+
+    // Final literal-only sequence
+    PutSequence(out, data + anchor, length - anchor, 0, 0);
+}
+
+bool Lz4DecompressBlock(const uint8_t* block, size_t length, size_t max_length, std::vector<uint8_t>& out)
+{
+    out.clear();
+    const uint8_t* in = block;
+    const uint8_t* end = block + length;
+
+    while (in < end) {
+        const uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (!GetLength(in, end, literal_length) || literal_length > static_cast<size_t>(end - in) ||
+            out.size() + literal_length > max_length) {
+            return false;
+        }
+        out.insert(out.end(), in, in + literal_length);
+        in += literal_length;
+        if (in == end) {
+            return true;   // The last sequence has no match
+        }
+
+        if (end - in < 2) {
+            return false;
+        }
+        const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t match_length = token & 0x0F;
+        if (!GetLength(in, end, match_length)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + match_length > max_length) {
+            return false;
+        }
+
+        // Byte by byte: a match may overlap the bytes it produces
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < match_length; i++) {
+            out.push_back(out[from++]);
+        }
+    }
+    return length == 0;
+}
+
+} // namespace SimpleSerial
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Compress a buffer into a single LZ4 block (no frame header)
+ *
+ * Produces the standard LZ4 block format, so any LZ4 block decoder
+ * (e.g. LZ4_decompress_safe on the MCU) can unpack it. Each block is
+ * self-contained; no dictionary is shared between calls.
+ *
+ * @param data Input bytes
+ * @param length Number of input bytes
+ * @return Compressed block (may be larger than the input for random data)
+ */
+std::vector<uint8_t> Lz4CompressBlock(const uint8_t* data, size_t length);
+
+/**
+ * @brief Compress a buffer into a single LZ4 block, appended to @p out
+ *
+ * Same output as above, but lets callers reuse one buffer (e.g. a packet
+ * under construction) instead of allocating per block.
+ */
+void Lz4CompressBlock(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+
+/**
+ * @brief Decode a single LZ4 block into @p out (replacing its contents)
+ *
+ * The host-side counterpart of the MCU decoder, for tests and emulators.
+ * Malformed input and output beyond @p max_length are rejected.
+ *
+ * @return false if the block is malformed or decodes to more than @p max_length bytes
+ */
+bool Lz4DecompressBlock(const uint8_t* block, size_t length, size_t max_length, std::vector<uint8_t>& out);
+
+} // namespace SimpleSerial
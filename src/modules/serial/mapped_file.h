@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Read-only memory mapping of a file (e.g. build/firmware.bin)
+ *
+ * Lets the flashing code work straight from the page cache instead of
+ * copying the image into a buffer first. The mapping stays valid until
+ * Close() or destruction; the file must not be truncated meanwhile.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map a file into memory
+     * @param path File to map
+     * @return true on success, false otherwise (check GetLastError())
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @brief Unmap the file
+     */
+    void Close();
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool IsOpen() const { return data_ != nullptr; }
+
+    std::string GetLastError() const { return last_error_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::string last_error_;
+
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+} // namespace SimpleSerial
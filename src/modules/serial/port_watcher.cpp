@@ -0,0 +1,349 @@
+#include "port_watcher.h"
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <initguid.h>
+#include <cfgmgr32.h>
+#include <ntddser.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/serial/IOSerialKeys.h>
+#else
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace SimpleSerial {
+
+namespace {
+
+// Device changes come in bursts (USB device, interface, tty node); wait
+// for this much quiet before re-enumerating
+const int kSettleMs = 100;
+
+// Poll interval without OS notifications
+const int kPollMs = 1000;
+
+bool SamePort(const PortInfo& a, const PortInfo& b) {
+    return a.name == b.name && a.vid == b.vid && a.pid == b.pid &&
+           a.serial_number == b.serial_number && a.location == b.location;
+}
+
+bool Contains(const std::vector<PortInfo>& ports, const PortInfo& port) {
+    for (const auto& other : ports) {
+        if (SamePort(other, port)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+PortWatcher::PortWatcher()
+    : running_(false)
+    , stop_(false)
+    , event_driven_(false)
+#if defined(_WIN32) || defined(__APPLE__)
+    , pending_(false)
+#endif
+#ifdef _WIN32
+    , notification_(NULL)
+#elif defined(__APPLE__)
+    , notify_port_(NULL)
+    , queue_(NULL)
+    , added_(0)
+    , removed_(0)
+#else
+    , netlink_(-1)
+    , wake_pipe_{-1, -1}
+#endif
+{
+}
+
+PortWatcher::~PortWatcher() {
+    Stop();
+}
+
+bool PortWatcher::Start(Callback callback) {
+    if (running_) {
+        return false;
+    }
+
+    callback_ = std::move(callback);
+    stop_ = false;
+    event_driven_ = OpenNotifications();
+
+    // Snapshot before returning so nothing plugged in after Start() is missed
+    ports_ = Serial::ListPortDetails();
+
+    running_ = true;
+    thread_ = std::thread(&PortWatcher::ThreadFunc, this);
+    return true;
+}
+
+void PortWatcher::Stop() {
+    if (!running_) {
+        return;
+    }
+    stop_ = true;
+    Rescan();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    CloseNotifications();
+    running_ = false;
+}
+
+void PortWatcher::ThreadFunc() {
+    while (!stop_) {
+        bool changed = WaitForChange(event_driven_ ? -1 : kPollMs);
+        if (stop_) {
+            break;
+        }
+        if (changed) {
+            while (WaitForChange(kSettleMs) && !stop_) {
+            }
+        } else if (event_driven_) {
+            continue;
+        }
+
+        std::vector<PortInfo> ports = Serial::ListPortDetails();
+        for (const auto& port : ports_) {
+            if (!Contains(ports, port) && !stop_) {
+                callback_(PortEvent::REMOVED, port);
+            }
+        }
+        for (const auto& port : ports) {
+            if (!Contains(ports_, port) && !stop_) {
+                callback_(PortEvent::ADDED, port);
+            }
+        }
+        ports_ = std::move(ports);
+    }
+}
+
+#if defined(_WIN32) || defined(__APPLE__)
+
+void PortWatcher::Rescan() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+    }
+    changed_.notify_one();
+}
+
+bool PortWatcher::WaitForChange(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout_ms < 0) {
+        changed_.wait(lock, [this] { return pending_; });
+    } else {
+        changed_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return pending_; });
+    }
+    bool changed = pending_;
+    pending_ = false;
+    return changed;
+}
+
+#endif
+
+#ifdef _WIN32
+
+namespace {
+
+DWORD CALLBACK OnDeviceInterfaceChange(HCMNOTIFICATION, PVOID context, CM_NOTIFY_ACTION,
+                                       PCM_NOTIFY_EVENT_DATA, DWORD) {
+    static_cast<PortWatcher*>(context)->Rescan();
+    return ERROR_SUCCESS;
+}
+
+} // namespace
+
+bool PortWatcher::OpenNotifications() {
+    // Arrival and removal of any COM port interface
+    CM_NOTIFY_FILTER filter = {};
+    filter.cbSize = sizeof(filter);
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    filter.u.DeviceInterface.ClassGuid = GUID_DEVINTERFACE_COMPORT;
+
+    HCMNOTIFICATION notification = NULL;
+    if (CM_Register_Notification(&filter, this, OnDeviceInterfaceChange, &notification) != CR_SUCCESS) {
+        return false;
+    }
+    notification_ = notification;
+    return true;
+}
+
+void PortWatcher::CloseNotifications() {
+    if (notification_) {
+        // Waits for callbacks in progress
+        CM_Unregister_Notification(static_cast<HCMNOTIFICATION>(notification_));
+        notification_ = NULL;
+    }
+}
+
+#elif defined(__APPLE__)
+
+namespace {
+
+// Iterators must be drained to re-arm the notification
+void OnServicesChanged(void* context, io_iterator_t iterator) {
+    io_object_t service;
+    while ((service = IOIteratorNext(iterator)) != IO_OBJECT_NULL) {
+        IOObjectRelease(service);
+    }
+    if (context) {
+        static_cast<PortWatcher*>(context)->Rescan();
+    }
+}
+
+} // namespace
+
+bool PortWatcher::OpenNotifications() {
+    IONotificationPortRef port = IONotificationPortCreate(MACH_PORT_NULL);
+    if (!port) {
+        return false;
+    }
+    dispatch_queue_t queue = dispatch_queue_create("lumos.port-watcher", DISPATCH_QUEUE_SERIAL);
+    IONotificationPortSetDispatchQueue(port, queue);
+    notify_port_ = port;
+    queue_ = queue;
+
+    // Each call consumes one reference to the matching dictionary
+    CFMutableDictionaryRef matching = IOServiceMatching(kIOSerialBSDServiceValue);
+    if (!matching) {
+        CloseNotifications();
+        return false;
+    }
+    CFRetain(matching);
+
+    io_iterator_t added = IO_OBJECT_NULL;
+    io_iterator_t removed = IO_OBJECT_NULL;
+    kern_return_t first = IOServiceAddMatchingNotification(
+        port, kIOFirstMatchNotification, matching, OnServicesChanged, this, &added);
+    kern_return_t terminated = IOServiceAddMatchingNotification(
+        port, kIOTerminatedNotification, matching, OnServicesChanged, this, &removed);
+    added_ = added;
+    removed_ = removed;
+    if (first != KERN_SUCCESS || terminated != KERN_SUCCESS) {
+        CloseNotifications();
+        return false;
+    }
+
+    // Arm both; the ports already present are in the snapshot
+    OnServicesChanged(NULL, added);
+    OnServicesChanged(NULL, removed);
+    return true;
+}
+
+void PortWatcher::CloseNotifications() {
+    if (added_) {
+        IOObjectRelease(added_);
+        added_ = 0;
+    }
+    if (removed_) {
+        IOObjectRelease(removed_);
+        removed_ = 0;
+    }
+    if (notify_port_) {
+        IONotificationPortDestroy(static_cast<IONotificationPortRef>(notify_port_));
+        notify_port_ = NULL;
+    }
+    if (queue_) {
+        // Let a callback in progress finish before the watcher can go away
+        dispatch_queue_t queue = static_cast<dispatch_queue_t>(queue_);
+        dispatch_sync_f(queue, NULL, [](void*) {});
+        dispatch_release(queue);
+        queue_ = NULL;
+    }
+}
+
+#else
+
+bool PortWatcher::OpenNotifications() {
+    if (wake_pipe_[0] < 0 && pipe2(wake_pipe_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        wake_pipe_[0] = wake_pipe_[1] = -1;
+    }
+
+    // Kernel uevents (group 1) arrive as soon as the tty is registered;
+    // udev's (group 2) once it has created the /dev node
+    netlink_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (netlink_ < 0) {
+        return false;
+    }
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1 | 2;
+    if (bind(netlink_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        addr.nl_groups = 1;
+        if (bind(netlink_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(netlink_);
+            netlink_ = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+void PortWatcher::CloseNotifications() {
+    if (netlink_ >= 0) {
+        close(netlink_);
+        netlink_ = -1;
+    }
+    for (int& fd : wake_pipe_) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void PortWatcher::Rescan() {
+    if (wake_pipe_[1] >= 0) {
+        char byte = 1;
+        (void)write(wake_pipe_[1], &byte, 1);
+    }
+}
+
+bool PortWatcher::WaitForChange(int timeout_ms) {
+    struct pollfd pfds[2];
+    nfds_t count = 0;
+    if (wake_pipe_[0] >= 0) {
+        pfds[count].fd = wake_pipe_[0];
+        pfds[count++].events = POLLIN;
+    }
+    if (netlink_ >= 0) {
+        pfds[count].fd = netlink_;
+        pfds[count++].events = POLLIN;
+    }
+    if (poll(pfds, count, timeout_ms) <= 0) {
+        return false;
+    }
+
+    bool changed = false;
+    char buffer[8192];
+    if (wake_pipe_[0] >= 0) {
+        while (read(wake_pipe_[0], buffer, sizeof(buffer)) > 0) {
+            changed = true;
+        }
+    }
+
+    // Only tty events matter (not every USB device or interface)
+    static const std::string kTty("SUBSYSTEM=tty", sizeof("SUBSYSTEM=tty"));
+    ssize_t length;
+    while (netlink_ >= 0 && (length = recv(netlink_, buffer, sizeof(buffer), 0)) > 0) {
+        if (std::string(buffer, length).find(kTty) != std::string::npos) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+#endif
+
+} // namespace SimpleSerial
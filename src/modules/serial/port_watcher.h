@@ -0,0 +1,109 @@
+#pragma once
+
+#include "serial.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Serial port hotplug event
+ */
+enum class PortEvent {
+    ADDED,
+    REMOVED
+};
+
+/**
+ * @brief Reports serial ports being plugged in and removed
+ *
+ * A background thread sleeps until the OS announces a device change
+ * (kernel uevents on Linux, IOKit notifications on macOS, configuration
+ * manager notifications on Windows), re-enumerates with
+ * Serial::ListPortDetails() and reports the difference. If notifications
+ * are unavailable (e.g. no netlink in a container) it polls once a second.
+ */
+class PortWatcher {
+public:
+    /** Called on the watcher thread */
+    using Callback = std::function<void(PortEvent event, const PortInfo& port)>;
+
+    PortWatcher();
+    ~PortWatcher();
+
+    PortWatcher(const PortWatcher&) = delete;
+    PortWatcher& operator=(const PortWatcher&) = delete;
+
+    /**
+     * @brief Start watching
+     *
+     * Ports present at this point are not reported; list them with
+     * Serial::ListPortDetails() first.
+     *
+     * @param callback Receives every change
+     * @return true if the watcher thread was started
+     */
+    bool Start(Callback callback);
+
+    /**
+     * @brief Stop watching; no callback runs after this returns
+     */
+    void Stop();
+
+    bool IsRunning() const { return running_; }
+
+    /**
+     * @brief Re-enumerate now instead of waiting for the OS
+     *
+     * Safe to call from any thread, e.g. from a "Refresh" button.
+     */
+    void Rescan();
+
+    /**
+     * @brief Whether changes arrive as OS notifications (false = polling)
+     */
+    bool IsEventDriven() const { return event_driven_; }
+
+private:
+    // Platform notification source; OpenNotifications() returns false
+    // to fall back to polling. WaitForChange() returns true on a change
+    // notification or Rescan(), false on timeout.
+    bool OpenNotifications();
+    void CloseNotifications();
+    bool WaitForChange(int timeout_ms);
+
+    void ThreadFunc();
+
+    Callback callback_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_;
+    bool event_driven_;
+    std::vector<PortInfo> ports_;
+
+#if defined(_WIN32) || defined(__APPLE__)
+    // Set by OS callbacks on their own thread and by Rescan()
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool pending_;
+#endif
+
+#ifdef _WIN32
+    void* notification_;    // HCMNOTIFICATION
+#elif defined(__APPLE__)
+    void* notify_port_;     // IONotificationPortRef
+    void* queue_;           // dispatch_queue_t
+    unsigned int added_;    // io_iterator_t
+    unsigned int removed_;  // io_iterator_t
+#else
+    int netlink_;           // NETLINK_KOBJECT_UEVENT socket
+    int wake_pipe_[2];      // Written by Rescan()
+#endif
+};
+
+} // namespace SimpleSerial
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -16,6 +17,24 @@ enum class PortStatus {
     UNKNOWN_ERROR   // Other error occurred
 };
 
+/**
+ * @brief A serial port found by Serial::ListPortDetails()
+ *
+ * Gathered from the OS device tree (sysfs, IOKit, SetupAPI) without
+ * opening the port. The USB fields are empty/zero for other ports.
+ */
+struct PortInfo {
+    std::string name;           // e.g. "/dev/ttyACM0", "/dev/cu.usbmodem1101", "COM3"
+    std::string description;    // USB product string or driver / friendly name
+    std::string manufacturer;   // USB manufacturer string
+    std::string serial_number;  // USB iSerialNumber
+    std::string location;       // Physical USB path, stable across replugs (e.g. "1-2.3:1.0")
+    uint16_t vid = 0;           // USB vendor ID
+    uint16_t pid = 0;           // USB product ID
+
+    bool IsUsb() const { return vid != 0 || pid != 0; }
+};
+
 /**
  * @brief Serial port configuration
  */
@@ -25,6 +44,31 @@ struct SerialConfig {
     int stop_bits = 1;
     char parity = 'N';  // 'N' = None, 'E' = Even, 'O' = Odd
     int timeout_ms = 1000;  // Read timeout in milliseconds
+
+    // Have the driver pass on received bytes at once instead of batching
+    // them (ASYNC_LOW_LATENCY and the FTDI latency timer on Linux,
+    // IOSSDATALAT on macOS, return-on-first-byte timeouts on Windows)
+    bool low_latency = true;
+};
+
+/**
+ * @brief Write-to-reply times of a port (Serial::GetRoundTrip())
+ *
+ * One sample per reply: from the first Write() after the last read to the
+ * next read that returns data. In a stop-and-wait protocol that is the
+ * command/ACK round trip, USB-serial adapter latency included.
+ */
+struct RoundTripStats {
+    uint64_t count = 0;
+    double min_ms = 0;
+    double max_ms = 0;
+    double total_ms = 0;
+
+    double MeanMs() const { return count > 0 ? total_ms / count : 0.0; }
+    void Add(double ms);
+
+    /** e.g. "412 round trips, min 0.21 ms, avg 0.35 ms, max 1.02 ms" */
+    std::string Describe() const;
 };
 
 /**
@@ -62,6 +106,8 @@ public:
      * @param data Pointer to data buffer
      * @param length Number of bytes to write
      * @return Number of bytes actually written, -1 on error
+     *
+     * One thread may write while another reads the same port.
      */
     int Write(const uint8_t* data, size_t length);
 
@@ -87,6 +133,48 @@ public:
      */
     int Read(uint8_t* buffer, size_t max_length);
 
+    /**
+     * @brief Read data, waiting at most @p timeout_ms for the first byte
+     * @param buffer Pointer to buffer to store read data
+     * @param max_length Maximum number of bytes to read
+     * @param timeout_ms Timeout for this call instead of the configured one
+     * @return Number of bytes actually read, -1 on error, 0 on timeout
+     */
+    int Read(uint8_t* buffer, size_t max_length, int timeout_ms);
+
+    /**
+     * @brief Block until data is available to read
+     *
+     * Sleeps in the OS until a byte arrives (poll on Linux, kqueue on
+     * macOS, an overlapped EV_RXCHAR wait on Windows), so callers wake with
+     * sub-millisecond latency instead of polling. Does not consume data.
+     *
+     * @param timeout_ms Maximum time to wait
+     * @return 1 if data is available, 0 on timeout, -1 on error
+     */
+    int WaitForData(int timeout_ms);
+
+    /**
+     * @brief Block until any of several ports has data to read
+     *
+     * One thread can serve many ports this way (e.g. lumos monitor --ports).
+     *
+     * @param ports Open ports to watch
+     * @param timeout_ms Maximum time to wait
+     * @param ready Receives the indices into @p ports that have data
+     * @return Number of ready ports, 0 on timeout, -1 on error
+     */
+    static int WaitForAny(const std::vector<Serial*>& ports, int timeout_ms,
+                          std::vector<size_t>& ready);
+
+    /**
+     * @brief Make a pending (or the next) WaitForData() return early
+     *
+     * Safe to call from any thread. The interrupted wait returns 0 as if
+     * it had timed out. Used to wake an I/O thread when it has new work.
+     */
+    void WakeUp();
+
     /**
      * @brief Read data into a vector
      * @param max_length Maximum number of bytes to read
@@ -96,6 +184,10 @@ public:
 
     /**
      * @brief Read until a specific byte is encountered or max_length is reached
+     *
+     * Reads ahead in blocks into an internal buffer and scans it for the
+     * terminator; bytes after it stay buffered for the next read call.
+     *
      * @param terminator Byte to stop reading at (inclusive)
      * @param max_length Maximum number of bytes to read
      * @return Vector containing read data including terminator (empty on error)
@@ -109,6 +201,14 @@ public:
      */
     std::string ReadLine(size_t max_length = 1024);
 
+    /**
+     * @brief Read a line into @p line, reusing its storage
+     * @param line Receives the line (without newline)
+     * @param max_length Maximum number of bytes to read
+     * @return true if any bytes were read, false on timeout or error
+     */
+    bool ReadLine(std::string& line, size_t max_length = 1024);
+
     /**
      * @brief Get the number of bytes available to read
      * @return Number of bytes available, -1 on error
@@ -121,6 +221,38 @@ public:
      */
     bool Flush();
 
+    /**
+     * @brief Change the baud rate of an open port
+     *
+     * Pending output is transmitted at the old rate first. The DTR/RTS
+     * lines are left untouched, so the attached MCU is not reset.
+     *
+     * @param baud_rate New baud rate
+     * @return true if successful, false otherwise (the old rate is kept)
+     */
+    bool SetBaudRate(int baud_rate);
+
+    /**
+     * @brief Whether the driver took the SerialConfig::low_latency request
+     *
+     * False for ports without a batching driver (ptys, CDC ACM devices),
+     * which are low latency already, and where it needs privileges.
+     */
+    bool IsLowLatency() const { return low_latency_; }
+
+    /**
+     * @brief Write-to-reply times measured since Open() or ResetRoundTrip()
+     */
+    const RoundTripStats& GetRoundTrip() const { return round_trip_; }
+
+    void ResetRoundTrip() { round_trip_ = RoundTripStats(); awaiting_reply_ = false; }
+
+    /**
+     * @brief Don't count the reply to the last write (e.g. an ACK that
+     * waits for a flash erase)
+     */
+    void IgnoreNextReply() { awaiting_reply_ = false; }
+
     /**
      * @brief Get the last error message
      * @return Error message string
@@ -183,6 +315,16 @@ public:
      */
     static std::vector<std::string> ListPorts();
 
+    /**
+     * @brief List available serial ports with their USB details
+     *
+     * Reads the OS device tree only; no port is opened, so attached boards
+     * are not reset or disturbed.
+     *
+     * @return Ports sorted by name
+     */
+    static std::vector<PortInfo> ListPortDetails();
+
     /**
      * @brief Check the status of a serial port without fully opening it
      * @param port_name Name of the port to check
@@ -190,21 +332,83 @@ public:
      */
     static PortStatus CheckPortStatus(const std::string& port_name);
 
+    /**
+     * @brief Check many ports at once without asserting their control lines
+     *
+     * On Linux no port is opened: a live UUCP lock file or an open file
+     * descriptor in /proc marks a port in use, and its permissions decide
+     * the rest. Other systems can only tell by opening the port, which
+     * raises DTR on most drivers; with @p allow_open those ports are
+     * opened as CheckPortStatus() does, all at once on their own threads.
+     *
+     * @param port_names Ports to check
+     * @param allow_open Open ports that can't be checked otherwise; if
+     *        false they are reported as UNKNOWN_ERROR
+     * @param timeout_ms Longest wait for an open (e.g. a Bluetooth port
+     *        connecting); a port still opening is UNKNOWN_ERROR
+     * @return One status per name, in order
+     */
+    static std::vector<PortStatus> CheckPortStatuses(const std::vector<std::string>& port_names,
+                                                     bool allow_open = true, int timeout_ms = 250);
+
 private:
+    /**
+     * @brief Status of the ports the OS can tell without opening them
+     *
+     * Sets statuses[i] and decided[i] for those; serial_<os>.cpp.
+     */
+    static void InspectPortStatuses(const std::vector<std::string>& port_names,
+                                    std::vector<PortStatus>& statuses, std::vector<bool>& decided);
+
     // Platform-specific handle
 #ifdef _WIN32
     void* handle_;  // HANDLE on Windows
+    void* wake_event_;  // Event set by WakeUp()
+    void* read_event_;  // OVERLAPPED events for Read() and Write()
+    void* write_event_;
 #else
     int fd_;  // File descriptor on POSIX systems
+    int wake_pipe_[2];  // Written by WakeUp(), watched next to fd_
+#endif
+#ifdef __APPLE__
+    int kq_;  // kqueue watching fd_ for input (-1 = fall back to select)
 #endif
 
     SerialConfig config_;
     std::string port_name_;
     std::string last_error_;
     bool is_open_;
+    bool low_latency_ = false;
+
+    // Round trip measurement: Write() starts a sample, the next read with
+    // data ends it
+    std::chrono::steady_clock::time_point write_time_;
+    bool awaiting_reply_ = false;
+    RoundTripStats round_trip_;
+
+    void NoteWrite();
+    void NoteRead();
+
+    // Read-ahead buffer for ReadUntil/ReadLine; Read() drains it first
+    std::vector<uint8_t> read_buffer_;
+    size_t read_begin_ = 0;
+    size_t read_end_ = 0;
+
+    size_t Buffered() const { return read_end_ - read_begin_; }
+    size_t TakeBuffered(uint8_t* buffer, size_t max_length);
+    void DiscardBuffered() { read_begin_ = read_end_ = 0; }
+
+    // Appends up to max_length bytes through the terminator to out
+    // (ReadUntil and ReadLine share this); returns false on timeout/error
+    template <typename Container>
+    bool ReadUntilInto(uint8_t terminator, size_t max_length, Container& out);
 
     // Platform-specific helper methods
     bool ConfigurePort();
+    bool SetLowLatency();  // Called by Open() when config_.low_latency is set
+#ifdef _WIN32
+    bool SetConfiguredTimeouts();
+#endif
     void SetError(const std::string& error);
 };
 
@@ -0,0 +1,173 @@
+#include "serial.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Platform-independent parts of Serial; the rest lives in serial_<os>.cpp
+
+namespace SimpleSerial {
+
+namespace {
+
+// Large enough that a burst of log lines arrives in one read() call
+constexpr size_t READ_BUFFER_SIZE = 16 * 1024;
+
+} // namespace
+
+void RoundTripStats::Add(double ms) {
+    if (count == 0 || ms < min_ms) {
+        min_ms = ms;
+    }
+    if (count == 0 || ms > max_ms) {
+        max_ms = ms;
+    }
+    total_ms += ms;
+    count++;
+}
+
+std::string RoundTripStats::Describe() const {
+    char text[128];
+    snprintf(text, sizeof(text), "%llu round trips, min %.2f ms, avg %.2f ms, max %.2f ms",
+             static_cast<unsigned long long>(count), min_ms, MeanMs(), max_ms);
+    return text;
+}
+
+void Serial::NoteWrite() {
+    if (!awaiting_reply_) {
+        write_time_ = std::chrono::steady_clock::now();
+        awaiting_reply_ = true;
+    }
+}
+
+void Serial::NoteRead() {
+    if (awaiting_reply_) {
+        awaiting_reply_ = false;
+        round_trip_.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - write_time_).count());
+    }
+}
+
+size_t Serial::TakeBuffered(uint8_t* buffer, size_t max_length) {
+    const size_t count = std::min(Buffered(), max_length);
+    if (count > 0) {
+        memcpy(buffer, read_buffer_.data() + read_begin_, count);
+        read_begin_ += count;
+    }
+    return count;
+}
+
+template <typename Container>
+bool Serial::ReadUntilInto(uint8_t terminator, size_t max_length, Container& out) {
+    if (read_buffer_.empty()) {
+        read_buffer_.resize(READ_BUFFER_SIZE);
+    }
+
+    size_t taken = 0;
+    while (taken < max_length) {
+        if (Buffered() == 0) {
+            // Refill with whatever has arrived, up to a whole block
+            int bytes_read = Read(read_buffer_.data(), read_buffer_.size());
+            if (bytes_read <= 0) {
+                break;
+            }
+            read_begin_ = 0;
+            read_end_ = static_cast<size_t>(bytes_read);
+        }
+
+        const uint8_t* begin = read_buffer_.data() + read_begin_;
+        const size_t length = std::min(Buffered(), max_length - taken);
+        const void* hit = memchr(begin, terminator, length);
+        const size_t count = hit ? static_cast<const uint8_t*>(hit) - begin + 1 : length;
+
+        out.insert(out.end(), begin, begin + count);
+        read_begin_ += count;
+        taken += count;
+        if (hit) {
+            break;
+        }
+    }
+    return taken > 0;
+}
+
+std::vector<uint8_t> Serial::ReadUntil(uint8_t terminator, size_t max_length) {
+    std::vector<uint8_t> result;
+    ReadUntilInto(terminator, max_length, result);
+    return result;
+}
+
+std::string Serial::ReadLine(size_t max_length) {
+    std::string line;
+    ReadLine(line, max_length);
+    return line;
+}
+
+bool Serial::ReadLine(std::string& line, size_t max_length) {
+    line.clear();
+    if (!ReadUntilInto('\n', max_length, line)) {
+        return false;
+    }
+
+    // Remove trailing \r\n if present
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+        line.pop_back();
+    }
+    return true;
+}
+
+std::vector<std::string> Serial::ListPorts() {
+    std::vector<std::string> ports;
+    for (const auto& port : ListPortDetails()) {
+        ports.push_back(port.name);
+    }
+    return ports;
+}
+
+std::vector<PortStatus> Serial::CheckPortStatuses(const std::vector<std::string>& port_names,
+                                                  bool allow_open, int timeout_ms) {
+    std::vector<PortStatus> statuses(port_names.size(), PortStatus::UNKNOWN_ERROR);
+    std::vector<bool> decided(port_names.size(), false);
+    InspectPortStatuses(port_names, statuses, decided);
+    if (!allow_open) {
+        return statuses;
+    }
+
+    // The probes share this with the caller; one stuck in open() past the
+    // timeout is left to finish on its own
+    struct Probes {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::vector<PortStatus> statuses;
+        std::vector<bool> finished;
+        size_t pending = 0;
+    };
+    auto probes = std::make_shared<Probes>();
+    probes->statuses = statuses;
+    probes->finished = decided;
+    for (size_t i = 0; i < port_names.size(); i++) {
+        if (decided[i]) {
+            continue;
+        }
+        probes->pending++;
+        std::thread([probes, i, name = port_names[i]] {
+            const PortStatus status = CheckPortStatus(name);
+            std::lock_guard<std::mutex> lock(probes->mutex);
+            probes->statuses[i] = status;
+            probes->finished[i] = true;
+            if (--probes->pending == 0) {
+                probes->done.notify_all();
+            }
+        }).detach();
+    }
+
+    std::unique_lock<std::mutex> lock(probes->mutex);
+    probes->done.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&probes] { return probes->pending == 0; });
+    for (size_t i = 0; i < port_names.size(); i++) {
+        statuses[i] = probes->finished[i] ? probes->statuses[i] : PortStatus::UNKNOWN_ERROR;
+    }
+    return statuses;
+}
+
+} // namespace SimpleSerial
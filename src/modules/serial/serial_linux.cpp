@@ -1,18 +1,53 @@
 #include "serial.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
+#include <linux/serial.h>
+#include <poll.h>
 #include <dirent.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
 
 namespace SimpleSerial {
 
+namespace {
+
+// First line of a sysfs attribute, "" if missing
+std::string ReadSysfs(const std::string& path) {
+    std::ifstream file(path);
+    std::string value;
+    std::getline(file, value);
+    while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+        value.pop_back();
+    }
+    return value;
+}
+
+std::string Basename(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Pseudo-terminals (bootloader emulators, socat) have no parity or modem lines
+bool IsPseudoTerminal(int fd) {
+    const char* name = ttyname(fd);
+    return name != nullptr && strncmp(name, "/dev/pts/", 9) == 0;
+}
+
+} // namespace
+
 Serial::Serial()
     : fd_(-1)
+    , wake_pipe_{-1, -1}
     , is_open_(false)
 {
 }
@@ -44,10 +79,20 @@ bool Serial::Open(const std::string& port_name, const SerialConfig& config) {
         fd_ = -1;
         return false;
     }
+    low_latency_ = config_.low_latency && SetLowLatency();
+    ResetRoundTrip();
 
     // Set non-blocking mode
     fcntl(fd_, F_SETFL, 0);
 
+    // Self-pipe for WakeUp(); both ends non-blocking so neither side stalls
+    if (pipe(wake_pipe_) == 0) {
+        fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_pipe_[1], F_SETFL, O_NONBLOCK);
+    } else {
+        wake_pipe_[0] = wake_pipe_[1] = -1;
+    }
+
     is_open_ = true;
     return true;
 }
@@ -62,9 +107,25 @@ void Serial::Close() {
         fd_ = -1;
     }
 
+    for (int& end : wake_pipe_) {
+        if (end != -1) {
+            close(end);
+            end = -1;
+        }
+    }
+
+    DiscardBuffered();
     is_open_ = false;
 }
 
+void Serial::WakeUp() {
+    if (wake_pipe_[1] != -1) {
+        const uint8_t byte = 0;
+        // A full pipe already guarantees a wake-up
+        (void)write(wake_pipe_[1], &byte, 1);
+    }
+}
+
 bool Serial::IsOpen() const {
     return is_open_;
 }
@@ -80,6 +141,7 @@ int Serial::Write(const uint8_t* data, size_t length) {
         SetError("Write failed: " + std::string(strerror(errno)));
         return -1;
     }
+    NoteWrite();
     return result;
 }
 
@@ -92,31 +154,24 @@ int Serial::Write(const std::vector<uint8_t>& data) {
 }
 
 int Serial::Read(uint8_t* buffer, size_t max_length) {
+    return Read(buffer, max_length, config_.timeout_ms);
+}
+
+int Serial::Read(uint8_t* buffer, size_t max_length, int timeout_ms) {
     if (!is_open_) {
         SetError("Serial port not open");
         return -1;
     }
 
-    // Use select() for timeout
-    fd_set read_fds;
-    struct timeval timeout;
-
-    FD_ZERO(&read_fds);
-    FD_SET(fd_, &read_fds);
-
-    timeout.tv_sec = config_.timeout_ms / 1000;
-    timeout.tv_usec = (config_.timeout_ms % 1000) * 1000;
-
-    int select_result = select(fd_ + 1, &read_fds, NULL, NULL, &timeout);
-
-    if (select_result < 0) {
-        SetError("Select failed: " + std::string(strerror(errno)));
-        return -1;
+    // Bytes read ahead by ReadUntil() come first
+    if (size_t buffered = TakeBuffered(buffer, max_length)) {
+        return static_cast<int>(buffered);
     }
 
-    if (select_result == 0) {
-        // Timeout
-        return 0;
+    int ready = WaitForData(timeout_ms);
+    if (ready <= 0) {
+        // Timeout or error
+        return ready;
     }
 
     ssize_t result = read(fd_, buffer, max_length);
@@ -124,56 +179,94 @@ int Serial::Read(uint8_t* buffer, size_t max_length) {
         SetError("Read failed: " + std::string(strerror(errno)));
         return -1;
     }
+    if (result > 0) {
+        NoteRead();
+    }
 
     return result;
 }
 
-std::vector<uint8_t> Serial::Read(size_t max_length) {
-    std::vector<uint8_t> buffer(max_length);
-    int bytes_read = Read(buffer.data(), max_length);
-
-    if (bytes_read <= 0) {
-        return std::vector<uint8_t>();
+int Serial::WaitForData(int timeout_ms) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return -1;
     }
 
-    buffer.resize(bytes_read);
-    return buffer;
-}
-
-std::vector<uint8_t> Serial::ReadUntil(uint8_t terminator, size_t max_length) {
-    std::vector<uint8_t> result;
-    uint8_t byte;
+    if (Buffered() > 0) {
+        return 1;
+    }
 
-    while (result.size() < max_length) {
-        int bytes_read = Read(&byte, 1);
+    // poll() on the port and the wake-up pipe; the thread sleeps in the
+    // kernel until the tty driver queues input or WakeUp() is called
+    struct pollfd pfds[2];
+    pfds[0].fd = fd_;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    pfds[1].fd = wake_pipe_[0];
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
 
-        if (bytes_read <= 0) {
-            break;
+    int result = poll(pfds, wake_pipe_[0] != -1 ? 2 : 1, timeout_ms);
+    if (result < 0 && errno == EINTR) {
+        return 0;  // Interrupted by a signal, same as a timeout
+    }
+    if (result < 0) {
+        SetError("Poll failed: " + std::string(strerror(errno)));
+        return -1;
+    }
+    if (pfds[1].revents & POLLIN) {
+        uint8_t drain[64];
+        while (read(wake_pipe_[0], drain, sizeof(drain)) > 0) {
         }
+    }
+    if ((pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) && !(pfds[0].revents & POLLIN)) {
+        SetError("Serial port disconnected");
+        return -1;
+    }
+    result = (pfds[0].revents & POLLIN) ? 1 : 0;
+    return result > 0 ? 1 : 0;
+}
 
-        result.push_back(byte);
-
-        if (byte == terminator) {
-            break;
+int Serial::WaitForAny(const std::vector<Serial*>& ports, int timeout_ms,
+                       std::vector<size_t>& ready) {
+    ready.clear();
+    std::vector<struct pollfd> pfds(ports.size());
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (ports[i]->Buffered() > 0) {
+            ready.push_back(i);
         }
+        pfds[i].fd = ports[i]->fd_;
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+    if (!ready.empty()) {
+        return static_cast<int>(ready.size());
     }
 
-    return result;
+    int result = poll(pfds.data(), pfds.size(), timeout_ms);
+    if (result < 0) {
+        // A signal (e.g. Ctrl+C) counts as a timeout
+        return errno == EINTR ? 0 : -1;
+    }
+    for (size_t i = 0; i < pfds.size(); i++) {
+        // Hang-ups are reported too, so the caller's Read() sees the error
+        if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)) {
+            ready.push_back(i);
+        }
+    }
+    return static_cast<int>(ready.size());
 }
 
-std::string Serial::ReadLine(size_t max_length) {
-    auto data = ReadUntil('\n', max_length);
-
-    if (data.empty()) {
-        return "";
-    }
+std::vector<uint8_t> Serial::Read(size_t max_length) {
+    std::vector<uint8_t> buffer(max_length);
+    int bytes_read = Read(buffer.data(), max_length);
 
-    // Remove trailing \r\n if present
-    while (!data.empty() && (data.back() == '\n' || data.back() == '\r')) {
-        data.pop_back();
+    if (bytes_read <= 0) {
+        return std::vector<uint8_t>();
     }
 
-    return std::string(data.begin(), data.end());
+    buffer.resize(bytes_read);
+    return buffer;
 }
 
 int Serial::Available() const {
@@ -185,7 +278,7 @@ int Serial::Available() const {
     if (ioctl(fd_, FIONREAD, &bytes_available) < 0) {
         return -1;
     }
-    return bytes_available;
+    return bytes_available + static_cast<int>(Buffered());
 }
 
 bool Serial::Flush() {
@@ -193,9 +286,30 @@ bool Serial::Flush() {
         return false;
     }
 
+    DiscardBuffered();
     return tcflush(fd_, TCIOFLUSH) == 0;
 }
 
+bool Serial::SetBaudRate(int baud_rate) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return false;
+    }
+
+    tcdrain(fd_);
+
+    const int previous = config_.baud_rate;
+    config_.baud_rate = baud_rate;
+    if (!ConfigurePort()) {
+        const std::string error = last_error_;
+        config_.baud_rate = previous;
+        ConfigurePort();
+        SetError(error);
+        return false;
+    }
+    return true;
+}
+
 std::string Serial::GetLastError() const {
     return last_error_;
 }
@@ -208,6 +322,9 @@ bool Serial::SetDTR(bool state) {
 
     int status;
     if (ioctl(fd_, TIOCMGET, &status) < 0) {
+        if (IsPseudoTerminal(fd_)) {
+            return true;  // Nothing to drive
+        }
         SetError("Failed to get modem status: " + std::string(strerror(errno)));
         return false;
     }
@@ -234,6 +351,9 @@ bool Serial::SetRTS(bool state) {
 
     int status;
     if (ioctl(fd_, TIOCMGET, &status) < 0) {
+        if (IsPseudoTerminal(fd_)) {
+            return true;  // Nothing to drive
+        }
         SetError("Failed to get modem status: " + std::string(strerror(errno)));
         return false;
     }
@@ -362,24 +482,83 @@ bool Serial::PulseRTS(int duration_ms, bool active_low) {
     return true;
 }
 
-std::vector<std::string> Serial::ListPorts() {
-    std::vector<std::string> ports;
+std::vector<PortInfo> Serial::ListPortDetails() {
+    std::vector<PortInfo> ports;
+
+    // Every tty the kernel knows is in /sys/class/tty; those backed by
+    // hardware have a device link (virtual consoles and ptys do not)
+    DIR* dir = opendir("/sys/class/tty");
+    if (!dir) {
+        return ports;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+
+        char resolved[PATH_MAX];
+        std::string tty = "/sys/class/tty/" + name;
+        if (!realpath((tty + "/device").c_str(), resolved)) {
+            continue;
+        }
+        std::string device = resolved;
+
+        // Linux 6.5+ puts serial-base "port" and "ctrl" devices between the
+        // tty and its UART
+        while (realpath((device + "/subsystem").c_str(), resolved) &&
+               Basename(resolved) == "serial-base") {
+            device = device.substr(0, device.rfind('/'));
+        }
+
+        // The 8250 driver registers placeholder ttyS ports whether or not a
+        // UART exists; real ones belong to a pnp/pci device instead
+        std::string driver;
+        if (realpath((device + "/driver").c_str(), resolved)) {
+            driver = Basename(resolved);
+        }
+        if (driver == "serial8250") {
+            continue;
+        }
 
-    // Linux: Check /dev/ttyUSB*, /dev/ttyACM*, /dev/ttyS*
-    DIR* dir = opendir("/dev");
-    if (dir) {
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-            std::string name = entry->d_name;
-            if (name.find("ttyUSB") == 0 ||
-                name.find("ttyACM") == 0 ||
-                name.find("ttyS") == 0) {
-                ports.push_back("/dev/" + name);
+        PortInfo port;
+        port.name = "/dev/" + name;
+        if (access(port.name.c_str(), F_OK) != 0) {
+            continue;  // Node not created (yet) by udev
+        }
+        port.description = driver;
+
+        // Walk up to the USB device: ttyACM's device is the interface,
+        // ttyUSB's is a child of it
+        std::string interface;
+        for (std::string path = device; path.size() > sizeof("/sys/devices");
+             path = path.substr(0, path.rfind('/'))) {
+            if (interface.empty() && access((path + "/bInterfaceNumber").c_str(), F_OK) == 0) {
+                interface = Basename(path);
+            }
+            if (access((path + "/idVendor").c_str(), F_OK) != 0) {
+                continue;
             }
+            port.vid = static_cast<uint16_t>(strtoul(ReadSysfs(path + "/idVendor").c_str(), NULL, 16));
+            port.pid = static_cast<uint16_t>(strtoul(ReadSysfs(path + "/idProduct").c_str(), NULL, 16));
+            port.serial_number = ReadSysfs(path + "/serial");
+            port.manufacturer = ReadSysfs(path + "/manufacturer");
+            std::string product = ReadSysfs(path + "/product");
+            if (!product.empty()) {
+                port.description = product;
+            }
+            port.location = interface.empty() ? Basename(path) : interface;
+            break;
         }
-        closedir(dir);
+
+        ports.push_back(port);
     }
+    closedir(dir);
 
+    std::sort(ports.begin(), ports.end(),
+              [](const PortInfo& a, const PortInfo& b) { return a.name < b.name; });
     return ports;
 }
 
@@ -403,6 +582,98 @@ PortStatus Serial::CheckPortStatus(const std::string& port_name) {
     return PortStatus::UNKNOWN_ERROR;
 }
 
+void Serial::InspectPortStatuses(const std::vector<std::string>& port_names,
+                                 std::vector<PortStatus>& statuses, std::vector<bool>& decided) {
+    // The device node each name leads to, so /dev/serial/by-id links
+    // match the tty a process opened
+    std::vector<std::string> devices(port_names.size());
+    bool any = false;
+    for (size_t i = 0; i < port_names.size(); i++) {
+        struct stat info;
+        char real[PATH_MAX];
+        if (stat(port_names[i].c_str(), &info) != 0 || !S_ISCHR(info.st_mode) ||
+            realpath(port_names[i].c_str(), real) == NULL) {
+            statuses[i] = errno == EACCES ? PortStatus::NO_PERMISSION : PortStatus::UNKNOWN_ERROR;
+            decided[i] = true;
+            continue;
+        }
+        devices[i] = real;
+        any = true;
+    }
+    if (!any) {
+        return;
+    }
+
+    // Ports another process has open: one pass over /proc for all of
+    // them, reading the fd links only (a stat() could hang on a network
+    // mount). Other users' processes can't be read; a tty open there goes
+    // unseen unless it also has a lock file
+    std::vector<bool> open_elsewhere(port_names.size(), false);
+    if (DIR* proc = opendir("/proc")) {
+        while (struct dirent* process = readdir(proc)) {
+            if (process->d_name[0] < '0' || process->d_name[0] > '9') {
+                continue;
+            }
+            const std::string fd_path = std::string("/proc/") + process->d_name + "/fd/";
+            DIR* fds = opendir(fd_path.c_str());
+            if (fds == NULL) {
+                continue;
+            }
+            while (struct dirent* fd = readdir(fds)) {
+                char target[PATH_MAX];
+                const ssize_t length = readlink((fd_path + fd->d_name).c_str(), target, sizeof(target) - 1);
+                if (length <= 5 || strncmp(target, "/dev/", 5) != 0) {
+                    continue;
+                }
+                target[length] = '\0';
+                for (size_t i = 0; i < port_names.size(); i++) {
+                    if (!decided[i] && devices[i] == target) {
+                        open_elsewhere[i] = true;
+                    }
+                }
+            }
+            closedir(fds);
+        }
+        closedir(proc);
+    }
+
+    // UUCP lock files (minicom, screen, ModemManager): the owner's PID in
+    // ASCII, or as a binary int from old tools; a dead owner's is stale
+    auto locked = [](const std::string& device) {
+        for (const char* dir : {"/run/lock", "/var/lock", "/var/spool/lock"}) {
+            std::ifstream file(std::string(dir) + "/LCK.." + Basename(device), std::ios::binary);
+            if (!file) {
+                continue;
+            }
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            long pid = strtol(content.c_str(), NULL, 10);
+            if (pid <= 0 && content.size() == sizeof(int)) {
+                int binary;
+                memcpy(&binary, content.data(), sizeof(binary));
+                pid = binary;
+            }
+            if (pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (size_t i = 0; i < port_names.size(); i++) {
+        if (decided[i]) {
+            continue;
+        }
+        if (open_elsewhere[i] || locked(devices[i])) {
+            statuses[i] = PortStatus::IN_USE;
+        } else if (access(devices[i].c_str(), R_OK | W_OK) != 0) {
+            statuses[i] = errno == EACCES || errno == EPERM ? PortStatus::NO_PERMISSION : PortStatus::UNKNOWN_ERROR;
+        } else {
+            statuses[i] = PortStatus::AVAILABLE;
+        }
+        decided[i] = true;
+    }
+}
+
 bool Serial::ConfigurePort() {
     struct termios tty;
     memset(&tty, 0, sizeof(tty));
@@ -421,6 +692,11 @@ bool Serial::ConfigurePort() {
         case 57600: baud = B57600; break;
         case 115200: baud = B115200; break;
         case 230400: baud = B230400; break;
+        case 460800: baud = B460800; break;
+        case 921600: baud = B921600; break;
+        case 1000000: baud = B1000000; break;
+        case 1500000: baud = B1500000; break;
+        case 2000000: baud = B2000000; break;
         default:
             SetError("Unsupported baud rate: " + std::to_string(config_.baud_rate));
             return false;
@@ -478,6 +754,9 @@ bool Serial::ConfigurePort() {
     // Input flags - disable software flow control
     tty.c_iflag &= ~(IXON | IXOFF | IXANY);
 
+    // No input translation: pass CR, NL, breaks and bit 7 through untouched
+    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+
     // Disable canonical mode, echo, and signals
     tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
 
@@ -489,13 +768,46 @@ bool Serial::ConfigurePort() {
     tty.c_cc[VTIME] = config_.timeout_ms / 100;
 
     if (tcsetattr(fd_, TCSANOW, &tty) != 0) {
-        SetError("Failed to set terminal attributes: " + std::string(strerror(errno)));
-        return false;
+        // Linux ptys reject PARENB; the byte stream is the same without it
+        const bool pty_parity = errno == EINVAL && (tty.c_cflag & PARENB) && IsPseudoTerminal(fd_);
+        tty.c_cflag &= ~(PARENB | PARODD);
+        if (!pty_parity || tcsetattr(fd_, TCSANOW, &tty) != 0) {
+            SetError("Failed to set terminal attributes: " + std::string(strerror(errno)));
+            return false;
+        }
     }
 
     return true;
 }
 
+// FTDI adapters hold received bytes for their latency timer (16 ms by
+// default) unless a USB packet fills up; ftdi_sio lowers it to 1 ms for
+// ASYNC_LOW_LATENCY. If the flag is refused, a udev rule may still have
+// made the timer itself writable.
+bool Serial::SetLowLatency() {
+    bool applied = false;
+    struct serial_struct info;
+    memset(&info, 0, sizeof(info));
+    if (ioctl(fd_, TIOCGSERIAL, &info) == 0) {
+        info.flags |= ASYNC_LOW_LATENCY;
+        applied = ioctl(fd_, TIOCSSERIAL, &info) == 0;
+    }
+
+    // By name of the tty itself, not of a /dev/serial/by-id link to it
+    char tty[PATH_MAX];
+    const std::string name = realpath(port_name_.c_str(), tty) != nullptr ? tty : port_name_;
+    const std::string timer = "/sys/class/tty/" + Basename(name) + "/device/latency_timer";
+    const std::string value = ReadSysfs(timer);
+    if (!value.empty()) {
+        if (value != "1") {
+            std::ofstream file(timer);
+            file << "1\n";
+        }
+        applied = ReadSysfs(timer) == "1";
+    }
+    return applied;
+}
+
 void Serial::SetError(const std::string& error) {
     last_error_ = error;
 }
@@ -1,4 +1,6 @@
 #include "serial.h"
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <fcntl.h>
@@ -6,13 +8,61 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
-#include <dirent.h>
+#include <sys/event.h>
 #include <errno.h>
+#include <IOKit/serial/ioss.h>
+#include <IOKit/IOBSD.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/serial/IOSerialKeys.h>
+#include <CoreFoundation/CoreFoundation.h>
 
 namespace SimpleSerial {
 
+namespace {
+
+// Property of @p service, or of its nearest ancestor having it if
+// @p search_parents (USB strings live on the IOUSBHostDevice)
+std::string RegistryString(io_object_t service, CFStringRef key, bool search_parents) {
+    CFTypeRef value = search_parents
+        ? IORegistryEntrySearchCFProperty(service, kIOServicePlane, key, kCFAllocatorDefault,
+                                          kIORegistryIterateRecursively | kIORegistryIterateParents)
+        : IORegistryEntryCreateCFProperty(service, key, kCFAllocatorDefault, 0);
+    if (!value) {
+        return "";
+    }
+    std::string result;
+    if (CFGetTypeID(value) == CFStringGetTypeID()) {
+        char buffer[256];
+        if (CFStringGetCString(static_cast<CFStringRef>(value), buffer, sizeof(buffer),
+                               kCFStringEncodingUTF8)) {
+            result = buffer;
+        }
+    }
+    CFRelease(value);
+    return result;
+}
+
+uint64_t RegistryNumber(io_object_t service, CFStringRef key) {
+    CFTypeRef value = IORegistryEntrySearchCFProperty(
+        service, kIOServicePlane, key, kCFAllocatorDefault,
+        kIORegistryIterateRecursively | kIORegistryIterateParents);
+    if (!value) {
+        return 0;
+    }
+    int64_t result = 0;
+    if (CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue(static_cast<CFNumberRef>(value), kCFNumberSInt64Type, &result);
+    }
+    CFRelease(value);
+    return static_cast<uint64_t>(result);
+}
+
+} // namespace
+
 Serial::Serial()
     : fd_(-1)
+    , wake_pipe_{-1, -1}
+    , kq_(-1)
     , is_open_(false)
 {
 }
@@ -44,10 +94,35 @@ bool Serial::Open(const std::string& port_name, const SerialConfig& config) {
         fd_ = -1;
         return false;
     }
+    low_latency_ = config_.low_latency && SetLowLatency();
+    ResetRoundTrip();
 
     // Set non-blocking mode
     fcntl(fd_, F_SETFL, 0);
 
+    // Self-pipe for WakeUp(); both ends non-blocking so neither side stalls
+    if (pipe(wake_pipe_) == 0) {
+        fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_pipe_[1], F_SETFL, O_NONBLOCK);
+    } else {
+        wake_pipe_[0] = wake_pipe_[1] = -1;
+    }
+
+    // Wake on input through kqueue; older drivers that reject it use select()
+    kq_ = kqueue();
+    if (kq_ != -1) {
+        struct kevent events[2];
+        int count = 0;
+        EV_SET(&events[count++], fd_, EVFILT_READ, EV_ADD, 0, 0, NULL);
+        if (wake_pipe_[0] != -1) {
+            EV_SET(&events[count++], wake_pipe_[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+        }
+        if (kevent(kq_, events, count, NULL, 0, NULL) != 0) {
+            close(kq_);
+            kq_ = -1;
+        }
+    }
+
     is_open_ = true;
     return true;
 }
@@ -57,14 +132,35 @@ void Serial::Close() {
         return;
     }
 
+    if (kq_ != -1) {
+        close(kq_);
+        kq_ = -1;
+    }
+
     if (fd_ != -1) {
         close(fd_);
         fd_ = -1;
     }
 
+    for (int& end : wake_pipe_) {
+        if (end != -1) {
+            close(end);
+            end = -1;
+        }
+    }
+
+    DiscardBuffered();
     is_open_ = false;
 }
 
+void Serial::WakeUp() {
+    if (wake_pipe_[1] != -1) {
+        const uint8_t byte = 0;
+        // A full pipe already guarantees a wake-up
+        (void)write(wake_pipe_[1], &byte, 1);
+    }
+}
+
 bool Serial::IsOpen() const {
     return is_open_;
 }
@@ -80,6 +176,7 @@ int Serial::Write(const uint8_t* data, size_t length) {
         SetError("Write failed: " + std::string(strerror(errno)));
         return -1;
     }
+    NoteWrite();
     return result;
 }
 
@@ -92,31 +189,24 @@ int Serial::Write(const std::vector<uint8_t>& data) {
 }
 
 int Serial::Read(uint8_t* buffer, size_t max_length) {
+    return Read(buffer, max_length, config_.timeout_ms);
+}
+
+int Serial::Read(uint8_t* buffer, size_t max_length, int timeout_ms) {
     if (!is_open_) {
         SetError("Serial port not open");
         return -1;
     }
 
-    // Use select() for timeout
-    fd_set read_fds;
-    struct timeval timeout;
-
-    FD_ZERO(&read_fds);
-    FD_SET(fd_, &read_fds);
-
-    timeout.tv_sec = config_.timeout_ms / 1000;
-    timeout.tv_usec = (config_.timeout_ms % 1000) * 1000;
-
-    int select_result = select(fd_ + 1, &read_fds, NULL, NULL, &timeout);
-
-    if (select_result < 0) {
-        SetError("Select failed: " + std::string(strerror(errno)));
-        return -1;
+    // Bytes read ahead by ReadUntil() come first
+    if (size_t buffered = TakeBuffered(buffer, max_length)) {
+        return static_cast<int>(buffered);
     }
 
-    if (select_result == 0) {
-        // Timeout
-        return 0;
+    int ready = WaitForData(timeout_ms);
+    if (ready <= 0) {
+        // Timeout or error
+        return ready;
     }
 
     ssize_t result = read(fd_, buffer, max_length);
@@ -124,56 +214,135 @@ int Serial::Read(uint8_t* buffer, size_t max_length) {
         SetError("Read failed: " + std::string(strerror(errno)));
         return -1;
     }
+    if (result > 0) {
+        NoteRead();
+    }
 
     return result;
 }
 
-std::vector<uint8_t> Serial::Read(size_t max_length) {
-    std::vector<uint8_t> buffer(max_length);
-    int bytes_read = Read(buffer.data(), max_length);
-
-    if (bytes_read <= 0) {
-        return std::vector<uint8_t>();
+int Serial::WaitForData(int timeout_ms) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return -1;
     }
 
-    buffer.resize(bytes_read);
-    return buffer;
-}
+    if (Buffered() > 0) {
+        return 1;
+    }
 
-std::vector<uint8_t> Serial::ReadUntil(uint8_t terminator, size_t max_length) {
-    std::vector<uint8_t> result;
-    uint8_t byte;
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000;
 
-    while (result.size() < max_length) {
-        int bytes_read = Read(&byte, 1);
+    bool readable = false;
+    bool woken = false;
+    bool eof = false;
 
-        if (bytes_read <= 0) {
-            break;
+    if (kq_ != -1) {
+        // fd_ and the wake-up pipe were registered with EVFILT_READ in
+        // Open(); level-triggered, so bytes left unread still report ready
+        struct kevent events[2];
+        int result = kevent(kq_, NULL, 0, events, 2, &timeout);
+        if (result < 0 && errno == EINTR) {
+            return 0;  // Interrupted by a signal, same as a timeout
+        }
+        if (result < 0) {
+            SetError("kevent failed: " + std::string(strerror(errno)));
+            return -1;
+        }
+        for (int i = 0; i < result; i++) {
+            if (static_cast<int>(events[i].ident) == fd_) {
+                readable = events[i].data > 0;
+                eof = (events[i].flags & EV_EOF) && events[i].data == 0;
+            } else {
+                woken = true;
+            }
+        }
+    } else {
+        // Fallback for devices kqueue refused
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd_, &read_fds);
+        int max_fd = fd_;
+        if (wake_pipe_[0] != -1) {
+            FD_SET(wake_pipe_[0], &read_fds);
+            max_fd = std::max(max_fd, wake_pipe_[0]);
         }
 
-        result.push_back(byte);
+        struct timeval tv;
+        tv.tv_sec = timeout.tv_sec;
+        tv.tv_usec = timeout.tv_nsec / 1000;
 
-        if (byte == terminator) {
-            break;
+        int result = select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+        if (result < 0 && errno == EINTR) {
+            return 0;
         }
+        if (result < 0) {
+            SetError("Select failed: " + std::string(strerror(errno)));
+            return -1;
+        }
+        readable = FD_ISSET(fd_, &read_fds);
+        woken = wake_pipe_[0] != -1 && FD_ISSET(wake_pipe_[0], &read_fds);
     }
 
-    return result;
+    if (woken) {
+        uint8_t drain[64];
+        while (read(wake_pipe_[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+    if (eof) {
+        SetError("Serial port disconnected");
+        return -1;
+    }
+    return readable ? 1 : 0;
 }
 
-std::string Serial::ReadLine(size_t max_length) {
-    auto data = ReadUntil('\n', max_length);
+int Serial::WaitForAny(const std::vector<Serial*>& ports, int timeout_ms,
+                       std::vector<size_t>& ready) {
+    ready.clear();
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    int max_fd = -1;
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (ports[i]->Buffered() > 0) {
+            ready.push_back(i);
+        }
+        FD_SET(ports[i]->fd_, &read_fds);
+        max_fd = std::max(max_fd, ports[i]->fd_);
+    }
+    if (!ready.empty()) {
+        return static_cast<int>(ready.size());
+    }
 
-    if (data.empty()) {
-        return "";
+    // The per-port kqueues can't be combined, and select() covers a
+    // handful of ports just as well
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    int result = select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+    if (result < 0) {
+        // A signal (e.g. Ctrl+C) counts as a timeout
+        return errno == EINTR ? 0 : -1;
     }
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (FD_ISSET(ports[i]->fd_, &read_fds)) {
+            ready.push_back(i);
+        }
+    }
+    return static_cast<int>(ready.size());
+}
+
+std::vector<uint8_t> Serial::Read(size_t max_length) {
+    std::vector<uint8_t> buffer(max_length);
+    int bytes_read = Read(buffer.data(), max_length);
 
-    // Remove trailing \r\n if present
-    while (!data.empty() && (data.back() == '\n' || data.back() == '\r')) {
-        data.pop_back();
+    if (bytes_read <= 0) {
+        return std::vector<uint8_t>();
     }
 
-    return std::string(data.begin(), data.end());
+    buffer.resize(bytes_read);
+    return buffer;
 }
 
 int Serial::Available() const {
@@ -185,7 +354,7 @@ int Serial::Available() const {
     if (ioctl(fd_, FIONREAD, &bytes_available) < 0) {
         return -1;
     }
-    return bytes_available;
+    return bytes_available + static_cast<int>(Buffered());
 }
 
 bool Serial::Flush() {
@@ -193,9 +362,30 @@ bool Serial::Flush() {
         return false;
     }
 
+    DiscardBuffered();
     return tcflush(fd_, TCIOFLUSH) == 0;
 }
 
+bool Serial::SetBaudRate(int baud_rate) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return false;
+    }
+
+    tcdrain(fd_);
+
+    const int previous = config_.baud_rate;
+    config_.baud_rate = baud_rate;
+    if (!ConfigurePort()) {
+        const std::string error = last_error_;
+        config_.baud_rate = previous;
+        ConfigurePort();
+        SetError(error);
+        return false;
+    }
+    return true;
+}
+
 std::string Serial::GetLastError() const {
     return last_error_;
 }
@@ -362,22 +552,54 @@ bool Serial::PulseRTS(int duration_ms, bool active_low) {
     return true;
 }
 
-std::vector<std::string> Serial::ListPorts() {
-    std::vector<std::string> ports;
+std::vector<PortInfo> Serial::ListPortDetails() {
+    std::vector<PortInfo> ports;
+
+    // Every serial device registers an IOSerialBSDClient service carrying
+    // its /dev/cu.* and /dev/tty.* names; the USB device is an ancestor
+    CFMutableDictionaryRef matching = IOServiceMatching(kIOSerialBSDServiceValue);
+    if (!matching) {
+        return ports;
+    }
+    CFDictionarySetValue(matching, CFSTR(kIOSerialBSDTypeKey), CFSTR(kIOSerialBSDAllTypes));
+
+    io_iterator_t services = IO_OBJECT_NULL;
+    if (IOServiceGetMatchingServices(MACH_PORT_NULL, matching, &services) != KERN_SUCCESS) {
+        return ports;
+    }
+
+    io_object_t service;
+    while ((service = IOIteratorNext(services)) != IO_OBJECT_NULL) {
+        PortInfo port;
+        port.description = RegistryString(service, CFSTR(kIOTTYDeviceKey), false);
+        port.vid = static_cast<uint16_t>(RegistryNumber(service, CFSTR("idVendor")));
+        port.pid = static_cast<uint16_t>(RegistryNumber(service, CFSTR("idProduct")));
+        if (port.IsUsb()) {
+            port.serial_number = RegistryString(service, CFSTR("USB Serial Number"), true);
+            port.manufacturer = RegistryString(service, CFSTR("USB Vendor Name"), true);
+            std::string product = RegistryString(service, CFSTR("USB Product Name"), true);
+            if (!product.empty()) {
+                port.description = product;
+            }
+            char location[16];
+            snprintf(location, sizeof(location), "0x%08llx",
+                     static_cast<unsigned long long>(RegistryNumber(service, CFSTR("locationID"))));
+            port.location = location;
+        }
 
-    // macOS: Check /dev/tty.* and /dev/cu.*
-    DIR* dir = opendir("/dev");
-    if (dir) {
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-            std::string name = entry->d_name;
-            if (name.find("tty.") == 0 || name.find("cu.") == 0) {
-                ports.push_back("/dev/" + name);
+        // List both the callout (cu.*) and dial-in (tty.*) nodes, as /dev does
+        for (CFStringRef key : {CFSTR(kIOCalloutDeviceKey), CFSTR(kIODialinDeviceKey)}) {
+            port.name = RegistryString(service, key, false);
+            if (!port.name.empty()) {
+                ports.push_back(port);
             }
         }
-        closedir(dir);
+        IOObjectRelease(service);
     }
+    IOObjectRelease(services);
 
+    std::sort(ports.begin(), ports.end(),
+              [](const PortInfo& a, const PortInfo& b) { return a.name < b.name; });
     return ports;
 }
 
@@ -401,6 +623,15 @@ PortStatus Serial::CheckPortStatus(const std::string& port_name) {
     return PortStatus::UNKNOWN_ERROR;
 }
 
+// macOS keeps no record of which process has a tty open that a user
+// process can read, so every port is left to an open
+void Serial::InspectPortStatuses(const std::vector<std::string>& port_names,
+                                 std::vector<PortStatus>& statuses, std::vector<bool>& decided) {
+    (void)port_names;
+    (void)statuses;
+    (void)decided;
+}
+
 bool Serial::ConfigurePort() {
     struct termios tty;
     memset(&tty, 0, sizeof(tty));
@@ -420,8 +651,13 @@ bool Serial::ConfigurePort() {
         case 115200: baud = B115200; break;
         case 230400: baud = B230400; break;
         default:
-            SetError("Unsupported baud rate: " + std::to_string(config_.baud_rate));
-            return false;
+            // Higher rates are set through IOSSIOSPEED once tcsetattr is done
+            if (config_.baud_rate <= 230400) {
+                SetError("Unsupported baud rate: " + std::to_string(config_.baud_rate));
+                return false;
+            }
+            baud = B230400;
+            break;
     }
 
     cfsetispeed(&tty, baud);
@@ -476,6 +712,9 @@ bool Serial::ConfigurePort() {
     // Input flags - disable software flow control
     tty.c_iflag &= ~(IXON | IXOFF | IXANY);
 
+    // No input translation: pass CR, NL, breaks and bit 7 through untouched
+    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+
     // Disable canonical mode, echo, and signals
     tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
 
@@ -491,9 +730,24 @@ bool Serial::ConfigurePort() {
         return false;
     }
 
+    if (config_.baud_rate > 230400) {
+        speed_t speed = config_.baud_rate;
+        if (ioctl(fd_, IOSSIOSPEED, &speed) < 0) {
+            SetError("Unsupported baud rate: " + std::to_string(config_.baud_rate));
+            return false;
+        }
+    }
+
     return true;
 }
 
+// Receive latency of the driver's data queue in microseconds; USB-serial
+// drivers (FTDI's, Apple's CDC) otherwise batch bytes for a few ms
+bool Serial::SetLowLatency() {
+    unsigned long latency_us = 1;
+    return ioctl(fd_, IOSSDATALAT, &latency_us) == 0;
+}
+
 void Serial::SetError(const std::string& error) {
     last_error_ = error;
 }
@@ -1,15 +1,62 @@
 #include "serial.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <windows.h>
+#include <initguid.h>   // Before ntddser.h, to define GUID_DEVINTERFACE_COMPORT
+#include <setupapi.h>
+#include <cfgmgr32.h>
+#include <ntddser.h>
 // windows.h defines ConfigurePort as ConfigurePortA (ANSI thunk), which
 // conflicts with the Serial::ConfigurePort() private method.
 #undef ConfigurePort
 
 namespace SimpleSerial {
 
+namespace {
+
+// Driver queue sizes asked for with SetupComm(). The defaults (often 4 KB)
+// overflow while a flashing station is busy with other ports.
+constexpr DWORD kDriverQueueSize = 64 * 1024;
+
+// The port is opened for overlapped I/O so reads, writes and EV_RXCHAR
+// waits each have their own OVERLAPPED and can run on different threads.
+// Waits up to timeout_ms (< 0 = no limit), then cancels the operation and
+// keeps whatever it had already transferred.
+bool FinishOverlapped(HANDLE handle, OVERLAPPED& ov, BOOL started, DWORD& transferred, int timeout_ms) {
+    if (!started && GetLastError() != ERROR_IO_PENDING) {
+        return false;
+    }
+    if (!started && WaitForSingleObject(ov.hEvent, timeout_ms < 0 ? INFINITE : timeout_ms) == WAIT_TIMEOUT) {
+        CancelIoEx(handle, &ov);
+    }
+    if (GetOverlappedResult(handle, &ov, &transferred, TRUE)) {
+        return true;
+    }
+    return GetLastError() == ERROR_OPERATION_ABORTED;
+}
+
+// SetupAPI registry property as a string, "" if missing
+std::string DeviceProperty(HDEVINFO devices, SP_DEVINFO_DATA& device, DWORD property) {
+    char value[256];
+    DWORD type = 0;
+    if (!SetupDiGetDeviceRegistryPropertyA(devices, &device, property, &type,
+                                           reinterpret_cast<BYTE*>(value), sizeof(value), NULL) ||
+        type != REG_SZ) {
+        return "";
+    }
+    value[sizeof(value) - 1] = '\0';
+    return value;
+}
+
+} // namespace
+
 Serial::Serial()
     : handle_(INVALID_HANDLE_VALUE)
+    , wake_event_(NULL)
+    , read_event_(NULL)
+    , write_event_(NULL)
     , is_open_(false)
 {
 }
@@ -34,7 +81,7 @@ bool Serial::Open(const std::string& port_name, const SerialConfig& config) {
         0,
         NULL,
         OPEN_EXISTING,
-        0,
+        FILE_FLAG_OVERLAPPED,
         NULL
     );
 
@@ -43,11 +90,23 @@ bool Serial::Open(const std::string& port_name, const SerialConfig& config) {
         return false;
     }
 
+    // Best effort: drivers may ignore the request
+    SetupComm(handle_, kDriverQueueSize, kDriverQueueSize);
+
+    low_latency_ = false;
     if (!ConfigurePort()) {
         CloseHandle(handle_);
         handle_ = INVALID_HANDLE_VALUE;
         return false;
     }
+    low_latency_ = config_.low_latency && SetLowLatency();
+    ResetRoundTrip();
+
+    // Manual-reset event for WakeUp(); stays set until a wait consumes it
+    wake_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    // One per direction, so Read() and Write() don't share an OVERLAPPED
+    read_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    write_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
 
     is_open_ = true;
     return true;
@@ -63,9 +122,23 @@ void Serial::Close() {
         handle_ = INVALID_HANDLE_VALUE;
     }
 
+    for (void** event : {&wake_event_, &read_event_, &write_event_}) {
+        if (*event != NULL) {
+            CloseHandle(*event);
+            *event = NULL;
+        }
+    }
+
+    DiscardBuffered();
     is_open_ = false;
 }
 
+void Serial::WakeUp() {
+    if (wake_event_ != NULL) {
+        SetEvent(wake_event_);
+    }
+}
+
 bool Serial::IsOpen() const {
     return is_open_;
 }
@@ -76,11 +149,16 @@ int Serial::Write(const uint8_t* data, size_t length) {
         return -1;
     }
 
-    DWORD bytes_written;
-    if (!WriteFile(handle_, data, length, &bytes_written, NULL)) {
+    // WriteTotalTimeoutConstant (see SetConfiguredTimeouts) bounds the wait
+    OVERLAPPED ov = {0};
+    ov.hEvent = write_event_;
+    DWORD bytes_written = 0;
+    BOOL started = WriteFile(handle_, data, length, NULL, &ov);
+    if (!FinishOverlapped(handle_, ov, started, bytes_written, -1)) {
         SetError("Write failed");
         return -1;
     }
+    NoteWrite();
     return bytes_written;
 }
 
@@ -93,65 +171,164 @@ int Serial::Write(const std::vector<uint8_t>& data) {
 }
 
 int Serial::Read(uint8_t* buffer, size_t max_length) {
+    return Read(buffer, max_length, config_.timeout_ms);
+}
+
+int Serial::Read(uint8_t* buffer, size_t max_length, int timeout_ms) {
     if (!is_open_) {
         SetError("Serial port not open");
         return -1;
     }
 
-    DWORD bytes_read;
-    if (!ReadFile(handle_, buffer, max_length, &bytes_read, NULL)) {
-        SetError("Read failed");
-        return -1;
+    // Bytes read ahead by ReadUntil() come first
+    if (size_t buffered = TakeBuffered(buffer, max_length)) {
+        return static_cast<int>(buffered);
+    }
+
+    // The per-call timeout is a wait on the overlapped read rather than a
+    // SetCommTimeouts() call, which would also change the timeouts of a
+    // Write() running on another thread. The driver's own read timeout
+    // can end a read early with nothing, so read again until timeout_ms.
+    const DWORD start = GetTickCount();
+    DWORD bytes_read = 0;
+    while (true) {
+        OVERLAPPED ov = {0};
+        ov.hEvent = read_event_;
+        const DWORD elapsed = GetTickCount() - start;
+        const int remaining = timeout_ms < 0 ? -1 : (std::max)(0, timeout_ms - static_cast<int>(elapsed));
+        BOOL started = ReadFile(handle_, buffer, max_length, NULL, &ov);
+        if (!FinishOverlapped(handle_, ov, started, bytes_read, remaining)) {
+            SetError("Read failed");
+            return -1;
+        }
+        if (bytes_read > 0 || remaining == 0) {
+            break;
+        }
+    }
+    if (bytes_read > 0) {
+        NoteRead();
     }
     return bytes_read;
 }
 
-std::vector<uint8_t> Serial::Read(size_t max_length) {
-    std::vector<uint8_t> buffer(max_length);
-    int bytes_read = Read(buffer.data(), max_length);
-
-    if (bytes_read <= 0) {
-        return std::vector<uint8_t>();
+int Serial::WaitForData(int timeout_ms) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return -1;
     }
 
-    buffer.resize(bytes_read);
-    return buffer;
-}
+    if (Buffered() > 0) {
+        return 1;
+    }
 
-std::vector<uint8_t> Serial::ReadUntil(uint8_t terminator, size_t max_length) {
-    std::vector<uint8_t> result;
-    uint8_t byte;
+    COMSTAT status;
+    DWORD errors;
+    if (ClearCommError(handle_, &errors, &status) && status.cbInQue > 0) {
+        return 1;
+    }
 
-    while (result.size() < max_length) {
-        int bytes_read = Read(&byte, 1);
+    if (!SetCommMask(handle_, EV_RXCHAR)) {
+        SetError("Failed to set comm mask");
+        return -1;
+    }
 
-        if (bytes_read <= 0) {
-            break;
+    OVERLAPPED ov = {0};
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    DWORD mask = 0;
+    if (!WaitCommEvent(handle_, &mask, &ov)) {
+        if (GetLastError() != ERROR_IO_PENDING) {
+            CloseHandle(ov.hEvent);
+            SetError("WaitCommEvent failed");
+            return -1;
         }
-
-        result.push_back(byte);
-
-        if (byte == terminator) {
-            break;
+        HANDLE events[2] = { ov.hEvent, wake_event_ };
+        DWORD count = wake_event_ != NULL ? 2 : 1;
+        if (WaitForMultipleObjects(count, events, FALSE, timeout_ms) != WAIT_OBJECT_0) {
+            // Timeout or WakeUp(). Clearing the mask completes the pending
+            // wait; mask and ov must stay alive until it has
+            SetCommMask(handle_, 0);
+            DWORD unused;
+            GetOverlappedResult(handle_, &ov, &unused, TRUE);
         }
     }
+    CloseHandle(ov.hEvent);
+    if (wake_event_ != NULL) {
+        ResetEvent(wake_event_);
+    }
 
-    return result;
+    // EV_RXCHAR also fires for bytes a concurrent Read() already took
+    if (!ClearCommError(handle_, &errors, &status)) {
+        SetError("Serial port disconnected");
+        return -1;
+    }
+    return status.cbInQue > 0 ? 1 : 0;
 }
 
-std::string Serial::ReadLine(size_t max_length) {
-    auto data = ReadUntil('\n', max_length);
+int Serial::WaitForAny(const std::vector<Serial*>& ports, int timeout_ms,
+                       std::vector<size_t>& ready) {
+    ready.clear();
+    if (ports.size() > MAXIMUM_WAIT_OBJECTS) {
+        return -1;
+    }
 
-    if (data.empty()) {
-        return "";
+    auto collect = [&]() {
+        for (size_t i = 0; i < ports.size(); i++) {
+            COMSTAT status;
+            DWORD errors;
+            if (ports[i]->Buffered() > 0 ||
+                (ClearCommError(ports[i]->handle_, &errors, &status) && status.cbInQue > 0)) {
+                ready.push_back(i);
+            }
+        }
+        return static_cast<int>(ready.size());
+    };
+    if (collect() > 0) {
+        return static_cast<int>(ready.size());
+    }
+
+    // One overlapped EV_RXCHAR wait per port, then wait for the first
+    std::vector<OVERLAPPED> ovs(ports.size());
+    std::vector<DWORD> masks(ports.size(), 0);
+    std::vector<HANDLE> events;
+    std::vector<bool> pending(ports.size(), false);
+    bool signalled = false;
+    for (size_t i = 0; i < ports.size(); i++) {
+        ovs[i] = OVERLAPPED{};
+        ovs[i].hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        events.push_back(ovs[i].hEvent);
+        SetCommMask(ports[i]->handle_, EV_RXCHAR);
+        if (WaitCommEvent(ports[i]->handle_, &masks[i], &ovs[i])) {
+            signalled = true;
+        } else if (GetLastError() == ERROR_IO_PENDING) {
+            pending[i] = true;
+        }
+    }
+    if (!signalled) {
+        WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, timeout_ms);
+    }
+
+    // Complete every outstanding wait before its OVERLAPPED goes away
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (pending[i]) {
+            SetCommMask(ports[i]->handle_, 0);
+            DWORD unused;
+            GetOverlappedResult(ports[i]->handle_, &ovs[i], &unused, TRUE);
+        }
+        CloseHandle(ovs[i].hEvent);
     }
+    return collect();
+}
 
-    // Remove trailing \r\n if present
-    while (!data.empty() && (data.back() == '\n' || data.back() == '\r')) {
-        data.pop_back();
+std::vector<uint8_t> Serial::Read(size_t max_length) {
+    std::vector<uint8_t> buffer(max_length);
+    int bytes_read = Read(buffer.data(), max_length);
+
+    if (bytes_read <= 0) {
+        return std::vector<uint8_t>();
     }
 
-    return std::string(data.begin(), data.end());
+    buffer.resize(bytes_read);
+    return buffer;
 }
 
 int Serial::Available() const {
@@ -164,7 +341,7 @@ int Serial::Available() const {
     if (!ClearCommError(handle_, &errors, &status)) {
         return -1;
     }
-    return status.cbInQue;
+    return static_cast<int>(status.cbInQue + Buffered());
 }
 
 bool Serial::Flush() {
@@ -172,9 +349,30 @@ bool Serial::Flush() {
         return false;
     }
 
+    DiscardBuffered();
     return FlushFileBuffers(handle_) != 0;
 }
 
+bool Serial::SetBaudRate(int baud_rate) {
+    if (!is_open_) {
+        SetError("Serial port not open");
+        return false;
+    }
+
+    FlushFileBuffers(handle_);
+
+    const int previous = config_.baud_rate;
+    config_.baud_rate = baud_rate;
+    if (!ConfigurePort()) {
+        const std::string error = last_error_;
+        config_.baud_rate = previous;
+        ConfigurePort();
+        SetError(error);
+        return false;
+    }
+    return true;
+}
+
 std::string Serial::GetLastError() const {
     return last_error_;
 }
@@ -320,28 +518,74 @@ bool Serial::PulseRTS(int duration_ms, bool active_low) {
     return true;
 }
 
-std::vector<std::string> Serial::ListPorts() {
-    std::vector<std::string> ports;
-
-    // Windows: Check COM1 through COM256
-    for (int i = 1; i <= 256; i++) {
-        std::string port = "COM" + std::to_string(i);
-        HANDLE h = CreateFileA(
-            port.c_str(),
-            GENERIC_READ | GENERIC_WRITE,
-            0,
-            NULL,
-            OPEN_EXISTING,
-            0,
-            NULL
-        );
-
-        if (h != INVALID_HANDLE_VALUE) {
-            ports.push_back(port);
-            CloseHandle(h);
+std::vector<PortInfo> Serial::ListPortDetails() {
+    std::vector<PortInfo> ports;
+
+    // Present devices exposing the COM port interface; probing COM1..256
+    // with CreateFile instead is slow and opens every port
+    HDEVINFO devices = SetupDiGetClassDevsA(&GUID_DEVINTERFACE_COMPORT, NULL, NULL,
+                                            DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (devices == INVALID_HANDLE_VALUE) {
+        return ports;
+    }
+
+    SP_DEVINFO_DATA device = {};
+    device.cbSize = sizeof(device);
+    for (DWORD i = 0; SetupDiEnumDeviceInfo(devices, i, &device); ++i) {
+        PortInfo port;
+
+        HKEY key = SetupDiOpenDevRegKey(devices, &device, DICS_FLAG_GLOBAL, 0, DIREG_DEV, KEY_READ);
+        if (key == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        char name[64];
+        DWORD size = sizeof(name);
+        DWORD type = 0;
+        LONG result = RegQueryValueExA(key, "PortName", NULL, &type,
+                                       reinterpret_cast<BYTE*>(name), &size);
+        RegCloseKey(key);
+        if (result != ERROR_SUCCESS || type != REG_SZ) {
+            continue;
+        }
+        port.name.assign(name, strnlen(name, size));
+
+        port.description = DeviceProperty(devices, device, SPDRP_FRIENDLYNAME);
+        port.manufacturer = DeviceProperty(devices, device, SPDRP_MFG);
+
+        // "USB\VID_0483&PID_5740\<serial>" for the USB device itself;
+        // composite devices put the interface in between, so ask the parent
+        char instance[MAX_DEVICE_ID_LEN];
+        DEVINST parent = 0;
+        if (CM_Get_Device_IDA(device.DevInst, instance, sizeof(instance), 0) == CR_SUCCESS) {
+            std::string id = instance;
+            if (id.find("&MI_") != std::string::npos &&
+                CM_Get_Parent(&parent, device.DevInst, 0) == CR_SUCCESS &&
+                CM_Get_Device_IDA(parent, instance, sizeof(instance), 0) == CR_SUCCESS) {
+                id = instance;
+            }
+            size_t vid = id.find("VID_");
+            size_t pid = id.find("PID_");
+            if (id.compare(0, 4, "USB\\") == 0 && vid != std::string::npos && pid != std::string::npos) {
+                port.vid = static_cast<uint16_t>(strtoul(id.substr(vid + 4, 4).c_str(), NULL, 16));
+                port.pid = static_cast<uint16_t>(strtoul(id.substr(pid + 4, 4).c_str(), NULL, 16));
+                // Windows makes up an instance ID containing '&' when the
+                // device has no serial number
+                size_t slash = id.rfind('\\');
+                if (slash != std::string::npos && id.find('&', slash) == std::string::npos) {
+                    port.serial_number = id.substr(slash + 1);
+                }
+                port.location = DeviceProperty(devices, device, SPDRP_LOCATION_INFORMATION);
+            }
         }
+
+        ports.push_back(port);
     }
+    SetupDiDestroyDeviceInfoList(devices);
 
+    // COM10 after COM9
+    std::sort(ports.begin(), ports.end(), [](const PortInfo& a, const PortInfo& b) {
+        return a.name.size() != b.name.size() ? a.name.size() < b.name.size() : a.name < b.name;
+    });
     return ports;
 }
 
@@ -374,6 +618,15 @@ PortStatus Serial::CheckPortStatus(const std::string& port_name) {
     return PortStatus::UNKNOWN_ERROR;
 }
 
+// Windows only tells whether a COM port is taken by opening it, so
+// every port is left to CreateFile()
+void Serial::InspectPortStatuses(const std::vector<std::string>& port_names,
+                                 std::vector<PortStatus>& statuses, std::vector<bool>& decided) {
+    (void)port_names;
+    (void)statuses;
+    (void)decided;
+}
+
 bool Serial::ConfigurePort() {
     DCB dcb = {0};
     dcb.DCBlength = sizeof(DCB);
@@ -399,18 +652,37 @@ bool Serial::ConfigurePort() {
         return false;
     }
 
+    if (!SetConfiguredTimeouts()) {
+        SetError("Failed to set timeouts");
+        return false;
+    }
+
+    return true;
+}
+
+bool Serial::SetConfiguredTimeouts() {
+    // Low latency: ReadFile returns with the first bytes to arrive, and
+    // Read() times it out itself. Otherwise it waits for the whole buffer
+    // or the timeout.
     COMMTIMEOUTS timeouts = {0};
-    timeouts.ReadIntervalTimeout = config_.timeout_ms;
-    timeouts.ReadTotalTimeoutConstant = config_.timeout_ms;
-    timeouts.ReadTotalTimeoutMultiplier = 0;
+    timeouts.ReadIntervalTimeout = low_latency_ ? MAXDWORD : config_.timeout_ms;
+    timeouts.ReadTotalTimeoutMultiplier = low_latency_ ? MAXDWORD : 0;
+    timeouts.ReadTotalTimeoutConstant = low_latency_ ? MAXDWORD - 1 : config_.timeout_ms;
     timeouts.WriteTotalTimeoutConstant = config_.timeout_ms;
     timeouts.WriteTotalTimeoutMultiplier = 0;
+    return SetCommTimeouts(handle_, &timeouts) != 0;
+}
 
-    if (!SetCommTimeouts(handle_, &timeouts)) {
-        SetError("Failed to set timeouts");
+// The FTDI latency timer is a driver setting on Windows (Device Manager,
+// Port Settings > Advanced), not reachable without administrator rights;
+// what can be done per handle is not to wait for a full buffer in ReadFile
+bool Serial::SetLowLatency() {
+    low_latency_ = true;
+    if (!SetConfiguredTimeouts()) {
+        low_latency_ = false;
+        SetConfiguredTimeouts();
         return false;
     }
-
     return true;
 }
 
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace SimpleSerial {
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring buffer
+ *
+ * One thread may call the producer side (Push), one other thread the
+ * consumer side (Front/Pop) concurrently without locking. The capacity
+ * is rounded up to a power of two.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : slots_(RoundUp(capacity))
+        , mask_(slots_.size() - 1)
+        , head_(0)
+        , tail_(0)
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t Capacity() const { return slots_.size(); }
+
+    /** Items currently queued (exact for either side, a snapshot for others) */
+    size_t Size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    /** Drop every item; only while neither side is in use */
+    void Clear()
+    {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    // ── Producer ────────────────────────────────────────────────────────────
+
+    /** @return false if the ring is full */
+    bool Push(T item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[head & mask_] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Push all @p count items or none
+     * @return false if there is not enough room
+     */
+    bool PushAll(const T* items, size_t count)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (slots_.size() - (head - tail_.load(std::memory_order_acquire)) < count) {
+            return false;
+        }
+        const size_t start = head & mask_;
+        const size_t first = std::min(count, slots_.size() - start);
+        std::copy(items, items + first, slots_.begin() + start);
+        std::copy(items + first, items + count, slots_.begin());
+        head_.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    // ── Consumer ────────────────────────────────────────────────────────────
+
+    /** @return Oldest item, or nullptr if the ring is empty */
+    T* Front()
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[tail & mask_];
+    }
+
+    /** @return false if the ring is empty */
+    bool Pop(T& item)
+    {
+        T* front = Front();
+        if (!front) {
+            return false;
+        }
+        item = std::move(*front);
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @return Number of items moved into @p items (at most @p max) */
+    size_t Pop(T* items, size_t max)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t count = std::min(max, head_.load(std::memory_order_acquire) - tail);
+        const size_t start = tail & mask_;
+        const size_t first = std::min(count, slots_.size() - start);
+        std::move(slots_.begin() + start, slots_.begin() + start + first, items);
+        std::move(slots_.begin(), slots_.begin() + (count - first), items + first);
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<T> slots_;
+    const size_t mask_;
+
+    // Free-running counters; head_ is written by the producer only, tail_
+    // by the consumer only. Kept on separate cache lines.
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+} // namespace SimpleSerial
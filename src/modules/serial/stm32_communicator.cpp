@@ -1,4 +1,7 @@
 #include "stm32_communicator.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <chrono>
 #include <thread>
@@ -8,17 +11,38 @@ namespace SimpleSerial {
 STM32Communicator::STM32Communicator()
     : baud_rate_(115200)
     , is_connected_(false)
+    , streamed_writes_(false)
     , monitoring_active_(false)
+    , monitor_ring_(1 << 20)  // Seconds of slack for a stalled subscriber at 2 Mbaud
+    , reply_reader_(monitor_ring_)
+    , next_subscriber_id_(1)
 {
+    // Streamed command + address + N-1 + 256 data bytes + checksum
+    packet_.reserve(7 + 1 + 256 + 1);
+
+    // Everything received goes into the ring, for the monitor, the
+    // subscribers and the bootloader commands alike
+    serial_.AsyncRead([this](const uint8_t* data, size_t length) { OnReceive(data, length); });
 }
 
 STM32Communicator::~STM32Communicator() {
     StopMonitoring();
     Disconnect();
+
+    std::vector<int> ids;
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        for (const auto& subscriber : subscribers_) {
+            ids.push_back(subscriber->id);
+        }
+    }
+    for (int id : ids) {
+        Unsubscribe(id);
+    }
 }
 
 bool STM32Communicator::Connect(const std::string& port_name, int baud_rate) {
-    std::lock_guard<std::mutex> lock(serial_mutex_);
+    std::lock_guard<std::mutex> lock(command_mutex_);
 
     if (is_connected_) {
         SetError("Already connected. Disconnect first.");
@@ -39,6 +63,7 @@ bool STM32Communicator::Connect(const std::string& port_name, int baud_rate) {
 
     port_name_ = port_name;
     baud_rate_ = baud_rate;
+    reply_reader_.Discard();
     is_connected_ = true;
 
     return true;
@@ -47,7 +72,7 @@ bool STM32Communicator::Connect(const std::string& port_name, int baud_rate) {
 void STM32Communicator::Disconnect() {
     StopMonitoring();
 
-    std::lock_guard<std::mutex> lock(serial_mutex_);
+    std::lock_guard<std::mutex> lock(command_mutex_);
 
     if (is_connected_) {
         serial_.Close();
@@ -65,7 +90,7 @@ std::string STM32Communicator::GetPortName() const {
 }
 
 bool STM32Communicator::EnterBootloader(bool pulse_dtr) {
-    std::lock_guard<std::mutex> lock(serial_mutex_);
+    std::lock_guard<std::mutex> lock(command_mutex_);
 
     if (!is_connected_) {
         SetError("Not connected to any port");
@@ -75,19 +100,19 @@ bool STM32Communicator::EnterBootloader(bool pulse_dtr) {
     // Pulse DTR to reset the MCU if requested
     if (pulse_dtr) {
         if (!serial_.PulseDTR(100, true)) {
-            SetError("Failed to pulse DTR: " + serial_.GetLastError());
+            SetError("Failed to pulse DTR");
             return false;
         }
         // Wait for MCU to boot
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
-    // Flush any existing data
-    serial_.Flush();
+    // Drop what arrived before (boot messages, monitor output)
+    reply_reader_.Discard();
 
     // Send initialization byte
     uint8_t init_byte = 0x7F;
-    if (serial_.Write(&init_byte, 1) != 1) {
+    if (!Write(&init_byte, 1)) {
         SetError("Failed to send init byte");
         return false;
     }
@@ -101,19 +126,38 @@ bool STM32Communicator::EnterBootloader(bool pulse_dtr) {
     return true;
 }
 
+bool STM32Communicator::ReadProductId(uint16_t& pid) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
+    }
+    if (!GetProductId(pid)) {
+        SetError("No reply to GET_ID");
+        return false;
+    }
+    return true;
+}
+
 bool STM32Communicator::Flash(const FirmwareData& firmware, bool erase_all) {
-    std::lock_guard<std::mutex> lock(serial_mutex_);
+    std::lock_guard<std::mutex> lock(command_mutex_);
 
     if (!is_connected_) {
         SetError("Not connected to any port");
         return false;
     }
 
-    if (firmware.data.empty()) {
+    if (firmware.Size() == 0) {
         SetError("Firmware data is empty");
         return false;
     }
 
+    // A mass erase would take the preserved range with it
+    if (erase_all && HasPreservedRange()) {
+        return FlashRanges({&firmware}, false);
+    }
+
     // Erase memory
     std::cout << "Erasing flash memory..." << std::endl;
     if (!EraseMemory(erase_all)) {
@@ -121,36 +165,73 @@ bool STM32Communicator::Flash(const FirmwareData& firmware, bool erase_all) {
         return false;
     }
 
-    // Write firmware in chunks
-    const size_t CHUNK_SIZE = 256;  // STM32 bootloader typically supports up to 256 bytes
-    size_t total_written = 0;
-    uint32_t address = firmware.start_address;
+    std::cout << "Writing " << firmware.Size() << " bytes to 0x"
+              << std::hex << firmware.start_address << std::dec << "..." << std::endl;
 
-    std::cout << "Writing " << firmware.data.size() << " bytes to 0x"
-              << std::hex << address << std::dec << "..." << std::endl;
+    size_t written = 0;
+    if (!WriteImage(firmware.start_address, firmware.Bytes(), firmware.Size(), false,
+                    written, firmware.Size())) {
+        return false;
+    }
 
-    while (total_written < firmware.data.size()) {
-        size_t remaining = firmware.data.size() - total_written;
-        size_t chunk_size = (remaining < CHUNK_SIZE) ? remaining : CHUNK_SIZE;
+    std::cout << "\nFlashing completed successfully!" << std::endl;
+    return true;
+}
 
-        if (!WriteMemory(address, firmware.data.data() + total_written, chunk_size)) {
-            SetError("Failed to write memory at address 0x" +
-                    std::to_string(address));
-            return false;
-        }
+bool STM32Communicator::FlashDelta(const FirmwareData& firmware) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
+    }
+    return FlashRanges({&firmware}, true);
+}
 
-        total_written += chunk_size;
-        address += chunk_size;
+bool STM32Communicator::FlashSegments(const std::vector<FirmwareData>& segments, bool delta) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
+    }
+    std::vector<const FirmwareData*> ranges;
+    for (const auto& segment : segments) {
+        ranges.push_back(&segment);
+    }
+    return FlashRanges(ranges, delta);
+}
 
-        // Print progress
-        int progress = (total_written * 100) / firmware.data.size();
-        std::cout << "\rProgress: " << progress << "%" << std::flush;
+bool STM32Communicator::EraseAhead(uint32_t address, size_t length) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
     }
+    return EraseRangeAhead(address, length);
+}
 
-    std::cout << "\nFlashing completed successfully!" << std::endl;
+bool STM32Communicator::Go(uint32_t address) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
+    }
+    if (!SendCommandWithAddress(BootloaderCommand::GO, address)) {
+        SetError("GO command not acknowledged");
+        return false;
+    }
     return true;
 }
 
+bool STM32Communicator::Verify(const FirmwareData& firmware, size_t stride) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+
+    if (!is_connected_) {
+        SetError("Not connected to any port");
+        return false;
+    }
+    return VerifyRange(firmware, stride);
+}
+
 bool STM32Communicator::StartMonitoring(DataCallback callback) {
     if (monitoring_active_) {
         SetError("Monitoring already active");
@@ -171,7 +252,11 @@ bool STM32Communicator::StartMonitoring(DataCallback callback) {
 
 void STM32Communicator::StopMonitoring() {
     if (monitoring_active_) {
-        monitoring_active_ = false;
+        {
+            // Waits out a callback in progress on the I/O thread
+            std::lock_guard<std::mutex> lock(monitor_mutex_);
+            monitoring_active_ = false;
+        }
         if (monitor_thread_.joinable()) {
             monitor_thread_.join();
         }
@@ -182,15 +267,55 @@ bool STM32Communicator::IsMonitoring() const {
     return monitoring_active_;
 }
 
-int STM32Communicator::Send(const uint8_t* data, size_t length) {
-    std::lock_guard<std::mutex> lock(serial_mutex_);
+int STM32Communicator::Subscribe(DataCallback callback) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    const int id = next_subscriber_id_++;
+    auto subscriber = std::unique_ptr<Subscriber>(new Subscriber(id, monitor_ring_, std::move(callback)));
+    subscriber->thread = std::thread(&STM32Communicator::SubscriberThreadFunc, subscriber.get());
+    subscribers_.push_back(std::move(subscriber));
+    return id;
+}
+
+void STM32Communicator::Unsubscribe(int id) {
+    std::unique_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        auto it = std::find_if(subscribers_.begin(), subscribers_.end(),
+                               [id](const std::unique_ptr<Subscriber>& s) { return s->id == id; });
+        if (it == subscribers_.end()) {
+            return;
+        }
+        subscriber = std::move(*it);
+        subscribers_.erase(it);
+    }
+
+    // Joined outside the lock: the callback may be slow, or subscribe others
+    subscriber->active = false;
+    if (subscriber->thread.joinable()) {
+        subscriber->thread.join();
+    }
+}
+
+uint64_t STM32Communicator::GetDroppedBytes(int id) const {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    for (const auto& subscriber : subscribers_) {
+        if (subscriber->id == id) {
+            return subscriber->reader.GetDropped();
+        }
+    }
+    return 0;
+}
 
+int STM32Communicator::Send(const uint8_t* data, size_t length) {
     if (!is_connected_) {
         SetError("Not connected to any port");
         return -1;
     }
-
-    return serial_.Write(data, length);
+    if (!Write(data, length)) {
+        SetError("Failed to queue data: " + serial_.GetLastError());
+        return -1;
+    }
+    return static_cast<int>(length);
 }
 
 int STM32Communicator::Send(const std::string& str) {
@@ -210,37 +335,108 @@ void STM32Communicator::SetError(const std::string& error) {
 }
 
 void STM32Communicator::MonitorThreadFunc() {
-    const size_t BUFFER_SIZE = 1024;
-    uint8_t buffer[BUFFER_SIZE];
+    // Upper bound on how long StopMonitoring() waits for this thread
+    const int WAKE_INTERVAL_MS = 100;
 
+    // The data arrives through OnReceive(); this only notices a lost port
     while (monitoring_active_) {
-        int bytes_read;
-        {
-            std::lock_guard<std::mutex> lock(serial_mutex_);
-            if (!is_connected_) {
-                break;
-            }
-            bytes_read = serial_.Read(buffer, BUFFER_SIZE);
+        if (!serial_.IsOpen()) {
+            std::cerr << "Error reading from serial: " << serial_.GetLastError() << std::endl;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_INTERVAL_MS));
+    }
+}
+
+void STM32Communicator::SubscriberThreadFunc(Subscriber* subscriber) {
+    const size_t BUFFER_SIZE = 4096;
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+
+    // Upper bound on how long Unsubscribe() waits for an idle subscriber
+    const int WAKE_INTERVAL_MS = 100;
+
+    while (subscriber->active) {
+        size_t count = subscriber->reader.Wait(buffer.data(), BUFFER_SIZE, WAKE_INTERVAL_MS);
+        if (count > 0 && subscriber->callback) {
+            subscriber->callback(buffer.data(), count);
         }
+    }
 
-        if (bytes_read > 0) {
-            if (data_callback_) {
-                // Call user callback
-                data_callback_(buffer, bytes_read);
-            } else {
-                // Default: print to stdout
-                std::cout.write(reinterpret_cast<const char*>(buffer), bytes_read);
-                std::cout.flush();
-            }
-        } else if (bytes_read < 0) {
-            // Error occurred
-            std::cerr << "Error reading from serial: " << serial_.GetLastError() << std::endl;
+    // Hand on what had arrived by Unsubscribe() (the tail of a log); only
+    // that much, so a port that keeps sending cannot hold it up
+    size_t left = subscriber->reader.Available();
+    while (left > 0) {
+        size_t count = subscriber->reader.Read(buffer.data(), std::min(left, BUFFER_SIZE));
+        if (count == 0) {
             break;
         }
-        // bytes_read == 0 means timeout, continue
+        if (subscriber->callback) {
+            subscriber->callback(buffer.data(), count);
+        }
+        left -= std::min(left, count);
+    }
+}
+
+void STM32Communicator::OnReceive(const uint8_t* data, size_t length) {
+    // On the I/O thread: the ring's only producer, and never blocks
+    monitor_ring_.Write(data, length);
+
+    // Called here rather than through a Reader, which would drop what a
+    // slow callback can't keep up with; a slow one paces the port instead
+    if (!monitoring_active_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(monitor_mutex_);
+    if (!monitoring_active_) {
+        return;
+    }
+    if (data_callback_) {
+        data_callback_(data, length);
+    } else if (monitor_ring_.GetReaderCount() <= 1) {
+        // Default, without subscribers (reply_reader_ is the one reader): print to stdout
+        std::cout.write(reinterpret_cast<const char*>(data), length);
+        std::cout.flush();
+    }
+}
+
+bool STM32Communicator::Write(const uint8_t* data, size_t length) {
+    // Waits only while the transmit ring is full, e.g. behind a long Send()
+    const size_t CHUNK = 4096;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000);
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    size_t offset = 0;
+    while (offset < length) {
+        const size_t count = std::min(CHUNK, length - offset);
+        if (serial_.AsyncWrite(data + offset, count)) {
+            offset += count;
+            continue;
+        }
+        if (!serial_.IsOpen() || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+int STM32Communicator::ReadReply(uint8_t* data, size_t length, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
-        // Small delay to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        // Sleeps until the I/O thread writes to the ring
+        size_t count = reply_reader_.Wait(data, length, static_cast<int>(std::max<int64_t>(remaining, 0)));
+        if (count > 0) {
+            return static_cast<int>(count);
+        }
+        if (!serial_.IsOpen()) {
+            return -1;
+        }
+        if (remaining <= 0) {
+            return 0;
+        }
     }
 }
 
@@ -249,7 +445,7 @@ bool STM32Communicator::SendCommand(BootloaderCommand cmd) {
     cmd_bytes[0] = static_cast<uint8_t>(cmd);
     cmd_bytes[1] = ~cmd_bytes[0];  // Complement
 
-    if (serial_.Write(cmd_bytes, 2) != 2) {
+    if (!Write(cmd_bytes, 2)) {
         return false;
     }
 
@@ -270,7 +466,7 @@ bool STM32Communicator::SendCommandWithAddress(BootloaderCommand cmd, uint32_t a
     addr_bytes[3] = address & 0xFF;
     addr_bytes[4] = addr_bytes[0] ^ addr_bytes[1] ^ addr_bytes[2] ^ addr_bytes[3];
 
-    if (serial_.Write(addr_bytes, 5) != 5) {
+    if (!Write(addr_bytes, 5)) {
         return false;
     }
 
@@ -278,11 +474,20 @@ bool STM32Communicator::SendCommandWithAddress(BootloaderCommand cmd, uint32_t a
 }
 
 bool STM32Communicator::WaitForAck(int timeout_ms) {
-    auto start = std::chrono::steady_clock::now();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
 
     while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            return false;
+        }
+
         uint8_t response;
-        int bytes_read = serial_.Read(&response, 1);
+        int bytes_read = ReadReply(&response, 1, static_cast<int>(remaining));
+        if (bytes_read < 0) {
+            return false;
+        }
 
         if (bytes_read == 1) {
             if (response == static_cast<uint8_t>(BootloaderResponse::ACK)) {
@@ -291,53 +496,187 @@ bool STM32Communicator::WaitForAck(int timeout_ms) {
                 return false;
             }
         }
+    }
+}
+
+void STM32Communicator::AppendCommand(std::vector<uint8_t>& packet, BootloaderCommand cmd,
+                                      uint32_t address) {
+    const uint8_t code = static_cast<uint8_t>(cmd);
+    packet.push_back(code);
+    packet.push_back(static_cast<uint8_t>(~code));  // Complement
+
+    const uint8_t addr_bytes[4] = {
+        static_cast<uint8_t>((address >> 24) & 0xFF),
+        static_cast<uint8_t>((address >> 16) & 0xFF),
+        static_cast<uint8_t>((address >> 8) & 0xFF),
+        static_cast<uint8_t>(address & 0xFF),
+    };
+    packet.insert(packet.end(), addr_bytes, addr_bytes + 4);
+    packet.push_back(CalculateChecksum(addr_bytes, 4));
+}
+
+bool STM32Communicator::WriteMemory(uint32_t address, const uint8_t* data, size_t length) {
+    if (length == 0 || length > 256) {
+        return false;
+    }
+
+    // Streamed: command, address and data go out in one write and the
+    // three ACKs are collected afterwards, saving two round trips
+    std::vector<uint8_t>& packet = packet_;
+    packet.clear();
+    if (streamed_writes_) {
+        AppendCommand(packet, BootloaderCommand::WRITE_MEMORY, address);
+    } else if (!SendCommandWithAddress(BootloaderCommand::WRITE_MEMORY, address)) {
+        return false;
+    }
+
+    // Data packet: N-1 (1 byte) + data (N bytes) + checksum (XOR of both)
+    const size_t data_start = packet.size();
+    packet.push_back(static_cast<uint8_t>(length - 1));  // N-1
+    packet.insert(packet.end(), data, data + length);
+    packet.push_back(CalculateChecksum(packet.data() + data_start, packet.size() - data_start));
+
+    // Send packet
+    if (!Write(packet.data(), packet.size())) {
+        return false;
+    }
+
+    if (streamed_writes_ && (!WaitForAck() || !WaitForAck())) {
+        return false;
+    }
+    return WaitForAck();
+}
+
+bool STM32Communicator::WriteImage(uint32_t address, const uint8_t* data, size_t length,
+                                   bool skip_erased, size_t& written, size_t total) {
+    // Write in chunks
+    const size_t CHUNK_SIZE = 256;  // STM32 bootloader typically supports up to 256 bytes
+    size_t total_written = 0;
 
-        auto elapsed = std::chrono::steady_clock::now() - start;
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >= timeout_ms) {
+    while (total_written < length) {
+        size_t remaining = length - total_written;
+        size_t chunk_size = (remaining < CHUNK_SIZE) ? remaining : CHUNK_SIZE;
+        const uint8_t* chunk = data + total_written;
+
+        // Freshly erased flash already reads 0xFF
+        bool erased = skip_erased &&
+            std::all_of(chunk, chunk + chunk_size, [](uint8_t b) { return b == 0xFF; });
+
+        if (!erased && !WriteMemory(address, chunk, chunk_size)) {
+            SetError("Failed to write memory at address 0x" +
+                    std::to_string(address));
             return false;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        total_written += chunk_size;
+        written += chunk_size;
+        address += chunk_size;
+
+        // Print progress
+        int progress = (written * 100) / total;
+        std::cout << "\rProgress: " << progress << "%" << std::flush;
     }
+
+    return true;
 }
 
-bool STM32Communicator::WriteMemory(uint32_t address, const uint8_t* data, size_t length) {
+bool STM32Communicator::ReadMemory(uint32_t address, uint8_t* data, size_t length) {
     if (length == 0 || length > 256) {
         return false;
     }
 
-    // Send Write Memory command with address
-    if (!SendCommandWithAddress(BootloaderCommand::WRITE_MEMORY, address)) {
+    std::vector<uint8_t>& packet = packet_;
+    packet.clear();
+    if (streamed_writes_) {
+        AppendCommand(packet, BootloaderCommand::READ_MEMORY, address);
+    } else if (!SendCommandWithAddress(BootloaderCommand::READ_MEMORY, address)) {
         return false;
     }
 
-    // Prepare data packet: N-1 (1 byte) + data (N bytes) + checksum (1 byte)
-    std::vector<uint8_t> packet;
-    packet.push_back(static_cast<uint8_t>(length - 1));  // N-1
-    packet.insert(packet.end(), data, data + length);
+    // Number of bytes: N-1 + complement
+    packet.push_back(static_cast<uint8_t>(length - 1));
+    packet.push_back(static_cast<uint8_t>(~packet.back()));
+    if (!Write(packet.data(), packet.size())) {
+        return false;
+    }
+    if (streamed_writes_ && (!WaitForAck() || !WaitForAck())) {
+        return false;
+    }
+    if (!WaitForAck()) {
+        return false;
+    }
 
-    // Calculate checksum (XOR of all bytes)
-    uint8_t checksum = packet[0];
-    for (size_t i = 1; i < packet.size(); i++) {
-        checksum ^= packet[i];
+    size_t received = 0;
+    while (received < length) {
+        int n = ReadReply(data + received, length - received);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
     }
-    packet.push_back(checksum);
+    return true;
+}
 
-    // Send packet
-    if (serial_.Write(packet.data(), packet.size()) != static_cast<int>(packet.size())) {
+bool STM32Communicator::GetProductId(uint16_t& pid) {
+    if (!SendCommand(BootloaderCommand::GET_ID)) {
         return false;
     }
 
+    // N (number of bytes - 1), then N+1 bytes of product ID (MSB first), then ACK
+    uint8_t count;
+    if (ReadReply(&count, 1) != 1 || count > 3) {
+        return false;
+    }
+    pid = 0;
+    for (int i = 0; i <= count; i++) {
+        uint8_t b;
+        if (ReadReply(&b, 1) != 1) {
+            return false;
+        }
+        pid = static_cast<uint16_t>((pid << 8) | b);
+    }
     return WaitForAck();
 }
 
+bool STM32Communicator::EraseSectors(const std::vector<FlashSector>& sectors) {
+    if (sectors.empty()) {
+        return true;
+    }
+
+    if (!SendCommand(BootloaderCommand::EXTENDED_ERASE)) {
+        return false;
+    }
+
+    // N-1 (2 bytes, MSB first), N sector codes (2 bytes each), XOR checksum
+    std::vector<uint8_t> packet;
+    const uint16_t count = static_cast<uint16_t>(sectors.size() - 1);
+    packet.push_back(static_cast<uint8_t>(count >> 8));
+    packet.push_back(static_cast<uint8_t>(count & 0xFF));
+    for (const auto& sector : sectors) {
+        packet.push_back(static_cast<uint8_t>(sector.number >> 8));
+        packet.push_back(static_cast<uint8_t>(sector.number & 0xFF));
+    }
+    packet.push_back(CalculateChecksum(packet.data(), packet.size()));
+
+    if (!Write(packet.data(), packet.size())) {
+        return false;
+    }
+
+    // Sector erase takes up to a few seconds each on the H7
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        serial_.IgnoreNextReply();
+    }
+    return WaitForAck(std::max(30000, static_cast<int>(sectors.size()) * 4000));
+}
+
 bool STM32Communicator::EraseMemory(bool full_erase) {
     // Send Extended Erase command (0x44)
     uint8_t cmd_bytes[2];
     cmd_bytes[0] = static_cast<uint8_t>(BootloaderCommand::EXTENDED_ERASE);
     cmd_bytes[1] = ~cmd_bytes[0];
 
-    if (serial_.Write(cmd_bytes, 2) != 2) {
+    if (!Write(cmd_bytes, 2)) {
         return false;
     }
 
@@ -348,19 +687,23 @@ bool STM32Communicator::EraseMemory(bool full_erase) {
     if (full_erase) {
         // Global erase: 0xFFFF + checksum
         uint8_t erase_cmd[3] = {0xFF, 0xFF, 0x00};
-        if (serial_.Write(erase_cmd, 3) != 3) {
+        if (!Write(erase_cmd, 3)) {
             return false;
         }
     } else {
         // For now, only support global erase
         // Sector-specific erase would require sector list
         uint8_t erase_cmd[3] = {0xFF, 0xFF, 0x00};
-        if (serial_.Write(erase_cmd, 3) != 3) {
+        if (!Write(erase_cmd, 3)) {
             return false;
         }
     }
 
     // Erase can take a long time, use extended timeout
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        serial_.IgnoreNextReply();
+    }
     return WaitForAck(30000);  // 30 second timeout for erase
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
-#include "serial.h"
+#include "async_serial.h"
+#include "flash_target.h"
+#include "broadcast_ring.h"
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -8,17 +10,10 @@
 #include <mutex>
 #include <atomic>
 #include <functional>
+#include <memory>
 
 namespace SimpleSerial {
 
-/**
- * @brief Firmware data structure for flashing
- */
-struct FirmwareData {
-    uint32_t start_address;
-    std::vector<uint8_t> data;
-};
-
 /**
  * @brief STM32 bootloader response codes
  */
@@ -51,8 +46,14 @@ enum class BootloaderCommand : uint8_t {
  * Handles communication with STM32 microcontrollers for both flashing
  * firmware and runtime serial communication. The class manages a serial
  * connection that can be switched between different ports at runtime.
+ *
+ * The port is an AsyncSerial: its I/O thread transmits what the bootloader
+ * commands and Send() queue, and writes everything it receives into the
+ * monitor ring, and hands it to the monitor callback. The commands read
+ * their replies from the ring like any other reader, so monitoring and
+ * Send() never wait for a flash step to give up the port.
  */
-class STM32Communicator {
+class STM32Communicator : public FlashTarget {
 public:
     /**
      * @brief Callback type for received data
@@ -96,17 +97,88 @@ public:
      */
     bool EnterBootloader(bool pulse_dtr = true);
 
+    /**
+     * @brief Ask the bootloader for the MCU's product ID (GET_ID)
+     * @return false if no valid reply came back
+     */
+    bool ReadProductId(uint16_t& pid);
+
     /**
      * @brief Flash firmware to the MCU
      * @param firmware Firmware data to flash
-     * @param erase_all If true, perform full chip erase before flashing
+     * @param erase_all If true, perform full chip erase before flashing (only the
+     *        covered sectors with SetPreservedRange())
      * @return true if successful, false otherwise
      */
     bool Flash(const FirmwareData& firmware, bool erase_all = true);
 
+    /**
+     * @brief Flash only the sectors whose contents changed
+     *
+     * Reads back the current flash contents, then erases and rewrites only
+     * the sectors that differ from the firmware. Falls back to a full erase
+     * if the sector layout of the connected MCU is unknown.
+     *
+     * @param firmware Firmware data to flash
+     * @return true if successful, false otherwise
+     */
+    bool FlashDelta(const FirmwareData& firmware);
+
+    /**
+     * @brief Flash a sparse image, erasing only the sectors it covers
+     *
+     * Nothing between the segments is erased or written. With @p delta,
+     * only the covered sectors whose contents differ are rewritten (as
+     * FlashDelta()). Falls back to a full erase if the sector layout of the
+     * connected MCU is unknown.
+     *
+     * @param segments Populated ranges, in address order
+     * @param delta Compare with the flash contents first
+     * @return true if successful, false otherwise
+     */
+    bool FlashSegments(const std::vector<FirmwareData>& segments, bool delta);
+
+    /**
+     * @brief Erase the sectors under a range before the image is known
+     *
+     * The next Flash*() call leaves these sectors to the write, so the
+     * erase can overlap the end of a build (lumos run).
+     *
+     * @return false if the sector layout is unknown or the erase failed
+     */
+    bool EraseAhead(uint32_t address, size_t length);
+
+    /**
+     * @brief Leave the bootloader and run the code at @p address (GO)
+     */
+    bool Go(uint32_t address);
+
+    /**
+     * @brief Compare flash contents with the firmware
+     *
+     * Reads back every @p stride-th 256-byte block and the last block.
+     * A stride of 1 verifies the whole image; larger strides trade coverage
+     * for speed and still catch a missed erase or a shifted image.
+     *
+     * @param firmware Firmware that was flashed
+     * @param stride Block sampling interval
+     * @return true if all sampled blocks match
+     */
+    bool Verify(const FirmwareData& firmware, size_t stride = 1);
+
+    /**
+     * @brief Send command, address and payload of each write in one go
+     *
+     * Saves two round trips per 256-byte block. Off by default: the ROM
+     * bootloader reads the UART without a FIFO, so this relies on the
+     * adapter not outrunning it while it sends each ACK.
+     */
+    void SetStreamedWrites(bool enable) { streamed_writes_ = enable; }
+
     /**
      * @brief Start monitoring serial data from MCU
-     * Starts a background thread that receives and processes data
+     * The callback runs on the I/O thread as data arrives; a background
+     * thread reports a lost port
      * @param callback Function to call when data is received (optional)
      * @return true if started successfully, false otherwise
      */
@@ -117,6 +189,39 @@ public:
      */
     void StopMonitoring();
 
+    /**
+     * @brief Add a consumer of the monitored data, on a thread of its own
+     *
+     * Every chunk the I/O thread receives goes into a broadcast ring
+     * first; each subscriber reads it at its own pace and @p callback runs
+     * on the subscriber's thread. A subscriber that falls more than the
+     * ring behind loses the oldest bytes (see GetDroppedBytes()) instead of
+     * holding up the port or the others. Subscribers may come and go
+     * before or while monitoring; with any subscribed, data is no longer
+     * printed to stdout by default.
+     * @return Id for Unsubscribe()
+     */
+    int Subscribe(DataCallback callback);
+
+    /**
+     * @brief Remove a subscriber; its callback is not called once this returns
+     *
+     * The data that had arrived by then still reaches the callback first,
+     * so e.g. a log keeps its tail. Not from the subscriber's own callback.
+     */
+    void Unsubscribe(int id);
+
+    /**
+     * @brief Bytes subscriber @p id lost by falling behind, 0 if unknown
+     */
+    uint64_t GetDroppedBytes(int id) const;
+
+    /**
+     * @brief Ring the received data is written to, for polling it with a
+     * BroadcastRing::Reader (e.g. from a GUI timer) instead of a thread
+     */
+    BroadcastRing& GetMonitorRing() { return monitor_ring_; }
+
     /**
      * @brief Check if monitoring is active
      * @return true if monitoring, false otherwise
@@ -125,23 +230,27 @@ public:
 
     /**
      * @brief Send data to the MCU
+     *
+     * Queues the bytes for the I/O thread, waiting only while its transmit
+     * ring is full.
+     *
      * @param data Pointer to data to send
      * @param length Number of bytes to send
-     * @return Number of bytes sent, -1 on error
+     * @return Number of bytes queued, -1 on error
      */
     int Send(const uint8_t* data, size_t length);
 
     /**
      * @brief Send a string to the MCU
      * @param str String to send
-     * @return Number of bytes sent, -1 on error
+     * @return Number of bytes queued, -1 on error
      */
     int Send(const std::string& str);
 
     /**
      * @brief Send a vector of bytes to the MCU
      * @param data Vector of bytes to send
-     * @return Number of bytes sent, -1 on error
+     * @return Number of bytes queued, -1 on error
      */
     int Send(const std::vector<uint8_t>& data);
 
@@ -151,29 +260,73 @@ public:
      */
     std::string GetLastError() const;
 
+    /**
+     * @brief Command/ACK round trips since Connect(), erases left out
+     */
+    const RoundTripStats& GetRoundTrip() const { return serial_.GetRoundTrip(); }
+
+    /** Whether the port's driver was put in low-latency mode */
+    bool IsLowLatency() const { return serial_.IsLowLatency(); }
+
 private:
-    Serial serial_;
+    AsyncSerial serial_;
     std::string port_name_;
     int baud_rate_;
-    bool is_connected_;
+    std::atomic<bool> is_connected_;
+    bool streamed_writes_;
     std::string last_error_;
+    std::vector<uint8_t> packet_;  // Reused by WriteMemory/ReadMemory
 
-    // Monitoring thread
+    // One bootloader command sequence at a time; monitoring and Send()
+    // don't take it
+    std::mutex command_mutex_;
+    // AsyncWrite() allows one producer at a time, held only while queueing
+    std::mutex write_mutex_;
+
+    // Monitoring: data_callback_ runs on the I/O thread, the monitor
+    // thread only watches the port
     std::thread monitor_thread_;
     std::atomic<bool> monitoring_active_;
-    std::mutex serial_mutex_;
     DataCallback data_callback_;
+    std::mutex monitor_mutex_;  // Held while data_callback_ runs
+
+    // Fan-out of the monitored data
+    struct Subscriber {
+        Subscriber(int id, BroadcastRing& ring, DataCallback callback)
+            : id(id), reader(ring), callback(std::move(callback)), active(true) {}
+
+        int id;
+        BroadcastRing::Reader reader;
+        DataCallback callback;
+        std::atomic<bool> active;
+        std::thread thread;
+    };
+    BroadcastRing monitor_ring_;
+    BroadcastRing::Reader reply_reader_;  // Bootloader replies, under command_mutex_
+    mutable std::mutex subscribers_mutex_;
+    std::vector<std::unique_ptr<Subscriber>> subscribers_;
+    int next_subscriber_id_;
 
     // Private helper methods
-    void SetError(const std::string& error);
+    void SetError(const std::string& error) override;
     void MonitorThreadFunc();
+    static void SubscriberThreadFunc(Subscriber* subscriber);
 
     // Bootloader protocol helpers
+    void OnReceive(const uint8_t* data, size_t length);
+    bool Write(const uint8_t* data, size_t length);
+    int ReadReply(uint8_t* data, size_t length, int timeout_ms = 1000);
     bool SendCommand(BootloaderCommand cmd);
     bool SendCommandWithAddress(BootloaderCommand cmd, uint32_t address);
     bool WaitForAck(int timeout_ms = 1000);
+    void AppendCommand(std::vector<uint8_t>& packet, BootloaderCommand cmd, uint32_t address);
     bool WriteMemory(uint32_t address, const uint8_t* data, size_t length);
-    bool EraseMemory(bool full_erase = true);
+    bool EraseMemory(bool full_erase = true) override;
+    bool EraseSectors(const std::vector<FlashSector>& sectors) override;
+    bool ReadMemory(uint32_t address, uint8_t* data, size_t length) override;
+    bool GetProductId(uint16_t& pid) override;
+    bool WriteImage(uint32_t address, const uint8_t* data, size_t length, bool skip_erased,
+                    size_t& written, size_t total) override;
     uint8_t CalculateChecksum(const uint8_t* data, size_t length);
 };
 
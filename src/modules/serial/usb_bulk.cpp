@@ -0,0 +1,254 @@
+#include "usb_bulk.h"
+
+#if LUMOS_HAVE_LIBUSB
+#include <cstdio>
+#include <libusb.h>
+#include <vector>
+#endif
+
+namespace SimpleSerial {
+
+#if LUMOS_HAVE_LIBUSB
+
+namespace {
+
+constexpr unsigned char BULK_IN_EP = 0x81;
+constexpr unsigned char BULK_OUT_EP = 0x01;
+
+struct StreamState {
+    const UsbBulk::DataCallback* callback = nullptr;
+    uint64_t received = 0;
+    int active = 0;            // Transfers submitted and not yet finished
+    bool stopping = false;     // Finished transfers are not resubmitted
+    libusb_transfer_status failure = LIBUSB_TRANSFER_COMPLETED;
+};
+
+// Runs inside libusb_handle_events(), on the thread running Stream()
+void LIBUSB_CALL OnTransfer(libusb_transfer* transfer) {
+    StreamState* state = static_cast<StreamState*>(transfer->user_data);
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        if (transfer->actual_length > 0) {
+            state->received += static_cast<uint64_t>(transfer->actual_length);
+            (*state->callback)(transfer->buffer, static_cast<size_t>(transfer->actual_length));
+        }
+        if (!state->stopping && libusb_submit_transfer(transfer) == LIBUSB_SUCCESS) {
+            return;
+        }
+    } else if (transfer->status != LIBUSB_TRANSFER_CANCELLED && state->failure == LIBUSB_TRANSFER_COMPLETED) {
+        state->failure = transfer->status;
+    }
+    // One transfer dropping out would leave a gap in the data: end the stream
+    state->active--;
+    state->stopping = true;
+}
+
+std::string DescribeStatus(libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            return "device disconnected";
+        case LIBUSB_TRANSFER_STALL:
+            return "endpoint stalled";
+        case LIBUSB_TRANSFER_OVERFLOW:
+            return "device sent more than a transfer holds";
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            return "transfer timed out";
+        default:
+            return "transfer failed";
+    }
+}
+
+std::string DescribeError(const char* what, int rc) {
+    std::string error = std::string(what) + ": " + libusb_error_name(rc);
+    if (rc == LIBUSB_ERROR_ACCESS) {
+        error += " (no permission for the device; on Linux add a udev rule for it)";
+    } else if (rc == LIBUSB_ERROR_NOT_SUPPORTED) {
+        error += " (on Windows bind the interface to WinUSB, e.g. with Zadig)";
+    }
+    return error;
+}
+
+} // namespace
+
+UsbBulk::UsbBulk() = default;
+
+UsbBulk::~UsbBulk() {
+    Close();
+}
+
+bool UsbBulk::IsAvailable() {
+    return true;
+}
+
+bool UsbBulk::Open(uint16_t vid, uint16_t pid, const std::string& serial) {
+    Close();
+    int rc = libusb_init(&context_);
+    if (rc != LIBUSB_SUCCESS) {
+        context_ = nullptr;
+        last_error_ = DescribeError("libusb init failed", rc);
+        return false;
+    }
+
+    libusb_device** devices = nullptr;
+    ssize_t count = libusb_get_device_list(context_, &devices);
+    int open_error = LIBUSB_SUCCESS;
+    for (ssize_t i = 0; i < count && handle_ == nullptr; i++) {
+        libusb_device_descriptor descriptor;
+        if (libusb_get_device_descriptor(devices[i], &descriptor) != LIBUSB_SUCCESS ||
+            descriptor.idVendor != vid || descriptor.idProduct != pid) {
+            continue;
+        }
+        libusb_device_handle* handle = nullptr;
+        rc = libusb_open(devices[i], &handle);
+        if (rc != LIBUSB_SUCCESS) {
+            open_error = rc;
+            continue;
+        }
+        if (!serial.empty()) {
+            unsigned char text[128] = {0};
+            if (libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber, text, sizeof(text)) < 0 ||
+                serial != reinterpret_cast<const char*>(text)) {
+                libusb_close(handle);
+                continue;
+            }
+        }
+        handle_ = handle;
+    }
+    if (count > 0) {
+        libusb_free_device_list(devices, 1);
+    }
+
+    char id[16];
+    snprintf(id, sizeof(id), "%04x:%04x", vid, pid);
+    if (handle_ == nullptr) {
+        last_error_ = open_error != LIBUSB_SUCCESS
+            ? DescribeError((std::string("Failed to open ") + id).c_str(), open_error)
+            : std::string("No USB device ") + id + (serial.empty() ? "" : " with serial " + serial) +
+              " (is the firmware using USBInterface::Vendor?)";
+        Close();
+        return false;
+    }
+
+    // Not supported (and not needed) on macOS and Windows
+    libusb_set_auto_detach_kernel_driver(handle_, 1);
+    rc = libusb_claim_interface(handle_, 0);
+    if (rc != LIBUSB_SUCCESS) {
+        last_error_ = DescribeError((std::string("Failed to claim ") + id).c_str(), rc);
+        Close();
+        return false;
+    }
+    last_error_.clear();
+    return true;
+}
+
+void UsbBulk::Close() {
+    if (handle_ != nullptr) {
+        libusb_release_interface(handle_, 0);
+        libusb_close(handle_);
+        handle_ = nullptr;
+    }
+    if (context_ != nullptr) {
+        libusb_exit(context_);
+        context_ = nullptr;
+    }
+}
+
+uint64_t UsbBulk::Stream(const volatile bool& running, const DataCallback& callback,
+                         size_t transfer_size, size_t in_flight) {
+    if (handle_ == nullptr) {
+        last_error_ = "USB device not open";
+        return 0;
+    }
+
+    StreamState state;
+    state.callback = &callback;
+    std::vector<std::vector<unsigned char>> buffers(in_flight, std::vector<unsigned char>(transfer_size));
+    std::vector<libusb_transfer*> transfers;
+    for (auto& buffer : buffers) {
+        libusb_transfer* transfer = libusb_alloc_transfer(0);
+        if (transfer == nullptr) {
+            break;
+        }
+        libusb_fill_bulk_transfer(transfer, handle_, BULK_IN_EP, buffer.data(), static_cast<int>(buffer.size()),
+                                  OnTransfer, &state, 0);
+        transfers.push_back(transfer);
+        if (libusb_submit_transfer(transfer) == LIBUSB_SUCCESS) {
+            state.active++;
+        }
+    }
+    if (state.active == 0) {
+        last_error_ = "Failed to queue USB transfers";
+    }
+
+    // Events time out so that Ctrl+C is noticed
+    bool cancelled = false;
+    while (state.active > 0) {
+        if ((!running || state.stopping) && !cancelled) {
+            state.stopping = true;
+            for (libusb_transfer* transfer : transfers) {
+                libusb_cancel_transfer(transfer);  // LIBUSB_ERROR_NOT_FOUND once finished
+            }
+            cancelled = true;
+        }
+        timeval timeout = {0, 100000};
+        libusb_handle_events_timeout_completed(context_, &timeout, nullptr);
+    }
+    for (libusb_transfer* transfer : transfers) {
+        libusb_free_transfer(transfer);
+    }
+
+    if (state.failure != LIBUSB_TRANSFER_COMPLETED) {
+        last_error_ = "USB stream ended: " + DescribeStatus(state.failure);
+    }
+    return state.received;
+}
+
+bool UsbBulk::Write(const uint8_t* data, size_t length, unsigned int timeout_ms) {
+    if (handle_ == nullptr) {
+        last_error_ = "USB device not open";
+        return false;
+    }
+    int transferred = 0;
+    int rc = libusb_bulk_transfer(handle_, BULK_OUT_EP, const_cast<unsigned char*>(data), static_cast<int>(length),
+                                  &transferred, timeout_ms);
+    if (rc != LIBUSB_SUCCESS || static_cast<size_t>(transferred) != length) {
+        last_error_ = DescribeError("USB write failed", rc);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+UsbBulk::UsbBulk() = default;
+
+UsbBulk::~UsbBulk() = default;
+
+bool UsbBulk::IsAvailable() {
+    return false;
+}
+
+bool UsbBulk::Open(uint16_t vid, uint16_t pid, const std::string& serial) {
+    (void)vid;
+    (void)pid;
+    (void)serial;
+    last_error_ = "Built without libusb-1.0; install it (e.g. apt install libusb-1.0-0-dev) and rebuild";
+    return false;
+}
+
+void UsbBulk::Close() {
+}
+
+uint64_t UsbBulk::Stream(const volatile bool&, const DataCallback&, size_t, size_t) {
+    return 0;
+}
+
+bool UsbBulk::Write(const uint8_t* data, size_t length, unsigned int timeout_ms) {
+    (void)data;
+    (void)length;
+    (void)timeout_ms;
+    return false;
+}
+
+#endif // LUMOS_HAVE_LIBUSB
+
+} // namespace SimpleSerial
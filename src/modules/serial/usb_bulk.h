@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct libusb_context;
+struct libusb_device_handle;
+
+namespace SimpleSerial {
+
+/** Lumos bulk stream device (USB::begin(USBInterface::Vendor)) */
+constexpr uint16_t kLumosUsbVid = 0x0483;
+constexpr uint16_t kLumosUsbVendorPid = 0x5750;
+
+/**
+ * @brief Reads a vendor-class bulk IN endpoint at full bus speed
+ *
+ * A CDC port goes through the tty layer, which reads a packet or two at
+ * a time; here many large transfers are queued with libusb at once, so
+ * the host controller always has a buffer to fill and the device is
+ * never NAKed while the host turns a transfer around. Transfers complete
+ * in the order they were queued, so the data arrives in order.
+ *
+ * Needs libusb-1.0 at build time (LUMOS_HAVE_LIBUSB); without it Open()
+ * fails with an explanation. On Windows the interface must be bound to
+ * WinUSB (e.g. with Zadig).
+ */
+class UsbBulk {
+public:
+    /** Received data, called on the thread running Stream() */
+    using DataCallback = std::function<void(const uint8_t* data, size_t length)>;
+
+    UsbBulk();
+    ~UsbBulk();
+
+    UsbBulk(const UsbBulk&) = delete;
+    UsbBulk& operator=(const UsbBulk&) = delete;
+
+    /** Whether this build has libusb */
+    static bool IsAvailable();
+
+    /**
+     * @brief Open the first device with @p vid / @p pid and claim interface 0
+     * @param serial Only a device with this serial number (empty = any)
+     */
+    bool Open(uint16_t vid = kLumosUsbVid, uint16_t pid = kLumosUsbVendorPid, const std::string& serial = "");
+
+    void Close();
+
+    bool IsOpen() const { return handle_ != nullptr; }
+
+    /**
+     * @brief Read endpoint 0x81 until @p running turns false or the device goes away
+     * @param transfer_size Bytes per transfer, a multiple of the max packet size
+     * @param in_flight Transfers queued at any time
+     * @return Bytes received; GetLastError() says why a stream ended early
+     */
+    uint64_t Stream(const volatile bool& running, const DataCallback& callback,
+                    size_t transfer_size = 16384, size_t in_flight = 32);
+
+    /**
+     * @brief Blocking write to endpoint 0x01
+     */
+    bool Write(const uint8_t* data, size_t length, unsigned int timeout_ms = 1000);
+
+    std::string GetLastError() const { return last_error_; }
+
+private:
+    libusb_context* context_ = nullptr;
+    libusb_device_handle* handle_ = nullptr;
+    std::string last_error_;
+};
+
+} // namespace SimpleSerial
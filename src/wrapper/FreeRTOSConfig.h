@@ -0,0 +1,101 @@
+#pragma once
+
+// FreeRTOS configuration for RtosExecutor (framework/rtos_executor.h)
+//
+// Used when project.yaml selects 'rtos: freertos'. FreeRTOS comes from the
+// STM32Cube package (Middlewares/Third_Party/FreeRTOS); a project can
+// replace this file with include/FreeRTOSConfig.h.
+//
+// Everything is statically allocated: task stacks come from the pool sized
+// by project.yaml (LUMOS_RTOS_STACK_POOL_WORDS) and there is no FreeRTOS
+// heap. Wrapper peripherals use NVIC priority 5, so their interrupts (and
+// any ISR at priority 5 or lower urgency) may call FromISR functions.
+
+#include <stdint.h>
+
+#if defined(STM32H7)
+    #include "stm32h7xx.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern uint32_t SystemCoreClock;
+uint32_t LumosRtosRunTimeCounter(void);   // Microseconds, from rtos_executor.cpp
+#ifdef __cplusplus
+}
+#endif
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_TIME_SLICING                  1
+#define configCPU_CLOCK_HZ                      (SystemCoreClock)
+#define configTICK_RATE_HZ                      ((TickType_t)1000)   // Same 1 ms tick as HAL_GetTick()
+#define configMAX_PRIORITIES                    16
+#define configMINIMAL_STACK_SIZE                ((uint16_t)128)
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             0
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configQUEUE_REGISTRY_SIZE               0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_MALLOC_FAILED_HOOK            0
+
+// Static allocation only
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configSUPPORT_DYNAMIC_ALLOCATION        0
+#define configUSE_TIMERS                        0
+
+// Per-task CPU usage (RtosExecutor::UpdateStats())
+#define configUSE_TRACE_FACILITY                1
+#define configGENERATE_RUN_TIME_STATS           1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        LumosRtosRunTimeCounter()
+
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_xTaskDelayUntil                 1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_vTaskPrioritySet                0
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     0
+
+// Cortex-M33 port (H5): no TrustZone or MPU, FPU on
+#define configENABLE_TRUSTZONE                  0
+#define configENABLE_MPU                        0
+#define configENABLE_FPU                        1
+#define configRUN_FREERTOS_SECURE_ONLY          1
+
+// Interrupt priorities
+#ifdef __NVIC_PRIO_BITS
+#define configPRIO_BITS                         __NVIC_PRIO_BITS
+#else
+#define configPRIO_BITS                         4
+#endif
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY        ((1 << configPRIO_BITS) - 1)
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY   5
+#define configKERNEL_INTERRUPT_PRIORITY         (configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY    (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_API_CALL_INTERRUPT_PRIORITY   configMAX_SYSCALL_INTERRUPT_PRIORITY
+
+#define configASSERT(x) if ((x) == 0) { __asm volatile("cpsid i"); for (;;) {} }
+
+// The port supplies these two handlers; the board's stm32xxxx_it.c leaves
+// them out and calls xPortSysTickHandler() from its SysTick_Handler
+#define vPortSVCHandler     SVC_Handler
+#define xPortPendSVHandler  PendSV_Handler
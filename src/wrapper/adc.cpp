@@ -1,5 +1,8 @@
 #include "adc.h"
 #include "gpio.h"
+#include "peripherals.h"
+#include "memory_sections.h"
+#include "timer.h"
 #include <algorithm>
 
 // Static storage for AnalogInput instances (for interrupt handling)
@@ -33,10 +36,28 @@ AnalogInput::AnalogInput(ADC_TypeDef* adc)
       initialized_(false),
       resolution_(ADC_RESOLUTION_12B),
       vref_voltage_(3.3f),
+      oversampling_(1),
+      vref_mv_(3300),
+      mv_scale_(0),
+      volt_scale_(0),
+      q15_shift_(3),
+      vrefint_num_(0),
       num_configured_channels_(0),
       current_channel_(0),
+      channel_programmed_(false),
+      programmed_channel_(0),
+      programmed_sampling_time_(0),
+      raw_running_(false),
       latest_value_(0),
-      continuous_mode_(false)
+      continuous_mode_(false),
+      dma_handle_{},
+      dma_ready_(false),
+      scanning_(false),
+      scan_buffer_(nullptr),
+      scan_length_(0),
+      scan_callback_(nullptr),
+      scan_blocks_(0),
+      trigger_timer_(nullptr)
 {
     adc_handle_.Instance = adc;
 
@@ -57,9 +78,13 @@ AnalogInput::AnalogInput(ADC_TypeDef* adc)
 AnalogInput::~AnalogInput()
 {
     if (initialized_) {
+        stopScan();
         stop();
         HAL_ADC_DeInit(&adc_handle_);
     }
+    if (dma_ready_) {
+        HAL_DMA_DeInit(&dma_handle_);
+    }
 
     // Unregister instance
     int idx = getADCIndex(adc_);
@@ -70,60 +95,83 @@ AnalogInput::~AnalogInput()
 
 void AnalogInput::enableADCClock()
 {
-#ifdef ADC1
-    if (adc_ == ADC1) __HAL_RCC_ADC_CLK_ENABLE();
-#endif
-#ifdef ADC2
-    if (adc_ == ADC2) __HAL_RCC_ADC_CLK_ENABLE();
-#endif
-#ifdef ADC3
-    if (adc_ == ADC3) __HAL_RCC_ADC_CLK_ENABLE();
-#endif
-#ifdef ADC4
-    if (adc_ == ADC4) {
-#if defined(STM32G4)
-        __HAL_RCC_ADC345_CLK_ENABLE();
-#endif
-    }
-#endif
-#ifdef ADC5
-    if (adc_ == ADC5) {
-#if defined(STM32G4)
-        __HAL_RCC_ADC345_CLK_ENABLE();
-#endif
-    }
-#endif
+    enablePeripheralClock(adc_);
 }
 
-bool AnalogInput::init(uint32_t resolution, bool continuous, float vref_voltage)
+bool AnalogInput::init(uint32_t resolution, bool continuous, float vref_voltage, uint16_t oversampling)
 {
     if (initialized_) {
         return false;
     }
 
+    // Power of two up to 256, and only where the ADC has an oversampler
+    if (oversampling == 0 || oversampling > 256 || (oversampling & (oversampling - 1)) != 0) {
+        return false;
+    }
+#if defined(STM32F4)
+    if (oversampling > 1) {
+        return false;
+    }
+#endif
+
     resolution_ = resolution;
-    vref_voltage_ = vref_voltage;
     continuous_mode_ = continuous;
+    oversampling_ = oversampling;
+    setVRef(vref_voltage);
+
+    if (!applyInit(false, ADC_SOFTWARE_START)) {
+        return false;
+    }
+
+#if defined(VREFINT_CAL_ADDR) && defined(VREFINT_CAL_VREF)
+    // Factory VREFINT reading at VREFINT_CAL_VREF mV, taken at 16 bits on
+    // the H7 and 12 bits elsewhere; rescaled once so measuring VDDA later
+    // is a single division
+#if defined(STM32H7)
+    const uint8_t cal_bits = 16;
+#else
+    const uint8_t cal_bits = 12;
+#endif
+    const uint8_t bits = getResolutionBits();
+    uint32_t cal = *VREFINT_CAL_ADDR;
+    cal = (bits >= cal_bits) ? (cal << (bits - cal_bits)) : (cal >> (cal_bits - bits));
+    vrefint_num_ = (uint32_t)VREFINT_CAL_VREF * cal;
+#endif
+
+    initialized_ = true;
+    return true;
+}
+
+// Single conversions (scan = false) or a scan of all configured channels
+bool AnalogInput::applyInit(bool scan, uint32_t trigger)
+{
+    channel_programmed_ = false;
 
     // Common ADC configuration
-    adc_handle_.Init.Resolution = resolution;
+    adc_handle_.Init.Resolution = resolution_;
     adc_handle_.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-    adc_handle_.Init.ScanConvMode = ADC_SCAN_DISABLE;
-    adc_handle_.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
-    adc_handle_.Init.ContinuousConvMode = continuous ? ENABLE : DISABLE;
-    adc_handle_.Init.NbrOfConversion = 1;
+#if defined(STM32F4)
+    adc_handle_.Init.ScanConvMode = scan ? ENABLE : DISABLE;
+#else
+    adc_handle_.Init.ScanConvMode = scan ? ADC_SCAN_ENABLE : ADC_SCAN_DISABLE;
+#endif
+    adc_handle_.Init.EOCSelection = scan ? ADC_EOC_SEQ_CONV : ADC_EOC_SINGLE_CONV;
+    // Scans without a hardware trigger run back to back
+    adc_handle_.Init.ContinuousConvMode =
+        (scan ? trigger == ADC_SOFTWARE_START : continuous_mode_) ? ENABLE : DISABLE;
+    adc_handle_.Init.NbrOfConversion = scan ? num_configured_channels_ : 1;
     adc_handle_.Init.DiscontinuousConvMode = DISABLE;
-    adc_handle_.Init.ExternalTrigConv = ADC_SOFTWARE_START;
-    adc_handle_.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+    adc_handle_.Init.ExternalTrigConv = trigger;
+    adc_handle_.Init.ExternalTrigConvEdge =
+        (trigger == ADC_SOFTWARE_START) ? ADC_EXTERNALTRIGCONVEDGE_NONE : ADC_EXTERNALTRIGCONVEDGE_RISING;
 
 #if defined(STM32H7) || defined(STM32H5)
     // H7/H5-specific settings
     adc_handle_.Init.ClockPrescaler = ADC_CLOCK_ASYNC_DIV2;
     adc_handle_.Init.LowPowerAutoWait = DISABLE;
     adc_handle_.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
-    adc_handle_.Init.OversamplingMode = DISABLE;
     adc_handle_.Init.LeftBitShift = ADC_LEFTBITSHIFT_NONE;
-    adc_handle_.Init.ConversionDataManagement = ADC_CONVERSIONDATA_DR;
+    adc_handle_.Init.ConversionDataManagement = scan ? ADC_CONVERSIONDATA_DMA_CIRCULAR : ADC_CONVERSIONDATA_DR;
 
 #elif defined(STM32G0)
     // G0-specific settings
@@ -133,27 +181,54 @@ bool AnalogInput::init(uint32_t resolution, bool continuous, float vref_voltage)
     adc_handle_.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
     adc_handle_.Init.LowPowerAutoWait = DISABLE;
     adc_handle_.Init.LowPowerAutoPowerOff = DISABLE;
+    adc_handle_.Init.DMAContinuousRequests = scan ? ENABLE : DISABLE;
 
 #elif defined(STM32G4)
     // G4-specific settings
     adc_handle_.Init.ClockPrescaler = ADC_CLOCK_ASYNC_DIV2;
     adc_handle_.Init.LowPowerAutoWait = DISABLE;
     adc_handle_.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
-    adc_handle_.Init.OversamplingMode = DISABLE;
+    adc_handle_.Init.DMAContinuousRequests = scan ? ENABLE : DISABLE;
 
 #elif defined(STM32F4)
     // F4-specific settings
     adc_handle_.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
-    adc_handle_.Init.DMAContinuousRequests = DISABLE;
+    adc_handle_.Init.DMAContinuousRequests = scan ? ENABLE : DISABLE;
 
 #endif
 
-    if (HAL_ADC_Init(&adc_handle_) != HAL_OK) {
-        return false;
+#if !defined(STM32F4)
+    adc_handle_.Init.OversamplingMode = (oversampling_ > 1) ? ENABLE : DISABLE;
+    if (oversampling_ > 1) {
+        // Sum `ratio` conversions and shift by log2(ratio): an average at
+        // the configured resolution
+        uint8_t shift = 0;
+        while ((1u << shift) < oversampling_) {
+            shift++;
+        }
+        static const uint32_t right_shifts[] = {
+            ADC_RIGHTBITSHIFT_NONE, ADC_RIGHTBITSHIFT_1, ADC_RIGHTBITSHIFT_2, ADC_RIGHTBITSHIFT_3,
+            ADC_RIGHTBITSHIFT_4, ADC_RIGHTBITSHIFT_5, ADC_RIGHTBITSHIFT_6, ADC_RIGHTBITSHIFT_7,
+            ADC_RIGHTBITSHIFT_8};
+        adc_handle_.Init.Oversampling.RightBitShift = right_shifts[shift];
+#if defined(STM32H7)
+        // H7 takes the plain ratio
+        adc_handle_.Init.Oversampling.Ratio = oversampling_;
+#else
+        static const uint32_t ratios[] = {
+            0, ADC_OVERSAMPLING_RATIO_2, ADC_OVERSAMPLING_RATIO_4, ADC_OVERSAMPLING_RATIO_8,
+            ADC_OVERSAMPLING_RATIO_16, ADC_OVERSAMPLING_RATIO_32, ADC_OVERSAMPLING_RATIO_64,
+            ADC_OVERSAMPLING_RATIO_128, ADC_OVERSAMPLING_RATIO_256};
+        adc_handle_.Init.Oversampling.Ratio = ratios[shift];
+#endif
+        adc_handle_.Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;
+#if !defined(STM32G0)
+        adc_handle_.Init.Oversampling.OversamplingStopReset = ADC_REGOVERSAMPLING_CONTINUED_MODE;
+#endif
     }
+#endif
 
-    initialized_ = true;
-    return true;
+    return HAL_ADC_Init(&adc_handle_) == HAL_OK;
 }
 
 bool AnalogInput::calibrate()
@@ -191,10 +266,20 @@ bool AnalogInput::configureChannel(uint32_t channel, GPIO_TypeDef* port, uint16_
         configureGPIOAnalog(port, pin);
     }
 
-    // Store channel configuration
-    configured_channels_[num_configured_channels_] = channel;
-    stored_sampling_times_[num_configured_channels_] = sampling_time;
-    num_configured_channels_++;
+    // Store channel configuration (reconfiguring a channel updates it, so
+    // the scan sequence holds each channel once)
+    uint8_t index = 0;
+    while (index < num_configured_channels_ && configured_channels_[index] != channel) {
+        index++;
+    }
+    if (index == num_configured_channels_) {
+        if (num_configured_channels_ == MAX_CHANNELS) {
+            return false;
+        }
+        num_configured_channels_++;
+    }
+    configured_channels_[index] = channel;
+    stored_sampling_times_[index] = sampling_time;
     current_channel_ = channel;
 
     return true;
@@ -236,20 +321,13 @@ bool AnalogInput::configureVRefChannel()
 
 uint16_t AnalogInput::read(uint32_t channel, uint32_t timeout_ms)
 {
-    if (!initialized_) {
+    if (!initialized_ || scanning_) {
         return 0;
     }
 
     // Find sampling time for the channel
-    uint32_t sampling_time = 0;
     uint32_t ch = (channel != 0) ? channel : current_channel_;
-
-    for (uint8_t i = 0; i < num_configured_channels_; i++) {
-        if (configured_channels_[i] == ch) {
-            sampling_time = stored_sampling_times_[i];
-            break;
-        }
-    }
+    uint32_t sampling_time = samplingTimeFor(ch);
 
     // Select channel if specified
     if (channel != 0 && channel != current_channel_) {
@@ -271,6 +349,7 @@ uint16_t AnalogInput::read(uint32_t channel, uint32_t timeout_ms)
     // Wait for conversion to complete
     if (HAL_ADC_PollForConversion(&adc_handle_, timeout_ms) != HAL_OK) {
         HAL_ADC_Stop(&adc_handle_);
+        raw_running_ = false;
         return 0;
     }
 
@@ -279,10 +358,56 @@ uint16_t AnalogInput::read(uint32_t channel, uint32_t timeout_ms)
 
     // Stop ADC
     HAL_ADC_Stop(&adc_handle_);
+    raw_running_ = false;
 
     return value;
 }
 
+uint16_t AnalogInput::readRaw(uint32_t channel)
+{
+    if (!initialized_ || scanning_) {
+        return 0;
+    }
+
+    // Reconfigures only when the channel changes (see selectChannel())
+    uint32_t ch = (channel != 0) ? channel : current_channel_;
+    if (!channel_programmed_ || ch != programmed_channel_) {
+        if (!selectChannel(ch, samplingTimeFor(ch))) {
+            return 0;
+        }
+    }
+
+    if (!raw_running_) {
+        // The HAL enables the ADC and starts the first conversion; it stays
+        // enabled afterwards so later ones only need the start bit
+        if (HAL_ADC_Start(&adc_handle_) != HAL_OK) {
+            return 0;
+        }
+        raw_running_ = true;
+    } else {
+#if defined(STM32F4)
+        adc_->CR2 |= ADC_CR2_SWSTART;
+#else
+        adc_->CR |= ADC_CR_ADSTART;
+#endif
+    }
+
+    // Even the slowest sampling time converts well within this
+    uint32_t spins = 1000000;
+#if defined(STM32F4)
+    while ((adc_->SR & ADC_SR_EOC) == 0) {
+#else
+    while ((adc_->ISR & ADC_ISR_EOC) == 0) {
+#endif
+        if (--spins == 0) {
+            return 0;
+        }
+    }
+
+    // Reading DR clears EOC
+    return (uint16_t)adc_->DR;
+}
+
 float AnalogInput::readVoltage(uint32_t channel, uint32_t timeout_ms)
 {
     uint16_t raw = read(channel, timeout_ms);
@@ -346,24 +471,33 @@ float AnalogInput::readVRef()
     configureVRefChannel();
     uint16_t raw = read(0, 100);
 
-    // VRef calculation
-#if defined(STM32G0)
-    const uint16_t *VREFINT_CAL = (uint16_t*)0x1FFF75AA;
-    float vref = 3.0f * (*VREFINT_CAL) / raw;
-    return vref;
-#elif defined(STM32G4)
-    const uint16_t *VREFINT_CAL = (uint16_t*)0x1FFF75AA;
-    float vref = 3.0f * (*VREFINT_CAL) / raw;
-    return vref;
-#else
+    // VRef calculation from the factory calibration (see init())
+    if (vrefint_num_ != 0 && raw != 0) {
+        return (float)(vrefint_num_ / raw) / 1000.0f;
+    }
+
     // For platforms without calibration, use nominal VRef
     return rawToVoltage(raw);
-#endif
+}
+
+uint32_t AnalogInput::measureVddaMillivolts()
+{
+    if (!initialized_ || scanning_ || vrefint_num_ == 0 || !configureVRefChannel()) {
+        return 0;
+    }
+
+    uint16_t raw = read(0, 100);
+    if (raw == 0) {
+        return 0;
+    }
+
+    setVRefMillivolts(vrefint_num_ / raw);
+    return vref_mv_;
 }
 
 bool AnalogInput::startContinuous()
 {
-    if (!initialized_ || !continuous_mode_) {
+    if (!initialized_ || !continuous_mode_ || scanning_) {
         return false;
     }
 
@@ -391,6 +525,205 @@ void AnalogInput::stop()
     } else {
         HAL_ADC_Stop(&adc_handle_);
     }
+    raw_running_ = false;
+}
+
+// ===== Scan Mode =====
+
+bool AnalogInput::beginDma(AdcDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq)
+{
+#if defined(STM32H5)
+    // GPDMA only runs circular transfers from a linked-list queue
+    (void)dma_instance;
+    (void)dma_request;
+    (void)dma_irq;
+    return false;
+#else
+    if (scanning_) {
+        return false;
+    }
+
+    enableDMAClock(dma_instance);
+
+    dma_handle_ = {};
+    dma_handle_.Instance = dma_instance;
+#if defined(STM32F4)
+    dma_handle_.Init.Channel = dma_request;
+#else
+    dma_handle_.Init.Request = dma_request;
+#endif
+    dma_handle_.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    dma_handle_.Init.PeriphInc = DMA_PINC_DISABLE;
+    dma_handle_.Init.MemInc = DMA_MINC_ENABLE;
+    dma_handle_.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    dma_handle_.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    dma_handle_.Init.Mode = DMA_CIRCULAR;
+    dma_handle_.Init.Priority = DMA_PRIORITY_HIGH;
+#if defined(STM32H7) || defined(STM32F4)
+    dma_handle_.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+
+    if (HAL_DMA_Init(&dma_handle_) != HAL_OK) {
+        return false;
+    }
+    __HAL_LINKDMA(&adc_handle_, DMA_Handle, dma_handle_);
+    dma_ready_ = true;
+
+    HAL_NVIC_SetPriority(dma_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(dma_irq);
+    return true;
+#endif
+}
+
+bool AnalogInput::startScan(uint16_t* buffer, uint16_t length, ScanCallback callback, uint32_t trigger)
+{
+    const uint8_t channels = num_configured_channels_;
+    if (!initialized_ || !dma_ready_ || scanning_ || buffer == nullptr ||
+        channels == 0 || channels > MAX_SCAN_CHANNELS ||
+        length == 0 || length % (2 * channels) != 0) {
+        return false;
+    }
+
+#if defined(STM32H7)
+    // DMA1/DMA2 cannot reach DTCM, and each half is invalidated from the
+    // D-cache on its own, so the halves must cover whole cache lines
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    if ((address >= 0x20000000 && address < 0x20020000) ||
+        (isDCacheable(buffer) && (address % 32 != 0 || length % 32 != 0))) {
+        return false;
+    }
+#endif
+
+    stop();
+    if (!applyInit(true, trigger)) {
+        applyInit(false, ADC_SOFTWARE_START);
+        return false;
+    }
+    for (uint8_t i = 0; i < channels; i++) {
+        if (!selectChannel(configured_channels_[i], stored_sampling_times_[i], i + 1)) {
+            applyInit(false, ADC_SOFTWARE_START);
+            return false;
+        }
+    }
+
+    scan_buffer_ = buffer;
+    scan_length_ = length;
+    scan_callback_ = callback;
+    scan_blocks_ = 0;
+
+    invalidateDCache(buffer, length * sizeof(uint16_t));
+
+    scanning_ = true;
+    if (HAL_ADC_Start_DMA(&adc_handle_, reinterpret_cast<uint32_t*>(buffer), length) != HAL_OK) {
+        scanning_ = false;
+        applyInit(false, ADC_SOFTWARE_START);
+        return false;
+    }
+    return true;
+}
+
+// ADC external trigger fired by a timer's TRGO (TRGO2 for G0's TIM1), or
+// ADC_SOFTWARE_START if the timer can't trigger the ADC
+static uint32_t timerTrigger(TIM_TypeDef* timer)
+{
+#if defined(STM32F4)
+#ifdef ADC_EXTERNALTRIGCONV_T2_TRGO
+    if (timer == TIM2) return ADC_EXTERNALTRIGCONV_T2_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIGCONV_T3_TRGO
+    if (timer == TIM3) return ADC_EXTERNALTRIGCONV_T3_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIGCONV_T8_TRGO
+    if (timer == TIM8) return ADC_EXTERNALTRIGCONV_T8_TRGO;
+#endif
+#else
+#if defined(ADC_EXTERNALTRIG_T1_TRGO)
+    if (timer == TIM1) return ADC_EXTERNALTRIG_T1_TRGO;
+#elif defined(ADC_EXTERNALTRIG_T1_TRGO2)
+    if (timer == TIM1) return ADC_EXTERNALTRIG_T1_TRGO2;
+#endif
+#ifdef ADC_EXTERNALTRIG_T2_TRGO
+    if (timer == TIM2) return ADC_EXTERNALTRIG_T2_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T3_TRGO
+    if (timer == TIM3) return ADC_EXTERNALTRIG_T3_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T4_TRGO
+    if (timer == TIM4) return ADC_EXTERNALTRIG_T4_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T6_TRGO
+    if (timer == TIM6) return ADC_EXTERNALTRIG_T6_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T7_TRGO
+    if (timer == TIM7) return ADC_EXTERNALTRIG_T7_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T8_TRGO
+    if (timer == TIM8) return ADC_EXTERNALTRIG_T8_TRGO;
+#endif
+#ifdef ADC_EXTERNALTRIG_T15_TRGO
+    if (timer == TIM15) return ADC_EXTERNALTRIG_T15_TRGO;
+#endif
+#endif
+    (void)timer;
+    return ADC_SOFTWARE_START;
+}
+
+bool AnalogInput::startScan(uint16_t* buffer, uint16_t length, ScanCallback callback, Timer& trigger_timer)
+{
+    const uint32_t trigger = timerTrigger(trigger_timer.getHandle()->Instance);
+    if (!trigger_timer.isInitialized() || trigger == ADC_SOFTWARE_START ||
+        !trigger_timer.enableTriggerOutput()) {
+        return false;
+    }
+
+    // ADC first, so the first trigger already finds it armed
+    if (!startScan(buffer, length, callback, trigger)) {
+        return false;
+    }
+    trigger_timer_ = &trigger_timer;
+    trigger_timer.start();
+    return true;
+}
+
+float AnalogInput::getScanRate() const
+{
+    return (trigger_timer_ != nullptr) ? trigger_timer_->getUpdateRate() : 0.0f;
+}
+
+void AnalogInput::stopScan()
+{
+    if (!scanning_) {
+        return;
+    }
+
+    if (trigger_timer_ != nullptr) {
+        trigger_timer_->stop();
+        trigger_timer_ = nullptr;
+    }
+    HAL_ADC_Stop_DMA(&adc_handle_);
+    scanning_ = false;
+    scan_callback_ = nullptr;
+
+    // Back to single conversions; read() selects its channel again
+    applyInit(false, ADC_SOFTWARE_START);
+}
+
+void AnalogInput::onScanBlock(bool second_half)
+{
+    if (!scanning_) {
+        return;
+    }
+
+    const uint16_t half = scan_length_ / 2;
+    const uint16_t* block = scan_buffer_ + (second_half ? half : 0);
+
+    // Drop stale cache lines so the CPU reads what the DMA wrote
+    invalidateDCache(const_cast<uint16_t*>(block), half * sizeof(uint16_t));
+
+    scan_blocks_ = scan_blocks_ + 1;
+    if (scan_callback_) {
+        scan_callback_(block, half);
+    }
 }
 
 float AnalogInput::getVoltage() const
@@ -404,6 +737,42 @@ float AnalogInput::rawToVoltage(uint16_t raw_value) const
     return (float)raw_value * vref_voltage_ / (float)max_value;
 }
 
+void AnalogInput::setVRef(float vref_voltage)
+{
+    vref_voltage_ = vref_voltage;
+    vref_mv_ = (uint32_t)(vref_voltage * 1000.0f + 0.5f);
+    updateConversion();
+}
+
+void AnalogInput::setVRefMillivolts(uint32_t vref_mv)
+{
+    vref_mv_ = vref_mv;
+    vref_voltage_ = (float)vref_mv / 1000.0f;
+    updateConversion();
+}
+
+void AnalogInput::updateConversion()
+{
+    // Divisions happen here, once, rather than per sample
+    mv_scale_ = (vref_mv_ << 16) / getMaxValue();
+    const uint32_t full_scale_mv = 1000u * getMaxValue();
+    volt_scale_ = (uint32_t)((((uint64_t)vref_mv_ << 24) + full_scale_mv / 2) / full_scale_mv);
+    q15_shift_ = (int8_t)(15 - getResolutionBits());
+}
+
+uint8_t AnalogInput::getResolutionBits() const
+{
+    switch (resolution_) {
+        case ADC_RESOLUTION_10B: return 10;
+        case ADC_RESOLUTION_8B:  return 8;
+#if defined(STM32H7) || defined(STM32H5)
+        case ADC_RESOLUTION_16B: return 16;
+        case ADC_RESOLUTION_14B: return 14;
+#endif
+        default: return 12;
+    }
+}
+
 uint16_t AnalogInput::getMaxValue() const
 {
     switch (resolution_) {
@@ -430,12 +799,29 @@ void AnalogInput::configureGPIOAnalog(GPIO_TypeDef* port, uint16_t pin)
     gpio.mode(GPIO_MODE_ANALOG, GPIO_NOPULL, GPIO_SPEED_FREQ_LOW);
 }
 
-bool AnalogInput::selectChannel(uint32_t channel, uint32_t sampling_time)
+uint32_t AnalogInput::samplingTimeFor(uint32_t channel) const
+{
+    for (uint8_t i = 0; i < num_configured_channels_; i++) {
+        if (configured_channels_[i] == channel) {
+            return stored_sampling_times_[i];
+        }
+    }
+    return 0;
+}
+
+bool AnalogInput::selectChannel(uint32_t channel, uint32_t sampling_time, uint8_t rank)
 {
+    // The sequencer keeps its setup between conversions
+    if (rank == 1 && channel_programmed_ && channel == programmed_channel_ &&
+        sampling_time == programmed_sampling_time_) {
+        current_channel_ = channel;
+        return true;
+    }
+
     ADC_ChannelConfTypeDef config = {0};
 
     config.Channel = getADCChannel(channel);
-    config.Rank = ADC_REGULAR_RANK_1;
+    config.Rank = getRegularRank(rank);
 
 #if defined(STM32H7) || defined(STM32H5)
     config.SamplingTime = (sampling_time == 0) ? ADC_SAMPLETIME_8CYCLES_5 : sampling_time;
@@ -459,9 +845,15 @@ bool AnalogInput::selectChannel(uint32_t channel, uint32_t sampling_time)
 #endif
 
     if (HAL_ADC_ConfigChannel(&adc_handle_, &config) != HAL_OK) {
+        channel_programmed_ = false;
         return false;
     }
 
+    if (rank == 1) {
+        channel_programmed_ = true;
+        programmed_channel_ = channel;
+        programmed_sampling_time_ = sampling_time;
+    }
     current_channel_ = channel;
     return true;
 }
@@ -491,10 +883,38 @@ uint32_t AnalogInput::getADCChannel(uint32_t channel)
 #ifdef ADC_CHANNEL_18
         case 18: return ADC_CHANNEL_18;
 #endif
-        default: return ADC_CHANNEL_0;
+        // Internal channels are passed as HAL constants already
+        default: return channel;
     }
 }
 
+uint32_t AnalogInput::getRegularRank(uint8_t rank)
+{
+#if defined(STM32F4)
+    // F4 ranks are plain sequence positions
+    return rank;
+#else
+    switch (rank) {
+        case 2:  return ADC_REGULAR_RANK_2;
+        case 3:  return ADC_REGULAR_RANK_3;
+        case 4:  return ADC_REGULAR_RANK_4;
+        case 5:  return ADC_REGULAR_RANK_5;
+        case 6:  return ADC_REGULAR_RANK_6;
+        case 7:  return ADC_REGULAR_RANK_7;
+        case 8:  return ADC_REGULAR_RANK_8;
+        case 9:  return ADC_REGULAR_RANK_9;
+        case 10: return ADC_REGULAR_RANK_10;
+        case 11: return ADC_REGULAR_RANK_11;
+        case 12: return ADC_REGULAR_RANK_12;
+        case 13: return ADC_REGULAR_RANK_13;
+        case 14: return ADC_REGULAR_RANK_14;
+        case 15: return ADC_REGULAR_RANK_15;
+        case 16: return ADC_REGULAR_RANK_16;
+        default: return ADC_REGULAR_RANK_1;
+    }
+#endif
+}
+
 // Helper Functions Implementation
 
 uint32_t getADCClock(ADC_TypeDef* adc)
@@ -520,15 +940,34 @@ uint32_t getADCClock(ADC_TypeDef* adc)
 
 // HAL Callbacks
 
-extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+static AnalogInput* findADC(ADC_HandleTypeDef* hadc)
 {
-    // Find which ADC instance this is
     for (int i = 0; i < 5; i++) {
-        if (adc_instances[i] != nullptr) {
-            if (adc_instances[i]->getHandle() == hadc) {
-                adc_instances[i]->handleInterrupt();
-                break;
-            }
+        if (adc_instances[i] != nullptr && adc_instances[i]->getHandle() == hadc) {
+            return adc_instances[i];
         }
     }
+    return nullptr;
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    AnalogInput* adc = findADC(hadc);
+    if (adc == nullptr) {
+        return;
+    }
+
+    // In scan mode this is the DMA reaching the end of the buffer
+    if (adc->isScanning()) {
+        adc->onScanBlock(true);
+    } else {
+        adc->handleInterrupt();
+    }
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    if (AnalogInput* adc = findADC(hadc)) {
+        adc->onScanBlock(false);
+    }
 }
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <functional>
+#include "fixed_point.h"
+#include "trace.h"
 
 // Platform-specific HAL headers
 #if defined(STM32H7)
@@ -23,6 +25,15 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
 #endif
 
+class Timer;
+
+// DMA stream (H7, F4) or channel (G0, G4) used for scans
+#if defined(STM32H7) || defined(STM32F4)
+    typedef DMA_Stream_TypeDef AdcDmaInstance;
+#else
+    typedef DMA_Channel_TypeDef AdcDmaInstance;
+#endif
+
 // AnalogInput Class - Analog to Digital Converter
 // Note: Class is named AnalogInput to avoid conflict with ADC macro in STM32 headers
 //
@@ -57,25 +68,106 @@
 //      float temp = adc.readTemperature();
 //      float vref = adc.readVRef();
 //
+//      Repeated reads of the same channel reuse its configuration; for
+//      tight polling loops readRaw() skips the HAL altogether:
+//      while (running) { uint16_t v = adc.readRaw(3); ... }
+//
+//   5. Multi-Channel Scan via circular DMA:
+//      Converts every configured channel in order, over and over, into a
+//      buffer split in two halves. While the DMA fills one half the
+//      callback gets the other, complete one, so the CPU never sees a
+//      half-written block. Samples are interleaved per scan:
+//      ch_a, ch_b, ch_c, ch_a, ch_b, ch_c, ...
+//
+//      alignas(32) static uint16_t samples[2 * 8 * 3];  // 2 halves of 8 scans of 3 channels
+//
+//      AnalogInput adc(ADC1);
+//      adc.init();
+//      adc.configureChannel(3, GPIOA, GPIO_PIN_6);  // Phase A current
+//      adc.configureChannel(5, GPIOB, GPIO_PIN_1);  // Phase B current
+//      adc.configureChannel(9, GPIOB, GPIO_PIN_0);  // Bus voltage
+//      adc.beginDma(DMA1_Stream0, DMA_REQUEST_ADC1, DMA1_Stream0_IRQn);
+//      adc.startScan(samples, 2 * 8 * 3,
+//          [](const uint16_t* block, uint16_t count) { /* count = 24 samples */ },
+//          ADC_EXTERNALTRIG_T1_TRGO);  // One scan per TIM1 update
+//
+//      extern "C" void DMA1_Stream0_IRQHandler(void) { adc.handleDmaInterrupt(); }
+//
+//      The trigger sets the scan rate (see Timer::enableTriggerOutput());
+//      ADC_SOFTWARE_START scans back to back as fast as the ADC runs. On
+//      the H7 the buffer must be in DMA-reachable RAM (not DTCM), 32-byte
+//      aligned, with halves that are a multiple of 32 bytes.
+//
+//   6. Scans at an exact rate from a Timer:
+//      Timer sample_timer(TIM6);
+//      sample_timer.initFrequency(25600);  // 25.6 kHz, one scan per update
+//      adc.startScan(samples, 2 * 8 * 3, on_block, sample_timer);
+//      float fs = adc.getScanRate();  // Rate the hardware really runs at
+//
+//      The ADC sets up the timer's trigger output and starts and stops it
+//      with the scan; no CPU time is spent per sample.
+//
+//   7. Oversampling and integer conversions (no FPU needed):
+//      AnalogInput adc(ADC1);
+//      adc.init(ADC_RESOLUTION_12B, false, 3.3f, 16);  // Average 16 conversions in hardware
+//      adc.measureVddaMillivolts();  // Optional: track the real supply via VREFINT
+//      uint32_t mv = adc.readMillivolts(3);
+//      int16_t q = adc.rawToQ15(adc.readRaw(3));  // Fraction of full scale
+//
+//      Oversampling runs on G0, G4, H7 and H5; each result costs `ratio`
+//      conversions but keeps the configured resolution scale.
+//
 class AnalogInput
 {
+public:
+    // Callback for each complete half of the scan buffer
+    using ScanCallback = std::function<void(const uint16_t* block, uint16_t count)>;
+
 private:
     ADC_HandleTypeDef adc_handle_;
     ADC_TypeDef* adc_;
     bool initialized_;
     uint32_t resolution_;
     float vref_voltage_;  // Reference voltage (default 3.3V)
+    uint16_t oversampling_;  // Hardware oversampling ratio, 1 = off
+
+    // Integer conversions, precomputed from the reference and resolution
+    uint32_t vref_mv_;
+    uint32_t mv_scale_;      // Millivolts per count, 16.16 fixed point
+    uint32_t volt_scale_;    // Volts per count, 8.24 fixed point
+    int8_t q15_shift_;       // Left shift from raw counts to Q15
+    uint32_t vrefint_num_;   // VREFINT_CAL_VREF * VREFINT_CAL at our resolution, 0 if unknown
 
     // Channel configuration
     static constexpr uint8_t MAX_CHANNELS = 18;
     uint32_t configured_channels_[MAX_CHANNELS];
     uint8_t num_configured_channels_;
-    uint8_t current_channel_;
+    uint32_t current_channel_;
+
+    // What the regular sequencer's rank 1 holds, so reads of the same
+    // channel skip HAL_ADC_ConfigChannel
+    bool channel_programmed_;
+    uint32_t programmed_channel_;
+    uint32_t programmed_sampling_time_;
+    bool raw_running_;  // ADC left enabled by readRaw()
 
     // Continuous mode storage
     uint16_t latest_value_;
     bool continuous_mode_;
 
+    // Scan mode, see startScan()
+    static constexpr uint8_t MAX_SCAN_CHANNELS = 16;  // Regular sequence length
+    DMA_HandleTypeDef dma_handle_;
+    bool dma_ready_;
+    bool scanning_;
+    uint16_t* scan_buffer_;
+    uint16_t scan_length_;
+    ScanCallback scan_callback_;
+    volatile uint32_t scan_blocks_;
+    Timer* trigger_timer_;
+
+    bool applyInit(bool scan, uint32_t trigger);
+
 public:
     AnalogInput() = delete;
     AnalogInput(ADC_TypeDef* adc);
@@ -88,13 +180,16 @@ public:
      * @param resolution ADC resolution (ADC_RESOLUTION_12B, ADC_RESOLUTION_10B, etc.)
      * @param continuous Enable continuous conversion mode
      * @param vref_voltage Reference voltage in volts (default 3.3V)
-     * @return true if successful
+     * @param oversampling Hardware oversampling ratio: 1 (off) or a power
+     *        of two up to 256, averaged back to the configured resolution
+     * @return true if successful, false if the ratio isn't supported
      *
      * Example: adc.init(ADC_RESOLUTION_12B, false, 3.3f);
      */
     bool init(uint32_t resolution = ADC_RESOLUTION_12B,
               bool continuous = false,
-              float vref_voltage = 3.3f);
+              float vref_voltage = 3.3f,
+              uint16_t oversampling = 1);
 
     /**
      * @brief Calibrate ADC (recommended before first use)
@@ -155,6 +250,31 @@ public:
      */
     float readVoltage(uint32_t channel = 0, uint32_t timeout_ms = 100);
 
+    /**
+     * @brief Read ADC value as volts in @p T: float or Fixed (fixed_point.h)
+     *
+     * Fixed needs no floating point, for boards without an FPU; Real is
+     * whichever of the two suits the board.
+     *
+     * Example: Real volts = adc.readVoltage<Real>();
+     */
+    template <typename T>
+    T readVoltage(uint32_t channel = 0, uint32_t timeout_ms = 100)
+    {
+        return rawToVoltage<T>(read(channel, timeout_ms));
+    }
+
+    /**
+     * @brief Fast blocking read that drives the ADC registers directly
+     * @param channel Channel to read (0 = the one last read)
+     * @return ADC value, or 0 on timeout
+     *
+     * Leaves the ADC enabled between calls and only sets the start bit, so
+     * a conversion costs little more than its sampling time. For tight
+     * polling loops; stop() disables the ADC again.
+     */
+    uint16_t readRaw(uint32_t channel = 0);
+
     /**
      * @brief Read internal temperature sensor
      * @return Temperature in degrees Celsius
@@ -194,6 +314,71 @@ public:
      */
     float getVoltage() const;
 
+    /**
+     * @brief Latest continuous-mode value as volts in @p T (float or Fixed)
+     */
+    template <typename T>
+    T getVoltage() const { return rawToVoltage<T>(latest_value_); }
+
+    // ===== Scan Mode (circular DMA) =====
+
+    /**
+     * @brief Set up the DMA for startScan()
+     * @param dma_instance DMA stream/channel, e.g. DMA1_Stream0 (H7, F4) or DMA1_Channel1 (G0, G4)
+     * @param dma_request DMAMUX request, e.g. DMA_REQUEST_ADC1 (DMA_CHANNEL_x on F4)
+     * @param dma_irq Interrupt of the DMA stream/channel
+     * @return true if successful (false on H5: GPDMA circular mode needs a linked list)
+     */
+    bool beginDma(AdcDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq);
+
+    /**
+     * @brief Start scanning all configured channels into a double buffer
+     * @param buffer Sample storage, must stay valid until stopScan()
+     * @param length Samples in @p buffer; a multiple of 2 * channel count
+     * @param callback Called from the DMA interrupt with each complete half
+     * @param trigger ADC_SOFTWARE_START (free running) or a hardware trigger
+     *        such as ADC_EXTERNALTRIG_T1_TRGO (one scan per trigger)
+     * @return true if the scan was started
+     */
+    bool startScan(uint16_t* buffer, uint16_t length, ScanCallback callback,
+                   uint32_t trigger = ADC_SOFTWARE_START);
+
+    /**
+     * @brief Start scanning at the update rate of a timer
+     * @param trigger_timer Initialized timer (e.g. initFrequency(rate)) that
+     *        can trigger this ADC; it is started here and stopped by stopScan()
+     * @return false if the timer is not initialized or cannot trigger this ADC
+     */
+    bool startScan(uint16_t* buffer, uint16_t length, ScanCallback callback, Timer& trigger_timer);
+
+    /**
+     * @brief Scans per second when triggered by a Timer, 0 otherwise
+     */
+    float getScanRate() const;
+
+    /**
+     * @brief Stop scanning; read() works again afterwards
+     */
+    void stopScan();
+
+    bool isScanning() const { return scanning_; }
+
+    /**
+     * @brief Half buffers completed since startScan()
+     */
+    uint32_t getScanBlocks() const { return scan_blocks_; }
+
+    /**
+     * @brief Handle the scan DMA interrupt (called from the DMA IRQ handler)
+     */
+    void handleDmaInterrupt() { LUMOS_TRACE_ISR("adc dma"); HAL_DMA_IRQHandler(&dma_handle_); }
+
+    /**
+     * @brief Deliver a completed half (called from the HAL callbacks)
+     * @param second_half false for the first half of the buffer
+     */
+    void onScanBlock(bool second_half);
+
     // ===== Utilities =====
 
     /**
@@ -203,17 +388,66 @@ public:
      */
     float rawToVoltage(uint16_t raw_value) const;
 
+    /**
+     * @brief Convert raw ADC value to volts in @p T (float or Fixed)
+     * @param raw_value Raw ADC reading
+     * @return Volts; as Fixed one multiply and shift
+     */
+    template <typename T>
+    T rawToVoltage(uint16_t raw_value) const { return voltageAs(raw_value, static_cast<T*>(nullptr)); }
+
     /**
      * @brief Get maximum ADC value for current resolution
      * @return Maximum value (e.g., 4095 for 12-bit)
      */
     uint16_t getMaxValue() const;
 
+    /**
+     * @brief Convert raw ADC value to millivolts without floating point
+     * @param raw_value Raw ADC reading
+     * @return Millivolts (one multiply and shift)
+     */
+    uint32_t rawToMillivolts(uint16_t raw_value) const { return (raw_value * mv_scale_ + 0x8000) >> 16; }
+
+    /**
+     * @brief Convert raw ADC value to a Q15 fraction of full scale
+     * @param raw_value Raw ADC reading
+     * @return 0 to just under 32768 (1.0)
+     */
+    int16_t rawToQ15(uint16_t raw_value) const
+    {
+        return (int16_t)((q15_shift_ >= 0) ? (raw_value << q15_shift_) : (raw_value >> -q15_shift_));
+    }
+
+    /**
+     * @brief Read ADC value in millivolts (integer)
+     * @param channel Channel to read
+     * @param timeout_ms Timeout in milliseconds
+     * @return Millivolts
+     */
+    uint32_t readMillivolts(uint32_t channel = 0, uint32_t timeout_ms = 100)
+    {
+        return rawToMillivolts(read(channel, timeout_ms));
+    }
+
+    /**
+     * @brief Measure the real reference (VDDA) against the factory VREFINT
+     *        calibration and use it for later conversions
+     * @return VDDA in millivolts, or 0 if this part has no calibration value
+     */
+    uint32_t measureVddaMillivolts();
+
     /**
      * @brief Set reference voltage (if different from default)
      * @param vref_voltage Reference voltage in volts
      */
-    void setVRef(float vref_voltage) { vref_voltage_ = vref_voltage; }
+    void setVRef(float vref_voltage);
+
+    /**
+     * @brief Set reference voltage in millivolts (no floating point)
+     * @param vref_mv Reference voltage in millivolts
+     */
+    void setVRefMillivolts(uint32_t vref_mv);
 
     /**
      * @brief Check if ADC is initialized
@@ -237,7 +471,16 @@ private:
     void enableADCClock();
     uint32_t getADCChannel(uint32_t channel);
     void configureGPIOAnalog(GPIO_TypeDef* port, uint16_t pin);
-    bool selectChannel(uint32_t channel, uint32_t sampling_time = 0);
+    bool selectChannel(uint32_t channel, uint32_t sampling_time = 0, uint8_t rank = 1);
+    uint32_t samplingTimeFor(uint32_t channel) const;
+    uint8_t getResolutionBits() const;
+    void updateConversion();
+    float voltageAs(uint16_t raw_value, float*) const { return rawToVoltage(raw_value); }
+    Fixed voltageAs(uint16_t raw_value, Fixed*) const
+    {
+        return Fixed::fromRaw((int32_t)((raw_value * volt_scale_ + 0x80) >> 8));
+    }
+    uint32_t getRegularRank(uint8_t rank);
     uint32_t stored_sampling_times_[MAX_CHANNELS];
 };
 
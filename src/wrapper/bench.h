@@ -0,0 +1,147 @@
+#pragma once
+
+#include "sys.h"
+
+// On-target micro-benchmarks, collected with `lumos bench`
+// Usage Example:
+//   GPIO pin(GPIOA, GPIO_PIN_15);
+//   PrintBench(SerialCom, RunBench("gpio_write", 1000, [&]() { pin.write(true); }));
+//
+//   // Regions that need work outside the measurement
+//   BenchStats stats("can_read");
+//   for (uint32_t i = 0; i < 100; i++) {
+//       CAN1.send(0x123, data, 8);
+//       while (!CAN1.available()) {}
+//       const uint32_t start = BenchCycles();
+//       CAN1.read(frame);
+//       stats.add(BenchElapsed(start));
+//   }
+//   PrintBench(SerialCom, stats);
+//   PrintBenchSkip(SerialCom, "spi_transfer", "no_spi_port");
+//   PrintBenchDone(SerialCom, "LumosBrain");
+//
+// Cycles are CPU cycles: DWT->CYCCNT on Cortex-M3 and up (call
+// InitMicrosecondTiming() first), SysTick->VAL on Cortex-M0+, which only
+// measures regions shorter than one SysTick period (1 ms). The cost of the
+// measurement itself is subtracted. The minimum is the figure to track
+// across releases; interrupts taken during a region only raise the
+// average and maximum.
+//
+// Output is one "@bench name=NAME n=N min=C avg=C max=C clock=HZ" line
+// per result, "@bench_skip name=NAME reason=WHY" for benchmarks the board
+// can't run and "@bench_done board=NAME" at the end of a run.
+
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+#define LUMOS_BENCH_CYCLE_COUNTER 1
+#endif
+
+// Start of a region
+inline uint32_t BenchCycles()
+{
+#ifdef LUMOS_BENCH_CYCLE_COUNTER
+    return DWT->CYCCNT;
+#else
+    return SysTick->VAL;
+#endif
+}
+
+// Raw cycles from @p start to now
+inline uint32_t BenchElapsedRaw(uint32_t start)
+{
+    const uint32_t now = BenchCycles();
+#ifdef LUMOS_BENCH_CYCLE_COUNTER
+    return now - start;
+#else
+    // SysTick counts down from LOAD and reloads
+    return start >= now ? start - now : start + (SysTick->LOAD + 1) - now;
+#endif
+}
+
+// Cycles of an empty region, measured once
+inline uint32_t BenchOverhead()
+{
+    static uint32_t overhead = UINT32_MAX;
+    if (overhead == UINT32_MAX) {
+        uint32_t best = UINT32_MAX;
+        for (int i = 0; i < 64; i++) {
+            const uint32_t start = BenchCycles();
+            const uint32_t cycles = BenchElapsedRaw(start);
+            if (cycles < best) {
+                best = cycles;
+            }
+        }
+        overhead = best;
+    }
+    return overhead;
+}
+
+// Cycles from @p start to now, without the cost of measuring
+inline uint32_t BenchElapsed(uint32_t start)
+{
+    const uint32_t cycles = BenchElapsedRaw(start);
+    const uint32_t overhead = BenchOverhead();
+    return cycles > overhead ? cycles - overhead : 0;
+}
+
+struct BenchStats
+{
+    const char* name;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+
+    explicit BenchStats(const char* bench_name)
+        : name(bench_name), count(0), min(UINT32_MAX), max(0), total(0)
+    {
+    }
+
+    void add(uint32_t cycles)
+    {
+        count++;
+        total += cycles;
+        if (cycles < min) min = cycles;
+        if (cycles > max) max = cycles;
+    }
+
+    uint32_t average() const { return count > 0 ? (uint32_t)(total / count) : 0; }
+};
+
+// Time @p iterations calls of @p body, one region per call
+template <typename Body>
+BenchStats RunBench(const char* name, uint32_t iterations, Body body)
+{
+    BenchStats stats(name);
+    BenchOverhead();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const uint32_t start = BenchCycles();
+        body();
+        stats.add(BenchElapsed(start));
+    }
+    return stats;
+}
+
+// @p out is Serial, USB or anything else with printf()
+template <typename Out>
+void PrintBenchSkip(Out& out, const char* name, const char* reason)
+{
+    out.printf("@bench_skip name=%s reason=%s\r\n", name, reason);
+}
+
+template <typename Out>
+void PrintBench(Out& out, const BenchStats& stats)
+{
+    if (stats.count == 0) {
+        PrintBenchSkip(out, stats.name, "no_samples");
+        return;
+    }
+    out.printf("@bench name=%s n=%u min=%u avg=%u max=%u clock=%u\r\n",
+               stats.name, (unsigned)stats.count, (unsigned)stats.min,
+               (unsigned)stats.average(), (unsigned)stats.max, (unsigned)SystemCoreClock);
+}
+
+template <typename Out>
+void PrintBenchDone(Out& out, const char* board)
+{
+    out.printf("@bench_done board=%s\r\n", board);
+}
@@ -0,0 +1,96 @@
+#include "boot_profile.h"
+
+// Platform-specific HAL headers
+#if defined(STM32H7)
+    #include "stm32h7xx_hal.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx_hal.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx_hal.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx_hal.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx_hal.h"
+#else
+    #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
+#endif
+
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+#define BOOT_CYCLE_COUNTER 1
+#endif
+
+static uint32_t boot_cycles[BOOT_STAGE_COUNT];
+static uint32_t boot_clock_hz[BOOT_STAGE_COUNT];   // Core clock at each mark
+
+static const char* const boot_stage_names[BOOT_STAGE_COUNT] = {
+    "reset", "main", "hal", "clock", "peripherals", "setup"
+};
+
+extern "C" {
+
+void BootProfileStart(void)
+{
+#ifdef BOOT_CYCLE_COUNTER
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void BootProfileMark(BootStage stage)
+{
+#ifdef BOOT_CYCLE_COUNTER
+    if (stage >= BOOT_STAGE_COUNT) {
+        return;
+    }
+    boot_cycles[stage] = DWT->CYCCNT;
+    boot_clock_hz[stage] = SystemCoreClock;
+    if (stage == BOOT_STAGE_MAIN) {
+        // Nothing before main() could store the reset clock, and it has
+        // not changed since
+        boot_clock_hz[BOOT_STAGE_RESET] = SystemCoreClock;
+    }
+#else
+    (void)stage;
+#endif
+}
+
+uint32_t GetBootCycles(BootStage stage)
+{
+    return (stage < BOOT_STAGE_COUNT) ? boot_cycles[stage] : 0;
+}
+
+uint32_t GetBootStageUs(BootStage stage)
+{
+    if (stage == BOOT_STAGE_RESET || stage >= BOOT_STAGE_COUNT || boot_cycles[stage] == 0) {
+        return 0;
+    }
+
+    // Unmarked stages in between are skipped over
+    int previous = (int)stage - 1;
+    while (previous > BOOT_STAGE_RESET && boot_cycles[previous] == 0) {
+        previous--;
+    }
+    const uint32_t hz = boot_clock_hz[previous];
+    if (hz == 0) {
+        return 0;
+    }
+    const uint64_t cycles = boot_cycles[stage] - boot_cycles[previous];
+    return (uint32_t)(cycles * 1000000u / hz);
+}
+
+uint32_t GetBootTotalUs(void)
+{
+    uint32_t total = 0;
+    for (int stage = BOOT_STAGE_MAIN; stage < BOOT_STAGE_COUNT; stage++) {
+        total += GetBootStageUs((BootStage)stage);
+    }
+    return total;
+}
+
+const char* GetBootStageName(BootStage stage)
+{
+    return (stage < BOOT_STAGE_COUNT) ? boot_stage_names[stage] : "";
+}
+
+}  // extern "C"
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+// Boot time breakdown, measured with the DWT cycle counter
+// Usage Example (board main.c; usable from C):
+//   void SystemInit(void) { BootProfileStart(); ... }   // Counter from reset
+//
+//   int main(void) {
+//       BootProfileMark(BOOT_STAGE_MAIN);      // .data, .bss and constructors done
+//       HAL_Init();
+//       BootProfileMark(BOOT_STAGE_HAL);
+//       ...
+//       BootProfileMark(BOOT_STAGE_SETUP);
+//       setup();
+//   }
+//
+//   // Later, from the sketch
+//   for (int s = BOOT_STAGE_MAIN; s < BOOT_STAGE_COUNT; s++) {
+//       printf("%-12s %6lu us\n", GetBootStageName((BootStage)s), GetBootStageUs((BootStage)s));
+//   }
+//
+// BootProfileStart() runs before .data and .bss are set up, so it only
+// touches core registers; the marks are stored from main() on. Cortex-M0+
+// parts have no cycle counter and report zero throughout.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    BOOT_STAGE_RESET = 0,     // SystemInit(): counter started
+    BOOT_STAGE_MAIN,          // main(): memory init and static constructors
+    BOOT_STAGE_HAL,           // HAL_Init()
+    BOOT_STAGE_CLOCK,         // SystemClock_Config(): oscillator and PLL lock
+    BOOT_STAGE_PERIPHERALS,   // MX_*_Init() of the board
+    BOOT_STAGE_SETUP,         // Up to the call of setup()
+    BOOT_STAGE_COUNT
+} BootStage;
+
+// Enable and zero the cycle counter; first thing in SystemInit()
+void BootProfileStart(void);
+
+// Record the end of a stage
+void BootProfileMark(BootStage stage);
+
+// Cycles from BootProfileStart() to the stage's mark (0 if not marked)
+uint32_t GetBootCycles(BootStage stage);
+
+// Time spent in the stage, at the core clock it started with
+uint32_t GetBootStageUs(BootStage stage);
+
+// Reset to the setup() mark
+uint32_t GetBootTotalUs(void);
+
+const char* GetBootStageName(BootStage stage);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,169 @@
+#include "bus_device.h"
+
+// ===== SPIDevice =====
+
+SPIDevice::SPIDevice(SPI& bus, GPIO_TypeDef* cs_port, uint16_t cs_pin, const SPIConfig& config)
+    : bus_(bus),
+      cs_port_(cs_port),
+      cs_pin_(cs_pin),
+      config_(config)
+{
+}
+
+void SPIDevice::begin()
+{
+    // Deassert before switching to output so the device sees no glitch
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_SET);
+
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = cs_pin_;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    HAL_GPIO_Init(cs_port_, &GPIO_InitStruct);
+}
+
+// Wait for queued transfers, then switch the bus to this device's settings
+bool SPIDevice::acquire(uint32_t timeout)
+{
+    if (bus_.pending() > 0 && !bus_.waitIdle(timeout)) {
+        return false;
+    }
+    return bus_.configure(config_).applyConfig();
+}
+
+bool SPIDevice::transfer(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout)
+{
+    if (!acquire(timeout)) {
+        return false;
+    }
+
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_RESET);
+    const bool ok = bus_.transfer(tx_data, rx_data, length, timeout);
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_SET);
+    return ok;
+}
+
+bool SPIDevice::write(const uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    if (!acquire(timeout)) {
+        return false;
+    }
+
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_RESET);
+    const bool ok = bus_.write(data, length, timeout);
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_SET);
+    return ok;
+}
+
+bool SPIDevice::read(uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    if (!acquire(timeout)) {
+        return false;
+    }
+
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_RESET);
+    const bool ok = bus_.read(data, length, timeout);
+    HAL_GPIO_WritePin(cs_port_, cs_pin_, GPIO_PIN_SET);
+    return ok;
+}
+
+bool SPIDevice::transferAsync(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length,
+                              std::function<void(bool ok)> callback)
+{
+    SPITransaction transaction;
+    transaction.tx_data = tx_data;
+    transaction.rx_data = rx_data;
+    transaction.length = length;
+    transaction.cs_port = cs_port_;
+    transaction.cs_pin = cs_pin_;
+    transaction.callback = callback;
+    transaction.config = &config_;
+    return bus_.queue(transaction);
+}
+
+// ===== I2CDevice =====
+
+I2CDevice::I2CDevice(I2C& bus, uint8_t address, uint32_t clock_speed)
+    : bus_(bus),
+      address_(address),
+      clock_speed_(clock_speed)
+{
+}
+
+// Wait for queued transfers, then switch the bus to this device's clock
+bool I2CDevice::acquire(uint32_t timeout)
+{
+    if (bus_.pending() > 0 && !bus_.waitIdle(timeout)) {
+        return false;
+    }
+    return bus_.setClock(clock_speed_).applyConfig();
+}
+
+bool I2CDevice::write(const uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    return acquire(timeout) && bus_.write(address_, data, length, timeout);
+}
+
+bool I2CDevice::read(uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    return acquire(timeout) && bus_.read(address_, data, length, timeout);
+}
+
+bool I2CDevice::writeRegister(uint8_t reg, uint8_t value, uint32_t timeout)
+{
+    return acquire(timeout) && bus_.writeRegister(address_, reg, value, timeout);
+}
+
+bool I2CDevice::readRegister(uint8_t reg, uint8_t& value, uint32_t timeout)
+{
+    return acquire(timeout) && bus_.readRegister(address_, reg, value, timeout);
+}
+
+bool I2CDevice::readRegisters(uint8_t reg, uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    return acquire(timeout) && bus_.readRegisters(address_, reg, data, length, timeout);
+}
+
+bool I2CDevice::probe(uint32_t timeout)
+{
+    return acquire(timeout) && bus_.probe(address_, timeout);
+}
+
+bool I2CDevice::queue(uint8_t reg_size, uint8_t reg, const uint8_t* tx_data, uint8_t* rx_data,
+                      uint16_t length, std::function<void(bool ok)> callback)
+{
+    I2CTransaction transaction;
+    transaction.address = address_;
+    transaction.reg = reg;
+    transaction.reg_size = reg_size;
+    transaction.tx_data = tx_data;
+    transaction.tx_length = (tx_data != nullptr) ? length : 0;
+    transaction.rx_data = rx_data;
+    transaction.rx_length = (rx_data != nullptr) ? length : 0;
+    transaction.callback = callback;
+    transaction.clock_speed = clock_speed_;
+    return bus_.queue(transaction);
+}
+
+bool I2CDevice::writeAsync(const uint8_t* data, uint16_t length, std::function<void(bool ok)> callback)
+{
+    return queue(0, 0, data, nullptr, length, callback);
+}
+
+bool I2CDevice::readAsync(uint8_t* data, uint16_t length, std::function<void(bool ok)> callback)
+{
+    return queue(0, 0, nullptr, data, length, callback);
+}
+
+bool I2CDevice::writeRegistersAsync(uint8_t reg, const uint8_t* data, uint16_t length,
+                                    std::function<void(bool ok)> callback)
+{
+    return queue(1, reg, data, nullptr, length, callback);
+}
+
+bool I2CDevice::readRegistersAsync(uint8_t reg, uint8_t* data, uint16_t length,
+                                   std::function<void(bool ok)> callback)
+{
+    return queue(1, reg, nullptr, data, length, callback);
+}
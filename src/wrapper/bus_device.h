@@ -0,0 +1,103 @@
+#pragma once
+
+#include "spi.h"
+#include "i2c.h"
+
+// Devices sharing one SPI or I2C bus
+//
+// Each driver gets its own SPIDevice/I2CDevice holding its chip select,
+// address and bus settings. The SPI/I2C object still owns the peripheral:
+// async transfers from all devices go into its queue, each tagged with
+// its device's settings, which are written to the peripheral only when
+// they differ from the previous transfer's.
+//
+// Usage Example:
+//   SPIDevice imu{spi1, GPIOA, GPIO_PIN_4, SPIConfig{8000000, SPI_POLARITY_HIGH, SPI_PHASE_2EDGE}};
+//   SPIDevice flash{spi1, GPIOB, GPIO_PIN_0, SPIConfig{20000000}};
+//
+//   spi1.begin();
+//   spi1.beginDma(...);
+//   imu.begin();
+//   flash.begin();
+//
+//   imu.transferAsync(imu_tx, imu_rx, 32, [](bool ok) { imu_ready = ok; });
+//   flash.transferAsync(page_cmd, nullptr, 4);  // Runs right after the IMU transfer
+//
+//   I2CDevice baro{i2c1, 0x76, 400000};
+//   baro.readRegistersAsync(0xF7, baro_raw, 6, [](bool ok) { baro_ready = ok; });
+//
+// Blocking calls wait for the bus queue to drain first, so they never
+// interleave with another device's queued transfer. Don't issue them from
+// the completion callbacks, which run in interrupt context.
+
+class SPIDevice
+{
+private:
+    SPI& bus_;
+    GPIO_TypeDef* cs_port_;
+    uint16_t cs_pin_;
+    SPIConfig config_;
+
+    bool acquire(uint32_t timeout);
+
+public:
+    SPIDevice() = delete;
+    SPIDevice(SPI& bus, GPIO_TypeDef* cs_port, uint16_t cs_pin, const SPIConfig& config = SPIConfig{});
+
+    // Configure the chip select pin (output, deasserted)
+    void begin();
+
+    // Blocking transfers with chip select
+    bool transfer(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout = 1000);
+    bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 1000);
+    bool read(uint8_t* data, uint16_t length, uint32_t timeout = 1000);
+
+    // Queued DMA transfer with chip select (see SPI::queue())
+    bool transferAsync(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length,
+                       std::function<void(bool ok)> callback = nullptr);
+
+    // Settings used for this device's transfers
+    const SPIConfig& getConfig() const { return config_; }
+    SPIDevice& setConfig(const SPIConfig& config)
+    {
+        config_ = config;
+        return *this;
+    }
+
+    SPI& getBus() { return bus_; }
+};
+
+class I2CDevice
+{
+private:
+    I2C& bus_;
+    uint8_t address_;
+    uint32_t clock_speed_;
+
+    bool acquire(uint32_t timeout);
+    bool queue(uint8_t reg_size, uint8_t reg, const uint8_t* tx_data, uint8_t* rx_data,
+               uint16_t length, std::function<void(bool ok)> callback);
+
+public:
+    I2CDevice() = delete;
+    I2CDevice(I2C& bus, uint8_t address, uint32_t clock_speed = 100000);
+
+    // Blocking transfers
+    bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 1000);
+    bool read(uint8_t* data, uint16_t length, uint32_t timeout = 1000);
+    bool writeRegister(uint8_t reg, uint8_t value, uint32_t timeout = 1000);
+    bool readRegister(uint8_t reg, uint8_t& value, uint32_t timeout = 1000);
+    bool readRegisters(uint8_t reg, uint8_t* data, uint16_t length, uint32_t timeout = 1000);
+    bool probe(uint32_t timeout = 100);
+
+    // Queued interrupt transfers (see I2C::queue())
+    bool writeAsync(const uint8_t* data, uint16_t length, std::function<void(bool ok)> callback = nullptr);
+    bool readAsync(uint8_t* data, uint16_t length, std::function<void(bool ok)> callback = nullptr);
+    bool writeRegistersAsync(uint8_t reg, const uint8_t* data, uint16_t length,
+                             std::function<void(bool ok)> callback = nullptr);
+    bool readRegistersAsync(uint8_t reg, uint8_t* data, uint16_t length,
+                            std::function<void(bool ok)> callback = nullptr);
+
+    uint8_t getAddress() const { return address_; }
+    I2C& getBus() { return bus_; }
+};
@@ -1,20 +1,58 @@
 #include "can.h"
+#include "peripherals.h"
+#include "sys.h"
+#include "event_loop.h"
+#include <cstring>
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
-#endif
+// Ports using the RX or TX interrupt (for the HAL callbacks)
+static CAN* can_instances[3] = {nullptr};
+
+static bool registerInstance(CAN* can)
+{
+    for (CAN* instance : can_instances) {
+        if (instance == can) return true;
+    }
+    for (CAN*& instance : can_instances) {
+        if (instance == nullptr) {
+            instance = can;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void unregisterInstance(CAN* can)
+{
+    for (CAN*& instance : can_instances) {
+        if (instance == can) instance = nullptr;
+    }
+}
+
+// Bus arbitration order: lower keys win. A standard ID beats an extended
+// ID with the same 11-bit base.
+static uint32_t arbitrationKey(const CANFrame& frame)
+{
+    return frame.extended ? ((frame.id << 1) | 1) : (frame.id << 19);
+}
+
+// Payload bytes for a HAL DataLength code
+static uint8_t dataLengthToBytes(uint32_t data_length)
+{
+    if (data_length <= FDCAN_DLC_BYTES_8) return static_cast<uint8_t>(data_length / FDCAN_DLC_BYTES_1);
+    if (data_length == FDCAN_DLC_BYTES_12) return 12;
+    if (data_length == FDCAN_DLC_BYTES_16) return 16;
+    if (data_length == FDCAN_DLC_BYTES_20) return 20;
+    if (data_length == FDCAN_DLC_BYTES_24) return 24;
+    if (data_length == FDCAN_DLC_BYTES_32) return 32;
+    if (data_length == FDCAN_DLC_BYTES_48) return 48;
+    return 64;
+}
+
+// Bits of a frame on the bus at nominal timing: SOF, arbitration, control,
+// data, CRC, ACK, EOF and interframe space; stuff bits are not counted
+static uint32_t frameBits(uint8_t length, bool extended)
+{
+    return (extended ? 67u : 47u) + 8u * length;
 }
 
 CAN::CAN(FDCAN_GlobalTypeDef* fdcan_instance,
@@ -26,8 +64,30 @@ CAN::CAN(FDCAN_GlobalTypeDef* fdcan_instance,
       tx_pin_(tx_pin),
       rx_port_(rx_port),
       rx_pin_(rx_pin),
-      alternate_function_(alternate_function)
+      alternate_function_(alternate_function),
+      rx_queue_(nullptr),
+      rx_queue_size_(0),
+      rx_queue_head_(0),
+      rx_queue_tail_(0),
+      rx_queue_overflows_(0),
+      rx_fifo_overflows_(0),
+      irq_(static_cast<IRQn_Type>(0)),
+      handlers_{},
+      handler_count_(0),
+      forwards_{},
+      forward_count_(0),
+      forwarded_frames_(0),
+      tx_queue_(nullptr),
+      tx_queue_size_(0),
+      tx_queue_head_(0),
+      tx_queue_count_(0),
+      tx_complete_hook_(nullptr),
+      tx_complete_context_(nullptr),
+      error_passive_since_(0),
+      nominal_timing_set_(false)
 {
+    resetStats();
+
     // Initialize FDCAN handle with default values
     fdcan_handle_.Instance = fdcan_instance;
 
@@ -56,65 +116,98 @@ CAN::CAN(FDCAN_GlobalTypeDef* fdcan_instance,
 #if defined(STM32H7) || defined(STM32H5)
     // STM32H7/H5 has detailed Message RAM configuration
     fdcan_handle_.Init.MessageRAMOffset = 0;
-    fdcan_handle_.Init.StdFiltersNbr = 1;
-    fdcan_handle_.Init.ExtFiltersNbr = 1;
+#if defined(STM32H7)
+    // The FDCAN instances share one 2560 word message RAM, give each a third
+#ifdef FDCAN2
+    if (fdcan_instance == FDCAN2) fdcan_handle_.Init.MessageRAMOffset = 853;
+#endif
+#ifdef FDCAN3
+    if (fdcan_instance == FDCAN3) fdcan_handle_.Init.MessageRAMOffset = 2 * 853;
+#endif
+#endif
+    fdcan_handle_.Init.StdFiltersNbr = MAX_STD_FILTERS;
+    fdcan_handle_.Init.ExtFiltersNbr = MAX_EXT_FILTERS;
     fdcan_handle_.Init.RxFifo0ElmtsNbr = 8;
     fdcan_handle_.Init.RxFifo0ElmtSize = FDCAN_DATA_BYTES_8;
-    fdcan_handle_.Init.RxFifo1ElmtsNbr = 0;
+    fdcan_handle_.Init.RxFifo1ElmtsNbr = 8;
+    fdcan_handle_.Init.RxFifo1ElmtSize = FDCAN_DATA_BYTES_8;
     fdcan_handle_.Init.RxBuffersNbr = 0;
-    fdcan_handle_.Init.TxEventsNbr = 0;
+    fdcan_handle_.Init.TxEventsNbr = 4;          // sendTimestamped()
     fdcan_handle_.Init.TxBuffersNbr = 0;
     fdcan_handle_.Init.TxFifoQueueElmtsNbr = 8;
     fdcan_handle_.Init.TxFifoQueueMode = FDCAN_TX_FIFO_OPERATION;
     fdcan_handle_.Init.TxElmtSize = FDCAN_DATA_BYTES_8;
 #elif defined(STM32G0) || defined(STM32G4)
     // STM32G0/G4 has minimal FDCAN configuration - most RAM config is automatic
-    fdcan_handle_.Init.StdFiltersNbr = 1;
-    fdcan_handle_.Init.ExtFiltersNbr = 1;
+    fdcan_handle_.Init.StdFiltersNbr = MAX_STD_FILTERS;
+    fdcan_handle_.Init.ExtFiltersNbr = MAX_EXT_FILTERS;
 #endif
 }
 
-void CAN::begin(const uint32_t bitrate)
+#if defined(STM32H7)
+// FDCAN_DATA_BYTES_* for a payload of @p bytes
+static bool elementSize(uint8_t bytes, uint32_t& size)
 {
-    // Enable GPIO port clocks
-    enableGPIOClock(tx_port_);
-    enableGPIOClock(rx_port_);
+    switch (bytes) {
+    case 8:  size = FDCAN_DATA_BYTES_8;  return true;
+    case 12: size = FDCAN_DATA_BYTES_12; return true;
+    case 16: size = FDCAN_DATA_BYTES_16; return true;
+    case 20: size = FDCAN_DATA_BYTES_20; return true;
+    case 24: size = FDCAN_DATA_BYTES_24; return true;
+    case 32: size = FDCAN_DATA_BYTES_32; return true;
+    case 48: size = FDCAN_DATA_BYTES_48; return true;
+    case 64: size = FDCAN_DATA_BYTES_64; return true;
+    default: return false;
+    }
+}
+#endif
 
-    // Configure GPIO pins for FDCAN
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
+bool CAN::setMessageRam(const CANMessageRam& layout)
+{
+#if defined(STM32H7)
+    uint32_t element_size;
+    if (!elementSize(layout.data_bytes, element_size) ||
+        layout.std_filters > 128 || layout.ext_filters > 64 ||
+        layout.rx_fifo0 < 1 || layout.rx_fifo0 > 64 || layout.rx_fifo1 > 64 ||
+        layout.tx_events > 32 || layout.tx_fifo < 1 || layout.tx_fifo > 32 ||
+        layout.end() > CANMessageRam::TOTAL_WORDS) {
+        return false;
+    }
 
-    // Configure TX pin
-    GPIO_InitStruct.Pin = tx_pin_;
-    HAL_GPIO_Init(tx_port_, &GPIO_InitStruct);
+    // Applied by HAL_FDCAN_Init() in begin()
+    fdcan_handle_.Init.MessageRAMOffset = layout.offset;
+    fdcan_handle_.Init.StdFiltersNbr = layout.std_filters;
+    fdcan_handle_.Init.ExtFiltersNbr = layout.ext_filters;
+    fdcan_handle_.Init.RxFifo0ElmtsNbr = layout.rx_fifo0;
+    fdcan_handle_.Init.RxFifo0ElmtSize = element_size;
+    fdcan_handle_.Init.RxFifo1ElmtsNbr = layout.rx_fifo1;
+    fdcan_handle_.Init.RxFifo1ElmtSize = element_size;
+    fdcan_handle_.Init.TxEventsNbr = layout.tx_events;
+    fdcan_handle_.Init.TxFifoQueueElmtsNbr = layout.tx_fifo;
+    fdcan_handle_.Init.TxElmtSize = element_size;
+    return true;
+#else
+    (void)layout;
+    return false;  // Fixed layout per port
+#endif
+}
 
-    // Configure RX pin
-    GPIO_InitStruct.Pin = rx_pin_;
-    HAL_GPIO_Init(rx_port_, &GPIO_InitStruct);
+void CAN::begin(const uint32_t bitrate)
+{
+    // Configure TX and RX pins
+    const PinRef pins[] = {{tx_port_, tx_pin_}, {rx_port_, rx_pin_}};
+    initAlternatePins(pins, 2, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_VERY_HIGH, alternate_function_);
 
     // Enable FDCAN peripheral clock
-    if (fdcan_handle_.Instance == FDCAN1) {
-        __HAL_RCC_FDCAN_CLK_ENABLE();
-    }
-#ifdef FDCAN2
-    else if (fdcan_handle_.Instance == FDCAN2) {
-        __HAL_RCC_FDCAN_CLK_ENABLE();
-    }
-#endif
-#ifdef FDCAN3
-    else if (fdcan_handle_.Instance == FDCAN3) {
-        __HAL_RCC_FDCAN_CLK_ENABLE();
-    }
-#endif
+    enablePeripheralClock(fdcan_handle_.Instance);
 
     // Calculate prescaler for desired bitrate (assuming 80 MHz kernel clock)
     // Bitrate = ClockFreq / (Prescaler * (SyncJumpWidth + TimeSeg1 + TimeSeg2))
     // For simplicity, use fixed time segments and calculate prescaler
-    uint32_t prescaler = 80000000 / (bitrate * 16);  // 16 time quanta
-    fdcan_handle_.Init.NominalPrescaler = (prescaler > 0) ? prescaler : 1;
+    if (!nominal_timing_set_) {
+        uint32_t prescaler = 80000000 / (bitrate * 16);  // 16 time quanta
+        fdcan_handle_.Init.NominalPrescaler = (prescaler > 0) ? prescaler : 1;
+    }
 
     // Initialize FDCAN peripheral
     if (HAL_FDCAN_Init(&fdcan_handle_) != HAL_OK)
@@ -123,6 +216,10 @@ void CAN::begin(const uint32_t bitrate)
         return;
     }
 
+    // Timestamp counter for received frames, one tick per nominal bit time
+    HAL_FDCAN_ConfigTimestampCounter(&fdcan_handle_, FDCAN_TIMESTAMP_PRESC_1);
+    HAL_FDCAN_EnableTimestampCounter(&fdcan_handle_, FDCAN_TIMESTAMP_INTERNAL);
+
     // Configure global filter to accept all messages by default
     setAcceptAll();
 
@@ -132,6 +229,17 @@ void CAN::begin(const uint32_t bitrate)
 
 void CAN::end()
 {
+    if (rx_queue_ != nullptr || tx_queue_ != nullptr) {
+        HAL_NVIC_DisableIRQ(irq_);
+        HAL_FDCAN_DeactivateNotification(&fdcan_handle_,
+            FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_MESSAGE_LOST |
+            FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_MESSAGE_LOST |
+            FDCAN_IT_TX_COMPLETE | FDCAN_IT_ERROR_PASSIVE | FDCAN_IT_BUS_OFF);
+        unregisterInstance(this);
+        rx_queue_ = nullptr;
+        tx_queue_ = nullptr;
+    }
+
     HAL_FDCAN_Stop(&fdcan_handle_);
     HAL_FDCAN_DeInit(&fdcan_handle_);
 
@@ -141,6 +249,23 @@ void CAN::end()
 }
 
 bool CAN::send(uint32_t id, const uint8_t* data, uint8_t length, bool extended)
+{
+    if (tx_queue_ == nullptr) {
+        if (transmit(id, data, length, extended)) return true;
+        tx_dropped_ = tx_dropped_ + 1;
+        return false;
+    }
+
+    CANFrame frame;
+    frame.id = id;
+    frame.extended = extended;
+    frame.length = length;
+    memcpy(frame.data, data, length <= sizeof(frame.data) ? length : sizeof(frame.data));
+    return sendBatch(&frame, 1) == 1;
+}
+
+// Hand one frame to the hardware TX FIFO; a non-zero @p marker stores a TX event
+bool CAN::transmit(uint32_t id, const uint8_t* data, uint8_t length, bool extended, uint8_t marker)
 {
     // Check if we're in FD mode or Classic mode
     bool is_fd_mode = (fdcan_handle_.Init.FrameFormat == FDCAN_FRAME_FD_BRS ||
@@ -196,8 +321,8 @@ bool CAN::send(uint32_t id, const uint8_t* data, uint8_t length, bool extended)
         tx_header.FDFormat = FDCAN_CLASSIC_CAN;
     }
 
-    tx_header.TxEventFifoControl = FDCAN_NO_TX_EVENTS;
-    tx_header.MessageMarker = 0;
+    tx_header.TxEventFifoControl = marker != 0 ? FDCAN_STORE_TX_EVENTS : FDCAN_NO_TX_EVENTS;
+    tx_header.MessageMarker = marker;
 
     // Add message to TX FIFO
     if (HAL_FDCAN_AddMessageToTxFifoQ(&fdcan_handle_, &tx_header, (uint8_t*)data) != HAL_OK)
@@ -205,9 +330,143 @@ bool CAN::send(uint32_t id, const uint8_t* data, uint8_t length, bool extended)
         return false;
     }
 
+    tx_frames_ = tx_frames_ + 1;
+    bus_bits_ = bus_bits_ + frameBits(length, extended);
+    return true;
+}
+
+bool CAN::beginTxQueue(CANFrame* queue, uint16_t size, IRQn_Type irq)
+{
+    if (queue == nullptr || size == 0 || !registerInstance(this)) {
+        return false;
+    }
+
+    tx_queue_ = queue;
+    tx_queue_size_ = size;
+    tx_queue_head_ = 0;
+    tx_queue_count_ = 0;
+    irq_ = irq;
+
+    // TX complete for every element of the TX FIFO
+    if (HAL_FDCAN_ActivateNotification(&fdcan_handle_, FDCAN_IT_TX_COMPLETE,
+                                       (1u << txFifoDepth()) - 1) != HAL_OK) {
+        tx_queue_ = nullptr;
+        if (rx_queue_ == nullptr) unregisterInstance(this);
+        return false;
+    }
+
+    enableStatusInterrupts();
+    HAL_NVIC_SetPriority(irq_, 5, 0);
+    HAL_NVIC_EnableIRQ(irq_);
     return true;
 }
 
+uint16_t CAN::sendBatch(const CANFrame* frames, uint16_t count)
+{
+    const bool is_fd_mode = (fdcan_handle_.Init.FrameFormat == FDCAN_FRAME_FD_BRS ||
+                             fdcan_handle_.Init.FrameFormat == FDCAN_FRAME_FD_NO_BRS);
+    const uint8_t max_length = is_fd_mode ? 64 : 8;
+
+    uint16_t queued = 0;
+    if (tx_queue_ == nullptr) {
+        while (queued < count &&
+               transmit(frames[queued].id, frames[queued].data, frames[queued].length, frames[queued].extended)) {
+            queued++;
+        }
+        tx_dropped_ = tx_dropped_ + (count - queued);
+        return queued;
+    }
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (; queued < count; ++queued) {
+        const CANFrame& frame = frames[queued];
+        if (frame.length > max_length) {
+            break;
+        }
+
+        // Nothing waiting and room in the hardware: skip the queue
+        if (tx_queue_count_ == 0 &&
+            txFifoDepth() - HAL_FDCAN_GetTxFifoFreeLevel(&fdcan_handle_) < TX_HW_DEPTH &&
+            transmit(frame.id, frame.data, frame.length, frame.extended)) {
+            continue;
+        }
+        if (tx_queue_count_ == tx_queue_size_) {
+            break;
+        }
+
+        // Insert behind every frame that wins arbitration against it or
+        // has the same key, so equal IDs keep their order
+        const uint32_t key = arbitrationKey(frame);
+        uint16_t position = tx_queue_count_;
+        while (position > 0) {
+            const uint16_t previous = (tx_queue_head_ + position - 1) % tx_queue_size_;
+            if (arbitrationKey(tx_queue_[previous]) <= key) break;
+            tx_queue_[(previous + 1) % tx_queue_size_] = tx_queue_[previous];
+            position--;
+        }
+        tx_queue_[(tx_queue_head_ + position) % tx_queue_size_] = frame;
+        tx_queue_count_++;
+        if (tx_queue_count_ > tx_queue_high_water_) tx_queue_high_water_ = tx_queue_count_;
+    }
+    tx_dropped_ = tx_dropped_ + (count - queued);
+
+    pumpTx();
+    __set_PRIMASK(primask);
+    return queued;
+}
+
+// Move queued frames into the hardware FIFO, highest priority first.
+// Runs with interrupts disabled or from the FDCAN interrupt.
+void CAN::pumpTx()
+{
+    while (tx_queue_count_ > 0) {
+        const uint32_t in_flight = txFifoDepth() - HAL_FDCAN_GetTxFifoFreeLevel(&fdcan_handle_);
+        if (in_flight >= TX_HW_DEPTH) {
+            return;
+        }
+
+        const CANFrame& frame = tx_queue_[tx_queue_head_];
+        if (!transmit(frame.id, frame.data, frame.length, frame.extended)) {
+            return;
+        }
+        tx_queue_head_ = (tx_queue_head_ + 1 == tx_queue_size_) ? 0 : tx_queue_head_ + 1;
+        tx_queue_count_--;
+    }
+}
+
+uint32_t CAN::txFifoDepth() const
+{
+#if defined(STM32H7) || defined(STM32H5)
+    return fdcan_handle_.Init.TxFifoQueueElmtsNbr;
+#else
+    return 3;  // Fixed by the G0/G4 message RAM layout
+#endif
+}
+
+uint16_t CAN::txPending() const
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint16_t pending = tx_queue_count_;
+    __set_PRIMASK(primask);
+    return pending;
+}
+
+bool CAN::setTxCompleteHook(TxCompleteHook hook, void* context)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const bool free = (hook == nullptr || tx_complete_hook_ == nullptr);
+    if (free) {
+        tx_complete_hook_ = hook;
+        tx_complete_context_ = context;
+    }
+    __set_PRIMASK(primask);
+    return free;
+}
+
 bool CAN::sendRemote(uint32_t id, bool extended)
 {
     FDCAN_TxHeaderTypeDef tx_header;
@@ -229,33 +488,232 @@ bool CAN::sendRemote(uint32_t id, bool extended)
     return true;
 }
 
+// ===== Message Reception =====
+
 bool CAN::available()
 {
-    return (HAL_FDCAN_GetRxFifoFillLevel(&fdcan_handle_, FDCAN_RX_FIFO0) > 0);
+    if (rx_queue_ != nullptr) {
+        dispatch();
+        return rx_queue_tail_ != rx_queue_head_;
+    }
+    return HAL_FDCAN_GetRxFifoFillLevel(&fdcan_handle_, FDCAN_RX_FIFO0) > 0 ||
+           HAL_FDCAN_GetRxFifoFillLevel(&fdcan_handle_, FDCAN_RX_FIFO1) > 0;
 }
 
 bool CAN::read(uint32_t& id, uint8_t* data, uint8_t& length, bool& extended)
 {
-    if (!available())
+    CANFrame frame;
+    if (!read(frame)) {
         return false;
+    }
+
+    id = frame.id;
+    extended = frame.extended;
+    length = frame.length;
+    memcpy(data, frame.data, frame.length);
+    return true;
+}
+
+bool CAN::read(CANFrame& frame)
+{
+    if (rx_queue_ != nullptr) {
+        return available() && popFrame(frame);
+    }
+    return readFifo(FDCAN_RX_FIFO0, frame) || readFifo(FDCAN_RX_FIFO1, frame);
+}
+
+// Take one frame from a hardware RX FIFO (polling mode and interrupt)
+bool CAN::readFifo(uint32_t fifo, CANFrame& frame)
+{
+    const uint32_t fill_level = HAL_FDCAN_GetRxFifoFillLevel(&fdcan_handle_, fifo);
+    if (fill_level == 0) {
+        return false;
+    }
+    uint16_t& high_water = rx_fifo_high_water_[fifo == FDCAN_RX_FIFO0 ? 0 : 1];
+    if (fill_level > high_water) high_water = static_cast<uint16_t>(fill_level);
 
     FDCAN_RxHeaderTypeDef rx_header;
+    if (HAL_FDCAN_GetRxMessage(&fdcan_handle_, fifo, &rx_header, frame.data) != HAL_OK) {
+        return false;
+    }
 
-    // Get message from RX FIFO
-    if (HAL_FDCAN_GetRxMessage(&fdcan_handle_, FDCAN_RX_FIFO0, &rx_header, data) != HAL_OK)
-    {
+    frame.id = rx_header.Identifier;
+    frame.extended = (rx_header.IdType == FDCAN_EXTENDED_ID);
+    frame.fd = (rx_header.FDFormat == FDCAN_FD_CAN);
+    frame.length = dataLengthToBytes(rx_header.DataLength);
+    frame.timestamp = static_cast<uint16_t>(rx_header.RxTimestamp);
+    frame.handler = NO_HANDLER;
+    rx_frames_ = rx_frames_ + 1;
+    bus_bits_ = bus_bits_ + frameBits(frame.length, frame.extended);
+    return true;
+}
+
+bool CAN::popFrame(CANFrame& frame)
+{
+    const uint16_t tail = rx_queue_tail_;
+    if (tail == rx_queue_head_) {
+        return false;
+    }
+    __DMB();  // Read the frame only after seeing the head that covers it
+    frame = rx_queue_[tail];
+    __DMB();
+    rx_queue_tail_ = (tail + 1 == rx_queue_size_) ? 0 : tail + 1;
+    return true;
+}
+
+bool CAN::beginRxInterrupt(CANFrame* queue, uint16_t size, IRQn_Type irq)
+{
+    if (queue == nullptr || size < 2 || !registerInstance(this)) {
+        return false;
+    }
+
+    rx_queue_ = queue;
+    rx_queue_size_ = size;
+    rx_queue_head_ = 0;
+    rx_queue_tail_ = 0;
+    rx_queue_overflows_ = 0;
+    rx_fifo_overflows_ = 0;
+    irq_ = irq;
+
+    if (HAL_FDCAN_ActivateNotification(&fdcan_handle_,
+            FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_MESSAGE_LOST |
+            FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_MESSAGE_LOST, 0) != HAL_OK) {
+        rx_queue_ = nullptr;
+        if (tx_queue_ == nullptr) unregisterInstance(this);
         return false;
     }
 
-    id = rx_header.Identifier;
-    extended = (rx_header.IdType == FDCAN_EXTENDED_ID);
-    length = rx_header.DataLength >> 16;  // Convert from FDCAN_DLC format
+    enableStatusInterrupts();
+    HAL_NVIC_SetPriority(irq_, 5, 0);
+    HAL_NVIC_EnableIRQ(irq_);
+    return true;
+}
+
+bool CAN::forwardTo(CAN& target, uint32_t id, uint32_t mask, bool extended)
+{
+    if (forward_count_ >= MAX_FORWARDS || rx_queue_ == nullptr ||
+        target.tx_queue_ == nullptr || &target == this) {
+        return false;
+    }
+
+    // Complete the entry before the interrupt can see it
+    Forward& rule = forwards_[forward_count_];
+    rule.id = id & mask;
+    rule.mask = mask;
+    rule.extended = extended;
+    rule.target = &target;
+    __DMB();
+    forward_count_ = forward_count_ + 1;
+    return true;
+}
+
+// Called from the FDCAN interrupt: send @p frame on the port of the first
+// matching forwardTo() rule
+bool CAN::forward(const CANFrame& frame)
+{
+    for (uint8_t i = 0; i < forward_count_; ++i) {
+        const Forward& rule = forwards_[i];
+        if (rule.extended == frame.extended && (frame.id & rule.mask) == rule.id) {
+            // sendBatch() counts a refused frame in the target's tx_dropped
+            if (rule.target->sendBatch(&frame, 1) == 1) {
+                forwarded_frames_ = forwarded_frames_ + 1;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CAN::onReceive(uint32_t id, uint32_t mask, CANCallback callback, bool extended)
+{
+    if (handler_count_ >= MAX_HANDLERS || !callback) {
+        return false;
+    }
 
+    // Complete the entry before the interrupt can see it
+    Handler& handler = handlers_[handler_count_];
+    handler.id = id & mask;
+    handler.mask = mask;
+    handler.extended = extended;
+    handler.callback = callback;
+    __DMB();
+    handler_count_ = handler_count_ + 1;
     return true;
 }
 
-void CAN::setFilter(uint32_t id, uint32_t mask, bool extended)
+uint16_t CAN::dispatch()
 {
+    if (rx_queue_ == nullptr) {
+        return 0;
+    }
+
+    uint16_t handled = 0;
+    while (true) {
+        const uint16_t tail = rx_queue_tail_;
+        if (tail == rx_queue_head_) break;
+        __DMB();
+        const CANFrame& frame = rx_queue_[tail];
+        if (frame.handler == NO_HANDLER) break;  // Left for read()
+
+        // The slot stays owned by us until the tail moves past it
+        handlers_[frame.handler].callback(frame);
+        rx_queue_tail_ = (tail + 1 == rx_queue_size_) ? 0 : tail + 1;
+        handled++;
+    }
+    return handled;
+}
+
+// Called from the FDCAN interrupt: move everything in @p fifo to the queue
+void CAN::onRxFifo(uint32_t fifo, uint32_t interrupts)
+{
+    const uint32_t lost = (fifo == FDCAN_RX_FIFO0) ? FDCAN_IT_RX_FIFO0_MESSAGE_LOST
+                                                   : FDCAN_IT_RX_FIFO1_MESSAGE_LOST;
+    if (interrupts & lost) {
+        rx_fifo_overflows_ = rx_fifo_overflows_ + 1;
+    }
+
+    while (true) {
+        const uint16_t head = rx_queue_head_;
+        const uint16_t next = (head + 1 == rx_queue_size_) ? 0 : head + 1;
+
+        // Frames are read straight into the next queue slot, which a
+        // forwarded frame leaves free again. With the queue full they
+        // still leave the FIFO, so new frames keep the interrupt going;
+        // what is not forwarded then is counted as thrown away.
+        CANFrame spare;
+        const bool full = (next == rx_queue_tail_);
+        CANFrame& frame = full ? spare : rx_queue_[head];
+        if (!readFifo(fifo, frame)) {
+            return;
+        }
+        if (forward_count_ > 0 && forward(frame)) {
+            continue;
+        }
+        if (full) {
+            rx_queue_overflows_ = rx_queue_overflows_ + 1;
+            continue;
+        }
+
+        for (uint8_t i = 0; i < handler_count_; ++i) {
+            const Handler& handler = handlers_[i];
+            if (handler.extended == frame.extended && (frame.id & handler.mask) == handler.id) {
+                frame.handler = i;
+                break;
+            }
+        }
+
+        __DMB();  // Publish the frame before the new head
+        rx_queue_head_ = next;
+        LUMOS_POST_EVENT(EVENT_CAN_RX);
+
+        const uint16_t depth = (next + rx_queue_size_ - rx_queue_tail_) % rx_queue_size_;
+        if (depth > rx_queue_high_water_) rx_queue_high_water_ = depth;
+    }
+}
+
+void CAN::setFilter(uint32_t id, uint32_t mask, bool extended, uint8_t fifo)
+{
+    const uint32_t config = (fifo == 1) ? FDCAN_FILTER_TO_RXFIFO1 : FDCAN_FILTER_TO_RXFIFO0;
     FDCAN_FilterTypeDef filter;
 
     if (extended)
@@ -263,7 +721,7 @@ void CAN::setFilter(uint32_t id, uint32_t mask, bool extended)
         filter.IdType = FDCAN_EXTENDED_ID;
         filter.FilterIndex = 0;
         filter.FilterType = FDCAN_FILTER_MASK;
-        filter.FilterConfig = FDCAN_FILTER_TO_RXFIFO0;
+        filter.FilterConfig = config;
         filter.FilterID1 = id;
         filter.FilterID2 = mask;
 
@@ -274,7 +732,7 @@ void CAN::setFilter(uint32_t id, uint32_t mask, bool extended)
         filter.IdType = FDCAN_STANDARD_ID;
         filter.FilterIndex = 0;
         filter.FilterType = FDCAN_FILTER_MASK;
-        filter.FilterConfig = FDCAN_FILTER_TO_RXFIFO0;
+        filter.FilterConfig = config;
         filter.FilterID1 = id;
         filter.FilterID2 = mask;
 
@@ -285,13 +743,127 @@ void CAN::setFilter(uint32_t id, uint32_t mask, bool extended)
 void CAN::setAcceptAll()
 {
     // Configure global filter to accept all standard and extended IDs
+    setGlobalFilter(FDCAN_ACCEPT_IN_RX_FIFO0);
+}
+
+// Where frames go that no filter element matches (remote frames are
+// always dropped)
+void CAN::setGlobalFilter(uint32_t non_matching)
+{
+    // The HAL only changes the global filter while the controller is stopped
+    const bool running = (fdcan_handle_.State == HAL_FDCAN_STATE_BUSY);
+    if (running) HAL_FDCAN_Stop(&fdcan_handle_);
+
     HAL_FDCAN_ConfigGlobalFilter(
         &fdcan_handle_,
-        FDCAN_ACCEPT_IN_RX_FIFO0,  // Accept standard IDs
-        FDCAN_ACCEPT_IN_RX_FIFO0,  // Accept extended IDs
+        non_matching,               // Standard IDs
+        non_matching,               // Extended IDs
         FDCAN_FILTER_REMOTE,        // Filter remote frames
         FDCAN_FILTER_REMOTE         // Filter remote frames
     );
+
+    if (running) HAL_FDCAN_Start(&fdcan_handle_);
+}
+
+static uint32_t filterConfig(const CANFilter& filter)
+{
+    switch (filter.action) {
+    case CANFilter::REJECT:
+        return FDCAN_FILTER_REJECT;
+    case CANFilter::FIFO1:
+        return filter.high_priority ? FDCAN_FILTER_TO_RXFIFO1_HP : FDCAN_FILTER_TO_RXFIFO1;
+    default:
+        return filter.high_priority ? FDCAN_FILTER_TO_RXFIFO0_HP : FDCAN_FILTER_TO_RXFIFO0;
+    }
+}
+
+// Hardware element for filters[i]; an EXACT entry takes the next one
+// along when that is an EXACT ID for the same place. Returns the number
+// of entries used.
+static uint8_t filterElement(const CANFilter* filters, uint8_t count, uint8_t i,
+                             FDCAN_FilterTypeDef& element)
+{
+    const CANFilter& filter = filters[i];
+    element = {};
+    element.IdType = filter.extended ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID;
+    element.FilterConfig = filterConfig(filter);
+    element.FilterID1 = filter.id1;
+    element.FilterID2 = filter.id2;
+
+    switch (filter.type) {
+    case CANFilter::EXACT:
+        element.FilterType = FDCAN_FILTER_DUAL;
+        if (i + 1 < count) {
+            const CANFilter& next = filters[i + 1];
+            if (next.type == CANFilter::EXACT && next.extended == filter.extended &&
+                next.action == filter.action && next.high_priority == filter.high_priority) {
+                element.FilterID2 = next.id1;
+                return 2;
+            }
+        }
+        break;
+    case CANFilter::RANGE:
+        element.FilterType = FDCAN_FILTER_RANGE;
+        break;
+    case CANFilter::MASK:
+        element.FilterType = FDCAN_FILTER_MASK;
+        break;
+    case CANFilter::DUAL:
+        element.FilterType = FDCAN_FILTER_DUAL;
+        break;
+    }
+    return 1;
+}
+
+bool CAN::setFilters(const CANFilter* filters, uint8_t count, bool accept_non_matching)
+{
+    // As many elements as the message RAM layout has room for
+    const uint32_t std_limit = fdcan_handle_.Init.StdFiltersNbr;
+    const uint32_t ext_limit = fdcan_handle_.Init.ExtFiltersNbr;
+    FDCAN_FilterTypeDef element;
+
+    // Count first so a list that does not fit changes nothing
+    uint32_t std_count = 0;
+    uint32_t ext_count = 0;
+    for (uint8_t i = 0; i < count;) {
+        const bool extended = filters[i].extended;
+        i += filterElement(filters, count, i, element);
+        if (extended) {
+            ext_count++;
+        } else {
+            std_count++;
+        }
+    }
+    if (std_count > std_limit || ext_count > ext_limit) {
+        return false;
+    }
+
+    std_count = 0;
+    ext_count = 0;
+    for (uint8_t i = 0; i < count;) {
+        const bool extended = filters[i].extended;
+        i += filterElement(filters, count, i, element);
+        element.FilterIndex = extended ? ext_count++ : std_count++;
+        HAL_FDCAN_ConfigFilter(&fdcan_handle_, &element);
+    }
+
+    // Switch off elements left over from earlier filter lists
+    FDCAN_FilterTypeDef unused = {};
+    unused.FilterType = FDCAN_FILTER_MASK;
+    unused.FilterConfig = FDCAN_FILTER_DISABLE;
+    unused.IdType = FDCAN_STANDARD_ID;
+    for (uint32_t index = std_count; index < std_limit; ++index) {
+        unused.FilterIndex = index;
+        HAL_FDCAN_ConfigFilter(&fdcan_handle_, &unused);
+    }
+    unused.IdType = FDCAN_EXTENDED_ID;
+    for (uint32_t index = ext_count; index < ext_limit; ++index) {
+        unused.FilterIndex = index;
+        HAL_FDCAN_ConfigFilter(&fdcan_handle_, &unused);
+    }
+
+    setGlobalFilter(accept_non_matching ? FDCAN_ACCEPT_IN_RX_FIFO0 : FDCAN_REJECT);
+    return true;
 }
 
 uint32_t CAN::getErrorCount()
@@ -310,3 +882,170 @@ bool CAN::isBusOff()
 
     return (status.BusOff == 1);
 }
+
+// ===== Statistics =====
+
+CANStats CAN::getStats()
+{
+    CANStats stats;
+    stats.tx_frames = tx_frames_;
+    stats.tx_dropped = tx_dropped_;
+    stats.rx_frames = rx_frames_;
+    stats.rx_dropped = rx_queue_overflows_ + rx_fifo_overflows_;
+    stats.bus_bits = bus_bits_;
+    stats.rx_fifo_high_water[0] = rx_fifo_high_water_[0];
+    stats.rx_fifo_high_water[1] = rx_fifo_high_water_[1];
+    stats.rx_queue_high_water = rx_queue_high_water_;
+    stats.tx_queue_high_water = tx_queue_high_water_;
+
+    FDCAN_ErrorCountersTypeDef counters;
+    HAL_FDCAN_GetErrorCounters(&fdcan_handle_, &counters);
+    stats.tx_error_count = static_cast<uint8_t>(counters.TxErrorCnt);
+    stats.rx_error_count = static_cast<uint8_t>(counters.RxErrorCnt);
+
+    // Include the error-passive period still in progress
+    const uint32_t since = error_passive_since_;
+    stats.error_passive_ms = error_passive_ms_ + (since != 0 ? HAL_GetTick() - since : 0);
+    stats.bus_off_count = bus_off_count_;
+    return stats;
+}
+
+void CAN::resetStats()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    tx_frames_ = 0;
+    tx_dropped_ = 0;
+    rx_frames_ = 0;
+    bus_bits_ = 0;
+    rx_queue_overflows_ = 0;
+    rx_fifo_overflows_ = 0;
+    rx_fifo_high_water_[0] = 0;
+    rx_fifo_high_water_[1] = 0;
+    rx_queue_high_water_ = 0;
+    tx_queue_high_water_ = 0;
+    error_passive_ms_ = 0;
+    if (error_passive_since_ != 0) error_passive_since_ = HAL_GetTick() | 1;
+    bus_off_count_ = 0;
+    __set_PRIMASK(primask);
+}
+
+uint32_t CAN::getNominalBitrate() const
+{
+    const uint32_t quanta = fdcan_handle_.Init.NominalPrescaler *
+        (1 + fdcan_handle_.Init.NominalTimeSeg1 + fdcan_handle_.Init.NominalTimeSeg2);
+    return quanta > 0 ? 80000000 / quanta : 0;
+}
+
+uint16_t CAN::getTimestamp()
+{
+    return static_cast<uint16_t>(HAL_FDCAN_GetTimestampCounter(&fdcan_handle_));
+}
+
+uint32_t CAN::timestampToMicros(uint32_t ticks) const
+{
+    // One time quantum is 12.5 ns at 80 MHz
+    const uint32_t quanta = fdcan_handle_.Init.NominalPrescaler *
+        (1 + fdcan_handle_.Init.NominalTimeSeg1 + fdcan_handle_.Init.NominalTimeSeg2);
+    return static_cast<uint32_t>((static_cast<uint64_t>(ticks) * quanta) / 80);
+}
+
+bool CAN::sendTimestamped(uint32_t id, const uint8_t* data, uint8_t length, uint8_t marker, bool extended)
+{
+    // Straight to the hardware, so the TX event is not held up by the queue
+    if (marker == 0) return false;
+    if (transmit(id, data, length, extended, marker)) return true;
+    tx_dropped_ = tx_dropped_ + 1;
+    return false;
+}
+
+bool CAN::readTxEvent(uint8_t& marker, uint16_t& timestamp)
+{
+    FDCAN_TxEventFifoTypeDef event;
+    if (HAL_FDCAN_GetTxEvent(&fdcan_handle_, &event) != HAL_OK) return false;
+    marker = static_cast<uint8_t>(event.MessageMarker);
+    timestamp = static_cast<uint16_t>(event.TxTimestamp);
+    return true;
+}
+
+uint64_t CAN::timestampToTimeUs(uint16_t timestamp)
+{
+    // Read both clocks back to back, then step back by the counter's age;
+    // valid while the frame is younger than one counter wrap (65536 bit times)
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint16_t counter = getTimestamp();
+    const uint64_t now = GetCurrentTimeUs();
+    __set_PRIMASK(primask);
+    return now - timestampToMicros(static_cast<uint16_t>(counter - timestamp));
+}
+
+void CAN::enableStatusInterrupts()
+{
+    HAL_FDCAN_ActivateNotification(&fdcan_handle_, FDCAN_IT_ERROR_PASSIVE | FDCAN_IT_BUS_OFF, 0);
+}
+
+// Called from the FDCAN interrupt when the error-passive or bus-off state changes
+void CAN::onErrorStatus(uint32_t interrupts)
+{
+    FDCAN_ProtocolStatusTypeDef status;
+    HAL_FDCAN_GetProtocolStatus(&fdcan_handle_, &status);
+
+    if (interrupts & FDCAN_IT_ERROR_PASSIVE) {
+        const uint32_t since = error_passive_since_;
+        if (status.ErrorPassive && since == 0) {
+            error_passive_since_ = HAL_GetTick() | 1;  // Never 0
+        } else if (!status.ErrorPassive && since != 0) {
+            error_passive_ms_ = error_passive_ms_ + (HAL_GetTick() - since);
+            error_passive_since_ = 0;
+        }
+    }
+    if ((interrupts & FDCAN_IT_BUS_OFF) && status.BusOff) {
+        bus_off_count_ = bus_off_count_ + 1;
+    }
+}
+
+// ===== HAL Callbacks =====
+
+static CAN* findInstance(FDCAN_HandleTypeDef* hfdcan)
+{
+    for (CAN* instance : can_instances) {
+        if (instance != nullptr && instance->getHandle() == hfdcan) {
+            return instance;
+        }
+    }
+    return nullptr;
+}
+
+extern "C" void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef* hfdcan, uint32_t RxFifo0ITs)
+{
+    CAN* instance = findInstance(hfdcan);
+    if (instance != nullptr) {
+        instance->onRxFifo(FDCAN_RX_FIFO0, RxFifo0ITs);
+    }
+}
+
+extern "C" void HAL_FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef* hfdcan, uint32_t RxFifo1ITs)
+{
+    CAN* instance = findInstance(hfdcan);
+    if (instance != nullptr) {
+        instance->onRxFifo(FDCAN_RX_FIFO1, RxFifo1ITs);
+    }
+}
+
+extern "C" void HAL_FDCAN_TxBufferCompleteCallback(FDCAN_HandleTypeDef* hfdcan, uint32_t BufferIndexes)
+{
+    (void)BufferIndexes;
+    CAN* instance = findInstance(hfdcan);
+    if (instance != nullptr) {
+        instance->onTxComplete();
+    }
+}
+
+extern "C" void HAL_FDCAN_ErrorStatusCallback(FDCAN_HandleTypeDef* hfdcan, uint32_t ErrorStatusITs)
+{
+    CAN* instance = findInstance(hfdcan);
+    if (instance != nullptr) {
+        instance->onErrorStatus(ErrorStatusITs);
+    }
+}
@@ -23,6 +23,139 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, or STM32H5."
 #endif
 
+#include <cstdint>
+#include <functional>
+#include "trace.h"
+
+// Received frame, as queued by the interrupt-driven receive mode
+struct CANFrame
+{
+    uint32_t id;
+    uint8_t length;       // Payload bytes (0-8, FD up to 64)
+    bool extended;
+    bool fd;
+    uint8_t handler;      // Index of the onReceive() handler that claimed it
+    uint16_t timestamp;   // FDCAN timestamp counter at reception
+    uint8_t data[64];
+};
+
+// Bus health counters of one CAN port (CAN::getStats())
+struct CANStats
+{
+    uint32_t tx_frames;            // Frames handed to the hardware
+    uint32_t tx_dropped;           // Frames send()/sendBatch() refused
+    uint32_t rx_frames;            // Frames taken from the RX FIFOs
+    uint32_t rx_dropped;           // Hardware FIFO plus software queue overflows
+    uint32_t bus_bits;             // Estimated bits of all TX and RX frames (no stuff bits)
+    uint16_t rx_fifo_high_water[2];  // Highest RX FIFO0/FIFO1 fill level seen
+    uint16_t rx_queue_high_water;  // Highest software RX queue depth
+    uint16_t tx_queue_high_water;  // Highest software TX queue depth
+    uint8_t tx_error_count;        // Current TEC
+    uint8_t rx_error_count;        // Current REC
+    uint32_t error_passive_ms;     // Total time spent error passive
+    uint32_t bus_off_count;        // Times the port went bus-off
+};
+
+// One entry of a hardware filter list for CAN::setFilters()
+//
+//   static const CANFilter filters[] = {
+//       CANFilter::exact(0x010).toFifo(1).highPriority(),  // E-stop
+//       CANFilter::range(0x100, 0x17F),
+//       CANFilter::exact(0x200),                           // Consecutive exact IDs
+//       CANFilter::exact(0x210),                           // share one element
+//       CANFilter::mask(0x18FF0000, 0x1FFF0000, true),
+//   };
+//   CAN1.setFilters(filters, 5);
+struct CANFilter
+{
+    enum Type : uint8_t { EXACT, RANGE, MASK, DUAL };
+    enum Action : uint8_t { FIFO0, FIFO1, REJECT };
+
+    Type type;
+    uint32_t id1;
+    uint32_t id2;
+    bool extended;
+    Action action;
+    bool high_priority;
+
+    // Accept a single ID
+    static constexpr CANFilter exact(uint32_t id, bool extended = false)
+    {
+        return CANFilter{EXACT, id, id, extended, FIFO0, false};
+    }
+    // Accept IDs from first to last (inclusive)
+    static constexpr CANFilter range(uint32_t first, uint32_t last, bool extended = false)
+    {
+        return CANFilter{RANGE, first, last, extended, FIFO0, false};
+    }
+    // Accept IDs where (ID & mask) == (id & mask)
+    static constexpr CANFilter mask(uint32_t id, uint32_t mask, bool extended = false)
+    {
+        return CANFilter{MASK, id, mask, extended, FIFO0, false};
+    }
+    // Accept either of two IDs
+    static constexpr CANFilter dual(uint32_t id1, uint32_t id2, bool extended = false)
+    {
+        return CANFilter{DUAL, id1, id2, extended, FIFO0, false};
+    }
+
+    // Store matching frames in RX FIFO 1 instead of 0
+    constexpr CANFilter toFifo(uint8_t fifo) const
+    {
+        return CANFilter{type, id1, id2, extended, fifo == 1 ? FIFO1 : FIFO0, high_priority};
+    }
+    // Drop matching frames (checked in list order, so put it before the
+    // entries it makes exceptions to)
+    constexpr CANFilter reject() const
+    {
+        return CANFilter{type, id1, id2, extended, REJECT, false};
+    }
+    // Flag matching frames as high priority (FDCAN HPM status and interrupt)
+    constexpr CANFilter highPriority() const
+    {
+        return CANFilter{type, id1, id2, extended, action, true};
+    }
+};
+
+// Message RAM of one FDCAN port, for CAN::setMessageRam() (H7)
+//
+//   // Gateway: CAN1 filters finely and buffers deep, CAN2 mostly transmits
+//   //   offset, std/ext filters, RX FIFO0/FIFO1, TX events, TX FIFO, payload
+//   static constexpr CANMessageRam can1_ram = {0, 64, 16, 32, 8, 0, 16, 8};
+//   static constexpr CANMessageRam can2_ram = {can1_ram.end(), 4, 0, 8, 0, 4, 32, 8};
+//   CAN1.setMessageRam(can1_ram);
+//   CAN2.setMessageRam(can2_ram);
+//
+// The H7's FDCAN ports share 2560 words of message RAM; by default each
+// gets a third with 28/8 filters, 8 + 8 RX and 8 TX elements of 8 bytes.
+// Offsets are not checked against the other ports, so lay them out one
+// after another with end(). The G0, G4 and H5 have a fixed layout per
+// port (28/8 filters, 3 + 3 RX and 3 TX elements) that needs no setting.
+struct CANMessageRam
+{
+    static constexpr uint32_t TOTAL_WORDS = 2560;
+
+    uint16_t offset;      // First word in the shared message RAM
+    uint8_t std_filters;  // Standard ID filter elements (0-128)
+    uint8_t ext_filters;  // Extended ID filter elements (0-64)
+    uint8_t rx_fifo0;     // RX FIFO 0 elements (1-64)
+    uint8_t rx_fifo1;     // RX FIFO 1 elements (0-64)
+    uint8_t tx_events;    // TX event elements, for sendTimestamped() (0-32)
+    uint8_t tx_fifo;      // TX FIFO elements (1-32)
+    uint8_t data_bytes;   // Payload per RX/TX element: 8, 12, 16, 20, 24, 32, 48 or 64 (FD)
+
+    // Words taken: a word per standard filter, two per extended filter and
+    // TX event, a two word header plus the payload per RX/TX element
+    constexpr uint32_t words() const
+    {
+        return std_filters + 2u * ext_filters + 2u * tx_events +
+               (rx_fifo0 + rx_fifo1 + tx_fifo) * (2u + (data_bytes + 3u) / 4u);
+    }
+
+    // Offset for the next port's layout
+    constexpr uint16_t end() const { return static_cast<uint16_t>(offset + words()); }
+};
+
 // CAN (FDCAN) Class - Flexible Data-rate CAN
 // Usage Example:
 //   CAN1.begin(500000);  // Start CAN at 500 kbps
@@ -36,8 +169,75 @@
 //       bool ext;
 //       CAN1.read(id, data, len, ext);
 //   }
+//
+// The setters only stage settings; begin() writes them to the controller
+// in one go. Call them before begin() (or end() and begin() again).
+//
+//   CAN1.setNominalBitrate(5, 13, 2).enableFD().begin();
+//
+// By default available() and read() poll the hardware RX FIFO, which only
+// holds a few frames. After beginRxInterrupt() the FDCAN interrupt drains
+// both RX FIFOs into a software queue instead, so a slow loop() no longer
+// loses frames on a busy bus. Handlers registered with onReceive() run
+// from dispatch() in loop(), never in the interrupt:
+//
+//   static CANFrame can1_queue[32];
+//   CAN1.begin(500000);
+//   CAN1.beginRxInterrupt(can1_queue, 32, FDCAN1_IT0_IRQn);
+//   CAN1.onReceive(0x100, 0x7F0, [](const CANFrame& frame) { ... });  // 0x100-0x10F
+//
+//   extern "C" void FDCAN1_IT0_IRQHandler(void) { CAN1.handleInterrupt(); }
+//
+//   void loop() { CAN1.dispatch(); }
+//
+// Frames stay in arrival order: dispatch() runs handlers until it reaches
+// a frame no handler claimed, which is left for read().
+//
+// beginTxQueue() does the same for transmit: send() and sendBatch() queue
+// frames, and the TX complete interrupt feeds them to the hardware in
+// priority order, so bursts no longer fail when the TX FIFO is full:
+//
+//   static CANFrame can1_tx_queue[32];
+//   CAN1.beginTxQueue(can1_tx_queue, 32, FDCAN1_IT0_IRQn);
+//
+// forwardTo() turns two ports into a gateway. Matching frames are sent on
+// the other port from this port's RX interrupt, the moment they arrive:
+// they never pass through the RX queue, dispatch() or loop(), and go
+// straight to the hardware when the other port's TX queue is empty. Both
+// buses run concurrently, each in its own interrupt:
+//
+//   CAN1.beginRxInterrupt(can1_queue, 16, FDCAN1_IT0_IRQn);
+//   CAN1.beginTxQueue(can1_tx_queue, 16, FDCAN1_IT0_IRQn);
+//   CAN2.beginRxInterrupt(can2_queue, 16, FDCAN2_IT0_IRQn);
+//   CAN2.beginTxQueue(can2_tx_queue, 16, FDCAN2_IT0_IRQn);
+//   CAN1.forwardTo(CAN2, 0x000, 0x000);   // Everything from bus 1
+//   CAN2.forwardTo(CAN1, 0x100, 0x700);   // 0x100-0x1FF from bus 2
+//
+// On the G0B1 FDCAN1 and FDCAN2 share TIM16_FDCAN_IT0_IRQn, whose handler
+// calls handleInterrupt() of both ports.
+//
+// getStats() returns frame, drop and error counters; printStats() sends
+// them as one "@canstats" line that `lumos can-stats` turns into rates and
+// bus load. RX frames carry the FDCAN timestamp counter (one tick per
+// nominal bit time), which getTimestamp() and timestampToMicros() turn
+// into latencies. Error-passive time and bus-off events are only tracked
+// once beginRxInterrupt() or beginTxQueue() has enabled the interrupt.
 class CAN
 {
+public:
+    using CANCallback = std::function<void(const CANFrame&)>;
+    static constexpr uint8_t MAX_HANDLERS = 8;
+    static constexpr uint8_t NO_HANDLER = 0xFF;
+    // Frames from the TX queue allowed in the hardware FIFO at once: enough
+    // to send back-to-back, few enough that a new urgent frame is not stuck
+    // behind a full FIFO of lower priority ones
+    static constexpr uint32_t TX_HW_DEPTH = 2;
+    // Hardware filter elements per port (FDCAN maximum on G0/G4)
+    static constexpr uint8_t MAX_STD_FILTERS = 28;
+    static constexpr uint8_t MAX_EXT_FILTERS = 8;
+    static constexpr uint8_t MAX_FORWARDS = 4;
+    using TxCompleteHook = void (*)(void* context);
+
 private:
     FDCAN_HandleTypeDef fdcan_handle_;
 
@@ -48,6 +248,70 @@ private:
     uint16_t rx_pin_;
     uint32_t alternate_function_;
 
+    // Software RX queue: the interrupt only advances rx_queue_head_, the
+    // main loop only rx_queue_tail_ (one slot stays empty)
+    CANFrame* rx_queue_;
+    uint16_t rx_queue_size_;
+    volatile uint16_t rx_queue_head_;
+    volatile uint16_t rx_queue_tail_;
+    volatile uint32_t rx_queue_overflows_;
+    volatile uint32_t rx_fifo_overflows_;
+    IRQn_Type irq_;
+
+    struct Handler
+    {
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+        CANCallback callback;
+    };
+    Handler handlers_[MAX_HANDLERS];
+    volatile uint8_t handler_count_;
+
+    bool readFifo(uint32_t fifo, CANFrame& frame);
+    bool popFrame(CANFrame& frame);
+
+    struct Forward
+    {
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+        CAN* target;
+    };
+    Forward forwards_[MAX_FORWARDS];
+    volatile uint8_t forward_count_;
+    volatile uint32_t forwarded_frames_;
+
+    bool forward(const CANFrame& frame);
+
+    // Software TX queue, kept sorted by arbitration priority. Shared with
+    // the TX complete interrupt, so only touched with interrupts disabled.
+    CANFrame* tx_queue_;
+    uint16_t tx_queue_size_;
+    uint16_t tx_queue_head_;
+    uint16_t tx_queue_count_;
+    TxCompleteHook tx_complete_hook_;
+    void* tx_complete_context_;
+
+    bool transmit(uint32_t id, const uint8_t* data, uint8_t length, bool extended, uint8_t marker = 0);
+    void setGlobalFilter(uint32_t non_matching);
+    void enableStatusInterrupts();
+
+    // Statistics, see CANStats
+    volatile uint32_t tx_frames_;
+    volatile uint32_t tx_dropped_;
+    volatile uint32_t rx_frames_;
+    volatile uint32_t bus_bits_;
+    uint16_t rx_fifo_high_water_[2];
+    uint16_t rx_queue_high_water_;
+    uint16_t tx_queue_high_water_;
+    volatile uint32_t error_passive_since_;  // HAL_GetTick() on entry, 0 = not passive
+    volatile uint32_t error_passive_ms_;
+    volatile uint32_t bus_off_count_;
+    bool nominal_timing_set_;  // setNominalBitrate() overrides begin()'s bitrate
+    void pumpTx();
+    uint32_t txFifoDepth() const;
+
 public:
     CAN() = delete;
     CAN(FDCAN_GlobalTypeDef* fdcan_instance,
@@ -58,11 +322,10 @@ public:
     void begin(const uint32_t bitrate = 500000);
     void end();
 
-    // Fluent API setters
+    // Fluent API setters (applied by begin())
     CAN& setMode(const uint32_t mode)
     {
         fdcan_handle_.Init.Mode = mode;
-        HAL_FDCAN_Init(&fdcan_handle_);
         return *this;
     }
 
@@ -71,7 +334,7 @@ public:
         fdcan_handle_.Init.NominalPrescaler = prescaler;
         fdcan_handle_.Init.NominalTimeSeg1 = seg1;
         fdcan_handle_.Init.NominalTimeSeg2 = seg2;
-        HAL_FDCAN_Init(&fdcan_handle_);
+        nominal_timing_set_ = true;
         return *this;
     }
 
@@ -80,7 +343,6 @@ public:
         fdcan_handle_.Init.DataPrescaler = prescaler;
         fdcan_handle_.Init.DataTimeSeg1 = seg1;
         fdcan_handle_.Init.DataTimeSeg2 = seg2;
-        HAL_FDCAN_Init(&fdcan_handle_);
         return *this;
     }
 
@@ -91,30 +353,214 @@ public:
         } else {
             fdcan_handle_.Init.FrameFormat = FDCAN_FRAME_FD_NO_BRS;  // FD without BRS
         }
-        HAL_FDCAN_Init(&fdcan_handle_);
         return *this;
     }
 
     CAN& disableFD()
     {
         fdcan_handle_.Init.FrameFormat = FDCAN_FRAME_CLASSIC;
-        HAL_FDCAN_Init(&fdcan_handle_);
         return *this;
     }
 
+    // Frames of up to 64 bytes (enableFD())
+    bool isFD() const { return fdcan_handle_.Init.FrameFormat != FDCAN_FRAME_CLASSIC; }
+
+    /**
+     * @brief Lay out this port's part of the shared message RAM (H7, before begin())
+     * @param layout Element counts and offset, see CANMessageRam
+     * @return false if a count is out of range, the layout runs past the
+     *         end of the message RAM, or the part has a fixed layout
+     *
+     * setFilters() can then use up to layout.std_filters and
+     * layout.ext_filters elements. For FD frames longer than 8 bytes set
+     * data_bytes to the longest payload.
+     */
+    bool setMessageRam(const CANMessageRam& layout);
+
     // Message transmission
+    // With the TX queue, send() queues the frame and returns false only if
+    // the queue is full
     bool send(uint32_t id, const uint8_t* data, uint8_t length, bool extended = false);
     bool sendRemote(uint32_t id, bool extended = false);
 
+    /**
+     * @brief Transmit through a software queue fed from the TX complete interrupt
+     * @param queue Frame storage, must outlive the CAN
+     * @param size Number of frames in @p queue
+     * @param irq Interrupt line 0 of this FDCAN, e.g. FDCAN1_IT0_IRQn
+     * @return true if the interrupt was enabled
+     *
+     * Queued frames go out lowest ID first (the order they would win bus
+     * arbitration); frames with the same ID keep their order.
+     */
+    bool beginTxQueue(CANFrame* queue, uint16_t size, IRQn_Type irq);
+
+    /**
+     * @brief Queue several frames at once (id, extended, length and data are used)
+     * @return Number of frames accepted, from the start of @p frames. Stops
+     *         at the first frame that does not fit or is too long.
+     *
+     * Without the TX queue the frames go straight to the hardware FIFO.
+     */
+    uint16_t sendBatch(const CANFrame* frames, uint16_t count);
+
+    // Frames waiting in the TX queue
+    uint16_t txPending() const;
+
+    /**
+     * @brief Call @p hook from the TX complete interrupt, after the TX queue has moved on
+     * @return false if another hook is set; nullptr removes it
+     *
+     * For protocols that feed the port frame by frame (can_isotp.h). The
+     * interrupt is enabled by beginTxQueue().
+     */
+    bool setTxCompleteHook(TxCompleteHook hook, void* context = nullptr);
+
+    /**
+     * @brief Send a frame and record its start-of-frame timestamp (time sync)
+     * @param marker Non-zero tag handed back by readTxEvent() for this frame
+     * @return false if the hardware TX FIFO is full
+     *
+     * Bypasses the TX queue. The timestamp is in the CANFrame::timestamp
+     * time base, so sender and receivers capture the same bus instant.
+     */
+    bool sendTimestamped(uint32_t id, const uint8_t* data, uint8_t length, uint8_t marker, bool extended = false);
+
+    // Oldest TX event of a sendTimestamped() frame; false if none is pending
+    bool readTxEvent(uint8_t& marker, uint16_t& timestamp);
+
     // Message reception
+    // With the RX interrupt, available() first runs dispatch()
     bool available();
     bool read(uint32_t& id, uint8_t* data, uint8_t& length, bool& extended);
+    bool read(CANFrame& frame);
+
+    /**
+     * @brief Receive through the FDCAN interrupt into a software queue
+     * @param queue Frame storage, must outlive the CAN
+     * @param size Number of frames in @p queue (one slot stays unused)
+     * @param irq Interrupt line 0 of this FDCAN, e.g. FDCAN1_IT0_IRQn
+     * @return true if the interrupt was enabled
+     */
+    bool beginRxInterrupt(CANFrame* queue, uint16_t size, IRQn_Type irq);
+
+    /**
+     * @brief Call @p callback from dispatch() for frames whose ID matches
+     * @param id Identifier to match
+     * @param mask Bits of the identifier that must match @p id
+     * @param callback Handler, runs in the main loop
+     * @param extended Match extended (29-bit) instead of standard IDs
+     * @return false if all MAX_HANDLERS handlers are taken
+     */
+    bool onReceive(uint32_t id, uint32_t mask, CANCallback callback, bool extended = false);
+
+    /**
+     * @brief Run the handlers of queued frames, in arrival order
+     * @return Number of frames handled
+     */
+    uint16_t dispatch();
+
+    /**
+     * @brief Send frames whose ID matches on @p target, from the RX interrupt
+     * @param target Port to send them on; needs beginTxQueue(), which keeps
+     *        this interrupt and send() in loop() from colliding
+     * @param id Identifier to match
+     * @param mask Bits of the identifier that must match @p id (0 = all)
+     * @param extended Match extended (29-bit) instead of standard IDs
+     * @return false without beginRxInterrupt() here or beginTxQueue() on
+     *         @p target, or if all MAX_FORWARDS rules are taken
+     *
+     * Rules are checked before the onReceive() handlers; forwarded frames
+     * are not queued here. What @p target cannot take counts in its
+     * tx_dropped.
+     */
+    bool forwardTo(CAN& target, uint32_t id, uint32_t mask, bool extended = false);
+
+    // Frames forwardTo() handed to their target port
+    uint32_t forwardedFrames() const { return forwarded_frames_; }
+
+    // Frames lost because the software queue was full
+    uint32_t rxQueueOverflows() const { return rx_queue_overflows_; }
+    // Frames lost because a hardware RX FIFO was full
+    uint32_t rxFifoOverflows() const { return rx_fifo_overflows_; }
+
+    // Called from the board's FDCAN interrupt handler
+    void handleInterrupt() { LUMOS_TRACE_ISR("can irq"); HAL_FDCAN_IRQHandler(&fdcan_handle_); }
+
+    // Called from the HAL callbacks
+    void onRxFifo(uint32_t fifo, uint32_t interrupts);
+    void onTxComplete()
+    {
+        pumpTx();
+        if (tx_complete_hook_) tx_complete_hook_(tx_complete_context_);
+    }
+    FDCAN_HandleTypeDef* getHandle() { return &fdcan_handle_; }
 
     // Filter configuration
-    void setFilter(uint32_t id, uint32_t mask, bool extended = false);
+    // fifo selects RX FIFO 0 or 1 for matching frames
+    void setFilter(uint32_t id, uint32_t mask, bool extended = false, uint8_t fifo = 0);
     void setAcceptAll();
 
+    /**
+     * @brief Program the hardware filter tables from a list
+     * @param filters Entries, evaluated in order per ID type (first match wins)
+     * @param count Number of entries
+     * @param accept_non_matching Put frames no entry matches in FIFO0
+     *        instead of dropping them
+     * @return false if the list needs more standard or extended elements
+     *         than the message RAM has (MAX_STD_FILTERS and MAX_EXT_FILTERS
+     *         unless setMessageRam() changed them); nothing is changed then
+     *
+     * Replaces all filters, including the one from setFilter(). Consecutive
+     * exact IDs with the same settings are packed two per element. On a
+     * running port the controller is stopped briefly to change the global
+     * filter, so frames waiting in the hardware TX FIFO may be dropped;
+     * call it right after begin().
+     */
+    bool setFilters(const CANFilter* filters, uint8_t count, bool accept_non_matching = false);
+
     // Status
     uint32_t getErrorCount();
     bool isBusOff();
+
+    CANStats getStats();
+    void resetStats();
+
+    /**
+     * @brief Send the statistics as one line for `lumos can-stats`
+     * @param out Serial, USB or anything else with printf()
+     * @param port Number identifying this port in the output
+     *
+     * "@canstats port=N t=MS bitrate=BPS tx= tx_drop= rx= rx_drop= bits=
+     *  fifo0_hw= fifo1_hw= rxq_hw= txq_hw= tec= rec= ep_ms= busoff="
+     */
+    template <typename Out>
+    void printStats(Out& out, uint8_t port)
+    {
+        const CANStats stats = getStats();
+        out.printf("@canstats port=%u t=%u bitrate=%u tx=%u tx_drop=%u rx=%u rx_drop=%u bits=%u "
+                   "fifo0_hw=%u fifo1_hw=%u rxq_hw=%u txq_hw=%u tec=%u rec=%u ep_ms=%u busoff=%u\r\n",
+                   port, HAL_GetTick(), getNominalBitrate(), stats.tx_frames, stats.tx_dropped,
+                   stats.rx_frames, stats.rx_dropped, stats.bus_bits,
+                   stats.rx_fifo_high_water[0], stats.rx_fifo_high_water[1],
+                   stats.rx_queue_high_water, stats.tx_queue_high_water,
+                   stats.tx_error_count, stats.rx_error_count,
+                   stats.error_passive_ms, stats.bus_off_count);
+    }
+
+    // Nominal bitrate from the current bit timing (80 MHz kernel clock, as begin())
+    uint32_t getNominalBitrate() const;
+
+    // Current FDCAN timestamp counter, same time base as CANFrame::timestamp
+    uint16_t getTimestamp();
+
+    // Length of @p ticks timestamp counter ticks (nominal bit times) in microseconds
+    uint32_t timestampToMicros(uint32_t ticks) const;
+
+    // GetCurrentTimeUs() at the moment the timestamp counter read @p timestamp
+    // (no more than one counter wrap ago, 65 ms at 1 Mbit/s)
+    uint64_t timestampToTimeUs(uint16_t timestamp);
+
+    // Called from the HAL error status callback
+    void onErrorStatus(uint32_t interrupts);
 };
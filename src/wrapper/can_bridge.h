@@ -0,0 +1,241 @@
+#pragma once
+
+#include "can.h"
+#include "fast_libc.h"
+#include <cstdint>
+#include <cstring>
+
+// Binary CAN-to-serial bridge for `lumos can`
+//
+// Frames travel as COBS-encoded packets, each terminated by a 0x00 byte,
+// so a reader that starts mid-stream resynchronizes at the next 0x00.
+// Decoded, a packet is
+//
+//   type u8 | payload | crc8 (poly 0x07, over type and payload)
+//
+// with little-endian fields:
+//
+//   FRAME  0x01  device -> host  flags u8 | id u32 | time_us u32 | length u8 | data
+//   SEND   0x02  host -> device  flags u8 | id u32 | length u8 | data
+//   MODE   0x03  host -> device  binary u8 (1 = start, 0 = back to text)
+//   DROPS  0x04  device -> host  can_dropped u32 | bridge_dropped u32
+//
+// flags: bit 0 extended ID, bit 1 CAN FD. time_us is the reception time
+// on a free-running microsecond clock built from the FDCAN timestamp
+// counter (bit-time resolution even where the CPU has no cycle counter).
+//
+// The bridge starts in text mode; the host switches it to binary with a
+// MODE packet:
+//
+//   CANBridge<Serial> bridge(CAN1, SerialPgm);
+//
+//   void loop() {
+//       bridge.poll();                       // Host packets, clock upkeep
+//       CANFrame frame;
+//       while (CAN1.read(frame)) {
+//           if (bridge.binary()) bridge.forward(frame);
+//           else { /* print as text */ }
+//       }
+//   }
+//
+// poll() must run at least every 65536 bit times (131 ms at 500 kbit/s)
+// to keep the clock from losing a timestamp counter wrap.
+template <typename Port>
+class CANBridge
+{
+public:
+    static constexpr uint8_t TYPE_FRAME = 0x01;
+    static constexpr uint8_t TYPE_SEND = 0x02;
+    static constexpr uint8_t TYPE_MODE = 0x03;
+    static constexpr uint8_t TYPE_DROPS = 0x04;
+
+    static constexpr uint8_t FLAG_EXTENDED = 0x01;
+    static constexpr uint8_t FLAG_FD = 0x02;
+
+    CANBridge(CAN& can, Port& port)
+        : can_(can), port_(port), binary_(false), rx_length_(0), rx_overrun_(false),
+          last_timestamp_(0), ticks_(0), dropped_(0)
+    {
+    }
+
+    bool binary() const { return binary_; }
+
+    // Frames that could not be written to the port
+    uint32_t dropped() const { return dropped_; }
+
+    /**
+     * @brief Handle packets from the host and keep the clock running
+     * @return Number of frames sent on the bus for the host
+     */
+    uint16_t poll()
+    {
+        updateClock();
+
+        uint16_t sent = 0;
+        int byte;
+        while ((byte = port_.read()) >= 0) {
+            if (byte != 0) {
+                if (rx_length_ < sizeof(rx_packet_)) {
+                    rx_packet_[rx_length_++] = static_cast<uint8_t>(byte);
+                } else {
+                    rx_overrun_ = true;
+                }
+                continue;
+            }
+
+            // End of packet
+            uint8_t packet[sizeof(rx_packet_)];
+            const uint16_t length = rx_overrun_ ? 0 : decode(rx_packet_, rx_length_, packet);
+            rx_length_ = 0;
+            rx_overrun_ = false;
+            if (length >= 2 && Crc8(0, packet, length - 1) == packet[length - 1]) {
+                sent += handlePacket(packet, length - 1);
+            }
+        }
+        return sent;
+    }
+
+    /**
+     * @brief Send a received frame to the host (binary mode)
+     * @return false if the port did not take it (counted in dropped())
+     */
+    bool forward(const CANFrame& frame)
+    {
+        updateClock();
+
+        // Age of the frame in bit times, from its FDCAN timestamp
+        const uint16_t age = static_cast<uint16_t>(last_timestamp_ - frame.timestamp);
+        const uint32_t time_us = can_.timestampToMicros(ticks_ - age);
+
+        uint8_t packet[4 + 4 + 4 + 64 + 1];
+        uint16_t length = 0;
+        packet[length++] = TYPE_FRAME;
+        packet[length++] = (frame.extended ? FLAG_EXTENDED : 0) | (frame.fd ? FLAG_FD : 0);
+        length = put32(packet, length, frame.id);
+        length = put32(packet, length, time_us);
+        const uint8_t data_length = frame.length <= 64 ? frame.length : 64;
+        packet[length++] = data_length;
+        memcpy(packet + length, frame.data, data_length);
+        length += data_length;
+
+        if (!sendPacket(packet, length)) {
+            dropped_++;
+            return false;
+        }
+        return true;
+    }
+
+    // Report dropped frames to the host (binary mode)
+    bool sendDrops()
+    {
+        const CANStats stats = can_.getStats();
+        uint8_t packet[1 + 4 + 4 + 1];
+        uint16_t length = 0;
+        packet[length++] = TYPE_DROPS;
+        length = put32(packet, length, stats.rx_dropped);
+        length = put32(packet, length, dropped_);
+        return sendPacket(packet, length);
+    }
+
+private:
+    CAN& can_;
+    Port& port_;
+    bool binary_;
+
+    uint8_t rx_packet_[96];  // Encoded bytes of the packet being received
+    uint16_t rx_length_;
+    bool rx_overrun_;
+
+    // Bit-time clock: the 16-bit FDCAN timestamp counter, extended
+    uint16_t last_timestamp_;
+    uint32_t ticks_;
+
+    uint32_t dropped_;
+
+    static uint16_t put32(uint8_t* buffer, uint16_t offset, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) {
+            buffer[offset++] = static_cast<uint8_t>(value >> (8 * i));
+        }
+        return offset;
+    }
+
+    static uint32_t get32(const uint8_t* buffer)
+    {
+        return static_cast<uint32_t>(buffer[0]) | (static_cast<uint32_t>(buffer[1]) << 8) |
+               (static_cast<uint32_t>(buffer[2]) << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+    }
+
+    // COBS decode without the trailing 0x00; returns 0 on malformed input
+    static uint16_t decode(const uint8_t* in, uint16_t length, uint8_t* out)
+    {
+        uint16_t read = 0;
+        uint16_t written = 0;
+        while (read < length) {
+            const uint8_t code = in[read++];
+            if (code == 0 || read + code - 1 > length) {
+                return 0;
+            }
+            for (uint8_t i = 1; i < code; ++i) {
+                out[written++] = in[read++];
+            }
+            if (code != 0xFF && read < length) {
+                out[written++] = 0;
+            }
+        }
+        return written;
+    }
+
+    // Append the CRC, COBS-encode and write one packet
+    bool sendPacket(uint8_t* packet, uint16_t length)
+    {
+        packet[length] = Crc8(0, packet, length);
+        length++;
+
+        uint8_t encoded[sizeof(rx_packet_) + 2];
+        uint16_t code_index = 0;
+        uint16_t written = 1;
+        uint8_t code = 1;
+        for (uint16_t i = 0; i < length; ++i) {
+            if (packet[i] == 0) {
+                encoded[code_index] = code;
+                code_index = written++;
+                code = 1;
+            } else {
+                encoded[written++] = packet[i];
+                if (++code == 0xFF) {
+                    encoded[code_index] = code;
+                    code_index = written++;
+                    code = 1;
+                }
+            }
+        }
+        encoded[code_index] = code;
+        encoded[written++] = 0;
+        return port_.write(encoded, written, 10);
+    }
+
+    uint16_t handlePacket(const uint8_t* packet, uint16_t length)
+    {
+        switch (packet[0]) {
+        case TYPE_MODE:
+            if (length >= 2) binary_ = packet[1] != 0;
+            return 0;
+        case TYPE_SEND: {
+            if (length < 7) return 0;
+            const uint8_t data_length = packet[6];
+            if (length < 7 + data_length) return 0;
+            return can_.send(get32(packet + 2), packet + 7, data_length, (packet[1] & FLAG_EXTENDED) != 0) ? 1 : 0;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    void updateClock()
+    {
+        const uint16_t now = can_.getTimestamp();
+        ticks_ += static_cast<uint16_t>(now - last_timestamp_);
+        last_timestamp_ = now;
+    }
+};
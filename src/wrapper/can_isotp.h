@@ -0,0 +1,520 @@
+#pragma once
+
+#include "can.h"
+#include "sys.h"
+#include <cstdint>
+#include <cstring>
+
+// Messages larger than one frame over CAN (FD), segmented as ISO 15765-2 (ISO-TP)
+//
+// A link is a pair of IDs: frames go out on tx_id, and frames from the
+// other node, data as well as flow control, arrive on rx_id. Both
+// directions run at once. The first byte of each frame (PCI) tells
+// the kind:
+//
+//   SINGLE       0x0 len | data              7 bytes classic; FD: 0x00 len u8 | 62 bytes
+//   FIRST        0x1 len:12 | data           len 0 = 0x10 0x00 | len u32 (big-endian), for > 4095
+//   CONSECUTIVE  0x2 seq:4 | data            63 bytes FD, 7 classic; seq counts 1..15, 0, 1, ...
+//   FLOW         0x3 status:4 | bs | stmin   status CONTINUE, WAIT or OVERFLOW
+//
+// After the first frame the sender waits for flow control: the receiver
+// allows block_size consecutive frames (0 = all), at least stmin apart
+// (0-127 ms, 0xF1-0xF9 = 100-900 us), then answers again. Frames are
+// padded with 0xCC to a valid FD length (8, 12, ..., 64 bytes).
+//
+//   uint8_t config[2048];
+//   CANIsoTp link(CAN1, 0x7A0, 0x7A8);            // Send on 0x7A0, receive on 0x7A8
+//   link.begin(config, sizeof(config));
+//   CAN1.setFilters(...);                          // Include link.filter()
+//
+//   link.send(blob, blob_size);                    // Returns at once
+//
+//   void loop() {
+//       CANFrame frame;
+//       while (CAN1.read(frame)) {
+//           if (!link.handle(frame)) { /* application frame */ }
+//       }
+//       link.poll();
+//       if (uint32_t length = link.receive()) applyConfig(config, length);
+//       if (!link.sending() && link.txResult() != CANIsoTp::RESULT_OK) { /* retry */ }
+//   }
+//
+// Sending is driven by the port's TX complete interrupt (beginTxQueue()):
+// each time a frame leaves, the next consecutive frames are queued, so a
+// large transfer keeps the bus busy without loop() taking part. At most
+// TX_QUEUED frames of it wait in the TX queue at once, and the queue sorts
+// by ID, so other traffic of higher priority still gets through. With
+// stmin > 0 or without the TX queue poll() sends them instead. Only one
+// link per port can use the interrupt (begin() returns false for the
+// others, which then send from poll()).
+//
+// The receiving side answers first frames and each completed block from
+// handle(), in loop(): a block is only allowed once the previous one has
+// left the RX queue. block_size must therefore fit the receiver's RX
+// queue (beginRxInterrupt()) or hardware FIFO; the default block of 8
+// frames carries 504 bytes on FD. stmin stays 0, as the TX queue already
+// paces the sender to the bus, and block_size can be raised up to the
+// queue depth.
+class CANIsoTp
+{
+public:
+    static constexpr uint8_t RESULT_OK = 0;
+    static constexpr uint8_t RESULT_BUSY = 1;      // Transfer in progress
+    static constexpr uint8_t RESULT_TIMEOUT = 2;   // No flow control within TIMEOUT_MS
+    static constexpr uint8_t RESULT_OVERFLOW = 3;  // The receiver has no room for the message
+    static constexpr uint8_t RESULT_ERROR = 4;     // Frame refused by the port, or bad flow control
+
+    static constexpr uint32_t TIMEOUT_MS = 1000;   // N_Bs and N_Cr of ISO 15765-2
+    static constexpr uint8_t MAX_WAITS = 8;        // WAIT flow controls accepted in a row
+    static constexpr uint16_t TX_QUEUED = 2;
+    static constexpr uint8_t PADDING = 0xCC;
+
+    /**
+     * @param tx_id Identifier this node sends on
+     * @param rx_id Identifier the other node sends on
+     */
+    CANIsoTp(CAN& can, uint32_t tx_id, uint32_t rx_id, bool extended = false)
+        : can_(can), tx_id_(tx_id), rx_id_(rx_id), extended_(extended), hooked_(false),
+          block_size_(8), st_min_(0),
+          tx_data_(nullptr), tx_length_(0), tx_offset_(0), tx_state_(TX_IDLE), tx_result_(RESULT_OK),
+          tx_seq_(0), tx_block_size_(0), tx_block_left_(0), tx_waits_(0), tx_st_min_us_(0),
+          tx_last_us_(0), tx_deadline_(0),
+          rx_buffer_(nullptr), rx_capacity_(0), rx_length_(0), rx_offset_(0), rx_state_(RX_IDLE),
+          rx_seq_(0), rx_block_left_(0), rx_deadline_(0), rx_dropped_(0)
+    {
+    }
+
+    ~CANIsoTp()
+    {
+        if (hooked_) can_.setTxCompleteHook(nullptr);
+    }
+
+    CANIsoTp(const CANIsoTp&) = delete;
+    CANIsoTp& operator=(const CANIsoTp&) = delete;
+
+    /**
+     * @brief Set the buffer received messages are reassembled in
+     * @param buffer Room for the largest message (nullptr: send only)
+     * @return false if another link already has the port's TX complete
+     *         interrupt; this one then sends from poll()
+     */
+    bool begin(uint8_t* buffer, uint32_t capacity)
+    {
+        rx_buffer_ = buffer;
+        rx_capacity_ = buffer != nullptr ? capacity : 0;
+        if (!hooked_) hooked_ = can_.setTxCompleteHook(&CANIsoTp::onTxComplete, this);
+        return hooked_;
+    }
+
+    /**
+     * @brief Flow control this node asks of senders
+     * @param block_size Consecutive frames between flow controls (0 = no limit)
+     * @param st_min Minimum gap between them, encoded as in the flow control frame
+     */
+    void setFlowControl(uint8_t block_size, uint8_t st_min = 0)
+    {
+        block_size_ = block_size;
+        st_min_ = st_min;
+    }
+
+    // Filter entry for the incoming frames, for CAN::setFilters()
+    CANFilter filter() const { return CANFilter::exact(rx_id_, extended_); }
+
+    /**
+     * @brief Start sending a message
+     * @param data Stays in use until sending() is false
+     * @return false while a transfer is in progress or if the first frame was refused
+     */
+    bool send(const uint8_t* data, uint32_t length)
+    {
+        if (tx_state_ != TX_IDLE || length == 0) {
+            return false;
+        }
+
+        const uint8_t frame_bytes = frameBytes();
+        CANFrame frame;
+        uint8_t header;
+        if (length <= 7) {
+            frame.data[0] = static_cast<uint8_t>(length);
+            header = 1;
+        } else if (length <= static_cast<uint32_t>(frame_bytes - 2) && frame_bytes > 8) {
+            frame.data[0] = 0x00;
+            frame.data[1] = static_cast<uint8_t>(length);
+            header = 2;
+        } else {
+            header = 0;
+        }
+        if (header > 0) {
+            memcpy(frame.data + header, data, length);
+            tx_result_ = transmit(frame, static_cast<uint8_t>(header + length)) ? RESULT_OK : RESULT_ERROR;
+            return tx_result_ == RESULT_OK;
+        }
+
+        if (length <= 0xFFF) {
+            frame.data[0] = static_cast<uint8_t>(0x10 | (length >> 8));
+            frame.data[1] = static_cast<uint8_t>(length);
+            header = 2;
+        } else {
+            frame.data[0] = 0x10;
+            frame.data[1] = 0x00;
+            frame.data[2] = static_cast<uint8_t>(length >> 24);
+            frame.data[3] = static_cast<uint8_t>(length >> 16);
+            frame.data[4] = static_cast<uint8_t>(length >> 8);
+            frame.data[5] = static_cast<uint8_t>(length);
+            header = 6;
+        }
+        const uint8_t chunk = static_cast<uint8_t>(frame_bytes - header);
+        memcpy(frame.data + header, data, chunk);
+
+        tx_data_ = data;
+        tx_length_ = length;
+        tx_offset_ = chunk;
+        tx_seq_ = 1;
+        tx_waits_ = 0;
+        tx_deadline_ = HAL_GetTick() + TIMEOUT_MS;
+        tx_result_ = RESULT_BUSY;
+        tx_state_ = TX_WAIT_FLOW;
+        if (!transmit(frame, frame_bytes)) {
+            tx_state_ = TX_IDLE;
+            tx_result_ = RESULT_ERROR;
+            return false;
+        }
+        return true;
+    }
+
+    bool sending() const { return tx_state_ != TX_IDLE; }
+
+    // Outcome of the last send(), RESULT_BUSY while it runs
+    uint8_t txResult() const { return tx_result_; }
+
+    /**
+     * @brief Consume a frame of this link
+     * @return false if the frame is not for this link (left to the application)
+     */
+    bool handle(const CANFrame& frame)
+    {
+        if (frame.id != rx_id_ || frame.extended != extended_) {
+            return false;
+        }
+        if (frame.length == 0) {
+            return true;
+        }
+
+        switch (frame.data[0] >> 4) {
+        case 0x0:
+            handleSingle(frame);
+            break;
+        case 0x1:
+            handleFirst(frame);
+            break;
+        case 0x2:
+            handleConsecutive(frame);
+            break;
+        case 0x3:
+            handleFlow(frame);
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Length of a message complete in the buffer, 0 if there is none
+     *
+     * The buffer is free for the next message afterwards, so use it before
+     * handing this link more frames. Until then new messages are refused
+     * (OVERFLOW flow control) and counted in rxDropped().
+     */
+    uint32_t receive()
+    {
+        if (rx_state_ != RX_READY) {
+            return 0;
+        }
+        rx_state_ = RX_IDLE;
+        return rx_length_;
+    }
+
+    // Messages lost: no room, sequence gaps and timeouts
+    uint32_t rxDropped() const { return rx_dropped_; }
+
+    // Send paced consecutive frames and time out stalled transfers, from loop()
+    void poll()
+    {
+        const uint32_t now = HAL_GetTick();
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (tx_state_ == TX_SENDING) {
+            pump();
+        } else if (tx_state_ == TX_WAIT_FLOW && static_cast<int32_t>(now - tx_deadline_) >= 0) {
+            finish(RESULT_TIMEOUT);
+        }
+        __set_PRIMASK(primask);
+
+        if (rx_state_ == RX_RECEIVING && static_cast<int32_t>(now - rx_deadline_) >= 0) {
+            rx_state_ = RX_IDLE;
+            rx_dropped_++;
+        }
+    }
+
+private:
+    static constexpr uint8_t TX_IDLE = 0;
+    static constexpr uint8_t TX_WAIT_FLOW = 1;
+    static constexpr uint8_t TX_SENDING = 2;
+
+    static constexpr uint8_t RX_IDLE = 0;
+    static constexpr uint8_t RX_RECEIVING = 1;
+    static constexpr uint8_t RX_READY = 2;
+
+    static constexpr uint8_t FLOW_CONTINUE = 0;
+    static constexpr uint8_t FLOW_WAIT = 1;
+    static constexpr uint8_t FLOW_OVERFLOW = 2;
+
+    CAN& can_;
+    const uint32_t tx_id_;
+    const uint32_t rx_id_;
+    const bool extended_;
+    bool hooked_;
+    uint8_t block_size_;
+    uint8_t st_min_;
+
+    // Sender, shared with the TX complete interrupt: changed only with
+    // interrupts disabled or from pump()
+    const uint8_t* tx_data_;
+    uint32_t tx_length_;
+    uint32_t tx_offset_;
+    volatile uint8_t tx_state_;
+    volatile uint8_t tx_result_;
+    uint8_t tx_seq_;
+    uint8_t tx_block_size_;
+    uint8_t tx_block_left_;
+    uint8_t tx_waits_;
+    uint32_t tx_st_min_us_;
+    uint64_t tx_last_us_;
+    uint32_t tx_deadline_;
+
+    // Receiver, only used from loop()
+    uint8_t* rx_buffer_;
+    uint32_t rx_capacity_;
+    uint32_t rx_length_;
+    uint32_t rx_offset_;
+    uint8_t rx_state_;
+    uint8_t rx_seq_;
+    uint8_t rx_block_left_;
+    uint32_t rx_deadline_;
+    uint32_t rx_dropped_;
+
+    uint8_t frameBytes() const { return can_.isFD() ? 64 : 8; }
+
+    // Smallest valid frame length holding @p length bytes
+    static uint8_t paddedLength(uint8_t length)
+    {
+        static const uint8_t lengths[] = {8, 12, 16, 20, 24, 32, 48, 64};
+        for (uint8_t padded : lengths) {
+            if (length <= padded) return padded;
+        }
+        return 64;
+    }
+
+    static uint32_t stMinUs(uint8_t st_min)
+    {
+        if (st_min <= 0x7F) return st_min * 1000u;
+        if (st_min >= 0xF1 && st_min <= 0xF9) return (st_min - 0xF0) * 100u;
+        return 127000u;  // Reserved values mean the longest gap
+    }
+
+    bool transmit(CANFrame& frame, uint8_t length)
+    {
+        const uint8_t padded = paddedLength(length);
+        memset(frame.data + length, PADDING, padded - length);
+        frame.id = tx_id_;
+        frame.extended = extended_;
+        frame.length = padded;
+        return can_.sendBatch(&frame, 1) == 1;
+    }
+
+    void finish(uint8_t result)
+    {
+        tx_state_ = TX_IDLE;
+        tx_result_ = result;
+    }
+
+    static void onTxComplete(void* context)
+    {
+        CANIsoTp* link = static_cast<CANIsoTp*>(context);
+        if (link->tx_state_ == TX_SENDING) link->pump();
+    }
+
+    // Queue consecutive frames while the block, the pacing and the TX
+    // queue allow. Runs with interrupts disabled or from the TX interrupt.
+    void pump()
+    {
+        while (tx_state_ == TX_SENDING) {
+            const uint64_t now = GetCurrentTimeUs();
+            if (tx_st_min_us_ > 0 && now - tx_last_us_ < tx_st_min_us_) {
+                return;  // poll() sends it
+            }
+            if (can_.txPending() >= TX_QUEUED) {
+                return;  // The next TX complete comes back here
+            }
+
+            CANFrame frame;
+            const uint8_t frame_bytes = frameBytes();
+            const uint32_t left = tx_length_ - tx_offset_;
+            const uint8_t chunk = static_cast<uint8_t>(left < frame_bytes - 1u ? left : frame_bytes - 1u);
+            frame.data[0] = static_cast<uint8_t>(0x20 | tx_seq_);
+            memcpy(frame.data + 1, tx_data_ + tx_offset_, chunk);
+            if (!transmit(frame, static_cast<uint8_t>(1 + chunk))) {
+                return;  // TX queue taken by other traffic, try again later
+            }
+
+            tx_offset_ += chunk;
+            tx_seq_ = (tx_seq_ + 1) & 0x0F;
+            tx_last_us_ = now;
+            if (tx_offset_ >= tx_length_) {
+                finish(RESULT_OK);
+            } else if (tx_block_size_ > 0 && --tx_block_left_ == 0) {
+                tx_deadline_ = HAL_GetTick() + TIMEOUT_MS;
+                tx_state_ = TX_WAIT_FLOW;
+            } else if (tx_st_min_us_ > 0) {
+                return;
+            }
+        }
+    }
+
+    void handleFlow(const CANFrame& frame)
+    {
+        if (frame.length < 3) {
+            return;
+        }
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        if (tx_state_ == TX_WAIT_FLOW) {
+            switch (frame.data[0] & 0x0F) {
+            case FLOW_CONTINUE:
+                tx_block_size_ = frame.data[1];
+                tx_block_left_ = frame.data[1];
+                tx_st_min_us_ = stMinUs(frame.data[2]);
+                tx_last_us_ = GetCurrentTimeUs() - tx_st_min_us_;  // First one may go now
+                tx_waits_ = 0;
+                tx_state_ = TX_SENDING;
+                pump();
+                break;
+            case FLOW_WAIT:
+                if (++tx_waits_ > MAX_WAITS) {
+                    finish(RESULT_TIMEOUT);
+                } else {
+                    tx_deadline_ = HAL_GetTick() + TIMEOUT_MS;
+                }
+                break;
+            case FLOW_OVERFLOW:
+                finish(RESULT_OVERFLOW);
+                break;
+            default:
+                finish(RESULT_ERROR);
+                break;
+            }
+        }
+        __set_PRIMASK(primask);
+    }
+
+    void sendFlow(uint8_t status)
+    {
+        CANFrame frame;
+        frame.data[0] = static_cast<uint8_t>(0x30 | status);
+        frame.data[1] = block_size_;
+        frame.data[2] = st_min_;
+        transmit(frame, 3);
+    }
+
+    // A new message replaces one still being received, as ISO 15765-2
+    // asks; one not yet taken with receive() is kept
+    bool startMessage(uint32_t length)
+    {
+        if (rx_state_ == RX_READY) {
+            rx_dropped_++;
+            return false;
+        }
+        if (rx_state_ == RX_RECEIVING) {
+            rx_state_ = RX_IDLE;
+            rx_dropped_++;
+        }
+        if (length > rx_capacity_) {
+            rx_dropped_++;
+            return false;
+        }
+        rx_length_ = length;
+        return true;
+    }
+
+    void handleSingle(const CANFrame& frame)
+    {
+        uint32_t length = frame.data[0] & 0x0F;
+        uint8_t header = 1;
+        if (length == 0 && frame.length > 8) {
+            length = frame.data[1];
+            header = 2;
+        }
+        if (length == 0 || length > static_cast<uint32_t>(frame.length - header) || !startMessage(length)) {
+            return;
+        }
+        memcpy(rx_buffer_, frame.data + header, length);
+        rx_state_ = RX_READY;
+    }
+
+    void handleFirst(const CANFrame& frame)
+    {
+        if (frame.length < 8) {
+            return;
+        }
+        uint32_t length = (static_cast<uint32_t>(frame.data[0] & 0x0F) << 8) | frame.data[1];
+        uint8_t header = 2;
+        if (length == 0) {
+            length = (static_cast<uint32_t>(frame.data[2]) << 24) | (static_cast<uint32_t>(frame.data[3]) << 16) |
+                     (static_cast<uint32_t>(frame.data[4]) << 8) | frame.data[5];
+            header = 6;
+        }
+        const uint32_t chunk = frame.length - header;
+        if (length <= chunk) {
+            return;  // Would have been a single frame
+        }
+        if (!startMessage(length)) {
+            sendFlow(FLOW_OVERFLOW);
+            return;
+        }
+
+        memcpy(rx_buffer_, frame.data + header, chunk);
+        rx_offset_ = chunk;
+        rx_seq_ = 1;
+        rx_block_left_ = block_size_;
+        rx_deadline_ = HAL_GetTick() + TIMEOUT_MS;
+        rx_state_ = RX_RECEIVING;
+        sendFlow(FLOW_CONTINUE);
+    }
+
+    void handleConsecutive(const CANFrame& frame)
+    {
+        if (rx_state_ != RX_RECEIVING) {
+            return;
+        }
+        if ((frame.data[0] & 0x0F) != rx_seq_) {
+            rx_state_ = RX_IDLE;  // A frame went missing
+            rx_dropped_++;
+            return;
+        }
+
+        const uint32_t left = rx_length_ - rx_offset_;
+        const uint32_t chunk = frame.length - 1u < left ? frame.length - 1u : left;
+        memcpy(rx_buffer_ + rx_offset_, frame.data + 1, chunk);
+        rx_offset_ += chunk;
+        rx_seq_ = (rx_seq_ + 1) & 0x0F;
+        rx_deadline_ = HAL_GetTick() + TIMEOUT_MS;
+
+        if (rx_offset_ >= rx_length_) {
+            rx_state_ = RX_READY;
+        } else if (block_size_ > 0 && --rx_block_left_ == 0) {
+            rx_block_left_ = block_size_;
+            sendFlow(FLOW_CONTINUE);
+        }
+    }
+};
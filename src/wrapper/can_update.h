@@ -0,0 +1,283 @@
+#pragma once
+
+#include "can.h"
+#include "fast_libc.h"
+#include <cstdint>
+#include <cstring>
+
+// Firmware download over CAN FD to many nodes at once, for `lumos can-update`
+//
+// The host streams the image through a CAN bridge (can_bridge.h) that
+// puts it on the bus; every node taking part receives the same frames,
+// so the download takes as long for twenty nodes as for one. Lost frames
+// are repeated selectively: after each block the host asks all nodes
+// which frames they are missing and sends the union again.
+//
+//   DATA     0x1F000000 | seq  extended, host -> nodes  64 bytes of image at seq * 64
+//   CONTROL  0x7E0             standard, host -> nodes  command u8 | node u8 | session u16 | ...
+//   STATUS   0x780 + node      standard, node -> host   48 bytes, see below
+//
+// CONTROL commands (node 0xFF addresses every node), little-endian:
+//
+//   BEGIN   0x01  size u32 | crc32 u32   Erase room for the image, start receiving
+//   QUERY   0x02  block u16              Report the frames received of a block
+//   COMMIT  0x03                         Check the CRC and hand the image on
+//   ABORT   0x04                         Drop the download
+//
+// Each command is answered with a STATUS frame:
+//
+//   state u8 | 0 | session u16 | block u16 | missing u16 | bitmap[32] | 0 x 8
+//
+// state is IDLE, RECEIVING, DONE or ERROR (no room, storage or CRC
+// failure). A block is 256 frames (16 KB); bit i of the bitmap is set once
+// frame block * 256 + i is stored, and missing counts the clear ones of
+// the block. All nodes answer a broadcast QUERY at once, CAN arbitration
+// serializes the replies. The last frame is padded to 64 bytes. When a
+// node has every frame of a block it moves on to the next; earlier blocks
+// report complete.
+//
+// The storage decides where the image goes (e.g. a staging area in flash
+// that a bootloader installs from); it provides
+//
+//   uint32_t capacity();
+//   bool begin(uint32_t size);                                    // Erase
+//   bool write(uint32_t offset, const uint8_t* data, uint8_t length);
+//   bool read(uint32_t offset, uint8_t* data, uint8_t length);
+//   bool finish(uint32_t size, uint32_t crc);                     // CRC checked
+//
+// offset is a multiple of 64, length at most 64. begin() may take as long
+// as the erase does; the host waits for the BEGIN replies.
+//
+//   FlashStaging staging;
+//   CANUpdateTarget<FlashStaging> update(CAN1, staging, NODE_ID);
+//
+//   void loop() {
+//       CANFrame frame;
+//       while (CAN1.read(frame)) {
+//           if (!update.handle(frame)) { /* application frame */ }
+//       }
+//   }
+//
+// The port must run CAN FD (enableFD()) and accept the DATA and CONTROL
+// IDs (dataFilter() and controlFilter() for setFilters()). Receive with
+// beginRxInterrupt() and send with beginTxQueue(), so frames keep coming
+// in while flash is programmed and replies queue behind each other.
+template <typename Storage>
+class CANUpdateTarget
+{
+public:
+    static constexpr uint32_t DATA_BASE = 0x1F000000;
+    static constexpr uint32_t CONTROL_ID = 0x7E0;
+    static constexpr uint32_t STATUS_BASE = 0x780;
+    static constexpr uint8_t MAX_NODES = 64;
+    static constexpr uint8_t ALL_NODES = 0xFF;
+
+    static constexpr uint8_t CMD_BEGIN = 0x01;
+    static constexpr uint8_t CMD_QUERY = 0x02;
+    static constexpr uint8_t CMD_COMMIT = 0x03;
+    static constexpr uint8_t CMD_ABORT = 0x04;
+
+    static constexpr uint8_t STATE_IDLE = 0;
+    static constexpr uint8_t STATE_RECEIVING = 1;
+    static constexpr uint8_t STATE_DONE = 2;
+    static constexpr uint8_t STATE_ERROR = 3;
+
+    static constexpr uint8_t FRAME_BYTES = 64;
+    static constexpr uint16_t BLOCK_FRAMES = 256;
+    static constexpr uint8_t STATUS_BYTES = 48;
+
+    /**
+     * @param node Address of this node, 0 to MAX_NODES - 1
+     */
+    CANUpdateTarget(CAN& can, Storage& storage, uint8_t node)
+        : can_(can), storage_(storage), node_(node), state_(STATE_IDLE), session_(0), size_(0), crc_(0),
+          frames_(0), block_(0), missing_(0), received_{}
+    {
+    }
+
+    uint8_t state() const { return state_; }
+
+    // Image bytes stored so far (whole blocks plus frames of the current one)
+    uint32_t received() const
+    {
+        const uint32_t frames = static_cast<uint32_t>(block_) * BLOCK_FRAMES + blockFrames(block_) - missing_;
+        const uint32_t bytes = frames * FRAME_BYTES;
+        return bytes < size_ ? bytes : size_;
+    }
+
+    // Filter entries for the update traffic, for CAN::setFilters()
+    static constexpr CANFilter dataFilter() { return CANFilter::mask(DATA_BASE, 0x1FFF0000, true); }
+    static constexpr CANFilter controlFilter() { return CANFilter::exact(CONTROL_ID); }
+
+    /**
+     * @brief Consume a frame of the update protocol
+     * @return false if the frame is not update traffic (left to the application)
+     */
+    bool handle(const CANFrame& frame)
+    {
+        if (frame.extended && (frame.id & 0x1FFF0000) == DATA_BASE) {
+            handleData(static_cast<uint16_t>(frame.id), frame.data, frame.length);
+            return true;
+        }
+        if (!frame.extended && frame.id == CONTROL_ID) {
+            handleControl(frame.data, frame.length);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    CAN& can_;
+    Storage& storage_;
+    const uint8_t node_;
+    uint8_t state_;
+    uint16_t session_;
+    uint32_t size_;
+    uint32_t crc_;
+    uint32_t frames_;            // Frames in the image
+    uint16_t block_;             // First block not yet complete
+    uint16_t missing_;           // Frames of block_ not yet stored
+    uint8_t received_[BLOCK_FRAMES / 8];  // Frames of block_ stored
+
+    static uint16_t get16(const uint8_t* buffer)
+    {
+        return static_cast<uint16_t>(buffer[0] | (buffer[1] << 8));
+    }
+
+    static uint32_t get32(const uint8_t* buffer)
+    {
+        return static_cast<uint32_t>(buffer[0]) | (static_cast<uint32_t>(buffer[1]) << 8) |
+               (static_cast<uint32_t>(buffer[2]) << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+    }
+
+    uint16_t blockFrames(uint16_t block) const
+    {
+        const uint32_t first = static_cast<uint32_t>(block) * BLOCK_FRAMES;
+        if (first >= frames_) return 0;
+        const uint32_t left = frames_ - first;
+        return static_cast<uint16_t>(left < BLOCK_FRAMES ? left : BLOCK_FRAMES);
+    }
+
+    void startBlock(uint16_t block)
+    {
+        block_ = block;
+        missing_ = blockFrames(block);
+        memset(received_, 0, sizeof(received_));
+    }
+
+    void handleData(uint16_t seq, const uint8_t* data, uint8_t length)
+    {
+        if (state_ != STATE_RECEIVING || length < FRAME_BYTES || seq >= frames_) {
+            return;
+        }
+        // Earlier blocks are complete; later ones only come once the host
+        // has given up on this node
+        if (seq / BLOCK_FRAMES != block_) {
+            return;
+        }
+        const uint16_t index = seq % BLOCK_FRAMES;
+        const uint8_t bit = static_cast<uint8_t>(1u << (index % 8));
+        if (received_[index / 8] & bit) {
+            return;
+        }
+
+        const uint32_t offset = static_cast<uint32_t>(seq) * FRAME_BYTES;
+        const uint32_t left = size_ - offset;
+        if (!storage_.write(offset, data, static_cast<uint8_t>(left < FRAME_BYTES ? left : FRAME_BYTES))) {
+            state_ = STATE_ERROR;
+            return;
+        }
+        received_[index / 8] |= bit;
+        if (--missing_ == 0 && blockFrames(block_ + 1) > 0) {
+            startBlock(block_ + 1);
+        }
+    }
+
+    void handleControl(const uint8_t* data, uint8_t length)
+    {
+        if (length < 4 || (data[1] != node_ && data[1] != ALL_NODES)) {
+            return;
+        }
+        const uint16_t session = get16(data + 2);
+        bool query = false;
+        uint16_t block = 0;
+
+        switch (data[0]) {
+        case CMD_BEGIN:
+            if (length < 12) return;
+            // A repeated BEGIN (lost reply) must not erase what arrived since
+            if (session != session_ || state_ != STATE_RECEIVING) {
+                begin(session, get32(data + 4), get32(data + 8));
+            }
+            break;
+        case CMD_QUERY:
+            if (length < 6) return;
+            query = session == session_;
+            block = get16(data + 4);
+            break;
+        case CMD_COMMIT:
+            if (session == session_ && state_ == STATE_RECEIVING && missing_ == 0) {
+                commit();
+            }
+            break;
+        case CMD_ABORT:
+            if (session == session_) {
+                state_ = STATE_IDLE;
+            }
+            break;
+        default:
+            return;
+        }
+        reply(query ? block : block_);
+    }
+
+    void begin(uint16_t session, uint32_t size, uint32_t crc)
+    {
+        session_ = session;
+        size_ = size;
+        crc_ = crc;
+        frames_ = (size + FRAME_BYTES - 1) / FRAME_BYTES;
+        startBlock(0);
+        const bool fits = size > 0 && size <= storage_.capacity() && frames_ <= 0x10000;
+        state_ = fits && storage_.begin(size) ? STATE_RECEIVING : STATE_ERROR;
+    }
+
+    void commit()
+    {
+        uint8_t chunk[FRAME_BYTES];
+        uint32_t crc = 0;
+        for (uint32_t offset = 0; offset < size_; offset += FRAME_BYTES) {
+            const uint32_t left = size_ - offset;
+            const uint8_t length = static_cast<uint8_t>(left < FRAME_BYTES ? left : FRAME_BYTES);
+            if (!storage_.read(offset, chunk, length)) {
+                state_ = STATE_ERROR;
+                return;
+            }
+            crc = Crc32(crc, chunk, length);  // ISO-HDLC, as SimpleSerial::Crc32() on the host
+        }
+        state_ = crc == crc_ && storage_.finish(size_, crc) ? STATE_DONE : STATE_ERROR;
+    }
+
+    void reply(uint16_t block)
+    {
+        uint8_t status[STATUS_BYTES] = {};
+        status[0] = state_;
+        status[2] = static_cast<uint8_t>(session_);
+        status[3] = static_cast<uint8_t>(session_ >> 8);
+        status[4] = static_cast<uint8_t>(block);
+        status[5] = static_cast<uint8_t>(block >> 8);
+
+        uint16_t missing = 0;
+        if (block == block_) {
+            missing = missing_;
+            memcpy(status + 8, received_, sizeof(received_));
+        } else if (block < block_) {
+            memset(status + 8, 0xFF, sizeof(received_));
+        } else {
+            missing = blockFrames(block);
+        }
+        status[6] = static_cast<uint8_t>(missing);
+        status[7] = static_cast<uint8_t>(missing >> 8);
+        can_.send(STATUS_BASE + node_, status, STATUS_BYTES, false);
+    }
+};
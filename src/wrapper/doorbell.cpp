@@ -0,0 +1,156 @@
+#include "doorbell.h"
+
+Doorbell::Handler Doorbell::handlers_[Doorbell::CHANNELS] = {};
+void* Doorbell::contexts_[Doorbell::CHANNELS] = {};
+
+#if defined(HSEM)
+
+// Core ID field of RLR and R; the HAL header defines it only when its
+// HSEM module is enabled
+#if defined(HSEM_CR_COREID_CURRENT)
+#define DOORBELL_COREID HSEM_CR_COREID_CURRENT
+#else
+#define DOORBELL_COREID (3u << HSEM_CR_COREID_Pos)
+#endif
+
+// Tries to take a semaphore another core holds for a moment
+static constexpr int RING_ATTEMPTS = 8;
+
+bool Doorbell::attach(uint32_t channel, Handler handler, void* context)
+{
+    if (channel >= CHANNELS || handler == nullptr) {
+        return false;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    handlers_[channel] = handler;
+    contexts_[channel] = context;
+    HSEM_COMMON->ICR = 1u << channel;
+    HSEM_COMMON->IER |= 1u << channel;
+    __set_PRIMASK(primask);
+
+    __HAL_RCC_HSEM_CLK_ENABLE();
+    HAL_NVIC_SetPriority(HSEM1_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(HSEM1_IRQn);
+    return true;
+}
+
+void Doorbell::detach(uint32_t channel)
+{
+    if (channel >= CHANNELS) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    HSEM_COMMON->IER &= ~(1u << channel);
+    HSEM_COMMON->ICR = 1u << channel;
+    handlers_[channel] = nullptr;
+    __set_PRIMASK(primask);
+}
+
+bool Doorbell::ring(uint32_t channel)
+{
+    if (channel >= CHANNELS) {
+        return false;
+    }
+    __HAL_RCC_HSEM_CLK_ENABLE();
+    for (int attempt = 0; attempt < RING_ATTEMPTS; attempt++) {
+        // One-step lock: the read takes the semaphore if it was free
+        if (HSEM->RLR[channel] == (DOORBELL_COREID | HSEM_RLR_LOCK)) {
+            HSEM->R[channel] = DOORBELL_COREID;   // Release raises the interrupt
+            return true;
+        }
+    }
+    return false;
+}
+
+void Doorbell::useInterrupt(IRQn_Type irq)
+{
+    (void)irq;   // HSEM1_IRQHandler serves every channel
+}
+
+void Doorbell::handleInterrupt()
+{
+    const uint32_t status = HSEM_COMMON->MISR;
+    HSEM_COMMON->ICR = status;
+    for (uint32_t pending = status; pending != 0; pending &= pending - 1) {
+        const uint32_t channel = static_cast<uint32_t>(__builtin_ctz(pending));
+        const Handler handler = handlers_[channel];
+        if (handler != nullptr) {
+            handler(contexts_[channel]);
+        }
+    }
+}
+
+extern "C" void HSEM1_IRQHandler(void)
+{
+    Doorbell::handleInterrupt();
+}
+
+#else
+
+volatile uint32_t Doorbell::pending_ = 0;
+int32_t Doorbell::irq_ = -1;
+
+bool Doorbell::attach(uint32_t channel, Handler handler, void* context)
+{
+    if (channel >= CHANNELS || handler == nullptr || irq_ < 0) {
+        return false;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    handlers_[channel] = handler;
+    contexts_[channel] = context;
+    __set_PRIMASK(primask);
+    return true;
+}
+
+void Doorbell::detach(uint32_t channel)
+{
+    if (channel >= CHANNELS) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    handlers_[channel] = nullptr;
+    pending_ &= ~(1u << channel);
+    __set_PRIMASK(primask);
+}
+
+bool Doorbell::ring(uint32_t channel)
+{
+    if (channel >= CHANNELS || irq_ < 0) {
+        return false;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    pending_ |= 1u << channel;
+    __set_PRIMASK(primask);
+    HAL_NVIC_SetPendingIRQ(static_cast<IRQn_Type>(irq_));
+    return true;
+}
+
+void Doorbell::useInterrupt(IRQn_Type irq)
+{
+    irq_ = static_cast<int32_t>(irq);
+    HAL_NVIC_SetPriority(irq, 5, 0);
+    HAL_NVIC_EnableIRQ(irq);
+}
+
+void Doorbell::handleInterrupt()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint32_t status = pending_;
+    pending_ = 0;
+    __set_PRIMASK(primask);
+    for (uint32_t pending = status; pending != 0; pending &= pending - 1) {
+        const uint32_t channel = static_cast<uint32_t>(__builtin_ctz(pending));
+        const Handler handler = handlers_[channel];
+        if (handler != nullptr) {
+            handler(contexts_[channel]);
+        }
+    }
+}
+
+#endif
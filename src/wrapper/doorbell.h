@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+// Platform-specific HAL headers
+#if defined(STM32H7)
+    #include "stm32h7xx_hal.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx_hal.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx_hal.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx_hal.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx_hal.h"
+#else
+    #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
+#endif
+
+// Doorbell: interrupt another context (or core) that new data is waiting
+// Usage Example:
+//   Doorbell::attach(0, [](void*) { scheduler.Trigger(decoder); }, nullptr);
+//   Doorbell::ring(0);               // From any context; runs the handler
+//
+//   // G0, G4, F4 and H5: name an interrupt the board does not use
+//   Doorbell::useInterrupt(TIM7_IRQn);
+//   extern "C" void TIM7_IRQHandler(void) { Doorbell::handleInterrupt(); }
+//
+// The framework's SharedTopic (framework/shared_topic.h) rings one from
+// its notify hook, so a reader in another context is woken instead of
+// polling. Rings of a channel before its handler runs are merged.
+//
+// On the H7 each channel is a hardware semaphore: ring() takes and
+// releases it, and the release raises HSEM1_IRQHandler on every core
+// that enabled that semaphore's interrupt (both cores of the dual-core
+// parts). No HAL module is needed. Other families have no HSEM; their
+// channels share a spare interrupt that ring() sets pending.
+// Handlers run at priority 5, like the wrapper's other interrupts.
+class Doorbell
+{
+public:
+    static constexpr uint32_t CHANNELS = 32;
+
+    using Handler = void (*)(void* context);
+
+    /**
+     * @brief Run @p handler from the doorbell interrupt when @p channel rings
+     * @return false for a channel out of range, or without an interrupt
+     *         on families that need useInterrupt()
+     */
+    static bool attach(uint32_t channel, Handler handler, void* context);
+
+    /** @brief Stop handling @p channel */
+    static void detach(uint32_t channel);
+
+    /**
+     * @brief Interrupt the handlers of @p channel (any context)
+     * @return false if the channel could not be rung (the semaphore was
+     *         held elsewhere throughout)
+     */
+    static bool ring(uint32_t channel);
+
+    /** @brief Interrupt used by every channel where there is no HSEM */
+    static void useInterrupt(IRQn_Type irq);
+
+    /** @brief Dispatch rung channels; called by the doorbell interrupt */
+    static void handleInterrupt();
+
+private:
+    static Handler handlers_[CHANNELS];
+    static void* contexts_[CHANNELS];
+#if !defined(HSEM)
+    static volatile uint32_t pending_;
+    static int32_t irq_;
+#endif
+};
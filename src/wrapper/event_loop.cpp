@@ -0,0 +1,152 @@
+#include "event_loop.h"
+#include "sys.h"
+
+extern "C" void loop(void);
+
+struct EventSlot {
+    EventHandler handler;
+    void* context;
+    uint64_t posted_us;   // First post since the last dispatch
+    EventStats stats;
+};
+
+static EventSlot event_slots[EVENT_TYPE_COUNT];
+static volatile uint32_t event_pending = 0;   // One bit per EventType, under PRIMASK
+static uint32_t loop_interval_ms = 1;
+static uint64_t last_loop_ms = 0;
+
+static const char* const event_names[EVENT_TYPE_COUNT] = {
+    "uart_rx", "can_rx", "timer", "exti", "usb_rx", "user"
+};
+
+// Milliseconds until loop() is due without events (UINT32_MAX: never)
+static uint32_t MsUntilLoop(uint64_t now_ms)
+{
+    if (loop_interval_ms == 0) {
+        return UINT32_MAX;
+    }
+    const uint64_t elapsed = now_ms - last_loop_ms;
+    return elapsed >= loop_interval_ms ? 0 : (uint32_t)(loop_interval_ms - elapsed);
+}
+
+extern "C" {
+
+void PostEvent(EventType type)
+{
+    if ((unsigned)type >= EVENT_TYPE_COUNT) {
+        return;
+    }
+    const uint32_t bit = 1u << type;
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    EventSlot& slot = event_slots[type];
+    if ((event_pending & bit) == 0) {
+        slot.posted_us = GetCurrentTimeUs();
+        event_pending = event_pending | bit;
+    }
+    slot.stats.posts++;
+    __set_PRIMASK(primask);
+}
+
+void OnEvent(EventType type, EventHandler handler, void* context)
+{
+    if ((unsigned)type >= EVENT_TYPE_COUNT) {
+        return;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    event_slots[type].handler = handler;
+    event_slots[type].context = context;
+    __set_PRIMASK(primask);
+}
+
+void SetLoopInterval(uint32_t ms)
+{
+    loop_interval_ms = ms;
+}
+
+void ServiceEventLoop(void)
+{
+    uint64_t posted_us[EVENT_TYPE_COUNT];
+
+    // Take the pending set; with nothing to do, sleep with interrupts
+    // masked so a post after the check still wakes the core (Idle())
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint32_t pending = event_pending;
+    if (pending == 0) {
+        const uint32_t wait_ms = MsUntilLoop(GetCurrentTimeMs());
+        if (wait_ms > 0) {
+            Idle(wait_ms);
+            __set_PRIMASK(primask);
+            return;
+        }
+    }
+    event_pending = 0;
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        posted_us[i] = event_slots[i].posted_us;
+    }
+    __set_PRIMASK(primask);
+
+    const uint64_t now_us = GetCurrentTimeUs();
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        if ((pending & (1u << i)) == 0) {
+            continue;
+        }
+        EventSlot& slot = event_slots[i];
+        const uint64_t latency = now_us - posted_us[i];
+        __disable_irq();
+        slot.stats.dispatches++;
+        slot.stats.total_latency_us += latency;
+        if (latency > slot.stats.max_latency_us) {
+            slot.stats.max_latency_us = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+        }
+        const EventHandler handler = slot.handler;
+        void* const context = slot.context;
+        __set_PRIMASK(primask);
+
+        if (handler != nullptr) {
+            handler(context);
+        }
+    }
+
+    last_loop_ms = GetCurrentTimeMs();
+    loop();
+}
+
+void RunEventLoop(void)
+{
+    last_loop_ms = GetCurrentTimeMs();
+    for (;;) {
+        ServiceEventLoop();
+    }
+}
+
+EventStats GetEventStats(EventType type)
+{
+    EventStats stats = {};
+    if ((unsigned)type < EVENT_TYPE_COUNT) {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        stats = event_slots[type].stats;
+        __set_PRIMASK(primask);
+    }
+    return stats;
+}
+
+void ResetEventStats(void)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        event_slots[i].stats = EventStats{};
+    }
+    __set_PRIMASK(primask);
+}
+
+const char* GetEventName(EventType type)
+{
+    return ((unsigned)type < EVENT_TYPE_COUNT) ? event_names[type] : "";
+}
+
+}  // extern "C"
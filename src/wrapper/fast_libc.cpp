@@ -0,0 +1,168 @@
+#include "fast_libc.h"
+
+// ===== CRC =====
+
+#ifdef LUMOS_FAST_LIBC
+static constexpr uint32_t kCrcTableBits = 8;   // A byte per lookup, 1 KB + 256 bytes of flash
+#else
+static constexpr uint32_t kCrcTableBits = 4;   // A nibble per lookup, 80 bytes of flash
+#endif
+
+namespace {
+
+struct CrcTables {
+    uint32_t crc32[1u << kCrcTableBits];
+    uint8_t crc8[1u << kCrcTableBits];
+
+    constexpr CrcTables() : crc32(), crc8()
+    {
+        for (uint32_t i = 0; i < (1u << kCrcTableBits); ++i) {
+            uint32_t crc = i;
+            uint8_t crc_msb = static_cast<uint8_t>(i << (8 - kCrcTableBits));
+            for (uint32_t bit = 0; bit < kCrcTableBits; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                crc_msb = (crc_msb & 0x80) ? static_cast<uint8_t>((crc_msb << 1) ^ 0x07)
+                                           : static_cast<uint8_t>(crc_msb << 1);
+            }
+            crc32[i] = crc;
+            crc8[i] = crc_msb;
+        }
+    }
+};
+
+constexpr CrcTables crc_tables;
+
+} // namespace
+
+extern "C" uint32_t Crc32(uint32_t crc, const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= bytes[i];
+        for (uint32_t bits = 0; bits < 8; bits += kCrcTableBits) {
+            crc = crc_tables.crc32[crc & ((1u << kCrcTableBits) - 1)] ^ (crc >> kCrcTableBits);
+        }
+    }
+    return ~crc;
+}
+
+extern "C" uint8_t Crc8(uint8_t crc, const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= bytes[i];
+        for (uint32_t bits = 0; bits < 8; bits += kCrcTableBits) {
+            crc = static_cast<uint8_t>((kCrcTableBits < 8 ? crc << kCrcTableBits : 0) ^
+                                       crc_tables.crc8[crc >> (8 - kCrcTableBits)]);
+        }
+    }
+    return crc;
+}
+
+// ===== memcpy / memset =====
+
+#ifdef LUMOS_FAST_LIBC
+
+// Words of any memory, whatever type the caller stored there
+typedef uint32_t __attribute__((may_alias)) Word;
+typedef uint32_t __attribute__((may_alias, aligned(1))) UnalignedWord;
+
+// The loops below must not be turned back into memcpy()/memset() calls;
+// used keeps LTO from dropping them before it emits its own calls
+#define LUMOS_LIBC_FUNCTION __attribute__((used, optimize("no-tree-loop-distribute-patterns")))
+
+static constexpr size_t kWordCopyMin = 16;   // Below this, aligning costs more than it saves
+
+extern "C" LUMOS_LIBC_FUNCTION void* memcpy(void* __restrict destination, const void* __restrict source, size_t length)
+{
+    uint8_t* dst = static_cast<uint8_t*>(destination);
+    const uint8_t* src = static_cast<const uint8_t*>(source);
+
+    if (length >= kWordCopyMin) {
+        while (reinterpret_cast<uintptr_t>(dst) & 3) {
+            *dst++ = *src++;
+            length--;
+        }
+
+        if ((reinterpret_cast<uintptr_t>(src) & 3) == 0) {
+            Word* dw = reinterpret_cast<Word*>(dst);
+            const Word* sw = reinterpret_cast<const Word*>(src);
+            while (length >= 32) {
+                // All loads first, so they issue as one LDM
+                const uint32_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+                const uint32_t w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+                dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+                dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+                dw += 8;
+                sw += 8;
+                length -= 32;
+            }
+            while (length >= 4) {
+                *dw++ = *sw++;
+                length -= 4;
+            }
+            dst = reinterpret_cast<uint8_t*>(dw);
+            src = reinterpret_cast<const uint8_t*>(sw);
+        }
+#if defined(__ARM_FEATURE_UNALIGNED)
+        else {
+            // M7/M33: LDR takes unaligned addresses (LDM doesn't)
+            Word* dw = reinterpret_cast<Word*>(dst);
+            const UnalignedWord* sw = reinterpret_cast<const UnalignedWord*>(src);
+            while (length >= 16) {
+                const uint32_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+                dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+                dw += 4;
+                sw += 4;
+                length -= 16;
+            }
+            while (length >= 4) {
+                *dw++ = *sw++;
+                length -= 4;
+            }
+            dst = reinterpret_cast<uint8_t*>(dw);
+            src = reinterpret_cast<const uint8_t*>(sw);
+        }
+#endif
+    }
+
+    while (length--) {
+        *dst++ = *src++;
+    }
+    return destination;
+}
+
+extern "C" LUMOS_LIBC_FUNCTION void* memset(void* destination, int value, size_t length)
+{
+    uint8_t* dst = static_cast<uint8_t*>(destination);
+    const uint8_t byte = static_cast<uint8_t>(value);
+
+    if (length >= kWordCopyMin) {
+        while (reinterpret_cast<uintptr_t>(dst) & 3) {
+            *dst++ = byte;
+            length--;
+        }
+
+        const uint32_t word = 0x01010101u * byte;
+        Word* dw = reinterpret_cast<Word*>(dst);
+        while (length >= 32) {
+            dw[0] = word; dw[1] = word; dw[2] = word; dw[3] = word;
+            dw[4] = word; dw[5] = word; dw[6] = word; dw[7] = word;
+            dw += 8;
+            length -= 32;
+        }
+        while (length >= 4) {
+            *dw++ = word;
+            length -= 4;
+        }
+        dst = reinterpret_cast<uint8_t*>(dw);
+    }
+
+    while (length--) {
+        *dst++ = byte;
+    }
+    return destination;
+}
+
+#endif // LUMOS_FAST_LIBC
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Word-wide memcpy()/memset() and table-driven CRCs
+// Usage Example (usable from C):
+//   memcpy(frame, samples, sizeof(samples));   // The fast one with fast_libc on
+//
+//   uint32_t crc = Crc32(0, image, image_size);
+//   crc = Crc32(crc, more, more_size);          // Continues over several calls
+//   frame[length] = Crc8(0, frame, length);
+//
+// newlib-nano's memcpy() and memset() move a byte per loop iteration. With
+// `fast_libc` on (project.yaml; by default in the release and fast
+// profiles) this file defines both instead, so every caller - the HAL,
+// USB, SD and DMA pipeline copies, struct assignments the compiler turns
+// into calls - gets the fast ones:
+//   - The destination is aligned first, then 32 bytes move per iteration
+//     as eight word loads and stores (LDM/STM), then words, then bytes.
+//   - A source misaligned to the destination is read with unaligned word
+//     loads on the M7 and M33; the M0+ has none and copies such buffers
+//     a byte at a time, as newlib does.
+// Copies shorter than 16 bytes skip the setup and go bytewise.
+//
+// The CRCs use 256-entry tables in flash with fast_libc, 16-entry
+// (nibble) tables otherwise; both give the same results as the bitwise
+// loops on the host. Crc32 is CRC-32/ISO-HDLC (zlib, SimpleSerial::Crc32())
+// and Crc8 the polynomial 0x07 CRC of TokenLog and the CAN bridge.
+// `lumos bench` times them, against newlib with --no-fast-libc.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-32 (ISO-HDLC) of @p data, continuing from @p crc (0 to start)
+uint32_t Crc32(uint32_t crc, const void* data, size_t length);
+
+// CRC-8 (polynomial 0x07, no reflection), continuing from @p crc (0 to start)
+uint8_t Crc8(uint8_t crc, const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
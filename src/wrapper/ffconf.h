@@ -0,0 +1,95 @@
+#pragma once
+
+// FatFs configuration for FileSystem (filesystem.h)
+//
+// FatFs comes from the STM32Cube package (Middlewares/Third_Party/FatFs).
+// Packages ship different FatFs releases, which name their options
+// differently (R0.12: _FS_READONLY, R0.13 and later: FF_FS_READONLY), so
+// both sets are defined. The revision check takes its value from
+// ff.h itself, which defines it before including this file.
+
+// ===== R0.13 and later =====
+#ifdef FF_DEFINED
+#define FFCONF_DEF          FF_DEFINED
+#endif
+
+#define FF_FS_READONLY      0
+#define FF_FS_MINIMIZE      0
+#define FF_USE_FIND         0
+#define FF_USE_MKFS         0
+#define FF_USE_FASTSEEK     0
+#define FF_USE_EXPAND       1   // f_expand() for contiguous, pre-allocated files
+#define FF_USE_CHMOD        0
+#define FF_USE_LABEL        0
+#define FF_USE_FORWARD      0
+#define FF_USE_STRFUNC      0
+#define FF_PRINT_LLI        0
+#define FF_PRINT_FLOAT      0
+#define FF_STRF_ENCODE      0
+
+#define FF_CODE_PAGE        437
+#define FF_USE_LFN          0   // 8.3 names, no Unicode tables
+#define FF_MAX_LFN          255
+#define FF_LFN_UNICODE      0
+#define FF_LFN_BUF          255
+#define FF_SFN_BUF          12
+#define FF_FS_RPATH         0
+
+#define FF_VOLUMES          1
+#define FF_STR_VOLUME_ID    0
+#define FF_MULTI_PARTITION  0
+#define FF_MIN_SS           512
+#define FF_MAX_SS           512
+#define FF_LBA64            0
+#define FF_MIN_GPT          0x10000000
+#define FF_USE_TRIM         0
+
+#define FF_FS_TINY          0   // Per-file sector buffers, whole sectors go straight to the card
+#define FF_FS_EXFAT         0
+#define FF_FS_NORTC         1
+#define FF_NORTC_MON        1
+#define FF_NORTC_MDAY       1
+#define FF_NORTC_YEAR       2025
+#define FF_FS_NOFSINFO      0
+#define FF_FS_LOCK          0
+#define FF_FS_REENTRANT     0
+#define FF_FS_TIMEOUT       1000
+
+// ===== R0.12 =====
+#ifdef _FATFS
+#define _FFCONF             _FATFS
+#endif
+
+#define _FS_READONLY        FF_FS_READONLY
+#define _FS_MINIMIZE        FF_FS_MINIMIZE
+#define _USE_STRFUNC        FF_USE_STRFUNC
+#define _USE_FIND           FF_USE_FIND
+#define _USE_MKFS           FF_USE_MKFS
+#define _USE_FASTSEEK       FF_USE_FASTSEEK
+#define _USE_EXPAND         FF_USE_EXPAND
+#define _USE_CHMOD          FF_USE_CHMOD
+#define _USE_LABEL          FF_USE_LABEL
+#define _USE_FORWARD        FF_USE_FORWARD
+#define _CODE_PAGE          FF_CODE_PAGE
+#define _USE_LFN            FF_USE_LFN
+#define _MAX_LFN            FF_MAX_LFN
+#define _LFN_UNICODE        FF_LFN_UNICODE
+#define _STRF_ENCODE        FF_STRF_ENCODE
+#define _FS_RPATH           FF_FS_RPATH
+#define _VOLUMES            FF_VOLUMES
+#define _STR_VOLUME_ID      FF_STR_VOLUME_ID
+#define _MULTI_PARTITION    FF_MULTI_PARTITION
+#define _MIN_SS             FF_MIN_SS
+#define _MAX_SS             FF_MAX_SS
+#define _USE_TRIM           FF_USE_TRIM
+#define _FS_NOFSINFO        FF_FS_NOFSINFO
+#define _FS_TINY            FF_FS_TINY
+#define _FS_EXFAT           FF_FS_EXFAT
+#define _FS_NORTC           FF_FS_NORTC
+#define _NORTC_MON          FF_NORTC_MON
+#define _NORTC_MDAY         FF_NORTC_MDAY
+#define _NORTC_YEAR         FF_NORTC_YEAR
+#define _FS_LOCK            FF_FS_LOCK
+#define _FS_REENTRANT       FF_FS_REENTRANT
+#define _FS_TIMEOUT         FF_FS_TIMEOUT
+#define _SYNC_t             void*
@@ -0,0 +1,560 @@
+#include "filesystem.h"
+
+#ifdef LUMOS_FATFS
+
+#include "diskio.h"
+#include <cstring>
+
+// FatFs has one volume, backed by the mounted FileSystem
+static FileSystem* mounted_fs = nullptr;
+
+// ===== FileSystem =====
+
+FileSystem::FileSystem(SDCard& card, uint8_t* cache, uint32_t cache_sectors)
+    : card_(card),
+      fatfs_{},
+      mounted_(false),
+      cache_(cache),
+      cache_sectors_(cache != nullptr ? cache_sectors : 0),
+      entries_{},
+      use_counter_(0),
+      cache_hits_(0),
+      cache_misses_(0),
+      transfer_ok_(false)
+{
+    if (cache_sectors_ > MAX_CACHE_SECTORS) {
+        cache_sectors_ = MAX_CACHE_SECTORS;
+    }
+}
+
+FileSystem::~FileSystem()
+{
+    unmount();
+}
+
+bool FileSystem::mount()
+{
+    if (mounted_) {
+        return true;
+    }
+    if (mounted_fs != nullptr || card_.getBlockCount() == 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < cache_sectors_; i++) {
+        entries_[i].valid = false;
+        entries_[i].dirty = false;
+    }
+
+    mounted_fs = this;
+    if (f_mount(&fatfs_, "", 1) != FR_OK) {
+        f_mount(nullptr, "", 0);
+        mounted_fs = nullptr;
+        return false;
+    }
+    mounted_ = true;
+    return true;
+}
+
+void FileSystem::unmount()
+{
+    if (!mounted_) {
+        return;
+    }
+    sync();
+    f_mount(nullptr, "", 0);
+    mounted_ = false;
+    mounted_fs = nullptr;
+}
+
+bool FileSystem::sync()
+{
+    // Ascending sector order keeps the write-back sequential
+    bool ok = true;
+    for (;;) {
+        int next = -1;
+        for (uint32_t i = 0; i < cache_sectors_; i++) {
+            if (entries_[i].valid && entries_[i].dirty &&
+                (next < 0 || entries_[i].sector < entries_[next].sector)) {
+                next = (int)i;
+            }
+        }
+        if (next < 0) {
+            return ok;
+        }
+        if (!writeBack((uint32_t)next)) {
+            ok = false;
+            entries_[next].valid = false;  // Don't retry it forever
+        }
+    }
+}
+
+uint32_t FileSystem::getClusterBytes() const
+{
+    return mounted_ ? (uint32_t)fatfs_.csize * SECTOR_SIZE : 0;
+}
+
+uint64_t FileSystem::getFreeBytes()
+{
+    if (!mounted_) {
+        return 0;
+    }
+
+    DWORD free_clusters = 0;
+    FATFS* fs = nullptr;
+    if (f_getfree("", &free_clusters, &fs) != FR_OK) {
+        return 0;
+    }
+    return (uint64_t)free_clusters * fs->csize * SECTOR_SIZE;
+}
+
+bool FileSystem::remove(const char* path)
+{
+    return mounted_ && f_unlink(path) == FR_OK;
+}
+
+bool FileSystem::rename(const char* from, const char* to)
+{
+    return mounted_ && f_rename(from, to) == FR_OK;
+}
+
+bool FileSystem::makeDirectory(const char* path)
+{
+    return mounted_ && f_mkdir(path) == FR_OK;
+}
+
+bool FileSystem::exists(const char* path)
+{
+    FILINFO info;
+    return mounted_ && f_stat(path, &info) == FR_OK;
+}
+
+bool FileSystem::readSectors(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    if (count == 1 && cache_sectors_ > 0) {
+        int index = findEntry(sector);
+        if (index >= 0) {
+            cache_hits_++;
+        } else {
+            cache_misses_++;
+            index = allocateEntry(sector);
+            if (index < 0 || !cardRead(slot((uint32_t)index), sector, 1)) {
+                if (index >= 0) {
+                    entries_[index].valid = false;
+                }
+                return false;
+            }
+        }
+        memcpy(buffer, slot((uint32_t)index), SECTOR_SIZE);
+        return true;
+    }
+
+    // Dirty sectors in the range are newer than the card
+    return flushRange(sector, count) && cardRead(buffer, sector, count);
+}
+
+bool FileSystem::writeSectors(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    if (count == 1 && cache_sectors_ > 0) {
+        int index = findEntry(sector);
+        if (index >= 0) {
+            cache_hits_++;
+        } else {
+            cache_misses_++;
+            index = allocateEntry(sector);
+            if (index < 0) {
+                return false;
+            }
+        }
+        memcpy(slot((uint32_t)index), buffer, SECTOR_SIZE);
+        entries_[index].dirty = true;
+        return true;
+    }
+
+    // Bulk data goes straight to the card; cached copies are refreshed
+    if (!cardWrite(buffer, sector, count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < cache_sectors_; i++) {
+        if (entries_[i].valid && entries_[i].sector - sector < count) {
+            memcpy(slot(i), buffer + (entries_[i].sector - sector) * SECTOR_SIZE, SECTOR_SIZE);
+            entries_[i].dirty = false;
+        }
+    }
+    return true;
+}
+
+int FileSystem::findEntry(uint32_t sector)
+{
+    for (uint32_t i = 0; i < cache_sectors_; i++) {
+        if (entries_[i].valid && entries_[i].sector == sector) {
+            entries_[i].last_use = use_counter_++;
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Free or least recently used slot, written back first if dirty
+int FileSystem::allocateEntry(uint32_t sector)
+{
+    uint32_t victim = 0;
+    for (uint32_t i = 0; i < cache_sectors_; i++) {
+        if (!entries_[i].valid) {
+            victim = i;
+            break;
+        }
+        if (entries_[i].last_use < entries_[victim].last_use) {
+            victim = i;
+        }
+    }
+
+    if (entries_[victim].valid && entries_[victim].dirty && !writeBack(victim)) {
+        return -1;
+    }
+
+    entries_[victim].sector = sector;
+    entries_[victim].last_use = use_counter_++;
+    entries_[victim].valid = true;
+    entries_[victim].dirty = false;
+    return (int)victim;
+}
+
+bool FileSystem::writeBack(uint32_t index)
+{
+    if (!cardWrite(slot(index), entries_[index].sector, 1)) {
+        return false;
+    }
+    entries_[index].dirty = false;
+    return true;
+}
+
+bool FileSystem::flushRange(uint32_t sector, uint32_t count)
+{
+    for (uint32_t i = 0; i < cache_sectors_; i++) {
+        if (entries_[i].valid && entries_[i].dirty && entries_[i].sector - sector < count &&
+            !writeBack(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// DMA when the card has it and the buffer allows it, polled otherwise
+bool FileSystem::cardRead(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    if (card_.isDmaReady() && card_.isDmaBuffer(buffer, true)) {
+        // A member, the callback may still come after a timeout
+        transfer_ok_ = false;
+        if (!card_.readBlocksAsync(sector, buffer, count, [this](bool ok) { transfer_ok_ = ok; })) {
+            return false;
+        }
+        return card_.waitIdle() && transfer_ok_;
+    }
+    return card_.readBlocks(sector, buffer, count);
+}
+
+bool FileSystem::cardWrite(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    if (card_.isDmaReady() && card_.isDmaBuffer(buffer, false)) {
+        // A member, the callback may still come after a timeout
+        transfer_ok_ = false;
+        if (!card_.writeBlocksAsync(sector, buffer, count, [this](bool ok) { transfer_ok_ = ok; })) {
+            return false;
+        }
+        return card_.waitIdle() && transfer_ok_;
+    }
+    return card_.writeBlocks(sector, buffer, count);
+}
+
+// ===== File =====
+
+File::File()
+    : file_{},
+      open_(false),
+      preallocated_(false),
+      written_end_(0),
+      stage_(nullptr),
+      stage_size_(0),
+      stage_fill_(0),
+      stage_target_(0),
+      cluster_bytes_(0)
+{
+}
+
+File::~File()
+{
+    close();
+}
+
+bool File::open(const char* path, Mode mode)
+{
+    if (open_) {
+        close();
+    }
+
+    BYTE flags = FA_READ;
+    switch (mode) {
+        case Mode::READ:       flags = FA_READ; break;
+        case Mode::WRITE:      flags = FA_WRITE | FA_CREATE_ALWAYS; break;
+        case Mode::APPEND:     flags = FA_WRITE | FA_OPEN_ALWAYS; break;
+        case Mode::READ_WRITE: flags = FA_READ | FA_WRITE | FA_OPEN_EXISTING; break;
+    }
+
+    if (mounted_fs == nullptr || f_open(&file_, path, flags) != FR_OK) {
+        return false;
+    }
+    if (mode == Mode::APPEND && f_lseek(&file_, f_size(&file_)) != FR_OK) {
+        f_close(&file_);
+        return false;
+    }
+
+    open_ = true;
+    preallocated_ = false;
+    written_end_ = f_size(&file_);
+    cluster_bytes_ = (uint32_t)file_.obj.fs->csize * FileSystem::SECTOR_SIZE;
+    stage_ = nullptr;
+    stage_size_ = 0;
+    resetStage();
+    return true;
+}
+
+bool File::close()
+{
+    if (!open_) {
+        return false;
+    }
+
+    bool ok = flushStage();
+
+    // Give back the pre-allocated clusters that were never written
+    if (preallocated_ && written_end_ < f_size(&file_)) {
+        ok = f_lseek(&file_, written_end_) == FR_OK && f_truncate(&file_) == FR_OK && ok;
+    }
+
+    ok = f_close(&file_) == FR_OK && ok;
+    open_ = false;
+    if (mounted_fs != nullptr) {
+        ok = mounted_fs->sync() && ok;
+    }
+    return ok;
+}
+
+bool File::preallocate(uint64_t bytes)
+{
+    if (!open_ || f_size(&file_) != 0 || stage_fill_ != 0) {
+        return false;
+    }
+    if (f_expand(&file_, (FSIZE_t)bytes, 1) != FR_OK) {
+        return false;
+    }
+    preallocated_ = true;
+    written_end_ = 0;
+    return true;
+}
+
+bool File::setWriteBuffer(uint8_t* buffer, uint32_t size)
+{
+    if (!open_ || !flushStage()) {
+        return false;
+    }
+
+    const uint32_t usable = (cluster_bytes_ != 0) ? size / cluster_bytes_ * cluster_bytes_ : 0;
+    if (buffer == nullptr || usable == 0) {
+        stage_ = nullptr;
+        stage_size_ = 0;
+        return buffer == nullptr;
+    }
+
+    stage_ = buffer;
+    stage_size_ = usable;
+    resetStage();
+    return true;
+}
+
+uint32_t File::write(const void* data, uint32_t length)
+{
+    if (!open_ || data == nullptr) {
+        return 0;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (stage_ == nullptr) {
+        return writeDirect(bytes, length);
+    }
+
+    uint32_t done = 0;
+    while (done < length) {
+        // Large writes starting on a cluster boundary skip the copy
+        if (stage_fill_ == 0 && stage_target_ == stage_size_ && length - done >= stage_size_) {
+            const uint32_t chunk = (length - done) / cluster_bytes_ * cluster_bytes_;
+            const uint32_t written = writeDirect(bytes + done, chunk);
+            done += written;
+            if (written != chunk) {
+                return done;
+            }
+            continue;
+        }
+
+        uint32_t chunk = stage_target_ - stage_fill_;
+        if (chunk > length - done) {
+            chunk = length - done;
+        }
+        memcpy(stage_ + stage_fill_, bytes + done, chunk);
+        stage_fill_ += chunk;
+        done += chunk;
+
+        if (stage_fill_ == stage_target_) {
+            const uint32_t staged = stage_fill_;
+            if (!flushStage()) {
+                return done > staged ? done - staged : 0;
+            }
+        }
+    }
+    return done;
+}
+
+uint32_t File::read(void* data, uint32_t length)
+{
+    if (!open_ || data == nullptr || !flushStage()) {
+        return 0;
+    }
+
+    UINT read_bytes = 0;
+    if (f_read(&file_, data, length, &read_bytes) != FR_OK) {
+        return 0;
+    }
+    return read_bytes;
+}
+
+bool File::sync()
+{
+    if (!open_) {
+        return false;
+    }
+    const bool ok = flushStage() && f_sync(&file_) == FR_OK;
+    return (mounted_fs != nullptr) ? mounted_fs->sync() && ok : ok;
+}
+
+bool File::seek(uint64_t position)
+{
+    if (!open_ || !flushStage()) {
+        return false;
+    }
+    const bool ok = f_lseek(&file_, (FSIZE_t)position) == FR_OK;
+    resetStage();
+    return ok;
+}
+
+uint64_t File::tell() const
+{
+    return open_ ? f_tell(&file_) + stage_fill_ : 0;
+}
+
+uint64_t File::size() const
+{
+    if (!open_) {
+        return 0;
+    }
+    // A pre-allocated file is only as long as what was written
+    const uint64_t end = preallocated_ ? written_end_ : (uint64_t)f_size(&file_);
+    const uint64_t staged_end = f_tell(&file_) + stage_fill_;
+    return staged_end > end ? staged_end : end;
+}
+
+bool File::flushStage()
+{
+    if (stage_fill_ == 0) {
+        return true;
+    }
+
+    const uint32_t fill = stage_fill_;
+    const bool ok = writeDirect(stage_, fill) == fill;
+    stage_fill_ = 0;
+    resetStage();
+    return ok;
+}
+
+uint32_t File::writeDirect(const uint8_t* data, uint32_t length)
+{
+    UINT written = 0;
+    if (f_write(&file_, data, length, &written) != FR_OK) {
+        written = 0;
+    }
+    if (f_tell(&file_) > written_end_) {
+        written_end_ = f_tell(&file_);
+    }
+    return written;
+}
+
+// The next stage ends on a cluster boundary, so whole-cluster flushes
+// reach the card as multi-block writes
+void File::resetStage()
+{
+    stage_fill_ = 0;
+    if (stage_ == nullptr || cluster_bytes_ == 0) {
+        stage_target_ = 0;
+        return;
+    }
+    const uint32_t offset = (uint32_t)(f_tell(&file_) % cluster_bytes_);
+    stage_target_ = stage_size_ - offset;
+}
+
+// ===== FatFs disk I/O =====
+
+extern "C" DSTATUS disk_initialize(BYTE pdrv)
+{
+    return disk_status(pdrv);
+}
+
+extern "C" DSTATUS disk_status(BYTE pdrv)
+{
+    if (pdrv != 0 || mounted_fs == nullptr) {
+        return STA_NOINIT;
+    }
+    return 0;
+}
+
+extern "C" DRESULT disk_read(BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+    if (pdrv != 0 || mounted_fs == nullptr) {
+        return RES_NOTRDY;
+    }
+    return mounted_fs->readSectors(buff, sector, count) ? RES_OK : RES_ERROR;
+}
+
+extern "C" DRESULT disk_write(BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+    if (pdrv != 0 || mounted_fs == nullptr) {
+        return RES_NOTRDY;
+    }
+    return mounted_fs->writeSectors(buff, sector, count) ? RES_OK : RES_ERROR;
+}
+
+extern "C" DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+    if (pdrv != 0 || mounted_fs == nullptr) {
+        return RES_NOTRDY;
+    }
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            return mounted_fs->sync() ? RES_OK : RES_ERROR;
+        case GET_SECTOR_COUNT:
+            *static_cast<DWORD*>(buff) = mounted_fs->getCard().getBlockCount();
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *static_cast<WORD*>(buff) = FileSystem::SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE: {
+            // Erase block in sectors, for cluster alignment in f_mkfs()
+            const uint32_t au = mounted_fs->getCard().getAllocationUnitBlocks();
+            *static_cast<DWORD*>(buff) = (au != 0) ? au : 1;
+            return RES_OK;
+        }
+        default:
+            return RES_PARERR;
+    }
+}
+
+#endif // LUMOS_FATFS
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "sd.h"
+
+// FAT filesystem on an SDCard, using FatFs from the STM32Cube package
+// (Middlewares/Third_Party/FatFs, configured by ffconf.h). Without FatFs in
+// the package, or without the SD HAL module, this header is empty.
+//
+// Usage Example:
+//   alignas(32) static uint8_t fs_cache[8 * 512];
+//   FileSystem fs{sdcard, fs_cache, 8};   // 8-sector write-back cache
+//
+//   sdcard.begin();
+//   sdcard.beginDma(SDMMC1_IRQn);         // Optional, sectors then move by IDMA
+//   fs.mount();
+//
+//   File log;
+//   log.open("LOG0001.BIN", File::Mode::WRITE);
+//   log.preallocate(64 * 1024 * 1024);    // Contiguous 64 MB, no FAT walks later
+//
+//   alignas(32) static uint8_t log_stage[32 * 1024];
+//   log.setWriteBuffer(log_stage, sizeof(log_stage));
+//   log.write(&sample, sizeof(sample));   // Goes out in whole clusters
+//
+//   log.close();                          // Flushes, trims to the written size
+//   fs.sync();                            // Writes back the sector cache
+//
+// The sector cache holds single-sector accesses, which is where FatFs
+// touches the FAT and directory entries; dirty sectors are written back on
+// sync(), close() or eviction. Multi-sector transfers (file data in whole
+// sectors) bypass it and go to the card as one multi-block command. Only
+// one FileSystem can be mounted at a time.
+
+#if defined(HAL_SD_MODULE_ENABLED) && __has_include("ff.h")
+
+#include "ff.h"
+
+#define LUMOS_FATFS 1
+
+class FileSystem
+{
+public:
+    static constexpr uint32_t SECTOR_SIZE = 512;
+    static constexpr uint32_t MAX_CACHE_SECTORS = 32;
+
+    /**
+     * @param card Card to mount, started with begin()
+     * @param cache Storage for the sector cache, cache_sectors * 512 bytes
+     *        (usable for SD DMA if beginDma() is used, see SDCard)
+     * @param cache_sectors Cached sectors, up to MAX_CACHE_SECTORS (0 = no cache)
+     */
+    FileSystem(SDCard& card, uint8_t* cache = nullptr, uint32_t cache_sectors = 0);
+    ~FileSystem();
+
+    FileSystem(const FileSystem&) = delete;
+    FileSystem& operator=(const FileSystem&) = delete;
+
+    // Mount the first FAT volume on the card
+    bool mount();
+    void unmount();
+    bool isMounted() const { return mounted_; }
+
+    // Write back every dirty cached sector
+    bool sync();
+
+    // Volume information
+    uint32_t getClusterBytes() const;
+    uint64_t getFreeBytes();
+
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    bool makeDirectory(const char* path);
+    bool exists(const char* path);
+
+    // Sector cache statistics
+    uint32_t getCacheHits() const { return cache_hits_; }
+    uint32_t getCacheMisses() const { return cache_misses_; }
+
+    // Called from the FatFs disk I/O functions
+    bool readSectors(uint8_t* buffer, uint32_t sector, uint32_t count);
+    bool writeSectors(const uint8_t* buffer, uint32_t sector, uint32_t count);
+    SDCard& getCard() { return card_; }
+
+private:
+    struct CacheEntry
+    {
+        uint32_t sector;
+        uint32_t last_use;   // For least-recently-used eviction
+        bool valid;
+        bool dirty;
+    };
+
+    SDCard& card_;
+    FATFS fatfs_;
+    bool mounted_;
+
+    uint8_t* cache_;
+    uint32_t cache_sectors_;
+    CacheEntry entries_[MAX_CACHE_SECTORS];
+    uint32_t use_counter_;
+    uint32_t cache_hits_;
+    uint32_t cache_misses_;
+    volatile bool transfer_ok_;
+
+    uint8_t* slot(uint32_t index) { return cache_ + index * SECTOR_SIZE; }
+    int findEntry(uint32_t sector);
+    int allocateEntry(uint32_t sector);
+    bool writeBack(uint32_t index);
+    bool flushRange(uint32_t sector, uint32_t count);
+
+    bool cardRead(uint8_t* buffer, uint32_t sector, uint32_t count);
+    bool cardWrite(const uint8_t* buffer, uint32_t sector, uint32_t count);
+};
+
+class File
+{
+public:
+    enum class Mode {
+        READ,        // Existing file, from the start
+        WRITE,       // Created or truncated
+        APPEND,      // Created if missing, writes at the end
+        READ_WRITE   // Existing file, read and write anywhere
+    };
+
+    File();
+    ~File();
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    bool open(const char* path, Mode mode);
+
+    // Flush the write buffer, trim a pre-allocation to the written size and close
+    bool close();
+    bool isOpen() const { return open_; }
+
+    /**
+     * @brief Reserve contiguous clusters for a new, empty file
+     *
+     * Later writes then need no cluster allocation, so logging never waits
+     * for a FAT search. close() gives back what was not written.
+     */
+    bool preallocate(uint64_t bytes);
+
+    /**
+     * @brief Collect small writes into buffer and write them in whole clusters
+     * @param buffer Staging storage (usable for SD DMA if beginDma() is used);
+     *        the size is rounded down to whole clusters, nullptr to stop
+     * @return false if the buffer is smaller than one cluster; small writes
+     *         then go straight to FatFs
+     */
+    bool setWriteBuffer(uint8_t* buffer, uint32_t size);
+
+    // Bytes written (fewer on error or when the volume is full)
+    uint32_t write(const void* data, uint32_t length);
+    uint32_t read(void* data, uint32_t length);
+
+    // Flush the write buffer and the file's directory entry
+    bool sync();
+
+    bool seek(uint64_t position);
+    uint64_t tell() const;
+    uint64_t size() const;
+
+    FIL* getHandle() { return &file_; }
+
+private:
+    FIL file_;
+    bool open_;
+    bool preallocated_;
+    uint64_t written_end_;     // Furthest byte written, where close() trims to
+
+    uint8_t* stage_;
+    uint32_t stage_size_;      // Whole clusters
+    uint32_t stage_fill_;
+    uint32_t stage_target_;    // Fill that ends on a cluster boundary
+    uint32_t cluster_bytes_;
+
+    bool flushStage();
+    uint32_t writeDirect(const uint8_t* data, uint32_t length);
+    void resetStage();
+};
+
+#endif // HAL_SD_MODULE_ENABLED && ff.h
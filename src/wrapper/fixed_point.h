@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+
+// Q16.16 fixed point, and Real: float with an FPU, Fixed without
+// Usage Example:
+//   timer.setDutyCycle(1, 37.5_fx);                 // No float code on the M0+
+//   Fixed volts = adc.readVoltage<Fixed>();
+//   SerialCom.println(volts * 2, 3);                // "3.300"
+//
+//   Real gain = adc.readVoltage<Real>() / 2;        // float on the H7, Fixed on the G0
+//   timer.setDutyCycle(2, gain * 10);
+//
+// The Cortex-M0+ of the LumosMicroBrain has no FPU (float_abi: soft in
+// the board config), so there every float multiply, divide and
+// conversion is a call into libgcc's soft-float routines: tens to
+// hundreds of cycles each and several KB of flash once linked. Fixed
+// does the same with integer instructions. +, - and comparisons are
+// single instructions, * is one 32x32->64 bit multiply and / a 64-bit
+// divide (a library call, but no slower than the soft-float one). The
+// range is -32768 to just under 32768 with a resolution of 1/65536.
+//
+// Real is float where the compiler targets an FPU (__ARM_FP, from the
+// board's hard float ABI) or runs on the host, and Fixed elsewhere. Code
+// written against Real, using the wrapper's Fixed overloads (Timer,
+// AnalogInput, print()), does its arithmetic in hardware on every board.
+// _fx literals are computed by the compiler; use constexpr where a
+// constant must never be converted at run time.
+class Fixed
+{
+public:
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+    constexpr Fixed() : raw_(0) {}
+    constexpr explicit Fixed(int32_t integer) : raw_(integer * ONE) {}
+
+    static constexpr Fixed fromRaw(int32_t raw)
+    {
+        Fixed value;
+        value.raw_ = raw;
+        return value;
+    }
+
+    // @p numerator / @p denominator, rounded toward zero
+    static constexpr Fixed fromRatio(int32_t numerator, int32_t denominator)
+    {
+        return fromRaw(static_cast<int32_t>(static_cast<int64_t>(numerator) * ONE / denominator));
+    }
+
+    constexpr int32_t raw() const { return raw_; }
+
+    // Integer part, rounded toward minus infinity
+    constexpr int32_t toInt() const { return raw_ >> FRACTION_BITS; }
+
+    // Value in thousandths, rounded (volts to millivolts)
+    constexpr int32_t toMilli() const
+    {
+        return static_cast<int32_t>((static_cast<int64_t>(raw_) * 1000 + ONE / 2) >> FRACTION_BITS);
+    }
+
+    // For code that needs a float; a soft-float call without an FPU
+    constexpr float toFloat() const { return static_cast<float>(raw_) / ONE; }
+
+    constexpr Fixed operator-() const { return fromRaw(-raw_); }
+    constexpr Fixed operator+(Fixed other) const { return fromRaw(raw_ + other.raw_); }
+    constexpr Fixed operator-(Fixed other) const { return fromRaw(raw_ - other.raw_); }
+    constexpr Fixed operator*(Fixed other) const
+    {
+        return fromRaw(static_cast<int32_t>((static_cast<int64_t>(raw_) * other.raw_) >> FRACTION_BITS));
+    }
+    constexpr Fixed operator/(Fixed other) const
+    {
+        return fromRaw(static_cast<int32_t>((static_cast<int64_t>(raw_) << FRACTION_BITS) / other.raw_));
+    }
+    constexpr Fixed operator*(int32_t factor) const { return fromRaw(raw_ * factor); }
+    constexpr Fixed operator/(int32_t divisor) const { return fromRaw(raw_ / divisor); }
+
+    Fixed& operator+=(Fixed other) { return *this = *this + other; }
+    Fixed& operator-=(Fixed other) { return *this = *this - other; }
+    Fixed& operator*=(Fixed other) { return *this = *this * other; }
+    Fixed& operator/=(Fixed other) { return *this = *this / other; }
+    Fixed& operator*=(int32_t factor) { return *this = *this * factor; }
+    Fixed& operator/=(int32_t divisor) { return *this = *this / divisor; }
+
+    constexpr bool operator==(Fixed other) const { return raw_ == other.raw_; }
+    constexpr bool operator!=(Fixed other) const { return raw_ != other.raw_; }
+    constexpr bool operator<(Fixed other) const { return raw_ < other.raw_; }
+    constexpr bool operator<=(Fixed other) const { return raw_ <= other.raw_; }
+    constexpr bool operator>(Fixed other) const { return raw_ > other.raw_; }
+    constexpr bool operator>=(Fixed other) const { return raw_ >= other.raw_; }
+
+private:
+    int32_t raw_;
+};
+
+constexpr Fixed operator"" _fx(long double value)
+{
+    return Fixed::fromRaw(static_cast<int32_t>(value * Fixed::ONE + (value < 0 ? -0.5L : 0.5L)));
+}
+
+constexpr Fixed operator"" _fx(unsigned long long value)
+{
+    return Fixed(static_cast<int32_t>(value));
+}
+
+#if defined(__ARM_FP) || !defined(__arm__)
+#define LUMOS_HAS_FPU 1
+using Real = float;
+#else
+#define LUMOS_HAS_FPU 0
+using Real = Fixed;
+#endif
@@ -0,0 +1,174 @@
+#include "flash.h"
+#include "memory_sections.h"
+
+#include <cstring>
+
+// .settings in the board linker script; weak, so a board without the
+// section links with an empty region
+extern "C" __attribute__((weak)) uint8_t _ssettings[];
+extern "C" __attribute__((weak)) uint8_t _esettings[];
+
+volatile bool Flash::erasing_ = false;
+volatile bool Flash::failed_ = false;
+uint32_t Flash::erase_address_ = 0;
+
+uint32_t Flash::regionStart()
+{
+    return sectorSize() > 0 ? reinterpret_cast<uint32_t>(_ssettings) : 0;
+}
+
+uint32_t Flash::regionSize()
+{
+    const uint32_t sector = sectorSize();
+    if (sector == 0 || _ssettings == nullptr) {
+        return 0;
+    }
+    return static_cast<uint32_t>(_esettings - _ssettings) / sector * sector;
+}
+
+uint32_t Flash::sectorSize()
+{
+#if defined(STM32H7) || defined(STM32H5)
+    return FLASH_SECTOR_SIZE;
+#elif defined(STM32G0)
+    return FLASH_PAGE_SIZE;
+#else
+    return 0;
+#endif
+}
+
+bool Flash::inRegion(uint32_t address, uint32_t length)
+{
+    const uint32_t start = regionStart();
+    const uint32_t size = regionSize();
+    return size > 0 && address >= start && length <= size && address - start <= size - length;
+}
+
+bool Flash::eraseAsync(uint32_t address)
+{
+    const uint32_t sector = sectorSize();
+    if (erasing_ || !inRegion(address, sector) || (address - regionStart()) % sector != 0) {
+        return false;
+    }
+
+#if defined(STM32H7) || defined(STM32H5) || defined(STM32G0)
+    FLASH_EraseInitTypeDef erase = {};
+#if defined(STM32H7)
+    const uint32_t offset = address - FLASH_BANK1_BASE;
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+#if defined(DUAL_BANK)
+    erase.Banks = offset >= FLASH_BANK_SIZE ? FLASH_BANK_2 : FLASH_BANK_1;
+#else
+    erase.Banks = FLASH_BANK_1;
+#endif
+    erase.Sector = (offset % FLASH_BANK_SIZE) / FLASH_SECTOR_SIZE;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+#elif defined(STM32H5)
+    const uint32_t offset = address - FLASH_BASE;
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Banks = offset >= FLASH_BANK_SIZE ? FLASH_BANK_2 : FLASH_BANK_1;
+    erase.Sector = (offset % FLASH_BANK_SIZE) / FLASH_SECTOR_SIZE;
+    erase.NbSectors = 1;
+#else
+    const uint32_t offset = address - FLASH_BASE;
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+#if defined(FLASH_DBANK_SUPPORT)
+    // Bank 2 pages are numbered from 256
+    if (offset >= FLASH_BANK_SIZE) {
+        erase.Banks = FLASH_BANK_2;
+        erase.Page = 256 + (offset - FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+    } else {
+        erase.Banks = FLASH_BANK_1;
+        erase.Page = offset / FLASH_PAGE_SIZE;
+    }
+#else
+    erase.Banks = FLASH_BANK_1;
+    erase.Page = offset / FLASH_PAGE_SIZE;
+#endif
+    erase.NbPages = 1;
+#endif
+
+    erasing_ = true;
+    failed_ = false;
+    erase_address_ = address;
+    HAL_NVIC_SetPriority(FLASH_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(FLASH_IRQn);
+    HAL_FLASH_Unlock();
+    if (HAL_FLASHEx_Erase_IT(&erase) != HAL_OK) {
+        HAL_FLASH_Lock();
+        erasing_ = false;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Flash::program(uint32_t address, const void* data)
+{
+    if (erasing_ || address % PROGRAM_SIZE != 0 || !inRegion(address, PROGRAM_SIZE)) {
+        return false;
+    }
+
+#if defined(STM32H7) || defined(STM32H5) || defined(STM32G0)
+    HAL_FLASH_Unlock();
+#if defined(STM32H7)
+    const HAL_StatusTypeDef status =
+        HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, address, reinterpret_cast<uint32_t>(data));
+#elif defined(STM32H5)
+    const HAL_StatusTypeDef status =
+        HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, address, reinterpret_cast<uint32_t>(data));
+#else
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    const HAL_StatusTypeDef status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address, word);
+#endif
+    HAL_FLASH_Lock();
+    // Lines read while the word was erased may still be cached
+    invalidateDCache(reinterpret_cast<void*>(address), PROGRAM_SIZE);
+    return status == HAL_OK;
+#else
+    (void)data;
+    return false;
+#endif
+}
+
+void Flash::onEraseDone(bool error)
+{
+    HAL_FLASH_Lock();
+    invalidateDCache(reinterpret_cast<void*>(erase_address_), sectorSize());
+    failed_ = error;
+    erasing_ = false;
+}
+
+// ===== Flash interrupt =====
+
+// Only with the flash module in the build (LUMOS_HAL_<MODULE> from the
+// builder, as for the board files), so wrappers: all does not take the
+// vector and the HAL callbacks from an application that owns them
+#if (defined(STM32H7) || defined(STM32H5) || defined(STM32G0)) && \
+    (!defined(LUMOS_BOARD_MODULES) || defined(LUMOS_HAL_FLASH))
+extern "C" void FLASH_IRQHandler(void)
+{
+    HAL_FLASH_IRQHandler();
+}
+
+// One sector per erase, so the first end of operation is the last
+extern "C" void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+    (void)ReturnValue;
+    if (Flash::busy()) {
+        Flash::onEraseDone(false);
+    }
+}
+
+extern "C" void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+    (void)ReturnValue;
+    if (Flash::busy()) {
+        Flash::onEraseDone(true);
+    }
+}
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Platform-specific HAL headers
+#if defined(STM32H7)
+    #include "stm32h7xx_hal.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx_hal.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx_hal.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx_hal.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx_hal.h"
+#else
+    #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
+#endif
+
+// Internal flash: the board's settings region, erased in the background
+// Usage Example:
+//   const uint32_t sector = Flash::regionStart();
+//   Flash::eraseAsync(sector);                  // Returns at once
+//   while (Flash::busy()) {
+//       control.step();                         // Keeps running
+//   }
+//
+//   alignas(4) uint8_t word[Flash::PROGRAM_SIZE] = {...};
+//   Flash::program(sector, word);               // One flash word
+//
+// The region is defined per board by the linker script (.settings,
+// _ssettings to _esettings) and is normally used through the framework's
+// SettingsStore (framework/settings_store.h). An erase runs from the flash
+// interrupt, so the caller only waits for programming, one flash word at
+// a time (tens of microseconds). Flash can only be programmed after an
+// erase, and each word only once: on the H7 and H5 its ECC is written
+// along with it.
+//
+// Reads of a bank wait while it erases. On the G0B1 and H523 the region
+// is in bank 2 and the firmware in bank 1, so code keeps running; the
+// H723 has a single bank, and any fetch from flash (code, constants, the
+// vector table) stalls until its erase ends. Code in ITCM and data in RAM
+// are not affected.
+//
+// Supported on the H7, G0 and H5; other families have no region.
+class Flash
+{
+public:
+#if defined(STM32H7)
+    static constexpr size_t PROGRAM_SIZE = 32;   // 256-bit flash word
+#elif defined(STM32H5)
+    static constexpr size_t PROGRAM_SIZE = 16;   // Quad-word
+#else
+    static constexpr size_t PROGRAM_SIZE = 8;    // Double word
+#endif
+
+    /** @brief First address of the settings region (0 without one) */
+    static uint32_t regionStart();
+
+    /** @brief Size of the settings region in bytes, a multiple of sectorSize() */
+    static uint32_t regionSize();
+
+    /** @brief Erase unit in bytes (sector or page; 0 if not supported) */
+    static uint32_t sectorSize();
+
+    /**
+     * @brief Start erasing the sector at @p address
+     * @return false if an erase is running, @p address is not the start
+     *         of a sector in the region, or the flash refused it
+     */
+    static bool eraseAsync(uint32_t address);
+
+    /** @brief An erase is running */
+    static bool busy() { return erasing_; }
+
+    /** @brief The last erase reported an error (cleared by eraseAsync()) */
+    static bool failed() { return failed_; }
+
+    /**
+     * @brief Program PROGRAM_SIZE bytes from @p data at @p address
+     *
+     * Waits for the one word. The address must be PROGRAM_SIZE aligned,
+     * in the region and erased; @p data 4-byte aligned.
+     * @return false during an erase, for a bad address, or on a flash error
+     */
+    static bool program(uint32_t address, const void* data);
+
+    /** @brief Called from the flash interrupt when an erase ends */
+    static void onEraseDone(bool error);
+
+private:
+    static bool inRegion(uint32_t address, uint32_t length);
+
+    static volatile bool erasing_;
+    static volatile bool failed_;
+    static uint32_t erase_address_;
+};
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "fixed_point.h"
+
+// Formatted output shared by Serial and USB
+//
+// A class gets print(), println() and printf() by deriving from
+// Print<Class> and providing
+//
+//   bool write(const uint8_t* data, uint16_t length, uint32_t timeout);
+//
+// Text is formatted into a small chunk on the stack (no heap, no snprintf)
+// and handed to write() once per call, or once per chunk for long output.
+// With a DMA ring behind write() this is a single copy into the ring, so
+// logging from a tight loop does not block per token:
+//
+//   SerialCom.printf("t=%u ms  temp=%.1f C  state=%s\r\n", HAL_GetTick(), temp, name);
+//   SerialCom.println(adc_value, 16);
+//
+// printf() understands %d %i %u %x %X %o %b %c %s %f and %%, with optional
+// '-' and '0' flags, a width and a precision (%08x, %-6s, %.3f). Arguments
+// are matched by type at compile time rather than through varargs, so a
+// mismatched specifier prints the argument as its own type instead of
+// reading garbage; a specifier without an argument is printed literally.
+// Fixed values (fixed_point.h) print like floats, with integer code only.
+template <typename Derived>
+class Print
+{
+public:
+    bool print(const char* str)
+    {
+        if (str == nullptr) return false;
+        Writer out(derived());
+        out.put(str, strlen(str));
+        return out.finish();
+    }
+
+    bool print(char c)
+    {
+        Writer out(derived());
+        out.put(c);
+        return out.finish();
+    }
+
+    bool print(int value, int base = 10) { return printInteger(value, base, false); }
+    bool print(unsigned int value, int base = 10) { return printInteger(value, base, false); }
+    bool print(long value, int base = 10) { return printInteger(value, base, false); }
+    bool print(unsigned long value, int base = 10) { return printInteger(value, base, false); }
+    bool print(float value, int decimals = 2) { return printFloat(value, decimals, false); }
+    bool print(double value, int decimals = 2) { return printFloat(static_cast<float>(value), decimals, false); }
+    bool print(Fixed value, int decimals = 2) { return printFixed(value, decimals, false); }
+
+    bool println(const char* str)
+    {
+        if (str == nullptr) return false;
+        Writer out(derived());
+        out.put(str, strlen(str));
+        out.put("\r\n", 2);
+        return out.finish();
+    }
+
+    bool println(int value, int base = 10) { return printInteger(value, base, true); }
+    bool println(unsigned int value, int base = 10) { return printInteger(value, base, true); }
+    bool println(long value, int base = 10) { return printInteger(value, base, true); }
+    bool println(unsigned long value, int base = 10) { return printInteger(value, base, true); }
+    bool println(float value, int decimals = 2) { return printFloat(value, decimals, true); }
+    bool println(double value, int decimals = 2) { return printFloat(static_cast<float>(value), decimals, true); }
+    bool println(Fixed value, int decimals = 2) { return printFixed(value, decimals, true); }
+    bool println() { return print("\r\n"); }  // Just newline
+
+    template <typename... Args>
+    bool printf(const char* format, const Args&... args)
+    {
+        if (format == nullptr) return false;
+        Writer out(derived());
+        formatNext(out, format, args...);
+        return out.finish();
+    }
+
+protected:
+    static constexpr uint16_t CHUNK_SIZE = 64;
+    static constexpr uint32_t WRITE_TIMEOUT = 1000;
+
+    // Collects output and passes it to Derived::write() in chunks
+    class Writer
+    {
+    public:
+        explicit Writer(Derived& target) : target_(target), length_(0), ok_(true) {}
+
+        void put(char c)
+        {
+            if (length_ == CHUNK_SIZE) flush();
+            buffer_[length_++] = static_cast<uint8_t>(c);
+        }
+
+        void put(const char* data, size_t length)
+        {
+            if (length_ + length <= CHUNK_SIZE) {
+                memcpy(buffer_ + length_, data, length);
+                length_ += length;
+                return;
+            }
+            // Too long to batch: send what is pending, then the data itself
+            flush();
+            while (length > 0) {
+                const uint16_t part = length > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(length);
+                ok_ = target_.write(reinterpret_cast<const uint8_t*>(data), part, WRITE_TIMEOUT) && ok_;
+                data += part;
+                length -= part;
+            }
+        }
+
+        void fill(char c, int count)
+        {
+            for (int i = 0; i < count; ++i) put(c);
+        }
+
+        bool finish()
+        {
+            flush();
+            return ok_;
+        }
+
+    private:
+        Derived& target_;
+        uint8_t buffer_[CHUNK_SIZE];
+        uint16_t length_;
+        bool ok_;
+
+        void flush()
+        {
+            if (length_ == 0) return;
+            ok_ = target_.write(buffer_, length_, WRITE_TIMEOUT) && ok_;
+            length_ = 0;
+        }
+    };
+
+    // Parsed %-specifier
+    struct Spec
+    {
+        char conversion = 'd';
+        bool left = false;
+        bool zero = false;
+        int width = 0;
+        int precision = -1;
+        const char* text = nullptr;  // The specifier as written
+    };
+
+private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    template <typename T>
+    bool printInteger(T value, int base, bool newline)
+    {
+        Writer out(derived());
+        Spec spec;
+        spec.conversion = base == 16 ? 'x' : base == 8 ? 'o' : base == 2 ? 'b' : 'd';
+        formatArgument(out, spec, value);
+        if (newline) out.put("\r\n", 2);
+        return out.finish();
+    }
+
+    bool printFloat(float value, int decimals, bool newline)
+    {
+        Writer out(derived());
+        Spec spec;
+        spec.conversion = 'f';
+        spec.precision = decimals;
+        formatFloat(out, spec, value);
+        if (newline) out.put("\r\n", 2);
+        return out.finish();
+    }
+
+    bool printFixed(Fixed value, int decimals, bool newline)
+    {
+        Writer out(derived());
+        Spec spec;
+        spec.conversion = 'f';
+        spec.precision = decimals;
+        formatFixed(out, spec, value);
+        if (newline) out.put("\r\n", 2);
+        return out.finish();
+    }
+
+    // Text and padding, honouring width and the '-' flag
+    static void emitPadded(Writer& out, const Spec& spec, const char* prefix,
+                           const char* digits, int length)
+    {
+        const int prefix_length = static_cast<int>(strlen(prefix));
+        const int padding = spec.width > prefix_length + length ? spec.width - prefix_length - length : 0;
+        if (spec.left) {
+            out.put(prefix, prefix_length);
+            out.put(digits, length);
+            out.fill(' ', padding);
+        } else if (spec.zero) {
+            out.put(prefix, prefix_length);
+            out.fill('0', padding);
+            out.put(digits, length);
+        } else {
+            out.fill(' ', padding);
+            out.put(prefix, prefix_length);
+            out.put(digits, length);
+        }
+    }
+
+    static void formatUnsigned(Writer& out, const Spec& spec, const char* sign, uint64_t value)
+    {
+        const uint32_t base = spec.conversion == 'x' || spec.conversion == 'X' ? 16
+                            : spec.conversion == 'o' ? 8
+                            : spec.conversion == 'b' ? 2 : 10;
+        const char* symbols = spec.conversion == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+
+        char digits[64];
+        int position = sizeof(digits);
+        uint32_t low = static_cast<uint32_t>(value);
+        if (value > 0xFFFFFFFFu) {
+            // 64-bit division is a library call on Cortex-M; only use it for the high digits
+            while (value > 0xFFFFFFFFu) {
+                digits[--position] = symbols[value % base];
+                value /= base;
+            }
+            low = static_cast<uint32_t>(value);
+        }
+        do {
+            digits[--position] = symbols[low % base];
+            low /= base;
+        } while (low != 0);
+        emitPadded(out, spec, sign, digits + position, static_cast<int>(sizeof(digits)) - position);
+    }
+
+    // 0..6 decimals; anything else means the %f default of 6
+    static int fractionDigits(const Spec& spec)
+    {
+        return spec.precision >= 0 && spec.precision <= 6 ? spec.precision : 6;
+    }
+
+    static void formatFloat(Writer& out, const Spec& spec, float value)
+    {
+        const int decimals = fractionDigits(spec);
+
+        if (value != value) {
+            emitPadded(out, spec, "", "nan", 3);
+            return;
+        }
+        const char* sign = "";
+        if (value < 0.0f) {
+            sign = "-";
+            value = -value;
+        }
+        if (value > 1.8e19f) {
+            emitPadded(out, spec, sign, "inf", 3);
+            return;
+        }
+
+        uint32_t scale = 1;
+        for (int i = 0; i < decimals; ++i) scale *= 10;
+
+        uint64_t integer = static_cast<uint64_t>(value);
+        uint32_t fraction = static_cast<uint32_t>((value - static_cast<float>(integer)) * scale + 0.5f);
+        if (fraction >= scale) {
+            integer += 1;
+            fraction -= scale;
+        }
+        emitDecimal(out, spec, sign, integer, fraction, scale);
+    }
+
+    static void formatFixed(Writer& out, const Spec& spec, Fixed value)
+    {
+        const int decimals = fractionDigits(spec);
+        const int32_t raw = value.raw();
+        const char* sign = raw < 0 ? "-" : "";
+        const uint32_t magnitude = raw < 0 ? 0u - static_cast<uint32_t>(raw) : static_cast<uint32_t>(raw);
+
+        uint32_t scale = 1;
+        for (int i = 0; i < decimals; ++i) scale *= 10;
+
+        uint32_t integer = magnitude >> Fixed::FRACTION_BITS;
+        const uint32_t bits = magnitude & (Fixed::ONE - 1);
+        const uint32_t half = Fixed::ONE / 2;
+        // Up to 4 decimals the product fits 32 bits, so no library multiply on the M0+
+        uint32_t fraction = decimals <= 4 ? (bits * scale + half) >> Fixed::FRACTION_BITS
+                          : static_cast<uint32_t>((static_cast<uint64_t>(bits) * scale + half) >> Fixed::FRACTION_BITS);
+        if (fraction >= scale) {
+            integer += 1;
+            fraction -= scale;
+        }
+        emitDecimal(out, spec, sign, integer, fraction, scale);
+    }
+
+    // @p integer, then @p fraction as the decimals of @p scale (10^decimals)
+    static void emitDecimal(Writer& out, const Spec& spec, const char* sign, uint64_t integer,
+                            uint32_t fraction, uint32_t scale)
+    {
+        char digits[32];
+        int length = 0;
+        char reversed[20];
+        int count = 0;
+        while (integer > 0xFFFFFFFFu) {
+            reversed[count++] = static_cast<char>('0' + integer % 10);
+            integer /= 10;
+        }
+        uint32_t low = static_cast<uint32_t>(integer);
+        do {
+            reversed[count++] = static_cast<char>('0' + low % 10);
+            low /= 10;
+        } while (low != 0);
+        while (count > 0) digits[length++] = reversed[--count];
+        if (scale > 1) {
+            digits[length++] = '.';
+            for (uint32_t place = scale / 10; place > 0; place /= 10) {
+                digits[length++] = static_cast<char>('0' + (fraction / place) % 10);
+            }
+        }
+        emitPadded(out, spec, sign, digits, length);
+    }
+
+    // One argument, formatted according to its type
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type
+    formatArgument(Writer& out, const Spec& spec, T value)
+    {
+        if (spec.conversion == 'c') {
+            const char c = static_cast<char>(value);
+            emitPadded(out, spec, "", &c, 1);
+        } else if (spec.conversion == 'f') {
+            formatFloat(out, spec, static_cast<float>(value));
+        } else if (std::is_signed<T>::value && (spec.conversion == 'd' || spec.conversion == 'i')) {
+            const int64_t number = static_cast<int64_t>(value);
+            formatUnsigned(out, spec, number < 0 ? "-" : "",
+                           number < 0 ? 0 - static_cast<uint64_t>(number) : static_cast<uint64_t>(number));
+        } else {
+            // Negative values in hex/octal/binary show their two's complement
+            formatUnsigned(out, spec, "", static_cast<typename std::make_unsigned<T>::type>(value));
+        }
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    formatArgument(Writer& out, const Spec& spec, T value)
+    {
+        formatFloat(out, spec, static_cast<float>(value));
+    }
+
+    static void formatArgument(Writer& out, const Spec& spec, Fixed value)
+    {
+        formatFixed(out, spec, value);
+    }
+
+    static void formatArgument(Writer& out, const Spec& spec, bool value)
+    {
+        emitPadded(out, spec, "", value ? "true" : "false", value ? 4 : 5);
+    }
+
+    static void formatArgument(Writer& out, const Spec& spec, const char* value)
+    {
+        if (value == nullptr) value = "(null)";
+        int length = static_cast<int>(strlen(value));
+        if (spec.precision >= 0 && spec.precision < length) length = spec.precision;
+        emitPadded(out, spec, "", value, length);
+    }
+
+    static void formatArgument(Writer& out, const Spec& spec, char* value)
+    {
+        formatArgument(out, spec, static_cast<const char*>(value));
+    }
+
+    static void formatArgument(Writer& out, const Spec& spec, const void* value)
+    {
+        Spec hex = spec;
+        hex.conversion = 'x';
+        formatUnsigned(out, hex, "0x", reinterpret_cast<uintptr_t>(value));
+    }
+
+    // Copy literal text up to the next specifier and parse it
+    // @return false at the end of the format string
+    static bool nextSpec(Writer& out, const char*& format, Spec& spec)
+    {
+        while (*format != '\0') {
+            const char* start = format;
+            while (*format != '\0' && *format != '%') ++format;
+            out.put(start, static_cast<size_t>(format - start));
+            if (*format == '\0') return false;
+
+            const char* percent = format++;
+            if (*format == '%') {
+                out.put('%');
+                ++format;
+                continue;
+            }
+
+            spec = Spec();
+            spec.text = percent;
+            for (;; ++format) {
+                if (*format == '-') spec.left = true;
+                else if (*format == '0') spec.zero = true;
+                else break;
+            }
+            while (*format >= '0' && *format <= '9') spec.width = spec.width * 10 + (*format++ - '0');
+            if (*format == '.') {
+                spec.precision = 0;
+                ++format;
+                while (*format >= '0' && *format <= '9') spec.precision = spec.precision * 10 + (*format++ - '0');
+            }
+            while (*format == 'l' || *format == 'h' || *format == 'z') ++format;  // Lengths come from the type
+
+            const char conversion = *format;
+            if (conversion != '\0' && strchr("diuxXobcsfp", conversion) != nullptr) {
+                spec.conversion = conversion;
+                ++format;
+                return true;
+            }
+            // Unknown specifier: print it as it was written
+            out.put(percent, static_cast<size_t>(format - percent));
+        }
+        return false;
+    }
+
+    static void formatNext(Writer& out, const char* format)
+    {
+        // No arguments left: the rest is literal text
+        Spec spec;
+        while (nextSpec(out, format, spec)) {
+            out.put(spec.text, static_cast<size_t>(format - spec.text));
+        }
+    }
+
+    template <typename T, typename... Rest>
+    static void formatNext(Writer& out, const char* format, const T& value, const Rest&... rest)
+    {
+        Spec spec;
+        if (!nextSpec(out, format, spec)) return;  // Extra arguments are ignored
+        formatArgument(out, spec, decay(value));
+        formatNext(out, format, rest...);
+    }
+
+    // String literals and arrays reach formatArgument as pointers
+    template <typename T>
+    static const T& decay(const T& value) { return value; }
+    template <typename T, size_t N>
+    static const T* decay(const T (&value)[N]) { return value; }
+};
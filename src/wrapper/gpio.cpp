@@ -1,21 +1,8 @@
 #include "gpio.h"
-
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
-#endif
-}
+#include "peripherals.h"
+#include "sys.h"
+#include "trace.h"
+#include "event_loop.h"
 
 // GPIO Class Implementation
 
@@ -28,6 +15,11 @@ GPIO::GPIO(GPIO_TypeDef* port, uint16_t pin)
     enableGPIOClock(port_);
 }
 
+GPIO::~GPIO()
+{
+    detachInterrupt();
+}
+
 void GPIO::mode(uint32_t mode, uint32_t pull, uint32_t speed)
 {
     GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -57,59 +49,311 @@ void GPIO::setAlternateFunction(uint32_t alternate)
     initialized_ = true;
 }
 
-void GPIO::write(bool value)
+// Helper Functions Implementation
+
+void pinMode(GPIO_TypeDef* port, uint16_t pin, uint32_t mode, uint32_t pull)
 {
-    HAL_GPIO_WritePin(port_, pin_, value ? GPIO_PIN_SET : GPIO_PIN_RESET);
+    initGPIOPins(port, pin, mode, pull, GPIO_SPEED_FREQ_LOW);
 }
 
-bool GPIO::read() const
+void initGPIOPins(GPIO_TypeDef* port, uint16_t pins, uint32_t mode, uint32_t pull, uint32_t speed)
 {
-    return HAL_GPIO_ReadPin(port_, pin_) == GPIO_PIN_SET;
+    enableGPIOClock(port);
+
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    GPIO_InitStruct.Pin = pins;
+    GPIO_InitStruct.Mode = mode;
+    GPIO_InitStruct.Pull = pull;
+    GPIO_InitStruct.Speed = speed;
+
+    HAL_GPIO_Init(port, &GPIO_InitStruct);
 }
 
-void GPIO::toggle()
+// ===== EXTI interrupts =====
+
+struct ExtiLine
+{
+    GPIO* gpio;
+    GPIO::Handler handler;
+    void* context;
+    GPIO::Edge edge;
+    uint32_t debounce_us;
+    uint32_t settle_at;    // Debounce deadline, while the line is pending
+    uint32_t edge_at;      // Time of the edge that started the deadline
+    bool level;            // Last reported level (debounced lines)
+};
+
+struct ExtiRecord
+{
+    uint32_t time_us;
+    uint8_t line;
+    bool level;
+};
+
+// Single producer (the EXTI interrupts, which share one priority and so
+// never preempt each other), single consumer (dispatchInterrupts())
+static const uint32_t EXTI_QUEUE_SIZE = 32;   // Power of two
+static const uint32_t EXTI_NVIC_PRIORITY = 5;
+
+static ExtiLine exti_lines[16];
+static volatile uint16_t exti_attached = 0;
+static uint16_t exti_settling = 0;         // Debounced lines waiting out their time
+static ExtiRecord exti_queue[EXTI_QUEUE_SIZE];
+static volatile uint32_t exti_head = 0;   // Advanced by the interrupts only
+static volatile uint32_t exti_tail = 0;   // Advanced by dispatchInterrupts() only
+static volatile uint32_t exti_dropped = 0;
+
+static uint8_t pinToLine(uint16_t pin)
 {
-    HAL_GPIO_TogglePin(port_, pin_);
+    return (uint8_t)__builtin_ctz(pin);
 }
 
-void GPIO::high()
+static IRQn_Type extiIRQn(uint8_t line)
 {
-    write(true);
+#if defined(STM32G0)
+    if (line < 2) return EXTI0_1_IRQn;
+    if (line < 4) return EXTI2_3_IRQn;
+    return EXTI4_15_IRQn;
+#elif defined(STM32H5)
+    return (IRQn_Type)(EXTI0_IRQn + line);   // One vector per line
+#else
+    if (line < 5) return (IRQn_Type)(EXTI0_IRQn + line);
+    if (line < 10) return EXTI9_5_IRQn;
+    return EXTI15_10_IRQn;
+#endif
 }
 
-void GPIO::low()
+bool GPIO::attachInterrupt(Edge edge, Handler handler, void* context, uint32_t debounce_us, uint32_t pull)
 {
-    write(false);
+    if (handler == nullptr || pin_ == 0 || (pin_ & (pin_ - 1)) != 0) {
+        return false;
+    }
+
+    const uint8_t line = pinToLine(pin_);
+    ExtiLine& slot = exti_lines[line];
+    if (slot.gpio != nullptr && slot.gpio != this) {
+        return false;
+    }
+
+    // Debounced lines watch both edges, so the release after a press is
+    // seen and the level they report stays in step with the pin
+    uint32_t it_mode = GPIO_MODE_IT_RISING_FALLING;
+    if (debounce_us == 0 && edge == Edge::RISING) {
+        it_mode = GPIO_MODE_IT_RISING;
+    } else if (debounce_us == 0 && edge == Edge::FALLING) {
+        it_mode = GPIO_MODE_IT_FALLING;
+    }
+
+    const IRQn_Type irq = extiIRQn(line);
+    HAL_NVIC_DisableIRQ(irq);
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    slot.gpio = this;
+    slot.handler = handler;
+    slot.context = context;
+    slot.edge = edge;
+    slot.debounce_us = debounce_us;
+    exti_settling &= ~pin_;
+    exti_attached |= pin_;
+    __set_PRIMASK(primask);
+
+    mode(it_mode, pull);
+    slot.level = read();
+
+    HAL_NVIC_SetPriority(irq, EXTI_NVIC_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(irq);
+    return true;
 }
 
-// Helper Functions Implementation
+void GPIO::detachInterrupt()
+{
+    if (pin_ == 0 || (pin_ & (pin_ - 1)) != 0) {
+        return;
+    }
 
-void pinMode(GPIO_TypeDef* port, uint16_t pin, uint32_t mode, uint32_t pull)
+    const uint8_t line = pinToLine(pin_);
+    ExtiLine& slot = exti_lines[line];
+    if (slot.gpio != this) {
+        return;
+    }
+
+    // Back to a plain input first, so no new edges latch (HAL_GPIO_Init()
+    // alone leaves the EXTI line unmasked)
+    HAL_GPIO_DeInit(port_, pin_);
+    mode(GPIO_MODE_INPUT, GPIO_NOPULL);
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    slot.gpio = nullptr;
+    slot.handler = nullptr;
+    exti_attached &= ~pin_;
+    exti_settling &= ~pin_;
+    __set_PRIMASK(primask);
+
+    // Shared vectors stay on while another line on them is attached
+    const IRQn_Type irq = extiIRQn(line);
+    bool shared = false;
+    for (uint8_t other = 0; other < 16; other++) {
+        if ((exti_attached & (1u << other)) != 0 && extiIRQn(other) == irq) {
+            shared = true;
+        }
+    }
+    if (!shared) {
+        HAL_NVIC_DisableIRQ(irq);
+    }
+}
+
+void GPIO::dispatchInterrupts()
 {
-    // Enable GPIO port clock
-    enableGPIOClock(port);
+    uint32_t tail = exti_tail;
+    while (tail != exti_head) {
+        const ExtiRecord record = exti_queue[tail & (EXTI_QUEUE_SIZE - 1)];
+        tail++;
+        exti_tail = tail;   // Slot free before the handler runs
 
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
+        ExtiLine& slot = exti_lines[record.line];
+        if (slot.handler == nullptr) {
+            continue;   // Detached since the edge
+        }
 
-    GPIO_InitStruct.Pin = pin;
-    GPIO_InitStruct.Mode = mode;
-    GPIO_InitStruct.Pull = pull;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+        if (slot.debounce_us == 0) {
+            const Event event = {(uint16_t)(1u << record.line), record.level, record.time_us};
+            slot.handler(slot.context, event);
+        } else {
+            // Every edge, bounces included, restarts the settle time
+            slot.settle_at = record.time_us + slot.debounce_us;
+            slot.edge_at = record.time_us;
+            exti_settling |= (uint16_t)(1u << record.line);
+        }
+    }
 
-    HAL_GPIO_Init(port, &GPIO_InitStruct);
+    if (exti_settling == 0) {
+        return;
+    }
+
+    const uint32_t now = (uint32_t)GetCurrentTimeUs();
+    for (uint8_t line = 0; line < 16; line++) {
+        const uint16_t pin = (uint16_t)(1u << line);
+        ExtiLine& slot = exti_lines[line];
+        if ((exti_settling & pin) == 0 || (int32_t)(now - slot.settle_at) < 0) {
+            continue;
+        }
+        exti_settling &= ~pin;
+
+        const bool level = slot.gpio->read();
+        if (level == slot.level) {
+            continue;   // Bounced back to where it was
+        }
+        slot.level = level;
+
+        if ((slot.edge == Edge::RISING && !level) || (slot.edge == Edge::FALLING && level)) {
+            continue;
+        }
+        const Event event = {pin, level, slot.edge_at};
+        slot.handler(slot.context, event);
+    }
 }
 
-void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value)
+uint32_t GPIO::getDroppedInterrupts()
 {
-    HAL_GPIO_WritePin(port, pin, value ? GPIO_PIN_SET : GPIO_PIN_RESET);
+    return exti_dropped;
 }
 
-bool digitalRead(GPIO_TypeDef* port, uint16_t pin)
+// Interrupt side: record and return
+static void recordEdge(uint16_t pin, bool level)
 {
-    return HAL_GPIO_ReadPin(port, pin) == GPIO_PIN_SET;
+    const uint8_t line = pinToLine(pin);
+    if (exti_lines[line].gpio == nullptr) {
+        return;
+    }
+
+    const uint32_t head = exti_head;
+    if (head - exti_tail >= EXTI_QUEUE_SIZE) {
+        exti_dropped = exti_dropped + 1;
+        return;
+    }
+
+    ExtiRecord& record = exti_queue[head & (EXTI_QUEUE_SIZE - 1)];
+    record.time_us = (uint32_t)GetCurrentTimeUs();
+    record.line = line;
+    record.level = level;
+    __DMB();   // Record complete before the consumer can see it
+    exti_head = head + 1;
+    LUMOS_POST_EVENT(EVENT_EXTI);
+}
+
+// Lines first to last of one vector; HAL checks and clears each pending
+// flag, also a stray one left by a line detached meanwhile
+static void handleExtiLines(uint8_t first, uint8_t last)
+{
+    LUMOS_TRACE_ISR("exti");
+    for (uint8_t line = first; line <= last; line++) {
+        HAL_GPIO_EXTI_IRQHandler((uint16_t)(1u << line));
+    }
+}
+
+// ===== HAL Callbacks (called from HAL_GPIO_EXTI_IRQHandler) =====
+// Weak, as the vectors below: an application that defines its own keeps
+// them, and attachInterrupt() only works on the lines it leaves alone.
+// startup.o links after the wrappers, so these win over its defaults.
+
+extern "C" {
+
+#if defined(STM32G0) || defined(STM32H5)
+// Separate rising and falling pending flags, so the edge gives the level
+__weak void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin)
+{
+    recordEdge(GPIO_Pin, true);
 }
 
-void togglePin(GPIO_TypeDef* port, uint16_t pin)
+__weak void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin)
+{
+    recordEdge(GPIO_Pin, false);
+}
+#else
+__weak void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
-    HAL_GPIO_TogglePin(port, pin);
+    const uint8_t line = pinToLine(GPIO_Pin);
+    GPIO* gpio = exti_lines[line].gpio;
+    if (gpio != nullptr) {
+        recordEdge(GPIO_Pin, gpio->read());
+    }
 }
+#endif
+
+// ===== EXTI interrupt vectors =====
+
+#if defined(STM32G0)
+__weak void EXTI0_1_IRQHandler(void) { handleExtiLines(0, 1); }
+__weak void EXTI2_3_IRQHandler(void) { handleExtiLines(2, 3); }
+__weak void EXTI4_15_IRQHandler(void) { handleExtiLines(4, 15); }
+#elif defined(STM32H5)
+__weak void EXTI0_IRQHandler(void) { handleExtiLines(0, 0); }
+__weak void EXTI1_IRQHandler(void) { handleExtiLines(1, 1); }
+__weak void EXTI2_IRQHandler(void) { handleExtiLines(2, 2); }
+__weak void EXTI3_IRQHandler(void) { handleExtiLines(3, 3); }
+__weak void EXTI4_IRQHandler(void) { handleExtiLines(4, 4); }
+__weak void EXTI5_IRQHandler(void) { handleExtiLines(5, 5); }
+__weak void EXTI6_IRQHandler(void) { handleExtiLines(6, 6); }
+__weak void EXTI7_IRQHandler(void) { handleExtiLines(7, 7); }
+__weak void EXTI8_IRQHandler(void) { handleExtiLines(8, 8); }
+__weak void EXTI9_IRQHandler(void) { handleExtiLines(9, 9); }
+__weak void EXTI10_IRQHandler(void) { handleExtiLines(10, 10); }
+__weak void EXTI11_IRQHandler(void) { handleExtiLines(11, 11); }
+__weak void EXTI12_IRQHandler(void) { handleExtiLines(12, 12); }
+__weak void EXTI13_IRQHandler(void) { handleExtiLines(13, 13); }
+__weak void EXTI14_IRQHandler(void) { handleExtiLines(14, 14); }
+__weak void EXTI15_IRQHandler(void) { handleExtiLines(15, 15); }
+#else
+__weak void EXTI0_IRQHandler(void) { handleExtiLines(0, 0); }
+__weak void EXTI1_IRQHandler(void) { handleExtiLines(1, 1); }
+__weak void EXTI2_IRQHandler(void) { handleExtiLines(2, 2); }
+__weak void EXTI3_IRQHandler(void) { handleExtiLines(3, 3); }
+__weak void EXTI4_IRQHandler(void) { handleExtiLines(4, 4); }
+__weak void EXTI9_5_IRQHandler(void) { handleExtiLines(5, 9); }
+__weak void EXTI15_10_IRQHandler(void) { handleExtiLines(10, 15); }
+#endif
+
+}  // extern "C"
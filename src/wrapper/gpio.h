@@ -27,6 +27,41 @@
 //   GPIO button(GPIOB, GPIO_PIN_0);
 //   button.mode(GPIO_MODE_INPUT, GPIO_PULLUP);
 //   bool pressed = button.read();
+//
+// Edge interrupts: the EXTI interrupt only queues the pin, its level and a
+// microsecond timestamp; handlers run later from dispatchInterrupts(), in
+// the main loop (or a SoftTimer handler), where they may take their time:
+//
+//   void onButton(void* context, const GPIO::Event& event) { ... }
+//
+//   InitMicrosecondTiming();   // Timestamps and debounce use GetCurrentTimeUs()
+//   button.attachInterrupt(GPIO::Edge::FALLING, onButton, nullptr, 5000, GPIO_PULLUP);
+//
+//   void loop() {
+//       GPIO::dispatchInterrupts();
+//   }
+//
+// With a debounce time, an edge is reported once the pin has held its new
+// level that long, so bounces within it are one event (or none when the
+// pin returns to where it was). EXTI line n is shared by pin n of every
+// port, so only one GPIO per pin number can attach.
+//
+// write(), read() and toggle() are inline single register accesses (BSRR
+// for writes, so no read-modify-write races with interrupts). When the
+// pin is known at compile time, FastPin drops the port and pin loads too:
+//
+//   using Strobe = FastPin<GPIOB_BASE, GPIO_PIN_3>;
+//   Strobe::init(GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_VERY_HIGH);
+//   Strobe::high();  // One store to GPIOB->BSRR
+//   Strobe::low();
+//
+// Parallel buses: FastBus writes a run of adjacent pins in one BSRR store,
+// FastPort any set of pins on a port:
+//
+//   using Data = FastBus<GPIOD_BASE, 0, 8>;  // PD0-PD7
+//   Data::init(GPIO_MODE_OUTPUT_PP);
+//   Data::write(0xA5);
+//   FastPort<GPIOE_BASE>::write(GPIO_PIN_0 | GPIO_PIN_4, GPIO_PIN_4);  // PE0 low, PE4 high
 class GPIO
 {
 private:
@@ -35,25 +70,147 @@ private:
     bool initialized_;
 
 public:
+    enum class Edge {
+        RISING,
+        FALLING,
+        BOTH
+    };
+
+    struct Event
+    {
+        uint16_t pin;       // GPIO_PIN_x
+        bool level;         // Pin level after the edge
+        uint32_t time_us;   // Low 32 bits of GetCurrentTimeUs() at the edge
+    };
+
+    using Handler = void (*)(void* context, const Event& event);
+
     GPIO() = delete;
     GPIO(GPIO_TypeDef* port, uint16_t pin);
+    ~GPIO();
 
     // Configuration
     void mode(uint32_t mode, uint32_t pull = GPIO_NOPULL, uint32_t speed = GPIO_SPEED_FREQ_LOW);
     void setAlternateFunction(uint32_t alternate);
 
     // Digital I/O
-    void write(bool value);
-    bool read() const;
-    void toggle();
-    void high();
-    void low();
+    void write(bool value) { port_->BSRR = (uint32_t)pin_ << (value ? 0 : 16); }
+    bool read() const { return (port_->IDR & pin_) != 0; }
+    void toggle()
+    {
+        // Set the pins that are low and reset the ones that are high, in one store
+        const uint32_t odr = port_->ODR;
+        port_->BSRR = ((odr & pin_) << 16) | (~odr & pin_);
+    }
+    void high() { port_->BSRR = pin_; }
+    void low() { port_->BSRR = (uint32_t)pin_ << 16; }
+
+    /**
+     * @brief Configure the pin as an EXTI input and enable its interrupt
+     * @param edge Edges to report
+     * @param handler Called from dispatchInterrupts(), never from the interrupt
+     * @param debounce_us Time the level must hold before the edge counts (0 = off)
+     * @return false if another GPIO holds this pin number's EXTI line
+     */
+    bool attachInterrupt(Edge edge, Handler handler, void* context = nullptr,
+                         uint32_t debounce_us = 0, uint32_t pull = GPIO_NOPULL);
+    void detachInterrupt();
+
+    /**
+     * @brief Run the handlers for the edges queued since the last call
+     *
+     * Call often from the main loop; debounced edges are only reported
+     * here, so the call rate sets how late they can come.
+     */
+    static void dispatchInterrupts();
+
+    // Edges lost because the queue was full between dispatches
+    static uint32_t getDroppedInterrupts();
 
     // Utilities
     GPIO_TypeDef* getPort() const { return port_; }
     uint16_t getPin() const { return pin_; }
 };
 
+// Compile-time pin: PortBase is the port's base address (GPIOA_BASE, ...)
+// and Pin a single GPIO_PIN_x mask
+template <uintptr_t PortBase, uint16_t Pin>
+class FastPin
+{
+    static_assert(Pin != 0 && (Pin & (Pin - 1)) == 0, "FastPin takes a single GPIO_PIN_x");
+
+public:
+    FastPin() = delete;
+
+    static GPIO_TypeDef* port() { return reinterpret_cast<GPIO_TypeDef*>(PortBase); }
+
+    // Enables the port clock and configures the pin (not timing critical)
+    static void init(uint32_t mode, uint32_t pull = GPIO_NOPULL, uint32_t speed = GPIO_SPEED_FREQ_LOW);
+
+    static void high() { port()->BSRR = Pin; }
+    static void low() { port()->BSRR = (uint32_t)Pin << 16; }
+    static void write(bool value) { port()->BSRR = (uint32_t)Pin << (value ? 0 : 16); }
+    static bool read() { return (port()->IDR & Pin) != 0; }
+    static void toggle()
+    {
+        const uint32_t odr = port()->ODR;
+        port()->BSRR = ((odr & Pin) << 16) | (~odr & Pin);
+    }
+};
+
+// Any set of pins on one port, each access a single register access
+template <uintptr_t PortBase>
+class FastPort
+{
+public:
+    FastPort() = delete;
+
+    static GPIO_TypeDef* port() { return reinterpret_cast<GPIO_TypeDef*>(PortBase); }
+
+    // Pins in mask take their level from value; the others are untouched
+    static void write(uint16_t mask, uint16_t value)
+    {
+        port()->BSRR = ((uint32_t)(mask & ~value) << 16) | (mask & value);
+    }
+    static void set(uint16_t mask) { port()->BSRR = mask; }
+    static void clear(uint16_t mask) { port()->BSRR = (uint32_t)mask << 16; }
+    static uint16_t read() { return (uint16_t)port()->IDR; }
+};
+
+// Width adjacent pins starting at pin number First, written as one value
+template <uintptr_t PortBase, uint8_t First, uint8_t Width>
+class FastBus
+{
+    static_assert(Width > 0 && First + Width <= 16, "FastBus pins must lie within one port");
+
+public:
+    static constexpr uint16_t MASK = (uint16_t)(((1u << Width) - 1) << First);
+
+    FastBus() = delete;
+
+    static GPIO_TypeDef* port() { return reinterpret_cast<GPIO_TypeDef*>(PortBase); }
+
+    static void init(uint32_t mode, uint32_t pull = GPIO_NOPULL, uint32_t speed = GPIO_SPEED_FREQ_VERY_HIGH);
+
+    static void write(uint16_t value) { FastPort<PortBase>::write(MASK, (uint16_t)(value << First)); }
+    static uint16_t read() { return (uint16_t)((port()->IDR & MASK) >> First); }
+};
+
+// Shared by the templates' init(): port clock plus HAL_GPIO_Init()
+void initGPIOPins(GPIO_TypeDef* port, uint16_t pins, uint32_t mode, uint32_t pull, uint32_t speed);
+
+template <uintptr_t PortBase, uint16_t Pin>
+void FastPin<PortBase, Pin>::init(uint32_t mode, uint32_t pull, uint32_t speed)
+{
+    initGPIOPins(port(), Pin, mode, pull, speed);
+}
+
+template <uintptr_t PortBase, uint8_t First, uint8_t Width>
+void FastBus<PortBase, First, Width>::init(uint32_t mode, uint32_t pull, uint32_t speed)
+{
+    initGPIOPins(port(), MASK, mode, pull, speed);
+}
+
 // Helper functions for quick GPIO operations (Arduino-style)
 // These require specifying both port and pin explicitly
 
@@ -72,7 +229,10 @@ void pinMode(GPIO_TypeDef* port, uint16_t pin, uint32_t mode, uint32_t pull = GP
  * @param pin GPIO pin number (GPIO_PIN_0 to GPIO_PIN_15)
  * @param value true for HIGH, false for LOW
  */
-void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value);
+inline void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value)
+{
+    port->BSRR = (uint32_t)pin << (value ? 0 : 16);
+}
 
 /**
  * @brief Read digital value from GPIO pin
@@ -80,11 +240,18 @@ void digitalWrite(GPIO_TypeDef* port, uint16_t pin, bool value);
  * @param pin GPIO pin number (GPIO_PIN_0 to GPIO_PIN_15)
  * @return true for HIGH, false for LOW
  */
-bool digitalRead(GPIO_TypeDef* port, uint16_t pin);
+inline bool digitalRead(GPIO_TypeDef* port, uint16_t pin)
+{
+    return (port->IDR & pin) != 0;
+}
 
 /**
  * @brief Toggle GPIO pin state
  * @param port GPIO port (GPIOA, GPIOB, etc.)
  * @param pin GPIO pin number (GPIO_PIN_0 to GPIO_PIN_15)
  */
-void togglePin(GPIO_TypeDef* port, uint16_t pin);
+inline void togglePin(GPIO_TypeDef* port, uint16_t pin)
+{
+    const uint32_t odr = port->ODR;
+    port->BSRR = ((odr & pin) << 16) | (~odr & pin);
+}
@@ -1,21 +1,9 @@
 #include "i2c.h"
+#include "peripherals.h"
+#include "memory_sections.h"
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
-#endif
-}
+// I2Cs using interrupt transfers (for the HAL callbacks)
+static I2C* it_i2c_instances[4] = {nullptr};
 
 I2C::I2C(I2C_TypeDef* i2c_instance,
          GPIO_TypeDef* scl_port, uint16_t scl_pin,
@@ -26,7 +14,20 @@ I2C::I2C(I2C_TypeDef* i2c_instance,
       scl_pin_(scl_pin),
       sda_port_(sda_port),
       sda_pin_(sda_pin),
-      alternate_function_(alternate_function)
+      alternate_function_(alternate_function),
+      initialized_(false),
+      config_dirty_(false),
+      timing_dirty_(false),
+      fast_mode_plus_(false),
+      queue_{},
+      queue_head_(0),
+      queue_count_(0),
+      it_busy_(false),
+      it_ready_(false),
+      dma_tx_handle_{},
+      dma_rx_handle_{},
+      dma_ready_(false),
+      head_dma_rx_(false)
 {
     // Initialize I2C handle with default values
     i2c_handle_.Instance = i2c_instance;
@@ -44,93 +45,111 @@ I2C::I2C(I2C_TypeDef* i2c_instance,
 
 void I2C::begin(const uint32_t clock_speed)
 {
-    // Enable GPIO port clocks
-    enableGPIOClock(scl_port_);
-    enableGPIOClock(sda_port_);
+    // Configure SCL and SDA pins: open-drain, pull-ups required for I2C
+    const PinRef pins[] = {{scl_port_, scl_pin_}, {sda_port_, sda_pin_}};
+    initAlternatePins(pins, 2, GPIO_MODE_AF_OD, GPIO_PULLUP, GPIO_SPEED_FREQ_HIGH, alternate_function_);
 
-    // Configure GPIO pins for I2C
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;  // Open-drain for I2C
-    GPIO_InitStruct.Pull = GPIO_PULLUP;       // Pull-up required for I2C
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
+    // Enable I2C peripheral clock
+    enablePeripheralClock(i2c_handle_.Instance);
 
-    // Configure SCL pin
-    GPIO_InitStruct.Pin = scl_pin_;
-    HAL_GPIO_Init(scl_port_, &GPIO_InitStruct);
+    // Set timing for requested clock speed
+    setClock(clock_speed);
 
-    // Configure SDA pin
-    GPIO_InitStruct.Pin = sda_pin_;
-    HAL_GPIO_Init(sda_port_, &GPIO_InitStruct);
+    // Initialize I2C peripheral, including settings staged before begin()
+    initialized_ = true;
+    config_dirty_ = true;
+    applyConfig();
+}
 
-    // Enable I2C peripheral clock
-    if (i2c_handle_.Instance == I2C1) {
-        __HAL_RCC_I2C1_CLK_ENABLE();
-    }
-#ifdef I2C2
-    else if (i2c_handle_.Instance == I2C2) {
-        __HAL_RCC_I2C2_CLK_ENABLE();
-    }
-#endif
-#ifdef I2C3
-    else if (i2c_handle_.Instance == I2C3) {
-        __HAL_RCC_I2C3_CLK_ENABLE();
+bool I2C::applyConfig()
+{
+    if (!config_dirty_ && !timing_dirty_) {
+        return true;
     }
-#endif
-#ifdef I2C4
-    else if (i2c_handle_.Instance == I2C4) {
-        __HAL_RCC_I2C4_CLK_ENABLE();
+    if (!initialized_ || it_busy_) {
+        return false;
     }
-#endif
 
-    // Set timing for requested clock speed
-    i2c_handle_.Init.Timing = calculateTiming(clock_speed);
+    if (!config_dirty_) {
+        // Speed switch: TIMINGR can only be written with the peripheral off
+        timing_dirty_ = false;
+        __HAL_I2C_DISABLE(&i2c_handle_);
+        i2c_handle_.Instance->TIMINGR = i2c_handle_.Init.Timing;
+        applyFastModePlus();
+        __HAL_I2C_ENABLE(&i2c_handle_);
+        return true;
+    }
 
-    // Initialize I2C peripheral
+    config_dirty_ = false;
+    timing_dirty_ = false;
     if (HAL_I2C_Init(&i2c_handle_) != HAL_OK)
     {
-        // Error handling
-        return;
+        return false;
     }
 
     // Configure analog filter
     HAL_I2CEx_ConfigAnalogFilter(&i2c_handle_, I2C_ANALOGFILTER_ENABLE);
+    applyFastModePlus();
+    return true;
+}
+
+// 1 MHz needs the 20 mA Fast-mode Plus drive on the I2C pins (SYSCFG)
+void I2C::applyFastModePlus()
+{
+#if defined(I2C_FASTMODEPLUS_I2C1)
+    uint32_t config = 0;
+    if (i2c_handle_.Instance == I2C1) config = I2C_FASTMODEPLUS_I2C1;
+#if defined(I2C_FASTMODEPLUS_I2C2)
+    if (i2c_handle_.Instance == I2C2) config = I2C_FASTMODEPLUS_I2C2;
+#endif
+#if defined(I2C_FASTMODEPLUS_I2C3)
+    if (i2c_handle_.Instance == I2C3) config = I2C_FASTMODEPLUS_I2C3;
+#endif
+#if defined(I2C_FASTMODEPLUS_I2C4)
+    if (i2c_handle_.Instance == I2C4) config = I2C_FASTMODEPLUS_I2C4;
+#endif
+    if (config == 0) {
+        return;
+    }
+    if (fast_mode_plus_) {
+        HAL_I2CEx_EnableFastModePlus(config);
+    } else {
+        HAL_I2CEx_DisableFastModePlus(config);
+    }
+#endif
 }
 
 void I2C::end()
 {
+    if (it_ready_) {
+        abort();
+        for (I2C*& instance : it_i2c_instances) {
+            if (instance == this) instance = nullptr;
+        }
+        it_ready_ = false;
+    }
+    if (dma_ready_) {
+        HAL_DMA_DeInit(&dma_tx_handle_);
+        HAL_DMA_DeInit(&dma_rx_handle_);
+        i2c_handle_.hdmatx = nullptr;
+        i2c_handle_.hdmarx = nullptr;
+        dma_ready_ = false;
+    }
+
     HAL_I2C_DeInit(&i2c_handle_);
+    initialized_ = false;
 
     // Deinitialize GPIO pins
     HAL_GPIO_DeInit(scl_port_, scl_pin_);
     HAL_GPIO_DeInit(sda_port_, sda_pin_);
 }
 
-uint32_t I2C::calculateTiming(uint32_t clock_speed)
+bool I2C::write(uint8_t device_address, const uint8_t* data, uint16_t length, uint32_t timeout)
 {
-    // Timing calculation for STM32H7 at 100 MHz I2C kernel clock
-    // These values are precalculated for common speeds
-    // For precise calculation, use STM32CubeMX I2C timing calculator
-
-    if (clock_speed <= 100000) {
-        // Standard Mode (100 kHz)
-        // Timing: PRESC=15, SCLDEL=4, SDADEL=2, SCLH=0xF3, SCLL=0xF9
-        return 0xF0420F13;  // 100 kHz
-    }
-    else if (clock_speed <= 400000) {
-        // Fast Mode (400 kHz)
-        // Timing: PRESC=3, SCLDEL=3, SDADEL=1, SCLH=0x3C, SCLL=0x49
-        return 0x30B0364D;  // 400 kHz
+    if (!applyConfig()) {
+        return false;
     }
-    else {
-        // Fast Mode Plus (1 MHz)
-        // Timing: PRESC=1, SCLDEL=4, SDADEL=0, SCLH=0x0F, SCLL=0x13
-        return 0x10400413;  // 1 MHz
-    }
-}
 
-bool I2C::write(uint8_t device_address, const uint8_t* data, uint16_t length, uint32_t timeout)
-{
     HAL_StatusTypeDef status = HAL_I2C_Master_Transmit(
         &i2c_handle_,
         device_address << 1,  // Shift address for HAL
@@ -144,6 +163,10 @@ bool I2C::write(uint8_t device_address, const uint8_t* data, uint16_t length, ui
 
 bool I2C::read(uint8_t device_address, uint8_t* data, uint16_t length, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_I2C_Master_Receive(
         &i2c_handle_,
         device_address << 1,  // Shift address for HAL
@@ -157,6 +180,10 @@ bool I2C::read(uint8_t device_address, uint8_t* data, uint16_t length, uint32_t
 
 bool I2C::writeRegister(uint8_t device_address, uint8_t reg_address, uint8_t value, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_I2C_Mem_Write(
         &i2c_handle_,
         device_address << 1,
@@ -172,6 +199,10 @@ bool I2C::writeRegister(uint8_t device_address, uint8_t reg_address, uint8_t val
 
 bool I2C::writeRegister16(uint8_t device_address, uint8_t reg_address, uint16_t value, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     uint8_t data[2];
     data[0] = (value >> 8) & 0xFF;  // MSB
     data[1] = value & 0xFF;          // LSB
@@ -191,6 +222,10 @@ bool I2C::writeRegister16(uint8_t device_address, uint8_t reg_address, uint16_t
 
 bool I2C::readRegister(uint8_t device_address, uint8_t reg_address, uint8_t& value, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_I2C_Mem_Read(
         &i2c_handle_,
         device_address << 1,
@@ -206,6 +241,10 @@ bool I2C::readRegister(uint8_t device_address, uint8_t reg_address, uint8_t& val
 
 bool I2C::readRegister16(uint8_t device_address, uint8_t reg_address, uint16_t& value, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     uint8_t data[2];
 
     HAL_StatusTypeDef status = HAL_I2C_Mem_Read(
@@ -229,6 +268,10 @@ bool I2C::readRegister16(uint8_t device_address, uint8_t reg_address, uint16_t&
 
 bool I2C::readRegisters(uint8_t device_address, uint8_t reg_address, uint8_t* data, uint16_t length, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_I2C_Mem_Read(
         &i2c_handle_,
         device_address << 1,
@@ -244,6 +287,10 @@ bool I2C::readRegisters(uint8_t device_address, uint8_t reg_address, uint8_t* da
 
 bool I2C::probe(uint8_t device_address, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_I2C_IsDeviceReady(
         &i2c_handle_,
         device_address << 1,
@@ -254,21 +301,290 @@ bool I2C::probe(uint8_t device_address, uint32_t timeout)
     return (status == HAL_OK);
 }
 
-void I2C::scan(uint8_t* found_addresses, uint8_t& count, uint8_t max_count)
+void I2C::scan(uint8_t* found_addresses, uint8_t& count, uint8_t max_count, uint32_t timeout)
 {
     count = 0;
+    if (queue_count_ > 0 || !applyConfig()) {
+        return;
+    }
 
     // Scan all 7-bit addresses (0x08 to 0x77)
-    for (uint8_t addr = 0x08; addr < 0x78; addr++)
+    for (uint8_t addr = 0x08; addr < 0x78 && count < max_count; addr++)
     {
-        if (count >= max_count)
-            break;
-
-        if (probe(addr, 10))  // 10ms timeout for scan
-        {
+        HAL_StatusTypeDef status = HAL_I2C_IsDeviceReady(&i2c_handle_, addr << 1, 1, timeout);
+        if (status == HAL_OK) {
             found_addresses[count++] = addr;
+        } else if (status == HAL_BUSY) {
+            break;  // Bus held low, every further address would wait too
+        }
+    }
+}
+
+// ===== Interrupt Transfers =====
+
+bool I2C::beginInterrupt(IRQn_Type event_irq, IRQn_Type error_irq)
+{
+    int slot = -1;
+    for (int i = 0; i < 4; i++) {
+        if (it_i2c_instances[i] == this) { slot = i; break; }
+        if (slot < 0 && it_i2c_instances[i] == nullptr) slot = i;
+    }
+    if (slot < 0) return false;
+    it_i2c_instances[slot] = this;
+
+    queue_head_ = 0;
+    queue_count_ = 0;
+    it_busy_ = false;
+    it_ready_ = true;
+
+    HAL_NVIC_SetPriority(event_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(event_irq);
+    if (error_irq != event_irq) {
+        HAL_NVIC_SetPriority(error_irq, 5, 0);
+        HAL_NVIC_EnableIRQ(error_irq);
+    }
+    return true;
+}
+
+bool I2C::queue(const I2CTransaction& transaction)
+{
+    const bool writes = transaction.tx_length > 0;
+    const bool reads = transaction.rx_length > 0;
+    if (!it_ready_ || writes == reads || transaction.reg_size > 2) {
+        return false;
+    }
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (queue_count_ == QUEUE_SIZE) {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    queue_[(queue_head_ + queue_count_) % QUEUE_SIZE] = transaction;
+    queue_count_ = queue_count_ + 1;
+    if (!it_busy_) {
+        startNext();
+    }
+
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool I2C::readRegistersAsync(uint8_t device_address, uint8_t reg, uint8_t* data, uint16_t length,
+                             std::function<void(bool ok)> callback)
+{
+    I2CTransaction transaction;
+    transaction.address = device_address;
+    transaction.reg = reg;
+    transaction.reg_size = 1;
+    transaction.tx_data = nullptr;
+    transaction.tx_length = 0;
+    transaction.rx_data = data;
+    transaction.rx_length = length;
+    transaction.callback = std::move(callback);
+    return queue(transaction);
+}
+
+// ===== DMA Transfers =====
+
+bool I2C::initDma(DMA_HandleTypeDef& handle, I2CDmaInstance* dma_instance,
+                  uint32_t dma_request, bool receive)
+{
+    handle = {};
+    handle.Instance = dma_instance;
+#if defined(STM32F4)
+    handle.Init.Channel = dma_request;
+#else
+    handle.Init.Request = dma_request;
+#endif
+    handle.Init.Direction = receive ? DMA_PERIPH_TO_MEMORY : DMA_MEMORY_TO_PERIPH;
+#if defined(STM32H5)
+    handle.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    handle.Init.SrcInc = receive ? DMA_SINC_FIXED : DMA_SINC_INCREMENTED;
+    handle.Init.DestInc = receive ? DMA_DINC_INCREMENTED : DMA_DINC_FIXED;
+    handle.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+    handle.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+    handle.Init.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+    handle.Init.SrcBurstLength = 1;
+    handle.Init.DestBurstLength = 1;
+    handle.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    handle.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    handle.Init.Mode = DMA_NORMAL;
+#else
+    handle.Init.PeriphInc = DMA_PINC_DISABLE;
+    handle.Init.MemInc = DMA_MINC_ENABLE;
+    handle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    handle.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    // One byte per SCL byte time, far below what any priority needs
+    handle.Init.Priority = DMA_PRIORITY_LOW;
+    handle.Init.Mode = DMA_NORMAL;
+#endif
+#if defined(STM32H7) || defined(STM32F4)
+    handle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+
+    return HAL_DMA_Init(&handle) == HAL_OK;
+}
+
+bool I2C::beginDma(I2CDmaInstance* tx_instance, uint32_t tx_request, IRQn_Type tx_irq,
+                   I2CDmaInstance* rx_instance, uint32_t rx_request, IRQn_Type rx_irq)
+{
+    if (!it_ready_ || it_busy_) {
+        return false;
+    }
+
+    enableDMAClock(tx_instance);
+    enableDMAClock(rx_instance);
+    if (!initDma(dma_tx_handle_, tx_instance, tx_request, false)) return false;
+    if (!initDma(dma_rx_handle_, rx_instance, rx_request, true)) return false;
+    __HAL_LINKDMA(&i2c_handle_, hdmatx, dma_tx_handle_);
+    __HAL_LINKDMA(&i2c_handle_, hdmarx, dma_rx_handle_);
+    dma_ready_ = true;
+
+    HAL_NVIC_SetPriority(tx_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(tx_irq);
+    HAL_NVIC_SetPriority(rx_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(rx_irq);
+    return true;
+}
+
+// Whether a queued transfer of this buffer can go by DMA
+bool I2C::useDma(const uint8_t* data, uint16_t length, bool receive) const
+{
+    if (!dma_ready_) {
+        return false;
+    }
+#if defined(STM32H7)
+    // DMA1/DMA2 cannot reach the tightly coupled memories
+    const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+    if (address < 0x00010000 || (address >= 0x20000000 && address < 0x20020000)) {
+        return false;
+    }
+    // Invalidating a cache line shared with other data would discard it
+    if (receive && isDCacheable(data) && (address % 32 != 0 || length % 32 != 0)) {
+        return false;
+    }
+#else
+    (void)data;
+    (void)length;
+    (void)receive;
+#endif
+    return true;
+}
+
+bool I2C::waitIdle(uint32_t timeout)
+{
+    const uint32_t start = HAL_GetTick();
+    while (queue_count_ > 0) {
+        if (HAL_GetTick() - start >= timeout) return false;
+    }
+    return true;
+}
+
+void I2C::abort()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (it_busy_) {
+        HAL_I2C_Master_Abort_IT(&i2c_handle_, i2c_handle_.Devaddress);
+    }
+    // Fail the running transfer and everything behind it
+    while (queue_count_ > 0) {
+        it_busy_ = true;  // Keeps queue() in a callback from starting a transfer
+        const uint8_t head = queue_head_;
+        std::function<void(bool ok)> callback = std::move(queue_[head].callback);
+        queue_[head].callback = nullptr;
+        queue_head_ = (head + 1) % QUEUE_SIZE;
+        queue_count_ = queue_count_ - 1;
+        if (callback) callback(false);
+    }
+    it_busy_ = false;
+    __set_PRIMASK(primask);
+}
+
+// Start the transfer at the head of the queue. Runs with interrupts
+// disabled or from the completion interrupt.
+void I2C::startNext()
+{
+    if (queue_count_ == 0) {
+        it_busy_ = false;
+        return;
+    }
+
+    I2CTransaction& transaction = queue_[queue_head_];
+    if (transaction.clock_speed != 0) {
+        setClock(transaction.clock_speed);
+    }
+
+    HAL_StatusTypeDef status = HAL_ERROR;
+    head_dma_rx_ = false;
+    if (applyConfig()) {
+        const uint16_t address = transaction.address << 1;  // Shift address for HAL
+        const uint16_t reg_size = (transaction.reg_size == 2) ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT;
+        uint8_t* tx = const_cast<uint8_t*>(transaction.tx_data);
+        uint8_t* rx = transaction.rx_data;
+
+        if (transaction.tx_length > 0 && useDma(tx, transaction.tx_length, false)) {
+            cleanDCache(tx, transaction.tx_length);
+            if (transaction.reg_size == 0) {
+                status = HAL_I2C_Master_Transmit_DMA(&i2c_handle_, address, tx, transaction.tx_length);
+            } else {
+                status = HAL_I2C_Mem_Write_DMA(&i2c_handle_, address, transaction.reg, reg_size,
+                    tx, transaction.tx_length);
+            }
+        } else if (transaction.rx_length > 0 && useDma(rx, transaction.rx_length, true)) {
+            // No dirty line may be written back over the received data
+            invalidateDCache(rx, transaction.rx_length);
+            head_dma_rx_ = true;
+            if (transaction.reg_size == 0) {
+                status = HAL_I2C_Master_Receive_DMA(&i2c_handle_, address, rx, transaction.rx_length);
+            } else {
+                status = HAL_I2C_Mem_Read_DMA(&i2c_handle_, address, transaction.reg, reg_size,
+                    rx, transaction.rx_length);
+            }
+        } else if (transaction.reg_size == 0 && transaction.tx_length > 0) {
+            status = HAL_I2C_Master_Transmit_IT(&i2c_handle_, address, tx, transaction.tx_length);
+        } else if (transaction.reg_size == 0) {
+            status = HAL_I2C_Master_Receive_IT(&i2c_handle_, address, rx, transaction.rx_length);
+        } else if (transaction.tx_length > 0) {
+            status = HAL_I2C_Mem_Write_IT(&i2c_handle_, address, transaction.reg, reg_size,
+                tx, transaction.tx_length);
+        } else {
+            status = HAL_I2C_Mem_Read_IT(&i2c_handle_, address, transaction.reg, reg_size,
+                rx, transaction.rx_length);
         }
     }
+
+    // Could not start: fail this one, finishHead() moves on to the next
+    it_busy_ = true;
+    if (status != HAL_OK) {
+        finishHead(false);
+    }
+}
+
+// Complete the transfer at the head, start the next one, then run the
+// finished one's callback so queued transfers follow without a gap
+void I2C::finishHead(bool ok)
+{
+    if (queue_count_ == 0) {
+        it_busy_ = false;
+        return;
+    }
+
+    I2CTransaction& transaction = queue_[queue_head_];
+    if (head_dma_rx_) {
+        invalidateDCache(transaction.rx_data, transaction.rx_length);
+    }
+    head_dma_rx_ = false;
+    std::function<void(bool ok)> callback = std::move(transaction.callback);
+    transaction.callback = nullptr;
+    queue_head_ = (queue_head_ + 1) % QUEUE_SIZE;
+    queue_count_ = queue_count_ - 1;
+    it_busy_ = false;
+
+    startNext();
+    if (callback) callback(ok);
 }
 
 uint32_t I2C::getError()
@@ -280,3 +596,51 @@ bool I2C::isReady()
 {
     return (HAL_I2C_GetState(&i2c_handle_) == HAL_I2C_STATE_READY);
 }
+
+// HAL Callbacks (called from HAL_I2C_EV_IRQHandler / HAL_I2C_ER_IRQHandler,
+// or HAL_DMA_IRQHandler for DMA transfers)
+
+static I2C* findInterruptI2C(I2C_HandleTypeDef* hi2c)
+{
+    for (I2C* instance : it_i2c_instances) {
+        if (instance != nullptr && instance->getHandle() == hi2c) {
+            return instance;
+        }
+    }
+    return nullptr;
+}
+
+extern "C" void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (I2C* i2c = findInterruptI2C(hi2c)) {
+        i2c->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (I2C* i2c = findInterruptI2C(hi2c)) {
+        i2c->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (I2C* i2c = findInterruptI2C(hi2c)) {
+        i2c->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (I2C* i2c = findInterruptI2C(hi2c)) {
+        i2c->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c)
+{
+    if (I2C* i2c = findInterruptI2C(hi2c)) {
+        i2c->onTransferComplete(false);
+    }
+}
@@ -20,10 +20,37 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
 #endif
 
+#include <cstdint>
+#include <functional>
+#include "i2c_timing.h"
+#include "trace.h"
+
+// DMA stream (H7, F4) or channel (G0, G4, H5 GPDMA) used for transfers
+#if defined(STM32H7) || defined(STM32F4)
+    typedef DMA_Stream_TypeDef I2CDmaInstance;
+#else
+    typedef DMA_Channel_TypeDef I2CDmaInstance;
+#endif
+
+// One interrupt-driven transfer, see I2C::queue()
+struct I2CTransaction
+{
+    uint8_t address;          // 7-bit device address
+    uint16_t reg;             // Register address (used if reg_size > 0)
+    uint8_t reg_size;         // 0 = plain write/read, 1 or 2 = register bytes
+    const uint8_t* tx_data;   // Data written (to reg if reg_size > 0)
+    uint16_t tx_length;
+    uint8_t* rx_data;         // Data read (from reg if reg_size > 0)
+    uint16_t rx_length;
+    std::function<void(bool ok)> callback;  // Runs in the interrupt when done
+    uint32_t clock_speed = 0;               // Applied before the transfer (0 = keep current)
+};
+
 // I2C Class - Inter-Integrated Circuit
 // Usage Example:
 //   i2c1.begin();  // Start I2C at default 100 kHz
-//   i2c1.setClock(400000);  // Set to 400 kHz (Fast Mode)
+//   i2c1.setClock(400000);  // Set to 400 kHz (Fast Mode), applied by the next transfer
+//   i2c1.setClock(1000000); // 1 MHz (Fast Mode Plus, with the stronger pin drive)
 //
 //   uint8_t data[] = {0x10, 0x20};
 //   i2c1.write(0x50, data, 2);  // Write to device at address 0x50
@@ -34,6 +61,32 @@
 //   // Register read/write
 //   i2c1.writeRegister(0x50, 0x10, 0xFF);  // Write 0xFF to register 0x10
 //   uint8_t value = i2c1.readRegister(0x50, 0x10);  // Read register 0x10
+//
+// After beginInterrupt(), queue() runs transfers from the I2C interrupts
+// and returns at once. A transaction either writes or reads; with a
+// register address it reads or writes that register. Queued transactions
+// start back to back from the completion interrupt. The board forwards
+// the event and error interrupts (parts with one I2C vector call both):
+//
+//   i2c1.beginInterrupt(I2C1_EV_IRQn, I2C1_ER_IRQn);
+//
+//   extern "C" void I2C1_EV_IRQHandler(void) { i2c1.handleEventInterrupt(); }
+//   extern "C" void I2C1_ER_IRQHandler(void) { i2c1.handleErrorInterrupt(); }
+//
+// With beginDma() as well, queued transfers move their data by DMA and
+// interrupt only at the end, so a burst read of an IMU costs two
+// interrupts instead of one per byte:
+//
+//   i2c1.beginDma(DMA1_Stream6, DMA_REQUEST_I2C1_TX, DMA1_Stream6_IRQn,
+//                 DMA1_Stream7, DMA_REQUEST_I2C1_RX, DMA1_Stream7_IRQn);
+//
+//   extern "C" void DMA1_Stream6_IRQHandler(void) { i2c1.handleTxDmaInterrupt(); }
+//   extern "C" void DMA1_Stream7_IRQHandler(void) { i2c1.handleRxDmaInterrupt(); }
+//
+//   alignas(32) uint8_t sample[32];  // whole cache lines on H7
+//   i2c1.readRegistersAsync(0x68, 0x3B, sample, 14, [](bool ok) { ... });
+//
+// Buffers must stay valid until the callback has run.
 class I2C
 {
 private:
@@ -46,6 +99,37 @@ private:
     uint16_t sda_pin_;
     uint32_t alternate_function_;
 
+    // Settings in i2c_handle_.Init not yet written to the peripheral.
+    // A timing change alone only rewrites TIMINGR (timing_dirty_), any
+    // other one runs HAL_I2C_Init again (config_dirty_).
+    bool initialized_;
+    bool config_dirty_;
+    bool timing_dirty_;
+    bool fast_mode_plus_;
+
+    // Interrupt transfers: a ring of queued transactions, the one at
+    // queue_head_ is on the bus while it_busy_ is set. Shared with the
+    // interrupt, so changed only with interrupts disabled.
+    static constexpr uint8_t QUEUE_SIZE = 8;
+    I2CTransaction queue_[QUEUE_SIZE];
+    uint8_t queue_head_;
+    volatile uint8_t queue_count_;
+    volatile bool it_busy_;
+    bool it_ready_;
+
+    // DMA for queued transfers, see beginDma(); head_dma_rx_ is set while
+    // the running transfer receives by DMA
+    DMA_HandleTypeDef dma_tx_handle_;
+    DMA_HandleTypeDef dma_rx_handle_;
+    bool dma_ready_;
+    bool head_dma_rx_;
+
+    bool initDma(DMA_HandleTypeDef& handle, I2CDmaInstance* dma_instance,
+                 uint32_t dma_request, bool receive);
+    bool useDma(const uint8_t* data, uint16_t length, bool receive) const;
+    void startNext();
+    void finishHead(bool ok);
+
 public:
     I2C() = delete;
     I2C(I2C_TypeDef* i2c_instance,
@@ -56,21 +140,38 @@ public:
     void begin(const uint32_t clock_speed = 100000);
     void end();
 
-    // Fluent API setters
+    // Fluent API setters (applied by begin() or the next transfer)
+
+    // Fastest of 100 kHz, 400 kHz and 1 MHz not above clock_speed, from the
+    // tables for LUMOS_I2C_KERNEL_CLOCK (see i2c_timing.h)
     I2C& setClock(const uint32_t clock_speed)
     {
-        i2c_handle_.Init.Timing = calculateTiming(clock_speed);
-        HAL_I2C_Init(&i2c_handle_);
+        return setTiming(calculateTiming(clock_speed), clock_speed >= 1000000);
+    }
+
+    // Raw TIMINGR value, e.g. I2CTiming<64000000>::FAST for another kernel clock
+    I2C& setTiming(const uint32_t timing, const bool fast_mode_plus = false)
+    {
+        if (i2c_handle_.Init.Timing != timing || fast_mode_plus_ != fast_mode_plus) {
+            i2c_handle_.Init.Timing = timing;
+            fast_mode_plus_ = fast_mode_plus;
+            timing_dirty_ = true;
+        }
         return *this;
     }
 
     I2C& setAddressingMode(const uint32_t mode)
     {
-        i2c_handle_.Init.AddressingMode = mode;
-        HAL_I2C_Init(&i2c_handle_);
-        return *this;
+        return stage(i2c_handle_.Init.AddressingMode, mode);
     }
 
+    /**
+     * @brief Write staged settings to the peripheral now
+     * @return false if begin() has not run, an interrupt transfer is in
+     *         progress or initialization failed
+     */
+    bool applyConfig();
+
     // Basic read/write operations
     bool write(uint8_t device_address, const uint8_t* data, uint16_t length, uint32_t timeout = 1000);
     bool read(uint8_t device_address, uint8_t* data, uint16_t length, uint32_t timeout = 1000);
@@ -84,12 +185,92 @@ public:
 
     // Device detection
     bool probe(uint8_t device_address, uint32_t timeout = 100);
-    void scan(uint8_t* found_addresses, uint8_t& count, uint8_t max_count = 128);
+
+    /**
+     * @brief Probe addresses 0x08..0x77 once each
+     * @param timeout Per address in ms; an absent device NACKs within one
+     *        address byte, so this only bounds a device holding SCL low
+     *
+     * Stops early when the bus is busy (SDA or SCL held low) rather than
+     * timing out at every address, and finds nothing while queued
+     * transfers are running.
+     */
+    void scan(uint8_t* found_addresses, uint8_t& count, uint8_t max_count = 128, uint32_t timeout = 1);
+
+    /**
+     * @brief Enable interrupt-driven transfers for queue()
+     * @param event_irq Event interrupt, e.g. I2C1_EV_IRQn (I2C1_IRQn on G0)
+     * @param error_irq Error interrupt, e.g. I2C1_ER_IRQn (same as event_irq on G0)
+     * @return true if the interrupts were set up
+     */
+    bool beginInterrupt(IRQn_Type event_irq, IRQn_Type error_irq);
+
+    /**
+     * @brief Queue a transfer
+     * @return false if interrupts are not set up, the queue is full or the
+     *         transaction writes and reads without a register address (the
+     *         callback is not called then)
+     */
+    bool queue(const I2CTransaction& transaction);
+
+    /**
+     * @brief Queue a read of @p length bytes starting at 8-bit register @p reg
+     * @return false if the transfer could not be queued, see queue()
+     */
+    bool readRegistersAsync(uint8_t device_address, uint8_t reg, uint8_t* data, uint16_t length,
+                            std::function<void(bool ok)> callback);
+
+    /**
+     * @brief Move queued transfers by DMA (call after beginInterrupt())
+     * @param tx_instance DMA stream/channel for writes, e.g. DMA1_Stream6
+     * @param tx_request DMA request or channel, e.g. DMA_REQUEST_I2C1_TX
+     * @param rx_instance DMA stream/channel for reads
+     * @return true if DMA was set up
+     *
+     * Transfers whose buffer DMA cannot use (DTCM on H7, or a receive
+     * buffer not covering whole cache lines with the D-cache on) still
+     * run by interrupt.
+     */
+    bool beginDma(I2CDmaInstance* tx_instance, uint32_t tx_request, IRQn_Type tx_irq,
+                  I2CDmaInstance* rx_instance, uint32_t rx_request, IRQn_Type rx_irq);
+
+    // Wait until every queued transfer has finished
+    bool waitIdle(uint32_t timeout = 1000);
+
+    // Stop the running transfer and drop the queue (callbacks get ok = false)
+    void abort();
+
+    // Transfers queued or running
+    uint8_t pending() const { return queue_count_; }
+
+    // Called from the board's IRQ handlers
+    void handleEventInterrupt() { LUMOS_TRACE_ISR("i2c event"); HAL_I2C_EV_IRQHandler(&i2c_handle_); }
+    void handleErrorInterrupt() { LUMOS_TRACE_ISR("i2c error"); HAL_I2C_ER_IRQHandler(&i2c_handle_); }
+    void handleTxDmaInterrupt() { LUMOS_TRACE_ISR("i2c tx dma"); HAL_DMA_IRQHandler(&dma_tx_handle_); }
+    void handleRxDmaInterrupt() { LUMOS_TRACE_ISR("i2c rx dma"); HAL_DMA_IRQHandler(&dma_rx_handle_); }
+
+    // Called from the HAL callbacks
+    void onTransferComplete(bool ok) { finishHead(ok); }
+    I2C_HandleTypeDef* getHandle() { return &i2c_handle_; }
 
     // Error handling
     uint32_t getError();
     bool isReady();
 
 private:
-    uint32_t calculateTiming(uint32_t clock_speed);
+    static constexpr uint32_t calculateTiming(uint32_t clock_speed)
+    {
+        return I2CTiming<LUMOS_I2C_KERNEL_CLOCK>::forSpeed(clock_speed);
+    }
+
+    void applyFastModePlus();
+
+    I2C& stage(uint32_t& field, const uint32_t value)
+    {
+        if (field != value) {
+            field = value;
+            config_dirty_ = true;
+        }
+        return *this;
+    }
 };
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+
+// I2C kernel clock the timing tables are built for. The H7 boards feed
+// I2C1-3 from a 100 MHz PCLK1; a board with another kernel clock defines
+// LUMOS_I2C_KERNEL_CLOCK in its compile flags.
+#ifndef LUMOS_I2C_KERNEL_CLOCK
+    #if defined(STM32G0)
+        #define LUMOS_I2C_KERNEL_CLOCK 64000000UL
+    #elif defined(STM32G4)
+        #define LUMOS_I2C_KERNEL_CLOCK 170000000UL
+    #elif defined(STM32H5)
+        #define LUMOS_I2C_KERNEL_CLOCK 250000000UL
+    #else
+        #define LUMOS_I2C_KERNEL_CLOCK 100000000UL
+    #endif
+#endif
+
+// TIMINGR values (I2C v2: H7, G0, G4, H5) computed by the compiler from the
+// I2C specification limits, as the CubeMX timing tool does
+// Usage Example:
+//   i2c1.setTiming(I2CTiming<64000000>::FAST_PLUS);  // 1 MHz at a 64 MHz kernel clock
+//
+//   static_assert(I2CTiming<LUMOS_I2C_KERNEL_CLOCK>::FAST != 0, "no 400 kHz timing");
+namespace I2CTimingDetail {
+
+struct Mode {
+    uint32_t bus_speed;   // Hz
+    uint32_t low_min;     // tLOW, ns
+    uint32_t high_min;    // tHIGH, ns
+    uint32_t setup_min;   // tSU;DAT, ns
+    uint32_t valid_max;   // tVD;DAT, ns
+    uint32_t rise_max;    // tr, ns
+    uint32_t fall_max;    // tf, ns
+};
+
+constexpr Mode STANDARD = {100000, 4700, 4000, 250, 3450, 1000, 300};
+constexpr Mode FAST = {400000, 1300, 600, 100, 900, 300, 300};
+constexpr Mode FAST_PLUS = {1000000, 500, 260, 50, 450, 120, 120};
+
+// Analog filter delay limits, ns
+constexpr uint32_t FILTER_MIN = 50;
+constexpr uint32_t FILTER_MAX = 260;
+
+// Kernel clock cycles covering ns, rounded up
+constexpr uint32_t cycles(uint32_t kernel_clock, uint32_t ns)
+{
+    return static_cast<uint32_t>((static_cast<uint64_t>(ns) * kernel_clock + 999999999ULL) / 1000000000ULL);
+}
+
+constexpr uint32_t divideUp(uint32_t value, uint32_t divisor)
+{
+    return (value + divisor - 1) / divisor;
+}
+
+// Smallest prescaler whose fields fit. With clamp_setup a data setup delay
+// beyond SCLDEL's range is cut to its maximum (which still leaves the
+// setup time for edges faster than the specification's slowest). 0 if the
+// kernel clock is too slow or too fast for the mode.
+constexpr uint32_t search(uint32_t kernel_clock, const Mode& mode, bool clamp_setup)
+{
+    const uint32_t period = divideUp(kernel_clock, mode.bus_speed);
+    // SCL synchronisation adds the edges, the filter and 2 cycles per edge.
+    // Counted with instant edges so slow edges only ever lower the speed.
+    const uint32_t sync = static_cast<uint32_t>(static_cast<uint64_t>(2 * FILTER_MIN) * kernel_clock / 1000000000ULL) + 4;
+    const uint32_t scl_delay = cycles(kernel_clock, mode.rise_max + mode.setup_min);
+    const uint32_t filter = cycles(kernel_clock, FILTER_MIN) + 3;
+    const uint32_t fall = cycles(kernel_clock, mode.fall_max);
+    const uint32_t sda_delay = fall > filter ? fall - filter : 0;
+    const uint32_t valid_used = mode.rise_max + FILTER_MAX;
+    const uint32_t sda_delay_max = mode.valid_max > valid_used
+        ? cycles(kernel_clock, mode.valid_max - valid_used) : 0;
+
+    for (uint32_t prescaler = 0; prescaler < 16; prescaler++) {
+        const uint32_t step = prescaler + 1;
+        uint32_t scldel = scl_delay > step ? divideUp(scl_delay, step) - 1 : 0;
+        if (clamp_setup && scldel > 15) {
+            scldel = 15;
+        }
+        const uint32_t sdadel = divideUp(sda_delay, step);
+        if (scldel > 15 || sdadel > 15 || sdadel * step > sda_delay_max) {
+            continue;
+        }
+
+        const uint32_t low_min = divideUp(cycles(kernel_clock, mode.low_min), step);
+        const uint32_t high_min = divideUp(cycles(kernel_clock, mode.high_min), step);
+        const uint32_t wanted = period > sync ? divideUp(period - sync, step) : 0;
+        const uint32_t total = wanted > low_min + high_min ? wanted : low_min + high_min;
+        const uint32_t extra = total - low_min - high_min;
+        const uint32_t low = low_min + extra - extra / 2;
+        const uint32_t high = high_min + extra / 2;
+        if (low > 256 || high > 256) {
+            continue;
+        }
+
+        return (prescaler << 28) | (scldel << 20) | (sdadel << 16) | ((high - 1) << 8) | (low - 1);
+    }
+    return 0;
+}
+
+constexpr uint32_t compute(uint32_t kernel_clock, const Mode& mode)
+{
+    const uint32_t timing = search(kernel_clock, mode, false);
+    return timing != 0 ? timing : search(kernel_clock, mode, true);
+}
+
+} // namespace I2CTimingDetail
+
+template <uint32_t KernelClock>
+struct I2CTiming {
+    static constexpr uint32_t STANDARD = I2CTimingDetail::compute(KernelClock, I2CTimingDetail::STANDARD);   // 100 kHz
+    static constexpr uint32_t FAST = I2CTimingDetail::compute(KernelClock, I2CTimingDetail::FAST);           // 400 kHz
+    static constexpr uint32_t FAST_PLUS = I2CTimingDetail::compute(KernelClock, I2CTimingDetail::FAST_PLUS); // 1 MHz
+
+    // Mode for a requested bus speed: the fastest one not above it
+    static constexpr uint32_t forSpeed(uint32_t clock_speed)
+    {
+        return clock_speed >= 1000000 ? FAST_PLUS : (clock_speed >= 400000 ? FAST : STANDARD);
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Platform-specific HAL headers
+#if defined(STM32H7)
+    #include "stm32h7xx_hal.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx_hal.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx_hal.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx_hal.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx_hal.h"
+#else
+    #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
+#endif
+
+// Placement of hot code and data in zero-wait-state memory
+// Usage Example:
+//   LUMOS_FAST_CODE void controlStep() { ... }       // Runs from ITCM
+//   extern "C" LUMOS_FAST_CODE void TIM6_DAC_IRQHandler(void) { ... }
+//
+//   LUMOS_FAST_DATA float gains[16] = {1.0f, ...};   // DTCM, initialized
+//   LUMOS_FAST_BSS  float state[256];                // DTCM, zeroed
+//
+//   LUMOS_DMA_BUFFER uint8_t rx_buffer[512];         // Reachable by DMA
+//
+// On the H7 the sections map to ITCMRAM, DTCMRAM and RAM_D2 in the board
+// linker script; the startup code copies the ITCM code and DTCM data
+// from flash and zeroes the DTCM bss along with .data and .bss.
+// DTCM is not reachable by DMA1/DMA2 or SDMMC, so buffers handed to a
+// DMA stream belong in LUMOS_DMA_BUFFER (D2 SRAM, next to DMA1/DMA2).
+// SDMMC1's IDMA only reaches AXI SRAM, so SD buffers stay in regular RAM.
+// DMA buffers are 32-byte (cache line) aligned and, like any uninitialized
+// RAM, not zeroed at startup. The MPU maps D2 SRAM non-cacheable, so the
+// DMA and the CPU always see the same bytes there. The rest of D2 SRAM is the framework's
+// DMA pool (.dma_pool, Lumos::DmaPool in dma_pool.h) for buffers taken
+// and returned at run time.
+//
+// Boards without TCMs run LUMOS_FAST_CODE from SRAM (.RamFunc, copied with
+// .data), and the data attributes fall back to regular RAM. `lumos size`
+// lists the usage of each memory region.
+
+#if defined(STM32H7)
+    #define LUMOS_FAST_CODE  __attribute__((section(".itcm_text"), noinline))
+    #define LUMOS_FAST_DATA  __attribute__((section(".dtcm_data")))
+    #define LUMOS_FAST_BSS   __attribute__((section(".dtcm_bss")))
+    #define LUMOS_DMA_BUFFER __attribute__((section(".dma_buffer"), aligned(32)))
+#else
+    #define LUMOS_FAST_CODE  __attribute__((section(".RamFunc"), noinline))
+    #define LUMOS_FAST_DATA
+    #define LUMOS_FAST_BSS
+    #define LUMOS_DMA_BUFFER __attribute__((aligned(4)))
+#endif
+
+// D-cache maintenance around DMA transfers
+// Usage Example:
+//   cleanDCache(tx, length);        // CPU writes reach RAM before the DMA reads
+//   invalidateDCache(rx, length);   // Before the DMA writes rx, and after it
+//
+// The H7 runs with the I- and D-cache on (main.c). The wrapper's DMA paths
+// (UART, SPI, I2C, SD, ADC scan, timer capture and bursts) call these
+// themselves; code running its own DMA needs them for buffers in cached
+// RAM. They do nothing when the D-cache is off, on chips without one, and
+// for memory the cache does not hold: DTCM and D2 SRAM (LUMOS_DMA_BUFFER,
+// the DMA pool). Invalidating drops every line the range touches, so a
+// receive buffer in cached RAM should start and end on a 32-byte line,
+// or writes to a neighbour sharing its first or last line are lost.
+
+// False for memory the D-cache never holds
+inline bool isDCacheable(const void* data)
+{
+#if defined(STM32H7)
+    const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+    const bool dtcm = address >= 0x20000000 && address < 0x20020000;
+    const bool d2_sram = address >= 0x30000000 && address < 0x30008000;   // MPU_Config()
+    return (SCB->CCR & SCB_CCR_DC_Msk) && !dtcm && !d2_sram;
+#else
+    (void)data;
+    return false;
+#endif
+}
+
+// Write back the lines covering @p length bytes at @p data
+inline void cleanDCache(const void* data, size_t length)
+{
+#if defined(STM32H7)
+    if (length > 0 && isDCacheable(data)) {
+        const uintptr_t first = reinterpret_cast<uintptr_t>(data) & ~uintptr_t(31);
+        const uintptr_t last = reinterpret_cast<uintptr_t>(data) + length;
+        SCB_CleanDCache_by_Addr(reinterpret_cast<uint32_t*>(first), static_cast<int32_t>(last - first));
+    }
+#else
+    (void)data;
+    (void)length;
+#endif
+}
+
+// Discard the lines covering @p length bytes at @p data, dirty or not
+inline void invalidateDCache(void* data, size_t length)
+{
+#if defined(STM32H7)
+    if (length > 0 && isDCacheable(data)) {
+        const uintptr_t first = reinterpret_cast<uintptr_t>(data) & ~uintptr_t(31);
+        const uintptr_t last = reinterpret_cast<uintptr_t>(data) + length;
+        SCB_InvalidateDCache_by_Addr(reinterpret_cast<uint32_t*>(first), static_cast<int32_t>(last - first));
+    }
+#else
+    (void)data;
+    (void)length;
+#endif
+}
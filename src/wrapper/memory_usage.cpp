@@ -0,0 +1,78 @@
+#include "memory_usage.h"
+#include "sys.h"
+
+static const uint32_t kStackPattern = 0xA5A5A5A5u;
+static const uint32_t kStackMargin = 64;   // Left unpainted below the SP of the caller
+
+extern "C" {
+
+// Linker script symbols
+extern uint8_t _end;
+extern uint8_t _estack;
+extern uint8_t _Min_Stack_Size;
+
+// From the board's sysmem.c, if it has one
+uint8_t* SysmemGetHeapEnd(void) __attribute__((weak));
+uint8_t* SysmemGetHeapPeak(void) __attribute__((weak));
+
+static uint32_t* painted_bottom = nullptr;
+
+// Lowest address the heap may reach by now
+static uint8_t* GetHeapBreak(void)
+{
+    uint8_t* end = SysmemGetHeapPeak ? SysmemGetHeapPeak() : nullptr;
+    return end != nullptr ? end : &_end;
+}
+
+void PaintMainStack(void)
+{
+    uint32_t* bottom = reinterpret_cast<uint32_t*>((reinterpret_cast<uintptr_t>(GetHeapBreak()) + 3) & ~3u);
+    uint32_t* top = reinterpret_cast<uint32_t*>((__get_MSP() - kStackMargin) & ~3u);
+    for (uint32_t* word = bottom; word < top; word++) {
+        *word = kStackPattern;
+    }
+    painted_bottom = bottom;
+}
+
+uint32_t GetMainStackPeak(void)
+{
+    if (painted_bottom == nullptr) {
+        return 0;
+    }
+    // Heap grown into the painted area since is not stack use
+    uint32_t* word = painted_bottom;
+    uint32_t* heap = reinterpret_cast<uint32_t*>((reinterpret_cast<uintptr_t>(GetHeapBreak()) + 3) & ~3u);
+    if (heap > word) {
+        word = heap;
+    }
+    uint32_t* sp = reinterpret_cast<uint32_t*>(__get_MSP());
+    while (word < sp && *word == kStackPattern) {
+        word++;
+    }
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&_estack) - reinterpret_cast<uintptr_t>(word));
+}
+
+uint32_t GetMainStackSize(void)
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&_Min_Stack_Size));
+}
+
+uint32_t GetHeapUsed(void)
+{
+    uint8_t* end = SysmemGetHeapEnd ? SysmemGetHeapEnd() : nullptr;
+    return end != nullptr ? static_cast<uint32_t>(end - &_end) : 0;
+}
+
+uint32_t GetHeapPeak(void)
+{
+    uint8_t* peak = SysmemGetHeapPeak ? SysmemGetHeapPeak() : nullptr;
+    return peak != nullptr ? static_cast<uint32_t>(peak - &_end) : 0;
+}
+
+uint32_t GetHeapLimit(void)
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&_estack) - reinterpret_cast<uintptr_t>(&_Min_Stack_Size) -
+                                 reinterpret_cast<uintptr_t>(&_end));
+}
+
+}
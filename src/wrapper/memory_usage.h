@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// Main stack and heap high-water marks
+// Usage Example (board main.c; usable from C):
+//   int main(void) {
+//       PaintMainStack();                  // First thing, before the stack is deep
+//       ...
+//   }
+//
+//   // Later, e.g. from a telemetry app
+//   printf("stack %lu/%lu heap peak %lu/%lu\n", GetMainStackPeak(), GetMainStackSize(),
+//          GetHeapPeak(), GetHeapLimit());
+//
+// PaintMainStack() fills the free RAM between the heap and the current
+// stack pointer with a pattern; GetMainStackPeak() finds the deepest word
+// the stack has overwritten since. The heap figures come from the board's
+// _sbrk() (sysmem.c), which records its peak break; boards without it
+// report zero. _Min_Stack_Size is only what the linker script reserves:
+// the stack may grow past it into unused heap, which the peak shows.
+// FreeRTOS task stacks are covered by RtosExecutor::UpdateStats().
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fill the unused main stack with the watermark pattern
+void PaintMainStack(void);
+
+// Deepest main stack use in bytes since PaintMainStack() (0 if never painted)
+uint32_t GetMainStackPeak(void);
+
+// Stack reserved by the linker script (_Min_Stack_Size)
+uint32_t GetMainStackSize(void);
+
+// Heap in use now, the most ever in use, and the most _sbrk() will hand out
+uint32_t GetHeapUsed(void);
+uint32_t GetHeapPeak(void);
+uint32_t GetHeapLimit(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,411 @@
+#include "peripherals.h"
+
+// ===== Platform names =====
+
+// DMA requests of the request multiplexer (DMAMUX, GPDMA on H5); F4
+// streams have fixed channels instead, so there is nothing to list
+#if defined(STM32H5)
+    #define DMA_REQ(name) GPDMA1_REQUEST_##name
+#elif defined(STM32F4)
+    #define DMA_REQ(name) PERIPHERAL_NO_DMA
+#else
+    #define DMA_REQ(name) DMA_REQUEST_##name
+#endif
+
+// Interrupts that G0 shares between instances
+#if defined(STM32G0)
+    #if defined(LPUART2)
+        #define USART2_IRQ USART2_LPUART2_IRQn
+    #else
+        #define USART2_IRQ USART2_IRQn
+    #endif
+    #if defined(USART5)
+        #define USART3_6_IRQ USART3_4_5_6_LPUART1_IRQn
+    #elif defined(USART4)
+        #define USART3_6_IRQ USART3_4_LPUART1_IRQn
+    #else
+        #define USART3_6_IRQ USART3_IRQn
+    #endif
+    #if defined(SPI3)
+        #define SPI2_IRQ SPI2_3_IRQn
+    #else
+        #define SPI2_IRQ SPI2_IRQn
+    #endif
+    #if defined(I2C3)
+        #define I2C2_IRQ I2C2_3_IRQn
+    #else
+        #define I2C2_IRQ I2C2_IRQn
+    #endif
+    #define I2C1_IRQ I2C1_IRQn
+    #define FDCAN_IRQ(n) TIM16_FDCAN_IT0_IRQn
+#else
+    #define USART2_IRQ USART2_IRQn
+    #define USART3_6_IRQ USART3_IRQn
+    #define SPI2_IRQ SPI2_IRQn
+    #define I2C1_IRQ I2C1_EV_IRQn
+    #define I2C2_IRQ I2C2_EV_IRQn
+    #define FDCAN_IRQ(n) FDCAN##n##_IT0_IRQn
+#endif
+
+// Instance whose clock macro carries its own name (__HAL_RCC_SPI1_CLK_ENABLE)
+#define PERIPHERAL(instance, irq, dma_tx, dma_rx) \
+    {instance##_BASE, [] { __HAL_RCC_##instance##_CLK_ENABLE(); }, \
+     [] { return __HAL_RCC_##instance##_IS_CLK_ENABLED() != 0; }, irq, dma_tx, dma_rx}
+
+// Instance behind a shared clock (FDCAN, ADC12, ...)
+#define PERIPHERAL_CLOCK(instance, clock, irq) \
+    {instance##_BASE, [] { __HAL_RCC_##clock##_CLK_ENABLE(); }, \
+     [] { return __HAL_RCC_##clock##_IS_CLK_ENABLED() != 0; }, irq, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA}
+
+// Timers have several interrupts, which Timer::enableInterrupt() is given
+#define TIMER(instance) \
+    {instance##_BASE, [] { __HAL_RCC_##instance##_CLK_ENABLE(); }, \
+     [] { return __HAL_RCC_##instance##_IS_CLK_ENABLED() != 0; }, \
+     PERIPHERAL_NO_IRQ, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA}
+
+// ===== Descriptor table =====
+
+static constexpr PeripheralInfo peripheral_table[] = {
+    // U(S)ART
+#ifdef USART1
+    PERIPHERAL(USART1, USART1_IRQn, DMA_REQ(USART1_TX), DMA_REQ(USART1_RX)),
+#endif
+#ifdef USART2
+    PERIPHERAL(USART2, USART2_IRQ, DMA_REQ(USART2_TX), DMA_REQ(USART2_RX)),
+#endif
+#ifdef USART3
+    PERIPHERAL(USART3, USART3_6_IRQ, DMA_REQ(USART3_TX), DMA_REQ(USART3_RX)),
+#endif
+#ifdef UART4
+    PERIPHERAL(UART4, UART4_IRQn, DMA_REQ(UART4_TX), DMA_REQ(UART4_RX)),
+#endif
+#ifdef UART5
+    PERIPHERAL(UART5, UART5_IRQn, DMA_REQ(UART5_TX), DMA_REQ(UART5_RX)),
+#endif
+#ifdef USART4
+    PERIPHERAL(USART4, USART3_6_IRQ, DMA_REQ(USART4_TX), DMA_REQ(USART4_RX)),
+#endif
+#ifdef USART5
+    PERIPHERAL(USART5, USART3_6_IRQ, DMA_REQ(USART5_TX), DMA_REQ(USART5_RX)),
+#endif
+#ifdef USART6
+    #if defined(STM32G0)
+    PERIPHERAL(USART6, USART3_6_IRQ, DMA_REQ(USART6_TX), DMA_REQ(USART6_RX)),
+    #else
+    PERIPHERAL(USART6, USART6_IRQn, DMA_REQ(USART6_TX), DMA_REQ(USART6_RX)),
+    #endif
+#endif
+#ifdef UART7
+    PERIPHERAL(UART7, UART7_IRQn, DMA_REQ(UART7_TX), DMA_REQ(UART7_RX)),
+#endif
+#ifdef UART8
+    PERIPHERAL(UART8, UART8_IRQn, DMA_REQ(UART8_TX), DMA_REQ(UART8_RX)),
+#endif
+#ifdef UART9
+    PERIPHERAL(UART9, UART9_IRQn, DMA_REQ(UART9_TX), DMA_REQ(UART9_RX)),
+#endif
+#ifdef USART10
+    PERIPHERAL(USART10, USART10_IRQn, DMA_REQ(USART10_TX), DMA_REQ(USART10_RX)),
+#endif
+
+    // SPI
+#ifdef SPI1
+    PERIPHERAL(SPI1, SPI1_IRQn, DMA_REQ(SPI1_TX), DMA_REQ(SPI1_RX)),
+#endif
+#ifdef SPI2
+    PERIPHERAL(SPI2, SPI2_IRQ, DMA_REQ(SPI2_TX), DMA_REQ(SPI2_RX)),
+#endif
+#ifdef SPI3
+    #if defined(STM32G0)
+    PERIPHERAL(SPI3, SPI2_IRQ, DMA_REQ(SPI3_TX), DMA_REQ(SPI3_RX)),
+    #else
+    PERIPHERAL(SPI3, SPI3_IRQn, DMA_REQ(SPI3_TX), DMA_REQ(SPI3_RX)),
+    #endif
+#endif
+#ifdef SPI4
+    PERIPHERAL(SPI4, SPI4_IRQn, DMA_REQ(SPI4_TX), DMA_REQ(SPI4_RX)),
+#endif
+#ifdef SPI5
+    PERIPHERAL(SPI5, SPI5_IRQn, DMA_REQ(SPI5_TX), DMA_REQ(SPI5_RX)),
+#endif
+#ifdef SPI6
+    #if defined(STM32H7)
+    // BDMA, outside DMAMUX1
+    PERIPHERAL(SPI6, SPI6_IRQn, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA),
+    #else
+    PERIPHERAL(SPI6, SPI6_IRQn, DMA_REQ(SPI6_TX), DMA_REQ(SPI6_RX)),
+    #endif
+#endif
+
+    // I2C
+#ifdef I2C1
+    PERIPHERAL(I2C1, I2C1_IRQ, DMA_REQ(I2C1_TX), DMA_REQ(I2C1_RX)),
+#endif
+#ifdef I2C2
+    PERIPHERAL(I2C2, I2C2_IRQ, DMA_REQ(I2C2_TX), DMA_REQ(I2C2_RX)),
+#endif
+#ifdef I2C3
+    #if defined(STM32G0)
+    PERIPHERAL(I2C3, I2C2_IRQ, DMA_REQ(I2C3_TX), DMA_REQ(I2C3_RX)),
+    #else
+    PERIPHERAL(I2C3, I2C3_EV_IRQn, DMA_REQ(I2C3_TX), DMA_REQ(I2C3_RX)),
+    #endif
+#endif
+#ifdef I2C4
+    #if defined(STM32H7)
+    // BDMA, outside DMAMUX1
+    PERIPHERAL(I2C4, I2C4_EV_IRQn, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA),
+    #else
+    PERIPHERAL(I2C4, I2C4_EV_IRQn, DMA_REQ(I2C4_TX), DMA_REQ(I2C4_RX)),
+    #endif
+#endif
+#ifdef I2C5
+    PERIPHERAL(I2C5, I2C5_EV_IRQn, DMA_REQ(I2C5_TX), DMA_REQ(I2C5_RX)),
+#endif
+
+    // SDMMC (internal IDMA, no request)
+#ifdef SDMMC1
+    PERIPHERAL(SDMMC1, SDMMC1_IRQn, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA),
+#endif
+#ifdef SDMMC2
+    PERIPHERAL(SDMMC2, SDMMC2_IRQn, PERIPHERAL_NO_DMA, PERIPHERAL_NO_DMA),
+#endif
+
+    // FDCAN (one clock for all instances)
+#ifdef FDCAN1
+    PERIPHERAL_CLOCK(FDCAN1, FDCAN, FDCAN_IRQ(1)),
+#endif
+#ifdef FDCAN2
+    PERIPHERAL_CLOCK(FDCAN2, FDCAN, FDCAN_IRQ(2)),
+#endif
+#ifdef FDCAN3
+    PERIPHERAL_CLOCK(FDCAN3, FDCAN, FDCAN_IRQ(3)),
+#endif
+
+    // ADC
+#if defined(STM32F4)
+    #ifdef ADC1
+    PERIPHERAL_CLOCK(ADC1, ADC1, ADC_IRQn),
+    #endif
+    #ifdef ADC2
+    PERIPHERAL_CLOCK(ADC2, ADC2, ADC_IRQn),
+    #endif
+    #ifdef ADC3
+    PERIPHERAL_CLOCK(ADC3, ADC3, ADC_IRQn),
+    #endif
+#elif defined(STM32H7) || defined(STM32G4)
+    #ifdef ADC1
+    PERIPHERAL_CLOCK(ADC1, ADC12, PERIPHERAL_NO_IRQ),
+    #endif
+    #ifdef ADC2
+    PERIPHERAL_CLOCK(ADC2, ADC12, PERIPHERAL_NO_IRQ),
+    #endif
+    #if defined(STM32H7) && defined(ADC3)
+    PERIPHERAL_CLOCK(ADC3, ADC3, PERIPHERAL_NO_IRQ),
+    #elif defined(ADC3)
+    PERIPHERAL_CLOCK(ADC3, ADC345, PERIPHERAL_NO_IRQ),
+    #endif
+    #ifdef ADC4
+    PERIPHERAL_CLOCK(ADC4, ADC345, PERIPHERAL_NO_IRQ),
+    #endif
+    #ifdef ADC5
+    PERIPHERAL_CLOCK(ADC5, ADC345, PERIPHERAL_NO_IRQ),
+    #endif
+#else
+    #ifdef ADC1
+    PERIPHERAL_CLOCK(ADC1, ADC, PERIPHERAL_NO_IRQ),
+    #endif
+    #ifdef ADC2
+    PERIPHERAL_CLOCK(ADC2, ADC, PERIPHERAL_NO_IRQ),
+    #endif
+#endif
+
+    // Timers
+#ifdef TIM1
+    TIMER(TIM1),
+#endif
+#ifdef TIM2
+    TIMER(TIM2),
+#endif
+#ifdef TIM3
+    TIMER(TIM3),
+#endif
+#ifdef TIM4
+    TIMER(TIM4),
+#endif
+#ifdef TIM5
+    TIMER(TIM5),
+#endif
+#ifdef TIM6
+    TIMER(TIM6),
+#endif
+#ifdef TIM7
+    TIMER(TIM7),
+#endif
+#ifdef TIM8
+    TIMER(TIM8),
+#endif
+#ifdef TIM9
+    TIMER(TIM9),
+#endif
+#ifdef TIM10
+    TIMER(TIM10),
+#endif
+#ifdef TIM11
+    TIMER(TIM11),
+#endif
+#ifdef TIM12
+    TIMER(TIM12),
+#endif
+#ifdef TIM13
+    TIMER(TIM13),
+#endif
+#ifdef TIM14
+    TIMER(TIM14),
+#endif
+#ifdef TIM15
+    TIMER(TIM15),
+#endif
+#ifdef TIM16
+    TIMER(TIM16),
+#endif
+#ifdef TIM17
+    TIMER(TIM17),
+#endif
+#ifdef TIM20
+    TIMER(TIM20),
+#endif
+#ifdef TIM23
+    TIMER(TIM23),
+#endif
+#ifdef TIM24
+    TIMER(TIM24),
+#endif
+};
+
+const PeripheralInfo* findPeripheral(const void* instance)
+{
+    const uintptr_t base = reinterpret_cast<uintptr_t>(instance);
+    for (const PeripheralInfo& info : peripheral_table) {
+        if (info.base == base) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+bool enablePeripheralClock(const void* instance)
+{
+    const PeripheralInfo* info = findPeripheral(instance);
+    if (info == nullptr) {
+        return false;
+    }
+    info->enable_clock();
+    return true;
+}
+
+bool isPeripheralClockEnabled(const void* instance)
+{
+    const PeripheralInfo* info = findPeripheral(instance);
+    return info != nullptr && info->clock_enabled();
+}
+
+// ===== GPIO ports =====
+
+// Ports are 0x400 apart from GPIOA on every family, and port n's clock is
+// bit n of one RCC register
+static const uintptr_t GPIO_PORT_STRIDE = 0x400;
+static const uint32_t GPIO_PORT_COUNT = 11;   // A to K
+
+#if defined(STM32F4)
+    #define GPIO_CLOCK_REGISTER (RCC->AHB1ENR)
+#elif defined(STM32H7)
+    #define GPIO_CLOCK_REGISTER (RCC->AHB4ENR)
+#elif defined(STM32G0)
+    #define GPIO_CLOCK_REGISTER (RCC->IOPENR)
+#else
+    #define GPIO_CLOCK_REGISTER (RCC->AHB2ENR)   // G4, H5
+#endif
+
+void enableGPIOClock(GPIO_TypeDef* port)
+{
+    const uintptr_t offset = reinterpret_cast<uintptr_t>(port) - GPIOA_BASE;
+    const uint32_t index = (uint32_t)(offset / GPIO_PORT_STRIDE);
+    if (offset % GPIO_PORT_STRIDE != 0 || index >= GPIO_PORT_COUNT) {
+        return;
+    }
+
+    const uint32_t bit = 1u << index;
+    if ((GPIO_CLOCK_REGISTER & bit) == 0) {
+        GPIO_CLOCK_REGISTER |= bit;
+        // Read back, as the HAL macros do, so the port is clocked before use
+        volatile uint32_t delay = GPIO_CLOCK_REGISTER & bit;
+        (void)delay;
+    }
+}
+
+void initAlternatePins(const PinRef* pins, size_t count, uint32_t mode, uint32_t pull,
+                       uint32_t speed, uint32_t alternate)
+{
+    // Merge each port's pins into one mask, first come first served
+    uint16_t done = 0;   // Bit per entry already merged, up to 16 pins
+    for (size_t i = 0; i < count && i < 16; i++) {
+        if ((done & (1u << i)) != 0 || pins[i].port == nullptr) {
+            continue;
+        }
+
+        uint16_t mask = pins[i].pin;
+        for (size_t j = i + 1; j < count && j < 16; j++) {
+            if (pins[j].port == pins[i].port) {
+                mask |= pins[j].pin;
+                done |= (uint16_t)(1u << j);
+            }
+        }
+
+        enableGPIOClock(pins[i].port);
+
+        GPIO_InitTypeDef GPIO_InitStruct = {0};
+        GPIO_InitStruct.Pin = mask;
+        GPIO_InitStruct.Mode = mode;
+        GPIO_InitStruct.Pull = pull;
+        GPIO_InitStruct.Speed = speed;
+        GPIO_InitStruct.Alternate = alternate;
+        HAL_GPIO_Init(pins[i].port, &GPIO_InitStruct);
+    }
+}
+
+// ===== DMA controllers =====
+
+// Streams and channels lie inside their controller's register block
+#if defined(STM32H5)
+static const uintptr_t DMA_BLOCK_SIZE = 0x1000;
+#else
+static const uintptr_t DMA_BLOCK_SIZE = 0x400;
+#endif
+
+static bool inDmaBlock(uintptr_t address, uintptr_t base)
+{
+    return address - base < DMA_BLOCK_SIZE;
+}
+
+void enableDMAClock(const void* channel)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(channel);
+#if defined(STM32H5)
+    if (inDmaBlock(address, GPDMA1_BASE)) __HAL_RCC_GPDMA1_CLK_ENABLE();
+    else if (inDmaBlock(address, GPDMA2_BASE)) __HAL_RCC_GPDMA2_CLK_ENABLE();
+#else
+#ifdef DMA1
+    if (inDmaBlock(address, DMA1_BASE)) __HAL_RCC_DMA1_CLK_ENABLE();
+#endif
+#ifdef DMA2
+    if (inDmaBlock(address, DMA2_BASE)) __HAL_RCC_DMA2_CLK_ENABLE();
+#endif
+#if defined(STM32H7) && defined(BDMA)
+    if (inDmaBlock(address, BDMA_BASE)) __HAL_RCC_BDMA_CLK_ENABLE();
+#endif
+#if defined(STM32G4)
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+#endif
+#endif
+}
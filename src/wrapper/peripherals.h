@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Platform-specific HAL headers
+#if defined(STM32H7)
+    #include "stm32h7xx_hal.h"
+#elif defined(STM32G0)
+    #include "stm32g0xx_hal.h"
+#elif defined(STM32G4)
+    #include "stm32g4xx_hal.h"
+#elif defined(STM32F4)
+    #include "stm32f4xx_hal.h"
+#elif defined(STM32H5)
+    #include "stm32h5xx_hal.h"
+#else
+    #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
+#endif
+
+// Peripheral descriptors - one table per platform (peripherals.cpp) maps
+// every instance the device has to its RCC clock enable, main interrupt
+// and DMA requests. The wrappers enable clocks through it instead of each
+// carrying its own if/else chain.
+// Usage Example:
+//   enablePeripheralClock(SPI2);
+//
+//   const PeripheralInfo* info = findPeripheral(USART1);
+//   if (info != nullptr && info->irq != PERIPHERAL_NO_IRQ) {
+//       HAL_NVIC_EnableIRQ(info->irq);
+//   }
+//   uint32_t tx_request = info->dma_tx;   // e.g. DMA_REQUEST_USART1_TX
+//
+//   // Pins sharing a port are configured with one HAL_GPIO_Init()
+//   const PinRef pins[] = {{GPIOC, GPIO_PIN_8}, {GPIOC, GPIO_PIN_9}, {GPIOD, GPIO_PIN_2}};
+//   initAlternatePins(pins, 3, GPIO_MODE_AF_PP, GPIO_NOPULL,
+//                     GPIO_SPEED_FREQ_VERY_HIGH, GPIO_AF12_SDMMC1);
+
+static constexpr IRQn_Type PERIPHERAL_NO_IRQ = static_cast<IRQn_Type>(-128);
+static constexpr uint32_t PERIPHERAL_NO_DMA = 0xFFFFFFFFu;
+
+struct PeripheralInfo
+{
+    uintptr_t base;            // Instance base address (USART1_BASE, ...)
+    void (*enable_clock)();    // RCC clock enable
+    bool (*clock_enabled)();   // Its enable bit is set
+    IRQn_Type irq;             // Main interrupt (event interrupt for I2C, IT0 for FDCAN)
+    uint32_t dma_tx;           // DMA request, PERIPHERAL_NO_DMA without a request mux
+    uint32_t dma_rx;
+};
+
+/**
+ * @brief Look up an instance (USART1, SPI2, TIM3, ...)
+ * @return The descriptor, nullptr if the instance is not in the table
+ */
+const PeripheralInfo* findPeripheral(const void* instance);
+
+// Enable the instance's RCC clock; false if the instance is unknown
+bool enablePeripheralClock(const void* instance);
+
+// The instance's RCC clock is enabled (false if the instance is unknown),
+// e.g. for framework/power_tracker.h
+bool isPeripheralClockEnabled(const void* instance);
+
+// Enable a GPIO port clock; a single register check once it is running
+void enableGPIOClock(GPIO_TypeDef* port);
+
+struct PinRef
+{
+    GPIO_TypeDef* port;
+    uint16_t pin;
+};
+
+/**
+ * @brief Configure pins with the same settings, one HAL_GPIO_Init() per port
+ *
+ * Enables the port clocks too. Pins with a null port are skipped.
+ */
+void initAlternatePins(const PinRef* pins, size_t count, uint32_t mode, uint32_t pull,
+                       uint32_t speed, uint32_t alternate);
+
+// Enable the clock of the DMA controller a stream or channel belongs to
+// (DMA1_Stream0, GPDMA1_Channel2, ...), plus DMAMUX1 on G4
+void enableDMAClock(const void* channel);
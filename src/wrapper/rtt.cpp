@@ -0,0 +1,125 @@
+#include "rtt.h"
+#include "memory_sections.h"
+#include <cstring>
+
+// Layout of SEGGER RTT's control block and ring descriptors, which probes
+// and viewers read. The target only advances write_offset of an up ring
+// and read_offset of a down ring; the probe the other two.
+struct RTTRing {
+    const char* name;
+    uint8_t* buffer;
+    uint32_t size;
+    volatile uint32_t write_offset;
+    volatile uint32_t read_offset;
+    uint32_t flags;
+};
+
+struct RTTControlBlock {
+    char id[16];
+    int32_t max_up;
+    int32_t max_down;
+    RTTRing up[1];
+    RTTRing down[1];
+};
+
+static constexpr uint32_t RTT_MODE_NO_BLOCK_SKIP = 0;
+
+LUMOS_FAST_BSS static uint8_t rtt_up_buffer[LUMOS_RTT_UP_SIZE];
+LUMOS_FAST_BSS static uint8_t rtt_down_buffer[LUMOS_RTT_DOWN_SIZE];
+
+// Initialized data rather than set up by a constructor: valid before any
+// code runs, and left out of builds that never use RTTCom
+extern "C" {
+LUMOS_FAST_DATA RTTControlBlock _SEGGER_RTT = {
+    "SEGGER RTT", 1, 1,
+    {{"Terminal", rtt_up_buffer, LUMOS_RTT_UP_SIZE, 0, 0, RTT_MODE_NO_BLOCK_SKIP}},
+    {{"Terminal", rtt_down_buffer, LUMOS_RTT_DOWN_SIZE, 0, 0, RTT_MODE_NO_BLOCK_SKIP}},
+};
+}
+
+RTT RTTCom;
+
+bool RTT::write(const uint8_t* data, uint16_t length, uint32_t timeout)
+{
+    (void)timeout;
+    if (length == 0) {
+        return true;
+    }
+    RTTRing& ring = _SEGGER_RTT.up[0];
+
+    // Any context may write; the offset is claimed and published under PRIMASK
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t write_offset = ring.write_offset;
+    const uint32_t read_offset = ring.read_offset;
+    const uint32_t free = read_offset > write_offset
+        ? read_offset - write_offset - 1
+        : ring.size - (write_offset - read_offset) - 1;
+    if (length > free) {
+        dropped_ = dropped_ + 1;
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    const uint32_t first = ring.size - write_offset < length ? ring.size - write_offset : length;
+    memcpy(ring.buffer + write_offset, data, first);
+    memcpy(ring.buffer, data + first, length - first);
+    write_offset += length;
+    if (write_offset >= ring.size) {
+        write_offset -= ring.size;
+    }
+    __DMB();   // Data before the offset that makes it visible
+    ring.write_offset = write_offset;
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool RTT::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+uint16_t RTT::availableForWrite() const
+{
+    const RTTRing& ring = _SEGGER_RTT.up[0];
+    const uint32_t write_offset = ring.write_offset;
+    const uint32_t read_offset = ring.read_offset;
+    const uint32_t free = read_offset > write_offset
+        ? read_offset - write_offset - 1
+        : ring.size - (write_offset - read_offset) - 1;
+    return free > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(free);
+}
+
+uint16_t RTT::available() const
+{
+    const RTTRing& ring = _SEGGER_RTT.down[0];
+    const uint32_t write_offset = ring.write_offset;
+    const uint32_t read_offset = ring.read_offset;
+    const uint32_t count = write_offset >= read_offset
+        ? write_offset - read_offset
+        : ring.size - read_offset + write_offset;
+    return static_cast<uint16_t>(count);
+}
+
+uint16_t RTT::read(uint8_t* buffer, uint16_t length)
+{
+    RTTRing& ring = _SEGGER_RTT.down[0];
+    uint32_t read_offset = ring.read_offset;
+    const uint32_t write_offset = ring.write_offset;
+    uint16_t count = 0;
+    while (count < length && read_offset != write_offset) {
+        buffer[count++] = ring.buffer[read_offset];
+        if (++read_offset == ring.size) {
+            read_offset = 0;
+        }
+    }
+    __DMB();   // Bytes read before the probe may reuse them
+    ring.read_offset = read_offset;
+    return count;
+}
+
+int RTT::read()
+{
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "format.h"
+
+// Size of the target-to-host ring (power of two not required)
+#ifndef LUMOS_RTT_UP_SIZE
+#define LUMOS_RTT_UP_SIZE 4096
+#endif
+
+// Size of the host-to-target ring
+#ifndef LUMOS_RTT_DOWN_SIZE
+#define LUMOS_RTT_DOWN_SIZE 64
+#endif
+
+// Ring buffers in RAM read by a debug probe in the background (SEGGER RTT)
+//
+// write() copies into a ring in RAM and returns; a probe (ST-Link or
+// CMSIS-DAP through OpenOCD, `lumos monitor --rtt`, or any RTT viewer)
+// reads it over SWD while the core runs. No peripheral, pin or interrupt
+// is involved, so logging costs only the copy and runs at the probe's
+// speed, typically 1-2 MB/s.
+//
+// RTTCom has the same interface as SerialCom, so text and the framework's
+// tokenized logs and traces go through it unchanged:
+//
+//   RTTCom.printf("t=%u ms  temp=%.1f C\r\n", HAL_GetTick(), temp);
+//   tlog.Flush(RTTCom);           // framework/token_log.h
+//   FlushTrace(RTTCom);           // trace.h
+//
+//   uint8_t command[16];
+//   uint16_t n = RTTCom.read(command, sizeof(command));   // From the host
+//
+// The control block is the global _SEGGER_RTT; `lumos monitor --rtt`
+// takes its address from build/firmware.elf, other tools find it by the
+// "SEGGER RTT" id in RAM. It is initialized data, so output written
+// before setup() is kept. When no probe reads, or it falls
+// behind, a write() that does not fit is dropped whole (never blocks,
+// never splits a token log frame) and counted in dropped(). On the H7 the
+// block and rings live in DTCM, which the D-cache does not hold, so the
+// probe always sees what the core wrote.
+class RTT : public Print<RTT>
+{
+public:
+    constexpr RTT() : dropped_(0) {}
+
+    // Same signature as Serial::write(); timeout is ignored, a write
+    // either fits now or is dropped
+    bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 0);
+    bool write(uint8_t byte);
+    // print(), println() and printf() are inherited from Print (format.h)
+
+    // Free space in the up ring, and writes dropped because it was full
+    uint16_t availableForWrite() const;
+    uint32_t dropped() const { return dropped_; }
+
+    // Data from the host (down ring)
+    uint16_t available() const;
+    uint16_t read(uint8_t* buffer, uint16_t length);
+    int read();  // Read single byte, returns -1 if no data
+
+private:
+    volatile uint32_t dropped_;
+};
+
+extern RTT RTTCom;
@@ -1,24 +1,15 @@
 #include "sd.h"
+#include "peripherals.h"
+#include "memory_sections.h"
 
 // SD card functionality is only available on platforms with SDMMC peripheral
 #ifdef HAL_SD_MODULE_ENABLED
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
-#endif
-}
+#include "sys.h"
+#include <cstring>
+
+// Cards with DMA enabled, for routing the HAL callbacks
+static SDCard* dma_sd_instances[2] = {nullptr};
 
 SDCard::SDCard(SDMMC_TypeDef* sdmmc_instance,
                GPIO_TypeDef* cmd_port, uint16_t cmd_pin,
@@ -30,6 +21,12 @@ SDCard::SDCard(SDMMC_TypeDef* sdmmc_instance,
                uint32_t alternate_function)
     : sd_handle_{},
       initialized_(false),
+      bus_speed_(BusSpeed::DEFAULT_SPEED),
+      dma_ready_(false),
+      busy_(false),
+      rx_buffer_(nullptr),
+      rx_length_(0),
+      callback_(nullptr),
       cmd_port_(cmd_port),
       cmd_pin_(cmd_pin),
       clk_port_(clk_port),
@@ -55,60 +52,20 @@ SDCard::SDCard(SDMMC_TypeDef* sdmmc_instance,
     sd_handle_.Init.ClockDiv = 2;  // Divider for clock speed
 }
 
-bool SDCard::begin(BusWidth width)
+bool SDCard::begin(BusWidth width, BusSpeed speed)
 {
-    // Set bus width
-    if (width == BusWidth::BUS_1BIT) {
-        sd_handle_.Init.BusWide = SDMMC_BUS_WIDE_1B;
-    } else {
-        sd_handle_.Init.BusWide = SDMMC_BUS_WIDE_4B;
-    }
-
-    // Enable GPIO port clocks
-    enableGPIOClock(cmd_port_);
-    enableGPIOClock(clk_port_);
-    enableGPIOClock(d0_port_);
-    enableGPIOClock(d1_port_);
-    enableGPIOClock(d2_port_);
-    enableGPIOClock(d3_port_);
-
-    // Configure GPIO pins for SDMMC
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
+    // Identification always runs on one data line; the width is switched
+    // once the card is in transfer state
+    sd_handle_.Init.BusWide = SDMMC_BUS_WIDE_1B;
+    bus_speed_ = BusSpeed::DEFAULT_SPEED;
 
-    // Configure CMD pin
-    GPIO_InitStruct.Pin = cmd_pin_;
-    HAL_GPIO_Init(cmd_port_, &GPIO_InitStruct);
-
-    // Configure CLK pin
-    GPIO_InitStruct.Pin = clk_pin_;
-    HAL_GPIO_Init(clk_port_, &GPIO_InitStruct);
-
-    // Configure D0 pin
-    GPIO_InitStruct.Pin = d0_pin_;
-    HAL_GPIO_Init(d0_port_, &GPIO_InitStruct);
-
-    // Configure D1 pin
-    GPIO_InitStruct.Pin = d1_pin_;
-    HAL_GPIO_Init(d1_port_, &GPIO_InitStruct);
-
-    // Configure D2 pin
-    GPIO_InitStruct.Pin = d2_pin_;
-    HAL_GPIO_Init(d2_port_, &GPIO_InitStruct);
-
-    // Configure D3 pin
-    GPIO_InitStruct.Pin = d3_pin_;
-    HAL_GPIO_Init(d3_port_, &GPIO_InitStruct);
+    // Configure CMD, CLK and D0-D3 pins
+    const PinRef pins[] = {{cmd_port_, cmd_pin_}, {clk_port_, clk_pin_}, {d0_port_, d0_pin_},
+                           {d1_port_, d1_pin_}, {d2_port_, d2_pin_}, {d3_port_, d3_pin_}};
+    initAlternatePins(pins, 6, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_VERY_HIGH, alternate_function_);
 
     // Enable SDMMC peripheral clock
-    if (sd_handle_.Instance == SDMMC1) {
-        __HAL_RCC_SDMMC1_CLK_ENABLE();
-    } else if (sd_handle_.Instance == SDMMC2) {
-        __HAL_RCC_SDMMC2_CLK_ENABLE();
-    }
+    enablePeripheralClock(sd_handle_.Instance);
 
     // Initialize SDMMC peripheral
     if (HAL_SD_Init(&sd_handle_) != HAL_OK) {
@@ -116,21 +73,73 @@ bool SDCard::begin(BusWidth width)
         return false;
     }
 
-    // Configure bus width if different from initialization
-    if (width == BusWidth::BUS_4BIT && sd_handle_.Init.BusWide == SDMMC_BUS_WIDE_1B) {
+    // Configure bus width
+    if (width == BusWidth::BUS_4BIT) {
         if (HAL_SD_ConfigWideBusOperation(&sd_handle_, SDMMC_BUS_WIDE_4B) != HAL_OK) {
             initialized_ = false;
             return false;
         }
     }
 
+    // Default speed caps the card clock at 25 MHz; a card that declines
+    // the switch stays there
+    if (speed != BusSpeed::DEFAULT_SPEED && switchHighSpeed()) {
+        bus_speed_ = BusSpeed::HIGH_SPEED;
+        setClockLimit(50000000);
+    } else {
+        setClockLimit(25000000);
+    }
+
     initialized_ = true;
     return true;
 }
 
+// CMD6 switch to high speed (SDR25), through the HAL on the SDMMC families
+bool SDCard::switchHighSpeed()
+{
+#if defined(STM32H7) || defined(STM32H5)
+    if (HAL_SD_ConfigSpeedBusOperation(&sd_handle_, SDMMC_SPEED_MODE_HIGH) != HAL_OK) {
+        return false;
+    }
+    return HAL_SD_GetCardState(&sd_handle_) == HAL_SD_CARD_TRANSFER;
+#else
+    return false;
+#endif
+}
+
+// Fastest card clock up to max_hz: f = kernel / (2 * CLKDIV), or the
+// kernel clock itself with CLKDIV = 0
+void SDCard::setClockLimit(uint32_t max_hz)
+{
+#if defined(STM32H7) || defined(STM32H5)
+#if defined(STM32H7)
+    const uint32_t kernel_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC);
+#else
+    const uint32_t kernel_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC1);
+#endif
+    if (kernel_hz == 0) {
+        return;
+    }
+
+    uint32_t div = 0;
+    if (kernel_hz > max_hz) {
+        div = (kernel_hz + 2 * max_hz - 1) / (2 * max_hz);
+    }
+    sd_handle_.Init.ClockDiv = div;
+    MODIFY_REG(sd_handle_.Instance->CLKCR, SDMMC_CLKCR_CLKDIV, div);
+#else
+    (void)max_hz;
+#endif
+}
+
 void SDCard::end()
 {
     if (initialized_) {
+        if (busy_) {
+            HAL_SD_Abort(&sd_handle_);
+            busy_ = false;
+        }
+        dma_ready_ = false;
         HAL_SD_DeInit(&sd_handle_);
 
         // Deinitialize GPIO pins
@@ -225,6 +234,166 @@ bool SDCard::eraseBlocks(uint32_t start_block, uint32_t end_block, uint32_t time
     return waitReady(timeout);
 }
 
+bool SDCard::beginDma(IRQn_Type irq)
+{
+#if defined(STM32H7) || defined(STM32H5)
+    if (!initialized_) {
+        return false;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < 2; i++) {
+        if (dma_sd_instances[i] == this) { slot = i; break; }
+        if (slot < 0 && dma_sd_instances[i] == nullptr) slot = i;
+    }
+    if (slot < 0) {
+        return false;
+    }
+    dma_sd_instances[slot] = this;
+
+    HAL_NVIC_SetPriority(irq, 5, 0);
+    HAL_NVIC_EnableIRQ(irq);
+    dma_ready_ = true;
+    return true;
+#else
+    // SDIO on these families needs DMA streams linked by the board
+    (void)irq;
+    return false;
+#endif
+}
+
+bool SDCard::isDmaBuffer(const void* buffer, bool read) const
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+
+    // IDMA transfers whole words
+    if (buffer == nullptr || (address % 4) != 0) {
+        return false;
+    }
+
+#if defined(STM32H7)
+    // IDMA cannot reach the tightly coupled memories, and SDMMC1 (on the
+    // AXI bus) not the D2/D3 SRAMs either
+    const bool itcm = address < 0x00010000;
+    const bool dtcm = address >= 0x20000000 && address < 0x20020000;
+    const bool d2_d3 = address >= 0x30000000 && address < 0x40000000;
+    if (itcm || dtcm || (sd_handle_.Instance == SDMMC1 && d2_d3)) {
+        return false;
+    }
+    // Invalidating a cache line shared with other data would discard it
+    if (read && isDCacheable(buffer) && (address % 32) != 0) {
+        return false;
+    }
+#else
+    (void)read;
+#endif
+    return true;
+}
+
+bool SDCard::readBlocksAsync(uint32_t block_address, uint8_t* buffer, uint32_t num_blocks,
+                             Callback callback)
+{
+    if (!dma_ready_ || busy_ || num_blocks == 0 || !isDmaBuffer(buffer, true)) {
+        return false;
+    }
+    if (HAL_SD_GetCardState(&sd_handle_) != HAL_SD_CARD_TRANSFER) {
+        return false;
+    }
+
+    const uint32_t length = num_blocks * BLOCKSIZE;
+    // No dirty line may be written back over the received data
+    invalidateDCache(buffer, length);
+
+    // Set up before starting, the completion interrupt can come at once
+    rx_buffer_ = buffer;
+    rx_length_ = length;
+    callback_ = std::move(callback);
+    busy_ = true;
+
+    if (HAL_SD_ReadBlocks_DMA(&sd_handle_, buffer, block_address, num_blocks) != HAL_OK) {
+        busy_ = false;
+        rx_buffer_ = nullptr;
+        callback_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool SDCard::writeBlocksAsync(uint32_t block_address, const uint8_t* buffer, uint32_t num_blocks,
+                              Callback callback, bool pre_erase)
+{
+    if (!dma_ready_ || busy_ || num_blocks == 0 || !isDmaBuffer(buffer, false)) {
+        return false;
+    }
+    if (HAL_SD_GetCardState(&sd_handle_) != HAL_SD_CARD_TRANSFER) {
+        return false;
+    }
+    // ACMD23 applies to the next CMD25 only, so it goes right before it
+    if (pre_erase && num_blocks > 1 && !setWriteEraseCount(num_blocks)) {
+        return false;
+    }
+
+    cleanDCache(buffer, num_blocks * BLOCKSIZE);
+
+    rx_buffer_ = nullptr;
+    callback_ = std::move(callback);
+    busy_ = true;
+
+    if (HAL_SD_WriteBlocks_DMA(&sd_handle_, const_cast<uint8_t*>(buffer), block_address, num_blocks) != HAL_OK) {
+        busy_ = false;
+        callback_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool SDCard::setWriteEraseCount(uint32_t num_blocks)
+{
+#if defined(STM32H7) || defined(STM32H5)
+    // ACMD23 (SET_WR_BLK_ERASE_COUNT): CMD55, then CMD23 with the count in bits 22:0
+    uint32_t error = SDMMC_CmdAppCommand(sd_handle_.Instance, sd_handle_.SdCard.RelCardAdd << 16);
+    if (error == SDMMC_ERROR_NONE) {
+        error = SDMMC_CmdBlockCount(sd_handle_.Instance, num_blocks & 0x007FFFFF);
+    }
+    return error == SDMMC_ERROR_NONE;
+#else
+    (void)num_blocks;
+    return false;
+#endif
+}
+
+bool SDCard::waitIdle(uint32_t timeout)
+{
+    const uint32_t start = HAL_GetTick();
+
+    while (busy_) {
+        if ((HAL_GetTick() - start) >= timeout) {
+            return false;
+        }
+    }
+
+    const uint32_t elapsed = HAL_GetTick() - start;
+    return waitReady(elapsed < timeout ? timeout - elapsed : 1);
+}
+
+void SDCard::onTransferComplete(bool ok)
+{
+    // Drop lines speculatively fetched while the DMA was writing
+    if (rx_buffer_ != nullptr) {
+        invalidateDCache(rx_buffer_, rx_length_);
+    }
+    rx_buffer_ = nullptr;
+
+    // Cleared first, so the callback can start the next transfer
+    Callback callback = std::move(callback_);
+    callback_ = nullptr;
+    busy_ = false;
+
+    if (callback) {
+        callback(ok);
+    }
+}
+
 uint64_t SDCard::getCapacity()
 {
     if (!initialized_) {
@@ -294,6 +463,25 @@ SDCard::CardType SDCard::getCardType()
     }
 }
 
+uint32_t SDCard::getAllocationUnitBlocks()
+{
+    if (!initialized_) {
+        return 0;
+    }
+
+    HAL_SD_CardStatusTypeDef status;
+    if (HAL_SD_GetCardStatus(&sd_handle_, &status) != HAL_OK) {
+        return 0;
+    }
+
+    // AU_SIZE code from the SD status register, in KB
+    static const uint32_t au_kb[16] = {
+        0, 16, 32, 64, 128, 256, 512, 1024,
+        2048, 4096, 8192, 12288, 16384, 24576, 32768, 65536
+    };
+    return au_kb[status.AllocationUnitSize & 0x0F] * 1024 / BLOCKSIZE;
+}
+
 bool SDCard::isCardPresent()
 {
     if (!initialized_) {
@@ -347,13 +535,53 @@ SDCard& SDCard::setBusWidth(BusWidth width)
 
 SDCard& SDCard::setClockSpeed(uint32_t clock_div)
 {
+    sd_handle_.Init.ClockDiv = clock_div;
     if (initialized_) {
-        sd_handle_.Init.ClockDiv = clock_div;
-        HAL_SD_Init(&sd_handle_);
+        // Only the divider changes, the card stays in transfer state
+        MODIFY_REG(sd_handle_.Instance->CLKCR, SDMMC_CLKCR_CLKDIV, clock_div);
     }
     return *this;
 }
 
+uint32_t SDCard::getClockHz() const
+{
+#if defined(STM32H7) || defined(STM32H5)
+#if defined(STM32H7)
+    const uint32_t kernel_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC);
+#else
+    const uint32_t kernel_hz = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC1);
+#endif
+    const uint32_t div = sd_handle_.Instance->CLKCR & SDMMC_CLKCR_CLKDIV;
+    return (div == 0) ? kernel_hz : kernel_hz / (2 * div);
+#else
+    return 0;
+#endif
+}
+
+uint32_t SDCard::measureThroughput(uint32_t block_address, uint8_t* buffer, uint32_t num_blocks, bool write)
+{
+    if (!initialized_ || buffer == nullptr || num_blocks == 0) {
+        return 0;
+    }
+
+    const uint64_t start = GetCurrentTimeUs();
+    bool ok;
+    if (dma_ready_ && isDmaBuffer(buffer, !write)) {
+        ok = write ? writeBlocksAsync(block_address, buffer, num_blocks)
+                   : readBlocksAsync(block_address, buffer, num_blocks);
+        ok = ok && waitIdle();
+    } else {
+        ok = write ? writeBlocks(block_address, buffer, num_blocks)
+                   : readBlocks(block_address, buffer, num_blocks);
+    }
+    const uint64_t elapsed_us = GetCurrentTimeUs() - start;
+
+    if (!ok || elapsed_us == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)num_blocks * BLOCKSIZE * 1000000 / elapsed_us);
+}
+
 bool SDCard::waitReady(uint32_t timeout)
 {
     uint32_t start = HAL_GetTick();
@@ -368,4 +596,275 @@ bool SDCard::waitReady(uint32_t timeout)
     return false;
 }
 
+// ===== SDStreamWriter =====
+
+SDStreamWriter::SDStreamWriter(SDCard& card, uint8_t* buffers, uint32_t buffer_blocks)
+    : card_(card),
+      buffers_{buffers, buffers + buffer_blocks * BLOCK_SIZE},
+      buffer_blocks_(buffer_blocks),
+      fill_{0, 0},
+      full_{false, false},
+      block_{0, 0},
+      writing_(-1),
+      next_write_(0),
+      active_(0),
+      start_block_(0),
+      next_block_(0),
+      end_block_(0),
+      pre_erase_(false),
+      submit_us_{0, 0},
+      last_latency_us_(0),
+      max_latency_us_(0),
+      latency_budget_us_(0),
+      slow_writes_(0),
+      bytes_written_(0),
+      overruns_(0),
+      error_(true)  // Until begin()
+{
+}
+
+bool SDStreamWriter::begin(uint32_t start_block, uint32_t block_count)
+{
+    const uint32_t card_blocks = card_.getBlockCount();
+    if (buffer_blocks_ == 0 || start_block >= card_blocks ||
+        !card_.isDmaBuffer(buffers_[0], false) || !card_.isDmaBuffer(buffers_[1], false)) {
+        return false;
+    }
+
+    if (block_count == 0 || block_count > card_blocks - start_block) {
+        block_count = card_blocks - start_block;
+    }
+
+    fill_[0] = fill_[1] = 0;
+    full_[0] = full_[1] = false;
+    writing_ = -1;
+    next_write_ = 0;
+    active_ = 0;
+    start_block_ = start_block;
+    next_block_ = start_block;
+    end_block_ = start_block + block_count;
+    pre_erase_ = false;
+    bytes_written_ = 0;
+    overruns_ = 0;
+    error_ = false;
+    resetLatencyStats();
+    return true;
+}
+
+bool SDStreamWriter::beginLogging(uint32_t start_block, uint32_t block_count, uint32_t erase_timeout)
+{
+    const uint32_t card_blocks = card_.getBlockCount();
+    uint32_t au = card_.getAllocationUnitBlocks();
+    if (au == 0) {
+        au = 1;
+    }
+
+    // Whole AUs only: a partly written AU is what the card has to clean up
+    const uint64_t first = ((uint64_t)start_block + au - 1) / au * au;
+    if (first >= card_blocks) {
+        return false;
+    }
+    uint64_t count = card_blocks - first;
+    if (block_count != 0 && block_count < count) {
+        count = block_count;
+    }
+    if (count >= au) {
+        count -= count % au;
+    }
+
+    if (!begin((uint32_t)first, (uint32_t)count)) {
+        return false;
+    }
+    error_ = true;  // Nothing may be written until the erase is done
+    if (!card_.eraseBlocks((uint32_t)first, (uint32_t)(first + count - 1), erase_timeout)) {
+        return false;
+    }
+    pre_erase_ = true;
+    error_ = false;
+    return true;
+}
+
+void SDStreamWriter::resetLatencyStats()
+{
+    last_latency_us_ = 0;
+    max_latency_us_ = 0;
+    slow_writes_ = 0;
+}
+
+uint32_t SDStreamWriter::write(const void* data, uint32_t length)
+{
+    if (error_ || data == nullptr) {
+        return 0;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t taken = 0;
+
+    while (taken < length) {
+        if (full_[active_]) {
+            // Both buffers are queued: the card is behind
+            overruns_++;
+            break;
+        }
+
+        // The last buffer may be cut short by the end of the region
+        uint32_t blocks = end_block_ - next_block_;
+        if (blocks > buffer_blocks_) {
+            blocks = buffer_blocks_;
+        }
+        const uint32_t capacity = blocks * BLOCK_SIZE;
+        const uint32_t fill = fill_[active_];
+        if (fill >= capacity) {
+            break;  // Region full
+        }
+
+        uint32_t chunk = capacity - fill;
+        if (chunk > length - taken) {
+            chunk = length - taken;
+        }
+        memcpy(buffers_[active_] + fill, bytes + taken, chunk);
+        fill_[active_] = fill + chunk;
+        taken += chunk;
+
+        if (fill + chunk == capacity) {
+            submit(active_);
+            active_ ^= 1;
+        }
+    }
+    return taken;
+}
+
+void SDStreamWriter::poll()
+{
+    if (!error_) {
+        startPending();
+    }
+}
+
+bool SDStreamWriter::flush(uint32_t timeout)
+{
+    if (error_) {
+        return false;
+    }
+
+    const uint32_t start = HAL_GetTick();
+
+    // Pad the partial block, the card only takes whole ones
+    const uint32_t fill = fill_[active_];
+    if (!full_[active_] && fill > 0) {
+        const uint32_t padded = (fill + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        memset(buffers_[active_] + fill, 0, padded - fill);
+        submit(active_);
+        active_ ^= 1;
+    }
+
+    while (full_[0] || full_[1]) {
+        if (error_ || (HAL_GetTick() - start) >= timeout) {
+            return false;
+        }
+        startPending();
+    }
+
+    const uint32_t elapsed = HAL_GetTick() - start;
+    return !error_ && card_.waitIdle(elapsed < timeout ? timeout - elapsed : 1);
+}
+
+void SDStreamWriter::submit(uint8_t index)
+{
+    block_[index] = next_block_;
+    next_block_ += (fill_[index] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    submit_us_[index] = GetCurrentTimeUs();
+    full_[index] = true;
+    startPending();
+}
+
+// Called from the main loop and from the completion interrupt
+void SDStreamWriter::startPending()
+{
+    // Only claiming the buffer needs interrupts off; no transfer is
+    // running while it is claimed, so no completion can interfere
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint8_t index = next_write_;
+    if (writing_ >= 0 || !full_[index]) {
+        __set_PRIMASK(primask);
+        return;
+    }
+    writing_ = index;
+    next_write_ = index ^ 1;
+    __set_PRIMASK(primask);
+
+    const uint32_t blocks = (fill_[index] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (!card_.writeBlocksAsync(block_[index], buffers_[index], blocks,
+                                [this](bool ok) { onWriteComplete(ok); }, pre_erase_)) {
+        // Still programming the last write; poll() retries
+        next_write_ = index;
+        writing_ = -1;
+    }
+}
+
+void SDStreamWriter::onWriteComplete(bool ok)
+{
+    const int8_t index = writing_;
+    writing_ = -1;
+    if (index < 0) {
+        return;
+    }
+
+    if (ok) {
+        bytes_written_ += fill_[index];
+
+        const uint64_t latency = GetCurrentTimeUs() - submit_us_[index];
+        const uint32_t latency_us = latency > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)latency;
+        last_latency_us_ = latency_us;
+        if (latency_us > max_latency_us_) {
+            max_latency_us_ = latency_us;
+        }
+        if (latency_budget_us_ != 0 && latency_us > latency_budget_us_) {
+            slow_writes_++;
+        }
+    } else {
+        error_ = true;
+    }
+    fill_[index] = 0;
+    full_[index] = false;
+
+    if (!error_) {
+        startPending();
+    }
+}
+
+// HAL Callbacks (called from HAL_SD_IRQHandler)
+
+static SDCard* findDmaCard(SD_HandleTypeDef* hsd)
+{
+    for (SDCard* instance : dma_sd_instances) {
+        if (instance != nullptr && instance->getHandle() == hsd) {
+            return instance;
+        }
+    }
+    return nullptr;
+}
+
+extern "C" void HAL_SD_TxCpltCallback(SD_HandleTypeDef* hsd)
+{
+    if (SDCard* card = findDmaCard(hsd)) {
+        card->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_SD_RxCpltCallback(SD_HandleTypeDef* hsd)
+{
+    if (SDCard* card = findDmaCard(hsd)) {
+        card->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_SD_ErrorCallback(SD_HandleTypeDef* hsd)
+{
+    if (SDCard* card = findDmaCard(hsd)) {
+        card->onTransferComplete(false);
+    }
+}
+
 #endif // HAL_SD_MODULE_ENABLED
@@ -25,6 +25,10 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
 #endif
 
+#include <cstdint>
+#include <functional>
+#include "trace.h"
+
 // SDCard Class - SD Card interface via SDMMC
 // Usage Example:
 //   sdcard.begin();  // Initialize SD card
@@ -44,6 +48,60 @@
 //   // Get card info
 //   uint64_t capacity = sdcard.getCapacity();
 //   uint32_t blockSize = sdcard.getBlockSize();
+//
+// begin() switches the card to high speed (50 MHz, CMD6) when it supports
+// it (H7, H5) and sets the SDMMC clock to match; the result and the
+// throughput actually reached can be checked:
+//
+//   sdcard.begin(SDCard::BusWidth::BUS_4BIT, SDCard::BusSpeed::AUTO);
+//   bool fast = sdcard.getBusSpeed() == SDCard::BusSpeed::HIGH_SPEED;
+//   uint32_t hz = sdcard.getClockHz();
+//   uint32_t read_bps = sdcard.measureThroughput(0, buffer, 64, false);
+//
+// After beginDma(), transfers can run through the SDMMC's internal DMA
+// (IDMA, H7 and H5) while the CPU does other work. The board forwards the
+// SDMMC interrupt:
+//
+//   sdcard.begin();
+//   sdcard.beginDma(SDMMC1_IRQn);
+//   extern "C" void SDMMC1_IRQHandler(void) { sdcard.handleInterrupt(); }
+//
+//   alignas(32) static uint8_t block_buffer[8 * 512];
+//   sdcard.readBlocksAsync(0, block_buffer, 8, [](bool ok) { read_done = ok; });
+//
+// Buffers must stay valid until the callback has run and be 4-byte
+// aligned. On the H7 SDMMC1 only reaches AXI SRAM (RAM_D1, where .bss
+// lives) and external memory, SDMMC2 also the D2 SRAMs; buffers are
+// cleaned from the D-cache before writes, and read buffers must be
+// 32-byte aligned so they can be invalidated safely.
+//
+// Streaming writes (data logging): SDStreamWriter collects data into two
+// buffers and writes each one as a single multi-block command while the
+// other fills, so the card always has a large transfer queued:
+//
+//   alignas(32) static uint8_t log_buffers[2 * 64 * 512];  // 2 x 32 KB
+//   SDStreamWriter logger{sdcard, log_buffers, 64};
+//   logger.begin(start_block);
+//
+//   void loop() {
+//       logger.write(&sample, sizeof(sample));  // Copies, never waits for the card
+//       logger.poll();                          // Restarts writes the card delayed
+//   }
+//
+//   logger.flush();  // Pads and writes the last partial block
+//
+// For timing-critical logging, beginLogging() instead erases the region up
+// front, aligns it to the card's allocation unit (AU) and announces each
+// write with ACMD23 (SET_WR_BLK_ERASE_COUNT), which keeps the card out of
+// garbage collection on the way. Keep buffer_blocks a divisor of the AU
+// (typically 4 MB); the latency statistics show how close writes come to
+// the budget:
+//
+//   logger.beginLogging(start_block, 1024 * 1024 * 2);  // 1 GB, erased now
+//   logger.setLatencyBudget(50000);                     // 50 ms per buffer
+//   ...
+//   uint32_t worst = logger.getMaxWriteLatencyUs();
+//   uint32_t late = logger.getSlowWrites();
 
 // SD card class is only available on platforms with SDMMC peripheral
 #ifdef HAL_SD_MODULE_ENABLED
@@ -63,9 +121,27 @@ public:
         BUS_4BIT = 1
     };
 
+    // UHS modes need a 1.8 V signalling transceiver, which no board has
+    enum class BusSpeed {
+        DEFAULT_SPEED,   // Up to 25 MHz
+        HIGH_SPEED,      // Up to 50 MHz, after a CMD6 switch
+        AUTO             // High speed if the card supports it (begin() only)
+    };
+
+    // Completion of an async transfer, called from the SDMMC interrupt
+    using Callback = std::function<void(bool ok)>;
+
 private:
     SD_HandleTypeDef sd_handle_;
     bool initialized_;
+    BusSpeed bus_speed_;
+
+    // DMA (IDMA) transfers
+    bool dma_ready_;
+    volatile bool busy_;
+    uint8_t* rx_buffer_;     // Invalidated again once a read completes
+    uint32_t rx_length_;
+    Callback callback_;
 
     // GPIO configuration
     GPIO_TypeDef* cmd_port_;
@@ -94,7 +170,7 @@ public:
            uint32_t alternate_function);
 
     // Initialization
-    bool begin(BusWidth width = BusWidth::BUS_4BIT);
+    bool begin(BusWidth width = BusWidth::BUS_4BIT, BusSpeed speed = BusSpeed::AUTO);
     void end();
 
     // Single block operations (512 bytes per block)
@@ -108,11 +184,49 @@ public:
     // Erase operations
     bool eraseBlocks(uint32_t start_block, uint32_t end_block, uint32_t timeout = 10000);
 
+    /**
+     * @brief Enable interrupt-driven IDMA transfers
+     * @param irq Interrupt of this SDMMC, e.g. SDMMC1_IRQn
+     * @return false if not initialized or the family has no IDMA (G0, G4, F4)
+     */
+    bool beginDma(IRQn_Type irq);
+
+    /**
+     * @brief Start a DMA read or write of num_blocks and return at once
+     * @param pre_erase Writes only: send ACMD23 first so the card can
+     *        pre-erase num_blocks for the multi-block write
+     * @return false if DMA is not set up, a transfer is running, the card is
+     *         not ready or the buffer is unusable for DMA (the callback is
+     *         not called then)
+     */
+    bool readBlocksAsync(uint32_t block_address, uint8_t* buffer, uint32_t num_blocks,
+                         Callback callback = nullptr);
+    bool writeBlocksAsync(uint32_t block_address, const uint8_t* buffer, uint32_t num_blocks,
+                          Callback callback = nullptr, bool pre_erase = false);
+
+    // An async transfer is running
+    bool isBusy() const { return busy_; }
+    bool isDmaReady() const { return dma_ready_; }
+
+    // Wait until the async transfer has finished and the card is ready again
+    bool waitIdle(uint32_t timeout = 5000);
+
+    // Called from the board's SDMMC IRQ handler
+    void handleInterrupt() { LUMOS_TRACE_ISR("sd irq"); HAL_SD_IRQHandler(&sd_handle_); }
+
+    // Called from the HAL callbacks
+    void onTransferComplete(bool ok);
+    SD_HandleTypeDef* getHandle() { return &sd_handle_; }
+
+    // Buffer address and alignment are usable for DMA reads or writes
+    bool isDmaBuffer(const void* buffer, bool read) const;
+
     // Card information
     uint64_t getCapacity();          // Total capacity in bytes
     uint32_t getBlockSize();         // Block size in bytes (typically 512)
     uint32_t getBlockCount();        // Total number of blocks
     CardType getCardType();          // Card type (SDSC, SDHC, SDXC)
+    uint32_t getAllocationUnitBlocks();  // AU size from the SD status, 0 if unknown
     bool isCardPresent();            // Check if card is inserted
     bool isWriteProtected();         // Check write protection status
 
@@ -123,10 +237,130 @@ public:
 
     // Advanced configuration
     SDCard& setBusWidth(BusWidth width);
-    SDCard& setClockSpeed(uint32_t clock_div);
+    SDCard& setClockSpeed(uint32_t clock_div);  // Raw CLKDIV (H7/H5: kernel clock / (2 * div), 0 = bypass)
+
+    // Bus speed mode and card clock in use
+    BusSpeed getBusSpeed() const { return bus_speed_; }
+    uint32_t getClockHz() const;
+
+    /**
+     * @brief Time a transfer of num_blocks and return bytes per second
+     * @param write Write buffer to the card instead of reading (destroys
+     *        what was stored there)
+     * @return 0 if the transfer failed
+     */
+    uint32_t measureThroughput(uint32_t block_address, uint8_t* buffer, uint32_t num_blocks, bool write);
 
 private:
     bool waitReady(uint32_t timeout = 1000);
+    bool setWriteEraseCount(uint32_t num_blocks);
+    bool switchHighSpeed();
+    void setClockLimit(uint32_t max_hz);
+};
+
+// Double-buffered sequential writer for logging
+//
+// Data is copied into one buffer while the other is written to the card
+// as one multi-block command. The next write is started straight from the
+// completion interrupt when the card is ready again, otherwise by poll().
+class SDStreamWriter
+{
+public:
+    static constexpr uint32_t BLOCK_SIZE = 512;
+
+    /**
+     * @param card Card with beginDma() done
+     * @param buffers Storage for both buffers, 2 * buffer_blocks * 512 bytes,
+     *        usable for SD DMA (see SDCard)
+     * @param buffer_blocks Blocks per buffer; larger buffers mean fewer
+     *        commands and ride out longer card stalls
+     */
+    SDStreamWriter(SDCard& card, uint8_t* buffers, uint32_t buffer_blocks);
+
+    /**
+     * @brief Start writing at start_block
+     * @param block_count Blocks available for the stream (0 = up to the end of the card)
+     */
+    bool begin(uint32_t start_block, uint32_t block_count = 0);
+
+    /**
+     * @brief Start a logging stream with consistent write latency
+     *
+     * Moves start_block up to the next AU boundary, trims the region to
+     * whole AUs, erases it (blocking, can take seconds on large regions) and
+     * sends ACMD23 before every write.
+     * @param block_count Blocks wanted (0 = up to the end of the card)
+     * @param erase_timeout Time allowed for the erase in ms
+     * @return false if the card is not usable or the erase failed
+     */
+    bool beginLogging(uint32_t start_block, uint32_t block_count = 0, uint32_t erase_timeout = 60000);
+
+    /**
+     * @brief Append data
+     * @return Bytes taken; fewer than length when both buffers are waiting
+     *         for the card (counted as an overrun) or the region is full
+     */
+    uint32_t write(const void* data, uint32_t length);
+
+    // Start a full buffer the card was not ready for; call from the main loop
+    void poll();
+
+    /**
+     * @brief Write everything buffered, zero-padding the last block, and wait
+     * @return false on a write error or timeout
+     */
+    bool flush(uint32_t timeout = 5000);
+
+    // Next block the stream writes to
+    uint32_t getNextBlock() const { return next_block_; }
+    uint64_t getBytesWritten() const { return bytes_written_; }
+    uint32_t getOverruns() const { return overruns_; }
+    bool hasError() const { return error_; }
+
+    // First block of the region, after AU alignment in beginLogging()
+    uint32_t getStartBlock() const { return start_block_; }
+
+    // Buffer latency: from the buffer filling up until the card took it,
+    // including any wait for the card to finish the previous write
+    uint32_t getLastWriteLatencyUs() const { return last_latency_us_; }
+    uint32_t getMaxWriteLatencyUs() const { return max_latency_us_; }
+
+    // Count writes with a latency above budget_us (0 = off)
+    void setLatencyBudget(uint32_t budget_us) { latency_budget_us_ = budget_us; }
+    uint32_t getSlowWrites() const { return slow_writes_; }
+    void resetLatencyStats();
+
+    // Called from the card's completion callback
+    void onWriteComplete(bool ok);
+
+private:
+    SDCard& card_;
+    uint8_t* buffers_[2];
+    uint32_t buffer_blocks_;
+
+    volatile uint32_t fill_[2];   // Bytes in each buffer
+    volatile bool full_[2];       // Waiting for or in a card write
+    uint32_t block_[2];           // Target of each submitted buffer
+    volatile int8_t writing_;     // Buffer being written, -1 if none
+    volatile uint8_t next_write_; // Buffer due next; they go out in fill order
+    uint8_t active_;              // Buffer being filled
+
+    uint32_t start_block_;
+    uint32_t next_block_;         // Where the next submitted buffer goes
+    uint32_t end_block_;
+    bool pre_erase_;              // ACMD23 before each write
+
+    uint64_t submit_us_[2];       // When each buffer filled up
+    volatile uint32_t last_latency_us_;
+    volatile uint32_t max_latency_us_;
+    uint32_t latency_budget_us_;
+    volatile uint32_t slow_writes_;
+    volatile uint64_t bytes_written_;
+    volatile uint32_t overruns_;
+    volatile bool error_;
+
+    void submit(uint8_t index);
+    void startPending();
 };
 
 #endif // HAL_SD_MODULE_ENABLED
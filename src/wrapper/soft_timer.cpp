@@ -0,0 +1,253 @@
+#include "soft_timer.h"
+
+// ===== SoftTimer =====
+
+SoftTimer::SoftTimer(Handler handler, void* context)
+    : next_(nullptr),
+      pprev_(nullptr),
+      wheel_(nullptr),
+      expires_(0),
+      period_(0),
+      level_(0),
+      slot_(0),
+      handler_(handler),
+      context_(context)
+{
+}
+
+SoftTimer::~SoftTimer()
+{
+    if (wheel_ != nullptr) {
+        wheel_->cancel(*this);
+    }
+}
+
+// ===== TimerWheel =====
+
+TimerWheel::TimerWheel()
+    : occupied_{},
+      now_(0),
+      active_(0),
+      tick_timer_(nullptr),
+      last_count_(0),
+      count_mask_(0)
+{
+    for (uint8_t level = 0; level < LEVELS; level++) {
+        for (uint32_t slot = 0; slot < SLOTS; slot++) {
+            slots_[level][slot] = nullptr;
+        }
+    }
+}
+
+bool TimerWheel::begin(Timer& tick_timer)
+{
+    if (!tick_timer.isInitialized()) {
+        return false;
+    }
+
+    tick_timer_ = &tick_timer;
+    // Free-running timers count up to their full period (16 or 32 bits)
+    count_mask_ = tick_timer.getHandle()->Init.Period;
+    last_count_ = tick_timer.getCounter();
+    return true;
+}
+
+void TimerWheel::poll()
+{
+    if (tick_timer_ == nullptr) {
+        return;
+    }
+
+    const uint32_t count = tick_timer_->getCounter();
+    const uint32_t elapsed = (count - last_count_) & count_mask_;
+    last_count_ = count;
+    advance(elapsed);
+}
+
+void TimerWheel::advance(uint32_t ticks)
+{
+    while (ticks > 0) {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        // Jump straight to the next occupied slot or cascade point
+        const uint32_t step = (active_ == 0) ? ticks : ticksUntilNext();
+        if (step > ticks) {
+            now_ += ticks;
+            __set_PRIMASK(primask);
+            return;
+        }
+        now_ += step;
+        ticks -= step;
+
+        // At a level boundary pull the next coarse slots down, the highest
+        // first, since its timers can land in the slots below
+        uint8_t top = 0;
+        while (top < LEVELS - 1 && ((now_ >> (LEVEL_BITS * top)) & (SLOTS - 1)) == 0) {
+            top++;
+        }
+        for (uint8_t level = top; level > 0; level--) {
+            cascade(level);
+        }
+        __set_PRIMASK(primask);
+
+        expire();
+    }
+}
+
+uint32_t TimerWheel::ticksUntilNext() const
+{
+    if (active_ == 0) {
+        return MAX_DELAY;
+    }
+
+    // Level 0 slots ahead in this rotation, else the next cascade
+    const uint32_t pos = now_ & (SLOTS - 1);
+    const uint32_t ahead = occupied_[0] & ~((2u << pos) - 1);
+    if (ahead != 0) {
+        return (uint32_t)__builtin_ctz(ahead) - pos;
+    }
+    return SLOTS - pos;
+}
+
+void TimerWheel::startOnce(SoftTimer& timer, uint32_t delay_ticks)
+{
+    schedule(timer, delay_ticks, 0);
+}
+
+void TimerWheel::startPeriodic(SoftTimer& timer, uint32_t period_ticks, uint32_t first_delay)
+{
+    if (period_ticks == 0) {
+        return;
+    }
+    if (period_ticks > MAX_DELAY) {
+        period_ticks = MAX_DELAY;
+    }
+    schedule(timer, (first_delay != 0) ? first_delay : period_ticks, period_ticks);
+}
+
+void TimerWheel::cancel(SoftTimer& timer)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (timer.wheel_ == this) {
+        unlink(timer);
+        timer.wheel_ = nullptr;
+        active_--;
+    }
+    __set_PRIMASK(primask);
+}
+
+void TimerWheel::schedule(SoftTimer& timer, uint32_t delay_ticks, uint32_t period_ticks)
+{
+    if (delay_ticks == 0) {
+        delay_ticks = 1;
+    } else if (delay_ticks > MAX_DELAY) {
+        delay_ticks = MAX_DELAY;
+    }
+
+    // Restarting moves the timer, also off another wheel
+    if (timer.wheel_ != nullptr && timer.wheel_ != this) {
+        timer.wheel_->cancel(timer);
+    }
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (timer.wheel_ == this) {
+        unlink(timer);
+    } else {
+        timer.wheel_ = this;
+        active_++;
+    }
+    timer.expires_ = now_ + delay_ticks;
+    timer.period_ = period_ticks;
+    insert(timer);
+    __set_PRIMASK(primask);
+}
+
+// Called with interrupts disabled. The level is the highest digit in which
+// the expiry differs from now, so the slot is always ahead at that level
+// and reaches level 0 exactly on time through the cascades.
+void TimerWheel::insert(SoftTimer& timer)
+{
+    const uint32_t diff = timer.expires_ ^ now_;
+    uint8_t level = 0;
+    while (level < LEVELS - 1 && (diff >> (LEVEL_BITS * (level + 1))) != 0) {
+        level++;
+    }
+    const uint8_t slot = (timer.expires_ >> (LEVEL_BITS * level)) & (SLOTS - 1);
+
+    SoftTimer*& head = slots_[level][slot];
+    timer.next_ = head;
+    timer.pprev_ = &head;
+    if (head != nullptr) {
+        head->pprev_ = &timer.next_;
+    }
+    head = &timer;
+    timer.level_ = level;
+    timer.slot_ = slot;
+    occupied_[level] |= 1u << slot;
+}
+
+// Called with interrupts disabled
+void TimerWheel::unlink(SoftTimer& timer)
+{
+    *timer.pprev_ = timer.next_;
+    if (timer.next_ != nullptr) {
+        timer.next_->pprev_ = timer.pprev_;
+    }
+    if (slots_[timer.level_][timer.slot_] == nullptr) {
+        occupied_[timer.level_] &= ~(1u << timer.slot_);
+    }
+    timer.next_ = nullptr;
+    timer.pprev_ = nullptr;
+}
+
+// Called with interrupts disabled
+void TimerWheel::cascade(uint8_t level)
+{
+    const uint8_t slot = (now_ >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    SoftTimer* timer = slots_[level][slot];
+    slots_[level][slot] = nullptr;
+    occupied_[level] &= ~(1u << slot);
+
+    while (timer != nullptr) {
+        SoftTimer* next = timer->next_;
+        insert(*timer);
+        timer = next;
+    }
+}
+
+// Run everything in the current level 0 slot; all of it is due now
+void TimerWheel::expire()
+{
+    const uint8_t slot = now_ & (SLOTS - 1);
+
+    for (;;) {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        SoftTimer* timer = slots_[0][slot];
+        if (timer == nullptr) {
+            __set_PRIMASK(primask);
+            return;
+        }
+
+        unlink(*timer);
+        SoftTimer::Handler handler = timer->handler_;
+        void* context = timer->context_;
+        if (timer->period_ != 0) {
+            // Rescheduled before the handler runs, so it can cancel itself
+            timer->expires_ += timer->period_;
+            insert(*timer);
+        } else {
+            timer->wheel_ = nullptr;
+            active_--;
+        }
+        __set_PRIMASK(primask);
+
+        if (handler != nullptr) {
+            handler(context);
+        }
+    }
+}
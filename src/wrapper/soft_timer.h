@@ -0,0 +1,148 @@
+#pragma once
+
+#include "timer.h"
+
+// Software timers multiplexed on one hardware timer
+//
+// A hierarchical timing wheel: 5 levels of 32 slots, each level 32x
+// coarser than the one below, covering 2^25 ticks (over 9 hours at 1 ms).
+// SoftTimer objects are intrusive list nodes owned by the caller, so
+// there is no allocation, and start/cancel are O(1) however many
+// timers exist. Timers due on the same tick fire together, and advancing
+// skips straight over empty slots.
+//
+// Usage Example:
+//   Timer tick_timer(TIM14);
+//   tick_timer.initTickPeriod(1000);  // Free-running, 1 tick = 1 ms
+//   tick_timer.start();
+//
+//   TimerWheel wheel;
+//   wheel.begin(tick_timer);
+//
+//   void blink(void* ctx) { static_cast<GPIO*>(ctx)->toggle(); }
+//   SoftTimer blink_timer{blink, &led};
+//   wheel.startPeriodic(blink_timer, 500);  // Every 500 ticks
+//
+//   SoftTimer timeout{[](void*) { giveUp(); }};
+//   wheel.startOnce(timeout, 2000);
+//   wheel.cancel(timeout);  // e.g. when the reply arrived
+//
+//   void loop() { wheel.poll(); }  // Handlers run here, not in an ISR
+//
+// poll() must run at least once per counter wrap (65536 ticks on 16-bit
+// timers). Without a free-running timer, call advance(1) from a periodic
+// interrupt instead; handlers then run in that interrupt.
+
+class TimerWheel;
+
+class SoftTimer
+{
+public:
+    using Handler = void (*)(void* context);
+
+    SoftTimer(Handler handler = nullptr, void* context = nullptr);
+    ~SoftTimer();
+
+    SoftTimer(const SoftTimer&) = delete;
+    SoftTimer& operator=(const SoftTimer&) = delete;
+
+    void setHandler(Handler handler, void* context = nullptr)
+    {
+        handler_ = handler;
+        context_ = context;
+    }
+
+    bool isActive() const { return wheel_ != nullptr; }
+
+    // Tick at which the timer fires next (valid while active)
+    uint32_t getExpiry() const { return expires_; }
+
+private:
+    friend class TimerWheel;
+
+    SoftTimer* next_;
+    SoftTimer** pprev_;  // Link pointing at this node, for O(1) unlinking
+    TimerWheel* wheel_;  // Set while scheduled
+    uint32_t expires_;
+    uint32_t period_;    // 0 for one-shot
+    uint8_t level_;
+    uint8_t slot_;
+    Handler handler_;
+    void* context_;
+};
+
+class TimerWheel
+{
+public:
+    static constexpr uint8_t LEVEL_BITS = 5;
+    static constexpr uint8_t LEVELS = 5;
+    static constexpr uint32_t SLOTS = 1u << LEVEL_BITS;
+    static constexpr uint32_t MAX_DELAY = (1u << (LEVEL_BITS * LEVELS)) - 1;
+
+    TimerWheel();
+
+    /**
+     * @brief Drive the wheel from a free-running timer's counter
+     * @param tick_timer Started timer set up with initTickPeriod() (or another
+     *        free-running init); one wheel tick per counter tick
+     * @return false if the timer is not initialized
+     */
+    bool begin(Timer& tick_timer);
+
+    /**
+     * @brief Catch up with the tick timer and run due handlers
+     */
+    void poll();
+
+    /**
+     * @brief Move time forward by a number of ticks and run due handlers
+     */
+    void advance(uint32_t ticks);
+
+    /**
+     * @brief Fire once after delay_ticks (at least 1), restarting if active
+     */
+    void startOnce(SoftTimer& timer, uint32_t delay_ticks);
+
+    /**
+     * @brief Fire every period_ticks, first after first_delay (0 = one period)
+     *
+     * Reloads from the previous expiry, so periods don't drift when
+     * handlers run late.
+     */
+    void startPeriodic(SoftTimer& timer, uint32_t period_ticks, uint32_t first_delay = 0);
+
+    /**
+     * @brief Stop a timer; safe to call on inactive timers and from handlers
+     */
+    void cancel(SoftTimer& timer);
+
+    // Current wheel time in ticks
+    uint32_t now() const { return now_; }
+
+    // Number of scheduled timers
+    uint32_t active() const { return active_; }
+
+    /**
+     * @brief Ticks that can pass before the wheel has work to do
+     * @return Lower bound on the time to the next expiry, e.g. to sleep
+     *         that long; MAX_DELAY if nothing is scheduled
+     */
+    uint32_t ticksUntilNext() const;
+
+private:
+    SoftTimer* slots_[LEVELS][SLOTS];
+    uint32_t occupied_[LEVELS];  // Bit per non-empty slot
+    volatile uint32_t now_;
+    uint32_t active_;
+
+    Timer* tick_timer_;
+    uint32_t last_count_;
+    uint32_t count_mask_;
+
+    void insert(SoftTimer& timer);
+    void unlink(SoftTimer& timer);
+    void cascade(uint8_t level);
+    void expire();
+    void schedule(SoftTimer& timer, uint32_t delay_ticks, uint32_t period_ticks);
+};
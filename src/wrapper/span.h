@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// View of contiguous elements, the part of C++20's std::span the wrappers
+// need, usable with -std=c++17
+// Usage Example:
+//   uint8_t frame[16];
+//   SerialCom.write(Span<const uint8_t>(frame, length));
+//   SerialCom.read(Span<uint8_t>(frame));        // the whole array
+//
+//   std::array<uint8_t, 8> reply;
+//   SerialCom.writeAsync(reply);                  // anything with data() and size()
+template <typename T>
+class Span
+{
+private:
+    T* data_;
+    size_t size_;
+
+public:
+    constexpr Span() : data_(nullptr), size_(0) {}
+    constexpr Span(T* data, size_t size) : data_(data), size_(size) {}
+
+    template <size_t N>
+    constexpr Span(T (&array)[N]) : data_(array), size_(N) {}
+
+    // std::array, std::vector, std::string, Span<U> with U convertible to T
+    template <typename Container,
+              typename = typename std::enable_if<
+                  std::is_convertible<decltype(std::declval<Container&>().data()), T*>::value>::type,
+              typename = decltype(std::declval<Container&>().size())>
+    constexpr Span(Container& container) : data_(container.data()), size_(container.size()) {}
+
+    template <typename Container,
+              typename = typename std::enable_if<
+                  std::is_convertible<decltype(std::declval<const Container&>().data()), T*>::value>::type,
+              typename = decltype(std::declval<const Container&>().size())>
+    constexpr Span(const Container& container) : data_(container.data()), size_(container.size()) {}
+
+    constexpr T* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+
+    constexpr T* begin() const { return data_; }
+    constexpr T* end() const { return data_ + size_; }
+    constexpr T& operator[](size_t index) const { return data_[index]; }
+
+    constexpr Span first(size_t count) const { return Span(data_, count < size_ ? count : size_); }
+    constexpr Span subspan(size_t offset) const
+    {
+        return offset < size_ ? Span(data_ + offset, size_ - offset) : Span(data_ + size_, 0);
+    }
+};
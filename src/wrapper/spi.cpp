@@ -1,21 +1,10 @@
 #include "spi.h"
+#include "peripherals.h"
+#include "memory_sections.h"
+#include <cstring>
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
-#endif
-}
+// SPIs using DMA (for the HAL callbacks)
+static SPI* dma_spi_instances[6] = {nullptr};
 
 SPI::SPI(SPI_TypeDef* spi_instance,
          GPIO_TypeDef* mosi_port, uint16_t mosi_pin,
@@ -29,7 +18,17 @@ SPI::SPI(SPI_TypeDef* spi_instance,
       miso_pin_(miso_pin),
       sck_port_(sck_port),
       sck_pin_(sck_pin),
-      alternate_function_(alternate_function)
+      alternate_function_(alternate_function),
+      initialized_(false),
+      config_dirty_(false),
+      clock_speed_(0),
+      dma_tx_handle_{},
+      dma_rx_handle_{},
+      queue_{},
+      queue_head_(0),
+      queue_count_(0),
+      dma_busy_(false),
+      dma_ready_(false)
 {
     // Initialize SPI handle with default values
     spi_handle_.Instance = spi_instance;
@@ -67,74 +66,37 @@ SPI::SPI(SPI_TypeDef* spi_instance,
 
 void SPI::begin(const uint32_t clock_speed)
 {
-    // Enable GPIO port clocks
-    enableGPIOClock(mosi_port_);
-    enableGPIOClock(miso_port_);
-    enableGPIOClock(sck_port_);
-
-    // Configure GPIO pins for SPI
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
-
-    // Configure MOSI pin
-    GPIO_InitStruct.Pin = mosi_pin_;
-    HAL_GPIO_Init(mosi_port_, &GPIO_InitStruct);
-
-    // Configure MISO pin
-    GPIO_InitStruct.Pin = miso_pin_;
-    HAL_GPIO_Init(miso_port_, &GPIO_InitStruct);
-
-    // Configure SCK pin
-    GPIO_InitStruct.Pin = sck_pin_;
-    HAL_GPIO_Init(sck_port_, &GPIO_InitStruct);
+    // Configure MOSI, MISO and SCK pins
+    const PinRef pins[] = {{mosi_port_, mosi_pin_}, {miso_port_, miso_pin_}, {sck_port_, sck_pin_}};
+    initAlternatePins(pins, 3, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_VERY_HIGH, alternate_function_);
 
     // Enable SPI peripheral clock
-    if (spi_handle_.Instance == SPI1) {
-        __HAL_RCC_SPI1_CLK_ENABLE();
-    }
-#ifdef SPI2
-    else if (spi_handle_.Instance == SPI2) {
-        __HAL_RCC_SPI2_CLK_ENABLE();
-    }
-#endif
-#ifdef SPI3
-    else if (spi_handle_.Instance == SPI3) {
-        __HAL_RCC_SPI3_CLK_ENABLE();
-    }
-#endif
-#ifdef SPI4
-    else if (spi_handle_.Instance == SPI4) {
-        __HAL_RCC_SPI4_CLK_ENABLE();
-    }
-#endif
-#ifdef SPI5
-    else if (spi_handle_.Instance == SPI5) {
-        __HAL_RCC_SPI5_CLK_ENABLE();
-    }
-#endif
-#ifdef SPI6
-    else if (spi_handle_.Instance == SPI6) {
-        __HAL_RCC_SPI6_CLK_ENABLE();
-    }
-#endif
+    enablePeripheralClock(spi_handle_.Instance);
 
     // Set baud rate prescaler for requested clock speed
+    clock_speed_ = clock_speed;
     spi_handle_.Init.BaudRatePrescaler = calculatePrescaler(clock_speed);
 
-    // Initialize SPI peripheral
-    if (HAL_SPI_Init(&spi_handle_) != HAL_OK)
-    {
-        // Error handling
-        return;
-    }
+    // Initialize SPI peripheral, including settings staged before begin()
+    initialized_ = true;
+    config_dirty_ = true;
+    applyConfig();
 }
 
 void SPI::end()
 {
+    if (dma_ready_) {
+        abort();
+        HAL_DMA_DeInit(&dma_tx_handle_);
+        HAL_DMA_DeInit(&dma_rx_handle_);
+        for (SPI*& instance : dma_spi_instances) {
+            if (instance == this) instance = nullptr;
+        }
+        dma_ready_ = false;
+    }
+
     HAL_SPI_DeInit(&spi_handle_);
+    initialized_ = false;
 
     // Deinitialize GPIO pins
     HAL_GPIO_DeInit(mosi_port_, mosi_pin_);
@@ -142,6 +104,47 @@ void SPI::end()
     HAL_GPIO_DeInit(sck_port_, sck_pin_);
 }
 
+SPI& SPI::setClock(const uint32_t clock_speed)
+{
+    clock_speed_ = clock_speed;
+    return stage(spi_handle_.Init.BaudRatePrescaler, calculatePrescaler(clock_speed));
+}
+
+SPI& SPI::configure(const SPIConfig& config)
+{
+    if (config.clock_speed != clock_speed_) {
+        setClock(config.clock_speed);
+    }
+    stage(spi_handle_.Init.CLKPolarity, config.cpol);
+    stage(spi_handle_.Init.CLKPhase, config.cpha);
+    stage(spi_handle_.Init.DataSize, config.data_size);
+    return stage(spi_handle_.Init.FirstBit, config.first_bit);
+}
+
+SPIConfig SPI::getConfig() const
+{
+    SPIConfig config;
+    config.clock_speed = clock_speed_;
+    config.cpol = spi_handle_.Init.CLKPolarity;
+    config.cpha = spi_handle_.Init.CLKPhase;
+    config.data_size = spi_handle_.Init.DataSize;
+    config.first_bit = spi_handle_.Init.FirstBit;
+    return config;
+}
+
+bool SPI::applyConfig()
+{
+    if (!config_dirty_) {
+        return true;
+    }
+    if (!initialized_ || dma_busy_) {
+        return false;
+    }
+
+    config_dirty_ = false;
+    return HAL_SPI_Init(&spi_handle_) == HAL_OK;
+}
+
 uint32_t SPI::calculatePrescaler(uint32_t clock_speed)
 {
     // Assume SPI kernel clock is 100 MHz (typical for STM32H7)
@@ -171,6 +174,10 @@ uint32_t SPI::calculatePrescaler(uint32_t clock_speed)
 
 bool SPI::transfer(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_SPI_TransmitReceive(
         &spi_handle_,
         (uint8_t*)tx_data,
@@ -191,6 +198,10 @@ uint8_t SPI::transfer(uint8_t data, uint32_t timeout)
 
 bool SPI::write(const uint8_t* data, uint16_t length, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_SPI_Transmit(
         &spi_handle_,
         (uint8_t*)data,
@@ -208,6 +219,10 @@ bool SPI::write(uint8_t data, uint32_t timeout)
 
 bool SPI::read(uint8_t* data, uint16_t length, uint32_t timeout)
 {
+    if (!applyConfig()) {
+        return false;
+    }
+
     HAL_StatusTypeDef status = HAL_SPI_Receive(
         &spi_handle_,
         data,
@@ -225,6 +240,276 @@ uint8_t SPI::read(uint32_t timeout)
     return data;
 }
 
+// ===== DMA Transfers =====
+
+bool SPI::initDma(DMA_HandleTypeDef& handle, SpiDmaInstance* dma_instance,
+                  uint32_t dma_request, bool receive)
+{
+    handle = {};
+    handle.Instance = dma_instance;
+#if defined(STM32F4)
+    handle.Init.Channel = dma_request;
+#else
+    handle.Init.Request = dma_request;
+#endif
+    handle.Init.Direction = receive ? DMA_PERIPH_TO_MEMORY : DMA_MEMORY_TO_PERIPH;
+#if defined(STM32H5)
+    handle.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    handle.Init.SrcInc = receive ? DMA_SINC_FIXED : DMA_SINC_INCREMENTED;
+    handle.Init.DestInc = receive ? DMA_DINC_INCREMENTED : DMA_DINC_FIXED;
+    handle.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+    handle.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+    handle.Init.Priority = receive ? DMA_HIGH_PRIORITY : DMA_LOW_PRIORITY_HIGH_WEIGHT;
+    handle.Init.SrcBurstLength = 1;
+    handle.Init.DestBurstLength = 1;
+    handle.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    handle.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    handle.Init.Mode = DMA_NORMAL;
+#else
+    handle.Init.PeriphInc = DMA_PINC_DISABLE;
+    handle.Init.MemInc = DMA_MINC_ENABLE;
+    handle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    handle.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    // RX above TX so the receive FIFO never overruns
+    handle.Init.Priority = receive ? DMA_PRIORITY_HIGH : DMA_PRIORITY_MEDIUM;
+    handle.Init.Mode = DMA_NORMAL;
+#endif
+#if defined(STM32H7) || defined(STM32F4)
+    handle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+
+    return HAL_DMA_Init(&handle) == HAL_OK;
+}
+
+bool SPI::beginDma(SpiDmaInstance* tx_instance, uint32_t tx_request, IRQn_Type tx_irq,
+                   SpiDmaInstance* rx_instance, uint32_t rx_request, IRQn_Type rx_irq,
+                   IRQn_Type spi_irq)
+{
+    int slot = -1;
+    for (int i = 0; i < 6; i++) {
+        if (dma_spi_instances[i] == this) { slot = i; break; }
+        if (slot < 0 && dma_spi_instances[i] == nullptr) slot = i;
+    }
+    if (slot < 0) return false;
+
+    enableDMAClock(tx_instance);
+    enableDMAClock(rx_instance);
+    if (!initDma(dma_tx_handle_, tx_instance, tx_request, false)) return false;
+    if (!initDma(dma_rx_handle_, rx_instance, rx_request, true)) return false;
+    __HAL_LINKDMA(&spi_handle_, hdmatx, dma_tx_handle_);
+    __HAL_LINKDMA(&spi_handle_, hdmarx, dma_rx_handle_);
+    dma_spi_instances[slot] = this;
+
+    queue_head_ = 0;
+    queue_count_ = 0;
+    dma_busy_ = false;
+    dma_ready_ = true;
+
+    HAL_NVIC_SetPriority(tx_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(tx_irq);
+    HAL_NVIC_SetPriority(rx_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(rx_irq);
+    HAL_NVIC_SetPriority(spi_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(spi_irq);
+    return true;
+}
+
+#if defined(STM32H7)
+// DMA1/DMA2 cannot reach the tightly coupled memories
+static bool isDmaAccessible(const void* buffer)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    const bool itcm = address < 0x00010000;
+    const bool dtcm = address >= 0x20000000 && address < 0x20020000;
+    return !itcm && !dtcm;
+}
+#endif
+
+bool SPI::queue(const SPITransaction& transaction)
+{
+    if (!dma_ready_ || transaction.length == 0 ||
+        (transaction.tx_data == nullptr && transaction.rx_data == nullptr)) {
+        return false;
+    }
+
+#if defined(STM32H7)
+    if ((transaction.tx_data != nullptr && !isDmaAccessible(transaction.tx_data)) ||
+        (transaction.rx_data != nullptr && !isDmaAccessible(transaction.rx_data))) {
+        return false;
+    }
+    // Invalidating a cache line shared with other data would discard it
+    if (transaction.rx_data != nullptr && isDCacheable(transaction.rx_data) &&
+        ((reinterpret_cast<uintptr_t>(transaction.rx_data) % 32) != 0 || (transaction.length % 32) != 0)) {
+        return false;
+    }
+#endif
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (queue_count_ == QUEUE_SIZE) {
+        __set_PRIMASK(primask);
+        return false;
+    }
+    queue_[(queue_head_ + queue_count_) % QUEUE_SIZE] = transaction;
+    queue_count_ = queue_count_ + 1;
+    if (!dma_busy_) {
+        startNext();
+    }
+
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool SPI::transferAsync(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length,
+                        std::function<void(bool ok)> callback)
+{
+    SPITransaction transaction;
+    transaction.tx_data = tx_data;
+    transaction.rx_data = rx_data;
+    transaction.length = length;
+    transaction.cs_port = nullptr;
+    transaction.cs_pin = 0;
+    transaction.callback = callback;
+    transaction.config = nullptr;
+    return queue(transaction);
+}
+
+bool SPI::transferDMA(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout)
+{
+    volatile bool done = false;
+    volatile bool result = false;
+    if (!transferAsync(tx_data, rx_data, length, [&done, &result](bool ok) {
+            result = ok;
+            done = true;
+        })) {
+        return false;
+    }
+
+    const uint32_t start = HAL_GetTick();
+    while (!done) {
+        if (HAL_GetTick() - start >= timeout) {
+            // The callback refers to this frame; it must not outlive it
+            abort();
+            return false;
+        }
+    }
+    return result;
+}
+
+bool SPI::waitIdle(uint32_t timeout)
+{
+    const uint32_t start = HAL_GetTick();
+    while (queue_count_ > 0) {
+        if (HAL_GetTick() - start >= timeout) return false;
+    }
+    return true;
+}
+
+void SPI::abort()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (dma_busy_) {
+        HAL_SPI_Abort(&spi_handle_);
+    }
+    // Fail the running transfer and everything behind it
+    while (queue_count_ > 0) {
+        dma_busy_ = true;  // Keeps queue() in a callback from starting a transfer
+        const uint8_t head = queue_head_;
+        if (queue_[head].cs_port != nullptr) {
+            HAL_GPIO_WritePin(queue_[head].cs_port, queue_[head].cs_pin, GPIO_PIN_SET);
+        }
+        std::function<void(bool ok)> callback = std::move(queue_[head].callback);
+        queue_[head].callback = nullptr;
+        queue_head_ = (head + 1) % QUEUE_SIZE;
+        queue_count_ = queue_count_ - 1;
+        if (callback) callback(false);
+    }
+    dma_busy_ = false;
+    __set_PRIMASK(primask);
+}
+
+// Start the transfer at the head of the queue. Runs with interrupts
+// disabled or from the completion interrupt.
+void SPI::startNext()
+{
+    while (queue_count_ > 0) {
+        SPITransaction& transaction = queue_[queue_head_];
+        if (transaction.config != nullptr) {
+            configure(*transaction.config);
+        }
+        if (!applyConfig()) {
+            dma_busy_ = true;
+            finishHead(false);
+            return;
+        }
+
+        uint8_t* rx = transaction.rx_data;
+        const uint8_t* tx = transaction.tx_data;
+
+        if (tx == nullptr) {
+            // Receive only: clock out 0xFF from the RX buffer itself
+            memset(rx, 0xFF, transaction.length);
+            tx = rx;
+        }
+
+        cleanDCache(tx, transaction.length);
+        if (rx != nullptr && rx != tx) {
+            // No dirty line may be written back over the received data
+            invalidateDCache(rx, transaction.length);
+        }
+
+        if (transaction.cs_port != nullptr) {
+            HAL_GPIO_WritePin(transaction.cs_port, transaction.cs_pin, GPIO_PIN_RESET);
+        }
+
+        HAL_StatusTypeDef status;
+        if (rx == nullptr) {
+            status = HAL_SPI_Transmit_DMA(&spi_handle_, const_cast<uint8_t*>(tx), transaction.length);
+        } else {
+            status = HAL_SPI_TransmitReceive_DMA(&spi_handle_, const_cast<uint8_t*>(tx), rx, transaction.length);
+        }
+        if (status == HAL_OK) {
+            dma_busy_ = true;
+            return;
+        }
+
+        // Could not start: fail this one and try the next
+        dma_busy_ = true;
+        finishHead(false);
+        return;
+    }
+    dma_busy_ = false;
+}
+
+// Complete the transfer at the head, start the next one, then run the
+// finished one's callback so chained transfers follow without a gap
+void SPI::finishHead(bool ok)
+{
+    if (queue_count_ == 0) {
+        dma_busy_ = false;
+        return;
+    }
+
+    SPITransaction& transaction = queue_[queue_head_];
+    if (transaction.rx_data != nullptr) {
+        invalidateDCache(transaction.rx_data, transaction.length);
+    }
+    if (transaction.cs_port != nullptr) {
+        HAL_GPIO_WritePin(transaction.cs_port, transaction.cs_pin, GPIO_PIN_SET);
+    }
+
+    std::function<void(bool ok)> callback = std::move(transaction.callback);
+    transaction.callback = nullptr;
+    queue_head_ = (queue_head_ + 1) % QUEUE_SIZE;
+    queue_count_ = queue_count_ - 1;
+    dma_busy_ = false;
+
+    startNext();
+    if (callback) callback(ok);
+}
+
 bool SPI::isReady()
 {
     return (HAL_SPI_GetState(&spi_handle_) == HAL_SPI_STATE_READY);
@@ -234,3 +519,36 @@ uint32_t SPI::getError()
 {
     return HAL_SPI_GetError(&spi_handle_);
 }
+
+// HAL Callbacks (called from HAL_SPI_IRQHandler / HAL_DMA_IRQHandler)
+
+static SPI* findDmaSpi(SPI_HandleTypeDef* hspi)
+{
+    for (SPI* instance : dma_spi_instances) {
+        if (instance != nullptr && instance->getHandle() == hspi) {
+            return instance;
+        }
+    }
+    return nullptr;
+}
+
+extern "C" void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+    if (SPI* spi = findDmaSpi(hspi)) {
+        spi->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi)
+{
+    if (SPI* spi = findDmaSpi(hspi)) {
+        spi->onTransferComplete(true);
+    }
+}
+
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi)
+{
+    if (SPI* spi = findDmaSpi(hspi)) {
+        spi->onTransferComplete(false);
+    }
+}
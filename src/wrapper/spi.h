@@ -20,6 +20,39 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
 #endif
 
+#include <cstdint>
+#include <functional>
+#include "trace.h"
+
+// DMA stream (H7, F4) or channel (G0, G4, H5 GPDMA) used for transfers
+#if defined(STM32H7) || defined(STM32F4)
+    typedef DMA_Stream_TypeDef SpiDmaInstance;
+#else
+    typedef DMA_Channel_TypeDef SpiDmaInstance;
+#endif
+
+// Bus settings of one device, see SPI::configure()
+struct SPIConfig
+{
+    uint32_t clock_speed = 1000000;
+    uint32_t cpol = SPI_POLARITY_LOW;
+    uint32_t cpha = SPI_PHASE_1EDGE;
+    uint32_t data_size = SPI_DATASIZE_8BIT;
+    uint32_t first_bit = SPI_FIRSTBIT_MSB;
+};
+
+// One DMA transfer, see SPI::queue()
+struct SPITransaction
+{
+    const uint8_t* tx_data;   // nullptr = receive only (0xFF is clocked out)
+    uint8_t* rx_data;         // nullptr = transmit only
+    uint16_t length;
+    GPIO_TypeDef* cs_port;    // Chip select held low during the transfer (nullptr = none)
+    uint16_t cs_pin;
+    std::function<void(bool ok)> callback;  // Runs in the interrupt when done
+    const SPIConfig* config = nullptr;      // Applied before the transfer (nullptr = keep current)
+};
+
 // SPI Class - Serial Peripheral Interface
 // Usage Example:
 //   spi1.begin(1000000);  // Start SPI at 1 MHz
@@ -37,6 +70,38 @@
 //
 //   // Single byte transfer
 //   uint8_t response = spi1.transfer(0x42);
+//
+// Setters only stage the new settings; they are written to the peripheral
+// once, by begin() or before the next transfer. Devices sharing a bus can
+// keep an SPIConfig each and switch with configure(), which costs nothing
+// when the settings are already active:
+//
+//   static const SPIConfig imu_config{8000000, SPI_POLARITY_HIGH, SPI_PHASE_2EDGE};
+//   static const SPIConfig flash_config{20000000};
+//
+//   spi1.configure(imu_config).transfer(tx, rx, 6);
+//   spi1.configure(flash_config).write(cmd, 4);
+//
+// After beginDma(), transfers can run through DMA while the CPU does
+// other work. transferAsync()/queue() return at once; queued transfers
+// are started back to back from the completion interrupt, each with its
+// own optional chip select and callback. The board forwards the DMA and
+// SPI interrupts:
+//
+//   spi1.begin(8000000);
+//   spi1.beginDma(DMA1_Stream4, DMA_REQUEST_SPI1_TX, DMA1_Stream4_IRQn,
+//                 DMA1_Stream5, DMA_REQUEST_SPI1_RX, DMA1_Stream5_IRQn, SPI1_IRQn);
+//
+//   extern "C" void DMA1_Stream4_IRQHandler(void) { spi1.handleTxDmaInterrupt(); }
+//   extern "C" void DMA1_Stream5_IRQHandler(void) { spi1.handleRxDmaInterrupt(); }
+//   extern "C" void SPI1_IRQHandler(void)         { spi1.handleInterrupt(); }
+//
+//   spi1.transferAsync(frame, nullptr, sizeof(frame), [](bool ok) { frame_sent = ok; });
+//
+// Buffers must stay valid until the callback has run. On the H7 they must
+// be reachable by the DMA (AXI SRAM or SRAM1-4, not DTCM); TX buffers are
+// cleaned from the D-cache, and RX buffers need a 32-byte aligned address
+// and a length that is a multiple of 32 so they can be invalidated safely.
 class SPI
 {
 private:
@@ -51,6 +116,28 @@ private:
     uint16_t sck_pin_;
     uint32_t alternate_function_;
 
+    // Settings in spi_handle_.Init not yet written to the peripheral
+    bool initialized_;
+    bool config_dirty_;
+    uint32_t clock_speed_;
+
+    // DMA transfers: a ring of queued transactions, the one at
+    // queue_head_ is on the bus while dma_busy_ is set. Shared with the
+    // interrupt, so changed only with interrupts disabled.
+    static constexpr uint8_t QUEUE_SIZE = 8;
+    DMA_HandleTypeDef dma_tx_handle_;
+    DMA_HandleTypeDef dma_rx_handle_;
+    SPITransaction queue_[QUEUE_SIZE];
+    uint8_t queue_head_;
+    volatile uint8_t queue_count_;
+    volatile bool dma_busy_;
+    bool dma_ready_;
+
+    bool initDma(DMA_HandleTypeDef& handle, SpiDmaInstance* dma_instance,
+                 uint32_t dma_request, bool receive);
+    void startNext();
+    void finishHead(bool ok);
+
 public:
     SPI() = delete;
     SPI(SPI_TypeDef* spi_instance,
@@ -62,42 +149,46 @@ public:
     void begin(const uint32_t clock_speed = 1000000);
     void end();
 
-    // Fluent API setters
+    // Fluent API setters (applied by begin() or the next transfer)
     SPI& setMode(const uint32_t mode)
     {
-        spi_handle_.Init.Mode = mode;
-        HAL_SPI_Init(&spi_handle_);
-        return *this;
+        return stage(spi_handle_.Init.Mode, mode);
     }
 
     SPI& setDataSize(const uint32_t data_size)
     {
-        spi_handle_.Init.DataSize = data_size;
-        HAL_SPI_Init(&spi_handle_);
-        return *this;
+        return stage(spi_handle_.Init.DataSize, data_size);
     }
 
     SPI& setCPOL(const uint32_t cpol)
     {
-        spi_handle_.Init.CLKPolarity = cpol;
-        HAL_SPI_Init(&spi_handle_);
-        return *this;
+        return stage(spi_handle_.Init.CLKPolarity, cpol);
     }
 
     SPI& setCPHA(const uint32_t cpha)
     {
-        spi_handle_.Init.CLKPhase = cpha;
-        HAL_SPI_Init(&spi_handle_);
-        return *this;
+        return stage(spi_handle_.Init.CLKPhase, cpha);
     }
 
     SPI& setFirstBit(const uint32_t first_bit)
     {
-        spi_handle_.Init.FirstBit = first_bit;
-        HAL_SPI_Init(&spi_handle_);
-        return *this;
+        return stage(spi_handle_.Init.FirstBit, first_bit);
     }
 
+    SPI& setClock(const uint32_t clock_speed);
+
+    // Stage all settings of a device at once
+    SPI& configure(const SPIConfig& config);
+
+    // Settings currently staged
+    SPIConfig getConfig() const;
+
+    /**
+     * @brief Write staged settings to the peripheral now
+     * @return false if begin() has not run or a DMA transfer is in progress
+     */
+    bool applyConfig();
+
     // Full duplex transfer
     bool transfer(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout = 1000);
     uint8_t transfer(uint8_t data, uint32_t timeout = 1000);
@@ -110,10 +201,66 @@ public:
     bool read(uint8_t* data, uint16_t length, uint32_t timeout = 1000);
     uint8_t read(uint32_t timeout = 1000);
 
+    /**
+     * @brief Set up DMA for transferAsync(), transferDMA() and queue()
+     * @param tx_instance DMA stream/channel for TX, e.g. DMA1_Stream4 (H7, F4) or DMA1_Channel2 (G0, G4)
+     * @param tx_request DMAMUX request, e.g. DMA_REQUEST_SPI1_TX (DMA_CHANNEL_x on F4)
+     * @param tx_irq Interrupt of the TX stream/channel
+     * @param rx_instance DMA stream/channel for RX
+     * @param rx_request DMAMUX request for RX
+     * @param rx_irq Interrupt of the RX stream/channel
+     * @param spi_irq Interrupt of this SPI (end of transfer)
+     * @return true if DMA was set up
+     */
+    bool beginDma(SpiDmaInstance* tx_instance, uint32_t tx_request, IRQn_Type tx_irq,
+                  SpiDmaInstance* rx_instance, uint32_t rx_request, IRQn_Type rx_irq,
+                  IRQn_Type spi_irq);
+
+    /**
+     * @brief Queue a DMA transfer
+     * @return false if DMA is not set up, the queue is full or a buffer is
+     *         unusable for DMA (the callback is not called then)
+     */
+    bool queue(const SPITransaction& transaction);
+
+    // Queue a transfer without chip select handling
+    bool transferAsync(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length,
+                       std::function<void(bool ok)> callback = nullptr);
+
+    // DMA transfer that waits for completion (aborts all queued transfers on timeout)
+    bool transferDMA(const uint8_t* tx_data, uint8_t* rx_data, uint16_t length, uint32_t timeout = 1000);
+
+    // Wait until every queued transfer has finished
+    bool waitIdle(uint32_t timeout = 1000);
+
+    // Stop the running transfer and drop the queue (callbacks get ok = false)
+    void abort();
+
+    // Transfers queued or running
+    uint8_t pending() const { return queue_count_; }
+
+    // Called from the board's IRQ handlers when DMA is used
+    void handleTxDmaInterrupt() { LUMOS_TRACE_ISR("spi tx dma"); HAL_DMA_IRQHandler(&dma_tx_handle_); }
+    void handleRxDmaInterrupt() { LUMOS_TRACE_ISR("spi rx dma"); HAL_DMA_IRQHandler(&dma_rx_handle_); }
+    void handleInterrupt() { LUMOS_TRACE_ISR("spi irq"); HAL_SPI_IRQHandler(&spi_handle_); }
+
+    // Called from the HAL callbacks
+    void onTransferComplete(bool ok) { finishHead(ok); }
+    SPI_HandleTypeDef* getHandle() { return &spi_handle_; }
+
     // Status
     bool isReady();
     uint32_t getError();
 
 private:
     uint32_t calculatePrescaler(uint32_t clock_speed);
+
+    SPI& stage(uint32_t& field, const uint32_t value)
+    {
+        if (field != value) {
+            field = value;
+            config_dirty_ = true;
+        }
+        return *this;
+    }
 };
@@ -1,17 +1,69 @@
 #include "sys.h"
+#include "peripherals.h"
+#include "trace.h"
 
 // Static variables for time tracking
 static volatile uint32_t last_tick = 0;
 static volatile uint32_t tick_rollovers = 0;
-static volatile bool dwt_initialized = false;
+static volatile bool us_timing_ready = false;
+
+// Stop mode entry registered by the board, see SetStopModeHandler()
+static StopModeHandler stop_handler = nullptr;
+static uint32_t stop_min_ms = 10;
+
+// Waits longer than this sleep until the last SysTick before the
+// deadline; the rest covers the wake-up latency
+static constexpr uint32_t SLEEP_MARGIN_US = 1000 + 50;
+
+// Power state accounting and hook, see GetPowerStateTimes()
+static PowerStateTimes power_times = {0, 0, 0, 0};
+static PowerStateHook power_hook = nullptr;
+static void* power_hook_context = nullptr;
+
+static void AdvanceTimeBase(uint32_t ms);
+static void SleepUntilInterrupt();
+static uint32_t EnterStop(uint32_t max_ms);
 
 void DelayMs(uint32_t ms)
 {
-    HAL_Delay(ms);
+    const uint32_t start = HAL_GetTick();
+    uint32_t wait = ms;
+
+    // Like HAL_Delay(), add a tick so the wait is at least ms
+    if (wait < HAL_MAX_DELAY) {
+        wait += (uint32_t)HAL_GetTickFreq();
+    }
+
+    uint32_t elapsed;
+    while ((elapsed = HAL_GetTick() - start) < wait) {
+        const uint32_t remaining = wait - elapsed;
+        if (stop_handler != nullptr && remaining > stop_min_ms) {
+            // One tick short, the last partial tick is slept with WFI
+            if (EnterStop(remaining - 1) != 0) {
+                continue;
+            }
+        }
+        SleepUntilInterrupt();  // SysTick wakes us every tick at the latest
+    }
 }
 
 void DelayUs(uint32_t us)
 {
+    if (us_timing_ready) {
+        const uint64_t deadline = GetCurrentTimeUs() + us;
+
+        // Sleep while a whole tick fits, unless interrupts are masked, as
+        // only SysTick is certain to wake the core
+        if (us > SLEEP_MARGIN_US && __get_PRIMASK() == 0) {
+            while (deadline - GetCurrentTimeUs() > SLEEP_MARGIN_US) {
+                SleepUntilInterrupt();
+            }
+        }
+        while (GetCurrentTimeUs() < deadline) {
+        }
+        return;
+    }
+
     // Get CPU frequency in MHz
     uint32_t cpu_freq_mhz;
 
@@ -37,6 +89,33 @@ void DelayUs(uint32_t us)
     }
 }
 
+// ===== Time Base =====
+//
+// Cortex-M3 and up: DWT cycles, extended to 64 bits by anchoring every
+// read; SysTick milliseconds catch missed CYCCNT wraps (every 7.8 s at
+// 550 MHz) when reads are far apart.
+// Cortex-M0+: a 32-bit timer at 1 MHz chained into a 16-bit one, which
+// counts its overflows, gives a free-running 48-bit microsecond counter
+// in hardware. Only with the pair picked by the project (project.yaml
+// us_timers, LUMOS_US_TIMER_LOW/HIGH): otherwise no timer is taken and
+// the time base stays at millisecond resolution.
+
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+static volatile uint32_t anchor_cycles = 0;
+static volatile uint32_t anchor_tick = 0;
+static volatile uint64_t anchor_us = 0;
+static uint32_t cycles_per_us = 1;
+static uint32_t exact_ms = 0;  // Read gap up to which the 32-bit difference is exact
+#elif defined(LUMOS_US_TIMER_LOW) && defined(LUMOS_US_TIMER_HIGH)
+#define LUMOS_US_TIMERS 1
+// Internal trigger of the high timer the low one drives. On the G0, TIM2
+// is ITR1 of TIM3 and TIM4.
+#ifndef LUMOS_US_TIMER_TRIGGER
+#define LUMOS_US_TIMER_TRIGGER 1
+#endif
+static volatile uint64_t offset_us = 0;  // Time at start plus time in Stop mode, where the timers halt
+#endif
+
 void InitMicrosecondTiming()
 {
 #if defined(__CORTEX_M) && (__CORTEX_M >= 3)
@@ -50,15 +129,87 @@ void InitMicrosecondTiming()
     // Enable the cycle counter
     DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-    dwt_initialized = true;
+    // Looked up once, reading the clock tree per call is slow
+    cycles_per_us = HAL_RCC_GetSysClockFreq() / 1000000;
+    if (cycles_per_us == 0) {
+        cycles_per_us = 1;
+    }
+    exact_ms = 0x80000000u / (cycles_per_us * 1000);  // Half a CYCCNT period
+
+    // Continue from the millisecond time so both clocks agree
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    anchor_us = GetCurrentTimeMs() * 1000;
+    anchor_tick = HAL_GetTick();
+    anchor_cycles = DWT->CYCCNT;
+    us_timing_ready = true;
+    __set_PRIMASK(primask);
+#elif defined(LUMOS_US_TIMERS)
+    // Cortex-M0/M0+ has no DWT: chain the two timers instead. Registers
+    // are set directly so this doesn't pull in the TIM HAL module.
+    TIM_TypeDef* const low = LUMOS_US_TIMER_LOW;
+    TIM_TypeDef* const high = LUMOS_US_TIMER_HIGH;
+    enablePeripheralClock(low);
+    enablePeripheralClock(high);
+
+    RCC_ClkInitTypeDef clk_init;
+    uint32_t flash_latency;
+    HAL_RCC_GetClockConfig(&clk_init, &flash_latency);
+    uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+    if (clk_init.APB1CLKDivider != RCC_HCLK_DIV1) {
+        timer_clock *= 2;
+    }
+
+    low->CR1 = 0;
+    high->CR1 = 0;
+
+    // Low: 1 MHz over the full 32 bits, TRGO on update (overflow)
+    low->PSC = timer_clock / 1000000 - 1;
+    low->ARR = 0xFFFFFFFF;
+    low->CR2 = TIM_CR2_MMS_1;
+    low->EGR = TIM_EGR_UG;  // Load the prescaler
+    low->CNT = 0;
+
+    // High: clocked by the low timer's TRGO (external clock mode 1)
+    high->PSC = 0;
+    high->ARR = 0xFFFF;
+    high->SMCR = ((uint32_t)LUMOS_US_TIMER_TRIGGER << TIM_SMCR_TS_Pos) | TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1 | TIM_SMCR_SMS_2;
+    high->EGR = TIM_EGR_UG;
+    high->CNT = 0;
+
+    // Continue from the millisecond time so both clocks agree
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    offset_us = GetCurrentTimeMs() * 1000;
+    high->CR1 = TIM_CR1_CEN;
+    low->CR1 = TIM_CR1_CEN;
+    us_timing_ready = true;
+    __set_PRIMASK(primask);
 #else
-    // Cortex-M0/M0+ doesn't have DWT, fall back to millisecond timing
-    dwt_initialized = false;
+    us_timing_ready = false;
+#endif
+}
+
+bool ReleaseMicrosecondTimer(const void* instance)
+{
+#if defined(LUMOS_US_TIMERS)
+    if (instance != LUMOS_US_TIMER_LOW && instance != LUMOS_US_TIMER_HIGH) {
+        return false;
+    }
+    // Back to the millisecond tick, which the chain started from
+    us_timing_ready = false;
+    return true;
+#else
+    (void)instance;
+    return false;
 #endif
 }
 
 uint64_t GetCurrentTimeMs()
 {
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
     // Handle HAL_GetTick() 32-bit rollover by detecting when it decreases
     uint32_t current_tick = HAL_GetTick();
 
@@ -72,38 +223,181 @@ uint64_t GetCurrentTimeMs()
     // Each rollover represents 2^32 milliseconds (~49.7 days)
     uint64_t total_ms = ((uint64_t)tick_rollovers << 32) | current_tick;
 
+    __set_PRIMASK(primask);
     return total_ms;
 }
 
 uint64_t GetCurrentTimeUs()
 {
+    if (!us_timing_ready) {
+        // Fall back to millisecond resolution (* 1000)
+        return GetCurrentTimeMs() * 1000;
+    }
+
 #if defined(__CORTEX_M) && (__CORTEX_M >= 3)
-    if (dwt_initialized) {
-        // Use DWT cycle counter for microsecond resolution
-        uint32_t cycles = DWT->CYCCNT;
-        uint32_t cpu_freq_mhz;
+    // A short masked section keeps the anchor consistent for ISRs and
+    // threads alike; there is no lock to wait on
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
 
-#if defined(STM32H7)
-        cpu_freq_mhz = HAL_RCC_GetSysClockFreq() / 1000000;
-#elif defined(STM32G0)
-        cpu_freq_mhz = HAL_RCC_GetSysClockFreq() / 1000000;
-#elif defined(STM32G4)
-        cpu_freq_mhz = HAL_RCC_GetSysClockFreq() / 1000000;
-#elif defined(STM32F4)
-        cpu_freq_mhz = HAL_RCC_GetSysClockFreq() / 1000000;
-#elif defined(STM32H5)
-        cpu_freq_mhz = HAL_RCC_GetSysClockFreq() / 1000000;
+    const uint32_t cycles = DWT->CYCCNT;
+    const uint32_t tick = HAL_GetTick();
+    uint32_t delta = cycles - anchor_cycles;
+    uint32_t us;
+
+    // Within half a CYCCNT period the 32-bit difference is exact
+    const uint32_t elapsed_ms = tick - anchor_tick;
+    if (elapsed_ms < exact_ms) {
+        us = delta / cycles_per_us;
+        anchor_cycles += us * cycles_per_us;  // Keep the sub-microsecond rest
+    } else {
+        // Reads were far apart: count the wraps from the millisecond tick
+        const uint64_t approx = (uint64_t)elapsed_ms * cycles_per_us * 1000;
+        const uint64_t wraps = (approx - delta + 0x80000000u) >> 32;
+        const uint64_t full = (wraps << 32) + delta;
+        const uint64_t full_us = full / cycles_per_us;
+        anchor_cycles += (uint32_t)(full_us * cycles_per_us);
+        anchor_us += full_us;
+        anchor_tick = tick;
+        const uint64_t now = anchor_us;
+        __set_PRIMASK(primask);
+        return now;
+    }
+
+    anchor_tick = tick;
+    const uint64_t now = anchor_us + us;
+    anchor_us = now;
+    __set_PRIMASK(primask);
+    return now;
+#elif defined(LUMOS_US_TIMERS)
+    // Lock-free: the high timer holds the high bits, re-read if the low one wrapped between
+    uint32_t high = LUMOS_US_TIMER_HIGH->CNT;
+    uint32_t low = LUMOS_US_TIMER_LOW->CNT;
+    const uint32_t high_again = LUMOS_US_TIMER_HIGH->CNT;
+    if (high != high_again) {
+        high = high_again;
+        low = LUMOS_US_TIMER_LOW->CNT;
+    }
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint64_t offset = offset_us;
+    __set_PRIMASK(primask);
+    return (((uint64_t)high << 32) | low) + offset;
+#else
+    return GetCurrentTimeMs() * 1000;
 #endif
+}
 
-        // Convert cycles to microseconds
-        uint64_t us = (uint64_t)cycles / cpu_freq_mhz;
+// ===== Low Power =====
 
-        // Add millisecond time for full 64-bit range
-        uint64_t ms_time = GetCurrentTimeMs();
-        return (ms_time * 1000) + (us % 1000);
+void Idle(uint32_t max_ms)
+{
+    if (stop_handler != nullptr && max_ms >= stop_min_ms) {
+        if (EnterStop(max_ms) != 0) {
+            return;
+        }
     }
+    SleepUntilInterrupt();
+}
+
+void SetStopModeHandler(StopModeHandler handler, uint32_t min_ms)
+{
+    stop_min_ms = (min_ms > 1) ? min_ms : 1;
+    stop_handler = handler;
+}
+
+// SysTick, DWT and the timers all halt in Stop mode: credit the time the
+// board measured on its wake-up timer to every time base
+static void AdvanceTimeBase(uint32_t ms)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+    if (us_timing_ready) {
+        (void)GetCurrentTimeUs();  // Anchor on the wake-up instant
+        anchor_us += (uint64_t)ms * 1000;
+    }
+    uwTick += ms;
+    anchor_tick = HAL_GetTick();
+#elif defined(LUMOS_US_TIMERS)
+    if (us_timing_ready) {
+        offset_us += (uint64_t)ms * 1000;
+    }
+    uwTick += ms;
+#else
+    uwTick += ms;
 #endif
+    __set_PRIMASK(primask);
+}
 
-    // Fall back to millisecond resolution (* 1000)
-    return GetCurrentTimeMs() * 1000;
+// ===== Power States =====
+
+// WFI with interrupts masked, so the one that wakes the core is handled
+// after the sleep is timed and counts as run time
+static void SleepUntilInterrupt()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    {
+        LUMOS_TRACE_SCOPE("sleep");
+        if (power_hook != nullptr) {
+            power_hook(PowerState::Sleep, power_hook_context);
+        }
+        const uint64_t start = GetCurrentTimeUs();
+        __WFI();
+        power_times.sleep_us += GetCurrentTimeUs() - start;
+        power_times.sleeps++;
+        if (power_hook != nullptr) {
+            power_hook(PowerState::Run, power_hook_context);
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+// The board's handler, with the time it stopped credited to the time
+// bases and the Stop total; returns that time (0 if it did not stop)
+static uint32_t EnterStop(uint32_t max_ms)
+{
+    LUMOS_TRACE_SCOPE("stop");   // Short on the timeline: DWT halts in Stop
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (power_hook != nullptr) {
+        power_hook(PowerState::Stop, power_hook_context);
+    }
+    __set_PRIMASK(primask);
+
+    const uint32_t stopped = stop_handler(max_ms);
+    if (stopped != 0) {
+        AdvanceTimeBase(stopped);
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (stopped != 0) {
+        power_times.stop_us += (uint64_t)stopped * 1000;
+        power_times.stops++;
+    }
+    if (power_hook != nullptr) {
+        power_hook(PowerState::Run, power_hook_context);
+    }
+    __set_PRIMASK(primask);
+    return stopped;
+}
+
+PowerStateTimes GetPowerStateTimes()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const PowerStateTimes times = power_times;
+    __set_PRIMASK(primask);
+    return times;
+}
+
+void SetPowerStateHook(PowerStateHook hook, void* context)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    power_hook = hook;
+    power_hook_context = context;
+    __set_PRIMASK(primask);
 }
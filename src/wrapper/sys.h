@@ -22,12 +22,33 @@
 //   DelayMs(1000);  // Delay for 1 second
 //   DelayUs(100);   // Delay for 100 microseconds
 //   uint64_t time = GetCurrentTimeMs();  // Get current time in milliseconds
+//
+//   InitMicrosecondTiming();              // Once at startup
+//   uint64_t t0 = GetCurrentTimeUs();     // Monotonic, safe from ISRs
+//
+// Low-power idle (delays sleep between interrupts instead of spinning):
+//   // Board code enters Stop with an LPTIM/RTC wake-up, restores the clocks
+//   // (SystemClock_Config()) and returns how many milliseconds passed
+//   uint32_t enterStop(uint32_t max_ms);
+//   SetStopModeHandler(enterStop, 20);    // Used for waits of 20 ms and up
+//
+//   void loop() {
+//       wheel.poll();
+//       Idle(wheel.ticksUntilNext());     // Tickless: 1 ms wheel ticks
+//   }
+//
+// Power profiling (framework/power_tracker.h, `lumos stats`):
+//   PowerStateTimes power = GetPowerStateTimes();
+//   uint64_t run_us = GetCurrentTimeUs() - power.sleep_us - power.stop_us;
 
 /**
  * @brief Delay for specified milliseconds
  * @param ms Number of milliseconds to delay
  *
- * Uses HAL_Delay() which relies on SysTick timer (1ms tick)
+ * Same timing as HAL_Delay() (SysTick, 1ms tick), but the core sleeps
+ * (WFI) between ticks, and waits long enough for the Stop mode handler
+ * (SetStopModeHandler()) go through it. Must not be called with
+ * interrupts disabled, as SysTick would never advance.
  */
 void DelayMs(uint32_t ms);
 
@@ -35,11 +56,42 @@ void DelayMs(uint32_t ms);
  * @brief Delay for specified microseconds
  * @param us Number of microseconds to delay
  *
- * Uses cycle-accurate delay based on CPU frequency
- * Note: For very short delays (<10us), accuracy depends on CPU speed
+ * With InitMicrosecondTiming() this follows the microsecond time base:
+ * short waits spin, and waits over a millisecond sleep (WFI) until the
+ * last tick before the deadline. Otherwise a calibrated busy loop
+ * whose accuracy for very short delays (<10us) depends on CPU speed.
  */
 void DelayUs(uint32_t us);
 
+/**
+ * @brief Sleep until the next interrupt, or in Stop mode when idle long
+ * @param max_ms Milliseconds with nothing to do (e.g. from
+ *        TimerWheel::ticksUntilNext()); at or above the Stop mode
+ *        threshold the registered handler is used, otherwise WFI, which
+ *        returns at the latest on the next SysTick
+ *
+ * May be called with interrupts disabled, after checking for work: the
+ * core still wakes on a pending interrupt, which runs once they are
+ * enabled again, so no wake-up is lost in between.
+ */
+void Idle(uint32_t max_ms = 0);
+
+/**
+ * @brief Stop mode entry supplied by the board
+ * @param max_ms Longest the core may stay stopped
+ * @return Milliseconds actually spent stopped (0 if Stop was not entered),
+ *         added to the SysTick and microsecond time bases, which don't
+ *         run in Stop
+ */
+using StopModeHandler = uint32_t (*)(uint32_t max_ms);
+
+/**
+ * @brief Register the Stop mode handler used by DelayMs() and Idle()
+ * @param handler Board function, nullptr to only ever use WFI
+ * @param min_ms Shortest wait worth the Stop entry and clock restore cost
+ */
+void SetStopModeHandler(StopModeHandler handler, uint32_t min_ms = 10);
+
 /**
  * @brief Get current system time in milliseconds
  * @return uint64_t Time in milliseconds since system start
@@ -53,15 +105,71 @@ uint64_t GetCurrentTimeMs();
  * @brief Get current system time in microseconds
  * @return uint64_t Time in microseconds since system start
  *
- * Uses DWT cycle counter if available for microsecond resolution
- * Falls back to millisecond resolution if DWT not available
+ * Monotonic over the full 64 bits and safe to call from interrupts.
+ * Uses the DWT cycle counter on Cortex-M3 and up, or the timer pair of
+ * project.yaml `us_timers` on Cortex-M0+, once InitMicrosecondTiming()
+ * has run; millisecond resolution before that (and on an M0+ without
+ * us_timers).
  */
 uint64_t GetCurrentTimeUs();
 
 /**
- * @brief Initialize microsecond timing (enables DWT if available)
+ * @brief Initialize microsecond timing
  *
  * Call this once during initialization if you need microsecond timing
- * Not required for millisecond timing
+ * (after the system clock is configured). Not required for millisecond
+ * timing. Cortex-M0+ parts (G0) have no cycle counter: there it takes
+ * over the two timers the project names, e.g. `us_timers: TIM2,TIM4`
+ * (a 32-bit timer and one it triggers), and does nothing without them.
+ */
+void InitMicrosecondTiming();
+
+/**
+ * @brief Give a timer of the microsecond time base back to the application
+ *
+ * Called by Timer when it configures @p instance; if it is one of the
+ * us_timers pair, GetCurrentTimeUs() drops back to millisecond resolution.
+ * @return true if it was, and its trigger chaining needs undoing
+ */
+bool ReleaseMicrosecondTimer(const void* instance);
+
+// ===== Power States =====
+
+enum class PowerState : uint8_t
+{
+    Run,
+    Sleep,   // WFI: the core clock stops, enabled peripherals keep running
+    Stop     // The board's Stop mode handler: every high-speed clock stops
+};
+
+struct PowerStateTimes
+{
+    uint64_t sleep_us;   // In WFI (DelayMs(), DelayUs(), Idle())
+    uint64_t stop_us;    // In Stop mode, as the board's handler measured it
+    uint32_t sleeps;     // WFI entries
+    uint32_t stops;      // Stop entries the handler took
+};
+
+/**
+ * @brief Time the core has spent asleep since startup
+ *
+ * Run time is the rest of GetCurrentTimeUs(). Each sleep is measured
+ * with the microsecond time base (millisecond steps before
+ * InitMicrosecondTiming()), with interrupts masked across the WFI, so
+ * the handler that wakes the core counts as run time.
+ */
+PowerStateTimes GetPowerStateTimes();
+
+/**
+ * @brief Called with the state the core enters, then PowerState::Run
+ *        once it runs again
+ *
+ * Runs with interrupts masked, right around each WFI and Stop entry;
+ * keep it to reading a few registers.
+ */
+using PowerStateHook = void (*)(PowerState state, void* context);
+
+/**
+ * @brief Register the power state hook (one; nullptr to remove it)
  */
-void InitMicrosecondTiming();
\ No newline at end of file
+void SetPowerStateHook(PowerStateHook hook, void* context = nullptr);
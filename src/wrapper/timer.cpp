@@ -1,5 +1,9 @@
 #include "timer.h"
 #include "gpio.h"
+#include "peripherals.h"
+#include "memory_sections.h"
+#include "event_loop.h"
+#include "sys.h"
 #include <algorithm>
 
 // Static storage for timer callbacks (to handle IRQs)
@@ -58,7 +62,27 @@ static int getTimerIndex(TIM_TypeDef* timer)
 Timer::Timer(TIM_TypeDef* timer)
     : timer_(timer),
       initialized_(false),
-      frequency_hz_(0)
+      frequency_hz_(0),
+      handler_(nullptr),
+      handler_context_(nullptr),
+      measure_latency_(false),
+      last_latency_ticks_(0),
+      max_latency_ticks_(0),
+      encoder_mode_(false),
+      encoder_last_(0),
+      encoder_position_(0),
+      dma_handle_{},
+      dma_ready_(false),
+      capturing_(false),
+      capture_channel_(0),
+      capture_buffer_(nullptr),
+      capture_length_(0),
+      capture_callback_(nullptr),
+      bursting_(false),
+      burst_buffer_(nullptr),
+      burst_length_(0),
+      burst_channels_(0),
+      burst_callback_(nullptr)
 {
     tim_handle_.Instance = timer;
 
@@ -91,48 +115,19 @@ Timer::~Timer()
 
 void Timer::enableTimerClock()
 {
-#ifdef TIM1
-    if (timer_ == TIM1) __HAL_RCC_TIM1_CLK_ENABLE();
-#endif
-#ifdef TIM2
-    if (timer_ == TIM2) __HAL_RCC_TIM2_CLK_ENABLE();
-#endif
-#ifdef TIM3
-    if (timer_ == TIM3) __HAL_RCC_TIM3_CLK_ENABLE();
-#endif
-#ifdef TIM4
-    if (timer_ == TIM4) __HAL_RCC_TIM4_CLK_ENABLE();
-#endif
-#ifdef TIM5
-    if (timer_ == TIM5) __HAL_RCC_TIM5_CLK_ENABLE();
-#endif
-#ifdef TIM6
-    if (timer_ == TIM6) __HAL_RCC_TIM6_CLK_ENABLE();
-#endif
-#ifdef TIM7
-    if (timer_ == TIM7) __HAL_RCC_TIM7_CLK_ENABLE();
-#endif
-#ifdef TIM8
-    if (timer_ == TIM8) __HAL_RCC_TIM8_CLK_ENABLE();
-#endif
-#ifdef TIM12
-    if (timer_ == TIM12) __HAL_RCC_TIM12_CLK_ENABLE();
-#endif
-#ifdef TIM13
-    if (timer_ == TIM13) __HAL_RCC_TIM13_CLK_ENABLE();
-#endif
-#ifdef TIM14
-    if (timer_ == TIM14) __HAL_RCC_TIM14_CLK_ENABLE();
-#endif
-#ifdef TIM15
-    if (timer_ == TIM15) __HAL_RCC_TIM15_CLK_ENABLE();
-#endif
-#ifdef TIM16
-    if (timer_ == TIM16) __HAL_RCC_TIM16_CLK_ENABLE();
-#endif
-#ifdef TIM17
-    if (timer_ == TIM17) __HAL_RCC_TIM17_CLK_ENABLE();
-#endif
+    enablePeripheralClock(timer_);
+}
+
+// A timer of the Cortex-M0+ microsecond time base (sys.cpp) runs chained
+// to the other; undo that before the HAL configures it, which leaves
+// SMCR and CR2 alone
+static void releaseTimeBase(TIM_TypeDef* timer)
+{
+    if (ReleaseMicrosecondTimer(timer)) {
+        timer->CR1 &= ~TIM_CR1_CEN;
+        timer->SMCR = 0;
+        timer->CR2 = 0;
+    }
 }
 
 bool Timer::initPWM(uint32_t frequency_hz, float duty_cycle)
@@ -159,6 +154,7 @@ bool Timer::initPWM(uint32_t frequency_hz, float duty_cycle)
     tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
 
+    releaseTimeBase(timer_);
     if (HAL_TIM_PWM_Init(&tim_handle_) != HAL_OK) {
         return false;
     }
@@ -174,6 +170,17 @@ bool Timer::initPeriodic(uint32_t period_ms, TimerCallback callback)
     }
 
     callback_ = callback;
+    return initPeriodic(period_ms, callback_ ? &Timer::invokeCallback : nullptr, this);
+}
+
+bool Timer::initPeriodic(uint32_t period_ms, TimerHandler handler, void* context)
+{
+    if (initialized_) {
+        return false;
+    }
+
+    handler_ = handler;
+    handler_context_ = context;
 
     // Convert period to frequency
     uint32_t frequency_hz = 1000 / period_ms;  // Hz
@@ -195,6 +202,7 @@ bool Timer::initPeriodic(uint32_t period_ms, TimerCallback callback)
     tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
 
+    releaseTimeBase(timer_);
     if (HAL_TIM_Base_Init(&tim_handle_) != HAL_OK) {
         return false;
     }
@@ -227,6 +235,7 @@ bool Timer::initFrequency(uint32_t frequency_hz)
     tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
 
+    releaseTimeBase(timer_);
     if (HAL_TIM_Base_Init(&tim_handle_) != HAL_OK) {
         return false;
     }
@@ -265,24 +274,14 @@ bool Timer::initTickPeriod(uint32_t tick_period_us)
     uint32_t frequency_hz = 1000000 / tick_period_us;
     frequency_hz_ = frequency_hz;
 
-    // Determine maximum period based on timer type
-    // Check if this is a 32-bit timer (TIM2, TIM5 on most platforms)
-    uint32_t max_period = 0xFFFF;  // Default 16-bit
-
-#ifdef TIM2
-    if (timer_ == TIM2) max_period = 0xFFFFFFFF;  // 32-bit
-#endif
-#ifdef TIM5
-    if (timer_ == TIM5) max_period = 0xFFFFFFFF;  // 32-bit
-#endif
-
     // Configure timer base for maximum period (free-running counter)
     tim_handle_.Init.Prescaler = prescaler - 1;
     tim_handle_.Init.CounterMode = TIM_COUNTERMODE_UP;
-    tim_handle_.Init.Period = max_period;  // Maximum period for free-running
+    tim_handle_.Init.Period = getMaxPeriod();  // Maximum period for free-running
     tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
 
+    releaseTimeBase(timer_);
     if (HAL_TIM_Base_Init(&tim_handle_) != HAL_OK) {
         return false;
     }
@@ -350,6 +349,23 @@ void Timer::setDutyCycle(uint32_t channel, float duty_cycle)
     __HAL_TIM_SET_COMPARE(&tim_handle_, hal_channel, pulse);
 }
 
+void Timer::setCompare(uint32_t channel, uint32_t compare)
+{
+    if (!initialized_ || channel < 1 || channel > 4) {
+        return;
+    }
+    __HAL_TIM_SET_COMPARE(&tim_handle_, channelToHAL(channel), compare);
+}
+
+void Timer::setDutyCycleQ16(uint32_t channel, uint32_t duty)
+{
+    if (duty > 65536) {
+        duty = 65536;
+    }
+    // Multiply and shift only; no float or divide on the M0+
+    setCompare(channel, (uint32_t)(((uint64_t)(tim_handle_.Init.Period + 1) * duty) >> 16));
+}
+
 float Timer::getDutyCycle(uint32_t channel) const
 {
     if (!initialized_ || channel < 1 || channel > 4) {
@@ -363,12 +379,34 @@ float Timer::getDutyCycle(uint32_t channel) const
     return (float)pulse / (float)period * 100.0f;
 }
 
+bool Timer::enableTriggerOutput(uint32_t trigger)
+{
+    if (!initialized_) {
+        return false;
+    }
+
+    TIM_MasterConfigTypeDef config = {0};
+    config.MasterOutputTrigger = trigger;
+#if defined(TIM_TRGO2_RESET)
+    // Advanced timers also drive TRGO2, some ADCs (G0) only take TIM1's TRGO2
+    config.MasterOutputTrigger2 = (trigger == TIM_TRGO_UPDATE) ? TIM_TRGO2_UPDATE : TIM_TRGO2_RESET;
+#endif
+    config.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+
+    return HAL_TIMEx_MasterConfigSynchronization(&tim_handle_, &config) == HAL_OK;
+}
+
 void Timer::start()
 {
     if (!initialized_) {
         return;
     }
 
+    if (encoder_mode_) {
+        HAL_TIM_Encoder_Start(&tim_handle_, TIM_CHANNEL_ALL);
+        return;
+    }
+
     // If any PWM channels are configured, start them
     bool has_pwm_channels = false;
     for (int i = 0; i < 4; i++) {
@@ -380,7 +418,7 @@ void Timer::start()
     }
 
     // If no PWM channels and we have a callback, start in interrupt mode
-    if (!has_pwm_channels && callback_) {
+    if (!has_pwm_channels && handler_) {
         HAL_TIM_Base_Start_IT(&tim_handle_);
     } else if (!has_pwm_channels) {
         // Just start the base timer
@@ -394,6 +432,13 @@ void Timer::stop()
         return;
     }
 
+    if (encoder_mode_) {
+        HAL_TIM_Encoder_Stop(&tim_handle_, TIM_CHANNEL_ALL);
+        return;
+    }
+    stopCapture();
+    stopBurst();
+
     // Stop all PWM channels
     for (int i = 0; i < 4; i++) {
         if (channel_enabled_[i]) {
@@ -403,7 +448,7 @@ void Timer::stop()
     }
 
     // Stop base timer
-    if (callback_) {
+    if (handler_) {
         HAL_TIM_Base_Stop_IT(&tim_handle_);
     } else {
         HAL_TIM_Base_Stop(&tim_handle_);
@@ -438,6 +483,15 @@ uint32_t Timer::getCounter() const
     return __HAL_TIM_GET_COUNTER(&tim_handle_);
 }
 
+float Timer::getUpdateRate() const
+{
+    if (!initialized_) {
+        return 0.0f;
+    }
+    const float divisor = (float)(tim_handle_.Init.Prescaler + 1) * (float)(tim_handle_.Init.Period + 1);
+    return (float)getTimerClock(timer_) / divisor;
+}
+
 void Timer::setCounter(uint32_t value)
 {
     if (!initialized_) {
@@ -448,11 +502,386 @@ void Timer::setCounter(uint32_t value)
 
 void Timer::handleInterrupt()
 {
-    if (callback_) {
-        callback_();
+    if (measure_latency_) {
+        recordLatency();
+    }
+    if (handler_ != nullptr) {
+        handler_(handler_context_);
+    }
+    LUMOS_POST_EVENT(EVENT_TIMER);
+}
+
+void Timer::invokeCallback(void* context)
+{
+    Timer* timer = static_cast<Timer*>(context);
+    if (timer->callback_) {
+        timer->callback_();
+    }
+}
+
+void Timer::enableInterrupt(IRQn_Type irq, uint32_t priority)
+{
+    HAL_NVIC_SetPriority(irq, priority, 0);
+    HAL_NVIC_EnableIRQ(irq);
+}
+
+void Timer::enableLatencyMeasurement(bool enable)
+{
+    last_latency_ticks_ = 0;
+    max_latency_ticks_ = 0;
+    measure_latency_ = enable;
+}
+
+void Timer::recordLatency()
+{
+    // Up-counting from 0 at the update event, so the counter is the time
+    // since the event in timer ticks
+    const uint32_t ticks = timer_->CNT;
+    last_latency_ticks_ = ticks;
+    if (ticks > max_latency_ticks_) {
+        max_latency_ticks_ = ticks;
+    }
+}
+
+uint32_t Timer::ticksToCycles(uint32_t ticks) const
+{
+    const uint32_t timer_clock = getTimerClock(timer_);
+    if (timer_clock == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)ticks * (tim_handle_.Init.Prescaler + 1) * HAL_RCC_GetHCLKFreq() / timer_clock);
+}
+
+// ===== Encoder Mode =====
+
+bool Timer::initEncoder(GPIO_TypeDef* port_a, uint16_t pin_a, GPIO_TypeDef* port_b, uint16_t pin_b,
+                        uint32_t alternate, uint32_t filter)
+{
+    if (initialized_) {
+        return false;
+    }
+
+    GPIO gpio_a(port_a, pin_a);
+    gpio_a.setAlternateFunction(alternate);
+    GPIO gpio_b(port_b, pin_b);
+    gpio_b.setAlternateFunction(alternate);
+
+    // Count every encoder edge, over the full counter range
+    tim_handle_.Init.Prescaler = 0;
+    tim_handle_.Init.CounterMode = TIM_COUNTERMODE_UP;
+    tim_handle_.Init.Period = getMaxPeriod();
+    tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+    TIM_Encoder_InitTypeDef config = {0};
+    config.EncoderMode = TIM_ENCODERMODE_TI12;
+    config.IC1Polarity = TIM_ICPOLARITY_RISING;
+    config.IC1Selection = TIM_ICSELECTION_DIRECTTI;
+    config.IC1Prescaler = TIM_ICPSC_DIV1;
+    config.IC1Filter = filter & 0xF;
+    config.IC2Polarity = TIM_ICPOLARITY_RISING;
+    config.IC2Selection = TIM_ICSELECTION_DIRECTTI;
+    config.IC2Prescaler = TIM_ICPSC_DIV1;
+    config.IC2Filter = filter & 0xF;
+
+    releaseTimeBase(timer_);
+    if (HAL_TIM_Encoder_Init(&tim_handle_, &config) != HAL_OK) {
+        return false;
+    }
+
+    encoder_mode_ = true;
+    encoder_last_ = 0;
+    encoder_position_ = 0;
+    initialized_ = true;
+    return true;
+}
+
+int32_t Timer::getEncoderPosition()
+{
+    if (!encoder_mode_) {
+        return 0;
+    }
+
+    // Signed distance since the last read, at the counter's width
+    const uint32_t count = timer_->CNT;
+    if (getMaxPeriod() == 0xFFFF) {
+        encoder_position_ += (int16_t)(count - encoder_last_);
+    } else {
+        encoder_position_ += (int32_t)(count - encoder_last_);
+    }
+    encoder_last_ = count;
+    return encoder_position_;
+}
+
+void Timer::setEncoderPosition(int32_t position)
+{
+    encoder_last_ = timer_->CNT;
+    encoder_position_ = position;
+}
+
+// ===== Input Capture =====
+
+bool Timer::initInputCapture(uint32_t tick_frequency_hz)
+{
+    if (initialized_ || tick_frequency_hz == 0) {
+        return false;
+    }
+
+    uint32_t prescaler = getTimerClock(timer_) / tick_frequency_hz;
+    if (prescaler == 0 || prescaler > 65536) {
+        return false;
+    }
+    frequency_hz_ = tick_frequency_hz;
+
+    // Free-running so timestamps wrap at the counter width
+    tim_handle_.Init.Prescaler = prescaler - 1;
+    tim_handle_.Init.CounterMode = TIM_COUNTERMODE_UP;
+    tim_handle_.Init.Period = getMaxPeriod();
+    tim_handle_.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    tim_handle_.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+
+    releaseTimeBase(timer_);
+    if (HAL_TIM_IC_Init(&tim_handle_) != HAL_OK) {
+        return false;
+    }
+
+    initialized_ = true;
+    return true;
+}
+
+bool Timer::setCaptureChannel(uint32_t channel, GPIO_TypeDef* port, uint16_t pin, uint32_t alternate,
+                              uint32_t polarity, uint32_t filter)
+{
+    if (!initialized_ || encoder_mode_ || channel < 1 || channel > 4) {
+        return false;
+    }
+
+    GPIO gpio(port, pin);
+    gpio.setAlternateFunction(alternate);
+
+    TIM_IC_InitTypeDef config = {0};
+    config.ICPolarity = polarity;
+    config.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    config.ICPrescaler = TIM_ICPSC_DIV1;
+    config.ICFilter = filter & 0xF;
+
+    return HAL_TIM_IC_ConfigChannel(&tim_handle_, &config, channelToHAL(channel)) == HAL_OK;
+}
+
+bool Timer::beginCaptureDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq)
+{
+    return initDma(dma_instance, dma_request, dma_irq, DMA_PERIPH_TO_MEMORY);
+}
+
+// Circular word DMA between memory and the capture or burst registers
+bool Timer::initDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq, uint32_t direction)
+{
+#if defined(STM32H5)
+    // GPDMA only runs circular transfers from a linked-list queue
+    (void)dma_instance;
+    (void)dma_request;
+    (void)dma_irq;
+    (void)direction;
+    return false;
+#else
+    if (capturing_ || bursting_) {
+        return false;
+    }
+
+    enableDMAClock(dma_instance);
+
+    dma_handle_ = {};
+    dma_handle_.Instance = dma_instance;
+#if defined(STM32F4)
+    dma_handle_.Init.Channel = dma_request;
+#else
+    dma_handle_.Init.Request = dma_request;
+#endif
+    dma_handle_.Init.Direction = direction;
+    dma_handle_.Init.PeriphInc = DMA_PINC_DISABLE;
+    dma_handle_.Init.MemInc = DMA_MINC_ENABLE;
+    // Whole CCR words, so 16- and 32-bit timers share one buffer type
+    dma_handle_.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    dma_handle_.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    dma_handle_.Init.Mode = DMA_CIRCULAR;
+    dma_handle_.Init.Priority = DMA_PRIORITY_HIGH;
+#if defined(STM32H7) || defined(STM32F4)
+    dma_handle_.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+
+    if (HAL_DMA_Init(&dma_handle_) != HAL_OK) {
+        return false;
+    }
+    dma_ready_ = true;
+
+    HAL_NVIC_SetPriority(dma_irq, 5, 0);
+    HAL_NVIC_EnableIRQ(dma_irq);
+    return true;
+#endif
+}
+
+bool Timer::startCapture(uint32_t channel, uint32_t* buffer, uint16_t length, CaptureCallback callback)
+{
+    if (!initialized_ || encoder_mode_ || !dma_ready_ || capturing_ || bursting_ || buffer == nullptr ||
+        dma_handle_.Init.Direction != DMA_PERIPH_TO_MEMORY ||
+        channel < 1 || channel > 4 || length < 2 || length % 2 != 0) {
+        return false;
+    }
+
+#if defined(STM32H7)
+    // DMA1/DMA2 cannot reach DTCM, and each half is invalidated from the
+    // D-cache on its own, so the halves must cover whole cache lines
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    if ((address >= 0x20000000 && address < 0x20020000) ||
+        (isDCacheable(buffer) && (address % 32 != 0 || length % 16 != 0))) {
+        return false;
+    }
+#endif
+
+    // The HAL picks the DMA handle by capture channel
+    tim_handle_.hdma[TIM_DMA_ID_CC1 + (channel - 1)] = &dma_handle_;
+    dma_handle_.Parent = &tim_handle_;
+
+    capture_channel_ = channel;
+    capture_buffer_ = buffer;
+    capture_length_ = length;
+    capture_callback_ = callback;
+
+    invalidateDCache(buffer, length * sizeof(uint32_t));
+
+    capturing_ = true;
+    if (HAL_TIM_IC_Start_DMA(&tim_handle_, channelToHAL(channel), buffer, length) != HAL_OK) {
+        capturing_ = false;
+        capture_callback_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Timer::stopCapture()
+{
+    if (!capturing_) {
+        return;
+    }
+
+    HAL_TIM_IC_Stop_DMA(&tim_handle_, channelToHAL(capture_channel_));
+    capturing_ = false;
+    capture_callback_ = nullptr;
+}
+
+void Timer::onCaptureBlock(bool second_half)
+{
+    if (!capturing_) {
+        return;
+    }
+
+    const uint16_t half = capture_length_ / 2;
+    const uint32_t* block = capture_buffer_ + (second_half ? half : 0);
+
+    // Drop stale cache lines so the CPU reads what the DMA wrote
+    invalidateDCache(const_cast<uint32_t*>(block), half * sizeof(uint32_t));
+
+    if (capture_callback_) {
+        capture_callback_(block, half);
     }
 }
 
+// ===== DMA Burst PWM =====
+
+bool Timer::beginBurstDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq)
+{
+    return initDma(dma_instance, dma_request, dma_irq, DMA_MEMORY_TO_PERIPH);
+}
+
+bool Timer::startBurst(const uint32_t* buffer, uint16_t updates, uint8_t channels, BurstCallback callback)
+{
+    static const uint32_t burst_lengths[] = {
+        TIM_DMABURSTLENGTH_1TRANSFER, TIM_DMABURSTLENGTH_2TRANSFERS,
+        TIM_DMABURSTLENGTH_3TRANSFERS, TIM_DMABURSTLENGTH_4TRANSFERS};
+
+    const uint32_t length = (uint32_t)updates * channels;
+    if (!initialized_ || encoder_mode_ || !dma_ready_ || capturing_ || bursting_ || buffer == nullptr ||
+        dma_handle_.Init.Direction != DMA_MEMORY_TO_PERIPH ||
+        channels < 1 || channels > 4 || updates < 2 || updates % 2 != 0 || length > 0xFFFF) {
+        return false;
+    }
+
+#if defined(STM32H7)
+    // DMA1/DMA2 cannot reach DTCM
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    if (address >= 0x20000000 && address < 0x20020000) {
+        return false;
+    }
+#endif
+
+    // Output the channels, then every update event the DMA writes the next
+    // CCR1..CCRn through DMAR
+    for (uint8_t i = 0; i < channels; i++) {
+        if (channel_enabled_[i]) {
+            HAL_TIM_PWM_Start(&tim_handle_, channelToHAL(i + 1));
+        }
+    }
+
+    tim_handle_.hdma[TIM_DMA_ID_UPDATE] = &dma_handle_;
+    dma_handle_.Parent = &tim_handle_;
+
+    burst_buffer_ = buffer;
+    burst_length_ = (uint16_t)length;
+    burst_channels_ = channels;
+    burst_callback_ = callback;
+
+    cleanDCache(buffer, length * sizeof(uint32_t));
+
+    bursting_ = true;
+    if (HAL_TIM_DMABurst_MultiWriteStart(&tim_handle_, TIM_DMABASE_CCR1, TIM_DMA_UPDATE,
+                                         const_cast<uint32_t*>(buffer), burst_lengths[channels - 1],
+                                         length) != HAL_OK) {
+        bursting_ = false;
+        burst_callback_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Timer::stopBurst()
+{
+    if (!bursting_) {
+        return;
+    }
+
+    HAL_TIM_DMABurst_WriteStop(&tim_handle_, TIM_DMA_UPDATE);
+    bursting_ = false;
+    burst_callback_ = nullptr;
+}
+
+void Timer::onBurstBlock(bool second_half)
+{
+    if (!bursting_) {
+        return;
+    }
+
+    // The half just sent is free to refill while the DMA sends the other
+    const uint16_t half = burst_length_ / 2;
+    const uint32_t* block = burst_buffer_ + (second_half ? half : 0);
+    if (burst_callback_) {
+        burst_callback_(const_cast<uint32_t*>(block), half / burst_channels_);
+        // Write CPU-side values back so the DMA doesn't send stale memory
+        cleanDCache(block, half * sizeof(uint32_t));
+    }
+}
+
+uint32_t Timer::getMaxPeriod() const
+{
+    // 32-bit counters on TIM2 and TIM5, 16-bit everywhere else
+#ifdef TIM2
+    if (timer_ == TIM2) return 0xFFFFFFFF;
+#endif
+#ifdef TIM5
+    if (timer_ == TIM5) return 0xFFFFFFFF;
+#endif
+    return 0xFFFF;
+}
+
 uint32_t Timer::channelToHAL(uint32_t channel) const
 {
     switch (channel) {
@@ -482,6 +911,18 @@ bool calculateTimerConfig(uint32_t timer_clock, uint32_t target_freq,
     const uint32_t MAX_PRESCALER = 65536;
     const uint32_t MAX_PERIOD = 65536;
 
+    // Prefer an exact divisor so sampling and control rates don't drift,
+    // using the smallest prescaler (largest period) that divides evenly
+    if (total_divisor > 0 && timer_clock % target_freq == 0) {
+        for (prescaler = (total_divisor + MAX_PERIOD - 1) / MAX_PERIOD; prescaler <= MAX_PRESCALER; prescaler++) {
+            if (total_divisor % prescaler == 0) {
+                period = total_divisor / prescaler;
+                if (period < 2) break;
+                return true;
+            }
+        }
+    }
+
     // Try to keep period as large as possible for PWM resolution
     for (prescaler = 1; prescaler <= MAX_PRESCALER; prescaler++) {
         period = total_divisor / prescaler;
@@ -592,12 +1033,40 @@ uint32_t getTimerClock(TIM_TypeDef* timer)
 extern "C" void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
     // Find which timer instance this is
-    for (int i = 0; i < 20; i++) {
-        if (timer_instances[i] != nullptr) {
-            if (timer_instances[i]->getHandle() == htim) {
-                timer_instances[i]->handleInterrupt();
-                break;
-            }
-        }
+    int idx = getTimerIndex(htim->Instance);
+    if (idx < 0 || timer_instances[idx] == nullptr) {
+        return;
+    }
+
+    // In burst mode this is the DMA reaching the end of the buffer
+    if (timer_instances[idx]->isBursting()) {
+        timer_instances[idx]->onBurstBlock(true);
+    } else {
+        timer_instances[idx]->handleInterrupt();
+    }
+}
+
+extern "C" void HAL_TIM_PeriodElapsedHalfCpltCallback(TIM_HandleTypeDef *htim)
+{
+    int idx = getTimerIndex(htim->Instance);
+    if (idx >= 0 && timer_instances[idx] != nullptr) {
+        timer_instances[idx]->onBurstBlock(false);
+    }
+}
+
+extern "C" void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef *htim)
+{
+    // In capture DMA mode this is the DMA reaching the end of the buffer
+    int idx = getTimerIndex(htim->Instance);
+    if (idx >= 0 && timer_instances[idx] != nullptr) {
+        timer_instances[idx]->onCaptureBlock(true);
+    }
+}
+
+extern "C" void HAL_TIM_IC_CaptureHalfCpltCallback(TIM_HandleTypeDef *htim)
+{
+    int idx = getTimerIndex(htim->Instance);
+    if (idx >= 0 && timer_instances[idx] != nullptr) {
+        timer_instances[idx]->onCaptureBlock(false);
     }
 }
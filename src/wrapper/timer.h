@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <functional>
+#include "fixed_point.h"
+#include "trace.h"
 
 // Platform-specific HAL headers
 #if defined(STM32H7)
@@ -23,6 +25,13 @@
     #error "Unsupported STM32 platform. Define STM32H7, STM32G0, STM32G4, STM32F4, or STM32H5."
 #endif
 
+// DMA stream (H7, F4) or channel (G0, G4) used for input capture
+#if defined(STM32H7) || defined(STM32F4)
+    typedef DMA_Stream_TypeDef TimerDmaInstance;
+#else
+    typedef DMA_Channel_TypeDef TimerDmaInstance;
+#endif
+
 // Timer Class - Hardware Timer Control
 //
 // Usage Examples:
@@ -39,6 +48,18 @@
 //      periodic.initPeriodic(100, []() { /* called every 100ms */ });
 //      periodic.start();
 //
+//      For interrupt-critical work use a plain handler with a context
+//      pointer and forward the IRQ straight to the timer; this skips
+//      HAL_TIM_IRQHandler and std::function entirely:
+//      void onTick(void* ctx) { static_cast<Controller*>(ctx)->step(); }
+//      periodic.initPeriodic(1, onTick, &controller);
+//      periodic.enableInterrupt(TIM3_IRQn);
+//      periodic.start();
+//      extern "C" void TIM3_IRQHandler(void) { periodic.handleUpdateInterrupt(); }
+//
+//      enableLatencyMeasurement() then records how long each update took to
+//      reach the handler (getLatencyCycles(), in CPU cycles).
+//
 //   3. Microsecond Counter:
 //      Timer us_counter(TIM14);
 //      us_counter.initMicrosecondCounter();  // 1μs per tick
@@ -57,22 +78,106 @@
 //      custom.start();
 //      uint32_t ticks = custom.getCounter();
 //
+//   6. Trigger for other peripherals (e.g. ADC scans in step with PWM):
+//      Timer pwm_timer(TIM1);
+//      pwm_timer.initPWM(20000, 50);
+//      pwm_timer.enableTriggerOutput();  // TRGO on every update, 20 kHz
+//      pwm_timer.start();
+//
+//   7. Quadrature Encoder:
+//      Timer encoder(TIM3);
+//      encoder.initEncoder(GPIOA, GPIO_PIN_6, GPIOA, GPIO_PIN_7, GPIO_AF2_TIM3);
+//      encoder.start();
+//      int32_t position = encoder.getEncoderPosition();  // 4 counts per line
+//
+//      Counting is done by the timer; getEncoderPosition() extends 16-bit
+//      counters to 32 bits, so call it at least every 32768 counts.
+//
+//   8. Input Capture to DMA (edge timestamps, e.g. pulse widths):
+//      static uint32_t edges[64];
+//      Timer capture(TIM2);
+//      capture.initInputCapture(1000000);  // 1 MHz timestamps
+//      capture.setCaptureChannel(1, GPIOA, GPIO_PIN_0, GPIO_AF1_TIM2, TIM_INPUTCHANNELPOLARITY_BOTHEDGE);
+//      capture.beginCaptureDma(DMA1_Stream1, DMA_REQUEST_TIM2_CH1, DMA1_Stream1_IRQn);
+//      capture.startCapture(1, edges, 64, [](const uint32_t* t, uint16_t n) {
+//          uint32_t width = (t[1] - t[0]) & capture.getCounterMask();
+//      });
+//
+//      extern "C" void DMA1_Stream1_IRQHandler(void) { capture.handleDmaInterrupt(); }
+//
+//      Like ADC scans the buffer is split in halves, each handed to the
+//      callback once the DMA has moved on to the other. On the H7 the
+//      buffer must be outside DTCM, 32-byte aligned, with a length that is
+//      a multiple of 16.
+//
+//   9. DMA Burst PWM (all channels updated every period, no CPU):
+//      static uint32_t phases[2 * 16 * 3];  // 2 halves of 16 updates of CCR1..CCR3
+//      Timer pwm(TIM1);
+//      pwm.initPWM(20000, 0);
+//      pwm.setPWMChannel(1, GPIOA, GPIO_PIN_8, GPIO_AF1_TIM1);
+//      pwm.setPWMChannel(2, GPIOA, GPIO_PIN_9, GPIO_AF1_TIM1);
+//      pwm.setPWMChannel(3, GPIOA, GPIO_PIN_10, GPIO_AF1_TIM1);
+//      pwm.beginBurstDma(DMA1_Stream2, DMA_REQUEST_TIM1_UP, DMA1_Stream2_IRQn);
+//      pwm.startBurst(phases, 32, 3, [](uint32_t* next, uint16_t updates) {
+//          // Refill 'updates' sets of 3 compare values (0..getPeriodTicks())
+//      });
+//
+//      Compare values are in ticks; precompute them with getPeriodTicks()
+//      or use setDutyCycleQ16() for integer single-channel updates.
+//
 class Timer
 {
 public:
     // Callback type for periodic interrupts
     using TimerCallback = std::function<void()>;
 
+    // Plain handler for interrupt-critical code: one direct call from the IRQ
+    using TimerHandler = void (*)(void* context);
+
+    // Callback for each complete half of the capture buffer
+    using CaptureCallback = std::function<void(const uint32_t* timestamps, uint16_t count)>;
+
+    // Callback with each half of the burst buffer once it has been sent
+    using BurstCallback = std::function<void(uint32_t* compares, uint16_t updates)>;
+
 private:
     TIM_HandleTypeDef tim_handle_;
     TIM_TypeDef* timer_;
     bool initialized_;
     uint32_t frequency_hz_;
     TimerCallback callback_;
+    TimerHandler handler_;
+    void* handler_context_;
+
+    // Update-to-handler latency, in timer ticks
+    bool measure_latency_;
+    volatile uint32_t last_latency_ticks_;
+    volatile uint32_t max_latency_ticks_;
 
     // Track which channels are configured
     bool channel_enabled_[4];  // Up to 4 channels
 
+    // Encoder mode, see initEncoder()
+    bool encoder_mode_;
+    uint32_t encoder_last_;
+    int32_t encoder_position_;
+
+    // Input capture, see startCapture()
+    DMA_HandleTypeDef dma_handle_;
+    bool dma_ready_;
+    bool capturing_;
+    uint32_t capture_channel_;
+    uint32_t* capture_buffer_;
+    uint16_t capture_length_;
+    CaptureCallback capture_callback_;
+
+    // DMA burst PWM, see startBurst()
+    bool bursting_;
+    const uint32_t* burst_buffer_;
+    uint16_t burst_length_;
+    uint8_t burst_channels_;
+    BurstCallback burst_callback_;
+
 public:
     Timer() = delete;
     Timer(TIM_TypeDef* timer);
@@ -100,6 +205,17 @@ public:
      */
     bool initPeriodic(uint32_t period_ms, TimerCallback callback);
 
+    /**
+     * @brief Initialize timer for periodic interrupts with a plain handler
+     * @param period_ms Period in milliseconds
+     * @param handler Function to call on each timer interrupt
+     * @param context Passed to the handler
+     * @return true if successful
+     *
+     * Example: timer.initPeriodic(1, onTick, &controller);
+     */
+    bool initPeriodic(uint32_t period_ms, TimerHandler handler, void* context = nullptr);
+
     /**
      * @brief Initialize timer with custom frequency
      * @param frequency_hz Timer frequency in Hz
@@ -171,6 +287,182 @@ public:
      */
     float getDutyCycle(uint32_t channel) const;
 
+    /**
+     * @brief Set a channel's compare value directly, in timer ticks
+     * @param channel Timer channel (1-4)
+     * @param compare 0 to getPeriodTicks()
+     */
+    void setCompare(uint32_t channel, uint32_t compare);
+
+    /**
+     * @brief Set duty cycle as a 16-bit fraction, without floating point
+     * @param channel Timer channel (1-4)
+     * @param duty 0 (off) to 65536 (always on)
+     *
+     * Example: timer.setDutyCycleQ16(1, 3 * 65536 / 4);  // 75%
+     */
+    void setDutyCycleQ16(uint32_t channel, uint32_t duty);
+
+    /**
+     * @brief Set PWM duty cycle from a fixed-point percentage (fixed_point.h)
+     * @param channel Timer channel (1-4)
+     * @param duty_cycle Duty cycle 0-100 (percentage)
+     *
+     * Integer math only, for boards without an FPU; with Real arguments the
+     * float or the Fixed overload is picked to suit the board.
+     *
+     * Example: timer.setDutyCycle(1, 37.5_fx);
+     */
+    void setDutyCycle(uint32_t channel, Fixed duty_cycle)
+    {
+        const int32_t percent = duty_cycle.raw();
+        setDutyCycleQ16(channel, percent > 0 ? (uint32_t)percent / 100 : 0);
+    }
+
+    /**
+     * @brief Timer ticks per PWM period, the full-scale compare value
+     */
+    uint32_t getPeriodTicks() const { return tim_handle_.Init.Period + 1; }
+
+    // ===== DMA Burst PWM =====
+
+    /**
+     * @brief Set up the DMA that feeds compare values on each update
+     * @param dma_instance DMA stream/channel (e.g. DMA1_Stream2, DMA1_Channel3)
+     * @param dma_request Update request of this timer (e.g. DMA_REQUEST_TIM1_UP)
+     * @param dma_irq IRQ of the stream/channel; forward it to handleDmaInterrupt()
+     * @return true if successful (false on H5: GPDMA circular mode needs a linked list)
+     */
+    bool beginBurstDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq);
+
+    /**
+     * @brief Stream compare values into CCR1..CCRn on every update event
+     * @param buffer @p channels compare values per update, must stay valid
+     *        until stopBurst()
+     * @param updates Number of updates in @p buffer (even); it repeats
+     * @param channels Channels written per update, starting at channel 1
+     * @param callback Optional, called from the DMA interrupt with each half
+     *        after it has been sent, to refill it
+     * @return true if streaming started
+     *
+     * Starts the PWM outputs of the configured channels; don't call start()
+     * as well.
+     */
+    bool startBurst(const uint32_t* buffer, uint16_t updates, uint8_t channels = 4,
+                    BurstCallback callback = nullptr);
+
+    /**
+     * @brief Stop streaming; outputs keep the last compare values
+     */
+    void stopBurst();
+
+    bool isBursting() const { return bursting_; }
+
+    /**
+     * @brief Hand a sent half to the callback (called from the HAL callbacks)
+     * @param second_half false for the first half of the buffer
+     */
+    void onBurstBlock(bool second_half);
+
+    /**
+     * @brief Drive the timer's TRGO output, e.g. as an ADC trigger
+     * @param trigger Event that fires TRGO (TIM_TRGO_UPDATE, TIM_TRGO_OC1REF, ...)
+     * @return true if successful
+     *
+     * Must call one of the init functions first!
+     * Example: timer.enableTriggerOutput();  // TRGO at the timer frequency
+     */
+    bool enableTriggerOutput(uint32_t trigger = TIM_TRGO_UPDATE);
+
+    // ===== Encoder Mode =====
+
+    /**
+     * @brief Initialize timer as a quadrature encoder counter (x4)
+     * @param port_a, pin_a Channel 1 input (encoder A)
+     * @param port_b, pin_b Channel 2 input (encoder B)
+     * @param alternate Alternate function (GPIO_AF2_TIM3, etc.)
+     * @param filter Input filter 0-15 against contact bounce and noise
+     * @return true if successful
+     *
+     * Call start() to begin counting.
+     */
+    bool initEncoder(GPIO_TypeDef* port_a, uint16_t pin_a, GPIO_TypeDef* port_b, uint16_t pin_b,
+                     uint32_t alternate, uint32_t filter = 0);
+
+    /**
+     * @brief Get the encoder position, extended to 32 bits
+     * @return Signed count since start or setEncoderPosition()
+     */
+    int32_t getEncoderPosition();
+
+    /**
+     * @brief Set the current encoder position
+     */
+    void setEncoderPosition(int32_t position);
+
+    // ===== Input Capture =====
+
+    /**
+     * @brief Initialize timer as a free-running timestamp counter for captures
+     * @param tick_frequency_hz Counter rate, i.e. timestamp resolution
+     * @return true if successful
+     */
+    bool initInputCapture(uint32_t tick_frequency_hz);
+
+    /**
+     * @brief Configure a capture channel with its GPIO pin
+     * @param channel Timer channel (1-4)
+     * @param polarity TIM_INPUTCHANNELPOLARITY_RISING, _FALLING or _BOTHEDGE
+     * @param filter Input filter 0-15
+     * @return true if successful
+     *
+     * Must call initInputCapture() first!
+     */
+    bool setCaptureChannel(uint32_t channel, GPIO_TypeDef* port, uint16_t pin, uint32_t alternate,
+                           uint32_t polarity = TIM_INPUTCHANNELPOLARITY_RISING, uint32_t filter = 0);
+
+    /**
+     * @brief Set up the DMA that streams capture timestamps
+     * @param dma_instance DMA stream/channel (e.g. DMA1_Stream1, DMA1_Channel2)
+     * @param dma_request Request line of the capture channel (e.g. DMA_REQUEST_TIM2_CH1)
+     * @param dma_irq IRQ of the stream/channel; forward it to handleDmaInterrupt()
+     * @return true if successful (false on H5: GPDMA circular mode needs a linked list)
+     */
+    bool beginCaptureDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq);
+
+    /**
+     * @brief Start streaming capture timestamps into a double buffer
+     * @param channel Capture channel set up with setCaptureChannel()
+     * @param buffer Timestamp storage, must stay valid until stopCapture()
+     * @param length Timestamps in @p buffer (even)
+     * @param callback Called from the DMA interrupt with each full half
+     * @return true if capturing started
+     */
+    bool startCapture(uint32_t channel, uint32_t* buffer, uint16_t length, CaptureCallback callback);
+
+    /**
+     * @brief Stop streaming captures
+     */
+    void stopCapture();
+
+    bool isCapturing() const { return capturing_; }
+
+    /**
+     * @brief Mask for wrap-safe timestamp differences: (b - a) & mask
+     */
+    uint32_t getCounterMask() const { return tim_handle_.Init.Period; }
+
+    /**
+     * @brief Handle capture or burst DMA interrupt (call from the DMA IRQ handler)
+     */
+    void handleDmaInterrupt() { LUMOS_TRACE_ISR("timer dma"); HAL_DMA_IRQHandler(&dma_handle_); }
+
+    /**
+     * @brief Deliver a completed half (called from the HAL callbacks)
+     * @param second_half false for the first half of the buffer
+     */
+    void onCaptureBlock(bool second_half);
+
     // ===== Timer Control =====
 
     /**
@@ -205,6 +497,15 @@ public:
      */
     uint32_t getFrequency() const { return frequency_hz_; }
 
+    /**
+     * @brief Get the update rate the hardware actually runs at
+     * @return Rate in Hz from the timer clock, prescaler and period
+     *
+     * Differs from getFrequency() when the timer clock is not an exact
+     * multiple of the requested frequency.
+     */
+    float getUpdateRate() const;
+
     /**
      * @brief Get current timer counter value
      * @return Counter value
@@ -231,6 +532,53 @@ public:
      */
     void handleInterrupt();
 
+    /**
+     * @brief Enable the timer's interrupt in the NVIC
+     * @param irq Timer IRQ (TIM3_IRQn, TIM6_DAC_IRQn, ...)
+     * @param priority NVIC preemption priority
+     */
+    void enableInterrupt(IRQn_Type irq, uint32_t priority = 5);
+
+    /**
+     * @brief Fast update interrupt path, called directly from TIMx_IRQHandler
+     *
+     * Clears the update flag and calls the handler without going through
+     * HAL_TIM_IRQHandler. Only for timers that use no other interrupts.
+     */
+    void handleUpdateInterrupt()
+    {
+        LUMOS_TRACE_ISR("timer update");
+        if ((timer_->SR & TIM_SR_UIF) == 0) {
+            return;
+        }
+        timer_->SR = ~TIM_SR_UIF;
+        if (measure_latency_) {
+            recordLatency();
+        }
+        if (handler_ != nullptr) {
+            handler_(handler_context_);
+        }
+    }
+
+    /**
+     * @brief Record update-to-handler latency from the counter value
+     * @param enable true to measure on every interrupt
+     *
+     * Uses the timer's own counter, so it also works on Cortex-M0+ parts
+     * without a DWT cycle counter.
+     */
+    void enableLatencyMeasurement(bool enable = true);
+
+    /**
+     * @brief Latency of the last interrupt in CPU cycles
+     */
+    uint32_t getLatencyCycles() const { return ticksToCycles(last_latency_ticks_); }
+
+    /**
+     * @brief Worst latency since enableLatencyMeasurement() in CPU cycles
+     */
+    uint32_t getMaxLatencyCycles() const { return ticksToCycles(max_latency_ticks_); }
+
     // ===== Utilities =====
 
     /**
@@ -243,6 +591,11 @@ private:
     // Helper functions
     void enableTimerClock();
     uint32_t channelToHAL(uint32_t channel) const;
+    uint32_t getMaxPeriod() const;
+    bool initDma(TimerDmaInstance* dma_instance, uint32_t dma_request, IRQn_Type dma_irq, uint32_t direction);
+    void recordLatency();
+    uint32_t ticksToCycles(uint32_t ticks) const;
+    static void invokeCallback(void* context);
 };
 
 // ===== Helper Functions =====
@@ -0,0 +1,73 @@
+#include "trace.h"
+#include "sys.h"
+
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3)
+#define TRACE_CYCLE_COUNTER 1
+#endif
+
+static_assert((LUMOS_TRACE_EVENTS & (LUMOS_TRACE_EVENTS - 1)) == 0, "LUMOS_TRACE_EVENTS must be a power of two");
+
+static Lumos::TraceEvent trace_events[LUMOS_TRACE_EVENTS];
+static uint32_t trace_head = 0;            // Written under PRIMASK by any context
+static volatile uint32_t trace_tail = 0;   // Written by the flushing context
+static volatile uint32_t trace_dropped = 0;
+
+void TraceRecord(Lumos::TraceType type, const char* name)
+{
+#ifdef TRACE_CYCLE_COUNTER
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // Stamped inside the section so events are in cycle order
+    const uint32_t cycles = DWT->CYCCNT;
+    if (trace_head - trace_tail >= LUMOS_TRACE_EVENTS) {
+        trace_dropped = trace_dropped + 1;
+    } else {
+        Lumos::TraceEvent& event = trace_events[trace_head & (LUMOS_TRACE_EVENTS - 1)];
+        event.cycles = cycles;
+        event.name = (uint32_t)(uintptr_t)name;
+        event.context = (uint16_t)(__get_IPSR() & 0x1FF);
+        event.type = type;
+        event.reserved = 0;
+        trace_head++;
+    }
+    __set_PRIMASK(primask);
+#else
+    (void)type;
+    (void)name;
+#endif
+}
+
+size_t PeekTraceEvents(Lumos::TraceEvent* events, size_t max)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint32_t head = trace_head;
+    __set_PRIMASK(primask);
+
+    const uint32_t tail = trace_tail;
+    size_t count = 0;
+    while (count < max && tail + count != head) {
+        // Slots between tail and head are only rewritten after Consume
+        events[count] = trace_events[(tail + count) & (LUMOS_TRACE_EVENTS - 1)];
+        count++;
+    }
+    return count;
+}
+
+void ConsumeTraceEvents(size_t count)
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    trace_tail = trace_tail + (uint32_t)count;
+    __set_PRIMASK(primask);
+}
+
+uint32_t GetTraceDroppedCount()
+{
+    return trace_dropped;
+}
+
+uint32_t GetTraceClockHz()
+{
+    return SystemCoreClock;
+}
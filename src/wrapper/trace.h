@@ -0,0 +1,171 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Cycle-stamped scope trace, viewed on one timeline with `lumos trace`
+// Usage Example (project.yaml: trace: true):
+//   void ControlApp::Step() {
+//       LUMOS_TRACE_SCOPE("control step");   // Begin here, end at the closing brace
+//       ...
+//       LUMOS_TRACE_EVENT("setpoint reached");
+//   }
+//
+//   void loop() { FlushTrace(Serial1); }     // Or from a low-priority app
+//
+// Every event stores DWT->CYCCNT, the name's address and the active
+// exception number (IPSR), so interrupt handlers appear as their own rows
+// and preemption shows where a handler's scope sits inside a thread
+// scope. The wrappers' handle*Interrupt() methods (UART, SPI, I2C, CAN,
+// timers, EXTI, including the DMA completion interrupts) open a scope of
+// their own. Scope names go to the .lumos_log section, which stays in
+// firmware.elf without taking flash; `lumos trace` looks the names up in
+// build/firmware.elf and writes Chrome/Perfetto JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// Without LUMOS_TRACE the macros compile to nothing. Recording takes a
+// short PRIMASK section, so any context may trace; when the ring
+// (LUMOS_TRACE_EVENTS, default 512) is full new events are dropped and
+// counted. Cortex-M0+ parts have no cycle counter and are not supported.
+//
+// Frame: 0x00, 0xFE, event count, dropped total (u32), core clock in kHz
+// (u32), count x (cycles u32, name u32, IPSR u16, type u8, 0), CRC-8 of
+// everything after the 0xFE.
+
+#ifndef LUMOS_TRACE_EVENTS
+#define LUMOS_TRACE_EVENTS 512
+#endif
+
+#ifdef __cplusplus
+
+namespace Lumos
+{
+    enum class TraceType : uint8_t { Begin, End, Instant };
+
+    struct TraceEvent {
+        uint32_t cycles;       // DWT->CYCCNT
+        uint32_t name;         // Address of the name in firmware.elf
+        uint16_t context;      // IPSR: 0 in thread mode, else the exception number
+        TraceType type;
+        uint8_t reserved;
+    };
+}
+
+// Record one event; use the macros instead
+void TraceRecord(Lumos::TraceType type, const char* name);
+
+// Copy up to @p max of the oldest events to @p events without removing
+// them; ConsumeTraceEvents() removes them once sent. Call from one context.
+size_t PeekTraceEvents(Lumos::TraceEvent* events, size_t max);
+void ConsumeTraceEvents(size_t count);
+
+// Events lost to a full ring since startup
+uint32_t GetTraceDroppedCount();
+
+// Core clock the cycle counts are in
+uint32_t GetTraceClockHz();
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : name_(name)
+    {
+        TraceRecord(Lumos::TraceType::Begin, name_);
+    }
+
+    ~TraceScope() { TraceRecord(Lumos::TraceType::End, name_); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+};
+
+// Pass buffered events to @p stream (write(data, length) returning false
+// when busy); events stay buffered until the stream takes their frame
+template <typename Stream>
+void FlushTrace(Stream& stream)
+{
+    static const size_t kEventsPerFrame = 16;
+    Lumos::TraceEvent events[kEventsPerFrame];
+    uint8_t frame[11 + kEventsPerFrame * 12 + 1];
+    for (;;) {
+        const size_t count = PeekTraceEvents(events, kEventsPerFrame);
+        if (count == 0) {
+            return;
+        }
+
+        const uint32_t dropped = GetTraceDroppedCount();
+        const uint32_t clock_khz = GetTraceClockHz() / 1000;
+        frame[0] = 0x00;
+        frame[1] = 0xFE;
+        frame[2] = static_cast<uint8_t>(count);
+        size_t length = 3;
+        for (int i = 0; i < 4; i++) {
+            frame[length++] = static_cast<uint8_t>(dropped >> (8 * i));
+        }
+        for (int i = 0; i < 4; i++) {
+            frame[length++] = static_cast<uint8_t>(clock_khz >> (8 * i));
+        }
+        for (size_t e = 0; e < count; e++) {
+            for (int i = 0; i < 4; i++) {
+                frame[length++] = static_cast<uint8_t>(events[e].cycles >> (8 * i));
+            }
+            for (int i = 0; i < 4; i++) {
+                frame[length++] = static_cast<uint8_t>(events[e].name >> (8 * i));
+            }
+            frame[length++] = static_cast<uint8_t>(events[e].context);
+            frame[length++] = static_cast<uint8_t>(events[e].context >> 8);
+            frame[length++] = static_cast<uint8_t>(events[e].type);
+            frame[length++] = 0;
+        }
+
+        // CRC-8 (polynomial 0x07), as in TokenLog
+        uint8_t crc = 0;
+        for (size_t i = 2; i < length; i++) {
+            crc ^= frame[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+            }
+        }
+        frame[length++] = crc;
+
+        if (!stream.write(frame, static_cast<uint16_t>(length))) {
+            return;
+        }
+        ConsumeTraceEvents(count);
+    }
+}
+
+#endif // __cplusplus
+
+#ifndef LUMOS_TRACE_NAME_SECTION
+#define LUMOS_TRACE_NAME_SECTION __attribute__((section(".lumos_log"), used))
+#endif
+
+#define LUMOS_TRACE_CONCAT_(a, b) a##b
+#define LUMOS_TRACE_CONCAT(a, b) LUMOS_TRACE_CONCAT_(a, b)
+
+#ifdef LUMOS_TRACE
+// Trace the rest of the enclosing block as @p name
+#define LUMOS_TRACE_SCOPE(name)                                                                          \
+    LUMOS_TRACE_NAME_SECTION static const char LUMOS_TRACE_CONCAT(lumos_trace_name_, __LINE__)[] = name; \
+    TraceScope LUMOS_TRACE_CONCAT(lumos_trace_scope_, __LINE__)(LUMOS_TRACE_CONCAT(lumos_trace_name_, __LINE__))
+
+// Mark a point in time, e.g. a DMA completion
+#define LUMOS_TRACE_EVENT(name)                                                   \
+    do {                                                                          \
+        LUMOS_TRACE_NAME_SECTION static const char lumos_trace_name[] = name;     \
+        TraceRecord(Lumos::TraceType::Instant, lumos_trace_name);                 \
+    } while (0)
+
+// Scope of a wrapper's interrupt handler; the name is an ordinary literal,
+// since these live in inline functions
+#define LUMOS_TRACE_ISR(name) TraceScope lumos_trace_isr(name)
+#else
+#define LUMOS_TRACE_SCOPE(name)
+#define LUMOS_TRACE_EVENT(name) do {} while (0)
+#define LUMOS_TRACE_ISR(name)
+#endif
@@ -1,59 +1,16 @@
 #include "uart.h"
+#include "peripherals.h"
+#include "memory_sections.h"
+#include "event_loop.h"
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
-#endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
+// Serial ports that can be begun at once (U(S)ART and LPUART instances)
+#ifndef LUMOS_SERIAL_PORTS
+#define LUMOS_SERIAL_PORTS 12
 #endif
-}
 
-// Helper function to enable UART peripheral clock
-static void enableUARTClock(USART_TypeDef* uart)
-{
-#ifdef USART1
-    if (uart == USART1) __HAL_RCC_USART1_CLK_ENABLE();
-#endif
-#ifdef USART2
-    else if (uart == USART2) __HAL_RCC_USART2_CLK_ENABLE();
-#endif
-#ifdef USART3
-    else if (uart == USART3) __HAL_RCC_USART3_CLK_ENABLE();
-#endif
-#ifdef UART4
-    else if (uart == UART4) __HAL_RCC_UART4_CLK_ENABLE();
-#endif
-#ifdef UART5
-    else if (uart == UART5) __HAL_RCC_UART5_CLK_ENABLE();
-#endif
-#ifdef USART4
-    else if (uart == USART4) __HAL_RCC_USART4_CLK_ENABLE();
-#endif
-#ifdef USART5
-    else if (uart == USART5) __HAL_RCC_USART5_CLK_ENABLE();
-#endif
-#ifdef USART6
-    else if (uart == USART6) __HAL_RCC_USART6_CLK_ENABLE();
-#endif
-#ifdef UART7
-    else if (uart == UART7) __HAL_RCC_UART7_CLK_ENABLE();
-#endif
-#ifdef UART8
-    else if (uart == UART8) __HAL_RCC_UART8_CLK_ENABLE();
-#endif
-#ifdef USART10
-    else if (uart == USART10) __HAL_RCC_USART10_CLK_ENABLE();
-#endif
-}
+// Ports between begin() and end(), for the HAL callbacks: a plain
+// UART_HandleTypeDef with HAL IT/DMA (CubeMX's huartN) is not a Serial
+static Serial* serial_instances[LUMOS_SERIAL_PORTS] = {nullptr};
 
 Serial::Serial(USART_TypeDef* usart_def,
                GPIO_TypeDef* tx_port, uint16_t tx_pin,
@@ -64,7 +21,35 @@ Serial::Serial(USART_TypeDef* usart_def,
       tx_pin_(tx_pin),
       rx_port_(rx_port),
       rx_pin_(rx_pin),
-      alternate_function_(alternate_function)
+      alternate_function_(alternate_function),
+      dma_tx_handle_{},
+      tx_buffer_(nullptr),
+      tx_size_(0),
+      tx_head_(0),
+      tx_tail_(0),
+      tx_dma_length_(0),
+      tx_dma_released_(0),
+      tx_dma_busy_(false),
+      dma_irq_(static_cast<IRQn_Type>(0)),
+      uart_irq_(static_cast<IRQn_Type>(0)),
+      uart_irq_enabled_(false),
+      dma_rx_handle_{},
+      rx_buffer_(nullptr),
+      rx_size_(0),
+      rx_position_(0),
+      rx_received_(0),
+      rx_consumed_(0),
+      rx_overflows_(0),
+      rx_skip_from_(0),
+      rx_skip_to_(0),
+      rx_dma_irq_(static_cast<IRQn_Type>(0)),
+      tx_async_(false),
+      tx_async_length_(0),
+      tx_done_(nullptr),
+      tx_context_(nullptr),
+      rx_async_(false),
+      rx_done_(nullptr),
+      rx_context_(nullptr)
 {
     // Initialize default values
     uart_handle_.Instance = usart_def;
@@ -85,31 +70,12 @@ void Serial::begin(const uint32_t baudrate)
 {
     uart_handle_.Init.BaudRate = baudrate;
 
-    // Enable GPIO port clocks
-    enableGPIOClock(tx_port_);
-    enableGPIOClock(rx_port_);
-
-    // Configure GPIO pins
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
-
-    // Configure TX pin
-    GPIO_InitStruct.Pin = tx_pin_;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    GPIO_InitStruct.Alternate = alternate_function_;
-    HAL_GPIO_Init(tx_port_, &GPIO_InitStruct);
-
-    // Configure RX pin
-    GPIO_InitStruct.Pin = rx_pin_;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    GPIO_InitStruct.Alternate = alternate_function_;
-    HAL_GPIO_Init(rx_port_, &GPIO_InitStruct);
+    // Configure TX and RX pins
+    const PinRef pins[] = {{tx_port_, tx_pin_}, {rx_port_, rx_pin_}};
+    initAlternatePins(pins, 2, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_LOW, alternate_function_);
 
     // Enable UART peripheral clock
-    enableUARTClock(uart_handle_.Instance);
+    enablePeripheralClock(uart_handle_.Instance);
 
     // Initialize UART
     if (HAL_UART_Init(&uart_handle_) != HAL_OK)
@@ -117,201 +83,507 @@ void Serial::begin(const uint32_t baudrate)
         // Error handling - you may want to add error callback here
         return;
     }
+
+    int slot = -1;
+    for (int i = 0; i < LUMOS_SERIAL_PORTS; i++) {
+        if (serial_instances[i] == this) return;
+        if (slot < 0 && serial_instances[i] == nullptr) slot = i;
+    }
+    if (slot >= 0) {
+        serial_instances[slot] = this;
+    }
+}
+
+Serial* Serial::fromHandle(UART_HandleTypeDef* huart)
+{
+    for (int i = 0; i < LUMOS_SERIAL_PORTS; i++) {
+        if (serial_instances[i] != nullptr && &serial_instances[i]->uart_handle_ == huart) {
+            return serial_instances[i];
+        }
+    }
+    return nullptr;
+}
+
+void Serial::enableUartIrq(IRQn_Type uart_irq)
+{
+    uart_irq_ = uart_irq;
+    uart_irq_enabled_ = true;
+    HAL_NVIC_SetPriority(uart_irq_, 5, 0);
+    HAL_NVIC_EnableIRQ(uart_irq_);
+}
+
+bool Serial::initDma(DMA_HandleTypeDef& handle, SerialDmaInstance* dma_instance,
+                     uint32_t dma_request, bool receive)
+{
+    enableDMAClock(dma_instance);
+
+    handle = {};
+    handle.Instance = dma_instance;
+#if defined(STM32F4)
+    handle.Init.Channel = dma_request;
+#else
+    handle.Init.Request = dma_request;
+#endif
+    handle.Init.Direction = receive ? DMA_PERIPH_TO_MEMORY : DMA_MEMORY_TO_PERIPH;
+#if defined(STM32H5)
+    handle.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    handle.Init.SrcInc = receive ? DMA_SINC_FIXED : DMA_SINC_INCREMENTED;
+    handle.Init.DestInc = receive ? DMA_DINC_INCREMENTED : DMA_DINC_FIXED;
+    handle.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+    handle.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+    handle.Init.Priority = receive ? DMA_HIGH_PRIORITY : DMA_LOW_PRIORITY_LOW_WEIGHT;
+    handle.Init.SrcBurstLength = 1;
+    handle.Init.DestBurstLength = 1;
+    handle.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+    handle.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    // GPDMA has no circular mode without linked lists; the RX event
+    // callback restarts the transfer instead
+    handle.Init.Mode = DMA_NORMAL;
+#else
+    handle.Init.PeriphInc = DMA_PINC_DISABLE;
+    handle.Init.MemInc = DMA_MINC_ENABLE;
+    handle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    handle.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    // Received bytes must not wait behind a long transmission
+    handle.Init.Priority = receive ? DMA_PRIORITY_HIGH : DMA_PRIORITY_LOW;
+    handle.Init.Mode = receive ? DMA_CIRCULAR : DMA_NORMAL;
+#endif
+#if defined(STM32H7) || defined(STM32F4)
+    handle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+
+    return HAL_DMA_Init(&handle) == HAL_OK;
+}
+
+bool Serial::beginTxDma(SerialDmaInstance* dma_instance, uint32_t dma_request,
+                        IRQn_Type dma_irq, IRQn_Type uart_irq,
+                        uint8_t* buffer, uint16_t size)
+{
+    if (buffer == nullptr || size < 2) return false;
+    if (!initDma(dma_tx_handle_, dma_instance, dma_request, false)) return false;
+    __HAL_LINKDMA(&uart_handle_, hdmatx, dma_tx_handle_);
+
+    tx_buffer_ = buffer;
+    tx_size_ = size;
+    tx_head_ = 0;
+    tx_tail_ = 0;
+    tx_dma_length_ = 0;
+    tx_dma_released_ = 0;
+    tx_dma_busy_ = false;
+    dma_irq_ = dma_irq;
+
+    // The UART interrupt signals the last byte leaving the shift register
+    HAL_NVIC_SetPriority(dma_irq_, 5, 0);
+    HAL_NVIC_EnableIRQ(dma_irq_);
+    enableUartIrq(uart_irq);
+    return true;
+}
+
+bool Serial::beginRxDma(SerialDmaInstance* dma_instance, uint32_t dma_request,
+                        IRQn_Type dma_irq, IRQn_Type uart_irq,
+                        uint8_t* buffer, uint16_t size)
+{
+    if (buffer == nullptr || size < 2) return false;
+#if defined(STM32H7)
+    // Invalidating a cache line shared with other data would discard it
+    if (isDCacheable(buffer) &&
+        ((reinterpret_cast<uintptr_t>(buffer) % 32) != 0 || (size % 32) != 0)) {
+        return false;
+    }
+#endif
+    if (rx_async_) return false;
+    if (!initDma(dma_rx_handle_, dma_instance, dma_request, true)) return false;
+    __HAL_LINKDMA(&uart_handle_, hdmarx, dma_rx_handle_);
+
+    rx_buffer_ = buffer;
+    rx_size_ = size;
+    rx_position_ = 0;
+    rx_received_ = 0;
+    rx_consumed_ = 0;
+    rx_overflows_ = 0;
+    rx_skip_from_ = 0;
+    rx_skip_to_ = 0;
+    rx_dma_irq_ = dma_irq;
+
+    HAL_NVIC_SetPriority(rx_dma_irq_, 5, 0);
+    HAL_NVIC_EnableIRQ(rx_dma_irq_);
+    enableUartIrq(uart_irq);
+
+    return startRxDma();
+}
+
+bool Serial::startRxDma()
+{
+    // Reports half, complete and IDLE-line events to HAL_UARTEx_RxEventCallback
+    rx_position_ = 0;
+    if (HAL_UARTEx_ReceiveToIdle_DMA(&uart_handle_, rx_buffer_, rx_size_) != HAL_OK) {
+        return false;
+    }
+    return true;
 }
 
 void Serial::end()
 {
+    if (uart_irq_enabled_) {
+        HAL_NVIC_DisableIRQ(uart_irq_);
+        uart_irq_enabled_ = false;
+    }
+    if (tx_async_ || rx_async_) {
+        HAL_UART_Abort(&uart_handle_);
+        tx_async_ = false;
+        rx_async_ = false;
+    }
+    if (tx_buffer_ != nullptr) {
+        HAL_NVIC_DisableIRQ(dma_irq_);
+        HAL_UART_AbortTransmit(&uart_handle_);
+        HAL_DMA_DeInit(&dma_tx_handle_);
+        tx_buffer_ = nullptr;
+        tx_dma_busy_ = false;
+    }
+    if (rx_buffer_ != nullptr) {
+        HAL_NVIC_DisableIRQ(rx_dma_irq_);
+        HAL_UART_AbortReceive(&uart_handle_);
+        HAL_DMA_DeInit(&dma_rx_handle_);
+        rx_buffer_ = nullptr;
+    }
+
     // Deinitialize UART
     HAL_UART_DeInit(&uart_handle_);
 
     // Deinitialize GPIO pins
     HAL_GPIO_DeInit(tx_port_, tx_pin_);
     HAL_GPIO_DeInit(rx_port_, rx_pin_);
+
+    for (int i = 0; i < LUMOS_SERIAL_PORTS; i++) {
+        if (serial_instances[i] == this) serial_instances[i] = nullptr;
+    }
 }
 
 // ===== Data Transmission Methods =====
 
 bool Serial::write(const uint8_t* data, uint16_t length, uint32_t timeout)
 {
+    if (tx_buffer_ != nullptr) {
+        return writeDma(data, length, timeout);
+    }
     if (HAL_UART_Transmit(&uart_handle_, (uint8_t*)data, length, timeout) == HAL_OK) {
         return true;
     }
     return false;
 }
 
-bool Serial::write(uint8_t byte)
+bool Serial::write(Span<const uint8_t> data, uint32_t timeout)
 {
-    return write(&byte, 1, 100);
+    const uint8_t* next = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        const uint16_t chunk = clampLength(remaining);
+        if (!write(next, chunk, timeout)) return false;
+        next += chunk;
+        remaining -= chunk;
+    }
+    return true;
 }
 
-// ===== Formatted Print Methods =====
-
-bool Serial::print(const char* str)
+bool Serial::writeAsync(Span<const uint8_t> data, SerialCallback done, void* context)
 {
-    if (str == nullptr) return false;
-    return write((const uint8_t*)str, strlen(str), 1000);
+    if (data.empty() || data.size() > 0xFFFF) return false;
+    if (tx_buffer_ == nullptr && !uart_irq_enabled_) return false;
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // The ring and an async transfer share the transmitter; whichever
+    // holds it finishes first
+    const bool busy = tx_async_ || (tx_buffer_ != nullptr && (tx_dma_busy_ || tx_head_ != tx_tail_));
+    if (!busy) {
+        tx_async_ = true;
+        tx_async_length_ = static_cast<uint16_t>(data.size());
+        tx_done_ = done;
+        tx_context_ = context;
+        if (tx_buffer_ != nullptr) tx_dma_busy_ = true;
+    }
+    __set_PRIMASK(primask);
+    if (busy) return false;
+
+    uint8_t* bytes = const_cast<uint8_t*>(data.data());
+    HAL_StatusTypeDef status;
+    if (tx_buffer_ != nullptr) {
+        cleanDCache(data.data(), data.size());
+        status = HAL_UART_Transmit_DMA(&uart_handle_, bytes, tx_async_length_);
+    } else {
+        status = HAL_UART_Transmit_IT(&uart_handle_, bytes, tx_async_length_);
+    }
+    if (status != HAL_OK) {
+        tx_async_ = false;
+        tx_dma_busy_ = false;
+        return false;
+    }
+    return true;
 }
 
-bool Serial::print(int value, int base)
+bool Serial::writeDma(const uint8_t* data, uint16_t length, uint32_t timeout)
 {
-    char buffer[34];  // Enough for 32-bit int in binary + null
-
-    if (base == 10) {
-        snprintf(buffer, sizeof(buffer), "%d", value);
-    } else if (base == 16) {
-        snprintf(buffer, sizeof(buffer), "%x", value);
-    } else if (base == 8) {
-        snprintf(buffer, sizeof(buffer), "%o", value);
-    } else if (base == 2) {
-        // Binary conversion
-        int i = 0;
-        unsigned int v = (value < 0) ? -value : value;
-        if (value < 0) buffer[i++] = '-';
-
-        // Find first set bit
-        int bit_pos = 31;
-        while (bit_pos >= 0 && !(v & (1U << bit_pos))) bit_pos--;
-
-        if (bit_pos < 0) {
-            buffer[i++] = '0';
-        } else {
-            for (; bit_pos >= 0; bit_pos--) {
-                buffer[i++] = (v & (1U << bit_pos)) ? '1' : '0';
-            }
+    const uint32_t start = HAL_GetTick();
+
+    while (length > 0) {
+        // Free space up to the end of the buffer (one slot stays empty so
+        // head == tail means empty)
+        const uint16_t head = tx_head_;
+        const uint16_t tail = tx_tail_;
+        uint16_t space = (tail > head) ? tail - head - 1
+                                       : tx_size_ - head - (tail == 0 ? 1 : 0);
+        if (space == 0) {
+            // Ring full: only happens when writing faster than the wire
+            if (HAL_GetTick() - start >= timeout) return false;
+            continue;
         }
-        buffer[i] = '\0';
-    } else {
-        return false;  // Unsupported base
-    }
 
-    return print(buffer);
+        const uint16_t chunk = (length < space) ? length : space;
+        memcpy(tx_buffer_ + head, data, chunk);
+        tx_head_ = (head + chunk == tx_size_) ? 0 : head + chunk;
+        data += chunk;
+        length -= chunk;
+
+        // Start DMA if it is idle; it restarts itself while data remains
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        startTxDma();
+        __set_PRIMASK(primask);
+    }
+    return true;
 }
 
-bool Serial::print(unsigned int value, int base)
+// Called with interrupts masked or from the DMA/UART interrupt
+void Serial::startTxDma()
 {
-    char buffer[34];
-
-    if (base == 10) {
-        snprintf(buffer, sizeof(buffer), "%u", value);
-    } else if (base == 16) {
-        snprintf(buffer, sizeof(buffer), "%x", value);
-    } else if (base == 8) {
-        snprintf(buffer, sizeof(buffer), "%o", value);
-    } else if (base == 2) {
-        // Binary conversion
-        int i = 0;
-        int bit_pos = 31;
-        while (bit_pos >= 0 && !(value & (1U << bit_pos))) bit_pos--;
-
-        if (bit_pos < 0) {
-            buffer[i++] = '0';
-        } else {
-            for (; bit_pos >= 0; bit_pos--) {
-                buffer[i++] = (value & (1U << bit_pos)) ? '1' : '0';
-            }
-        }
-        buffer[i] = '\0';
-    } else {
-        return false;
-    }
+    if (tx_dma_busy_ || tx_head_ == tx_tail_) return;
+
+    // One contiguous run; a wrapped ring needs a second transfer
+    const uint16_t tail = tx_tail_;
+    const uint16_t end = (tx_head_ > tail) ? tx_head_ : tx_size_;
+    const uint16_t length = end - tail;
+
+    cleanDCache(tx_buffer_ + tail, length);
 
-    return print(buffer);
+    tx_dma_length_ = length;
+    tx_dma_released_ = 0;
+    tx_dma_busy_ = true;
+    if (HAL_UART_Transmit_DMA(&uart_handle_, tx_buffer_ + tail, length) != HAL_OK) {
+        tx_dma_busy_ = false;
+    }
 }
 
-bool Serial::print(long value, int base)
+void Serial::onTxHalfComplete()
 {
-    return print((int)value, base);
+    if (tx_async_ || tx_buffer_ == nullptr) return;
+
+    // The first half of the transfer has been read by the DMA: free it so
+    // writers blocked on a full ring can continue early
+    const uint16_t half = tx_dma_length_ / 2;
+    tx_tail_ = (tx_tail_ + half) % tx_size_;
+    tx_dma_released_ = half;
 }
 
-bool Serial::print(unsigned long value, int base)
+void Serial::onTxComplete()
 {
-    return print((unsigned int)value, base);
+    if (tx_async_) {
+        tx_async_ = false;
+        tx_dma_busy_ = false;
+        if (tx_done_ != nullptr) tx_done_(tx_context_, tx_async_length_);
+        // Bytes written to the ring meanwhile
+        if (tx_buffer_ != nullptr) startTxDma();
+        return;
+    }
+    if (tx_buffer_ == nullptr) return;
+
+    tx_tail_ = (tx_tail_ + tx_dma_length_ - tx_dma_released_) % tx_size_;
+    tx_dma_length_ = 0;
+    tx_dma_released_ = 0;
+    tx_dma_busy_ = false;
+    startTxDma();
 }
 
-bool Serial::print(float value, int decimals)
+bool Serial::flush(uint32_t timeout)
 {
-    char buffer[32];
-
-    if (decimals == 0) {
-        snprintf(buffer, sizeof(buffer), "%.0f", value);
-    } else if (decimals == 1) {
-        snprintf(buffer, sizeof(buffer), "%.1f", value);
-    } else if (decimals == 2) {
-        snprintf(buffer, sizeof(buffer), "%.2f", value);
-    } else if (decimals == 3) {
-        snprintf(buffer, sizeof(buffer), "%.3f", value);
-    } else if (decimals == 4) {
-        snprintf(buffer, sizeof(buffer), "%.4f", value);
-    } else {
-        snprintf(buffer, sizeof(buffer), "%f", value);
+    const uint32_t start = HAL_GetTick();
+    if (tx_buffer_ == nullptr) {
+        // Blocking writes are already done
+        while (tx_async_) {
+            if (HAL_GetTick() - start >= timeout) return false;
+        }
+        return true;
     }
 
-    return print(buffer);
+    while (tx_dma_busy_ || tx_head_ != tx_tail_) {
+        if (HAL_GetTick() - start >= timeout) return false;
+    }
+    return true;
 }
 
-bool Serial::println(const char* str)
+bool Serial::write(uint8_t byte)
 {
-    if (!print(str)) return false;
-    return print("\r\n");
+    return write(&byte, 1, 100);
 }
 
-bool Serial::println(int value, int base)
+// ===== Data Reception Methods =====
+
+bool Serial::readAsync(Span<uint8_t> buffer, SerialCallback done, void* context)
 {
-    if (!print(value, base)) return false;
-    return print("\r\n");
+    if (buffer.empty() || buffer.size() > 0xFFFF) return false;
+    if (rx_buffer_ != nullptr || !uart_irq_enabled_ || rx_async_) return false;
+
+    rx_done_ = done;
+    rx_context_ = context;
+    rx_async_ = true;
+    // Reports a full buffer or an IDLE line to HAL_UARTEx_RxEventCallback
+    if (HAL_UARTEx_ReceiveToIdle_IT(&uart_handle_, buffer.data(), static_cast<uint16_t>(buffer.size())) != HAL_OK) {
+        rx_async_ = false;
+        return false;
+    }
+    return true;
 }
 
-bool Serial::println(unsigned int value, int base)
+uint16_t Serial::available()
 {
-    if (!print(value, base)) return false;
-    return print("\r\n");
+    if (rx_buffer_ == nullptr) {
+        // For basic implementation, return 0
+        // A full implementation would use interrupt-driven RX with a ring buffer
+        return 0;
+    }
+
+    const uint32_t received = rx_received_;
+    if (received - rx_consumed_ > rx_size_) {
+        // The DMA lapped the reader: the oldest bytes are gone
+        rx_overflows_++;
+        rx_consumed_ = received - rx_size_;
+    }
+    if (rx_consumed_ >= rx_skip_from_ && rx_consumed_ < rx_skip_to_) {
+        rx_consumed_ = rx_skip_to_;
+    }
+
+    uint32_t pending = received - rx_consumed_;
+    if (rx_consumed_ < rx_skip_from_) {
+        pending -= rx_skip_to_ - rx_skip_from_;
+    }
+    return static_cast<uint16_t>(pending);
 }
 
-bool Serial::println(long value, int base)
+uint16_t Serial::read(uint8_t* buffer, uint16_t length)
 {
-    if (!print(value, base)) return false;
-    return print("\r\n");
+    if (rx_buffer_ != nullptr) {
+        uint16_t count = available();
+        if (count > length) count = length;
+        // Stop short of a stale range; the next read skips it
+        if (rx_consumed_ < rx_skip_from_ && rx_skip_from_ - rx_consumed_ < count) {
+            count = static_cast<uint16_t>(rx_skip_from_ - rx_consumed_);
+        }
+
+        uint16_t index = static_cast<uint16_t>(rx_consumed_ % rx_size_);
+        uint16_t first = (count < rx_size_ - index) ? count : rx_size_ - index;
+        invalidateDCache(rx_buffer_, rx_size_);
+        memcpy(buffer, rx_buffer_ + index, first);
+        memcpy(buffer + first, rx_buffer_, count - first);
+        rx_consumed_ += count;
+        return count;
+    }
+
+    if (HAL_UART_Receive(&uart_handle_, buffer, length, 100) == HAL_OK) {
+        return length;
+    }
+    return 0;
 }
 
-bool Serial::println(unsigned long value, int base)
+int Serial::read()
 {
-    if (!print(value, base)) return false;
-    return print("\r\n");
+    if (rx_buffer_ != nullptr) {
+        uint8_t byte;
+        return read(&byte, 1) == 1 ? byte : -1;
+    }
+
+    uint8_t byte;
+    if (HAL_UART_Receive(&uart_handle_, &byte, 1, 10) == HAL_OK) {
+        return byte;
+    }
+    return -1;
 }
 
-bool Serial::println(float value, int decimals)
+void Serial::onRxEvent(uint16_t position)
 {
-    if (!print(value, decimals)) return false;
-    return print("\r\n");
+    if (rx_async_) {
+        // position is the number of bytes received
+        rx_async_ = false;
+        if (rx_done_ != nullptr) rx_done_(rx_context_, position);
+        LUMOS_POST_EVENT(EVENT_UART_RX);
+        return;
+    }
+    if (rx_buffer_ == nullptr) return;
+
+    // position is where the DMA will write next (rx_size_ at the end of
+    // the buffer); publish everything since the previous event
+    const uint16_t last = rx_position_;
+    const uint16_t arrived = (position >= last) ? position - last : rx_size_ - last + position;
+    rx_received_ += arrived;
+    rx_position_ = (position == rx_size_) ? 0 : position;
+    if (arrived > 0) LUMOS_POST_EVENT(EVENT_UART_RX);
+
+#if defined(STM32H5)
+    // Normal-mode GPDMA stops at the end of the buffer
+    if (position == rx_size_) startRxDma();
+#endif
 }
 
-bool Serial::println()
+void Serial::onError()
 {
-    return print("\r\n");
+    // A blocking error ends an async transfer; report it as nothing done
+    if (tx_async_ && uart_handle_.gState == HAL_UART_STATE_READY) {
+        tx_async_ = false;
+        tx_dma_busy_ = false;
+        if (tx_done_ != nullptr) tx_done_(tx_context_, 0);
+        if (tx_buffer_ != nullptr) startTxDma();
+    }
+    if (rx_async_ && uart_handle_.RxState == HAL_UART_STATE_READY) {
+        rx_async_ = false;
+        if (rx_done_ != nullptr) rx_done_(rx_context_, 0);
+    }
+
+    // Framing/noise errors are only reported; an overrun aborts the
+    // reception. The DMA restarts at index 0, so the rest of the current
+    // lap holds stale bytes: count them as received but skip them.
+    if (rx_buffer_ != nullptr && uart_handle_.RxState == HAL_UART_STATE_READY) {
+        const uint32_t gap = (rx_size_ - rx_position_) % rx_size_;
+        rx_skip_from_ = rx_received_;
+        rx_skip_to_ = rx_received_ + gap;
+        rx_received_ += gap;
+        startRxDma();
+    }
 }
 
-// ===== Data Reception Methods =====
+// HAL Callbacks (called from HAL_UART_IRQHandler / HAL_DMA_IRQHandler)
 
-uint16_t Serial::available()
+extern "C" void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
 {
-    // For basic implementation, return 0
-    // A full implementation would use interrupt-driven RX with a ring buffer
-    return 0;
+    if (Serial* serial = Serial::fromHandle(huart)) {
+        serial->onTxHalfComplete();
+    }
 }
 
-uint16_t Serial::read(uint8_t* buffer, uint16_t length)
+extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
-    if (HAL_UART_Receive(&uart_handle_, buffer, length, 100) == HAL_OK) {
-        return length;
+    if (Serial* serial = Serial::fromHandle(huart)) {
+        serial->onTxComplete();
     }
-    return 0;
 }
 
-int Serial::read()
+extern "C" void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
-    uint8_t byte;
-    if (HAL_UART_Receive(&uart_handle_, &byte, 1, 10) == HAL_OK) {
-        return byte;
+    if (Serial* serial = Serial::fromHandle(huart)) {
+        serial->onRxEvent(Size);
+    }
+}
+
+extern "C" void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (Serial* serial = Serial::fromHandle(huart)) {
+        serial->onError();
     }
-    return -1;
 }
@@ -23,9 +23,67 @@
 #endif
 
 #include <cstring>
-#include <cstdio>
+#include "format.h"
+#include "span.h"
+#include "trace.h"
 
-class Serial
+// DMA stream (H7, F4) or channel (G0, G4, H5 GPDMA) used for TX
+#if defined(STM32H7) || defined(STM32F4)
+    typedef DMA_Stream_TypeDef SerialDmaInstance;
+#else
+    typedef DMA_Channel_TypeDef SerialDmaInstance;
+#endif
+
+// Completion of writeAsync()/readAsync(), called from the interrupt with
+// the bytes sent or received (0 after an error)
+typedef void (*SerialCallback)(void* context, uint16_t length);
+
+// Serial port
+//
+// By default write() blocks until the bytes are on the wire. After
+// beginTxDma(), write() copies into a ring buffer and returns at once;
+// DMA drains the ring in the background, freeing its first half on the
+// half-transfer interrupt and the rest on transfer complete. The board
+// must forward the DMA and UART interrupts:
+//
+//   static uint8_t com_tx[1024];
+//   SerialCom.begin(115200);
+//   SerialCom.beginTxDma(DMA1_Stream0, DMA_REQUEST_USART6_TX,
+//                        DMA1_Stream0_IRQn, USART6_IRQn, com_tx, sizeof(com_tx));
+//
+//   extern "C" void DMA1_Stream0_IRQHandler(void) { SerialCom.handleDmaInterrupt(); }
+//   extern "C" void USART6_IRQHandler(void)       { SerialCom.handleInterrupt(); }
+//
+// The buffer must be reachable by the DMA controller (on the H7 not in
+// DTCM; D-cache lines are cleaned before each transfer).
+//
+// Likewise, after beginRxDma() a circular DMA receives continuously into a
+// ring buffer. The UART's half/complete and IDLE-line events publish what
+// has arrived, so available() and read() never block and no byte is lost
+// while loop() is busy, as long as it reads before the ring wraps:
+//
+//   alignas(32) static uint8_t com_rx[1024];
+//   SerialCom.beginRxDma(DMA1_Stream1, DMA_REQUEST_USART6_RX,
+//                        DMA1_Stream1_IRQn, USART6_IRQn, com_rx, sizeof(com_rx));
+//
+//   extern "C" void DMA1_Stream1_IRQHandler(void) { SerialCom.handleRxDmaInterrupt(); }
+//
+// On the H7 with D-cache enabled the RX buffer and its size must be
+// multiples of 32 bytes so cache lines can be invalidated safely.
+//
+// writeAsync() and readAsync() transfer straight from and into the
+// caller's buffer and report completion through a callback. They run on
+// the TX DMA after beginTxDma() (once the ring has drained), otherwise on
+// the UART interrupt, which beginAsync() enables:
+//
+//   SerialCom.beginAsync(USART6_IRQn);
+//   SerialCom.writeAsync(frame, onFrameSent, &state);   // frame stays valid until then
+//   SerialCom.readAsync(reply, onReply, &state);        // full, or the line went idle
+//
+// The HAL callbacks look the handle up among the begun Serial ports and
+// ignore any other, so UART_HandleTypeDefs driven by plain HAL IT/DMA
+// calls work next to them (their callbacks are up to the application).
+class Serial : public Print<Serial>
 {
 private:
     UART_HandleTypeDef uart_handle_;
@@ -35,6 +93,53 @@ private:
     uint16_t rx_pin_;
     uint32_t alternate_function_;
 
+    // DMA transmit ring: write() appends at tx_head_, DMA consumes from
+    // tx_tail_. tx_head_ is only written by the caller, tx_tail_ and the
+    // DMA state only with interrupts masked or from the interrupt itself.
+    DMA_HandleTypeDef dma_tx_handle_;
+    uint8_t* tx_buffer_;
+    uint16_t tx_size_;
+    volatile uint16_t tx_head_;
+    volatile uint16_t tx_tail_;
+    volatile uint16_t tx_dma_length_;    // bytes in the running transfer
+    volatile uint16_t tx_dma_released_;  // of those, freed at half-transfer
+    volatile bool tx_dma_busy_;
+    IRQn_Type dma_irq_;
+    IRQn_Type uart_irq_;
+    bool uart_irq_enabled_;
+
+    bool writeDma(const uint8_t* data, uint16_t length, uint32_t timeout);
+    void startTxDma();
+
+    // DMA receive ring: the DMA writes circularly, rx_received_ counts the
+    // bytes published by UART events, rx_consumed_ the bytes read. Both
+    // only grow, so their difference is what is waiting (index = count
+    // modulo rx_size_).
+    DMA_HandleTypeDef dma_rx_handle_;
+    uint8_t* rx_buffer_;
+    uint16_t rx_size_;
+    volatile uint16_t rx_position_;     // DMA write index at the last event
+    volatile uint32_t rx_received_;
+    uint32_t rx_consumed_;
+    uint32_t rx_overflows_;
+    volatile uint32_t rx_skip_from_;    // stale range left by a restart
+    volatile uint32_t rx_skip_to_;      // after a reception error
+    IRQn_Type rx_dma_irq_;
+
+    bool startRxDma();
+    bool initDma(DMA_HandleTypeDef& handle, SerialDmaInstance* dma_instance,
+                 uint32_t dma_request, bool receive);
+    void enableUartIrq(IRQn_Type uart_irq);
+
+    // Caller-buffer transfers; tx_async_ also holds off the TX ring
+    volatile bool tx_async_;
+    uint16_t tx_async_length_;
+    SerialCallback tx_done_;
+    void* tx_context_;
+    volatile bool rx_async_;
+    SerialCallback rx_done_;
+    void* rx_context_;
+
 public:
     Serial() = delete;
     Serial(USART_TypeDef* usart_def,
@@ -52,27 +157,146 @@ public:
         return *this;
     }
 
+    /**
+     * @brief Switch transmission to a DMA-drained ring buffer
+     * @param dma_instance DMA stream/channel, e.g. DMA1_Stream0 (H7, F4) or DMA1_Channel1 (G0, G4)
+     * @param dma_request DMAMUX request, e.g. DMA_REQUEST_USART6_TX (DMA_CHANNEL_x on F4)
+     * @param dma_irq Interrupt of the stream/channel
+     * @param uart_irq Interrupt of this UART
+     * @param buffer Ring storage, must outlive the Serial
+     * @param size Ring size in bytes (one byte stays unused)
+     * @return true if DMA was set up
+     */
+    bool beginTxDma(SerialDmaInstance* dma_instance, uint32_t dma_request,
+                    IRQn_Type dma_irq, IRQn_Type uart_irq,
+                    uint8_t* buffer, uint16_t size);
+
+    /**
+     * @brief Receive continuously through circular DMA into a ring buffer
+     * @param dma_instance DMA stream/channel, e.g. DMA1_Stream1 (H7, F4) or DMA1_Channel2 (G0, G4)
+     * @param dma_request DMAMUX request, e.g. DMA_REQUEST_USART6_RX (DMA_CHANNEL_x on F4)
+     * @param dma_irq Interrupt of the stream/channel
+     * @param uart_irq Interrupt of this UART (IDLE-line detection)
+     * @param buffer Ring storage, must outlive the Serial
+     * @param size Ring size in bytes
+     * @return true if reception was started
+     */
+    bool beginRxDma(SerialDmaInstance* dma_instance, uint32_t dma_request,
+                    IRQn_Type dma_irq, IRQn_Type uart_irq,
+                    uint8_t* buffer, uint16_t size);
+
+    /**
+     * @brief Enable writeAsync()/readAsync() on the UART interrupt
+     * @param uart_irq Interrupt of this UART, forwarded to handleInterrupt()
+     *
+     * Not needed after beginTxDma() or beginRxDma(), which enable it too.
+     */
+    void beginAsync(IRQn_Type uart_irq) { enableUartIrq(uart_irq); }
+
+    /**
+     * @brief Times unread data was overwritten because the ring wrapped
+     */
+    uint32_t rxOverflows() const { return rx_overflows_; }
+
+    /**
+     * @brief Block until everything queued has been sent
+     * @param timeout Maximum wait in milliseconds
+     * @return true if the ring drained in time
+     */
+    bool flush(uint32_t timeout = 1000);
+
+    // Called from the board's IRQ handlers when TX DMA is used
+    void handleDmaInterrupt() { LUMOS_TRACE_ISR("uart tx dma"); HAL_DMA_IRQHandler(&dma_tx_handle_); }
+    void handleRxDmaInterrupt() { LUMOS_TRACE_ISR("uart rx dma"); HAL_DMA_IRQHandler(&dma_rx_handle_); }
+    void handleInterrupt() { LUMOS_TRACE_ISR("uart irq"); HAL_UART_IRQHandler(&uart_handle_); }
+
+    // Called from the HAL callbacks
+    void onTxHalfComplete();
+    void onTxComplete();
+    void onRxEvent(uint16_t position);
+    void onError();
+
+    UART_HandleTypeDef* getHandle() { return &uart_handle_; }
+    static Serial* fromHandle(UART_HandleTypeDef* huart);
+
     // Data transmission
+    // With TX DMA, timeout only bounds the wait for ring space
     bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 100);
+    bool write(Span<const uint8_t> data, uint32_t timeout = 100);
     bool write(uint8_t byte);
+    // print(), println() and printf() are inherited from Print (format.h)
 
-    // Formatted output (like Arduino Serial)
-    bool print(const char* str);
-    bool print(int value, int base = 10);
-    bool print(unsigned int value, int base = 10);
-    bool print(long value, int base = 10);
-    bool print(unsigned long value, int base = 10);
-    bool print(float value, int decimals = 2);
-    bool println(const char* str);
-    bool println(int value, int base = 10);
-    bool println(unsigned int value, int base = 10);
-    bool println(long value, int base = 10);
-    bool println(unsigned long value, int base = 10);
-    bool println(float value, int decimals = 2);
-    bool println();  // Just newline
+    /**
+     * @brief Start sending @p data without copying it
+     * @param data Bytes to send, untouched until @p done is called
+     * @param done Called from the interrupt when the last byte has gone
+     * @param context Passed to @p done
+     * @return false while another writeAsync() or the TX ring is sending,
+     *         or without beginTxDma()/beginAsync()
+     *
+     * With TX DMA the buffer must be reachable by the DMA controller.
+     */
+    bool writeAsync(Span<const uint8_t> data, SerialCallback done = nullptr, void* context = nullptr);
 
     // Data reception
+    // With RX DMA these return immediately with what has arrived
     uint16_t available();
     uint16_t read(uint8_t* buffer, uint16_t length);
+    uint16_t read(Span<uint8_t> buffer) { return read(buffer.data(), clampLength(buffer.size())); }
     int read();  // Read single byte, returns -1 if no data
+
+    /**
+     * @brief Receive into @p buffer until it is full or the line goes idle
+     * @param buffer Storage, untouched by the caller until @p done is called
+     * @param done Called from the interrupt with the bytes received
+     * @param context Passed to @p done
+     * @return false while another readAsync() is pending, with the RX DMA
+     *         ring running, or without beginAsync()
+     */
+    bool readAsync(Span<uint8_t> buffer, SerialCallback done, void* context = nullptr);
+
+private:
+    static uint16_t clampLength(size_t length) { return length > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(length); }
+};
+
+// Compile-time binding of a Serial to its DMA streams and interrupts
+//
+// The streams, requests and IRQ numbers are template arguments, so the
+// setup is a handful of constants and the IRQ handlers call straight
+// into the port; ring sizes are checked by the compiler:
+//
+//   using SerialComDma = SerialDma<SerialCom, USART6_IRQn,
+//                                  DMA1_Stream0_BASE, DMA_REQUEST_USART6_TX, DMA1_Stream0_IRQn,
+//                                  DMA1_Stream1_BASE, DMA_REQUEST_USART6_RX, DMA1_Stream1_IRQn>;
+//
+//   alignas(32) static uint8_t com_tx[1024];
+//   alignas(32) static uint8_t com_rx[1024];
+//   SerialComDma::begin(115200, com_tx, com_rx);
+//
+//   extern "C" void DMA1_Stream0_IRQHandler(void) { SerialComDma::txDmaInterrupt(); }
+//   extern "C" void DMA1_Stream1_IRQHandler(void) { SerialComDma::rxDmaInterrupt(); }
+//   extern "C" void USART6_IRQHandler(void)       { SerialComDma::uartInterrupt(); }
+template <Serial& port, IRQn_Type uart_irq,
+          uintptr_t tx_dma, uint32_t tx_request, IRQn_Type tx_dma_irq,
+          uintptr_t rx_dma, uint32_t rx_request, IRQn_Type rx_dma_irq>
+struct SerialDma
+{
+    template <size_t tx_size, size_t rx_size>
+    static bool begin(uint32_t baudrate, uint8_t (&tx_ring)[tx_size], uint8_t (&rx_ring)[rx_size])
+    {
+        static_assert(tx_size >= 2 && tx_size <= 0xFFFF, "TX ring must hold 2 to 65535 bytes");
+        static_assert(rx_size >= 2 && rx_size <= 0xFFFF, "RX ring must hold 2 to 65535 bytes");
+#if defined(STM32H7)
+        static_assert(rx_size % 32 == 0, "RX ring must be whole D-cache lines");
+#endif
+        port.begin(baudrate);
+        return port.beginTxDma(reinterpret_cast<SerialDmaInstance*>(tx_dma), tx_request, tx_dma_irq,
+                               uart_irq, tx_ring, tx_size) &&
+               port.beginRxDma(reinterpret_cast<SerialDmaInstance*>(rx_dma), rx_request, rx_dma_irq,
+                               uart_irq, rx_ring, rx_size);
+    }
+
+    static void txDmaInterrupt() { port.handleDmaInterrupt(); }
+    static void rxDmaInterrupt() { port.handleRxDmaInterrupt(); }
+    static void uartInterrupt() { port.handleInterrupt(); }
 };
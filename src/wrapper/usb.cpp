@@ -1,74 +1,176 @@
 #include "usb.h"
+#include "peripherals.h"
+#include "event_loop.h"
 
-// Helper function to enable GPIO port clock
-static void enableGPIOClock(GPIO_TypeDef* port)
-{
-    if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
-    else if (port == GPIOB) __HAL_RCC_GPIOB_CLK_ENABLE();
-    else if (port == GPIOC) __HAL_RCC_GPIOC_CLK_ENABLE();
-    else if (port == GPIOD) __HAL_RCC_GPIOD_CLK_ENABLE();
-    else if (port == GPIOE) __HAL_RCC_GPIOE_CLK_ENABLE();
-    else if (port == GPIOF) __HAL_RCC_GPIOF_CLK_ENABLE();
-#ifdef GPIOG
-    else if (port == GPIOG) __HAL_RCC_GPIOG_CLK_ENABLE();
+#if LUMOS_USB_CDC
+#include "usbd_core.h"
+#include "usbd_cdc.h"
 #endif
-#ifdef GPIOH
-    else if (port == GPIOH) __HAL_RCC_GPIOH_CLK_ENABLE();
+
+// Port the USB Device Library glue below is bound to (set by begin())
+static USB* active_usb = nullptr;
+
+#if LUMOS_USB_CDC
+static uint8_t* getDeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getLangIdDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getManufacturerDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getProductDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getSerialDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getConfigurationDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+static uint8_t* getInterfaceDescriptor(USBD_SpeedTypeDef speed, uint16_t* length);
+
+static USBD_DescriptorsTypeDef usb_descriptors = {
+    getDeviceDescriptor,
+    getLangIdDescriptor,
+    getManufacturerDescriptor,
+    getProductDescriptor,
+    getSerialDescriptor,
+    getConfigurationDescriptor,
+    getInterfaceDescriptor
+};
+
+static int8_t cdcInit();
+static int8_t cdcDeInit();
+static int8_t cdcControl(uint8_t cmd, uint8_t* buffer, uint16_t length);
+static int8_t cdcReceive(uint8_t* buffer, uint32_t* length);
+
+static USBD_CDC_ItfTypeDef cdc_interface = {
+    cdcInit,
+    cdcDeInit,
+    cdcControl,
+    cdcReceive
+};
+
+// Vendor interface endpoints; the same numbers as CDC's data endpoints,
+// so both share the transmit and receive paths
+#define VENDOR_IN_EP  CDC_IN_EP
+#define VENDOR_OUT_EP CDC_OUT_EP
+
+static uint8_t vendorInit(USBD_HandleTypeDef* device, uint8_t config);
+static uint8_t vendorDeInit(USBD_HandleTypeDef* device, uint8_t config);
+static uint8_t vendorSetup(USBD_HandleTypeDef* device, USBD_SetupReqTypedef* request);
+static uint8_t vendorDataIn(USBD_HandleTypeDef* device, uint8_t endpoint);
+static uint8_t vendorDataOut(USBD_HandleTypeDef* device, uint8_t endpoint);
+static uint8_t* vendorGetHsConfig(uint16_t* length);
+static uint8_t* vendorGetFsConfig(uint16_t* length);
+static uint8_t* vendorGetDeviceQualifier(uint16_t* length);
+
+static USBD_ClassTypeDef vendor_class = {
+    vendorInit,
+    vendorDeInit,
+    vendorSetup,
+    nullptr,                  // EP0_TxSent
+    nullptr,                  // EP0_RxReady
+    vendorDataIn,
+    vendorDataOut,
+    nullptr,                  // SOF, handled by HAL_PCD_SOFCallback()
+    nullptr,                  // IsoINIncomplete
+    nullptr,                  // IsoOUTIncomplete
+    vendorGetHsConfig,
+    vendorGetFsConfig,
+    vendorGetFsConfig,        // Other speed
+    vendorGetDeviceQualifier,
+};
+
+static void setDeviceDescriptor(USBInterface interface);
 #endif
-}
 
 USB::USB(PCD_TypeDef* usb_instance,
          GPIO_TypeDef* dp_port, uint16_t dp_pin,
          GPIO_TypeDef* dm_port, uint16_t dm_pin,
          uint32_t alternate_function)
     : pcd_handle_{},
-      rx_buffer_{},
+      rx_storage_{},
+      rx_buffer_(rx_storage_),
+      rx_mask_(RX_BUFFER_SIZE - 1),
       rx_head_(0),
       rx_tail_(0),
+      rx_paused_(false),
       initialized_(false),
       connected_(false),
+      interface_(USBInterface::CDC),
       dp_port_(dp_port),
       dp_pin_(dp_pin),
       dm_port_(dm_port),
       dm_pin_(dm_pin),
-      alternate_function_(alternate_function)
+      alternate_function_(alternate_function),
+      tx_buffers_{},
+      tx_fill_(0),
+      tx_fill_length_(0),
+      tx_transfer_length_(0),
+      tx_busy_(false),
+      tx_stats_{},
+      tx_stats_start_(0)
 {
     pcd_handle_.Instance = usb_instance;
 }
 
-bool USB::begin()
+bool USB::begin(USBInterface interface)
 {
-    // Enable GPIO port clocks
-    enableGPIOClock(dp_port_);
-    enableGPIOClock(dm_port_);
+#if LUMOS_USB_CDC
+    return begin(interface, nullptr);
+}
 
-    // Configure GPIO pins for USB
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
+bool USB::begin(USBInterface interface, USBD_ClassTypeDef* device_class)
+{
+#endif
+    // Configure DP (D+) and DM (D-) pins
+    const PinRef pins[] = {{dp_port_, dp_pin_}, {dm_port_, dm_pin_}};
+    initAlternatePins(pins, 2, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_FREQ_VERY_HIGH, alternate_function_);
 
-    // Configure DP pin (D+)
-    GPIO_InitStruct.Pin = dp_pin_;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
-    HAL_GPIO_Init(dp_port_, &GPIO_InitStruct);
+    initialized_ = false;
+    connected_ = false;
+    rx_head_ = 0;
+    rx_tail_ = 0;
+    rx_paused_ = false;
+    tx_fill_ = 0;
+    tx_fill_length_ = 0;
+    tx_busy_ = false;
+    resetTxStats();
+    interface_ = interface;
+    active_usb = this;
+
+#if LUMOS_USB_CDC
+    // The library calls back into initController() through USBD_LL_Init()
+    setDeviceDescriptor(interface);
+    if (USBD_Init(&device_, &usb_descriptors, 0) != USBD_OK) {
+        return false;
+    }
+    if (device_class != nullptr) {
+        if (USBD_RegisterClass(&device_, device_class) != USBD_OK) {
+            return false;
+        }
+    } else if (interface == USBInterface::Vendor) {
+        if (USBD_RegisterClass(&device_, &vendor_class) != USBD_OK) {
+            return false;
+        }
+    } else if (USBD_RegisterClass(&device_, &USBD_CDC) != USBD_OK ||
+               USBD_CDC_RegisterInterface(&device_, &cdc_interface) != USBD_OK) {
+        return false;
+    }
+    if (USBD_Start(&device_) != USBD_OK) {
+        return false;
+    }
+#else
+    if (!initController()) {
+        return false;
+    }
+#endif
 
-    // Configure DM pin (D-)
-    GPIO_InitStruct.Pin = dm_pin_;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-    GPIO_InitStruct.Alternate = alternate_function_;
-    HAL_GPIO_Init(dm_port_, &GPIO_InitStruct);
+    initialized_ = true;
+    return true;
+}
 
+bool USB::initController()
+{
     // Configure USB - platform specific
 #if defined(STM32H7)
     // USB OTG HS on STM32H7
     pcd_handle_.Init.dev_endpoints = 9;
-    pcd_handle_.Init.speed = PCD_SPEED_HIGH;
+    pcd_handle_.Init.speed = PCD_SPEED_FULL;  // The embedded PHY is full speed only
     pcd_handle_.Init.dma_enable = DISABLE;
     pcd_handle_.Init.phy_itface = USB_OTG_EMBEDDED_PHY;
-    pcd_handle_.Init.Sof_enable = DISABLE;
+    pcd_handle_.Init.Sof_enable = ENABLE;  // Flushes batched writes
     pcd_handle_.Init.low_power_enable = DISABLE;
     pcd_handle_.Init.lpm_enable = DISABLE;
     pcd_handle_.Init.battery_charging_enable = DISABLE;
@@ -79,7 +181,7 @@ bool USB::begin()
     pcd_handle_.Init.dev_endpoints = 8;
     pcd_handle_.Init.speed = PCD_SPEED_FULL;
     pcd_handle_.Init.phy_itface = PCD_PHY_EMBEDDED;
-    pcd_handle_.Init.Sof_enable = DISABLE;
+    pcd_handle_.Init.Sof_enable = ENABLE;  // Flushes batched writes
     pcd_handle_.Init.low_power_enable = DISABLE;
     pcd_handle_.Init.lpm_enable = DISABLE;
     pcd_handle_.Init.battery_charging_enable = DISABLE;
@@ -89,7 +191,7 @@ bool USB::begin()
     pcd_handle_.Init.speed = PCD_SPEED_FULL;
     pcd_handle_.Init.dma_enable = DISABLE;
     pcd_handle_.Init.phy_itface = PCD_PHY_EMBEDDED;
-    pcd_handle_.Init.Sof_enable = DISABLE;
+    pcd_handle_.Init.Sof_enable = ENABLE;  // Flushes batched writes
     pcd_handle_.Init.low_power_enable = DISABLE;
     pcd_handle_.Init.lpm_enable = DISABLE;
     pcd_handle_.Init.vbus_sensing_enable = DISABLE;
@@ -99,7 +201,7 @@ bool USB::begin()
     pcd_handle_.Init.dev_endpoints = 9;
     pcd_handle_.Init.speed = PCD_SPEED_FULL;
     pcd_handle_.Init.phy_itface = PCD_PHY_EMBEDDED;
-    pcd_handle_.Init.Sof_enable = DISABLE;
+    pcd_handle_.Init.Sof_enable = ENABLE;  // Flushes batched writes
     pcd_handle_.Init.low_power_enable = DISABLE;
     pcd_handle_.Init.lpm_enable = DISABLE;
     pcd_handle_.Init.battery_charging_enable = DISABLE;
@@ -108,23 +210,73 @@ bool USB::begin()
 
     // Initialize USB peripheral
     if (HAL_PCD_Init(&pcd_handle_) != HAL_OK) {
-        initialized_ = false;
         return false;
     }
 
-    // Note: CDC device class initialization would be done here
-    // This requires the USB Device middleware which is included in the toolchain
+#if LUMOS_USB_CDC
+    // Endpoint memory: control, data IN (0x81), data OUT (0x01) and CDC
+    // command IN (0x82)
+#if defined(USB_OTG_FS) || defined(USB_OTG_HS)
+    // Shared RX FIFO plus one TX FIFO per IN endpoint, in 32-bit words.
+    // The vendor and mass storage interfaces have no command endpoint and
+    // give its FIFO to data IN, so more packets of a transfer are queued in
+    // the core.
+    const bool vendor = interface_ != USBInterface::CDC;
+#if defined(STM32F4)
+    HAL_PCDEx_SetRxFiFo(&pcd_handle_, 0x80);
+    HAL_PCDEx_SetTxFiFo(&pcd_handle_, 0, 0x40);
+    HAL_PCDEx_SetTxFiFo(&pcd_handle_, 1, vendor ? 0x80 : 0x60);
+    if (!vendor) {
+        HAL_PCDEx_SetTxFiFo(&pcd_handle_, 2, 0x20);
+    }
+#else
+    HAL_PCDEx_SetRxFiFo(&pcd_handle_, 0x80);
+    HAL_PCDEx_SetTxFiFo(&pcd_handle_, 0, 0x40);
+    HAL_PCDEx_SetTxFiFo(&pcd_handle_, 1, vendor ? 0x200 : 0x100);
+    if (!vendor) {
+        HAL_PCDEx_SetTxFiFo(&pcd_handle_, 2, 0x20);
+    }
+#endif
+#else
+    // Packet memory offsets (USB device peripheral)
+    HAL_PCDEx_PMAConfig(&pcd_handle_, 0x00, PCD_SNG_BUF, 0x18);
+    HAL_PCDEx_PMAConfig(&pcd_handle_, 0x80, PCD_SNG_BUF, 0x58);
+    HAL_PCDEx_PMAConfig(&pcd_handle_, 0x81, PCD_SNG_BUF, 0xC0);
+    HAL_PCDEx_PMAConfig(&pcd_handle_, 0x01, PCD_SNG_BUF, 0x110);
+    HAL_PCDEx_PMAConfig(&pcd_handle_, 0x82, PCD_SNG_BUF, 0x100);
+#endif
+#endif
+
+    // Enable the USB interrupt (forwarded to handleInterrupt() by the board)
+    IRQn_Type irq;
+#if defined(STM32H7) || defined(STM32F4)
+#ifdef USB_OTG_FS
+    irq = (pcd_handle_.Instance == USB_OTG_HS) ? OTG_HS_IRQn : OTG_FS_IRQn;
+#else
+    irq = OTG_HS_IRQn;
+#endif
+#elif defined(STM32G4)
+    irq = USB_LP_IRQn;
+#elif defined(STM32G0)
+    irq = USB_UCPD1_2_IRQn;
+#elif defined(STM32H5)
+    irq = USB_DRD_FS_IRQn;
+#endif
+    HAL_NVIC_SetPriority(irq, 5, 0);
+    HAL_NVIC_EnableIRQ(irq);
 
-    initialized_ = true;
-    rx_head_ = 0;
-    rx_tail_ = 0;
     return true;
 }
 
 void USB::end()
 {
     if (initialized_) {
+#if LUMOS_USB_CDC
+        USBD_Stop(&device_);
+        USBD_DeInit(&device_);  // Deinitializes the PCD
+#else
         HAL_PCD_DeInit(&pcd_handle_);
+#endif
 
         // Deinitialize GPIO pins
         HAL_GPIO_DeInit(dp_port_, dp_pin_);
@@ -132,70 +284,171 @@ void USB::end()
 
         initialized_ = false;
         connected_ = false;
+        tx_busy_ = false;
+        tx_fill_length_ = 0;
     }
 }
 
+// ===== Data Transmission Methods =====
+
 bool USB::write(const uint8_t* data, uint16_t length, uint32_t timeout)
 {
-    if (!initialized_ || !connected_ || !data || length == 0) {
+    // The mass storage class has the IN endpoint to itself
+    if (!initialized_ || !connected_ || !data || length == 0 || interface_ == USBInterface::MassStorage) {
         return false;
     }
+#if !LUMOS_USB_CDC
+    (void)timeout;
+    return false;
+#else
+    const uint16_t max_packet = getMaxPacketSize();
+    const uint32_t start = HAL_GetTick();
 
-    // Note: Actual CDC transmission would use CDC_Transmit_HS() function
-    // This is a placeholder that would need to call the USB CDC middleware
-    // For now, we'll return true to indicate the interface is available
+    while (length > 0) {
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
 
-    // In a full implementation, this would be:
-    // return (CDC_Transmit_HS((uint8_t*)data, length) == USBD_OK);
+        const uint16_t space = TX_BUFFER_SIZE - tx_fill_length_;
+        if (space == 0) {
+            // Both buffers full: wait for the host to take the one in flight
+            startTransfer();
+            __set_PRIMASK(primask);
+            if (!connected_) return false;
+            if (HAL_GetTick() - start >= timeout) {
+                tx_stats_.timeouts++;
+                return false;
+            }
+            continue;
+        }
 
+        const uint16_t chunk = (length < space) ? length : space;
+        memcpy(tx_buffers_[tx_fill_] + tx_fill_length_, data, chunk);
+        tx_fill_length_ += chunk;
+
+        // Full packets go out at once; smaller tails wait for start-of-frame
+        if (tx_fill_length_ >= max_packet) {
+            startTransfer();
+        }
+        __set_PRIMASK(primask);
+
+        data += chunk;
+        length -= chunk;
+    }
     return true;
+#endif
 }
 
-bool USB::write(uint8_t byte)
+// Called with interrupts masked or from the USB interrupt
+void USB::startTransfer()
 {
-    return write(&byte, 1);
+#if LUMOS_USB_CDC
+    if (tx_busy_ || tx_fill_length_ == 0 || !connected_) return;
+
+    const uint8_t buffer = tx_fill_;
+    const uint16_t length = tx_fill_length_;
+
+    tx_busy_ = true;
+    tx_transfer_length_ = length;
+    tx_fill_ = buffer ^ 1;
+    tx_fill_length_ = 0;
+
+    if (HAL_PCD_EP_Transmit(&pcd_handle_, CDC_IN_EP, tx_buffers_[buffer], length) != HAL_OK) {
+        // Keep the data for the next attempt
+        tx_busy_ = false;
+        tx_fill_ = buffer;
+        tx_fill_length_ = length;
+        return;
+    }
+
+    const uint16_t max_packet = getMaxPacketSize();
+    tx_stats_.bytes += length;
+    tx_stats_.transfers++;
+    tx_stats_.packets += (length + max_packet - 1) / max_packet;
+#endif
+}
+
+void USB::onTxComplete()
+{
+#if LUMOS_USB_CDC
+    if (interface_ == USBInterface::MassStorage) {
+        return;  // The class got the completion through USBD_LL_DataInStage()
+    }
+    const uint16_t last = tx_transfer_length_;
+    tx_busy_ = false;
+
+    // A transfer that ended on a packet boundary leaves the host waiting
+    // for more; if nothing follows, end it with a zero-length packet
+    if (last > 0 && last % getMaxPacketSize() == 0 && tx_fill_length_ == 0) {
+        tx_busy_ = true;
+        tx_transfer_length_ = 0;
+        if (HAL_PCD_EP_Transmit(&pcd_handle_, CDC_IN_EP, nullptr, 0) == HAL_OK) {
+            tx_stats_.zero_length++;
+            return;
+        }
+        tx_busy_ = false;
+    }
+    startTransfer();
+#endif
 }
 
-bool USB::print(const char* str)
+void USB::onStartOfFrame()
 {
-    if (!str) return false;
-    return write((const uint8_t*)str, strlen(str));
+    // Send whatever small writes have collected during the last frame
+    startTransfer();
 }
 
-bool USB::print(int value)
+bool USB::flush(uint32_t timeout)
 {
-    char buffer[16];
-    snprintf(buffer, sizeof(buffer), "%d", value);
-    return print(buffer);
+    const uint32_t start = HAL_GetTick();
+    while (tx_busy_ || tx_fill_length_ > 0) {
+        if (!connected_) return false;
+        if (HAL_GetTick() - start >= timeout) return false;
+    }
+    return true;
 }
 
-bool USB::print(float value, int decimals)
+USBTxStats USB::getTxStats() const
 {
-    char buffer[32];
-    char format[8];
-    snprintf(format, sizeof(format), "%%.%df", decimals);
-    snprintf(buffer, sizeof(buffer), format, value);
-    return print(buffer);
+    USBTxStats stats = tx_stats_;
+    stats.elapsed_ms = HAL_GetTick() - tx_stats_start_;
+    stats.bytes_per_second = stats.elapsed_ms > 0
+        ? static_cast<uint32_t>(static_cast<uint64_t>(stats.bytes) * 1000 / stats.elapsed_ms)
+        : 0;
+    return stats;
 }
 
-bool USB::println(const char* str)
+void USB::resetTxStats()
 {
-    return print(str) && print("\r\n");
+    tx_stats_ = USBTxStats{};
+    tx_stats_start_ = HAL_GetTick();
 }
 
-bool USB::println(int value)
+uint16_t USB::getMaxPacketSize() const
 {
-    return print(value) && print("\r\n");
+#if LUMOS_USB_CDC
+    return device_.dev_speed == USBD_SPEED_HIGH ? CDC_DATA_HS_MAX_PACKET_SIZE : CDC_DATA_FS_MAX_PACKET_SIZE;
+#else
+    return 64;
+#endif
 }
 
-bool USB::println(float value, int decimals)
+bool USB::write(uint8_t byte)
 {
-    return print(value, decimals) && print("\r\n");
+    return write(&byte, 1);
 }
 
-bool USB::println()
+// ===== Data Reception Methods =====
+
+bool USB::setRxBuffer(uint8_t* buffer, uint16_t size)
 {
-    return print("\r\n");
+    if (initialized_ || buffer == nullptr || size < 64 || size > 32768 || (size & (size - 1)) != 0) {
+        return false;
+    }
+    rx_buffer_ = buffer;
+    rx_mask_ = size - 1;
+    rx_head_ = 0;
+    rx_tail_ = 0;
+    return true;
 }
 
 uint16_t USB::available()
@@ -203,12 +456,7 @@ uint16_t USB::available()
     if (!initialized_) {
         return 0;
     }
-
-    if (rx_head_ >= rx_tail_) {
-        return rx_head_ - rx_tail_;
-    } else {
-        return RX_BUFFER_SIZE - rx_tail_ + rx_head_;
-    }
+    return static_cast<uint16_t>(rx_head_ - rx_tail_);
 }
 
 uint16_t USB::read(uint8_t* buffer, uint16_t length)
@@ -217,24 +465,34 @@ uint16_t USB::read(uint8_t* buffer, uint16_t length)
         return 0;
     }
 
-    uint16_t bytes_read = 0;
-    while (bytes_read < length && available() > 0) {
-        buffer[bytes_read++] = rx_buffer_[rx_tail_];
-        rx_tail_ = (rx_tail_ + 1) % RX_BUFFER_SIZE;
+    const uint32_t tail = rx_tail_;
+    const uint32_t count = rx_head_ - tail;
+    __DMB();  // Read the data only after seeing the head that covers it
+
+    const uint16_t bytes_read = (count < length) ? static_cast<uint16_t>(count) : length;
+    if (bytes_read == 0) {
+        return 0;
     }
 
+    // At most two runs: up to the end of the ring, then from its start
+    const uint32_t start = tail & rx_mask_;
+    const uint32_t first = (bytes_read < rx_mask_ + 1 - start) ? bytes_read : rx_mask_ + 1 - start;
+    memcpy(buffer, rx_buffer_ + start, first);
+    memcpy(buffer + first, rx_buffer_, bytes_read - first);
+
+    __DMB();  // Finish reading before the interrupt may overwrite the space
+    rx_tail_ = tail + bytes_read;
+
+    if (rx_paused_) {
+        resumeReceive();
+    }
     return bytes_read;
 }
 
 int USB::read()
 {
-    if (!initialized_ || available() == 0) {
-        return -1;
-    }
-
-    uint8_t byte = rx_buffer_[rx_tail_];
-    rx_tail_ = (rx_tail_ + 1) % RX_BUFFER_SIZE;
-    return byte;
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
 }
 
 bool USB::isConnected()
@@ -247,49 +505,544 @@ bool USB::isReady()
     return initialized_ && connected_;
 }
 
-void USB::flush()
+// Called from the USB interrupt with a packet from the OUT endpoint
+void USB::onDataReceived(uint8_t* data, uint32_t length)
 {
-    rx_head_ = 0;
-    rx_tail_ = 0;
+    if (data != nullptr && length > 0) {
+        const uint32_t head = rx_head_;
+        const uint32_t space = rx_mask_ + 1 - (head - rx_tail_);
+        // Space for a whole packet was checked before the endpoint was
+        // armed, so this only truncates if the host ignores the packet size
+        if (length > space) length = space;
+
+        const uint32_t start = head & rx_mask_;
+        const uint32_t first = (length < rx_mask_ + 1 - start) ? length : rx_mask_ + 1 - start;
+        memcpy(rx_buffer_ + start, data, first);
+        memcpy(rx_buffer_, data + first, length - first);
+
+        __DMB();  // Publish the data before the new head
+        rx_head_ = head + length;
+        LUMOS_POST_EVENT(EVENT_USB_RX);
+    }
+
+    armReceive();
 }
 
-void USB::onDataReceived(uint8_t* data, uint32_t length)
+// Called from the USB interrupt: accept the next packet if it fits,
+// otherwise leave the endpoint NAKing until read() frees space
+void USB::armReceive()
 {
-    if (!data || length == 0) {
+#if LUMOS_USB_CDC
+    const uint32_t space = rx_mask_ + 1 - (rx_head_ - rx_tail_);
+    if (space < getMaxPacketSize()) {
+        rx_paused_ = true;
         return;
     }
+    rx_paused_ = false;
+    if (interface_ == USBInterface::Vendor) {
+        USBD_LL_PrepareReceive(&device_, VENDOR_OUT_EP, rx_packet_, getMaxPacketSize());
+        return;
+    }
+    USBD_CDC_SetRxBuffer(&device_, rx_packet_);
+    USBD_CDC_ReceivePacket(&device_);
+#endif
+}
 
-    // Copy data to circular buffer
-    for (uint32_t i = 0; i < length; i++) {
-        uint16_t next_head = (rx_head_ + 1) % RX_BUFFER_SIZE;
-
-        // Check if buffer is full
-        if (next_head == rx_tail_) {
-            // Buffer full, drop oldest data
-            rx_tail_ = (rx_tail_ + 1) % RX_BUFFER_SIZE;
-        }
-
-        rx_buffer_[rx_head_] = data[i];
-        rx_head_ = next_head;
+// Called by read() once the host has been held off
+void USB::resumeReceive()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (rx_paused_ && connected_) {
+        armReceive();
     }
+    __set_PRIMASK(primask);
 }
 
 void USB::onConnect()
 {
+    // The CDC class arms the OUT endpoint itself when configured
     connected_ = true;
+    rx_paused_ = false;
+    if (interface_ == USBInterface::Vendor) {
+        armReceive();
+    }
 }
 
 void USB::onDisconnect()
 {
+    // Unread received data stays available
     connected_ = false;
-    flush();
+    rx_paused_ = false;
+    tx_busy_ = false;
+    tx_fill_length_ = 0;
+}
+
+#if LUMOS_USB_CDC
+
+// ===== CDC Interface =====
+
+static int8_t cdcInit()
+{
+    // The host selected the configuration: the data endpoints are open
+    USBD_HandleTypeDef* device = active_usb->getDevice();
+    USBD_CDC_SetTxBuffer(device, nullptr, 0);  // Transmission bypasses the class
+    USBD_CDC_SetRxBuffer(device, active_usb->getRxPacket());
+    active_usb->onConnect();
+    return USBD_OK;
+}
+
+static int8_t cdcDeInit()
+{
+    active_usb->onDisconnect();
+    return USBD_OK;
+}
+
+static int8_t cdcControl(uint8_t cmd, uint8_t* buffer, uint16_t length)
+{
+    // Baud rate and line settings are meaningless on USB; report back
+    // whatever the host set
+    static uint8_t line_coding[7] = {0x00, 0xC2, 0x01, 0x00, 0, 0, 8};  // 115200 8N1
+
+    if (cmd == CDC_SET_LINE_CODING && length >= sizeof(line_coding)) {
+        memcpy(line_coding, buffer, sizeof(line_coding));
+    } else if (cmd == CDC_GET_LINE_CODING && length >= sizeof(line_coding)) {
+        memcpy(buffer, line_coding, sizeof(line_coding));
+    }
+    return USBD_OK;
+}
+
+static int8_t cdcReceive(uint8_t* buffer, uint32_t* length)
+{
+    // Copies the packet and re-arms the endpoint if another one fits
+    active_usb->onDataReceived(buffer, *length);
+    return USBD_OK;
+}
+
+// ===== Vendor Interface =====
+
+static uint8_t vendorInit(USBD_HandleTypeDef* device, uint8_t config)
+{
+    (void)config;
+    const uint16_t max_packet = device->dev_speed == USBD_SPEED_HIGH ? CDC_DATA_HS_MAX_PACKET_SIZE
+                                                                    : CDC_DATA_FS_MAX_PACKET_SIZE;
+    USBD_LL_OpenEP(device, VENDOR_IN_EP, USBD_EP_TYPE_BULK, max_packet);
+    device->ep_in[VENDOR_IN_EP & 0xFU].is_used = 1U;
+    USBD_LL_OpenEP(device, VENDOR_OUT_EP, USBD_EP_TYPE_BULK, max_packet);
+    device->ep_out[VENDOR_OUT_EP & 0xFU].is_used = 1U;
+    active_usb->onConnect();  // Arms the OUT endpoint
+    return USBD_OK;
 }
 
-uint16_t USB::getRxBufferAvailable()
+static uint8_t vendorDeInit(USBD_HandleTypeDef* device, uint8_t config)
 {
-    if (rx_head_ >= rx_tail_) {
-        return RX_BUFFER_SIZE - (rx_head_ - rx_tail_);
-    } else {
-        return rx_tail_ - rx_head_;
+    (void)config;
+    USBD_LL_CloseEP(device, VENDOR_IN_EP);
+    device->ep_in[VENDOR_IN_EP & 0xFU].is_used = 0U;
+    USBD_LL_CloseEP(device, VENDOR_OUT_EP);
+    device->ep_out[VENDOR_OUT_EP & 0xFU].is_used = 0U;
+    active_usb->onDisconnect();
+    return USBD_OK;
+}
+
+static uint8_t vendorSetup(USBD_HandleTypeDef* device, USBD_SetupReqTypedef* request)
+{
+    // Only the standard interface requests; the data needs no control
+    static uint8_t status[2] = {0, 0};
+    static uint8_t alternate = 0;
+    if ((request->bmRequest & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD) {
+        switch (request->bRequest) {
+            case USB_REQ_GET_STATUS:
+                USBD_CtlSendData(device, status, 2);
+                return USBD_OK;
+            case USB_REQ_GET_INTERFACE:
+                USBD_CtlSendData(device, &alternate, 1);
+                return USBD_OK;
+            case USB_REQ_SET_INTERFACE:
+                if (request->wValue == 0) {
+                    return USBD_OK;
+                }
+                break;
+            case USB_REQ_CLEAR_FEATURE:
+                return USBD_OK;
+            default:
+                break;
+        }
     }
+    USBD_CtlError(device, request);
+    return USBD_FAIL;
+}
+
+static uint8_t vendorDataIn(USBD_HandleTypeDef* device, uint8_t endpoint)
+{
+    // USB::onTxComplete() runs from HAL_PCD_DataInStageCallback()
+    (void)device;
+    (void)endpoint;
+    return USBD_OK;
+}
+
+static uint8_t vendorDataOut(USBD_HandleTypeDef* device, uint8_t endpoint)
+{
+    // Copies the packet and re-arms the endpoint if another one fits
+    active_usb->onDataReceived(active_usb->getRxPacket(), USBD_LL_GetRxDataSize(device, endpoint));
+    return USBD_OK;
 }
+
+#define VENDOR_CONFIG_SIZE 32
+
+// Configuration, one vendor-specific interface, bulk IN and bulk OUT
+#define VENDOR_CONFIG_DESCRIPTOR(max_packet)                                            \
+    {                                                                                   \
+        0x09, USB_DESC_TYPE_CONFIGURATION, VENDOR_CONFIG_SIZE, 0x00,                    \
+        0x01,                   /* bNumInterfaces */                                    \
+        0x01,                   /* bConfigurationValue */                               \
+        0x00,                   /* iConfiguration */                                    \
+        0x80,                   /* bmAttributes: bus powered */                         \
+        0xFA,                   /* bMaxPower: 500 mA */                                 \
+        0x09, USB_DESC_TYPE_INTERFACE,                                                  \
+        0x00,                   /* bInterfaceNumber */                                  \
+        0x00,                   /* bAlternateSetting */                                 \
+        0x02,                   /* bNumEndpoints */                                     \
+        0xFF, 0x00, 0x00,       /* Vendor-specific class, no subclass or protocol */    \
+        0x00,                   /* iInterface */                                        \
+        0x07, USB_DESC_TYPE_ENDPOINT, VENDOR_IN_EP, USBD_EP_TYPE_BULK,                  \
+        LOBYTE(max_packet), HIBYTE(max_packet), 0x00,                                   \
+        0x07, USB_DESC_TYPE_ENDPOINT, VENDOR_OUT_EP, USBD_EP_TYPE_BULK,                 \
+        LOBYTE(max_packet), HIBYTE(max_packet), 0x00                                    \
+    }
+
+__ALIGN_BEGIN static uint8_t vendor_fs_config[VENDOR_CONFIG_SIZE] __ALIGN_END =
+    VENDOR_CONFIG_DESCRIPTOR(CDC_DATA_FS_MAX_PACKET_SIZE);
+__ALIGN_BEGIN static uint8_t vendor_hs_config[VENDOR_CONFIG_SIZE] __ALIGN_END =
+    VENDOR_CONFIG_DESCRIPTOR(CDC_DATA_HS_MAX_PACKET_SIZE);
+
+__ALIGN_BEGIN static uint8_t vendor_device_qualifier[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END = {
+    USB_LEN_DEV_QUALIFIER_DESC, USB_DESC_TYPE_DEVICE_QUALIFIER,
+    0x00, 0x02,                 // bcdUSB (2.00)
+    0x00, 0x00, 0x00,           // Class per interface
+    0x40,                       // bMaxPacketSize0
+    0x01,                       // bNumConfigurations
+    0x00
+};
+
+static uint8_t* vendorGetHsConfig(uint16_t* length)
+{
+    *length = sizeof(vendor_hs_config);
+    return vendor_hs_config;
+}
+
+static uint8_t* vendorGetFsConfig(uint16_t* length)
+{
+    *length = sizeof(vendor_fs_config);
+    return vendor_fs_config;
+}
+
+static uint8_t* vendorGetDeviceQualifier(uint16_t* length)
+{
+    *length = sizeof(vendor_device_qualifier);
+    return vendor_device_qualifier;
+}
+
+// ===== Descriptors =====
+
+#define LUMOS_USB_VID           0x0483  // STMicroelectronics
+#define LUMOS_USB_PID           0x5740  // Virtual COM Port
+#ifndef LUMOS_USB_VENDOR_PID
+#define LUMOS_USB_VENDOR_PID    0x5750  // Vendor bulk interface (lumos monitor --usb)
+#endif
+#define LUMOS_USB_MSC_PID       0x5720  // Mass storage
+#define LUMOS_USB_LANGID        0x0409  // English (US)
+
+__ALIGN_BEGIN static uint8_t device_descriptor[USB_LEN_DEV_DESC] __ALIGN_END = {
+    0x12,                       // bLength
+    USB_DESC_TYPE_DEVICE,       // bDescriptorType
+    0x00, 0x02,                 // bcdUSB (2.00)
+    0x02,                       // bDeviceClass (CDC)
+    0x02,                       // bDeviceSubClass
+    0x00,                       // bDeviceProtocol
+    USB_MAX_EP0_SIZE,           // bMaxPacketSize
+    LOBYTE(LUMOS_USB_VID), HIBYTE(LUMOS_USB_VID),
+    LOBYTE(LUMOS_USB_PID), HIBYTE(LUMOS_USB_PID),
+    0x00, 0x02,                 // bcdDevice (2.00)
+    USBD_IDX_MFC_STR,
+    USBD_IDX_PRODUCT_STR,
+    USBD_IDX_SERIAL_STR,
+    USBD_MAX_NUM_CONFIGURATION
+};
+
+// The CDC descriptor above, or one with the class per interface
+static void setDeviceDescriptor(USBInterface interface)
+{
+    const bool cdc = interface == USBInterface::CDC;
+    const uint16_t pid = cdc ? LUMOS_USB_PID
+                       : interface == USBInterface::Vendor ? LUMOS_USB_VENDOR_PID : LUMOS_USB_MSC_PID;
+    device_descriptor[4] = cdc ? 0x02 : 0x00;      // bDeviceClass
+    device_descriptor[5] = cdc ? 0x02 : 0x00;      // bDeviceSubClass
+    device_descriptor[10] = LOBYTE(pid);
+    device_descriptor[11] = HIBYTE(pid);
+}
+
+__ALIGN_BEGIN static uint8_t lang_id_descriptor[USB_LEN_LANGID_STR_DESC] __ALIGN_END = {
+    USB_LEN_LANGID_STR_DESC,
+    USB_DESC_TYPE_STRING,
+    LOBYTE(LUMOS_USB_LANGID), HIBYTE(LUMOS_USB_LANGID)
+};
+
+__ALIGN_BEGIN static uint8_t string_descriptor[USBD_MAX_STR_DESC_SIZ] __ALIGN_END;
+
+static uint8_t* getStringDescriptor(const char* text, uint16_t* length)
+{
+    USBD_GetString(reinterpret_cast<uint8_t*>(const_cast<char*>(text)), string_descriptor, length);
+    return string_descriptor;
+}
+
+static uint8_t* getDeviceDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    *length = sizeof(device_descriptor);
+    return device_descriptor;
+}
+
+static uint8_t* getLangIdDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    *length = sizeof(lang_id_descriptor);
+    return lang_id_descriptor;
+}
+
+static uint8_t* getManufacturerDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    return getStringDescriptor("Lumos Robotics", length);
+}
+
+static uint8_t* getProductDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    if (active_usb != nullptr && active_usb->getInterface() == USBInterface::Vendor) {
+        return getStringDescriptor("Lumos Bulk Stream", length);
+    }
+    if (active_usb != nullptr && active_usb->getInterface() == USBInterface::MassStorage) {
+        return getStringDescriptor("Lumos SD Card", length);
+    }
+    return getStringDescriptor("Lumos Virtual COM Port", length);
+}
+
+static uint8_t* getSerialDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    // 96-bit unique device ID, folded to 48 bits of hex like ST's own stack
+    const uint32_t* uid = reinterpret_cast<const uint32_t*>(UID_BASE);
+    const uint32_t high = uid[0] + uid[2];
+    const uint32_t low = uid[1] >> 16;
+
+    char text[13];
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < 8; ++i) text[i] = digits[(high >> (28 - 4 * i)) & 0xF];
+    for (int i = 0; i < 4; ++i) text[8 + i] = digits[(low >> (12 - 4 * i)) & 0xF];
+    text[12] = '\0';
+    return getStringDescriptor(text, length);
+}
+
+static uint8_t* getConfigurationDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    return getStringDescriptor("CDC Config", length);
+}
+
+static uint8_t* getInterfaceDescriptor(USBD_SpeedTypeDef speed, uint16_t* length)
+{
+    (void)speed;
+    return getStringDescriptor("CDC Interface", length);
+}
+
+// ===== USB Device Library Low Level Driver =====
+//
+// Weak so a project bringing its own usbd_conf.c (e.g. examples/example_usb)
+// keeps working.
+
+static USBD_StatusTypeDef toUsbStatus(HAL_StatusTypeDef status)
+{
+    switch (status) {
+        case HAL_OK: return USBD_OK;
+        case HAL_BUSY: return USBD_BUSY;
+        default: return USBD_FAIL;
+    }
+}
+
+static PCD_HandleTypeDef* getPcd(USBD_HandleTypeDef* device)
+{
+    return static_cast<PCD_HandleTypeDef*>(device->pData);
+}
+
+extern "C" {
+
+__weak USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef* device)
+{
+    PCD_HandleTypeDef* pcd = active_usb->getHandle();
+    pcd->pData = device;
+    device->pData = pcd;
+    return active_usb->initController() ? USBD_OK : USBD_FAIL;
+}
+
+__weak USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef* device)
+{
+    return toUsbStatus(HAL_PCD_DeInit(getPcd(device)));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef* device)
+{
+    return toUsbStatus(HAL_PCD_Start(getPcd(device)));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef* device)
+{
+    return toUsbStatus(HAL_PCD_Stop(getPcd(device)));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef* device, uint8_t ep_addr,
+                                         uint8_t ep_type, uint16_t ep_mps)
+{
+    return toUsbStatus(HAL_PCD_EP_Open(getPcd(device), ep_addr, ep_mps, ep_type));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    return toUsbStatus(HAL_PCD_EP_Close(getPcd(device), ep_addr));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    return toUsbStatus(HAL_PCD_EP_Flush(getPcd(device), ep_addr));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    return toUsbStatus(HAL_PCD_EP_SetStall(getPcd(device), ep_addr));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    return toUsbStatus(HAL_PCD_EP_ClrStall(getPcd(device), ep_addr));
+}
+
+__weak uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    PCD_HandleTypeDef* pcd = getPcd(device);
+    return (ep_addr & 0x80) ? pcd->IN_ep[ep_addr & 0x7F].is_stall : pcd->OUT_ep[ep_addr & 0x7F].is_stall;
+}
+
+__weak USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef* device, uint8_t dev_addr)
+{
+    return toUsbStatus(HAL_PCD_SetAddress(getPcd(device), dev_addr));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef* device, uint8_t ep_addr,
+                                           uint8_t* buffer, uint32_t size)
+{
+    return toUsbStatus(HAL_PCD_EP_Transmit(getPcd(device), ep_addr, buffer, size));
+}
+
+__weak USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef* device, uint8_t ep_addr,
+                                                 uint8_t* buffer, uint32_t size)
+{
+    return toUsbStatus(HAL_PCD_EP_Receive(getPcd(device), ep_addr, buffer, size));
+}
+
+__weak uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef* device, uint8_t ep_addr)
+{
+    return HAL_PCD_EP_GetRxCount(getPcd(device), ep_addr);
+}
+
+__weak void USBD_LL_Delay(uint32_t delay)
+{
+    HAL_Delay(delay);
+}
+
+// For a usbd_conf.h mapping USBD_malloc to static allocation: the CDC
+// class allocates its handle once
+__weak void* USBD_static_malloc(uint32_t size)
+{
+    static uint32_t memory[(sizeof(USBD_CDC_HandleTypeDef) + 3) / 4];
+    return size <= sizeof(memory) ? memory : nullptr;
+}
+
+__weak void USBD_static_free(void* memory)
+{
+    (void)memory;
+}
+
+// ===== PCD Callbacks =====
+
+__weak void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_SetupStage(static_cast<USBD_HandleTypeDef*>(pcd->pData), reinterpret_cast<uint8_t*>(pcd->Setup));
+}
+
+__weak void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef* pcd, uint8_t epnum)
+{
+    USBD_LL_DataOutStage(static_cast<USBD_HandleTypeDef*>(pcd->pData), epnum, pcd->OUT_ep[epnum].xfer_buff);
+}
+
+__weak void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef* pcd, uint8_t epnum)
+{
+    USBD_LL_DataInStage(static_cast<USBD_HandleTypeDef*>(pcd->pData), epnum, pcd->IN_ep[epnum].xfer_buff);
+    if (epnum == (CDC_IN_EP & 0x7F) && active_usb != nullptr) {
+        active_usb->onTxComplete();
+    }
+}
+
+__weak void HAL_PCD_SOFCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_SOF(static_cast<USBD_HandleTypeDef*>(pcd->pData));
+    if (active_usb != nullptr) {
+        active_usb->onStartOfFrame();
+    }
+}
+
+__weak void HAL_PCD_ResetCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_HandleTypeDef* device = static_cast<USBD_HandleTypeDef*>(pcd->pData);
+    USBD_LL_SetSpeed(device, pcd->Init.speed == PCD_SPEED_HIGH ? USBD_SPEED_HIGH : USBD_SPEED_FULL);
+    USBD_LL_Reset(device);
+    if (active_usb != nullptr) {
+        active_usb->onDisconnect();
+    }
+}
+
+__weak void HAL_PCD_SuspendCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_Suspend(static_cast<USBD_HandleTypeDef*>(pcd->pData));
+}
+
+__weak void HAL_PCD_ResumeCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_Resume(static_cast<USBD_HandleTypeDef*>(pcd->pData));
+}
+
+__weak void HAL_PCD_ISOOUTIncompleteCallback(PCD_HandleTypeDef* pcd, uint8_t epnum)
+{
+    USBD_LL_IsoOUTIncomplete(static_cast<USBD_HandleTypeDef*>(pcd->pData), epnum);
+}
+
+__weak void HAL_PCD_ISOINIncompleteCallback(PCD_HandleTypeDef* pcd, uint8_t epnum)
+{
+    USBD_LL_IsoINIncomplete(static_cast<USBD_HandleTypeDef*>(pcd->pData), epnum);
+}
+
+__weak void HAL_PCD_ConnectCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_DevConnected(static_cast<USBD_HandleTypeDef*>(pcd->pData));
+}
+
+__weak void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef* pcd)
+{
+    USBD_LL_DevDisconnected(static_cast<USBD_HandleTypeDef*>(pcd->pData));
+    if (active_usb != nullptr) {
+        active_usb->onDisconnect();
+    }
+}
+
+} // extern "C"
+
+#endif // LUMOS_USB_CDC
@@ -21,16 +21,75 @@
 #endif
 
 #include <cstring>
-#include <cstdio>
+#include "format.h"
+#include "trace.h"
 
-// USB Class - USB OTG High Speed with CDC (Virtual COM Port)
+// The CDC device needs the ST USB Device Library, configured by the
+// board's (or project's) usbd_conf.h. Without it (or when the build leaves
+// out the library because the project doesn't use the pcd module)
+// write() fails and only the PCD is initialized.
+#if __has_include("usbd_conf.h") && __has_include("usbd_def.h")
+    #include "usbd_def.h"
+    #define LUMOS_USB_CDC 1
+#else
+    #define LUMOS_USB_CDC 0
+#endif
+
+// What the device presents to the host (USB::begin())
+//   CDC:    Virtual COM port, opened as a tty by any OS
+//   Vendor: One vendor-specific interface with a bulk IN (0x81) and a bulk
+//           OUT (0x01) endpoint and no class requests, read with libusb
+//           (`lumos monitor --usb`). No tty layer or line discipline sits
+//           in between, so the host keeps many large transfers queued and
+//           the link runs at the bus rate. Windows needs WinUSB bound to it
+//           (e.g. with Zadig).
+//   MassStorage: A USB drive backed by the SD card, see USBMassStorage
+//           (usb_msc.h), which starts the device with it.
+enum class USBInterface : uint8_t
+{
+    CDC,
+    Vendor,
+    MassStorage
+};
+
+// Transmit statistics since begin() or resetTxStats()
+struct USBTxStats
+{
+    uint32_t bytes;            // payload handed to the IN endpoint
+    uint32_t transfers;        // endpoint transfers (each one or more packets)
+    uint32_t packets;          // of those, full and short packets
+    uint32_t zero_length;      // ZLPs terminating transfers of whole packets
+    uint32_t timeouts;         // write() calls that gave up waiting for space
+    uint32_t elapsed_ms;
+    uint32_t bytes_per_second;
+};
+
+// USB Class - CDC (Virtual COM Port) on the USB OTG/device peripheral
+//
+// write() copies into one of two transmit buffers while the other is on
+// the IN endpoint. A buffer goes out as soon as the endpoint is free and
+// holds at least one full packet; smaller writes are batched until the
+// next start-of-frame (1 ms at full speed, 125 us at high speed). A
+// transfer that ends on a packet boundary is followed by a zero-length
+// packet so the host sees the end of the data. The board must forward
+// the USB interrupt:
+//
+//   extern "C" void OTG_HS_IRQHandler(void) { usb.handleInterrupt(); }
+//
+// Received data is never dropped: when the receive ring is full the host
+// is held off until read() makes room.
+//
 // Usage Example:
+//   static uint8_t usb_rx[4096];
+//   usb.setRxBuffer(usb_rx, sizeof(usb_rx));  // Optional, before begin()
 //   usb.begin();  // Initialize USB CDC
 //
 //   // Send data
 //   usb.write((uint8_t*)"Hello", 5);
 //   usb.print("Temperature: ");
 //   usb.println(25.5);
+//   usb.printf("adc=%u\r\n", value);
+//   usb.flush();  // Wait until everything has been sent
 //
 //   // Receive data
 //   if (usb.available()) {
@@ -42,17 +101,32 @@
 //   if (usb.isConnected()) {
 //       // USB host is connected
 //   }
-class USB
+//
+//   USBTxStats stats = usb.getTxStats();  // e.g. stats.bytes_per_second
+//
+//   usb.begin(USBInterface::Vendor);  // Same calls, no CDC framing
+class USB : public Print<USB>
 {
 private:
-    static constexpr uint16_t RX_BUFFER_SIZE = 1024;
+    static constexpr uint16_t RX_BUFFER_SIZE = 1024;  // Default, see setRxBuffer()
+    static constexpr uint16_t TX_BUFFER_SIZE = 2048;  // Each of the two
 
     PCD_HandleTypeDef pcd_handle_;
-    uint8_t rx_buffer_[RX_BUFFER_SIZE];
-    volatile uint16_t rx_head_;
-    volatile uint16_t rx_tail_;
+
+    // Single-producer/single-consumer receive ring: the USB interrupt only
+    // advances rx_head_, read() only advances rx_tail_. Both count bytes
+    // since begin() and are masked into the buffer, so the size must be a
+    // power of two. When less than a packet is free the OUT endpoint is
+    // left unarmed and the host is NAKed until read() makes room.
+    uint8_t rx_storage_[RX_BUFFER_SIZE];
+    uint8_t* rx_buffer_;
+    uint32_t rx_mask_;
+    volatile uint32_t rx_head_;
+    volatile uint32_t rx_tail_;
+    volatile bool rx_paused_;
     volatile bool initialized_;
     volatile bool connected_;
+    USBInterface interface_;
 
     GPIO_TypeDef* dp_port_;
     uint16_t dp_pin_;
@@ -60,6 +134,22 @@ private:
     uint16_t dm_pin_;
     uint32_t alternate_function_;
 
+    // Double-buffered transmit: write() fills tx_buffers_[tx_fill_] while
+    // the other buffer may be on the IN endpoint. The fill index and
+    // length change only with interrupts masked or from the USB interrupt.
+    alignas(4) uint8_t tx_buffers_[2][TX_BUFFER_SIZE];
+    volatile uint8_t tx_fill_;
+    volatile uint16_t tx_fill_length_;
+    volatile uint16_t tx_transfer_length_;  // length of the transfer in flight
+    volatile bool tx_busy_;
+    USBTxStats tx_stats_;
+    uint32_t tx_stats_start_;
+
+#if LUMOS_USB_CDC
+    USBD_HandleTypeDef device_;
+    alignas(4) uint8_t rx_packet_[512];  // OUT endpoint buffer (HS max packet)
+#endif
+
 public:
     USB() = delete;
     USB(PCD_TypeDef* usb_instance,
@@ -68,37 +158,78 @@ public:
         uint32_t alternate_function);
 
     // Initialization
-    bool begin();
+    bool begin(USBInterface interface = USBInterface::CDC);
     void end();
 
+#if LUMOS_USB_CDC
+    // Data endpoints of every interface
+    static constexpr uint8_t DATA_IN_EP = 0x81;
+    static constexpr uint8_t DATA_OUT_EP = 0x01;
+
+    /**
+     * @brief Start the device with a class implemented elsewhere
+     *
+     * The class (USBMassStorage's) owns the data endpoints and moves its
+     * data itself; write() and read() are not used then.
+     */
+    bool begin(USBInterface interface, USBD_ClassTypeDef* device_class);
+#endif
+
     // Data transmission
+    // timeout bounds the wait for buffer space while the host is slow
     bool write(const uint8_t* data, uint16_t length, uint32_t timeout = 100);
     bool write(uint8_t byte);
+    // Bytes write() takes right now without waiting for the host
+    uint16_t availableForWrite() const { return connected_ ? TX_BUFFER_SIZE - tx_fill_length_ : 0; }
+    // print(), println() and printf() are inherited from Print (format.h)
+
+    /**
+     * @brief Block until everything written has been sent
+     * @param timeout Maximum wait in milliseconds
+     * @return true if all data left in time
+     */
+    bool flush(uint32_t timeout = 1000);
 
-    // Formatted output (like Serial)
-    bool print(const char* str);
-    bool print(int value);
-    bool print(float value, int decimals = 2);
-    bool println(const char* str);
-    bool println(int value);
-    bool println(float value, int decimals = 2);
-    bool println();  // Just newline
+    USBTxStats getTxStats() const;
+    void resetTxStats();
+
+    /**
+     * @brief Use caller-provided storage for the receive ring
+     * @param buffer Ring storage, must outlive the USB
+     * @param size Power of two between 64 and 32768 bytes
+     * @return false if the size is invalid or the device is running
+     */
+    bool setRxBuffer(uint8_t* buffer, uint16_t size);
 
     // Data reception
     uint16_t available();
-    uint16_t read(uint8_t* buffer, uint16_t length);
+    uint16_t read(uint8_t* buffer, uint16_t length);  // Copies whatever has arrived
     int read();  // Read single byte, returns -1 if no data
 
     // Status
     bool isConnected();
     bool isReady();
-    void flush();
+
+    // Called from the board's USB interrupt handler
+    void handleInterrupt() { LUMOS_TRACE_ISR("usb irq"); HAL_PCD_IRQHandler(&pcd_handle_); }
 
     // Internal methods for callbacks
     void onDataReceived(uint8_t* data, uint32_t length);
     void onConnect();
     void onDisconnect();
+    void onTxComplete();
+    void onStartOfFrame();
+    bool initController();
+    PCD_HandleTypeDef* getHandle() { return &pcd_handle_; }
+    USBInterface getInterface() const { return interface_; }
+#if LUMOS_USB_CDC
+    USBD_HandleTypeDef* getDevice() { return &device_; }
+    uint8_t* getRxPacket() { return rx_packet_; }
+#endif
+    uint16_t getMaxPacketSize() const;
 
 private:
-    uint16_t getRxBufferAvailable();
+    void armReceive();
+    void resumeReceive();
+    void startTransfer();
 };
@@ -0,0 +1,1066 @@
+#include "usb_msc.h"
+
+#if defined(HAL_SD_MODULE_ENABLED) && LUMOS_USB_CDC
+
+#include <cstring>
+#include "usbd_core.h"
+
+// Drive the class glue below is bound to (set by begin())
+static USBMassStorage* active_storage = nullptr;
+
+// Bulk-only transport
+#define MSC_CBW_SIGNATURE       0x43425355U  // "USBC"
+#define MSC_CSW_SIGNATURE       0x53425355U  // "USBS"
+#define MSC_CBW_LENGTH          31
+#define MSC_CSW_LENGTH          13
+#define MSC_REQ_GET_MAX_LUN     0xFE
+#define MSC_REQ_RESET           0xFF
+
+// SCSI operation codes
+#define SCSI_TEST_UNIT_READY        0x00
+#define SCSI_REQUEST_SENSE          0x03
+#define SCSI_INQUIRY                0x12
+#define SCSI_MODE_SENSE_6           0x1A
+#define SCSI_START_STOP_UNIT        0x1B
+#define SCSI_PREVENT_ALLOW_REMOVAL  0x1E
+#define SCSI_READ_FORMAT_CAPACITIES 0x23
+#define SCSI_READ_CAPACITY_10       0x25
+#define SCSI_READ_10                0x28
+#define SCSI_WRITE_10               0x2A
+#define SCSI_VERIFY_10              0x2F
+#define SCSI_SYNCHRONIZE_CACHE_10   0x35
+#define SCSI_MODE_SENSE_10          0x5A
+#define SCSI_READ_12                0xA8
+#define SCSI_WRITE_12               0xAA
+
+// Sense keys and additional sense codes
+#define SENSE_NONE                  0x00
+#define SENSE_NOT_READY             0x02
+#define SENSE_MEDIUM_ERROR          0x03
+#define SENSE_ILLEGAL_REQUEST       0x05
+#define SENSE_DATA_PROTECT          0x07
+#define ASC_WRITE_ERROR             0x0C
+#define ASC_UNRECOVERED_READ_ERROR  0x11
+#define ASC_INVALID_OPCODE          0x20
+#define ASC_LBA_OUT_OF_RANGE        0x21
+#define ASC_INVALID_FIELD_IN_CDB    0x24
+#define ASC_WRITE_PROTECTED         0x27
+#define ASC_MEDIUM_NOT_PRESENT      0x3A
+
+static constexpr uint32_t COMBINE_IDLE_MS = 20;  // Write-back after this long without a write
+
+static uint32_t readBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t readBE16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void writeBE32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static uint32_t readLE32(const uint8_t* p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeLE32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+USBMassStorage::USBMassStorage(USB& usb, SDCard& card, uint8_t* buffers, uint32_t buffer_blocks)
+    : usb_(usb),
+      card_(card),
+      buffers_{},
+      buffer_blocks_(buffer_blocks),
+      card_blocks_(0),
+      max_packet_(64),
+      read_only_(false),
+      ejected_(false),
+      phase_(Phase::Command),
+      tag_(0),
+      data_length_(0),
+      data_moved_(0),
+      data_in_(false),
+      status_(0),
+      xfer_lba_(0),
+      xfer_end_(0),
+      usb_buffer_(-1),
+      usb_blocks_(0),
+      reply_(nullptr),
+      reply_length_(0),
+      card_buffer_(-1),
+      card_done_(false),
+      card_ok_(false),
+      fetch_lba_(0),
+      read_end_(0),
+      reading_(false),
+      write_back_(false),
+      write_failed_(false),
+      usb_done_(false),
+      rx_length_(0),
+      usb_idle_(true),
+      pumping_(false),
+      pump_again_(false),
+      sense_key_(SENSE_NONE),
+      sense_code_(0),
+      bytes_read_(0),
+      bytes_written_(0),
+      read_ahead_hits_(0),
+      card_writes_(0),
+      command_{},
+      status_block_{},
+      reply_data_{}
+{
+    for (uint8_t i = 0; i < 2; ++i) {
+        buffers_[i].data = buffers + i * buffer_blocks * BLOCK_SIZE;
+        buffers_[i].lba = 0;
+        buffers_[i].blocks = 0;
+        buffers_[i].state = BufferState::Free;
+        buffers_[i].stale = false;
+        buffers_[i].written_at = 0;
+    }
+}
+
+// ===== USB Class =====
+
+static uint8_t mscInit(USBD_HandleTypeDef* device, uint8_t config);
+static uint8_t mscDeInit(USBD_HandleTypeDef* device, uint8_t config);
+static uint8_t mscSetup(USBD_HandleTypeDef* device, USBD_SetupReqTypedef* request);
+static uint8_t mscDataIn(USBD_HandleTypeDef* device, uint8_t endpoint);
+static uint8_t mscDataOut(USBD_HandleTypeDef* device, uint8_t endpoint);
+static uint8_t* mscGetHsConfig(uint16_t* length);
+static uint8_t* mscGetFsConfig(uint16_t* length);
+static uint8_t* mscGetDeviceQualifier(uint16_t* length);
+
+static USBD_ClassTypeDef msc_class = {
+    mscInit,
+    mscDeInit,
+    mscSetup,
+    nullptr,                  // EP0_TxSent
+    nullptr,                  // EP0_RxReady
+    mscDataIn,
+    mscDataOut,
+    nullptr,                  // SOF
+    nullptr,                  // IsoINIncomplete
+    nullptr,                  // IsoOUTIncomplete
+    mscGetHsConfig,
+    mscGetFsConfig,
+    mscGetFsConfig,           // Other speed
+    mscGetDeviceQualifier,
+};
+
+static uint8_t mscInit(USBD_HandleTypeDef* device, uint8_t config)
+{
+    (void)config;
+    const uint16_t max_packet = device->dev_speed == USBD_SPEED_HIGH ? 512 : 64;
+    USBD_LL_OpenEP(device, USB::DATA_IN_EP, USBD_EP_TYPE_BULK, max_packet);
+    device->ep_in[USB::DATA_IN_EP & 0xFU].is_used = 1U;
+    USBD_LL_OpenEP(device, USB::DATA_OUT_EP, USBD_EP_TYPE_BULK, max_packet);
+    device->ep_out[USB::DATA_OUT_EP & 0xFU].is_used = 1U;
+    active_storage->onConfigured(max_packet);  // Arms the OUT endpoint for a command
+    return USBD_OK;
+}
+
+static uint8_t mscDeInit(USBD_HandleTypeDef* device, uint8_t config)
+{
+    (void)config;
+    USBD_LL_CloseEP(device, USB::DATA_IN_EP);
+    device->ep_in[USB::DATA_IN_EP & 0xFU].is_used = 0U;
+    USBD_LL_CloseEP(device, USB::DATA_OUT_EP);
+    device->ep_out[USB::DATA_OUT_EP & 0xFU].is_used = 0U;
+    active_storage->onDeconfigured();
+    return USBD_OK;
+}
+
+static uint8_t mscSetup(USBD_HandleTypeDef* device, USBD_SetupReqTypedef* request)
+{
+    static uint8_t max_lun = 0;  // One logical unit
+    static uint8_t status[2] = {0, 0};
+    static uint8_t alternate = 0;
+
+    switch (request->bmRequest & USB_REQ_TYPE_MASK) {
+        case USB_REQ_TYPE_CLASS:
+            if (request->bRequest == MSC_REQ_GET_MAX_LUN && request->wValue == 0 && request->wLength == 1 &&
+                (request->bmRequest & 0x80U) != 0) {
+                USBD_CtlSendData(device, &max_lun, 1);
+                return USBD_OK;
+            }
+            if (request->bRequest == MSC_REQ_RESET && request->wValue == 0 && request->wLength == 0 &&
+                (request->bmRequest & 0x80U) == 0) {
+                active_storage->onReset();
+                USBD_CtlSendStatus(device);
+                return USBD_OK;
+            }
+            break;
+
+        case USB_REQ_TYPE_STANDARD:
+            switch (request->bRequest) {
+                case USB_REQ_GET_STATUS:
+                    USBD_CtlSendData(device, status, 2);
+                    return USBD_OK;
+                case USB_REQ_GET_INTERFACE:
+                    USBD_CtlSendData(device, &alternate, 1);
+                    return USBD_OK;
+                case USB_REQ_SET_INTERFACE:
+                    if (request->wValue == 0) {
+                        return USBD_OK;
+                    }
+                    break;
+                case USB_REQ_CLEAR_FEATURE:
+                    // The core has cleared the halt and answered; the status
+                    // the halt held back can go now
+                    if ((request->bmRequest & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_ENDPOINT) {
+                        active_storage->onClearHalt();
+                    }
+                    return USBD_OK;
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+    USBD_CtlError(device, request);
+    return USBD_FAIL;
+}
+
+static uint8_t mscDataIn(USBD_HandleTypeDef* device, uint8_t endpoint)
+{
+    (void)device;
+    (void)endpoint;
+    active_storage->onDataIn();
+    return USBD_OK;
+}
+
+static uint8_t mscDataOut(USBD_HandleTypeDef* device, uint8_t endpoint)
+{
+    active_storage->onDataOut(USBD_LL_GetRxDataSize(device, endpoint));
+    return USBD_OK;
+}
+
+#define MSC_CONFIG_SIZE 32
+
+// Configuration, one mass storage interface (SCSI transparent command
+// set, bulk-only transport), bulk IN and bulk OUT
+#define MSC_CONFIG_DESCRIPTOR(max_packet)                                               \
+    {                                                                                   \
+        0x09, USB_DESC_TYPE_CONFIGURATION, MSC_CONFIG_SIZE, 0x00,                       \
+        0x01,                   /* bNumInterfaces */                                    \
+        0x01,                   /* bConfigurationValue */                               \
+        0x00,                   /* iConfiguration */                                    \
+        0x80,                   /* bmAttributes: bus powered */                         \
+        0xFA,                   /* bMaxPower: 500 mA */                                 \
+        0x09, USB_DESC_TYPE_INTERFACE,                                                  \
+        0x00,                   /* bInterfaceNumber */                                  \
+        0x00,                   /* bAlternateSetting */                                 \
+        0x02,                   /* bNumEndpoints */                                     \
+        0x08, 0x06, 0x50,       /* Mass storage, SCSI transparent, bulk-only */         \
+        0x00,                   /* iInterface */                                        \
+        0x07, USB_DESC_TYPE_ENDPOINT, USB::DATA_IN_EP, USBD_EP_TYPE_BULK,               \
+        LOBYTE(max_packet), HIBYTE(max_packet), 0x00,                                   \
+        0x07, USB_DESC_TYPE_ENDPOINT, USB::DATA_OUT_EP, USBD_EP_TYPE_BULK,              \
+        LOBYTE(max_packet), HIBYTE(max_packet), 0x00                                    \
+    }
+
+__ALIGN_BEGIN static uint8_t msc_fs_config[MSC_CONFIG_SIZE] __ALIGN_END = MSC_CONFIG_DESCRIPTOR(64);
+__ALIGN_BEGIN static uint8_t msc_hs_config[MSC_CONFIG_SIZE] __ALIGN_END = MSC_CONFIG_DESCRIPTOR(512);
+
+__ALIGN_BEGIN static uint8_t msc_device_qualifier[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END = {
+    USB_LEN_DEV_QUALIFIER_DESC, USB_DESC_TYPE_DEVICE_QUALIFIER,
+    0x00, 0x02,                 // bcdUSB (2.00)
+    0x00, 0x00, 0x00,           // Class per interface
+    0x40,                       // bMaxPacketSize0
+    0x01,                       // bNumConfigurations
+    0x00
+};
+
+static uint8_t* mscGetHsConfig(uint16_t* length)
+{
+    *length = sizeof(msc_hs_config);
+    return msc_hs_config;
+}
+
+static uint8_t* mscGetFsConfig(uint16_t* length)
+{
+    *length = sizeof(msc_fs_config);
+    return msc_fs_config;
+}
+
+static uint8_t* mscGetDeviceQualifier(uint16_t* length)
+{
+    *length = sizeof(msc_device_qualifier);
+    return msc_device_qualifier;
+}
+
+// ===== Drive =====
+
+bool USBMassStorage::begin(bool read_only)
+{
+    if (buffer_blocks_ == 0 || buffer_blocks_ > 64 || !card_.isDmaReady() ||
+        !card_.isDmaBuffer(buffers_[0].data, true) || !card_.isDmaBuffer(buffers_[1].data, true)) {
+        return false;
+    }
+
+    card_blocks_ = card_.getBlockCount();
+    read_only_ = read_only || card_.isWriteProtected();
+    ejected_ = false;
+    for (Buffer& buffer : buffers_) {
+        buffer.state = BufferState::Free;
+        buffer.blocks = 0;
+        buffer.stale = false;
+    }
+    phase_ = Phase::Command;
+    usb_buffer_ = -1;
+    card_buffer_ = -1;
+    card_done_ = false;
+    usb_done_ = false;
+    usb_idle_ = true;
+    reading_ = false;
+    write_back_ = false;
+    write_failed_ = false;
+    sense_key_ = SENSE_NONE;
+    sense_code_ = 0;
+    bytes_read_ = 0;
+    bytes_written_ = 0;
+    read_ahead_hits_ = 0;
+    card_writes_ = 0;
+
+    active_storage = this;
+    return card_blocks_ > 0 && usb_.begin(USBInterface::MassStorage, &msc_class);
+}
+
+void USBMassStorage::end()
+{
+    flush();
+    usb_.end();
+}
+
+void USBMassStorage::poll()
+{
+    pump();
+}
+
+bool USBMassStorage::flush(uint32_t timeout)
+{
+    const uint32_t start = HAL_GetTick();
+    write_back_ = true;
+    pump();
+    while (hasPendingWrites() || card_buffer_ >= 0) {
+        if (HAL_GetTick() - start >= timeout) {
+            return false;
+        }
+        pump();
+    }
+    write_back_ = false;
+    const bool ok = !write_failed_;
+    const uint32_t elapsed = HAL_GetTick() - start;
+    return card_.waitIdle(elapsed < timeout ? timeout - elapsed : 1) && ok;
+}
+
+// ===== Events =====
+//
+// The USB interrupt, the card's completion interrupt and poll() only post
+// what happened; pump() runs the state machine in whichever of them gets
+// there first and repeats for events that came in meanwhile.
+
+void USBMassStorage::onConfigured(uint16_t max_packet)
+{
+    max_packet_ = max_packet;
+    usb_.onConnect();
+    ejected_ = false;
+    onReset();
+}
+
+void USBMassStorage::onDeconfigured()
+{
+    usb_.onDisconnect();
+    onReset();
+    phase_ = Phase::Error;  // Nothing to receive until configured again
+}
+
+void USBMassStorage::onReset()
+{
+    // Data a buffer got before the reset is kept, a transfer cut short is not
+    for (Buffer& buffer : buffers_) {
+        if (buffer.state == BufferState::Sending) {
+            buffer.state = BufferState::Clean;
+        } else if (buffer.state == BufferState::Filling) {
+            buffer.state = buffer.blocks > 0 ? BufferState::Dirty : BufferState::Free;
+        }
+    }
+    usb_buffer_ = -1;
+    usb_done_ = false;
+    usb_idle_ = true;
+    reply_ = nullptr;
+    USBD_LL_FlushEP(device(), USB::DATA_IN_EP);
+    USBD_LL_ClearStallEP(device(), USB::DATA_IN_EP);
+    USBD_LL_ClearStallEP(device(), USB::DATA_OUT_EP);
+    expectCommand();
+    pump();
+}
+
+void USBMassStorage::onClearHalt()
+{
+    if (phase_ == Phase::Error) {
+        // Only a reset recovers from an invalid command block
+        USBD_LL_StallEP(device(), USB::DATA_IN_EP);
+        USBD_LL_StallEP(device(), USB::DATA_OUT_EP);
+    } else if (phase_ == Phase::Stalled) {
+        phase_ = Phase::Status;
+        pump();
+    }
+}
+
+void USBMassStorage::onDataIn()
+{
+    usb_done_ = true;
+    pump();
+}
+
+void USBMassStorage::onDataOut(uint32_t length)
+{
+    rx_length_ = length;
+    usb_done_ = true;
+    pump();
+}
+
+void USBMassStorage::onCardComplete(bool ok)
+{
+    card_ok_ = ok;
+    card_done_ = true;
+    pump();
+}
+
+void USBMassStorage::pump()
+{
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (pumping_) {
+        pump_again_ = true;
+        __set_PRIMASK(primask);
+        return;
+    }
+    pumping_ = true;
+    do {
+        pump_again_ = false;
+        __set_PRIMASK(primask);
+        step();
+        __disable_irq();
+    } while (pump_again_);
+    pumping_ = false;
+    __set_PRIMASK(primask);
+}
+
+void USBMassStorage::step()
+{
+    if (usb_done_) {
+        usb_done_ = false;
+        usb_idle_ = true;
+        const Phase phase = phase_;
+        if (phase == Phase::Command) {
+            handleCommand(rx_length_);
+        } else if (phase == Phase::Status) {
+            expectCommand();
+        } else if (phase == Phase::DataIn && reply_ != nullptr) {
+            reply_ = nullptr;
+            phase_ = Phase::Status;
+        } else if (phase == Phase::DataIn && usb_buffer_ >= 0) {
+            Buffer& buffer = buffers_[usb_buffer_];
+            xfer_lba_ += usb_blocks_;
+            data_moved_ += usb_blocks_ * BLOCK_SIZE;
+            bytes_read_ += usb_blocks_ * BLOCK_SIZE;
+            // Blocks past the command stay for the next sequential READ
+            buffer.state = xfer_lba_ < buffer.lba + buffer.blocks ? BufferState::Clean : BufferState::Free;
+            usb_buffer_ = -1;
+            finishData();
+        } else if (phase == Phase::DataOut && usb_buffer_ >= 0) {
+            Buffer& buffer = buffers_[usb_buffer_];
+            const uint32_t blocks = rx_length_ / BLOCK_SIZE;
+            buffer.blocks += blocks;
+            buffer.written_at = HAL_GetTick();
+            buffer.state = buffer.blocks > 0 ? BufferState::Dirty : BufferState::Free;
+            usb_buffer_ = -1;
+            xfer_lba_ += blocks;
+            data_moved_ += rx_length_;
+            bytes_written_ += blocks * BLOCK_SIZE;
+            if (rx_length_ != usb_blocks_ * BLOCK_SIZE) {
+                // The host sent less than the command announced
+                status_ = 2;
+                phase_ = Phase::Status;
+            } else {
+                finishData();
+            }
+        }
+    }
+
+    if (card_done_) {
+        card_done_ = false;
+        const int8_t index = card_buffer_;
+        card_buffer_ = -1;
+        if (index >= 0) {
+            Buffer& buffer = buffers_[index];
+            if (buffer.state == BufferState::Fetching) {
+                const bool needed = phase_ == Phase::DataIn && reply_ == nullptr && !buffer.stale &&
+                                    xfer_lba_ >= buffer.lba && xfer_lba_ < buffer.lba + buffer.blocks;
+                buffer.state = card_ok_ && !buffer.stale ? BufferState::Clean : BufferState::Free;
+                buffer.stale = false;
+                if (!card_ok_) {
+                    fetch_lba_ = read_end_;  // No read-ahead past a bad block
+                    if (needed) {
+                        fail(SENSE_MEDIUM_ERROR, ASC_UNRECOVERED_READ_ERROR);
+                    }
+                }
+            } else if (buffer.state == BufferState::Flushing) {
+                buffer.state = BufferState::Free;
+                if (card_ok_) {
+                    card_writes_++;
+                } else {
+                    write_failed_ = true;
+                }
+            }
+        }
+    }
+
+    // SYNCHRONIZE CACHE and eject answer once everything is on the card
+    if (phase_ == Phase::WaitCard && !hasPendingWrites() && card_buffer_ < 0) {
+        write_back_ = false;
+        if (write_failed_) {
+            write_failed_ = false;
+            fail(SENSE_MEDIUM_ERROR, ASC_WRITE_ERROR);
+        }
+        phase_ = Phase::Status;
+    }
+
+    startCard();
+    startUsb();
+}
+
+// ===== Commands =====
+
+void USBMassStorage::handleCommand(uint32_t length)
+{
+    const uint8_t* cbw = command_;
+    if (length != MSC_CBW_LENGTH || readLE32(cbw) != MSC_CBW_SIGNATURE ||
+        cbw[13] != 0 || cbw[14] < 1 || cbw[14] > 16) {
+        // Not meaningful: halt both endpoints until the host resets
+        phase_ = Phase::Error;
+        USBD_LL_StallEP(device(), USB::DATA_IN_EP);
+        USBD_LL_StallEP(device(), USB::DATA_OUT_EP);
+        return;
+    }
+
+    tag_ = readLE32(cbw + 4);
+    data_length_ = readLE32(cbw + 8);
+    data_in_ = (cbw[12] & 0x80) != 0;
+    data_moved_ = 0;
+    status_ = 0;
+    reply_ = nullptr;
+
+    if (!runCommand(cbw + 15)) {
+        return;  // fail() has decided what happens to the data phase
+    }
+    if (phase_ == Phase::Command) {
+        // No data: the host may still expect some (BOT cases 4 and 9)
+        phase_ = data_length_ > 0 ? Phase::Stalled : Phase::Status;
+        if (data_length_ > 0) {
+            stall(data_in_);
+        }
+    }
+}
+
+bool USBMassStorage::runCommand(const uint8_t* cdb)
+{
+    const uint8_t opcode = cdb[0];
+
+    // A failed write-back is reported on the next command that touches the medium
+    if (write_failed_ && opcode != SCSI_REQUEST_SENSE && opcode != SCSI_INQUIRY) {
+        write_failed_ = false;
+        fail(SENSE_MEDIUM_ERROR, ASC_WRITE_ERROR);
+        return false;
+    }
+
+    switch (opcode) {
+        case SCSI_TEST_UNIT_READY:
+            if (!isReady()) {
+                fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+                return false;
+            }
+            return true;
+
+        case SCSI_REQUEST_SENSE: {
+            // Fixed format
+            memset(reply_data_, 0, 18);
+            reply_data_[0] = 0x70;
+            reply_data_[2] = sense_key_;
+            reply_data_[7] = 10;
+            reply_data_[12] = sense_code_;
+            sense_key_ = SENSE_NONE;
+            sense_code_ = 0;
+            setReply(18);
+            return true;
+        }
+
+        case SCSI_INQUIRY: {
+            if (cdb[1] & 0x01) {
+                fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);  // No vital product data pages
+                return false;
+            }
+            static const char identification[] = "Lumos   SD Card         1.00";
+            memset(reply_data_, 0, 36);
+            reply_data_[0] = 0x00;      // Direct access block device
+            reply_data_[1] = 0x80;      // Removable
+            reply_data_[2] = 0x02;      // SPC-2
+            reply_data_[3] = 0x02;      // Response data format
+            reply_data_[4] = 36 - 5;    // Additional length
+            memcpy(reply_data_ + 8, identification, 28);  // Vendor, product, revision
+            setReply(36);
+            return true;
+        }
+
+        case SCSI_MODE_SENSE_6:
+        case SCSI_MODE_SENSE_10: {
+            // Header, then the caching page (write cache enabled) when asked for
+            const bool ten = opcode == SCSI_MODE_SENSE_10;
+            const uint8_t page = cdb[2] & 0x3F;
+            const uint32_t header = ten ? 8 : 4;
+            const bool caching = page == 0x08 || page == 0x3F;
+            const uint32_t length = header + (caching ? 20 : 0);
+            memset(reply_data_, 0, length);
+            if (ten) {
+                reply_data_[1] = (uint8_t)(length - 2);
+                reply_data_[3] = read_only_ ? 0x80 : 0x00;
+            } else {
+                reply_data_[0] = (uint8_t)(length - 1);
+                reply_data_[2] = read_only_ ? 0x80 : 0x00;
+            }
+            if (caching) {
+                uint8_t* caching_page = reply_data_ + header;
+                caching_page[0] = 0x08;
+                caching_page[1] = 18;
+                caching_page[2] = 0x04;  // WCE
+            }
+            setReply(length);
+            return true;
+        }
+
+        case SCSI_START_STOP_UNIT:
+            if ((cdb[4] & 0x03) == 0x02) {
+                // Eject: the card belongs to the firmware again once written back
+                startSync(true);
+            }
+            return true;
+
+        case SCSI_PREVENT_ALLOW_REMOVAL:
+            return true;
+
+        case SCSI_READ_FORMAT_CAPACITIES: {
+            if (!isReady()) {
+                fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+                return false;
+            }
+            memset(reply_data_, 0, 12);
+            reply_data_[3] = 8;                     // Capacity list length
+            writeBE32(reply_data_ + 4, card_blocks_);
+            reply_data_[8] = 0x02;                  // Formatted media
+            reply_data_[10] = (uint8_t)(BLOCK_SIZE >> 8);
+            reply_data_[11] = (uint8_t)BLOCK_SIZE;
+            setReply(12);
+            return true;
+        }
+
+        case SCSI_READ_CAPACITY_10:
+            if (!isReady()) {
+                fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+                return false;
+            }
+            writeBE32(reply_data_, card_blocks_ - 1);
+            writeBE32(reply_data_ + 4, BLOCK_SIZE);
+            setReply(8);
+            return true;
+
+        case SCSI_READ_10:
+            return startRead(readBE32(cdb + 2), readBE16(cdb + 7));
+        case SCSI_READ_12:
+            return startRead(readBE32(cdb + 2), readBE32(cdb + 6));
+        case SCSI_WRITE_10:
+            return startWrite(readBE32(cdb + 2), readBE16(cdb + 7));
+        case SCSI_WRITE_12:
+            return startWrite(readBE32(cdb + 2), readBE32(cdb + 6));
+
+        case SCSI_VERIFY_10:
+            // The card checks its own ECC; comparing data (BYTCHK) is not supported
+            if (cdb[1] & 0x02) {
+                fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+                return false;
+            }
+            return true;
+
+        case SCSI_SYNCHRONIZE_CACHE_10:
+            startSync(false);
+            return true;
+
+        default:
+            fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_OPCODE);
+            return false;
+    }
+}
+
+bool USBMassStorage::startRead(uint32_t lba, uint32_t blocks)
+{
+    if (!isReady()) {
+        fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+        return false;
+    }
+    if (lba >= card_blocks_ || blocks > card_blocks_ - lba) {
+        fail(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+        return false;
+    }
+    if (!data_in_ || data_length_ != blocks * BLOCK_SIZE) {
+        status_ = 2;  // The host and the command disagree on the data
+        phase_ = Phase::Stalled;
+        stall(data_in_);
+        return false;
+    }
+    if (blocks == 0) {
+        return true;
+    }
+
+    // Keep what read-ahead fetched if the command starts in it; the other
+    // buffer stays too if it continues from there
+    bool hit = false;
+    uint32_t fetched_to = lba;
+    for (uint8_t pass = 0; pass < 2; ++pass) {
+        for (Buffer& buffer : buffers_) {
+            const bool usable = (buffer.state == BufferState::Clean || buffer.state == BufferState::Fetching) &&
+                                !buffer.stale;
+            if (usable && fetched_to >= buffer.lba && fetched_to < buffer.lba + buffer.blocks) {
+                fetched_to = buffer.lba + buffer.blocks;
+                hit = hit || pass == 0;
+            }
+        }
+    }
+    for (Buffer& buffer : buffers_) {
+        const bool kept = buffer.lba + buffer.blocks > lba && buffer.lba < fetched_to;
+        if (buffer.state == BufferState::Clean && !kept) {
+            buffer.state = BufferState::Free;
+        } else if (buffer.state == BufferState::Fetching && !kept) {
+            buffer.stale = true;
+        }
+    }
+    if (hit) {
+        read_ahead_hits_++;
+    }
+
+    xfer_lba_ = lba;
+    xfer_end_ = lba + blocks;
+    fetch_lba_ = fetched_to;
+    read_end_ = xfer_end_;
+    reading_ = true;
+    phase_ = Phase::DataIn;
+    return true;
+}
+
+bool USBMassStorage::startWrite(uint32_t lba, uint32_t blocks)
+{
+    if (!isReady()) {
+        fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+        return false;
+    }
+    if (read_only_) {
+        fail(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+        return false;
+    }
+    if (lba >= card_blocks_ || blocks > card_blocks_ - lba) {
+        fail(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+        return false;
+    }
+    if (data_in_ || data_length_ != blocks * BLOCK_SIZE) {
+        status_ = 2;
+        phase_ = Phase::Stalled;
+        stall(data_in_);
+        return false;
+    }
+    if (blocks == 0) {
+        return true;
+    }
+
+    // Read data the write replaces is no longer the card's
+    for (Buffer& buffer : buffers_) {
+        const bool overlaps = buffer.lba < lba + blocks && lba < buffer.lba + buffer.blocks;
+        if (overlaps && buffer.state == BufferState::Clean) {
+            buffer.state = BufferState::Free;
+        } else if (overlaps && buffer.state == BufferState::Fetching) {
+            buffer.stale = true;
+        }
+    }
+
+    xfer_lba_ = lba;
+    xfer_end_ = lba + blocks;
+    reading_ = false;
+    phase_ = Phase::DataOut;
+    return true;
+}
+
+void USBMassStorage::startSync(bool eject)
+{
+    write_back_ = true;
+    phase_ = Phase::WaitCard;
+    if (eject) {
+        ejected_ = true;
+    }
+}
+
+// A block transfer moved its last block
+void USBMassStorage::finishData()
+{
+    if (xfer_lba_ >= xfer_end_) {
+        phase_ = Phase::Status;
+    }
+}
+
+// Record the sense and fail the command; data the host expects is refused
+// with a halt and the status follows once the host clears it
+void USBMassStorage::fail(uint8_t key, uint8_t code)
+{
+    sense_key_ = key;
+    sense_code_ = code;
+    status_ = 1;
+    if (data_length_ > data_moved_) {
+        phase_ = Phase::Stalled;
+        stall(data_in_);
+    } else {
+        phase_ = Phase::Status;
+    }
+}
+
+void USBMassStorage::setReply(uint32_t length)
+{
+    reply_ = reply_data_;
+    reply_length_ = data_length_ < length ? data_length_ : length;
+    if (!data_in_ || reply_length_ == 0) {
+        // The host expects no data (or sends some): nothing goes out
+        reply_ = nullptr;
+        if (data_length_ > 0) {
+            phase_ = Phase::Stalled;
+            if (!data_in_) {
+                status_ = 2;
+            }
+            stall(data_in_);
+        } else {
+            phase_ = Phase::Status;
+        }
+        return;
+    }
+    phase_ = Phase::DataIn;
+}
+
+void USBMassStorage::stall(bool in)
+{
+    USBD_LL_StallEP(device(), in ? USB::DATA_IN_EP : USB::DATA_OUT_EP);
+}
+
+void USBMassStorage::expectCommand()
+{
+    phase_ = Phase::Command;
+    usb_idle_ = false;
+    if (USBD_LL_PrepareReceive(device(), USB::DATA_OUT_EP, command_, max_packet_) != USBD_OK) {
+        usb_idle_ = true;
+    }
+}
+
+void USBMassStorage::sendStatus()
+{
+    const uint32_t residue = data_length_ > data_moved_ ? data_length_ - data_moved_ : 0;
+    writeLE32(status_block_, MSC_CSW_SIGNATURE);
+    writeLE32(status_block_ + 4, tag_);
+    writeLE32(status_block_ + 8, residue);
+    status_block_[12] = status_;
+    usb_idle_ = USBD_LL_Transmit(device(), USB::DATA_IN_EP, status_block_, MSC_CSW_LENGTH) != USBD_OK;
+}
+
+// ===== Transfers =====
+
+void USBMassStorage::startUsb()
+{
+    if (!usb_idle_) {
+        return;
+    }
+    const Phase phase = phase_;
+
+    if (phase == Phase::Command) {
+        expectCommand();  // An arm that failed earlier
+    } else if (phase == Phase::Status) {
+        sendStatus();
+    } else if (phase == Phase::DataIn && reply_ != nullptr) {
+        data_moved_ = reply_length_;
+        usb_idle_ = USBD_LL_Transmit(device(), USB::DATA_IN_EP, const_cast<uint8_t*>(reply_), reply_length_) != USBD_OK;
+    } else if (phase == Phase::DataIn) {
+        // The buffer holding the next block, written back data first
+        if (hasPendingWrites()) {
+            return;
+        }
+        for (uint8_t i = 0; i < 2; ++i) {
+            Buffer& buffer = buffers_[i];
+            if (buffer.state != BufferState::Clean || xfer_lba_ < buffer.lba ||
+                xfer_lba_ >= buffer.lba + buffer.blocks) {
+                continue;
+            }
+            uint32_t blocks = buffer.lba + buffer.blocks - xfer_lba_;
+            if (blocks > xfer_end_ - xfer_lba_) {
+                blocks = xfer_end_ - xfer_lba_;
+            }
+            buffer.state = BufferState::Sending;
+            usb_buffer_ = (int8_t)i;
+            usb_blocks_ = blocks;
+            usb_idle_ = false;
+            uint8_t* data = buffer.data + (xfer_lba_ - buffer.lba) * BLOCK_SIZE;
+            if (USBD_LL_Transmit(device(), USB::DATA_IN_EP, data, blocks * BLOCK_SIZE) != USBD_OK) {
+                buffer.state = BufferState::Clean;
+                usb_buffer_ = -1;
+                usb_idle_ = true;
+            }
+            return;
+        }
+    } else if (phase == Phase::DataOut) {
+        // Combine with the buffer the last write ended in, else take a free one
+        int8_t target = -1;
+        for (uint8_t i = 0; i < 2; ++i) {
+            const Buffer& buffer = buffers_[i];
+            if (buffer.state == BufferState::Dirty && buffer.lba + buffer.blocks == xfer_lba_ &&
+                buffer.blocks < buffer_blocks_ && !write_back_) {
+                target = (int8_t)i;
+            }
+        }
+        for (uint8_t i = 0; i < 2 && target < 0; ++i) {
+            if (buffers_[i].state == BufferState::Free) {
+                buffers_[i].lba = xfer_lba_;
+                buffers_[i].blocks = 0;
+                target = (int8_t)i;
+            }
+        }
+        if (target < 0) {
+            return;  // Both wait for the card; the host is NAKed until one is free
+        }
+
+        Buffer& buffer = buffers_[target];
+        uint32_t blocks = buffer_blocks_ - buffer.blocks;
+        if (blocks > xfer_end_ - xfer_lba_) {
+            blocks = xfer_end_ - xfer_lba_;
+        }
+        buffer.state = BufferState::Filling;
+        usb_buffer_ = target;
+        usb_blocks_ = blocks;
+        usb_idle_ = false;
+        uint8_t* data = buffer.data + buffer.blocks * BLOCK_SIZE;
+        if (USBD_LL_PrepareReceive(device(), USB::DATA_OUT_EP, data, blocks * BLOCK_SIZE) != USBD_OK) {
+            buffer.state = buffer.blocks > 0 ? BufferState::Dirty : BufferState::Free;
+            usb_buffer_ = -1;
+            usb_idle_ = true;
+        }
+    }
+}
+
+// Whether a buffer of write data should go to the card now
+bool USBMassStorage::wantsWriteBack(const Buffer& buffer) const
+{
+    if (buffer.state != BufferState::Dirty) {
+        return false;
+    }
+    if (write_back_ || buffer.blocks >= buffer_blocks_ || phase_ == Phase::DataIn) {
+        return true;
+    }
+    // A write that doesn't continue this buffer, or one that needs its space
+    if (phase_ == Phase::DataOut && buffer.lba + buffer.blocks != xfer_lba_) {
+        return true;
+    }
+    return phase_ != Phase::DataOut && HAL_GetTick() - buffer.written_at >= COMBINE_IDLE_MS;
+}
+
+bool USBMassStorage::hasPendingWrites() const
+{
+    for (const Buffer& buffer : buffers_) {
+        if (buffer.state == BufferState::Dirty || buffer.state == BufferState::Filling ||
+            buffer.state == BufferState::Flushing) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void USBMassStorage::startCard()
+{
+    if (card_buffer_ >= 0 || card_.isBusy()) {
+        return;
+    }
+
+    // Write-back first, so reads see what the host wrote
+    for (uint8_t i = 0; i < 2; ++i) {
+        Buffer& buffer = buffers_[i];
+        if (!wantsWriteBack(buffer)) {
+            continue;
+        }
+        buffer.state = BufferState::Flushing;
+        card_buffer_ = (int8_t)i;
+        if (!card_.writeBlocksAsync(buffer.lba, buffer.data, buffer.blocks,
+                                    [this](bool ok) { onCardComplete(ok); }, buffer.blocks > 1)) {
+            // Still programming the last write; poll() retries
+            buffer.state = BufferState::Dirty;
+            card_buffer_ = -1;
+        }
+        return;
+    }
+
+    // Fetch the running READ's blocks, then read ahead by one buffer
+    if (!reading_ || !isReady() || hasPendingWrites() || fetch_lba_ >= card_blocks_ ||
+        fetch_lba_ >= read_end_ + buffer_blocks_) {
+        return;
+    }
+    for (uint8_t i = 0; i < 2; ++i) {
+        Buffer& buffer = buffers_[i];
+        if (buffer.state != BufferState::Free) {
+            continue;
+        }
+        // Within the command only what it asks for, so a short READ isn't
+        // held up by a full buffer; read-ahead always fills one
+        uint32_t blocks = fetch_lba_ < read_end_ ? read_end_ - fetch_lba_ : buffer_blocks_;
+        if (blocks > buffer_blocks_) {
+            blocks = buffer_blocks_;
+        }
+        if (blocks > card_blocks_ - fetch_lba_) {
+            blocks = card_blocks_ - fetch_lba_;
+        }
+        buffer.lba = fetch_lba_;
+        buffer.blocks = blocks;
+        buffer.stale = false;
+        buffer.state = BufferState::Fetching;
+        card_buffer_ = (int8_t)i;
+        if (card_.readBlocksAsync(buffer.lba, buffer.data, blocks, [this](bool ok) { onCardComplete(ok); })) {
+            fetch_lba_ += blocks;
+        } else {
+            buffer.state = BufferState::Free;
+            card_buffer_ = -1;
+        }
+        return;
+    }
+}
+
+bool USBMassStorage::isReady() const
+{
+    return !ejected_ && card_blocks_ > 0 && card_.isDmaReady();
+}
+
+#endif // HAL_SD_MODULE_ENABLED && LUMOS_USB_CDC
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include "usb.h"
+#include "sd.h"
+
+// USBMassStorage Class - the SD card as a USB drive
+//
+// The device presents itself as a mass storage device (bulk-only
+// transport, SCSI transparent command set), so the host mounts the card's
+// filesystem and logs can be copied off without removing the card.
+//
+// Card transfers run through the SD card's DMA into two buffers while USB
+// moves the other one:
+//   - Reads fetch the requested blocks and then read ahead into the free
+//     buffer, so the next sequential READ finds its data waiting and the
+//     IN endpoint never idles for the card.
+//   - Writes are received straight into a buffer. Consecutive WRITE
+//     commands are combined into it as long as they continue where the
+//     last one ended, and the buffer goes to the card as one multi-block
+//     write once it is full, a write elsewhere comes in, the host
+//     synchronizes or ejects, or no write came for 20 ms. The drive reports
+//     a write cache, so hosts send SYNCHRONIZE CACHE before they consider
+//     data safe.
+//
+// The host's commands are answered from the USB interrupt; poll() starts
+// card transfers that had to wait for the card (e.g. while it programs a
+// write) and ends combining after the idle time, so call it from the main
+// loop. While the host has the drive, the firmware must not access the
+// card itself (e.g. through Filesystem) - after the host ejected the
+// drive isEjected() turns true and the card is free again.
+//
+// Usage Example:
+//   alignas(32) static uint8_t msc_buffers[2 * 64 * 512];  // 2 x 32 KB, DMA-capable
+//   USBMassStorage drive{usb, sdcard, msc_buffers, 64};
+//
+//   sdcard.begin();
+//   sdcard.beginDma(SDMMC1_IRQn);
+//   drive.begin();               // Enumerates as a USB drive instead of CDC
+//
+//   void loop() {
+//       drive.poll();
+//       if (drive.isEjected()) {
+//           drive.end();         // Host is done; log to the card again
+//       }
+//   }
+//
+// Throughput is bound by the USB bus: the H7's embedded PHY runs at full
+// speed, about 1 MB/s for bulk data, which the card easily stays ahead of.
+
+#if defined(HAL_SD_MODULE_ENABLED) && LUMOS_USB_CDC
+
+class USBMassStorage
+{
+public:
+    static constexpr uint32_t BLOCK_SIZE = 512;
+
+    /**
+     * @param usb Device to present the drive on (begin() starts it)
+     * @param card Card with begin() and beginDma() done
+     * @param buffers Storage for both buffers, 2 * buffer_blocks * 512 bytes,
+     *        usable for SD DMA (see SDCard)
+     * @param buffer_blocks Blocks per buffer, at most 64; larger buffers mean
+     *        fewer card commands and longer read-ahead
+     */
+    USBMassStorage(USB& usb, SDCard& card, uint8_t* buffers, uint32_t buffer_blocks);
+
+    /**
+     * @brief Start the USB device as a drive for the card
+     * @param read_only Report the drive write-protected (also when the
+     *        card's switch is set)
+     * @return false if the card or buffers are unusable or USB failed
+     */
+    bool begin(bool read_only = false);
+
+    /**
+     * @brief Write back combined data and stop the USB device
+     */
+    void end();
+
+    // Start card transfers the card was not ready for; call from the main loop
+    void poll();
+
+    /**
+     * @brief Write everything combined so far to the card and wait
+     * @return false on a write error or timeout
+     */
+    bool flush(uint32_t timeout = 5000);
+
+    // The host configured the device
+    bool isConnected() { return usb_.isConnected(); }
+
+    // The host ejected the drive (START STOP UNIT); the card is no longer in use
+    bool isEjected() const { return ejected_; }
+
+    // Data moved for the host since begin()
+    uint64_t getBytesRead() const { return bytes_read_; }
+    uint64_t getBytesWritten() const { return bytes_written_; }
+
+    // READ commands whose first block was already fetched by read-ahead
+    uint32_t getReadAheadHits() const { return read_ahead_hits_; }
+
+    // Card writes since begin(); fewer than WRITE commands when they were combined
+    uint32_t getCardWrites() const { return card_writes_; }
+
+    // Called from the USB class (usb_msc.cpp) in the USB interrupt
+    void onConfigured(uint16_t max_packet);
+    void onDeconfigured();
+    void onReset();
+    void onClearHalt();
+    void onDataIn();
+    void onDataOut(uint32_t length);
+
+private:
+    enum class BufferState : uint8_t {
+        Free,
+        Fetching,       // Card read in flight
+        Clean,          // Holds card data
+        Sending,        // On the IN endpoint
+        Filling,        // Receiving host data on the OUT endpoint
+        Dirty,          // Holds data not yet on the card
+        Flushing        // Card write in flight
+    };
+
+    struct Buffer {
+        uint8_t* data;
+        uint32_t lba;
+        uint32_t blocks;            // Valid blocks from lba
+        volatile BufferState state;
+        bool stale;                 // Fetching data a write has replaced
+        uint32_t written_at;        // Tick of the last data received (Dirty)
+    };
+
+    // Bulk-only transport phase
+    enum class Phase : uint8_t {
+        Command,        // Waiting for a command block wrapper
+        DataIn,
+        DataOut,
+        WaitCard,       // SYNCHRONIZE CACHE or eject waiting for write-back
+        Status,         // Command status wrapper due or on the IN endpoint
+        Stalled,        // Endpoint halted, status due once the host clears it
+        Error           // Invalid command block, until a reset
+    };
+
+    USB& usb_;
+    SDCard& card_;
+    Buffer buffers_[2];
+    uint32_t buffer_blocks_;
+    uint32_t card_blocks_;
+    uint16_t max_packet_;
+    bool read_only_;
+    volatile bool ejected_;
+
+    volatile Phase phase_;
+    uint32_t tag_;                  // Of the command being run
+    uint32_t data_length_;          // Bytes the host expects to move
+    uint32_t data_moved_;
+    bool data_in_;                  // Host expects data from the device
+    uint8_t status_;                // 0 passed, 1 failed, 2 phase error
+
+    // Block transfer of the running READ or WRITE
+    uint32_t xfer_lba_;             // Next block to move over USB
+    uint32_t xfer_end_;
+    int8_t usb_buffer_;             // Buffer on the endpoint, -1 if none
+    uint32_t usb_blocks_;           // Blocks of that endpoint transfer
+    const uint8_t* reply_;          // Small command reply instead of blocks
+    uint32_t reply_length_;
+
+    // Card side
+    int8_t card_buffer_;            // Buffer in a card transfer, -1 if none
+    volatile bool card_done_;
+    volatile bool card_ok_;
+    uint32_t fetch_lba_;            // Next block read-ahead fetches
+    uint32_t read_end_;             // End of the last READ, bounds read-ahead
+    bool reading_;                  // Last block command was a READ
+    bool write_back_;               // SYNCHRONIZE CACHE or eject: flush now
+    bool write_failed_;             // A write-back failed since the last sync
+
+    // Events from the interrupts, handled by pump()
+    volatile bool usb_done_;
+    volatile uint32_t rx_length_;
+    volatile bool usb_idle_;        // No endpoint transfer in flight
+    volatile bool pumping_;
+    volatile bool pump_again_;
+
+    // SCSI sense of the last failed command
+    uint8_t sense_key_;
+    uint8_t sense_code_;
+
+    volatile uint64_t bytes_read_;
+    volatile uint64_t bytes_written_;
+    volatile uint32_t read_ahead_hits_;
+    volatile uint32_t card_writes_;
+
+    alignas(4) uint8_t command_[512];     // Command block wrapper (HS max packet)
+    alignas(4) uint8_t status_block_[16]; // Command status wrapper
+    alignas(4) uint8_t reply_data_[64];
+
+    void pump();
+    void step();
+    void handleCommand(uint32_t length);
+    bool runCommand(const uint8_t* cdb);
+    bool startRead(uint32_t lba, uint32_t blocks);
+    bool startWrite(uint32_t lba, uint32_t blocks);
+    void startSync(bool eject);
+    void finishData();
+    void fail(uint8_t key, uint8_t code);
+    void sendStatus();
+    void expectCommand();
+    void stall(bool in);
+    void startUsb();
+    void startCard();
+    void onCardComplete(bool ok);
+    bool wantsWriteBack(const Buffer& buffer) const;
+    bool hasPendingWrites() const;
+    bool isReady() const;
+    void setReply(uint32_t length);
+    USBD_HandleTypeDef* device() { return usb_.getDevice(); }
+};
+
+#endif // HAL_SD_MODULE_ENABLED && LUMOS_USB_CDC
@@ -0,0 +1,80 @@
+#include "watchdog.h"
+#include "sys.h"
+
+#if defined(IWDG1)
+#define WATCHDOG_INSTANCE IWDG1
+#else
+#define WATCHDOG_INSTANCE IWDG
+#endif
+
+// Key register values
+static constexpr uint32_t IWDG_KEY_RELOAD = 0xAAAA;
+static constexpr uint32_t IWDG_KEY_ENABLE = 0xCCCC;
+static constexpr uint32_t IWDG_KEY_WRITE_ACCESS = 0x5555;
+
+static constexpr uint32_t LSI_HZ = 32000;
+static constexpr uint32_t IWDG_MAX_RELOAD = 0xFFF;
+
+uint32_t Watchdog::timeout_ms_ = 0;
+
+bool Watchdog::start(uint32_t timeout_ms)
+{
+    // Smallest prescaler (/4 to /256, PR 0 to 6) whose reload value fits,
+    // for the finest resolution
+    const uint64_t lsi_ticks = (uint64_t)timeout_ms * LSI_HZ / 1000;
+    uint32_t prescaler = 0;
+    while (prescaler <= 6 && lsi_ticks > (uint64_t)(IWDG_MAX_RELOAD + 1) << (prescaler + 2)) {
+        prescaler++;
+    }
+    const uint32_t reload = (uint32_t)(lsi_ticks >> (prescaler + 2));
+    if (prescaler > 6 || reload == 0) {
+        return false;
+    }
+
+#if defined(__HAL_RCC_DBGMCU_CLK_ENABLE)
+    __HAL_RCC_DBGMCU_CLK_ENABLE();
+#endif
+#if defined(__HAL_DBGMCU_FREEZE_IWDG1)
+    __HAL_DBGMCU_FREEZE_IWDG1();
+#elif defined(__HAL_DBGMCU_FREEZE_IWDG)
+    __HAL_DBGMCU_FREEZE_IWDG();
+#endif
+
+    // Starting also turns the LSI on; the prescaler and reload registers
+    // take a few LSI cycles to update
+    WATCHDOG_INSTANCE->KR = IWDG_KEY_ENABLE;
+    WATCHDOG_INSTANCE->KR = IWDG_KEY_WRITE_ACCESS;
+    WATCHDOG_INSTANCE->PR = prescaler;
+    WATCHDOG_INSTANCE->RLR = reload - 1;
+    const uint32_t begin = HAL_GetTick();
+    while (WATCHDOG_INSTANCE->SR != 0) {
+        if (HAL_GetTick() - begin > 10) {
+            return false;   // LSI not running
+        }
+    }
+    WATCHDOG_INSTANCE->KR = IWDG_KEY_RELOAD;
+
+    timeout_ms_ = (uint32_t)((uint64_t)reload * (4u << prescaler) * 1000 / LSI_HZ);
+    return true;
+}
+
+void Watchdog::feed()
+{
+    if (timeout_ms_ != 0) {
+        WATCHDOG_INSTANCE->KR = IWDG_KEY_RELOAD;
+    }
+}
+
+uint32_t Watchdog::getTimeoutMs()
+{
+    return timeout_ms_;
+}
+
+bool Watchdog::causedLastReset()
+{
+#if defined(RCC_FLAG_IWDG1RST)
+    return __HAL_RCC_GET_FLAG(RCC_FLAG_IWDG1RST) != 0;
+#else
+    return __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) != 0;
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// Independent watchdog (IWDG): resets the board unless fed in time
+// Usage Example:
+//   if (Watchdog::causedLastReset()) {
+//       SerialCom.println("Reset by the watchdog");
+//   }
+//   Watchdog::start(100);             // Reset 100 ms after the last feed
+//
+//   void loop() {
+//       control.step();
+//       Watchdog::feed();
+//   }
+//
+//   // Or let the framework scheduler feed it while its critical apps
+//   // meet their deadlines (framework/scheduler.h)
+//   scheduler.SetWatchdog(Watchdog::feedHandler);
+//
+// The IWDG counts the LSI (about 32 kHz, with a tolerance of several
+// percent between parts and temperatures), so leave margin above the
+// longest gap between feeds. Timeouts run from 1 ms to 32 s. Once started
+// it cannot be stopped or slowed down again until a reset; start() may
+// shorten or lengthen the timeout later. The counter is frozen while a
+// debugger halts the core, so stepping through code does not reset it.
+// The registers are written directly, so this does not need the IWDG HAL
+// module.
+class Watchdog
+{
+public:
+    // Start the watchdog (or change its timeout); false if out of range
+    static bool start(uint32_t timeout_ms);
+
+    // Reload the counter; nothing happens before start()
+    static void feed();
+
+    // Timeout as programmed (0 before start())
+    static uint32_t getTimeoutMs();
+
+    // The reset flag is kept until something clears the RCC reset flags
+    static bool causedLastReset();
+
+    // feed() with the callback signature Scheduler::SetWatchdog() takes
+    static void feedHandler(void* context)
+    {
+        (void)context;
+        feed();
+    }
+
+private:
+    static uint32_t timeout_ms_;
+};
@@ -1,6 +1,7 @@
 """
 Pytest configuration and fixtures for Lumos system tests
 """
+import json
 import os
 import sys
 import pytest
@@ -10,6 +11,19 @@ import shutil
 from pathlib import Path
 
 
+DEFAULT_PERF_BASELINE = Path(__file__).parent / "perf_baseline.json"
+
+
+def pytest_addoption(parser):
+    group = parser.getgroup("lumos performance")
+    group.addoption("--perf-baseline", default=str(DEFAULT_PERF_BASELINE),
+                    help="Baseline the performance tests compare against")
+    group.addoption("--update-perf-baseline", action="store_true",
+                    help="Write the measured values to the baseline instead of failing on regressions")
+    group.addoption("--perf-output", default=None,
+                    help="Also write every measured value to this JSON file")
+
+
 @pytest.fixture
 def lumos_root():
     """Get the Lumos repository root directory"""
@@ -31,6 +45,95 @@ def lumos_binary(lumos_root):
     return binary_path
 
 
+@pytest.fixture
+def lumos_bench_binary(lumos_root):
+    """Get path to the lumos_bench binary (configured with -DLUMOS_BUILD_BENCHMARKS=ON)"""
+    binary_path = lumos_root / "build" / "src" / "applications" / "lumos_simple" / "lumos_bench"
+
+    if not binary_path.exists():
+        pytest.skip(f"lumos_bench binary not found at {binary_path}. "
+                    "Configure with -DLUMOS_BUILD_BENCHMARKS=ON and build it first.")
+
+    return binary_path
+
+
+class PerfBaseline:
+    """
+    Measured values checked against perf_baseline.json
+
+    A value regresses when it is worse than the baseline by more than the
+    metric's threshold_percent plus its absolute slack (which keeps short
+    timings from failing on scheduler noise). Metrics missing from the
+    baseline are only recorded; --update-perf-baseline writes them, and
+    all others, with default thresholds.
+    """
+
+    # Defaults for new metrics, by unit: (threshold_percent, slack)
+    DEFAULTS = {
+        "s": (100.0, 0.05),
+        "bytes": (2.0, 256),
+        "bytes_per_second": (50.0, 0),
+    }
+
+    def __init__(self, path, update):
+        self.path = Path(path)
+        self.update = update
+        self.results = {}
+        self.metrics = {}
+        if self.path.exists():
+            with open(self.path) as f:
+                self.metrics = json.load(f).get("metrics", {})
+
+    def check(self, name, value, unit):
+        """Record @p value; returns a message if it regressed, else None"""
+        higher_is_better = unit == "bytes_per_second"
+        self.results[name] = {"value": value, "unit": unit}
+
+        baseline = self.metrics.get(name)
+        if baseline is None or self.update:
+            return None
+
+        threshold = baseline.get("threshold_percent", self.DEFAULTS[unit][0])
+        slack = baseline.get("slack", self.DEFAULTS[unit][1])
+        before = baseline["value"]
+        if higher_is_better:
+            limit = before * (1 - threshold / 100.0) - slack
+            regressed = value < limit
+        else:
+            limit = before * (1 + threshold / 100.0) + slack
+            regressed = value > limit
+        if not regressed:
+            return None
+        return (f"{name} regressed: {value:g} {unit} against a baseline of {before:g} "
+                f"(limit {limit:g}, threshold {threshold:g}%)")
+
+    def finish(self, output):
+        if output:
+            with open(output, "w") as f:
+                json.dump({"results": self.results}, f, indent=2, sort_keys=True)
+                f.write("\n")
+        if not self.update or not self.results:
+            return
+
+        for name, result in self.results.items():
+            threshold, slack = self.DEFAULTS[result["unit"]]
+            entry = self.metrics.setdefault(name, {"threshold_percent": threshold, "slack": slack})
+            entry["value"] = result["value"]
+            entry["unit"] = result["unit"]
+        with open(self.path, "w") as f:
+            json.dump({"metrics": self.metrics}, f, indent=2, sort_keys=True)
+            f.write("\n")
+
+
+@pytest.fixture(scope="session")
+def perf(request):
+    """Checks measured values against the performance baseline"""
+    baseline = PerfBaseline(request.config.getoption("--perf-baseline"),
+                            request.config.getoption("--update-perf-baseline"))
+    yield baseline
+    baseline.finish(request.config.getoption("--perf-output"))
+
+
 @pytest.fixture
 def temp_project_dir(tmp_path):
     """Create a temporary directory for project testing"""
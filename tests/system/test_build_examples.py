@@ -0,0 +1,69 @@
+"""
+System tests for 'lumos build' on the example projects
+
+Each example is copied to a temporary directory and built twice: a clean
+build without the shared object cache, then a build with nothing to do.
+The clean and no-op build times and the size of firmware.bin are checked
+against perf_baseline.json (see conftest.PerfBaseline).
+
+The examples target the boards, so these tests need an arm-none-eabi
+toolchain and are skipped without one.
+"""
+import re
+import shutil
+import time
+
+import pytest
+
+
+EXAMPLES = [
+    "example_adc",
+    "example_i2c",
+    "example_micro_brain",
+    "example_sdcard",
+    "example_simple",
+    "example_spi",
+    "example_timer",
+    "example_uart",
+    "example_usb",
+    "multi_can_network/device_node",
+    "multi_can_network/device_reader",
+]
+
+NO_TOOLCHAIN = "No arm-none-eabi toolchain found"
+
+
+def build(run_lumos, timeout=600):
+    """Run 'lumos build' in the current directory; returns (result, seconds)"""
+    start = time.monotonic()
+    result = run_lumos(["build", "--no-cache", "--no-daemon"], check=False, timeout=timeout)
+    seconds = time.monotonic() - start
+    if NO_TOOLCHAIN in result.stdout + result.stderr:
+        pytest.skip("arm-none-eabi toolchain not installed")
+    return result, seconds
+
+
+@pytest.mark.parametrize("example", EXAMPLES)
+def test_example_builds(example, lumos_root, temp_project_dir, run_lumos, perf):
+    """Clean and no-op build of an example, with image size"""
+    shutil.copytree(lumos_root / "examples" / example, temp_project_dir, dirs_exist_ok=True)
+    shutil.rmtree(temp_project_dir / "build", ignore_errors=True)
+
+    result, clean_seconds = build(run_lumos)
+    assert result.returncode == 0, result.stdout + result.stderr
+    image = temp_project_dir / "build" / "firmware.bin"
+    assert image.exists()
+
+    result, noop_seconds = build(run_lumos)
+    assert result.returncode == 0, result.stdout + result.stderr
+    up_to_date = re.search(r"(\d+) of (\d+) objects up to date", result.stdout)
+    assert up_to_date and up_to_date.group(1) == up_to_date.group(2), result.stdout
+
+    name = "build/" + example
+    regressions = [
+        perf.check(name + "/clean_s", round(clean_seconds, 3), "s"),
+        perf.check(name + "/noop_s", round(noop_seconds, 3), "s"),
+        perf.check(name + "/image_bytes", image.stat().st_size, "bytes"),
+    ]
+    regressions = [message for message in regressions if message]
+    assert not regressions, "\n".join(regressions)
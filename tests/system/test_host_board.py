@@ -0,0 +1,245 @@
+"""
+System tests that run firmware code on the Host board
+
+Each test writes a small project with 'board: Host', builds it with
+'lumos build' into a native build/firmware and runs it. setup() prints
+its results through SerialCom, which is stdout on the host, and the test
+compares them with what Python computes for the same input. No ARM
+toolchain is needed, only the host's g++.
+"""
+import shutil
+import subprocess
+import textwrap
+import zlib
+
+import pytest
+
+
+PROJECT_YAML = "board: Host\nsources:\n{sources}"
+
+# setup() prints, loop() only lets the simulated clock run out
+MAIN_TEMPLATE = """\
+#include "host.h"
+{includes}
+{body}
+
+void loop()
+{{
+    DelayMs(1000);
+}}
+"""
+
+
+def run_host_project(project_dir, run_lumos, body, includes=(), sources=()):
+    """Build a Host board project around @p body; returns its output lines"""
+    all_sources = ["main.cpp"] + list(sources)
+    (project_dir / "project.yaml").write_text(
+        PROJECT_YAML.format(sources="".join(f"  - {source}\n" for source in all_sources)))
+    (project_dir / "main.cpp").write_text(MAIN_TEMPLATE.format(
+        includes="".join(f'#include "{include}"\n' for include in includes),
+        body=textwrap.dedent(body)))
+
+    result = run_lumos(["build", "--no-daemon"], check=False, timeout=300)
+    assert result.returncode == 0, result.stdout + result.stderr
+
+    firmware = subprocess.run([str(project_dir / "build" / "firmware"), "--duration", "1"],
+                              capture_output=True, text=True, timeout=60, check=False)
+    assert firmware.returncode == 0, firmware.stdout + firmware.stderr
+    return firmware.stdout.splitlines()
+
+
+class TestFormat:
+    """Serial printf() (wrapper/format.h) against Python's % formatting"""
+
+    CASES = [
+        ("[%d|%i|%u|%x|%X|%o|%c|%s|%%]",
+         '-42, 7, 4000000000u, 0xbeefu, 0xbeefu, 8u, \'z\', "text"',
+         (-42, 7, 4000000000, 0xbeef, 0xbeef, 8, "z", "text")),
+        ("[%08x|%-6s|%6d|%-5d|%05d]",
+         '0x1234u, "ab", -17, 3, -42',
+         (0x1234, "ab", -17, 3, -42)),
+        ("[%.3f|%f|%8.2f|%.0f|%-7.1f]",
+         "3.14159, -2.5, 12.346, 9.0, 0.27",
+         (3.14159, -2.5, 12.346, 9.0, 0.27)),
+        ("[%d|%u|%x]",
+         "-2147483647 - 1, 0u, 0xffffffffu",
+         (-2147483648, 0, 0xffffffff)),
+    ]
+
+    def test_printf(self, temp_project_dir, run_lumos):
+        """printf() specifiers, flags, width and precision"""
+        calls = "".join(f'    SerialCom.printf("{fmt}\\n", {args});\n' for fmt, args, _ in self.CASES)
+        body = "void setup()\n{\n    SerialCom.begin(115200);\n" + calls + "}\n"
+        lines = run_host_project(temp_project_dir, run_lumos, body)
+        assert lines == [fmt % values for fmt, _, values in self.CASES]
+
+    def test_print_base(self, temp_project_dir, run_lumos):
+        """print()/println() with a base"""
+        body = """\
+        void setup()
+        {
+            SerialCom.begin(115200);
+            SerialCom.print(255, 16);
+            SerialCom.print(" ");
+            SerialCom.print(-255);
+            SerialCom.print(" ");
+            SerialCom.println(5, 2);
+        }
+        """
+        lines = run_host_project(temp_project_dir, run_lumos, body)
+        assert lines == ["ff -255 101"]
+
+
+class TestCrc32:
+    """The flash verify Crc32() (modules/serial/crc32.cpp) against zlib"""
+
+    LENGTHS = [0, 1, 7, 8, 9, 63, 64, 65, 1000, 4099]
+
+    @staticmethod
+    def pattern(length):
+        return bytes((i * 7 + (i >> 8)) & 0xFF for i in range(length))
+
+    def test_crc32_matches_zlib(self, lumos_root, temp_project_dir, run_lumos):
+        """Whole buffers around the 8-byte slices, and continued CRCs"""
+        shutil.copy(lumos_root / "src" / "modules" / "serial" / "crc32.cpp", temp_project_dir)
+        body = """\
+        static uint8_t data[4099];
+        static const size_t lengths[] = {%s};
+
+        void setup()
+        {
+            for (size_t i = 0; i < sizeof(data); i++) {
+                data[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+            }
+            SerialCom.begin(115200);
+            for (size_t length : lengths) {
+                const size_t split = length / 3;
+                const uint32_t whole = SimpleSerial::Crc32(data, length);
+                const uint32_t continued = SimpleSerial::Crc32(data + split, length - split,
+                                                               SimpleSerial::Crc32(data, split));
+                SerialCom.printf("%%08x %%08x\\n", whole, continued);
+            }
+        }
+        """ % ", ".join(str(length) for length in self.LENGTHS)
+        lines = run_host_project(temp_project_dir, run_lumos, body,
+                                 includes=["crc32.h"], sources=["crc32.cpp"])
+
+        data = self.pattern(max(self.LENGTHS))
+        expected = ["%08x %08x" % ((zlib.crc32(data[:length]),) * 2) for length in self.LENGTHS]
+        assert lines == expected
+
+
+class TestLockFree:
+    """SpscQueue, MpscQueue and SeqLockTopic (framework/lockfree.h) across threads"""
+
+    BODY = """\
+    #include <atomic>
+    #include <thread>
+    #include <vector>
+
+    using namespace Lumos;
+
+    static const uint32_t kItems = 200000;
+    static const uint32_t kProducers = 4;
+
+    // Every item arrives once and in order
+    static bool checkSpsc()
+    {
+        static SpscQueue<uint32_t, 64> queue;
+        std::thread producer([] {
+            for (uint32_t i = 0; i < kItems; i++) {
+                while (!queue.Push(i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        bool ok = true;
+        for (uint32_t expected = 0; expected < kItems;) {
+            uint32_t item;
+            if (!queue.Pop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            ok = ok && item == expected;
+            expected++;
+        }
+        producer.join();
+        return ok && queue.Empty();
+    }
+
+    // Every item arrives once, each producer's in its order
+    static bool checkMpsc()
+    {
+        static MpscQueue<uint32_t, 64> queue;
+        std::vector<std::thread> producers;
+        for (uint32_t p = 0; p < kProducers; p++) {
+            producers.emplace_back([p] {
+                for (uint32_t i = 0; i < kItems; i++) {
+                    while (!queue.Push(p << 24 | i)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        uint32_t next[kProducers] = {};
+        bool ok = true;
+        for (uint32_t received = 0; received < kItems * kProducers;) {
+            uint32_t item;
+            if (!queue.Pop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            const uint32_t p = item >> 24;
+            ok = ok && p < kProducers && (item & 0xFFFFFF) == next[p];
+            next[p] = (item & 0xFFFFFF) + 1;
+            received++;
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+        return ok && queue.Empty();
+    }
+
+    // A reader never gets parts of two different writes
+    static bool checkSeqLock()
+    {
+        struct Sample {
+            uint32_t value;
+            uint32_t inverse;
+            uint32_t copies[6];
+        };
+        static SeqLockTopic<Sample> topic;
+        static std::atomic<bool> done{false};
+        std::thread writer([] {
+            for (uint32_t i = 1; i <= kItems; i++) {
+                topic.Publish(Sample{i, ~i, {i, i, i, i, i, i}});
+            }
+            done = true;
+        });
+        bool ok = true;
+        uint32_t last = 0;
+        while (!done) {
+            Sample sample;
+            if (topic.Read(sample)) {
+                ok = ok && sample.inverse == ~sample.value && sample.copies[5] == sample.value &&
+                     sample.value >= last;
+                last = sample.value;
+            }
+        }
+        writer.join();
+        return ok && topic.GetSequence() == kItems;
+    }
+
+    void setup()
+    {
+        SerialCom.begin(115200);
+        SerialCom.printf("spsc %s\\n", checkSpsc() ? "ok" : "failed");
+        SerialCom.printf("mpsc %s\\n", checkMpsc() ? "ok" : "failed");
+        SerialCom.printf("seqlock %s\\n", checkSeqLock() ? "ok" : "failed");
+    }
+    """
+
+    def test_queues_and_topic(self, temp_project_dir, run_lumos):
+        """Producer and consumer threads; items are counted and checked for order"""
+        lines = run_host_project(temp_project_dir, run_lumos, self.BODY, includes=["lockfree.h"])
+        assert lines == ["spsc ok", "mpsc ok", "seqlock ok"]
@@ -0,0 +1,70 @@
+"""
+System tests for build, flash and monitor throughput
+
+These run lumos_bench (src/applications/lumos_simple/benchmarks), which
+flashes against the bootloader emulators on a pseudo-terminal, and check
+its results against perf_baseline.json (see conftest.PerfBaseline):
+
+- flash/*: both bootloader protocols with the emulators paced at the
+  line rate (--line-rate), so the times follow from the protocol and the
+  baud rate rather than the machine, and the thresholds can be tight
+- monitor/stm32: bytes per second through the monitor reader, unpaced,
+  as the line rate would take minutes for the 16 MiB it reads
+- build/*: the Builder on a generated Host board project, so no ARM
+  toolchain is needed
+
+lumos_bench must be built (-DLUMOS_BUILD_BENCHMARKS=ON); POSIX only.
+"""
+import json
+import subprocess
+
+import pytest
+
+
+def run_bench(lumos_bench_binary, tmp_path, args, timeout):
+    output = tmp_path / "bench.json"
+    result = subprocess.run([str(lumos_bench_binary)] + args + ["-o", str(output)],
+                            capture_output=True, text=True, timeout=timeout, check=False)
+    assert output.exists(), result.stdout + result.stderr
+    with open(output) as f:
+        results = json.load(f)["results"]
+    errors = [f"{r['name']}: {r['error']}" for r in results if "error" in r]
+    assert not errors, "\n".join(errors)
+    return results
+
+
+def check_results(perf, results, rate=False):
+    regressions = []
+    for result in results:
+        if rate:
+            message = perf.check(result["name"], result["bytes_per_second"], "bytes_per_second")
+        else:
+            message = perf.check(result["name"], round(result["min_s"], 4), "s")
+        if message:
+            regressions.append(message)
+    assert not regressions, "\n".join(regressions)
+
+
+def test_flash_throughput(lumos_bench_binary, tmp_path, perf):
+    """Flash times of a 16 KiB image at the line rate"""
+    results = run_bench(lumos_bench_binary, tmp_path,
+                        ["--filter", "flash/", "--line-rate", "--image-kb", "16", "--repetitions", "2"],
+                        timeout=300)
+    assert results
+    check_results(perf, results)
+
+
+def test_monitor_throughput(lumos_bench_binary, tmp_path, perf):
+    """Bytes per second through the monitor reader"""
+    results = run_bench(lumos_bench_binary, tmp_path,
+                        ["--filter", "monitor/", "--repetitions", "3"], timeout=120)
+    assert results
+    check_results(perf, results, rate=True)
+
+
+def test_build_throughput(lumos_bench_binary, tmp_path, perf):
+    """Clean, cached and no-op builds of a Host board project"""
+    results = run_bench(lumos_bench_binary, tmp_path,
+                        ["--filter", "build/", "--repetitions", "3"], timeout=600)
+    assert results
+    check_results(perf, results)